@@ -242,3 +242,188 @@ Finished:
     // TODO Wire up when Rollback CA's are wired up
     return (SUCCEEDED(hr)) ? ERROR_SUCCESS : ERROR_SUCCESS;
 }
+
+//
+// aspnetcorev2.dll is installed side by side in the version folder of its
+// release, next to its request handler, so that an upgrade never replaces
+// the file a worker process has loaded. Upgrades keep the globalModules
+// entry of the previous release, this switches its image to the new file:
+// the worker processes started after the change load it, while the ones
+// running keep the previous file until they recycle. The previous file
+// stays where it is.
+//
+// CustomActionData is the path of the new aspnetcorev2.dll.
+//
+UINT
+WINAPI
+SwitchGlobalModuleImageCA(
+    MSIHANDLE hInstall
+)
+{
+    HRESULT         hr = S_OK;
+    BOOL            fComInitialized = FALSE;
+    DWORD           dwIndex = 0;
+    STRU            strImage;
+    STRU            strFinalImage;
+    STRU            strCurrentImage;
+    WCHAR           ProgFiles[MAX_PATH];
+    DWORD           cchProgFiles = 0;
+    VARIANT         vtIndex;
+    CComPtr<IAppHostWritableAdminManager>   pAdminMgr;
+    CComPtr<IAppHostElement>                pGlobalModulesSection;
+    CComPtr<IAppHostElementCollection>      pGlobalModulesCollection;
+    CComPtr<IAppHostElement>                pModuleElement;
+
+    IISLogInitialize(hInstall, UNITEXT(__FUNCTION__));
+
+    hr = MsiUtilGetProperty( hInstall, L"CustomActionData", &strImage );
+    if ( FAILED( hr ) )
+    {
+        DBGERROR_HR(hr);
+        goto Finished;
+    }
+
+    //
+    // Written like InstallModule does, for the WOW64 worker processes to
+    // load the copy in their own program files folder.
+    //
+    cchProgFiles = GetEnvironmentVariable( L"ProgramFiles",
+                                           ProgFiles,
+                                           _countof(ProgFiles) );
+    if ( cchProgFiles == 0 || cchProgFiles >= _countof(ProgFiles) )
+    {
+        hr = E_UNEXPECTED;
+        DBGERROR_HR(hr);
+        goto Finished;
+    }
+
+    if ( _wcsnicmp( strImage.QueryStr(), ProgFiles, cchProgFiles ) == 0 )
+    {
+        if ( FAILED( hr = strFinalImage.Copy( L"%ProgramFiles%" ) ) ||
+             FAILED( hr = strFinalImage.Append( strImage.QueryStr() + cchProgFiles ) ) )
+        {
+            DBGERROR_HR(hr);
+            goto Finished;
+        }
+    }
+    else if ( FAILED( hr = strFinalImage.Copy( strImage.QueryStr() ) ) )
+    {
+        DBGERROR_HR(hr);
+        goto Finished;
+    }
+
+    hr = CoInitializeEx( NULL, COINIT_MULTITHREADED );
+    if ( FAILED( hr ) )
+    {
+        DBGERROR_HR(hr);
+        goto Finished;
+    }
+    fComInitialized = TRUE;
+
+    hr = GetConfigAdminManager( FALSE, &pAdminMgr );
+    if ( FAILED( hr ) )
+    {
+        DBGERROR_HR(hr);
+        goto Finished;
+    }
+
+    hr = pAdminMgr->GetAdminSection( CComBSTR( L"system.webServer/globalModules" ),
+                                     CComBSTR( L"MACHINE/WEBROOT/APPHOST" ),
+                                     &pGlobalModulesSection );
+    if ( FAILED( hr ) )
+    {
+        DBGERROR_HR(hr);
+        goto Finished;
+    }
+
+    hr = pGlobalModulesSection->get_Collection( &pGlobalModulesCollection );
+    if ( FAILED( hr ) )
+    {
+        DBGERROR_HR(hr);
+        goto Finished;
+    }
+
+    hr = FindElementInCollection( pGlobalModulesCollection,
+                                  L"name",
+                                  L"AspNetCoreModuleV2",
+                                  FIND_ELEMENT_CASE_SENSITIVE,
+                                  &dwIndex );
+    if ( FAILED( hr ) )
+    {
+        DBGERROR_HR(hr);
+        goto Finished;
+    }
+
+    if ( hr == S_FALSE )
+    {
+        //
+        // Not an upgrade, the module is registered by IISExecuteCA.
+        //
+        hr = S_OK;
+        goto Finished;
+    }
+
+    vtIndex.vt = VT_UI4;
+    vtIndex.ulVal = dwIndex;
+
+    hr = pGlobalModulesCollection->get_Item( vtIndex, &pModuleElement );
+    if ( FAILED( hr ) )
+    {
+        DBGERROR_HR(hr);
+        goto Finished;
+    }
+
+    hr = GetElementStringProperty( pModuleElement, L"image", &strCurrentImage );
+    if ( FAILED( hr ) )
+    {
+        DBGERROR_HR(hr);
+        goto Finished;
+    }
+
+    if ( _wcsicmp( strCurrentImage.QueryStr(), strFinalImage.QueryStr() ) == 0 )
+    {
+        goto Finished;
+    }
+
+    hr = SetElementStringProperty( pModuleElement, L"image", strFinalImage.QueryStr() );
+    if ( FAILED( hr ) )
+    {
+        DBGERROR_HR(hr);
+        goto Finished;
+    }
+
+    hr = CommitConfigChanges( pAdminMgr );
+    if ( FAILED( hr ) )
+    {
+        DBGERROR_HR(hr);
+        goto Finished;
+    }
+
+    IISLogWrite(SETUP_LOG_SEVERITY_INFORMATION,
+                L"Switched the image of AspNetCoreModuleV2 from '%s' to '%s'",
+                strCurrentImage.QueryStr(),
+                strFinalImage.QueryStr() );
+
+Finished:
+
+    pModuleElement.Release();
+    pGlobalModulesCollection.Release();
+    pGlobalModulesSection.Release();
+    pAdminMgr.Release();
+
+    if ( fComInitialized )
+    {
+        CoUninitialize();
+    }
+
+    if ( FAILED( hr ) )
+    {
+        IISLogWrite(SETUP_LOG_SEVERITY_ERROR,
+                    L"Failed to switch the image of AspNetCoreModuleV2 hr=0x%x",
+                    hr );
+    }
+
+    IISLogClose();
+
+    return SUCCEEDED(hr) ? ERROR_SUCCESS : ERROR_INSTALL_FAILURE;
+}
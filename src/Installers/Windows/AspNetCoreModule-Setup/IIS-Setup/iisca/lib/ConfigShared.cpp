@@ -57,3 +57,182 @@ exit:
     return hr;
 }        
 
+
+//
+// Shared admin managers of the open config transaction, indexed by
+// fAdminConfig.
+//
+static BOOL                             g_fConfigTransaction = FALSE;
+static IAppHostWritableAdminManager *   g_rgpConfigAdminMgr[2] = { NULL, NULL };
+static BOOL                             g_rgfConfigChanged[2] = { FALSE, FALSE };
+
+static
+HRESULT
+CommitSharedAdminManagers(
+    IN  BOOL            fCommit
+    )
+{
+    HRESULT hr = S_OK;
+    HRESULT hrCommit;
+
+    for ( DWORD i = 0; i < _countof( g_rgpConfigAdminMgr ); i++ )
+    {
+        if ( g_rgpConfigAdminMgr[i] == NULL )
+        {
+            continue;
+        }
+
+        if ( fCommit && g_rgfConfigChanged[i] )
+        {
+            hrCommit = g_rgpConfigAdminMgr[i]->CommitChanges();
+            if ( FAILED(hrCommit) )
+            {
+                DBGERROR_HR(hrCommit);
+                if ( SUCCEEDED(hr) )
+                {
+                    hr = hrCommit;
+                }
+            }
+        }
+
+        g_rgpConfigAdminMgr[i]->Release();
+        g_rgpConfigAdminMgr[i] = NULL;
+        g_rgfConfigChanged[i] = FALSE;
+    }
+
+    return hr;
+}
+
+HRESULT
+BeginConfigTransaction(
+    VOID
+    )
+{
+    g_fConfigTransaction = TRUE;
+    return S_OK;
+}
+
+HRESULT
+EndConfigTransaction(
+    IN  BOOL            fCommit
+    )
+{
+    HRESULT hr = S_OK;
+
+    if ( !g_fConfigTransaction )
+    {
+        goto exit;
+    }
+
+    hr = CommitSharedAdminManagers( fCommit );
+    if ( FAILED(hr) )
+    {
+        IISLogWrite(SETUP_LOG_SEVERITY_ERROR,
+                    L"Committing the IIS configuration failed 0x%08x", hr);
+    }
+    else if ( !fCommit )
+    {
+        IISLogWrite(SETUP_LOG_SEVERITY_INFORMATION,
+                    L"IIS configuration changes discarded.");
+    }
+
+    g_fConfigTransaction = FALSE;
+
+exit:
+    return hr;
+}
+
+HRESULT
+FlushConfigTransaction(
+    VOID
+    )
+{
+    if ( !g_fConfigTransaction )
+    {
+        return S_OK;
+    }
+
+    return CommitSharedAdminManagers( TRUE );
+}
+
+HRESULT
+GetConfigAdminManager(
+    IN  BOOL                            fAdminConfig,
+    OUT IAppHostWritableAdminManager ** ppAdminMgr
+    )
+{
+    HRESULT hr = S_OK;
+    CComPtr<IAppHostWritableAdminManager>   pAdminMgr;
+    CONST DWORD                             i = fAdminConfig ? 1 : 0;
+
+    *ppAdminMgr = NULL;
+
+    if ( g_fConfigTransaction && g_rgpConfigAdminMgr[i] != NULL )
+    {
+        g_rgpConfigAdminMgr[i]->AddRef();
+        *ppAdminMgr = g_rgpConfigAdminMgr[i];
+        goto exit;
+    }
+
+    hr = CoCreateInstance( __uuidof( AppHostWritableAdminManager ),
+                           NULL,
+                           CLSCTX_INPROC_SERVER,
+                           __uuidof( IAppHostWritableAdminManager ),
+                           (VOID **)&pAdminMgr );
+    if ( FAILED(hr) )
+    {
+        DBGERROR_HR(hr);
+        goto exit;
+    }
+
+    if ( fAdminConfig )
+    {
+        hr = InitAdminMgrForAdminConfig( pAdminMgr, L"MACHINE/WEBROOT" );
+        if ( FAILED(hr) )
+        {
+            DBGERROR_HR(hr);
+            goto exit;
+        }
+    }
+
+    if ( g_fConfigTransaction )
+    {
+        g_rgpConfigAdminMgr[i] = pAdminMgr;
+        g_rgpConfigAdminMgr[i]->AddRef();
+    }
+
+    *ppAdminMgr = pAdminMgr.Detach();
+
+exit:
+    return hr;
+}
+
+HRESULT
+CommitConfigChanges(
+    IN  IAppHostWritableAdminManager *  pAdminMgr
+    )
+{
+    HRESULT hr = S_OK;
+
+    if ( g_fConfigTransaction )
+    {
+        for ( DWORD i = 0; i < _countof( g_rgpConfigAdminMgr ); i++ )
+        {
+            if ( g_rgpConfigAdminMgr[i] == pAdminMgr )
+            {
+                g_rgfConfigChanged[i] = TRUE;
+                goto exit;
+            }
+        }
+    }
+
+    hr = pAdminMgr->CommitChanges();
+    if ( FAILED(hr) )
+    {
+        DBGERROR_HR(hr);
+        goto exit;
+    }
+
+exit:
+    return hr;
+}
@@ -6,3 +6,49 @@ CheckInstallToSharedConfig(
     IN  MSIHANDLE           hInstall,
         BOOL *              pbShouldInstall
     );
+
+//
+// Config transaction of an IISExecuteCA run. While it is open the execute
+// CAs share one admin manager per config file, and CommitConfigChanges only
+// marks it changed: each file is written once when the transaction ends,
+// and not at all when no CA changed it.
+//
+HRESULT
+BeginConfigTransaction(
+    VOID
+    );
+
+HRESULT
+EndConfigTransaction(
+    IN  BOOL                            fCommit
+    );
+
+//
+// Writes the changes made so far and drops the shared admin managers, for
+// edits that the next ones have to observe as committed, such as a new
+// section definition.
+//
+HRESULT
+FlushConfigTransaction(
+    VOID
+    );
+
+//
+// Referenced admin manager for applicationHost.config, or for
+// administration.config when fAdminConfig is set. Outside of a
+// transaction it is a new one.
+//
+HRESULT
+GetConfigAdminManager(
+    IN  BOOL                            fAdminConfig,
+    OUT IAppHostWritableAdminManager ** ppAdminMgr
+    );
+
+//
+// Commits the changes made through pAdminMgr, or marks them for the end
+// of the transaction.
+//
+HRESULT
+CommitConfigChanges(
+    IN  IAppHostWritableAdminManager *  pAdminMgr
+    );
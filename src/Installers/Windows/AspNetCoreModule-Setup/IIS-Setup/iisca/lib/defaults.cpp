@@ -510,11 +510,7 @@ ResetConfigSectionFromResource(
         goto exit;
     }
 
-    hr = CoCreateInstance( __uuidof( AppHostWritableAdminManager ),
-                           NULL,
-                           CLSCTX_INPROC_SERVER,
-                           __uuidof( IAppHostWritableAdminManager ),
-                           (VOID **)&pAdminMgr );
+    hr = GetConfigAdminManager( FALSE, &pAdminMgr );
     if( FAILED(hr) )
     {
         DBGERROR_HR(hr);
@@ -534,7 +530,7 @@ ResetConfigSectionFromResource(
     // Save
     //
 
-    hr = pAdminMgr->CommitChanges();
+    hr = CommitConfigChanges( pAdminMgr );
     if( FAILED(hr) )
     {
         DBGERROR_HR(hr);
@@ -569,11 +565,7 @@ ResetConfigSectionFromFile(
         goto exit;
     }
 
-    hr = CoCreateInstance( __uuidof( AppHostWritableAdminManager ),
-                           NULL,
-                           CLSCTX_INPROC_SERVER,
-                           __uuidof( IAppHostWritableAdminManager ),
-                           (VOID **)&pAdminMgr );
+    hr = GetConfigAdminManager( FALSE, &pAdminMgr );
     if( FAILED(hr) )
     {
         DBGERROR_HR(hr);
@@ -593,7 +585,7 @@ ResetConfigSectionFromFile(
     // Save
     //
 
-    hr = pAdminMgr->CommitChanges();
+    hr = CommitConfigChanges( pAdminMgr );
     if( FAILED(hr) )
     {
         DBGERROR_HR(hr);
@@ -628,11 +620,7 @@ AppendConfigSectionFromFile(
         goto exit;
     }
 
-    hr = CoCreateInstance( __uuidof( AppHostWritableAdminManager ),
-                           NULL,
-                           CLSCTX_INPROC_SERVER,
-                           __uuidof( IAppHostWritableAdminManager ),
-                           (VOID **)&pAdminMgr );
+    hr = GetConfigAdminManager( FALSE, &pAdminMgr );
     if( FAILED(hr) )
     {
         DBGERROR_HR(hr);
@@ -652,7 +640,7 @@ AppendConfigSectionFromFile(
     // Save
     //
 
-    hr = pAdminMgr->CommitChanges();
+    hr = CommitConfigChanges( pAdminMgr );
     if( FAILED(hr) )
     {
         DBGERROR_HR(hr);
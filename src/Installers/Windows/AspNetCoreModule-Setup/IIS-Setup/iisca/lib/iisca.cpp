@@ -2968,15 +2968,11 @@ ExecuteInstallHandlerCA(
     CComPtr<IAppHostWritableAdminManager>   pAdminMgr;
 
     
-    hr = CoCreateInstance(__uuidof(AppHostWritableAdminManager),
-                          NULL,
-                          CLSCTX_INPROC_SERVER,
-                          __uuidof(IAppHostWritableAdminManager),
-                          (VOID **)&pAdminMgr);
+    hr = GetConfigAdminManager(FALSE, &pAdminMgr);
     if (FAILED(hr))
     {
         IISLogWrite(SETUP_LOG_SEVERITY_ERROR, 
-                    L"CoCreateInstance failed 0x%08x", hr);
+                    L"GetConfigAdminManager failed 0x%08x", hr);
         DBGERROR_HR(hr);
         goto exit;
     } 
@@ -3083,13 +3079,15 @@ ExecuteInstallHandlerCA(
     if ( hr == HRESULT_FROM_WIN32( ERROR_ALREADY_EXISTS ) )
     {
         //
-        // We'll quietly accept a handler already exists.
+        // We'll quietly accept a handler already exists,
+        // nothing changed so there is nothing to commit.
         //
         IISLogWrite(SETUP_LOG_SEVERITY_INFORMATION,
                     L"Handler: '%s' already installed.",
                     szName);
 
         hr = S_OK;
+        goto exit;
     }
 
     if ( FAILED(hr) )
@@ -3106,7 +3104,7 @@ ExecuteInstallHandlerCA(
     //
     // Update config
     //
-    hr = pAdminMgr->CommitChanges();
+    hr = CommitConfigChanges( pAdminMgr );
     if ( FAILED(hr) )
     {
         DBGERROR_HR(hr);
@@ -3139,15 +3137,11 @@ ExecuteUnInstallHandlerCA(
     CComPtr<IAppHostWritableAdminManager>   pAdminMgr;
  
         
-    hr = CoCreateInstance(__uuidof(AppHostWritableAdminManager),
-                          NULL,
-                          CLSCTX_INPROC_SERVER,
-                          __uuidof(IAppHostWritableAdminManager),
-                          (VOID **)&pAdminMgr);
+    hr = GetConfigAdminManager(FALSE, &pAdminMgr);
     if (FAILED(hr))
     {
         IISLogWrite(SETUP_LOG_SEVERITY_ERROR, 
-                    L"CoCreateInstance failed 0x%08x", hr);
+                    L"GetConfigAdminManager failed 0x%08x", hr);
         DBGERROR_HR(hr);
         goto exit;
     }
@@ -3174,7 +3168,7 @@ ExecuteUnInstallHandlerCA(
     //
     // Update config
     //
-    hr = pAdminMgr->CommitChanges();
+    hr = CommitConfigChanges( pAdminMgr );
     if ( FAILED(hr) )
     {
         DBGERROR_HR(hr);
@@ -3406,23 +3400,6 @@ ExecuteInstallSectionDefaultsCA(
     WCHAR * szSectionName = NULL;
     WCHAR * szTempFileName = NULL;
 
-    CComPtr<IAppHostWritableAdminManager>   pAdminMgr;
-
-    
-    hr = CoCreateInstance(__uuidof(AppHostWritableAdminManager),
-                          NULL,
-                          CLSCTX_INPROC_SERVER,
-                          __uuidof(IAppHostWritableAdminManager),
-                          (VOID **)&pAdminMgr);
-    if (FAILED(hr))
-    {
-        IISLogWrite(SETUP_LOG_SEVERITY_ERROR, 
-                    L"CoCreateInstance failed 0x%08x", hr);
-        DBGERROR_HR(hr);
-        goto exit;
-    } 
-    
-
     hr = cadata->Read( &szSectionName );
     if ( FAILED(hr) )
     {
@@ -3454,16 +3431,6 @@ ExecuteInstallSectionDefaultsCA(
     {
         hr = S_OK;
     }
-    
-    //
-    // Update config
-    //
-    hr = pAdminMgr->CommitChanges();
-    if ( FAILED(hr) )
-    {
-        DBGERROR_HR(hr);
-        goto exit;
-    }
 
 exit:
 
@@ -3691,23 +3658,6 @@ ExecuteInstallSectionAdditionsCA(
     WCHAR * szSectionName = NULL;
     WCHAR * szTempFileName = NULL;
 
-    CComPtr<IAppHostWritableAdminManager>   pAdminMgr;
-
-    
-    hr = CoCreateInstance(__uuidof(AppHostWritableAdminManager),
-                          NULL,
-                          CLSCTX_INPROC_SERVER,
-                          __uuidof(IAppHostWritableAdminManager),
-                          (VOID **)&pAdminMgr);
-    if (FAILED(hr))
-    {
-        IISLogWrite(SETUP_LOG_SEVERITY_ERROR, 
-                    L"CoCreateInstance failed 0x%08x", hr);
-        DBGERROR_HR(hr);
-        goto exit;
-    } 
-    
-
     hr = cadata->Read( &szSectionName );
     if ( FAILED(hr) )
     {
@@ -3739,16 +3689,6 @@ ExecuteInstallSectionAdditionsCA(
     {
         hr = S_OK;
     }
-    
-    //
-    // Update config
-    //
-    hr = pAdminMgr->CommitChanges();
-    if ( FAILED(hr) )
-    {
-        DBGERROR_HR(hr);
-        goto exit;
-    }
 
 exit:
 
@@ -4143,15 +4083,11 @@ ExecuteInstallCgiRestrictionsCA(
     CComPtr<IAppHostWritableAdminManager>   pAdminMgr;
 
     
-    hr = CoCreateInstance(__uuidof(AppHostWritableAdminManager),
-                          NULL,
-                          CLSCTX_INPROC_SERVER,
-                          __uuidof(IAppHostWritableAdminManager),
-                          (VOID **)&pAdminMgr);
+    hr = GetConfigAdminManager(FALSE, &pAdminMgr);
     if (FAILED(hr))
     {
         IISLogWrite(SETUP_LOG_SEVERITY_ERROR, 
-                    L"CoCreateInstance failed 0x%08x", hr);
+                    L"GetConfigAdminManager failed 0x%08x", hr);
         DBGERROR_HR(hr);
         goto exit;
     } 
@@ -4211,7 +4147,7 @@ ExecuteInstallCgiRestrictionsCA(
     //
     // Update config
     //
-    hr = pAdminMgr->CommitChanges();
+    hr = CommitConfigChanges( pAdminMgr );
     if ( FAILED(hr) )
     {
         DBGERROR_HR(hr);
@@ -4244,15 +4180,11 @@ ExecuteUnInstallCgiRestrictionsCA(
     CComPtr<IAppHostWritableAdminManager>   pAdminMgr;
 
     
-    hr = CoCreateInstance(__uuidof(AppHostWritableAdminManager),
-                          NULL,
-                          CLSCTX_INPROC_SERVER,
-                          __uuidof(IAppHostWritableAdminManager),
-                          (VOID **)&pAdminMgr);
+    hr = GetConfigAdminManager(FALSE, &pAdminMgr);
     if (FAILED(hr))
     {
         IISLogWrite(SETUP_LOG_SEVERITY_ERROR, 
-                    L"CoCreateInstance failed 0x%08x", hr);
+                    L"GetConfigAdminManager failed 0x%08x", hr);
         DBGERROR_HR(hr);
         goto exit;
     } 
@@ -4281,7 +4213,7 @@ ExecuteUnInstallCgiRestrictionsCA(
     //
     // Update config
     //
-    hr = pAdminMgr->CommitChanges();
+    hr = CommitConfigChanges( pAdminMgr );
     if ( FAILED(hr) )
     {
         DBGERROR_HR(hr);
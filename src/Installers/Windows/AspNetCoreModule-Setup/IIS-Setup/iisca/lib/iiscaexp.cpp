@@ -302,6 +302,7 @@ IISExecuteCA(
     )
 {
     HRESULT hr = NOERROR;
+    HRESULT hrEnd;
     CA_DATA_READER cadata;
     INT icaType = 0; 
     BOOL fCoInit = FALSE; 
@@ -322,6 +323,18 @@ IISExecuteCA(
         DBGERROR_HR(hr);
         goto exit;
     }
+
+    //
+    // All the config edits of the run are written together at the end,
+    // so that IIS reloads its configuration once per install.
+    //
+    hr = BeginConfigTransaction();
+    if ( FAILED(hr) )
+    {
+        DBGERROR_HR(hr);
+        goto exit;
+    }
+
     while ( SUCCEEDED(hr = cadata.Read( &icaType )) )
     {
         switch (icaType )
@@ -482,6 +495,15 @@ IISExecuteCA(
 
 exit:
 
+    //
+    // A failed run leaves the configuration as it was.
+    //
+    hrEnd = EndConfigTransaction( SUCCEEDED(hr) );
+    if ( SUCCEEDED(hr) )
+    {
+        hr = hrEnd;
+    }
+
     if ( fCoInit )
     {
         CoUninitialize();
@@ -43,14 +43,11 @@ InstallModule(
     )
 {
     HRESULT hr = NOERROR;
+    BOOL    fGlobalModuleAdded = FALSE;
 
     CComPtr<IAppHostWritableAdminManager>   pAdminMgr;
 
-    hr = CoCreateInstance( __uuidof( AppHostWritableAdminManager ),
-                           NULL,
-                           CLSCTX_INPROC_SERVER,
-                           __uuidof( IAppHostWritableAdminManager ),
-                           (VOID **)&pAdminMgr );
+    hr = GetConfigAdminManager( FALSE, &pAdminMgr );
     if ( FAILED(hr) )
     {
         DBGERROR_HR(hr);
@@ -118,19 +115,30 @@ InstallModule(
             DBGERROR_HR(hr);
             goto exit;
         }
+
+        fGlobalModuleAdded = TRUE;
     }
 
     hr = AddModuleToRootModules( pAdminMgr,
                                  szName,
                                  szPreCondition,
                                  szType );
+    if ( hr == HRESULT_FROM_WIN32( ERROR_ALREADY_EXISTS ) && fGlobalModuleAdded )
+    {
+        //
+        // Only the globalModules entry was missing. The admin manager may
+        // be shared with the other CAs of the install, so the entry added
+        // is committed rather than left for them to write.
+        //
+        hr = S_OK;
+    }
     if ( FAILED(hr) )
     {
         DBGERROR_HR(hr);
         goto exit;
     }
 
-    hr = pAdminMgr->CommitChanges();
+    hr = CommitConfigChanges( pAdminMgr );
     if ( FAILED(hr) )
     {
         DBGERROR_HR(hr);
@@ -169,11 +177,7 @@ UnInstallModule(
         goto exit;
     }
 
-    hr = CoCreateInstance( __uuidof( AppHostWritableAdminManager ),
-                           NULL,
-                           CLSCTX_INPROC_SERVER,
-                           __uuidof( IAppHostWritableAdminManager ),
-                           (VOID **)&pAdminMgr );
+    hr = GetConfigAdminManager( FALSE, &pAdminMgr );
     if ( FAILED(hr) )
     {
         DBGERROR_HR(hr);
@@ -252,7 +256,7 @@ UnInstallModule(
 
     if ( fChanged )
     {
-        hr = pAdminMgr->CommitChanges();
+        hr = CommitConfigChanges( pAdminMgr );
         if ( FAILED(hr) )
         {
             DBGERROR_HR(hr);
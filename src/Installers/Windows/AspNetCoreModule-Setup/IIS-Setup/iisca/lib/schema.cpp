@@ -103,36 +103,26 @@ exit:
 
 HRESULT 
 InitializeAdminManager(
-    IN      CONST BOOL                     isSectionInAdminSchema,    
-    IN      IAppHostWritableAdminManager * pAdminMgr,
-    OUT     CONST WCHAR **                 pszCommitPath
+    IN      CONST BOOL                      isSectionInAdminSchema,
+    OUT     IAppHostWritableAdminManager ** ppAdminMgr,
+    OUT     CONST WCHAR **                  pszCommitPath
 )
 {
     HRESULT hr = NOERROR;
     CONST WCHAR * szAdminCommitPath = L"MACHINE/WEBROOT";
     CONST WCHAR * szAppHostCommitPath = L"MACHINE/WEBROOT/APPHOST";
 
-    CONST WCHAR * szCommitPath = NULL;
-
     *pszCommitPath = NULL;
 
-    if(isSectionInAdminSchema)
-    {
-        szCommitPath = szAdminCommitPath;
-        hr = InitAdminMgrForAdminConfig( pAdminMgr,
-                                        szCommitPath );
-        if( FAILED(hr) )
-        {
-            DBGERROR_HR(hr);
-            goto exit;
-        }
-    }
-    else
+    hr = GetConfigAdminManager( isSectionInAdminSchema,
+                                ppAdminMgr );
+    if( FAILED(hr) )
     {
-        szCommitPath = szAppHostCommitPath;
+        DBGERROR_HR(hr);
+        goto exit;
     }
 
-    *pszCommitPath = szCommitPath;
+    *pszCommitPath = isSectionInAdminSchema ? szAdminCommitPath : szAppHostCommitPath;
 
 exit:
     return hr;
@@ -191,19 +181,8 @@ RegisterSectionSchema(
         *szShortName++ = L'\0';
     }
 
-    hr = CoCreateInstance( __uuidof( AppHostWritableAdminManager ),
-                           NULL,
-                           CLSCTX_INPROC_SERVER,
-                           __uuidof( IAppHostWritableAdminManager ),
-                           (VOID **)&pAdminMgr );
-    if( FAILED(hr) )
-    {
-        DBGERROR_HR(hr);
-        goto exit;
-    }
-    
     hr = InitializeAdminManager( isSectionInAdminSchema,
-                                 pAdminMgr,
+                                 &pAdminMgr,
                                  &szCommitPath);
     if( FAILED(hr) )
     {
@@ -362,10 +341,18 @@ RegisterSectionSchema(
     }
 
     //
-    // Persist changes
+    // Persist changes. The sections of the later CAs are only found by
+    // admin managers created once their definition is committed.
     //
 
-    hr = pAdminMgr->CommitChanges();
+    hr = CommitConfigChanges( pAdminMgr );
+    if( FAILED(hr) )
+    {
+        DBGERROR_HR(hr);
+        goto exit;
+    }
+
+    hr = FlushConfigTransaction();
     if( FAILED(hr) )
     {
         DBGERROR_HR(hr);
@@ -678,19 +665,8 @@ UnRegisterSectionSchema(
         *szShortName++ = 0;
     }
 
-    hr = CoCreateInstance( __uuidof( AppHostWritableAdminManager ),
-                           NULL,
-                           CLSCTX_INPROC_SERVER,
-                           __uuidof( IAppHostWritableAdminManager ),
-                           (VOID **)&pAdminMgr );
-    if( FAILED(hr) )
-    {
-        DBGERROR_HR(hr);
-        goto exit;
-    }
-
     hr = InitializeAdminManager( isSectionInAdminSchema,
-                                 pAdminMgr,
+                                 &pAdminMgr,
                                  &szCommitPath);
     if( FAILED(hr) )
     {
@@ -725,7 +701,7 @@ UnRegisterSectionSchema(
         goto exit;
     }
 
-    hr = pAdminMgr->CommitChanges();
+    hr = CommitConfigChanges( pAdminMgr );
     if( FAILED(hr) )
     {
         DBGERROR_HR(hr);
@@ -45,11 +45,7 @@ RegisterTraceArea(
         goto exit;
     }
 
-    hr = CoCreateInstance( __uuidof( AppHostWritableAdminManager ),
-                           NULL,
-                           CLSCTX_INPROC_SERVER,
-                           __uuidof( IAppHostWritableAdminManager ),
-                           (VOID **)&pAdminMgr );
+    hr = GetConfigAdminManager( FALSE, &pAdminMgr );
     if( FAILED(hr) )
     {
         DBGERROR_HR(hr);
@@ -144,7 +140,7 @@ RegisterTraceArea(
         goto exit;
     }
 
-    hr = pAdminMgr->CommitChanges();
+    hr = CommitConfigChanges( pAdminMgr );
     if ( FAILED(hr) )
     {
         DBGERROR_HR(hr);
@@ -243,7 +243,9 @@ RegisterUIModule(
     VariantInit( &varValue );
     DWORD dwIndex;
     BOOL fAddElement = FALSE;
+    BOOL fChanged = FALSE;
     INT cIndex;
+    BSTR bstrType = NULL;
 
     BSTR bstrCommitPath = SysAllocString( L"MACHINE/WEBROOT" );
     BSTR bstrModuleProvidersName = SysAllocString( L"moduleProviders" );
@@ -260,19 +262,7 @@ RegisterUIModule(
         goto exit;
     }
 
-    hr = CoCreateInstance( __uuidof( AppHostWritableAdminManager ),
-                           NULL,
-                           CLSCTX_INPROC_SERVER,
-                           __uuidof( IAppHostWritableAdminManager ),
-                           (VOID **)&pAdminMgr );
-    if( FAILED(hr) )
-    {
-        DBGERROR_HR(hr);
-        goto exit;
-    }
-
-    hr = InitAdminMgrForAdminConfig( pAdminMgr,
-                                    bstrCommitPath );
+    hr = GetConfigAdminManager( TRUE, &pAdminMgr );
     if( FAILED(hr) )
     {
         DBGERROR_HR(hr);
@@ -321,6 +311,24 @@ RegisterUIModule(
             DBGERROR_HR(hr);
             goto exit;
         }
+
+        hr = GetElementStringProperty(
+                pNewModuleElement,
+                L"type",
+                &bstrType);
+        if (FAILED(hr))
+        {
+            DBGERROR_HR(hr);
+            goto exit;
+        }
+
+        //
+        // A provider already registered with this type is left untouched.
+        //
+        if (wcscmp(bstrType, szModuleTypeInfo) == 0)
+        {
+            goto SkipProviderUpdate;
+        }
     }
     else
     {
@@ -335,6 +343,8 @@ RegisterUIModule(
         fAddElement = TRUE;
     }
 
+    fChanged = TRUE;
+
     hr = VariantAssign( &varValue, szModuleName );
     if( FAILED(hr) )
     {
@@ -384,6 +394,7 @@ RegisterUIModule(
         }
     }
 
+ SkipProviderUpdate:
     if( szRegisterInModulesSection && *szRegisterInModulesSection )
     {
         // register global <modules> section
@@ -441,18 +452,25 @@ RegisterUIModule(
         {
             hr = S_OK;
         }
-        if( FAILED(hr) )
+        else if( FAILED(hr) )
         {
              DBGERROR_HR(hr);
              goto exit;
         }
+        else
+        {
+            fChanged = TRUE;
+        }
     }
 
-    hr = pAdminMgr->CommitChanges();
-    if( FAILED(hr) )
+    if( fChanged )
     {
-        DBGERROR_HR(hr);
-        goto exit;
+        hr = CommitConfigChanges( pAdminMgr );
+        if( FAILED(hr) )
+        {
+            DBGERROR_HR(hr);
+            goto exit;
+        }
     }
 
 exit:
@@ -461,6 +479,7 @@ exit:
     SysFreeString( bstrModuleProvidersName );
     SysFreeString( bstrAdd );
     SysFreeString( bstrModulesSectionName );
+    SysFreeString( bstrType );
 
     VariantClear( &varValue );
 
@@ -497,18 +516,7 @@ UnRegisterUIModule(
         goto exit;
     }
 
-    hr = CoCreateInstance( __uuidof( AppHostWritableAdminManager ),
-                           NULL,
-                           CLSCTX_INPROC_SERVER,
-                           __uuidof( IAppHostWritableAdminManager ),
-                           (VOID **)&pAdminMgr );
-    if( FAILED(hr) )
-    {
-        DBGERROR_HR(hr);
-        goto exit;
-    }
-
-    hr = InitAdminMgrForAdminConfig( pAdminMgr, bstrCommitPath );
+    hr = GetConfigAdminManager( TRUE, &pAdminMgr );
     if( FAILED(hr) )
     {
         DBGERROR_HR(hr);
@@ -617,7 +625,7 @@ UnRegisterUIModule(
 
     if( fProvidersDeleted || fModulesDeleted )
     {
-        hr = pAdminMgr->CommitChanges();
+        hr = CommitConfigChanges( pAdminMgr );
         if( FAILED(hr) )
         {
             DBGERROR_HR(hr);
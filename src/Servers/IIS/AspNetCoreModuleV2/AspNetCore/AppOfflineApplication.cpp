@@ -3,6 +3,7 @@
 
 #include "AppOfflineApplication.h"
 
+#include <atomic>
 #include "HandleWrapper.h"
 #include "AppOfflineHandler.h"
 #include "exceptions.h"
@@ -11,7 +12,7 @@ HRESULT AppOfflineApplication::CreateHandler(IHttpContext* pHttpContext, IREQUES
 {
     try
     {
-        auto handler = std::make_unique<AppOfflineHandler>(*pHttpContext, m_strAppOfflineContent);
+        auto handler = std::make_unique<AppOfflineHandler>(*pHttpContext, std::atomic_load(&m_pAppOfflineContent));
         *pRequestHandler = handler.release();
     }
     CATCH_RETURN();
@@ -50,7 +51,7 @@ HRESULT AppOfflineApplication::OnAppOfflineFound()
         RETURN_LAST_ERROR_IF(!ReadFile(handle, pszBuff.data(), li.LowPart, &bytesRead, nullptr));
         pszBuff.resize(bytesRead);
 
-        m_strAppOfflineContent = pszBuff;
+        std::atomic_store(&m_pAppOfflineContent, std::shared_ptr<const std::string>(std::make_shared<std::string>(std::move(pszBuff))));
     }
 
     return S_OK;
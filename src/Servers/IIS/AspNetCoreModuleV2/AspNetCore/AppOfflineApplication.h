@@ -23,6 +23,8 @@ public:
     static bool ShouldBeStarted(const IHttpApplication& pApplication);
 
 private:
-    std::string m_strAppOfflineContent;
+    // Replaced as a whole when the file changes, requests still sending
+    // the previous content keep it alive.
+    std::shared_ptr<const std::string> m_pAppOfflineContent;
 };
 
@@ -21,10 +21,13 @@ REQUEST_NOTIFICATION_STATUS AppOfflineHandler::ExecuteRequestHandler()
         FALSE
     );
 
-    DataChunk.DataChunkType = HttpDataChunkFromMemory;
-    DataChunk.FromMemory.pBuffer = m_strAppOfflineContent.data();
-    DataChunk.FromMemory.BufferLength = static_cast<ULONG>(m_strAppOfflineContent.size());
-    pResponse->WriteEntityChunkByReference(&DataChunk);
+    if (m_pAppOfflineContent != nullptr)
+    {
+        DataChunk.DataChunkType = HttpDataChunkFromMemory;
+        DataChunk.FromMemory.pBuffer = const_cast<char*>(m_pAppOfflineContent->data());
+        DataChunk.FromMemory.BufferLength = static_cast<ULONG>(m_pAppOfflineContent->size());
+        pResponse->WriteEntityChunkByReference(&DataChunk);
+    }
 
     return REQUEST_NOTIFICATION_STATUS::RQ_NOTIFICATION_FINISH_REQUEST;
 }
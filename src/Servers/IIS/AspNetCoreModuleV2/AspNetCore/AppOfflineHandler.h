@@ -3,16 +3,19 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
 #include "requesthandler.h"
 
 class AppOfflineHandler: public REQUEST_HANDLER
 {
 public:
-    AppOfflineHandler(IHttpContext& pContext, const std::string& appOfflineContent)
+    // The content is shared with the application and every other request,
+    // it is written to the response by reference.
+    AppOfflineHandler(IHttpContext& pContext, std::shared_ptr<const std::string> appOfflineContent)
         : REQUEST_HANDLER(pContext),
         m_pContext(pContext),
-        m_strAppOfflineContent(appOfflineContent)
+        m_pAppOfflineContent(std::move(appOfflineContent))
     {
     }
 
@@ -20,5 +23,6 @@ public:
 
 private:
     IHttpContext& m_pContext;
-    std::string m_strAppOfflineContent;
+    // Kept alive until the response has been sent
+    std::shared_ptr<const std::string> m_pAppOfflineContent;
 };
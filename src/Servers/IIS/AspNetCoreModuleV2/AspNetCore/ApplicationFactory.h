@@ -8,6 +8,7 @@
 #include <utility>
 #include "iapplication.h"
 #include "HandleWrapper.h"
+#include "StartupTimeline.h"
 
 typedef
 HRESULT
@@ -22,13 +23,21 @@ HRESULT
 class ApplicationFactory
 {
 public:
-    ApplicationFactory(HMODULE hRequestHandlerDll, std::wstring location, PFN_ASPNETCORE_CREATE_APPLICATION pfnAspNetCoreCreateApplication) noexcept:
+    ApplicationFactory(HMODULE hRequestHandlerDll, std::wstring location, PFN_ASPNETCORE_CREATE_APPLICATION pfnAspNetCoreCreateApplication, const StartupTimeline& startupTimeline, std::wstring handlerDllPath) noexcept:
         m_pfnAspNetCoreCreateApplication(pfnAspNetCoreCreateApplication),
         m_location(std::move(location)),
-        m_hRequestHandlerDll(hRequestHandlerDll)
+        m_handlerDllPath(std::move(handlerDllPath)),
+        m_hRequestHandlerDll(hRequestHandlerDll),
+        m_startupTimeline(startupTimeline)
     {
     }
 
+    // Empty if the handler was found loaded by its name.
+    const std::wstring& QueryHandlerDllPath() const noexcept
+    {
+        return m_handlerDllPath;
+    }
+
     HRESULT Execute(
         _In_  IHttpServer           *pServer,
         _In_  IHttpContext          *pHttpContext,
@@ -37,12 +46,14 @@ public:
     {
         // m_location.data() is const ptr copy to local to get mutable pointer
         auto location = m_location;
-        std::array<APPLICATION_PARAMETER, 4> parameters {
+        auto startupTimeline = m_startupTimeline;
+        std::array<APPLICATION_PARAMETER, 5> parameters {
             {
                 {"InProcessExeLocation", location.data()},
                 {"TraceContext", pHttpContext->GetTraceContext()},
                 {"Site", pHttpContext->GetSite()},
-                {"ShadowCopyDirectory", shadowCopyDirectory.data()}
+                {"ShadowCopyDirectory", shadowCopyDirectory.data()},
+                {"StartupTimeline", &startupTimeline}
             }
         };
 
@@ -52,5 +63,8 @@ public:
 private:
     PFN_ASPNETCORE_CREATE_APPLICATION m_pfnAspNetCoreCreateApplication;
     std::wstring m_location;
+    std::wstring m_handlerDllPath;
     HandleWrapper<ModuleHandleTraits> m_hRequestHandlerDll;
+    // The shim phases, up to loading the request handler.
+    StartupTimeline m_startupTimeline;
 };
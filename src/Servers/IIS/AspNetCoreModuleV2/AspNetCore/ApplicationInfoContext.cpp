@@ -0,0 +1,39 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+#include "ApplicationInfoContext.h"
+#include "applicationinfo.h"
+#include "SRWSharedLock.h"
+#include "SRWExclusiveLock.h"
+
+void ApplicationInfoContext::CleanupStoredContext() noexcept
+{
+    delete this;
+}
+
+bool ApplicationInfoContext::TryGetApplicationInfo(
+    LONG version,
+    std::shared_ptr<APPLICATION_INFO>& pApplicationInfo
+) const
+{
+    SRWSharedLock lock(m_srwLock);
+
+    if (m_version != version)
+    {
+        return false;
+    }
+
+    pApplicationInfo = m_pApplicationInfo.lock();
+    return pApplicationInfo != nullptr;
+}
+
+void ApplicationInfoContext::SetApplicationInfo(
+    LONG version,
+    const std::shared_ptr<APPLICATION_INFO>& pApplicationInfo
+)
+{
+    SRWExclusiveLock lock(m_srwLock);
+
+    m_version = version;
+    m_pApplicationInfo = pApplicationInfo;
+}
@@ -0,0 +1,47 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+#pragma once
+
+#include <httpserv.h>
+#include <memory>
+
+class APPLICATION_INFO;
+
+//
+// Stored in the module context of an IIS application, remembers the
+// APPLICATION_INFO its requests go to. Only valid while the version of the
+// application manager is the one it was stored with.
+//
+class ApplicationInfoContext final: public IHttpStoredContext
+{
+public:
+    ApplicationInfoContext()
+        : m_version(0)
+    {
+        InitializeSRWLock(&m_srwLock);
+    }
+
+    virtual
+    ~ApplicationInfoContext() = default;
+
+    void
+    CleanupStoredContext() noexcept override;
+
+    bool
+    TryGetApplicationInfo(
+        LONG version,
+        std::shared_ptr<APPLICATION_INFO>& pApplicationInfo
+    ) const;
+
+    void
+    SetApplicationInfo(
+        LONG version,
+        const std::shared_ptr<APPLICATION_INFO>& pApplicationInfo
+    );
+
+private:
+    mutable SRWLOCK m_srwLock {};
+    std::weak_ptr<APPLICATION_INFO> m_pApplicationInfo;
+    LONG m_version;
+};
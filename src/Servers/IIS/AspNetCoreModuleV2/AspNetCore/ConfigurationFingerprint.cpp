@@ -0,0 +1,139 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "ConfigurationFingerprint.h"
+
+#include <atlbase.h>
+#include "ConfigurationSource.h"
+#include "BindingInformation.h"
+#include "exceptions.h"
+
+#define CS_WEBSOCKET_SECTION                             L"system.webServer/webSocket"
+
+HRESULT
+ConfigurationFingerprint::Compute(
+    IAppHostAdminManager&   adminManager,
+    const std::wstring&     configPath,
+    bool                    fInProcess,
+    ULONGLONG&              ullFingerprint) noexcept
+{
+    static const struct
+    {
+        PCWSTR  pszName;
+        bool    fInProcessOnly;
+    } rgSections[] = {
+        { CS_ASPNETCORE_SECTION, false },
+        { CS_WINDOWS_AUTHENTICATION_SECTION, false },
+        { CS_BASIC_AUTHENTICATION_SECTION, false },
+        { CS_ANONYMOUS_AUTHENTICATION_SECTION, false },
+        { CS_MAX_REQUEST_BODY_SIZE_SECTION, false },
+        { CS_WEBSOCKET_SECTION, false },
+        { CS_SITE_SECTION, true },
+    };
+
+    const CComBSTR bstrConfigPath = configPath.c_str();
+    RETURN_LAST_ERROR_IF_NULL(bstrConfigPath.m_str);
+
+    ULONGLONG ullHash = FNV_OFFSET_BASIS;
+
+    for (const auto& section : rgSections)
+    {
+        if (section.fInProcessOnly && !fInProcess)
+        {
+            continue;
+        }
+
+        const CComBSTR bstrSection = section.pszName;
+        CComPtr<IAppHostElement> pSection;
+
+        RETURN_LAST_ERROR_IF_NULL(bstrSection.m_str);
+
+        // A section that is not installed (webSocket) hashes as empty.
+        if (FAILED(adminManager.GetAdminSection(bstrSection, bstrConfigPath, &pSection)))
+        {
+            HashString(nullptr, ullHash);
+            continue;
+        }
+
+        RETURN_IF_FAILED(HashElement(*pSection, ullHash));
+    }
+
+    ullFingerprint = ullHash;
+    return S_OK;
+}
+
+HRESULT
+ConfigurationFingerprint::HashElement(IAppHostElement& element, ULONGLONG& ullHash) noexcept
+{
+    CComBSTR bstrName;
+    CComPtr<IAppHostPropertyCollection> pProperties;
+    CComPtr<IAppHostChildElementCollection> pChildElements;
+    CComPtr<IAppHostElementCollection> pCollection;
+    DWORD cItems = 0;
+
+    RETURN_IF_FAILED(element.get_Name(&bstrName));
+    HashString(bstrName, ullHash);
+
+    //
+    // The values as they are effective at the path, the defaults of the
+    // schema included, so that setting a value to its default is not a
+    // change.
+    //
+    RETURN_IF_FAILED(element.get_Properties(&pProperties));
+    RETURN_IF_FAILED(pProperties->get_Count(&cItems));
+    for (DWORD i = 0; i < cItems; i++)
+    {
+        CComVariant index(i);
+        CComPtr<IAppHostProperty> pProperty;
+        CComBSTR bstrPropertyName;
+        CComBSTR bstrValue;
+
+        RETURN_IF_FAILED(pProperties->get_Item(index, &pProperty));
+        RETURN_IF_FAILED(pProperty->get_Name(&bstrPropertyName));
+        RETURN_IF_FAILED(pProperty->get_StringValue(&bstrValue));
+        HashString(bstrPropertyName, ullHash);
+        HashString(bstrValue, ullHash);
+    }
+
+    RETURN_IF_FAILED(element.get_ChildElements(&pChildElements));
+    RETURN_IF_FAILED(pChildElements->get_Count(&cItems));
+    for (DWORD i = 0; i < cItems; i++)
+    {
+        CComVariant index(i);
+        CComPtr<IAppHostElement> pChild;
+
+        RETURN_IF_FAILED(pChildElements->get_Item(index, &pChild));
+        RETURN_IF_FAILED(HashElement(*pChild, ullHash));
+    }
+
+    // Not every element is a collection.
+    if (SUCCEEDED(element.get_Collection(&pCollection)) && pCollection != nullptr)
+    {
+        RETURN_IF_FAILED(pCollection->get_Count(&cItems));
+        for (DWORD i = 0; i < cItems; i++)
+        {
+            CComVariant index(i);
+            CComPtr<IAppHostElement> pItem;
+
+            RETURN_IF_FAILED(pCollection->get_Item(index, &pItem));
+            RETURN_IF_FAILED(HashElement(*pItem, ullHash));
+        }
+    }
+
+    // Ends the element, a value can't pass for the name of the next one.
+    HashString(nullptr, ullHash);
+    return S_OK;
+}
+
+VOID
+ConfigurationFingerprint::HashString(_In_opt_ BSTR bstr, ULONGLONG& ullHash) noexcept
+{
+    // FNV-1a over the characters and the terminator.
+    const UINT cch = bstr != nullptr ? SysStringLen(bstr) : 0;
+    for (UINT i = 0; i <= cch; i++)
+    {
+        const WCHAR ch = i < cch ? bstr[i] : L'\0';
+        ullHash = (ullHash ^ static_cast<BYTE>(ch)) * FNV_PRIME;
+        ullHash = (ullHash ^ static_cast<BYTE>(ch >> 8)) * FNV_PRIME;
+    }
+}
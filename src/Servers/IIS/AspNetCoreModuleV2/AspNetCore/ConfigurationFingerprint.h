@@ -0,0 +1,40 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <Windows.h>
+#include <ahadmin.h>
+#include <string>
+
+//
+// Hash of every setting an application reads from its configuration: the
+// aspNetCore section with its environment variables and handler settings,
+// and the IIS sections the module and the request handler look at. Two
+// equal fingerprints mean a configuration change did not touch the
+// application, so it is not recycled.
+//
+class ConfigurationFingerprint
+{
+public:
+    // The sites section is only read in process, for the bindings.
+    static
+    HRESULT
+    Compute(
+        IAppHostAdminManager&   adminManager,
+        const std::wstring&     configPath,
+        bool                    fInProcess,
+        ULONGLONG&              ullFingerprint) noexcept;
+
+private:
+    static
+    HRESULT
+    HashElement(IAppHostElement& element, ULONGLONG& ullHash) noexcept;
+
+    static
+    VOID
+    HashString(_In_opt_ BSTR bstr, ULONGLONG& ullHash) noexcept;
+
+    static constexpr ULONGLONG  FNV_OFFSET_BASIS = 14695981039346656037ULL;
+    static constexpr ULONGLONG  FNV_PRIME = 1099511628211ULL;
+};
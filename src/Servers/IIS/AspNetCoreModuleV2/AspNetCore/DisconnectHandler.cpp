@@ -4,19 +4,15 @@
 #include "DisconnectHandler.h"
 #include "exceptions.h"
 #include "proxymodule.h"
-#include "SRWExclusiveLock.h"
 
 void DisconnectHandler::NotifyDisconnect()
 {
     try
     {
-        std::unique_ptr<IREQUEST_HANDLER, IREQUEST_HANDLER_DELETER> pHandler;
-        {
-            SRWExclusiveLock lock(m_handlerLock);
-            m_pHandler.swap(pHandler);
-            m_disconnectFired = true;
-        }
+        // Set first, a handler exchanged in after the exchange below sees it.
+        m_disconnectFired = true;
 
+        std::unique_ptr<IREQUEST_HANDLER, IREQUEST_HANDLER_DELETER> pHandler(m_pHandler.exchange(nullptr));
         if (pHandler != nullptr)
         {
             pHandler->NotifyDisconnect();
@@ -35,16 +31,13 @@ void DisconnectHandler::CleanupStoredContext() noexcept
 
 void DisconnectHandler::SetHandler(std::unique_ptr<IREQUEST_HANDLER, IREQUEST_HANDLER_DELETER> handler)
 {
-    IREQUEST_HANDLER* pHandler = nullptr;
-    {
-        SRWExclusiveLock lock(m_handlerLock);
-
-        handler.swap(m_pHandler);
-        pHandler = m_pHandler.get();
-    }
-
+    // The module keeps its own reference for the duration of the call,
+    // the handler outlives a disconnect that takes it out meanwhile.
+    IREQUEST_HANDLER* pHandler = handler.get();
     assert(pHandler != nullptr);
 
+    std::unique_ptr<IREQUEST_HANDLER, IREQUEST_HANDLER_DELETER> pPrevious(m_pHandler.exchange(handler.release()));
+
     if (pHandler != nullptr && (m_disconnectFired || m_pHttpConnection != nullptr && !m_pHttpConnection->IsConnected()))
     {
         pHandler->NotifyDisconnect();
@@ -53,6 +46,5 @@ void DisconnectHandler::SetHandler(std::unique_ptr<IREQUEST_HANDLER, IREQUEST_HA
 
 void DisconnectHandler::RemoveHandler() noexcept
 {
-    SRWExclusiveLock lock(m_handlerLock);
-    m_pHandler = nullptr;
+    std::unique_ptr<IREQUEST_HANDLER, IREQUEST_HANDLER_DELETER> pHandler(m_pHandler.exchange(nullptr));
 }
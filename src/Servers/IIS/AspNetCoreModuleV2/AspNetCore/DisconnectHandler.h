@@ -3,18 +3,24 @@
 
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include "irequesthandler.h"
 
 class ASPNET_CORE_PROXY_MODULE;
 
+//
+// Stored once per connection and reused by each of its requests. The
+// handler of the current request is exchanged in and out of m_pHandler
+// with a reference, whoever takes it out releases it, so that neither a
+// request nor the disconnect notification takes a lock.
+//
 class DisconnectHandler final: public IHttpConnectionStoredContext
 {
 public:
-    DisconnectHandler(IHttpConnection* pHttpConnection)
+    DisconnectHandler(IHttpConnection* pHttpConnection) noexcept
         : m_pHandler(nullptr), m_pHttpConnection(pHttpConnection), m_disconnectFired(false)
     {
-        InitializeSRWLock(&m_handlerLock);
     }
 
     virtual
@@ -35,9 +41,9 @@ public:
     void RemoveHandler() noexcept;
 
 private:
-    SRWLOCK m_handlerLock {};
-    std::unique_ptr<IREQUEST_HANDLER, IREQUEST_HANDLER_DELETER> m_pHandler;
+    // Holds a reference to the handler.
+    std::atomic<IREQUEST_HANDLER*> m_pHandler;
     IHttpConnection* m_pHttpConnection;
-    bool m_disconnectFired;
+    std::atomic<bool> m_disconnectFired;
 };
 
@@ -22,10 +22,13 @@ const PCWSTR HandlerResolver::s_pwzAspnetcoreOutOfProcessRequestHandlerName = L"
 HandlerResolver::HandlerResolver(HMODULE hModule, const IHttpServer &pServer)
     : m_hModule(hModule),
       m_pServer(pServer),
-      m_loadedApplicationHostingModel(HOSTING_UNKNOWN)
+      m_loadedApplicationHostingModel(HOSTING_UNKNOWN),
+      m_disallowRotationOnConfigChange(false),
+      m_fSideBySideOutOfProcessHandlers(false)
 {
-    m_disallowRotationOnConfigChange = false;
     InitializeSRWLock(&m_requestHandlerLoadLock);
+    // Created with the module's APPLICATION_MANAGER in RegisterModule.
+    m_startupTimeline.Mark(StartupTimeline::ModuleLoaded);
 }
 
 HRESULT
@@ -38,6 +41,8 @@ HandlerResolver::LoadRequestHandlerAssembly(const IHttpApplication &pApplication
     HRESULT hr = S_OK;
     PCWSTR pstrHandlerDllName = nullptr;
     auto preventUnload = false;
+
+    m_startupTimeline.Mark(StartupTimeline::HandlerResolveStarted);
     if (pConfiguration.QueryHostingModel() == APP_HOSTING_MODEL::HOSTING_IN_PROCESS)
     {
         preventUnload = false;
@@ -53,8 +58,16 @@ HandlerResolver::LoadRequestHandlerAssembly(const IHttpApplication &pApplication
     HandleWrapper<ModuleHandleTraits> hRequestHandlerDll;
     std::wstring location;
     std::wstring handlerDllPath;
+
+    // Looked up by path, so that a newer version is loaded next to the
+    // one the running applications use.
+    if (m_fSideBySideOutOfProcessHandlers && pConfiguration.QueryHostingModel() != APP_HOSTING_MODEL::HOSTING_IN_PROCESS)
+    {
+        RETURN_IF_FAILED(FindOutOfProcessRequestHandler(pConfiguration, handlerDllPath, errorContext));
+    }
+
     // Try to see if RH is already loaded, use GetModuleHandleEx to increment ref count
-    if (!GetModuleHandleEx(0, pstrHandlerDllName, &hRequestHandlerDll))
+    if (!GetModuleHandleEx(0, handlerDllPath.empty() ? pstrHandlerDllName : handlerDllPath.c_str(), &hRequestHandlerDll))
     {
         if (pConfiguration.QueryHostingModel() == APP_HOSTING_MODEL::HOSTING_IN_PROCESS)
         {
@@ -69,6 +82,8 @@ HandlerResolver::LoadRequestHandlerAssembly(const IHttpApplication &pApplication
                 errorContext,
                 options));
 
+            m_startupTimeline.Mark(StartupTimeline::HandlerHostFxrResolved);
+
             location = options->GetDotnetExeLocation();
 
             auto redirectionOutput = std::make_shared<StringStreamRedirectionOutput>();
@@ -85,26 +100,12 @@ HandlerResolver::LoadRequestHandlerAssembly(const IHttpApplication &pApplication
                     output.c_str());
                 return hr;
             }
+
+            m_startupTimeline.Mark(StartupTimeline::HandlerAssemblyFound);
         }
-        else
+        else if (handlerDllPath.empty())
         {
-            errorContext.generalErrorType = "ASP.NET Core IIS hosting failure (out-of-process)";
-
-            if (FAILED_LOG(hr = FindNativeAssemblyFromGlobalLocation(pConfiguration, pstrHandlerDllName, handlerDllPath)))
-            {
-                auto handlerName = handlerDllPath.empty() ? s_pwzAspnetcoreOutOfProcessRequestHandlerName : handlerDllPath.c_str();
-                EventLog::Error(
-                    ASPNETCORE_EVENT_OUT_OF_PROCESS_RH_MISSING,
-                    ASPNETCORE_EVENT_OUT_OF_PROCESS_RH_MISSING_MSG,
-                    handlerName);
-
-                errorContext.detailedErrorContent = to_multi_byte_string(format(ASPNETCORE_EVENT_OUT_OF_PROCESS_RH_MISSING_MSG, handlerName), CP_UTF8);
-                errorContext.statusCode = 500i16;
-                errorContext.subStatusCode = 36i16;
-                errorContext.errorReason = "The out of process request handler, aspnetcorev2_outofprocess.dll, could not be found next to the aspnetcorev2.dll.";
-
-                return hr;
-            }
+            RETURN_IF_FAILED(FindOutOfProcessRequestHandler(pConfiguration, handlerDllPath, errorContext));
         }
 
         LOG_INFOF(L"Loading request handler:  '%ls'", handlerDllPath.c_str());
@@ -122,7 +123,34 @@ HandlerResolver::LoadRequestHandlerAssembly(const IHttpApplication &pApplication
     auto pfnAspNetCoreCreateApplication = ModuleHelpers::GetKnownProcAddress<PFN_ASPNETCORE_CREATE_APPLICATION>(hRequestHandlerDll, "CreateApplication");
     RETURN_LAST_ERROR_IF_NULL(pfnAspNetCoreCreateApplication);
 
-    pApplicationFactory = std::make_unique<ApplicationFactory>(hRequestHandlerDll.release(), location, pfnAspNetCoreCreateApplication);
+    m_startupTimeline.Mark(StartupTimeline::HandlerLoaded);
+
+    pApplicationFactory = std::make_unique<ApplicationFactory>(hRequestHandlerDll.release(), location, pfnAspNetCoreCreateApplication, m_startupTimeline, std::move(handlerDllPath));
+    return S_OK;
+}
+
+HRESULT
+HandlerResolver::FindOutOfProcessRequestHandler(const ShimOptions& pConfiguration, std::wstring& handlerDllPath, ErrorContext& errorContext)
+{
+    errorContext.generalErrorType = "ASP.NET Core IIS hosting failure (out-of-process)";
+
+    const HRESULT hr = FindNativeAssemblyFromGlobalLocation(pConfiguration.QueryHandlerVersion().c_str(), s_pwzAspnetcoreOutOfProcessRequestHandlerName, handlerDllPath);
+    if (FAILED_LOG(hr))
+    {
+        auto handlerName = handlerDllPath.empty() ? s_pwzAspnetcoreOutOfProcessRequestHandlerName : handlerDllPath.c_str();
+        EventLog::Error(
+            ASPNETCORE_EVENT_OUT_OF_PROCESS_RH_MISSING,
+            ASPNETCORE_EVENT_OUT_OF_PROCESS_RH_MISSING_MSG,
+            handlerName);
+
+        errorContext.detailedErrorContent = to_multi_byte_string(format(ASPNETCORE_EVENT_OUT_OF_PROCESS_RH_MISSING_MSG, handlerName), CP_UTF8);
+        errorContext.statusCode = 500i16;
+        errorContext.subStatusCode = 36i16;
+        errorContext.errorReason = "The out of process request handler, aspnetcorev2_outofprocess.dll, could not be found next to the aspnetcorev2.dll.";
+
+        return hr;
+    }
+
     return S_OK;
 }
 
@@ -130,10 +158,11 @@ HRESULT
 HandlerResolver::GetApplicationFactory(const IHttpApplication& pApplication, const std::filesystem::path& shadowCopyPath, std::unique_ptr<ApplicationFactory>& pApplicationFactory, const ShimOptions& options, ErrorContext& errorContext)
 {
     SRWExclusiveLock lock(m_requestHandlerLoadLock);
-    if (m_loadedApplicationHostingModel != HOSTING_UNKNOWN)
+    const APP_HOSTING_MODEL loadedHostingModel = m_loadedApplicationHostingModel;
+    if (loadedHostingModel != HOSTING_UNKNOWN)
     {
         // Mixed hosting models
-        if (m_loadedApplicationHostingModel != options.QueryHostingModel())
+        if (loadedHostingModel != options.QueryHostingModel())
         {
             errorContext.detailedErrorContent = to_multi_byte_string(format(ASPNETCORE_EVENT_MIXED_HOSTING_MODEL_ERROR_MSG, pApplication.GetApplicationId(), options.QueryHostingModel()), CP_UTF8);
             errorContext.statusCode = 500i16;
@@ -149,8 +178,11 @@ HandlerResolver::GetApplicationFactory(const IHttpApplication& pApplication, con
 
             return E_FAIL;
         }
-        // Multiple in-process apps
-        if (m_loadedApplicationHostingModel == HOSTING_IN_PROCESS && m_loadedApplicationId != pApplication.GetApplicationId())
+        // Multiple in-process apps. hostfxr runs the Main of a single
+        // application per runtime, and the in-process handler keeps one
+        // IN_PROCESS_APPLICATION that the managed server registers its
+        // callbacks with, so a second application can't share the CLR.
+        if (loadedHostingModel == HOSTING_IN_PROCESS && m_loadedApplicationId != pApplication.GetApplicationId())
         {
             errorContext.detailedErrorContent = to_multi_byte_string(format(ASPNETCORE_EVENT_DUPLICATED_INPROCESS_APP_MSG, pApplication.GetApplicationId()), CP_UTF8);
 
@@ -185,21 +217,98 @@ void HandlerResolver::ResetHostingModel()
     m_loadedApplicationId.resize(0);
 }
 
-APP_HOSTING_MODEL HandlerResolver::GetHostingModel()
+APP_HOSTING_MODEL HandlerResolver::GetHostingModel() const noexcept
 {
-    SRWExclusiveLock lock(m_requestHandlerLoadLock);
-
     return m_loadedApplicationHostingModel;
 }
 
-bool HandlerResolver::GetDisallowRotationOnConfigChange()
+bool HandlerResolver::GetDisallowRotationOnConfigChange() const noexcept
 {
     return m_disallowRotationOnConfigChange;
 }
 
+//
+// Applications that ask for a specific handlerVersion get the preloaded
+// handler as well, like any application loaded after the first one.
+//
+HRESULT
+HandlerResolver::PreloadOutOfProcessRequestHandler()
+{
+    SRWExclusiveLock lock(m_requestHandlerLoadLock);
+
+    HandleWrapper<ModuleHandleTraits> hRequestHandlerDll;
+    if (GetModuleHandleEx(0, s_pwzAspnetcoreOutOfProcessRequestHandlerName, &hRequestHandlerDll))
+    {
+        return S_OK;
+    }
+
+    std::wstring handlerDllPath;
+    RETURN_IF_FAILED(FindNativeAssemblyFromGlobalLocation(L"", s_pwzAspnetcoreOutOfProcessRequestHandlerName, handlerDllPath));
+
+    LOG_INFOF(L"Preloading request handler:  '%ls'", handlerDllPath.c_str());
+
+    hRequestHandlerDll = LoadLibrary(handlerDllPath.c_str());
+    RETURN_LAST_ERROR_IF_NULL(hRequestHandlerDll);
+
+    // Pin module in memory, the out-of-process handler is never unloaded
+    GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_PIN, handlerDllPath.c_str(), &hRequestHandlerDll);
+
+    RETURN_LAST_ERROR_IF_NULL(ModuleHelpers::GetKnownProcAddress<PFN_ASPNETCORE_CREATE_APPLICATION>(hRequestHandlerDll, "CreateApplication"));
+
+    return S_OK;
+}
+
+HRESULT
+HandlerResolver::EnableSideBySideOutOfProcessHandlers(std::wstring& moduleFolderPath)
+{
+    SRWExclusiveLock lock(m_requestHandlerLoadLock);
+
+    try
+    {
+        if (m_moduleFolderPath.empty())
+        {
+            m_moduleFolderPath = GlobalVersionUtility::GetAspNetCoreFolderPath(
+                GlobalVersionUtility::RemoveFileNameFromFolderPath(GlobalVersionUtility::GetModuleName(m_hModule)).c_str());
+        }
+
+        moduleFolderPath = m_moduleFolderPath;
+    }
+    CATCH_RETURN();
+
+    m_fSideBySideOutOfProcessHandlers = true;
+    return S_OK;
+}
+
+//
+// Loaded next to the handlers in use and pinned like them, a handler
+// stays loaded once its applications were replaced.
+//
+HRESULT
+HandlerResolver::LoadLatestOutOfProcessRequestHandler(std::wstring& handlerDllPath)
+{
+    SRWExclusiveLock lock(m_requestHandlerLoadLock);
+
+    RETURN_IF_FAILED(FindNativeAssemblyFromGlobalLocation(L"", s_pwzAspnetcoreOutOfProcessRequestHandlerName, handlerDllPath));
+
+    HandleWrapper<ModuleHandleTraits> hRequestHandlerDll;
+    if (!GetModuleHandleEx(0, handlerDllPath.c_str(), &hRequestHandlerDll))
+    {
+        LOG_INFOF(L"Loading request handler side by side:  '%ls'", handlerDllPath.c_str());
+
+        hRequestHandlerDll = LoadLibrary(handlerDllPath.c_str());
+        RETURN_LAST_ERROR_IF_NULL(hRequestHandlerDll);
+
+        GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_PIN, handlerDllPath.c_str(), &hRequestHandlerDll);
+    }
+
+    RETURN_LAST_ERROR_IF_NULL(ModuleHelpers::GetKnownProcAddress<PFN_ASPNETCORE_CREATE_APPLICATION>(hRequestHandlerDll, "CreateApplication"));
+
+    return S_OK;
+}
+
 HRESULT
 HandlerResolver::FindNativeAssemblyFromGlobalLocation(
-    const ShimOptions& pConfiguration,
+    PCWSTR pwzHandlerVersion,
     PCWSTR pstrHandlerDllName,
     std::wstring& handlerDllPath
 )
@@ -213,12 +322,14 @@ HandlerResolver::FindNativeAssemblyFromGlobalLocation(
             return S_OK;
         }
 
-        std::wstring modulePath = GlobalVersionUtility::GetModuleName(m_hModule);
-
-        modulePath = GlobalVersionUtility::RemoveFileNameFromFolderPath(modulePath);
+        if (m_moduleFolderPath.empty())
+        {
+            m_moduleFolderPath = GlobalVersionUtility::GetAspNetCoreFolderPath(
+                GlobalVersionUtility::RemoveFileNameFromFolderPath(GlobalVersionUtility::GetModuleName(m_hModule)).c_str());
+        }
 
-        handlerDllPath = GlobalVersionUtility::GetGlobalRequestHandlerPath(modulePath.c_str(),
-            pConfiguration.QueryHandlerVersion().c_str(),
+        handlerDllPath = m_globalVersionCache.GetGlobalRequestHandlerPath(m_moduleFolderPath.c_str(),
+            pwzHandlerVersion,
             pstrHandlerDllName
         );
     }
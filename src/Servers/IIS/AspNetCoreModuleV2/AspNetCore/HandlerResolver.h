@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include "ShimOptions.h"
@@ -10,6 +11,8 @@
 #include "ApplicationFactory.h"
 #include "RedirectionOutput.h"
 #include "HostFxr.h"
+#include "StartupTimeline.h"
+#include "GlobalVersionUtility.h"
 
 class HandlerResolver
 {
@@ -17,12 +20,24 @@ public:
     HandlerResolver(HMODULE hModule, const IHttpServer &pServer);
     HRESULT GetApplicationFactory(const IHttpApplication &pApplication, const std::filesystem::path& shadowCopyPath, std::unique_ptr<ApplicationFactory>& pApplicationFactory, const ShimOptions& options, ErrorContext& errorContext);
     void ResetHostingModel();
-    APP_HOSTING_MODEL GetHostingModel();
-    bool GetDisallowRotationOnConfigChange();
+    // Read without the load lock, the configuration change handling
+    // calls them with the application manager lock held.
+    APP_HOSTING_MODEL GetHostingModel() const noexcept;
+    bool GetDisallowRotationOnConfigChange() const noexcept;
+    // Loads and pins the highest out-of-process handler of the global
+    // location, so that the first application does not wait for it.
+    HRESULT PreloadOutOfProcessRequestHandler();
+    // From then on out-of-process handlers are found by path, a newer
+    // version in the global location is loaded next to the older ones.
+    HRESULT EnableSideBySideOutOfProcessHandlers(std::wstring& moduleFolderPath);
+    // Loads the highest out-of-process handler of the global location, if
+    // it isn't loaded, and returns its path.
+    HRESULT LoadLatestOutOfProcessRequestHandler(std::wstring& handlerDllPath);
 
 private:
     HRESULT LoadRequestHandlerAssembly(const IHttpApplication &pApplication, const std::filesystem::path& shadowCopyPath, const ShimOptions& pConfiguration, std::unique_ptr<ApplicationFactory>& pApplicationFactory, ErrorContext& errorContext);
-    HRESULT FindNativeAssemblyFromGlobalLocation(const ShimOptions& pConfiguration, PCWSTR libraryName, std::wstring& handlerDllPath);
+    HRESULT FindOutOfProcessRequestHandler(const ShimOptions& pConfiguration, std::wstring& handlerDllPath, ErrorContext& errorContext);
+    HRESULT FindNativeAssemblyFromGlobalLocation(PCWSTR pwzHandlerVersion, PCWSTR libraryName, std::wstring& handlerDllPath);
     HRESULT FindNativeAssemblyFromHostfxr(
         const HostFxrResolutionResult& hostfxrOptions,
         PCWSTR libraryName,
@@ -37,9 +52,17 @@ private:
 
     SRWLOCK      m_requestHandlerLoadLock {};
     std::wstring m_loadedApplicationId;
-    APP_HOSTING_MODEL m_loadedApplicationHostingModel;
+    // Written under m_requestHandlerLoadLock.
+    std::atomic<APP_HOSTING_MODEL> m_loadedApplicationHostingModel;
     HostFxr m_hHostFxrDll;
-    bool m_disallowRotationOnConfigChange;
+    std::atomic<bool> m_disallowRotationOnConfigChange;
+    StartupTimeline m_startupTimeline;
+    // Folder of the handler versions, see GlobalVersionUtility::GetAspNetCoreFolderPath,
+    // under m_requestHandlerLoadLock.
+    std::wstring m_moduleFolderPath;
+    GlobalVersionCache m_globalVersionCache;
+    // Written under m_requestHandlerLoadLock.
+    bool m_fSideBySideOutOfProcessHandlers;
 
     static const PCWSTR          s_pwzAspnetcoreInProcessRequestHandlerName;
     static const PCWSTR          s_pwzAspnetcoreOutOfProcessRequestHandlerName;
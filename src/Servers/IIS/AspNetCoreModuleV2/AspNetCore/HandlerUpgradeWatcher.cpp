@@ -0,0 +1,133 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "HandlerUpgradeWatcher.h"
+
+#include "applicationmanager.h"
+#include "SRWExclusiveLock.h"
+#include "exceptions.h"
+
+HandlerUpgradeWatcher::HandlerUpgradeWatcher(APPLICATION_MANAGER& applicationManager) noexcept
+    : m_applicationManager(applicationManager),
+      m_pTimer(nullptr),
+      m_fStopped(false),
+      m_cAttempts(0)
+{
+    InitializeSRWLock(&m_srwLock);
+}
+
+HandlerUpgradeWatcher::~HandlerUpgradeWatcher()
+{
+    Stop();
+
+    if (m_pTimer != nullptr)
+    {
+        CloseThreadpoolTimer(m_pTimer);
+        m_pTimer = nullptr;
+    }
+}
+
+HRESULT
+HandlerUpgradeWatcher::Start(const std::wstring& moduleFolderPath)
+{
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        if (m_fStopped)
+        {
+            RETURN_HR(HRESULT_FROM_WIN32(ERROR_SERVER_SHUTDOWN_IN_PROGRESS));
+        }
+
+        if (m_pTimer == nullptr)
+        {
+            m_pTimer = CreateThreadpoolTimer(TimerCallback, this, nullptr);
+            RETURN_LAST_ERROR_IF_NULL(m_pTimer);
+        }
+    }
+
+    RETURN_IF_FAILED(DirectoryWatchService::StartWatching(
+        moduleFolderPath,
+        FILE_NOTIFY_CHANGE_DIR_NAME,
+        [this](HRESULT hr, const FILE_NOTIFY_INFORMATION*) { OnFolderChanged(hr); },
+        m_watch));
+
+    LOG_INFOF(L"Watching '%ls' for new request handler versions", moduleFolderPath.c_str());
+    return S_OK;
+}
+
+VOID
+HandlerUpgradeWatcher::Stop() noexcept
+{
+    {
+        SRWExclusiveLock lock(m_srwLock);
+        m_fStopped = true;
+    }
+
+    // Outside of the lock, the watch callback takes it.
+    m_watch = nullptr;
+
+    if (m_pTimer != nullptr)
+    {
+        SetThreadpoolTimer(m_pTimer, nullptr, 0, 0);
+        WaitForThreadpoolTimerCallbacks(m_pTimer, TRUE);
+    }
+}
+
+VOID
+HandlerUpgradeWatcher::OnFolderChanged(HRESULT hr) noexcept
+{
+    if (FAILED(hr))
+    {
+        // The version already loaded keeps serving, new ones need a recycle.
+        LOG_IF_FAILED(hr);
+        return;
+    }
+
+    SRWExclusiveLock lock(m_srwLock);
+
+    if (!m_fStopped)
+    {
+        m_cAttempts = 0;
+        ArmTimerNoLock();
+    }
+}
+
+// static
+VOID
+CALLBACK
+HandlerUpgradeWatcher::TimerCallback(
+    PTP_CALLBACK_INSTANCE,
+    PVOID                   pvContext,
+    PTP_TIMER
+)
+{
+    static_cast<HandlerUpgradeWatcher*>(pvContext)->Upgrade();
+}
+
+VOID
+HandlerUpgradeWatcher::Upgrade() noexcept
+{
+    const HRESULT hr = m_applicationManager.UpgradeOutOfProcessHandler();
+
+    SRWExclusiveLock lock(m_srwLock);
+
+    // A version folder still being copied fails to load.
+    if (FAILED(hr) && !m_fStopped && ++m_cAttempts < MAX_ATTEMPTS)
+    {
+        ArmTimerNoLock();
+    }
+}
+
+VOID
+HandlerUpgradeWatcher::ArmTimerNoLock() noexcept
+{
+    // Negative due times are relative, in 100ns units.
+    ULARGE_INTEGER ulDueTime;
+    ulDueTime.QuadPart = static_cast<ULONGLONG>(-static_cast<LONGLONG>(SETTLE_DELAY_MS) * 10000);
+
+    FILETIME ftDueTime;
+    ftDueTime.dwHighDateTime = ulDueTime.HighPart;
+    ftDueTime.dwLowDateTime = ulDueTime.LowPart;
+
+    SetThreadpoolTimer(m_pTimer, &ftDueTime, 0, 0);
+}
@@ -0,0 +1,76 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <Windows.h>
+#include <string>
+#include "DirectoryWatchService.h"
+
+class APPLICATION_MANAGER;
+
+//
+// Picks up a new out-of-process handler version installed in the global
+// location without a worker process recycle, when the HotSwapOutOfProcessHandler
+// parameter is set.
+//
+// A version folder created or renamed in the folder of the module is given
+// SETTLE_DELAY_MS to be copied, every further change starts that delay
+// again. The application manager then loads the new handler next to the
+// one in use and hands the applications on the older handler to the
+// recycle scheduler, which replaces them while they keep serving. A handler
+// that can't be loaded yet is tried again after the delay, at most
+// MAX_ATTEMPTS times.
+//
+// The older handler is pinned like every out-of-process handler, it stays
+// loaded once its applications are gone.
+//
+class HandlerUpgradeWatcher
+{
+public:
+    explicit
+    HandlerUpgradeWatcher(APPLICATION_MANAGER& applicationManager) noexcept;
+
+    ~HandlerUpgradeWatcher();
+
+    HandlerUpgradeWatcher(const HandlerUpgradeWatcher&) = delete;
+    HandlerUpgradeWatcher& operator=(const HandlerUpgradeWatcher&) = delete;
+
+    HRESULT
+    Start(const std::wstring& moduleFolderPath);
+
+    // No upgrade runs anymore once it returns.
+    VOID
+    Stop() noexcept;
+
+private:
+    static
+    VOID
+    CALLBACK
+    TimerCallback(
+        PTP_CALLBACK_INSTANCE   pInstance,
+        PVOID                   pvContext,
+        PTP_TIMER               pTimer
+    );
+
+    VOID
+    OnFolderChanged(HRESULT hr) noexcept;
+
+    VOID
+    Upgrade() noexcept;
+
+    // Called with m_srwLock held exclusively.
+    VOID
+    ArmTimerNoLock() noexcept;
+
+    static constexpr DWORD      SETTLE_DELAY_MS = 10 * 1000;
+    static constexpr DWORD      MAX_ATTEMPTS = 6;
+
+    APPLICATION_MANAGER&        m_applicationManager;
+
+    SRWLOCK                     m_srwLock {};
+    PTP_TIMER                   m_pTimer;
+    bool                        m_fStopped;
+    DWORD                       m_cAttempts;
+    DirectoryWatchService::WatchHandle m_watch;
+};
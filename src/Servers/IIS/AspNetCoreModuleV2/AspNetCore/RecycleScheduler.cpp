@@ -0,0 +1,176 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "RecycleScheduler.h"
+
+#include <algorithm>
+
+#include "applicationmanager.h"
+#include "SRWExclusiveLock.h"
+#include "exceptions.h"
+
+RecycleScheduler::RecycleScheduler(APPLICATION_MANAGER& applicationManager) noexcept
+    : m_applicationManager(applicationManager),
+      m_pTimer(nullptr),
+      m_fTimerArmed(false),
+      m_fStopped(false),
+      m_ullNextStartTick(0),
+      m_random(GetTickCount())
+{
+    InitializeSRWLock(&m_srwLock);
+
+    // A quarter of the processors start backends at a time, between 1 and 8.
+    const DWORD cProcessors = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+    m_cMaxReplacements = std::clamp(cProcessors / 4, 1UL, 8UL);
+}
+
+RecycleScheduler::~RecycleScheduler()
+{
+    Stop();
+
+    if (m_pTimer != nullptr)
+    {
+        CloseThreadpoolTimer(m_pTimer);
+        m_pTimer = nullptr;
+    }
+}
+
+HRESULT
+RecycleScheduler::Schedule(const std::vector<std::shared_ptr<APPLICATION_INFO>>& applications)
+{
+    SRWExclusiveLock lock(m_srwLock);
+
+    if (m_fStopped)
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_SERVER_SHUTDOWN_IN_PROGRESS));
+    }
+
+    if (m_pTimer == nullptr)
+    {
+        m_pTimer = CreateThreadpoolTimer(TimerCallback, this, nullptr);
+        RETURN_LAST_ERROR_IF_NULL(m_pTimer);
+    }
+
+    m_queue.insert(m_queue.end(), applications.begin(), applications.end());
+
+    if (!m_fTimerArmed)
+    {
+        ArmTimer(0);
+    }
+
+    return S_OK;
+}
+
+VOID
+RecycleScheduler::Stop() noexcept
+{
+    {
+        SRWExclusiveLock lock(m_srwLock);
+        m_fStopped = true;
+        m_queue.clear();
+    }
+
+    if (m_pTimer != nullptr)
+    {
+        SetThreadpoolTimer(m_pTimer, nullptr, 0, 0);
+        WaitForThreadpoolTimerCallbacks(m_pTimer, TRUE);
+    }
+
+    m_replacements.clear();
+}
+
+// static
+VOID
+CALLBACK
+RecycleScheduler::TimerCallback(
+    PTP_CALLBACK_INSTANCE,
+    PVOID                   pvContext,
+    PTP_TIMER
+)
+{
+    auto* pScheduler = static_cast<RecycleScheduler*>(pvContext);
+
+    try
+    {
+        pScheduler->ProcessReplacements();
+    }
+    catch (...)
+    {
+        OBSERVE_CAUGHT_EXCEPTION();
+    }
+
+    // Armed only once the callback is done, so that it never runs twice
+    // at the same time. Applications left queued by an exception are
+    // retried with the next run.
+    SRWExclusiveLock lock(pScheduler->m_srwLock);
+    pScheduler->m_fTimerArmed = false;
+    if (!pScheduler->m_fStopped && (!pScheduler->m_queue.empty() || !pScheduler->m_replacements.empty()))
+    {
+        pScheduler->ArmTimer(TIMER_INTERVAL_MS);
+    }
+}
+
+//
+// Only runs on the timer callback, which alone touches m_replacements
+// until Stop waited for it.
+//
+VOID
+RecycleScheduler::ProcessReplacements()
+{
+    const ULONGLONG ullNow = GetTickCount64();
+
+    for (auto itr = m_replacements.begin(); itr != m_replacements.end();)
+    {
+        if (m_applicationManager.IsApplicationReplaced(*itr->pApplicationInfo) ||
+            ullNow - itr->ullStartTick >= REPLACEMENT_TIMEOUT_MS)
+        {
+            const auto pApplicationInfo = std::move(itr->pApplicationInfo);
+            itr = m_replacements.erase(itr);
+
+            m_applicationManager.EndApplicationReplacement(pApplicationInfo);
+        }
+        else
+        {
+            ++itr;
+        }
+    }
+
+    for (;;)
+    {
+        std::shared_ptr<APPLICATION_INFO> pApplicationInfo;
+        {
+            SRWExclusiveLock lock(m_srwLock);
+            if (m_fStopped ||
+                m_queue.empty() ||
+                m_replacements.size() >= m_cMaxReplacements ||
+                ullNow < m_ullNextStartTick)
+            {
+                return;
+            }
+
+            pApplicationInfo = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_ullNextStartTick = ullNow + std::uniform_int_distribution<DWORD>(0, START_JITTER_MS)(m_random);
+        }
+
+        if (m_applicationManager.BeginApplicationReplacement(pApplicationInfo))
+        {
+            m_replacements.push_back({ std::move(pApplicationInfo), ullNow });
+        }
+    }
+}
+
+VOID
+RecycleScheduler::ArmTimer(DWORD dwDueTimeInMs) noexcept
+{
+    // Negative due times are relative, in 100ns units.
+    ULARGE_INTEGER ulDueTime;
+    ulDueTime.QuadPart = static_cast<ULONGLONG>(-static_cast<LONGLONG>(dwDueTimeInMs) * 10000);
+
+    FILETIME ftDueTime;
+    ftDueTime.dwHighDateTime = ulDueTime.HighPart;
+    ftDueTime.dwLowDateTime = ulDueTime.LowPart;
+
+    SetThreadpoolTimer(m_pTimer, &ftDueTime, 0, 0);
+    m_fTimerArmed = true;
+}
@@ -0,0 +1,87 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <Windows.h>
+#include <deque>
+#include <memory>
+#include <random>
+#include <vector>
+
+class APPLICATION_INFO;
+class APPLICATION_MANAGER;
+
+//
+// Rolls the out-of-process applications a configuration change applies to
+// through their replacement, a few at a time, so that a change to a shared
+// parent path does not start every backend at once.
+//
+// An application is replaced once its turn comes, after a random delay
+// following the previous start. The application manager then sends new
+// requests to a new APPLICATION_INFO while the replaced one keeps serving
+// the others, see APPLICATION_MANAGER::BeginApplicationReplacement. The
+// replaced application shuts down once its replacement served a request,
+// or after REPLACEMENT_TIMEOUT_MS if it does not, and frees the slot.
+//
+class RecycleScheduler
+{
+public:
+    explicit
+    RecycleScheduler(APPLICATION_MANAGER& applicationManager) noexcept;
+
+    ~RecycleScheduler();
+
+    RecycleScheduler(const RecycleScheduler&) = delete;
+    RecycleScheduler& operator=(const RecycleScheduler&) = delete;
+
+    // Fails if the timer can't be created, the caller recycles the
+    // applications right away then.
+    HRESULT
+    Schedule(const std::vector<std::shared_ptr<APPLICATION_INFO>>& applications);
+
+    // Drops the applications still queued and waits for the callback,
+    // the application manager shuts the ones it knows of down itself.
+    VOID
+    Stop() noexcept;
+
+private:
+    struct REPLACEMENT
+    {
+        std::shared_ptr<APPLICATION_INFO> pApplicationInfo;
+        ULONGLONG ullStartTick;
+    };
+
+    static
+    VOID
+    CALLBACK
+    TimerCallback(
+        PTP_CALLBACK_INSTANCE   pInstance,
+        PVOID                   pvContext,
+        PTP_TIMER               pTimer
+    );
+
+    VOID
+    ProcessReplacements();
+
+    // Called with m_srwLock held exclusively.
+    VOID
+    ArmTimer(DWORD dwDueTimeInMs) noexcept;
+
+    static constexpr DWORD      TIMER_INTERVAL_MS = 250;
+    static constexpr DWORD      START_JITTER_MS = 2000;
+    static constexpr ULONGLONG  REPLACEMENT_TIMEOUT_MS = 120 * 1000;
+
+    APPLICATION_MANAGER&        m_applicationManager;
+    DWORD                       m_cMaxReplacements;
+
+    SRWLOCK                     m_srwLock {};
+    PTP_TIMER                   m_pTimer;
+    bool                        m_fTimerArmed;
+    bool                        m_fStopped;
+    std::deque<std::shared_ptr<APPLICATION_INFO>> m_queue;
+    std::vector<REPLACEMENT>    m_replacements;
+    // No replacement starts before, set with a random delay after each start.
+    ULONGLONG                   m_ullNextStartTick;
+    std::minstd_rand            m_random;
+};
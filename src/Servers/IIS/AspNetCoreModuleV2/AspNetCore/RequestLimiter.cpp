@@ -0,0 +1,329 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "RequestLimiter.h"
+
+#include "ShimOptions.h"
+#include "SRWExclusiveLock.h"
+#include "exceptions.h"
+#include "debugutil.h"
+
+// static
+HRESULT
+RequestLimiter::Create(
+    const ShimOptions&                  options,
+    std::unique_ptr<RequestLimiter>&    pLimiter
+)
+{
+    pLimiter = nullptr;
+
+    const DWORD dwRate = options.QueryRateLimitRequestsPerSecond();
+    const DWORD dwClientRate = options.QueryClientRateLimitRequestsPerSecond();
+    const DWORD dwMaxActiveRequests = options.QueryMaxActiveRequests();
+
+    if (dwRate == 0 && dwClientRate == 0 && dwMaxActiveRequests == 0)
+    {
+        return S_OK;
+    }
+
+    std::unique_ptr<RequestLimiter> pNewLimiter(new RequestLimiter());
+
+    if (dwRate != 0)
+    {
+        RETURN_IF_FAILED(PER_CPU<TOKEN_BUCKET>::Create([](TOKEN_BUCKET* pBucket)
+        {
+            InitializeSRWLock(&pBucket->srwLock);
+            pBucket->llUnits = 0;
+            pBucket->ullRefillTick = 0;
+        }, &pNewLimiter->m_pApplicationBuckets));
+
+        LONGLONG cBuckets = 0;
+        pNewLimiter->m_pApplicationBuckets->ForEach([&cBuckets](TOKEN_BUCKET*) { cBuckets++; });
+
+        // A request costs as many units as all buckets together gain in a
+        // millisecond at one request per second, so that each bucket is
+        // refilled with its share of the rate.
+        auto& rate = pNewLimiter->m_applicationRate;
+        rate.llUnitsPerMs = dwRate;
+        rate.llUnitsPerRequest = 1000 * cBuckets;
+        rate.llCapacity = max(static_cast<LONGLONG>(options.QueryRateLimitBurst()) * 1000, rate.llUnitsPerRequest);
+
+        const auto ullNowTick = GetTickCount64();
+        pNewLimiter->m_pApplicationBuckets->ForEach([&rate, ullNowTick](TOKEN_BUCKET* pBucket)
+        {
+            pBucket->llUnits = rate.llCapacity;
+            pBucket->ullRefillTick = ullNowTick;
+        });
+    }
+
+    if (dwClientRate != 0)
+    {
+        pNewLimiter->m_pClientStripes = std::make_unique<CLIENT_STRIPE[]>(CLIENT_STRIPES);
+
+        auto& rate = pNewLimiter->m_clientRate;
+        rate.llUnitsPerMs = dwClientRate;
+        rate.llUnitsPerRequest = 1000;
+        rate.llCapacity = max(static_cast<LONGLONG>(options.QueryClientRateLimitBurst()) * 1000, rate.llUnitsPerRequest);
+    }
+
+    pNewLimiter->m_cMaxActiveRequests = static_cast<LONG>(min(dwMaxActiveRequests, static_cast<DWORD>(MAXLONG)));
+    pNewLimiter->m_priorityPaths = options.QueryPriorityPaths();
+
+    LOG_INFOF(L"Limiting requests to %u per second, %u per second per client and %u active.",
+        dwRate, dwClientRate, dwMaxActiveRequests);
+
+    pLimiter = std::move(pNewLimiter);
+    return S_OK;
+}
+
+RequestLimiter::RequestLimiter() noexcept
+    : m_pApplicationBuckets(nullptr),
+      m_applicationRate(),
+      m_clientRate(),
+      m_cMaxActiveRequests(0),
+      m_cActiveRequests(0)
+{
+}
+
+RequestLimiter::~RequestLimiter()
+{
+    if (m_pApplicationBuckets != nullptr)
+    {
+        m_pApplicationBuckets->Dispose();
+        m_pApplicationBuckets = nullptr;
+    }
+}
+
+RequestLimiter::Result
+RequestLimiter::TryAdmit(
+    IHttpRequest&   request
+) noexcept
+{
+    const auto ullNowTick = GetTickCount64();
+
+    if (m_pApplicationBuckets != nullptr && !TryTakeApplicationToken(ullNowTick))
+    {
+        return Result::RateLimited;
+    }
+
+    if (m_pClientStripes != nullptr && !TryTakeClientToken(request.GetRemoteAddress(), ullNowTick))
+    {
+        return Result::RateLimited;
+    }
+
+    if (m_cMaxActiveRequests != 0)
+    {
+        if (InterlockedIncrement(&m_cActiveRequests) > m_cMaxActiveRequests)
+        {
+            InterlockedDecrement(&m_cActiveRequests);
+            return Result::ConcurrencyLimited;
+        }
+    }
+
+    return Result::Admitted;
+}
+
+VOID
+RequestLimiter::Release() noexcept
+{
+    if (m_cMaxActiveRequests != 0)
+    {
+        InterlockedDecrement(&m_cActiveRequests);
+    }
+}
+
+// static
+VOID
+RequestLimiter::SetRejectedResponse(
+    IHttpResponse&  response,
+    Result          result
+) noexcept
+{
+    if (result == Result::RateLimited)
+    {
+        response.SetStatus(429, "Too Many Requests", 0, HRESULT_FROM_WIN32(ERROR_BUSY));
+        LOG_IF_FAILED(response.SetHeader("Retry-After", RETRY_AFTER_SECONDS, static_cast<USHORT>(strlen(RETRY_AFTER_SECONDS)), TRUE));
+    }
+    else
+    {
+        response.SetStatus(503, "Service Unavailable", 2, HRESULT_FROM_WIN32(ERROR_BUSY));
+    }
+}
+
+bool
+RequestLimiter::TryTakeApplicationToken(
+    ULONGLONG   ullNowTick
+) noexcept
+{
+    const auto& rate = m_applicationRate;
+
+    auto tryTake = [&rate, ullNowTick](TOKEN_BUCKET* pBucket)
+    {
+        SRWExclusiveLock lock(pBucket->srwLock);
+
+        Refill(rate, pBucket->llUnits, pBucket->ullRefillTick, ullNowTick);
+        if (pBucket->llUnits < rate.llUnitsPerRequest)
+        {
+            return false;
+        }
+
+        pBucket->llUnits -= rate.llUnitsPerRequest;
+        return true;
+    };
+
+    auto* pLocalBucket = m_pApplicationBuckets->GetLocal();
+    if (tryTake(pLocalBucket))
+    {
+        return true;
+    }
+
+    // Requests that don't spread evenly over the CPUs use the share of
+    // the others.
+    bool fTaken = false;
+    m_pApplicationBuckets->ForEach([&](TOKEN_BUCKET* pBucket)
+    {
+        if (!fTaken && pBucket != pLocalBucket)
+        {
+            fTaken = tryTake(pBucket);
+        }
+    });
+
+    return fTaken;
+}
+
+bool
+RequestLimiter::TryTakeClientToken(
+    const SOCKADDR* pRemoteAddress,
+    ULONGLONG       ullNowTick
+) noexcept
+{
+    CLIENT_KEY key;
+    if (!TryGetClientKey(pRemoteAddress, key))
+    {
+        // Not an IP connection, only the limits of the application apply.
+        return true;
+    }
+
+    const auto& rate = m_clientRate;
+    auto& stripe = m_pClientStripes[CLIENT_KEY_HASH()(key) % CLIENT_STRIPES];
+
+    SRWExclusiveLock lock(stripe.srwLock);
+
+    try
+    {
+        auto itr = stripe.buckets.find(key);
+        if (itr == stripe.buckets.end())
+        {
+            if (stripe.buckets.size() >= MAX_CLIENTS / CLIENT_STRIPES)
+            {
+                // A client whose bucket refilled is as good as a new one.
+                for (auto idle = stripe.buckets.begin(); idle != stripe.buckets.end();)
+                {
+                    Refill(rate, idle->second.llUnits, idle->second.ullRefillTick, ullNowTick);
+                    idle = idle->second.llUnits == rate.llCapacity ? stripe.buckets.erase(idle) : std::next(idle);
+                }
+
+                if (stripe.buckets.size() >= MAX_CLIENTS / CLIENT_STRIPES)
+                {
+                    stripe.buckets.erase(stripe.buckets.begin());
+                }
+            }
+
+            itr = stripe.buckets.emplace(key, CLIENT_BUCKET { rate.llCapacity, ullNowTick }).first;
+        }
+
+        auto& bucket = itr->second;
+        Refill(rate, bucket.llUnits, bucket.ullRefillTick, ullNowTick);
+        if (bucket.llUnits < rate.llUnitsPerRequest)
+        {
+            return false;
+        }
+
+        bucket.llUnits -= rate.llUnitsPerRequest;
+        return true;
+    }
+    catch (...)
+    {
+        // Out of memory for the table, the client is let through.
+        OBSERVE_CAUGHT_EXCEPTION();
+        return true;
+    }
+}
+
+// static
+VOID
+RequestLimiter::Refill(
+    const RATE& rate,
+    LONGLONG&   llUnits,
+    ULONGLONG&  ullRefillTick,
+    ULONGLONG   ullNowTick
+) noexcept
+{
+    if (ullNowTick <= ullRefillTick)
+    {
+        return;
+    }
+
+    const ULONGLONG ullElapsedMs = ullNowTick - ullRefillTick;
+    ullRefillTick = ullNowTick;
+
+    // Also keeps the product below from overflowing after a long pause.
+    if (ullElapsedMs >= static_cast<ULONGLONG>(rate.llCapacity / rate.llUnitsPerMs) + 1)
+    {
+        llUnits = rate.llCapacity;
+        return;
+    }
+
+    llUnits = min(rate.llCapacity, llUnits + static_cast<LONGLONG>(ullElapsedMs) * rate.llUnitsPerMs);
+}
+
+// static
+bool
+RequestLimiter::TryGetClientKey(
+    const SOCKADDR* pRemoteAddress,
+    CLIENT_KEY&     key
+) noexcept
+{
+    if (pRemoteAddress == nullptr)
+    {
+        return false;
+    }
+
+    if (pRemoteAddress->sa_family == AF_INET)
+    {
+        // Keyed like the IPv4-mapped IPv6 address, for dual mode sockets.
+        const auto* pAddress = reinterpret_cast<const SOCKADDR_IN*>(pRemoteAddress);
+        key.ullHigh = 0;
+        key.ullLow = 0xFFFF00000000ULL | pAddress->sin_addr.S_un.S_addr;
+        return true;
+    }
+
+    if (pRemoteAddress->sa_family == AF_INET6)
+    {
+        const auto* pAddress = reinterpret_cast<const SOCKADDR_IN6*>(pRemoteAddress);
+        memcpy(&key.ullHigh, &pAddress->sin6_addr.u.Byte[0], sizeof(key.ullHigh));
+        memcpy(&key.ullLow, &pAddress->sin6_addr.u.Byte[8], sizeof(key.ullLow));
+
+        if (key.ullHigh == 0 && (key.ullLow & 0xFFFFFFFFULL) == 0xFFFF0000ULL)
+        {
+            // Bytes 8 to 15 read little endian, ffff then the IPv4 address.
+            key.ullLow = 0xFFFF00000000ULL | (key.ullLow >> 32);
+        }
+        return true;
+    }
+
+    return false;
+}
+
+size_t
+RequestLimiter::CLIENT_KEY_HASH::operator()(
+    const CLIENT_KEY& key
+) const noexcept
+{
+    // The stripe takes the low bits, mix the address into them.
+    ULONGLONG ullHash = key.ullHigh * 0x9E3779B97F4A7C15ULL ^ key.ullLow;
+    ullHash ^= ullHash >> 33;
+    ullHash *= 0xFF51AFD7ED558CCDULL;
+    ullHash ^= ullHash >> 33;
+    return static_cast<size_t>(ullHash);
+}
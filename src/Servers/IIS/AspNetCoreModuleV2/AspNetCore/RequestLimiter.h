@@ -0,0 +1,156 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include "NonCopyable.h"
+#include "percpu.h"
+#include "PriorityPaths.h"
+
+class ShimOptions;
+
+//
+// Turns away the requests of an application beyond its configured rate or
+// concurrency before a handler is created for them, so that they take
+// neither a managed thread pool thread nor a backend connection.
+//
+// The rate of the application is a token bucket split into one bucket per
+// CPU, each refilled with its share of the rate. A request takes a token
+// from the bucket of its CPU and only looks at the others once that one
+// is empty. The rate of each client IP address is a bucket of its own, in
+// a table striped by address. Active requests are one shared count.
+//
+// Requests for the priorityPaths of the application are not limited.
+//
+// Limits are read once per APPLICATION_INFO, a configuration change that
+// changes them replaces the application info and with it the limiter.
+//
+class RequestLimiter : NonCopyable
+{
+public:
+    enum class Result
+    {
+        Admitted,
+        RateLimited,
+        ConcurrencyLimited
+    };
+
+    // Leaves pLimiter null when options sets no limit.
+    static
+    HRESULT
+    Create(
+        const ShimOptions&                  options,
+        std::unique_ptr<RequestLimiter>&    pLimiter);
+
+    ~RequestLimiter();
+
+    // Admitted without being counted, they don't call Release either.
+    bool
+    IsPriorityRequest(
+        IHttpContext&   context) const noexcept
+    {
+        return m_priorityPaths.Matches(context);
+    }
+
+    Result
+    TryAdmit(
+        IHttpRequest&   request) noexcept;
+
+    // Called once for every admitted request when it finished.
+    VOID
+    Release() noexcept;
+
+    // 429 with a Retry-After for a rate, the 503.2 IIS uses for its own
+    // concurrent request limit otherwise. The response has no body.
+    static
+    VOID
+    SetRejectedResponse(
+        IHttpResponse&  response,
+        Result          result) noexcept;
+
+private:
+    struct RATE
+    {
+        // Units added per millisecond, taken per request and at most held.
+        LONGLONG    llUnitsPerMs;
+        LONGLONG    llUnitsPerRequest;
+        LONGLONG    llCapacity;
+    };
+
+    struct TOKEN_BUCKET
+    {
+        SRWLOCK     srwLock;
+        LONGLONG    llUnits;
+        ULONGLONG   ullRefillTick;
+    };
+
+    struct CLIENT_KEY
+    {
+        ULONGLONG   ullHigh;
+        ULONGLONG   ullLow;
+
+        bool
+        operator==(const CLIENT_KEY& other) const noexcept
+        {
+            return ullHigh == other.ullHigh && ullLow == other.ullLow;
+        }
+    };
+
+    struct CLIENT_KEY_HASH
+    {
+        size_t
+        operator()(const CLIENT_KEY& key) const noexcept;
+    };
+
+    struct CLIENT_BUCKET
+    {
+        LONGLONG    llUnits;
+        ULONGLONG   ullRefillTick;
+    };
+
+    struct alignas(SYSTEM_CACHE_ALIGNMENT_SIZE) CLIENT_STRIPE
+    {
+        SRWLOCK     srwLock {};
+        std::unordered_map<CLIENT_KEY, CLIENT_BUCKET, CLIENT_KEY_HASH> buckets;
+    };
+
+    RequestLimiter() noexcept;
+
+    bool
+    TryTakeApplicationToken(ULONGLONG ullNowTick) noexcept;
+
+    bool
+    TryTakeClientToken(
+        const SOCKADDR* pRemoteAddress,
+        ULONGLONG       ullNowTick) noexcept;
+
+    // Called with the lock of the bucket held.
+    static
+    VOID
+    Refill(
+        const RATE& rate,
+        LONGLONG&   llUnits,
+        ULONGLONG&  ullRefillTick,
+        ULONGLONG   ullNowTick) noexcept;
+
+    static
+    bool
+    TryGetClientKey(
+        const SOCKADDR* pRemoteAddress,
+        CLIENT_KEY&     key) noexcept;
+
+    static constexpr DWORD      CLIENT_STRIPES = 16;
+    // A stripe beyond its share drops the clients whose bucket refilled.
+    static constexpr size_t     MAX_CLIENTS = 16384;
+    static constexpr PCSTR      RETRY_AFTER_SECONDS = "1";
+
+    PER_CPU<TOKEN_BUCKET>*      m_pApplicationBuckets;
+    RATE                        m_applicationRate;
+    std::unique_ptr<CLIENT_STRIPE[]> m_pClientStripes;
+    RATE                        m_clientRate;
+    LONG                        m_cMaxActiveRequests;
+    volatile LONG               m_cActiveRequests;
+    PriorityPaths               m_priorityPaths;
+};
@@ -12,10 +12,20 @@
 #define CS_ASPNETCORE_SHADOW_COPY_DIRECTORY              L"shadowCopyDirectory"
 #define CS_ASPNETCORE_CLEAN_SHADOW_DIRECTORY_CONTENT     L"cleanShadowCopyDirectory"
 #define CS_ASPNETCORE_DISALLOW_ROTATE_CONFIG             L"disallowRotationOnConfigChange"
+#define CS_ASPNETCORE_RATE_LIMIT_REQUESTS_PER_SECOND     L"rateLimitRequestsPerSecond"
+#define CS_ASPNETCORE_RATE_LIMIT_BURST                   L"rateLimitBurst"
+#define CS_ASPNETCORE_CLIENT_RATE_LIMIT_REQUESTS_PER_SECOND L"clientRateLimitRequestsPerSecond"
+#define CS_ASPNETCORE_CLIENT_RATE_LIMIT_BURST            L"clientRateLimitBurst"
+#define CS_ASPNETCORE_MAX_ACTIVE_REQUESTS                L"maxActiveRequests"
 
 ShimOptions::ShimOptions(const ConfigurationSource &configurationSource) :
         m_hostingModel(HOSTING_UNKNOWN),
-        m_fStdoutLogEnabled(false)
+        m_fStdoutLogEnabled(false),
+        m_dwRateLimitRequestsPerSecond(0),
+        m_dwRateLimitBurst(0),
+        m_dwClientRateLimitRequestsPerSecond(0),
+        m_dwClientRateLimitBurst(0),
+        m_dwMaxActiveRequests(0)
 {
     auto const section = configurationSource.GetRequiredSection(CS_ASPNETCORE_SECTION);
     auto hostingModel = section->GetString(CS_ASPNETCORE_HOSTING_MODEL).value_or(L"");
@@ -53,6 +63,19 @@ ShimOptions::ShimOptions(const ConfigurationSource &configurationSource) :
 
     auto disallowRotationOnConfigChange = find_element(handlerSettings, CS_ASPNETCORE_DISALLOW_ROTATE_CONFIG).value_or(std::wstring());
     m_fDisallowRotationOnConfigChange = equals_ignore_case(L"true", disallowRotationOnConfigChange);
+
+    auto readCount = [&handlerSettings](PCWSTR pszName, DWORD dwDefault)
+    {
+        const auto value = find_element(handlerSettings, pszName);
+        return value.has_value() ? static_cast<DWORD>(wcstoul(value->c_str(), nullptr, 10)) : dwDefault;
+    };
+
+    m_dwRateLimitRequestsPerSecond = readCount(CS_ASPNETCORE_RATE_LIMIT_REQUESTS_PER_SECOND, 0);
+    m_dwRateLimitBurst = readCount(CS_ASPNETCORE_RATE_LIMIT_BURST, m_dwRateLimitRequestsPerSecond);
+    m_dwClientRateLimitRequestsPerSecond = readCount(CS_ASPNETCORE_CLIENT_RATE_LIMIT_REQUESTS_PER_SECOND, 0);
+    m_dwClientRateLimitBurst = readCount(CS_ASPNETCORE_CLIENT_RATE_LIMIT_BURST, m_dwClientRateLimitRequestsPerSecond);
+    m_dwMaxActiveRequests = readCount(CS_ASPNETCORE_MAX_ACTIVE_REQUESTS, 0);
+    m_priorityPaths = PriorityPaths(find_element(handlerSettings, CS_ASPNETCORE_HANDLER_PRIORITY_PATHS).value_or(std::wstring()));
                 
     m_strProcessPath = section->GetRequiredString(CS_ASPNETCORE_PROCESS_EXE_PATH);
     m_strArguments = section->GetString(CS_ASPNETCORE_PROCESS_ARGUMENTS).value_or(CS_ASPNETCORE_PROCESS_ARGUMENTS_DEFAULT);
@@ -6,6 +6,7 @@
 #include <string>
 #include "ConfigurationSource.h"
 #include "exceptions.h"
+#include "PriorityPaths.h"
 
 enum APP_HOSTING_MODEL
 {
@@ -89,6 +90,46 @@ public:
         return m_fDisallowRotationOnConfigChange;
     }
 
+    // Requests per second of the application and of each client IP
+    // address, 0 if not limited. The bursts default to a second's worth.
+    DWORD
+    QueryRateLimitRequestsPerSecond() const noexcept
+    {
+        return m_dwRateLimitRequestsPerSecond;
+    }
+
+    DWORD
+    QueryRateLimitBurst() const noexcept
+    {
+        return m_dwRateLimitBurst;
+    }
+
+    DWORD
+    QueryClientRateLimitRequestsPerSecond() const noexcept
+    {
+        return m_dwClientRateLimitRequestsPerSecond;
+    }
+
+    DWORD
+    QueryClientRateLimitBurst() const noexcept
+    {
+        return m_dwClientRateLimitBurst;
+    }
+
+    // Requests of the application handled at the same time, the ones
+    // beyond are rejected. 0 if not limited.
+    DWORD
+    QueryMaxActiveRequests() const noexcept
+    {
+        return m_dwMaxActiveRequests;
+    }
+
+    const PriorityPaths&
+    QueryPriorityPaths() const noexcept
+    {
+        return m_priorityPaths;
+    }
+
     ShimOptions(const ConfigurationSource &configurationSource);
 
 private:
@@ -104,4 +145,10 @@ private:
     bool                           m_fCleanShadowCopyDirectory;
     bool                           m_fDisallowRotationOnConfigChange;
     std::wstring                   m_strShadowCopyingDirectory;
+    DWORD                          m_dwRateLimitRequestsPerSecond;
+    DWORD                          m_dwRateLimitBurst;
+    DWORD                          m_dwClientRateLimitRequestsPerSecond;
+    DWORD                          m_dwClientRateLimitBurst;
+    DWORD                          m_dwMaxActiveRequests;
+    PriorityPaths                  m_priorityPaths;
 };
@@ -17,9 +17,11 @@
 #include "resource.h"
 #include "file_utility.h"
 #include "ModuleEnvironment.h"
+#include "ConfigurationFingerprint.h"
 
 extern HINSTANCE           g_hServerModule;
 extern BOOL                g_fInAppOfflineShutdown;
+extern volatile LONG       g_lConfigurationVersion;
 
 HRESULT
 APPLICATION_INFO::CreateHandler(
@@ -30,9 +32,25 @@ APPLICATION_INFO::CreateHandler(
     HRESULT             hr = S_OK;
 
     {
-        SRWSharedLock lock(m_applicationLock);
+        // No lock, the request is only counted on its CPU while it uses the
+        // published application. Its count is in the epoch it read, which
+        // UnpublishApplication waits to drain before the application goes.
+        const auto epoch = m_readerEpoch.load();
+        auto pReaderCount = &m_pReaderCounts->GetLocal()->counts[epoch];
+        InterlockedIncrement(pReaderCount);
+
+        try
+        {
+            hr = TryCreateHandler(m_pPublishedApplication, pHttpContext, pHandler);
+        }
+        catch (...)
+        {
+            hr = OBSERVE_CAUGHT_EXCEPTION();
+        }
 
-        RETURN_IF_FAILED(hr = TryCreateHandler(pHttpContext, pHandler));
+        InterlockedDecrement(pReaderCount);
+
+        RETURN_IF_FAILED(hr);
 
         if (hr == S_OK)
         {
@@ -41,10 +59,10 @@ APPLICATION_INFO::CreateHandler(
     }
 
     {
-        SRWExclusiveLock lock(m_applicationLock);
+        SRWExclusiveLock lock(m_applicationLock, LockSite::ApplicationInfo);
 
         // check if other thread created application
-        RETURN_IF_FAILED(hr = TryCreateHandler(pHttpContext, pHandler));
+        RETURN_IF_FAILED(hr = TryCreateHandler(m_pApplication.get(), pHttpContext, pHandler));
 
         // In some cases (adding and removing app_offline quickly) application might start and stop immediately
         // so retry until we get valid handler or error
@@ -55,26 +73,64 @@ APPLICATION_INFO::CreateHandler(
             {
                 LOG_INFO(L"Application went offline");
 
+                UnpublishApplication();
+
                 // Call to wait for application to complete stopping
                 m_pApplication->Stop(/* fServerInitiated */ false);
                 m_pApplication = nullptr;
                 m_pApplicationFactory = nullptr;
             }
 
-            RETURN_IF_FAILED(CreateApplication(pHttpContext));
+            hr = CreateApplication(pHttpContext);
+            PublishApplication();
+            RETURN_IF_FAILED(hr);
 
-            RETURN_IF_FAILED(hr = TryCreateHandler(pHttpContext, pHandler));
+            RETURN_IF_FAILED(hr = TryCreateHandler(m_pApplication.get(), pHttpContext, pHandler));
         }
     }
 
     return S_OK;
 }
 
+VOID
+APPLICATION_INFO::PublishApplication()
+{
+    m_pPublishedApplication = m_pApplication.get();
+}
+
+VOID
+APPLICATION_INFO::UnpublishApplication()
+{
+    if (m_pPublishedApplication == nullptr)
+    {
+        return;
+    }
+
+    m_pPublishedApplication = nullptr;
+
+    // Requests that start from now on count in the other epoch and can't
+    // see the application anymore. The ones in the current epoch are done
+    // once they created their handler, none join them, so every count
+    // drops to zero and stays there.
+    const auto epoch = m_readerEpoch.load();
+    m_readerEpoch = 1 - epoch;
+
+    m_pReaderCounts->ForEach([epoch](READER_COUNTS* pCounts)
+    {
+        while (pCounts->counts[epoch] != 0)
+        {
+            SwitchToThread();
+        }
+    });
+}
+
 HRESULT
 APPLICATION_INFO::CreateApplication(IHttpContext& pHttpContext)
 {
     SetApplicationEnvironmentVariables(m_pServer, pHttpContext);
 
+    m_ullConfigurationFingerprint = 0;
+
     auto& pHttpApplication = *pHttpContext.GetApplication();
     if (AppOfflineApplication::ShouldBeStarted(pHttpApplication))
     {
@@ -86,8 +142,34 @@ APPLICATION_INFO::CreateApplication(IHttpContext& pHttpContext)
 
     try
     {
-        const WebConfigConfigurationSource configurationSource(m_pServer.GetAdminManager(), pHttpApplication);
-        ShimOptions options(configurationSource);
+        // Read before parsing, a change while parsing is picked up next time.
+        const LONG configurationVersion = g_lConfigurationVersion;
+        if (m_pShimOptions == nullptr || m_shimOptionsVersion != configurationVersion)
+        {
+            const WebConfigConfigurationSource configurationSource(m_pServer.GetAdminManager(), pHttpApplication);
+            m_pShimOptions = std::make_unique<ShimOptions>(configurationSource);
+            m_shimOptionsVersion = configurationVersion;
+        }
+
+        const ShimOptions& options = *m_pShimOptions;
+
+        // Of the configuration the application is about to be created with.
+        ULONGLONG ullFingerprint = 0;
+        LOG_IF_FAILED(ConfigurationFingerprint::Compute(
+            *m_pServer.GetAdminManager(),
+            m_strConfigPath,
+            options.QueryHostingModel() == APP_HOSTING_MODEL::HOSTING_IN_PROCESS,
+            ullFingerprint));
+
+        if (m_pRequestLimiter == nullptr)
+        {
+            // Without a limiter the requests are not limited, which is
+            // better than failing them.
+            if (SUCCEEDED(LOG_IF_FAILED(RequestLimiter::Create(options, m_pRequestLimiter))))
+            {
+                m_pPublishedRequestLimiter = m_pRequestLimiter.get();
+            }
+        }
 
         if (g_fInAppOfflineShutdown)
         {
@@ -136,6 +218,10 @@ APPLICATION_INFO::CreateApplication(IHttpContext& pHttpContext)
                 errorContext.subStatusCode,
                 "Internal Server Error");
         }
+        else
+        {
+            m_ullConfigurationFingerprint = ullFingerprint;
+        }
         return S_OK;
     }
     catch (const ConfigurationLoadException &ex)
@@ -166,6 +252,24 @@ APPLICATION_INFO::CreateApplication(IHttpContext& pHttpContext)
     return S_OK;
 }
 
+bool
+APPLICATION_INFO::HasConfigurationChanged(bool fInProcess) noexcept
+{
+    const ULONGLONG ullFingerprint = m_ullConfigurationFingerprint;
+    if (ullFingerprint == 0)
+    {
+        return true;
+    }
+
+    ULONGLONG ullCurrent = 0;
+    if (FAILED_LOG(ConfigurationFingerprint::Compute(*m_pServer.GetAdminManager(), m_strConfigPath, fInProcess, ullCurrent)))
+    {
+        return true;
+    }
+
+    return ullCurrent != ullFingerprint;
+}
+
 HRESULT
 APPLICATION_INFO::TryCreateApplication(IHttpContext& pHttpContext, const ShimOptions& options, ErrorContext& error)
 {
@@ -212,13 +316,14 @@ APPLICATION_INFO::TryCreateApplication(IHttpContext& pHttpContext, const ShimOpt
 
 HRESULT
 APPLICATION_INFO::TryCreateHandler(
+    IAPPLICATION* pApplication,
     IHttpContext& pHttpContext,
     std::unique_ptr<IREQUEST_HANDLER, IREQUEST_HANDLER_DELETER>& pHandler) const
 {
-    if (m_pApplication != nullptr)
+    if (pApplication != nullptr)
     {
         IREQUEST_HANDLER * newHandler;
-        const auto result = m_pApplication->TryCreateHandler(&pHttpContext, &newHandler);
+        const auto result = pApplication->TryCreateHandler(&pHttpContext, &newHandler);
         RETURN_IF_FAILED(result);
 
         if (result == S_OK)
@@ -232,18 +337,37 @@ APPLICATION_INFO::TryCreateHandler(
     return S_FALSE;
 }
 
+bool
+APPLICATION_INFO::UsesOtherOutOfProcessHandler(const std::wstring& handlerDllPath)
+{
+    SRWExclusiveLock lock(m_applicationLock, LockSite::ApplicationInfo);
+
+    if (m_pApplicationFactory == nullptr ||
+        m_pShimOptions == nullptr ||
+        m_pShimOptions->QueryHostingModel() != APP_HOSTING_MODEL::HOSTING_OUT_PROCESS ||
+        !m_pShimOptions->QueryHandlerVersion().empty())
+    {
+        return false;
+    }
+
+    const auto& loadedPath = m_pApplicationFactory->QueryHandlerDllPath();
+    return !loadedPath.empty() && _wcsicmp(loadedPath.c_str(), handlerDllPath.c_str()) != 0;
+}
+
 VOID
 APPLICATION_INFO::ShutDownApplication(const bool fServerInitiated)
 {
     IAPPLICATION* app = nullptr;
     {
-        SRWExclusiveLock lock(m_applicationLock);
+        SRWExclusiveLock lock(m_applicationLock, LockSite::ApplicationInfo);
         if (!m_pApplication)
         {
             return;
         }
         app = m_pApplication.get();
 
+        UnpublishApplication();
+
         LOG_INFOF(L"Stopping application '%ls'", QueryApplicationInfoKey().c_str());
         app->Stop(fServerInitiated);
 
@@ -7,6 +7,11 @@
 #include "iapplication.h"
 #include "SRWSharedLock.h"
 #include "HandlerResolver.h"
+#include "exceptions.h"
+#include "StringHelpers.h"
+#include "percpu.h"
+#include "RequestLimiter.h"
+#include <atomic>
 
 constexpr auto API_BUFFER_TOO_SMALL = 0x80008098;
 
@@ -24,12 +29,29 @@ public:
         m_pServer(pServer),
         m_handlerResolver(pHandlerResolver),
         m_strConfigPath(pApplication.GetAppConfigPath()),
-        m_strInfoKey(pApplication.GetApplicationId())
+        m_strInfoKey(pApplication.GetApplicationId()),
+        m_pReaderCounts(nullptr),
+        m_readerEpoch(0),
+        m_pPublishedApplication(nullptr),
+        m_shimOptionsVersion(0),
+        m_ullConfigurationFingerprint(0),
+        m_pPublishedRequestLimiter(nullptr),
+        m_fServedRequest(false)
     {
         InitializeSRWLock(&m_applicationLock);
+
+        THROW_IF_FAILED(PER_CPU<READER_COUNTS>::Create([](READER_COUNTS* pCounts)
+        {
+            pCounts->counts[0] = 0;
+            pCounts->counts[1] = 0;
+        }, &m_pReaderCounts));
     }
 
-    ~APPLICATION_INFO() = default;
+    ~APPLICATION_INFO()
+    {
+        m_pReaderCounts->Dispose();
+        m_pReaderCounts = nullptr;
+    }
 
     const std::wstring&
     QueryApplicationInfoKey() noexcept
@@ -51,28 +73,74 @@ public:
         IHttpContext& pHttpContext,
         std::unique_ptr<IREQUEST_HANDLER, IREQUEST_HANDLER_DELETER>& pHandler);
 
-    bool ConfigurationPathApplies(const std::wstring& path)
+    // Called when a request it created a handler for finishes, tells the
+    // application manager a replacement is ready to take all requests.
+    VOID
+    NotifyRequestFinished(USHORT statusCode) noexcept
     {
-        // We need to check that the last character of the config path
-        // is either a null terminator or a slash.
-        // This checks the case where the config path was
-        // MACHINE/WEBROOT/site and your site path is MACHINE/WEBROOT/siteTest
-        auto const changed = m_strConfigPath._Starts_with(path);
-        if (changed)
+        if (statusCode < 500)
         {
-            const auto lastChar = m_strConfigPath[m_strConfigPath.length()];
-            return lastChar == L'\0' || lastChar == L'/';
+            m_fServedRequest = true;
         }
-        return false;
+    }
+
+    // Null until the options of the first application are read, or if
+    // they set no limit.
+    RequestLimiter*
+    QueryRequestLimiter() const noexcept
+    {
+        return m_pPublishedRequestLimiter;
+    }
+
+    bool
+    HasServedRequest() const noexcept
+    {
+        return m_fServedRequest;
+    }
+
+    // Whether the application runs on an out-of-process handler other than
+    // handlerDllPath and follows the highest version of the global location.
+    bool
+    UsesOtherOutOfProcessHandler(const std::wstring& handlerDllPath);
+
+    // Whether a configuration change touched the settings the application
+    // was created with. Always true for an error or app_offline application,
+    // or when the configuration can't be read.
+    bool
+    HasConfigurationChanged(bool fInProcess) noexcept;
+
+    bool ConfigurationPathApplies(const std::wstring& path)
+    {
+        return starts_with_path(m_strConfigPath, path);
     }
 
 private:
 
+    //
+    // Requests in the middle of creating a handler, per CPU and per epoch
+    // so that replacing the application only waits for the ones that may
+    // have seen it published.
+    //
+    struct READER_COUNTS
+    {
+        volatile LONG counts[2];
+    };
+
     HRESULT
     TryCreateHandler(
+        IAPPLICATION* pApplication,
         IHttpContext& pHttpContext,
         std::unique_ptr<IREQUEST_HANDLER, IREQUEST_HANDLER_DELETER>& pHandler) const;
 
+    // Called with m_applicationLock held exclusively.
+    VOID
+    PublishApplication();
+
+    // Called with m_applicationLock held exclusively, returns once no
+    // request can still be creating a handler with the application.
+    VOID
+    UnpublishApplication();
+
     HRESULT
     CreateApplication(IHttpContext& pHttpContext);
 
@@ -87,9 +155,29 @@ private:
 
     std::wstring            m_strConfigPath;
     std::wstring            m_strInfoKey;
+    // Only taken to create, replace or shut down the application, creating
+    // handlers reads m_pPublishedApplication instead.
     SRWLOCK                 m_applicationLock {};
+    PER_CPU<READER_COUNTS>* m_pReaderCounts;
+    std::atomic<LONG>       m_readerEpoch;
+    std::atomic<IAPPLICATION*> m_pPublishedApplication;
 
     std::unique_ptr<ApplicationFactory> m_pApplicationFactory;
     std::unique_ptr<IAPPLICATION, IAPPLICATION_DELETER> m_pApplication;
+
+    // Parsed with the first application, applications created again after
+    // a recycle reuse them until the configuration changes.
+    std::unique_ptr<ShimOptions> m_pShimOptions;
+    LONG                    m_shimOptionsVersion;
+
+    // ConfigurationFingerprint of the running application, 0 when unknown.
+    std::atomic<ULONGLONG>  m_ullConfigurationFingerprint;
+
+    // Created once with the first options, requests that hold the
+    // application info may use it until the info goes away.
+    std::unique_ptr<RequestLimiter> m_pRequestLimiter;
+    std::atomic<RequestLimiter*> m_pPublishedRequestLimiter;
+
+    std::atomic<bool>       m_fServedRequest;
 };
 
@@ -3,11 +3,14 @@
 
 #include "applicationmanager.h"
 
+#include <algorithm>
+
 #include "proxymodule.h"
 #include "resources.h"
 #include "SRWExclusiveLock.h"
 #include "exceptions.h"
 #include "EventLog.h"
+#include "ApplicationInfoContext.h"
 
 extern BOOL         g_fInShutdown;
 extern BOOL         g_fInAppOfflineShutdown;
@@ -24,6 +27,16 @@ APPLICATION_MANAGER::GetOrCreateApplicationInfo(
 {
     auto &pApplication = *pHttpContext.GetApplication();
 
+    if (g_fInShutdown)
+    {
+        return HRESULT_FROM_WIN32(ERROR_SERVER_SHUTDOWN_IN_PROGRESS);
+    }
+
+    if (TryGetCachedApplicationInfo(pApplication, ppApplicationInfo))
+    {
+        return S_OK;
+    }
+
     // The configuration path is unique for each application and is used for the
     // key in the applicationInfoHash.
     std::wstring pszApplicationId = pApplication.GetApplicationId();
@@ -31,7 +44,7 @@ APPLICATION_MANAGER::GetOrCreateApplicationInfo(
     {
         // When accessing the m_pApplicationInfoHash, we need to acquire the application manager
         // lock to avoid races on setting state.
-        SRWSharedLock readLock(m_srwLock);
+        SRWSharedLock readLock(m_srwLock, LockSite::ApplicationManager);
 
         if (g_fInShutdown)
         {
@@ -41,7 +54,11 @@ APPLICATION_MANAGER::GetOrCreateApplicationInfo(
         const auto pair = m_pApplicationInfoHash.find(pszApplicationId);
         if (pair != m_pApplicationInfoHash.end())
         {
-            ppApplicationInfo = pair->second;
+            if (!TryGetReplacedApplicationInfo(pair->second, ppApplicationInfo))
+            {
+                ppApplicationInfo = pair->second;
+            }
+            CacheApplicationInfo(pApplication, ppApplicationInfo);
             return S_OK;
         }
 
@@ -50,7 +67,7 @@ APPLICATION_MANAGER::GetOrCreateApplicationInfo(
     }
 
     // Take exclusive lock before creating the application
-    SRWExclusiveLock writeLock(m_srwLock);
+    SRWExclusiveLock writeLock(m_srwLock, LockSite::ApplicationManager);
 
     if (!m_fDebugInitialize)
     {
@@ -62,22 +79,265 @@ APPLICATION_MANAGER::GetOrCreateApplicationInfo(
     const auto pair = m_pApplicationInfoHash.find(pszApplicationId);
     if (pair != m_pApplicationInfoHash.end())
     {
-        ppApplicationInfo = pair->second;
+        if (!TryGetReplacedApplicationInfo(pair->second, ppApplicationInfo))
+        {
+            ppApplicationInfo = pair->second;
+        }
+        CacheApplicationInfo(pApplication, ppApplicationInfo);
         return S_OK;
     }
 
     ppApplicationInfo = std::make_shared<APPLICATION_INFO>(m_pHttpServer, pApplication, m_handlerResolver);
     m_pApplicationInfoHash.emplace(pszApplicationId, ppApplicationInfo);
+    m_applicationsByConfigPath.emplace(ppApplicationInfo->QueryConfigPath(), ppApplicationInfo);
+
+    // The request starts the replacement of an application, the others
+    // keep going to the replaced one until it served them.
+    if (m_replacedApplications.find(pszApplicationId) == m_replacedApplications.end())
+    {
+        CacheApplicationInfo(pApplication, ppApplicationInfo);
+    }
 
     return S_OK;
 }
 
+bool
+APPLICATION_MANAGER::TryGetCachedApplicationInfo(
+    _In_ IHttpApplication& pApplication,
+    _Out_ std::shared_ptr<APPLICATION_INFO>& ppApplicationInfo
+)
+{
+    #pragma warning( push )
+    #pragma warning ( disable : 26466 ) // Disable "Don't use static_cast downcasts". We build without RTTI support so dynamic_cast is not available
+    const auto* pContext = static_cast<ApplicationInfoContext*>(pApplication.GetModuleContextContainer()->GetModuleContext(m_moduleId));
+    #pragma warning( pop )
+
+    return pContext != nullptr && pContext->TryGetApplicationInfo(m_applicationInfoVersion, ppApplicationInfo);
+}
+
+//
+// Called with m_srwLock held, so that the version can't change until the
+// application is cached with it.
+//
+VOID
+APPLICATION_MANAGER::CacheApplicationInfo(
+    _In_ IHttpApplication& pApplication,
+    _In_ const std::shared_ptr<APPLICATION_INFO>& pApplicationInfo
+)
+{
+    auto* moduleContainer = pApplication.GetModuleContextContainer();
+
+    #pragma warning( push )
+    #pragma warning ( disable : 26466 ) // Disable "Don't use static_cast downcasts". We build without RTTI support so dynamic_cast is not available
+    auto* pContext = static_cast<ApplicationInfoContext*>(moduleContainer->GetModuleContext(m_moduleId));
+    #pragma warning( pop )
+
+    if (pContext == nullptr)
+    {
+        auto newContext = std::make_unique<ApplicationInfoContext>();
+        // ModuleContextContainer takes ownership of the context, another
+        // request of the application may have set one first.
+        const HRESULT hr = moduleContainer->SetModuleContext(newContext.get(), m_moduleId);
+        if (SUCCEEDED(hr))
+        {
+            pContext = newContext.release();
+        }
+        else if (hr == HRESULT_FROM_WIN32(ERROR_ALREADY_ASSIGNED))
+        {
+            #pragma warning( push )
+            #pragma warning ( disable : 26466 ) // Disable "Don't use static_cast downcasts". We build without RTTI support so dynamic_cast is not available
+            pContext = static_cast<ApplicationInfoContext*>(moduleContainer->GetModuleContext(m_moduleId));
+            #pragma warning( pop )
+        }
+        else
+        {
+            LOG_IF_FAILED(hr);
+        }
+    }
+
+    if (pContext != nullptr)
+    {
+        pContext->SetApplicationInfo(m_applicationInfoVersion, pApplicationInfo);
+    }
+}
+
+//
+// Called with m_srwLock held exclusively.
+//
+VOID
+APPLICATION_MANAGER::ClearApplicationInfoCache()
+{
+    InterlockedIncrement(&m_applicationInfoVersion);
+}
+
+VOID
+APPLICATION_MANAGER::FindApplicationsByConfigPath(
+    _In_ const std::wstring& configurationPath,
+    _Inout_ std::vector<std::shared_ptr<APPLICATION_INFO>>& applications
+)
+{
+    // Every path starting with configurationPath sorts at or after it and
+    // before the first one that does not.
+    for (auto itr = m_applicationsByConfigPath.lower_bound(configurationPath);
+         itr != m_applicationsByConfigPath.end() && itr->first._Starts_with(configurationPath);
+         ++itr)
+    {
+        if (itr->second->ConfigurationPathApplies(configurationPath))
+        {
+            applications.emplace_back(itr->second);
+        }
+    }
+}
+
+VOID
+APPLICATION_MANAGER::RemoveApplicationInfo(
+    _In_ const std::shared_ptr<APPLICATION_INFO>& pApplicationInfo
+)
+{
+    const auto pair = m_pApplicationInfoHash.find(pApplicationInfo->QueryApplicationInfoKey());
+    if (pair == m_pApplicationInfoHash.end() || pair->second != pApplicationInfo)
+    {
+        return;
+    }
+
+    m_pApplicationInfoHash.erase(pair);
+
+    auto [first, last] = m_applicationsByConfigPath.equal_range(pApplicationInfo->QueryConfigPath());
+    for (auto itr = first; itr != last; ++itr)
+    {
+        if (itr->second == pApplicationInfo)
+        {
+            m_applicationsByConfigPath.erase(itr);
+            break;
+        }
+    }
+}
+
+bool
+APPLICATION_MANAGER::TryGetReplacedApplicationInfo(
+    _In_ const std::shared_ptr<APPLICATION_INFO>& pApplicationInfo,
+    _Out_ std::shared_ptr<APPLICATION_INFO>& ppApplicationInfo
+)
+{
+    if (m_replacedApplications.empty() || pApplicationInfo->HasServedRequest())
+    {
+        return false;
+    }
+
+    const auto pair = m_replacedApplications.find(pApplicationInfo->QueryApplicationInfoKey());
+    if (pair == m_replacedApplications.end())
+    {
+        return false;
+    }
+
+    ppApplicationInfo = pair->second;
+    return true;
+}
+
+bool
+APPLICATION_MANAGER::BeginApplicationReplacement(
+    _In_ const std::shared_ptr<APPLICATION_INFO>& pApplicationInfo
+)
+{
+    SRWExclusiveLock lock(m_srwLock, LockSite::ApplicationManager);
+
+    const auto pair = m_pApplicationInfoHash.find(pApplicationInfo->QueryApplicationInfoKey());
+    if (g_fInShutdown || pair == m_pApplicationInfoHash.end() || pair->second != pApplicationInfo)
+    {
+        return false;
+    }
+
+    RemoveApplicationInfo(pApplicationInfo);
+    // Replaces an application whose own replacement did not finish, which
+    // EndApplicationReplacement still shuts down.
+    m_replacedApplications[pApplicationInfo->QueryApplicationInfoKey()] = pApplicationInfo;
+
+    // Requests cached the application, the next one of each IIS
+    // application looks it up again and finds the replacement.
+    ClearApplicationInfoCache();
+
+    // All applications were unloaded reset handler resolver validation logic
+    if (m_pApplicationInfoHash.empty())
+    {
+        m_handlerResolver.ResetHostingModel();
+    }
+
+    return true;
+}
+
+bool
+APPLICATION_MANAGER::IsApplicationReplaced(
+    _In_ APPLICATION_INFO& applicationInfo
+)
+{
+    SRWSharedLock lock(m_srwLock, LockSite::ApplicationManager);
+
+    const auto pair = m_pApplicationInfoHash.find(applicationInfo.QueryApplicationInfoKey());
+    return pair != m_pApplicationInfoHash.end() && pair->second->HasServedRequest();
+}
+
+VOID
+APPLICATION_MANAGER::EndApplicationReplacement(
+    _In_ const std::shared_ptr<APPLICATION_INFO>& pApplicationInfo
+)
+{
+    {
+        SRWExclusiveLock lock(m_srwLock, LockSite::ApplicationManager);
+
+        const auto pair = m_replacedApplications.find(pApplicationInfo->QueryApplicationInfoKey());
+        if (pair != m_replacedApplications.end() && pair->second == pApplicationInfo)
+        {
+            m_replacedApplications.erase(pair);
+        }
+
+        ClearApplicationInfoCache();
+    }
+
+    ShutDownRecycledApplication(*pApplicationInfo, pApplicationInfo->QueryConfigPath().c_str());
+}
+
+VOID
+APPLICATION_MANAGER::ShutDownRecycledApplication(
+    _In_ APPLICATION_INFO& applicationInfo,
+    _In_ LPCWSTR pszConfigurationPath
+)
+{
+    try
+    {
+        applicationInfo.ShutDownApplication(/* fServerInitiated */ false);
+    }
+    catch (...)
+    {
+        LOG_ERRORF(L"Failed to stop application '%ls'", applicationInfo.QueryApplicationInfoKey().c_str());
+        OBSERVE_CAUGHT_EXCEPTION()
+
+        // Failed to recycle an application. Log an event
+        EventLog::Error(
+            ASPNETCORE_EVENT_RECYCLE_APP_FAILURE,
+            ASPNETCORE_EVENT_RECYCLE_FAILURE_CONFIGURATION_MSG,
+            pszConfigurationPath);
+        // Need to recycle the process as we cannot recycle the application
+        if (!g_fRecycleProcessCalled)
+        {
+            g_fRecycleProcessCalled = TRUE;
+            m_pHttpServer.RecycleProcess(L"AspNetCore Recycle Process on Demand Due Application Recycle Error");
+        }
+    }
+}
+
 //
-// Finds any applications affected by a configuration change and calls Recycle on them
+// Finds any applications affected by a configuration change and calls Recycle on them,
+// except the ones whose configuration fingerprint shows the change missed their settings.
 // InProcess:  Triggers g_httpServer->RecycleProcess() and keep the application inside of the manager.
 //             This will cause a shutdown event to occur through the global stop listening event.
-// OutOfProcess: Removes all applications in the application manager and calls Recycle, which will call Shutdown,
-//             on each application.
+// OutOfProcess: Hands the applications to the recycle scheduler, which replaces a few of them at
+//             a time and shuts each down once its replacement served a request. If it can't, they
+//             are removed from the application manager and shut down right away.
+//
+// The applications are found through the configuration path index, so
+// that request path lookups wait on m_srwLock for as long as it takes to
+// find and remove the affected ones, not for a scan of every application.
+// They are shut down after it is released.
 //
 HRESULT
 APPLICATION_MANAGER::RecycleApplicationFromManager(
@@ -87,6 +347,7 @@ APPLICATION_MANAGER::RecycleApplicationFromManager(
     try
     {
         std::vector<std::shared_ptr<APPLICATION_INFO>> applicationsToRecycle;
+        bool fInProcess;
 
         if (g_fInShutdown)
         {
@@ -96,47 +357,80 @@ APPLICATION_MANAGER::RecycleApplicationFromManager(
         }
 
         {
-            SRWExclusiveLock lock(m_srwLock);
+            SRWExclusiveLock lock(m_srwLock, LockSite::ApplicationManager);
             if (g_fInShutdown)
             {
                 return S_OK;
             }
             const std::wstring configurationPath = pszApplicationId;
 
-            auto itr = m_pApplicationInfoHash.begin();
-            while (itr != m_pApplicationInfoHash.end())
+            fInProcess = m_handlerResolver.GetHostingModel() == APP_HOSTING_MODEL::HOSTING_IN_PROCESS;
+
+            FindApplicationsByConfigPath(configurationPath, applicationsToRecycle);
+
+            // All applications were unloaded reset handler resolver validation logic
+            if (m_pApplicationInfoHash.empty())
             {
-                if (itr->second->ConfigurationPathApplies(configurationPath))
+                m_handlerResolver.ResetHostingModel();
+            }
+        }
+
+        // Reading the configuration of each is too slow for the lock. An
+        // application whose settings are all the same is left running, a
+        // cold start would gain it nothing.
+        applicationsToRecycle.erase(
+            std::remove_if(applicationsToRecycle.begin(), applicationsToRecycle.end(),
+                [fInProcess](const std::shared_ptr<APPLICATION_INFO>& application)
                 {
-                    applicationsToRecycle.emplace_back(itr->second);
-                    // Delay deleting an in-process app until after shutting the application down to avoid creating
-                    // another application info, which would just return app_offline.
-                    if (m_handlerResolver.GetHostingModel() == APP_HOSTING_MODEL::HOSTING_IN_PROCESS)
-                    {
-                        ++itr;
-                    }
-                    else
+                    if (application->HasConfigurationChanged(fInProcess))
                     {
-                        itr = m_pApplicationInfoHash.erase(itr);
+                        return false;
                     }
-                }
-                else
-                {
-                    ++itr;
 
-                }
+                    LOG_INFOF(L"Configuration of '%ls' is unchanged, not recycling it", application->QueryConfigPath().c_str());
+                    return true;
+                }),
+            applicationsToRecycle.end());
+
+        if (applicationsToRecycle.empty())
+        {
+            return S_OK;
+        }
+
+        if (fInProcess)
+        {
+            SRWExclusiveLock lock(m_srwLock, LockSite::ApplicationManager);
+            if (g_fInShutdown)
+            {
+                return S_OK;
             }
 
-            if (m_handlerResolver.GetHostingModel() == APP_HOSTING_MODEL::HOSTING_IN_PROCESS)
+            // For detecting app_offline when the app_offline file isn't present.
+            // Normally, app_offline state is independent of application
+            // (Just checks for app_offline file).
+            // For shadow copying, we need some other indication that the app is offline.
+            g_fInAppOfflineShutdown = true;
+        }
+
+        // The applications keep serving until their replacement does.
+        if (!fInProcess && SUCCEEDED_LOG(m_recycleScheduler.Schedule(applicationsToRecycle)))
+        {
+            return S_OK;
+        }
+
+        // Delay deleting an in-process app until after shutting the application down to avoid creating
+        // another application info, which would just return app_offline.
+        if (!fInProcess)
+        {
+            SRWExclusiveLock lock(m_srwLock, LockSite::ApplicationManager);
+
+            for (const auto& application : applicationsToRecycle)
             {
-                // For detecting app_offline when the app_offline file isn't present.
-                // Normally, app_offline state is independent of application
-                // (Just checks for app_offline file).
-                // For shadow copying, we need some other indication that the app is offline.
-                g_fInAppOfflineShutdown = true;
+                RemoveApplicationInfo(application);
             }
 
-            // All applications were unloaded reset handler resolver validation logic
+            ClearApplicationInfoCache();
+
             if (m_pApplicationInfoHash.empty())
             {
                 m_handlerResolver.ResetHostingModel();
@@ -147,56 +441,24 @@ APPLICATION_MANAGER::RecycleApplicationFromManager(
         // OutOfProcess: we will create a new application with new configuration
         // InProcess: the request would have to be rejected, as we are about to call g_HttpServer->RecycleProcess
         // on the worker process
-
-        if (!applicationsToRecycle.empty())
+        for (auto& application : applicationsToRecycle)
         {
-            for (auto& application : applicationsToRecycle)
-            {
-                try
-                {
-                    application->ShutDownApplication(/* fServerInitiated */ false);
-                }
-                catch (...)
-                {
-                    LOG_ERRORF(L"Failed to stop application '%ls'", application->QueryApplicationInfoKey().c_str());
-                    OBSERVE_CAUGHT_EXCEPTION()
-
-                    // Failed to recycle an application. Log an event
-                    EventLog::Error(
-                        ASPNETCORE_EVENT_RECYCLE_APP_FAILURE,
-                        ASPNETCORE_EVENT_RECYCLE_FAILURE_CONFIGURATION_MSG,
-                        pszApplicationId);
-                    // Need to recycle the process as we cannot recycle the application
-                    if (!g_fRecycleProcessCalled)
-                    {
-                        g_fRecycleProcessCalled = TRUE;
-                        m_pHttpServer.RecycleProcess(L"AspNetCore Recycle Process on Demand Due Application Recycle Error");
-                    }
-                }
-            }
+            ShutDownRecycledApplication(*application, pszApplicationId);
         }
 
         // Remove apps after calling shutdown on each of them
         // This is exclusive to in-process, as the shutdown of an in-process app recycles
         // the entire worker process.
-        if (m_handlerResolver.GetHostingModel() == APP_HOSTING_MODEL::HOSTING_IN_PROCESS)
+        if (fInProcess)
         {
-            SRWExclusiveLock lock(m_srwLock);
-            const std::wstring configurationPath = pszApplicationId;
+            SRWExclusiveLock lock(m_srwLock, LockSite::ApplicationManager);
 
-            auto itr = m_pApplicationInfoHash.begin();
-            while (itr != m_pApplicationInfoHash.end())
+            for (const auto& application : applicationsToRecycle)
             {
-                if (itr->second != nullptr && itr->second->ConfigurationPathApplies(configurationPath)
-                    && std::find(applicationsToRecycle.begin(), applicationsToRecycle.end(), itr->second) != applicationsToRecycle.end())
-                {
-                    itr = m_pApplicationInfoHash.erase(itr);
-                }
-                else
-                {
-                    ++itr;
-                }
+                RemoveApplicationInfo(application);
             }
+
+            ClearApplicationInfoCache();
         } // Release Exclusive m_srwLock
     }
     CATCH_RETURN()
@@ -208,6 +470,83 @@ APPLICATION_MANAGER::RecycleApplicationFromManager(
 // Shutsdown all applications in the application hashtable
 // Only called by OnGlobalStopListening.
 //
+HRESULT
+APPLICATION_MANAGER::PreloadRequestHandler()
+{
+    if (g_fInShutdown)
+    {
+        return S_OK;
+    }
+
+    return m_handlerResolver.PreloadOutOfProcessRequestHandler();
+}
+
+HRESULT
+APPLICATION_MANAGER::EnableHandlerHotSwap()
+{
+    std::wstring moduleFolderPath;
+    RETURN_IF_FAILED(m_handlerResolver.EnableSideBySideOutOfProcessHandlers(moduleFolderPath));
+
+    return m_handlerUpgradeWatcher.Start(moduleFolderPath);
+}
+
+//
+// The applications keep serving on the older handler until their
+// replacement, created with the new one, served a request.
+//
+HRESULT
+APPLICATION_MANAGER::UpgradeOutOfProcessHandler()
+{
+    if (g_fInShutdown)
+    {
+        return S_OK;
+    }
+
+    std::wstring handlerDllPath;
+    RETURN_IF_FAILED(m_handlerResolver.LoadLatestOutOfProcessRequestHandler(handlerDllPath));
+
+    try
+    {
+        std::vector<std::shared_ptr<APPLICATION_INFO>> applications;
+        {
+            SRWSharedLock lock(m_srwLock, LockSite::ApplicationManager);
+
+            if (g_fInShutdown || m_handlerResolver.GetHostingModel() != APP_HOSTING_MODEL::HOSTING_OUT_PROCESS)
+            {
+                return S_OK;
+            }
+
+            for (const auto& [key, applicationInfo] : m_pApplicationInfoHash)
+            {
+                applications.emplace_back(applicationInfo);
+            }
+        }
+
+        // Outside of the lock, an application being created holds its own
+        // lock for the start.
+        std::vector<std::shared_ptr<APPLICATION_INFO>> applicationsToReplace;
+        for (auto& applicationInfo : applications)
+        {
+            if (applicationInfo->UsesOtherOutOfProcessHandler(handlerDllPath))
+            {
+                applicationsToReplace.emplace_back(std::move(applicationInfo));
+            }
+        }
+
+        if (applicationsToReplace.empty())
+        {
+            return S_OK;
+        }
+
+        LOG_INFOF(L"Replacing %zu applications with request handler '%ls'", applicationsToReplace.size(), handlerDllPath.c_str());
+
+        RETURN_IF_FAILED(m_recycleScheduler.Schedule(applicationsToReplace));
+    }
+    CATCH_RETURN();
+
+    return S_OK;
+}
+
 VOID
 APPLICATION_MANAGER::ShutDown()
 {
@@ -217,11 +556,155 @@ APPLICATION_MANAGER::ShutDown()
     g_fInShutdown = TRUE;
     g_fInAppOfflineShutdown = true;
 
+    // Before taking the lock, replacements in progress take it as well.
+    m_handlerUpgradeWatcher.Stop();
+    m_recycleScheduler.Stop();
+
     // During shutdown we lock until we delete the application
-    SRWExclusiveLock lock(m_srwLock);
-    for (auto & [str, applicationInfo] : m_pApplicationInfoHash)
+    SRWExclusiveLock lock(m_srwLock, LockSite::ApplicationManager);
+
+    std::vector<std::shared_ptr<APPLICATION_INFO>> applications;
+    try
+    {
+        applications.reserve(m_pApplicationInfoHash.size() + m_replacedApplications.size());
+        for (auto & [str, applicationInfo] : m_pApplicationInfoHash)
+        {
+            applications.emplace_back(std::move(applicationInfo));
+        }
+        for (auto & [str, applicationInfo] : m_replacedApplications)
+        {
+            applications.emplace_back(applicationInfo);
+        }
+    }
+    catch (...)
+    {
+        OBSERVE_CAUGHT_EXCEPTION();
+    }
+    m_applicationsByConfigPath.clear();
+    m_replacedApplications.clear();
+
+    ShutDownApplications(applications);
+
+    ClearApplicationInfoCache();
+}
+
+VOID
+APPLICATION_MANAGER::ShutDownApplications(
+    _In_ const std::vector<std::shared_ptr<APPLICATION_INFO>>& applications
+)
+{
+    if (applications.empty())
     {
-        applicationInfo->ShutDownApplication(/* fServerInitiated */ true);
-        applicationInfo = nullptr;
+        return;
     }
+
+    const ULONGLONG ullStartTick = GetTickCount64();
+
+    std::shared_ptr<SHUTDOWN_BATCH> pBatch;
+    try
+    {
+        pBatch = std::make_shared<SHUTDOWN_BATCH>();
+        pBatch->hStopped = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    }
+    catch (...)
+    {
+        OBSERVE_CAUGHT_EXCEPTION();
+    }
+
+    if (pBatch == nullptr || pBatch->hStopped == nullptr)
+    {
+        LOG_LAST_ERROR_IF(pBatch != nullptr);
+
+        // One after another on this thread instead.
+        for (const auto& pApplicationInfo : applications)
+        {
+            ShutDownApplicationAndLog(*pApplicationInfo);
+        }
+        return;
+    }
+
+    // Held by this thread until all are submitted, so that the event is
+    // only set once.
+    pBatch->cPending = 1;
+
+    for (const auto& pApplicationInfo : applications)
+    {
+        InterlockedIncrement(&pBatch->cPending);
+
+        auto pWorkItem = new (std::nothrow) SHUTDOWN_WORK_ITEM { pBatch, pApplicationInfo };
+        if (pWorkItem == nullptr ||
+            !TrySubmitThreadpoolCallback(ShutDownApplicationCallback, pWorkItem, nullptr))
+        {
+            LOG_LAST_ERROR();
+
+            if (pWorkItem == nullptr)
+            {
+                ShutDownApplicationAndLog(*pApplicationInfo);
+                InterlockedDecrement(&pBatch->cPending);
+            }
+            else
+            {
+                ShutDownApplicationCallback(nullptr, pWorkItem);
+            }
+        }
+    }
+
+    if (InterlockedDecrement(&pBatch->cPending) == 0)
+    {
+        SetEvent(pBatch->hStopped);
+    }
+
+    if (WaitForSingleObject(pBatch->hStopped, SHUTDOWN_DEADLINE_MS) != WAIT_OBJECT_0)
+    {
+        LOG_WARNF(L"%ld of %zu applications did not stop within %u ms",
+            InterlockedCompareExchange(&pBatch->cPending, 0, 0),
+            applications.size(),
+            SHUTDOWN_DEADLINE_MS);
+        return;
+    }
+
+    LOG_INFOF(L"Stopped %zu applications in %llu ms", applications.size(), GetTickCount64() - ullStartTick);
+}
+
+// static
+VOID
+CALLBACK
+APPLICATION_MANAGER::ShutDownApplicationCallback(
+    _Inout_ PTP_CALLBACK_INSTANCE   Instance,
+    _Inout_opt_ PVOID               pContext
+)
+{
+    UNREFERENCED_PARAMETER(Instance);
+
+    std::unique_ptr<SHUTDOWN_WORK_ITEM> pWorkItem(static_cast<SHUTDOWN_WORK_ITEM*>(pContext));
+
+    ShutDownApplicationAndLog(*pWorkItem->pApplicationInfo);
+
+    if (InterlockedDecrement(&pWorkItem->pBatch->cPending) == 0)
+    {
+        SetEvent(pWorkItem->pBatch->hStopped);
+    }
+}
+
+// static
+VOID
+APPLICATION_MANAGER::ShutDownApplicationAndLog(
+    _In_ APPLICATION_INFO& applicationInfo
+) noexcept
+{
+    const ULONGLONG ullStartTick = GetTickCount64();
+
+    try
+    {
+        applicationInfo.ShutDownApplication(/* fServerInitiated */ true);
+    }
+    catch (...)
+    {
+        LOG_ERRORF(L"Failed to stop application '%ls'", applicationInfo.QueryApplicationInfoKey().c_str());
+        OBSERVE_CAUGHT_EXCEPTION();
+    }
+
+    LOG_INFOF(L"Application '%ls' took %llu ms to stop",
+        applicationInfo.QueryApplicationInfoKey().c_str(),
+        GetTickCount64() - ullStartTick);
 }
@@ -4,8 +4,12 @@
 #pragma once
 
 #include "applicationinfo.h"
+#include "RecycleScheduler.h"
+#include "HandlerUpgradeWatcher.h"
 #include "exceptions.h"
+#include "HandleWrapper.h"
 #include <unordered_map>
+#include <map>
 
 //
 // This class will manage the lifecycle of all Asp.Net Core application
@@ -31,12 +35,31 @@ public:
 
     VOID
     ShutDown();
+
+    // Run on a background thread by RegisterModule when the
+    // PreloadOutOfProcessHandler parameter is set.
+    HRESULT
+    PreloadRequestHandler();
+
+    // Called by RegisterModule when the HotSwapOutOfProcessHandler
+    // parameter is set, see HandlerUpgradeWatcher.
+    HRESULT
+    EnableHandlerHotSwap();
+
+    // Loads the highest out-of-process handler of the global location and
+    // replaces the applications that run on an older one.
+    HRESULT
+    UpgradeOutOfProcessHandler();
     
-    APPLICATION_MANAGER(HMODULE hModule, IHttpServer& pHttpServer) :
+    APPLICATION_MANAGER(HMODULE hModule, HTTP_MODULE_ID moduleId, IHttpServer& pHttpServer) :
                             m_pApplicationInfoHash(NULL),
+                            m_moduleId(moduleId),
+                            m_applicationInfoVersion(1),
                             m_fDebugInitialize(FALSE),
                             m_pHttpServer(pHttpServer),
-                            m_handlerResolver(hModule, pHttpServer)
+                            m_handlerResolver(hModule, pHttpServer),
+                            m_recycleScheduler(*this),
+                            m_handlerUpgradeWatcher(*this)
     {
         InitializeSRWLock(&m_srwLock);
     }
@@ -49,9 +72,134 @@ public:
 
 private:
 
+    friend class RecycleScheduler;
+
+    bool
+    TryGetCachedApplicationInfo(
+        _In_ IHttpApplication& pApplication,
+        _Out_ std::shared_ptr<APPLICATION_INFO>& ppApplicationInfo
+    );
+
+    VOID
+    CacheApplicationInfo(
+        _In_ IHttpApplication& pApplication,
+        _In_ const std::shared_ptr<APPLICATION_INFO>& pApplicationInfo
+    );
+
+    // The applications that are cached in the module context of an IIS
+    // application are only used as long as the version did not change.
+    VOID
+    ClearApplicationInfoCache();
+
+    // Appends the applications a change of configurationPath applies to,
+    // found in the configuration path index in the time of a lookup
+    // plus one step per application. Called with m_srwLock held.
+    VOID
+    FindApplicationsByConfigPath(
+        _In_ const std::wstring& configurationPath,
+        _Inout_ std::vector<std::shared_ptr<APPLICATION_INFO>>& applications
+    );
+
+    // Removes the application from the hash and the index, unless another
+    // one replaced it. Called with m_srwLock held exclusively.
+    VOID
+    RemoveApplicationInfo(
+        _In_ const std::shared_ptr<APPLICATION_INFO>& pApplicationInfo
+    );
+
+    // Called with m_srwLock held. Returns the application that keeps
+    // serving the requests of an application id while pApplicationInfo,
+    // its replacement, did not serve one yet.
+    bool
+    TryGetReplacedApplicationInfo(
+        _In_ const std::shared_ptr<APPLICATION_INFO>& pApplicationInfo,
+        _Out_ std::shared_ptr<APPLICATION_INFO>& ppApplicationInfo
+    );
+
+    // Takes the application out of the hash so that the next request of
+    // its id creates a replacement, it serves the others until then. Returns
+    // false if it was removed meanwhile.
+    bool
+    BeginApplicationReplacement(
+        _In_ const std::shared_ptr<APPLICATION_INFO>& pApplicationInfo
+    );
+
+    // Whether the replacement of the application served a request.
+    bool
+    IsApplicationReplaced(
+        _In_ APPLICATION_INFO& applicationInfo
+    );
+
+    // Sends every request of the application id to its replacement and
+    // shuts the application down.
+    VOID
+    EndApplicationReplacement(
+        _In_ const std::shared_ptr<APPLICATION_INFO>& pApplicationInfo
+    );
+
+    VOID
+    ShutDownRecycledApplication(
+        _In_ APPLICATION_INFO& applicationInfo,
+        _In_ LPCWSTR pszConfigurationPath
+    );
+
+    // The applications stopped together by ShutDown, freed with the last
+    // of their work items.
+    struct SHUTDOWN_BATCH
+    {
+        HandleWrapper<NullHandleTraits>     hStopped;
+        volatile LONG                       cPending;
+    };
+
+    struct SHUTDOWN_WORK_ITEM
+    {
+        std::shared_ptr<SHUTDOWN_BATCH>     pBatch;
+        std::shared_ptr<APPLICATION_INFO>   pApplicationInfo;
+    };
+
+    // Stops the applications in parallel on the thread pool and waits for
+    // them at most SHUTDOWN_DEADLINE_MS. The ones still stopping after it
+    // go on while the worker process exits.
+    static
+    VOID
+    ShutDownApplications(
+        _In_ const std::vector<std::shared_ptr<APPLICATION_INFO>>& applications
+    );
+
+    static
+    VOID
+    CALLBACK
+    ShutDownApplicationCallback(
+        _Inout_ PTP_CALLBACK_INSTANCE   Instance,
+        _Inout_opt_ PVOID               pContext
+    );
+
+    // Logs how long the application took to stop.
+    static
+    VOID
+    ShutDownApplicationAndLog(
+        _In_ APPLICATION_INFO& applicationInfo
+    ) noexcept;
+
+    // The default shutdownTimeLimit of an application pool, WAS terminates
+    // the worker process after it anyway.
+    static constexpr DWORD      SHUTDOWN_DEADLINE_MS = 90 * 1000;
+
     std::unordered_map<std::wstring, std::shared_ptr<APPLICATION_INFO>>      m_pApplicationInfoHash;
+    // The applications of m_pApplicationInfoHash ordered by configuration
+    // path, so that the ones under a changed path are next to each other.
+    std::multimap<std::wstring, std::shared_ptr<APPLICATION_INFO>>           m_applicationsByConfigPath;
     SRWLOCK                     m_srwLock {};
+    HTTP_MODULE_ID              m_moduleId;
+    // Bumped with m_srwLock held exclusively whenever applications are removed
+    volatile LONG               m_applicationInfoVersion;
     BOOL                        m_fDebugInitialize;
     IHttpServer                &m_pHttpServer;
     HandlerResolver             m_handlerResolver;
+    // Out-of-process applications being replaced by RecycleScheduler, by
+    // application id.
+    std::unordered_map<std::wstring, std::shared_ptr<APPLICATION_INFO>>      m_replacedApplications;
+    // Last, so that they stop before the rest of the manager goes.
+    RecycleScheduler            m_recycleScheduler;
+    HandlerUpgradeWatcher       m_handlerUpgradeWatcher;
 };
@@ -11,6 +11,7 @@
 #include "exceptions.h"
 #include "EventLog.h"
 #include "RegistryKey.h"
+#include <thread>
 
 DECLARE_DEBUG_PRINT_OBJECT("aspnetcorev2.dll");
 
@@ -18,6 +19,8 @@ HANDLE              g_hEventLog = nullptr;
 BOOL                g_fRecycleProcessCalled = FALSE;
 BOOL                g_fInShutdown = FALSE;
 BOOL                g_fInAppOfflineShutdown = FALSE;
+// Incremented on every configuration change notification
+volatile LONG       g_lConfigurationVersion = 0;
 HINSTANCE           g_hServerModule;
 DWORD               g_dwIISServerVersion;
 
@@ -26,6 +29,7 @@ StaticCleanup()
 {
     if (g_hEventLog != nullptr)
     {
+        EventLog::Stop();
         DeregisterEventSource(g_hEventLog);
         g_hEventLog = nullptr;
     }
@@ -102,7 +106,10 @@ HRESULT
         g_hEventLog = RegisterEventSource(nullptr, ASPNETCORE_EVENT_PROVIDER);
     }
 
-    auto fDisableModule = RegistryKey::TryGetDWORD(HKEY_LOCAL_MACHINE, L"SOFTWARE\\Microsoft\\IIS Extensions\\IIS AspNetCore Module V2\\Parameters", L"DisableANCM");
+    auto& parameters = CachedRegistryKey::Get(HKEY_LOCAL_MACHINE, L"SOFTWARE\\Microsoft\\IIS Extensions\\IIS AspNetCore Module V2\\Parameters");
+    auto fDisableModule = parameters.TryGetDWORD(L"DisableANCM");
+    auto fPreloadHandler = parameters.TryGetDWORD(L"PreloadOutOfProcessHandler");
+    auto fHotSwapHandler = parameters.TryGetDWORD(L"HotSwapOutOfProcessHandler");
 
     if (fDisableModule.has_value() && fDisableModule.value() != 0)
     {
@@ -118,9 +125,26 @@ HRESULT
     // static object initialized.
     //
 
-    auto applicationManager = std::make_shared<APPLICATION_MANAGER>(g_hServerModule, *pHttpServer);
+    auto applicationManager = std::make_shared<APPLICATION_MANAGER>(g_hServerModule, pModuleInfo->GetId(), *pHttpServer);
     auto moduleFactory = std::make_unique<ASPNET_CORE_PROXY_MODULE_FACTORY>(pModuleInfo->GetId(), applicationManager);
 
+    // Before any handler is loaded, so that they are all found by path.
+    if (fHotSwapHandler.has_value() && fHotSwapHandler.value() != 0)
+    {
+        LOG_IF_FAILED(applicationManager->EnableHandlerHotSwap());
+    }
+
+    if (fPreloadHandler.has_value() && fPreloadHandler.value() != 0)
+    {
+        // The in-process handler is found through hostfxr, per application.
+        std::thread preloadThread([](std::shared_ptr<APPLICATION_MANAGER> applicationManager)
+        {
+            LOG_IF_FAILED(applicationManager->PreloadRequestHandler());
+        }, applicationManager);
+
+        preloadThread.detach();
+    }
+
     RETURN_IF_FAILED(pModuleInfo->SetRequestNotifications(
                                   moduleFactory.release(),
                                   RQ_EXECUTE_REQUEST_HANDLER,
@@ -131,6 +155,7 @@ HRESULT
     RETURN_IF_FAILED(pModuleInfo->SetGlobalNotifications(
                                      pGlobalModule.release(),
                                      GL_CONFIGURATION_CHANGE | // Configuration change triggers IIS application stop
+                                     GL_APPLICATION_PRELOAD | // application with preloadEnabled starts eagerly
                                      GL_STOP_LISTENING));   // worker process stop or recycle
 
     return S_OK;
@@ -4,6 +4,7 @@
 #include "globalmodule.h"
 
 extern BOOL         g_fInShutdown;
+extern volatile LONG g_lConfigurationVersion;
 
 ASPNET_CORE_GLOBAL_MODULE::ASPNET_CORE_GLOBAL_MODULE(std::shared_ptr<APPLICATION_MANAGER> pApplicationManager) noexcept
     :m_pApplicationManager(std::move(pApplicationManager))
@@ -49,6 +50,10 @@ ASPNET_CORE_GLOBAL_MODULE::OnGlobalConfigurationChange(
     {
         return GL_NOTIFICATION_CONTINUE;
     }
+    // Any change may be inherited by an application, their parsed options
+    // are read again.
+    InterlockedIncrement(&g_lConfigurationVersion);
+
     // Retrieve the path that has changed.
     PCWSTR pwszChangePath = pProvider->GetChangePath();
 
@@ -70,3 +75,38 @@ ASPNET_CORE_GLOBAL_MODULE::OnGlobalConfigurationChange(
     // Return processing to the pipeline.
     return GL_NOTIFICATION_CONTINUE;
 }
+
+//
+// Is called at worker process startup for each application with
+// preloadEnabled, and again for the new worker process of a recycle.
+// Sends the application a request of its own so that it, and its backend
+// out of process, is started before the first user request arrives.
+// IIS executes the requests of the applications concurrently.
+//
+GLOBAL_NOTIFICATION_STATUS
+ASPNET_CORE_GLOBAL_MODULE::OnGlobalApplicationPreload(
+    _In_ IGlobalApplicationPreloadProvider * pProvider
+)
+{
+    IHttpContext* pHttpContext = nullptr;
+
+    if (g_fInShutdown || !m_pApplicationManager)
+    {
+        return GL_NOTIFICATION_CONTINUE;
+    }
+
+    if (FAILED_LOG(pProvider->CreateContext(&pHttpContext)))
+    {
+        return GL_NOTIFICATION_CONTINUE;
+    }
+
+    LOG_INFOF(L"ASPNET_CORE_GLOBAL_MODULE::OnGlobalApplicationPreload '%ls'",
+        pHttpContext->GetApplication()->GetAppConfigPath());
+
+    // Goes through the pipeline like any request, the application is
+    // created by the handler for its root the way the first request would.
+    // A failure leaves it to the first request to start it.
+    LOG_IF_FAILED(pProvider->ExecuteRequest(pHttpContext, nullptr));
+
+    return GL_NOTIFICATION_CONTINUE;
+}
@@ -33,6 +33,11 @@ public:
         _In_ IGlobalConfigurationChangeProvider * pProvider
     ) override;
 
+    GLOBAL_NOTIFICATION_STATUS
+    OnGlobalApplicationPreload(
+        _In_ IGlobalApplicationPreloadProvider * pProvider
+    ) override;
+
 private:
     std::shared_ptr<APPLICATION_MANAGER> m_pApplicationManager;
 };
@@ -8,6 +8,7 @@
 #include "exceptions.h"
 #include "DisconnectHandler.h"
 #include "SRWExclusiveLock.h"
+#include "AllocationTracking.h"
 
 extern BOOL         g_fInShutdown;
 
@@ -65,7 +66,8 @@ ASPNET_CORE_PROXY_MODULE::ASPNET_CORE_PROXY_MODULE(HTTP_MODULE_ID moduleId, std:
       m_pApplicationInfo(nullptr),
       m_pHandler(nullptr),
       m_moduleId(moduleId),
-      m_pDisconnectHandler(nullptr)
+      m_pDisconnectHandler(nullptr),
+      m_pRequestLimiter(nullptr)
 {
     InitializeSRWLock(&m_requestLock);
 }
@@ -73,6 +75,7 @@ ASPNET_CORE_PROXY_MODULE::ASPNET_CORE_PROXY_MODULE(HTTP_MODULE_ID moduleId, std:
 ASPNET_CORE_PROXY_MODULE::~ASPNET_CORE_PROXY_MODULE()
 {
     RemoveDisconnectHandler();
+    ReleaseRequestLimit();
 }
 
 __override
@@ -86,6 +89,7 @@ ASPNET_CORE_PROXY_MODULE::OnExecuteRequestHandler(
     REQUEST_NOTIFICATION_STATUS retVal = RQ_NOTIFICATION_CONTINUE;
 
     TraceContextScope traceScope(pHttpContext->GetTraceContext());
+    ALLOCATION_TRACKING_REQUEST_SCOPE(true);
     // We don't want OnAsyncCompletion to complete request before OnExecuteRequestHandler exits
     auto lock = SRWExclusiveLock(m_requestLock);
 
@@ -100,6 +104,22 @@ ASPNET_CORE_PROXY_MODULE::OnExecuteRequestHandler(
             *pHttpContext,
             m_pApplicationInfo));
 
+        // Rejected before a handler exists, the request never reaches
+        // managed code or a backend.
+        auto* pRequestLimiter = m_pApplicationInfo->QueryRequestLimiter();
+        if (pRequestLimiter != nullptr && !pRequestLimiter->IsPriorityRequest(*pHttpContext))
+        {
+            const auto result = pRequestLimiter->TryAdmit(*pHttpContext->GetRequest());
+            if (result != RequestLimiter::Result::Admitted)
+            {
+                RequestLimiter::SetRejectedResponse(*pHttpContext->GetResponse(), result);
+                retVal = RQ_NOTIFICATION_FINISH_REQUEST;
+                FINISHED(S_OK);
+            }
+
+            m_pRequestLimiter = pRequestLimiter;
+        }
+
         FINISHED_IF_FAILED(hr = m_pApplicationInfo->CreateHandler(*pHttpContext, m_pHandler));
 
         if (m_pHandler == nullptr)
@@ -130,7 +150,7 @@ Finished:
         }
     }
 
-    return HandleNotificationStatus(retVal);
+    return HandleNotificationStatus(pHttpContext, retVal);
 }
 
 __override
@@ -144,27 +164,38 @@ ASPNET_CORE_PROXY_MODULE::OnAsyncCompletion(
 )
 {
     TraceContextScope traceScope(pHttpContext->GetTraceContext());
+    ALLOCATION_TRACKING_REQUEST_SCOPE(false);
+
     // We don't want OnAsyncCompletion to complete request before OnExecuteRequestHandler exits
     auto lock = SRWExclusiveLock(m_requestLock);
 
     try
     {
-        return HandleNotificationStatus(m_pHandler->OnAsyncCompletion(
+        return HandleNotificationStatus(pHttpContext, m_pHandler->OnAsyncCompletion(
             pCompletionInfo->GetCompletionBytes(),
             pCompletionInfo->GetCompletionStatus()));
     }
     catch (...)
     {
         OBSERVE_CAUGHT_EXCEPTION();
-        return HandleNotificationStatus(RQ_NOTIFICATION_FINISH_REQUEST);
+        return HandleNotificationStatus(pHttpContext, RQ_NOTIFICATION_FINISH_REQUEST);
     }
 }
 
-REQUEST_NOTIFICATION_STATUS ASPNET_CORE_PROXY_MODULE::HandleNotificationStatus(REQUEST_NOTIFICATION_STATUS status) noexcept
+REQUEST_NOTIFICATION_STATUS ASPNET_CORE_PROXY_MODULE::HandleNotificationStatus(IHttpContext * pHttpContext, REQUEST_NOTIFICATION_STATUS status) noexcept
 {
     if (status != RQ_NOTIFICATION_PENDING)
     {
         RemoveDisconnectHandler();
+        ReleaseRequestLimit();
+
+        // Only asked for the status until the application served a request.
+        if (m_pHandler != nullptr && m_pApplicationInfo != nullptr && !m_pApplicationInfo->HasServedRequest())
+        {
+            USHORT statusCode = 0;
+            pHttpContext->GetResponse()->GetStatus(&statusCode);
+            m_pApplicationInfo->NotifyRequestFinished(statusCode);
+        }
     }
 
     return status;
@@ -215,3 +246,14 @@ void ASPNET_CORE_PROXY_MODULE::RemoveDisconnectHandler() noexcept
         handler->RemoveHandler();
     }
 }
+
+void ASPNET_CORE_PROXY_MODULE::ReleaseRequestLimit() noexcept
+{
+    auto* pRequestLimiter = m_pRequestLimiter;
+    m_pRequestLimiter = nullptr;
+
+    if (pRequestLimiter != nullptr)
+    {
+        pRequestLimiter->Release();
+    }
+}
@@ -50,16 +50,19 @@ class ASPNET_CORE_PROXY_MODULE : NonCopyable, public CHttpModule
 
  private:
     REQUEST_NOTIFICATION_STATUS
-    HandleNotificationStatus(REQUEST_NOTIFICATION_STATUS status) noexcept;
+    HandleNotificationStatus(IHttpContext * pHttpContext, REQUEST_NOTIFICATION_STATUS status) noexcept;
 
     void SetupDisconnectHandler(IHttpContext * pHttpContext);
     void RemoveDisconnectHandler() noexcept;
+    void ReleaseRequestLimit() noexcept;
 
     std::shared_ptr<APPLICATION_MANAGER> m_pApplicationManager;
     std::shared_ptr<APPLICATION_INFO> m_pApplicationInfo;
     std::unique_ptr<IREQUEST_HANDLER, IREQUEST_HANDLER_DELETER> m_pHandler;
     HTTP_MODULE_ID m_moduleId;
     DisconnectHandler * m_pDisconnectHandler;
+    // Set once the request was admitted by the limiter of the application.
+    RequestLimiter * m_pRequestLimiter;
     SRWLOCK m_requestLock {};
 };
 
@@ -0,0 +1,380 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "AllocationTracking.h"
+
+#ifdef ANCM_ALLOCATION_TRACKING
+
+#include <intrin.h>
+#include <new>
+#include "TraceProvider.h"
+#include "acache.h"
+
+namespace
+{
+    const PCSTR s_rgKindNames[static_cast<DWORD>(AllocationKind::Count)] =
+    {
+        "New",
+        "Heap",
+        "AllocCache",
+    };
+
+    struct SITE_COUNTERS
+    {
+        PVOID volatile  pCallSite;
+        // Written by the thread that claimed the entry, after the claim.
+        volatile LONG   kind;
+        LONG64          cAllocations;
+        LONG64          cbAllocated;
+    };
+
+    // A power of two. Sites past it, or past the probes, share the
+    // overflow entry.
+    constexpr DWORD MAX_SITES = 4096;
+    constexpr DWORD MAX_PROBES = 16;
+
+    SITE_COUNTERS s_rgSites[MAX_SITES];
+    SITE_COUNTERS s_overflow;
+
+    HMODULE s_hModule;
+    volatile LONG64 s_cRequests;
+
+    // What the imports pointed at before Install, null until then so that
+    // operator new can run before the dynamic initializers.
+    decltype(&HeapAlloc)    s_pfnHeapAlloc;
+    decltype(&HeapReAlloc)  s_pfnHeapReAlloc;
+
+    thread_local DWORD t_cRequestScopes;
+
+    bool
+    IsCounting() noexcept
+    {
+        return t_cRequestScopes != 0 &&
+            TraceLoggingProviderEnabled(g_hTraceProvider, WINEVENT_LEVEL_INFO, ASPNETCORE_TRACE_KEYWORD_ALLOCATIONS);
+    }
+
+    SITE_COUNTERS&
+    GetSite(
+        AllocationKind  kind,
+        PVOID           pCallSite
+    ) noexcept
+    {
+        // Call instructions are a few bytes apart, drop the low bits
+        // before the multiplicative hash.
+        const ULONG_PTR ulHash = (reinterpret_cast<ULONG_PTR>(pCallSite) >> 2) * 0x9E3779B97F4A7C15ULL >> 20;
+
+        for (DWORD i = 0; i < MAX_PROBES; ++i)
+        {
+            SITE_COUNTERS& site = s_rgSites[(ulHash + i) & (MAX_SITES - 1)];
+
+            PVOID pCurrent = site.pCallSite;
+            if (pCurrent == nullptr)
+            {
+                pCurrent = InterlockedCompareExchangePointer(&site.pCallSite, pCallSite, nullptr);
+                if (pCurrent == nullptr)
+                {
+                    InterlockedExchange(&site.kind, static_cast<LONG>(kind));
+                    return site;
+                }
+            }
+
+            if (pCurrent == pCallSite)
+            {
+                return site;
+            }
+        }
+
+        return s_overflow;
+    }
+
+    LPVOID
+    WINAPI
+    HeapAllocHook(
+        _In_ HANDLE     hHeap,
+        _In_ DWORD      dwFlags,
+        _In_ SIZE_T     cbBytes
+    )
+    {
+        AllocationTracking::Record(AllocationKind::Heap, _ReturnAddress(), cbBytes);
+        return s_pfnHeapAlloc(hHeap, dwFlags, cbBytes);
+    }
+
+    LPVOID
+    WINAPI
+    HeapReAllocHook(
+        _In_ HANDLE     hHeap,
+        _In_ DWORD      dwFlags,
+        _In_ LPVOID     pvMemory,
+        _In_ SIZE_T     cbBytes
+    )
+    {
+        AllocationTracking::Record(AllocationKind::Heap, _ReturnAddress(), cbBytes);
+        return s_pfnHeapReAlloc(hHeap, dwFlags, pvMemory, cbBytes);
+    }
+
+    void
+    TrackAllocCache(
+        PVOID   pCallSite,
+        SIZE_T  cbSize
+    )
+    {
+        AllocationTracking::Record(AllocationKind::AllocCache, pCallSite, cbSize);
+    }
+
+    //
+    // Points the import of pszFunction by hModule at pfnHook, once what
+    // it pointed at is stored in ppfnOriginal for the hook to call. Left
+    // alone if the module does not import it by name.
+    //
+    template<typename TFunction>
+    void
+    PatchImport(
+        HMODULE     hModule,
+        PCSTR       pszFunction,
+        TFunction   pfnHook,
+        TFunction * ppfnOriginal
+    ) noexcept
+    {
+        BYTE *                      pbImage = reinterpret_cast<BYTE *>(hModule);
+        const IMAGE_DOS_HEADER *    pDosHeader = reinterpret_cast<const IMAGE_DOS_HEADER *>(pbImage);
+        const IMAGE_NT_HEADERS *    pNtHeaders = reinterpret_cast<const IMAGE_NT_HEADERS *>(pbImage + pDosHeader->e_lfanew);
+        const IMAGE_DATA_DIRECTORY &directory = pNtHeaders->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+
+        if (directory.VirtualAddress == 0)
+        {
+            return;
+        }
+
+        for (const IMAGE_IMPORT_DESCRIPTOR *pDescriptor = reinterpret_cast<const IMAGE_IMPORT_DESCRIPTOR *>(pbImage + directory.VirtualAddress);
+             pDescriptor->Name != 0;
+             pDescriptor++)
+        {
+            if (pDescriptor->OriginalFirstThunk == 0)
+            {
+                continue;
+            }
+
+            const IMAGE_THUNK_DATA *pNameThunk = reinterpret_cast<const IMAGE_THUNK_DATA *>(pbImage + pDescriptor->OriginalFirstThunk);
+            IMAGE_THUNK_DATA *pAddressThunk = reinterpret_cast<IMAGE_THUNK_DATA *>(pbImage + pDescriptor->FirstThunk);
+
+            for (; pNameThunk->u1.AddressOfData != 0; pNameThunk++, pAddressThunk++)
+            {
+                if (IMAGE_SNAP_BY_ORDINAL(pNameThunk->u1.Ordinal))
+                {
+                    continue;
+                }
+
+                const IMAGE_IMPORT_BY_NAME *pImport = reinterpret_cast<const IMAGE_IMPORT_BY_NAME *>(pbImage + pNameThunk->u1.AddressOfData);
+                if (strcmp(reinterpret_cast<PCSTR>(pImport->Name), pszFunction) != 0)
+                {
+                    continue;
+                }
+
+                DWORD dwOldProtect;
+                if (!VirtualProtect(&pAddressThunk->u1.Function, sizeof(pAddressThunk->u1.Function), PAGE_READWRITE, &dwOldProtect))
+                {
+                    return;
+                }
+
+                InterlockedExchangePointer(reinterpret_cast<PVOID volatile *>(ppfnOriginal), reinterpret_cast<PVOID>(pAddressThunk->u1.Function));
+                InterlockedExchangePointer(reinterpret_cast<PVOID volatile *>(&pAddressThunk->u1.Function), reinterpret_cast<PVOID>(pfnHook));
+
+                VirtualProtect(&pAddressThunk->u1.Function, sizeof(pAddressThunk->u1.Function), dwOldProtect, &dwOldProtect);
+                return;
+            }
+        }
+    }
+
+    //
+    // Allocations of operator new go to the process heap through the
+    // original HeapAlloc, the hook would count them a second time from
+    // inside malloc.
+    //
+    void *
+    Allocate(
+        PVOID   pCallSite,
+        size_t  cbSize
+    ) noexcept
+    {
+        AllocationTracking::Record(AllocationKind::New, pCallSite, cbSize);
+        const auto pfnHeapAlloc = s_pfnHeapAlloc != nullptr ? s_pfnHeapAlloc : HeapAlloc;
+        return pfnHeapAlloc(GetProcessHeap(), 0, cbSize != 0 ? cbSize : 1);
+    }
+}
+
+//
+// Replacements of the global allocation functions of the module, the
+// containers of the standard library allocate through them as well.
+//
+void *
+operator new(
+    size_t  cbSize
+)
+{
+    void *pv = Allocate(_ReturnAddress(), cbSize);
+    if (pv == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return pv;
+}
+
+void *
+operator new(
+    size_t                  cbSize,
+    const std::nothrow_t &
+) noexcept
+{
+    return Allocate(_ReturnAddress(), cbSize);
+}
+
+void *
+operator new[](
+    size_t  cbSize
+)
+{
+    void *pv = Allocate(_ReturnAddress(), cbSize);
+    if (pv == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return pv;
+}
+
+void *
+operator new[](
+    size_t                  cbSize,
+    const std::nothrow_t &
+) noexcept
+{
+    return Allocate(_ReturnAddress(), cbSize);
+}
+
+void
+operator delete(
+    void *  pv
+) noexcept
+{
+    if (pv != nullptr)
+    {
+        HeapFree(GetProcessHeap(), 0, pv);
+    }
+}
+
+void
+operator delete(
+    void *  pv,
+    size_t
+) noexcept
+{
+    operator delete(pv);
+}
+
+void
+operator delete[](
+    void *  pv
+) noexcept
+{
+    operator delete(pv);
+}
+
+void
+operator delete[](
+    void *  pv,
+    size_t
+) noexcept
+{
+    operator delete(pv);
+}
+
+void
+AllocationTracking::Install(
+    HMODULE     hModule
+) noexcept
+{
+    s_hModule = hModule;
+
+    PatchImport(hModule, "HeapAlloc", &HeapAllocHook, &s_pfnHeapAlloc);
+    PatchImport(hModule, "HeapReAlloc", &HeapReAllocHook, &s_pfnHeapReAlloc);
+
+    ALLOC_CACHE_HANDLER::sm_pfnTrackAlloc = TrackAllocCache;
+}
+
+void
+AllocationTracking::Record(
+    AllocationKind  kind,
+    PVOID           pCallSite,
+    SIZE_T          cbSize
+) noexcept
+{
+    if (!IsCounting())
+    {
+        return;
+    }
+
+    SITE_COUNTERS& site = GetSite(kind, pCallSite);
+    InterlockedIncrement64(&site.cAllocations);
+    InterlockedAdd64(&site.cbAllocated, static_cast<LONG64>(cbSize));
+}
+
+AllocationTracking::RequestScope::RequestScope(
+    bool    fRequestStart
+) noexcept
+{
+    if (t_cRequestScopes++ == 0 && fRequestStart &&
+        TraceLoggingProviderEnabled(g_hTraceProvider, WINEVENT_LEVEL_INFO, ASPNETCORE_TRACE_KEYWORD_ALLOCATIONS))
+    {
+        InterlockedIncrement64(&s_cRequests);
+    }
+}
+
+AllocationTracking::RequestScope::~RequestScope() noexcept
+{
+    t_cRequestScopes--;
+}
+
+void
+AllocationTracking::Write() noexcept
+{
+    if (!TraceLoggingProviderEnabled(g_hTraceProvider, WINEVENT_LEVEL_INFO, ASPNETCORE_TRACE_KEYWORD_ALLOCATIONS))
+    {
+        return;
+    }
+
+    // Not a consistent snapshot, requests may go on meanwhile.
+    const LONG64 cRequests = s_cRequests;
+
+    auto writeSite = [cRequests](const SITE_COUNTERS& site)
+    {
+        const ULONG_PTR ulOffset = site.pCallSite == nullptr ? 0 :
+            reinterpret_cast<ULONG_PTR>(site.pCallSite) - reinterpret_cast<ULONG_PTR>(s_hModule);
+
+        TraceLoggingWrite(g_hTraceProvider,
+            "Allocation",
+            TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+            TraceLoggingKeyword(ASPNETCORE_TRACE_KEYWORD_ALLOCATIONS),
+            TraceLoggingString(s_rgKindNames[site.kind], "Kind"),
+            TraceLoggingPointer(site.pCallSite, "CallSite"),
+            TraceLoggingPointer(s_hModule, "ModuleBase"),
+            TraceLoggingUInt64(ulOffset, "Offset"),
+            TraceLoggingInt64(site.cAllocations, "Allocations"),
+            TraceLoggingInt64(site.cbAllocated, "Bytes"),
+            TraceLoggingInt64(cRequests, "Requests"));
+    };
+
+    for (const auto& site : s_rgSites)
+    {
+        if (site.pCallSite != nullptr && site.cAllocations != 0)
+        {
+            writeSite(site);
+        }
+    }
+
+    // Written with no call site, whatever the kinds that fell into it.
+    if (s_overflow.cAllocations != 0)
+    {
+        writeSite(s_overflow);
+    }
+}
+
+#endif
@@ -0,0 +1,84 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <Windows.h>
+
+#ifdef ANCM_ALLOCATION_TRACKING
+
+//
+// What an allocation went through. Append only, the names in
+// AllocationTracking.cpp follow the order.
+//
+enum class AllocationKind : DWORD
+{
+    New = 0,
+    Heap,
+    AllocCache,
+    Count
+};
+
+//
+// Heap allocations made on the request path of the module, counted by
+// call site while a session enabled ASPNETCORE_TRACE_KEYWORD_ALLOCATIONS
+// at the informational level. Built only with AncmAllocationTracking set,
+// see Build.Common.Settings, so that they cost nothing otherwise.
+//
+// The module replaces the global operator new, DebugInitialize points its
+// imports of HeapAlloc and HeapReAlloc at hooks and ALLOC_CACHE_HANDLER
+// reports each Alloc, hits of its lookaside lists included. A direct
+// malloc of the CRT is not counted, nor what other modules allocate for
+// this one.
+//
+// Only the allocations of a thread inside a RequestScope are counted, the
+// notifications of a request and the completions of its I/O open one. A
+// site is the return address of the allocation, written with the module
+// base so that it can be symbolized. They are written as Allocation
+// events, one per site, when a session asks for a rundown and when the
+// module stops, with the requests the module executed meanwhile.
+//
+namespace AllocationTracking
+{
+    void
+    Install(
+        HMODULE     hModule
+    ) noexcept;
+
+    void
+    Record(
+        AllocationKind  kind,
+        PVOID           pCallSite,
+        SIZE_T          cbSize
+    ) noexcept;
+
+    void
+    Write() noexcept;
+
+    class RequestScope
+    {
+    public:
+        //
+        // fRequestStart counts a new request, set by the notification
+        // that executes it.
+        //
+        explicit
+        RequestScope(
+            bool    fRequestStart
+        ) noexcept;
+
+        ~RequestScope() noexcept;
+
+        RequestScope(const RequestScope&) = delete;
+        RequestScope& operator=(const RequestScope&) = delete;
+    };
+}
+
+#define ALLOCATION_TRACKING_REQUEST_SCOPE(fRequestStart) \
+    AllocationTracking::RequestScope allocationTrackingScope(fRequestStart)
+
+#else
+
+#define ALLOCATION_TRACKING_REQUEST_SCOPE(fRequestStart)
+
+#endif
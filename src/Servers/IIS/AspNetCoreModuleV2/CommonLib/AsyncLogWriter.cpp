@@ -0,0 +1,262 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include "AsyncLogWriter.h"
+#include "SRWExclusiveLock.h"
+#include "StringHelpers.h"
+#include <memory>
+
+static_assert((AsyncLogWriter::RING_SIZE & (AsyncLogWriter::RING_SIZE - 1)) == 0, "RING_SIZE must be a power of two");
+
+AsyncLogWriter::AsyncLogWriter() noexcept :
+    m_enqueuePos(0),
+    m_dequeuePos(0),
+    m_lWriterActive(0),
+    m_lStopped(0),
+    m_cDroppedLines(0),
+    m_cReportedDroppedLines(0),
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_dwFlushIntervalMs(DEFAULT_FLUSH_INTERVAL_MS),
+    m_ullLastFlushTick(0)
+{
+    for (LONG64 i = 0; i < RING_SIZE; ++i)
+    {
+        m_rgSlots[i].sequence = i;
+        m_rgSlots[i].pLine = nullptr;
+    }
+
+    InitializeSRWLock(&m_fileLock);
+}
+
+AsyncLogWriter::~AsyncLogWriter()
+{
+    // Runs at module unload, only free what a writer is not working on.
+    if (InterlockedCompareExchange(&m_lWriterActive, 1L, 0L) == 0L)
+    {
+        std::string* pLine;
+        while (TryDequeue(&pLine))
+        {
+            delete pLine;
+        }
+    }
+}
+
+void
+AsyncLogWriter::SetFile(HANDLE hFile)
+{
+    HANDLE hPreviousFile;
+
+    {
+        SRWExclusiveLock lock(m_fileLock);
+        hPreviousFile = m_hFile;
+        m_hFile = hFile;
+    }
+
+    if (hPreviousFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(hPreviousFile);
+    }
+}
+
+bool
+AsyncLogWriter::Write(std::string line)
+{
+    if (m_lStopped != 0)
+    {
+        return false;
+    }
+
+    auto pLine = new (std::nothrow) std::string(std::move(line));
+    if (pLine == nullptr)
+    {
+        InterlockedIncrement64(&m_cDroppedLines);
+        return false;
+    }
+
+    // Bounded MPSC ring: a slot is free for position pos once its
+    // sequence equals pos, and holds a line once it equals pos + 1.
+    LONG64 pos = m_enqueuePos;
+    Slot* pSlot;
+    for (;;)
+    {
+        pSlot = &m_rgSlots[pos & (RING_SIZE - 1)];
+        const LONG64 diff = pSlot->sequence - pos;
+        if (diff == 0)
+        {
+            const LONG64 observed = InterlockedCompareExchange64(&m_enqueuePos, pos + 1, pos);
+            if (observed == pos)
+            {
+                break;
+            }
+            pos = observed;
+        }
+        else if (diff < 0)
+        {
+            // Full, the writer is behind; drop rather than wait for disk.
+            delete pLine;
+            InterlockedIncrement64(&m_cDroppedLines);
+            return false;
+        }
+        else
+        {
+            pos = m_enqueuePos;
+        }
+    }
+
+    pSlot->pLine = pLine;
+    InterlockedExchange64(&pSlot->sequence, pos + 1);
+
+    ScheduleWriter();
+    return true;
+}
+
+void
+AsyncLogWriter::Stop(DWORD dwTimeoutMs)
+{
+    InterlockedExchange(&m_lStopped, 1L);
+
+    const ULONGLONG ullStartTick = GetTickCount64();
+    while (InterlockedCompareExchange(&m_lWriterActive, 1L, 0L) != 0L)
+    {
+        if (GetTickCount64() - ullStartTick >= dwTimeoutMs)
+        {
+            // A batch is still being written, leave the ring to it.
+            return;
+        }
+        Sleep(1);
+    }
+
+    // m_lWriterActive stays set so no work item is scheduled anymore.
+    while (WriteBatch())
+    {
+    }
+
+    SRWExclusiveLock lock(m_fileLock);
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        FlushFileBuffers(m_hFile);
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+}
+
+bool
+AsyncLogWriter::TryDequeue(std::string** ppLine)
+{
+    Slot* pSlot = &m_rgSlots[m_dequeuePos & (RING_SIZE - 1)];
+    if (pSlot->sequence != m_dequeuePos + 1)
+    {
+        return false;
+    }
+
+    *ppLine = pSlot->pLine;
+    pSlot->pLine = nullptr;
+    InterlockedExchange64(&pSlot->sequence, m_dequeuePos + RING_SIZE);
+    m_dequeuePos++;
+    return true;
+}
+
+bool
+AsyncLogWriter::HasQueuedLines() const
+{
+    return m_rgSlots[m_dequeuePos & (RING_SIZE - 1)].sequence == m_dequeuePos + 1;
+}
+
+bool
+AsyncLogWriter::WriteBatch() noexcept
+{
+    std::string batch;
+    std::string* pLine;
+
+    try
+    {
+        while (batch.size() < MAX_BATCH_BYTES && TryDequeue(&pLine))
+        {
+            std::unique_ptr<std::string> line(pLine);
+            batch.append(*line);
+        }
+
+        const LONG64 cDroppedLines = m_cDroppedLines;
+        if (cDroppedLines != m_cReportedDroppedLines)
+        {
+            batch.append(format(std::string("[%lld log lines dropped, %lld in total]\r\n"),
+                cDroppedLines - m_cReportedDroppedLines,
+                cDroppedLines));
+            m_cReportedDroppedLines = cDroppedLines;
+        }
+    }
+    catch (...)
+    {
+        // Out of memory, the lines dequeued so far are lost.
+        return false;
+    }
+
+    if (batch.empty())
+    {
+        return false;
+    }
+
+    SRWExclusiveLock lock(m_fileLock);
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        DWORD nBytesWritten = 0;
+        SetFilePointer(m_hFile, 0, nullptr, FILE_END);
+        WriteFile(m_hFile, batch.data(), static_cast<DWORD>(batch.size()), &nBytesWritten, nullptr);
+
+        const ULONGLONG ullNow = GetTickCount64();
+        if (ullNow - m_ullLastFlushTick >= m_dwFlushIntervalMs)
+        {
+            FlushFileBuffers(m_hFile);
+            m_ullLastFlushTick = ullNow;
+        }
+    }
+
+    return true;
+}
+
+void
+AsyncLogWriter::ScheduleWriter()
+{
+    if (InterlockedCompareExchange(&m_lWriterActive, 1L, 0L) != 0L)
+    {
+        // The running writer picks the line up.
+        return;
+    }
+
+    if (!TrySubmitThreadpoolCallback(WriteCallback, this, nullptr))
+    {
+        // Left queued for the next Write to schedule.
+        InterlockedExchange(&m_lWriterActive, 0L);
+    }
+}
+
+VOID
+CALLBACK
+AsyncLogWriter::WriteCallback(
+    _Inout_ PTP_CALLBACK_INSTANCE   Instance,
+    _Inout_opt_ PVOID               pContext
+)
+{
+    UNREFERENCED_PARAMETER(Instance);
+
+    auto pWriter = static_cast<AsyncLogWriter*>(pContext);
+
+    for (;;)
+    {
+        while (pWriter->WriteBatch())
+        {
+        }
+
+        InterlockedExchange(&pWriter->m_lWriterActive, 0L);
+
+        // A line queued after the last dequeue may have seen the writer
+        // still active and not scheduled another one.
+        if (!pWriter->HasQueuedLines() ||
+            pWriter->m_lStopped != 0 ||
+            InterlockedCompareExchange(&pWriter->m_lWriterActive, 1L, 0L) != 0L)
+        {
+            break;
+        }
+    }
+}
@@ -0,0 +1,92 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <string>
+#include "NonCopyable.h"
+
+// Writes log lines to a file off the logging thread. Lines are queued in a
+// bounded lock-free ring and written in large sequential batches by a
+// thread pool work item; a line that does not fit in the ring is dropped
+// and counted rather than blocking the caller.
+class AsyncLogWriter : NonCopyable
+{
+public:
+    // Number of queued lines, must be a power of two
+    static constexpr LONG64 RING_SIZE = 4096;
+
+    // Upper bound of a single WriteFile
+    static constexpr size_t MAX_BATCH_BYTES = 64 * 1024;
+
+    static constexpr DWORD DEFAULT_FLUSH_INTERVAL_MS = 1000;
+
+    AsyncLogWriter() noexcept;
+
+    ~AsyncLogWriter();
+
+    // Switches the file lines are written to, the writer owns hFile from
+    // now on and closes the previous one. Lines still queued go to the new
+    // file.
+    void SetFile(HANDLE hFile);
+
+    bool HasFile() const
+    {
+        return m_hFile != INVALID_HANDLE_VALUE;
+    }
+
+    // FlushFileBuffers is called at most once per interval, 0 flushes
+    // after every batch.
+    void SetFlushInterval(DWORD dwFlushIntervalMs)
+    {
+        m_dwFlushIntervalMs = dwFlushIntervalMs;
+    }
+
+    // Queues an encoded line without blocking. Returns false if the line
+    // was dropped because the ring is full or the writer is stopped.
+    bool Write(std::string line);
+
+    // Writes out what is queued on the calling thread and closes the
+    // file, waiting at most dwTimeoutMs for a batch in progress.
+    void Stop(DWORD dwTimeoutMs);
+
+    LONG64 QueryDroppedLines() const
+    {
+        return m_cDroppedLines;
+    }
+
+private:
+    struct Slot
+    {
+        volatile LONG64 sequence;
+        std::string*    pLine;
+    };
+
+    // Consumer side, only called by the owner of m_lWriterActive.
+    bool TryDequeue(std::string** ppLine);
+    bool HasQueuedLines() const;
+    bool WriteBatch() noexcept;
+
+    void ScheduleWriter();
+
+    static
+    VOID
+    CALLBACK
+    WriteCallback(
+        _Inout_ PTP_CALLBACK_INSTANCE   Instance,
+        _Inout_opt_ PVOID               pContext);
+
+    Slot                m_rgSlots[RING_SIZE];
+    volatile LONG64     m_enqueuePos;
+    LONG64              m_dequeuePos;
+    // Set while a thread owns the consumer side of the ring.
+    volatile LONG       m_lWriterActive;
+    volatile LONG       m_lStopped;
+    volatile LONG64     m_cDroppedLines;
+    LONG64              m_cReportedDroppedLines;
+
+    SRWLOCK             m_fileLock;
+    HANDLE              m_hFile;
+    DWORD               m_dwFlushIntervalMs;
+    ULONGLONG           m_ullLastFlushTick;
+};
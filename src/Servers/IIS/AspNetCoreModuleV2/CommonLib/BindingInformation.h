@@ -95,9 +95,11 @@ public:
     {
         std::wstring result;
 
-        for (auto binding : bindings)
+        for (const auto& binding : bindings)
         {
-            result += binding.QueryProtocol() + L"://" + binding.QueryHost() + L":" + binding.QueryPort() + basePath + L";";
+            result.append(binding.QueryProtocol()).append(L"://")
+                .append(binding.QueryHost()).append(L":")
+                .append(binding.QueryPort()).append(basePath).append(L";");
         }
 
         return result;
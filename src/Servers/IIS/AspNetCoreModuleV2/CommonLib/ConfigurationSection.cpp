@@ -5,6 +5,7 @@
 
 #include "StringHelpers.h"
 #include "ConfigurationLoadException.h"
+#include "exceptions.h"
 #include <map>
 
 std::wstring ConfigurationSection::GetRequiredString(const std::wstring& name)  const
@@ -47,6 +48,66 @@ DWORD ConfigurationSection::GetRequiredTimespan(const std::wstring& name) const
     return result.value();
 }
 
+HRESULT ConfigurationSection::TryGetRequiredString(const std::wstring& name, std::wstring& value) const noexcept
+{
+    try
+    {
+        auto result = GetString(name);
+        if (!result.has_value() || result.value().empty())
+        {
+            return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+        }
+        value = std::move(result.value());
+        return S_OK;
+    }
+    CATCH_RETURN();
+}
+
+HRESULT ConfigurationSection::TryGetRequiredBool(const std::wstring& name, bool& value) const noexcept
+{
+    try
+    {
+        auto result = GetBool(name);
+        if (!result.has_value())
+        {
+            return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+        }
+        value = result.value();
+        return S_OK;
+    }
+    CATCH_RETURN();
+}
+
+HRESULT ConfigurationSection::TryGetRequiredLong(const std::wstring& name, DWORD& value) const noexcept
+{
+    try
+    {
+        auto result = GetLong(name);
+        if (!result.has_value())
+        {
+            return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+        }
+        value = result.value();
+        return S_OK;
+    }
+    CATCH_RETURN();
+}
+
+HRESULT ConfigurationSection::TryGetRequiredTimespan(const std::wstring& name, DWORD& value) const noexcept
+{
+    try
+    {
+        auto result = GetTimespan(name);
+        if (!result.has_value())
+        {
+            return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+        }
+        value = result.value();
+        return S_OK;
+    }
+    CATCH_RETURN();
+}
+
 void ConfigurationSection::ThrowRequiredException(const std::wstring& name)
 {
     throw ConfigurationLoadException(format(L"Attribute '%s' is required.", name.c_str()));
@@ -31,6 +31,18 @@
 #define CS_ASPNETCORE_HANDLER_CALL_STARTUP_HOOK          L"callStartupHook"
 #define CS_ASPNETCORE_HANDLER_STACK_SIZE                 L"stackSize"
 #define CS_ASPNETCORE_SUPPRESS_RECYCLE_ON_STARTUP_TIMEOUT L"suppressRecycleOnStartupTimeout"
+#define CS_ASPNETCORE_HANDLER_WARMUP_PATHS               L"warmupPaths"
+#define CS_ASPNETCORE_HANDLER_MAX_CONCURRENT_REQUESTS    L"maxConcurrentRequests"
+#define CS_ASPNETCORE_HANDLER_REQUEST_QUEUE_LIMIT        L"requestQueueLimit"
+#define CS_ASPNETCORE_HANDLER_SHADOW_COPY_QUIET_PERIOD   L"shadowCopyQuietPeriod"
+#define CS_ASPNETCORE_HANDLER_SHADOW_COPY_MAX_DELAY      L"shadowCopyMaxDelay"
+#define CS_ASPNETCORE_HANDLER_SHADOW_COPY_RETAINED_DIRECTORIES L"shadowCopyRetainedDirectories"
+#define CS_ASPNETCORE_STDOUT_LOG_MAX_FILE_SIZE           L"stdoutLogMaxFileSize"
+#define CS_ASPNETCORE_STDOUT_LOG_ROLL_INTERVAL           L"stdoutLogRollInterval"
+#define CS_ASPNETCORE_STDOUT_LOG_RETAINED_FILES          L"stdoutLogRetainedFiles"
+#define CS_ASPNETCORE_STDOUT_LOG_PREALLOCATE             L"stdoutLogPreallocate"
+#define CS_ASPNETCORE_STDOUT_LOG_COMPRESS                L"stdoutLogCompress"
+#define CS_ASPNETCORE_STDOUT_LOG_MAX_TOTAL_SIZE          L"stdoutLogMaxTotalSize"
 #define CS_ASPNETCORE_DETAILEDERRORS                     L"ASPNETCORE_DETAILEDERRORS"
 #define CS_ASPNETCORE_ENVIRONMENT                        L"ASPNETCORE_ENVIRONMENT"
 #define CS_DOTNET_ENVIRONMENT                            L"DOTNET_ENVIRONMENT"
@@ -55,6 +67,13 @@ public:
     DWORD GetRequiredLong(const std::wstring& name)  const;
     DWORD GetRequiredTimespan(const std::wstring& name)  const;
 
+    // Variants of the above that return HRESULT_FROM_WIN32(ERROR_NOT_FOUND)
+    // instead of throwing ConfigurationLoadException.
+    HRESULT TryGetRequiredString(const std::wstring& name, std::wstring& value) const noexcept;
+    HRESULT TryGetRequiredBool(const std::wstring& name, bool& value) const noexcept;
+    HRESULT TryGetRequiredLong(const std::wstring& name, DWORD& value) const noexcept;
+    HRESULT TryGetRequiredTimespan(const std::wstring& name, DWORD& value) const noexcept;
+
     virtual std::vector<std::pair<std::wstring, std::wstring>> GetKeyValuePairs(const std::wstring& name) const;
     virtual std::map<std::wstring, std::wstring, ignore_case_comparer> GetMap(const std::wstring& name) const;
 
@@ -0,0 +1,129 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include "DebugRingBuffer.h"
+#include "exceptions.h"
+
+static_assert(sizeof(DebugRingBuffer::Header) <= 64, "Header must fit HEADER_SIZE");
+static_assert(sizeof(DebugRingBuffer::Record) % 8 == 0, "Records are 8 byte aligned");
+static_assert((DebugRingBuffer::DEFAULT_DATA_SIZE & (DebugRingBuffer::DEFAULT_DATA_SIZE - 1)) == 0, "DEFAULT_DATA_SIZE must be a power of two");
+
+HRESULT
+DebugRingBuffer::Open(
+    const std::filesystem::path &path,
+    DWORD                        cbData
+)
+{
+    DBG_ASSERT(!IsOpen());
+    if (cbData == 0 || (cbData & (cbData - 1)) != 0)
+    {
+        RETURN_HR(E_INVALIDARG);
+    }
+
+    std::error_code ec;
+    create_directories(path.parent_path(), ec);
+
+    const HANDLE hFile = CreateFileW(path.c_str(),
+        GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr,
+        OPEN_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr);
+    RETURN_LAST_ERROR_IF(hFile == INVALID_HANDLE_VALUE);
+    m_hFile = hFile;
+
+    const ULONGLONG cbFile = HEADER_SIZE + static_cast<ULONGLONG>(cbData);
+    RETURN_LAST_ERROR_IF_NULL(m_hMapping = CreateFileMappingW(m_hFile,
+        nullptr,
+        PAGE_READWRITE,
+        static_cast<DWORD>(cbFile >> 32),
+        static_cast<DWORD>(cbFile),
+        nullptr));
+
+    const auto pView = static_cast<BYTE*>(MapViewOfFile(m_hMapping, FILE_MAP_WRITE, 0, 0, static_cast<SIZE_T>(cbFile)));
+    RETURN_LAST_ERROR_IF_NULL(pView);
+
+    //
+    // Lines of earlier processes are kept, they are what is wanted after a
+    // crash, and the other modules of this process append to the same
+    // ring. Anything else is reset.
+    //
+    const auto pHeader = reinterpret_cast<Header*>(pView);
+    if (pHeader->dwSignature != HEADER_SIGNATURE ||
+        pHeader->dwVersion != FORMAT_VERSION ||
+        pHeader->cbHeader != HEADER_SIZE ||
+        pHeader->cbData != cbData)
+    {
+        ZeroMemory(pView, static_cast<SIZE_T>(cbFile));
+        pHeader->dwVersion = FORMAT_VERSION;
+        pHeader->cbHeader = HEADER_SIZE;
+        pHeader->cbData = cbData;
+        pHeader->llWritePosition = 0;
+        MemoryBarrier();
+        pHeader->dwSignature = HEADER_SIGNATURE;
+    }
+
+    m_pbData = pView + HEADER_SIZE;
+    m_cbData = cbData;
+    m_pHeader = pHeader;
+
+    return S_OK;
+}
+
+void
+DebugRingBuffer::Write(
+    DWORD   dwFlag,
+    PCWSTR  pszMessage
+) noexcept
+{
+    if (!IsOpen())
+    {
+        return;
+    }
+
+    const DWORD cchMessage = static_cast<DWORD>(wcsnlen(pszMessage, MAX_MESSAGE_CCH));
+    const DWORD cbMessage = cchMessage * sizeof(WCHAR);
+
+    Record record;
+    record.dwMagic = RECORD_MAGIC;
+    record.cbRecord = (sizeof(Record) + cbMessage + 7) & ~7UL;
+    record.dwFlag = dwFlag;
+    record.cchMessage = cchMessage;
+    record.dwProcessId = GetCurrentProcessId();
+    record.dwThreadId = GetCurrentThreadId();
+
+    FILETIME timestamp;
+    GetSystemTimePreciseAsFileTime(&timestamp);
+    record.llTimestamp = (static_cast<LONGLONG>(timestamp.dwHighDateTime) << 32) | timestamp.dwLowDateTime;
+
+    const LONG64 llPosition = InterlockedExchangeAdd64(&m_pHeader->llWritePosition, record.cbRecord);
+
+    CopyIn(llPosition + sizeof(Record), pszMessage, cbMessage);
+
+    //
+    // The header goes last so a reader that finds the magic finds the
+    // message behind it.
+    //
+    MemoryBarrier();
+    CopyIn(llPosition, &record, sizeof(record));
+}
+
+void
+DebugRingBuffer::CopyIn(
+    LONG64       llPosition,
+    const void  *pvSource,
+    DWORD        cbSource
+) noexcept
+{
+    const DWORD  dwOffset = static_cast<DWORD>(llPosition & (m_cbData - 1));
+    const DWORD  cbFirst = min(cbSource, m_cbData - dwOffset);
+    const BYTE  *pbSource = static_cast<const BYTE*>(pvSource);
+
+    memcpy(m_pbData + dwOffset, pbSource, cbFirst);
+    if (cbFirst < cbSource)
+    {
+        memcpy(m_pbData, pbSource + cbFirst, cbSource - cbFirst);
+    }
+}
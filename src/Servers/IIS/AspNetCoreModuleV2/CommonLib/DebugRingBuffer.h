@@ -0,0 +1,89 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <Windows.h>
+#include <filesystem>
+#include "HandleWrapper.h"
+#include "NonCopyable.h"
+
+//
+// Keeps the most recent log lines in a memory mapped file of fixed size.
+// Writing a line is a reservation with one interlocked add and a copy
+// into the view; the system cache writes the pages back, so lines survive
+// a crash of the process without any WriteFile or FlushFileBuffers.
+//
+// The file starts with a Header, the rest is a circular byte stream of
+// Records. A reader starts at WritePosition - DataSize, looks for the
+// first 8 byte aligned RECORD_MAGIC with a plausible size and reads
+// records from there, ones overwritten while being written are skipped.
+//
+class DebugRingBuffer : NonCopyable
+{
+public:
+    // Size of the record area, a power of two.
+    static constexpr DWORD DEFAULT_DATA_SIZE = 4 * 1024 * 1024;
+
+    // Longer messages are truncated.
+    static constexpr DWORD MAX_MESSAGE_CCH = 2048;
+
+    static constexpr DWORD HEADER_SIGNATURE = 'RCNA';
+    static constexpr DWORD RECORD_MAGIC = 'CRNA';
+    static constexpr DWORD FORMAT_VERSION = 1;
+
+    struct Header
+    {
+        DWORD           dwSignature;
+        DWORD           dwVersion;
+        DWORD           cbHeader;
+        DWORD           cbData;
+        // Bytes ever reserved, the next record starts at this modulo cbData.
+        volatile LONG64 llWritePosition;
+    };
+
+    struct Record
+    {
+        DWORD       dwMagic;
+        // Including the header and the padding to 8 bytes.
+        DWORD       cbRecord;
+        DWORD       dwFlag;
+        DWORD       cchMessage;
+        // GetSystemTimePreciseAsFileTime
+        LONGLONG    llTimestamp;
+        DWORD       dwProcessId;
+        DWORD       dwThreadId;
+        // Followed by cchMessage WCHARs, not terminated.
+    };
+
+    DebugRingBuffer() noexcept = default;
+
+    //
+    // The view is never unmapped, a line logged while the module shuts
+    // down must not fault. It goes away with the process.
+    //
+    ~DebugRingBuffer() = default;
+
+    // Maps path, creating it or resetting one of another format. Every
+    // module of the process and later processes append to the same ring.
+    // Only called once, before anything is logged.
+    HRESULT Open(const std::filesystem::path &path, DWORD cbData = DEFAULT_DATA_SIZE);
+
+    bool IsOpen() const noexcept
+    {
+        return m_pHeader != nullptr;
+    }
+
+    void Write(DWORD dwFlag, PCWSTR pszMessage) noexcept;
+
+private:
+    static constexpr DWORD HEADER_SIZE = 64;
+
+    void CopyIn(LONG64 llPosition, const void *pvSource, DWORD cbSource) noexcept;
+
+    HandleWrapper<InvalidHandleTraits>  m_hFile;
+    HandleWrapper<NullHandleTraits>     m_hMapping;
+    Header *                            m_pHeader = nullptr;
+    BYTE *                              m_pbData = nullptr;
+    DWORD                               m_cbData = 0;
+};
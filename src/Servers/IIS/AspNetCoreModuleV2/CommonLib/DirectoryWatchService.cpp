@@ -0,0 +1,302 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "DirectoryWatchService.h"
+
+#include <atomic>
+#include "debugutil.h"
+#include "exceptions.h"
+#include "SRWExclusiveLock.h"
+#include "SRWSharedLock.h"
+
+#define DIRECTORY_WATCH_BUFFER_SIZE     4096
+
+class DirectoryWatchService::Watch: NonCopyable
+{
+public:
+    Watch(HANDLE hDirectory, DWORD dwNotifyFilter, Callback callback) noexcept
+        : m_hDirectory(hDirectory),
+          m_dwNotifyFilter(dwNotifyFilter),
+          m_callback(std::move(callback)),
+          m_fStopped(false),
+          m_cRefs(1),
+          m_overlapped()
+    {
+    }
+
+    HANDLE
+    QueryDirectory() noexcept
+    {
+        return m_hDirectory;
+    }
+
+    void
+    Reference() noexcept
+    {
+        InterlockedIncrement(&m_cRefs);
+    }
+
+    void
+    Dereference() noexcept
+    {
+        if (InterlockedDecrement(&m_cRefs) == 0)
+        {
+            delete this;
+        }
+    }
+
+    //
+    // The pending read holds a reference, dropped once it completes and
+    // no other read is issued.
+    //
+    HRESULT
+    Read() noexcept
+    {
+        m_overlapped = {};
+
+        Reference();
+        if (!ReadDirectoryChangesW(m_hDirectory,
+            m_buffer,
+            sizeof(m_buffer),
+            FALSE,          // watch subtree
+            m_dwNotifyFilter,
+            nullptr,
+            &m_overlapped,
+            nullptr))
+        {
+            const HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+            Dereference();
+            return hr;
+        }
+
+        return S_OK;
+    }
+
+    void
+    OnReadCompleted(HRESULT hr, DWORD cbCompletion) noexcept
+    {
+        {
+            //
+            // Held until the next read is issued, a read issued after Stop
+            // canceled the pending one would never complete.
+            //
+            SRWSharedLock lock(m_callbackLock);
+
+            if (!m_fStopped)
+            {
+                if (SUCCEEDED(hr))
+                {
+                    // Nothing is returned if the changes did not fit the buffer.
+                    Invoke(S_OK, cbCompletion == 0 ? nullptr : reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(m_buffer));
+                    hr = Read();
+                }
+
+                if (FAILED(hr))
+                {
+                    LOG_INFOF(L"Watching directory changes failed with %x", hr);
+                    Invoke(hr, nullptr);
+                }
+            }
+        }
+
+        Dereference();
+    }
+
+    void
+    Stop() noexcept
+    {
+        m_fStopped = true;
+
+        {
+            // Waits for a callback in progress to return.
+            SRWExclusiveLock lock(m_callbackLock);
+        }
+
+        // Completes the pending read with ERROR_OPERATION_ABORTED.
+        CancelIoEx(m_hDirectory, &m_overlapped);
+
+        Dereference();
+    }
+
+private:
+    ~Watch() = default;
+
+    void
+    Invoke(HRESULT hr, const FILE_NOTIFY_INFORMATION* pNotifications) noexcept
+    {
+        try
+        {
+            m_callback(hr, pNotifications);
+        }
+        catch (...)
+        {
+            OBSERVE_CAUGHT_EXCEPTION();
+        }
+    }
+
+    HandleWrapper<NullHandleTraits> m_hDirectory;
+    DWORD                           m_dwNotifyFilter;
+    Callback                        m_callback;
+    std::atomic_bool                m_fStopped;
+    SRWLOCK                         m_callbackLock = SRWLOCK_INIT;
+    volatile LONG                   m_cRefs;
+    OVERLAPPED                      m_overlapped;
+    // ReadDirectoryChangesW requires a DWORD aligned buffer
+    DWORD                           m_buffer[DIRECTORY_WATCH_BUFFER_SIZE / sizeof(DWORD)];
+};
+
+void
+DirectoryWatchService::WatchDeleter::operator()(Watch* pWatch) const noexcept
+{
+    pWatch->Stop();
+}
+
+HRESULT
+DirectoryWatchService::StartWatching(
+    const std::wstring  &directory,
+    DWORD                dwNotifyFilter,
+    Callback             callback,
+    WatchHandle         &watch
+)
+{
+    auto& service = GetInstance();
+
+    watch = nullptr;
+
+    RETURN_IF_FAILED(service.EnsureStarted());
+
+    const HANDLE hDirectory = CreateFileW(
+        directory.c_str(),
+        FILE_LIST_DIRECTORY,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+        nullptr);
+    RETURN_LAST_ERROR_IF(hDirectory == INVALID_HANDLE_VALUE);
+
+    // Owns the directory handle from here on.
+    WatchHandle newWatch(new Watch(hDirectory, dwNotifyFilter, std::move(callback)));
+
+    RETURN_LAST_ERROR_IF_NULL(CreateIoCompletionPort(
+        newWatch->QueryDirectory(),
+        service.m_hCompletionPort,
+        reinterpret_cast<ULONG_PTR>(newWatch.get()),
+        0));
+
+    // Fails for file systems that cannot report changes.
+    RETURN_IF_FAILED(newWatch->Read());
+
+    watch = std::move(newWatch);
+    return S_OK;
+}
+
+bool
+DirectoryWatchService::IsNotificationFor(
+    const FILE_NOTIFY_INFORMATION  *pNotification,
+    const std::wstring             &fileName
+) noexcept
+{
+    const size_t cchFileName = pNotification->FileNameLength / sizeof(WCHAR);
+
+    return cchFileName == fileName.size() &&
+        _wcsnicmp(pNotification->FileName, fileName.c_str(), cchFileName) == 0;
+}
+
+const FILE_NOTIFY_INFORMATION*
+DirectoryWatchService::NextNotification(
+    const FILE_NOTIFY_INFORMATION  *pNotification
+) noexcept
+{
+    if (pNotification->NextEntryOffset == 0)
+    {
+        return nullptr;
+    }
+
+    return reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(
+        reinterpret_cast<const BYTE*>(pNotification) + pNotification->NextEntryOffset);
+}
+
+HRESULT
+DirectoryWatchService::EnsureStarted()
+{
+    SRWExclusiveLock lock(m_startLock);
+
+    if (m_cThreads != 0)
+    {
+        return S_OK;
+    }
+
+    if (m_hCompletionPort == nullptr)
+    {
+        RETURN_LAST_ERROR_IF_NULL(m_hCompletionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, c_threadCount));
+    }
+
+    // Reads complete on any of them, the threads hold no state of their own.
+    while (m_cThreads < c_threadCount)
+    {
+        RETURN_LAST_ERROR_IF_NULL(m_hThreads[m_cThreads] = CreateThread(nullptr,
+            0,
+            CompletionThread,
+            this,
+            0,
+            nullptr));
+        m_cThreads++;
+    }
+
+    return S_OK;
+}
+
+DWORD
+WINAPI
+DirectoryWatchService::CompletionThread(
+    LPVOID  pvArg
+)
+/*++
+
+Routine Description:
+
+    Completes the directory reads of every watch until the completion port
+    is closed with the process.
+
+--*/
+{
+    auto pService = static_cast<DirectoryWatchService*>(pvArg);
+
+    LOG_INFO(L"Starting directory watch thread");
+
+    while (true)
+    {
+        DWORD       cbCompletion = 0;
+        OVERLAPPED* pOverlapped = nullptr;
+        ULONG_PTR   completionKey = 0;
+
+        const BOOL success = GetQueuedCompletionStatus(
+            pService->m_hCompletionPort,
+            &cbCompletion,
+            &completionKey,
+            &pOverlapped,
+            INFINITE);
+
+        if (pOverlapped == nullptr)
+        {
+            // The port itself failed.
+            break;
+        }
+
+        reinterpret_cast<Watch*>(completionKey)->OnReadCompleted(
+            success ? S_OK : HRESULT_FROM_WIN32(GetLastError()),
+            cbCompletion);
+    }
+
+    LOG_INFO(L"Stopping directory watch thread");
+
+    return 0;
+}
+
+DirectoryWatchService&
+DirectoryWatchService::GetInstance()
+{
+    static DirectoryWatchService service;
+    return service;
+}
@@ -0,0 +1,86 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <Windows.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include "HandleWrapper.h"
+#include "NonCopyable.h"
+
+//
+// Watches directories with ReadDirectoryChangesW for the whole process.
+// The reads of every watched directory complete on one completion port,
+// served by a few threads started with the first watch. A directory only
+// has one read pending, its callbacks never run concurrently.
+//
+class DirectoryWatchService: NonCopyable
+{
+public:
+    //
+    // Called on a watcher thread with the changes of one read, or with
+    // nullptr if changes were lost and anything could have changed. A
+    // failed hr ends the watch. Must return quickly and must not stop the
+    // watch it is called for, the threads serve every directory.
+    //
+    using Callback = std::function<void(HRESULT hr, const FILE_NOTIFY_INFORMATION* pNotifications)>;
+
+    class Watch;
+
+    // Stops the watch, no callback runs anymore once it returns.
+    struct WatchDeleter
+    {
+        void operator()(Watch* pWatch) const noexcept;
+    };
+
+    using WatchHandle = std::unique_ptr<Watch, WatchDeleter>;
+
+    static
+    HRESULT
+    StartWatching(
+        const std::wstring  &directory,
+        DWORD                dwNotifyFilter,
+        Callback             callback,
+        WatchHandle         &watch
+    );
+
+    // Whether pNotification is about fileName, compared case insensitively.
+    static
+    bool
+    IsNotificationFor(
+        const FILE_NOTIFY_INFORMATION  *pNotification,
+        const std::wstring             &fileName
+    ) noexcept;
+
+    static
+    const FILE_NOTIFY_INFORMATION*
+    NextNotification(
+        const FILE_NOTIFY_INFORMATION  *pNotification
+    ) noexcept;
+
+private:
+    static constexpr DWORD c_threadCount = 2;
+
+    DirectoryWatchService() = default;
+
+    HRESULT
+    EnsureStarted();
+
+    static
+    DWORD
+    WINAPI
+    CompletionThread(
+        LPVOID  pvArg
+    );
+
+    static
+    DirectoryWatchService&
+    GetInstance();
+
+    SRWLOCK                             m_startLock = SRWLOCK_INIT;
+    HandleWrapper<NullHandleTraits>     m_hCompletionPort;
+    HandleWrapper<NullHandleTraits>     m_hThreads[c_threadCount];
+    DWORD                               m_cThreads = 0;
+};
@@ -159,11 +159,16 @@ HRESULT Environment::CopyToDirectory(const std::wstring& source, const std::file
         std::filesystem::remove_all(destination);
     }
 
-    Environment::CopyToDirectoryInner(source, destination, directoryToIgnore, copiedFileCount);
+    // The tree is walked first, only the files that changed are copied then.
+    std::vector<FileCopy> filesToCopy;
+    Environment::CopyToDirectoryInner(source, destination, directoryToIgnore, filesToCopy);
+
+    copiedFileCount += static_cast<int>(filesToCopy.size());
+    CopyFiles(filesToCopy);
     return S_OK;
 }
 
-void Environment::CopyToDirectoryInner(const std::filesystem::path& source, const std::filesystem::path& destination, const std::filesystem::path& directoryToIgnore, int& copiedFileCount)
+void Environment::CopyToDirectoryInner(const std::filesystem::path& source, const std::filesystem::path& destination, const std::filesystem::path& directoryToIgnore, std::vector<FileCopy>& filesToCopy)
 {
     auto destinationDirEntry = std::filesystem::directory_entry(destination);
     if (!destinationDirEntry.exists())
@@ -178,18 +183,16 @@ void Environment::CopyToDirectoryInner(const std::filesystem::path& source, cons
             auto sourceFile = path.path().filename();
             auto destinationPath = (destination / sourceFile);
 
-            if (std::filesystem::directory_entry(destinationPath).exists())
+            // The directory iterator already read the size and the write time of the source.
+            auto destinationEntry = std::filesystem::directory_entry(destinationPath);
+            if (destinationEntry.is_regular_file() &&
+                destinationEntry.file_size() == path.file_size() &&
+                path.last_write_time() <= destinationEntry.last_write_time()) // file write time is the same
             {
-                auto sourceFileTime = std::filesystem::last_write_time(path);
-                auto destinationFileTime = std::filesystem::last_write_time(destinationPath);
-                if (sourceFileTime <= destinationFileTime) // file write time is the same
-                {
-                    continue;
-                }
+                continue;
             }
 
-            copiedFileCount++;
-            CopyFile(path.path().wstring().c_str(), destinationPath.wstring().c_str(), FALSE);
+            filesToCopy.emplace_back(path.path(), std::move(destinationPath));
         }
         else if (path.is_directory())
         {
@@ -197,9 +200,67 @@ void Environment::CopyToDirectoryInner(const std::filesystem::path& source, cons
 
             if (sourceInnerDirectory.wstring().rfind(directoryToIgnore, 0) != 0)
             {
-                CopyToDirectoryInner(path.path(), destination / path.path().filename(), directoryToIgnore, copiedFileCount);
+                CopyToDirectoryInner(path.path(), destination / path.path().filename(), directoryToIgnore, filesToCopy);
+            }
+        }
+    }
+}
+
+void Environment::CopyFiles(const std::vector<FileCopy>& filesToCopy)
+{
+    struct COPY_STATE
+    {
+        const std::vector<FileCopy>* pFilesToCopy;
+        volatile LONG                nextFile;
+
+        static void CopyNextFiles(COPY_STATE* pState) noexcept
+        {
+            const auto& files = *pState->pFilesToCopy;
+            for (LONG i = InterlockedIncrement(&pState->nextFile); i < static_cast<LONG>(files.size()); i = InterlockedIncrement(&pState->nextFile))
+            {
+                if (!CopyFile(files[i].first.c_str(), files[i].second.c_str(), FALSE))
+                {
+                    LOG_INFOF(L"Could not copy '%ls' to '%ls', error %d", files[i].first.c_str(), files[i].second.c_str(), GetLastError());
+                }
             }
         }
+    };
+
+    COPY_STATE state { &filesToCopy, -1 };
+
+    const DWORD cProcessors = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+    const DWORD cCopies = static_cast<DWORD>(filesToCopy.size());
+    DWORD cWorkers = cProcessors < c_maxParallelCopies ? cProcessors : c_maxParallelCopies;
+    cWorkers = cWorkers < cCopies ? cWorkers : cCopies;
+
+    //
+    // The calling thread copies as well, the copy makes progress even if
+    // the thread pool can't run more work right away.
+    //
+    PTP_WORK pWork = nullptr;
+    if (cWorkers > 1)
+    {
+        pWork = CreateThreadpoolWork(
+            [](PTP_CALLBACK_INSTANCE, PVOID pContext, PTP_WORK) { COPY_STATE::CopyNextFiles(static_cast<COPY_STATE*>(pContext)); },
+            &state,
+            nullptr);
+        LOG_LAST_ERROR_IF(pWork == nullptr);
+    }
+
+    if (pWork != nullptr)
+    {
+        for (DWORD i = 1; i < cWorkers; i++)
+        {
+            SubmitThreadpoolWork(pWork);
+        }
+    }
+
+    COPY_STATE::CopyNextFiles(&state);
+
+    if (pWork != nullptr)
+    {
+        WaitForThreadpoolWorkCallbacks(pWork, FALSE);
+        CloseThreadpoolWork(pWork);
     }
 }
 
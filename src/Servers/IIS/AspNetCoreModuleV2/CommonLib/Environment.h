@@ -3,8 +3,11 @@
 
 #pragma once
 
+#include <filesystem>
 #include <string>
 #include <optional>
+#include <utility>
+#include <vector>
 
 class Environment
 {
@@ -27,7 +30,14 @@ public:
     static
     bool CheckUpToDate(const std::wstring& source, const std::filesystem::path& destination, const std::wstring& extension, const std::filesystem::path& directoryToIgnore);
 private:
+    using FileCopy = std::pair<std::filesystem::path, std::filesystem::path>;
+
+    // Files copied at the same time at most
+    static constexpr DWORD c_maxParallelCopies = 8;
+
+    static
+    void CopyToDirectoryInner(const std::filesystem::path& source_folder, const std::filesystem::path& target_folder, const std::filesystem::path& directoryToIgnore, std::vector<FileCopy>& filesToCopy);
     static
-    void CopyToDirectoryInner(const std::filesystem::path& source_folder, const std::filesystem::path& target_folder, const std::filesystem::path& directoryToIgnore, int& copiedFileCount);
+    void CopyFiles(const std::vector<FileCopy>& filesToCopy);
 };
 
@@ -0,0 +1,70 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "EpochReaders.h"
+
+#include "exceptions.h"
+
+EpochReaders::~EpochReaders()
+{
+    if (m_pBanks != nullptr)
+    {
+        m_pBanks->Dispose();
+        m_pBanks = nullptr;
+    }
+}
+
+// static
+HRESULT
+EpochReaders::Create(std::unique_ptr<EpochReaders>& pReaders) noexcept
+{
+    std::unique_ptr<EpochReaders> pNew(new (std::nothrow) EpochReaders());
+    if (pNew == nullptr)
+    {
+        RETURN_HR(E_OUTOFMEMORY);
+    }
+
+    RETURN_IF_FAILED(PER_CPU<BANKS>::Create([](BANKS* pBanks)
+    {
+        pBanks->counts[0] = 0;
+        pBanks->counts[1] = 0;
+    }, &pNew->m_pBanks));
+
+    pReaders = std::move(pNew);
+    return S_OK;
+}
+
+LONG*
+EpochReaders::Enter() noexcept
+{
+    //
+    // The count is bumped before the caller loads the object, so that a
+    // writer retiring it either sees the reader or the reader sees the
+    // replacement.
+    //
+    const LONG lEpoch = ReadAcquire(&m_lEpoch);
+    LONG* pcReaders = const_cast<LONG*>(&m_pBanks->GetLocal()->counts[lEpoch & 1]);
+    InterlockedIncrement(pcReaders);
+    return pcReaders;
+}
+
+VOID
+EpochReaders::Advance() noexcept
+{
+    for (DWORD i = 0; i < 2; ++i)
+    {
+        const LONG lEpoch = m_lEpoch;
+        const DWORD dwNextBank = (lEpoch + 1) & 1;
+        const LONG cReaders = m_pBanks->Aggregate<LONG>([dwNextBank](BANKS* pBanks)
+        {
+            return InterlockedCompareExchange(&pBanks->counts[dwNextBank], 0, 0);
+        });
+
+        if (cReaders != 0)
+        {
+            return;
+        }
+
+        InterlockedExchange(&m_lEpoch, lEpoch + 1);
+    }
+}
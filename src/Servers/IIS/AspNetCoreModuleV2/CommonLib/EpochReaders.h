@@ -0,0 +1,79 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <Windows.h>
+#include <memory>
+#include "NonCopyable.h"
+#include "percpu.h"
+
+//
+// Tells when an object replaced under lock-free readers can be freed.
+//
+// Readers count themselves, per CPU, in the bank of the parity of the
+// epoch they enter in. A writer replaces the object, retires the previous
+// one at QueryEpoch() and calls Advance, which moves the epoch on only once
+// the bank it switches to is empty, i.e. once the readers that entered two
+// epochs before are gone. A reader that saw an object retired at epoch E
+// counted itself before it was retired, in the bank that one of the
+// advances to E + 1 and E + 2 found empty, so the object is free once the
+// epoch reached E + 2.
+//
+// New readers always enter the current bank, so the other one drains even
+// under sustained load. Enter and Exit are wait free; writers serialize
+// the calls to Advance.
+//
+class EpochReaders : NonCopyable
+{
+public:
+    ~EpochReaders();
+
+    static
+    HRESULT
+    Create(std::unique_ptr<EpochReaders>& pReaders) noexcept;
+
+    //
+    // To be called before the object is loaded. The counter is handed back
+    // to Exit as the thread may have migrated meanwhile.
+    //
+    LONG*
+    Enter() noexcept;
+
+    static
+    VOID
+    Exit(LONG* pcReaders) noexcept
+    {
+        InterlockedDecrement(pcReaders);
+    }
+
+    // The epoch an object replaced now is retired at.
+    LONG
+    QueryEpoch() const noexcept
+    {
+        return ReadAcquire(&m_lEpoch);
+    }
+
+    //
+    // Moves the epoch on as far as the readers allow, by two at most.
+    //
+    VOID
+    Advance() noexcept;
+
+    bool
+    IsReclaimable(LONG lRetiredEpoch) const noexcept
+    {
+        return QueryEpoch() - lRetiredEpoch >= 2;
+    }
+
+private:
+    struct BANKS
+    {
+        volatile LONG counts[2];
+    };
+
+    EpochReaders() noexcept = default;
+
+    PER_CPU<BANKS>*             m_pBanks = nullptr;
+    volatile LONG               m_lEpoch = 0;
+};
@@ -3,12 +3,58 @@
 
 #include <array>
 #include "EventLog.h"
+#include "EventLogLimiter.h"
 #include "debugutil.h"
 #include "exceptions.h"
 
 extern HANDLE       g_hEventLog;
 
-bool
+// How long Stop waits for an event being written.
+#define EVENT_LOG_STOP_TIMEOUT_MS   1000
+
+namespace
+{
+    void
+    WriteEvent(
+        WORD                dwEventInfoType,
+        DWORD               dwEventId,
+        const std::wstring &message
+    )
+    {
+        if (g_hEventLog == nullptr)
+        {
+            return;
+        }
+        // Static locals to avoid getting the process ID and string multiple times.
+        // Effectively have the same semantics as global variables, except initialized
+        // on first occurrence.
+        static const auto processIdString = GetProcessIdString();
+        static const auto versionInfoString = GetVersionInfoString();
+
+        std::array<LPCWSTR, 3> eventLogDataStrings
+        {
+            message.c_str(),
+            processIdString.c_str(),
+            versionInfoString.c_str()
+        };
+
+        // Not logged on failure, that would be one more event.
+        ReportEventW(g_hEventLog,
+            dwEventInfoType,
+            0,        // wCategory
+            dwEventId,
+            NULL,     // lpUserSid
+            static_cast<WORD>(eventLogDataStrings.size()), // wNumStrings
+            0,        // dwDataSize,
+            eventLogDataStrings.data(),
+            NULL      // lpRawData
+        );
+    }
+
+    EventLogLimiter g_eventLogLimiter(WriteEvent);
+}
+
+VOID
 EventLog::LogEventNoTrace(
     _In_ WORD    dwEventInfoType,
     _In_ DWORD   dwEventId,
@@ -17,31 +63,16 @@ EventLog::LogEventNoTrace(
 {
     if (g_hEventLog == nullptr)
     {
-        return true;
+        return;
     }
-    // Static locals to avoid getting the process ID and string multiple times.
-    // Effectively have the same semantics as global variables, except initialized
-    // on first occurrence.
-    static const auto processIdString = GetProcessIdString();
-    static const auto versionInfoString = GetVersionInfoString();
-    
-    std::array<LPCWSTR, 3> eventLogDataStrings
-    {
-        pstrMsg,
-        processIdString.c_str(),
-        versionInfoString.c_str()
-    };
 
-    return ReportEventW(g_hEventLog,
-        dwEventInfoType,
-        0,        // wCategory
-        dwEventId,
-        NULL,     // lpUserSid
-        static_cast<WORD>(eventLogDataStrings.size()), // wNumStrings
-        0,        // dwDataSize,
-        eventLogDataStrings.data(),
-        NULL      // lpRawData
-    );
+    g_eventLogLimiter.Report(dwEventInfoType, dwEventId, pstrMsg);
+}
+
+VOID
+EventLog::Stop()
+{
+    g_eventLogLimiter.Stop(EVENT_LOG_STOP_TIMEOUT_MS);
 }
 
 VOID
@@ -51,7 +82,7 @@ EventLog::LogEvent(
     _In_ LPCWSTR pstrMsg
 )
 {
-    LOG_LAST_ERROR_IF(!LogEventNoTrace(dwEventInfoType, dwEventId, pstrMsg));
+    LogEventNoTrace(dwEventInfoType, dwEventId, pstrMsg);
 
     DebugPrintfW(dwEventInfoType == EVENTLOG_ERROR_TYPE ? ASPNETCORE_DEBUG_FLAG_ERROR : ASPNETCORE_DEBUG_FLAG_INFO, L"Event Log: '%ls' \r\nEnd Event Log Message.", pstrMsg);
 }
@@ -59,13 +59,26 @@ public:
        _va_end(args);
     }
 
+    //
+    // Queues the event to be written off the calling thread, see
+    // EventLogLimiter for which events are written.
+    //
     static
-    bool
+    VOID
     LogEventNoTrace(
         _In_ WORD    dwEventInfoType,
         _In_ DWORD   dwEventId,
         _In_ LPCWSTR pstrMsg);
 
+    //
+    // Writes the queued events and suppression summaries, later events
+    // are written on the calling thread. Called before g_hEventLog goes
+    // away.
+    //
+    static
+    VOID
+    Stop();
+
 private:
     static
     VOID
@@ -0,0 +1,475 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include "EventLogLimiter.h"
+#include "SRWExclusiveLock.h"
+#include "SRWSharedLock.h"
+#include "StringHelpers.h"
+#include "resources.h"
+
+EventLogLimiter::EventLogLimiter(
+    Sink sink,
+    DWORD dwMaxEventsPerWindow,
+    DWORD dwWindowMs) noexcept :
+    m_sink(std::move(sink)),
+    m_dwMaxEventsPerWindow(dwMaxEventsPerWindow),
+    m_dwWindowMs(dwWindowMs),
+    m_rgKeys(),
+    m_cDropped(0),
+    m_wDroppedType(0),
+    m_dwDroppedEventId(0),
+    m_pTimer(nullptr),
+    m_fTimerArmed(false),
+    m_fStopped(false),
+    m_lWriterActive(0)
+{
+    InitializeSRWLock(&m_lock);
+}
+
+EventLogLimiter::~EventLogLimiter()
+{
+    // Stop already closed the timer of the module's limiter, this does not
+    // wait at module unload.
+    if (m_pTimer != nullptr)
+    {
+        SetThreadpoolTimer(m_pTimer, nullptr, 0, 0);
+        WaitForThreadpoolTimerCallbacks(m_pTimer, TRUE);
+        CloseThreadpoolTimer(m_pTimer);
+        m_pTimer = nullptr;
+    }
+}
+
+void
+EventLogLimiter::Report(WORD wType, DWORD dwEventId, PCWSTR pszMessage) noexcept
+{
+    try
+    {
+        const ULONG ulFingerprint = Fingerprint(pszMessage);
+        const ULONGLONG ullNow = GetTickCount64();
+        std::deque<Event> events;
+        bool fStopped;
+
+        {
+            SRWExclusiveLock lock(m_lock);
+
+            Key& key = FindKeyNoLock(wType, dwEventId, ulFingerprint, ullNow, events);
+            if (ullNow - key.ullWindowStart >= m_dwWindowMs)
+            {
+                EndWindowNoLock(key, ullNow, events);
+            }
+
+            if (key.cWritten < m_dwMaxEventsPerWindow)
+            {
+                key.cWritten++;
+                events.push_back({ wType, dwEventId, pszMessage });
+            }
+            else
+            {
+                key.cSuppressed++;
+                key.lastSuppressed = pszMessage;
+                ArmTimerNoLock(ullNow);
+            }
+
+            QueueNoLock(events);
+            fStopped = m_fStopped;
+        }
+
+        if (fStopped)
+        {
+            WriteNow(events);
+        }
+        else
+        {
+            ScheduleWriter();
+        }
+    }
+    catch (...)
+    {
+        // Out of memory, the event is lost.
+    }
+}
+
+void
+EventLogLimiter::Stop(DWORD dwTimeoutMs) noexcept
+{
+    std::deque<Event> summaries;
+    PTP_TIMER pTimer;
+
+    try
+    {
+        SRWExclusiveLock lock(m_lock);
+
+        if (m_fStopped)
+        {
+            return;
+        }
+
+        m_fStopped = true;
+        pTimer = m_pTimer;
+        m_pTimer = nullptr;
+        m_fTimerArmed = false;
+
+        const ULONGLONG ullNow = GetTickCount64();
+        for (auto& key : m_rgKeys)
+        {
+            if (key.fInUse && key.cSuppressed != 0)
+            {
+                EndWindowNoLock(key, ullNow, summaries);
+            }
+        }
+    }
+    catch (...)
+    {
+        // Out of memory, the summaries are lost.
+        pTimer = nullptr;
+    }
+
+    //
+    // Not waiting for a callback in progress, this runs at module unload.
+    // The callback sees m_fStopped and leaves alone.
+    //
+    if (pTimer != nullptr)
+    {
+        SetThreadpoolTimer(pTimer, nullptr, 0, 0);
+        CloseThreadpoolTimer(pTimer);
+    }
+
+    const ULONGLONG ullStartTick = GetTickCount64();
+    while (InterlockedCompareExchange(&m_lWriterActive, 1L, 0L) != 0L)
+    {
+        if (GetTickCount64() - ullStartTick >= dwTimeoutMs)
+        {
+            // The writer drains the queue, only the summaries are left.
+            WriteNow(summaries);
+            return;
+        }
+        Sleep(1);
+    }
+
+    // m_lWriterActive stays set so no work item is scheduled anymore.
+    while (WriteQueued())
+    {
+    }
+
+    WriteNow(summaries);
+}
+
+// static
+ULONG
+EventLogLimiter::Fingerprint(PCWSTR pszMessage) noexcept
+{
+    // FNV-1a
+    ULONG ulHash = 2166136261UL;
+    for (PCWSTR pch = pszMessage; *pch != L'\0'; ++pch)
+    {
+        if (*pch >= L'0' && *pch <= L'9')
+        {
+            continue;
+        }
+
+        ulHash ^= static_cast<ULONG>(*pch);
+        ulHash *= 16777619UL;
+    }
+
+    return ulHash;
+}
+
+EventLogLimiter::Key&
+EventLogLimiter::FindKeyNoLock(WORD wType, DWORD dwEventId, ULONG ulFingerprint, ULONGLONG ullNow, std::deque<Event>& events)
+{
+    Key* pVictim = nullptr;
+    for (auto& key : m_rgKeys)
+    {
+        if (!key.fInUse)
+        {
+            if (pVictim == nullptr || pVictim->fInUse)
+            {
+                pVictim = &key;
+            }
+            continue;
+        }
+
+        if (key.dwEventId == dwEventId && key.ulFingerprint == ulFingerprint && key.wType == wType)
+        {
+            return key;
+        }
+
+        if (pVictim == nullptr || (pVictim->fInUse && key.ullWindowStart < pVictim->ullWindowStart))
+        {
+            pVictim = &key;
+        }
+    }
+
+    if (pVictim->fInUse)
+    {
+        EndWindowNoLock(*pVictim, ullNow, events);
+    }
+
+    pVictim->fInUse = true;
+    pVictim->wType = wType;
+    pVictim->dwEventId = dwEventId;
+    pVictim->ulFingerprint = ulFingerprint;
+    pVictim->ullWindowStart = ullNow;
+    pVictim->cWritten = 0;
+    pVictim->cSuppressed = 0;
+    pVictim->lastSuppressed.clear();
+    return *pVictim;
+}
+
+void
+EventLogLimiter::EndWindowNoLock(Key& key, ULONGLONG ullNow, std::deque<Event>& events)
+{
+    if (key.cSuppressed != 0)
+    {
+        events.push_back({
+            key.wType,
+            key.dwEventId,
+            format(ASPNETCORE_EVENT_SUPPRESSED_MSG,
+                key.cSuppressed,
+                static_cast<DWORD>((ullNow - key.ullWindowStart) / 1000),
+                key.lastSuppressed.c_str()) });
+    }
+
+    key.ullWindowStart = ullNow;
+    key.cWritten = 0;
+    key.cSuppressed = 0;
+    key.lastSuppressed.clear();
+}
+
+void
+EventLogLimiter::ArmTimerNoLock(ULONGLONG ullNow) noexcept
+{
+    if (m_fStopped || m_fTimerArmed)
+    {
+        return;
+    }
+
+    if (m_pTimer == nullptr)
+    {
+        m_pTimer = CreateThreadpoolTimer(TimerCallback, this, nullptr);
+        if (m_pTimer == nullptr)
+        {
+            // The summary goes out with the next similar event or on Stop.
+            return;
+        }
+    }
+
+    ULONGLONG ullDueMs = m_dwWindowMs;
+    for (const auto& key : m_rgKeys)
+    {
+        if (key.fInUse && key.cSuppressed != 0)
+        {
+            const ULONGLONG ullElapsed = ullNow - key.ullWindowStart;
+            ullDueMs = min(ullDueMs, ullElapsed >= m_dwWindowMs ? 0 : m_dwWindowMs - ullElapsed);
+        }
+    }
+
+    ULARGE_INTEGER dueTime;
+    dueTime.QuadPart = static_cast<ULONGLONG>(-static_cast<LONGLONG>(ullDueMs) * 10000);
+    FILETIME ftDueTime;
+    ftDueTime.dwLowDateTime = dueTime.LowPart;
+    ftDueTime.dwHighDateTime = dueTime.HighPart;
+
+    SetThreadpoolTimer(m_pTimer, &ftDueTime, 0, 1000);
+    m_fTimerArmed = true;
+}
+
+void
+EventLogLimiter::QueueNoLock(std::deque<Event>& events)
+{
+    if (m_fStopped)
+    {
+        return;
+    }
+
+    for (auto& event : events)
+    {
+        if (m_queue.size() >= MAX_QUEUED_EVENTS)
+        {
+            if (m_cDropped++ == 0)
+            {
+                m_wDroppedType = event.wType;
+                m_dwDroppedEventId = event.dwEventId;
+            }
+            continue;
+        }
+
+        m_queue.push_back(std::move(event));
+    }
+
+    events.clear();
+}
+
+void
+EventLogLimiter::WriteNow(std::deque<Event>& events) noexcept
+{
+    for (const auto& event : events)
+    {
+        try
+        {
+            m_sink(event.wType, event.dwEventId, event.message);
+        }
+        catch (...)
+        {
+            // ignore
+        }
+    }
+
+    events.clear();
+}
+
+bool
+EventLogLimiter::WriteQueued() noexcept
+{
+    try
+    {
+        Event event;
+        DWORD cDropped = 0;
+
+        {
+            SRWExclusiveLock lock(m_lock);
+            if (!m_queue.empty())
+            {
+                event = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+            else if (m_cDropped != 0)
+            {
+                cDropped = m_cDropped;
+                event.wType = m_wDroppedType;
+                event.dwEventId = m_dwDroppedEventId;
+                m_cDropped = 0;
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        if (cDropped != 0)
+        {
+            event.message = format(ASPNETCORE_EVENT_DROPPED_MSG, cDropped);
+        }
+
+        m_sink(event.wType, event.dwEventId, event.message);
+        return true;
+    }
+    catch (...)
+    {
+        // Out of memory, what was dequeued is lost.
+        return true;
+    }
+}
+
+void
+EventLogLimiter::ScheduleWriter()
+{
+    if (InterlockedCompareExchange(&m_lWriterActive, 1L, 0L) != 0L)
+    {
+        // The running writer picks the event up.
+        return;
+    }
+
+    if (!TrySubmitThreadpoolCallback(WriteCallback, this, nullptr))
+    {
+        // Left queued for the next Report to schedule.
+        InterlockedExchange(&m_lWriterActive, 0L);
+    }
+}
+
+// static
+VOID
+CALLBACK
+EventLogLimiter::WriteCallback(
+    _Inout_ PTP_CALLBACK_INSTANCE   Instance,
+    _Inout_opt_ PVOID               pContext
+)
+{
+    UNREFERENCED_PARAMETER(Instance);
+
+    auto pLimiter = static_cast<EventLogLimiter*>(pContext);
+
+    for (;;)
+    {
+        while (pLimiter->WriteQueued())
+        {
+        }
+
+        InterlockedExchange(&pLimiter->m_lWriterActive, 0L);
+
+        // An event queued after the last dequeue may have seen the writer
+        // still active and not scheduled another one.
+        bool fHasQueued;
+        {
+            SRWSharedLock lock(pLimiter->m_lock);
+            fHasQueued = !pLimiter->m_fStopped && (!pLimiter->m_queue.empty() || pLimiter->m_cDropped != 0);
+        }
+
+        if (!fHasQueued ||
+            InterlockedCompareExchange(&pLimiter->m_lWriterActive, 1L, 0L) != 0L)
+        {
+            break;
+        }
+    }
+}
+
+// static
+VOID
+CALLBACK
+EventLogLimiter::TimerCallback(
+    _Inout_     PTP_CALLBACK_INSTANCE   Instance,
+    _Inout_opt_ PVOID                   pContext,
+    _Inout_     PTP_TIMER               pTimer
+)
+{
+    UNREFERENCED_PARAMETER(Instance);
+    UNREFERENCED_PARAMETER(pTimer);
+
+    auto pLimiter = static_cast<EventLogLimiter*>(pContext);
+
+    try
+    {
+        SRWExclusiveLock lock(pLimiter->m_lock);
+
+        pLimiter->m_fTimerArmed = false;
+        if (pLimiter->m_fStopped)
+        {
+            return;
+        }
+
+        std::deque<Event> summaries;
+        bool fSuppressing = false;
+        const ULONGLONG ullNow = GetTickCount64();
+        for (auto& key : pLimiter->m_rgKeys)
+        {
+            if (!key.fInUse || key.cSuppressed == 0)
+            {
+                continue;
+            }
+
+            if (ullNow - key.ullWindowStart >= pLimiter->m_dwWindowMs)
+            {
+                pLimiter->EndWindowNoLock(key, ullNow, summaries);
+            }
+            else
+            {
+                fSuppressing = true;
+            }
+        }
+
+        if (fSuppressing)
+        {
+            pLimiter->ArmTimerNoLock(ullNow);
+        }
+
+        pLimiter->QueueNoLock(summaries);
+    }
+    catch (...)
+    {
+        // Out of memory, the summaries are lost.
+        return;
+    }
+
+    pLimiter->ScheduleWriter();
+}
@@ -0,0 +1,126 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <Windows.h>
+#include <deque>
+#include <functional>
+#include <string>
+#include "NonCopyable.h"
+
+//
+// Writes Event Log events off the calling thread and limits how many
+// similar ones are written. Events are similar if they have the same id
+// and the same message once digits are ignored, which keeps the process
+// ids, ports and error codes of a crash loop from making every occurrence
+// unique while the events of different applications stay apart.
+//
+// Of similar events only the first MaxEventsPerWindow of a window are
+// written, the others are counted and one summary is written with the id
+// of the suppressed ones once the window ended.
+//
+class EventLogLimiter : NonCopyable
+{
+public:
+    // Called on the writer thread, or on the caller once stopped.
+    using Sink = std::function<void(WORD wType, DWORD dwEventId, const std::wstring& message)>;
+
+    static constexpr DWORD DEFAULT_MAX_EVENTS_PER_WINDOW = 10;
+    static constexpr DWORD DEFAULT_WINDOW_MS = 60 * 1000;
+
+    // Similar events tracked at once, the key with the oldest window gives
+    // way to a new one.
+    static constexpr size_t MAX_KEYS = 64;
+
+    // Events waiting for the writer, more are dropped and counted.
+    static constexpr size_t MAX_QUEUED_EVENTS = 256;
+
+    EventLogLimiter(
+        Sink sink,
+        DWORD dwMaxEventsPerWindow = DEFAULT_MAX_EVENTS_PER_WINDOW,
+        DWORD dwWindowMs = DEFAULT_WINDOW_MS) noexcept;
+
+    ~EventLogLimiter();
+
+    void Report(WORD wType, DWORD dwEventId, PCWSTR pszMessage) noexcept;
+
+    // Writes the pending summaries and queued events on the calling
+    // thread, waiting at most dwTimeoutMs for an event being written.
+    // Events reported afterwards are still limited but written right away.
+    // Only the first call does anything.
+    void Stop(DWORD dwTimeoutMs) noexcept;
+
+private:
+    struct Event
+    {
+        WORD            wType;
+        DWORD           dwEventId;
+        std::wstring    message;
+    };
+
+    struct Key
+    {
+        bool            fInUse;
+        WORD            wType;
+        DWORD           dwEventId;
+        ULONG           ulFingerprint;
+        ULONGLONG       ullWindowStart;
+        DWORD           cWritten;
+        DWORD           cSuppressed;
+        std::wstring    lastSuppressed;
+    };
+
+    static ULONG Fingerprint(PCWSTR pszMessage) noexcept;
+
+    Key& FindKeyNoLock(WORD wType, DWORD dwEventId, ULONG ulFingerprint, ULONGLONG ullNow, std::deque<Event>& events);
+
+    // Moves the summary of the suppressed events of key to events and
+    // starts a new window.
+    void EndWindowNoLock(Key& key, ULONGLONG ullNow, std::deque<Event>& events);
+
+    void ArmTimerNoLock(ULONGLONG ullNow) noexcept;
+
+    // Queues events, or returns them to be written by the caller once
+    // stopped.
+    void QueueNoLock(std::deque<Event>& events);
+
+    void WriteNow(std::deque<Event>& events) noexcept;
+
+    bool WriteQueued() noexcept;
+
+    void ScheduleWriter();
+
+    static
+    VOID
+    CALLBACK
+    WriteCallback(
+        _Inout_ PTP_CALLBACK_INSTANCE   Instance,
+        _Inout_opt_ PVOID               pContext);
+
+    static
+    VOID
+    CALLBACK
+    TimerCallback(
+        _Inout_     PTP_CALLBACK_INSTANCE   Instance,
+        _Inout_opt_ PVOID                   pContext,
+        _Inout_     PTP_TIMER               pTimer);
+
+    Sink                m_sink;
+    DWORD               m_dwMaxEventsPerWindow;
+    DWORD               m_dwWindowMs;
+
+    SRWLOCK             m_lock;
+    Key                 m_rgKeys[MAX_KEYS];
+    std::deque<Event>   m_queue;
+    DWORD               m_cDropped;
+    WORD                m_wDroppedType;
+    DWORD               m_dwDroppedEventId;
+    // Ends the windows nothing more was reported for.
+    PTP_TIMER           m_pTimer;
+    bool                m_fTimerArmed;
+    bool                m_fStopped;
+
+    // Set while a thread owns the consumer side of the queue.
+    volatile LONG       m_lWriterActive;
+};
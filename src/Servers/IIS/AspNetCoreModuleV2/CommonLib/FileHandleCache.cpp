@@ -0,0 +1,243 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "FileHandleCache.h"
+
+#include <filesystem>
+#include "debugutil.h"
+#include "exceptions.h"
+#include "SRWExclusiveLock.h"
+#include "SRWSharedLock.h"
+
+HRESULT
+FileHandleCache::Entry::Initialize(
+    const std::wstring     &path
+)
+{
+    m_hFile = CreateFile(path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN,
+        nullptr);
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        // Not logged, a missing file is the usual 404.
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    BY_HANDLE_FILE_INFORMATION fileInformation;
+    RETURN_LAST_ERROR_IF(!GetFileInformationByHandle(m_hFile, &fileInformation));
+
+    if (fileInformation.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+    {
+        return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    }
+
+    ULARGE_INTEGER liSize;
+    liSize.LowPart = fileInformation.nFileSizeLow;
+    liSize.HighPart = fileInformation.nFileSizeHigh;
+
+    ULARGE_INTEGER liLastWriteTime;
+    liLastWriteTime.LowPart = fileInformation.ftLastWriteTime.dwLowDateTime;
+    liLastWriteTime.HighPart = fileInformation.ftLastWriteTime.dwHighDateTime;
+
+    m_cbFile = liSize.QuadPart;
+    m_ftLastWriteTime = fileInformation.ftLastWriteTime;
+
+    try
+    {
+        m_etag = format("\"%llx:%llx\"", liLastWriteTime.QuadPart, liSize.QuadPart);
+    }
+    CATCH_RETURN();
+
+    return S_OK;
+}
+
+FileHandleCache::~FileHandleCache()
+{
+    decltype(m_directories) directories;
+    {
+        SRWExclusiveLock lock(m_lock);
+        directories.swap(m_directories);
+    }
+
+    // Outside of the lock, stopping a watch waits for its callback.
+    for (auto& directory : directories)
+    {
+        directory.second->watch = nullptr;
+    }
+
+    for (auto& directory : directories)
+    {
+        for (auto& file : directory.second->files)
+        {
+            file.second->Dereference();
+        }
+    }
+}
+
+HRESULT
+FileHandleCache::Open(
+    PCWSTR              pszPath,
+    Entry             **ppEntry
+)
+{
+    *ppEntry = nullptr;
+
+    try
+    {
+        const std::filesystem::path path(pszPath);
+        const auto directoryPath = path.parent_path().wstring();
+        const auto fileName = path.filename().wstring();
+
+        Directory  *pDirectory = nullptr;
+        DWORD       dwGeneration = 0;
+
+        {
+            SRWSharedLock lock(m_lock);
+
+            const auto directory = m_directories.find(directoryPath);
+            if (directory != m_directories.end())
+            {
+                pDirectory = directory->second.get();
+                dwGeneration = pDirectory->dwGeneration;
+
+                const auto file = pDirectory->files.find(fileName);
+                if (file != pDirectory->files.end())
+                {
+                    file->second->Reference();
+                    *ppEntry = file->second;
+                    return S_OK;
+                }
+            }
+        }
+
+        if (pDirectory == nullptr)
+        {
+            SRWExclusiveLock lock(m_lock);
+
+            auto& pNewDirectory = m_directories[directoryPath];
+            if (pNewDirectory == nullptr)
+            {
+                pNewDirectory = std::make_unique<Directory>();
+
+                Directory* pWatchedDirectory = pNewDirectory.get();
+                const HRESULT hr = DirectoryWatchService::StartWatching(
+                    directoryPath,
+                    FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE,
+                    [this, pWatchedDirectory](HRESULT hrWatch, const FILE_NOTIFY_INFORMATION* pNotifications) noexcept
+                    {
+                        OnDirectoryChanged(*pWatchedDirectory, hrWatch, pNotifications);
+                    },
+                    pNewDirectory->watch);
+
+                if (FAILED(hr))
+                {
+                    LOG_INFOF(L"Could not watch '%ls' (%x), its files are not cached", directoryPath.c_str(), hr);
+                }
+                else
+                {
+                    pNewDirectory->fWatching = true;
+                }
+            }
+
+            pDirectory = pNewDirectory.get();
+            dwGeneration = pDirectory->dwGeneration;
+        }
+
+        //
+        // Opened outside of the lock. The watch was started first, a change
+        // made from now on moves the generation and the entry isn't kept.
+        //
+        Entry* pEntry = new Entry();
+        const HRESULT hr = pEntry->Initialize(path.wstring());
+        if (FAILED(hr))
+        {
+            pEntry->Dereference();
+            return hr;
+        }
+
+        SRWExclusiveLock lock(m_lock);
+
+        if (!pDirectory->fWatching ||
+            pDirectory->dwGeneration != dwGeneration ||
+            m_cEntries >= MAX_ENTRIES)
+        {
+            *ppEntry = pEntry;
+            return S_OK;
+        }
+
+        const auto inserted = pDirectory->files.emplace(fileName, pEntry);
+        if (!inserted.second)
+        {
+            // Opened by another request meanwhile.
+            pEntry->Dereference();
+            pEntry = inserted.first->second;
+        }
+        else
+        {
+            m_cEntries++;
+        }
+
+        pEntry->Reference();
+        *ppEntry = pEntry;
+        return S_OK;
+    }
+    CATCH_RETURN();
+}
+
+void
+FileHandleCache::DropFilesNoLock(
+    Directory          &directory
+) noexcept
+{
+    for (auto& file : directory.files)
+    {
+        file.second->Dereference();
+    }
+
+    m_cEntries -= directory.files.size();
+    directory.files.clear();
+}
+
+void
+FileHandleCache::OnDirectoryChanged(
+    Directory                          &directory,
+    HRESULT                             hr,
+    const FILE_NOTIFY_INFORMATION      *pNotifications
+) noexcept
+{
+    SRWExclusiveLock lock(m_lock);
+
+    directory.dwGeneration++;
+
+    if (FAILED(hr) || pNotifications == nullptr)
+    {
+        // Changes aren't reported anymore, or some were lost.
+        directory.fWatching = directory.fWatching && SUCCEEDED(hr);
+        DropFilesNoLock(directory);
+        return;
+    }
+
+    for (auto pNotification = pNotifications; pNotification != nullptr; pNotification = DirectoryWatchService::NextNotification(pNotification))
+    {
+        try
+        {
+            const auto file = directory.files.find(std::wstring(pNotification->FileName, pNotification->FileNameLength / sizeof(WCHAR)));
+            if (file != directory.files.end())
+            {
+                file->second->Dereference();
+                directory.files.erase(file);
+                m_cEntries--;
+            }
+        }
+        catch (...)
+        {
+            OBSERVE_CAUGHT_EXCEPTION();
+            DropFilesNoLock(directory);
+            return;
+        }
+    }
+}
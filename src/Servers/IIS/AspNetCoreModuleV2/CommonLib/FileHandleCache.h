@@ -0,0 +1,147 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <Windows.h>
+#include <map>
+#include <memory>
+#include <string>
+#include "DirectoryWatchService.h"
+#include "NonCopyable.h"
+#include "StringHelpers.h"
+
+//
+// Open handles of the files an application sends, with their size, last
+// write time and ETag, so that a response can reference a file with an
+// HttpDataChunkFromFileHandle chunk without opening it for every request.
+//
+// The directory of the cached files is watched with DirectoryWatchService.
+// A file is dropped from the cache once it is changed, renamed or deleted,
+// and every file of a directory once its changes were lost. Files of a
+// directory that can't be watched, or past MAX_ENTRIES, are opened every
+// time instead.
+//
+// Files are opened for overlapped reads and share read, write and delete
+// access like the IIS file cache does, so a deployment isn't blocked by
+// the handles.
+//
+class FileHandleCache: NonCopyable
+{
+public:
+    //
+    // An opened file. The handle stays open while the entry is referenced,
+    // including after it was dropped from the cache.
+    //
+    class Entry: NonCopyable
+    {
+    public:
+        HANDLE
+        QueryHandle() const noexcept
+        {
+            return m_hFile;
+        }
+
+        ULONGLONG
+        QuerySize() const noexcept
+        {
+            return m_cbFile;
+        }
+
+        const FILETIME&
+        QueryLastWriteTime() const noexcept
+        {
+            return m_ftLastWriteTime;
+        }
+
+        // Quoted, the value of an ETag header.
+        const std::string&
+        QueryETag() const noexcept
+        {
+            return m_etag;
+        }
+
+        void
+        Reference() noexcept
+        {
+            InterlockedIncrement(&m_cRefs);
+        }
+
+        void
+        Dereference() noexcept
+        {
+            if (InterlockedDecrement(&m_cRefs) == 0)
+            {
+                delete this;
+            }
+        }
+
+    private:
+        friend class FileHandleCache;
+
+        Entry() noexcept = default;
+
+        ~Entry()
+        {
+            if (m_hFile != INVALID_HANDLE_VALUE)
+            {
+                CloseHandle(m_hFile);
+            }
+        }
+
+        HRESULT
+        Initialize(
+            const std::wstring     &path
+        );
+
+        HANDLE          m_hFile = INVALID_HANDLE_VALUE;
+        ULONGLONG       m_cbFile = 0;
+        FILETIME        m_ftLastWriteTime = {};
+        std::string     m_etag;
+        volatile LONG   m_cRefs = 1;
+    };
+
+    FileHandleCache() noexcept = default;
+
+    ~FileHandleCache();
+
+    //
+    // pszPath is a full path. The entry is referenced for the caller, which
+    // dereferences it once nothing is sent from the handle anymore.
+    //
+    HRESULT
+    Open(
+        PCWSTR              pszPath,
+        Entry             **ppEntry
+    );
+
+    static constexpr size_t MAX_ENTRIES = 4096;
+
+private:
+    struct Directory
+    {
+        DirectoryWatchService::WatchHandle              watch;
+        std::map<std::wstring, Entry*, ignore_case_comparer> files;
+        // Changed by every notification, an entry opened across one isn't cached.
+        DWORD                                           dwGeneration = 0;
+        bool                                            fWatching = false;
+    };
+
+    // Called with m_lock held exclusively.
+    void
+    DropFilesNoLock(
+        Directory          &directory
+    ) noexcept;
+
+    void
+    OnDirectoryChanged(
+        Directory                          &directory,
+        HRESULT                             hr,
+        const FILE_NOTIFY_INFORMATION      *pNotifications
+    ) noexcept;
+
+    SRWLOCK                             m_lock = SRWLOCK_INIT;
+    // Kept until the cache goes away, the watch callbacks refer to them.
+    std::map<std::wstring, std::unique_ptr<Directory>, ignore_case_comparer> m_directories;
+    size_t                              m_cEntries = 0;
+};
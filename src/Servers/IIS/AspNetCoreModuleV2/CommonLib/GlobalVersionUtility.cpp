@@ -5,6 +5,7 @@
 #include <filesystem>
 
 #include "GlobalVersionUtility.h"
+#include "SRWExclusiveLock.h"
 
 namespace fs = std::filesystem;
 
@@ -98,6 +99,26 @@ GlobalVersionUtility::RemoveFileNameFromFolderPath(std::wstring fileName)
     return path.parent_path();
 }
 
+// Throw invalid_argument if any argument is null
+std::wstring
+GlobalVersionUtility::GetAspNetCoreFolderPath(PCWSTR pwzModuleFolderPath)
+{
+    if (pwzModuleFolderPath == NULL)
+    {
+        throw std::invalid_argument("pwzModuleFolderPath is NULL");
+    }
+
+    fs::path moduleFolderPath(pwzModuleFolderPath);
+    fx_ver_t folderVersion(-1, -1, -1);
+    if (moduleFolderPath.has_parent_path() &&
+        fx_ver_t::parse(moduleFolderPath.filename(), &folderVersion, false))
+    {
+        return moduleFolderPath.parent_path();
+    }
+
+    return moduleFolderPath;
+}
+
 std::wstring
 GlobalVersionUtility::GetModuleName(HMODULE hModuleName)
 {
@@ -131,3 +152,77 @@ GlobalVersionUtility::GetModuleName(HMODULE hModuleName)
 
     return retVal;
 }
+
+GlobalVersionCache::GlobalVersionCache() noexcept
+{
+    InitializeSRWLock(&m_srwLock);
+}
+
+// throws runtime error if no request handler versions are installed.
+// Throw invalid_argument if any argument is null
+std::wstring
+GlobalVersionCache::GetGlobalRequestHandlerPath(PCWSTR pwzAspNetCoreFolderPath, PCWSTR pwzHandlerVersion, PCWSTR pwzHandlerName)
+{
+    if (pwzAspNetCoreFolderPath == NULL)
+    {
+        throw std::invalid_argument("pwzAspNetCoreFolderPath is NULL");
+    }
+
+    if (pwzHandlerVersion == NULL || pwzHandlerVersion[0] != L'\0')
+    {
+        return GlobalVersionUtility::GetGlobalRequestHandlerPath(pwzAspNetCoreFolderPath, pwzHandlerVersion, pwzHandlerName);
+    }
+
+    const std::wstring folderVersion = FindHighestGlobalVersion(pwzAspNetCoreFolderPath);
+    return GlobalVersionUtility::GetGlobalRequestHandlerPath(pwzAspNetCoreFolderPath, folderVersion.c_str(), pwzHandlerName);
+}
+
+// throws runtime error if no request handler versions are installed.
+// Throw invalid_argument if any argument is null
+std::wstring
+GlobalVersionCache::FindHighestGlobalVersion(PCWSTR pwzAspNetCoreFolderPath)
+{
+    if (pwzAspNetCoreFolderPath == NULL)
+    {
+        throw std::invalid_argument("pwzAspNetCoreFolderPath is NULL");
+    }
+
+    SRWExclusiveLock lock(m_srwLock);
+
+    if (m_hChangeNotification == INVALID_HANDLE_VALUE || m_folderPath != pwzAspNetCoreFolderPath)
+    {
+        m_highestVersion.clear();
+        const HANDLE hPrevious = m_hChangeNotification.release();
+        if (hPrevious != INVALID_HANDLE_VALUE)
+        {
+            FindCloseChangeNotification(hPrevious);
+        }
+
+        m_folderPath = pwzAspNetCoreFolderPath;
+
+        // Armed before the scan, a version installed meanwhile is seen by
+        // the next call. Without one nothing is cached.
+        m_hChangeNotification = FindFirstChangeNotificationW(pwzAspNetCoreFolderPath, FALSE, FILE_NOTIFY_CHANGE_DIR_NAME);
+    }
+    else if (WaitForSingleObject(m_hChangeNotification, 0) == WAIT_OBJECT_0)
+    {
+        m_highestVersion.clear();
+        if (!FindNextChangeNotification(m_hChangeNotification))
+        {
+            FindCloseChangeNotification(m_hChangeNotification.release());
+        }
+    }
+
+    if (!m_highestVersion.empty())
+    {
+        return m_highestVersion;
+    }
+
+    std::wstring highestVersion = GlobalVersionUtility::FindHighestGlobalVersion(pwzAspNetCoreFolderPath);
+    if (m_hChangeNotification != INVALID_HANDLE_VALUE)
+    {
+        m_highestVersion = highestVersion;
+    }
+
+    return highestVersion;
+}
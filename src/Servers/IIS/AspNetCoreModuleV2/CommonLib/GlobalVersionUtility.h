@@ -4,6 +4,7 @@
 #pragma once
 
 #include "fx_ver.h"
+#include "HandleWrapper.h"
 
 using namespace aspnet;
 
@@ -23,6 +24,15 @@ public:
         std::wstring
         RemoveFileNameFromFolderPath(std::wstring fileName);
 
+    //
+    // Folder of the handler version folders for aspnetcorev2.dll loaded
+    // from pwzModuleFolderPath: that folder, or its parent when the module
+    // was installed side by side in a version folder itself.
+    //
+    static
+        std::wstring
+        GetAspNetCoreFolderPath(PCWSTR pwzModuleFolderPath);
+
     static
         std::vector<fx_ver_t>
         GetRequestHandlerVersions(PCWSTR pwzAspNetCoreFolderPath);
@@ -32,3 +42,32 @@ public:
         GetModuleName(HMODULE hModuleName);
 };
 
+
+//
+// Highest handler version of one folder, scanned again only once a change
+// notification reports a directory created, renamed or deleted in it, so
+// that the application starts of a worker do not list the folder each.
+//
+class GlobalVersionCache
+{
+public:
+    GlobalVersionCache() noexcept;
+
+    GlobalVersionCache(const GlobalVersionCache&) = delete;
+    GlobalVersionCache& operator=(const GlobalVersionCache&) = delete;
+
+    // Throws like GlobalVersionUtility::GetGlobalRequestHandlerPath.
+    std::wstring
+    GetGlobalRequestHandlerPath(PCWSTR pwzAspNetCoreFolderPath, PCWSTR pwzHandlerVersion, PCWSTR pwzHandlerName);
+
+    // Throws like GlobalVersionUtility::FindHighestGlobalVersion.
+    std::wstring
+    FindHighestGlobalVersion(PCWSTR pwzAspNetCoreFolderPath);
+
+private:
+    SRWLOCK         m_srwLock {};
+    std::wstring    m_folderPath;
+    // Empty until a scan of m_folderPath succeeded.
+    std::wstring    m_highestVersion;
+    HandleWrapper<FindChangeNotificationHandleTraits> m_hChangeNotification;
+};
@@ -27,6 +27,20 @@ struct ModuleHandleTraits
     static void Close(HMODULE handle) noexcept { FreeModule(handle); }
 };
 
+struct RegistryKeyHandleTraits
+{
+    using HandleType = HKEY;
+    static constexpr HKEY DefaultHandle = nullptr;
+    static void Close(HKEY handle) noexcept { RegCloseKey(handle); }
+};
+
+struct FindChangeNotificationHandleTraits
+{
+    using HandleType = HANDLE;
+    static constexpr HANDLE DefaultHandle = INVALID_HANDLE_VALUE;
+    static void Close(HANDLE handle) noexcept { FindCloseChangeNotification(handle); }
+};
+
 // Code analysis doesn't like nullptr usages via traits
 #pragma warning(push)
 #pragma warning(disable : 26477) // disable  Use 'nullptr' rather than 0 or NULL (es.47).
@@ -0,0 +1,176 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "HostFxrResolutionCache.h"
+
+#include <algorithm>
+#include <cwctype>
+#include <fstream>
+#include <sstream>
+#include "debugutil.h"
+#include "Environment.h"
+#include "StringHelpers.h"
+
+namespace fs = std::filesystem;
+
+// Changes whenever the format or what the key covers changes.
+#define HOSTFXR_RESOLUTION_CACHE_VERSION L"1"
+
+std::wstring
+HostFxrResolutionCache::GetKey(
+    const std::wstring &knownDotnetLocation,
+    const std::wstring &processPath,
+    const fs::path     &applicationPhysicalPath,
+    const std::wstring &applicationArguments
+)
+{
+    std::wostringstream key;
+
+    key << HOSTFXR_RESOLUTION_CACHE_VERSION << L'|'
+        << knownDotnetLocation << L'|'
+        << processPath << L'|'
+        << applicationPhysicalPath.wstring() << L'|'
+        << applicationArguments << L'|'
+        // Finding dotnet.exe searches PATH
+        << Environment::GetEnvironmentVariableValue(L"PATH").value_or(L"");
+
+    // Publishing the app again changes these, and with them what hostfxr is
+    // picked or whether the app is standalone.
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(applicationPhysicalPath, ec))
+    {
+        const auto fileName = entry.path().filename().wstring();
+        if (!endsWith(fileName, L".runtimeconfig.json", true) &&
+            !endsWith(fileName, L".deps.json", true) &&
+            !equals_ignore_case(fileName, L"hostfxr.dll"))
+        {
+            continue;
+        }
+
+        std::error_code timeError;
+        const auto lastWriteTime = entry.last_write_time(timeError);
+        key << L'|' << fileName << L'=' << (timeError ? 0 : lastWriteTime.time_since_epoch().count());
+    }
+
+    return key.str();
+}
+
+bool
+HostFxrResolutionCache::TryGet(
+    const std::wstring        &key,
+    const fs::path            &applicationPhysicalPath,
+    fs::path                  &hostFxrDllPath,
+    fs::path                  &dotnetExePath,
+    std::vector<std::wstring> &arguments
+)
+{
+    const auto cachePath = GetCachePath(applicationPhysicalPath);
+    if (cachePath.empty())
+    {
+        return false;
+    }
+
+    std::ifstream file(cachePath, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    const std::string bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const std::wstring content(reinterpret_cast<const wchar_t*>(bytes.data()), bytes.size() / sizeof(wchar_t));
+
+    // Fields are NUL separated: the key, hostfxr.dll, dotnet.exe, then the arguments.
+    std::vector<std::wstring> fields;
+    std::wistringstream stream(content);
+    std::wstring field;
+    while (std::getline(stream, field, L'\0'))
+    {
+        fields.push_back(field);
+    }
+
+    if (fields.size() < 3 || fields[0] != key)
+    {
+        LOG_INFOF(L"No matching hostfxr resolution cached at '%ls'", cachePath.c_str());
+        return false;
+    }
+
+    std::error_code ec;
+    if (!fs::is_regular_file(fields[1], ec) || (!fields[2].empty() && !fs::is_regular_file(fields[2], ec)))
+    {
+        LOG_INFOF(L"Cached hostfxr resolution at '%ls' refers to files that don't exist anymore", cachePath.c_str());
+        return false;
+    }
+
+    hostFxrDllPath = fields[1];
+    dotnetExePath = fields[2];
+    arguments.assign(fields.begin() + 3, fields.end());
+
+    LOG_INFOF(L"Using the hostfxr resolution cached at '%ls'", cachePath.c_str());
+    return true;
+}
+
+void
+HostFxrResolutionCache::Store(
+    const std::wstring              &key,
+    const fs::path                  &applicationPhysicalPath,
+    const fs::path                  &hostFxrDllPath,
+    const fs::path                  &dotnetExePath,
+    const std::vector<std::wstring> &arguments
+)
+{
+    const auto cachePath = GetCachePath(applicationPhysicalPath);
+    if (cachePath.empty())
+    {
+        return;
+    }
+
+    std::error_code ec;
+    fs::create_directories(cachePath.parent_path(), ec);
+
+    // Written aside and moved in place, worker processes of a web garden
+    // may read or write the same entry at the same time.
+    auto temporaryPath = cachePath;
+    temporaryPath += format(L".%u.tmp", GetCurrentProcessId());
+
+    std::wstring content = key + L'\0' + hostFxrDllPath.wstring() + L'\0' + dotnetExePath.wstring();
+    for (const auto& argument : arguments)
+    {
+        content += L'\0' + argument;
+    }
+
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(content.data()), content.size() * sizeof(wchar_t));
+        if (!file)
+        {
+            LOG_INFOF(L"Could not cache the hostfxr resolution at '%ls'", cachePath.c_str());
+            file.close();
+            fs::remove(temporaryPath, ec);
+            return;
+        }
+    }
+
+    if (!MoveFileExW(temporaryPath.c_str(), cachePath.c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        LOG_INFOF(L"Could not cache the hostfxr resolution at '%ls', error %d", cachePath.c_str(), GetLastError());
+        fs::remove(temporaryPath, ec);
+    }
+}
+
+fs::path
+HostFxrResolutionCache::GetCachePath(
+    const fs::path &applicationPhysicalPath
+)
+{
+    std::error_code ec;
+    const auto temporaryDirectory = fs::temp_directory_path(ec);
+    if (ec)
+    {
+        return {};
+    }
+
+    std::wstring normalizedPath = applicationPhysicalPath.wstring();
+    std::transform(normalizedPath.begin(), normalizedPath.end(), normalizedPath.begin(), towlower);
+
+    return temporaryDirectory / L"aspnetcoremodule" / format(L"%016llx.hostfxr", static_cast<unsigned long long>(std::hash<std::wstring>()(normalizedPath)));
+}
@@ -0,0 +1,62 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <Windows.h>
+#include <vector>
+#include <filesystem>
+#include <string>
+
+//
+// Remembers what HostFxrResolver resolved for an application across
+// worker process recycles, so that starting it again neither probes for
+// dotnet nor searches PATH for it.
+//
+// The key holds everything the resolution depends on: the configured
+// paths and arguments, PATH, and the last write times of the app's
+// runtimeconfig.json, deps.json and app local hostfxr.dll. An entry is
+// only used if the key matches and the resolved files still exist.
+// Entries live in the temporary directory of the worker process identity.
+//
+class HostFxrResolutionCache
+{
+public:
+
+    static
+    std::wstring
+    GetKey(
+        const std::wstring              &knownDotnetLocation,
+        const std::wstring              &processPath,
+        const std::filesystem::path     &applicationPhysicalPath,
+        const std::wstring              &applicationArguments
+    );
+
+    static
+    bool
+    TryGet(
+        const std::wstring              &key,
+        const std::filesystem::path     &applicationPhysicalPath,
+        std::filesystem::path           &hostFxrDllPath,
+        std::filesystem::path           &dotnetExePath,
+        std::vector<std::wstring>       &arguments
+    );
+
+    static
+    void
+    Store(
+        const std::wstring              &key,
+        const std::filesystem::path     &applicationPhysicalPath,
+        const std::filesystem::path     &hostFxrDllPath,
+        const std::filesystem::path     &dotnetExePath,
+        const std::vector<std::wstring> &arguments
+    );
+
+private:
+
+    static
+    std::filesystem::path
+    GetCachePath(
+        const std::filesystem::path     &applicationPhysicalPath
+    );
+};
@@ -4,6 +4,7 @@
 #include "HostFxrResolutionResult.h"
 
 #include "HostFxrResolver.h"
+#include "HostFxrResolutionCache.h"
 #include "debugutil.h"
 #include "exceptions.h"
 #include "EventLog.h"
@@ -37,14 +38,35 @@ HRESULT HostFxrResolutionResult::Create(
     {
         std::filesystem::path hostFxrDllPath;
         std::vector<std::wstring> arguments;
-        HostFxrResolver::GetHostFxrParameters(
-                pcwzProcessPath,
-                pcwzApplicationPhysicalPath,
-                pcwzArguments,
-                hostFxrDllPath,
-                knownDotnetLocation,
-                arguments,
-                errorContext);
+        std::wstring cacheKey;
+
+        // The cache only saves time, resolving goes on without it.
+        try
+        {
+            cacheKey = HostFxrResolutionCache::GetKey(pcwzDotnetExePath, pcwzProcessPath, pcwzApplicationPhysicalPath, pcwzArguments);
+        }
+        catch (...)
+        {
+            OBSERVE_CAUGHT_EXCEPTION();
+        }
+
+        if (cacheKey.empty() ||
+            !HostFxrResolutionCache::TryGet(cacheKey, pcwzApplicationPhysicalPath, hostFxrDllPath, knownDotnetLocation, arguments))
+        {
+            HostFxrResolver::GetHostFxrParameters(
+                    pcwzProcessPath,
+                    pcwzApplicationPhysicalPath,
+                    pcwzArguments,
+                    hostFxrDllPath,
+                    knownDotnetLocation,
+                    arguments,
+                    errorContext);
+
+            if (!cacheKey.empty())
+            {
+                HostFxrResolutionCache::Store(cacheKey, pcwzApplicationPhysicalPath, hostFxrDllPath, knownDotnetLocation, arguments);
+            }
+        }
 
         LOG_INFOF(L"Parsed hostfxr options: dotnet location: '%ls' hostfxr path: '%ls' arguments:", knownDotnetLocation.c_str(), hostFxrDllPath.c_str());
         for (size_t i = 0; i < arguments.size(); i++)
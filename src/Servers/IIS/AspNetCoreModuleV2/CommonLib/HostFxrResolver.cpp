@@ -3,11 +3,10 @@
 
 #include "HostFxrResolver.h"
 
-#include <atlcomcli.h>
+#include <algorithm>
 #include "fx_ver.h"
 #include "debugutil.h"
 #include "exceptions.h"
-#include "HandleWrapper.h"
 #include "Environment.h"
 #include "StringHelpers.h"
 #include "RegistryKey.h"
@@ -135,7 +134,7 @@ HostFxrResolver::GetHostFxrParameters(
                 errorContext.subStatusCode = 38;
                 errorContext.errorReason = "The app couldn't be found. Confirm the app's main DLL is present. Single-file deployments are not supported in IIS.";
                 errorContext.generalErrorType = "Failed to locate ASP.NET Core app";
-                errorContext.detailedErrorContent = format("Application was not found at %s.", to_multi_byte_string(applicationDllPath, CP_UTF8).c_str());
+                errorContext.detailedErrorContent = format("Application was not found at %s.", to_multi_byte_string(applicationDllPath.c_str(), CP_UTF8).c_str());
                 throw InvalidOperationException(
                     format(L"The app couldn't be found at %s. Confirm the app's main DLL is present. Single-file deployments are not supported in IIS.",
                         applicationDllPath.c_str()));
@@ -318,7 +317,7 @@ HostFxrResolver::GetAbsolutePathToDotnet(
         return processPath;
     }
 
-    // At this point, we are calling where.exe to find dotnet.
+    // At this point, we are searching PATH for dotnet.
     // If we encounter any failures, try getting dotnet.exe from the
     // backup location.
     // Only do it if no path is specified
@@ -329,12 +328,12 @@ HostFxrResolver::GetAbsolutePathToDotnet(
         throw InvalidOperationException(format(L"Could not find dotnet.exe at '%s'", processPath.c_str()));
     }
 
-    const auto dotnetViaWhere = InvokeWhereToFindDotnet();
-    if (dotnetViaWhere.has_value())
+    const auto dotnetOnPath = FindDotnetOnPath();
+    if (dotnetOnPath.has_value())
     {
-        LOG_INFOF(L"Found dotnet.exe via where.exe invocation at '%ls'", dotnetViaWhere.value().c_str());
+        LOG_INFOF(L"Found dotnet.exe on PATH at '%ls'", dotnetOnPath.value().c_str());
 
-        return dotnetViaWhere.value();
+        return dotnetOnPath.value();
     }
 
     auto isWow64Process = Environment::IsRunning64BitProcess();
@@ -350,10 +349,10 @@ HostFxrResolver::GetAbsolutePathToDotnet(
         regKeySubSection = L"SOFTWARE\\dotnet\\Setup\\InstalledVersions\\x86";
     }
 
-    const auto installationLocation = RegistryKey::TryGetString(
+    // Read on every application start that resolves dotnet.exe, cached for the workers starting many.
+    const auto installationLocation = CachedRegistryKey::Get(
         HKEY_LOCAL_MACHINE,
-        regKeySubSection,
-        L"InstallLocation");
+        regKeySubSection).TryGetString(L"InstallLocation");
 
     if (installationLocation.has_value())
     {
@@ -390,138 +389,54 @@ HostFxrResolver::GetAbsolutePathToDotnetFromHostfxr(const fs::path& hostfxrPath)
 }
 
 //
-// Tries to call where.exe to find the location of dotnet.exe.
-// Will check that the bitness of dotnet matches the current
-// worker process bitness.
-// Returns true if a valid dotnet was found, else false.R
+// Looks for dotnet.exe in the directories on PATH, in order, the way
+// where.exe would without starting it. Will check that the bitness of
+// dotnet matches the current worker process bitness.
 //
 std::optional<fs::path>
-HostFxrResolver::InvokeWhereToFindDotnet()
+HostFxrResolver::FindDotnetOnPath()
 {
-    HRESULT             hr = S_OK;
-    // Arguments to call where.exe
-    STARTUPINFOW        startupInfo = { 0 };
-    PROCESS_INFORMATION processInformation = { 0 };
-    SECURITY_ATTRIBUTES securityAttributes;
-
-    CHAR                pzFileContents[READ_BUFFER_SIZE];
-    HandleWrapper<InvalidHandleTraits>     hStdOutReadPipe;
-    HandleWrapper<InvalidHandleTraits>     hStdOutWritePipe;
-    HandleWrapper<InvalidHandleTraits>     hProcess;
-    HandleWrapper<InvalidHandleTraits>     hThread;
-    CComBSTR            pwzDotnetName = NULL;
-    DWORD               dwFilePointer;
-    BOOL                fIsCurrentProcess64Bit;
-    DWORD               dwExitCode;
-    STRU                struDotnetSubstring;
-    STRU                struDotnetLocationsString;
-    DWORD               dwNumBytesRead;
-    DWORD               dwBinaryType;
-    INT                 index = 0;
-    INT                 prevIndex = 0;
-    std::optional<fs::path> result;
-
-    // Set the security attributes for the read/write pipe
-    securityAttributes.nLength = sizeof(securityAttributes);
-    securityAttributes.lpSecurityDescriptor = NULL;
-    securityAttributes.bInheritHandle = TRUE;
-
-    LOG_INFO(L"Invoking where.exe to find dotnet.exe");
-
-    // Create a read/write pipe that will be used for reading the result of where.exe
-    FINISHED_LAST_ERROR_IF(!CreatePipe(&hStdOutReadPipe, &hStdOutWritePipe, &securityAttributes, 0));
-    FINISHED_LAST_ERROR_IF(!SetHandleInformation(hStdOutReadPipe, HANDLE_FLAG_INHERIT, 0));
-
-    // Set the stdout and err pipe to the write pipes.
-    startupInfo.cb = sizeof(startupInfo);
-    startupInfo.dwFlags |= STARTF_USESTDHANDLES;
-    startupInfo.hStdOutput = hStdOutWritePipe;
-    startupInfo.hStdError = hStdOutWritePipe;
-
-    // CreateProcess requires a mutable string to be passed to commandline
-    // See https://blogs.msdn.microsoft.com/oldnewthing/20090601-00/?p=18083/
-    pwzDotnetName = L"\"where.exe\" dotnet.exe";
-
-    // Create a process to invoke where.exe
-    FINISHED_LAST_ERROR_IF(!CreateProcessW(NULL,
-        pwzDotnetName,
-        NULL,
-        NULL,
-        TRUE,
-        CREATE_NO_WINDOW,
-        NULL,
-        NULL,
-        &startupInfo,
-        &processInformation
-    ));
-
-    // Store handles into wrapper so they get closed automatically
-    hProcess = processInformation.hProcess;
-    hThread = processInformation.hThread;
-
-    // Wait for where.exe to return
-    WaitForSingleObject(processInformation.hProcess, INFINITE);
-
-    //
-    // where.exe will return 0 on success, 1 if the file is not found
-    // and 2 if there was an error. Check if the exit code is 1 and set
-    // a new hr result saying it couldn't find dotnet.exe
-    //
-    FINISHED_LAST_ERROR_IF (!GetExitCodeProcess(processInformation.hProcess, &dwExitCode));
-
-    //
-    // In this block, if anything fails, we will goto our fallback of
-    // looking in C:/Program Files/
-    //
-    if (dwExitCode != 0)
+    const auto path = Environment::GetEnvironmentVariableValue(L"PATH");
+    if (!path.has_value())
     {
-        FINISHED_IF_FAILED(E_FAIL);
+        return std::nullopt;
     }
 
-    // Where succeeded.
-    // Reset file pointer to the beginning of the file.
-    dwFilePointer = SetFilePointer(hStdOutReadPipe, 0, NULL, FILE_BEGIN);
-    if (dwFilePointer == INVALID_SET_FILE_POINTER)
-    {
-        FINISHED_IF_FAILED(E_FAIL);
-    }
+    const BOOL fIsCurrentProcess64Bit = Environment::IsRunning64BitProcess();
 
-    //
-    // As the call to where.exe succeeded (dotnet.exe was found), ReadFile should not hang.
-    // TODO consider putting ReadFile in a separate thread with a timeout to guarantee it doesn't block.
-    //
-    FINISHED_LAST_ERROR_IF (!ReadFile(hStdOutReadPipe, pzFileContents, READ_BUFFER_SIZE, &dwNumBytesRead, NULL));
+    LOG_INFOF(L"Looking for dotnet.exe on PATH, current process bitness type detected as isX64=%d", fIsCurrentProcess64Bit);
 
-    if (dwNumBytesRead >= READ_BUFFER_SIZE)
+    size_t entryStart = 0;
+    while (entryStart < path->length())
     {
-        // This shouldn't ever be this large. We could continue to call ReadFile in a loop,
-        // however if someone had this many dotnet.exes on their machine.
-        FINISHED_IF_FAILED(E_FAIL);
-    }
-
-    FINISHED_IF_FAILED(struDotnetLocationsString.CopyA(pzFileContents, dwNumBytesRead));
+        auto entryEnd = path->find(L';', entryStart);
+        if (entryEnd == std::wstring::npos)
+        {
+            entryEnd = path->length();
+        }
 
-    LOG_INFOF(L"where.exe invocation returned: '%ls'", struDotnetLocationsString.QueryStr());
+        std::wstring directory = path->substr(entryStart, entryEnd - entryStart);
+        entryStart = entryEnd + 1;
 
-    fIsCurrentProcess64Bit = Environment::IsRunning64BitProcess();
+        // Entries may be quoted
+        directory.erase(std::remove(directory.begin(), directory.end(), L'"'), directory.end());
+        if (directory.empty())
+        {
+            continue;
+        }
 
-    LOG_INFOF(L"Current process bitness type detected as isX64=%d", fIsCurrentProcess64Bit);
+        const auto dotnetPath = fs::path(Environment::ExpandEnvironmentVariables(directory)) / L"dotnet.exe";
 
-    while (TRUE)
-    {
-        index = struDotnetLocationsString.IndexOf(L"\r\n", prevIndex);
-        if (index == -1)
+        std::error_code ec;
+        if (!is_regular_file(dotnetPath, ec))
         {
-            break;
+            continue;
         }
 
-        FINISHED_IF_FAILED(struDotnetSubstring.Copy(&struDotnetLocationsString.QueryStr()[prevIndex], index - prevIndex));
-        // \r\n is two wchars, so add 2 here.
-        prevIndex = index + 2;
-
-        LOG_INFOF(L"Processing entry '%ls'", struDotnetSubstring.QueryStr());
+        LOG_INFOF(L"Processing entry '%ls'", dotnetPath.c_str());
 
-        if (LOG_LAST_ERROR_IF(!GetBinaryTypeW(struDotnetSubstring.QueryStr(), &dwBinaryType)))
+        DWORD dwBinaryType;
+        if (LOG_LAST_ERROR_IF(!GetBinaryTypeW(dotnetPath.c_str(), &dwBinaryType)))
         {
             continue;
         }
@@ -531,12 +446,11 @@ HostFxrResolver::InvokeWhereToFindDotnet()
         if (fIsCurrentProcess64Bit == (dwBinaryType == SCS_64BIT_BINARY))
         {
             // The bitness of dotnet matched with the current worker process bitness.
-            return std::make_optional(struDotnetSubstring.QueryStr());
+            return dotnetPath;
         }
     }
 
-    Finished:
-    return result;
+    return std::nullopt;
 }
 
 std::optional<fs::path>
@@ -11,8 +11,6 @@
 
 #include "ErrorContext.h"
 
-#define READ_BUFFER_SIZE 4096
-
 class HostFxrResolver
 {
 public:
@@ -65,7 +63,7 @@ private:
 
     static
     std::optional<std::filesystem::path>
-    InvokeWhereToFindDotnet();
+    FindDotnetOnPath();
 
     static
     std::filesystem::path
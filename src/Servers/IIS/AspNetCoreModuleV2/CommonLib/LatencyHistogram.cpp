@@ -0,0 +1,176 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "LatencyHistogram.h"
+
+#include <cmath>
+#include <intrin.h>
+#include "TraceProvider.h"
+#include "exceptions.h"
+
+// static
+DWORD
+LatencyHistogramSnapshot::QueryBucket(ULONGLONG ullMicroseconds) noexcept
+{
+    if (ullMicroseconds < SUB_BUCKETS)
+    {
+        return static_cast<DWORD>(ullMicroseconds);
+    }
+
+    unsigned long ulExponent = 0;
+    _BitScanReverse64(&ulExponent, ullMicroseconds);
+    if (ulExponent > MAX_EXPONENT)
+    {
+        return BUCKETS - 1;
+    }
+
+    // The bits below the leading one pick the linear sub-bucket.
+    const DWORD dwSubBucket = static_cast<DWORD>(ullMicroseconds >> (ulExponent - SUB_BUCKET_BITS)) - SUB_BUCKETS;
+    return SUB_BUCKETS * (ulExponent - SUB_BUCKET_BITS + 1) + dwSubBucket;
+}
+
+// static
+ULONGLONG
+LatencyHistogramSnapshot::QueryBucketUpperBound(DWORD iBucket) noexcept
+{
+    if (iBucket < SUB_BUCKETS)
+    {
+        return iBucket;
+    }
+
+    if (iBucket >= BUCKETS - 1)
+    {
+        return MAXULONGLONG;
+    }
+
+    const DWORD dwShift = iBucket / SUB_BUCKETS - 1;
+    const ULONGLONG ullLowerBound = static_cast<ULONGLONG>(SUB_BUCKETS + iBucket % SUB_BUCKETS) << dwShift;
+    return ullLowerBound + (1ULL << dwShift) - 1;
+}
+
+VOID
+LatencyHistogramSnapshot::Merge(const LatencyHistogramSnapshot& other) noexcept
+{
+    for (DWORD i = 0; i < BUCKETS; i++)
+    {
+        m_rgCounts[i] += other.m_rgCounts[i];
+    }
+    m_cValues += other.m_cValues;
+    m_llSum += other.m_llSum;
+}
+
+VOID
+LatencyHistogramSnapshot::Subtract(const LatencyHistogramSnapshot& earlier) noexcept
+{
+    for (DWORD i = 0; i < BUCKETS; i++)
+    {
+        m_rgCounts[i] -= earlier.m_rgCounts[i];
+    }
+    m_cValues -= earlier.m_cValues;
+    m_llSum -= earlier.m_llSum;
+}
+
+ULONGLONG
+LatencyHistogramSnapshot::QueryPercentile(double dPercentile) const noexcept
+{
+    if (m_cValues == 0)
+    {
+        return 0;
+    }
+
+    // The rank of the value, 1 based.
+    const LONG64 llRank = min(max(static_cast<LONG64>(ceil(dPercentile * m_cValues / 100.0)), 1LL), m_cValues);
+
+    LONG64 llSeen = 0;
+    for (DWORD i = 0; i < BUCKETS; i++)
+    {
+        llSeen += m_rgCounts[i];
+        if (llSeen >= llRank)
+        {
+            return QueryBucketUpperBound(i);
+        }
+    }
+
+    return QueryBucketUpperBound(BUCKETS - 1);
+}
+
+LatencyHistogram::~LatencyHistogram()
+{
+    if (m_pCounts != nullptr)
+    {
+        m_pCounts->Dispose();
+        m_pCounts = nullptr;
+    }
+}
+
+// static
+HRESULT
+LatencyHistogram::Create(std::unique_ptr<LatencyHistogram>& pHistogram) noexcept
+{
+    std::unique_ptr<LatencyHistogram> pNew(new (std::nothrow) LatencyHistogram());
+    if (pNew == nullptr)
+    {
+        RETURN_HR(E_OUTOFMEMORY);
+    }
+
+    // Zeroed by Create.
+    RETURN_IF_FAILED(PER_CPU<COUNTS>::Create([](COUNTS*) {}, &pNew->m_pCounts));
+
+    pHistogram = std::move(pNew);
+    return S_OK;
+}
+
+VOID
+LatencyHistogram::Record(ULONGLONG ullMicroseconds) noexcept
+{
+    // Interlocked as the thread may move to another processor meanwhile,
+    // no fence as nothing is ordered after the counts.
+    COUNTS* pCounts = m_pCounts->GetLocal();
+    InterlockedIncrementNoFence64(&pCounts->rgCounts[LatencyHistogramSnapshot::QueryBucket(ullMicroseconds)]);
+    InterlockedAddNoFence64(&pCounts->llSum, static_cast<LONG64>(min(ullMicroseconds, static_cast<ULONGLONG>(MAXLONG64))));
+}
+
+VOID
+LatencyHistogram::Snapshot(LatencyHistogramSnapshot& snapshot) noexcept
+{
+    snapshot = LatencyHistogramSnapshot();
+
+    m_pCounts->ForEach([&snapshot](COUNTS* pCounts)
+    {
+        for (DWORD i = 0; i < LatencyHistogramSnapshot::BUCKETS; i++)
+        {
+            const LONG64 cValues = ReadNoFence64(&pCounts->rgCounts[i]);
+            snapshot.m_rgCounts[i] += cValues;
+            snapshot.m_cValues += cValues;
+        }
+        snapshot.m_llSum += ReadNoFence64(&pCounts->llSum);
+    });
+}
+
+// static
+VOID
+LatencyHistogram::Write(
+    PCSTR                               pszName,
+    PCWSTR                              pszApplicationPath,
+    const LatencyHistogramSnapshot&     snapshot) noexcept
+{
+    if (snapshot.QueryCount() == 0 ||
+        !TraceLoggingProviderEnabled(g_hTraceProvider, WINEVENT_LEVEL_INFO, ASPNETCORE_TRACE_KEYWORD_COUNTERS))
+    {
+        return;
+    }
+
+    TraceLoggingWrite(g_hTraceProvider,
+        "LatencyHistogram",
+        TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+        TraceLoggingKeyword(ASPNETCORE_TRACE_KEYWORD_COUNTERS),
+        TraceLoggingString(pszName, "Name"),
+        TraceLoggingWideString(pszApplicationPath, "ApplicationPath"),
+        TraceLoggingInt64(snapshot.QueryCount(), "Count"),
+        TraceLoggingInt64(snapshot.QuerySum() / snapshot.QueryCount(), "MeanMicroseconds"),
+        TraceLoggingUInt64(snapshot.QueryPercentile(50), "P50Microseconds"),
+        TraceLoggingUInt64(snapshot.QueryPercentile(90), "P90Microseconds"),
+        TraceLoggingUInt64(snapshot.QueryPercentile(99), "P99Microseconds"),
+        TraceLoggingUInt64(snapshot.QueryPercentile(99.9), "P999Microseconds"),
+        TraceLoggingUInt64(snapshot.QueryPercentile(100), "MaxMicroseconds"));
+}
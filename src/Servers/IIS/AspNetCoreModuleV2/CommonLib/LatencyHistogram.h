@@ -0,0 +1,118 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <Windows.h>
+#include <memory>
+#include "NonCopyable.h"
+#include "percpu.h"
+
+//
+// Counts of a LatencyHistogram at one point, summed over the processors.
+// Snapshots of several histograms, of the processes of an application for
+// instance, merge into one.
+//
+class LatencyHistogramSnapshot
+{
+public:
+    //
+    // Log-linear buckets of microseconds: values under SUB_BUCKETS each
+    // have their own, every power of two above is split into SUB_BUCKETS
+    // linear ones, which keeps a value within 1/SUB_BUCKETS of its bucket.
+    // Values of 2^(MAX_EXPONENT + 1) and more all go into the last one.
+    //
+    static constexpr DWORD      SUB_BUCKET_BITS = 4;
+    static constexpr DWORD      SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr DWORD      MAX_EXPONENT = 35;
+    static constexpr DWORD      BUCKETS = SUB_BUCKETS * (MAX_EXPONENT - SUB_BUCKET_BITS + 2);
+
+    static
+    DWORD
+    QueryBucket(ULONGLONG ullMicroseconds) noexcept;
+
+    // Highest value that goes into iBucket.
+    static
+    ULONGLONG
+    QueryBucketUpperBound(DWORD iBucket) noexcept;
+
+    VOID
+    Merge(const LatencyHistogramSnapshot& other) noexcept;
+
+    // Leaves the values recorded since earlier, a snapshot of the same
+    // histogram taken before this one.
+    VOID
+    Subtract(const LatencyHistogramSnapshot& earlier) noexcept;
+
+    LONG64
+    QueryCount() const noexcept
+    {
+        return m_cValues;
+    }
+
+    LONG64
+    QuerySum() const noexcept
+    {
+        return m_llSum;
+    }
+
+    //
+    // Smallest value that dPercentile percent of the values don't exceed,
+    // as the upper bound of its bucket. 0 without any value.
+    //
+    ULONGLONG
+    QueryPercentile(double dPercentile) const noexcept;
+
+private:
+    friend class LatencyHistogram;
+
+    LONG64                      m_rgCounts[BUCKETS] = {};
+    LONG64                      m_cValues = 0;
+    LONG64                      m_llSum = 0;
+};
+
+//
+// Distribution of a latency, recorded on the request path. Each processor
+// counts into buckets of its own with relaxed interlocked increments, so
+// that recording shares no cache line and takes no lock; a value costs a
+// bit scan and two increments. Snapshots sum the processors and are not
+// consistent with recording going on, good enough for a distribution.
+//
+class LatencyHistogram : NonCopyable
+{
+public:
+    ~LatencyHistogram();
+
+    static
+    HRESULT
+    Create(std::unique_ptr<LatencyHistogram>& pHistogram) noexcept;
+
+    VOID
+    Record(ULONGLONG ullMicroseconds) noexcept;
+
+    VOID
+    Snapshot(LatencyHistogramSnapshot& snapshot) noexcept;
+
+    //
+    // Writes the count, mean and percentiles of snapshot as a
+    // LatencyHistogram event named pszName, while a session enables
+    // ASPNETCORE_TRACE_KEYWORD_COUNTERS.
+    //
+    static
+    VOID
+    Write(
+        PCSTR                               pszName,
+        PCWSTR                              pszApplicationPath,
+        const LatencyHistogramSnapshot&     snapshot) noexcept;
+
+private:
+    struct COUNTS
+    {
+        LONG64  rgCounts[LatencyHistogramSnapshot::BUCKETS];
+        LONG64  llSum;
+    };
+
+    LatencyHistogram() noexcept = default;
+
+    PER_CPU<COUNTS>*            m_pCounts = nullptr;
+};
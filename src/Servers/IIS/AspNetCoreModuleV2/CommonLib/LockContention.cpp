@@ -0,0 +1,155 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "LockContention.h"
+
+#include "TraceProvider.h"
+
+namespace
+{
+    const PCSTR s_rgSiteNames[static_cast<DWORD>(LockSite::Count)] =
+    {
+        "DisconnectHandler",
+        "ApplicationInfo",
+        "ApplicationManager",
+        "ProcessManager",
+        "ForwardingHandlerRequest",
+        "DebugLogFile",
+    };
+
+    struct SITE_COUNTERS
+    {
+        LONG64  cAcquisitions;
+        LONG64  cContentions;
+        LONG64  llWaitTicks;
+    };
+
+    // Processors past this share the blocks of the first ones.
+    constexpr DWORD MAX_SLOTS = 64;
+
+    struct alignas(SYSTEM_CACHE_ALIGNMENT_SIZE) SLOT
+    {
+        SITE_COUNTERS rgSites[static_cast<DWORD>(LockSite::Count)];
+    };
+
+    SLOT s_rgSlots[MAX_SLOTS];
+
+    bool
+    IsCounting() noexcept
+    {
+        return TraceLoggingProviderEnabled(g_hTraceProvider, WINEVENT_LEVEL_INFO, ASPNETCORE_TRACE_KEYWORD_LOCKS);
+    }
+
+    SITE_COUNTERS&
+    GetLocal(
+        LockSite    site
+    ) noexcept
+    {
+        PROCESSOR_NUMBER processor;
+        GetCurrentProcessorNumberEx(&processor);
+        return s_rgSlots[(processor.Group * 64u + processor.Number) % MAX_SLOTS].rgSites[static_cast<DWORD>(site)];
+    }
+
+    LONGLONG
+    QueryTimestamp() noexcept
+    {
+        LARGE_INTEGER liCounter;
+        QueryPerformanceCounter(&liCounter);
+        return liCounter.QuadPart;
+    }
+
+    //
+    // Interlocked as a thread may move to another processor after GetLocal.
+    //
+    template<typename TTryAcquire, typename TAcquire>
+    void
+    Acquire(
+        SRWLOCK *   pLock,
+        LockSite    site,
+        TTryAcquire tryAcquire,
+        TAcquire    acquire
+    ) noexcept
+    {
+        if (!IsCounting())
+        {
+            acquire(pLock);
+            return;
+        }
+
+        if (tryAcquire(pLock))
+        {
+            InterlockedIncrement64(&GetLocal(site).cAcquisitions);
+            return;
+        }
+
+        const LONGLONG llStart = QueryTimestamp();
+        acquire(pLock);
+        const LONGLONG llWaitTicks = QueryTimestamp() - llStart;
+
+        SITE_COUNTERS& counters = GetLocal(site);
+        InterlockedIncrement64(&counters.cAcquisitions);
+        InterlockedIncrement64(&counters.cContentions);
+        InterlockedAdd64(&counters.llWaitTicks, llWaitTicks);
+    }
+}
+
+void
+LockContention::AcquireExclusive(
+    SRWLOCK *   pLock,
+    LockSite    site
+) noexcept
+{
+    Acquire(pLock, site,
+        [](SRWLOCK* p) { return TryAcquireSRWLockExclusive(p) != FALSE; },
+        [](SRWLOCK* p) { AcquireSRWLockExclusive(p); });
+}
+
+void
+LockContention::AcquireShared(
+    SRWLOCK *   pLock,
+    LockSite    site
+) noexcept
+{
+    Acquire(pLock, site,
+        [](SRWLOCK* p) { return TryAcquireSRWLockShared(p) != FALSE; },
+        [](SRWLOCK* p) { AcquireSRWLockShared(p); });
+}
+
+void
+LockContention::Write() noexcept
+{
+    LARGE_INTEGER liFrequency;
+    if (!IsCounting() || !QueryPerformanceFrequency(&liFrequency))
+    {
+        return;
+    }
+
+    for (DWORD i = 0; i < static_cast<DWORD>(LockSite::Count); ++i)
+    {
+        // Not a consistent snapshot, acquisitions may go on meanwhile.
+        SITE_COUNTERS totals = {};
+        for (const auto& slot : s_rgSlots)
+        {
+            totals.cAcquisitions += slot.rgSites[i].cAcquisitions;
+            totals.cContentions += slot.rgSites[i].cContentions;
+            totals.llWaitTicks += slot.rgSites[i].llWaitTicks;
+        }
+
+        if (totals.cAcquisitions == 0)
+        {
+            continue;
+        }
+
+        const LONGLONG llWaitMicroseconds = (totals.llWaitTicks / liFrequency.QuadPart) * 1000000 +
+            (totals.llWaitTicks % liFrequency.QuadPart) * 1000000 / liFrequency.QuadPart;
+
+        TraceLoggingWrite(g_hTraceProvider,
+            "LockContention",
+            TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+            TraceLoggingKeyword(ASPNETCORE_TRACE_KEYWORD_LOCKS),
+            TraceLoggingString(s_rgSiteNames[i], "Site"),
+            TraceLoggingInt64(totals.cAcquisitions, "Acquisitions"),
+            TraceLoggingInt64(totals.cContentions, "Contentions"),
+            TraceLoggingInt64(llWaitMicroseconds, "WaitMicroseconds"));
+    }
+}
@@ -0,0 +1,53 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <Windows.h>
+
+//
+// The locks of the request path whose contention is measured. Append only,
+// the names in LockContention.cpp follow the order.
+//
+enum class LockSite : DWORD
+{
+    // Shim
+    DisconnectHandler = 0,
+    ApplicationInfo,
+    ApplicationManager,
+    // Out-of-process handler
+    ProcessManager,
+    ForwardingHandlerRequest,
+    // Every module
+    DebugLogFile,
+    Count
+};
+
+//
+// Acquisitions, contended acquisitions and time spent waiting of the lock
+// sites, counted only while a session enabled ASPNETCORE_TRACE_KEYWORD_LOCKS
+// at the informational level. An acquisition is contended if the lock
+// could not be taken right away.
+//
+// Counters live in cache-line sized blocks per processor of the module, so
+// that counting adds no shared write to an uncontended acquisition. They
+// are written as LockContention events, one per site that was acquired,
+// when a session asks for a rundown and when the module stops.
+//
+namespace LockContention
+{
+    void
+    AcquireExclusive(
+        SRWLOCK *   pLock,
+        LockSite    site
+    ) noexcept;
+
+    void
+    AcquireShared(
+        SRWLOCK *   pLock,
+        LockSite    site
+    ) noexcept;
+
+    void
+    Write() noexcept;
+}
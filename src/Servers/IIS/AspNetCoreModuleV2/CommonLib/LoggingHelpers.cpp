@@ -10,13 +10,14 @@ std::shared_ptr<RedirectionOutput> LoggingHelpers::CreateOutputs(
     bool enableFileLogging,
     std::wstring outputFileName,
     std::wstring applicationPath,
-    std::shared_ptr<RedirectionOutput> stringStreamOutput)
+    std::shared_ptr<RedirectionOutput> stringStreamOutput,
+    const FileRollingOptions& rollingOptions)
 {
     auto stdOutOutput = std::make_shared<StandardOutputRedirectionOutput>();
     std::shared_ptr<RedirectionOutput> fileOutput;
     if (enableFileLogging)
     {
-        fileOutput = std::make_shared<FileRedirectionOutput>(applicationPath, outputFileName);
+        fileOutput = std::make_shared<FileRedirectionOutput>(applicationPath, outputFileName, rollingOptions);
     }
 
     return std::make_shared<AggregateRedirectionOutput>(std::move(fileOutput), std::move(stdOutOutput), std::move(stringStreamOutput));
@@ -15,7 +15,8 @@ public:
         bool enableFileLogging,
         std::wstring outputFileName,
         std::wstring applicationPath,
-        std::shared_ptr<RedirectionOutput> stringStreamOutput
+        std::shared_ptr<RedirectionOutput> stringStreamOutput,
+        const FileRollingOptions& rollingOptions = FileRollingOptions()
     );
 };
 
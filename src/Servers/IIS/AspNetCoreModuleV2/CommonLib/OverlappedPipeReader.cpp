@@ -0,0 +1,201 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include "OverlappedPipeReader.h"
+#include "exceptions.h"
+
+OverlappedPipeReader::OverlappedPipeReader(PFN_PIPE_DATA_CALLBACK pfnCallback, PVOID pContext) noexcept :
+    m_pfnCallback(pfnCallback),
+    m_pContext(pContext),
+    m_hReadPipe(INVALID_HANDLE_VALUE),
+    m_pIo(nullptr),
+    m_hReadsDone(nullptr),
+    m_lStopping(0),
+    m_overlapped()
+{
+}
+
+OverlappedPipeReader::~OverlappedPipeReader()
+{
+    Stop(0);
+}
+
+HRESULT
+OverlappedPipeReader::Create(BOOL fInheritWritePipe, _Out_ HANDLE* phWritePipe)
+{
+    static volatile LONG s_cPipes = 0;
+
+    SECURITY_ATTRIBUTES saAttr = { 0 };
+    WCHAR               pszPipeName[64];
+
+    *phWritePipe = INVALID_HANDLE_VALUE;
+
+    // Anonymous pipes do not support overlapped reads, use a uniquely named
+    // local pipe instead.
+    if (swprintf_s(pszPipeName,
+        _countof(pszPipeName),
+        L"\\\\.\\pipe\\ANCM_%lu_%lu_%ld",
+        GetCurrentProcessId(),
+        GetTickCount(),
+        InterlockedIncrement(&s_cPipes)) < 0)
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER));
+    }
+
+    m_hReadPipe = CreateNamedPipeW(pszPipeName,
+        PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+        PIPE_TYPE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+        1,                  // max instances
+        0,                  // out buffer size
+        PIPE_READ_SIZE,     // in buffer size
+        0,                  // default timeout
+        nullptr);
+    RETURN_LAST_ERROR_IF(m_hReadPipe == INVALID_HANDLE_VALUE);
+
+    saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
+    saAttr.bInheritHandle = fInheritWritePipe;
+    saAttr.lpSecurityDescriptor = nullptr;
+
+    HANDLE hWritePipe = CreateFileW(pszPipeName,
+        GENERIC_WRITE,
+        0,
+        &saAttr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr);
+    RETURN_LAST_ERROR_IF(hWritePipe == INVALID_HANDLE_VALUE);
+
+    m_hReadsDone = CreateEvent(nullptr, TRUE, TRUE, nullptr);
+    if (m_hReadsDone == nullptr)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        CloseHandle(hWritePipe);
+        RETURN_HR(hr);
+    }
+
+    m_pIo = CreateThreadpoolIo(m_hReadPipe, OnReadCompleted, this, nullptr);
+    if (m_pIo == nullptr)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        CloseHandle(hWritePipe);
+        RETURN_HR(hr);
+    }
+
+    *phWritePipe = hWritePipe;
+    return S_OK;
+}
+
+HRESULT
+OverlappedPipeReader::Start()
+{
+    ResetEvent(m_hReadsDone);
+
+    HRESULT hr = PostRead();
+    if (FAILED(hr))
+    {
+        SetEvent(m_hReadsDone);
+    }
+
+    return hr;
+}
+
+void
+OverlappedPipeReader::Stop(DWORD dwDrainTimeoutMs)
+{
+    if (m_hReadsDone != nullptr && dwDrainTimeoutMs != 0)
+    {
+        WaitForSingleObject(m_hReadsDone, dwDrainTimeoutMs);
+    }
+
+    if (InterlockedExchange(&m_lStopping, 1L) == 0L && m_hReadPipe != INVALID_HANDLE_VALUE)
+    {
+        // Completes the outstanding read with ERROR_OPERATION_ABORTED.
+        // Don't check return value as IO may or may not be completed already.
+        CancelIoEx(m_hReadPipe, &m_overlapped);
+    }
+
+    if (m_hReadsDone != nullptr &&
+        WaitForSingleObject(m_hReadsDone, PIPE_CANCEL_TIMEOUT_MS) != WAIT_OBJECT_0)
+    {
+        LOG_WARN(L"Pipe read did not complete after being canceled, canceling its callback.");
+    }
+
+    if (m_pIo != nullptr)
+    {
+        WaitForThreadpoolIoCallbacks(m_pIo, TRUE);
+        CloseThreadpoolIo(m_pIo);
+        m_pIo = nullptr;
+    }
+
+    if (m_hReadPipe != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hReadPipe);
+        m_hReadPipe = INVALID_HANDLE_VALUE;
+    }
+
+    if (m_hReadsDone != nullptr)
+    {
+        CloseHandle(m_hReadsDone);
+        m_hReadsDone = nullptr;
+    }
+}
+
+HRESULT
+OverlappedPipeReader::PostRead()
+{
+    ZeroMemory(&m_overlapped, sizeof(m_overlapped));
+
+    StartThreadpoolIo(m_pIo);
+
+    if (!ReadFile(m_hReadPipe, m_buffer, PIPE_READ_SIZE, nullptr, &m_overlapped))
+    {
+        DWORD dwError = GetLastError();
+        if (dwError != ERROR_IO_PENDING)
+        {
+            // No completion will be queued for this read.
+            CancelThreadpoolIo(m_pIo);
+            return HRESULT_FROM_WIN32(dwError);
+        }
+    }
+
+    // Stop may have run between the caller's check and the read being posted.
+    if (m_lStopping != 0)
+    {
+        CancelIoEx(m_hReadPipe, &m_overlapped);
+    }
+
+    return S_OK;
+}
+
+VOID
+CALLBACK
+OverlappedPipeReader::OnReadCompleted(
+    _Inout_ PTP_CALLBACK_INSTANCE   Instance,
+    _Inout_opt_ PVOID               pContext,
+    _Inout_opt_ PVOID               pOverlapped,
+    ULONG                           IoResult,
+    ULONG_PTR                       cbTransferred,
+    _Inout_ PTP_IO                  pIo
+)
+{
+    UNREFERENCED_PARAMETER(Instance);
+    UNREFERENCED_PARAMETER(pOverlapped);
+    UNREFERENCED_PARAMETER(pIo);
+
+    auto pReader = static_cast<OverlappedPipeReader*>(pContext);
+
+    if (IoResult == NO_ERROR && cbTransferred != 0)
+    {
+        pReader->m_pfnCallback(pReader->m_pContext, pReader->m_buffer, static_cast<DWORD>(cbTransferred));
+    }
+
+    // ERROR_BROKEN_PIPE once every write handle is closed,
+    // ERROR_OPERATION_ABORTED after Stop.
+    if (IoResult != NO_ERROR ||
+        pReader->m_lStopping != 0 ||
+        FAILED(pReader->PostRead()))
+    {
+        SetEvent(pReader->m_hReadsDone);
+    }
+}
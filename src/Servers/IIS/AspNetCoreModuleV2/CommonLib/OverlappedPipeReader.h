@@ -0,0 +1,65 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include "NonCopyable.h"
+
+// Reads the inbound end of a pipe with overlapped reads completed on the
+// process thread pool, so that capturing output does not keep a thread
+// blocked in ReadFile per pipe.
+class OverlappedPipeReader : NonCopyable
+{
+public:
+    // Called on a thread pool thread for every chunk read from the pipe,
+    // never concurrently for the same reader.
+    typedef void (*PFN_PIPE_DATA_CALLBACK)(PVOID pContext, const char* pData, DWORD cbData);
+
+    // Size of the buffer used to read from the pipe
+    static constexpr DWORD PIPE_READ_SIZE = 4096;
+
+    // Time given to a canceled read to complete
+    static constexpr DWORD PIPE_CANCEL_TIMEOUT_MS = 2000;
+
+    OverlappedPipeReader(PFN_PIPE_DATA_CALLBACK pfnCallback, PVOID pContext) noexcept;
+
+    ~OverlappedPipeReader();
+
+    // Creates the pipe and binds its read end to the thread pool. The write
+    // end is returned in *phWritePipe and owned by the caller.
+    HRESULT Create(BOOL fInheritWritePipe, _Out_ HANDLE* phWritePipe);
+
+    // Posts the first read, reading continues until the write end is
+    // closed or Stop is called.
+    HRESULT Start();
+
+    // Waits up to dwDrainTimeoutMs for reading to end on its own, i.e. for
+    // every write end to be closed and the buffered output to be read,
+    // then cancels the outstanding read. The callback is not called
+    // anymore once Stop returns.
+    void Stop(DWORD dwDrainTimeoutMs);
+
+private:
+    HRESULT PostRead();
+
+    static
+    VOID
+    CALLBACK
+    OnReadCompleted(
+        _Inout_ PTP_CALLBACK_INSTANCE   Instance,
+        _Inout_opt_ PVOID               pContext,
+        _Inout_opt_ PVOID               pOverlapped,
+        ULONG                           IoResult,
+        ULONG_PTR                       cbTransferred,
+        _Inout_ PTP_IO                  pIo);
+
+    PFN_PIPE_DATA_CALLBACK  m_pfnCallback;
+    PVOID                   m_pContext;
+    HANDLE                  m_hReadPipe;
+    PTP_IO                  m_pIo;
+    // Signaled once no read is outstanding anymore.
+    HANDLE                  m_hReadsDone;
+    volatile LONG           m_lStopping;
+    OVERLAPPED              m_overlapped;
+    char                    m_buffer[PIPE_READ_SIZE];
+};
@@ -24,22 +24,29 @@ PollingAppOfflineApplication::CheckAppOffline()
     }
 
     const auto ulCurrentTime = GetTickCount64();
+    if (m_fWatchingAppOffline)
+    {
+        //
+        // Only looked at again once the directory watch reported a change,
+        // requests otherwise just read the flag.
+        //
+        if (m_fAppOfflineChanged && m_fAppOfflineChanged.exchange(false))
+        {
+            SRWExclusiveLock lock(m_statusLock);
+            UpdateAppOfflineStatus(ulCurrentTime);
+        }
+    }
     //
     // we only care about app offline presented. If not, it means the application has started
     // and is monitoring  the app offline file
     // we cache the file exist check result for 200 ms
     //
-    if (ulCurrentTime - m_ulLastCheckTime > c_appOfflineRefreshIntervalMS)
+    else if (ulCurrentTime - m_ulLastCheckTime > c_appOfflineRefreshIntervalMS)
     {
         SRWExclusiveLock lock(m_statusLock);
         if (ulCurrentTime - m_ulLastCheckTime > c_appOfflineRefreshIntervalMS)
         {
-            m_fAppOfflineFound = FileExists(m_appOfflineLocation);
-            if(m_fAppOfflineFound)
-            {
-                LOG_IF_FAILED(OnAppOfflineFound());
-            }
-            m_ulLastCheckTime = ulCurrentTime;
+            UpdateAppOfflineStatus(ulCurrentTime);
         }
     }
 
@@ -49,6 +56,63 @@ PollingAppOfflineApplication::CheckAppOffline()
     }
 }
 
+void
+PollingAppOfflineApplication::UpdateAppOfflineStatus(ULONGLONG ulCurrentTime)
+{
+    m_fAppOfflineFound = FileExists(m_appOfflineLocation);
+    if(m_fAppOfflineFound)
+    {
+        LOG_IF_FAILED(OnAppOfflineFound());
+    }
+    m_ulLastCheckTime = ulCurrentTime;
+}
+
+void
+PollingAppOfflineApplication::StartWatchingAppOffline()
+{
+    const HRESULT hr = DirectoryWatchService::StartWatching(
+        m_appOfflineLocation.parent_path().wstring(),
+        FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE,
+        [this](HRESULT hrWatch, const FILE_NOTIFY_INFORMATION* pNotifications) noexcept { OnDirectoryChanged(hrWatch, pNotifications); },
+        m_appOfflineWatch);
+
+    // Some shares can't report changes, keep polling for those.
+    if (FAILED(hr))
+    {
+        LOG_INFOF(L"Could not watch for '%ls' (%x), polling for it instead", m_appOfflineLocation.c_str(), hr);
+        return;
+    }
+
+    m_fWatchingAppOffline = true;
+}
+
+void
+PollingAppOfflineApplication::OnDirectoryChanged(HRESULT hr, const FILE_NOTIFY_INFORMATION* pNotifications) noexcept
+{
+    if (FAILED(hr))
+    {
+        // Changes aren't reported anymore, fall back to polling.
+        m_fWatchingAppOffline = false;
+        m_fAppOfflineChanged = true;
+        return;
+    }
+
+    if (pNotifications == nullptr)
+    {
+        m_fAppOfflineChanged = true;
+        return;
+    }
+
+    const auto appOfflineFileName = m_appOfflineLocation.filename().wstring();
+    for (auto pNotification = pNotifications; pNotification != nullptr; pNotification = DirectoryWatchService::NextNotification(pNotification))
+    {
+        if (DirectoryWatchService::IsNotificationFor(pNotification, appOfflineFileName))
+        {
+            m_fAppOfflineChanged = true;
+            return;
+        }
+    }
+}
 
 std::filesystem::path PollingAppOfflineApplication::GetAppOfflineLocation(const IHttpApplication& pApplication)
 {
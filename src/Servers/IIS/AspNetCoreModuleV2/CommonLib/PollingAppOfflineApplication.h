@@ -2,8 +2,10 @@
 // The .NET Foundation licenses this file to you under the MIT license.
 
 #pragma once
+#include <atomic>
 #include <filesystem>
 #include "application.h"
+#include "DirectoryWatchService.h"
 
 enum PollingAppOfflineApplicationMode
 {
@@ -19,9 +21,12 @@ public:
         m_ulLastCheckTime(0),
         m_appOfflineLocation(GetAppOfflineLocation(pApplication)),
         m_fAppOfflineFound(false),
-        m_mode(mode)
+        m_mode(mode),
+        m_fAppOfflineChanged(true),
+        m_fWatchingAppOffline(false)
     {
         InitializeSRWLock(&m_statusLock);
+        StartWatchingAppOffline();
     }
 
     HRESULT
@@ -31,17 +36,30 @@ public:
 
     void CheckAppOffline();
     virtual HRESULT OnAppOfflineFound() = 0;
-    void StopInternal(bool fServerInitiated) override { UNREFERENCED_PARAMETER(fServerInitiated); }
+    void StopInternal(bool fServerInitiated) override
+    {
+        UNREFERENCED_PARAMETER(fServerInitiated);
+        m_appOfflineWatch = nullptr;
+    }
 
 protected:
     std::filesystem::path m_appOfflineLocation;
     static std::filesystem::path GetAppOfflineLocation(const IHttpApplication& pApplication);
     static bool FileExists(const std::filesystem::path& path) noexcept;
 private:
+    void StartWatchingAppOffline();
+    void OnDirectoryChanged(HRESULT hr, const FILE_NOTIFY_INFORMATION* pNotifications) noexcept;
+    void UpdateAppOfflineStatus(ULONGLONG ulCurrentTime);
+
     static const int c_appOfflineRefreshIntervalMS = 200;
-    std::string m_strAppOfflineContent;
     ULONGLONG m_ulLastCheckTime;
     bool m_fAppOfflineFound;
     SRWLOCK m_statusLock {};
     PollingAppOfflineApplicationMode m_mode;
+    // Set by the watch whenever app_offline.htm might have changed
+    std::atomic_bool m_fAppOfflineChanged;
+    // Polls every c_appOfflineRefreshIntervalMS instead while false
+    std::atomic_bool m_fWatchingAppOffline;
+    // Last, no callback may run once the members it uses are gone
+    DirectoryWatchService::WatchHandle m_appOfflineWatch;
 };
@@ -0,0 +1,104 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <httpserv.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define CS_ASPNETCORE_HANDLER_PRIORITY_PATHS             L"priorityPaths"
+
+//
+// The paths of an application that skip its request limits and queues,
+// like the health checks of a load balancer, which would otherwise mark
+// the instance down while it is busy. Set through the priorityPaths
+// handler setting, relative to the application and semicolon separated,
+// e.g. "/health;/alive". A path matches the request path exactly, without
+// its query and ignoring case.
+//
+class PriorityPaths
+{
+public:
+    PriorityPaths() = default;
+
+    explicit
+    PriorityPaths(std::wstring_view paths)
+    {
+        size_t pathStart = 0;
+        while (pathStart < paths.length())
+        {
+            auto pathEnd = paths.find(L';', pathStart);
+            if (pathEnd == std::wstring_view::npos)
+            {
+                pathEnd = paths.length();
+            }
+
+            if (pathEnd > pathStart)
+            {
+                m_paths.emplace_back(paths.substr(pathStart, pathEnd - pathStart));
+            }
+
+            pathStart = pathEnd + 1;
+        }
+    }
+
+    bool
+    empty() const noexcept
+    {
+        return m_paths.empty();
+    }
+
+    bool
+    Matches(IHttpContext& context) const noexcept
+    {
+        if (m_paths.empty())
+        {
+            return false;
+        }
+
+        const auto& cookedUrl = context.GetRequest()->GetRawHttpRequest()->CookedUrl;
+        if (cookedUrl.pAbsPath == nullptr)
+        {
+            return false;
+        }
+
+        std::wstring_view path(cookedUrl.pAbsPath, cookedUrl.AbsPathLength / sizeof(WCHAR));
+
+        // The virtual path of the root application is "/", the others
+        // have no trailing slash.
+        std::wstring_view virtualPath(context.GetApplication()->GetApplicationVirtualPath());
+        if (virtualPath.length() > 1)
+        {
+            if (path.length() < virtualPath.length() ||
+                !EqualsIgnoreCase(path.substr(0, virtualPath.length()), virtualPath))
+            {
+                return false;
+            }
+
+            path.remove_prefix(virtualPath.length());
+        }
+
+        for (const auto& priorityPath : m_paths)
+        {
+            if (EqualsIgnoreCase(path, priorityPath))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+private:
+    static
+    bool
+    EqualsIgnoreCase(std::wstring_view s1, std::wstring_view s2) noexcept
+    {
+        return s1.length() == s2.length() &&
+            CompareStringOrdinal(s1.data(), static_cast<int>(s1.length()), s2.data(), static_cast<int>(s2.length()), TRUE) == CSTR_EQUAL;
+    }
+
+    std::vector<std::wstring> m_paths;
+};
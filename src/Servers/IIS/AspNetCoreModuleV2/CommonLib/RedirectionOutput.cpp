@@ -2,16 +2,213 @@
 // Licensed under the MIT License. See License.txt in the project root for license information.
 
 #include "RedirectionOutput.h"
-#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <winioctl.h>
 #include "exceptions.h"
 #include "EventLog.h"
 
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    //
+    // Appends text to output as UTF-8 with every line feed written as
+    // \r\n, what the text mode stream used to write. Runs of ASCII are
+    // narrowed eight characters at a time, the rest goes through
+    // WideCharToMultiByte.
+    //
+    void AppendAsUtf8(std::wstring_view text, std::string& output)
+    {
+        // A UTF-16 unit takes at most three bytes, a line feed two.
+        const size_t cbStart = output.size();
+        output.resize(cbStart + text.size() * 3);
+
+        char* pOutput = output.data() + cbStart;
+        const wchar_t* pch = text.data();
+        const wchar_t* const pchEnd = pch + text.size();
+
+        while (pch < pchEnd)
+        {
+#if defined(_M_IX86) || defined(_M_X64)
+            const __m128i nonAsciiBits = _mm_set1_epi16(static_cast<short>(0xFF80));
+            const __m128i lineFeed = _mm_set1_epi16(L'\n');
+            while (pchEnd - pch >= 8)
+            {
+                const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pch));
+                const __m128i special = _mm_or_si128(
+                    _mm_and_si128(chars, nonAsciiBits),
+                    _mm_cmpeq_epi16(chars, lineFeed));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi16(special, _mm_setzero_si128())) != 0xFFFF)
+                {
+                    break;
+                }
+
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(pOutput), _mm_packus_epi16(chars, chars));
+                pOutput += 8;
+                pch += 8;
+            }
+
+            if (pch == pchEnd)
+            {
+                break;
+            }
+#endif
+            if (*pch < 0x80)
+            {
+                if (*pch == L'\n' && (pch == text.data() || pch[-1] != L'\r'))
+                {
+                    *pOutput++ = '\r';
+                }
+                *pOutput++ = static_cast<char>(*pch++);
+                continue;
+            }
+
+            // Up to the next ASCII character, which never splits a surrogate pair.
+            const wchar_t* pchRun = pch;
+            while (pch < pchEnd && *pch >= 0x80)
+            {
+                pch++;
+            }
+
+            const int cchRun = static_cast<int>(pch - pchRun);
+            const int cbAvailable = static_cast<int>(output.data() + output.size() - pOutput);
+            pOutput += WideCharToMultiByte(CP_UTF8, 0, pchRun, cchRun, pOutput, cbAvailable, nullptr, nullptr);
+        }
+
+        output.resize(pOutput - output.data());
+    }
+
+    //
+    // The same for bytes that already are UTF-8, copied a line at a time.
+    //
+    void AppendWithCrLf(std::string_view bytes, std::string& output)
+    {
+        const size_t cbStart = output.size();
+        output.resize(cbStart + bytes.size() * 2);
+
+        char* pOutput = output.data() + cbStart;
+        const char* pch = bytes.data();
+        const char* const pchEnd = pch + bytes.size();
+
+        while (pch < pchEnd)
+        {
+            const char* pchLineFeed = static_cast<const char*>(memchr(pch, '\n', pchEnd - pch));
+            if (pchLineFeed == nullptr)
+            {
+                pchLineFeed = pchEnd;
+            }
+
+            memcpy(pOutput, pch, pchLineFeed - pch);
+            pOutput += pchLineFeed - pch;
+            pch = pchLineFeed;
+
+            if (pch < pchEnd)
+            {
+                if (pch == bytes.data() || pch[-1] != '\r')
+                {
+                    *pOutput++ = '\r';
+                }
+                *pOutput++ = *pch++;
+            }
+        }
+
+        output.resize(pOutput - output.data());
+    }
+
+    bool IsAscii(std::string_view bytes) noexcept
+    {
+        const char* pch = bytes.data();
+        const char* const pchEnd = pch + bytes.size();
+
+#if defined(_M_IX86) || defined(_M_X64)
+        while (pchEnd - pch >= 16)
+        {
+            if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pch))) != 0)
+            {
+                return false;
+            }
+            pch += 16;
+        }
+#endif
+        for (; pch < pchEnd; pch++)
+        {
+            if (static_cast<unsigned char>(*pch) >= 0x80)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    //
+    // In place, the file stays readable as it is by any tool. Files on a
+    // volume without NTFS compression are left as they are.
+    //
+    void CompressLogFile(const std::filesystem::path& path)
+    {
+        const DWORD dwAttributes = GetFileAttributesW(path.c_str());
+        if (dwAttributes == INVALID_FILE_ATTRIBUTES || (dwAttributes & FILE_ATTRIBUTE_COMPRESSED) != 0)
+        {
+            return;
+        }
+
+        const HANDLE hFile = CreateFileW(path.c_str(),
+            GENERIC_READ | GENERIC_WRITE,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr);
+        if (hFile == INVALID_HANDLE_VALUE)
+        {
+            return;
+        }
+
+        USHORT usFormat = COMPRESSION_FORMAT_DEFAULT;
+        DWORD cbReturned;
+        if (!DeviceIoControl(hFile, FSCTL_SET_COMPRESSION, &usFormat, sizeof(usFormat), nullptr, 0, &cbReturned, nullptr))
+        {
+            const DWORD dwError = GetLastError();
+            LOG_IF_FAILED(dwError == ERROR_INVALID_FUNCTION || dwError == ERROR_NOT_SUPPORTED ? S_OK : HRESULT_FROM_WIN32(dwError));
+        }
+
+        CloseHandle(hFile);
+    }
+
+    // Compressed files count with what they take on disk.
+    ULONGLONG GetLogFileSizeOnDisk(const std::filesystem::path& path)
+    {
+        DWORD dwSizeHigh = 0;
+        const DWORD dwSizeLow = GetCompressedFileSizeW(path.c_str(), &dwSizeHigh);
+        if (dwSizeLow == INVALID_FILE_SIZE && GetLastError() != NO_ERROR)
+        {
+            return 0;
+        }
+
+        return (static_cast<ULONGLONG>(dwSizeHigh) << 32) | dwSizeLow;
+    }
+}
+
+void RedirectionOutput::AppendBytes(std::string_view bytes, UINT codePage)
+{
+    if (!TryAppendBytes(bytes, codePage))
+    {
+        Append(to_wide_string(bytes, codePage));
+    }
+}
+
 AggregateRedirectionOutput::AggregateRedirectionOutput(std::shared_ptr<RedirectionOutput> outputA, std::shared_ptr<RedirectionOutput> outputB, std::shared_ptr<RedirectionOutput> outputC) noexcept(true):
     m_outputA(std::move(outputA)), m_outputB(std::move(outputB)), m_outputC(std::move(outputC))
 {
 }
 
-void AggregateRedirectionOutput::Append(const std::wstring& text)
+// Every output gets the same view, none of them keeps it.
+void AggregateRedirectionOutput::Append(std::wstring_view text)
 {
     if (m_outputA != nullptr)
     {
@@ -27,8 +224,35 @@ void AggregateRedirectionOutput::Append(const std::wstring& text)
     }
 }
 
-FileRedirectionOutput::FileRedirectionOutput(const std::wstring& applicationPath, const std::wstring& fileName)
+bool AggregateRedirectionOutput::TryAppendBytes(std::string_view bytes, UINT codePage)
 {
+    std::wstring text;
+    bool fConverted = false;
+
+    for (auto* output : { m_outputA.get(), m_outputB.get(), m_outputC.get() })
+    {
+        if (output == nullptr || output->TryAppendBytes(bytes, codePage))
+        {
+            continue;
+        }
+
+        if (!fConverted)
+        {
+            text = to_wide_string(bytes, codePage);
+            fConverted = true;
+        }
+        output->Append(text);
+    }
+
+    return true;
+}
+
+FileRedirectionOutput::FileRedirectionOutput(const std::wstring& applicationPath, const std::wstring& fileName, const FileRollingOptions& rollingOptions) :
+    m_rollingOptions(rollingOptions)
+{
+    InitializeSRWLock(&m_srwLock);
+    InitializeSRWLock(&m_writeLock);
+
     try
     {
         SYSTEMTIME systemTime{};
@@ -48,7 +272,9 @@ FileRedirectionOutput::FileRedirectionOutput(const std::wstring& applicationPath
 
         THROW_LAST_ERROR_IF(!FileTimeToSystemTime(&processCreationTime, &systemTime));
 
-        m_fileName = format(L"%s_%d%02d%02d%02d%02d%02d_%d.log",
+        m_logDirectory = logPath.parent_path();
+        m_logPrefix = logPath.filename().wstring() + L"_";
+        m_baseName = format(L"%s_%d%02d%02d%02d%02d%02d_%d",
                             logPath.c_str(),
                             systemTime.wYear,
                             systemTime.wMonth,
@@ -57,9 +283,15 @@ FileRedirectionOutput::FileRedirectionOutput(const std::wstring& applicationPath
                             systemTime.wMinute,
                             systemTime.wSecond,
                             GetCurrentProcessId());
+        m_fileName = m_baseName + L".log";
 
-        m_file.exceptions(std::ifstream::failbit);
-        m_file.open(m_fileName, std::wofstream::out | std::wofstream::app);
+        m_pFlushTimer = CreateThreadpoolTimer(FlushCallback, this, nullptr);
+        THROW_LAST_ERROR_IF_NULL(m_pFlushTimer);
+
+        OpenFile();
+
+        // Files left behind by earlier process starts count against retention too.
+        ScheduleCleanup();
     }
     catch (...)
     {
@@ -73,38 +305,401 @@ FileRedirectionOutput::FileRedirectionOutput(const std::wstring& applicationPath
     }
 }
 
-void FileRedirectionOutput::Append(const std::wstring& text)
+template<typename TEncode>
+void FileRedirectionOutput::AppendEncoded(const TEncode& encode)
 {
-    if (m_file.is_open())
     {
-        auto multiByte = to_multi_byte_string(text, CP_UTF8);
+        SRWExclusiveLock lock(m_srwLock);
+        if (AppendNoLock(encode, false))
+        {
+            return;
+        }
+    }
+
+    // Rolling closes the file, the flush may be writing to it.
+    SRWExclusiveLock writeLock(m_writeLock);
+    SRWExclusiveLock lock(m_srwLock);
+    AppendNoLock(encode, true);
+}
 
-        // Writing \r\n to an ostream will cause two new lines to be written rather
-        // than one. Change all \r\n to \n.
-        std::string slashRslashN = "\r\n";
-        std::string slashN = "\n";
-        size_t start_pos = 0;
-        while ((start_pos = multiByte.find(slashRslashN, start_pos)) != std::string::npos) {
-            multiByte.replace(start_pos, slashRslashN.length(), slashN);
-            start_pos += slashN.length();
+template<typename TEncode>
+bool FileRedirectionOutput::AppendNoLock(const TEncode& encode, bool fCanRoll)
+{
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        return true;
+    }
+
+    const size_t cbPending = m_pending.size();
+    encode(m_pending);
+
+    const size_t cbAppend = m_pending.size() - cbPending;
+    if (ShouldRoll(cbAppend))
+    {
+        if (!fCanRoll)
+        {
+            m_pending.resize(cbPending);
+            return false;
         }
 
-        m_file << multiByte;
+        // What was pending before goes to the current file.
+        std::string appended(m_pending, cbPending);
+        m_pending.resize(cbPending);
+        Roll();
+        if (m_hFile == INVALID_HANDLE_VALUE)
+        {
+            return true;
+        }
+        m_pending += appended;
+    }
+
+    m_cbWritten += cbAppend;
+    ScheduleFlushNoLock();
+    return true;
+}
+
+void FileRedirectionOutput::Append(std::wstring_view text)
+{
+    AppendEncoded([text](std::string& output) { AppendAsUtf8(text, output); });
+}
+
+bool FileRedirectionOutput::TryAppendBytes(std::string_view bytes, UINT codePage)
+{
+    // ASCII is the same in every code page the console may use.
+    if (codePage != CP_UTF8 && !IsAscii(bytes))
+    {
+        return false;
     }
+
+    AppendEncoded([bytes](std::string& output) { AppendWithCrLf(bytes, output); });
+    return true;
 }
 
 FileRedirectionOutput::~FileRedirectionOutput()
 {
-    if (m_file.is_open())
+    if (m_pFlushTimer != nullptr)
+    {
+        SetThreadpoolTimer(m_pFlushTimer, nullptr, 0, 0);
+        WaitForThreadpoolTimerCallbacks(m_pFlushTimer, TRUE);
+        CloseThreadpoolTimer(m_pFlushTimer);
+        m_pFlushTimer = nullptr;
+    }
+
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        WritePending();
+        CloseFile();
+    }
+}
+
+void FileRedirectionOutput::OpenFile()
+{
+    m_fPreallocated = false;
+
+    const bool fPreallocate = m_rollingOptions.preallocate && m_rollingOptions.maxFileSizeBytes != 0;
+    if (fPreallocate && m_rollingOptions.retainedFiles != 0)
     {
-        m_file.close();
+        // Missing when no file was retired yet, a new file is created below then.
         std::error_code ec;
-        if (std::filesystem::file_size(m_fileName, ec) == 0 && SUCCEEDED_LOG(ec))
+        std::filesystem::rename(m_logDirectory / (m_logPrefix + L"spare.log"), m_fileName, ec);
+    }
+
+    m_hFile = CreateFileW(m_fileName.c_str(),
+        GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE,
+        nullptr,
+        OPEN_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+        nullptr);
+    THROW_LAST_ERROR_IF(m_hFile == INVALID_HANDLE_VALUE);
+
+    LARGE_INTEGER liPosition {};
+    if (fPreallocate)
+    {
+        // Reserve the clusters up front so the file is not fragmented by
+        // growing a write at a time. Writes start at the beginning and the
+        // file is cut back to what was written on close.
+        LARGE_INTEGER liSize;
+        liSize.QuadPart = static_cast<LONGLONG>(m_rollingOptions.maxFileSizeBytes);
+        if (SetFilePointerEx(m_hFile, liSize, nullptr, FILE_BEGIN) && SetEndOfFile(m_hFile))
+        {
+            m_fPreallocated = true;
+        }
+        else
         {
-            std::filesystem::remove(m_fileName, ec);
-            LOG_IF_FAILED(ec);
+            LOG_LAST_ERROR();
         }
     }
+
+    THROW_LAST_ERROR_IF(!SetFilePointerEx(m_hFile, liPosition, nullptr, m_fPreallocated ? FILE_BEGIN : FILE_END));
+
+    m_cbWritten = 0;
+    m_ullOpenedTick = GetTickCount64();
+}
+
+void FileRedirectionOutput::CloseFile()
+{
+    if (m_fPreallocated)
+    {
+        LARGE_INTEGER liSize;
+        liSize.QuadPart = static_cast<LONGLONG>(m_cbWritten);
+        LOG_LAST_ERROR_IF(!SetFilePointerEx(m_hFile, liSize, nullptr, FILE_BEGIN) || !SetEndOfFile(m_hFile));
+    }
+
+    CloseHandle(m_hFile);
+    m_hFile = INVALID_HANDLE_VALUE;
+
+    std::error_code ec;
+    if (std::filesystem::file_size(m_fileName, ec) == 0 && SUCCEEDED_LOG(ec))
+    {
+        std::filesystem::remove(m_fileName, ec);
+        LOG_IF_FAILED(ec);
+    }
+}
+
+void FileRedirectionOutput::WritePending()
+{
+    if (!m_pending.empty())
+    {
+        DWORD cbWritten;
+        LOG_LAST_ERROR_IF(!WriteFile(m_hFile, m_pending.data(), static_cast<DWORD>(m_pending.size()), &cbWritten, nullptr));
+        m_pending.clear();
+    }
+}
+
+bool FileRedirectionOutput::ShouldRoll(size_t cbAppend) const
+{
+    if (m_cbWritten == 0)
+    {
+        // Never leave an empty file behind, even for a single oversized write.
+        return false;
+    }
+
+    return (m_rollingOptions.maxFileSizeBytes != 0 && m_cbWritten + cbAppend > m_rollingOptions.maxFileSizeBytes) ||
+        (m_rollingOptions.rollIntervalMs != 0 && GetTickCount64() - m_ullOpenedTick >= m_rollingOptions.rollIntervalMs);
+}
+
+void FileRedirectionOutput::Roll()
+{
+    try
+    {
+        WritePending();
+        CloseFile();
+
+        m_dwSequence++;
+        m_fileName = format(L"%s_%lu.log", m_baseName.c_str(), m_dwSequence);
+        OpenFile();
+
+        ScheduleCleanup();
+    }
+    catch (...)
+    {
+        // Output is dropped from now on rather than failing the writer.
+        OBSERVE_CAUGHT_EXCEPTION();
+        if (m_hFile != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(m_hFile);
+            m_hFile = INVALID_HANDLE_VALUE;
+        }
+        m_pending.clear();
+    }
+}
+
+void FileRedirectionOutput::ScheduleFlushNoLock() noexcept
+{
+    if (m_pFlushTimer == nullptr)
+    {
+        return;
+    }
+
+    if (m_pending.size() >= FLUSH_BATCH_BYTES)
+    {
+        // Negative due times are relative, zero runs it right away.
+        FILETIME ftDueTime {};
+        SetThreadpoolTimer(m_pFlushTimer, &ftDueTime, 0, 0);
+        m_fFlushScheduled = true;
+    }
+    else if (!m_fFlushScheduled)
+    {
+        ULARGE_INTEGER ulDueTime;
+        ulDueTime.QuadPart = static_cast<ULONGLONG>(-static_cast<LONGLONG>(FLUSH_DELAY_MS) * 10000);
+
+        FILETIME ftDueTime;
+        ftDueTime.dwHighDateTime = ulDueTime.HighPart;
+        ftDueTime.dwLowDateTime = ulDueTime.LowPart;
+        SetThreadpoolTimer(m_pFlushTimer, &ftDueTime, 0, 0);
+        m_fFlushScheduled = true;
+    }
+}
+
+void FileRedirectionOutput::Flush()
+{
+    SRWExclusiveLock writeLock(m_writeLock);
+    {
+        SRWExclusiveLock lock(m_srwLock);
+        m_fFlushScheduled = false;
+        if (m_hFile == INVALID_HANDLE_VALUE || m_pending.empty())
+        {
+            return;
+        }
+
+        m_writing.swap(m_pending);
+    }
+
+    DWORD cbWritten;
+    LOG_LAST_ERROR_IF(!WriteFile(m_hFile, m_writing.data(), static_cast<DWORD>(m_writing.size()), &cbWritten, nullptr));
+    m_writing.clear();
+}
+
+VOID
+CALLBACK
+FileRedirectionOutput::FlushCallback(
+    _Inout_ PTP_CALLBACK_INSTANCE   Instance,
+    _Inout_opt_ PVOID               pContext,
+    _Inout_ PTP_TIMER               pTimer
+)
+{
+    UNREFERENCED_PARAMETER(Instance);
+    UNREFERENCED_PARAMETER(pTimer);
+
+    try
+    {
+        static_cast<FileRedirectionOutput*>(pContext)->Flush();
+    }
+    catch (...)
+    {
+        OBSERVE_CAUGHT_EXCEPTION();
+    }
+}
+
+void FileRedirectionOutput::ScheduleCleanup() const
+{
+    if (m_rollingOptions.retainedFiles == 0 && !m_rollingOptions.compress && m_rollingOptions.maxTotalBytes == 0)
+    {
+        return;
+    }
+
+    auto context = std::make_unique<CleanupContext>();
+    context->directory = m_logDirectory;
+    context->prefix = m_logPrefix;
+    // Only keep a spare to reuse when new files are preallocated.
+    if (m_rollingOptions.preallocate && m_rollingOptions.maxFileSizeBytes != 0)
+    {
+        context->spareFileName = m_logPrefix + L"spare.log";
+    }
+    context->currentFileName = std::filesystem::path(m_fileName).filename().wstring();
+    context->retainedFiles = m_rollingOptions.retainedFiles;
+    context->fCompress = m_rollingOptions.compress;
+    context->maxTotalBytes = m_rollingOptions.maxTotalBytes;
+
+    if (TrySubmitThreadpoolCallback(CleanupCallback, context.get(), nullptr))
+    {
+        context.release();
+    }
+    else
+    {
+        LOG_LAST_ERROR();
+    }
+}
+
+VOID
+CALLBACK
+FileRedirectionOutput::CleanupCallback(
+    _Inout_ PTP_CALLBACK_INSTANCE   Instance,
+    _Inout_opt_ PVOID               pContext
+)
+{
+    UNREFERENCED_PARAMETER(Instance);
+
+    std::unique_ptr<CleanupContext> context(static_cast<CleanupContext*>(pContext));
+
+    // Lowers the CPU and I/O priority of the thread until it is returned to the pool.
+    const bool fBackground = SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+
+    try
+    {
+        std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> files;
+        std::error_code ec;
+
+        for (const auto& entry : std::filesystem::directory_iterator(context->directory, ec))
+        {
+            const auto name = entry.path().filename().wstring();
+            if (!entry.is_regular_file(ec) ||
+                name.compare(0, context->prefix.size(), context->prefix) != 0 ||
+                !equals_ignore_case(entry.path().extension().wstring(), L".log") ||
+                equals_ignore_case(name, context->prefix + L"spare.log") ||
+                equals_ignore_case(name, context->currentFileName))
+            {
+                continue;
+            }
+
+            files.emplace_back(entry.last_write_time(ec), entry.path());
+        }
+
+        std::sort(files.begin(), files.end());
+
+        // The current file is not in the list but is one of the retained ones.
+        size_t firstRetained = 0;
+        if (context->retainedFiles != 0 && files.size() >= context->retainedFiles)
+        {
+            const auto spare = context->directory / context->spareFileName;
+            for (; firstRetained <= files.size() - context->retainedFiles; firstRetained++)
+            {
+                // A compressed file would make the writes to the next one compress.
+                if (!context->spareFileName.empty() && !std::filesystem::exists(spare, ec) &&
+                    (GetFileAttributesW(files[firstRetained].second.c_str()) & FILE_ATTRIBUTE_COMPRESSED) == 0)
+                {
+                    std::filesystem::rename(files[firstRetained].second, spare, ec);
+                    if (!ec)
+                    {
+                        continue;
+                    }
+                }
+
+                // Fails for files still held open by other processes, those are
+                // picked up by a later cleanup.
+                std::filesystem::remove(files[firstRetained].second, ec);
+            }
+        }
+
+        if (context->fCompress)
+        {
+            for (size_t i = firstRetained; i < files.size(); i++)
+            {
+                CompressLogFile(files[i].second);
+            }
+        }
+
+        if (context->maxTotalBytes != 0)
+        {
+            std::vector<ULONGLONG> sizes(files.size());
+            ULONGLONG cbTotal = GetLogFileSizeOnDisk(context->directory / context->currentFileName);
+            for (size_t i = firstRetained; i < files.size(); i++)
+            {
+                sizes[i] = GetLogFileSizeOnDisk(files[i].second);
+                cbTotal += sizes[i];
+            }
+
+            // Oldest first, the current file is always kept.
+            for (size_t i = firstRetained; i < files.size() && cbTotal > context->maxTotalBytes; i++)
+            {
+                std::filesystem::remove(files[i].second, ec);
+                if (!ec)
+                {
+                    cbTotal -= sizes[i];
+                }
+            }
+        }
+    }
+    catch (...)
+    {
+        OBSERVE_CAUGHT_EXCEPTION();
+    }
+
+    if (fBackground)
+    {
+        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+    }
 }
 
 StandardOutputRedirectionOutput::StandardOutputRedirectionOutput(): m_handle(GetStdHandle(STD_OUTPUT_HANDLE))
@@ -121,22 +716,59 @@ StandardOutputRedirectionOutput::StandardOutputRedirectionOutput(): m_handle(Get
     m_handle = stdOutHandle;
 }
 
-void StandardOutputRedirectionOutput::Append(const std::wstring& text)
+void StandardOutputRedirectionOutput::Append(std::wstring_view text)
 {
     DWORD nBytesWritten = 0;
     auto encodedBytes = to_multi_byte_string(text, GetConsoleOutputCP());
     WriteFile(m_handle, encodedBytes.data(), static_cast<DWORD>(encodedBytes.size()), &nBytesWritten, nullptr);
 }
 
+bool StandardOutputRedirectionOutput::TryAppendBytes(std::string_view bytes, UINT codePage)
+{
+    if (codePage != GetConsoleOutputCP())
+    {
+        return false;
+    }
+
+    DWORD nBytesWritten = 0;
+    WriteFile(m_handle, bytes.data(), static_cast<DWORD>(bytes.size()), &nBytesWritten, nullptr);
+    return true;
+}
+
 StringStreamRedirectionOutput::StringStreamRedirectionOutput()
+    : m_buffer(std::make_unique<wchar_t[]>(MAX_CHARACTERS))
 {
-    InitializeSRWLock(&m_srwLock);
 }
 
-void StringStreamRedirectionOutput::Append(const std::wstring& text)
+void StringStreamRedirectionOutput::Append(std::wstring_view text)
 {
-    SRWExclusiveLock lock(m_srwLock);
-    auto const writeSize = min(m_charactersLeft, text.size());
-    m_output.write(text.c_str(), writeSize);
-    m_charactersLeft -= writeSize;
+    if (text.empty() || m_charactersReserved.load(std::memory_order_relaxed) >= MAX_CHARACTERS)
+    {
+        return;
+    }
+
+    auto const start = m_charactersReserved.fetch_add(text.size(), std::memory_order_relaxed);
+    if (start >= MAX_CHARACTERS)
+    {
+        return;
+    }
+
+    auto const writeSize = min(MAX_CHARACTERS - start, text.size());
+    std::copy_n(text.data(), writeSize, m_buffer.get() + start);
+    m_charactersWritten.fetch_add(writeSize, std::memory_order_release);
+}
+
+std::wstring StringStreamRedirectionOutput::GetOutput() const
+{
+    for (;;)
+    {
+        auto const requested = m_charactersReserved.load(std::memory_order_relaxed);
+        auto const reserved = min(requested, MAX_CHARACTERS);
+        if (m_charactersWritten.load(std::memory_order_acquire) >= reserved)
+        {
+            return std::wstring(m_buffer.get(), reserved);
+        }
+
+        YieldProcessor();
+    }
 }
@@ -6,13 +6,30 @@
 #include "SRWExclusiveLock.h"
 #include "NonCopyable.h"
 #include "HandleWrapper.h"
-#include <fstream>
+#include <filesystem>
+#include <atomic>
+#include <memory>
+#include <string_view>
 
 class RedirectionOutput
 {
 public:
     virtual ~RedirectionOutput() = default;
-    virtual void Append(const std::wstring& text) = 0;
+    // text is only valid for the duration of the call.
+    virtual void Append(std::wstring_view text) = 0;
+
+    // Output read from a pipe, encoded in codePage. Only converted to
+    // UTF-16 for the outputs that do not take the bytes as they are.
+    void AppendBytes(std::string_view bytes, UINT codePage);
+
+    // Returns false, without appending, when the bytes have to be
+    // converted for this output.
+    virtual bool TryAppendBytes(std::string_view bytes, UINT codePage)
+    {
+        UNREFERENCED_PARAMETER(bytes);
+        UNREFERENCED_PARAMETER(codePage);
+        return false;
+    }
 };
 
 class AggregateRedirectionOutput: NonCopyable, public RedirectionOutput
@@ -20,7 +37,10 @@ class AggregateRedirectionOutput: NonCopyable, public RedirectionOutput
 public:
     AggregateRedirectionOutput(std::shared_ptr<RedirectionOutput> outputA, std::shared_ptr<RedirectionOutput> outputB, std::shared_ptr<RedirectionOutput> outputC) noexcept(true);
 
-    void Append(const std::wstring& text) override;
+    void Append(std::wstring_view text) override;
+
+    // Converts the bytes at most once, for the outputs that need it.
+    bool TryAppendBytes(std::string_view bytes, UINT codePage) override;
 
 private:
     std::shared_ptr<RedirectionOutput> m_outputA;
@@ -28,18 +48,122 @@ private:
     std::shared_ptr<RedirectionOutput> m_outputC;
 };
 
+struct FileRollingOptions
+{
+    // Start a new file once the current one would grow past this size, 0 disables size based rolling
+    ULONGLONG maxFileSizeBytes = 0;
+    // Start a new file once the current one has been written to for this long, 0 disables time based rolling
+    DWORD rollIntervalMs = 0;
+    // Number of log files with the same prefix kept in the log directory, 0 keeps all of them
+    DWORD retainedFiles = 0;
+    // Extend every file to maxFileSizeBytes when it is opened and reuse the
+    // oldest file beyond retainedFiles instead of deleting it
+    bool preallocate = false;
+    // Compress the files rolled over in place with NTFS compression
+    bool compress = false;
+    // Bytes on disk the log files with the same prefix may take, the oldest
+    // rolled ones are deleted beyond it, 0 disables the quota
+    ULONGLONG maxTotalBytes = 0;
+};
+
+//
+// Appends convert the text to UTF-8 into a pending buffer, a thread pool
+// timer writes it to the file once FLUSH_BATCH_BYTES are pending or after
+// FLUSH_DELAY_MS, so that a verbose application does not pay a write per
+// line. What is pending when the process crashes is lost. Bytes read from
+// a pipe are copied as they are when they are UTF-8 or ASCII.
+//
+// m_srwLock protects the pending buffer and the sizes, m_writeLock the
+// file. When both are needed m_writeLock is acquired first, an append only
+// waits for a write when the file has to roll.
+//
 class FileRedirectionOutput: NonCopyable, public RedirectionOutput
 {
 public:
-    FileRedirectionOutput(const std::wstring& applicationPath, const std::wstring& fileName);
+    FileRedirectionOutput(const std::wstring& applicationPath, const std::wstring& fileName, const FileRollingOptions& rollingOptions = FileRollingOptions());
 
-    void Append(const std::wstring& text) override;
+    void Append(std::wstring_view text) override;
+
+    bool TryAppendBytes(std::string_view bytes, UINT codePage) override;
 
     ~FileRedirectionOutput() override;
 
 private:
+    struct CleanupContext
+    {
+        std::filesystem::path directory;
+        std::wstring prefix;
+        std::wstring spareFileName;
+        std::wstring currentFileName;
+        DWORD retainedFiles;
+        bool fCompress;
+        ULONGLONG maxTotalBytes;
+    };
+
+    // encode writes the UTF-8 of one append at the end of the pending
+    // buffer, it may run twice when the file rolls.
+    template<typename TEncode>
+    void AppendEncoded(const TEncode& encode);
+
+    // Returns false, without appending, if the file has to roll first and
+    // fCanRoll is not set.
+    template<typename TEncode>
+    bool AppendNoLock(const TEncode& encode, bool fCanRoll);
+
+    // Called with both locks held, or without a timer, like the ones below.
+    void OpenFile();
+    void CloseFile();
+    void WritePending();
+    bool ShouldRoll(size_t cbAppend) const;
+    void Roll();
+
+    // Called with m_srwLock held.
+    void ScheduleFlushNoLock() noexcept;
+    // Writes what is pending with only m_writeLock held during the write.
+    void Flush();
+
+    static
+    VOID
+    CALLBACK
+    FlushCallback(
+        _Inout_ PTP_CALLBACK_INSTANCE   Instance,
+        _Inout_opt_ PVOID               pContext,
+        _Inout_ PTP_TIMER               pTimer);
+
+    // Compresses the rolled files and deletes the ones beyond retention or
+    // quota on the thread pool, at background priority: the writer never
+    // waits on the directory scan, the sites sharing the disk hardly on
+    // the compression.
+    void ScheduleCleanup() const;
+
+    static
+    VOID
+    CALLBACK
+    CleanupCallback(
+        _Inout_ PTP_CALLBACK_INSTANCE   Instance,
+        _Inout_opt_ PVOID               pContext);
+
+    FileRollingOptions m_rollingOptions;
+    std::filesystem::path m_logDirectory;
+    std::wstring m_logPrefix;
+    std::wstring m_baseName;
     std::wstring m_fileName;
-    std::ofstream m_file;
+    HANDLE m_hFile = INVALID_HANDLE_VALUE;
+    bool m_fPreallocated = false;
+    DWORD m_dwSequence = 0;
+    // Bytes appended to the current file, pending ones included.
+    ULONGLONG m_cbWritten = 0;
+    ULONGLONG m_ullOpenedTick = 0;
+    std::string m_pending;
+    // Swapped with m_pending by the flush, to keep both capacities.
+    std::string m_writing;
+    PTP_TIMER m_pFlushTimer = nullptr;
+    bool m_fFlushScheduled = false;
+    SRWLOCK m_srwLock{};
+    SRWLOCK m_writeLock{};
+
+    static constexpr size_t FLUSH_BATCH_BYTES = 64 * 1024;
+    static constexpr DWORD FLUSH_DELAY_MS = 100;
 };
 
 class StandardOutputRedirectionOutput: NonCopyable, public RedirectionOutput
@@ -47,7 +171,10 @@ class StandardOutputRedirectionOutput: NonCopyable, public RedirectionOutput
 public:
     StandardOutputRedirectionOutput();
 
-    void Append(const std::wstring& text) override;
+    void Append(std::wstring_view text) override;
+
+    // Written as they are when they are in the console code page.
+    bool TryAppendBytes(std::string_view bytes, UINT codePage) override;
 
 private:
     HandleWrapper<InvalidHandleTraits> m_handle;
@@ -61,7 +188,7 @@ public:
     {
     }
 
-    void Append(const std::wstring& text) override
+    void Append(std::wstring_view text) override
     {
         auto const target = *m_target;
         if (target)
@@ -70,27 +197,47 @@ public:
         }
     }
 
+    bool TryAppendBytes(std::string_view bytes, UINT codePage) override
+    {
+        auto const target = *m_target;
+        return target == nullptr || target->TryAppendBytes(bytes, codePage);
+    }
+
 private:
     RedirectionOutput** m_target;
 };
 
+//
+// Keeps the first MAX_CHARACTERS characters written to it, the rest is
+// dropped. Writers reserve their range of the buffer with an atomic add and
+// copy into it without a lock, so that a chatty startup does not serialize
+// the threads that log.
+//
 class StringStreamRedirectionOutput: NonCopyable, public RedirectionOutput
 {
 public:
     StringStreamRedirectionOutput();
 
-    void Append(const std::wstring& text) override;
+    void Append(std::wstring_view text) override;
+
+    // Waits for the writers that reserved a range to finish copying it.
+    std::wstring GetOutput() const;
 
-    std::wstring GetOutput() const
+    // Bytes allocated up front for the output, whatever is captured.
+    static constexpr std::size_t GetBufferSize() noexcept
     {
-        return m_output.str();
+        return MAX_CHARACTERS * sizeof(wchar_t);
     }
 
 private:
     // Logs collected by this output are mostly used for Event Log messages where size limit is 32K
-    std::size_t m_charactersLeft = 30000;
-    std::wstringstream m_output;
-    SRWLOCK m_srwLock{};
+    static constexpr std::size_t MAX_CHARACTERS = 30000;
+
+    std::unique_ptr<wchar_t[]> m_buffer;
+    // Characters asked for, past MAX_CHARACTERS once the buffer is full.
+    std::atomic<std::size_t> m_charactersReserved { 0 };
+    // Characters copied, at most MAX_CHARACTERS.
+    std::atomic<std::size_t> m_charactersWritten { 0 };
 };
 
 
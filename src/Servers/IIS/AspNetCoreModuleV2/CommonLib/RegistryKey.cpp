@@ -3,6 +3,8 @@
 
 #include "RegistryKey.h"
 #include "exceptions.h"
+#include "SRWExclusiveLock.h"
+#include "SRWSharedLock.h"
 
 std::optional<DWORD> RegistryKey::TryGetDWORD(HKEY section, const std::wstring& subSectionName, const std::wstring& valueName, DWORD flags)
 {
@@ -53,3 +55,167 @@ bool RegistryKey::CheckReturnValue(int errorCode)
     return false;
 }
 
+
+SRWLOCK CachedRegistryKey::s_srwKeysLock = SRWLOCK_INIT;
+std::list<CachedRegistryKey> CachedRegistryKey::s_keys;
+
+CachedRegistryKey::CachedRegistryKey(HKEY section, std::wstring subSectionName) noexcept
+    : m_section(section),
+      m_subSectionName(std::move(subSectionName))
+{
+    InitializeSRWLock(&m_srwLock);
+}
+
+std::optional<DWORD> CachedRegistryKey::TryGetDWORD(const std::wstring& valueName)
+{
+    return TryGetValue(m_dwordValues, valueName, [&]() { return RegistryKey::TryGetDWORD(m_section, m_subSectionName, valueName); });
+}
+
+std::optional<std::wstring> CachedRegistryKey::TryGetString(const std::wstring& valueName)
+{
+    return TryGetValue(m_stringValues, valueName, [&]() { return RegistryKey::TryGetString(m_section, m_subSectionName, valueName); });
+}
+
+CachedRegistryKey& CachedRegistryKey::Get(HKEY section, const std::wstring& subSectionName)
+{
+    {
+        SRWSharedLock lock(s_srwKeysLock);
+        for (auto& key : s_keys)
+        {
+            if (key.m_section == section && _wcsicmp(key.m_subSectionName.c_str(), subSectionName.c_str()) == 0)
+            {
+                return key;
+            }
+        }
+    }
+
+    SRWExclusiveLock lock(s_srwKeysLock);
+    for (auto& key : s_keys)
+    {
+        if (key.m_section == section && _wcsicmp(key.m_subSectionName.c_str(), subSectionName.c_str()) == 0)
+        {
+            return key;
+        }
+    }
+
+    // A list, the references handed out stay valid.
+    return s_keys.emplace_back(section, subSectionName);
+}
+
+template <typename T, typename ReadValue>
+std::optional<T>
+CachedRegistryKey::TryGetValue(std::map<std::wstring, std::optional<T>>& values, const std::wstring& valueName, ReadValue readValue)
+{
+    bool fWatchFailed;
+    {
+        SRWSharedLock lock(m_srwLock);
+        fWatchFailed = m_fWatchFailed;
+        if (!fWatchFailed && IsCurrentNoLock())
+        {
+            const auto value = values.find(valueName);
+            if (value != values.end())
+            {
+                return value->second;
+            }
+        }
+    }
+
+    if (fWatchFailed)
+    {
+        return readValue();
+    }
+
+    SRWExclusiveLock lock(m_srwLock);
+
+    if (!IsCurrentNoLock())
+    {
+        RefreshNoLock();
+    }
+
+    auto value = readValue();
+
+    // Changed since the notification was armed, read again by the next call.
+    if (IsCurrentNoLock())
+    {
+        values[valueName] = value;
+    }
+
+    return value;
+}
+
+bool CachedRegistryKey::IsCurrentNoLock() noexcept
+{
+    return m_hWatchedKey != nullptr && WaitForSingleObject(m_hChanged, 0) == WAIT_TIMEOUT;
+}
+
+void CachedRegistryKey::RefreshNoLock() noexcept
+{
+    m_dwordValues.clear();
+    m_stringValues.clear();
+
+    const HKEY hPrevious = m_hWatchedKey.release();
+    if (hPrevious != nullptr)
+    {
+        // Cancels its notification.
+        RegCloseKey(hPrevious);
+    }
+
+    if (m_fWatchFailed)
+    {
+        return;
+    }
+
+    if (m_hChanged == nullptr)
+    {
+        m_hChanged = CreateEvent(nullptr, /* bManualReset */ TRUE, /* bInitialState */ FALSE, nullptr);
+        if (m_hChanged == nullptr)
+        {
+            LOG_LAST_ERROR();
+            m_fWatchFailed = true;
+            return;
+        }
+    }
+    ResetEvent(m_hChanged);
+
+    //
+    // Reopened each time, the watched key may have been deleted or the key
+    // missing before created. A key created later is reported by a parent
+    // watched with its subtree, the root of the section is not watched.
+    //
+    std::wstring watchedName = m_subSectionName;
+    HKEY hKey = nullptr;
+    LSTATUS status;
+    while ((status = RegOpenKeyEx(m_section, watchedName.c_str(), 0, KEY_NOTIFY, &hKey)) == ERROR_FILE_NOT_FOUND)
+    {
+        const auto separator = watchedName.rfind(L'\\');
+        if (separator == std::wstring::npos)
+        {
+            m_fWatchFailed = true;
+            return;
+        }
+        watchedName.resize(separator);
+    }
+
+    if (status != NO_ERROR)
+    {
+        LOG_IF_FAILED(HRESULT_FROM_WIN32(status));
+        m_fWatchFailed = true;
+        return;
+    }
+
+    // REG_NOTIFY_THREAD_AGNOSTIC, the thread that read first may exit before the key changes.
+    status = RegNotifyChangeKeyValue(hKey,
+        /* bWatchSubtree */ TRUE,
+        REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET | REG_NOTIFY_THREAD_AGNOSTIC,
+        m_hChanged,
+        /* fAsynchronous */ TRUE);
+    if (status != NO_ERROR)
+    {
+        LOG_IF_FAILED(HRESULT_FROM_WIN32(status));
+        RegCloseKey(hKey);
+        m_fWatchFailed = true;
+        return;
+    }
+
+    m_hWatchedKey = hKey;
+}
@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include <list>
+#include <map>
 #include <optional>
 #include "HandleWrapper.h"
 
@@ -20,3 +22,53 @@ private:
     bool
     CheckReturnValue(int errorCode);
 };
+
+//
+// Values of one key read through RegistryKey, cached for the module until
+// RegNotifyChangeKeyValue reports a change of the key, or of its nearest
+// parent while the key does not exist. The notification is checked when a
+// value is read, like GlobalVersionCache checks its folder, so no wait of
+// the module outlives it. Where it cannot be armed, values are read each
+// time as before.
+//
+class CachedRegistryKey
+{
+public:
+    CachedRegistryKey(HKEY section, std::wstring subSectionName) noexcept;
+
+    CachedRegistryKey(const CachedRegistryKey&) = delete;
+    CachedRegistryKey& operator=(const CachedRegistryKey&) = delete;
+
+    std::optional<DWORD> TryGetDWORD(const std::wstring& valueName);
+
+    std::optional<std::wstring> TryGetString(const std::wstring& valueName);
+
+    // The instance of the module for the key.
+    static
+    CachedRegistryKey&
+    Get(HKEY section, const std::wstring& subSectionName);
+
+private:
+    template <typename T, typename ReadValue>
+    std::optional<T>
+    TryGetValue(std::map<std::wstring, std::optional<T>>& values, const std::wstring& valueName, ReadValue readValue);
+
+    bool
+    IsCurrentNoLock() noexcept;
+
+    void
+    RefreshNoLock() noexcept;
+
+    const HKEY          m_section;
+    const std::wstring  m_subSectionName;
+    SRWLOCK             m_srwLock {};
+    bool                m_fWatchFailed = false;
+    HandleWrapper<RegistryKeyHandleTraits> m_hWatchedKey;
+    // Manual reset, set by the notification.
+    HandleWrapper<NullHandleTraits> m_hChanged;
+    std::map<std::wstring, std::optional<DWORD>> m_dwordValues;
+    std::map<std::wstring, std::optional<std::wstring>> m_stringValues;
+
+    static SRWLOCK                          s_srwKeysLock;
+    static std::list<CachedRegistryKey>     s_keys;
+};
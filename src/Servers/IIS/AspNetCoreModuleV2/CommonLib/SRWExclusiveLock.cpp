@@ -9,6 +9,12 @@ SRWExclusiveLock::SRWExclusiveLock(const SRWLOCK& lock) noexcept
     AcquireSRWLockExclusive(const_cast<SRWLOCK*>(&m_lock));
 }
 
+SRWExclusiveLock::SRWExclusiveLock(const SRWLOCK& lock, LockSite site) noexcept
+    : m_lock(lock)
+{
+    LockContention::AcquireExclusive(const_cast<SRWLOCK*>(&m_lock), site);
+}
+
 SRWExclusiveLock::~SRWExclusiveLock()
 {
     ReleaseSRWLockExclusive(const_cast<SRWLOCK*>(&m_lock));
@@ -4,11 +4,14 @@
 #pragma once
 
 #include <synchapi.h>
+#include "LockContention.h"
 
 class SRWExclusiveLock
 {
 public:
 	SRWExclusiveLock(const SRWLOCK& lock) noexcept;
+	// Counts the contention of the acquisition for site, see LockContention.
+	SRWExclusiveLock(const SRWLOCK& lock, LockSite site) noexcept;
 	~SRWExclusiveLock();
 private:
     const SRWLOCK& m_lock;
@@ -9,6 +9,12 @@ SRWSharedLock::SRWSharedLock(const SRWLOCK& lock)
     AcquireSRWLockShared(const_cast<SRWLOCK*>(&m_lock));
 }
 
+SRWSharedLock::SRWSharedLock(const SRWLOCK& lock, LockSite site) noexcept
+    : m_lock(lock)
+{
+    LockContention::AcquireShared(const_cast<SRWLOCK*>(&m_lock), site);
+}
+
 SRWSharedLock::~SRWSharedLock()
 {
     ReleaseSRWLockShared(const_cast<SRWLOCK*>(&m_lock));
@@ -4,11 +4,14 @@
 #pragma once
 
 #include <synchapi.h>
+#include "LockContention.h"
 
 class SRWSharedLock
 {
 public:
 	SRWSharedLock(const SRWLOCK& lock);
+	// Counts the contention of the acquisition for site, see LockContention.
+	SRWSharedLock(const SRWLOCK& lock, LockSite site) noexcept;
 	~SRWSharedLock();
 private:
     const SRWLOCK& m_lock;
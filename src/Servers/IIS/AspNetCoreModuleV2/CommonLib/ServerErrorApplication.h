@@ -11,11 +11,7 @@ class ServerErrorApplication : public PollingAppOfflineApplication
 public:
     ServerErrorApplication(const IHttpApplication& pApplication, HRESULT hr, bool disableStartupPage, const std::string& responseContent, USHORT status, USHORT substatus, const std::string& statusText)
         : m_HR(hr),
-        m_disableStartupPage(disableStartupPage),
-        m_responseContent(responseContent),
-        m_statusCode(status),
-        m_subStatusCode(substatus),
-        m_statusText(statusText),
+        m_page(std::make_shared<const ServerErrorPage>(ServerErrorPage{ status, substatus, statusText, disableStartupPage, responseContent })),
         PollingAppOfflineApplication(pApplication, PollingAppOfflineApplicationMode::StopWhenAdded)
     {
     }
@@ -24,7 +20,7 @@ public:
 
     HRESULT CreateHandler(IHttpContext *pHttpContext, IREQUEST_HANDLER ** pRequestHandler) override
     {
-        *pRequestHandler = std::make_unique<ServerErrorHandler>(*pHttpContext, m_statusCode, m_subStatusCode, m_statusText, m_HR, m_disableStartupPage, m_responseContent).release();
+        *pRequestHandler = std::make_unique<ServerErrorHandler>(*pHttpContext, m_page, m_HR).release();
 
         return S_OK;
     }
@@ -32,9 +28,5 @@ public:
     HRESULT OnAppOfflineFound() noexcept override { return S_OK; }
 private:
     HRESULT m_HR;
-    bool m_disableStartupPage;
-    std::string m_responseContent;
-    USHORT m_statusCode;
-    USHORT m_subStatusCode;
-    std::string m_statusText;
+    std::shared_ptr<const ServerErrorPage> m_page;
 };
@@ -2,21 +2,31 @@
 // Licensed under the MIT License. See License.txt in the project root for license information.
 
 #pragma once
+#include <memory>
 #include "requesthandler.h"
 #include "file_utility.h"
 #include "Environment.h"
 
+//
+// The response of an application that failed, rendered once when it
+// failed and shared by the handlers of all its requests.
+//
+struct ServerErrorPage
+{
+    USHORT statusCode;
+    USHORT subStatusCode;
+    std::string statusText;
+    bool disableStartupPage;
+    std::string content;
+};
+
 class ServerErrorHandler : public REQUEST_HANDLER
 {
 public:
-    ServerErrorHandler(IHttpContext& pContext, USHORT statusCode, USHORT subStatusCode, const std::string& statusText, HRESULT hr, bool disableStartupPage, std::string& responseContent) noexcept
+    ServerErrorHandler(IHttpContext& pContext, std::shared_ptr<const ServerErrorPage> page, HRESULT hr) noexcept
         : REQUEST_HANDLER(pContext),
         m_HR(hr),
-        m_disableStartupPage(disableStartupPage),
-        m_statusCode(statusCode),
-        m_subStatusCode(subStatusCode),
-        m_statusText(std::move(statusText)),
-        m_ExceptionInfoContent(responseContent)
+        m_page(std::move(page))
     {
     }
 
@@ -30,32 +40,32 @@ public:
 private:
     void WriteResponse()
     {
-        if (m_disableStartupPage)
+        const ServerErrorPage& page = *m_page;
+
+        if (page.disableStartupPage)
         {
-            m_pHttpContext.GetResponse()->SetStatus(m_statusCode, m_statusText.c_str(), m_subStatusCode, E_FAIL);
+            m_pHttpContext.GetResponse()->SetStatus(page.statusCode, page.statusText.c_str(), page.subStatusCode, E_FAIL);
             return;
         }
 
         HTTP_DATA_CHUNK dataChunk = {};
         IHttpResponse* pResponse = m_pHttpContext.GetResponse();
-        pResponse->SetStatus(m_statusCode, m_statusText.c_str(), m_subStatusCode, m_HR, nullptr, true);
+        pResponse->SetStatus(page.statusCode, page.statusText.c_str(), page.subStatusCode, m_HR, nullptr, true);
         pResponse->SetHeader("Content-Type",
             "text/html",
             (USHORT)strlen("text/html"),
             FALSE
         );
 
+        // The handler keeps the page alive until the request is done with
+        // the buffer, whatever happens to the application meanwhile.
         dataChunk.DataChunkType = HttpDataChunkFromMemory;
-        dataChunk.FromMemory.pBuffer = m_ExceptionInfoContent.data();
-        dataChunk.FromMemory.BufferLength = static_cast<ULONG>(m_ExceptionInfoContent.size());
+        dataChunk.FromMemory.pBuffer = const_cast<char*>(page.content.data());
+        dataChunk.FromMemory.BufferLength = static_cast<ULONG>(page.content.size());
 
         pResponse->WriteEntityChunkByReference(&dataChunk);
     }
 
     HRESULT m_HR;
-    bool m_disableStartupPage;
-    USHORT m_statusCode;
-    USHORT m_subStatusCode;
-    std::string m_statusText;
-    std::string& m_ExceptionInfoContent;
+    std::shared_ptr<const ServerErrorPage> m_page;
 };
@@ -13,9 +13,7 @@
 
 StandardStreamRedirection::StandardStreamRedirection(RedirectionOutput& output, bool commandLineLaunch) :
     m_output(output),
-    m_hErrReadPipe(INVALID_HANDLE_VALUE),
     m_hErrWritePipe(INVALID_HANDLE_VALUE),
-    m_hErrThread(nullptr),
     m_disposed(false),
     m_commandLineLaunch(commandLineLaunch)
 {
@@ -50,12 +48,10 @@ StandardStreamRedirection::~StandardStreamRedirection() noexcept(false)
 }
 
 // Start redirecting stdout and stderr into a pipe
-// Continuously read the pipe on a background thread
-// until Stop is called.
+// Continuously read the pipe with overlapped reads on
+// the thread pool until Stop is called.
 void StandardStreamRedirection::Start()
 {
-    SECURITY_ATTRIBUTES     saAttr = { 0 };
-    HANDLE                  hStdErrReadPipe;
     HANDLE                  hStdErrWritePipe;
 
     // To make Console.* functions work, allocate a console
@@ -69,9 +65,9 @@ void StandardStreamRedirection::Start()
         }
     }
 
-    THROW_LAST_ERROR_IF(!CreatePipe(&hStdErrReadPipe, &hStdErrWritePipe, &saAttr, 0 /*nSize*/));
+    m_pErrReader = std::make_unique<OverlappedPipeReader>(OnStdErrData, this);
+    THROW_IF_FAILED(m_pErrReader->Create(FALSE /*fInheritWritePipe*/, &hStdErrWritePipe));
 
-    m_hErrReadPipe = hStdErrReadPipe;
     m_hErrWritePipe = hStdErrWritePipe;
 
     stdoutWrapper = std::make_unique<StdWrapper>(stdout, STD_OUTPUT_HANDLE, hStdErrWritePipe, !m_commandLineLaunch);
@@ -80,20 +76,11 @@ void StandardStreamRedirection::Start()
     LOG_IF_FAILED(stdoutWrapper->StartRedirection());
     LOG_IF_FAILED(stderrWrapper->StartRedirection());
 
-    // Read the stderr handle on a separate thread until we get 30Kb.
-    m_hErrThread = CreateThread(
-        nullptr,       // default security attributes
-        0,          // default stack size
-        reinterpret_cast<LPTHREAD_START_ROUTINE>(ReadStdErrHandle),
-        this,       // thread function arguments
-        0,          // default creation flags
-        nullptr);      // receive thread identifier
-
-    THROW_LAST_ERROR_IF_NULL(m_hErrThread);
+    THROW_IF_FAILED(m_pErrReader->Start());
 }
 
 // Stop redirecting stdout and stderr into a pipe
-// This closes the background thread reading from the pipe
+// This cancels the outstanding read of the pipe
 // and prints any output that was captured in the pipe.
 // If more than 30Kb was written to the pipe, that output will
 // be thrown away.
@@ -134,78 +121,25 @@ void StandardStreamRedirection::Stop()
         LOG_IF_FAILED(stderrWrapper->StopRedirection());
     }
 
-    // Forces ReadFile to cancel, causing the read loop to complete.
-    // Don't check return value as IO may or may not be completed already.
-    if (m_hErrThread != nullptr)
+    // Cancels the outstanding read, waiting for its completion
+    // at most the termination timeout.
+    if (m_pErrReader != nullptr)
     {
         LOG_INFO(L"Canceling standard stream pipe reader");
-        CancelSynchronousIo(m_hErrThread);
-    }
-
-    // GetExitCodeThread returns 0 on failure; thread status code is invalid.
-    DWORD dwThreadStatus = 0;
-    if (m_hErrThread != nullptr &&
-        !LOG_LAST_ERROR_IF(!GetExitCodeThread(m_hErrThread, &dwThreadStatus)) &&
-        dwThreadStatus == STILL_ACTIVE)
-    {
-        // Wait for graceful shutdown, i.e., the exit of the background thread or timeout
-        if (WaitForSingleObject(m_hErrThread, m_terminationTimeoutMs) != WAIT_OBJECT_0)
-        {
-            // If the thread is still running, we need kill it first before exit to avoid AV
-            if (!LOG_LAST_ERROR_IF(GetExitCodeThread(m_hErrThread, &dwThreadStatus) == 0) &&
-                dwThreadStatus == STILL_ACTIVE)
-            {
-                LOG_WARN(L"Thread reading stdout/err hit timeout, forcibly closing thread.");
-                TerminateThread(m_hErrThread, STATUS_CONTROL_C_EXIT);
-            }
-        }
-    }
-
-    if (m_hErrThread != nullptr)
-    {
-        CloseHandle(m_hErrThread);
-        m_hErrThread = nullptr;
-    }
-
-    if (m_hErrReadPipe != INVALID_HANDLE_VALUE)
-    {
-        CloseHandle(m_hErrReadPipe);
-        m_hErrReadPipe = INVALID_HANDLE_VALUE;
+        m_pErrReader->Stop(m_terminationTimeoutMs);
+        m_pErrReader.reset();
     }
 }
 
 
 void
-StandardStreamRedirection::ReadStdErrHandle(
-    LPVOID pContext
+StandardStreamRedirection::OnStdErrData(
+    PVOID pContext,
+    const char* pData,
+    DWORD cbData
 )
 {
     auto pLoggingProvider = static_cast<StandardStreamRedirection*>(pContext);
     DBG_ASSERT(pLoggingProvider != NULL);
-    pLoggingProvider->ReadStdErrHandleInternal();
-}
-
-void
-StandardStreamRedirection::ReadStdErrHandleInternal()
-{
-    std::string tempBuffer;
-    tempBuffer.resize(PIPE_READ_SIZE);
-
-    // If ReadFile ever returns false, exit the thread
-    DWORD dwNumBytesRead = 0;
-    while (true)
-    {
-        if (ReadFile(m_hErrReadPipe,
-            tempBuffer.data(),
-            PIPE_READ_SIZE,
-            &dwNumBytesRead,
-            nullptr))
-        {
-            m_output.Append(to_wide_string(tempBuffer.substr(0, dwNumBytesRead), GetConsoleOutputCP()));
-        }
-        else
-        {
-            return;
-        }
-    }
+    pLoggingProvider->m_output.AppendBytes(std::string_view(pData, cbData), GetConsoleOutputCP());
 }
@@ -6,19 +6,17 @@
 #include "RedirectionOutput.h"
 #include "StdWrapper.h"
 #include "ModuleHelpers.h"
+#include "OverlappedPipeReader.h"
 
 class StandardStreamRedirection : NonCopyable
 {
-    // Default timeout for the redirection thread to exit before it is forcefully terminated
+    // Default timeout for the outstanding pipe read to complete before its callback is canceled
     // This can be overridden with ASPNETCORE_OUTPUT_REDIRECTION_TERMINATION_TIMEOUT_MS
     static constexpr int PIPE_OUTPUT_THREAD_TIMEOUT_MS_DEFAULT = 2000;
 
     // Maximum allowed timeout value
     static constexpr int PIPE_OUTPUT_THREAD_TIMEOUT_MS_MAX = 1800000; // 30 minutes
 
-    // Size of the buffer used to read from the pipe
-    static constexpr int PIPE_READ_SIZE = 4096;
-
 public:
     StandardStreamRedirection(RedirectionOutput& output, bool commandLineLaunch);
 
@@ -55,13 +53,11 @@ private:
         }
     }
 
-    // Thread functions
-    void ReadStdErrHandleInternal();
-    static void ReadStdErrHandle(LPVOID pContext);
+    // Pipe reader callback, runs on the thread pool
+    static void OnStdErrData(PVOID pContext, const char* pData, DWORD cbData);
 
-    HANDLE                          m_hErrReadPipe;
     HANDLE                          m_hErrWritePipe;
-    HANDLE                          m_hErrThread;
+    std::unique_ptr<OverlappedPipeReader> m_pErrReader;
 
     bool m_disposed;
     bool m_commandLineLaunch;
@@ -0,0 +1,147 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "StartupTimeline.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include "debugutil.h"
+#include "StringHelpers.h"
+#include "TraceProvider.h"
+
+static_assert(std::is_standard_layout<StartupTimeline>::value, "StartupTimeline is passed between modules");
+
+namespace
+{
+    const PCWSTR s_rgPhaseNames[StartupTimeline::PhaseCount] =
+    {
+        L"ModuleLoaded",
+        L"HandlerResolveStarted",
+        L"HandlerHostFxrResolved",
+        L"HandlerAssemblyFound",
+        L"HandlerLoaded",
+        L"ApplicationCreated",
+        L"ExecuteApplicationStarted",
+        L"HostFxrResolved",
+        L"HostFxrLoaded",
+        L"HostFxrInitialized",
+        L"ClrThreadStarted",
+        L"CallbacksRegistered",
+    };
+
+    ULONGLONG
+    ToMicroseconds(LONGLONG llTicks, LONGLONG llFrequency) noexcept
+    {
+        if (llTicks <= 0 || llFrequency <= 0)
+        {
+            return 0;
+        }
+
+        const auto ullTicks = static_cast<ULONGLONG>(llTicks);
+        const auto ullFrequency = static_cast<ULONGLONG>(llFrequency);
+        return ullTicks / ullFrequency * 1000000 + ullTicks % ullFrequency * 1000000 / ullFrequency;
+    }
+}
+
+void
+StartupTimeline::Merge(
+    const StartupTimeline *pOther
+) noexcept
+{
+    if (pOther == nullptr || pOther->m_cbSize < offsetof(StartupTimeline, m_rgllTimestamps))
+    {
+        return;
+    }
+
+    const size_t cOtherPhases = std::min<size_t>(
+        (pOther->m_cbSize - offsetof(StartupTimeline, m_rgllTimestamps)) / sizeof(LONGLONG),
+        PhaseCount);
+
+    for (size_t i = 0; i < cOtherPhases; ++i)
+    {
+        if (pOther->m_rgllTimestamps[i] != 0 && m_rgllTimestamps[i] == 0)
+        {
+            m_rgllTimestamps[i] = pOther->m_rgllTimestamps[i];
+        }
+    }
+}
+
+void
+StartupTimeline::Write(
+    PCWSTR pszApplicationId
+) const
+{
+    LARGE_INTEGER liFrequency;
+    if (!QueryPerformanceFrequency(&liFrequency))
+    {
+        return;
+    }
+
+    LONGLONG llFirst = 0;
+    for (const auto llTimestamp : m_rgllTimestamps)
+    {
+        if (llTimestamp != 0 && (llFirst == 0 || llTimestamp < llFirst))
+        {
+            llFirst = llTimestamp;
+        }
+    }
+
+    if (llFirst == 0)
+    {
+        return;
+    }
+
+    // Since the first phase, 0 for phases that were not reached, e.g. the
+    // shim ones with a shim that does not pass its timeline.
+    ULONGLONG rgullMicroseconds[PhaseCount] = {};
+    for (DWORD i = 0; i < PhaseCount; ++i)
+    {
+        if (m_rgllTimestamps[i] != 0)
+        {
+            rgullMicroseconds[i] = ToMicroseconds(m_rgllTimestamps[i] - llFirst, liFrequency.QuadPart);
+        }
+    }
+
+    TraceLoggingWrite(g_hTraceProvider,
+        "StartupTimeline",
+        TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+        TraceLoggingKeyword(ASPNETCORE_TRACE_KEYWORD_STARTUP),
+        TraceLoggingWideString(pszApplicationId, "ApplicationId"),
+        TraceLoggingUInt64(rgullMicroseconds[ModuleLoaded], "ModuleLoadedMicroseconds"),
+        TraceLoggingUInt64(rgullMicroseconds[HandlerResolveStarted], "HandlerResolveStartedMicroseconds"),
+        TraceLoggingUInt64(rgullMicroseconds[HandlerHostFxrResolved], "HandlerHostFxrResolvedMicroseconds"),
+        TraceLoggingUInt64(rgullMicroseconds[HandlerAssemblyFound], "HandlerAssemblyFoundMicroseconds"),
+        TraceLoggingUInt64(rgullMicroseconds[HandlerLoaded], "HandlerLoadedMicroseconds"),
+        TraceLoggingUInt64(rgullMicroseconds[ApplicationCreated], "ApplicationCreatedMicroseconds"),
+        TraceLoggingUInt64(rgullMicroseconds[ExecuteApplicationStarted], "ExecuteApplicationStartedMicroseconds"),
+        TraceLoggingUInt64(rgullMicroseconds[HostFxrResolved], "HostFxrResolvedMicroseconds"),
+        TraceLoggingUInt64(rgullMicroseconds[HostFxrLoaded], "HostFxrLoadedMicroseconds"),
+        TraceLoggingUInt64(rgullMicroseconds[HostFxrInitialized], "HostFxrInitializedMicroseconds"),
+        TraceLoggingUInt64(rgullMicroseconds[ClrThreadStarted], "ClrThreadStartedMicroseconds"),
+        TraceLoggingUInt64(rgullMicroseconds[CallbacksRegistered], "CallbacksRegisteredMicroseconds"));
+
+    if (!IsLogLevelEnabled(ASPNETCORE_DEBUG_FLAG_INFO))
+    {
+        return;
+    }
+
+    // One key=value pair per phase reached, with the time since the
+    // previous one so the slow phase stands out.
+    std::wstring line;
+    ULONGLONG ullPrevious = 0;
+    for (DWORD i = 0; i < PhaseCount; ++i)
+    {
+        if (m_rgllTimestamps[i] == 0)
+        {
+            continue;
+        }
+
+        const auto ullDelta = rgullMicroseconds[i] > ullPrevious ? rgullMicroseconds[i] - ullPrevious : 0;
+        line.append(format(L" %ls=%llu(+%llu)", s_rgPhaseNames[i], rgullMicroseconds[i], ullDelta));
+        ullPrevious = rgullMicroseconds[i];
+    }
+
+    LOG_INFOF(L"Startup timeline of '%ls' in microseconds:%ls", pszApplicationId, line.c_str());
+}
@@ -0,0 +1,75 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <Windows.h>
+
+//
+// QueryPerformanceCounter timestamps of the phases an application goes
+// through from the module load to its first request. The shim marks the
+// phases up to loading the request handler and hands its timeline to
+// CreateApplication as the "StartupTimeline" parameter, the in-process
+// handler marks the rest and writes the whole timeline once the managed
+// server registered its callbacks.
+//
+// Passed between modules of possibly different versions, so phases are
+// only ever appended and the layout stays standard with the size first.
+//
+class StartupTimeline
+{
+public:
+    enum Phase : DWORD
+    {
+        // Shim
+        ModuleLoaded = 0,
+        HandlerResolveStarted,
+        HandlerHostFxrResolved,
+        HandlerAssemblyFound,
+        HandlerLoaded,
+        // In-process handler
+        ApplicationCreated,
+        ExecuteApplicationStarted,
+        HostFxrResolved,
+        HostFxrLoaded,
+        HostFxrInitialized,
+        ClrThreadStarted,
+        CallbacksRegistered,
+        PhaseCount
+    };
+
+    StartupTimeline() noexcept
+        : m_cbSize(sizeof(StartupTimeline)),
+          m_rgllTimestamps()
+    {
+    }
+
+    void
+    Mark(
+        Phase phase
+    ) noexcept
+    {
+        LARGE_INTEGER liCounter;
+        QueryPerformanceCounter(&liCounter);
+        m_rgllTimestamps[phase] = liCounter.QuadPart;
+    }
+
+    // Takes the phases marked in pOther, which may come from another
+    // module build; phases it does not know of are left alone.
+    void
+    Merge(
+        const StartupTimeline *pOther
+    ) noexcept;
+
+    // Writes a StartupTimeline event to the module's TraceLogging provider
+    // and one line to the debug log, with the time of every phase marked
+    // since the first one.
+    void
+    Write(
+        PCWSTR pszApplicationId
+    ) const;
+
+private:
+    DWORD       m_cbSize;
+    LONGLONG    m_rgllTimestamps[PhaseCount];
+};
@@ -20,25 +20,39 @@ bool equals_ignore_case(const std::wstring& s1, const std::wstring& s2)
     return compare_ignore_case(s1, s2) == 0;
 }
 
+bool starts_with_path(const std::wstring& path, const std::wstring& prefix)
+{
+    if (!path._Starts_with(prefix))
+    {
+        return false;
+    }
+
+    // We need to check that the character of the path following the prefix
+    // is either a null terminator or a slash.
+    const auto nextChar = path[prefix.length()];
+    return nextChar == L'\0' || nextChar == L'/' || prefix.empty() || prefix.back() == L'/';
+}
+
 int compare_ignore_case(const std::wstring& s1, const std::wstring& s2)
 {
     return CompareStringOrdinal(s1.c_str(), static_cast<int>(s1.length()), s2.c_str(), static_cast<int>(s2.length()), true) - CSTR_EQUAL;
 }
 
-std::wstring to_wide_string(const std::string &source, const unsigned int codePage)
+std::wstring to_wide_string(const std::string& source, const int length, const unsigned int codePage)
 {
-    return to_wide_string(source, static_cast<int>(source.length()), codePage);
+    return to_wide_string(std::string_view(source.data(), static_cast<size_t>(length)), codePage);
 }
 
-std::wstring to_wide_string(const std::string& source, const int length, const unsigned int codePage)
+std::wstring to_wide_string(std::string_view source, const unsigned int codePage)
 {
     // MultiByteToWideChar returns 0 on failure, which is also the same return value
     // for empty strings. Preemptive return.
-    if (length == 0)
+    if (source.empty())
     {
         return L"";
     }
 
+    const int length = static_cast<int>(source.size());
     std::wstring destination;
 
     int nChars = MultiByteToWideChar(codePage, 0, source.data(), length, NULL, 0);
@@ -52,13 +66,18 @@ std::wstring to_wide_string(const std::string& source, const int length, const u
     return destination;
 }
 
-std::string to_multi_byte_string(const std::wstring& text, const unsigned int codePage)
+std::string to_multi_byte_string(std::wstring_view text, const unsigned int codePage)
 {
-    auto const encodedByteCount = WideCharToMultiByte(codePage, 0, text.data(), -1, nullptr, 0, nullptr, nullptr);
+    if (text.empty())
+    {
+        return std::string();
+    }
+
+    auto const length = static_cast<int>(text.length());
+    auto const encodedByteCount = WideCharToMultiByte(codePage, 0, text.data(), length, nullptr, 0, nullptr, nullptr);
 
     std::string encodedBytes;
     encodedBytes.resize(encodedByteCount);
-    WideCharToMultiByte(codePage, 0, text.data(), -1, encodedBytes.data(), encodedByteCount, nullptr, nullptr);
-    encodedBytes.resize(encodedByteCount - 1);
+    WideCharToMultiByte(codePage, 0, text.data(), length, encodedBytes.data(), encodedByteCount, nullptr, nullptr);
     return encodedBytes;
 }
@@ -4,6 +4,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 
 [[nodiscard]]
 bool endsWith(const std::wstring &source, const std::wstring &suffix, bool ignoreCase = false);
@@ -11,17 +12,23 @@ bool endsWith(const std::wstring &source, const std::wstring &suffix, bool ignor
 [[nodiscard]]
 bool equals_ignore_case(const std::wstring& s1, const std::wstring& s2);
 
+// Whether path is prefix or one of its descendants, prefix being a '/'
+// separated path such as a configuration path. MACHINE/WEBROOT/site is
+// not a prefix of MACHINE/WEBROOT/siteTest. Case sensitive.
+[[nodiscard]]
+bool starts_with_path(const std::wstring& path, const std::wstring& prefix);
+
 [[nodiscard]]
 int compare_ignore_case(const std::wstring& s1, const std::wstring& s2);
 
 [[nodiscard]]
-std::wstring to_wide_string(const std::string& source, const unsigned int codePage);
+std::wstring to_wide_string(std::string_view source, const unsigned int codePage);
 
 [[nodiscard]]
 std::wstring to_wide_string(const std::string &source, const int length, const unsigned int codePage);
 
 [[nodiscard]]
-std::string to_multi_byte_string(const std::wstring& text, const unsigned int codePage);
+std::string to_multi_byte_string(std::wstring_view text, const unsigned int codePage);
 
 template<typename ... Args>
 [[nodiscard]]
@@ -0,0 +1,330 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "TimerWheel.h"
+#include "SRWExclusiveLock.h"
+#include "exceptions.h"
+
+TimerWheel::Timer::Timer(
+    Callback        pfnCallback,
+    PVOID           pContext,
+    TimerWheel&     wheel
+) noexcept
+    : m_wheel(wheel),
+      m_pfnCallback(pfnCallback),
+      m_pContext(pContext),
+      m_ullDueTick(0),
+      m_dwPeriodMs(0),
+      m_state(State::Idle)
+{
+    InitializeListHead(&m_listEntry);
+}
+
+TimerWheel::Timer::~Timer()
+{
+    Cancel();
+}
+
+HRESULT
+TimerWheel::Timer::Set(
+    DWORD   dwDueTimeMs,
+    DWORD   dwPeriodMs
+) noexcept
+{
+    SRWExclusiveLock lock(m_wheel.m_srwLock);
+
+    RETURN_IF_FAILED(m_wheel.m_hrTimer);
+
+    if (m_state == State::Scheduled)
+    {
+        m_wheel.RemoveNoLock(*this);
+    }
+
+    // A wheel without timers did not advance meanwhile.
+    const ULONGLONG ullNowTick = m_wheel.QueryNowTick();
+    if (m_wheel.m_cTimers == 0)
+    {
+        m_wheel.m_ullCurrentTick = ullNowTick;
+    }
+
+    m_ullDueTick = ullNowTick + ToTicks(dwDueTimeMs);
+    m_dwPeriodMs = dwPeriodMs;
+    m_wheel.InsertNoLock(*this);
+
+    if (!m_wheel.m_fArmed)
+    {
+        // Negative due times are relative, in 100ns units.
+        ULARGE_INTEGER ulDueTime;
+        ulDueTime.QuadPart = static_cast<ULONGLONG>(-static_cast<LONGLONG>(TICK_MS) * 10000);
+
+        FILETIME ftDueTime;
+        ftDueTime.dwHighDateTime = ulDueTime.HighPart;
+        ftDueTime.dwLowDateTime = ulDueTime.LowPart;
+
+        SetThreadpoolTimer(m_wheel.m_pTimer, &ftDueTime, TICK_MS, TICK_MS);
+        m_wheel.m_fArmed = true;
+    }
+
+    return S_OK;
+}
+
+VOID
+TimerWheel::Timer::Cancel() noexcept
+{
+    SRWExclusiveLock lock(m_wheel.m_srwLock);
+
+    for (;;)
+    {
+        if (m_state == State::Scheduled)
+        {
+            m_wheel.RemoveNoLock(*this);
+        }
+
+        if (m_wheel.m_pFiring != this)
+        {
+            return;
+        }
+
+        if (m_wheel.m_dwFiringThreadId == GetCurrentThreadId())
+        {
+            // The callback is done with the timer once it returns.
+            m_wheel.m_pFiring = nullptr;
+            m_state = State::Idle;
+            return;
+        }
+
+        // A periodic timer set again by the callback is removed above.
+        SleepConditionVariableSRW(&m_wheel.m_firingDone, &m_wheel.m_srwLock, INFINITE, 0);
+    }
+}
+
+TimerWheel::TimerWheel() noexcept
+    : m_pTimer(nullptr),
+      m_hrTimer(S_OK),
+      m_fArmed(false),
+      m_fProcessing(false),
+      m_ullStartTick(GetTickCount64()),
+      m_ullCurrentTick(0),
+      m_cTimers(0),
+      m_pFiring(nullptr),
+      m_dwFiringThreadId(0)
+{
+    InitializeSRWLock(&m_srwLock);
+    InitializeConditionVariable(&m_firingDone);
+    InitializeListHead(&m_expired);
+
+    for (auto& level : m_rgSlots)
+    {
+        for (auto& slot : level)
+        {
+            InitializeListHead(&slot);
+        }
+    }
+
+    m_pTimer = CreateThreadpoolTimer(TimerCallback, this, nullptr);
+    if (m_pTimer == nullptr)
+    {
+        m_hrTimer = LOG_IF_FAILED(HRESULT_FROM_WIN32(GetLastError()));
+    }
+}
+
+TimerWheel::~TimerWheel()
+{
+    if (m_pTimer != nullptr)
+    {
+        SetThreadpoolTimer(m_pTimer, nullptr, 0, 0);
+        WaitForThreadpoolTimerCallbacks(m_pTimer, TRUE);
+        CloseThreadpoolTimer(m_pTimer);
+        m_pTimer = nullptr;
+    }
+}
+
+// static
+TimerWheel&
+TimerWheel::GetInstance() noexcept
+{
+    static TimerWheel s_wheel;
+    return s_wheel;
+}
+
+// static
+VOID
+CALLBACK
+TimerWheel::TimerCallback(
+    _Inout_ PTP_CALLBACK_INSTANCE   Instance,
+    _Inout_opt_ PVOID               pContext,
+    _Inout_ PTP_TIMER               pTimer
+)
+{
+    UNREFERENCED_PARAMETER(Instance);
+    UNREFERENCED_PARAMETER(pTimer);
+
+    static_cast<TimerWheel*>(pContext)->ProcessTimers();
+}
+
+VOID
+TimerWheel::InsertNoLock(
+    Timer&      timer
+) noexcept
+{
+    ULONGLONG ullDueTick = timer.m_ullDueTick;
+    if (ullDueTick - m_ullCurrentTick >= MAX_TICKS)
+    {
+        ullDueTick = m_ullCurrentTick + MAX_TICKS - 1;
+    }
+
+    // The first wheel whose revolution covers the due time, counted from
+    // the current tick. Its slot comes around before the timer is due.
+    const ULONGLONG ullDelta = ullDueTick - m_ullCurrentTick;
+    DWORD dwLevel = 0;
+    while (dwLevel < LEVELS - 1 && ullDelta >= (1ULL << (SLOT_BITS * (dwLevel + 1))))
+    {
+        dwLevel++;
+    }
+
+    const DWORD dwSlot = static_cast<DWORD>(ullDueTick >> (SLOT_BITS * dwLevel)) & (SLOTS - 1);
+    InsertTailList(&m_rgSlots[dwLevel][dwSlot], &timer.m_listEntry);
+
+    timer.m_state = Timer::State::Scheduled;
+    m_cTimers++;
+}
+
+VOID
+TimerWheel::RemoveNoLock(
+    Timer&      timer
+) noexcept
+{
+    RemoveEntryList(&timer.m_listEntry);
+    InitializeListHead(&timer.m_listEntry);
+
+    timer.m_state = Timer::State::Idle;
+    m_cTimers--;
+}
+
+VOID
+TimerWheel::CascadeNoLock(
+    DWORD       dwLevel
+) noexcept
+{
+    LIST_ENTRY& slot = m_rgSlots[dwLevel][static_cast<DWORD>(m_ullCurrentTick >> (SLOT_BITS * dwLevel)) & (SLOTS - 1)];
+
+    while (!IsListEmpty(&slot))
+    {
+        Timer* pTimer = CONTAINING_RECORD(RemoveHeadList(&slot), Timer, m_listEntry);
+        m_cTimers--;
+        InsertNoLock(*pTimer);
+    }
+}
+
+VOID
+TimerWheel::AdvanceNoLock(
+    ULONGLONG   ullNowTick
+) noexcept
+{
+    if (m_cTimers == 0)
+    {
+        m_ullCurrentTick = ullNowTick;
+        return;
+    }
+
+    while (m_ullCurrentTick < ullNowTick)
+    {
+        m_ullCurrentTick++;
+
+        // The slots of the next wheels come around each time the
+        // previous wheel completes a revolution.
+        for (DWORD dwLevel = 1; dwLevel < LEVELS; dwLevel++)
+        {
+            if ((m_ullCurrentTick & ((1ULL << (SLOT_BITS * dwLevel)) - 1)) != 0)
+            {
+                break;
+            }
+            CascadeNoLock(dwLevel);
+        }
+
+        // What is left in the slot of the first wheel is due.
+        LIST_ENTRY& slot = m_rgSlots[0][static_cast<DWORD>(m_ullCurrentTick) & (SLOTS - 1)];
+        if (!IsListEmpty(&slot))
+        {
+            PLIST_ENTRY pFirst = slot.Flink;
+            RemoveEntryList(&slot);
+            AppendTailList(&m_expired, pFirst);
+            InitializeListHead(&slot);
+        }
+    }
+}
+
+VOID
+TimerWheel::ProcessTimers() noexcept
+{
+    SRWExclusiveLock lock(m_srwLock);
+
+    if (m_fProcessing)
+    {
+        return;
+    }
+
+    m_fProcessing = true;
+    AdvanceNoLock(QueryNowTick());
+
+    while (!IsListEmpty(&m_expired))
+    {
+        Timer* pTimer = CONTAINING_RECORD(RemoveHeadList(&m_expired), Timer, m_listEntry);
+        InitializeListHead(&pTimer->m_listEntry);
+        pTimer->m_state = Timer::State::Firing;
+        m_cTimers--;
+
+        m_pFiring = pTimer;
+        m_dwFiringThreadId = GetCurrentThreadId();
+
+        const auto pfnCallback = pTimer->m_pfnCallback;
+        const auto pCallbackContext = pTimer->m_pContext;
+
+        // Not held by the callback, which may set or cancel timers.
+        ReleaseSRWLockExclusive(&m_srwLock);
+        pfnCallback(pCallbackContext);
+        AcquireSRWLockExclusive(&m_srwLock);
+
+        // Left alone when the callback cancelled it, it may be gone.
+        if (m_pFiring == pTimer)
+        {
+            m_pFiring = nullptr;
+            if (pTimer->m_state == Timer::State::Firing)
+            {
+                pTimer->m_state = Timer::State::Idle;
+                if (pTimer->m_dwPeriodMs != 0)
+                {
+                    pTimer->m_ullDueTick = QueryNowTick() + ToTicks(pTimer->m_dwPeriodMs);
+                    InsertNoLock(*pTimer);
+                }
+            }
+        }
+
+        WakeAllConditionVariable(&m_firingDone);
+    }
+
+    if (m_cTimers == 0 && m_fArmed)
+    {
+        SetThreadpoolTimer(m_pTimer, nullptr, 0, 0);
+        m_fArmed = false;
+    }
+
+    m_fProcessing = false;
+}
+
+ULONGLONG
+TimerWheel::QueryNowTick() const noexcept
+{
+    return (GetTickCount64() - m_ullStartTick) / TICK_MS;
+}
+
+// static
+ULONGLONG
+TimerWheel::ToTicks(
+    DWORD       dwMilliseconds
+) noexcept
+{
+    // Never due on the current tick, which was processed already.
+    const ULONGLONG ullTicks = (static_cast<ULONGLONG>(dwMilliseconds) + TICK_MS - 1) / TICK_MS;
+    return ullTicks != 0 ? ullTicks : 1;
+}
@@ -0,0 +1,151 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <Windows.h>
+#include "NonCopyable.h"
+#include "listentry.h"
+
+//
+// Timeouts of the module driven by a single thread pool timer, so that
+// the cost of a timer does not grow with how many are outstanding.
+//
+// Timers are linked into the slots of four wheels of SLOTS slots, the
+// first one TICK_MS per slot and each of the others a revolution of the
+// previous one per slot, 74 hours in all. Setting or cancelling a timer
+// is a list insert or removal. A timer further away goes into the last
+// slot of the last wheel and is placed again when that slot comes around.
+// The thread pool timer only runs while timers are set.
+//
+// Callbacks run one after the other on the thread pool, they have to be
+// short and queue anything long, like the shadow copy of FILE_WATCHER
+// which keeps its own STTIMER for that reason.
+//
+class TimerWheel : NonCopyable
+{
+public:
+    using Callback = VOID (CALLBACK *)(PVOID pContext);
+
+    class Timer : NonCopyable
+    {
+    public:
+        Timer(
+            Callback        pfnCallback,
+            PVOID           pContext,
+            TimerWheel&     wheel = TimerWheel::GetInstance()) noexcept;
+
+        ~Timer();
+
+        //
+        // Runs the callback dwDueTimeMs from now, then every dwPeriodMs if
+        // it is not 0. Replaces the due time of a timer already set, the
+        // callback may set its own timer again.
+        //
+        HRESULT
+        Set(
+            DWORD   dwDueTimeMs,
+            DWORD   dwPeriodMs = 0) noexcept;
+
+        //
+        // Once it returns the callback does not run anymore and is not
+        // running, unless Cancel is called by the callback itself. The
+        // callback must not destroy its own timer without cancelling it.
+        //
+        VOID
+        Cancel() noexcept;
+
+    private:
+        friend class TimerWheel;
+
+        enum class State
+        {
+            Idle,
+            Scheduled,
+            Firing,
+        };
+
+        TimerWheel&     m_wheel;
+        Callback        m_pfnCallback;
+        PVOID           m_pContext;
+        // Links the timer into its slot, or into the expired timers.
+        LIST_ENTRY      m_listEntry;
+        ULONGLONG       m_ullDueTick;
+        DWORD           m_dwPeriodMs;
+        State           m_state;
+    };
+
+    TimerWheel() noexcept;
+
+    // Timers must be cancelled before their wheel goes away.
+    ~TimerWheel();
+
+    // The wheel of the module, created on first use.
+    static
+    TimerWheel&
+    GetInstance() noexcept;
+
+    static constexpr DWORD  TICK_MS = 16;
+
+private:
+    static
+    VOID
+    CALLBACK
+    TimerCallback(
+        _Inout_ PTP_CALLBACK_INSTANCE   Instance,
+        _Inout_opt_ PVOID               pContext,
+        _Inout_ PTP_TIMER               pTimer);
+
+    // Called with m_srwLock held, like the ones below.
+    VOID
+    InsertNoLock(
+        Timer&      timer) noexcept;
+
+    VOID
+    RemoveNoLock(
+        Timer&      timer) noexcept;
+
+    // Moves the timers of a slot to the wheel of their due time.
+    VOID
+    CascadeNoLock(
+        DWORD       dwLevel) noexcept;
+
+    VOID
+    AdvanceNoLock(
+        ULONGLONG   ullNowTick) noexcept;
+
+    VOID
+    ProcessTimers() noexcept;
+
+    ULONGLONG
+    QueryNowTick() const noexcept;
+
+    static
+    ULONGLONG
+    ToTicks(
+        DWORD       dwMilliseconds) noexcept;
+
+    static constexpr DWORD      SLOT_BITS = 6;
+    static constexpr DWORD      SLOTS = 1 << SLOT_BITS;
+    static constexpr DWORD      LEVELS = 4;
+    static constexpr ULONGLONG  MAX_TICKS = 1ULL << (SLOT_BITS * LEVELS);
+
+    SRWLOCK             m_srwLock {};
+    // Signaled each time a callback returns, for Cancel to wait on.
+    CONDITION_VARIABLE  m_firingDone {};
+    PTP_TIMER           m_pTimer;
+    HRESULT             m_hrTimer;
+    bool                m_fArmed;
+    // Set while a callback of the thread pool timer processes the wheel,
+    // a late one that runs meanwhile returns right away.
+    bool                m_fProcessing;
+    ULONGLONG           m_ullStartTick;
+    // Last tick processed, timers are due after it.
+    ULONGLONG           m_ullCurrentTick;
+    // Timers in the slots or expired, the thread pool timer stops at 0.
+    DWORD               m_cTimers;
+    Timer *             m_pFiring;
+    DWORD               m_dwFiringThreadId;
+    LIST_ENTRY          m_expired;
+    LIST_ENTRY          m_rgSlots[LEVELS][SLOTS];
+};
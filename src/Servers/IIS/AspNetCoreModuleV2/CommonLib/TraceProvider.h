@@ -0,0 +1,40 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <Windows.h>
+#include <TraceLoggingProvider.h>
+
+//
+// "Microsoft-AspNetCore-Module", defined in debugutil.cpp and registered
+// by DebugInitialize in every module.
+//
+TRACELOGGING_DECLARE_PROVIDER(g_hTraceProvider);
+
+// Debug log lines have no keyword, sessions get them with any keyword mask.
+#define ASPNETCORE_TRACE_KEYWORD_COUNTERS   0x0000000000000001ULL
+// Backend process lifecycle of out-of-process applications.
+#define ASPNETCORE_TRACE_KEYWORD_PROCESS    0x0000000000000002ULL
+// Startup timeline of in-process applications.
+#define ASPNETCORE_TRACE_KEYWORD_STARTUP    0x0000000000000004ULL
+// Sampled requests of out-of-process applications.
+#define ASPNETCORE_TRACE_KEYWORD_REQUESTS   0x0000000000000008ULL
+// Contention of the request path locks.
+#define ASPNETCORE_TRACE_KEYWORD_LOCKS      0x0000000000000010ULL
+// Reference trace logs of the out-of-process handler.
+#define ASPNETCORE_TRACE_KEYWORD_REFTRACE   0x0000000000000020ULL
+// Request path allocations, in modules built with AncmAllocationTracking.
+#define ASPNETCORE_TRACE_KEYWORD_ALLOCATIONS 0x0000000000000040ULL
+
+typedef VOID (*PFN_TRACE_CAPTURE_STATE)(VOID);
+
+//
+// Sets the function called when a session asks the provider of this module
+// for a rundown (EVENT_CONTROL_CODE_CAPTURE_STATE), nullptr for none. It
+// runs on the thread that delivers the enable callback.
+//
+VOID
+SetTraceCaptureStateCallback(
+    PFN_TRACE_CAPTURE_STATE pfnCaptureState
+    );
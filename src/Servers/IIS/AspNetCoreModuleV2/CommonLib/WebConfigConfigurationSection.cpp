@@ -8,6 +8,12 @@
 
 std::optional<std::wstring> WebConfigConfigurationSection::GetString(const std::wstring& name) const
 {
+    const CComVariant* pValue = FindProperty(name);
+    if (pValue != nullptr && pValue->vt == VT_BSTR)
+    {
+        return std::make_optional(std::wstring(pValue->bstrVal, SysStringLen(pValue->bstrVal)));
+    }
+
     CComBSTR result;
     if (FAILED_LOG(GetElementStringProperty(m_element, name.c_str(), &result.m_str)))
     {
@@ -19,6 +25,17 @@ std::optional<std::wstring> WebConfigConfigurationSection::GetString(const std::
 
 std::optional<bool> WebConfigConfigurationSection::GetBool(const std::wstring& name) const
 {
+    if (const CComVariant* pValue = FindProperty(name))
+    {
+        CComVariant value;
+        if (FAILED_LOG(value.ChangeType(VT_BOOL, pValue)))
+        {
+            return std::nullopt;
+        }
+
+        return std::make_optional(value.boolVal == VARIANT_TRUE);
+    }
+
     bool result;
     if (FAILED_LOG(GetElementBoolProperty(m_element, name.c_str(), &result)))
     {
@@ -30,6 +47,17 @@ std::optional<bool> WebConfigConfigurationSection::GetBool(const std::wstring& n
 
 std::optional<DWORD> WebConfigConfigurationSection::GetLong(const std::wstring& name) const
 {
+    if (const CComVariant* pValue = FindProperty(name))
+    {
+        CComVariant value;
+        if (FAILED_LOG(value.ChangeType(VT_UI4, pValue)))
+        {
+            return std::nullopt;
+        }
+
+        return std::make_optional(static_cast<DWORD>(value.ulVal));
+    }
+
     DWORD result;
     if (FAILED_LOG(GetElementDWORDProperty(m_element, name.c_str(), &result)))
     {
@@ -42,7 +70,17 @@ std::optional<DWORD> WebConfigConfigurationSection::GetLong(const std::wstring&
 std::optional<DWORD> WebConfigConfigurationSection::GetTimespan(const std::wstring& name) const
 {
     ULONGLONG result;
-    if (FAILED_LOG(GetElementRawTimeSpanProperty(m_element, name.c_str(), &result)))
+    if (const CComVariant* pValue = FindProperty(name))
+    {
+        CComVariant value;
+        if (FAILED_LOG(value.ChangeType(VT_UI8, pValue)))
+        {
+            return std::nullopt;
+        }
+
+        result = value.ullVal;
+    }
+    else if (FAILED_LOG(GetElementRawTimeSpanProperty(m_element, name.c_str(), &result)))
     {
         return std::nullopt;
     }
@@ -85,3 +123,49 @@ std::vector<std::shared_ptr<ConfigurationSection>> WebConfigConfigurationSection
 
     return elements;
 }
+
+const CComVariant* WebConfigConfigurationSection::FindProperty(const std::wstring& name) const
+{
+    if (!m_fPropertiesLoaded)
+    {
+        m_fPropertiesLoaded = true;
+        LOG_IF_FAILED(LoadProperties());
+    }
+
+    const auto property = m_properties.find(name);
+    return property != m_properties.end() ? &property->second : nullptr;
+}
+
+HRESULT WebConfigConfigurationSection::LoadProperties() const
+{
+    try
+    {
+        HRESULT findPropertyResult;
+        CComPtr<IAppHostPropertyCollection> propertyCollection = nullptr;
+        CComPtr<IAppHostProperty>           property = nullptr;
+        ENUM_INDEX                          index{};
+
+        RETURN_IF_FAILED(m_element->get_Properties(&propertyCollection));
+        RETURN_IF_FAILED(findPropertyResult = FindFirstProperty(propertyCollection, &index, &property));
+
+        while (findPropertyResult != S_FALSE)
+        {
+            CComBSTR    propertyName;
+            CComVariant value;
+
+            // A property that can't be read here is read from the element later.
+            if (SUCCEEDED_LOG(property->get_Name(&propertyName)) &&
+                SUCCEEDED_LOG(property->get_Value(&value)))
+            {
+                m_properties.emplace(std::wstring(propertyName), std::move(value));
+            }
+
+            property.Release();
+
+            RETURN_IF_FAILED(findPropertyResult = FindNextProperty(propertyCollection, &index, &property));
+        }
+    }
+    CATCH_RETURN();
+
+    return S_OK;
+}
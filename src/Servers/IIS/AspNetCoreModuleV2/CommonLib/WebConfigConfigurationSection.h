@@ -5,13 +5,23 @@
 
 #include <atlcomcli.h>
 #include <optional>
+#include <map>
 #include "ConfigurationSection.h"
 
+//
+// Reads all the properties of the element at the first read, one COM call
+// each instead of a name lookup and a value per read. Properties missing
+// from the map, and strings that the element holds as another type like
+// the names of enums, are still read from the element one by one.
+//
+// Like the options read from it, a section is used by one thread.
+//
 class WebConfigConfigurationSection: public ConfigurationSection
 {
 public:
     WebConfigConfigurationSection(IAppHostElement* pElement)
-        : m_element(pElement)
+        : m_element(pElement),
+          m_fPropertiesLoaded(false)
     {
     }
 
@@ -23,5 +33,11 @@ public:
     std::vector<std::shared_ptr<ConfigurationSection>> GetCollection() const override;
 
 private:
+    // Null when the property has to be read from the element.
+    const CComVariant* FindProperty(const std::wstring& name) const;
+    HRESULT LoadProperties() const;
+
     CComPtr<IAppHostElement> m_element;
+    mutable bool m_fPropertiesLoaded;
+    mutable std::map<std::wstring, CComVariant, ignore_case_comparer> m_properties;
 };
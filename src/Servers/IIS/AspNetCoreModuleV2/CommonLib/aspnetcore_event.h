@@ -1073,5 +1073,317 @@ public:
                                  3 ); //Verbosity
         };
     };
+    //
+    // Event: mof class name ANCMForwardTimings,
+    // Description: Forwarded request latency breakdown
+    // EventTypeName: ANCM_REQUEST_FORWARD_TIMINGS
+    // EventType: 16
+    // EventLevel: 4
+    //
+    
+    class ANCM_REQUEST_FORWARD_TIMINGS
+    {
+    public:
+        static
+        HRESULT
+        RaiseEvent(
+            IHttpTraceContext * pHttpTraceContext,
+            LPCGUID    pContextId,
+            ULONG      SendCompleteMicroseconds,
+            ULONG      HeadersAvailableMicroseconds,
+            ULONG      FirstByteMicroseconds,
+            ULONG      LastByteMicroseconds
+        )
+        //
+        // Raise ANCM_REQUEST_FORWARD_TIMINGS Event
+        //
+        {
+            HTTP_TRACE_EVENT Event;
+            Event.pProviderGuid = WWWServerTraceProvider::GetProviderGuid();
+            Event.dwArea =  WWWServerTraceProvider::ANCM;
+            Event.pAreaGuid = ANCMEvents::GetAreaGuid();
+            Event.dwEvent = 16;
+            Event.pszEventName = L"ANCM_REQUEST_FORWARD_TIMINGS";
+            Event.dwEventVersion = 1;
+            Event.dwVerbosity = 4;
+            Event.cEventItems = 5;
+            Event.pActivityGuid = NULL;
+            Event.pRelatedActivityGuid = NULL;
+            Event.dwTimeStamp = 0;
+            Event.dwFlags = HTTP_TRACE_EVENT_FLAG_STATIC_DESCRIPTIVE_FIELDS;
+    
+            // pActivityGuid, pRelatedActivityGuid, Timestamp to be filled in by IIS
+    
+            HTTP_TRACE_EVENT_ITEM Items[ 5 ];
+            Items[ 0 ].pszName = L"ContextId";
+            Items[ 0 ].dwDataType = HTTP_TRACE_TYPE_LPCGUID; // mof type (object)
+            Items[ 0 ].pbData = (PBYTE) pContextId;
+            Items[ 0 ].cbData = 16;
+            Items[ 0 ].pszDataDescription = NULL;
+            Items[ 1 ].pszName = L"SendCompleteMicroseconds";
+            Items[ 1 ].dwDataType = HTTP_TRACE_TYPE_ULONG; // mof type (uint32)
+            Items[ 1 ].pbData = (PBYTE) &SendCompleteMicroseconds;
+            Items[ 1 ].cbData = 4;
+            Items[ 1 ].pszDataDescription = NULL;
+            Items[ 2 ].pszName = L"HeadersAvailableMicroseconds";
+            Items[ 2 ].dwDataType = HTTP_TRACE_TYPE_ULONG; // mof type (uint32)
+            Items[ 2 ].pbData = (PBYTE) &HeadersAvailableMicroseconds;
+            Items[ 2 ].cbData = 4;
+            Items[ 2 ].pszDataDescription = NULL;
+            Items[ 3 ].pszName = L"FirstByteMicroseconds";
+            Items[ 3 ].dwDataType = HTTP_TRACE_TYPE_ULONG; // mof type (uint32)
+            Items[ 3 ].pbData = (PBYTE) &FirstByteMicroseconds;
+            Items[ 3 ].cbData = 4;
+            Items[ 3 ].pszDataDescription = NULL;
+            Items[ 4 ].pszName = L"LastByteMicroseconds";
+            Items[ 4 ].dwDataType = HTTP_TRACE_TYPE_ULONG; // mof type (uint32)
+            Items[ 4 ].pbData = (PBYTE) &LastByteMicroseconds;
+            Items[ 4 ].cbData = 4;
+            Items[ 4 ].pszDataDescription = NULL;
+            Event.pEventItems = Items;
+            pHttpTraceContext->RaiseTraceEvent( &Event );
+            return S_OK;
+        };
+    
+        static
+        BOOL
+        IsEnabled( 
+            IHttpTraceContext *  pHttpTraceContext )
+        // Check if tracing for this event is enabled
+        {
+            return WWWServerTraceProvider::CheckTracingEnabled( 
+                                 pHttpTraceContext,
+                                 WWWServerTraceProvider::ANCM,
+                                 4 ); //Verbosity
+        };
+    };
+    //
+    // Event: mof class name ANCMWebSocketConnectionEnd,
+    // Description: Proxied WebSocket connection closed
+    // EventTypeName: ANCM_WEBSOCKET_CONNECTION_END
+    // EventType: 17
+    // EventLevel: 4
+    //
+    
+    class ANCM_WEBSOCKET_CONNECTION_END
+    {
+    public:
+        static
+        HRESULT
+        RaiseEvent(
+            IHttpTraceContext * pHttpTraceContext,
+            LPCGUID    pContextId,
+            ULONG      DurationMilliseconds,
+            ULONGLONG  MessagesToBackend,
+            ULONGLONG  BytesToBackend,
+            ULONGLONG  MessagesToClient,
+            ULONGLONG  BytesToClient,
+            ULONG      RelayToBackendMicroseconds,
+            ULONG      RelayToClientMicroseconds,
+            ULONG      ActiveConnections,
+            ULONGLONG  TotalConnections,
+            ULONGLONG  TotalMessagesToBackend,
+            ULONGLONG  TotalBytesToBackend,
+            ULONGLONG  TotalMessagesToClient,
+            ULONGLONG  TotalBytesToClient
+        )
+        //
+        // Raise ANCM_WEBSOCKET_CONNECTION_END Event
+        //
+        {
+            HTTP_TRACE_EVENT Event;
+            Event.pProviderGuid = WWWServerTraceProvider::GetProviderGuid();
+            Event.dwArea =  WWWServerTraceProvider::ANCM;
+            Event.pAreaGuid = ANCMEvents::GetAreaGuid();
+            Event.dwEvent = 17;
+            Event.pszEventName = L"ANCM_WEBSOCKET_CONNECTION_END";
+            Event.dwEventVersion = 1;
+            Event.dwVerbosity = 4;
+            Event.cEventItems = 14;
+            Event.pActivityGuid = NULL;
+            Event.pRelatedActivityGuid = NULL;
+            Event.dwTimeStamp = 0;
+            Event.dwFlags = HTTP_TRACE_EVENT_FLAG_STATIC_DESCRIPTIVE_FIELDS;
+    
+            // pActivityGuid, pRelatedActivityGuid, Timestamp to be filled in by IIS
+    
+            HTTP_TRACE_EVENT_ITEM Items[ 14 ];
+            Items[ 0 ].pszName = L"ContextId";
+            Items[ 0 ].dwDataType = HTTP_TRACE_TYPE_LPCGUID; // mof type (object)
+            Items[ 0 ].pbData = (PBYTE) pContextId;
+            Items[ 0 ].cbData = 16;
+            Items[ 0 ].pszDataDescription = NULL;
+            Items[ 1 ].pszName = L"DurationMilliseconds";
+            Items[ 1 ].dwDataType = HTTP_TRACE_TYPE_ULONG; // mof type (uint32)
+            Items[ 1 ].pbData = (PBYTE) &DurationMilliseconds;
+            Items[ 1 ].cbData = 4;
+            Items[ 1 ].pszDataDescription = NULL;
+            Items[ 2 ].pszName = L"MessagesToBackend";
+            Items[ 2 ].dwDataType = HTTP_TRACE_TYPE_ULONGLONG; // mof type (uint64)
+            Items[ 2 ].pbData = (PBYTE) &MessagesToBackend;
+            Items[ 2 ].cbData = 8;
+            Items[ 2 ].pszDataDescription = NULL;
+            Items[ 3 ].pszName = L"BytesToBackend";
+            Items[ 3 ].dwDataType = HTTP_TRACE_TYPE_ULONGLONG; // mof type (uint64)
+            Items[ 3 ].pbData = (PBYTE) &BytesToBackend;
+            Items[ 3 ].cbData = 8;
+            Items[ 3 ].pszDataDescription = NULL;
+            Items[ 4 ].pszName = L"MessagesToClient";
+            Items[ 4 ].dwDataType = HTTP_TRACE_TYPE_ULONGLONG; // mof type (uint64)
+            Items[ 4 ].pbData = (PBYTE) &MessagesToClient;
+            Items[ 4 ].cbData = 8;
+            Items[ 4 ].pszDataDescription = NULL;
+            Items[ 5 ].pszName = L"BytesToClient";
+            Items[ 5 ].dwDataType = HTTP_TRACE_TYPE_ULONGLONG; // mof type (uint64)
+            Items[ 5 ].pbData = (PBYTE) &BytesToClient;
+            Items[ 5 ].cbData = 8;
+            Items[ 5 ].pszDataDescription = NULL;
+            Items[ 6 ].pszName = L"RelayToBackendMicroseconds";
+            Items[ 6 ].dwDataType = HTTP_TRACE_TYPE_ULONG; // mof type (uint32)
+            Items[ 6 ].pbData = (PBYTE) &RelayToBackendMicroseconds;
+            Items[ 6 ].cbData = 4;
+            Items[ 6 ].pszDataDescription = NULL;
+            Items[ 7 ].pszName = L"RelayToClientMicroseconds";
+            Items[ 7 ].dwDataType = HTTP_TRACE_TYPE_ULONG; // mof type (uint32)
+            Items[ 7 ].pbData = (PBYTE) &RelayToClientMicroseconds;
+            Items[ 7 ].cbData = 4;
+            Items[ 7 ].pszDataDescription = NULL;
+            Items[ 8 ].pszName = L"ActiveConnections";
+            Items[ 8 ].dwDataType = HTTP_TRACE_TYPE_ULONG; // mof type (uint32)
+            Items[ 8 ].pbData = (PBYTE) &ActiveConnections;
+            Items[ 8 ].cbData = 4;
+            Items[ 8 ].pszDataDescription = NULL;
+            Items[ 9 ].pszName = L"TotalConnections";
+            Items[ 9 ].dwDataType = HTTP_TRACE_TYPE_ULONGLONG; // mof type (uint64)
+            Items[ 9 ].pbData = (PBYTE) &TotalConnections;
+            Items[ 9 ].cbData = 8;
+            Items[ 9 ].pszDataDescription = NULL;
+            Items[ 10 ].pszName = L"TotalMessagesToBackend";
+            Items[ 10 ].dwDataType = HTTP_TRACE_TYPE_ULONGLONG; // mof type (uint64)
+            Items[ 10 ].pbData = (PBYTE) &TotalMessagesToBackend;
+            Items[ 10 ].cbData = 8;
+            Items[ 10 ].pszDataDescription = NULL;
+            Items[ 11 ].pszName = L"TotalBytesToBackend";
+            Items[ 11 ].dwDataType = HTTP_TRACE_TYPE_ULONGLONG; // mof type (uint64)
+            Items[ 11 ].pbData = (PBYTE) &TotalBytesToBackend;
+            Items[ 11 ].cbData = 8;
+            Items[ 11 ].pszDataDescription = NULL;
+            Items[ 12 ].pszName = L"TotalMessagesToClient";
+            Items[ 12 ].dwDataType = HTTP_TRACE_TYPE_ULONGLONG; // mof type (uint64)
+            Items[ 12 ].pbData = (PBYTE) &TotalMessagesToClient;
+            Items[ 12 ].cbData = 8;
+            Items[ 12 ].pszDataDescription = NULL;
+            Items[ 13 ].pszName = L"TotalBytesToClient";
+            Items[ 13 ].dwDataType = HTTP_TRACE_TYPE_ULONGLONG; // mof type (uint64)
+            Items[ 13 ].pbData = (PBYTE) &TotalBytesToClient;
+            Items[ 13 ].cbData = 8;
+            Items[ 13 ].pszDataDescription = NULL;
+            Event.pEventItems = Items;
+            pHttpTraceContext->RaiseTraceEvent( &Event );
+            return S_OK;
+        };
+    
+        static
+        BOOL
+        IsEnabled( 
+            IHttpTraceContext *  pHttpTraceContext )
+        // Check if tracing for this event is enabled
+        {
+            return WWWServerTraceProvider::CheckTracingEnabled( 
+                                 pHttpTraceContext,
+                                 WWWServerTraceProvider::ANCM,
+                                 4 ); //Verbosity
+        };
+    };
+    //
+    // Event: mof class name ANCMBackendProcessStart,
+    // Description: First request forwarded to a started backend process
+    // EventTypeName: ANCM_BACKEND_PROCESS_START
+    // EventType: 18
+    // EventLevel: 4
+    //
+    
+    class ANCM_BACKEND_PROCESS_START
+    {
+    public:
+        static
+        HRESULT
+        RaiseEvent(
+            IHttpTraceContext * pHttpTraceContext,
+            LPCGUID    pContextId,
+            ULONG      ProcessId,
+            ULONG      Port,
+            ULONG      ProcessCreatedMicroseconds,
+            ULONG      ListenMicroseconds,
+            ULONG      FirstRequestMicroseconds
+        )
+        //
+        // Raise ANCM_BACKEND_PROCESS_START Event
+        //
+        {
+            HTTP_TRACE_EVENT Event;
+            Event.pProviderGuid = WWWServerTraceProvider::GetProviderGuid();
+            Event.dwArea =  WWWServerTraceProvider::ANCM;
+            Event.pAreaGuid = ANCMEvents::GetAreaGuid();
+            Event.dwEvent = 18;
+            Event.pszEventName = L"ANCM_BACKEND_PROCESS_START";
+            Event.dwEventVersion = 1;
+            Event.dwVerbosity = 4;
+            Event.cEventItems = 6;
+            Event.pActivityGuid = NULL;
+            Event.pRelatedActivityGuid = NULL;
+            Event.dwTimeStamp = 0;
+            Event.dwFlags = HTTP_TRACE_EVENT_FLAG_STATIC_DESCRIPTIVE_FIELDS;
+    
+            // pActivityGuid, pRelatedActivityGuid, Timestamp to be filled in by IIS
+    
+            HTTP_TRACE_EVENT_ITEM Items[ 6 ];
+            Items[ 0 ].pszName = L"ContextId";
+            Items[ 0 ].dwDataType = HTTP_TRACE_TYPE_LPCGUID; // mof type (object)
+            Items[ 0 ].pbData = (PBYTE) pContextId;
+            Items[ 0 ].cbData = 16;
+            Items[ 0 ].pszDataDescription = NULL;
+            Items[ 1 ].pszName = L"ProcessId";
+            Items[ 1 ].dwDataType = HTTP_TRACE_TYPE_ULONG; // mof type (uint32)
+            Items[ 1 ].pbData = (PBYTE) &ProcessId;
+            Items[ 1 ].cbData = 4;
+            Items[ 1 ].pszDataDescription = NULL;
+            Items[ 2 ].pszName = L"Port";
+            Items[ 2 ].dwDataType = HTTP_TRACE_TYPE_ULONG; // mof type (uint32)
+            Items[ 2 ].pbData = (PBYTE) &Port;
+            Items[ 2 ].cbData = 4;
+            Items[ 2 ].pszDataDescription = NULL;
+            Items[ 3 ].pszName = L"ProcessCreatedMicroseconds";
+            Items[ 3 ].dwDataType = HTTP_TRACE_TYPE_ULONG; // mof type (uint32)
+            Items[ 3 ].pbData = (PBYTE) &ProcessCreatedMicroseconds;
+            Items[ 3 ].cbData = 4;
+            Items[ 3 ].pszDataDescription = NULL;
+            Items[ 4 ].pszName = L"ListenMicroseconds";
+            Items[ 4 ].dwDataType = HTTP_TRACE_TYPE_ULONG; // mof type (uint32)
+            Items[ 4 ].pbData = (PBYTE) &ListenMicroseconds;
+            Items[ 4 ].cbData = 4;
+            Items[ 4 ].pszDataDescription = NULL;
+            Items[ 5 ].pszName = L"FirstRequestMicroseconds";
+            Items[ 5 ].dwDataType = HTTP_TRACE_TYPE_ULONG; // mof type (uint32)
+            Items[ 5 ].pbData = (PBYTE) &FirstRequestMicroseconds;
+            Items[ 5 ].cbData = 4;
+            Items[ 5 ].pszDataDescription = NULL;
+            Event.pEventItems = Items;
+            pHttpTraceContext->RaiseTraceEvent( &Event );
+            return S_OK;
+        };
+    
+        static
+        BOOL
+        IsEnabled( 
+            IHttpTraceContext *  pHttpTraceContext )
+        // Check if tracing for this event is enabled
+        {
+            return WWWServerTraceProvider::CheckTracingEnabled( 
+                                 pHttpTraceContext,
+                                 WWWServerTraceProvider::ANCM,
+                                 4 ); //Verbosity
+        };
+    };
 };
 #endif
\ No newline at end of file
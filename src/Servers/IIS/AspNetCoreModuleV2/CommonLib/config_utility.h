@@ -8,6 +8,7 @@
 #include "stringu.h"
 #include "exceptions.h"
 #include "atlbase.h"
+#include "PriorityPaths.h"
 
 class ConfigUtility
 {
@@ -16,7 +17,57 @@ class ConfigUtility
     #define CS_ASPNETCORE_DEBUG_FILE                         L"debugFile"
     #define CS_ASPNETCORE_ENABLE_OUT_OF_PROCESS_CONSOLE_REDIRECTION L"enableOutOfProcessConsoleRedirection"
     #define CS_ASPNETCORE_FORWARD_RESPONSE_CONNECTION_HEADER L"forwardResponseConnectionHeader"
+    #define CS_ASPNETCORE_RESPONSE_READ_AHEAD_BUFFERS        L"responseReadAheadBuffers"
+    #define CS_ASPNETCORE_REQUEST_BODY_READ_AHEAD_BUFFERS    L"requestBodyReadAheadBuffers"
+    #define CS_ASPNETCORE_REQUEST_BODY_READ_AHEAD_LIMIT      L"requestBodyReadAheadLimit"
+    #define CS_ASPNETCORE_REQUEST_BUFFERING_MEMORY_LIMIT     L"requestBufferingMemoryLimit"
+    #define CS_ASPNETCORE_REQUEST_BUFFERING_MAX_SIZE         L"requestBufferingMaxSize"
+    #define CS_ASPNETCORE_MAX_REQUEST_BODY_SIZE              L"maxRequestBodySize"
+    #define CS_ASPNETCORE_RESPONSE_SPOOLING_MEMORY_LIMIT     L"responseSpoolingMemoryLimit"
+    #define CS_ASPNETCORE_RESPONSE_SPOOLING_MAX_SIZE         L"responseSpoolingMaxSize"
+    #define CS_ASPNETCORE_RESPONSE_BUFFERING_POLICY          L"responseBufferingPolicy"
+    #define CS_ASPNETCORE_FORWARD_TIMINGS_SERVER_VARIABLE    L"forwardTimingsServerVariable"
+    #define CS_ASPNETCORE_OFFLOAD_RESPONSE_COMPRESSION       L"offloadResponseCompression"
+    #define CS_ASPNETCORE_IDEMPOTENT_REQUEST_RETRIES         L"idempotentRequestRetries"
+    #define CS_ASPNETCORE_MAX_CONNECTIONS_PER_BACKEND        L"maxConnectionsPerBackend"
+    #define CS_ASPNETCORE_PREWARM_CONNECTIONS                L"prewarmConnections"
+    #define CS_ASPNETCORE_ISOLATE_WINHTTP_SESSION            L"isolateWinHttpSession"
+    #define CS_ASPNETCORE_PROCESS_ROUTING_POLICY             L"processRoutingPolicy"
+    #define CS_ASPNETCORE_STANDBY_PROCESSES                  L"standbyProcesses"
+    #define CS_ASPNETCORE_STANDBY_WARMUP_URL                 L"standbyWarmupUrl"
+    #define CS_ASPNETCORE_EAGER_PROCESS_STARTUP              L"eagerProcessStartup"
+    #define CS_ASPNETCORE_SHARE_BACKENDS_ACROSS_WEB_GARDEN   L"shareBackendsAcrossWebGarden"
+    #define CS_ASPNETCORE_REQUEST_DELEGATION                 L"requestDelegation"
+    #define CS_ASPNETCORE_CACHE_WINDOWS_AUTH_TOKEN           L"cacheWindowsAuthToken"
+    #define CS_ASPNETCORE_SEND_FILE_ROOT                     L"sendFileRoot"
+    #define CS_ASPNETCORE_PROCESS_CPU_RATE_LIMIT             L"processCpuRateLimit"
+    #define CS_ASPNETCORE_PROCESS_MEMORY_LIMIT               L"processMemoryLimit"
+    #define CS_ASPNETCORE_PROCESS_WORKING_SET_LIMIT          L"processWorkingSetLimit"
+    #define CS_ASPNETCORE_PROCESS_NUMA_NODE                  L"processNumaNode"
+    #define CS_ASPNETCORE_PROCESS_CPU_SETS                   L"processCpuSets"
+    #define CS_ASPNETCORE_PROCESS_NUMA_PLACEMENT             L"processNumaPlacement"
+    #define CS_ASPNETCORE_NUMA_LOCAL_COMPLETIONS             L"numaLocalCompletions"
+    #define CS_ASPNETCORE_RAPID_FAIL_BACKOFF_INITIAL         L"rapidFailBackoffInitial"
+    #define CS_ASPNETCORE_RAPID_FAIL_BACKOFF_MAX             L"rapidFailBackoffMax"
+    #define CS_ASPNETCORE_RAPID_FAIL_RECOVERY_INTERVAL       L"rapidFailRecoveryInterval"
+    #define CS_ASPNETCORE_HEALTH_CHECK_PATH                  L"healthCheckPath"
+    #define CS_ASPNETCORE_HEALTH_CHECK_INTERVAL              L"healthCheckInterval"
+    #define CS_ASPNETCORE_HEALTH_CHECK_TIMEOUT               L"healthCheckTimeout"
+    #define CS_ASPNETCORE_HEALTH_CHECK_UNHEALTHY_THRESHOLD   L"healthCheckUnhealthyThreshold"
+    #define CS_ASPNETCORE_OUTLIER_CONSECUTIVE_FAILURES       L"outlierConsecutiveFailures"
+    #define CS_ASPNETCORE_IDLE_SCALE_DOWN_TIMEOUT            L"idleScaleDownTimeout"
+    #define CS_ASPNETCORE_IDLE_SUSPEND                       L"idleSuspend"
+    #define CS_ASPNETCORE_WEBSOCKET_RECEIVE_BUFFER_SIZE      L"webSocketReceiveBufferSize"
+    #define CS_ASPNETCORE_WEBSOCKET_COALESCE_FRAGMENTS       L"webSocketCoalesceFragments"
+    #define CS_ASPNETCORE_WEBSOCKET_IDLE_TIMEOUT             L"webSocketIdleTimeout"
+    #define CS_ASPNETCORE_WEBSOCKET_STRIP_EXTENSIONS         L"webSocketStripExtensions"
+    #define CS_ASPNETCORE_WEBSOCKET_SLOW_CLIENT_TIMEOUT      L"webSocketSlowClientTimeout"
+    #define CS_ASPNETCORE_WEBSOCKET_MAX_MESSAGE_SIZE         L"webSocketMaxMessageSize"
+    #define CS_ASPNETCORE_REQUEST_SAMPLING_RATE              L"requestSamplingRate"
+    #define CS_ASPNETCORE_RESPONSE_CACHE_SIZE                L"responseCacheSize"
+    #define CS_ASPNETCORE_RESPONSE_INLINE_READS              L"responseInlineReads"
     #define CS_ASPNETCORE_DEBUG_LEVEL                        L"debugLevel"
+    #define CS_ASPNETCORE_DEBUG_FLUSH_INTERVAL               L"debugFlushInterval"
     #define CS_ASPNETCORE_HANDLER_SETTINGS_NAME              L"name"
     #define CS_ASPNETCORE_HANDLER_SETTINGS_VALUE             L"value"
 
@@ -42,6 +93,13 @@ public:
         return FindKeyValuePair(pElement, CS_ASPNETCORE_DEBUG_LEVEL, strDebugFile);
     }
 
+    static
+    HRESULT
+    FindDebugFlushInterval(IAppHostElement* pElement, STRU& strDebugFlushInterval)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_DEBUG_FLUSH_INTERVAL, strDebugFlushInterval);
+    }
+
     static
     HRESULT
     FindEnableOutOfProcessConsoleRedirection(IAppHostElement* pElement, STRU& strEnableOutOfProcessConsoleRedirection)
@@ -56,6 +114,356 @@ public:
         return FindKeyValuePair(pElement, CS_ASPNETCORE_FORWARD_RESPONSE_CONNECTION_HEADER, strForwardResponseConnectionHeader);
     }
 
+    static
+    HRESULT
+    FindResponseReadAheadBuffers(IAppHostElement* pElement, STRU& strResponseReadAheadBuffers)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_RESPONSE_READ_AHEAD_BUFFERS, strResponseReadAheadBuffers);
+    }
+
+    static
+    HRESULT
+    FindRequestBodyReadAheadBuffers(IAppHostElement* pElement, STRU& strRequestBodyReadAheadBuffers)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_REQUEST_BODY_READ_AHEAD_BUFFERS, strRequestBodyReadAheadBuffers);
+    }
+
+    static
+    HRESULT
+    FindRequestBodyReadAheadLimit(IAppHostElement* pElement, STRU& strRequestBodyReadAheadLimit)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_REQUEST_BODY_READ_AHEAD_LIMIT, strRequestBodyReadAheadLimit);
+    }
+
+    static
+    HRESULT
+    FindRequestBufferingMemoryLimit(IAppHostElement* pElement, STRU& strRequestBufferingMemoryLimit)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_REQUEST_BUFFERING_MEMORY_LIMIT, strRequestBufferingMemoryLimit);
+    }
+
+    static
+    HRESULT
+    FindRequestBufferingMaxSize(IAppHostElement* pElement, STRU& strRequestBufferingMaxSize)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_REQUEST_BUFFERING_MAX_SIZE, strRequestBufferingMaxSize);
+    }
+
+    static
+    HRESULT
+    FindMaxRequestBodySize(IAppHostElement* pElement, STRU& strMaxRequestBodySize)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_MAX_REQUEST_BODY_SIZE, strMaxRequestBodySize);
+    }
+
+    static
+    HRESULT
+    FindResponseSpoolingMemoryLimit(IAppHostElement* pElement, STRU& strResponseSpoolingMemoryLimit)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_RESPONSE_SPOOLING_MEMORY_LIMIT, strResponseSpoolingMemoryLimit);
+    }
+
+    static
+    HRESULT
+    FindResponseSpoolingMaxSize(IAppHostElement* pElement, STRU& strResponseSpoolingMaxSize)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_RESPONSE_SPOOLING_MAX_SIZE, strResponseSpoolingMaxSize);
+    }
+
+    static
+    HRESULT
+    FindResponseBufferingPolicy(IAppHostElement* pElement, STRU& strResponseBufferingPolicy)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_RESPONSE_BUFFERING_POLICY, strResponseBufferingPolicy);
+    }
+
+    static
+    HRESULT
+    FindForwardTimingsServerVariable(IAppHostElement* pElement, STRU& strForwardTimingsServerVariable)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_FORWARD_TIMINGS_SERVER_VARIABLE, strForwardTimingsServerVariable);
+    }
+
+    static
+    HRESULT
+    FindOffloadResponseCompression(IAppHostElement* pElement, STRU& strOffloadResponseCompression)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_OFFLOAD_RESPONSE_COMPRESSION, strOffloadResponseCompression);
+    }
+
+    static
+    HRESULT
+    FindIdempotentRequestRetries(IAppHostElement* pElement, STRU& strIdempotentRequestRetries)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_IDEMPOTENT_REQUEST_RETRIES, strIdempotentRequestRetries);
+    }
+
+    static
+    HRESULT
+    FindMaxConnectionsPerBackend(IAppHostElement* pElement, STRU& strMaxConnectionsPerBackend)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_MAX_CONNECTIONS_PER_BACKEND, strMaxConnectionsPerBackend);
+    }
+
+    static
+    HRESULT
+    FindPrewarmConnections(IAppHostElement* pElement, STRU& strPrewarmConnections)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_PREWARM_CONNECTIONS, strPrewarmConnections);
+    }
+
+    static
+    HRESULT
+    FindIsolateWinHttpSession(IAppHostElement* pElement, STRU& strIsolateWinHttpSession)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_ISOLATE_WINHTTP_SESSION, strIsolateWinHttpSession);
+    }
+
+    static
+    HRESULT
+    FindPriorityPaths(IAppHostElement* pElement, STRU& strPriorityPaths)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_HANDLER_PRIORITY_PATHS, strPriorityPaths);
+    }
+
+    static
+    HRESULT
+    FindProcessRoutingPolicy(IAppHostElement* pElement, STRU& strProcessRoutingPolicy)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_PROCESS_ROUTING_POLICY, strProcessRoutingPolicy);
+    }
+
+    static
+    HRESULT
+    FindStandbyProcesses(IAppHostElement* pElement, STRU& strStandbyProcesses)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_STANDBY_PROCESSES, strStandbyProcesses);
+    }
+
+    static
+    HRESULT
+    FindStandbyWarmupUrl(IAppHostElement* pElement, STRU& strStandbyWarmupUrl)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_STANDBY_WARMUP_URL, strStandbyWarmupUrl);
+    }
+
+    static
+    HRESULT
+    FindEagerProcessStartup(IAppHostElement* pElement, STRU& strEagerProcessStartup)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_EAGER_PROCESS_STARTUP, strEagerProcessStartup);
+    }
+
+    static
+    HRESULT
+    FindShareBackendsAcrossWebGarden(IAppHostElement* pElement, STRU& strShareBackendsAcrossWebGarden)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_SHARE_BACKENDS_ACROSS_WEB_GARDEN, strShareBackendsAcrossWebGarden);
+    }
+
+    static
+    HRESULT
+    FindRequestDelegation(IAppHostElement* pElement, STRU& strRequestDelegation)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_REQUEST_DELEGATION, strRequestDelegation);
+    }
+
+    static
+    HRESULT
+    FindCacheWindowsAuthToken(IAppHostElement* pElement, STRU& strCacheWindowsAuthToken)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_CACHE_WINDOWS_AUTH_TOKEN, strCacheWindowsAuthToken);
+    }
+
+    static
+    HRESULT
+    FindSendFileRoot(IAppHostElement* pElement, STRU& strSendFileRoot)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_SEND_FILE_ROOT, strSendFileRoot);
+    }
+
+    static
+    HRESULT
+    FindProcessCpuRateLimit(IAppHostElement* pElement, STRU& strProcessCpuRateLimit)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_PROCESS_CPU_RATE_LIMIT, strProcessCpuRateLimit);
+    }
+
+    static
+    HRESULT
+    FindProcessMemoryLimit(IAppHostElement* pElement, STRU& strProcessMemoryLimit)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_PROCESS_MEMORY_LIMIT, strProcessMemoryLimit);
+    }
+
+    static
+    HRESULT
+    FindProcessWorkingSetLimit(IAppHostElement* pElement, STRU& strProcessWorkingSetLimit)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_PROCESS_WORKING_SET_LIMIT, strProcessWorkingSetLimit);
+    }
+
+    static
+    HRESULT
+    FindProcessNumaNode(IAppHostElement* pElement, STRU& strProcessNumaNode)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_PROCESS_NUMA_NODE, strProcessNumaNode);
+    }
+
+    static
+    HRESULT
+    FindProcessCpuSets(IAppHostElement* pElement, STRU& strProcessCpuSets)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_PROCESS_CPU_SETS, strProcessCpuSets);
+    }
+
+    static
+    HRESULT
+    FindProcessNumaPlacement(IAppHostElement* pElement, STRU& strProcessNumaPlacement)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_PROCESS_NUMA_PLACEMENT, strProcessNumaPlacement);
+    }
+
+    static
+    HRESULT
+    FindNumaLocalCompletions(IAppHostElement* pElement, STRU& strNumaLocalCompletions)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_NUMA_LOCAL_COMPLETIONS, strNumaLocalCompletions);
+    }
+
+    static
+    HRESULT
+    FindRapidFailBackoffInitial(IAppHostElement* pElement, STRU& strRapidFailBackoffInitial)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_RAPID_FAIL_BACKOFF_INITIAL, strRapidFailBackoffInitial);
+    }
+
+    static
+    HRESULT
+    FindRapidFailBackoffMax(IAppHostElement* pElement, STRU& strRapidFailBackoffMax)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_RAPID_FAIL_BACKOFF_MAX, strRapidFailBackoffMax);
+    }
+
+    static
+    HRESULT
+    FindRapidFailRecoveryInterval(IAppHostElement* pElement, STRU& strRapidFailRecoveryInterval)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_RAPID_FAIL_RECOVERY_INTERVAL, strRapidFailRecoveryInterval);
+    }
+
+    static
+    HRESULT
+    FindHealthCheckPath(IAppHostElement* pElement, STRU& strHealthCheckPath)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_HEALTH_CHECK_PATH, strHealthCheckPath);
+    }
+
+    static
+    HRESULT
+    FindHealthCheckInterval(IAppHostElement* pElement, STRU& strHealthCheckInterval)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_HEALTH_CHECK_INTERVAL, strHealthCheckInterval);
+    }
+
+    static
+    HRESULT
+    FindHealthCheckTimeout(IAppHostElement* pElement, STRU& strHealthCheckTimeout)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_HEALTH_CHECK_TIMEOUT, strHealthCheckTimeout);
+    }
+
+    static
+    HRESULT
+    FindHealthCheckUnhealthyThreshold(IAppHostElement* pElement, STRU& strHealthCheckUnhealthyThreshold)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_HEALTH_CHECK_UNHEALTHY_THRESHOLD, strHealthCheckUnhealthyThreshold);
+    }
+
+    static
+    HRESULT
+    FindOutlierConsecutiveFailures(IAppHostElement* pElement, STRU& strOutlierConsecutiveFailures)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_OUTLIER_CONSECUTIVE_FAILURES, strOutlierConsecutiveFailures);
+    }
+
+    static
+    HRESULT
+    FindIdleScaleDownTimeout(IAppHostElement* pElement, STRU& strIdleScaleDownTimeout)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_IDLE_SCALE_DOWN_TIMEOUT, strIdleScaleDownTimeout);
+    }
+
+    static
+    HRESULT
+    FindIdleSuspend(IAppHostElement* pElement, STRU& strIdleSuspend)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_IDLE_SUSPEND, strIdleSuspend);
+    }
+
+    static
+    HRESULT
+    FindWebSocketReceiveBufferSize(IAppHostElement* pElement, STRU& strWebSocketReceiveBufferSize)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_WEBSOCKET_RECEIVE_BUFFER_SIZE, strWebSocketReceiveBufferSize);
+    }
+
+    static
+    HRESULT
+    FindWebSocketCoalesceFragments(IAppHostElement* pElement, STRU& strWebSocketCoalesceFragments)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_WEBSOCKET_COALESCE_FRAGMENTS, strWebSocketCoalesceFragments);
+    }
+
+    static
+    HRESULT
+    FindWebSocketIdleTimeout(IAppHostElement* pElement, STRU& strWebSocketIdleTimeout)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_WEBSOCKET_IDLE_TIMEOUT, strWebSocketIdleTimeout);
+    }
+
+    static
+    HRESULT
+    FindWebSocketStripExtensions(IAppHostElement* pElement, STRU& strWebSocketStripExtensions)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_WEBSOCKET_STRIP_EXTENSIONS, strWebSocketStripExtensions);
+    }
+
+    static
+    HRESULT
+    FindWebSocketSlowClientTimeout(IAppHostElement* pElement, STRU& strWebSocketSlowClientTimeout)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_WEBSOCKET_SLOW_CLIENT_TIMEOUT, strWebSocketSlowClientTimeout);
+    }
+
+    static
+    HRESULT
+    FindWebSocketMaxMessageSize(IAppHostElement* pElement, STRU& strWebSocketMaxMessageSize)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_WEBSOCKET_MAX_MESSAGE_SIZE, strWebSocketMaxMessageSize);
+    }
+
+    static
+    HRESULT
+    FindRequestSamplingRate(IAppHostElement* pElement, STRU& strRequestSamplingRate)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_REQUEST_SAMPLING_RATE, strRequestSamplingRate);
+    }
+
+    static
+    HRESULT
+    FindResponseCacheSize(IAppHostElement* pElement, STRU& strResponseCacheSize)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_RESPONSE_CACHE_SIZE, strResponseCacheSize);
+    }
+
+    static
+    HRESULT
+    FindResponseInlineReads(IAppHostElement* pElement, STRU& strResponseInlineReads)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_RESPONSE_INLINE_READS, strResponseInlineReads);
+    }
+
 private:
     static
     HRESULT
@@ -16,12 +16,129 @@
 #include "StringHelpers.h"
 #include "aspnetcore_msg.h"
 #include "EventLog.h"
-
-inline HANDLE g_logFile = INVALID_HANDLE_VALUE;
+#include "AsyncLogWriter.h"
+#include "DebugRingBuffer.h"
+#include "TraceProvider.h"
+#include "LockContention.h"
+#include "AllocationTracking.h"
+#include "RegistryKey.h"
+
+// How long DebugStop waits for a batch the log writer is writing.
+#define LOG_WRITER_STOP_TIMEOUT_MS 1000
+
+// Owns the debug log file. Log lines are written by a thread pool work
+// item so that logging threads never wait for the disk.
+inline AsyncLogWriter g_logWriter;
 inline HMODULE g_hModule;
 inline SRWLOCK g_logFileLock;
 inline HANDLE g_stdOutHandle = INVALID_HANDLE_VALUE;
 
+// Set by ASPNETCORE_MODULE_DEBUG_RING_FILE, cheap enough to stay enabled.
+inline DebugRingBuffer g_debugRing;
+
+inline PFN_TRACE_CAPTURE_STATE volatile g_pfnTraceCaptureState;
+
+//
+// Log lines as structured events, whatever the debug flags are. A session
+// picks the level; while none listens a log line costs one compare.
+// {a42b5c9c-7dac-5e57-5964-ec0e1f599312} is the ETW name hash of the name.
+//
+TRACELOGGING_DEFINE_PROVIDER(
+    g_hTraceProvider,
+    "Microsoft-AspNetCore-Module",
+    (0xa42b5c9c, 0x7dac, 0x5e57, 0x59, 0x64, 0xec, 0x0e, 0x1f, 0x59, 0x93, 0x12));
+
+static
+UCHAR
+GetTraceLevel(
+    DWORD   dwFlag
+    )
+{
+    switch (dwFlag)
+    {
+        case ASPNETCORE_DEBUG_FLAG_ERROR:
+            return WINEVENT_LEVEL_ERROR;
+        case ASPNETCORE_DEBUG_FLAG_WARNING:
+            return WINEVENT_LEVEL_WARNING;
+        case ASPNETCORE_DEBUG_FLAG_INFO:
+            return WINEVENT_LEVEL_INFO;
+        default:
+            return WINEVENT_LEVEL_VERBOSE;
+    }
+}
+
+// Whether any sink wants a line of this level.
+static
+BOOL
+ShouldLog(
+    DWORD   dwFlag
+    )
+{
+    return IsEnabled(dwFlag) || TraceLoggingProviderEnabled(g_hTraceProvider, GetTraceLevel(dwFlag), 0);
+}
+
+//
+// Recomputes g_dwEnabledLogLevels, after the debug flags changed or an
+// ETW session enabled or disabled the provider.
+//
+static
+VOID
+UpdateEnabledLogLevels()
+{
+    DWORD dwLevels = DEBUG_FLAGS_VAR & DEBUG_FLAGS_ANY;
+
+    for (const DWORD dwFlag : { ASPNETCORE_DEBUG_FLAG_ERROR, ASPNETCORE_DEBUG_FLAG_WARNING, ASPNETCORE_DEBUG_FLAG_INFO, ASPNETCORE_DEBUG_FLAG_TRACE })
+    {
+        if (TraceLoggingProviderEnabled(g_hTraceProvider, GetTraceLevel(dwFlag), 0))
+        {
+            dwLevels |= dwFlag;
+        }
+    }
+
+    g_dwEnabledLogLevels = dwLevels;
+}
+
+// The provider state is already updated when this runs.
+static
+VOID
+NTAPI
+TraceProviderEnableCallback(
+    LPCGUID                     /* pSourceId */,
+    ULONG                       ulIsEnabled,
+    UCHAR                       /* level */,
+    ULONGLONG                   /* ullMatchAnyKeyword */,
+    ULONGLONG                   /* ullMatchAllKeyword */,
+    PEVENT_FILTER_DESCRIPTOR    /* pFilterData */,
+    PVOID                       /* pCallbackContext */
+    )
+{
+    UpdateEnabledLogLevels();
+
+    if (ulIsEnabled != EVENT_CONTROL_CODE_CAPTURE_STATE)
+    {
+        return;
+    }
+
+    LockContention::Write();
+#ifdef ANCM_ALLOCATION_TRACKING
+    AllocationTracking::Write();
+#endif
+
+    const PFN_TRACE_CAPTURE_STATE pfnCaptureState = g_pfnTraceCaptureState;
+    if (pfnCaptureState != nullptr)
+    {
+        pfnCaptureState();
+    }
+}
+
+VOID
+SetTraceCaptureStateCallback(
+    PFN_TRACE_CAPTURE_STATE pfnCaptureState
+    )
+{
+    g_pfnTraceCaptureState = pfnCaptureState;
+}
+
 std::wstring GetDateTime()
 {
     std::chrono::milliseconds milliseconds =
@@ -146,6 +263,8 @@ void SetDebugFlags(const std::wstring &debugValue)
     {
         // ignore
     }
+
+    UpdateEnabledLogLevels();
 }
 
 bool CreateDebugLogFile(const std::filesystem::path &debugOutputFile)
@@ -154,30 +273,25 @@ bool CreateDebugLogFile(const std::filesystem::path &debugOutputFile)
     {
         if (!debugOutputFile.empty())
         {
-            if (g_logFile != INVALID_HANDLE_VALUE)
+            if (g_logWriter.HasFile())
             {
                 LOG_INFOF(L"Switching debug log files to '%ls'", debugOutputFile.c_str());
             }
 
-            SRWExclusiveLock lock(g_logFileLock);
-            if (g_logFile != INVALID_HANDLE_VALUE)
-            {
-                CloseHandle(g_logFile);
-                g_logFile = INVALID_HANDLE_VALUE;
-            }
+            SRWExclusiveLock lock(g_logFileLock, LockSite::DebugLogFile);
 
             // ignore errors
             std::error_code ec;
             create_directories(debugOutputFile.parent_path(), ec);
 
-            g_logFile = CreateFileW(debugOutputFile.c_str(),
+            g_logWriter.SetFile(CreateFileW(debugOutputFile.c_str(),
                 (GENERIC_READ | GENERIC_WRITE),
                 (FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE),
                 nullptr,
                 OPEN_ALWAYS,
                 FILE_ATTRIBUTE_NORMAL,
                 nullptr
-            );
+            ));
             return true;
         }
     }
@@ -193,6 +307,9 @@ VOID
 DebugInitialize(HMODULE hModule)
 {
     g_hModule = hModule;
+#ifdef ANCM_ALLOCATION_TRACKING
+    AllocationTracking::Install(hModule);
+#endif
     DuplicateHandle(
         /* hSourceProcessHandle*/ GetCurrentProcess(),
         /* hSourceHandle */ GetStdHandle(STD_OUTPUT_HANDLE),
@@ -202,32 +319,17 @@ DebugInitialize(HMODULE hModule)
         /* bInheritHandle */ TRUE,
         /* dwOptions  */ DUPLICATE_SAME_ACCESS);
 
-    HKEY hKey;
     InitializeSRWLock(&g_logFileLock);
 
-    if (RegOpenKeyEx(HKEY_LOCAL_MACHINE,
-            L"SOFTWARE\\Microsoft\\IIS Extensions\\IIS AspNetCore Module V2\\Parameters",
-            0,
-            KEY_READ,
-            &hKey) == NO_ERROR)
-    {
-        DWORD dwType;
-        DWORD dwData;
-        DWORD cbData;
-
-        cbData = sizeof(dwData);
-        if ((RegQueryValueEx(hKey,
-            L"DebugFlags",
-            NULL,
-            &dwType,
-            (LPBYTE)&dwData,
-            &cbData) == NO_ERROR) &&
-            (dwType == REG_DWORD))
-        {
-            DEBUG_FLAGS_VAR = dwData;
-        }
+    TraceLoggingRegisterEx(g_hTraceProvider, TraceProviderEnableCallback, nullptr);
 
-        RegCloseKey(hKey);
+    // The key the shim reads its parameters from, opened once for both.
+    const auto debugFlags = CachedRegistryKey::Get(HKEY_LOCAL_MACHINE,
+        L"SOFTWARE\\Microsoft\\IIS Extensions\\IIS AspNetCore Module V2\\Parameters").TryGetDWORD(L"DebugFlags");
+    if (debugFlags.has_value())
+    {
+        DEBUG_FLAGS_VAR = debugFlags.value();
+        UpdateEnabledLogLevels();
     }
 
     try
@@ -250,9 +352,30 @@ DebugInitialize(HMODULE hModule)
         // ignore
     }
 
+    try
+    {
+        const auto debugRingFile = Environment::GetEnvironmentVariableValue(L"ASPNETCORE_MODULE_DEBUG_RING_FILE");
+        if (debugRingFile.has_value() && !debugRingFile.value().empty())
+        {
+            LOG_IF_FAILED(g_debugRing.Open(debugRingFile.value()));
+
+            // Without levels the ring would stay empty.
+            if ((DEBUG_FLAGS_VAR & DEBUG_FLAGS_ANY) == 0)
+            {
+                DEBUG_FLAGS_VAR |= DEBUG_FLAGS_INFO;
+                UpdateEnabledLogLevels();
+            }
+        }
+    }
+    catch (...)
+    {
+        // ignore
+    }
+
     if (IsDebuggerPresent())
     {
         DEBUG_FLAGS_VAR |= DEBUG_FLAGS_INFO;
+        UpdateEnabledLogLevels();
     }
 
     PrintDebugHeader();
@@ -278,6 +401,14 @@ DebugInitializeFromConfig(IHttpServer& pHttpServer, IHttpApplication& pHttpAppli
     STRU debugValue;
     RETURN_IF_FAILED(ConfigUtility::FindDebugLevel(pAspNetCoreElement, debugValue));
 
+    STRU debugFlushInterval;
+    RETURN_IF_FAILED(ConfigUtility::FindDebugFlushInterval(pAspNetCoreElement, debugFlushInterval));
+
+    if (!debugFlushInterval.IsEmpty())
+    {
+        g_logWriter.SetFlushInterval(_wtoi(debugFlushInterval.QueryStr()));
+    }
+
     SetDebugFlags(debugValue.QueryStr());
 
     if (debugFile.QueryCCH() == 0 && IsEnabled(ASPNETCORE_DEBUG_FLAG_FILE))
@@ -305,15 +436,26 @@ DebugInitializeFromConfig(IHttpServer& pHttpServer, IHttpApplication& pHttpAppli
 VOID
 DebugStop()
 {
-    if (g_logFile != INVALID_HANDLE_VALUE)
-    {
-        CloseHandle(g_logFile);
-    }
+    // The shim stopped it before deregistering the event source, the
+    // request handlers never deregister theirs.
+    EventLog::Stop();
+
+    // Writes out the queued lines and closes the log file.
+    g_logWriter.Stop(LOG_WRITER_STOP_TIMEOUT_MS);
 
     if (g_stdOutHandle != INVALID_HANDLE_VALUE)
     {
         CloseHandle(g_stdOutHandle);
     }
+
+    // The totals of a session that is still running.
+    LockContention::Write();
+#ifdef ANCM_ALLOCATION_TRACKING
+    AllocationTracking::Write();
+#endif
+
+    TraceLoggingUnregister(g_hTraceProvider);
+    UpdateEnabledLogLevels();
 }
 
 BOOL
@@ -343,8 +485,53 @@ DebugPrintW(
     STACK_STRU (strOutput, 256);
     HRESULT  hr = S_OK;
 
+    if (TraceLoggingProviderEnabled(g_hTraceProvider, GetTraceLevel(dwFlag), 0))
+    {
+        // The level of an event is part of its static descriptor.
+#define WRITE_DEBUG_LOG_EVENT(level)                                \
+        TraceLoggingWrite(g_hTraceProvider,                         \
+            "DebugLog",                                             \
+            TraceLoggingLevel(level),                               \
+            TraceLoggingString(DEBUG_LABEL_VAR, "Module"),          \
+            TraceLoggingWideString(szString, "Message"))
+
+        switch (GetTraceLevel(dwFlag))
+        {
+            case WINEVENT_LEVEL_ERROR:
+                WRITE_DEBUG_LOG_EVENT(WINEVENT_LEVEL_ERROR);
+                break;
+            case WINEVENT_LEVEL_WARNING:
+                WRITE_DEBUG_LOG_EVENT(WINEVENT_LEVEL_WARNING);
+                break;
+            case WINEVENT_LEVEL_INFO:
+                WRITE_DEBUG_LOG_EVENT(WINEVENT_LEVEL_INFO);
+                break;
+            default:
+                WRITE_DEBUG_LOG_EVENT(WINEVENT_LEVEL_VERBOSE);
+                break;
+        }
+
+#undef WRITE_DEBUG_LOG_EVENT
+    }
+
     if ( IsEnabled( dwFlag ) )
     {
+        if (g_debugRing.IsOpen())
+        {
+            g_debugRing.Write(dwFlag, szString);
+
+            //
+            // Nothing else to format the line for, unless a debugger
+            // listens to OutputDebugString.
+            //
+            if (!IsEnabled(ASPNETCORE_DEBUG_FLAG_CONSOLE | ASPNETCORE_DEBUG_FLAG_EVENTLOG) &&
+                !g_logWriter.HasFile() &&
+                !IsDebuggerPresent())
+            {
+                return;
+            }
+        }
+
         auto time = GetDateTime();
         hr = strOutput.SafeSnwprintf(
             L"[%s, PID: %u] [%S] %s\r\n",
@@ -362,13 +549,17 @@ DebugPrintW(
             WriteFileEncoded(GetConsoleOutputCP(), g_stdOutHandle, strOutput.QueryStr());
         }
 
-        if (g_logFile != INVALID_HANDLE_VALUE)
+        if (g_logWriter.HasFile())
         {
-            SRWExclusiveLock lock(g_logFileLock);
-
-            SetFilePointer(g_logFile, 0, nullptr, FILE_END);
-            WriteFileEncoded(CP_UTF8, g_logFile, strOutput.QueryStr());
-            FlushFileBuffers(g_logFile);
+            try
+            {
+                // Dropped and counted if the writer is too far behind.
+                g_logWriter.Write(to_multi_byte_string(strOutput.QueryStr(), CP_UTF8));
+            }
+            catch (...)
+            {
+                // ignore
+            }
         }
 
         if (IsEnabled(ASPNETCORE_DEBUG_FLAG_EVENTLOG))
@@ -403,7 +594,7 @@ DebugPrintfW(
     va_list  args;
     HRESULT hr = S_OK;
 
-    if ( IsEnabled( dwFlag ) )
+    if ( ShouldLog( dwFlag ) )
     {
         va_start( args, szFormat );
 
@@ -428,7 +619,7 @@ DebugPrint(
 {
     STACK_STRU (strOutput, 256);
 
-    if ( IsEnabled( dwFlag ) )
+    if ( ShouldLog( dwFlag ) )
     {
         strOutput.CopyA(szString);
         DebugPrintW(dwFlag, strOutput.QueryStr());
@@ -447,7 +638,7 @@ DebugPrintf(
     va_list  args;
     HRESULT hr = S_OK;
 
-    if ( IsEnabled( dwFlag ) )
+    if ( ShouldLog( dwFlag ) )
     {
         va_start( args, szFormat );
 
@@ -16,17 +16,45 @@
 #define ASPNETCORE_DEBUG_FLAG_FILE          0x00000020
 #define ASPNETCORE_DEBUG_FLAG_EVENTLOG      0x00000040
 
-#define LOG_TRACE(...) DebugPrintW(ASPNETCORE_DEBUG_FLAG_TRACE, __VA_ARGS__)
-#define LOG_TRACEF(...) DebugPrintfW(ASPNETCORE_DEBUG_FLAG_TRACE, __VA_ARGS__)
-
-#define LOG_INFO(...) DebugPrintW(ASPNETCORE_DEBUG_FLAG_INFO, __VA_ARGS__)
-#define LOG_INFOF(...) DebugPrintfW(ASPNETCORE_DEBUG_FLAG_INFO, __VA_ARGS__)
-
-#define LOG_WARN(...) DebugPrintW(ASPNETCORE_DEBUG_FLAG_WARNING, __VA_ARGS__)
-#define LOG_WARNF(...) DebugPrintfW(ASPNETCORE_DEBUG_FLAG_WARNING, __VA_ARGS__)
-
-#define LOG_ERROR(...) DebugPrintW(ASPNETCORE_DEBUG_FLAG_ERROR, __VA_ARGS__)
-#define LOG_ERRORF(...) DebugPrintfW(ASPNETCORE_DEBUG_FLAG_ERROR, __VA_ARGS__)
+//
+// Levels any sink currently wants: the debug flags combined with what ETW
+// sessions enabled for the TraceLogging provider. The LOG_* macros test
+// it with one plain load before evaluating their arguments.
+//
+inline volatile DWORD g_dwEnabledLogLevels = 0;
+
+inline
+bool
+IsLogLevelEnabled(
+    DWORD   dwFlag
+    )
+{
+    return (g_dwEnabledLogLevels & dwFlag) != 0;
+}
+
+#define LOG_AT_LEVEL(dwFlag, pfnPrint, ...) \
+    do { if (IsLogLevelEnabled(dwFlag)) { pfnPrint(dwFlag, __VA_ARGS__); } } while (0, 0)
+
+//
+// Define ASPNETCORE_STRIP_TRACE_LOGS to compile trace level logging out,
+// arguments included.
+//
+#ifdef ASPNETCORE_STRIP_TRACE_LOGS
+#define LOG_TRACE(...) do { } while (0, 0)
+#define LOG_TRACEF(...) do { } while (0, 0)
+#else
+#define LOG_TRACE(...) LOG_AT_LEVEL(ASPNETCORE_DEBUG_FLAG_TRACE, DebugPrintW, __VA_ARGS__)
+#define LOG_TRACEF(...) LOG_AT_LEVEL(ASPNETCORE_DEBUG_FLAG_TRACE, DebugPrintfW, __VA_ARGS__)
+#endif
+
+#define LOG_INFO(...) LOG_AT_LEVEL(ASPNETCORE_DEBUG_FLAG_INFO, DebugPrintW, __VA_ARGS__)
+#define LOG_INFOF(...) LOG_AT_LEVEL(ASPNETCORE_DEBUG_FLAG_INFO, DebugPrintfW, __VA_ARGS__)
+
+#define LOG_WARN(...) LOG_AT_LEVEL(ASPNETCORE_DEBUG_FLAG_WARNING, DebugPrintW, __VA_ARGS__)
+#define LOG_WARNF(...) LOG_AT_LEVEL(ASPNETCORE_DEBUG_FLAG_WARNING, DebugPrintfW, __VA_ARGS__)
+
+#define LOG_ERROR(...) LOG_AT_LEVEL(ASPNETCORE_DEBUG_FLAG_ERROR, DebugPrintW, __VA_ARGS__)
+#define LOG_ERRORF(...) LOG_AT_LEVEL(ASPNETCORE_DEBUG_FLAG_ERROR, DebugPrintfW, __VA_ARGS__)
 
 VOID
 DebugInitialize(HMODULE hModule);
@@ -149,6 +149,54 @@ FILE_UTILITY::EnsureDirectoryPathExists(
     }
 }
 
+HRESULT
+FILE_UTILITY::GetFullPath(
+    _In_  LPCWSTR   pszPath,
+    _Out_ STRU*     pStruFullPath
+)
+{
+    DWORD cchFullPath = GetFullPathName(pszPath,
+        pStruFullPath->QuerySizeCCH(),
+        pStruFullPath->QueryStr(),
+        NULL);
+    if (cchFullPath >= pStruFullPath->QuerySizeCCH())
+    {
+        // Too small, the size needed is returned.
+        RETURN_IF_FAILED(pStruFullPath->Resize(cchFullPath));
+        cchFullPath = GetFullPathName(pszPath,
+            pStruFullPath->QuerySizeCCH(),
+            pStruFullPath->QueryStr(),
+            NULL);
+    }
+    RETURN_LAST_ERROR_IF(cchFullPath == 0 || cchFullPath >= pStruFullPath->QuerySizeCCH());
+
+    return pStruFullPath->SyncWithBuffer();
+}
+
+HRESULT
+FILE_UTILITY::GetFinalPath(
+    _In_  HANDLE    hFile,
+    _Out_ STRU*     pStruFinalPath
+)
+{
+    DWORD cchFinalPath = GetFinalPathNameByHandle(hFile,
+        pStruFinalPath->QueryStr(),
+        pStruFinalPath->QuerySizeCCH(),
+        FILE_NAME_NORMALIZED | VOLUME_NAME_DOS);
+    if (cchFinalPath >= pStruFinalPath->QuerySizeCCH())
+    {
+        // Too small, the size needed is returned.
+        RETURN_IF_FAILED(pStruFinalPath->Resize(cchFinalPath));
+        cchFinalPath = GetFinalPathNameByHandle(hFile,
+            pStruFinalPath->QueryStr(),
+            pStruFinalPath->QuerySizeCCH(),
+            FILE_NAME_NORMALIZED | VOLUME_NAME_DOS);
+    }
+    RETURN_LAST_ERROR_IF(cchFinalPath == 0 || cchFinalPath >= pStruFinalPath->QuerySizeCCH());
+
+    return pStruFinalPath->SyncWithBuffer();
+}
+
 std::string FILE_UTILITY::GetHtml(HMODULE module, int page, USHORT statusCode, USHORT subStatusCode, const std::string& specificReasonPhrase, const std::string& solution)
 {
     return GetHtml(module, page, statusCode, subStatusCode, specificReasonPhrase, solution, std::string());
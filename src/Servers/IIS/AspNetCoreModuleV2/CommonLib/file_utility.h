@@ -26,6 +26,28 @@ public:
         _In_  LPCWSTR pszPath
     );
 
+    //
+    // GetFullPathName, with '.' and '..' resolved and relative paths made
+    // relative to the current directory.
+    //
+    static
+    HRESULT
+    GetFullPath(
+        _In_  LPCWSTR   pszPath,
+        _Out_ STRU*     pStruFullPath
+    );
+
+    //
+    // The path of an open file with every junction and symbolic link on
+    // the way resolved, in the \\?\ form.
+    //
+    static
+    HRESULT
+    GetFinalPath(
+        _In_  HANDLE    hFile,
+        _Out_ STRU*     pStruFinalPath
+    );
+
     static
     std::string
     GetHtml(HMODULE module, int page, USHORT statusCode, USHORT subStatusCode, const std::string& specificReasonPhrase, const std::string& solution);
@@ -6,6 +6,7 @@
 #include "irequesthandler.h"
 #include "ntassert.h"
 #include "exceptions.h"
+#include "AllocationTracking.h"
 
 //
 // Pure abstract class
@@ -45,6 +46,7 @@ public:
     OnExecuteRequestHandler() final
     {
         TraceContextScope traceScope(m_pHttpContext.GetTraceContext());
+        ALLOCATION_TRACKING_REQUEST_SCOPE(true);
         return ExecuteRequestHandler();
     }
 
@@ -55,6 +57,7 @@ public:
     ) final
     {
         TraceContextScope traceScope(m_pHttpContext.GetTraceContext());
+        ALLOCATION_TRACKING_REQUEST_SCOPE(false);
         return AsyncCompletion(cbCompletion, hrCompletionStatus);
     };
 
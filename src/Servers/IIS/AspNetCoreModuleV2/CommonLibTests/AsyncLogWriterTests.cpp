@@ -0,0 +1,54 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+#include "stdafx.h"
+#include "AsyncLogWriter.h"
+
+namespace AsyncLogWriterTests
+{
+    HANDLE
+    CreateLogFile(const std::filesystem::path& path)
+    {
+        return CreateFileW(path.c_str(),
+            GENERIC_READ | GENERIC_WRITE,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            nullptr,
+            OPEN_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr);
+    }
+
+    std::string
+    ReadLogFile(const std::filesystem::path& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    TEST(AsyncLogWriterTest, StopWritesQueuedLinesInOrder)
+    {
+        auto tempDirectory = TempDirectory();
+        auto logFile = tempDirectory.path() / L"log.txt";
+
+        {
+            AsyncLogWriter writer;
+            writer.SetFile(CreateLogFile(logFile));
+
+            for (int i = 0; i < 100; ++i)
+            {
+                EXPECT_TRUE(writer.Write("line " + std::to_string(i) + "\r\n"));
+            }
+
+            writer.Stop(INFINITE);
+            EXPECT_FALSE(writer.Write("after stop\r\n"));
+        }
+
+        std::string expected;
+        for (int i = 0; i < 100; ++i)
+        {
+            expected += "line " + std::to_string(i) + "\r\n";
+        }
+
+        EXPECT_EQ(expected, ReadLogFile(logFile));
+    }
+}
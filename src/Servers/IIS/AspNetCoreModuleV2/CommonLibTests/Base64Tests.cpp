@@ -0,0 +1,62 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+#include "stdafx.h"
+
+namespace Base64Tests
+{
+    // Covers the SIMD blocks, the scalar tail and every padding length.
+    TEST(Base64Test, RoundTripsAcrossBlockSizes)
+    {
+        std::vector<BYTE> data(200);
+        for (size_t i = 0; i < data.size(); i++)
+        {
+            data[i] = static_cast<BYTE>(i * 37 + 11);
+        }
+
+        for (DWORD cbData = 1; cbData <= data.size(); cbData++)
+        {
+            DWORD cchEncoded = 0;
+            ASSERT_EQ(Base64Encode(data.data(), cbData, static_cast<PSTR>(nullptr), 0, &cchEncoded), static_cast<DWORD>(ERROR_SUCCESS));
+
+            std::vector<CHAR> encoded(cchEncoded);
+            std::vector<WCHAR> encodedW(cchEncoded);
+            ASSERT_EQ(Base64Encode(data.data(), cbData, encoded.data(), cchEncoded, nullptr), static_cast<DWORD>(ERROR_SUCCESS));
+            ASSERT_EQ(Base64Encode(data.data(), cbData, encodedW.data(), cchEncoded, nullptr), static_cast<DWORD>(ERROR_SUCCESS));
+
+            for (DWORD i = 0; i < cchEncoded; i++)
+            {
+                ASSERT_EQ(static_cast<WCHAR>(encoded[i]), encodedW[i]);
+            }
+
+            std::vector<BYTE> decoded(cbData);
+            DWORD cbDecoded = 0;
+            ASSERT_EQ(Base64Decode(encoded.data(), decoded.data(), cbData, &cbDecoded), static_cast<DWORD>(ERROR_SUCCESS));
+            ASSERT_EQ(cbDecoded, cbData);
+            ASSERT_EQ(memcmp(decoded.data(), data.data(), cbData), 0);
+
+            std::fill(decoded.begin(), decoded.end(), static_cast<BYTE>(0));
+            ASSERT_EQ(Base64Decode(encodedW.data(), decoded.data(), cbData, &cbDecoded), static_cast<DWORD>(ERROR_SUCCESS));
+            ASSERT_EQ(memcmp(decoded.data(), data.data(), cbData), 0);
+        }
+    }
+
+    TEST(Base64Test, RejectsInvalidCharactersInBlocks)
+    {
+        std::vector<BYTE> data(96, static_cast<BYTE>(0xA5));
+        CHAR encoded[129];
+        ASSERT_EQ(Base64Encode(data.data(), static_cast<DWORD>(data.size()), encoded, sizeof(encoded), nullptr), static_cast<DWORD>(ERROR_SUCCESS));
+
+        BYTE decoded[96];
+        encoded[40] = '*';
+        EXPECT_EQ(Base64Decode(encoded, decoded, sizeof(decoded), nullptr), static_cast<DWORD>(ERROR_INVALID_PARAMETER));
+
+        WCHAR encodedW[129];
+        for (size_t i = 0; i < _countof(encodedW); i++)
+        {
+            encodedW[i] = static_cast<BYTE>(encoded[i]);
+        }
+        encodedW[40] = L'\x0141';
+        EXPECT_EQ(Base64Decode(encodedW, decoded, sizeof(decoded), nullptr), static_cast<DWORD>(ERROR_INVALID_PARAMETER));
+    }
+}
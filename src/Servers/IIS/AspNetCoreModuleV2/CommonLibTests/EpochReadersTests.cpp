@@ -0,0 +1,137 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+#include "stdafx.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "EpochReaders.h"
+
+namespace EpochReadersTests
+{
+    TEST(EpochReadersTest, AdvancesTwiceWithoutReaders)
+    {
+        std::unique_ptr<EpochReaders> pReaders;
+        ASSERT_HRESULT_SUCCEEDED(EpochReaders::Create(pReaders));
+
+        const LONG lRetiredEpoch = pReaders->QueryEpoch();
+        EXPECT_FALSE(pReaders->IsReclaimable(lRetiredEpoch));
+
+        pReaders->Advance();
+
+        EXPECT_EQ(lRetiredEpoch + 2, pReaders->QueryEpoch());
+        EXPECT_TRUE(pReaders->IsReclaimable(lRetiredEpoch));
+    }
+
+    TEST(EpochReadersTest, RetiredOnlyReclaimedOnceBothBanksDrain)
+    {
+        std::unique_ptr<EpochReaders> pReaders;
+        ASSERT_HRESULT_SUCCEEDED(EpochReaders::Create(pReaders));
+
+        // A reader in the bank of epoch 0 holds the epoch at 1.
+        LONG* pcFirst = pReaders->Enter();
+        pReaders->Advance();
+        EXPECT_EQ(1, pReaders->QueryEpoch());
+
+        // A reader that may have loaded the object retired right after.
+        LONG* pcSecond = pReaders->Enter();
+        const LONG lRetiredEpoch = pReaders->QueryEpoch();
+
+        pReaders->Advance();
+        EXPECT_FALSE(pReaders->IsReclaimable(lRetiredEpoch));
+
+        // The first bank drained, the second still holds the object.
+        EpochReaders::Exit(pcFirst);
+        pReaders->Advance();
+        EXPECT_EQ(2, pReaders->QueryEpoch());
+        EXPECT_FALSE(pReaders->IsReclaimable(lRetiredEpoch));
+
+        EpochReaders::Exit(pcSecond);
+        pReaders->Advance();
+        EXPECT_TRUE(pReaders->IsReclaimable(lRetiredEpoch));
+    }
+
+    TEST(EpochReadersTest, ReadersNeverSeeReclaimedObjects)
+    {
+        struct NODE
+        {
+            std::atomic<bool>   fReclaimed { false };
+            LONG                lRetiredEpoch = 0;
+        };
+
+        constexpr int READERS = 4;
+        constexpr int PUBLISHES = 20000;
+
+        std::unique_ptr<EpochReaders> pReaders;
+        ASSERT_HRESULT_SUCCEEDED(EpochReaders::Create(pReaders));
+
+        // Nodes are only marked reclaimed, and freed once the readers are
+        // done, so that a read of a reclaimed node is seen instead of
+        // crashing.
+        std::vector<std::unique_ptr<NODE>> nodes;
+        nodes.reserve(PUBLISHES + 1);
+        nodes.emplace_back(std::make_unique<NODE>());
+
+        std::atomic<NODE*> pPublished { nodes.back().get() };
+        std::atomic<bool> fDone { false };
+        std::atomic<LONG> cReclaimedReads { 0 };
+
+        std::vector<std::thread> readers;
+        for (int i = 0; i < READERS; i++)
+        {
+            readers.emplace_back([&]()
+            {
+                while (!fDone.load())
+                {
+                    LONG* pcReaders = pReaders->Enter();
+                    NODE* pNode = pPublished.load();
+                    if (pNode->fReclaimed.load())
+                    {
+                        cReclaimedReads++;
+                    }
+                    EpochReaders::Exit(pcReaders);
+                }
+            });
+        }
+
+        std::vector<NODE*> retired;
+        for (int i = 0; i < PUBLISHES; i++)
+        {
+            nodes.emplace_back(std::make_unique<NODE>());
+            NODE* pPrevious = pPublished.exchange(nodes.back().get());
+            pPrevious->lRetiredEpoch = pReaders->QueryEpoch();
+            retired.push_back(pPrevious);
+
+            pReaders->Advance();
+
+            auto itr = retired.begin();
+            while (itr != retired.end())
+            {
+                if (pReaders->IsReclaimable((*itr)->lRetiredEpoch))
+                {
+                    (*itr)->fReclaimed = true;
+                    itr = retired.erase(itr);
+                }
+                else
+                {
+                    ++itr;
+                }
+            }
+        }
+
+        fDone = true;
+        for (auto& reader : readers)
+        {
+            reader.join();
+        }
+
+        EXPECT_EQ(0, cReclaimedReads.load());
+
+        // Without readers left whatever is still retired is reclaimed.
+        pReaders->Advance();
+        for (NODE* pNode : retired)
+        {
+            EXPECT_TRUE(pReaders->IsReclaimable(pNode->lRetiredEpoch));
+        }
+    }
+}
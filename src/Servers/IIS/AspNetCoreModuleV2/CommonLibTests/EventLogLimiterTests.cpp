@@ -0,0 +1,75 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+#include "stdafx.h"
+#include <mutex>
+#include "EventLogLimiter.h"
+
+namespace EventLogLimiterTests
+{
+    struct WrittenEvents
+    {
+        std::mutex                  lock;
+        std::vector<DWORD>          eventIds;
+        std::vector<std::wstring>   messages;
+
+        EventLogLimiter::Sink
+        Sink()
+        {
+            return [this](WORD, DWORD dwEventId, const std::wstring& message)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                eventIds.push_back(dwEventId);
+                messages.push_back(message);
+            };
+        }
+    };
+
+    TEST(EventLogLimiterTest, SuppressesSimilarEventsAndSummarizesThem)
+    {
+        WrittenEvents written;
+        EventLogLimiter limiter(written.Sink(), 3, 60 * 1000);
+
+        // Only the process id differs, these are similar.
+        for (int i = 0; i < 10; ++i)
+        {
+            limiter.Report(EVENTLOG_ERROR_TYPE, 1000, (L"Process " + std::to_wstring(1000 + i) + L" crashed").c_str());
+        }
+
+        limiter.Stop(INFINITE);
+
+        ASSERT_EQ(4u, written.messages.size());
+        EXPECT_EQ(L"Process 1000 crashed", written.messages[0]);
+        EXPECT_EQ(L"Process 1002 crashed", written.messages[2]);
+        EXPECT_EQ(1000u, written.eventIds[3]);
+        EXPECT_EQ(0u, written.messages[3].find(L"7 similar events"));
+        EXPECT_NE(std::wstring::npos, written.messages[3].find(L"Process 1009 crashed"));
+    }
+
+    TEST(EventLogLimiterTest, LimitsEventsOfDifferentIdsAndMessagesSeparately)
+    {
+        WrittenEvents written;
+        EventLogLimiter limiter(written.Sink(), 1, 60 * 1000);
+
+        limiter.Report(EVENTLOG_WARNING_TYPE, 1000, L"Application '/LM/W3SVC/1/ROOT/a' failed");
+        limiter.Report(EVENTLOG_WARNING_TYPE, 1001, L"Application '/LM/W3SVC/1/ROOT/a' failed");
+        limiter.Report(EVENTLOG_WARNING_TYPE, 1000, L"Application '/LM/W3SVC/1/ROOT/b' failed");
+
+        limiter.Stop(INFINITE);
+
+        EXPECT_EQ(3u, written.messages.size());
+    }
+
+    TEST(EventLogLimiterTest, WritesOnTheCallerOnceStopped)
+    {
+        WrittenEvents written;
+        EventLogLimiter limiter(written.Sink(), 1, 60 * 1000);
+
+        limiter.Stop(INFINITE);
+        limiter.Report(EVENTLOG_INFORMATION_TYPE, 1000, L"after stop");
+        limiter.Report(EVENTLOG_INFORMATION_TYPE, 1000, L"after stop");
+
+        ASSERT_EQ(1u, written.messages.size());
+        EXPECT_EQ(L"after stop", written.messages[0]);
+    }
+}
@@ -0,0 +1,88 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+#include "stdafx.h"
+#include "FileHandleCache.h"
+
+namespace FileHandleCacheTests
+{
+    void
+    WriteTestFile(const std::filesystem::path& path, const std::string& content)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << content;
+    }
+
+    TEST(FileHandleCacheTest, OpensFileOnce)
+    {
+        auto tempDirectory = TempDirectory();
+        std::filesystem::create_directories(tempDirectory.path());
+        auto filePath = tempDirectory.path() / L"file.txt";
+        WriteTestFile(filePath, "content");
+
+        FileHandleCache cache;
+        FileHandleCache::Entry* pFirst = nullptr;
+        FileHandleCache::Entry* pSecond = nullptr;
+
+        ASSERT_EQ(S_OK, cache.Open(filePath.c_str(), &pFirst));
+        ASSERT_EQ(S_OK, cache.Open(filePath.c_str(), &pSecond));
+
+        EXPECT_EQ(pFirst, pSecond);
+        EXPECT_NE(INVALID_HANDLE_VALUE, pFirst->QueryHandle());
+        EXPECT_EQ(7u, pFirst->QuerySize());
+        EXPECT_EQ('"', pFirst->QueryETag().front());
+
+        pFirst->Dereference();
+        pSecond->Dereference();
+    }
+
+    TEST(FileHandleCacheTest, ChangedFileIsOpenedAgain)
+    {
+        auto tempDirectory = TempDirectory();
+        std::filesystem::create_directories(tempDirectory.path());
+        auto filePath = tempDirectory.path() / L"file.txt";
+        WriteTestFile(filePath, "content");
+
+        FileHandleCache cache;
+        FileHandleCache::Entry* pFirst = nullptr;
+        ASSERT_EQ(S_OK, cache.Open(filePath.c_str(), &pFirst));
+
+        WriteTestFile(filePath, "changed content");
+
+        // The change is reported asynchronously.
+        FileHandleCache::Entry* pChanged = nullptr;
+        for (int i = 0; i < 100; ++i)
+        {
+            ASSERT_EQ(S_OK, cache.Open(filePath.c_str(), &pChanged));
+            if (pChanged != pFirst)
+            {
+                break;
+            }
+            pChanged->Dereference();
+            pChanged = nullptr;
+            Sleep(100);
+        }
+
+        ASSERT_NE(nullptr, pChanged);
+        EXPECT_EQ(15u, pChanged->QuerySize());
+        EXPECT_NE(pFirst->QueryETag(), pChanged->QueryETag());
+
+        // Still open for the responses sending it.
+        EXPECT_EQ(7u, pFirst->QuerySize());
+
+        pFirst->Dereference();
+        pChanged->Dereference();
+    }
+
+    TEST(FileHandleCacheTest, MissingFileFails)
+    {
+        auto tempDirectory = TempDirectory();
+        std::filesystem::create_directories(tempDirectory.path());
+
+        FileHandleCache cache;
+        FileHandleCache::Entry* pEntry = nullptr;
+
+        EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND), cache.Open((tempDirectory.path() / L"missing.txt").c_str(), &pEntry));
+        EXPECT_EQ(nullptr, pEntry);
+    }
+}
@@ -0,0 +1,61 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+#include "stdafx.h"
+#include "StringHelpers.h"
+
+namespace FlatHashTableTests
+{
+    std::unique_ptr<ENVIRONMENT_VAR_ENTRY, ENVIRONMENT_VAR_ENTRY_DELETER>
+    CreateEntry(PCWSTR pszName, PCWSTR pszValue)
+    {
+        std::unique_ptr<ENVIRONMENT_VAR_ENTRY, ENVIRONMENT_VAR_ENTRY_DELETER> entry(new ENVIRONMENT_VAR_ENTRY());
+        EXPECT_HRESULT_SUCCEEDED(entry->Initialize(pszName, pszValue));
+        return entry;
+    }
+
+    TEST(FlatHashTableTest, FindsRecordsPastGrowthAndDeletes)
+    {
+        std::unique_ptr<ENVIRONMENT_VAR_HASH, ENVIRONMENT_VAR_HASH_DELETER> table(new ENVIRONMENT_VAR_HASH());
+        ASSERT_HRESULT_SUCCEEDED(table->Initialize(4));
+
+        // Grows several times, then leaves deleted slots behind.
+        for (int i = 0; i < 500; i++)
+        {
+            const auto name = format(L"VARIABLE_%d", i);
+            ASSERT_HRESULT_SUCCEEDED(table->InsertRecord(CreateEntry(name.c_str(), L"value").get()));
+        }
+
+        for (int i = 0; i < 500; i += 2)
+        {
+            auto name = format(L"variable_%d", i);
+            table->DeleteKey(name.data());
+        }
+
+        EXPECT_EQ(250u, table->Count());
+
+        for (int i = 0; i < 500; i++)
+        {
+            auto name = format(L"VARIABLE_%d", i);
+            ENVIRONMENT_VAR_ENTRY* pEntry = nullptr;
+            table->FindKey(name.data(), &pEntry);
+
+            EXPECT_EQ(i % 2 == 1, pEntry != nullptr) << name;
+            if (pEntry != nullptr)
+            {
+                EXPECT_STREQ(name.c_str(), pEntry->QueryName());
+                pEntry->Dereference();
+            }
+        }
+    }
+
+    TEST(FlatHashTableTest, RejectsDuplicateKeys)
+    {
+        std::unique_ptr<ENVIRONMENT_VAR_HASH, ENVIRONMENT_VAR_HASH_DELETER> table(new ENVIRONMENT_VAR_HASH());
+        ASSERT_HRESULT_SUCCEEDED(table->Initialize(16));
+
+        ASSERT_HRESULT_SUCCEEDED(table->InsertRecord(CreateEntry(L"PATH", L"a").get()));
+        EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS), table->InsertRecord(CreateEntry(L"Path", L"b").get()));
+        EXPECT_EQ(1u, table->Count());
+    }
+}
@@ -28,6 +28,15 @@ namespace GlobalVersionTests
         RemoveFileNamePath(L"test\\log.txt", L"test");
     }
 
+    TEST(GetAspNetCoreFolderPath, ParentOfVersionFolder)
+    {
+        EXPECT_STREQ(GlobalVersionUtility::GetAspNetCoreFolderPath(L"C:\\Program Files\\IIS\\Asp.Net Core Module\\V2\\19.0.24000").c_str(),
+            L"C:\\Program Files\\IIS\\Asp.Net Core Module\\V2");
+        EXPECT_STREQ(GlobalVersionUtility::GetAspNetCoreFolderPath(L"C:\\Program Files\\IIS\\Asp.Net Core Module\\V2").c_str(),
+            L"C:\\Program Files\\IIS\\Asp.Net Core Module\\V2");
+        EXPECT_STREQ(GlobalVersionUtility::GetAspNetCoreFolderPath(L"2.0.0").c_str(), L"2.0.0");
+    }
+
     TEST(GetRequestHandlerVersions, GetFolders)
     {
         auto tempPath = TempDirectory();
@@ -162,4 +171,26 @@ namespace GlobalVersionTests
 
         EXPECT_STREQ(result.c_str(), (tempPath.path() / L"2.1.0-preview\\aspnetcorev2_outofprocess.dll").c_str());
     }
+
+    TEST(GlobalVersionCache, FindsVersionInstalledAfterFirstScan)
+    {
+        auto tempPath = TempDirectory();
+        EXPECT_TRUE(fs::create_directories(tempPath.path() / "2.0.0"));
+
+        GlobalVersionCache cache;
+        EXPECT_STREQ(cache.FindHighestGlobalVersion(tempPath.path().c_str()).c_str(), L"2.0.0");
+        EXPECT_STREQ(cache.FindHighestGlobalVersion(tempPath.path().c_str()).c_str(), L"2.0.0");
+
+        EXPECT_TRUE(fs::create_directories(tempPath.path() / "2.1.0"));
+
+        // The notification is delivered asynchronously.
+        std::wstring res;
+        for (int i = 0; i < 50 && res != L"2.1.0"; i++)
+        {
+            res = cache.FindHighestGlobalVersion(tempPath.path().c_str());
+            Sleep(100);
+        }
+
+        EXPECT_STREQ(res.c_str(), L"2.1.0");
+    }
 }
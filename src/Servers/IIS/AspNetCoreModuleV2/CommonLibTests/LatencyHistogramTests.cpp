@@ -0,0 +1,89 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+#include "stdafx.h"
+#include <thread>
+#include "LatencyHistogram.h"
+
+namespace LatencyHistogramTests
+{
+    TEST(LatencyHistogramTest, BucketsKeepValuesWithinPrecision)
+    {
+        for (ULONGLONG ullValue = 0; ullValue < LatencyHistogramSnapshot::SUB_BUCKETS; ullValue++)
+        {
+            EXPECT_EQ(ullValue, LatencyHistogramSnapshot::QueryBucketUpperBound(LatencyHistogramSnapshot::QueryBucket(ullValue)));
+        }
+
+        DWORD iPrevious = 0;
+        for (ULONGLONG ullValue = 1; ullValue < (1ULL << LatencyHistogramSnapshot::MAX_EXPONENT); ullValue += ullValue / 7 + 1)
+        {
+            const DWORD iBucket = LatencyHistogramSnapshot::QueryBucket(ullValue);
+            const ULONGLONG ullUpperBound = LatencyHistogramSnapshot::QueryBucketUpperBound(iBucket);
+
+            EXPECT_LE(iPrevious, iBucket);
+            EXPECT_LE(ullValue, ullUpperBound);
+            EXPECT_LE(ullUpperBound - ullValue, ullValue / LatencyHistogramSnapshot::SUB_BUCKETS);
+            iPrevious = iBucket;
+        }
+
+        EXPECT_EQ(LatencyHistogramSnapshot::BUCKETS - 1, LatencyHistogramSnapshot::QueryBucket(MAXULONGLONG));
+    }
+
+    TEST(LatencyHistogramTest, PercentilesOfRecordedValues)
+    {
+        std::unique_ptr<LatencyHistogram> pHistogram;
+        ASSERT_HRESULT_SUCCEEDED(LatencyHistogram::Create(pHistogram));
+
+        for (ULONGLONG ullValue = 1; ullValue <= 1000; ullValue++)
+        {
+            pHistogram->Record(ullValue);
+        }
+
+        LatencyHistogramSnapshot snapshot;
+        pHistogram->Snapshot(snapshot);
+
+        EXPECT_EQ(1000, snapshot.QueryCount());
+        EXPECT_EQ(500500, snapshot.QuerySum());
+        EXPECT_EQ(1u, snapshot.QueryPercentile(0));
+        EXPECT_NEAR(500.0, static_cast<double>(snapshot.QueryPercentile(50)), 500.0 / 16);
+        EXPECT_NEAR(990.0, static_cast<double>(snapshot.QueryPercentile(99)), 990.0 / 16);
+        EXPECT_NEAR(1000.0, static_cast<double>(snapshot.QueryPercentile(100)), 1000.0 / 16);
+    }
+
+    TEST(LatencyHistogramTest, MergesSnapshotsAndConcurrentRecords)
+    {
+        std::unique_ptr<LatencyHistogram> pFirst;
+        std::unique_ptr<LatencyHistogram> pSecond;
+        ASSERT_HRESULT_SUCCEEDED(LatencyHistogram::Create(pFirst));
+        ASSERT_HRESULT_SUCCEEDED(LatencyHistogram::Create(pSecond));
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++)
+        {
+            threads.emplace_back([&pFirst]()
+            {
+                for (int i = 0; i < 10000; i++)
+                {
+                    pFirst->Record(10);
+                }
+            });
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        pSecond->Record(100000);
+
+        LatencyHistogramSnapshot merged;
+        LatencyHistogramSnapshot second;
+        pFirst->Snapshot(merged);
+        pSecond->Snapshot(second);
+        merged.Merge(second);
+
+        EXPECT_EQ(40001, merged.QueryCount());
+        EXPECT_EQ(10u, merged.QueryPercentile(99.99));
+        EXPECT_LE(100000u, merged.QueryPercentile(100));
+    }
+}
@@ -0,0 +1,87 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+#include "stdafx.h"
+#include <thread>
+#include "percputracelog.h"
+
+namespace PerCpuRefTraceLogTests
+{
+    struct LogDeleter
+    {
+        void operator()(PER_CPU_REF_TRACE_LOG* pLog) const noexcept
+        {
+            pLog->Destroy();
+        }
+    };
+
+    std::unique_ptr<PER_CPU_REF_TRACE_LOG, LogDeleter>
+    CreateLog(LONG cEntriesPerProcessor, BOOL fCaptureStack)
+    {
+        PER_CPU_REF_TRACE_LOG* pLog = nullptr;
+        EXPECT_HRESULT_SUCCEEDED(PER_CPU_REF_TRACE_LOG::Create(cEntriesPerProcessor, fCaptureStack, &pLog));
+        return std::unique_ptr<PER_CPU_REF_TRACE_LOG, LogDeleter>(pLog);
+    }
+
+    TEST(PerCpuRefTraceLogTest, MergesRingsOldestFirst)
+    {
+        auto log = CreateLog(1024, FALSE);
+        ASSERT_NE(nullptr, log);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++)
+        {
+            threads.emplace_back([&log, t]()
+            {
+                for (LONG i = 0; i < 100; i++)
+                {
+                    log->Write(i, reinterpret_cast<PVOID>(static_cast<DWORD_PTR>(t + 1)));
+                }
+            });
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        std::vector<PER_CPU_REF_TRACE_LOG_ENTRY> entries;
+        ASSERT_HRESULT_SUCCEEDED(log->Snapshot(entries));
+        ASSERT_EQ(400u, entries.size());
+
+        // Every thread's writes come out in the order it made them.
+        LONG rgLastRefCount[4] = { -1, -1, -1, -1 };
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            if (i > 0)
+            {
+                EXPECT_LE(entries[i - 1].llTimestamp, entries[i].llTimestamp);
+            }
+
+            const auto t = reinterpret_cast<DWORD_PTR>(entries[i].Context) - 1;
+            ASSERT_LT(t, 4u);
+            EXPECT_EQ(rgLastRefCount[t] + 1, entries[i].NewRefCount);
+            rgLastRefCount[t] = entries[i].NewRefCount;
+            EXPECT_EQ(nullptr, entries[i].Stack[0]);
+        }
+    }
+
+    TEST(PerCpuRefTraceLogTest, KeepsLastEntriesAndCapturesStacks)
+    {
+        auto log = CreateLog(8, TRUE);
+        ASSERT_NE(nullptr, log);
+
+        // A single thread may still move between processors, so only
+        // the newest entry is sure to be kept.
+        for (LONG i = 0; i < 100; i++)
+        {
+            log->Write(i, nullptr);
+        }
+
+        std::vector<PER_CPU_REF_TRACE_LOG_ENTRY> entries;
+        ASSERT_HRESULT_SUCCEEDED(log->Snapshot(entries));
+        ASSERT_FALSE(entries.empty());
+        EXPECT_EQ(99, entries.back().NewRefCount);
+        EXPECT_NE(nullptr, entries.back().Stack[0]);
+    }
+}
@@ -0,0 +1,57 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+#include "stdafx.h"
+#include <algorithm>
+#include "percpu.h"
+
+namespace PerCpuTests
+{
+    struct LARGE_OBJECT
+    {
+        BYTE    rgbData[200];
+    };
+
+    TEST(PerCpuTest, ObjectsLargerThanCacheLineDoNotOverlap)
+    {
+        PER_CPU<LARGE_OBJECT>* pObjects = nullptr;
+        ASSERT_HRESULT_SUCCEEDED(PER_CPU<LARGE_OBJECT>::Create([](LARGE_OBJECT* pObject)
+        {
+            ZeroMemory(pObject, sizeof(*pObject));
+        }, &pObjects));
+
+        std::vector<PBYTE> objects;
+        pObjects->ForEach([&objects](LARGE_OBJECT* pObject)
+        {
+            objects.push_back(reinterpret_cast<PBYTE>(pObject));
+        });
+
+        std::sort(objects.begin(), objects.end());
+        for (size_t i = 0; i < objects.size(); i++)
+        {
+            EXPECT_EQ(0u, reinterpret_cast<ULONG_PTR>(objects[i]) % SYSTEM_CACHE_ALIGNMENT_SIZE);
+            if (i > 0)
+            {
+                EXPECT_GE(static_cast<size_t>(objects[i] - objects[i - 1]), sizeof(LARGE_OBJECT));
+            }
+        }
+
+        //
+        // Each object keeps what was written to it.
+        //
+        BYTE bValue = 0;
+        pObjects->ForEach([&bValue](LARGE_OBJECT* pObject)
+        {
+            FillMemory(pObject->rgbData, sizeof(pObject->rgbData), ++bValue);
+        });
+
+        bValue = 0;
+        pObjects->ForEach([&bValue](LARGE_OBJECT* pObject)
+        {
+            ++bValue;
+            EXPECT_TRUE(std::all_of(std::begin(pObject->rgbData), std::end(pObject->rgbData), [bValue](BYTE b) { return b == bValue; }));
+        });
+
+        pObjects->Dispose();
+    }
+}
@@ -0,0 +1,34 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+#include "stdafx.h"
+#include "RegistryKey.h"
+
+namespace RegistryKeyTests
+{
+    const std::wstring TestKeyName = L"Software\\Microsoft\\ASP.NET Core Module Tests\\CachedRegistryKey";
+
+    void
+    SetTestValue(DWORD dwValue)
+    {
+        ASSERT_EQ(NO_ERROR, RegSetKeyValue(HKEY_CURRENT_USER, TestKeyName.c_str(), L"Value", REG_DWORD, &dwValue, sizeof(dwValue)));
+    }
+
+    TEST(CachedRegistryKeyTest, SeesCreatedAndChangedValues)
+    {
+        RegDeleteTree(HKEY_CURRENT_USER, TestKeyName.c_str());
+
+        CachedRegistryKey key(HKEY_CURRENT_USER, TestKeyName);
+        EXPECT_FALSE(key.TryGetDWORD(L"Value").has_value());
+
+        SetTestValue(1);
+        EXPECT_EQ(1u, key.TryGetDWORD(L"Value").value_or(0));
+        EXPECT_EQ(1u, key.TryGetDWORD(L"Value").value_or(0));
+
+        SetTestValue(2);
+        EXPECT_EQ(2u, key.TryGetDWORD(L"Value").value_or(0));
+
+        RegDeleteTree(HKEY_CURRENT_USER, TestKeyName.c_str());
+        EXPECT_FALSE(key.TryGetDWORD(L"Value").has_value());
+    }
+}
@@ -46,6 +46,72 @@ namespace FileRedirectionOutputTests
         Test(L"", stderr);
         Test(L"log", stderr);
     }
+
+    TEST(FileRedirectionOutputRollingTest, RollsBySizeAndKeepsAllOutput)
+    {
+        auto tempDirectory = TempDirectory();
+
+        FileRollingOptions rollingOptions;
+        rollingOptions.maxFileSizeBytes = 8;
+
+        {
+            FileRedirectionOutput redirectionOutput(tempDirectory.path(), L"log", rollingOptions);
+            redirectionOutput.Append(L"first");
+            redirectionOutput.Append(L"second");
+            redirectionOutput.Append(L"third");
+        }
+
+        std::wstring content;
+        size_t files = 0;
+        for (auto & p : std::filesystem::directory_iterator(tempDirectory.path()))
+        {
+            content += Helpers::ReadFileContent(std::wstring(p.path()));
+            files++;
+        }
+
+        ASSERT_EQ(files, 3);
+        ASSERT_EQ(content.size(), std::wstring(L"firstsecondthird").size());
+    }
+
+    TEST(FileRedirectionOutputEncodingTest, WritesUtf8WithCrLf)
+    {
+        auto tempDirectory = TempDirectory();
+
+        {
+            FileRedirectionOutput redirectionOutput(tempDirectory.path(), L"log");
+            redirectionOutput.Append(L"ascii text longer than a block\n");
+            redirectionOutput.Append(L"caf\u00e9 \U0001F600\r\n");
+        }
+
+        std::string content;
+        for (auto & p : std::filesystem::directory_iterator(tempDirectory.path()))
+        {
+            std::ifstream file(p.path(), std::ios::binary);
+            content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+
+        ASSERT_EQ(content, std::string("ascii text longer than a block\r\ncaf\xC3\xA9 \xF0\x9F\x98\x80\r\n"));
+    }
+
+    TEST(FileRedirectionOutputEncodingTest, WritesUtf8BytesAsTheyAre)
+    {
+        auto tempDirectory = TempDirectory();
+
+        {
+            FileRedirectionOutput redirectionOutput(tempDirectory.path(), L"log");
+            redirectionOutput.AppendBytes("first\nsecond\r\n", CP_UTF8);
+            redirectionOutput.AppendBytes("caf\xC3\xA9\n", CP_UTF8);
+        }
+
+        std::string content;
+        for (auto & p : std::filesystem::directory_iterator(tempDirectory.path()))
+        {
+            std::ifstream file(p.path(), std::ios::binary);
+            content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+
+        ASSERT_EQ(content, std::string("first\r\nsecond\r\ncaf\xC3\xA9\r\n"));
+    }
 }
 
 namespace PipeOutputManagerTests
@@ -0,0 +1,60 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+#include "stdafx.h"
+#include "HandleWrapper.h"
+#include "TimerWheel.h"
+
+namespace TimerWheelTests
+{
+    struct FiredTimer
+    {
+        HandleWrapper<NullHandleTraits> hFired { CreateEvent(nullptr, TRUE, FALSE, nullptr) };
+        volatile LONG                   cFired = 0;
+
+        static
+        VOID
+        CALLBACK
+        Callback(PVOID pContext)
+        {
+            auto pFired = static_cast<FiredTimer*>(pContext);
+            InterlockedIncrement(&pFired->cFired);
+            SetEvent(pFired->hFired);
+        }
+    };
+
+    TEST(TimerWheelTest, FiresTimersInDueOrder)
+    {
+        TimerWheel wheel;
+        FiredTimer first;
+        FiredTimer second;
+        TimerWheel::Timer secondTimer(FiredTimer::Callback, &second, wheel);
+        TimerWheel::Timer firstTimer(FiredTimer::Callback, &first, wheel);
+
+        // Past the first wheel, the second one cascades into it.
+        ASSERT_EQ(S_OK, secondTimer.Set(TimerWheel::TICK_MS * 100));
+        ASSERT_EQ(S_OK, firstTimer.Set(TimerWheel::TICK_MS));
+
+        ASSERT_EQ(WAIT_OBJECT_0, WaitForSingleObject(first.hFired, 10000));
+        EXPECT_EQ(0, InterlockedCompareExchange(&second.cFired, 0, 0));
+
+        ASSERT_EQ(WAIT_OBJECT_0, WaitForSingleObject(second.hFired, 10000));
+        EXPECT_EQ(1, InterlockedCompareExchange(&first.cFired, 0, 0));
+    }
+
+    TEST(TimerWheelTest, CancelledTimerDoesNotFire)
+    {
+        TimerWheel wheel;
+        FiredTimer cancelled;
+        FiredTimer fired;
+        TimerWheel::Timer cancelledTimer(FiredTimer::Callback, &cancelled, wheel);
+        TimerWheel::Timer firedTimer(FiredTimer::Callback, &fired, wheel);
+
+        ASSERT_EQ(S_OK, cancelledTimer.Set(TimerWheel::TICK_MS * 2));
+        ASSERT_EQ(S_OK, firedTimer.Set(TimerWheel::TICK_MS * 10));
+        cancelledTimer.Cancel();
+
+        ASSERT_EQ(WAIT_OBJECT_0, WaitForSingleObject(fired.hFired, 10000));
+        EXPECT_EQ(0, InterlockedCompareExchange(&cancelled.cFired, 0, 0));
+    }
+}
@@ -4,6 +4,7 @@
 #include "stdafx.h"
 #include "Environment.h"
 #include "StringHelpers.h"
+#include "applicationcounters.h"
 
 TEST(PassUnexpandedEnvString, ExpandsResult)
 {
@@ -73,3 +74,96 @@ TEST(CheckStringHelpers, FormatWithoutContentDoesNotIncreaseSizeWstring)
     auto result = format(testString);
     EXPECT_EQ(testString.size(), result.size());
 }
+
+TEST(CheckStringHelpers, StartsWithPathMatchesSelfAndDescendants)
+{
+    EXPECT_TRUE(starts_with_path(L"MACHINE/WEBROOT/APPHOST/site", L"MACHINE/WEBROOT/APPHOST/site"));
+    EXPECT_TRUE(starts_with_path(L"MACHINE/WEBROOT/APPHOST/site/app", L"MACHINE/WEBROOT/APPHOST/site"));
+    EXPECT_TRUE(starts_with_path(L"MACHINE/WEBROOT/APPHOST/site", L"MACHINE/WEBROOT/APPHOST"));
+    EXPECT_TRUE(starts_with_path(L"MACHINE/WEBROOT/APPHOST/site", L""));
+}
+
+TEST(CheckStringHelpers, StartsWithPathTrailingSlash)
+{
+    EXPECT_TRUE(starts_with_path(L"MACHINE/WEBROOT/APPHOST/site/app", L"MACHINE/WEBROOT/APPHOST/site/"));
+    EXPECT_TRUE(starts_with_path(L"MACHINE/WEBROOT/APPHOST/site/", L"MACHINE/WEBROOT/APPHOST/site"));
+    EXPECT_FALSE(starts_with_path(L"MACHINE/WEBROOT/APPHOST/site", L"MACHINE/WEBROOT/APPHOST/site/"));
+}
+
+TEST(CheckStringHelpers, StartsWithPathRequiresSegmentBoundary)
+{
+    EXPECT_FALSE(starts_with_path(L"MACHINE/WEBROOT/APPHOST/siteTest", L"MACHINE/WEBROOT/APPHOST/site"));
+    EXPECT_FALSE(starts_with_path(L"MACHINE/WEBROOT/APPHOST/siteTest/app", L"MACHINE/WEBROOT/APPHOST/site"));
+    EXPECT_FALSE(starts_with_path(L"MACHINE/WEBROOT/APPHOST/site", L"MACHINE/WEBROOT/APPHOST/site/app"));
+}
+
+TEST(CheckStringHelpers, StartsWithPathIsCaseSensitive)
+{
+    EXPECT_FALSE(starts_with_path(L"MACHINE/WEBROOT/APPHOST/Site", L"MACHINE/WEBROOT/APPHOST/site"));
+    EXPECT_FALSE(starts_with_path(L"MACHINE/WEBROOT/APPHOST/site/app", L"machine/webroot/apphost/site"));
+}
+
+TEST(ArenaStrings, GrowIntoArena)
+{
+    BUMP_ARENA arena(256);
+    ARENA_STRU(struValue, 4, &arena);
+    ARENA_STRA(strValue, 4, &arena);
+
+    for (int i = 0; i < 100; i++)
+    {
+        EXPECT_HRESULT_SUCCEEDED(struValue.Append(L"0123456789"));
+        EXPECT_HRESULT_SUCCEEDED(strValue.Append("0123456789"));
+    }
+
+    EXPECT_EQ(struValue.QueryCCH(), 1000u);
+    EXPECT_EQ(strValue.QueryCCH(), 1000u);
+    EXPECT_EQ(wcsncmp(struValue.QueryStr() + 990, L"0123456789", 10), 0);
+    EXPECT_EQ(strncmp(strValue.QueryStr() + 990, "0123456789", 10), 0);
+}
+
+TEST(ApplicationCounters, AddUpAcrossOwners)
+{
+    APPLICATION_COUNTERS counters;
+    APPLICATION_COUNTERS otherCounters;
+    ASSERT_HRESULT_SUCCEEDED(counters.Initialize());
+    ASSERT_HRESULT_SUCCEEDED(otherCounters.Initialize());
+
+    counters.RequestStarted();
+    counters.RequestStarted();
+    counters.RequestCompleted();
+    counters.RecordForward(100);
+    counters.RecordForward(300);
+    counters.RecordForwardingError(APPLICATION_COUNTERS::FORWARDING_ERROR_TIMEOUT);
+    otherCounters.BackendRestarted();
+    otherCounters.RapidFailTripped();
+
+    APPLICATION_COUNTERS::SNAPSHOT snapshot = {};
+    counters.AddToSnapshot(&snapshot);
+    otherCounters.AddToSnapshot(&snapshot);
+
+    EXPECT_EQ(snapshot.cTotalRequests, 2);
+    EXPECT_EQ(snapshot.cActiveRequests, 1);
+    EXPECT_EQ(snapshot.cForwardedRequests, 2);
+    EXPECT_EQ(snapshot.llForwardMicroseconds, 400);
+    EXPECT_EQ(snapshot.rgcForwardingErrors[APPLICATION_COUNTERS::FORWARDING_ERROR_TIMEOUT], 1);
+    EXPECT_EQ(snapshot.cBackendRestarts, 1);
+    EXPECT_EQ(snapshot.cRapidFailTrips, 1);
+}
+
+TEST(ApplicationCounters, TrackMemoryByTag)
+{
+    APPLICATION_COUNTERS counters;
+    ASSERT_HRESULT_SUCCEEDED(counters.Initialize());
+
+    counters.MemoryCharged(APPLICATION_COUNTERS::MEMORY_TAG_RESPONSE_BUFFERS, 8192);
+    counters.MemoryCharged(APPLICATION_COUNTERS::MEMORY_TAG_RESPONSE_BUFFERS, 4096);
+    counters.MemoryCharged(APPLICATION_COUNTERS::MEMORY_TAG_HANDLERS, 512);
+    counters.MemoryReleased(APPLICATION_COUNTERS::MEMORY_TAG_RESPONSE_BUFFERS, 8192);
+
+    APPLICATION_COUNTERS::SNAPSHOT snapshot = {};
+    counters.AddToSnapshot(&snapshot);
+
+    EXPECT_EQ(snapshot.rgcbMemory[APPLICATION_COUNTERS::MEMORY_TAG_RESPONSE_BUFFERS], 4096);
+    EXPECT_EQ(snapshot.rgcbMemory[APPLICATION_COUNTERS::MEMORY_TAG_HANDLERS], 512);
+    EXPECT_EQ(snapshot.rgcbMemory[APPLICATION_COUNTERS::MEMORY_TAG_WEBSOCKET_BUFFERS], 0);
+}
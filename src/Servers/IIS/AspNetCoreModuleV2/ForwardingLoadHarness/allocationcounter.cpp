@@ -0,0 +1,215 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include "exceptions.h"
+
+decltype(&HeapAlloc)    ALLOCATION_COUNTER::sm_pfnHeapAlloc = HeapAlloc;
+decltype(&HeapReAlloc)  ALLOCATION_COUNTER::sm_pfnHeapReAlloc = HeapReAlloc;
+volatile BOOL           ALLOCATION_COUNTER::sm_fEnabled = FALSE;
+volatile LONG64         ALLOCATION_COUNTER::sm_cAllocations = 0;
+
+#ifndef ANCM_ALLOCATION_TRACKING
+//
+// Replacements of the global allocation functions, everything else the
+// standard library offers is built on these. A build with allocation
+// tracking gets those of CommonLib instead, which this does not count.
+//
+void *
+operator new(
+    size_t  cbSize
+)
+{
+    ALLOCATION_COUNTER::Count();
+
+    void *pv = malloc(cbSize != 0 ? cbSize : 1);
+    if (pv == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    return pv;
+}
+
+void *
+operator new(
+    size_t                  cbSize,
+    const std::nothrow_t &
+) noexcept
+{
+    ALLOCATION_COUNTER::Count();
+
+    return malloc(cbSize != 0 ? cbSize : 1);
+}
+
+void *
+operator new[](
+    size_t  cbSize
+)
+{
+    return operator new(cbSize);
+}
+
+void *
+operator new[](
+    size_t                  cbSize,
+    const std::nothrow_t &  nothrow
+) noexcept
+{
+    return operator new(cbSize, nothrow);
+}
+
+void
+operator delete(
+    void *  pv
+) noexcept
+{
+    free(pv);
+}
+
+void
+operator delete(
+    void *  pv,
+    size_t
+) noexcept
+{
+    free(pv);
+}
+
+void
+operator delete[](
+    void *  pv
+) noexcept
+{
+    free(pv);
+}
+
+void
+operator delete[](
+    void *  pv,
+    size_t
+) noexcept
+{
+    free(pv);
+}
+#endif
+
+// static
+HRESULT
+ALLOCATION_COUNTER::Install(
+    VOID
+)
+{
+    PVOID pfnOriginal;
+
+    RETURN_IF_FAILED(PatchImport("HeapAlloc", reinterpret_cast<PVOID>(HeapAllocHook), &pfnOriginal));
+    sm_pfnHeapAlloc = reinterpret_cast<decltype(&HeapAlloc)>(pfnOriginal);
+
+    RETURN_IF_FAILED(PatchImport("HeapReAlloc", reinterpret_cast<PVOID>(HeapReAllocHook), &pfnOriginal));
+    sm_pfnHeapReAlloc = reinterpret_cast<decltype(&HeapReAlloc)>(pfnOriginal);
+
+    return S_OK;
+}
+
+// static
+LPVOID
+WINAPI
+ALLOCATION_COUNTER::HeapAllocHook(
+    _In_ HANDLE     hHeap,
+    _In_ DWORD      dwFlags,
+    _In_ SIZE_T     cbBytes
+)
+{
+    Count();
+
+    return sm_pfnHeapAlloc(hHeap, dwFlags, cbBytes);
+}
+
+// static
+LPVOID
+WINAPI
+ALLOCATION_COUNTER::HeapReAllocHook(
+    _In_ HANDLE     hHeap,
+    _In_ DWORD      dwFlags,
+    _In_ LPVOID     pvMemory,
+    _In_ SIZE_T     cbBytes
+)
+{
+    Count();
+
+    return sm_pfnHeapReAlloc(hHeap, dwFlags, pvMemory, cbBytes);
+}
+
+// static
+HRESULT
+ALLOCATION_COUNTER::PatchImport(
+    _In_ PCSTR      pszFunction,
+    _In_ PVOID      pfnHook,
+    _Out_ PVOID *   ppfnOriginal
+)
+/*++
+
+Routine Description:
+
+    Point the import of the executable named pszFunction at pfnHook.
+    Whichever DLL it is imported from, heap functions are imported by
+    name.
+
+--*/
+{
+    BYTE *                      pbImage = reinterpret_cast<BYTE *>(GetModuleHandleW(NULL));
+    const IMAGE_DOS_HEADER *    pDosHeader = reinterpret_cast<const IMAGE_DOS_HEADER *>(pbImage);
+    const IMAGE_NT_HEADERS *    pNtHeaders = reinterpret_cast<const IMAGE_NT_HEADERS *>(pbImage + pDosHeader->e_lfanew);
+    const IMAGE_DATA_DIRECTORY &directory = pNtHeaders->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+
+    *ppfnOriginal = NULL;
+
+    if (directory.VirtualAddress == 0)
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_PROC_NOT_FOUND));
+    }
+
+    for (const IMAGE_IMPORT_DESCRIPTOR *pDescriptor = reinterpret_cast<const IMAGE_IMPORT_DESCRIPTOR *>(pbImage + directory.VirtualAddress);
+         pDescriptor->Name != 0;
+         pDescriptor++)
+    {
+        if (pDescriptor->OriginalFirstThunk == 0)
+        {
+            continue;
+        }
+
+        const IMAGE_THUNK_DATA *pNameThunk = reinterpret_cast<const IMAGE_THUNK_DATA *>(pbImage + pDescriptor->OriginalFirstThunk);
+        IMAGE_THUNK_DATA *pAddressThunk = reinterpret_cast<IMAGE_THUNK_DATA *>(pbImage + pDescriptor->FirstThunk);
+
+        for (; pNameThunk->u1.AddressOfData != 0; pNameThunk++, pAddressThunk++)
+        {
+            if (IMAGE_SNAP_BY_ORDINAL(pNameThunk->u1.Ordinal))
+            {
+                continue;
+            }
+
+            const IMAGE_IMPORT_BY_NAME *pImport = reinterpret_cast<const IMAGE_IMPORT_BY_NAME *>(pbImage + pNameThunk->u1.AddressOfData);
+            if (strcmp(reinterpret_cast<PCSTR>(pImport->Name), pszFunction) != 0)
+            {
+                continue;
+            }
+
+            DWORD dwOldProtect;
+            RETURN_LAST_ERROR_IF(!VirtualProtect(&pAddressThunk->u1.Function,
+                sizeof(pAddressThunk->u1.Function),
+                PAGE_READWRITE,
+                &dwOldProtect));
+
+            *ppfnOriginal = reinterpret_cast<PVOID>(pAddressThunk->u1.Function);
+            pAddressThunk->u1.Function = reinterpret_cast<ULONG_PTR>(pfnHook);
+
+            VirtualProtect(&pAddressThunk->u1.Function,
+                sizeof(pAddressThunk->u1.Function),
+                dwOldProtect,
+                &dwOldProtect);
+
+            return S_OK;
+        }
+    }
+
+    RETURN_HR(HRESULT_FROM_WIN32(ERROR_PROC_NOT_FOUND));
+}
@@ -0,0 +1,104 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// Counts the heap allocations made by the code linked into the harness:
+// operator new, which the harness replaces, and HeapAlloc/HeapReAlloc,
+// which Install() redirects in the import table of the executable. The
+// handler, IISLib and CommonLib are linked in statically so all of their
+// allocations go through one of the two. The UCRT is linked as a DLL, so
+// a direct malloc is not counted, nor is what WinHTTP allocates.
+//
+// Counting is off until Enable() so that a run not asking for it pays
+// nothing but a predictable branch. Once on, every thread increments the
+// same counter, so the throughput of a counting run does not compare with
+// the one of a run without.
+//
+class ALLOCATION_COUNTER
+{
+public:
+
+    static
+    HRESULT
+    Install(
+        VOID
+    );
+
+    static
+    VOID
+    Enable(
+        VOID
+    )
+    {
+        sm_fEnabled = TRUE;
+    }
+
+    static
+    BOOL
+    IsEnabled(
+        VOID
+    )
+    {
+        return sm_fEnabled;
+    }
+
+    static
+    LONG64
+    QueryAllocations(
+        VOID
+    )
+    {
+        return sm_cAllocations;
+    }
+
+    __forceinline
+    static
+    VOID
+    Count(
+        VOID
+    )
+    {
+        if (sm_fEnabled)
+        {
+            InterlockedIncrement64(&sm_cAllocations);
+        }
+    }
+
+private:
+
+    ALLOCATION_COUNTER();
+
+    static
+    LPVOID
+    WINAPI
+    HeapAllocHook(
+        _In_ HANDLE     hHeap,
+        _In_ DWORD      dwFlags,
+        _In_ SIZE_T     cbBytes
+    );
+
+    static
+    LPVOID
+    WINAPI
+    HeapReAllocHook(
+        _In_ HANDLE     hHeap,
+        _In_ DWORD      dwFlags,
+        _In_ LPVOID     pvMemory,
+        _In_ SIZE_T     cbBytes
+    );
+
+    static
+    HRESULT
+    PatchImport(
+        _In_ PCSTR      pszFunction,
+        _In_ PVOID      pfnHook,
+        _Out_ PVOID *   ppfnOriginal
+    );
+
+    static decltype(&HeapAlloc)     sm_pfnHeapAlloc;
+    static decltype(&HeapReAlloc)   sm_pfnHeapReAlloc;
+    static volatile BOOL            sm_fEnabled;
+    static volatile LONG64          sm_cAllocations;
+};
@@ -0,0 +1,1020 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include "exceptions.h"
+
+//
+// Names of the known headers, in HTTP_HEADER_ID order.
+//
+static const PCSTR  g_rgpszRequestHeaderNames[HttpHeaderRequestMaximum] =
+{
+    "Cache-Control", "Connection", "Date", "Keep-Alive", "Pragma",
+    "Trailer", "Transfer-Encoding", "Upgrade", "Via", "Warning",
+    "Allow", "Content-Length", "Content-Type", "Content-Encoding", "Content-Language",
+    "Content-Location", "Content-MD5", "Content-Range", "Expires", "Last-Modified",
+    "Accept", "Accept-Charset", "Accept-Encoding", "Accept-Language", "Authorization",
+    "Cookie", "Expect", "From", "Host", "If-Match",
+    "If-Modified-Since", "If-None-Match", "If-Range", "If-Unmodified-Since", "Max-Forwards",
+    "Proxy-Authorization", "Referer", "Range", "TE", "Translate",
+    "User-Agent"
+};
+
+static const PCSTR  g_rgpszResponseHeaderNames[HttpHeaderResponseMaximum] =
+{
+    "Cache-Control", "Connection", "Date", "Keep-Alive", "Pragma",
+    "Trailer", "Transfer-Encoding", "Upgrade", "Via", "Warning",
+    "Allow", "Content-Length", "Content-Type", "Content-Encoding", "Content-Language",
+    "Content-Location", "Content-MD5", "Content-Range", "Expires", "Last-Modified",
+    "Accept-Ranges", "Age", "ETag", "Location", "Proxy-Authenticate",
+    "Retry-After", "Server", "Set-Cookie", "Vary", "WWW-Authenticate"
+};
+
+//
+// Fills request bodies, the backend does not look at them.
+//
+static const BYTE   g_bRequestBodyPattern = 'a';
+
+HRESULT
+FAKE_REQUEST_MEMORY::Initialize(
+    SIZE_T      cbCapacity
+)
+{
+    try
+    {
+        m_buffer.resize(cbCapacity);
+    }
+    CATCH_RETURN();
+
+    m_cbUsed = 0;
+    return S_OK;
+}
+
+VOID *
+FAKE_REQUEST_MEMORY::Alloc(
+    SIZE_T      cbSize
+)
+{
+    SIZE_T cbAligned = (cbSize + 7) & ~static_cast<SIZE_T>(7);
+
+    if (cbAligned < cbSize || cbAligned > m_buffer.size() - m_cbUsed)
+    {
+        return NULL;
+    }
+
+    VOID *pv = m_buffer.data() + m_cbUsed;
+    m_cbUsed += cbAligned;
+    return pv;
+}
+
+PSTR
+FAKE_REQUEST_MEMORY::CopyA(
+    _In_reads_(cch) PCSTR   psz,
+    SIZE_T                  cch
+)
+{
+    PSTR pszCopy = static_cast<PSTR>(Alloc(cch + 1));
+    if (pszCopy != NULL)
+    {
+        memcpy(pszCopy, psz, cch);
+        pszCopy[cch] = '\0';
+    }
+    return pszCopy;
+}
+
+VOID
+FAKE_HEADERS::Attach(
+    _In_ HTTP_KNOWN_HEADER *        pKnownHeaders,
+    _In_ USHORT *                   pcUnknownHeaders,
+    _In_ PHTTP_UNKNOWN_HEADER *     ppUnknownHeaders,
+    _In_ FAKE_REQUEST_MEMORY *      pMemory
+)
+{
+    m_pKnownHeaders = pKnownHeaders;
+    m_pcUnknownHeaders = pcUnknownHeaders;
+    m_ppUnknownHeaders = ppUnknownHeaders;
+    m_pMemory = pMemory;
+
+    *m_ppUnknownHeaders = m_rgUnknownHeaders;
+    Clear();
+}
+
+VOID
+FAKE_HEADERS::Clear(
+    VOID
+)
+{
+    ZeroMemory(m_pKnownHeaders, m_cKnown * sizeof(HTTP_KNOWN_HEADER));
+    *m_pcUnknownHeaders = 0;
+}
+
+DWORD
+FAKE_HEADERS::FindKnown(
+    _In_ PCSTR          pszName
+) const
+{
+    for (DWORD i = 0; i < m_cKnown; i++)
+    {
+        if (_stricmp(m_ppszKnownNames[i], pszName) == 0)
+        {
+            return i;
+        }
+    }
+    return m_cKnown;
+}
+
+PCSTR
+FAKE_HEADERS::Get(
+    _In_ PCSTR          pszName,
+    _Out_opt_ USHORT *  pcchValue
+) const
+{
+    DWORD dwIndex = FindKnown(pszName);
+    if (dwIndex < m_cKnown)
+    {
+        return Get(dwIndex, pcchValue);
+    }
+
+    for (USHORT i = 0; i < *m_pcUnknownHeaders; i++)
+    {
+        if (_stricmp(m_rgUnknownHeaders[i].pName, pszName) == 0)
+        {
+            if (pcchValue != NULL)
+            {
+                *pcchValue = m_rgUnknownHeaders[i].RawValueLength;
+            }
+            return m_rgUnknownHeaders[i].pRawValue;
+        }
+    }
+
+    if (pcchValue != NULL)
+    {
+        *pcchValue = 0;
+    }
+    return NULL;
+}
+
+PCSTR
+FAKE_HEADERS::Get(
+    DWORD               dwIndex,
+    _Out_opt_ USHORT *  pcchValue
+) const
+{
+    PCSTR pszValue = dwIndex < m_cKnown ? m_pKnownHeaders[dwIndex].pRawValue : NULL;
+
+    if (pcchValue != NULL)
+    {
+        *pcchValue = pszValue != NULL ? m_pKnownHeaders[dwIndex].RawValueLength : 0;
+    }
+    return pszValue;
+}
+
+HRESULT
+FAKE_HEADERS::Set(
+    _In_ PCSTR                      pszName,
+    _In_reads_(cchValue) PCSTR      pszValue,
+    USHORT                          cchValue,
+    BOOL                            fReplace
+)
+{
+    DWORD dwIndex = FindKnown(pszName);
+    if (dwIndex < m_cKnown)
+    {
+        return Set(dwIndex, pszValue, cchValue, fReplace);
+    }
+
+    HTTP_UNKNOWN_HEADER *pHeader = NULL;
+    for (USHORT i = 0; i < *m_pcUnknownHeaders; i++)
+    {
+        if (_stricmp(m_rgUnknownHeaders[i].pName, pszName) == 0)
+        {
+            pHeader = &m_rgUnknownHeaders[i];
+            break;
+        }
+    }
+
+    if (pHeader == NULL)
+    {
+        if (*m_pcUnknownHeaders == MAX_UNKNOWN_HEADERS)
+        {
+            RETURN_HR(HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER));
+        }
+
+        SIZE_T cchName = strlen(pszName);
+        pHeader = &m_rgUnknownHeaders[*m_pcUnknownHeaders];
+        pHeader->pName = m_pMemory->CopyA(pszName, cchName);
+        pHeader->NameLength = static_cast<USHORT>(cchName);
+        pHeader->pRawValue = NULL;
+        pHeader->RawValueLength = 0;
+        if (pHeader->pName == NULL)
+        {
+            RETURN_HR(E_OUTOFMEMORY);
+        }
+        (*m_pcUnknownHeaders)++;
+    }
+
+    if (!fReplace && pHeader->pRawValue != NULL)
+    {
+        //
+        // IIS appends to the existing value.
+        //
+        PSTR pszCombined = static_cast<PSTR>(m_pMemory->Alloc(pHeader->RawValueLength + 2 + cchValue + 1));
+        if (pszCombined == NULL)
+        {
+            RETURN_HR(E_OUTOFMEMORY);
+        }
+        memcpy(pszCombined, pHeader->pRawValue, pHeader->RawValueLength);
+        memcpy(pszCombined + pHeader->RawValueLength, ", ", 2);
+        memcpy(pszCombined + pHeader->RawValueLength + 2, pszValue, cchValue);
+        pszCombined[pHeader->RawValueLength + 2 + cchValue] = '\0';
+        pHeader->pRawValue = pszCombined;
+        pHeader->RawValueLength = static_cast<USHORT>(pHeader->RawValueLength + 2 + cchValue);
+        return S_OK;
+    }
+
+    pHeader->pRawValue = m_pMemory->CopyA(pszValue, cchValue);
+    pHeader->RawValueLength = cchValue;
+    if (pHeader->pRawValue == NULL)
+    {
+        RETURN_HR(E_OUTOFMEMORY);
+    }
+    return S_OK;
+}
+
+HRESULT
+FAKE_HEADERS::Set(
+    DWORD                           dwIndex,
+    _In_reads_(cchValue) PCSTR      pszValue,
+    USHORT                          cchValue,
+    BOOL                            fReplace
+)
+{
+    if (dwIndex >= m_cKnown)
+    {
+        RETURN_HR(E_INVALIDARG);
+    }
+
+    HTTP_KNOWN_HEADER *pHeader = &m_pKnownHeaders[dwIndex];
+
+    if (!fReplace && pHeader->pRawValue != NULL)
+    {
+        PSTR pszCombined = static_cast<PSTR>(m_pMemory->Alloc(pHeader->RawValueLength + 2 + cchValue + 1));
+        if (pszCombined == NULL)
+        {
+            RETURN_HR(E_OUTOFMEMORY);
+        }
+        memcpy(pszCombined, pHeader->pRawValue, pHeader->RawValueLength);
+        memcpy(pszCombined + pHeader->RawValueLength, ", ", 2);
+        memcpy(pszCombined + pHeader->RawValueLength + 2, pszValue, cchValue);
+        pszCombined[pHeader->RawValueLength + 2 + cchValue] = '\0';
+        pHeader->pRawValue = pszCombined;
+        pHeader->RawValueLength = static_cast<USHORT>(pHeader->RawValueLength + 2 + cchValue);
+        return S_OK;
+    }
+
+    pHeader->pRawValue = m_pMemory->CopyA(pszValue, cchValue);
+    pHeader->RawValueLength = cchValue;
+    if (pHeader->pRawValue == NULL)
+    {
+        pHeader->RawValueLength = 0;
+        RETURN_HR(E_OUTOFMEMORY);
+    }
+    return S_OK;
+}
+
+HRESULT
+FAKE_HEADERS::Delete(
+    _In_ PCSTR          pszName
+)
+{
+    DWORD dwIndex = FindKnown(pszName);
+    if (dwIndex < m_cKnown)
+    {
+        return Delete(dwIndex);
+    }
+
+    for (USHORT i = 0; i < *m_pcUnknownHeaders; i++)
+    {
+        if (_stricmp(m_rgUnknownHeaders[i].pName, pszName) == 0)
+        {
+            memmove(&m_rgUnknownHeaders[i],
+                &m_rgUnknownHeaders[i + 1],
+                (*m_pcUnknownHeaders - i - 1) * sizeof(HTTP_UNKNOWN_HEADER));
+            (*m_pcUnknownHeaders)--;
+            break;
+        }
+    }
+    return S_OK;
+}
+
+HRESULT
+FAKE_HEADERS::Delete(
+    DWORD               dwIndex
+)
+{
+    if (dwIndex < m_cKnown)
+    {
+        m_pKnownHeaders[dwIndex].pRawValue = NULL;
+        m_pKnownHeaders[dwIndex].RawValueLength = 0;
+    }
+    return S_OK;
+}
+
+HRESULT
+FAKE_HEADERS::BuildRaw(
+    _Out_ PCWSTR *      ppszRaw,
+    _Out_ DWORD *       pcchRaw
+) const
+{
+    SIZE_T cchRaw = 0;
+
+    for (DWORD i = 0; i < m_cKnown; i++)
+    {
+        if (m_pKnownHeaders[i].pRawValue != NULL)
+        {
+            cchRaw += strlen(m_ppszKnownNames[i]) + 2 + m_pKnownHeaders[i].RawValueLength + 2;
+        }
+    }
+    for (USHORT i = 0; i < *m_pcUnknownHeaders; i++)
+    {
+        cchRaw += m_rgUnknownHeaders[i].NameLength + 2 + m_rgUnknownHeaders[i].RawValueLength + 2;
+    }
+
+    PWSTR pszRaw = static_cast<PWSTR>(m_pMemory->Alloc((cchRaw + 1) * sizeof(WCHAR)));
+    if (pszRaw == NULL)
+    {
+        RETURN_HR(E_OUTOFMEMORY);
+    }
+
+    //
+    // Header names and the values the harness sends are ASCII.
+    //
+    PWSTR pszCurrent = pszRaw;
+    auto append = [&pszCurrent](PCSTR psz, SIZE_T cch)
+    {
+        for (SIZE_T i = 0; i < cch; i++)
+        {
+            *pszCurrent++ = static_cast<WCHAR>(static_cast<BYTE>(psz[i]));
+        }
+    };
+
+    for (DWORD i = 0; i < m_cKnown; i++)
+    {
+        if (m_pKnownHeaders[i].pRawValue != NULL)
+        {
+            append(m_ppszKnownNames[i], strlen(m_ppszKnownNames[i]));
+            append(": ", 2);
+            append(m_pKnownHeaders[i].pRawValue, m_pKnownHeaders[i].RawValueLength);
+            append("\r\n", 2);
+        }
+    }
+    for (USHORT i = 0; i < *m_pcUnknownHeaders; i++)
+    {
+        append(m_rgUnknownHeaders[i].pName, m_rgUnknownHeaders[i].NameLength);
+        append(": ", 2);
+        append(m_rgUnknownHeaders[i].pRawValue, m_rgUnknownHeaders[i].RawValueLength);
+        append("\r\n", 2);
+    }
+    *pszCurrent = L'\0';
+
+    *ppszRaw = pszRaw;
+    *pcchRaw = static_cast<DWORD>(cchRaw);
+    return S_OK;
+}
+
+FAKE_HTTP_REQUEST::FAKE_HTTP_REQUEST(
+    _In_ FAKE_HTTP_CONTEXT *    pContext
+) : m_pContext(pContext),
+    m_headers(g_rgpszRequestHeaderNames, HttpHeaderRequestMaximum),
+    m_pszMethod("GET"),
+    m_cbRemaining(0)
+{
+    ZeroMemory(&m_request, sizeof(m_request));
+    ZeroMemory(&m_localAddress, sizeof(m_localAddress));
+    ZeroMemory(&m_remoteAddress, sizeof(m_remoteAddress));
+    m_achUrl[0] = L'\0';
+    m_achRawUrl[0] = '\0';
+
+    m_localAddress.sin_family = AF_INET;
+    m_localAddress.sin_port = htons(80);
+    m_localAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    m_remoteAddress.sin_family = AF_INET;
+    m_remoteAddress.sin_port = htons(50000);
+    m_remoteAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+}
+
+HRESULT
+FAKE_HTTP_REQUEST::Reset(
+    const FAKE_REQUEST_SETTINGS &   settings
+)
+{
+    static const WCHAR  s_achScheme[] = L"http://";
+    static const WCHAR  s_achHost[] = L"localhost";
+    static const WCHAR  s_achPath[] = L"/echo";
+
+    ZeroMemory(&m_request, sizeof(m_request));
+    m_headers.Attach(m_request.Headers.KnownHeaders,
+        &m_request.Headers.UnknownHeaderCount,
+        &m_request.Headers.pUnknownHeaders,
+        m_pContext->QueryMemory());
+
+    int cchUrl = swprintf_s(m_achUrl, L"%s%s%s?size=%lu", s_achScheme, s_achHost, s_achPath, settings.cbResponseBody);
+    int cchRawUrl = sprintf_s(m_achRawUrl, "/echo?size=%lu", settings.cbResponseBody);
+    if (cchUrl < 0 || cchRawUrl < 0)
+    {
+        RETURN_HR(E_UNEXPECTED);
+    }
+
+    const USHORT cchScheme = _countof(s_achScheme) - 1;
+    const USHORT cchHost = _countof(s_achHost) - 1;
+    const USHORT cchPath = _countof(s_achPath) - 1;
+
+    m_request.CookedUrl.pFullUrl = m_achUrl;
+    m_request.CookedUrl.FullUrlLength = static_cast<USHORT>(cchUrl * sizeof(WCHAR));
+    m_request.CookedUrl.pHost = m_achUrl + cchScheme;
+    m_request.CookedUrl.HostLength = static_cast<USHORT>(cchHost * sizeof(WCHAR));
+    m_request.CookedUrl.pAbsPath = m_achUrl + cchScheme + cchHost;
+    m_request.CookedUrl.AbsPathLength = static_cast<USHORT>(cchPath * sizeof(WCHAR));
+    m_request.CookedUrl.pQueryString = m_achUrl + cchScheme + cchHost + cchPath;
+    m_request.CookedUrl.QueryStringLength = static_cast<USHORT>((cchUrl - cchScheme - cchHost - cchPath) * sizeof(WCHAR));
+    m_request.pRawUrl = m_achRawUrl;
+    m_request.RawUrlLength = static_cast<USHORT>(cchRawUrl);
+
+    m_request.Version.MajorVersion = 1;
+    m_request.Version.MinorVersion = 1;
+    m_request.Address.pLocalAddress = reinterpret_cast<PSOCKADDR>(&m_localAddress);
+    m_request.Address.pRemoteAddress = reinterpret_cast<PSOCKADDR>(&m_remoteAddress);
+
+    RETURN_IF_FAILED(m_headers.Set(HttpHeaderHost, "localhost", 9, TRUE));
+    RETURN_IF_FAILED(m_headers.Set(HttpHeaderUserAgent, "ForwardingLoadHarness", 21, TRUE));
+    RETURN_IF_FAILED(m_headers.Set(HttpHeaderAccept, "*/*", 3, TRUE));
+
+    if (settings.cbRequestBody != 0)
+    {
+        CHAR achContentLength[16];
+        int cchContentLength = sprintf_s(achContentLength, "%lu", settings.cbRequestBody);
+
+        m_request.Verb = HttpVerbPOST;
+        m_pszMethod = "POST";
+        RETURN_IF_FAILED(m_headers.Set(HttpHeaderContentLength, achContentLength, static_cast<USHORT>(cchContentLength), TRUE));
+        RETURN_IF_FAILED(m_headers.Set(HttpHeaderContentType, "application/octet-stream", 24, TRUE));
+    }
+    else
+    {
+        m_request.Verb = HttpVerbGET;
+        m_pszMethod = "GET";
+    }
+
+    for (DWORD i = 0; i < settings.cHeaders; i++)
+    {
+        RETURN_IF_FAILED(m_headers.Set(settings.pHeaders[i].pszName,
+            settings.pHeaders[i].pszValue,
+            settings.pHeaders[i].cchValue,
+            TRUE));
+    }
+
+    m_cbRemaining = settings.cbRequestBody;
+    return S_OK;
+}
+
+HRESULT
+FAKE_HTTP_REQUEST::ReadEntityBody(
+    _Out_ VOID *                pvBuffer,
+    _In_ DWORD                  cbBuffer,
+    _In_ BOOL                   fAsync,
+    _Out_ DWORD *               pcbBytesReceived,
+    _Out_ BOOL *                pfCompletionPending
+)
+{
+    if (m_cbRemaining == 0)
+    {
+        return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+    }
+
+    DWORD cbRead = min(cbBuffer, m_cbRemaining);
+    memset(pvBuffer, g_bRequestBodyPattern, cbRead);
+    m_cbRemaining -= cbRead;
+
+    if (fAsync)
+    {
+        if (pcbBytesReceived != NULL)
+        {
+            *pcbBytesReceived = 0;
+        }
+        if (pfCompletionPending != NULL)
+        {
+            *pfCompletionPending = TRUE;
+        }
+        m_pContext->PostIoCompletion(cbRead, S_OK);
+    }
+    else
+    {
+        if (pcbBytesReceived != NULL)
+        {
+            *pcbBytesReceived = cbRead;
+        }
+        if (pfCompletionPending != NULL)
+        {
+            *pfCompletionPending = FALSE;
+        }
+    }
+    return S_OK;
+}
+
+FAKE_HTTP_RESPONSE::FAKE_HTTP_RESPONSE(
+    _In_ FAKE_HTTP_CONTEXT *    pContext
+) : m_pContext(pContext),
+    m_headers(g_rgpszResponseHeaderNames, HttpHeaderResponseMaximum),
+    m_cbSent(0),
+    m_fHeadersSent(FALSE),
+    m_fConnectionReset(FALSE)
+{
+    ZeroMemory(&m_response, sizeof(m_response));
+}
+
+HRESULT
+FAKE_HTTP_RESPONSE::Reset(
+    VOID
+)
+{
+    ZeroMemory(&m_response, sizeof(m_response));
+    m_headers.Attach(m_response.Headers.KnownHeaders,
+        &m_response.Headers.UnknownHeaderCount,
+        &m_response.Headers.pUnknownHeaders,
+        m_pContext->QueryMemory());
+
+    m_response.Version.MajorVersion = 1;
+    m_response.Version.MinorVersion = 1;
+    m_response.StatusCode = 200;
+    m_response.pReason = "OK";
+    m_response.ReasonLength = 2;
+
+    //
+    // clear() keeps the capacity of the previous requests.
+    //
+    m_chunks.clear();
+    m_cbSent = 0;
+    m_fHeadersSent = FALSE;
+    m_fConnectionReset = FALSE;
+    return S_OK;
+}
+
+DWORD
+FAKE_HTTP_RESPONSE::SendBufferedChunks(
+    VOID
+)
+{
+    DWORD cbSent = 0;
+
+    //
+    // The handler drops buffered chunks by setting the count of the raw
+    // response, the vector follows.
+    //
+    m_chunks.resize(min(m_chunks.size(), static_cast<SIZE_T>(m_response.EntityChunkCount)));
+
+    for (const HTTP_DATA_CHUNK &chunk : m_chunks)
+    {
+        if (chunk.DataChunkType == HttpDataChunkFromMemory)
+        {
+            cbSent += chunk.FromMemory.BufferLength;
+        }
+    }
+
+    m_chunks.clear();
+    m_response.pEntityChunks = NULL;
+    m_response.EntityChunkCount = 0;
+    m_cbSent += cbSent;
+    m_fHeadersSent = TRUE;
+    return cbSent;
+}
+
+HRESULT
+FAKE_HTTP_RESPONSE::SetStatus(
+    _In_ USHORT                     statusCode,
+    _In_ PCSTR                      pszReason,
+    _In_ USHORT                     uSubStatus,
+    _In_ HRESULT                    hrErrorToReport,
+    _In_ IAppHostConfigException *  pException,
+    _In_ BOOL                       fTrySkipCustomErrors
+)
+{
+    UNREFERENCED_PARAMETER(uSubStatus);
+    UNREFERENCED_PARAMETER(hrErrorToReport);
+    UNREFERENCED_PARAMETER(pException);
+    UNREFERENCED_PARAMETER(fTrySkipCustomErrors);
+
+    SIZE_T cchReason = pszReason != NULL ? strlen(pszReason) : 0;
+    PSTR pszReasonCopy = m_pContext->QueryMemory()->CopyA(pszReason != NULL ? pszReason : "", cchReason);
+    if (pszReasonCopy == NULL)
+    {
+        RETURN_HR(E_OUTOFMEMORY);
+    }
+
+    m_response.StatusCode = statusCode;
+    m_response.pReason = pszReasonCopy;
+    m_response.ReasonLength = static_cast<USHORT>(cchReason);
+    return S_OK;
+}
+
+HRESULT
+FAKE_HTTP_RESPONSE::Flush(
+    _In_ BOOL                   fAsync,
+    _In_ BOOL                   fMoreData,
+    _Out_ DWORD *               pcbSent,
+    _Out_ BOOL *                pfCompletionExpected
+)
+{
+    UNREFERENCED_PARAMETER(fMoreData);
+
+    DWORD cbSent = SendBufferedChunks();
+
+    if (fAsync)
+    {
+        if (pfCompletionExpected != NULL)
+        {
+            *pfCompletionExpected = TRUE;
+        }
+        m_pContext->PostIoCompletion(cbSent, S_OK);
+    }
+    else if (pcbSent != NULL)
+    {
+        *pcbSent = cbSent;
+    }
+    return S_OK;
+}
+
+HRESULT
+FAKE_HTTP_RESPONSE::WriteEntityChunkByReference(
+    _In_ HTTP_DATA_CHUNK *      pDataChunk,
+    _In_ LONG                   lInsertPosition
+)
+{
+    m_chunks.resize(min(m_chunks.size(), static_cast<SIZE_T>(m_response.EntityChunkCount)));
+
+    try
+    {
+        if (lInsertPosition < 0 || static_cast<SIZE_T>(lInsertPosition) >= m_chunks.size())
+        {
+            m_chunks.push_back(*pDataChunk);
+        }
+        else
+        {
+            m_chunks.insert(m_chunks.begin() + lInsertPosition, *pDataChunk);
+        }
+    }
+    CATCH_RETURN();
+
+    m_response.pEntityChunks = m_chunks.data();
+    m_response.EntityChunkCount = static_cast<USHORT>(m_chunks.size());
+    return S_OK;
+}
+
+HRESULT
+FAKE_HTTP_RESPONSE::WriteEntityChunks(
+    _In_ HTTP_DATA_CHUNK *      pDataChunks,
+    _In_ DWORD                  nChunks,
+    _In_ BOOL                   fAsync,
+    _In_ BOOL                   fMoreData,
+    _Out_ DWORD *               pcbSent,
+    _Out_ BOOL *                pfCompletionExpected
+)
+{
+    UNREFERENCED_PARAMETER(fMoreData);
+
+    DWORD cbSent = SendBufferedChunks();
+
+    for (DWORD i = 0; i < nChunks; i++)
+    {
+        if (pDataChunks[i].DataChunkType == HttpDataChunkFromMemory)
+        {
+            cbSent += pDataChunks[i].FromMemory.BufferLength;
+            m_cbSent += pDataChunks[i].FromMemory.BufferLength;
+        }
+    }
+
+    if (fAsync)
+    {
+        if (pfCompletionExpected != NULL)
+        {
+            *pfCompletionExpected = TRUE;
+        }
+        m_pContext->PostIoCompletion(cbSent, S_OK);
+    }
+    else if (pcbSent != NULL)
+    {
+        *pcbSent = cbSent;
+    }
+    return S_OK;
+}
+
+VOID
+FAKE_HTTP_RESPONSE::GetStatus(
+    _Out_ USHORT *                      pStatusCode,
+    _Out_ USHORT *                      pSubStatus,
+    _Out_ PCSTR *                       ppszReason,
+    _Out_ USHORT *                      pcchReason,
+    _Out_ HRESULT *                     phrErrorToReport,
+    _Out_ PCWSTR *                      ppszModule,
+    _Out_ DWORD *                       pdwNotification,
+    _Out_ IAppHostConfigException **    ppException,
+    _Out_ BOOL *                        pfTrySkipCustomErrors
+)
+{
+    *pStatusCode = m_response.StatusCode;
+    if (pSubStatus != NULL)
+    {
+        *pSubStatus = 0;
+    }
+    if (ppszReason != NULL)
+    {
+        *ppszReason = m_response.pReason;
+    }
+    if (pcchReason != NULL)
+    {
+        *pcchReason = m_response.ReasonLength;
+    }
+    if (phrErrorToReport != NULL)
+    {
+        *phrErrorToReport = S_OK;
+    }
+    if (ppszModule != NULL)
+    {
+        *ppszModule = NULL;
+    }
+    if (pdwNotification != NULL)
+    {
+        *pdwNotification = RQ_EXECUTE_REQUEST_HANDLER;
+    }
+    if (ppException != NULL)
+    {
+        *ppException = NULL;
+    }
+    if (pfTrySkipCustomErrors != NULL)
+    {
+        *pfTrySkipCustomErrors = FALSE;
+    }
+}
+
+VOID *
+FAKE_HTTP_CONNECTION::AllocateMemory(
+    DWORD                       cbAllocation
+)
+{
+    return m_pContext->QueryMemory()->Alloc(cbAllocation);
+}
+
+FAKE_HTTP_CONTEXT::FAKE_HTTP_CONTEXT(
+    _In_ IAPPLICATION *             pApplication,
+    _In_ FAKE_HTTP_CONTEXT_OWNER *  pOwner
+) : m_pApplication(pApplication),
+    m_pOwner(pOwner),
+    m_request(this),
+    m_response(this),
+    m_connection(this),
+    m_pHandler(NULL),
+    m_fHandlerCreated(FALSE),
+    m_llStart(0),
+    m_llEnd(0),
+    m_iFirstCompletion(0),
+    m_cCompletions(0),
+    m_pCompletionWork(NULL)
+{
+    ZeroMemory(&m_settings, sizeof(m_settings));
+    InitializeSRWLock(&m_deliveryLock);
+    InitializeSRWLock(&m_queueLock);
+}
+
+FAKE_HTTP_CONTEXT::~FAKE_HTTP_CONTEXT()
+{
+    if (m_pCompletionWork != NULL)
+    {
+        WaitForThreadpoolWorkCallbacks(m_pCompletionWork, FALSE);
+        CloseThreadpoolWork(m_pCompletionWork);
+        m_pCompletionWork = NULL;
+    }
+
+    DBG_ASSERT(m_pHandler == NULL);
+}
+
+HRESULT
+FAKE_HTTP_CONTEXT::Initialize(
+    VOID
+)
+{
+    //
+    // Header values, ALL_RAW and whatever the handler allocates from the
+    // request fit many times over.
+    //
+    RETURN_IF_FAILED(m_memory.Initialize(64 * 1024));
+
+    m_pCompletionWork = CreateThreadpoolWork(CompletionCallback, this, NULL);
+    RETURN_LAST_ERROR_IF_NULL(m_pCompletionWork);
+
+    return S_OK;
+}
+
+VOID
+FAKE_HTTP_CONTEXT::Start(
+    const FAKE_REQUEST_SETTINGS &   settings
+)
+{
+    AcquireSRWLockExclusive(&m_deliveryLock);
+    RunRequestsLocked(settings);
+    ReleaseSRWLockExclusive(&m_deliveryLock);
+}
+
+VOID
+FAKE_HTTP_CONTEXT::PostIoCompletion(
+    DWORD                       cbCompletion,
+    HRESULT                     hrCompletionStatus
+)
+{
+    AcquireSRWLockExclusive(&m_queueLock);
+
+    //
+    // A handler has at most a read and a flush of the client outstanding,
+    // plus the PostCompletion of a WinHTTP callback.
+    //
+    DBG_ASSERT(m_cCompletions < _countof(m_rgCompletions));
+    COMPLETION &completion = m_rgCompletions[(m_iFirstCompletion + m_cCompletions) % _countof(m_rgCompletions)];
+    completion.cbCompletion = cbCompletion;
+    completion.hrCompletionStatus = hrCompletionStatus;
+    m_cCompletions++;
+
+    ReleaseSRWLockExclusive(&m_queueLock);
+
+    SubmitThreadpoolWork(m_pCompletionWork);
+}
+
+// static
+VOID
+CALLBACK
+FAKE_HTTP_CONTEXT::CompletionCallback(
+    _Inout_ PTP_CALLBACK_INSTANCE   Instance,
+    _Inout_opt_ PVOID               pvContext,
+    _Inout_ PTP_WORK                Work
+)
+{
+    UNREFERENCED_PARAMETER(Instance);
+    UNREFERENCED_PARAMETER(Work);
+
+    FAKE_HTTP_CONTEXT *     pContext = static_cast<FAKE_HTTP_CONTEXT *>(pvContext);
+    FAKE_REQUEST_SETTINGS   nextRequest;
+    COMPLETION              completion;
+
+    AcquireSRWLockExclusive(&pContext->m_deliveryLock);
+
+    AcquireSRWLockExclusive(&pContext->m_queueLock);
+    DBG_ASSERT(pContext->m_cCompletions != 0);
+    completion = pContext->m_rgCompletions[pContext->m_iFirstCompletion];
+    pContext->m_iFirstCompletion = (pContext->m_iFirstCompletion + 1) % _countof(pContext->m_rgCompletions);
+    pContext->m_cCompletions--;
+    ReleaseSRWLockExclusive(&pContext->m_queueLock);
+
+    //
+    // A completion posted after the handler finished has nobody to go to.
+    //
+    if (pContext->m_pHandler == NULL)
+    {
+        ReleaseSRWLockExclusive(&pContext->m_deliveryLock);
+        return;
+    }
+
+    REQUEST_NOTIFICATION_STATUS status = pContext->m_pHandler->OnAsyncCompletion(
+        completion.cbCompletion,
+        completion.hrCompletionStatus);
+
+    if (status != RQ_NOTIFICATION_PENDING && pContext->EndRequestLocked(&nextRequest))
+    {
+        pContext->RunRequestsLocked(nextRequest);
+    }
+
+    ReleaseSRWLockExclusive(&pContext->m_deliveryLock);
+}
+
+VOID
+FAKE_HTTP_CONTEXT::RunRequestsLocked(
+    const FAKE_REQUEST_SETTINGS &   settings
+)
+{
+    FAKE_REQUEST_SETTINGS nextRequest = settings;
+
+    do
+    {
+        if (BeginRequestLocked(nextRequest) == RQ_NOTIFICATION_PENDING)
+        {
+            return;
+        }
+    } while (EndRequestLocked(&nextRequest));
+}
+
+HRESULT
+FAKE_HTTP_CONTEXT::Prepare(
+    const FAKE_REQUEST_SETTINGS &   settings
+)
+{
+    m_settings = settings;
+    m_memory.Reset();
+
+    RETURN_IF_FAILED(m_request.Reset(settings));
+    RETURN_IF_FAILED(m_response.Reset());
+    return S_OK;
+}
+
+REQUEST_NOTIFICATION_STATUS
+FAKE_HTTP_CONTEXT::BeginRequestLocked(
+    const FAKE_REQUEST_SETTINGS &   settings
+)
+{
+    LARGE_INTEGER liStart;
+
+    QueryPerformanceCounter(&liStart);
+    m_llStart = liStart.QuadPart;
+
+    if (FAILED_LOG(Prepare(settings)) ||
+        FAILED_LOG(m_pApplication->TryCreateHandler(this, &m_pHandler)))
+    {
+        m_pHandler = NULL;
+        m_fHandlerCreated = FALSE;
+        m_response.SetStatus(500, "Internal Server Error");
+        return RQ_NOTIFICATION_FINISH_REQUEST;
+    }
+
+    m_fHandlerCreated = TRUE;
+    return m_pHandler->OnExecuteRequestHandler();
+}
+
+BOOL
+FAKE_HTTP_CONTEXT::EndRequestLocked(
+    _Out_ FAKE_REQUEST_SETTINGS *   pNextRequest
+)
+{
+    LARGE_INTEGER liEnd;
+
+    //
+    // IIS sends what is still buffered once the request is done.
+    //
+    m_response.SendBufferedChunks();
+
+    QueryPerformanceCounter(&liEnd);
+    m_llEnd = liEnd.QuadPart;
+
+    if (m_pHandler != NULL)
+    {
+        m_pHandler->DereferenceRequestHandler();
+        m_pHandler = NULL;
+    }
+
+    return m_pOwner->OnRequestCompleted(this, pNextRequest);
+}
+
+HRESULT
+FAKE_HTTP_CONTEXT::GetServerVariable(
+    _In_ PCSTR                  pszVariableName,
+    _Outptr_ PCWSTR *           ppszValue,
+    _Out_ DWORD *               pcchValueLength
+)
+{
+    if (_stricmp(pszVariableName, "ALL_RAW") == 0)
+    {
+        return m_request.BuildRawHeaders(ppszValue, pcchValueLength);
+    }
+    if (_stricmp(pszVariableName, "HTTP_VERSION") == 0)
+    {
+        *ppszValue = L"HTTP/1.1";
+        *pcchValueLength = 8;
+        return S_OK;
+    }
+
+    //
+    // WEBSOCKET_VERSION among others: the WebSocket module is not there.
+    //
+    *ppszValue = NULL;
+    *pcchValueLength = 0;
+    return HRESULT_FROM_WIN32(ERROR_INVALID_INDEX);
+}
+
+HRESULT
+FAKE_HTTP_CONTEXT::GetServerVariable(
+    _In_ PCSTR                  pszVariableName,
+    _Outptr_ PCSTR *            ppszValue,
+    _Out_ DWORD *               pcchValueLength
+)
+{
+    if (_stricmp(pszVariableName, "REMOTE_ADDR") == 0)
+    {
+        *ppszValue = "127.0.0.1";
+        *pcchValueLength = 9;
+        return S_OK;
+    }
+    if (_stricmp(pszVariableName, "REMOTE_PORT") == 0)
+    {
+        *ppszValue = "50000";
+        *pcchValueLength = 5;
+        return S_OK;
+    }
+
+    *ppszValue = NULL;
+    *pcchValueLength = 0;
+    return HRESULT_FROM_WIN32(ERROR_INVALID_INDEX);
+}
@@ -0,0 +1,1672 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// The IIS side of a request, without IIS: enough of IHttpContext and the
+// interfaces it hands out for FORWARDING_HANDLER to forward a request and
+// send the response.
+//
+// Unlike the mocks of CommonLibTests these are plain classes. A context is
+// reused for every request of one client of the harness and keeps its
+// memory between requests, so that the allocations counted for a request
+// are the handler's, not the fake's.
+//
+// Asynchronous reads, flushes and PostCompletion queue a completion that a
+// thread pool work item delivers to the handler. Like IIS, the context
+// never calls the handler on two threads at once: a completion waits for
+// the call in progress to return.
+//
+
+class FAKE_HTTP_CONTEXT;
+
+//
+// Backing memory of the request: header values, server variables and
+// AllocateRequestMemory. Released all at once when the next request of the
+// context starts.
+//
+class FAKE_REQUEST_MEMORY
+{
+public:
+
+    FAKE_REQUEST_MEMORY(
+        VOID
+    ) : m_cbUsed(0)
+    {
+    }
+
+    HRESULT
+    Initialize(
+        SIZE_T      cbCapacity
+    );
+
+    VOID
+    Reset(
+        VOID
+    )
+    {
+        m_cbUsed = 0;
+    }
+
+    //
+    // NULL when the capacity is exhausted.
+    //
+    VOID *
+    Alloc(
+        SIZE_T      cbSize
+    );
+
+    PSTR
+    CopyA(
+        _In_reads_(cch) PCSTR   psz,
+        SIZE_T                  cch
+    );
+
+private:
+
+    std::vector<BYTE>   m_buffer;
+    SIZE_T              m_cbUsed;
+};
+
+//
+// Known and unknown header arrays of an HTTP_REQUEST or HTTP_RESPONSE,
+// changed the way IIS changes them: deleting a known header clears it,
+// deleting an unknown header compacts the array.
+//
+class FAKE_HEADERS
+{
+public:
+
+    FAKE_HEADERS(
+        _In_ const PCSTR *      ppszKnownNames,
+        DWORD                   cKnown
+    ) : m_ppszKnownNames(ppszKnownNames),
+        m_cKnown(cKnown),
+        m_pKnownHeaders(NULL),
+        m_pcUnknownHeaders(NULL),
+        m_ppUnknownHeaders(NULL),
+        m_pMemory(NULL)
+    {
+    }
+
+    //
+    // Binds the helper to the header arrays of a raw request or response.
+    //
+    VOID
+    Attach(
+        _In_ HTTP_KNOWN_HEADER *        pKnownHeaders,
+        _In_ USHORT *                   pcUnknownHeaders,
+        _In_ PHTTP_UNKNOWN_HEADER *     ppUnknownHeaders,
+        _In_ FAKE_REQUEST_MEMORY *      pMemory
+    );
+
+    VOID
+    Clear(
+        VOID
+    );
+
+    PCSTR
+    Get(
+        _In_ PCSTR          pszName,
+        _Out_opt_ USHORT *  pcchValue
+    ) const;
+
+    PCSTR
+    Get(
+        DWORD               dwIndex,
+        _Out_opt_ USHORT *  pcchValue
+    ) const;
+
+    HRESULT
+    Set(
+        _In_ PCSTR                      pszName,
+        _In_reads_(cchValue) PCSTR      pszValue,
+        USHORT                          cchValue,
+        BOOL                            fReplace
+    );
+
+    HRESULT
+    Set(
+        DWORD                           dwIndex,
+        _In_reads_(cchValue) PCSTR      pszValue,
+        USHORT                          cchValue,
+        BOOL                            fReplace
+    );
+
+    HRESULT
+    Delete(
+        _In_ PCSTR          pszName
+    );
+
+    HRESULT
+    Delete(
+        DWORD               dwIndex
+    );
+
+    //
+    // "Name: value\r\n" for every header, as in the ALL_RAW server variable.
+    //
+    HRESULT
+    BuildRaw(
+        _Out_ PCWSTR *      ppszRaw,
+        _Out_ DWORD *       pcchRaw
+    ) const;
+
+    static const DWORD      MAX_UNKNOWN_HEADERS = 64;
+
+private:
+
+    DWORD
+    FindKnown(
+        _In_ PCSTR          pszName
+    ) const;
+
+    const PCSTR *           m_ppszKnownNames;
+    DWORD                   m_cKnown;
+    HTTP_KNOWN_HEADER *     m_pKnownHeaders;
+    USHORT *                m_pcUnknownHeaders;
+    PHTTP_UNKNOWN_HEADER *  m_ppUnknownHeaders;
+    HTTP_UNKNOWN_HEADER     m_rgUnknownHeaders[MAX_UNKNOWN_HEADERS];
+    FAKE_REQUEST_MEMORY *   m_pMemory;
+};
+
+//
+// A request header to send, cchValue characters of pszValue.
+//
+struct FAKE_HEADER_VALUE
+{
+    PCSTR       pszName;
+    PCSTR       pszValue;
+    USHORT      cchValue;
+};
+
+//
+// What a client of the harness sends.
+//
+struct FAKE_REQUEST_SETTINGS
+{
+    //
+    // POST with a body of that many bytes, GET when 0.
+    //
+    DWORD       cbRequestBody;
+    //
+    // Response body size the backend is asked for.
+    //
+    DWORD       cbResponseBody;
+    //
+    // Headers sent on top of the ones of the harness, replacing those of
+    // the same name. Must outlive the request.
+    //
+    const FAKE_HEADER_VALUE *   pHeaders;
+    DWORD                       cHeaders;
+};
+
+class FAKE_HTTP_REQUEST : public IHttpRequest
+{
+public:
+
+    FAKE_HTTP_REQUEST(
+        _In_ FAKE_HTTP_CONTEXT *    pContext
+    );
+
+    //
+    // Sets up the next request of the context.
+    //
+    HRESULT
+    Reset(
+        const FAKE_REQUEST_SETTINGS &   settings
+    );
+
+    HTTP_REQUEST *
+    GetRawHttpRequest(
+        VOID
+    ) override
+    {
+        return &m_request;
+    }
+
+    const HTTP_REQUEST *
+    GetRawHttpRequest(
+        VOID
+    ) const override
+    {
+        return &m_request;
+    }
+
+    PCSTR
+    GetHeader(
+        _In_ PCSTR                  pszHeaderName,
+        _Out_ USHORT *              pcchHeaderValue = NULL
+    ) const override
+    {
+        return m_headers.Get(pszHeaderName, pcchHeaderValue);
+    }
+
+    PCSTR
+    GetHeader(
+        _In_ HTTP_HEADER_ID         ulHeaderIndex,
+        _Out_ USHORT *              pcchHeaderValue = NULL
+    ) const override
+    {
+        return m_headers.Get(ulHeaderIndex, pcchHeaderValue);
+    }
+
+    HRESULT
+    SetHeader(
+        _In_ PCSTR                  pszHeaderName,
+        _In_ PCSTR                  pszHeaderValue,
+        _In_ USHORT                 cchHeaderValue,
+        _In_ BOOL                   fReplace
+    ) override
+    {
+        return m_headers.Set(pszHeaderName, pszHeaderValue, cchHeaderValue, fReplace);
+    }
+
+    HRESULT
+    SetHeader(
+        _In_ HTTP_HEADER_ID         ulHeaderIndex,
+        _In_ PCSTR                  pszHeaderValue,
+        _In_ USHORT                 cchHeaderValue,
+        _In_ BOOL                   fReplace
+    ) override
+    {
+        return m_headers.Set(ulHeaderIndex, pszHeaderValue, cchHeaderValue, fReplace);
+    }
+
+    HRESULT
+    DeleteHeader(
+        _In_ PCSTR                  pszHeaderName
+    ) override
+    {
+        return m_headers.Delete(pszHeaderName);
+    }
+
+    HRESULT
+    DeleteHeader(
+        _In_ HTTP_HEADER_ID         ulHeaderIndex
+    ) override
+    {
+        return m_headers.Delete(ulHeaderIndex);
+    }
+
+    PCSTR
+    GetHttpMethod(
+        VOID
+    ) const override
+    {
+        return m_pszMethod;
+    }
+
+    HRESULT
+    SetHttpMethod(
+        _In_ PCSTR                  pszHttpMethod
+    ) override
+    {
+        UNREFERENCED_PARAMETER(pszHttpMethod);
+        return E_NOTIMPL;
+    }
+
+    HRESULT
+    SetUrl(
+        _In_ PCWSTR                 pszUrl,
+        _In_ DWORD                  cchUrl,
+        _In_ BOOL                   fResetQueryString
+    ) override
+    {
+        UNREFERENCED_PARAMETER(pszUrl);
+        UNREFERENCED_PARAMETER(cchUrl);
+        UNREFERENCED_PARAMETER(fResetQueryString);
+        return E_NOTIMPL;
+    }
+
+    HRESULT
+    SetUrl(
+        _In_ PCSTR                  pszUrl,
+        _In_ DWORD                  cchUrl,
+        _In_ BOOL                   fResetQueryString
+    ) override
+    {
+        UNREFERENCED_PARAMETER(pszUrl);
+        UNREFERENCED_PARAMETER(cchUrl);
+        UNREFERENCED_PARAMETER(fResetQueryString);
+        return E_NOTIMPL;
+    }
+
+    BOOL
+    GetUrlChanged(
+        VOID
+    ) const override
+    {
+        return FALSE;
+    }
+
+    PCWSTR
+    GetForwardedUrl(
+        VOID
+    ) const override
+    {
+        return NULL;
+    }
+
+    PSOCKADDR
+    GetLocalAddress(
+        VOID
+    ) const override
+    {
+        return m_request.Address.pLocalAddress;
+    }
+
+    PSOCKADDR
+    GetRemoteAddress(
+        VOID
+    ) const override
+    {
+        return m_request.Address.pRemoteAddress;
+    }
+
+    HRESULT
+    ReadEntityBody(
+        _Out_ VOID *                pvBuffer,
+        _In_ DWORD                  cbBuffer,
+        _In_ BOOL                   fAsync,
+        _Out_ DWORD *               pcbBytesReceived,
+        _Out_ BOOL *                pfCompletionPending = NULL
+    ) override;
+
+    HRESULT
+    InsertEntityBody(
+        _In_ VOID *                 pvBuffer,
+        _In_ DWORD                  cbBuffer
+    ) override
+    {
+        UNREFERENCED_PARAMETER(pvBuffer);
+        UNREFERENCED_PARAMETER(cbBuffer);
+        return E_NOTIMPL;
+    }
+
+    DWORD
+    GetRemainingEntityBytes(
+        VOID
+    ) override
+    {
+        return m_cbRemaining;
+    }
+
+    VOID
+    GetHttpVersion(
+        _Out_ USHORT *              pMajorVersion,
+        _Out_ USHORT *              pMinorVersion
+    ) const override
+    {
+        *pMajorVersion = m_request.Version.MajorVersion;
+        *pMinorVersion = m_request.Version.MinorVersion;
+    }
+
+    HRESULT
+    GetClientCertificate(
+        _Outptr_ HTTP_SSL_CLIENT_CERT_INFO **   ppClientCertInfo,
+        _Out_ BOOL *                            pfClientCertNegotiated
+    ) override
+    {
+        *ppClientCertInfo = NULL;
+        *pfClientCertNegotiated = FALSE;
+        return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+    }
+
+    HRESULT
+    NegotiateClientCertificate(
+        _In_ BOOL                   fAsync,
+        _Out_ BOOL *                pfCompletionPending = NULL
+    ) override
+    {
+        UNREFERENCED_PARAMETER(fAsync);
+        UNREFERENCED_PARAMETER(pfCompletionPending);
+        return E_NOTIMPL;
+    }
+
+    DWORD
+    GetSiteId(
+        VOID
+    ) const override
+    {
+        return 1;
+    }
+
+    HRESULT
+    GetHeaderChanges(
+        _In_ DWORD                  dwOldChangeNumber,
+        _Out_ DWORD *               pdwNewChangeNumber,
+        _Inout_ PCSTR               knownHeaderSnapshot[HttpHeaderRequestMaximum],
+        _Inout_ DWORD *             pdwUnknownHeaderSnapshot,
+        _Inout_ PCSTR **            ppUnknownHeaderNameSnapshot,
+        _Inout_ PCSTR **            ppUnknownHeaderValueSnapshot,
+        _Out_ DWORD                 diffedKnownHeaderIndices[HttpHeaderRequestMaximum + 1],
+        _Out_ DWORD *               pdwDiffedUnknownHeaders,
+        _Out_ DWORD **              ppDiffedUnknownHeaderIndices
+    ) override
+    {
+        UNREFERENCED_PARAMETER(dwOldChangeNumber);
+        UNREFERENCED_PARAMETER(pdwNewChangeNumber);
+        UNREFERENCED_PARAMETER(knownHeaderSnapshot);
+        UNREFERENCED_PARAMETER(pdwUnknownHeaderSnapshot);
+        UNREFERENCED_PARAMETER(ppUnknownHeaderNameSnapshot);
+        UNREFERENCED_PARAMETER(ppUnknownHeaderValueSnapshot);
+        UNREFERENCED_PARAMETER(diffedKnownHeaderIndices);
+        UNREFERENCED_PARAMETER(pdwDiffedUnknownHeaders);
+        UNREFERENCED_PARAMETER(ppDiffedUnknownHeaderIndices);
+        return E_NOTIMPL;
+    }
+
+    //
+    // "Name: value\r\n" for every request header, for ALL_RAW.
+    //
+    HRESULT
+    BuildRawHeaders(
+        _Out_ PCWSTR *              ppszRaw,
+        _Out_ DWORD *               pcchRaw
+    ) const
+    {
+        return m_headers.BuildRaw(ppszRaw, pcchRaw);
+    }
+
+private:
+
+    FAKE_HTTP_REQUEST(const FAKE_HTTP_REQUEST &);
+    void operator=(const FAKE_HTTP_REQUEST &);
+
+    FAKE_HTTP_CONTEXT *     m_pContext;
+    HTTP_REQUEST            m_request;
+    FAKE_HEADERS            m_headers;
+    SOCKADDR_IN             m_localAddress;
+    SOCKADDR_IN             m_remoteAddress;
+    PCSTR                   m_pszMethod;
+    DWORD                   m_cbRemaining;
+    //
+    // Full URL, the cooked URL points into it.
+    //
+    WCHAR                   m_achUrl[128];
+    CHAR                    m_achRawUrl[64];
+};
+
+class FAKE_HTTP_RESPONSE : public IHttpResponse
+{
+public:
+
+    FAKE_HTTP_RESPONSE(
+        _In_ FAKE_HTTP_CONTEXT *    pContext
+    );
+
+    HRESULT
+    Reset(
+        VOID
+    );
+
+    //
+    // Counts the chunks buffered so far as sent, as a flush or the end of
+    // the request would send them, and returns their size.
+    //
+    DWORD
+    SendBufferedChunks(
+        VOID
+    );
+
+    USHORT
+    QueryStatusCode(
+        VOID
+    ) const
+    {
+        return m_response.StatusCode;
+    }
+
+    ULONGLONG
+    QueryBytesSent(
+        VOID
+    ) const
+    {
+        return m_cbSent;
+    }
+
+    BOOL
+    QueryConnectionReset(
+        VOID
+    ) const
+    {
+        return m_fConnectionReset;
+    }
+
+    BOOL
+    QueryHeadersSent(
+        VOID
+    ) const
+    {
+        return m_fHeadersSent;
+    }
+
+    HTTP_RESPONSE *
+    GetRawHttpResponse(
+        VOID
+    ) override
+    {
+        return &m_response;
+    }
+
+    const HTTP_RESPONSE *
+    GetRawHttpResponse(
+        VOID
+    ) const override
+    {
+        return &m_response;
+    }
+
+    IHttpCachePolicy *
+    GetCachePolicy(
+        VOID
+    ) override
+    {
+        return NULL;
+    }
+
+    HRESULT
+    SetStatus(
+        _In_ USHORT                     statusCode,
+        _In_ PCSTR                      pszReason,
+        _In_ USHORT                     uSubStatus = 0,
+        _In_ HRESULT                    hrErrorToReport = S_OK,
+        _In_ IAppHostConfigException *  pException = NULL,
+        _In_ BOOL                       fTrySkipCustomErrors = FALSE
+    ) override;
+
+    HRESULT
+    SetHeader(
+        _In_ PCSTR                  pszHeaderName,
+        _In_ PCSTR                  pszHeaderValue,
+        _In_ USHORT                 cchHeaderValue,
+        _In_ BOOL                   fReplace
+    ) override
+    {
+        return m_headers.Set(pszHeaderName, pszHeaderValue, cchHeaderValue, fReplace);
+    }
+
+    HRESULT
+    SetHeader(
+        _In_ HTTP_HEADER_ID         ulHeaderIndex,
+        _In_ PCSTR                  pszHeaderValue,
+        _In_ USHORT                 cchHeaderValue,
+        _In_ BOOL                   fReplace
+    ) override
+    {
+        return m_headers.Set(ulHeaderIndex, pszHeaderValue, cchHeaderValue, fReplace);
+    }
+
+    HRESULT
+    DeleteHeader(
+        _In_ PCSTR                  pszHeaderName
+    ) override
+    {
+        return m_headers.Delete(pszHeaderName);
+    }
+
+    HRESULT
+    DeleteHeader(
+        _In_ HTTP_HEADER_ID         ulHeaderIndex
+    ) override
+    {
+        return m_headers.Delete(ulHeaderIndex);
+    }
+
+    PCSTR
+    GetHeader(
+        _In_ PCSTR                  pszHeaderName,
+        _Out_ USHORT *              pcchHeaderValue = NULL
+    ) const override
+    {
+        return m_headers.Get(pszHeaderName, pcchHeaderValue);
+    }
+
+    PCSTR
+    GetHeader(
+        _In_ HTTP_HEADER_ID         ulHeaderIndex,
+        _Out_ USHORT *              pcchHeaderValue = NULL
+    ) const override
+    {
+        return m_headers.Get(ulHeaderIndex, pcchHeaderValue);
+    }
+
+    VOID
+    Clear(
+        VOID
+    ) override
+    {
+        m_headers.Clear();
+        m_response.EntityChunkCount = 0;
+    }
+
+    VOID
+    ClearHeaders(
+        VOID
+    ) override
+    {
+        m_headers.Clear();
+    }
+
+    VOID
+    SetNeedDisconnect(
+        VOID
+    ) override
+    {
+    }
+
+    VOID
+    ResetConnection(
+        VOID
+    ) override
+    {
+        m_fConnectionReset = TRUE;
+    }
+
+    VOID
+    DisableKernelCache(
+        ULONG                       reason = 9
+    ) override
+    {
+        UNREFERENCED_PARAMETER(reason);
+    }
+
+    BOOL
+    GetKernelCacheEnabled(
+        VOID
+    ) const override
+    {
+        return FALSE;
+    }
+
+    VOID
+    SuppressHeaders(
+        VOID
+    ) override
+    {
+    }
+
+    BOOL
+    GetHeadersSuppressed(
+        VOID
+    ) const override
+    {
+        return FALSE;
+    }
+
+    HRESULT
+    Flush(
+        _In_ BOOL                   fAsync,
+        _In_ BOOL                   fMoreData,
+        _Out_ DWORD *               pcbSent,
+        _Out_ BOOL *                pfCompletionExpected = NULL
+    ) override;
+
+    HRESULT
+    Redirect(
+        _In_ PCSTR                  pszUrl,
+        _In_ BOOL                   fResetStatusCode = TRUE,
+        _In_ BOOL                   fIncludeParameters = FALSE
+    ) override
+    {
+        UNREFERENCED_PARAMETER(pszUrl);
+        UNREFERENCED_PARAMETER(fResetStatusCode);
+        UNREFERENCED_PARAMETER(fIncludeParameters);
+        return E_NOTIMPL;
+    }
+
+    HRESULT
+    WriteEntityChunkByReference(
+        _In_ HTTP_DATA_CHUNK *      pDataChunk,
+        _In_ LONG                   lInsertPosition = -1
+    ) override;
+
+    HRESULT
+    WriteEntityChunks(
+        _In_ HTTP_DATA_CHUNK *      pDataChunks,
+        _In_ DWORD                  nChunks,
+        _In_ BOOL                   fAsync,
+        _In_ BOOL                   fMoreData,
+        _Out_ DWORD *               pcbSent,
+        _Out_ BOOL *                pfCompletionExpected = NULL
+    ) override;
+
+    VOID
+    DisableBuffering(
+        VOID
+    ) override
+    {
+    }
+
+    VOID
+    GetStatus(
+        _Out_ USHORT *                      pStatusCode,
+        _Out_ USHORT *                      pSubStatus = NULL,
+        _Out_ PCSTR *                       ppszReason = NULL,
+        _Out_ USHORT *                      pcchReason = NULL,
+        _Out_ HRESULT *                     phrErrorToReport = NULL,
+        _Out_ PCWSTR *                      ppszModule = NULL,
+        _Out_ DWORD *                       pdwNotification = NULL,
+        _Out_ IAppHostConfigException **    ppException = NULL,
+        _Out_ BOOL *                        pfTrySkipCustomErrors = NULL
+    ) override;
+
+    HRESULT
+    SetErrorDescription(
+        _In_ PCWSTR                 pszDescription,
+        _In_ DWORD                  cchDescription,
+        _In_ BOOL                   fHtmlEncode = TRUE
+    ) override
+    {
+        UNREFERENCED_PARAMETER(pszDescription);
+        UNREFERENCED_PARAMETER(cchDescription);
+        UNREFERENCED_PARAMETER(fHtmlEncode);
+        return S_OK;
+    }
+
+    PCWSTR
+    GetErrorDescription(
+        _Out_ DWORD *               pcchDescription = NULL
+    ) override
+    {
+        if (pcchDescription != NULL)
+        {
+            *pcchDescription = 0;
+        }
+        return L"";
+    }
+
+    HRESULT
+    GetHeaderChanges(
+        _In_ DWORD                  dwOldChangeNumber,
+        _Out_ DWORD *               pdwNewChangeNumber,
+        _Inout_ PCSTR               knownHeaderSnapshot[HttpHeaderResponseMaximum],
+        _Inout_ DWORD *             pdwUnknownHeaderSnapshot,
+        _Inout_ PCSTR **            ppUnknownHeaderNameSnapshot,
+        _Inout_ PCSTR **            ppUnknownHeaderValueSnapshot,
+        _Out_ DWORD                 diffedKnownHeaderIndices[HttpHeaderResponseMaximum + 1],
+        _Out_ DWORD *               pdwDiffedUnknownHeaders,
+        _Out_ DWORD **              ppDiffedUnknownHeaderIndices
+    ) override
+    {
+        UNREFERENCED_PARAMETER(dwOldChangeNumber);
+        UNREFERENCED_PARAMETER(pdwNewChangeNumber);
+        UNREFERENCED_PARAMETER(knownHeaderSnapshot);
+        UNREFERENCED_PARAMETER(pdwUnknownHeaderSnapshot);
+        UNREFERENCED_PARAMETER(ppUnknownHeaderNameSnapshot);
+        UNREFERENCED_PARAMETER(ppUnknownHeaderValueSnapshot);
+        UNREFERENCED_PARAMETER(diffedKnownHeaderIndices);
+        UNREFERENCED_PARAMETER(pdwDiffedUnknownHeaders);
+        UNREFERENCED_PARAMETER(ppDiffedUnknownHeaderIndices);
+        return E_NOTIMPL;
+    }
+
+    VOID
+    CloseConnection(
+        VOID
+    ) override
+    {
+        m_fConnectionReset = TRUE;
+    }
+
+private:
+
+    FAKE_HTTP_RESPONSE(const FAKE_HTTP_RESPONSE &);
+    void operator=(const FAKE_HTTP_RESPONSE &);
+
+    FAKE_HTTP_CONTEXT *             m_pContext;
+    HTTP_RESPONSE                   m_response;
+    FAKE_HEADERS                    m_headers;
+    //
+    // Chunks written by reference and not sent yet, EntityChunkCount of
+    // m_response is their number.
+    //
+    std::vector<HTTP_DATA_CHUNK>    m_chunks;
+    ULONGLONG                       m_cbSent;
+    BOOL                            m_fHeadersSent;
+    BOOL                            m_fConnectionReset;
+};
+
+class FAKE_HTTP_CONNECTION : public IHttpConnection
+{
+public:
+
+    FAKE_HTTP_CONNECTION(
+        _In_ FAKE_HTTP_CONTEXT *    pContext
+    ) : m_pContext(pContext)
+    {
+    }
+
+    BOOL
+    IsConnected(
+        VOID
+    ) const override
+    {
+        return TRUE;
+    }
+
+    VOID *
+    AllocateMemory(
+        DWORD                       cbAllocation
+    ) override;
+
+    IHttpConnectionStoredContext *
+    GetModuleContextContainer(
+        VOID
+    ) override
+    {
+        return NULL;
+    }
+
+private:
+
+    FAKE_HTTP_CONTEXT *     m_pContext;
+};
+
+//
+// Anonymous user, the response cache only serves those.
+//
+class FAKE_HTTP_USER : public IHttpUser
+{
+public:
+
+    PCWSTR
+    GetRemoteUserName(
+        VOID
+    ) override
+    {
+        return L"";
+    }
+
+    PCWSTR
+    GetUserName(
+        VOID
+    ) override
+    {
+        return L"";
+    }
+
+    PCWSTR
+    GetAuthenticationType(
+        VOID
+    ) override
+    {
+        return L"";
+    }
+
+    PCWSTR
+    GetPassword(
+        VOID
+    ) override
+    {
+        return L"";
+    }
+
+    HANDLE
+    GetImpersonationToken(
+        VOID
+    ) override
+    {
+        return NULL;
+    }
+
+    HANDLE
+    GetPrimaryToken(
+        VOID
+    ) override
+    {
+        return NULL;
+    }
+
+    VOID
+    ReferenceUser(
+        VOID
+    ) override
+    {
+    }
+
+    VOID
+    DereferenceUser(
+        VOID
+    ) override
+    {
+    }
+
+    BOOL
+    SupportsIsInRole(
+        VOID
+    ) override
+    {
+        return FALSE;
+    }
+
+    HRESULT
+    IsInRole(
+        _In_ PCWSTR                 pszRoleName,
+        _Out_ BOOL *                pfInRole
+    ) override
+    {
+        UNREFERENCED_PARAMETER(pszRoleName);
+        *pfInRole = FALSE;
+        return E_NOTIMPL;
+    }
+
+    PVOID
+    GetUserVariable(
+        _In_ PCSTR                  pszVariableName
+    ) override
+    {
+        UNREFERENCED_PARAMETER(pszVariableName);
+        return NULL;
+    }
+};
+
+//
+// Tracing is off, the ANCM events are never raised.
+//
+class FAKE_HTTP_TRACE_CONTEXT : public IHttpTraceContext
+{
+public:
+
+    FAKE_HTTP_TRACE_CONTEXT(
+        VOID
+    )
+    {
+        CoCreateGuid(&m_activityId);
+    }
+
+    HRESULT
+    GetTraceConfiguration(
+        _Inout_ HTTP_TRACE_CONFIGURATION *  pHttpTraceConfiguration
+    ) override
+    {
+        pHttpTraceConfiguration->fProviderEnabled = FALSE;
+        return S_OK;
+    }
+
+    HRESULT
+    SetTraceConfiguration(
+        _In_ HTTP_MODULE_ID                 moduleId,
+        _In_ HTTP_TRACE_CONFIGURATION *     pHttpTraceConfiguration,
+        _In_ DWORD                          cHttpTraceConfiguration = 1
+    ) override
+    {
+        UNREFERENCED_PARAMETER(moduleId);
+        UNREFERENCED_PARAMETER(pHttpTraceConfiguration);
+        UNREFERENCED_PARAMETER(cHttpTraceConfiguration);
+        return E_NOTIMPL;
+    }
+
+    HRESULT
+    RaiseTraceEvent(
+        _In_ HTTP_TRACE_EVENT *             pTraceEvent
+    ) override
+    {
+        UNREFERENCED_PARAMETER(pTraceEvent);
+        return S_OK;
+    }
+
+    LPCGUID
+    GetTraceActivityId(
+        VOID
+    ) override
+    {
+        return &m_activityId;
+    }
+
+    HRESULT
+    QuickTrace(
+        _In_ PCWSTR                         pszData1,
+        _In_ PCWSTR                         pszData2 = NULL,
+        _In_ HRESULT                        hrLastError = S_OK,
+        _In_ UCHAR                          Level = 4
+    ) override
+    {
+        UNREFERENCED_PARAMETER(pszData1);
+        UNREFERENCED_PARAMETER(pszData2);
+        UNREFERENCED_PARAMETER(hrLastError);
+        UNREFERENCED_PARAMETER(Level);
+        return S_OK;
+    }
+
+private:
+
+    GUID                    m_activityId;
+};
+
+//
+// The application OUT_OF_PROCESS_APPLICATION is created for.
+//
+class FAKE_HTTP_APPLICATION : public IHttpApplication
+{
+public:
+
+    FAKE_HTTP_APPLICATION(
+        _In_ PCWSTR                 pszPhysicalPath
+    ) : m_strPhysicalPath(pszPhysicalPath)
+    {
+    }
+
+    PCWSTR
+    GetApplicationPhysicalPath(
+        VOID
+    ) const override
+    {
+        return m_strPhysicalPath.c_str();
+    }
+
+    PCWSTR
+    GetApplicationId(
+        VOID
+    ) const override
+    {
+        return L"/LM/W3SVC/1/ROOT";
+    }
+
+    PCWSTR
+    GetAppConfigPath(
+        VOID
+    ) const override
+    {
+        return L"MACHINE/WEBROOT/APPHOST/ForwardingLoadHarness";
+    }
+
+    IHttpModuleContextContainer *
+    GetModuleContextContainer(
+        VOID
+    ) override
+    {
+        return NULL;
+    }
+
+private:
+
+    std::wstring            m_strPhysicalPath;
+};
+
+//
+// Called when a request of the context is done, on the thread that
+// completed it.
+//
+class FAKE_HTTP_CONTEXT_OWNER
+{
+public:
+
+    //
+    // Returns TRUE and the settings of the next request of the context to
+    // start one, FALSE once the client is done.
+    //
+    virtual
+    BOOL
+    OnRequestCompleted(
+        _In_ FAKE_HTTP_CONTEXT *            pContext,
+        _Out_ FAKE_REQUEST_SETTINGS *       pNextRequest
+    ) = 0;
+};
+
+class FAKE_HTTP_CONTEXT : public IHttpContext
+{
+public:
+
+    FAKE_HTTP_CONTEXT(
+        _In_ IAPPLICATION *             pApplication,
+        _In_ FAKE_HTTP_CONTEXT_OWNER *  pOwner
+    );
+
+    ~FAKE_HTTP_CONTEXT();
+
+    HRESULT
+    Initialize(
+        VOID
+    );
+
+    //
+    // Runs requests one after the other until the owner stops them, the
+    // first one on the calling thread.
+    //
+    VOID
+    Start(
+        const FAKE_REQUEST_SETTINGS &   settings
+    );
+
+    //
+    // Sets up the request and response of settings for a caller driving
+    // a handler itself, without starting the request.
+    //
+    HRESULT
+    Prepare(
+        const FAKE_REQUEST_SETTINGS &   settings
+    );
+
+    //
+    // Queues a completion of an asynchronous operation.
+    //
+    VOID
+    PostIoCompletion(
+        DWORD                       cbCompletion,
+        HRESULT                     hrCompletionStatus
+    );
+
+    FAKE_REQUEST_MEMORY *
+    QueryMemory(
+        VOID
+    )
+    {
+        return &m_memory;
+    }
+
+    //
+    // Outcome of the request that completed last.
+    //
+    USHORT
+    QueryStatusCode(
+        VOID
+    ) const
+    {
+        return m_response.QueryStatusCode();
+    }
+
+    ULONGLONG
+    QueryBytesSent(
+        VOID
+    ) const
+    {
+        return m_response.QueryBytesSent();
+    }
+
+    BOOL
+    QueryConnectionReset(
+        VOID
+    ) const
+    {
+        return m_response.QueryConnectionReset();
+    }
+
+    const FAKE_REQUEST_SETTINGS &
+    QuerySettings(
+        VOID
+    ) const
+    {
+        return m_settings;
+    }
+
+    //
+    // QueryPerformanceCounter values of the start and end of the request.
+    //
+    LONGLONG
+    QueryLatency(
+        VOID
+    ) const
+    {
+        return m_llEnd - m_llStart;
+    }
+
+    //
+    // FALSE when the handler could not even be created.
+    //
+    BOOL
+    QueryHandlerCreated(
+        VOID
+    ) const
+    {
+        return m_fHandlerCreated;
+    }
+
+    IHttpSite *
+    GetSite(
+        VOID
+    ) override
+    {
+        return NULL;
+    }
+
+    IHttpApplication *
+    GetApplication(
+        VOID
+    ) override
+    {
+        return NULL;
+    }
+
+    IHttpConnection *
+    GetConnection(
+        VOID
+    ) override
+    {
+        return &m_connection;
+    }
+
+    IHttpRequest *
+    GetRequest(
+        VOID
+    ) override
+    {
+        return &m_request;
+    }
+
+    IHttpResponse *
+    GetResponse(
+        VOID
+    ) override
+    {
+        return &m_response;
+    }
+
+    BOOL
+    GetResponseHeadersSent(
+        VOID
+    ) const override
+    {
+        return m_response.QueryHeadersSent();
+    }
+
+    IHttpUser *
+    GetUser(
+        VOID
+    ) const override
+    {
+        return const_cast<FAKE_HTTP_USER *>(&m_user);
+    }
+
+    IHttpModuleContextContainer *
+    GetModuleContextContainer(
+        VOID
+    ) override
+    {
+        return NULL;
+    }
+
+    VOID
+    IndicateCompletion(
+        _In_ REQUEST_NOTIFICATION_STATUS    notificationStatus
+    ) override
+    {
+        UNREFERENCED_PARAMETER(notificationStatus);
+    }
+
+    HRESULT
+    PostCompletion(
+        _In_ DWORD                  cbBytes
+    ) override
+    {
+        PostIoCompletion(cbBytes, S_OK);
+        return S_OK;
+    }
+
+    VOID
+    DisableNotifications(
+        _In_ DWORD                  dwNotifications,
+        _In_ DWORD                  dwPostNotifications
+    ) override
+    {
+        UNREFERENCED_PARAMETER(dwNotifications);
+        UNREFERENCED_PARAMETER(dwPostNotifications);
+    }
+
+    BOOL
+    GetNextNotification(
+        _In_ REQUEST_NOTIFICATION_STATUS    status,
+        _Out_ DWORD *                       pdwNotification,
+        _Out_ BOOL *                        pfIsPostNotification,
+        _Outptr_ CHttpModule **             ppModuleInfo,
+        _Outptr_ IHttpEventProvider **      ppRequestOutput
+    ) override
+    {
+        UNREFERENCED_PARAMETER(status);
+        UNREFERENCED_PARAMETER(pdwNotification);
+        UNREFERENCED_PARAMETER(pfIsPostNotification);
+        UNREFERENCED_PARAMETER(ppModuleInfo);
+        UNREFERENCED_PARAMETER(ppRequestOutput);
+        return FALSE;
+    }
+
+    BOOL
+    GetIsLastNotification(
+        _In_ REQUEST_NOTIFICATION_STATUS    status
+    ) override
+    {
+        UNREFERENCED_PARAMETER(status);
+        return TRUE;
+    }
+
+    HRESULT
+    ExecuteRequest(
+        _In_ BOOL                   fAsync,
+        _In_ IHttpContext *         pHttpContext,
+        _In_ DWORD                  dwExecuteFlags,
+        _In_ IHttpUser *            pHttpUser,
+        _Out_ BOOL *                pfCompletionExpected = NULL
+    ) override
+    {
+        UNREFERENCED_PARAMETER(fAsync);
+        UNREFERENCED_PARAMETER(pHttpContext);
+        UNREFERENCED_PARAMETER(dwExecuteFlags);
+        UNREFERENCED_PARAMETER(pHttpUser);
+        UNREFERENCED_PARAMETER(pfCompletionExpected);
+        return E_NOTIMPL;
+    }
+
+    DWORD
+    GetExecuteFlags(
+        VOID
+    ) const override
+    {
+        return 0;
+    }
+
+    HRESULT
+    GetServerVariable(
+        _In_ PCSTR                  pszVariableName,
+        _Outptr_ PCWSTR *           ppszValue,
+        _Out_ DWORD *               pcchValueLength
+    ) override;
+
+    HRESULT
+    GetServerVariable(
+        _In_ PCSTR                  pszVariableName,
+        _Outptr_ PCSTR *            ppszValue,
+        _Out_ DWORD *               pcchValueLength
+    ) override;
+
+    HRESULT
+    SetServerVariable(
+        _In_ PCSTR                  pszVariableName,
+        _In_ PCWSTR                 pszVariableValue
+    ) override
+    {
+        UNREFERENCED_PARAMETER(pszVariableName);
+        UNREFERENCED_PARAMETER(pszVariableValue);
+        return S_OK;
+    }
+
+    VOID *
+    AllocateRequestMemory(
+        _In_ DWORD                  cbAllocation
+    ) override
+    {
+        return m_memory.Alloc(cbAllocation);
+    }
+
+    IHttpUrlInfo *
+    GetUrlInfo(
+        VOID
+    ) override
+    {
+        return NULL;
+    }
+
+    IMetadataInfo *
+    GetMetadata(
+        VOID
+    ) override
+    {
+        return NULL;
+    }
+
+    PCWSTR
+    GetPhysicalPath(
+        _Out_ DWORD *               pcchPhysicalPath = NULL
+    ) override
+    {
+        UNREFERENCED_PARAMETER(pcchPhysicalPath);
+        return NULL;
+    }
+
+    PCWSTR
+    GetScriptName(
+        _Out_ DWORD *               pcchScriptName = NULL
+    ) const override
+    {
+        UNREFERENCED_PARAMETER(pcchScriptName);
+        return NULL;
+    }
+
+    PCWSTR
+    GetScriptTranslated(
+        _Out_ DWORD *               pcchScriptTranslated = NULL
+    ) override
+    {
+        UNREFERENCED_PARAMETER(pcchScriptTranslated);
+        return NULL;
+    }
+
+    IScriptMapInfo *
+    GetScriptMap(
+        VOID
+    ) const override
+    {
+        return NULL;
+    }
+
+    VOID
+    SetRequestHandled(
+        VOID
+    ) override
+    {
+    }
+
+    IHttpFileInfo *
+    GetFileInfo(
+        VOID
+    ) const override
+    {
+        return NULL;
+    }
+
+    HRESULT
+    MapPath(
+        _In_ PCWSTR                 pszUrl,
+        _Inout_ PWSTR               pszPhysicalPath,
+        _Inout_ DWORD *             pcbPhysicalPath
+    ) override
+    {
+        UNREFERENCED_PARAMETER(pszUrl);
+        UNREFERENCED_PARAMETER(pszPhysicalPath);
+        UNREFERENCED_PARAMETER(pcbPhysicalPath);
+        return E_NOTIMPL;
+    }
+
+    HRESULT
+    NotifyCustomNotification(
+        _In_ ICustomNotificationProvider *  pCustomOutput,
+        _Out_ BOOL *                        pfCompletionExpected
+    ) override
+    {
+        UNREFERENCED_PARAMETER(pCustomOutput);
+        UNREFERENCED_PARAMETER(pfCompletionExpected);
+        return E_NOTIMPL;
+    }
+
+    IHttpContext *
+    GetParentContext(
+        VOID
+    ) const override
+    {
+        return NULL;
+    }
+
+    IHttpContext *
+    GetRootContext(
+        VOID
+    ) const override
+    {
+        return const_cast<FAKE_HTTP_CONTEXT *>(this);
+    }
+
+    HRESULT
+    CloneContext(
+        _In_ DWORD                  dwCloneFlags,
+        _Outptr_ IHttpContext **    ppHttpContext
+    ) override
+    {
+        UNREFERENCED_PARAMETER(dwCloneFlags);
+        UNREFERENCED_PARAMETER(ppHttpContext);
+        return E_NOTIMPL;
+    }
+
+    HRESULT
+    ReleaseClonedContext(
+        VOID
+    ) override
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT
+    GetCurrentExecutionStats(
+        _Out_ DWORD *               pdwNotification,
+        _Out_ DWORD *               pdwNotificationStartTickCount = NULL,
+        _Out_ PCWSTR *              ppszModule = NULL,
+        _Out_ DWORD *               pdwModuleStartTickCount = NULL,
+        _Out_ DWORD *               pdwAsyncNotification = NULL,
+        _Out_ DWORD *               pdwAsyncNotificationStartTickCount = NULL
+    ) const override
+    {
+        UNREFERENCED_PARAMETER(pdwNotification);
+        UNREFERENCED_PARAMETER(pdwNotificationStartTickCount);
+        UNREFERENCED_PARAMETER(ppszModule);
+        UNREFERENCED_PARAMETER(pdwModuleStartTickCount);
+        UNREFERENCED_PARAMETER(pdwAsyncNotification);
+        UNREFERENCED_PARAMETER(pdwAsyncNotificationStartTickCount);
+        return E_NOTIMPL;
+    }
+
+    IHttpTraceContext *
+    GetTraceContext(
+        VOID
+    ) const override
+    {
+        return const_cast<FAKE_HTTP_TRACE_CONTEXT *>(&m_traceContext);
+    }
+
+    HRESULT
+    GetServerVarChanges(
+        _In_ DWORD                  dwOldChangeNumber,
+        _Out_ DWORD *               pdwNewChangeNumber,
+        _Inout_ DWORD *             pdwVariableSnapshot,
+        _Inout_ PCSTR **            ppVariableNameSnapshot,
+        _Inout_ PCWSTR **           ppVariableValueSnapshot,
+        _Out_ DWORD *               pdwDiffedVariables,
+        _Out_ DWORD **              ppDiffedVariableIndices
+    ) override
+    {
+        UNREFERENCED_PARAMETER(dwOldChangeNumber);
+        UNREFERENCED_PARAMETER(pdwNewChangeNumber);
+        UNREFERENCED_PARAMETER(pdwVariableSnapshot);
+        UNREFERENCED_PARAMETER(ppVariableNameSnapshot);
+        UNREFERENCED_PARAMETER(ppVariableValueSnapshot);
+        UNREFERENCED_PARAMETER(pdwDiffedVariables);
+        UNREFERENCED_PARAMETER(ppDiffedVariableIndices);
+        return E_NOTIMPL;
+    }
+
+    HRESULT
+    CancelIo(
+        VOID
+    ) override
+    {
+        return S_OK;
+    }
+
+    HRESULT
+    MapHandler(
+        _In_ DWORD                  dwSiteId,
+        _In_ PCWSTR                 pszSiteName,
+        _In_ PCWSTR                 pszUrl,
+        _In_ PCSTR                  pszVerb,
+        _Outptr_ IScriptMapInfo **  ppScriptMap,
+        _In_ BOOL                   fIgnoreWildcardMappings = FALSE
+    ) override
+    {
+        UNREFERENCED_PARAMETER(dwSiteId);
+        UNREFERENCED_PARAMETER(pszSiteName);
+        UNREFERENCED_PARAMETER(pszUrl);
+        UNREFERENCED_PARAMETER(pszVerb);
+        UNREFERENCED_PARAMETER(ppScriptMap);
+        UNREFERENCED_PARAMETER(fIgnoreWildcardMappings);
+        return E_NOTIMPL;
+    }
+
+    HRESULT
+    GetExtendedInterface(
+        _In_ HTTP_CONTEXT_INTERFACE_VERSION version,
+        _Outptr_ PVOID *                    ppInterface
+    ) override
+    {
+        UNREFERENCED_PARAMETER(version);
+        UNREFERENCED_PARAMETER(ppInterface);
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+private:
+
+    struct COMPLETION
+    {
+        DWORD       cbCompletion;
+        HRESULT     hrCompletionStatus;
+    };
+
+    FAKE_HTTP_CONTEXT(const FAKE_HTTP_CONTEXT &);
+    void operator=(const FAKE_HTTP_CONTEXT &);
+
+    static
+    VOID
+    CALLBACK
+    CompletionCallback(
+        _Inout_ PTP_CALLBACK_INSTANCE   Instance,
+        _Inout_opt_ PVOID               pvContext,
+        _Inout_ PTP_WORK                Work
+    );
+
+    //
+    // Runs requests, starting with the execution of settings, until one
+    // is pending or the owner is done. m_deliveryLock is held.
+    //
+    VOID
+    RunRequestsLocked(
+        const FAKE_REQUEST_SETTINGS &   settings
+    );
+
+    REQUEST_NOTIFICATION_STATUS
+    BeginRequestLocked(
+        const FAKE_REQUEST_SETTINGS &   settings
+    );
+
+    //
+    // Ends the request of the handler, FALSE when the owner is done
+    // with the context.
+    //
+    BOOL
+    EndRequestLocked(
+        _Out_ FAKE_REQUEST_SETTINGS *   pNextRequest
+    );
+
+    IAPPLICATION *                  m_pApplication;
+    FAKE_HTTP_CONTEXT_OWNER *       m_pOwner;
+    FAKE_REQUEST_MEMORY             m_memory;
+    FAKE_HTTP_REQUEST               m_request;
+    FAKE_HTTP_RESPONSE              m_response;
+    FAKE_HTTP_CONNECTION            m_connection;
+    FAKE_HTTP_USER                  m_user;
+    FAKE_HTTP_TRACE_CONTEXT         m_traceContext;
+    FAKE_REQUEST_SETTINGS           m_settings;
+    IREQUEST_HANDLER *              m_pHandler;
+    BOOL                            m_fHandlerCreated;
+    LONGLONG                        m_llStart;
+    LONGLONG                        m_llEnd;
+
+    //
+    // Held around every call into the handler.
+    //
+    SRWLOCK                         m_deliveryLock;
+    //
+    // Completions not delivered yet, one work item submitted for each.
+    //
+    SRWLOCK                         m_queueLock;
+    COMPLETION                      m_rgCompletions[8];
+    DWORD                           m_iFirstCompletion;
+    DWORD                           m_cCompletions;
+    PTP_WORK                        m_pCompletionWork;
+};
@@ -0,0 +1,513 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include <fstream>
+#include "exceptions.h"
+
+HEADER_REPLAY::HEADER_REPLAY(
+    _In_ IAPPLICATION *     pApplication
+) : m_pApplication(pApplication),
+    m_pServerProcess(NULL)
+{
+}
+
+HEADER_REPLAY::~HEADER_REPLAY()
+{
+    m_pContext.reset();
+
+    if (m_pServerProcess != NULL)
+    {
+        m_pServerProcess->DereferenceServerProcess();
+        m_pServerProcess = NULL;
+    }
+}
+
+HRESULT
+HEADER_REPLAY::Initialize(
+    VOID
+)
+{
+    m_pContext = std::make_unique<FAKE_HTTP_CONTEXT>(m_pApplication, this);
+    RETURN_IF_FAILED(m_pContext->Initialize());
+
+    RETURN_IF_FAILED(AddBuiltInSets());
+
+    //
+    // GetHeaders only reads the port and the pairing token of the process.
+    //
+    RETURN_IF_FAILED(static_cast<OUT_OF_PROCESS_APPLICATION*>(m_pApplication)->GetProcess(&m_pServerProcess));
+    return S_OK;
+}
+
+VOID
+HEADER_REPLAY::AddRequestHeader(
+    _Inout_ HEADER_SET *        pSet,
+    const std::string &         strName,
+    const std::string &         strValue
+)
+{
+    pSet->strings.push_back(strName);
+    PCSTR pszName = pSet->strings.back().c_str();
+    pSet->strings.push_back(strValue);
+    const std::string & strStored = pSet->strings.back();
+
+    pSet->requestHeaders.push_back({ pszName, strStored.c_str(), static_cast<USHORT>(strStored.size()) });
+}
+
+//
+// Deterministic token of cch characters, for the values whose length
+// matters but whose content does not: cookies, bearer tokens, nonces.
+//
+static
+std::string
+MakeToken(
+    SIZE_T      cch,
+    DWORD       dwSeed
+)
+{
+    static const CHAR s_rgchAlphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    std::string strToken(cch, '\0');
+
+    for (SIZE_T i = 0; i < cch; i++)
+    {
+        dwSeed = dwSeed * 1103515245 + 12345;
+        strToken[i] = s_rgchAlphabet[(dwSeed >> 16) & 63];
+    }
+    return strToken;
+}
+
+static
+VOID
+AppendResponseHeader(
+    _Inout_ std::string *   pstrHeaders,
+    PCSTR                   pszName,
+    const std::string &     strValue
+)
+{
+    pstrHeaders->append(pszName);
+    pstrHeaders->append(": ");
+    pstrHeaders->append(strValue);
+    pstrHeaders->append("\r\n");
+}
+
+HRESULT
+HEADER_REPLAY::AddBuiltInSets(
+    VOID
+)
+{
+    const std::string strDate = "Tue, 14 Oct 2025 08:12:31 GMT";
+
+    //
+    // A page navigation of a current desktop browser, with the
+    // antiforgery and telemetry cookies of an MVC site.
+    //
+    {
+        HEADER_SET set = {};
+        set.strName = "browser";
+        set.fReverseRewrite = FALSE;
+
+        AddRequestHeader(&set, "Host", "localhost");
+        AddRequestHeader(&set, "Accept", "text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,"
+            "image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7");
+        AddRequestHeader(&set, "Accept-Encoding", "gzip, deflate, br, zstd");
+        AddRequestHeader(&set, "Accept-Language", "en-US,en;q=0.9,de;q=0.8");
+        AddRequestHeader(&set, "Cache-Control", "max-age=0");
+        AddRequestHeader(&set, "Cookie", "ai_user=" + MakeToken(22, 1) + "|2025-10-13T07:41:12.118Z; "
+            ".AspNetCore.Antiforgery." + MakeToken(11, 2) + "=" + MakeToken(190, 3) + "; "
+            "ai_session=" + MakeToken(22, 4) + "|1728891151000|1728891151000");
+        AddRequestHeader(&set, "Referer", "https://localhost/products?page=2");
+        AddRequestHeader(&set, "sec-ch-ua", "\"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"");
+        AddRequestHeader(&set, "sec-ch-ua-mobile", "?0");
+        AddRequestHeader(&set, "sec-ch-ua-platform", "\"Windows\"");
+        AddRequestHeader(&set, "Sec-Fetch-Dest", "document");
+        AddRequestHeader(&set, "Sec-Fetch-Mode", "navigate");
+        AddRequestHeader(&set, "Sec-Fetch-Site", "same-origin");
+        AddRequestHeader(&set, "Sec-Fetch-User", "?1");
+        AddRequestHeader(&set, "Upgrade-Insecure-Requests", "1");
+        AddRequestHeader(&set, "User-Agent", "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 "
+            "(KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36");
+
+        set.strResponseHeaders = "HTTP/1.1 200 OK\r\n";
+        AppendResponseHeader(&set.strResponseHeaders, "Content-Type", "text/html; charset=utf-8");
+        AppendResponseHeader(&set.strResponseHeaders, "Date", strDate);
+        AppendResponseHeader(&set.strResponseHeaders, "Server", "Kestrel");
+        AppendResponseHeader(&set.strResponseHeaders, "Cache-Control", "no-cache, no-store");
+        AppendResponseHeader(&set.strResponseHeaders, "Pragma", "no-cache");
+        AppendResponseHeader(&set.strResponseHeaders, "Content-Encoding", "br");
+        AppendResponseHeader(&set.strResponseHeaders, "Transfer-Encoding", "chunked");
+        AppendResponseHeader(&set.strResponseHeaders, "Vary", "Accept-Encoding");
+        AppendResponseHeader(&set.strResponseHeaders, "Content-Security-Policy", "default-src 'self'; script-src 'self' "
+            "'nonce-" + MakeToken(24, 5) + "' https://cdn.example.net; style-src 'self' 'unsafe-inline'; "
+            "img-src 'self' data: https:; connect-src 'self' https://api.example.net; frame-ancestors 'none'");
+        AppendResponseHeader(&set.strResponseHeaders, "Set-Cookie", ".AspNetCore.Antiforgery." + MakeToken(11, 2) + "=" +
+            MakeToken(190, 6) + "; path=/; samesite=strict; httponly");
+        AppendResponseHeader(&set.strResponseHeaders, "Strict-Transport-Security", "max-age=31536000; includeSubDomains");
+        AppendResponseHeader(&set.strResponseHeaders, "X-Content-Type-Options", "nosniff");
+        AppendResponseHeader(&set.strResponseHeaders, "X-Frame-Options", "DENY");
+        set.strResponseHeaders.append("\r\n");
+
+        m_sets.push_back(std::move(set));
+    }
+
+    //
+    // A service to service call with a JWT bearer token and W3C trace
+    // context.
+    //
+    {
+        HEADER_SET set = {};
+        set.strName = "api";
+        set.fReverseRewrite = FALSE;
+
+        AddRequestHeader(&set, "Host", "localhost");
+        AddRequestHeader(&set, "Accept", "application/json");
+        AddRequestHeader(&set, "Accept-Encoding", "gzip");
+        AddRequestHeader(&set, "Authorization", "Bearer " + MakeToken(36, 7) + "." + MakeToken(980, 8) + "." + MakeToken(342, 9));
+        AddRequestHeader(&set, "Content-Type", "application/json; charset=utf-8");
+        AddRequestHeader(&set, "traceparent", "00-" + MakeToken(32, 10) + "-" + MakeToken(16, 11) + "-01");
+        AddRequestHeader(&set, "tracestate", "az=" + MakeToken(16, 12));
+        AddRequestHeader(&set, "Request-Id", "|" + MakeToken(32, 10) + "." + MakeToken(16, 11) + ".");
+        AddRequestHeader(&set, "X-Correlation-ID", MakeToken(36, 13));
+        AddRequestHeader(&set, "Api-Version", "2.0");
+        AddRequestHeader(&set, "User-Agent", "Microsoft.Extensions.Http/8.0 (.NET 8.0.10; Microsoft Windows 10.0.20348)");
+
+        set.strResponseHeaders = "HTTP/1.1 200 OK\r\n";
+        AppendResponseHeader(&set.strResponseHeaders, "Content-Type", "application/json; charset=utf-8");
+        AppendResponseHeader(&set.strResponseHeaders, "Date", strDate);
+        AppendResponseHeader(&set.strResponseHeaders, "Server", "Kestrel");
+        AppendResponseHeader(&set.strResponseHeaders, "Transfer-Encoding", "chunked");
+        AppendResponseHeader(&set.strResponseHeaders, "ETag", "W/\"" + MakeToken(27, 14) + "\"");
+        AppendResponseHeader(&set.strResponseHeaders, "api-supported-versions", "1.0, 2.0");
+        AppendResponseHeader(&set.strResponseHeaders, "Request-Context", "appId=cid-v1:" + MakeToken(36, 15));
+        AppendResponseHeader(&set.strResponseHeaders, "X-RateLimit-Limit", "1000");
+        AppendResponseHeader(&set.strResponseHeaders, "X-RateLimit-Remaining", "998");
+        AppendResponseHeader(&set.strResponseHeaders, "X-RateLimit-Reset", "1728893551");
+        set.strResponseHeaders.append("\r\n");
+
+        m_sets.push_back(std::move(set));
+    }
+
+    //
+    // A signed in session behind ARR: the authentication cookie split in
+    // chunks, affinity cookies, and the redirect of an OpenID Connect
+    // challenge whose Location and cookie domains point at the backend,
+    // so that the reverse rewrite has them all to rewrite.
+    //
+    {
+        HEADER_SET set = {};
+        set.strName = "cookies";
+        set.fReverseRewrite = TRUE;
+
+        AddRequestHeader(&set, "Host", "www.contoso.com");
+        AddRequestHeader(&set, "Accept", "text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8");
+        AddRequestHeader(&set, "Accept-Encoding", "gzip, deflate, br");
+        AddRequestHeader(&set, "Accept-Language", "en-US,en;q=0.5");
+        AddRequestHeader(&set, "Cookie", "ARRAffinity=" + MakeToken(64, 16) + "; ARRAffinitySameSite=" + MakeToken(64, 16) + "; "
+            ".AspNetCore.Cookies=chunks-3; "
+            ".AspNetCore.CookiesC1=" + MakeToken(4000, 17) + "; "
+            ".AspNetCore.CookiesC2=" + MakeToken(4000, 18) + "; "
+            ".AspNetCore.CookiesC3=" + MakeToken(1500, 19) + "; "
+            "_ga=GA1.1.1398524026.1728812112; _ga_" + MakeToken(10, 20) + "=GS1.1.1728891151.4.1.1728891160.0.0.0; "
+            "ai_user=" + MakeToken(22, 21) + "|2025-10-13T07:41:12.118Z");
+        AddRequestHeader(&set, "Referer", "https://www.contoso.com/account");
+        AddRequestHeader(&set, "User-Agent", "Mozilla/5.0 (Windows NT 10.0; Win64; x64; rv:131.0) Gecko/20100101 Firefox/131.0");
+
+        set.strResponseHeaders = "HTTP/1.1 302 Found\r\n";
+        AppendResponseHeader(&set.strResponseHeaders, "Content-Length", "0");
+        AppendResponseHeader(&set.strResponseHeaders, "Date", strDate);
+        AppendResponseHeader(&set.strResponseHeaders, "Server", "Kestrel");
+        AppendResponseHeader(&set.strResponseHeaders, "Cache-Control", "no-cache,no-store");
+        AppendResponseHeader(&set.strResponseHeaders, "Expires", "Thu, 01 Jan 1970 00:00:00 GMT");
+        AppendResponseHeader(&set.strResponseHeaders, "Pragma", "no-cache");
+        AppendResponseHeader(&set.strResponseHeaders, "Location", "http://127.0.0.1:5000/signin-oidc?state=" + MakeToken(600, 22));
+        AppendResponseHeader(&set.strResponseHeaders, "Set-Cookie", ".AspNetCore.OpenIdConnect.Nonce." + MakeToken(60, 23) +
+            "=N; expires=Tue, 14 Oct 2025 08:27:31 GMT; domain=127.0.0.1; path=/signin-oidc; secure; samesite=none; httponly");
+        AppendResponseHeader(&set.strResponseHeaders, "Set-Cookie", ".AspNetCore.Correlation." + MakeToken(43, 24) +
+            "=N; expires=Tue, 14 Oct 2025 08:27:31 GMT; domain=127.0.0.1; path=/signin-oidc; secure; samesite=none; httponly");
+        AppendResponseHeader(&set.strResponseHeaders, "Set-Cookie", ".AspNetCore.CookiesC1=; expires=Thu, 01 Jan 1970 00:00:00 GMT; "
+            "domain=127.0.0.1; path=/; secure; samesite=lax");
+        AppendResponseHeader(&set.strResponseHeaders, "Set-Cookie", ".AspNetCore.CookiesC2=; expires=Thu, 01 Jan 1970 00:00:00 GMT; "
+            "domain=127.0.0.1; path=/; secure; samesite=lax");
+        AppendResponseHeader(&set.strResponseHeaders, "Set-Cookie", ".AspNetCore.CookiesC3=; expires=Thu, 01 Jan 1970 00:00:00 GMT; "
+            "domain=127.0.0.1; path=/; secure; samesite=lax");
+        set.strResponseHeaders.append("\r\n");
+
+        m_sets.push_back(std::move(set));
+    }
+
+    //
+    // The preflight of a cross-origin call from a single page application,
+    // answered with the CORS, isolation and platform headers a gateway
+    // adds, most of them unknown to HTTP.sys.
+    //
+    {
+        HEADER_SET set = {};
+        set.strName = "cors";
+        set.fReverseRewrite = FALSE;
+
+        AddRequestHeader(&set, "Host", "api.contoso.com");
+        AddRequestHeader(&set, "Accept", "*/*");
+        AddRequestHeader(&set, "Accept-Encoding", "gzip, deflate, br, zstd");
+        AddRequestHeader(&set, "Accept-Language", "en-US,en;q=0.9");
+        AddRequestHeader(&set, "Access-Control-Request-Method", "PUT");
+        AddRequestHeader(&set, "Access-Control-Request-Headers",
+            "authorization,content-type,traceparent,x-client-version,x-correlation-id,x-requested-with,x-tenant-id");
+        AddRequestHeader(&set, "Origin", "https://app.contoso.com");
+        AddRequestHeader(&set, "Referer", "https://app.contoso.com/");
+        AddRequestHeader(&set, "Sec-Fetch-Dest", "empty");
+        AddRequestHeader(&set, "Sec-Fetch-Mode", "cors");
+        AddRequestHeader(&set, "Sec-Fetch-Site", "same-site");
+        AddRequestHeader(&set, "User-Agent", "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 "
+            "(KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36 Edg/124.0.0.0");
+
+        set.strResponseHeaders = "HTTP/1.1 204 No Content\r\n";
+        AppendResponseHeader(&set.strResponseHeaders, "Date", strDate);
+        AppendResponseHeader(&set.strResponseHeaders, "Server", "Kestrel");
+        AppendResponseHeader(&set.strResponseHeaders, "Access-Control-Allow-Origin", "https://app.contoso.com");
+        AppendResponseHeader(&set.strResponseHeaders, "Access-Control-Allow-Credentials", "true");
+        AppendResponseHeader(&set.strResponseHeaders, "Access-Control-Allow-Methods", "GET,POST,PUT,PATCH,DELETE,OPTIONS");
+        AppendResponseHeader(&set.strResponseHeaders, "Access-Control-Allow-Headers",
+            "authorization,content-type,traceparent,x-client-version,x-correlation-id,x-requested-with,x-tenant-id");
+        AppendResponseHeader(&set.strResponseHeaders, "Access-Control-Expose-Headers",
+            "content-disposition,etag,location,x-correlation-id,x-pagination,x-ratelimit-limit,x-ratelimit-remaining,"
+            "x-ratelimit-reset,x-request-id,x-total-count");
+        AppendResponseHeader(&set.strResponseHeaders, "Access-Control-Max-Age", "7200");
+        AppendResponseHeader(&set.strResponseHeaders, "Vary", "Origin, Access-Control-Request-Method, Access-Control-Request-Headers");
+        AppendResponseHeader(&set.strResponseHeaders, "Timing-Allow-Origin", "https://app.contoso.com");
+        AppendResponseHeader(&set.strResponseHeaders, "Cross-Origin-Resource-Policy", "same-site");
+        AppendResponseHeader(&set.strResponseHeaders, "Cross-Origin-Opener-Policy", "same-origin");
+        AppendResponseHeader(&set.strResponseHeaders, "Cross-Origin-Embedder-Policy", "require-corp");
+        AppendResponseHeader(&set.strResponseHeaders, "Permissions-Policy", "accelerometer=(), camera=(), geolocation=(), "
+            "gyroscope=(), magnetometer=(), microphone=(), payment=(), usb=(), interest-cohort=()");
+        AppendResponseHeader(&set.strResponseHeaders, "Referrer-Policy", "strict-origin-when-cross-origin");
+        AppendResponseHeader(&set.strResponseHeaders, "Strict-Transport-Security", "max-age=63072000; includeSubDomains; preload");
+        AppendResponseHeader(&set.strResponseHeaders, "X-Content-Type-Options", "nosniff");
+        AppendResponseHeader(&set.strResponseHeaders, "X-Frame-Options", "SAMEORIGIN");
+        AppendResponseHeader(&set.strResponseHeaders, "X-XSS-Protection", "0");
+        AppendResponseHeader(&set.strResponseHeaders, "X-Request-ID", MakeToken(36, 25));
+        AppendResponseHeader(&set.strResponseHeaders, "X-Correlation-ID", MakeToken(36, 13));
+        AppendResponseHeader(&set.strResponseHeaders, "X-Powered-By", "ASP.NET");
+        AppendResponseHeader(&set.strResponseHeaders, "X-Served-By", "cache-fra-etou8220100-FRA");
+        AppendResponseHeader(&set.strResponseHeaders, "X-Cache", "MISS");
+        AppendResponseHeader(&set.strResponseHeaders, "X-Azure-Ref", "0" + MakeToken(88, 26));
+        AppendResponseHeader(&set.strResponseHeaders, "x-ms-request-id", MakeToken(36, 27));
+        AppendResponseHeader(&set.strResponseHeaders, "x-ms-correlation-request-id", MakeToken(36, 28));
+        AppendResponseHeader(&set.strResponseHeaders, "x-ms-routing-request-id", "WESTEUROPE:20251014T081231Z:" + MakeToken(36, 29));
+        AppendResponseHeader(&set.strResponseHeaders, "x-envoy-upstream-service-time", "3");
+        AppendResponseHeader(&set.strResponseHeaders, "Request-Context", "appId=cid-v1:" + MakeToken(36, 15));
+        AppendResponseHeader(&set.strResponseHeaders, "Alt-Svc", "h3=\":443\"; ma=86400");
+        set.strResponseHeaders.append("\r\n");
+
+        m_sets.push_back(std::move(set));
+    }
+
+    return S_OK;
+}
+
+HRESULT
+HEADER_REPLAY::LoadCorpus(
+    _In_ PCWSTR             pszPath
+)
+{
+    std::ifstream   file(pszPath);
+    std::string     strLine;
+    HEADER_SET *    pSet = NULL;
+
+    if (!file)
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND));
+    }
+
+    //
+    // The sets are added to a local vector first, the FAKE_HEADER_VALUEs
+    // of a set point into its own strings and survive it being moved.
+    //
+    std::vector<HEADER_SET> sets;
+
+    while (std::getline(file, strLine))
+    {
+        if (!strLine.empty() && strLine.back() == '\r')
+        {
+            strLine.pop_back();
+        }
+
+        if (strLine.empty() || strLine[0] == '#')
+        {
+            continue;
+        }
+
+        if (strLine[0] == '[')
+        {
+            const size_t ichEnd = strLine.find(']');
+            if (ichEnd == std::string::npos)
+            {
+                RETURN_HR(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+            }
+
+            sets.emplace_back();
+            pSet = &sets.back();
+            pSet->strName = strLine.substr(1, ichEnd - 1);
+            pSet->fReverseRewrite = FALSE;
+            continue;
+        }
+
+        // Everything else belongs to a set.
+        if (pSet == NULL)
+        {
+            RETURN_HR(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+        }
+
+        if (strLine[0] == '!')
+        {
+            pSet->fReverseRewrite = TRUE;
+        }
+        else if (strLine.compare(0, 2, "> ") == 0)
+        {
+            const size_t ichColon = strLine.find(':', 2);
+            if (ichColon == std::string::npos)
+            {
+                RETURN_HR(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+            }
+
+            size_t ichValue = ichColon + 1;
+            while (ichValue < strLine.size() && strLine[ichValue] == ' ')
+            {
+                ichValue++;
+            }
+
+            if (strLine.size() - ichValue > MAXUSHORT)
+            {
+                RETURN_HR(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+            }
+            AddRequestHeader(pSet, strLine.substr(2, ichColon - 2), strLine.substr(ichValue));
+        }
+        else if (strLine.compare(0, 2, "< ") == 0)
+        {
+            pSet->strResponseHeaders.append(strLine, 2, std::string::npos);
+            pSet->strResponseHeaders.append("\r\n");
+        }
+        else
+        {
+            RETURN_HR(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+        }
+    }
+
+    for (HEADER_SET & set : sets)
+    {
+        // A set needs at least its status line.
+        if (set.strResponseHeaders.empty())
+        {
+            RETURN_HR(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+        }
+        set.strResponseHeaders.append("\r\n");
+        m_sets.push_back(std::move(set));
+    }
+
+    return S_OK;
+}
+
+HRESULT
+HEADER_REPLAY::ReplayOnce(
+    const HEADER_SET &          set
+)
+{
+    FAKE_REQUEST_SETTINGS   settings = {};
+    IREQUEST_HANDLER *      pRequestHandler = NULL;
+    PCWSTR                  pszHeaders = NULL;
+    DWORD                   cchHeaders = 0;
+    HRESULT                 hr = S_OK;
+
+    settings.pHeaders = set.requestHeaders.data();
+    settings.cHeaders = static_cast<DWORD>(set.requestHeaders.size());
+    RETURN_IF_FAILED(m_pContext->Prepare(settings));
+
+    RETURN_IF_FAILED(m_pApplication->TryCreateHandler(m_pContext.get(), &pRequestHandler));
+    FORWARDING_HANDLER *pHandler = static_cast<FORWARDING_HANDLER*>(pRequestHandler);
+
+    FINISHED_IF_FAILED(pHandler->GetHeaders(FORWARDING_HANDLER::QueryProtocolConfig(),
+        /* fForwardWindowsAuthToken */ FALSE,
+        m_pServerProcess,
+        &pszHeaders,
+        &cchHeaders));
+
+    if (set.fReverseRewrite)
+    {
+        //
+        // What OnExecuteRequestHandler sets up when the protocol config
+        // asks for the reverse rewrite.
+        //
+        USHORT cchHostName = 0;
+        FINISHED_IF_FAILED(pHandler->EnsureColdState());
+        pHandler->m_pCold->pszOriginalHostHeader = m_pContext->GetRequest()->GetHeader(HttpHeaderHost, &cchHostName);
+        pHandler->m_pCold->cchOriginalHostHeader = cchHostName;
+        pHandler->m_fDoReverseRewriteHeaders = TRUE;
+    }
+
+    memcpy(m_responseBuffer.data(), set.strResponseHeaders.c_str(), set.strResponseHeaders.size() + 1);
+    FINISHED_IF_FAILED(pHandler->SetStatusAndHeaders(m_responseBuffer.data(),
+        static_cast<DWORD>(set.strResponseHeaders.size())));
+
+Finished:
+    pRequestHandler->DereferenceRequestHandler();
+    return hr;
+}
+
+HRESULT
+HEADER_REPLAY::Run(
+    DWORD                   dwIndex,
+    DWORD                   cWarmup,
+    DWORD                   cIterations,
+    _Out_ RESULT *          pResult
+)
+{
+    const HEADER_SET &  set = m_sets[dwIndex];
+    const BOOL          fCountAllocations = ALLOCATION_COUNTER::IsEnabled();
+    LARGE_INTEGER       liFrequency;
+    LARGE_INTEGER       liStart;
+    LARGE_INTEGER       liEnd;
+    LONG64              cAllocationsBefore = 0;
+
+    ZeroMemory(pResult, sizeof(*pResult));
+    QueryPerformanceFrequency(&liFrequency);
+
+    if (m_responseBuffer.size() < set.strResponseHeaders.size() + 1)
+    {
+        m_responseBuffer.resize(set.strResponseHeaders.size() + 1);
+    }
+
+    for (DWORD i = 0; i < cWarmup; i++)
+    {
+        RETURN_IF_FAILED(ReplayOnce(set));
+    }
+
+    cAllocationsBefore = ALLOCATION_COUNTER::QueryAllocations();
+    QueryPerformanceCounter(&liStart);
+
+    for (DWORD i = 0; i < cIterations; i++)
+    {
+        RETURN_IF_FAILED(ReplayOnce(set));
+    }
+
+    QueryPerformanceCounter(&liEnd);
+
+    pResult->dblNanosecondsPerRequest = (liEnd.QuadPart - liStart.QuadPart) * 1e9 /
+        liFrequency.QuadPart / cIterations;
+    pResult->dblAllocationsPerRequest = fCountAllocations ?
+        static_cast<double>(ALLOCATION_COUNTER::QueryAllocations() - cAllocationsBefore) / cIterations :
+        -1;
+    return S_OK;
+}
+
+BOOL
+HEADER_REPLAY::OnRequestCompleted(
+    _In_ FAKE_HTTP_CONTEXT *            pContext,
+    _Out_ FAKE_REQUEST_SETTINGS *       pNextRequest
+)
+{
+    UNREFERENCED_PARAMETER(pContext);
+    UNREFERENCED_PARAMETER(pNextRequest);
+
+    // The replay never starts a request.
+    return FALSE;
+}
@@ -0,0 +1,151 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// Replays recorded request and response header sets through the header
+// paths of FORWARDING_HANDLER alone: GetHeaders builds the headers sent to
+// the backend, SetStatusAndHeaders parses the backend's response headers
+// onto the IIS response through RESPONSE_HEADER_HASH, along with
+// DoReverseRewrite for the sets recorded behind a reverse rewrite.
+// Nothing is sent, the backend of the harness only lends its
+// SERVER_PROCESS.
+//
+// One iteration is one request: the handler is created on a
+// FAKE_HTTP_CONTEXT prepared with the request headers, runs both paths
+// and is released. A replay measures the time of an iteration and, when
+// ALLOCATION_COUNTER is counting, the heap allocations of one.
+//
+// The built-in sets have the shape of the traffic that dominates the
+// production profiles: a browser navigation, an API client with a bearer
+// token, a session with chunked authentication cookies and a CORS heavy
+// cross-origin call. A corpus file adds recorded ones, see LoadCorpus.
+//
+class HEADER_REPLAY : public FAKE_HTTP_CONTEXT_OWNER
+{
+public:
+
+    struct RESULT
+    {
+        double      dblNanosecondsPerRequest;
+        //
+        // -1 when allocations were not counted.
+        //
+        double      dblAllocationsPerRequest;
+    };
+
+    HEADER_REPLAY(
+        _In_ IAPPLICATION *     pApplication
+    );
+
+    ~HEADER_REPLAY();
+
+    //
+    // Adds the built-in header sets, and starts the backend whose process
+    // the handlers are given.
+    //
+    HRESULT
+    Initialize(
+        VOID
+    );
+
+    //
+    // Adds the header sets of a corpus file. A set starts with a "[name]"
+    // line, followed by "> Name: value" lines for the request headers and
+    // "< " lines for the response, the status line first. A "!" line asks
+    // for the reverse rewrite of the response headers, "#" lines are
+    // comments.
+    //
+    HRESULT
+    LoadCorpus(
+        _In_ PCWSTR             pszPath
+    );
+
+    DWORD
+    QuerySetCount(
+        VOID
+    ) const
+    {
+        return static_cast<DWORD>(m_sets.size());
+    }
+
+    PCSTR
+    QuerySetName(
+        DWORD                   dwIndex
+    ) const
+    {
+        return m_sets[dwIndex].strName.c_str();
+    }
+
+    //
+    // Replays set dwIndex cWarmup times unmeasured, then cIterations
+    // times measured.
+    //
+    HRESULT
+    Run(
+        DWORD                   dwIndex,
+        DWORD                   cWarmup,
+        DWORD                   cIterations,
+        _Out_ RESULT *          pResult
+    );
+
+    BOOL
+    OnRequestCompleted(
+        _In_ FAKE_HTTP_CONTEXT *            pContext,
+        _Out_ FAKE_REQUEST_SETTINGS *       pNextRequest
+    ) override;
+
+private:
+
+    struct HEADER_SET
+    {
+        std::string                     strName;
+        //
+        // Names and values the FAKE_HEADER_VALUEs point into, a list so
+        // that adding one never moves the others.
+        //
+        std::list<std::string>          strings;
+        std::vector<FAKE_HEADER_VALUE>  requestHeaders;
+        //
+        // Status line and headers as WinHTTP hands them to the handler,
+        // lines ending with CRLF.
+        //
+        std::string                     strResponseHeaders;
+        BOOL                            fReverseRewrite;
+    };
+
+    HEADER_REPLAY(const HEADER_REPLAY &);
+    void operator=(const HEADER_REPLAY &);
+
+    HRESULT
+    AddBuiltInSets(
+        VOID
+    );
+
+    static
+    VOID
+    AddRequestHeader(
+        _Inout_ HEADER_SET *        pSet,
+        const std::string &         strName,
+        const std::string &         strValue
+    );
+
+    //
+    // One request of set: both header paths on a new handler.
+    //
+    HRESULT
+    ReplayOnce(
+        const HEADER_SET &          set
+    );
+
+    IAPPLICATION *                  m_pApplication;
+    std::unique_ptr<FAKE_HTTP_CONTEXT> m_pContext;
+    SERVER_PROCESS *                m_pServerProcess;
+    std::vector<HEADER_SET>         m_sets;
+    //
+    // SetStatusAndHeaders terminates names and values in place, each
+    // iteration parses a fresh copy.
+    //
+    std::vector<CHAR>               m_responseBuffer;
+};
@@ -0,0 +1,338 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include <TlHelp32.h>
+#include "exceptions.h"
+
+FORWARDING_LOAD_HARNESS::FORWARDING_LOAD_HARNESS(
+    const OPTIONS &     options
+) : m_options(options),
+    m_fStaticInitialized(FALSE),
+    m_cStarted(0),
+    m_cCompleted(0),
+    m_cSucceeded(0),
+    m_cFailed(0),
+    m_cContextsRunning(0),
+    m_cPhaseRequests(0),
+    m_fMeasure(FALSE),
+    m_cPeakThreads(0),
+    m_hPhaseDone(NULL)
+{
+    m_settings.cbRequestBody = options.cbRequestBody;
+    m_settings.cbResponseBody = options.cbResponseBody;
+    m_settings.pHeaders = NULL;
+    m_settings.cHeaders = 0;
+}
+
+FORWARDING_LOAD_HARNESS::~FORWARDING_LOAD_HARNESS()
+{
+    //
+    // Waits for the completions in flight, the requests are all done.
+    //
+    m_contexts.clear();
+
+    if (m_pApplication != NULL)
+    {
+        m_pApplication->Stop(/* fServerInitiated */ false);
+        m_pApplication.reset();
+    }
+
+    if (m_fStaticInitialized)
+    {
+        WEBSOCKET_HANDLER::StaticTerminate();
+        FORWARDING_HANDLER::StaticTerminate();
+        ALLOC_CACHE_HANDLER::StaticTerminate();
+    }
+
+    if (m_hPhaseDone != NULL)
+    {
+        CloseHandle(m_hPhaseDone);
+        m_hPhaseDone = NULL;
+    }
+}
+
+HRESULT
+FORWARDING_LOAD_HARNESS::Initialize(
+    VOID
+)
+{
+    WCHAR   achPath[MAX_PATH];
+    HRESULT hr;
+
+    //
+    // The same sequence as EnsureOutOfProcessInitializtion, without IIS.
+    //
+    InitializeSRWLock(&g_srwLockRH);
+
+    hr = WINHTTP_HELPER::StaticInitialize();
+    if (FAILED_LOG(hr))
+    {
+        if (hr != HRESULT_FROM_WIN32(ERROR_PROC_NOT_FOUND))
+        {
+            return hr;
+        }
+        g_fWebSocketStaticInitialize = FALSE;
+    }
+    g_hWinHttpModule = GetModuleHandle(TEXT("winhttp.dll"));
+
+    g_dwTlsIndex = TlsAlloc();
+    RETURN_LAST_ERROR_IF(g_dwTlsIndex == TLS_OUT_OF_INDEXES);
+    m_fStaticInitialized = TRUE;
+    RETURN_IF_FAILED(ALLOC_CACHE_HANDLER::StaticInitialize());
+    RETURN_IF_FAILED(FORWARDING_HANDLER::StaticInitialize(g_fEnableReferenceCountTracing));
+    RETURN_IF_FAILED(FORWARDER_CONNECTION::OpenSession(FORWARDING_HANDLER::QueryProtocolConfig(), &g_hWinhttpSession));
+    RETURN_IF_FAILED(WEBSOCKET_HANDLER::StaticInitialize(g_fEnableReferenceCountTracing));
+
+    //
+    // The application lives next to the executable, which is its backend.
+    //
+    DWORD cchPath = GetModuleFileNameW(NULL, achPath, _countof(achPath));
+    RETURN_LAST_ERROR_IF(cchPath == 0 || cchPath == _countof(achPath));
+
+    try
+    {
+        m_strDirectory.assign(achPath, cchPath);
+        m_strDirectory.erase(m_strDirectory.find_last_of(L'\\'));
+
+        m_pHttpApplication = std::make_unique<FAKE_HTTP_APPLICATION>(m_strDirectory.c_str());
+
+        std::unique_ptr<REQUESTHANDLER_CONFIG> pConfig;
+        RETURN_IF_FAILED(CreateConfig(&pConfig));
+
+        auto pApplication = std::make_unique<OUT_OF_PROCESS_APPLICATION>(*m_pHttpApplication, std::move(pConfig));
+        RETURN_IF_FAILED(pApplication->Initialize());
+        m_pApplication.reset(pApplication.release());
+
+        for (DWORD i = 0; i < m_options.cConcurrency; i++)
+        {
+            auto pContext = std::make_unique<FAKE_HTTP_CONTEXT>(m_pApplication.get(), this);
+            RETURN_IF_FAILED(pContext->Initialize());
+            m_contexts.push_back(std::move(pContext));
+        }
+
+        m_latencies.resize(m_options.cRequests);
+    }
+    CATCH_RETURN();
+
+    m_hPhaseDone = CreateEventW(NULL, TRUE, FALSE, NULL);
+    RETURN_LAST_ERROR_IF_NULL(m_hPhaseDone);
+
+    return S_OK;
+}
+
+HRESULT
+FORWARDING_LOAD_HARNESS::CreateConfig(
+    _Out_ std::unique_ptr<REQUESTHANDLER_CONFIG> *  ppConfig
+)
+{
+    WCHAR achProcessPath[MAX_PATH];
+    WCHAR achArguments[256];
+
+    std::unique_ptr<REQUESTHANDLER_CONFIG> pConfig(new REQUESTHANDLER_CONFIG());
+
+    DWORD cchProcessPath = GetModuleFileNameW(NULL, achProcessPath, _countof(achProcessPath));
+    RETURN_LAST_ERROR_IF(cchProcessPath == 0 || cchProcessPath == _countof(achProcessPath));
+
+    if (swprintf_s(achArguments,
+        L"-backend -latency %lu -failureRate %lu -failureMode %s",
+        m_options.backend.dwLatencyInMS,
+        m_options.backend.dwFailurePercent,
+        LOOPBACK_BACKEND::QueryFailureModeName(m_options.backend.failureMode)) < 0)
+    {
+        RETURN_HR(E_UNEXPECTED);
+    }
+
+    //
+    // What Populate would read from the aspNetCore element of a site that
+    // only forwards: generous timeouts so that a loaded backend is not
+    // taken for a hung one, and a rapid fail limit the failure injection
+    // does not reach.
+    //
+    pConfig->m_dwRequestTimeoutInMS = 120000;
+    pConfig->m_dwStartupTimeLimitInMS = 120000;
+    pConfig->m_dwShutdownTimeLimitInMS = 10000;
+    pConfig->m_dwRapidFailsPerMinute = 100;
+    pConfig->m_dwProcessesPerApplication = m_options.cProcesses;
+    pConfig->m_dwResponseReadAheadBuffers = m_options.dwResponseReadAheadBuffers;
+    pConfig->m_dwResponseInlineReads = m_options.dwResponseInlineReads;
+    pConfig->m_dwArgc = 0;
+    pConfig->m_fStdoutLogEnabled = FALSE;
+    pConfig->m_fForwardWindowsAuthToken = FALSE;
+    pConfig->m_fDisableStartUpErrorPage = TRUE;
+    pConfig->m_fWindowsAuthEnabled = FALSE;
+    pConfig->m_fBasicAuthEnabled = FALSE;
+    pConfig->m_fAnonymousAuthEnabled = TRUE;
+    pConfig->m_hostingModel = HOSTING_OUT_PROCESS;
+
+    RETURN_IF_FAILED(pConfig->m_struProcessPath.Copy(achProcessPath));
+    RETURN_IF_FAILED(pConfig->m_struArguments.Copy(achArguments));
+    RETURN_IF_FAILED(pConfig->m_struApplication.Copy(m_pHttpApplication->GetApplicationId()));
+    RETURN_IF_FAILED(pConfig->m_struApplicationPhysicalPath.Copy(m_strDirectory.c_str()));
+    RETURN_IF_FAILED(pConfig->m_struApplicationVirtualPath.Copy(L"/"));
+    RETURN_IF_FAILED(pConfig->m_struConfigPath.Copy(m_pHttpApplication->GetAppConfigPath()));
+    RETURN_IF_FAILED(pConfig->m_fEnableOutOfProcessConsoleRedirection.Copy(L"false"));
+
+    *ppConfig = std::move(pConfig);
+    return S_OK;
+}
+
+HRESULT
+FORWARDING_LOAD_HARNESS::Run(
+    _Out_ RESULT *      pResult
+)
+{
+    LARGE_INTEGER   liFrequency;
+    LARGE_INTEGER   liStart;
+    LARGE_INTEGER   liEnd;
+    LONG64          cAllocationsBefore = 0;
+
+    ZeroMemory(pResult, sizeof(*pResult));
+    QueryPerformanceFrequency(&liFrequency);
+
+    //
+    // Starts the backends and fills the connection pools, the handler's
+    // allocation caches and the memory of the contexts.
+    //
+    if (m_options.cWarmupRequests != 0)
+    {
+        RETURN_IF_FAILED(RunPhase(m_options.cWarmupRequests, FALSE));
+    }
+
+    if (m_options.fCountAllocations)
+    {
+        ALLOCATION_COUNTER::Enable();
+        cAllocationsBefore = ALLOCATION_COUNTER::QueryAllocations();
+    }
+
+    QueryPerformanceCounter(&liStart);
+    RETURN_IF_FAILED(RunPhase(m_options.cRequests, TRUE));
+    QueryPerformanceCounter(&liEnd);
+
+    std::sort(m_latencies.begin(), m_latencies.begin() + m_options.cRequests);
+    auto percentile = [&](DWORD dwPerMille)
+    {
+        SIZE_T i = min(static_cast<SIZE_T>(m_options.cRequests) * dwPerMille / 1000, static_cast<SIZE_T>(m_options.cRequests) - 1);
+        return m_latencies[i] * 1000000.0 / liFrequency.QuadPart;
+    };
+
+    pResult->dblRequestsPerSecond = m_options.cRequests * static_cast<double>(liFrequency.QuadPart) / (liEnd.QuadPart - liStart.QuadPart);
+    pResult->dblP50Microseconds = percentile(500);
+    pResult->dblP99Microseconds = percentile(990);
+    pResult->dblP999Microseconds = percentile(999);
+    pResult->cSucceeded = m_cSucceeded;
+    pResult->cFailed = m_cFailed;
+    pResult->dblAllocationsPerRequest = m_options.fCountAllocations ?
+        static_cast<double>(ALLOCATION_COUNTER::QueryAllocations() - cAllocationsBefore) / m_options.cRequests :
+        -1;
+    //
+    // RunPhase sampled the threads while waiting.
+    //
+    pResult->cPeakThreads = m_cPeakThreads;
+
+    return S_OK;
+}
+
+HRESULT
+FORWARDING_LOAD_HARNESS::RunPhase(
+    DWORD               cRequests,
+    BOOL                fMeasure
+)
+{
+    DWORD cContexts = min(cRequests, static_cast<DWORD>(m_contexts.size()));
+
+    m_cPhaseRequests = cRequests;
+    m_fMeasure = fMeasure;
+    m_cStarted = cContexts;
+    m_cCompleted = 0;
+    m_cSucceeded = 0;
+    m_cFailed = 0;
+    m_cContextsRunning = cContexts;
+    m_cPeakThreads = 0;
+    RETURN_LAST_ERROR_IF(!ResetEvent(m_hPhaseDone));
+
+    for (DWORD i = 0; i < cContexts; i++)
+    {
+        m_contexts[i]->Start(m_settings);
+    }
+
+    while (WaitForSingleObject(m_hPhaseDone, 100) == WAIT_TIMEOUT)
+    {
+        m_cPeakThreads = max(m_cPeakThreads, QueryThreadCount());
+    }
+    m_cPeakThreads = max(m_cPeakThreads, QueryThreadCount());
+
+    return S_OK;
+}
+
+BOOL
+FORWARDING_LOAD_HARNESS::OnRequestCompleted(
+    _In_ FAKE_HTTP_CONTEXT *            pContext,
+    _Out_ FAKE_REQUEST_SETTINGS *       pNextRequest
+)
+{
+    LONG iCompleted = InterlockedIncrement(&m_cCompleted) - 1;
+
+    if (m_fMeasure)
+    {
+        m_latencies[iCompleted] = pContext->QueryLatency();
+
+        //
+        // A 2xx is only a success with the whole body on a connection that
+        // was not reset, a truncated backend response is neither.
+        //
+        if (pContext->QueryHandlerCreated() &&
+            pContext->QueryStatusCode() >= 200 && pContext->QueryStatusCode() < 300 &&
+            !pContext->QueryConnectionReset() &&
+            pContext->QueryBytesSent() == pContext->QuerySettings().cbResponseBody)
+        {
+            InterlockedIncrement(&m_cSucceeded);
+        }
+        else
+        {
+            InterlockedIncrement(&m_cFailed);
+        }
+    }
+
+    if (static_cast<DWORD>(InterlockedIncrement(&m_cStarted)) <= m_cPhaseRequests)
+    {
+        *pNextRequest = m_settings;
+        return TRUE;
+    }
+
+    if (InterlockedDecrement(&m_cContextsRunning) == 0)
+    {
+        SetEvent(m_hPhaseDone);
+    }
+    return FALSE;
+}
+
+// static
+DWORD
+FORWARDING_LOAD_HARNESS::QueryThreadCount(
+    VOID
+)
+{
+    HANDLE          hSnapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+    PROCESSENTRY32W entry = {};
+    DWORD           dwProcessId = GetCurrentProcessId();
+    DWORD           cThreads = 0;
+
+    if (hSnapshot == INVALID_HANDLE_VALUE)
+    {
+        return 0;
+    }
+
+    entry.dwSize = sizeof(entry);
+    for (BOOL fMore = Process32FirstW(hSnapshot, &entry); fMore; fMore = Process32NextW(hSnapshot, &entry))
+    {
+        if (entry.th32ProcessID == dwProcessId)
+        {
+            cThreads = entry.cntThreads;
+            break;
+        }
+    }
+
+    CloseHandle(hSnapshot);
+    return cThreads;
+}
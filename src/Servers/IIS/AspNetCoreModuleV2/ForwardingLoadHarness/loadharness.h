@@ -0,0 +1,146 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// Drives the real forwarding path, OUT_OF_PROCESS_APPLICATION, PROCESS_MANAGER,
+// SERVER_PROCESS and FORWARDING_HANDLER over WinHTTP, at a fixed concurrency
+// against LOOPBACK_BACKEND processes started the way the module starts any
+// backend. Each client is a FAKE_HTTP_CONTEXT sending one request after the
+// other until the run has sent as many as asked for.
+//
+// A run measures:
+//
+//  - requests per second over the measured requests;
+//  - the latency of a request, from its execution until the handler
+//    finishes it, at the 50th, 99th and 99.9th percentiles;
+//  - how many requests got a 2xx with the whole body and how many did not;
+//  - heap allocations per request, see ALLOCATION_COUNTER;
+//  - the most threads the process had while the run was going.
+//
+class FORWARDING_LOAD_HARNESS : public FAKE_HTTP_CONTEXT_OWNER
+{
+public:
+    struct OPTIONS
+    {
+        DWORD                           cConcurrency;
+        DWORD                           cRequests;
+        DWORD                           cWarmupRequests;
+        DWORD                           cbRequestBody;
+        DWORD                           cbResponseBody;
+        DWORD                           cProcesses;
+        DWORD                           dwResponseInlineReads;
+        DWORD                           dwResponseReadAheadBuffers;
+        BOOL                            fCountAllocations;
+        LOOPBACK_BACKEND::SETTINGS      backend;
+    };
+
+    struct RESULT
+    {
+        double      dblRequestsPerSecond;
+        double      dblP50Microseconds;
+        double      dblP99Microseconds;
+        double      dblP999Microseconds;
+        DWORD       cSucceeded;
+        DWORD       cFailed;
+        //
+        // -1 when allocations were not counted.
+        //
+        double      dblAllocationsPerRequest;
+        DWORD       cPeakThreads;
+    };
+
+    FORWARDING_LOAD_HARNESS(
+        const OPTIONS &     options
+    );
+
+    ~FORWARDING_LOAD_HARNESS();
+
+    //
+    // Initializes the out of process handler the way its DLL does and
+    // creates the application, whose backends start with the first
+    // requests.
+    //
+    HRESULT
+    Initialize(
+        VOID
+    );
+
+    //
+    // Sends the warmup requests unmeasured, then the measured ones. A
+    // harness runs once.
+    //
+    HRESULT
+    Run(
+        _Out_ RESULT *      pResult
+    );
+
+    IAPPLICATION *
+    QueryApplication(
+        VOID
+    ) const
+    {
+        return m_pApplication.get();
+    }
+
+    BOOL
+    OnRequestCompleted(
+        _In_ FAKE_HTTP_CONTEXT *            pContext,
+        _Out_ FAKE_REQUEST_SETTINGS *       pNextRequest
+    ) override;
+
+private:
+    FORWARDING_LOAD_HARNESS(const FORWARDING_LOAD_HARNESS &);
+    void operator=(const FORWARDING_LOAD_HARNESS &);
+
+    HRESULT
+    CreateConfig(
+        _Out_ std::unique_ptr<REQUESTHANDLER_CONFIG> *  ppConfig
+    );
+
+    //
+    // Sends cRequests requests over every context and waits for them.
+    // When fMeasure is set, their latencies and outcomes are recorded.
+    //
+    HRESULT
+    RunPhase(
+        DWORD               cRequests,
+        BOOL                fMeasure
+    );
+
+    //
+    // Threads of the process right now.
+    //
+    static
+    DWORD
+    QueryThreadCount(
+        VOID
+    );
+
+    OPTIONS                                         m_options;
+    FAKE_REQUEST_SETTINGS                           m_settings;
+    std::wstring                                    m_strDirectory;
+    std::unique_ptr<FAKE_HTTP_APPLICATION>          m_pHttpApplication;
+    std::unique_ptr<IAPPLICATION, IAPPLICATION_DELETER> m_pApplication;
+    std::vector<std::unique_ptr<FAKE_HTTP_CONTEXT>> m_contexts;
+    BOOL                                            m_fStaticInitialized;
+
+    //
+    // State of the phase running, updated by OnRequestCompleted.
+    //
+    volatile LONG                                   m_cStarted;
+    volatile LONG                                   m_cCompleted;
+    volatile LONG                                   m_cSucceeded;
+    volatile LONG                                   m_cFailed;
+    volatile LONG                                   m_cContextsRunning;
+    DWORD                                           m_cPhaseRequests;
+    BOOL                                            m_fMeasure;
+    DWORD                                           m_cPeakThreads;
+    HANDLE                                          m_hPhaseDone;
+    //
+    // Latency of every measured request, in performance counter ticks,
+    // indexed by completion order.
+    //
+    std::vector<LONGLONG>                           m_latencies;
+};
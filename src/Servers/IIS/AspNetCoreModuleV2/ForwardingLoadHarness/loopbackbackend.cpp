@@ -0,0 +1,395 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+volatile LONG   LOOPBACK_BACKEND::sm_fShutdown = FALSE;
+SOCKET          LOOPBACK_BACKEND::sm_hListenSocket = INVALID_SOCKET;
+
+//
+// Largest request head accepted, WinHTTP sends much less.
+//
+static const DWORD  g_cbMaxRequestHead = 16 * 1024;
+
+//
+// Response bodies are sent from this in pieces.
+//
+static CHAR         g_rgbBody[64 * 1024];
+
+static const CHAR   g_szServiceUnavailable[] =
+    "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n";
+static const CHAR   g_szNotImplemented[] =
+    "HTTP/1.1 501 Not Implemented\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+static const CHAR   g_szAccepted[] =
+    "HTTP/1.1 202 Accepted\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+// static
+PCWSTR
+LOOPBACK_BACKEND::QueryFailureModeName(
+    FAILURE_MODE        failureMode
+)
+{
+    switch (failureMode)
+    {
+    case FAILURE_STATUS:
+        return L"status";
+    case FAILURE_TRUNCATE:
+        return L"truncate";
+    default:
+        return L"reset";
+    }
+}
+
+// static
+BOOL
+LOOPBACK_BACKEND::ParseFailureMode(
+    _In_ PCWSTR         pszName,
+    _Out_ FAILURE_MODE *pFailureMode
+)
+{
+    for (FAILURE_MODE failureMode : { FAILURE_RESET, FAILURE_STATUS, FAILURE_TRUNCATE })
+    {
+        if (_wcsicmp(pszName, QueryFailureModeName(failureMode)) == 0)
+        {
+            *pFailureMode = failureMode;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// static
+int
+LOOPBACK_BACKEND::Run(
+    const SETTINGS &    settings
+)
+{
+    WSADATA     wsaData;
+    WCHAR       achPort[16];
+    WCHAR       achReadyEvent[128];
+    SOCKADDR_IN address = {};
+
+    if (GetEnvironmentVariableW(L"ASPNETCORE_PORT", achPort, _countof(achPort)) == 0)
+    {
+        wprintf(L"ASPNETCORE_PORT is not set, the backend is started by the harness\n");
+        return 1;
+    }
+
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    {
+        return 1;
+    }
+
+    memset(g_rgbBody, 'b', sizeof(g_rgbBody));
+
+    sm_hListenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sm_hListenSocket == INVALID_SOCKET)
+    {
+        return 1;
+    }
+
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<u_short>(_wtoi(achPort)));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(sm_hListenSocket, reinterpret_cast<SOCKADDR *>(&address), sizeof(address)) == SOCKET_ERROR ||
+        listen(sm_hListenSocket, SOMAXCONN) == SOCKET_ERROR)
+    {
+        return 1;
+    }
+
+    //
+    // Spares SERVER_PROCESS polling the TCP table.
+    //
+    if (GetEnvironmentVariableW(L"ASPNETCORE_READY_EVENT", achReadyEvent, _countof(achReadyEvent)) != 0)
+    {
+        HANDLE hReadyEvent = OpenEventW(EVENT_MODIFY_STATE, FALSE, achReadyEvent);
+        if (hReadyEvent != NULL)
+        {
+            SetEvent(hReadyEvent);
+            CloseHandle(hReadyEvent);
+        }
+    }
+
+    while (!sm_fShutdown)
+    {
+        SOCKET hSocket = accept(sm_hListenSocket, NULL, NULL);
+        if (hSocket == INVALID_SOCKET)
+        {
+            break;
+        }
+
+        BOOL fNoDelay = TRUE;
+        setsockopt(hSocket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&fNoDelay), sizeof(fNoDelay));
+
+        CONNECTION *pConnection = new (std::nothrow) CONNECTION;
+        HANDLE hThread = NULL;
+        if (pConnection != NULL)
+        {
+            pConnection->hSocket = hSocket;
+            pConnection->pSettings = &settings;
+            hThread = CreateThread(NULL, 0, ConnectionThreadProc, pConnection, 0, NULL);
+        }
+
+        if (hThread == NULL)
+        {
+            delete pConnection;
+            closesocket(hSocket);
+            continue;
+        }
+        CloseHandle(hThread);
+    }
+
+    //
+    // Connection threads still running go away with the process.
+    //
+    return 0;
+}
+
+// static
+DWORD
+WINAPI
+LOOPBACK_BACKEND::ConnectionThreadProc(
+    _In_ LPVOID         pvConnection
+)
+{
+    CONNECTION *pConnection = static_cast<CONNECTION *>(pvConnection);
+
+    ServeConnection(pConnection->hSocket, *pConnection->pSettings);
+
+    delete pConnection;
+    return 0;
+}
+
+// static
+VOID
+LOOPBACK_BACKEND::ServeConnection(
+    SOCKET              hSocket,
+    const SETTINGS &    settings
+)
+{
+    std::vector<CHAR>   buffer(g_cbMaxRequestHead);
+    DWORD               cbBuffered = 0;
+
+    for (;;)
+    {
+        //
+        // Read up to the end of the request head.
+        //
+        CHAR *pchHeadEnd = NULL;
+        for (;;)
+        {
+            if (cbBuffered >= 4)
+            {
+                pchHeadEnd = std::search(buffer.data(), buffer.data() + cbBuffered, "\r\n\r\n", "\r\n\r\n" + 4);
+                if (pchHeadEnd == buffer.data() + cbBuffered)
+                {
+                    pchHeadEnd = NULL;
+                }
+            }
+            if (pchHeadEnd != NULL)
+            {
+                break;
+            }
+            if (cbBuffered == buffer.size())
+            {
+                closesocket(hSocket);
+                return;
+            }
+
+            int cbReceived = recv(hSocket, buffer.data() + cbBuffered, static_cast<int>(buffer.size() - cbBuffered), 0);
+            if (cbReceived <= 0)
+            {
+                closesocket(hSocket);
+                return;
+            }
+            cbBuffered += cbReceived;
+        }
+
+        DWORD cbHead = static_cast<DWORD>(pchHeadEnd - buffer.data()) + 4;
+        *pchHeadEnd = '\0';
+
+        //
+        // Request line and the few headers that matter.
+        //
+        DWORD   cbResponseBody = 0;
+        DWORD   cbRequestBody = 0;
+        BOOL    fChunked = FALSE;
+        BOOL    fShutdown = FALSE;
+        PCSTR   pszQuery = strstr(buffer.data(), "?size=");
+        PCSTR   pszLineEnd = strstr(buffer.data(), "\r\n");
+
+        if (pszQuery != NULL && (pszLineEnd == NULL || pszQuery < pszLineEnd))
+        {
+            cbResponseBody = strtoul(pszQuery + 6, NULL, 10);
+        }
+
+        for (PCSTR pszLine = pszLineEnd; pszLine != NULL; pszLine = strstr(pszLine, "\r\n"))
+        {
+            pszLine += 2;
+            if (_strnicmp(pszLine, "Content-Length:", 15) == 0)
+            {
+                cbRequestBody = strtoul(pszLine + 15, NULL, 10);
+            }
+            else if (_strnicmp(pszLine, "Transfer-Encoding:", 18) == 0)
+            {
+                fChunked = TRUE;
+            }
+            else if (_strnicmp(pszLine, "MS-ASPNETCORE-EVENT:", 20) == 0)
+            {
+                fShutdown = TRUE;
+            }
+        }
+
+        if (fShutdown)
+        {
+            SendAll(hSocket, g_szAccepted, sizeof(g_szAccepted) - 1);
+            closesocket(hSocket);
+            InterlockedExchange(&sm_fShutdown, TRUE);
+            closesocket(sm_hListenSocket);
+            return;
+        }
+
+        if (fChunked)
+        {
+            SendAll(hSocket, g_szNotImplemented, sizeof(g_szNotImplemented) - 1);
+            closesocket(hSocket);
+            return;
+        }
+
+        //
+        // Drain the request body, part of it may have come with the head.
+        //
+        DWORD cbBodyBuffered = min(cbBuffered - cbHead, cbRequestBody);
+        DWORD cbBodyLeft = cbRequestBody - cbBodyBuffered;
+        memmove(buffer.data(), buffer.data() + cbHead + cbBodyBuffered, cbBuffered - cbHead - cbBodyBuffered);
+        cbBuffered -= cbHead + cbBodyBuffered;
+
+        while (cbBodyLeft != 0)
+        {
+            int cbReceived = recv(hSocket,
+                buffer.data() + cbBuffered,
+                static_cast<int>(min(static_cast<SIZE_T>(cbBodyLeft), buffer.size() - cbBuffered)),
+                0);
+            if (cbReceived <= 0)
+            {
+                closesocket(hSocket);
+                return;
+            }
+            cbBodyLeft -= cbReceived;
+        }
+
+        if (settings.dwLatencyInMS != 0)
+        {
+            Sleep(settings.dwLatencyInMS);
+        }
+
+        BOOL fFail = ShouldFail(settings);
+        if (fFail && settings.failureMode == FAILURE_RESET)
+        {
+            ResetConnection(hSocket);
+            return;
+        }
+        if (fFail && settings.failureMode == FAILURE_STATUS)
+        {
+            if (!SendAll(hSocket, g_szServiceUnavailable, sizeof(g_szServiceUnavailable) - 1))
+            {
+                closesocket(hSocket);
+                return;
+            }
+            continue;
+        }
+
+        CHAR achHead[128];
+        int cchHead = sprintf_s(achHead,
+            "HTTP/1.1 200 OK\r\nContent-Length: %lu\r\nContent-Type: application/octet-stream\r\n\r\n",
+            cbResponseBody);
+
+        //
+        // A truncated response announces the whole body.
+        //
+        DWORD cbToSend = fFail ? cbResponseBody / 2 : cbResponseBody;
+        BOOL fSent = SendAll(hSocket, achHead, cchHead);
+
+        while (fSent && cbToSend != 0)
+        {
+            DWORD cbChunk = min(cbToSend, static_cast<DWORD>(sizeof(g_rgbBody)));
+            fSent = SendAll(hSocket, g_rgbBody, cbChunk);
+            cbToSend -= cbChunk;
+        }
+
+        if (!fSent)
+        {
+            closesocket(hSocket);
+            return;
+        }
+        if (fFail)
+        {
+            ResetConnection(hSocket);
+            return;
+        }
+    }
+}
+
+// static
+BOOL
+LOOPBACK_BACKEND::SendAll(
+    SOCKET                                  hSocket,
+    _In_reads_bytes_(cbData) const CHAR *   pbData,
+    DWORD                                   cbData
+)
+{
+    while (cbData != 0)
+    {
+        int cbSent = send(hSocket, pbData, static_cast<int>(cbData), 0);
+        if (cbSent <= 0)
+        {
+            return FALSE;
+        }
+        pbData += cbSent;
+        cbData -= cbSent;
+    }
+    return TRUE;
+}
+
+// static
+VOID
+LOOPBACK_BACKEND::ResetConnection(
+    SOCKET              hSocket
+)
+{
+    LINGER linger = {};
+    linger.l_onoff = 1;
+    linger.l_linger = 0;
+
+    setsockopt(hSocket, SOL_SOCKET, SO_LINGER, reinterpret_cast<const char *>(&linger), sizeof(linger));
+    closesocket(hSocket);
+}
+
+// static
+BOOL
+LOOPBACK_BACKEND::ShouldFail(
+    const SETTINGS &    settings
+)
+{
+    //
+    // xorshift32, seeded per thread.
+    //
+    static thread_local DWORD s_dwState = 0;
+
+    if (settings.dwFailurePercent == 0)
+    {
+        return FALSE;
+    }
+
+    if (s_dwState == 0)
+    {
+        s_dwState = GetCurrentThreadId() * 2654435761UL | 1;
+    }
+
+    s_dwState ^= s_dwState << 13;
+    s_dwState ^= s_dwState >> 17;
+    s_dwState ^= s_dwState << 5;
+
+    return s_dwState % 100 < settings.dwFailurePercent;
+}
@@ -0,0 +1,120 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// The backend the harness forwards to: the harness executable started by
+// SERVER_PROCESS with -backend. It listens on 127.0.0.1:%ASPNETCORE_PORT%
+// and answers every request to /echo?size=<bytes> with a 200 and a body of
+// that size, after an optional delay.
+//
+// A share of the requests fails on purpose, the way a crashing or
+// overloaded backend does:
+//
+//  - reset:    the connection is reset before anything is sent;
+//  - status:   a 503 is sent instead;
+//  - truncate: half of the body is sent, then the connection is reset.
+//
+// Only what WinHTTP sends is understood: keep-alive HTTP/1.1 with
+// Content-Length bodies. A chunked request body gets a 501.
+//
+class LOOPBACK_BACKEND
+{
+public:
+    enum FAILURE_MODE
+    {
+        FAILURE_RESET = 0,
+        FAILURE_STATUS,
+        FAILURE_TRUNCATE
+    };
+
+    struct SETTINGS
+    {
+        DWORD           dwLatencyInMS;
+        //
+        // Percentage of the requests that fail, 0 to 100.
+        //
+        DWORD           dwFailurePercent;
+        FAILURE_MODE    failureMode;
+    };
+
+    //
+    // Serves until the module asks the process to shut down. Returns the
+    // exit code of the process.
+    //
+    static
+    int
+    Run(
+        const SETTINGS &    settings
+    );
+
+    static
+    PCWSTR
+    QueryFailureModeName(
+        FAILURE_MODE        failureMode
+    );
+
+    static
+    BOOL
+    ParseFailureMode(
+        _In_ PCWSTR         pszName,
+        _Out_ FAILURE_MODE *pFailureMode
+    );
+
+private:
+    LOOPBACK_BACKEND();
+
+    struct CONNECTION
+    {
+        SOCKET              hSocket;
+        const SETTINGS *    pSettings;
+    };
+
+    static
+    DWORD
+    WINAPI
+    ConnectionThreadProc(
+        _In_ LPVOID         pvConnection
+    );
+
+    //
+    // Serves the requests of one connection until it closes or fails.
+    //
+    static
+    VOID
+    ServeConnection(
+        SOCKET              hSocket,
+        const SETTINGS &    settings
+    );
+
+    static
+    BOOL
+    SendAll(
+        SOCKET                                  hSocket,
+        _In_reads_bytes_(cbData) const CHAR *   pbData,
+        DWORD                                   cbData
+    );
+
+    //
+    // Closes the connection with a RST instead of a FIN.
+    //
+    static
+    VOID
+    ResetConnection(
+        SOCKET              hSocket
+    );
+
+    //
+    // Whether the next request fails, per thread so that connections do
+    // not contend on it.
+    //
+    static
+    BOOL
+    ShouldFail(
+        const SETTINGS &    settings
+    );
+
+    static volatile LONG    sm_fShutdown;
+    static SOCKET           sm_hListenSocket;
+};
@@ -0,0 +1,311 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+DECLARE_DEBUG_PRINT_OBJECT("forwardingloadharness");
+
+//
+// Globals of the out of process handler the forwarding path depends on,
+// set up by FORWARDING_LOAD_HARNESS::Initialize as its DLL would.
+//
+BOOL                g_fWebSocketStaticInitialize = TRUE;
+BOOL                g_fEnableReferenceCountTracing = FALSE;
+BOOL                g_fCaptureReferenceCountStacks = FALSE;
+BOOL                g_fWinHttpNonBlockingCallbackAvailable = FALSE;
+BOOL                g_fProcessDetach = FALSE;
+DWORD               g_OptionalWinHttpFlags = 0;
+DWORD               g_dwTlsIndex = TLS_OUT_OF_INDEXES;
+SRWLOCK             g_srwLockRH;
+HINTERNET           g_hWinhttpSession = NULL;
+IHttpServer *       g_pHttpServer = NULL;
+HINSTANCE           g_hWinHttpModule;
+HINSTANCE           g_hOutOfProcessRHModule;
+HINSTANCE           g_hAspNetCoreModule;
+HANDLE              g_hEventLog = NULL;
+
+static
+VOID
+PrintUsage(
+    VOID
+)
+{
+    wprintf(L"Usage: ForwardingLoadHarness [-concurrency <clients>] [-requests <count>] [-warmup <count>]\n"
+        L"           [-requestSize <bytes>] [-responseSize <bytes>] [-processes <count>]\n"
+        L"           [-inlineReads <count>] [-readAheadBuffers <count>] [-countAllocations]\n"
+        L"           [-latency <ms>] [-failureRate <percent>] [-failureMode reset|status|truncate]\n"
+        L"       ForwardingLoadHarness -replayHeaders [-headerCorpus <file>] [-requests <count>] [-warmup <count>]\n"
+        L"           [-countAllocations]\n");
+}
+
+//
+// Parses the options the harness and its backend share. Returns FALSE
+// when argv[*pi] is not one of them.
+//
+static
+BOOL
+ParseBackendOption(
+    int                             argc,
+    wchar_t *                       argv[],
+    _Inout_ int *                   pi,
+    _Inout_ LOOPBACK_BACKEND::SETTINGS *pSettings
+)
+{
+    int i = *pi;
+
+    if (_wcsicmp(argv[i], L"-latency") == 0 && i + 1 < argc)
+    {
+        pSettings->dwLatencyInMS = _wtoi(argv[++i]);
+    }
+    else if (_wcsicmp(argv[i], L"-failureRate") == 0 && i + 1 < argc)
+    {
+        pSettings->dwFailurePercent = min(static_cast<DWORD>(_wtoi(argv[++i])), 100UL);
+    }
+    else if (_wcsicmp(argv[i], L"-failureMode") == 0 && i + 1 < argc)
+    {
+        if (!LOOPBACK_BACKEND::ParseFailureMode(argv[++i], &pSettings->failureMode))
+        {
+            return FALSE;
+        }
+    }
+    else
+    {
+        return FALSE;
+    }
+
+    *pi = i;
+    return TRUE;
+}
+
+//
+// Replays every header set options.cRequests times, after
+// options.cWarmupRequests unmeasured, see HEADER_REPLAY.
+//
+static
+int
+ReplayHeaders(
+    FORWARDING_LOAD_HARNESS::OPTIONS    options,
+    _In_opt_ PCWSTR                     pszHeaderCorpus
+)
+{
+    HRESULT hr;
+
+    //
+    // A single backend lends its process, nothing is sent to it.
+    //
+    options.cConcurrency = 1;
+    options.cProcesses = 1;
+
+    FORWARDING_LOAD_HARNESS harness(options);
+
+    hr = harness.Initialize();
+    if (FAILED(hr))
+    {
+        wprintf(L"FORWARDING_LOAD_HARNESS::Initialize failed with %08x\n", hr);
+        return 1;
+    }
+
+    HEADER_REPLAY replay(harness.QueryApplication());
+
+    hr = replay.Initialize();
+    if (FAILED(hr))
+    {
+        wprintf(L"HEADER_REPLAY::Initialize failed with %08x\n", hr);
+        return 1;
+    }
+
+    if (pszHeaderCorpus != NULL)
+    {
+        hr = replay.LoadCorpus(pszHeaderCorpus);
+        if (FAILED(hr))
+        {
+            wprintf(L"Loading %s failed with %08x\n", pszHeaderCorpus, hr);
+            return 1;
+        }
+    }
+
+    if (options.fCountAllocations)
+    {
+        ALLOCATION_COUNTER::Enable();
+    }
+
+    wprintf(L"%-24s %12s %12s\n", L"headers", L"ns/req", L"allocs/req");
+
+    for (DWORD i = 0; i < replay.QuerySetCount(); i++)
+    {
+        HEADER_REPLAY::RESULT result;
+
+        hr = replay.Run(i, options.cWarmupRequests, options.cRequests, &result);
+        if (FAILED(hr))
+        {
+            wprintf(L"Replaying %S failed with %08x\n", replay.QuerySetName(i), hr);
+            return 1;
+        }
+
+        if (result.dblAllocationsPerRequest < 0)
+        {
+            wprintf(L"%-24S %12.0f %12s\n", replay.QuerySetName(i), result.dblNanosecondsPerRequest, L"-");
+        }
+        else
+        {
+            wprintf(L"%-24S %12.0f %12.1f\n", replay.QuerySetName(i), result.dblNanosecondsPerRequest,
+                result.dblAllocationsPerRequest);
+        }
+    }
+
+    return 0;
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    FORWARDING_LOAD_HARNESS::OPTIONS    options = {};
+    FORWARDING_LOAD_HARNESS::RESULT     result;
+    HRESULT                             hr;
+    BOOL                                fReplayHeaders = FALSE;
+    PCWSTR                              pszHeaderCorpus = NULL;
+
+    options.cConcurrency = 16;
+    options.cRequests = 100000;
+    options.cWarmupRequests = 1000;
+    options.cbRequestBody = 0;
+    options.cbResponseBody = 1024;
+    options.cProcesses = 1;
+    options.backend.failureMode = LOOPBACK_BACKEND::FAILURE_RESET;
+
+    //
+    // Started by SERVER_PROCESS as the backend of the harness.
+    //
+    if (argc > 1 && _wcsicmp(argv[1], L"-backend") == 0)
+    {
+        for (int i = 2; i < argc; ++i)
+        {
+            if (!ParseBackendOption(argc, argv, &i, &options.backend))
+            {
+                return 1;
+            }
+        }
+        return LOOPBACK_BACKEND::Run(options.backend);
+    }
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (_wcsicmp(argv[i], L"-concurrency") == 0 && i + 1 < argc)
+        {
+            options.cConcurrency = _wtoi(argv[++i]);
+        }
+        else if (_wcsicmp(argv[i], L"-requests") == 0 && i + 1 < argc)
+        {
+            options.cRequests = _wtoi(argv[++i]);
+        }
+        else if (_wcsicmp(argv[i], L"-warmup") == 0 && i + 1 < argc)
+        {
+            options.cWarmupRequests = _wtoi(argv[++i]);
+        }
+        else if (_wcsicmp(argv[i], L"-requestSize") == 0 && i + 1 < argc)
+        {
+            options.cbRequestBody = _wtoi(argv[++i]);
+        }
+        else if (_wcsicmp(argv[i], L"-responseSize") == 0 && i + 1 < argc)
+        {
+            options.cbResponseBody = _wtoi(argv[++i]);
+        }
+        else if (_wcsicmp(argv[i], L"-processes") == 0 && i + 1 < argc)
+        {
+            options.cProcesses = _wtoi(argv[++i]);
+        }
+        else if (_wcsicmp(argv[i], L"-inlineReads") == 0 && i + 1 < argc)
+        {
+            options.dwResponseInlineReads = _wtoi(argv[++i]);
+        }
+        else if (_wcsicmp(argv[i], L"-readAheadBuffers") == 0 && i + 1 < argc)
+        {
+            options.dwResponseReadAheadBuffers = _wtoi(argv[++i]);
+        }
+        else if (_wcsicmp(argv[i], L"-countAllocations") == 0)
+        {
+            options.fCountAllocations = TRUE;
+        }
+        else if (_wcsicmp(argv[i], L"-replayHeaders") == 0)
+        {
+            fReplayHeaders = TRUE;
+        }
+        else if (_wcsicmp(argv[i], L"-headerCorpus") == 0 && i + 1 < argc)
+        {
+            pszHeaderCorpus = argv[++i];
+        }
+        else if (!ParseBackendOption(argc, argv, &i, &options.backend))
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (options.cConcurrency == 0 || options.cRequests == 0 || options.cProcesses == 0)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    if (options.fCountAllocations)
+    {
+        hr = ALLOCATION_COUNTER::Install();
+        if (FAILED(hr))
+        {
+            wprintf(L"ALLOCATION_COUNTER::Install failed with %08x\n", hr);
+            return 1;
+        }
+    }
+
+    if (fReplayHeaders)
+    {
+        return ReplayHeaders(options, pszHeaderCorpus);
+    }
+
+    {
+        FORWARDING_LOAD_HARNESS harness(options);
+
+        hr = harness.Initialize();
+        if (FAILED(hr))
+        {
+            wprintf(L"FORWARDING_LOAD_HARNESS::Initialize failed with %08x\n", hr);
+            return 1;
+        }
+
+        hr = harness.Run(&result);
+        if (FAILED(hr))
+        {
+            wprintf(L"Running %lu requests failed with %08x\n", options.cRequests, hr);
+            return 1;
+        }
+    }
+
+    wprintf(L"%-12s %10s %10s %10s %10s %10s %12s %8s\n",
+        L"requests/s", L"p50 us", L"p99 us", L"p999 us", L"succeeded", L"failed", L"allocs/req", L"threads");
+
+    if (result.dblAllocationsPerRequest < 0)
+    {
+        wprintf(L"%-12.0f %10.1f %10.1f %10.1f %10lu %10lu %12s %8lu\n",
+            result.dblRequestsPerSecond,
+            result.dblP50Microseconds,
+            result.dblP99Microseconds,
+            result.dblP999Microseconds,
+            result.cSucceeded,
+            result.cFailed,
+            L"-",
+            result.cPeakThreads);
+    }
+    else
+    {
+        wprintf(L"%-12.0f %10.1f %10.1f %10.1f %10lu %10lu %12.1f %8lu\n",
+            result.dblRequestsPerSecond,
+            result.dblP50Microseconds,
+            result.dblP99Microseconds,
+            result.dblP999Microseconds,
+            result.cSucceeded,
+            result.cFailed,
+            result.dblAllocationsPerRequest,
+            result.cPeakThreads);
+    }
+
+    return 0;
+}
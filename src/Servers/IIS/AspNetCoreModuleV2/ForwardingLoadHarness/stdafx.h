@@ -0,0 +1,23 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// The forwarding path is compiled exactly as in the out of process handler.
+//
+#include "..\OutOfProcessRequestHandler\stdafx.h"
+
+#include <winsock2.h>
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "allocationcounter.h"
+#include "fakehttpcontext.h"
+#include "loopbackbackend.h"
+#include "loadharness.h"
+#include "headerreplay.h"
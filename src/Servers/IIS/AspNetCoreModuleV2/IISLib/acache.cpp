@@ -2,12 +2,22 @@
 // Licensed under the MIT License. See License.txt in the project root for license information.
 
 #include "precomp.h"
+#include "listentry.h"
+#ifdef ANCM_ALLOCATION_TRACKING
+#include <intrin.h>
+#endif
 
 #pragma warning( push )
 #pragma warning ( disable : ALL_CODE_ANALYSIS_WARNINGS )
 
-LONG    ALLOC_CACHE_HANDLER::sm_nFillPattern = 0xACA50000;
-HANDLE  ALLOC_CACHE_HANDLER::sm_hHeap;
+LONG        ALLOC_CACHE_HANDLER::sm_nFillPattern = 0xACA50000;
+HANDLE      ALLOC_CACHE_HANDLER::sm_hHeap;
+LIST_ENTRY  ALLOC_CACHE_HANDLER::sm_HandlerList;
+SRWLOCK     ALLOC_CACHE_HANDLER::sm_HandlerListLock = SRWLOCK_INIT;
+PTP_TIMER   ALLOC_CACHE_HANDLER::sm_pTrimTimer;
+#ifdef ANCM_ALLOCATION_TRACKING
+VOID        (*ALLOC_CACHE_HANDLER::sm_pfnTrackAlloc)(PVOID, SIZE_T);
+#endif
 
 //
 // This class is used to implement the free list.  We cast the free'd
@@ -28,19 +38,49 @@ public:
         FREE_SIGNATURE = (('A') | ('C' << 8) | ('a' << 16) | (('$' << 24) | 0x80)),
     };
 };
+
+//
+// Start of every slab, links the slabs of a handler for ReleaseSlabs.
+//
+class SLAB_HEADER
+{
+public:
+    SLIST_ENTRY     ListEntry;
+};
 #pragma warning(pop)
 
+#define SLAB_HEADER_SIZE    ((sizeof(SLAB_HEADER) + MEMORY_ALLOCATION_ALIGNMENT - 1) & ~(MEMORY_ALLOCATION_ALIGNMENT - 1))
+
 ALLOC_CACHE_HANDLER::ALLOC_CACHE_HANDLER(
 ) : m_nThreshold(0),
+    m_nMaxThreshold(0),
     m_cbSize(0),
     m_pFreeLists(NULL),
+    m_fUseSlabs(FALSE),
+    m_cbSlabStride(0),
+    m_nSlabObjects(0),
     m_nTotal(0)
 {
+    InitializeSListHead(&m_SpareList);
+    InitializeSListHead(&m_SlabList);
+    m_ListEntry.Flink = NULL;
+    m_ListEntry.Blink = NULL;
 }
 
 ALLOC_CACHE_HANDLER::~ALLOC_CACHE_HANDLER(
 )
 {
+    if (m_ListEntry.Flink != NULL)
+    {
+        //
+        // Waits for a trim in progress.
+        //
+        AcquireSRWLockExclusive(&sm_HandlerListLock);
+        RemoveEntryList(&m_ListEntry);
+        ReleaseSRWLockExclusive(&sm_HandlerListLock);
+        m_ListEntry.Flink = NULL;
+    }
+
     if (m_pFreeLists != NULL)
     {
         CleanupLookaside();
@@ -74,6 +114,11 @@ ALLOC_CACHE_HANDLER::Initialize(
         m_nThreshold = 0;
     }
 
+    //
+    // Lists that keep missing may grow past the threshold, up to this.
+    //
+    m_nMaxThreshold = min(m_nThreshold * 4, 0xffff);
+
     //
     // Make sure the block is big enough to hold a FREE_LIST_HEADER.
     //
@@ -86,24 +131,41 @@ ALLOC_CACHE_HANDLER::Initialize(
     //
     m_cbSize = (m_cbSize + sizeof(LONG) - 1) & ~(sizeof(LONG) - 1);
 
+    //
+    // Without the lookaside (page heap) every object must come from the
+    // heap for the checks to work.
+    //
+    m_fUseSlabs = m_nThreshold > 0 && m_cbSize <= MAX_SLAB_OBJECT_SIZE;
+    m_cbSlabStride = (m_cbSize + MEMORY_ALLOCATION_ALIGNMENT - 1) & ~(MEMORY_ALLOCATION_ALIGNMENT - 1);
+
 #if defined(_MSC_VER) && _MSC_VER >= 1600 // VC10
-    auto Init = [] (SLIST_HEADER* pHead)
+    auto Init = [=] (LOOKASIDE* pLookaside)
     {
-        InitializeSListHead(pHead);
+        InitializeSListHead(&pLookaside->ListHead);
+        pLookaside->nDepthLimit = m_nThreshold;
     };
 #else
     class Functor
     {
     public:
-        void operator()(SLIST_HEADER* pHead)
+        explicit Functor(LONG nThreshold) : _nThreshold(nThreshold)
+        {
+        }
+        void operator()(LOOKASIDE* pLookaside)
         {
-            InitializeSListHead(pHead);
+            InitializeSListHead(&pLookaside->ListHead);
+            pLookaside->nDepthLimit = _nThreshold;
         }
-    } Init;
+    private:
+        LONG _nThreshold;
+    } Init(m_nThreshold);
 #endif
 
-    hr = PER_CPU<SLIST_HEADER>::Create(Init,
-                                       &m_pFreeLists );
+    //
+    // PER_CPU zeroes the counters.
+    //
+    hr = PER_CPU<LOOKASIDE>::Create(Init,
+                                    &m_pFreeLists );
     if (FAILED(hr))
     {
         goto Finished;
@@ -111,6 +173,39 @@ ALLOC_CACHE_HANDLER::Initialize(
 
     m_nFillPattern = InterlockedIncrement(&sm_nFillPattern);
 
+    if ( m_nThreshold > 0 )
+    {
+        AcquireSRWLockExclusive(&sm_HandlerListLock);
+
+        if ( sm_HandlerList.Flink == NULL )
+        {
+            InitializeListHead(&sm_HandlerList);
+        }
+
+        if ( sm_pTrimTimer == NULL )
+        {
+            //
+            // Without the timer the lists keep their initial depth limit.
+            //
+            sm_pTrimTimer = CreateThreadpoolTimer(TrimTimerCallback, NULL, NULL);
+            if ( sm_pTrimTimer != NULL )
+            {
+                LARGE_INTEGER liDueTime;
+                FILETIME      ftDueTime;
+
+                liDueTime.QuadPart = (LONGLONG)TRIM_INTERVAL_MS * -10000;
+                ftDueTime.dwHighDateTime = liDueTime.HighPart;
+                ftDueTime.dwLowDateTime = liDueTime.LowPart;
+
+                SetThreadpoolTimer(sm_pTrimTimer, &ftDueTime, TRIM_INTERVAL_MS, TRIM_INTERVAL_MS / 10);
+            }
+        }
+
+        InsertTailList(&sm_HandlerList, &m_ListEntry);
+
+        ReleaseSRWLockExclusive(&sm_HandlerListLock);
+    }
+
 Finished:
 
     return hr;
@@ -123,9 +218,9 @@ ALLOC_CACHE_HANDLER::StaticInitialize(
 )
 {
     //
-    // Since the memory allocated is fixed size,
-    // a heap is not really needed, allocations can be done
-    // using VirtualAllocEx[Numa]. For now use Windows Heap.
+    // Small objects come from NUMA local slabs, see AllocFromSlab. The
+    // others, and every object when page heap is enabled, come from the
+    // process heap.
     //
     // Be aware that creating one private heap consumes more
     // virtual address space for the worker process.
@@ -140,9 +235,226 @@ VOID
 ALLOC_CACHE_HANDLER::StaticTerminate(
 )
 {
+    AcquireSRWLockExclusive(&sm_HandlerListLock);
+
+    if ( sm_pTrimTimer != NULL )
+    {
+        //
+        // Only stop new callbacks, waiting for one in progress could dead
+        // lock under the loader lock. The timer is freed once it returns.
+        //
+        SetThreadpoolTimer(sm_pTrimTimer, NULL, 0, 0);
+        CloseThreadpoolTimer(sm_pTrimTimer);
+        sm_pTrimTimer = NULL;
+    }
+
+    ReleaseSRWLockExclusive(&sm_HandlerListLock);
+
     sm_hHeap = NULL;
 }
 
+// static
+VOID
+CALLBACK
+ALLOC_CACHE_HANDLER::TrimTimerCallback(
+    __in PTP_CALLBACK_INSTANCE  pInstance,
+    __in PVOID                  pvContext,
+    __in PTP_TIMER              pTimer
+)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pvContext);
+    UNREFERENCED_PARAMETER(pTimer);
+
+    //
+    // Handlers leave the list under the exclusive lock before they are
+    // destroyed.
+    //
+    AcquireSRWLockShared(&sm_HandlerListLock);
+
+    for ( PLIST_ENTRY pEntry = sm_HandlerList.Flink;
+          pEntry != &sm_HandlerList;
+          pEntry = pEntry->Flink )
+    {
+        CONTAINING_RECORD(pEntry, ALLOC_CACHE_HANDLER, m_ListEntry)->Trim();
+    }
+
+    ReleaseSRWLockShared(&sm_HandlerListLock);
+}
+
+VOID
+ALLOC_CACHE_HANDLER::Trim(
+)
+/*++
+  Description:
+    Adapts the depth limit of every list to the traffic since the last
+    trim. A list that missed and released in the interval had churn, its
+    limit doubles. A list that did neither was idle, its limit halves. The
+    objects past the limit are released.
+
+  Arguments:
+    None.
+
+  Returns:
+     None
+--*/
+{
+#if defined(_MSC_VER) && _MSC_VER >= 1600 // VC10
+    auto Predicate = [=] (LOOKASIDE * pLookaside)
+    {
+        const ULONGLONG nMisses = pLookaside->nMisses;
+        const ULONGLONG nReleases = pLookaside->nReleases;
+        LONG nDepthLimit = pLookaside->nDepthLimit;
+
+        if ( nMisses != pLookaside->nLastMisses && nReleases != pLookaside->nLastReleases )
+        {
+            nDepthLimit = min(nDepthLimit * 2, m_nMaxThreshold);
+        }
+        else if ( nMisses == pLookaside->nLastMisses && nReleases == pLookaside->nLastReleases )
+        {
+            nDepthLimit = max(nDepthLimit / 2, min(MIN_DEPTH_LIMIT, m_nThreshold));
+        }
+
+        pLookaside->nLastMisses = nMisses;
+        pLookaside->nLastReleases = nReleases;
+        pLookaside->nDepthLimit = nDepthLimit;
+
+        for ( LONG nExcess = QueryDepthSList(&pLookaside->ListHead) - nDepthLimit;
+              nExcess > 0;
+              nExcess-- )
+        {
+            LPVOID pMemory = InterlockedPopEntrySList(&pLookaside->ListHead);
+            if ( pMemory == NULL )
+            {
+                break;
+            }
+
+            pLookaside->nTrims++;
+            ReleaseObject(pLookaside, pMemory);
+        }
+    };
+#else
+    class Functor
+    {
+    public:
+        explicit Functor(ALLOC_CACHE_HANDLER * pThis) : _pThis(pThis)
+        {
+        }
+        void operator()(LOOKASIDE * pLookaside)
+        {
+            const ULONGLONG nMisses = pLookaside->nMisses;
+            const ULONGLONG nReleases = pLookaside->nReleases;
+            LONG nDepthLimit = pLookaside->nDepthLimit;
+
+            if ( nMisses != pLookaside->nLastMisses && nReleases != pLookaside->nLastReleases )
+            {
+                nDepthLimit = min(nDepthLimit * 2, _pThis->m_nMaxThreshold);
+            }
+            else if ( nMisses == pLookaside->nLastMisses && nReleases == pLookaside->nLastReleases )
+            {
+                nDepthLimit = max(nDepthLimit / 2, min(MIN_DEPTH_LIMIT, _pThis->m_nThreshold));
+            }
+
+            pLookaside->nLastMisses = nMisses;
+            pLookaside->nLastReleases = nReleases;
+            pLookaside->nDepthLimit = nDepthLimit;
+
+            for ( LONG nExcess = QueryDepthSList(&pLookaside->ListHead) - nDepthLimit;
+                  nExcess > 0;
+                  nExcess-- )
+            {
+                LPVOID pMemory = InterlockedPopEntrySList(&pLookaside->ListHead);
+                if ( pMemory == NULL )
+                {
+                    break;
+                }
+
+                pLookaside->nTrims++;
+                _pThis->ReleaseObject(pLookaside, pMemory);
+            }
+        }
+    private:
+        ALLOC_CACHE_HANDLER * _pThis;
+    } Predicate(this);
+#endif
+
+    m_pFreeLists->ForEach(Predicate);
+}
+
+VOID
+ALLOC_CACHE_HANDLER::ReleaseObject(
+    __in LOOKASIDE *    pLookaside,
+    __in LPVOID         pMemory
+)
+/*++
+  Description:
+    Gives an object the list of pLookaside has no room for back to the
+    heap, or to the spare list if it was carved from a slab.
+
+  Arguments:
+    pLookaside - the list that had no room
+    pMemory - the object, its FREE_LIST_HEADER already set
+
+  Returns:
+     None
+--*/
+{
+    UNREFERENCED_PARAMETER(pLookaside);
+
+    if ( m_fUseSlabs )
+    {
+        InterlockedPushEntrySList(&m_SpareList, &static_cast<FREE_LIST_HEADER*>(pMemory)->ListEntry);
+    }
+    else
+    {
+        HeapFree( sm_hHeap, 0, pMemory );
+    }
+}
+
+VOID
+ALLOC_CACHE_HANDLER::QueryStatistics(
+    __out ALLOC_CACHE_STATISTICS * pStatistics
+)
+{
+    ZeroMemory(pStatistics, sizeof(*pStatistics));
+
+    if ( m_pFreeLists == NULL )
+    {
+        return;
+    }
+
+#if defined(_MSC_VER) && _MSC_VER >= 1600 // VC10
+    auto Predicate = [pStatistics] (LOOKASIDE * pLookaside)
+    {
+        pStatistics->nHits += pLookaside->nHits;
+        pStatistics->nMisses += pLookaside->nMisses;
+        pStatistics->nReleases += pLookaside->nReleases;
+        pStatistics->nTrims += pLookaside->nTrims;
+    };
+#else
+    class Functor
+    {
+    public:
+        explicit Functor(ALLOC_CACHE_STATISTICS * pStatistics) : _pStatistics(pStatistics)
+        {
+        }
+        void operator()(LOOKASIDE * pLookaside)
+        {
+            _pStatistics->nHits += pLookaside->nHits;
+            _pStatistics->nMisses += pLookaside->nMisses;
+            _pStatistics->nReleases += pLookaside->nReleases;
+            _pStatistics->nTrims += pLookaside->nTrims;
+        }
+    private:
+        ALLOC_CACHE_STATISTICS * _pStatistics;
+    } Predicate(pStatistics);
+#endif
+
+    m_pFreeLists->ForEach(Predicate);
+
+    pStatistics->nFree = QueryDepthForAllSLists();
+}
+
 VOID
 ALLOC_CACHE_HANDLER::CleanupLookaside(
 )
@@ -164,7 +476,9 @@ ALLOC_CACHE_HANDLER::CleanupLookaside(
     //
 
 #if defined(_MSC_VER) && _MSC_VER >= 1600 // VC10
-    auto Predicate = [=] (SLIST_HEADER * pListHeader)
+    LONG nFreeObjects = 0;
+
+    auto Predicate = [&] (SLIST_HEADER * pListHeader)
     {
         LONG NodesToDelete = QueryDepthSList( pListHeader );
 
@@ -172,12 +486,21 @@ ALLOC_CACHE_HANDLER::CleanupLookaside(
         while ( pl != NULL && --NodesToDelete >= 0 )
         {
             InterlockedDecrement( &m_nTotal);
+            nFreeObjects++;
 
-            HeapFree( sm_hHeap, 0, pl );
+            if ( !m_fUseSlabs )
+            {
+                HeapFree( sm_hHeap, 0, pl );
+            }
 
             pl = InterlockedPopEntrySList(pListHeader);
         }
     };
+
+    m_pFreeLists ->ForEach([&] (LOOKASIDE * pLookaside)
+    {
+        Predicate(&pLookaside->ListHead);
+    });
 #else
     class Functor
     {
@@ -185,6 +508,10 @@ ALLOC_CACHE_HANDLER::CleanupLookaside(
         explicit Functor(ALLOC_CACHE_HANDLER * pThis) : _pThis(pThis)
         {
         }
+        void operator()(LOOKASIDE * pLookaside)
+        {
+            (*this)(&pLookaside->ListHead);
+        }
         void operator()(SLIST_HEADER * pListHeader)
         {
             PSLIST_ENTRY pl;
@@ -194,18 +521,137 @@ ALLOC_CACHE_HANDLER::CleanupLookaside(
             while ( pl != NULL && --NodesToDelete >= 0 )
             {
                 InterlockedDecrement( &_pThis->m_nTotal);
+                nFreeObjects++;
 
-                ::HeapFree( sm_hHeap, 0, pl );
+                if ( !_pThis->m_fUseSlabs )
+                {
+                    ::HeapFree( sm_hHeap, 0, pl );
+                }
 
                 pl = InterlockedPopEntrySList(pListHeader);
             }
         }
+
+        LONG nFreeObjects = 0;
     private:
         ALLOC_CACHE_HANDLER * _pThis;
     } Predicate(this);
-#endif
 
     m_pFreeLists ->ForEach(Predicate);
+#endif
+
+    if ( m_fUseSlabs )
+    {
+        Predicate(&m_SpareList);
+#if defined(_MSC_VER) && _MSC_VER >= 1600 // VC10
+        ReleaseSlabs(nFreeObjects);
+#else
+        ReleaseSlabs(Predicate.nFreeObjects);
+#endif
+    }
+}
+
+VOID
+ALLOC_CACHE_HANDLER::ReleaseSlabs(
+    LONG    nFreeObjects
+)
+/*++
+  Description:
+    Returns the slabs to the system once every object carved from them
+    is back in the lists.
+
+  Arguments:
+    nFreeObjects - objects taken out of the lists by CleanupLookaside
+
+  Returns:
+     None
+--*/
+{
+    if ( nFreeObjects != m_nSlabObjects )
+    {
+        //
+        // Objects still in use would be freed under their owner, leak the
+        // slabs like the heap blocks of such objects would be.
+        //
+        return;
+    }
+
+    PSLIST_ENTRY pSlab = InterlockedFlushSList(&m_SlabList);
+    while ( pSlab != NULL )
+    {
+        PSLIST_ENTRY pNextSlab = pSlab->Next;
+        DBG_REQUIRE( VirtualFree( pSlab, 0, MEM_RELEASE ) );
+        pSlab = pNextSlab;
+    }
+
+    m_nSlabObjects = 0;
+}
+
+LPVOID
+ALLOC_CACHE_HANDLER::AllocFromSlab(
+    __in LOOKASIDE *    pLookaside
+)
+/*++
+  Description:
+    Serves a lookaside miss. Takes a spare object if another processor
+    freed more than it could keep, or carves a new slab on the NUMA node
+    of the current processor and refills the local list from it.
+
+  Arguments:
+    pLookaside - the list of the current processor
+
+  Returns:
+     The object, NULL if no slab could be committed.
+--*/
+{
+    LPVOID              pMemory = InterlockedPopEntrySList(&m_SpareList);
+    PROCESSOR_NUMBER    processorNumber;
+    USHORT              nodeNumber = 0;
+    BYTE *              pSlab = NULL;
+    DWORD               cObjects;
+
+    if ( pMemory != NULL )
+    {
+        return pMemory;
+    }
+
+    GetCurrentProcessorNumberEx(&processorNumber);
+    if ( !GetNumaProcessorNodeEx(&processorNumber, &nodeNumber) )
+    {
+        nodeNumber = static_cast<USHORT>(NUMA_NO_PREFERRED_NODE);
+    }
+
+    pSlab = static_cast<BYTE *>(VirtualAllocExNuma(GetCurrentProcess(),
+                                                   NULL,
+                                                   SLAB_SIZE,
+                                                   MEM_RESERVE | MEM_COMMIT,
+                                                   PAGE_READWRITE,
+                                                   nodeNumber));
+    if ( pSlab == NULL )
+    {
+        return NULL;
+    }
+
+    InterlockedPushEntrySList(&m_SlabList, &reinterpret_cast<SLAB_HEADER *>(pSlab)->ListEntry);
+
+    cObjects = static_cast<DWORD>((SLAB_SIZE - SLAB_HEADER_SIZE) / m_cbSlabStride);
+    InterlockedExchangeAdd(&m_nSlabObjects, static_cast<LONG>(cObjects));
+    m_nTotal += cObjects;
+
+    //
+    // The first object goes to the caller, the others fill the local list
+    // up to its depth limit and the spare list after that.
+    //
+    for ( DWORD i = 1; i < cObjects; i++ )
+    {
+        FREE_LIST_HEADER* pfl = reinterpret_cast<FREE_LIST_HEADER*>(pSlab + SLAB_HEADER_SIZE + i * m_cbSlabStride);
+        pfl->dwSignature = FREE_LIST_HEADER::FREE_SIGNATURE;
+
+        InterlockedPushEntrySList(QueryDepthSList(&pLookaside->ListHead) < pLookaside->nDepthLimit ? &pLookaside->ListHead : &m_SpareList,
+                                  &pfl->ListEntry);
+    }
+
+    return pSlab + SLAB_HEADER_SIZE;
 }
 
 LPVOID
@@ -213,11 +659,18 @@ ALLOC_CACHE_HANDLER::Alloc(
 )
 {
     LPVOID pMemory = NULL;
+    LOOKASIDE * pLookaside = m_pFreeLists ->GetLocal();
+
+#ifdef ANCM_ALLOCATION_TRACKING
+    if ( sm_pfnTrackAlloc != NULL )
+    {
+        sm_pfnTrackAlloc( _ReturnAddress(), m_cbSize );
+    }
+#endif
 
     if ( m_nThreshold > 0 )
     {
-        SLIST_HEADER * pListHeader = m_pFreeLists ->GetLocal();
-        pMemory = (LPVOID) InterlockedPopEntrySList(pListHeader);  // get the real object
+        pMemory = (LPVOID) InterlockedPopEntrySList(&pLookaside->ListHead);  // get the real object
 
         if (pMemory != NULL)
         {
@@ -228,10 +681,20 @@ ALLOC_CACHE_HANDLER::Alloc(
             //
             DBG_ASSERT(pfl->dwSignature == FREE_LIST_HEADER::FREE_SIGNATURE);
             (void)pfl;
+
+            pLookaside->nHits++;
+        }
+        else
+        {
+            pLookaside->nMisses++;
         }
     }
 
-    if ( pMemory == NULL )
+    if ( pMemory == NULL && m_fUseSlabs )
+    {
+        pMemory = AllocFromSlab(pLookaside);
+    }
+    else if ( pMemory == NULL )
     {
         //
         // No free entry. Need to alloc a new object.
@@ -299,22 +762,27 @@ ALLOC_CACHE_HANDLER::Free(
     //
     // Store the items in the alloc cache.
     //
-    SLIST_HEADER * pListHeader = m_pFreeLists ->GetLocal();
+    LOOKASIDE * pLookaside = m_pFreeLists ->GetLocal();
 
-    if ( QueryDepthSList(pListHeader) >= m_nThreshold )
+    if ( QueryDepthSList(&pLookaside->ListHead) >= pLookaside->nDepthLimit )
     {
         //
-        // Threshold for free entries is exceeded. Free the object to
+        // Depth limit for free entries is exceeded. Free the object to
         // process pool.
         //
-        HeapFree( sm_hHeap, 0, pMemory );
+        if ( m_nThreshold > 0 )
+        {
+            pLookaside->nReleases++;
+        }
+
+        ReleaseObject(pLookaside, pMemory);
     }
     else
     {
         //
         // Store the given pointer in the single linear list
         //
-        InterlockedPushEntrySList(pListHeader, &pfl->ListEntry);
+        InterlockedPushEntrySList(&pLookaside->ListHead, &pfl->ListEntry);
     }
 }
 
@@ -342,9 +810,9 @@ Return Value:
     if (m_pFreeLists  != NULL)
     {
 #if defined(_MSC_VER) && _MSC_VER >= 1600 // VC10
-        auto Predicate = [&Count] (SLIST_HEADER * pListHeader)
+        auto Predicate = [&Count] (LOOKASIDE * pLookaside)
         {
-            Count += QueryDepthSList(pListHeader);
+            Count += QueryDepthSList(&pLookaside->ListHead);
         };
 #else
         class Functor
@@ -353,9 +821,9 @@ Return Value:
             explicit Functor(DWORD& Count) : _Count(Count)
             {
             }
-            void operator()(SLIST_HEADER * pListHeader)
+            void operator()(LOOKASIDE * pLookaside)
             {
-                _Count += QueryDepthSList(pListHeader);
+                _Count += QueryDepthSList(&pLookaside->ListHead);
             }
         private:
             DWORD& _Count;
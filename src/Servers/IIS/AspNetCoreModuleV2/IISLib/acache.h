@@ -5,6 +5,24 @@
 
 #include "percpu.h"
 
+//
+// Counters of one ALLOC_CACHE_HANDLER since it was initialized, summed over
+// the processors. They are not interlocked, read them as hints.
+//
+struct ALLOC_CACHE_STATISTICS
+{
+    // Allocations served from a lookaside list
+    ULONGLONG   nHits;
+    // Allocations that had to go to the heap or a slab
+    ULONGLONG   nMisses;
+    // Frees past the depth limit of a list
+    ULONGLONG   nReleases;
+    // Objects taken out of idle lists by the periodic trim
+    ULONGLONG   nTrims;
+    // Objects currently in the lookaside lists
+    DWORD       nFree;
+};
+
 class ALLOC_CACHE_HANDLER
 {
 public:
@@ -30,21 +48,98 @@ public:
         __in LPVOID pMemory
     );
 
+    VOID
+    QueryStatistics(
+        __out ALLOC_CACHE_STATISTICS * pStatistics
+    );
 
 private:
 
+    //
+    // Free list of one processor. The depth limit adapts to the traffic
+    // seen between two trims, between MIN_DEPTH_LIMIT and four times the
+    // threshold given to Initialize.
+    //
+    struct LOOKASIDE
+    {
+        SLIST_HEADER    ListHead;
+        volatile LONG   nDepthLimit;
+        ULONGLONG       nHits;
+        ULONGLONG       nMisses;
+        ULONGLONG       nReleases;
+        ULONGLONG       nTrims;
+        // Seen by the previous trim
+        ULONGLONG       nLastMisses;
+        ULONGLONG       nLastReleases;
+    };
+
     VOID
     CleanupLookaside(
     );
 
+    VOID
+    Trim(
+    );
+
+    VOID
+    ReleaseObject(
+        __in LOOKASIDE *    pLookaside,
+        __in LPVOID         pMemory
+    );
+
+    static
+    VOID
+    CALLBACK
+    TrimTimerCallback(
+        __in PTP_CALLBACK_INSTANCE  pInstance,
+        __in PVOID                  pvContext,
+        __in PTP_TIMER              pTimer
+    );
+
     DWORD
     QueryDepthForAllSLists(
     );
 
+    LPVOID
+    AllocFromSlab(
+        __in LOOKASIDE *    pLookaside
+    );
+
+    VOID
+    ReleaseSlabs(
+        LONG        nFreeObjects
+    );
+
+    //
+    // Objects up to MAX_SLAB_OBJECT_SIZE come from slabs of SLAB_SIZE,
+    // the allocation granularity of VirtualAlloc, committed on the NUMA
+    // node of the processor that needs them.
+    //
+    static const DWORD      SLAB_SIZE = 64 * 1024;
+    static const DWORD      MAX_SLAB_OBJECT_SIZE = SLAB_SIZE / 16;
+
+    static constexpr LONG   MIN_DEPTH_LIMIT = 4;
+    static constexpr DWORD  TRIM_INTERVAL_MS = 10 * 1000;
+
     LONG                    m_nThreshold;
+    LONG                    m_nMaxThreshold;
     DWORD                   m_cbSize;
 
-    PER_CPU<SLIST_HEADER> * m_pFreeLists;
+    PER_CPU<LOOKASIDE> *    m_pFreeLists;
+
+    // In sm_HandlerList while registered for trimming
+    LIST_ENTRY              m_ListEntry;
+
+    BOOL                    m_fUseSlabs;
+    DWORD                   m_cbSlabStride;
+
+    //
+    // Slab objects freed past the threshold of a processor's list. They
+    // can't go back to the heap, the next miss on any processor takes them.
+    //
+    SLIST_HEADER            m_SpareList;
+    SLIST_HEADER            m_SlabList;
+    volatile LONG           m_nSlabObjects;
 
     //
     // Total heap allocations done over the lifetime.
@@ -70,10 +165,26 @@ public:
     BOOL
     IsPageheapEnabled();
 
+#ifdef ANCM_ALLOCATION_TRACKING
+    //
+    // Told about every Alloc with its caller, set by
+    // AllocationTracking::Install.
+    //
+    static VOID (*sm_pfnTrackAlloc)(PVOID pCallSite, SIZE_T cbSize);
+#endif
+
 private:
 
     static LONG             sm_nFillPattern;
     static HANDLE           sm_hHeap;
+
+    //
+    // Handlers trimmed by sm_pTrimTimer, the timer is created with the
+    // first one.
+    //
+    static LIST_ENTRY       sm_HandlerList;
+    static SRWLOCK          sm_HandlerListLock;
+    static PTP_TIMER        sm_pTrimTimer;
 };
 
 
@@ -1441,6 +1441,52 @@ FindNextChildElement(
     return hr;
 }
 
+HRESULT
+FindFirstProperty(
+    IN      IAppHostPropertyCollection *        pCollection,
+    OUT     ENUM_INDEX *                        pIndex,
+    OUT     IAppHostProperty **                 pProperty
+    )
+{
+    HRESULT hr = pCollection->get_Count(&pIndex->Count);
+
+    if (FAILED(hr))
+    {
+        DBGERROR_HR(hr);
+        return hr;
+    }
+
+    VariantInit(&pIndex->Index);
+    pIndex->Index.vt = VT_UI4;
+    pIndex->Index.ulVal = 0;
+
+    return FindNextProperty(pCollection, pIndex, pProperty);
+}
+
+HRESULT
+FindNextProperty(
+    IN      IAppHostPropertyCollection *        pCollection,
+    IN OUT  ENUM_INDEX *                        pIndex,
+    OUT     IAppHostProperty **                 pProperty
+    )
+{
+    *pProperty = NULL;
+
+    if (pIndex->Index.ulVal >= pIndex->Count)
+    {
+        return S_FALSE;
+    }
+
+    HRESULT hr = pCollection->get_Item(pIndex->Index, pProperty);
+
+    if (SUCCEEDED(hr))
+    {
+        pIndex->Index.ulVal++;
+    }
+
+    return hr;
+}
+
 HRESULT
 FindFirstLocation(
     IN      IAppHostConfigLocationCollection *  pCollection,
@@ -226,6 +226,20 @@ FindNextChildElement(
     OUT     IAppHostElement **                  pElement
     );
 
+HRESULT
+FindFirstProperty(
+    IN      IAppHostPropertyCollection *        pCollection,
+    OUT     ENUM_INDEX *                        pIndex,
+    OUT     IAppHostProperty **                 pProperty
+    );
+
+HRESULT
+FindNextProperty(
+    IN      IAppHostPropertyCollection *        pCollection,
+    IN OUT  ENUM_INDEX *                        pIndex,
+    OUT     IAppHostProperty **                 pProperty
+    );
+
 HRESULT
 FindFirstLocation(
     IN      IAppHostConfigLocationCollection *  pCollection,
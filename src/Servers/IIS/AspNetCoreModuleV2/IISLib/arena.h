@@ -0,0 +1,239 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <windows.h>
+#include <crtdbg.h>
+
+//
+// Bump allocator for memory that shares one owner's lifetime, e.g. the
+// strings a request builds while it is forwarded. Allocations are carved
+// out of heap chunks and are never freed one by one, everything goes away
+// with Reset or the destructor.
+//
+// Not thread safe, the owner must not allocate from two threads at once.
+//
+class BUMP_ARENA
+{
+public:
+
+    static constexpr SIZE_T DEFAULT_CHUNK_SIZE = 4096;
+
+    BUMP_ARENA(
+        SIZE_T  cbChunk = DEFAULT_CHUNK_SIZE
+    ) : m_pChunks( NULL ),
+        m_pCurrent( NULL ),
+        m_pEnd( NULL ),
+        m_cbChunk( cbChunk )
+    {
+        _ASSERTE( cbChunk > sizeof(CHUNK) );
+    }
+
+    ~BUMP_ARENA()
+    {
+        Reset();
+    }
+
+    BUMP_ARENA(const BUMP_ARENA&) = delete;
+    const BUMP_ARENA& operator=(const BUMP_ARENA&) = delete;
+
+    __success(return != NULL)
+    VOID*
+    Alloc(
+        SIZE_T  cbSize
+    )
+    /*++
+        Description:
+
+            Returns cbSize bytes aligned to ARENA_ALIGNMENT. Requests larger
+            than a quarter of a chunk get a chunk of their own so that the
+            remainder of the current one is not wasted.
+
+        Arguments:
+
+            cbSize  - Number of bytes.
+
+        Returns:
+
+            The memory, NULL if out of memory.
+
+    --*/
+    {
+        SIZE_T cbAligned = AlignSize( cbSize );
+        BYTE * pbResult;
+
+        if ( cbAligned < cbSize )
+        {
+            SetLastError( ERROR_INVALID_PARAMETER );
+            return NULL;
+        }
+
+        if ( static_cast<SIZE_T>( m_pEnd - m_pCurrent ) >= cbAligned )
+        {
+            pbResult = m_pCurrent;
+            m_pCurrent += cbAligned;
+            return pbResult;
+        }
+
+        if ( cbAligned > ( m_cbChunk - sizeof(CHUNK) ) / 4 )
+        {
+            CHUNK * pChunk = AllocChunk( cbAligned );
+            if ( pChunk == NULL )
+            {
+                return NULL;
+            }
+
+            //
+            // Linked behind the current chunk, which keeps serving the
+            // small requests.
+            //
+            if ( m_pChunks == NULL )
+            {
+                m_pChunks = pChunk;
+            }
+            else
+            {
+                pChunk->pNext = m_pChunks->pNext;
+                m_pChunks->pNext = pChunk;
+            }
+
+            return pChunk + 1;
+        }
+
+        CHUNK * pChunk = AllocChunk( m_cbChunk - sizeof(CHUNK) );
+        if ( pChunk == NULL )
+        {
+            return NULL;
+        }
+
+        pChunk->pNext = m_pChunks;
+        m_pChunks = pChunk;
+
+        pbResult = reinterpret_cast<BYTE*>( pChunk + 1 );
+        m_pCurrent = pbResult + cbAligned;
+        m_pEnd = pbResult + ( m_cbChunk - sizeof(CHUNK) );
+        return pbResult;
+    }
+
+    __success(return != NULL)
+    VOID*
+    Realloc(
+        __in_bcount(cbOldSize) VOID *  pvOld,
+        SIZE_T                          cbOldSize,
+        SIZE_T                          cbNewSize
+    )
+    /*++
+        Description:
+
+            Grows an allocation of this arena. The last allocation grows in
+            place while the chunk has room, anything else is copied to a
+            new allocation and the old one is left to the arena.
+
+        Arguments:
+
+            pvOld       - Allocation returned by Alloc or Realloc.
+            cbOldSize   - Size it was requested with.
+            cbNewSize   - Size to grow to.
+
+        Returns:
+
+            The memory, NULL if out of memory. pvOld is unchanged then.
+
+    --*/
+    {
+        BYTE * pbOld = static_cast<BYTE*>( pvOld );
+        SIZE_T cbOldAligned = AlignSize( cbOldSize );
+        SIZE_T cbNewAligned = AlignSize( cbNewSize );
+
+        _ASSERTE( cbNewSize >= cbOldSize );
+
+        if ( cbNewAligned >= cbNewSize &&
+             pbOld + cbOldAligned == m_pCurrent &&
+             static_cast<SIZE_T>( m_pEnd - pbOld ) >= cbNewAligned )
+        {
+            m_pCurrent = pbOld + cbNewAligned;
+            return pvOld;
+        }
+
+        VOID * pvNew = Alloc( cbNewSize );
+        if ( pvNew != NULL )
+        {
+            memcpy( pvNew, pvOld, cbOldSize );
+        }
+
+        return pvNew;
+    }
+
+    VOID
+    Reset(
+        VOID
+    )
+    /*++
+        Description:
+
+            Frees every allocation of the arena.
+
+    --*/
+    {
+        while ( m_pChunks != NULL )
+        {
+            CHUNK * pNext = m_pChunks->pNext;
+            HeapFree( GetProcessHeap(), 0, m_pChunks );
+            m_pChunks = pNext;
+        }
+
+        m_pCurrent = NULL;
+        m_pEnd = NULL;
+    }
+
+private:
+
+    static constexpr SIZE_T ARENA_ALIGNMENT = MEMORY_ALLOCATION_ALIGNMENT;
+
+    struct DECLSPEC_ALIGN(MEMORY_ALLOCATION_ALIGNMENT) CHUNK
+    {
+        CHUNK * pNext;
+    };
+
+    static
+    SIZE_T
+    AlignSize(
+        SIZE_T  cbSize
+    )
+    {
+        return ( cbSize + ARENA_ALIGNMENT - 1 ) & ~( ARENA_ALIGNMENT - 1 );
+    }
+
+    static
+    CHUNK *
+    AllocChunk(
+        SIZE_T  cbData
+    )
+    {
+        if ( cbData > MAXSIZE_T - sizeof(CHUNK) )
+        {
+            SetLastError( ERROR_INVALID_PARAMETER );
+            return NULL;
+        }
+
+        CHUNK * pChunk = static_cast<CHUNK*>(
+            HeapAlloc( GetProcessHeap(), 0, sizeof(CHUNK) + cbData ) );
+        if ( pChunk == NULL )
+        {
+            SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+            return NULL;
+        }
+
+        pChunk->pNext = NULL;
+        return pChunk;
+    }
+
+    //
+    // Most recent small chunk first, the one m_pCurrent points into.
+    //
+    CHUNK *     m_pChunks;
+    BYTE *      m_pCurrent;
+    BYTE *      m_pEnd;
+    SIZE_T      m_cbChunk;
+};
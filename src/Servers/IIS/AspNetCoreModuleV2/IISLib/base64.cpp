@@ -3,6 +3,403 @@
 
 #include "precomp.h"
 
+#include <intrin.h>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <immintrin.h>
+#define BASE64_USE_SIMD
+#endif
+
+//
+// SIMD kernels for the bulk of long inputs, the scalar loops finish the
+// tail and the padding. SSSE3 or AVX2 is picked once per process by
+// CPUID; without either, and on ARM64, only the scalar loops run.
+//
+// Encoding follows W. Mula's pshufb/multiply scheme. Decoding validates
+// and translates a block of characters with nibble lookups and stops at
+// the first block holding anything but the 64 alphabet characters, which
+// is left to the scalar loop so that it behaves exactly as before.
+//
+
+#ifdef BASE64_USE_SIMD
+
+enum BASE64_KERNEL
+{
+    BASE64_KERNEL_UNKNOWN = -1,
+    BASE64_KERNEL_SCALAR,
+    BASE64_KERNEL_SSSE3,
+    BASE64_KERNEL_AVX2
+};
+
+static
+BASE64_KERNEL
+QueryBase64Kernel(
+    VOID
+)
+{
+    static volatile LONG s_Kernel = BASE64_KERNEL_UNKNOWN;
+
+    LONG kernel = s_Kernel;
+    if (kernel != BASE64_KERNEL_UNKNOWN)
+    {
+        return static_cast<BASE64_KERNEL>(kernel);
+    }
+
+    int rgInfo[4];
+    kernel = BASE64_KERNEL_SCALAR;
+
+    __cpuid(rgInfo, 0);
+    const int nIds = rgInfo[0];
+
+    __cpuid(rgInfo, 1);
+    if (rgInfo[2] & (1 << 9))                       // SSSE3
+    {
+        kernel = BASE64_KERNEL_SSSE3;
+
+        //
+        // AVX2 also needs the OS to save the YMM registers.
+        //
+        if (nIds >= 7 &&
+            (rgInfo[2] & (1 << 27)) &&              // OSXSAVE
+            (rgInfo[2] & (1 << 28)) &&              // AVX
+            (_xgetbv(0) & 6) == 6)
+        {
+            __cpuidex(rgInfo, 7, 0);
+            if (rgInfo[1] & (1 << 5))               // AVX2
+            {
+                kernel = BASE64_KERNEL_AVX2;
+            }
+        }
+    }
+
+    // Racing threads compute the same value.
+    s_Kernel = kernel;
+    return static_cast<BASE64_KERNEL>(kernel);
+}
+
+//
+// 12 bytes in the low 12 bytes of in to 16 characters.
+//
+static
+__forceinline
+__m128i
+Base64EncodeSsse3(
+    __m128i in
+)
+{
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    const __m128i indices = _mm_or_si128(t1, t3);
+
+    //
+    // 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12
+    //
+    __m128i ranges = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    ranges = _mm_or_si128(ranges, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+
+    const __m128i shifts = _mm_shuffle_epi8(
+        _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                      '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0),
+        ranges);
+
+    return _mm_add_epi8(indices, shifts);
+}
+
+//
+// Same as Base64EncodeSsse3 for each 128 bit lane.
+//
+static
+__forceinline
+__m256i
+Base64EncodeAvx2(
+    __m256i in
+)
+{
+    in = _mm256_shuffle_epi8(in, _mm256_broadcastsi128_si256(
+        _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1)));
+
+    const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+    const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+    const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    const __m256i indices = _mm256_or_si256(t1, t3);
+
+    __m256i ranges = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    ranges = _mm256_or_si256(ranges, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices), _mm256_set1_epi8(13)));
+
+    const __m256i shifts = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(
+        _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                      '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0)),
+        ranges);
+
+    return _mm256_add_epi8(indices, shifts);
+}
+
+//
+// 16 characters to 12 bytes in the low 12 bytes of *pOut, false if any
+// of them is not one of the 64 alphabet characters.
+//
+static
+__forceinline
+bool
+Base64DecodeSsse3(
+    __m128i     chars,
+    __m128i *   pOut
+)
+{
+    const __m128i mask2F = _mm_set1_epi8(0x2f);
+    const __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(chars, 4), mask2F);
+    const __m128i loNibbles = _mm_and_si128(chars, mask2F);
+
+    const __m128i lo = _mm_shuffle_epi8(
+        _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A),
+        loNibbles);
+    const __m128i hi = _mm_shuffle_epi8(
+        _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10),
+        hiNibbles);
+
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xFFFF)
+    {
+        return false;
+    }
+
+    const __m128i roll = _mm_shuffle_epi8(
+        _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0),
+        _mm_add_epi8(_mm_cmpeq_epi8(chars, mask2F), hiNibbles));
+
+    const __m128i values = _mm_add_epi8(chars, roll);
+    const __m128i merged = _mm_madd_epi16(
+        _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140)),
+        _mm_set1_epi32(0x00011000));
+
+    *pOut = _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    return true;
+}
+
+//
+// 32 characters to 24 bytes in the low 24 bytes of *pOut.
+//
+static
+__forceinline
+bool
+Base64DecodeAvx2(
+    __m256i     chars,
+    __m256i *   pOut
+)
+{
+    const __m256i mask2F = _mm256_set1_epi8(0x2f);
+    const __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(chars, 4), mask2F);
+    const __m256i loNibbles = _mm256_and_si256(chars, mask2F);
+
+    const __m256i lo = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(
+        _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A)),
+        loNibbles);
+    const __m256i hi = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(
+        _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10)),
+        hiNibbles);
+
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256())) != -1)
+    {
+        return false;
+    }
+
+    const __m256i roll = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(
+        _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0)),
+        _mm256_add_epi8(_mm256_cmpeq_epi8(chars, mask2F), hiNibbles));
+
+    const __m256i values = _mm256_add_epi8(chars, roll);
+    const __m256i merged = _mm256_madd_epi16(
+        _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140)),
+        _mm256_set1_epi32(0x00011000));
+
+    const __m256i packed = _mm256_shuffle_epi8(merged, _mm256_broadcastsi128_si256(
+        _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)));
+
+    *pOut = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+    return true;
+}
+
+//
+// Loads and stores of 16 or 32 characters, wide characters are narrowed
+// with saturation so anything above 0xFF fails validation.
+//
+
+static __forceinline __m128i LoadChars16(const CHAR * pch)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(pch));
+}
+
+static __forceinline __m128i LoadChars16(const WCHAR * pch)
+{
+    return _mm_packus_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pch)),
+                            _mm_loadu_si128(reinterpret_cast<const __m128i*>(pch + 8)));
+}
+
+static __forceinline __m256i LoadChars32(const CHAR * pch)
+{
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pch));
+}
+
+static __forceinline __m256i LoadChars32(const WCHAR * pch)
+{
+    return _mm256_permute4x64_epi64(
+        _mm256_packus_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pch)),
+                            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pch + 16))),
+        0xD8);
+}
+
+static __forceinline VOID StoreChars16(CHAR * pch, __m128i chars)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pch), chars);
+}
+
+static __forceinline VOID StoreChars16(WCHAR * pch, __m128i chars)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pch), _mm_unpacklo_epi8(chars, _mm_setzero_si128()));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pch + 8), _mm_unpackhi_epi8(chars, _mm_setzero_si128()));
+}
+
+static __forceinline VOID StoreChars32(CHAR * pch, __m256i chars)
+{
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(pch), chars);
+}
+
+static __forceinline VOID StoreChars32(WCHAR * pch, __m256i chars)
+{
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(pch), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(chars)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(pch + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(chars, 1)));
+}
+
+#endif // BASE64_USE_SIMD
+
+template<typename TChar>
+static
+DWORD
+Base64EncodeBlocks(
+    __in_bcount(cbDecoded) const BYTE * pbDecoded,
+    DWORD                               cbDecoded,
+    __out TChar *                       pchEncoded
+)
+/*++
+
+Routine Description:
+
+    Encode as much of pbDecoded as the SIMD kernels can without reading
+    past its end. pchEncoded must hold the encoded size.
+
+Return Values:
+
+    Number of bytes encoded, a multiple of 3. 4 characters were written
+    for every 3 of them.
+
+--*/
+{
+    DWORD ib = 0;
+
+#ifdef BASE64_USE_SIMD
+    DWORD ich = 0;
+    const BASE64_KERNEL kernel = QueryBase64Kernel();
+
+    if (kernel == BASE64_KERNEL_AVX2)
+    {
+        // Each lane loads 16 bytes for the 12 it encodes.
+        for ( ; cbDecoded - ib >= 28; ib += 24, ich += 32)
+        {
+            const __m256i in = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pbDecoded + ib))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(pbDecoded + ib + 12)),
+                1);
+            StoreChars32(pchEncoded + ich, Base64EncodeAvx2(in));
+        }
+        _mm256_zeroupper();
+    }
+
+    if (kernel >= BASE64_KERNEL_SSSE3)
+    {
+        for ( ; cbDecoded - ib >= 16; ib += 12, ich += 16)
+        {
+            StoreChars16(pchEncoded + ich,
+                Base64EncodeSsse3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pbDecoded + ib))));
+        }
+    }
+#else
+    UNREFERENCED_PARAMETER(pbDecoded);
+    UNREFERENCED_PARAMETER(cbDecoded);
+    UNREFERENCED_PARAMETER(pchEncoded);
+#endif
+
+    return ib;
+}
+
+template<typename TChar>
+static
+DWORD
+Base64DecodeBlocks(
+    __in_ecount(cchEncoded) const TChar *   pchEncoded,
+    DWORD                                   cchEncoded,
+    __out_bcount(cbDecoded) BYTE *          pbDecoded,
+    DWORD                                   cbDecoded
+)
+/*++
+
+Routine Description:
+
+    Decode leading blocks of pchEncoded with the SIMD kernels, up to the
+    first block that is not plain base64. Stores may write up to 4 bytes
+    per block past what it decodes, but never past cbDecoded.
+
+Return Values:
+
+    Number of characters decoded, a multiple of 16. 3 bytes were written
+    for every 4 of them.
+
+--*/
+{
+    DWORD ich = 0;
+
+#ifdef BASE64_USE_SIMD
+    DWORD ib = 0;
+    const BASE64_KERNEL kernel = QueryBase64Kernel();
+
+    if (kernel == BASE64_KERNEL_AVX2)
+    {
+        for ( ; cchEncoded - ich >= 32 && cbDecoded - ib >= 32; ich += 32, ib += 24)
+        {
+            __m256i out;
+            if (!Base64DecodeAvx2(LoadChars32(pchEncoded + ich), &out))
+            {
+                break;
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(pbDecoded + ib), out);
+        }
+        _mm256_zeroupper();
+    }
+
+    if (kernel >= BASE64_KERNEL_SSSE3)
+    {
+        for ( ; cchEncoded - ich >= 16 && cbDecoded - ib >= 16; ich += 16, ib += 12)
+        {
+            __m128i out;
+            if (!Base64DecodeSsse3(LoadChars16(pchEncoded + ich), &out))
+            {
+                break;
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pbDecoded + ib), out);
+        }
+    }
+#else
+    UNREFERENCED_PARAMETER(pchEncoded);
+    UNREFERENCED_PARAMETER(cchEncoded);
+    UNREFERENCED_PARAMETER(pbDecoded);
+    UNREFERENCED_PARAMETER(cbDecoded);
+#endif
+
+    return ich;
+}
+
 DWORD
 Base64Encode(
     __in_bcount(cbDecodedBufferSize)    VOID *  pDecodedBuffer,
@@ -63,7 +460,8 @@ Return Values:
     }
 
     // Encode data byte triplets into four-byte clusters.
-    ib = ich = 0;
+    ib = Base64EncodeBlocks(pbDecodedBuffer, cbDecodedBufferSize, pszEncodedString);
+    ich = ib / 3 * 4;
     while (ib < cbDecodedBufferSize) {
         b0 = pbDecodedBuffer[ib++];
         b1 = (ib < cbDecodedBufferSize) ? pbDecodedBuffer[ib++] : 0;
@@ -213,7 +611,9 @@ constexpr auto NA = (255);
     }
 
     // Decode each four-byte cluster into the corresponding three data bytes.
-    ich = ib = 0;
+    // The last cluster may be padded, it is always left to the loop below.
+    ich = Base64DecodeBlocks(pszEncodedString, cchEncodedSize - 4, pbDecodeBuffer, cbDecoded);
+    ib = ich / 4 * 3;
     while (ich < cchEncodedSize) {
         b0 = DECODE(pszEncodedString[ich]); ich++;
         b1 = DECODE(pszEncodedString[ich]); ich++;
@@ -302,7 +702,8 @@ Return Values:
     }
 
     // Encode data byte triplets into four-byte clusters.
-    ib = ich = 0;
+    ib = Base64EncodeBlocks(pbDecodedBuffer, cbDecodedBufferSize, pszEncodedString);
+    ich = ib / 3 * 4;
     while (ib < cbDecodedBufferSize) {
         b0 = pbDecodedBuffer[ib++];
         b1 = (ib < cbDecodedBufferSize) ? pbDecodedBuffer[ib++] : 0;
@@ -452,7 +853,9 @@ Return Values:
     }
 
     // Decode each four-byte cluster into the corresponding three data bytes.
-    ich = ib = 0;
+    // The last cluster may be padded, it is always left to the loop below.
+    ich = Base64DecodeBlocks(pszEncodedString, cchEncodedSize - 4, pbDecodeBuffer, cbDecoded);
+    ib = ich / 4 * 3;
     while (ich < cchEncodedSize) {
         b0 = DECODE(pszEncodedString[ich]); ich++;
         b1 = DECODE(pszEncodedString[ich]); ich++;
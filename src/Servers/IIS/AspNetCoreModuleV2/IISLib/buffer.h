@@ -5,6 +5,7 @@
 
 #include <crtdbg.h>
 #include <CodeAnalysis/Warnings.h>
+#include "arena.h"
 
 #pragma warning( push )
 #pragma warning ( disable : ALL_CODE_ANALYSIS_WARNINGS )
@@ -15,6 +16,9 @@
 // BUFFER_T cannot hold other but primitive types since it doesn't call
 // constructor and destructor.
 //
+// A buffer given a BUMP_ARENA grows into the arena instead of the heap,
+// the arena must outlive it.
+//
 // Note: Size is in bytes.
 //
 template<typename T, DWORD LENGTH>
@@ -25,7 +29,9 @@ public:
     BUFFER_T()
       : m_cbBuffer( sizeof(m_rgBuffer) ),
         m_fHeapAllocated( false ),
-        m_pBuffer(m_rgBuffer)
+        m_fArenaAllocated( false ),
+        m_pBuffer(m_rgBuffer),
+        m_pArena( NULL )
     /*++
         Description:
 
@@ -45,10 +51,13 @@ public:
 
     BUFFER_T(
         __inout_bcount(cbInit) T* pbInit, 
-        __in DWORD cbInit
+        __in DWORD cbInit,
+        __in_opt BUMP_ARENA* pArena = NULL
     ) : m_pBuffer( pbInit ),
         m_cbBuffer( cbInit ),
-        m_fHeapAllocated( false )
+        m_fHeapAllocated( false ),
+        m_fArenaAllocated( false ),
+        m_pArena( pArena )
     /*++
         Description:
 
@@ -62,6 +71,7 @@ public:
 
             pbInit - Initial buffer to use.
             cbInit - Size of pbInit in bytes (not in elements).
+            pArena - Arena to grow into, NULL to grow on the heap.
 
         Returns:
             
@@ -144,6 +154,11 @@ public:
             return false;
         }
 
+        if( m_pArena != NULL )
+        {
+            return ArenaResize( cbNewSize, fZeroMemoryBeyondOldSize );
+        }
+
         DWORD dwHeapAllocFlags = fZeroMemoryBeyondOldSize ? HEAP_ZERO_MEMORY : 0;
 
         if( IsHeapAllocated() )
@@ -180,6 +195,49 @@ public:
 
 private:
 
+    __success(return == true)
+    bool
+    ArenaResize(
+        const SIZE_T   cbNewSize,
+        const bool     fZeroMemoryBeyondOldSize
+    )
+    {
+        PVOID pNewMem;
+
+        if( m_fArenaAllocated )
+        {
+            pNewMem = m_pArena->Realloc( m_pBuffer, m_cbBuffer, cbNewSize );
+        }
+        else
+        {
+            pNewMem = m_pArena->Alloc( cbNewSize );
+            if( pNewMem != NULL )
+            {
+                memcpy_s( pNewMem, cbNewSize, m_pBuffer, m_cbBuffer );
+            }
+        }
+
+        if( pNewMem == NULL )
+        {
+            SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+            return false;
+        }
+
+        if( fZeroMemoryBeyondOldSize )
+        {
+            ZeroMemory( reinterpret_cast<BYTE*>(pNewMem) + m_cbBuffer, cbNewSize - m_cbBuffer );
+        }
+
+        //
+        // The arena owns the memory, the destructor leaves it alone.
+        //
+        m_fArenaAllocated = true;
+        m_pBuffer = reinterpret_cast<T*>(pNewMem);
+        m_cbBuffer = static_cast<DWORD>(cbNewSize);
+
+        return true;
+    }
+
     bool 
     IsHeapAllocated(
         VOID
@@ -199,6 +257,11 @@ private:
     //
     bool    m_fHeapAllocated;
 
+    //
+    // Is m_pBuffer carved out of m_pArena?
+    //
+    bool    m_fArenaAllocated;
+
     //
     // Size of the buffer as requested by client in bytes.
     //
@@ -209,6 +272,11 @@ private:
     //
     __field_bcount_full(m_cbBuffer)
     T*      m_pBuffer;
+
+    //
+    // Arena Resize allocates from, NULL for the heap.
+    //
+    BUMP_ARENA* m_pArena;
 };
 
 //
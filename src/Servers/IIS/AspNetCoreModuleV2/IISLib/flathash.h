@@ -0,0 +1,685 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <crtdbg.h>
+#include <intrin.h>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+//
+// Open addressing alternative to HASH_TABLE with the same interface.
+//
+// Records are stored inline in one slot array, next to an array of control
+// bytes that hold 7 bits of the hash of each record, or mark the slot empty
+// or deleted. Slots are probed a group of 16 at a time, one SSE2 compare
+// finds the candidates of a whole group, so a lookup rarely touches more
+// than one cache line of control bytes and compares keys only on a match.
+//
+// Hash, key comparison and the record reference count come from _Traits at
+// compile time instead of virtual calls. _Traits provides, all static:
+//
+//     _Key  ExtractKey(_Record * pRecord);
+//     DWORD CalcKeyHash(_Key key);
+//     BOOL  EqualKeys(_Key key1, _Key key2);
+//     VOID  ReferenceRecord(_Record * pRecord);
+//     VOID  DereferenceRecord(_Record * pRecord);
+//
+// Lookups take the table lock shared, changes take it exclusively.
+//
+template <class _Record, class _Key, class _Traits>
+class FLAT_HASH_TABLE
+{
+protected:
+    typedef BOOL
+    (PFN_DELETE_IF)(
+        _Record *           pRecord,
+        PVOID               pvContext
+    );
+
+    typedef VOID
+    (PFN_APPLY)(
+        _Record *           pRecord,
+        PVOID               pvContext
+    );
+
+public:
+    FLAT_HASH_TABLE(
+        VOID
+    )
+      : _pControl( NULL ),
+        _ppRecords( NULL ),
+        _nSlots( 0 ),
+        _nItems( 0 ),
+        _nDeleted( 0 )
+    {
+        InitializeSRWLock(&_tableLock);
+    }
+
+    ~FLAT_HASH_TABLE();
+
+    DWORD
+    Count(
+        VOID
+    ) const
+    {
+        return _nItems;
+    }
+
+    bool
+    IsInitialized(
+        VOID
+    ) const
+    {
+        return _pControl != NULL;
+    }
+
+    VOID
+    Clear();
+
+    //
+    // nRecords is the number of records expected, the table grows past it
+    // as needed.
+    //
+    HRESULT
+    Initialize(
+        DWORD           nRecords
+    );
+
+    VOID
+    FindKey(
+        _Key        key,
+        _Record **  ppRecord
+    );
+
+    HRESULT
+    InsertRecord(
+        _Record *   pRecord
+    );
+
+    VOID
+    DeleteKey(
+        _Key        key
+    );
+
+    VOID
+    DeleteIf(
+        PFN_DELETE_IF       pfnDeleteIf,
+        PVOID               pvContext
+    );
+
+    VOID
+    Apply(
+        PFN_APPLY           pfnApply,
+        PVOID               pvContext
+    );
+
+private:
+
+    static constexpr DWORD  GROUP_WIDTH = 16;
+    static constexpr CHAR   CONTROL_EMPTY = static_cast<CHAR>(0x80);
+    static constexpr CHAR   CONTROL_DELETED = static_cast<CHAR>(0xFE);
+
+    //
+    // The multiplication spreads hashes that only differ in few bits, the
+    // top 7 bits go to the control byte and the others pick the group.
+    //
+    static
+    DWORD
+    MixHash(
+        DWORD       dwHash
+    )
+    {
+        return dwHash * 0x9E3779B1;
+    }
+
+    static
+    CHAR
+    ControlFromHash(
+        DWORD       dwMixedHash
+    )
+    {
+        return static_cast<CHAR>(dwMixedHash >> 25);
+    }
+
+    // Bit i is set if control byte i of the group equals chControl.
+    static
+    DWORD
+    MatchGroup(
+        const CHAR *    pGroup,
+        CHAR            chControl
+    );
+
+    // Bit i is set if slot i of the group is empty or deleted.
+    static
+    DWORD
+    MatchFreeInGroup(
+        const CHAR *    pGroup
+    );
+
+    static
+    DWORD
+    NextBit(
+        DWORD &     dwMask
+    )
+    {
+        unsigned long index;
+        _BitScanForward(&index, dwMask);
+        dwMask &= dwMask - 1;
+        return index;
+    }
+
+    //
+    // Returns the slot holding key or MAXDWORD. May be called under either
+    // lock.
+    //
+    DWORD
+    FindSlot(
+        _Key        key,
+        DWORD       dwMixedHash
+    ) const;
+
+    // The first empty or deleted slot on the probe sequence of the hash.
+    DWORD
+    FindFreeSlot(
+        DWORD       dwMixedHash
+    ) const;
+
+    VOID
+    EraseSlot(
+        DWORD       iSlot
+    );
+
+    HRESULT
+    AllocateSlots(
+        DWORD           nSlots,
+        CHAR **         ppControl,
+        _Record ***     pppRecords
+    );
+
+    VOID
+    FreeSlots(
+        CHAR *      pControl
+    )
+    {
+        if (pControl != NULL)
+        {
+            HeapFree(GetProcessHeap(), 0, pControl);
+        }
+    }
+
+    HRESULT
+    Rehash(
+        DWORD       nSlots
+    );
+
+    // Control bytes, followed by the records in the same allocation
+    CHAR *                  _pControl;
+    _Record **              _ppRecords;
+    // Power of 2, multiple of GROUP_WIDTH
+    DWORD                   _nSlots;
+    DWORD                   _nItems;
+    DWORD                   _nDeleted;
+    SRWLOCK                 _tableLock;
+};
+
+template <class _Record, class _Key, class _Traits>
+DWORD
+FLAT_HASH_TABLE<_Record,_Key,_Traits>::MatchGroup(
+    const CHAR *    pGroup,
+    CHAR            chControl
+)
+{
+#if defined(_M_IX86) || defined(_M_X64)
+    const __m128i control = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pGroup));
+    return static_cast<DWORD>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(chControl), control)));
+#else
+    DWORD dwMask = 0;
+    for (DWORD i = 0; i < GROUP_WIDTH; i++)
+    {
+        dwMask |= static_cast<DWORD>(pGroup[i] == chControl) << i;
+    }
+    return dwMask;
+#endif
+}
+
+template <class _Record, class _Key, class _Traits>
+DWORD
+FLAT_HASH_TABLE<_Record,_Key,_Traits>::MatchFreeInGroup(
+    const CHAR *    pGroup
+)
+{
+    //
+    // Only empty and deleted slots have the high bit of the control byte
+    // set.
+    //
+#if defined(_M_IX86) || defined(_M_X64)
+    return static_cast<DWORD>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pGroup))));
+#else
+    DWORD dwMask = 0;
+    for (DWORD i = 0; i < GROUP_WIDTH; i++)
+    {
+        dwMask |= static_cast<DWORD>(pGroup[i] < 0) << i;
+    }
+    return dwMask;
+#endif
+}
+
+template <class _Record, class _Key, class _Traits>
+HRESULT
+FLAT_HASH_TABLE<_Record,_Key,_Traits>::AllocateSlots(
+    DWORD           nSlots,
+    CHAR **         ppControl,
+    _Record ***     pppRecords
+)
+{
+    *ppControl = NULL;
+    *pppRecords = NULL;
+
+    if (nSlots >= MAXDWORD / (sizeof(CHAR) + sizeof(_Record *)))
+    {
+        return E_INVALIDARG;
+    }
+
+    CHAR * pControl = (CHAR *)HeapAlloc(GetProcessHeap(),
+                                        0,
+                                        nSlots * (sizeof(CHAR) + sizeof(_Record *)));
+    if (pControl == NULL)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_ENOUGH_MEMORY);
+    }
+
+    memset(pControl, CONTROL_EMPTY, nSlots);
+
+    *ppControl = pControl;
+    // nSlots is a multiple of GROUP_WIDTH, the records start aligned
+    *pppRecords = reinterpret_cast<_Record **>(pControl + nSlots);
+    return S_OK;
+}
+
+template <class _Record, class _Key, class _Traits>
+HRESULT
+FLAT_HASH_TABLE<_Record,_Key,_Traits>::Initialize(
+    DWORD   nRecords
+)
+{
+    HRESULT hr = S_OK;
+    DWORD   nSlots = GROUP_WIDTH;
+
+    if ( nRecords == 0 )
+    {
+        return E_INVALIDARG;
+    }
+
+    _ASSERTE(_pControl == NULL );
+    if ( _pControl != NULL )
+    {
+        return E_INVALIDARG;
+    }
+
+    //
+    // Keeps the table at most 7/8 full.
+    //
+    while (nSlots / 8 * 7 < nRecords)
+    {
+        if (nSlots >= MAXDWORD / 2)
+        {
+            return E_INVALIDARG;
+        }
+        nSlots *= 2;
+    }
+
+    hr = AllocateSlots(nSlots, &_pControl, &_ppRecords);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    _nSlots = nSlots;
+    return S_OK;
+}
+
+template <class _Record, class _Key, class _Traits>
+FLAT_HASH_TABLE<_Record,_Key,_Traits>::~FLAT_HASH_TABLE()
+{
+    _ASSERTE(_nItems == 0);
+
+    FreeSlots(_pControl);
+    _pControl = NULL;
+    _ppRecords = NULL;
+    _nSlots = 0;
+}
+
+template <class _Record, class _Key, class _Traits>
+VOID
+FLAT_HASH_TABLE<_Record,_Key,_Traits>::Clear()
+{
+    if (_pControl == NULL)
+    {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&_tableLock);
+
+    for (DWORD i = 0; i < _nSlots; i++)
+    {
+        if (_pControl[i] >= 0)
+        {
+            _Traits::DereferenceRecord(_ppRecords[i]);
+        }
+    }
+
+    memset(_pControl, CONTROL_EMPTY, _nSlots);
+    _nItems = 0;
+    _nDeleted = 0;
+
+    ReleaseSRWLockExclusive(&_tableLock);
+}
+
+template <class _Record, class _Key, class _Traits>
+DWORD
+FLAT_HASH_TABLE<_Record,_Key,_Traits>::FindSlot(
+    _Key        key,
+    DWORD       dwMixedHash
+) const
+{
+    const DWORD nGroupMask = _nSlots / GROUP_WIDTH - 1;
+    const CHAR  chControl = ControlFromHash(dwMixedHash);
+    DWORD       iGroup = dwMixedHash & nGroupMask;
+
+    //
+    // Triangular probing visits every group once the table is a power of 2.
+    //
+    for (DWORD nProbes = 1; nProbes <= nGroupMask + 1; nProbes++)
+    {
+        const CHAR * pGroup = _pControl + iGroup * GROUP_WIDTH;
+
+        for (DWORD dwMatches = MatchGroup(pGroup, chControl); dwMatches != 0; )
+        {
+            const DWORD iSlot = iGroup * GROUP_WIDTH + NextBit(dwMatches);
+            if (_Traits::EqualKeys(key, _Traits::ExtractKey(_ppRecords[iSlot])))
+            {
+                return iSlot;
+            }
+        }
+
+        //
+        // An insert would have used the empty slot, the key isn't further
+        // down the probe sequence.
+        //
+        if (MatchGroup(pGroup, CONTROL_EMPTY) != 0)
+        {
+            break;
+        }
+
+        iGroup = (iGroup + nProbes) & nGroupMask;
+    }
+
+    return MAXDWORD;
+}
+
+template <class _Record, class _Key, class _Traits>
+DWORD
+FLAT_HASH_TABLE<_Record,_Key,_Traits>::FindFreeSlot(
+    DWORD       dwMixedHash
+) const
+{
+    const DWORD nGroupMask = _nSlots / GROUP_WIDTH - 1;
+    DWORD       iGroup = dwMixedHash & nGroupMask;
+
+    for (DWORD nProbes = 1; ; nProbes++)
+    {
+        DWORD dwFree = MatchFreeInGroup(_pControl + iGroup * GROUP_WIDTH);
+        if (dwFree != 0)
+        {
+            return iGroup * GROUP_WIDTH + NextBit(dwFree);
+        }
+
+        // The table is never full, a free slot is always found.
+        iGroup = (iGroup + nProbes) & nGroupMask;
+    }
+}
+
+template <class _Record, class _Key, class _Traits>
+VOID
+FLAT_HASH_TABLE<_Record,_Key,_Traits>::EraseSlot(
+    DWORD       iSlot
+)
+{
+    _Record * pRecord = _ppRecords[iSlot];
+
+    //
+    // A group that still has an empty slot ends every probe sequence
+    // through it, so the slot can become empty again. Otherwise lookups
+    // have to keep probing past it.
+    //
+    if (MatchGroup(_pControl + iSlot / GROUP_WIDTH * GROUP_WIDTH, CONTROL_EMPTY) != 0)
+    {
+        _pControl[iSlot] = CONTROL_EMPTY;
+    }
+    else
+    {
+        _pControl[iSlot] = CONTROL_DELETED;
+        _nDeleted++;
+    }
+
+    _ppRecords[iSlot] = NULL;
+    _nItems--;
+
+    _Traits::DereferenceRecord(pRecord);
+}
+
+template <class _Record, class _Key, class _Traits>
+VOID
+FLAT_HASH_TABLE<_Record,_Key,_Traits>::FindKey(
+    _Key                key,
+    _Record **          ppRecord
+)
+{
+    *ppRecord = NULL;
+
+    if (_pControl == NULL)
+    {
+        return;
+    }
+
+    const DWORD dwMixedHash = MixHash(_Traits::CalcKeyHash(key));
+
+    AcquireSRWLockShared(&_tableLock);
+
+    const DWORD iSlot = FindSlot(key, dwMixedHash);
+    if (iSlot != MAXDWORD)
+    {
+        _Traits::ReferenceRecord(_ppRecords[iSlot]);
+        *ppRecord = _ppRecords[iSlot];
+    }
+
+    ReleaseSRWLockShared(&_tableLock);
+}
+
+template <class _Record, class _Key, class _Traits>
+HRESULT
+FLAT_HASH_TABLE<_Record,_Key,_Traits>::InsertRecord(
+    _Record *           pRecord
+)
+/*++
+  Takes a reference on pRecord once it is inserted.
+
+  Returns HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS) if the record already exists.
+  Never leak this error to the end user because "*file* already exists" may be confusing.
+--*/
+{
+    HRESULT     hr = S_OK;
+    _Key        key = _Traits::ExtractKey(pRecord);
+    const DWORD dwMixedHash = MixHash(_Traits::CalcKeyHash(key));
+    DWORD       iSlot;
+
+    if (_pControl == NULL)
+    {
+        return E_UNEXPECTED;
+    }
+
+    AcquireSRWLockExclusive(&_tableLock);
+
+    if (FindSlot(key, dwMixedHash) != MAXDWORD)
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+        goto Finished;
+    }
+
+    //
+    // Deleted slots count against the load, they lengthen the probes just
+    // the same. Rehashing in place drops them, the table only grows if it
+    // is full of records.
+    //
+    if (_nItems + _nDeleted + 1 > _nSlots / 8 * 7)
+    {
+        hr = Rehash(_nItems + 1 > _nSlots / 16 * 7 ? _nSlots * 2 : _nSlots);
+        if (FAILED(hr))
+        {
+            goto Finished;
+        }
+    }
+
+    iSlot = FindFreeSlot(dwMixedHash);
+    if (_pControl[iSlot] == CONTROL_DELETED)
+    {
+        _nDeleted--;
+    }
+
+    _Traits::ReferenceRecord(pRecord);
+    _ppRecords[iSlot] = pRecord;
+    _pControl[iSlot] = ControlFromHash(dwMixedHash);
+    _nItems++;
+
+Finished:
+
+    ReleaseSRWLockExclusive(&_tableLock);
+
+    return hr;
+}
+
+template <class _Record, class _Key, class _Traits>
+VOID
+FLAT_HASH_TABLE<_Record,_Key,_Traits>::DeleteKey(
+    _Key        key
+)
+{
+    if (_pControl == NULL)
+    {
+        return;
+    }
+
+    const DWORD dwMixedHash = MixHash(_Traits::CalcKeyHash(key));
+
+    AcquireSRWLockExclusive(&_tableLock);
+
+    const DWORD iSlot = FindSlot(key, dwMixedHash);
+    if (iSlot != MAXDWORD)
+    {
+        EraseSlot(iSlot);
+    }
+
+    ReleaseSRWLockExclusive(&_tableLock);
+}
+
+template <class _Record, class _Key, class _Traits>
+VOID
+FLAT_HASH_TABLE<_Record,_Key,_Traits>::DeleteIf(
+    PFN_DELETE_IF               pfnDeleteIf,
+    PVOID                       pvContext
+)
+{
+    if (_pControl == NULL)
+    {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&_tableLock);
+
+    for (DWORD i = 0; i < _nSlots; i++)
+    {
+        if (_pControl[i] >= 0 &&
+            pfnDeleteIf(_ppRecords[i], pvContext))
+        {
+            EraseSlot(i);
+        }
+    }
+
+    ReleaseSRWLockExclusive(&_tableLock);
+}
+
+template <class _Record, class _Key, class _Traits>
+VOID
+FLAT_HASH_TABLE<_Record,_Key,_Traits>::Apply(
+    PFN_APPLY                   pfnApply,
+    PVOID                       pvContext
+)
+{
+    if (_pControl == NULL)
+    {
+        return;
+    }
+
+    AcquireSRWLockShared(&_tableLock);
+
+    for (DWORD i = 0; i < _nSlots; i++)
+    {
+        if (_pControl[i] >= 0)
+        {
+            pfnApply(_ppRecords[i], pvContext);
+        }
+    }
+
+    ReleaseSRWLockShared(&_tableLock);
+}
+
+template <class _Record, class _Key, class _Traits>
+HRESULT
+FLAT_HASH_TABLE<_Record,_Key,_Traits>::Rehash(
+    DWORD       nSlots
+)
+/*++
+  Called with the table lock held exclusively. Records keep their
+  reference, they only move.
+--*/
+{
+    HRESULT     hr = S_OK;
+    CHAR *      pOldControl = _pControl;
+    _Record **  ppOldRecords = _ppRecords;
+    const DWORD nOldSlots = _nSlots;
+
+    if (nSlots < nOldSlots)
+    {
+        return E_INVALIDARG;
+    }
+
+    hr = AllocateSlots(nSlots, &_pControl, &_ppRecords);
+    if (FAILED(hr))
+    {
+        _pControl = pOldControl;
+        _ppRecords = ppOldRecords;
+        return hr;
+    }
+
+    _nSlots = nSlots;
+    _nDeleted = 0;
+
+    for (DWORD i = 0; i < nOldSlots; i++)
+    {
+        if (pOldControl[i] >= 0)
+        {
+            const DWORD dwMixedHash = MixHash(_Traits::CalcKeyHash(_Traits::ExtractKey(ppOldRecords[i])));
+            const DWORD iSlot = FindFreeSlot(dwMixedHash);
+
+            _ppRecords[iSlot] = ppOldRecords[i];
+            _pControl[iSlot] = ControlFromHash(dwMixedHash);
+        }
+    }
+
+    FreeSlots(pOldControl);
+
+    return S_OK;
+}
@@ -10,7 +10,7 @@
 template <class _Record>
 class HASH_NODE
 {
-    template <class _Record, class _Key>
+    template <class _Record, class _Key, class _Lock>
     friend class HASH_TABLE;
 
     HASH_NODE(
@@ -37,7 +37,11 @@ class HASH_NODE
     DWORD               _dwHash;
 };
 
-template <class _Record, class _Key>
+//
+// _Lock is CWSDRWLock by default, STRIPED_READ_WRITE_LOCK suits tables
+// looked up from many threads and rarely changed.
+//
+template <class _Record, class _Key, class _Lock = CWSDRWLock>
 class HASH_TABLE
 {
 protected:
@@ -187,12 +191,12 @@ private:
     // Allow to use lock object in const methods.
     //
     mutable
-    CWSDRWLock              _tableLock;
+    _Lock                   _tableLock;
 };
 
-template <class _Record, class _Key>
+template <class _Record, class _Key, class _Lock>
 HRESULT
-HASH_TABLE<_Record,_Key>::Initialize(
+HASH_TABLE<_Record,_Key,_Lock>::Initialize(
     DWORD   nBuckets
 )
 {
@@ -250,8 +254,8 @@ Failed:
 }
 
 
-template <class _Record, class _Key>
-HASH_TABLE<_Record,_Key>::~HASH_TABLE()
+template <class _Record, class _Key, class _Lock>
+HASH_TABLE<_Record,_Key,_Lock>::~HASH_TABLE()
 {
     if (_ppBuckets == NULL)
     {
@@ -267,16 +271,16 @@ HASH_TABLE<_Record,_Key>::~HASH_TABLE()
     _nBuckets = 0;
 }
 
-template< class _Record, class _Key>
+template <class _Record, class _Key, class _Lock>
 DWORD
-HASH_TABLE<_Record,_Key>::Count() const
+HASH_TABLE<_Record,_Key,_Lock>::Count() const
 {
     return _nItems;
 }
 
-template< class _Record, class _Key>
+template <class _Record, class _Key, class _Lock>
 bool
-HASH_TABLE<_Record,_Key>::IsInitialized(
+HASH_TABLE<_Record,_Key,_Lock>::IsInitialized(
     VOID
 ) const
 {
@@ -284,9 +288,9 @@ HASH_TABLE<_Record,_Key>::IsInitialized(
 }
 
 
-template <class _Record, class _Key>
+template <class _Record, class _Key, class _Lock>
 VOID
-HASH_TABLE<_Record,_Key>::Clear()
+HASH_TABLE<_Record,_Key,_Lock>::Clear()
 {
     HASH_NODE<_Record> *pCurrent;
     HASH_NODE<_Record> *pNext;
@@ -317,10 +321,10 @@ HASH_TABLE<_Record,_Key>::Clear()
     _tableLock.ExclusiveRelease();
 }
 
-template <class _Record, class _Key>
+template <class _Record, class _Key, class _Lock>
 __success(*ppNode != NULL && return != FALSE)
 BOOL
-HASH_TABLE<_Record,_Key>::FindNodeInternal(
+HASH_TABLE<_Record,_Key,_Lock>::FindNodeInternal(
     _Key                    key,
     DWORD                   dwHash,
     __deref_out
@@ -374,9 +378,9 @@ HASH_TABLE<_Record,_Key>::FindNodeInternal(
     return fFound;
 }
 
-template <class _Record, class _Key>
+template <class _Record, class _Key, class _Lock>
 VOID
-HASH_TABLE<_Record,_Key>::FindKey(
+HASH_TABLE<_Record,_Key,_Lock>::FindKey(
     _Key                key,
     _Record **          ppRecord
 )
@@ -399,9 +403,9 @@ HASH_TABLE<_Record,_Key>::FindKey(
     _tableLock.SharedRelease();
 }
 
-template <class _Record, class _Key>
+template <class _Record, class _Key, class _Lock>
 HRESULT
-HASH_TABLE<_Record,_Key>::InsertRecord(
+HASH_TABLE<_Record,_Key,_Lock>::InsertRecord(
     _Record *           pRecord
 )
 /*++
@@ -492,9 +496,9 @@ Finished:
     return hr;
 }
 
-template <class _Record, class _Key>
+template <class _Record, class _Key, class _Lock>
 VOID
-HASH_TABLE<_Record,_Key>::DeleteKey(
+HASH_TABLE<_Record,_Key,_Lock>::DeleteKey(
     _Key        key
 )
 {
@@ -515,9 +519,9 @@ HASH_TABLE<_Record,_Key>::DeleteKey(
     _tableLock.ExclusiveRelease();
 }
 
-template <class _Record, class _Key>
+template <class _Record, class _Key, class _Lock>
 VOID
-HASH_TABLE<_Record,_Key>::DeleteIf(
+HASH_TABLE<_Record,_Key,_Lock>::DeleteIf(
     PFN_DELETE_IF               pfnDeleteIf,
     PVOID                       pvContext
 )
@@ -555,9 +559,9 @@ HASH_TABLE<_Record,_Key>::DeleteIf(
     _tableLock.ExclusiveRelease();
 }
 
-template <class _Record, class _Key>
+template <class _Record, class _Key, class _Lock>
 VOID
-HASH_TABLE<_Record,_Key>::Apply(
+HASH_TABLE<_Record,_Key,_Lock>::Apply(
     PFN_APPLY                   pfnApply,
     PVOID                       pvContext
 )
@@ -583,9 +587,9 @@ HASH_TABLE<_Record,_Key>::Apply(
     _tableLock.SharedRelease();
 }
 
-template <class _Record, class _Key>
+template <class _Record, class _Key, class _Lock>
 VOID
-HASH_TABLE<_Record,_Key>::RehashTableIfNeeded(
+HASH_TABLE<_Record,_Key,_Lock>::RehashTableIfNeeded(
     VOID
 )
 {
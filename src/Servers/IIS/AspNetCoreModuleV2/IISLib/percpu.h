@@ -29,6 +29,16 @@ public:
         FunctionForEach Function
     );
 
+    //
+    // Sums Function(T*) over all processors, e.g. to read a counter
+    // incremented through GetLocal. Not a consistent snapshot.
+    //
+    template<typename TValue, typename FunctionValue>
+    TValue
+    Aggregate(
+        FunctionValue   Function
+    );
+
     VOID
     Dispose(
     );
@@ -66,11 +76,18 @@ private:
         DWORD Index
     );
 
+    //
+    // Groups past this share the slots of the first ones.
+    //
+    static constexpr DWORD MAX_PROCESSOR_GROUPS = 32;
+
     static
     HRESULT
     GetProcessorInformation(
         __out DWORD * pCacheLineSize,
-        __out DWORD * pNumberOfProcessors
+        __out DWORD * pNumberOfProcessors,
+        __out DWORD * pNumberOfGroups,
+        __out_ecount(MAX_PROCESSOR_GROUPS) DWORD * pGroupOffsets
     );
 
     //
@@ -79,6 +96,13 @@ private:
     PVOID   m_pVariables;
     SIZE_T  m_Alignment;
     SIZE_T  m_VariablesCount;
+
+    //
+    // Index of the first slot of each processor group, processor numbers
+    // are only unique within a group.
+    //
+    DWORD   m_GroupCount;
+    DWORD   m_GroupOffsets[MAX_PROCESSOR_GROUPS];
 };
 
 template<typename T>
@@ -94,10 +118,20 @@ PER_CPU<T>::Create(
     DWORD           CacheLineSize = 0;
     DWORD           ObjectCacheLineSize = 0;
     DWORD           NumberOfProcessors = 0;
+    DWORD           NumberOfGroups = 0;
+    DWORD           GroupOffsets[MAX_PROCESSOR_GROUPS] = { };
+    SIZE_T          HeaderSize = 0;
     PER_CPU<T> *    pInstance = NULL;
 
+    //
+    // Slots are only padded to the cache line.
+    //
+    static_assert(alignof(T) <= SYSTEM_CACHE_ALIGNMENT_SIZE, "PER_CPU<T> can't align T");
+
     hr = GetProcessorInformation(&CacheLineSize,
-                                 &NumberOfProcessors);
+                                 &NumberOfProcessors,
+                                 &NumberOfGroups,
+                                 GroupOffsets);
     if (FAILED(hr))
     {
         goto Finished;
@@ -108,7 +142,7 @@ PER_CPU<T>::Create(
         //
         // Round to the next multiple of the cache line size.
         //
-        ObjectCacheLineSize = (sizeof(T) + CacheLineSize-1) & (CacheLineSize-1);
+        ObjectCacheLineSize = (sizeof(T) + CacheLineSize-1) & ~(CacheLineSize-1);
     }
     else
     {
@@ -118,10 +152,11 @@ PER_CPU<T>::Create(
     {
         //
         // Calculate the size of the PER_CPU<T> object, including the array.
-        // The first cache line is for the member variables and the array
+        // The first cache lines are for the member variables and the array
         // starts in the next cache line.
         //
-        SIZE_T Size = CacheLineSize + NumberOfProcessors * ObjectCacheLineSize;
+        HeaderSize = (sizeof(PER_CPU<T>) + CacheLineSize - 1) & ~(SIZE_T)(CacheLineSize - 1);
+        SIZE_T Size = HeaderSize + NumberOfProcessors * ObjectCacheLineSize;
 
         pInstance = (PER_CPU<T>*) _aligned_malloc(Size, CacheLineSize);
         if (pInstance == NULL)
@@ -134,9 +169,11 @@ PER_CPU<T>::Create(
     }
 
     //
-    // The array start in the 2nd cache line.
+    // The array starts after the member variables.
     //
-    pInstance->m_pVariables = reinterpret_cast<PBYTE>(pInstance) + CacheLineSize;
+    pInstance->m_pVariables = reinterpret_cast<PBYTE>(pInstance) + HeaderSize;
+    pInstance->m_GroupCount = NumberOfGroups;
+    memcpy(pInstance->m_GroupOffsets, GroupOffsets, sizeof(GroupOffsets));
 
     //
     // Pass a disposer for disposing initialized items in case of failure.
@@ -171,9 +208,8 @@ T *
 PER_CPU<T>::GetLocal(
 )
 {
-    // Use GetCurrentProcessorNumber (up to 64 logical processors) instead of
-    // GetCurrentProcessorNumberEx (more than 64 logical processors) because
-    // the number of processors are not densely packed per group.
+    // Processor numbers restart at 0 in every group, each group has its
+    // own range of slots starting at m_GroupOffsets.
     // The idea of distributing variables per CPU is to have
     // a scalability multiplier (could be NUMA node instead).
     //
@@ -181,7 +217,21 @@ PER_CPU<T>::GetLocal(
     // there won't be even distribution, but still better
     // than one single variable.
     //
-    return GetObject(GetCurrentProcessorNumber());
+    PROCESSOR_NUMBER ProcessorNumber;
+    GetCurrentProcessorNumberEx(&ProcessorNumber);
+
+    SIZE_T Index = ProcessorNumber.Number;
+    if (ProcessorNumber.Group < m_GroupCount)
+    {
+        Index += m_GroupOffsets[ProcessorNumber.Group];
+    }
+
+    if (Index >= m_VariablesCount)
+    {
+        Index %= m_VariablesCount;
+    }
+
+    return GetObject(static_cast<DWORD>(Index));
 }
 
 template<typename T>
@@ -207,6 +257,23 @@ PER_CPU<T>::ForEach(
     }
 }
 
+template<typename T>
+template<typename TValue, typename FunctionValue>
+TValue
+PER_CPU<T>::Aggregate(
+    FunctionValue   Function
+)
+{
+    TValue Total = TValue();
+
+    for(DWORD Index = 0; Index < m_VariablesCount; ++Index)
+    {
+        Total += Function(GetObject(Index));
+    }
+
+    return Total;
+}
+
 template<typename T>
 VOID
 PER_CPU<T>::Dispose(
@@ -278,7 +345,9 @@ Routine Description:
 Arguments:
 
     pCacheLineSize - The processor cache-line size.
-    pNumberOfProcessors - Maximum number of processors per group.
+    pNumberOfProcessors - Maximum number of processors of all groups.
+    pNumberOfGroups - Number of groups in pGroupOffsets.
+    pGroupOffsets - Number of processors in the groups before each group.
 
 Return:
 
@@ -286,10 +355,29 @@ Return:
 
 --*/
 {
-    SYSTEM_INFO     SystemInfo = { };
+    DWORD           NumberOfProcessors = 0;
+    const DWORD     NumberOfGroups = GetMaximumProcessorGroupCount();
+
+    //
+    // The maximum counts include processors that can be added while
+    // running, their numbers are reserved in the group.
+    //
+    for (DWORD Group = 0; Group < NumberOfGroups && Group < MAX_PROCESSOR_GROUPS; ++Group)
+    {
+        pGroupOffsets[Group] = NumberOfProcessors;
+        NumberOfProcessors += GetMaximumProcessorCount(static_cast<WORD>(Group));
+    }
+
+    if (NumberOfProcessors == 0)
+    {
+        SYSTEM_INFO     SystemInfo = { };
+
+        GetSystemInfo(&SystemInfo);
+        NumberOfProcessors = SystemInfo.dwNumberOfProcessors;
+    }
 
-    GetSystemInfo(&SystemInfo);
-    *pNumberOfProcessors = SystemInfo.dwNumberOfProcessors;
+    *pNumberOfGroups = min(NumberOfGroups, MAX_PROCESSOR_GROUPS);
+    *pNumberOfProcessors = NumberOfProcessors;
     *pCacheLineSize = SYSTEM_CACHE_ALIGNMENT_SIZE;
 
     return S_OK;
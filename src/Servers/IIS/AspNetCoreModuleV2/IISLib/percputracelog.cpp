@@ -0,0 +1,179 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "precomp.h"
+#include <algorithm>
+#include <new>
+#include "percputracelog.h"
+
+// static
+HRESULT
+PER_CPU_REF_TRACE_LOG::Create(
+    LONG                                cEntriesPerProcessor,
+    BOOL                                fCaptureStack,
+    _Out_ PER_CPU_REF_TRACE_LOG **      ppLog
+)
+{
+    HRESULT                     hr = S_OK;
+    PER_CPU_REF_TRACE_LOG *     pLog = NULL;
+    DWORD                       cRings = 0;
+
+    *ppLog = NULL;
+
+    if (cEntriesPerProcessor <= 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    pLog = new (std::nothrow) PER_CPU_REF_TRACE_LOG();
+    if (pLog == NULL)
+    {
+        hr = E_OUTOFMEMORY;
+        goto Finished;
+    }
+
+    pLog->m_cEntriesPerProcessor = cEntriesPerProcessor;
+    pLog->m_fCaptureStack = fCaptureStack;
+
+    hr = PER_CPU<RING>::Create([&cRings](RING * pRing)
+        {
+            pRing->NextEntry = -1;
+            pRing->Processor = cRings++;
+            pRing->pEntries = NULL;
+        },
+        &pLog->m_pRings);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    pLog->m_pEntries = static_cast<PER_CPU_REF_TRACE_LOG_ENTRY *>(
+        VirtualAlloc(NULL,
+            static_cast<SIZE_T>(cRings) * cEntriesPerProcessor * sizeof(PER_CPU_REF_TRACE_LOG_ENTRY),
+            MEM_COMMIT | MEM_RESERVE,
+            PAGE_READWRITE));
+    if (pLog->m_pEntries == NULL)
+    {
+        hr = E_OUTOFMEMORY;
+        goto Finished;
+    }
+
+    pLog->m_pRings->ForEach([pLog](RING * pRing)
+        {
+            pRing->pEntries = pLog->m_pEntries + static_cast<SIZE_T>(pRing->Processor) * pLog->m_cEntriesPerProcessor;
+        });
+
+    *ppLog = pLog;
+    pLog = NULL;
+
+Finished:
+
+    if (pLog != NULL)
+    {
+        pLog->Destroy();
+        pLog = NULL;
+    }
+
+    return hr;
+}
+
+PER_CPU_REF_TRACE_LOG::~PER_CPU_REF_TRACE_LOG()
+{
+    if (m_pEntries != NULL)
+    {
+        VirtualFree(m_pEntries, 0, MEM_RELEASE);
+        m_pEntries = NULL;
+    }
+
+    if (m_pRings != NULL)
+    {
+        m_pRings->Dispose();
+        m_pRings = NULL;
+    }
+}
+
+VOID
+PER_CPU_REF_TRACE_LOG::Destroy(
+    VOID
+)
+{
+    delete this;
+}
+
+//
+// Not inlined so that the first frame skipped by RtlCaptureStackBackTrace
+// is this one.
+//
+__declspec(noinline)
+VOID
+PER_CPU_REF_TRACE_LOG::Write(
+    LONG                                NewRefCount,
+    CONST VOID *                        Context,
+    CONST VOID *                        Context1,
+    CONST VOID *                        Context2,
+    CONST VOID *                        Context3
+)
+{
+    RING *          pRing = m_pRings->GetLocal();
+    const ULONG     index = static_cast<ULONG>(InterlockedIncrement(&pRing->NextEntry)) %
+                            static_cast<ULONG>(m_cEntriesPerProcessor);
+    PER_CPU_REF_TRACE_LOG_ENTRY * pEntry = &pRing->pEntries[index];
+    LARGE_INTEGER   liCounter;
+
+    pEntry->NewRefCount = NewRefCount;
+    pEntry->Thread = GetCurrentThreadId();
+    pEntry->Processor = pRing->Processor;
+    pEntry->Context = Context;
+    pEntry->Context1 = Context1;
+    pEntry->Context2 = Context2;
+    pEntry->Context3 = Context3;
+
+    if (m_fCaptureStack)
+    {
+        const USHORT cFrames = RtlCaptureStackBackTrace(1,
+            REF_TRACE_LOG_STACK_DEPTH,
+            pEntry->Stack,
+            NULL);
+        ZeroMemory(pEntry->Stack + cFrames, (REF_TRACE_LOG_STACK_DEPTH - cFrames) * sizeof(PVOID));
+    }
+
+    //
+    // Last, a reader skips the slots without a timestamp.
+    //
+    QueryPerformanceCounter(&liCounter);
+    pEntry->llTimestamp = liCounter.QuadPart;
+}
+
+HRESULT
+PER_CPU_REF_TRACE_LOG::Snapshot(
+    _Inout_ std::vector<PER_CPU_REF_TRACE_LOG_ENTRY> & entries
+)
+{
+    try
+    {
+        entries.clear();
+
+        m_pRings->ForEach([this, &entries](RING * pRing)
+            {
+                for (LONG i = 0; i < m_cEntriesPerProcessor; i++)
+                {
+                    if (pRing->pEntries[i].llTimestamp != 0)
+                    {
+                        entries.push_back(pRing->pEntries[i]);
+                    }
+                }
+            });
+
+        std::stable_sort(entries.begin(), entries.end(),
+            [](const PER_CPU_REF_TRACE_LOG_ENTRY & left, const PER_CPU_REF_TRACE_LOG_ENTRY & right)
+            {
+                return left.llTimestamp < right.llTimestamp;
+            });
+    }
+    catch (const std::bad_alloc &)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    return S_OK;
+}
@@ -0,0 +1,112 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <windows.h>
+#include <vector>
+#include "percpu.h"
+#include "reftrace.h"
+
+//
+// Entry of a PER_CPU_REF_TRACE_LOG, REF_TRACE_LOG_ENTRY with the time it
+// was written so that the rings can be merged.
+//
+struct PER_CPU_REF_TRACE_LOG_ENTRY
+{
+    //
+    // QueryPerformanceCounter value, 0 for a slot never written.
+    //
+    LONGLONG        llTimestamp;
+    LONG            NewRefCount;
+    DWORD           Thread;
+    DWORD           Processor;
+    CONST VOID *    Context;
+    CONST VOID *    Context1;
+    CONST VOID *    Context2;
+    CONST VOID *    Context3;
+    //
+    // Zeroed unless the log captures stacks.
+    //
+    PVOID           Stack[REF_TRACE_LOG_STACK_DEPTH];
+};
+
+//
+// Reference count trace log cheap enough for production load. Unlike
+// TRACE_LOG, whose writers all increment the same index, every processor
+// writes its own ring so a write is an interlocked increment of a cache
+// line only that processor touches and a copy. Capturing the stack, which
+// costs far more than the rest, is optional.
+//
+// A slot being written while the log is read may come out torn, and a
+// thread that moved to another processor may share a slot index with the
+// writer of that processor when its ring wraps. Both are rare and only
+// affect one entry, which is fine for chasing a leak.
+//
+class PER_CPU_REF_TRACE_LOG
+{
+public:
+
+    static
+    HRESULT
+    Create(
+        LONG                                cEntriesPerProcessor,
+        BOOL                                fCaptureStack,
+        _Out_ PER_CPU_REF_TRACE_LOG **      ppLog
+    );
+
+    VOID
+    Destroy(
+        VOID
+    );
+
+    //
+    // Same contract as WriteRefTraceLogEx.
+    //
+    VOID
+    Write(
+        LONG                                NewRefCount,
+        CONST VOID *                        Context,
+        CONST VOID *                        Context1 = REF_TRACE_EMPTY_CONTEXT,
+        CONST VOID *                        Context2 = REF_TRACE_EMPTY_CONTEXT,
+        CONST VOID *                        Context3 = REF_TRACE_EMPTY_CONTEXT
+    );
+
+    //
+    // Merges the written entries of all rings, oldest first.
+    //
+    HRESULT
+    Snapshot(
+        _Inout_ std::vector<PER_CPU_REF_TRACE_LOG_ENTRY> & entries
+    );
+
+private:
+
+    struct RING
+    {
+        //
+        // Index of the last entry written, -1 before the first one.
+        //
+        volatile LONG                   NextEntry;
+        DWORD                           Processor;
+        PER_CPU_REF_TRACE_LOG_ENTRY *   pEntries;
+    };
+
+    PER_CPU_REF_TRACE_LOG() :
+        m_pRings(NULL),
+        m_pEntries(NULL),
+        m_cEntriesPerProcessor(0),
+        m_fCaptureStack(FALSE)
+    {
+    }
+
+    ~PER_CPU_REF_TRACE_LOG();
+
+    PER_CPU<RING> *                 m_pRings;
+    //
+    // One allocation for the entries of all rings.
+    //
+    PER_CPU_REF_TRACE_LOG_ENTRY *   m_pEntries;
+    LONG                            m_cEntriesPerProcessor;
+    BOOL                            m_fCaptureStack;
+};
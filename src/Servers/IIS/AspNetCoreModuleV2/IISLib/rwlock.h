@@ -185,6 +185,89 @@ private:
     SRWLOCK m_rwLock;
 };
 
+//
+// Reader/writer lock for read mostly data. Readers take the shared lock of
+// one of several stripes, picked by thread, each on its own cache line, so
+// concurrent readers on different cores rarely touch the same line. A
+// writer takes every stripe exclusively, which makes writes more
+// expensive.
+//
+// Same interface as CWSDRWLock, a thread releases the stripe it acquired
+// since the stripe only depends on the thread.
+//
+class STRIPED_READ_WRITE_LOCK
+{
+public:
+
+    STRIPED_READ_WRITE_LOCK()
+    {
+        for (DWORD i = 0; i < STRIPE_COUNT; i++)
+        {
+            InitializeSRWLock(&m_stripes[i].rwLock);
+        }
+    }
+
+    BOOL QueryInited()
+    {
+        return TRUE;
+    }
+
+    HRESULT Init()
+    {
+        return S_OK;
+    }
+
+    void SharedAcquire()
+    {
+        AcquireSRWLockShared(&m_stripes[GetStripeIndex()].rwLock);
+    }
+
+    void SharedRelease()
+    {
+        ReleaseSRWLockShared(&m_stripes[GetStripeIndex()].rwLock);
+    }
+
+    void ExclusiveAcquire()
+    {
+        //
+        // Always in the same order, two writers cannot deadlock.
+        //
+        for (DWORD i = 0; i < STRIPE_COUNT; i++)
+        {
+            AcquireSRWLockExclusive(&m_stripes[i].rwLock);
+        }
+    }
+
+    void ExclusiveRelease()
+    {
+        for (DWORD i = STRIPE_COUNT; i > 0; i--)
+        {
+            ReleaseSRWLockExclusive(&m_stripes[i - 1].rwLock);
+        }
+    }
+
+private:
+
+    // Power of 2
+    static constexpr DWORD STRIPE_COUNT = 16;
+
+    static DWORD GetStripeIndex()
+    {
+        //
+        // Thread ids are multiples of 4, the multiplication spreads
+        // consecutive ones over the stripes.
+        //
+        return ((GetCurrentThreadId() >> 2) * 0x9E3779B1) >> 28;
+    }
+
+    struct DECLSPEC_CACHEALIGN STRIPE
+    {
+        SRWLOCK rwLock;
+    };
+
+    STRIPE m_stripes[STRIPE_COUNT];
+};
+
 #endif
 
 //
@@ -3,6 +3,81 @@
 
 #include "precomp.h"
 
+#include <intrin.h>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#define STRA_USE_SSE2
+#endif
+
+//
+// Fast paths for the common all ASCII strings. SSE2 is part of every x64
+// and supported x86 target; ARM64 takes the scalar loops.
+//
+
+//
+// Number of leading characters of pwsz below 0x80.
+//
+static
+DWORD
+CountAsciiW(
+    __in_ecount(cch) PCWSTR pwsz,
+    DWORD                   cch
+)
+{
+    DWORD i = 0;
+
+#ifdef STRA_USE_SSE2
+    const __m128i nonAsciiMask = _mm_set1_epi16(static_cast<short>(0xFF80));
+
+    for ( ; i + 8 <= cch; i += 8)
+    {
+        const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pwsz + i));
+        const int     mask = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(chars, nonAsciiMask), _mm_setzero_si128()));
+        if (mask != 0xFFFF)
+        {
+            unsigned long index;
+            _BitScanForward(&index, ~mask & 0xFFFF);
+            return i + index / 2;
+        }
+    }
+#endif
+
+    while (i < cch && pwsz[i] < 0x80)
+    {
+        i++;
+    }
+
+    return i;
+}
+
+//
+// Copies cch ASCII characters of pwsz to pszDest, one byte each.
+//
+static
+VOID
+NarrowAsciiW(
+    __in_ecount(cch) PCWSTR     pwsz,
+    DWORD                       cch,
+    __out_ecount(cch) CHAR *    pszDest
+)
+{
+    DWORD i = 0;
+
+#ifdef STRA_USE_SSE2
+    for ( ; i + 16 <= cch; i += 16)
+    {
+        const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pwsz + i));
+        const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pwsz + i + 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pszDest + i), _mm_packus_epi16(low, high));
+    }
+#endif
+
+    for ( ; i < cch; i++)
+    {
+        pszDest[i] = static_cast<CHAR>(pwsz[i]);
+    }
+}
+
 STRA::STRA(
 ) : m_cchLen( 0 )
 {
@@ -11,13 +86,15 @@ STRA::STRA(
 
 STRA::STRA(
     __inout_ecount(cchInit) CHAR* pbInit,
-    __in DWORD cchInit
-) : m_Buff( pbInit, cchInit * sizeof( CHAR ) ),
+    __in DWORD cchInit,
+    __in_opt BUMP_ARENA* pArena
+) : m_Buff( pbInit, cchInit * sizeof( CHAR ), pArena ),
     m_cchLen(0)
 /*++
     Description:
 
-        Used by STACK_STRA. Initially populates underlying buffer with pbInit.
+        Used by STACK_STRA and ARENA_STRA. Initially populates underlying
+        buffer with pbInit, growing into pArena if given.
 
         pbInit is not freed.
 
@@ -25,6 +102,7 @@ STRA::STRA(
 
         pbInit - initial memory to use
         cchInit - count, in characters, of pbInit
+        pArena - arena to grow into, NULL to grow on the heap
 
     Returns:
 
@@ -608,6 +686,68 @@ FShouldEscapeUrl(
     return false;
 }
 
+//
+// Number of leading characters of pch, up to cch or the first NUL, that
+// pfnFShouldEscape leaves alone. The two predicates of STRA test 16
+// characters at once.
+//
+static
+DWORD
+CountUnescaped(
+    __in_ecount(cch) LPCSTR pch,
+    DWORD                   cch,
+    bool                 (* pfnFShouldEscape)(BYTE ch)
+)
+{
+    DWORD i = 0;
+
+#ifdef STRA_USE_SSE2
+    const bool fUrl = pfnFShouldEscape == FShouldEscapeUrl;
+
+    if (fUrl || pfnFShouldEscape == FShouldEscapeUtf8)
+    {
+        for ( ; i + 16 <= cch; i += 16)
+        {
+            const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pch + i));
+
+            // The high bit, and NUL to stop where the scalar loop would.
+            __m128i stop = _mm_or_si128(_mm_cmplt_epi8(chars, _mm_setzero_si128()),
+                                        _mm_cmpeq_epi8(chars, _mm_setzero_si128()));
+            if (fUrl)
+            {
+                // Controls and space but CR and LF; signed, the high bit is covered.
+                const __m128i control = _mm_andnot_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')),
+                                 _mm_cmpeq_epi8(chars, _mm_set1_epi8('\r'))),
+                    _mm_cmplt_epi8(chars, _mm_set1_epi8(33)));
+
+                stop = _mm_or_si128(stop, control);
+                stop = _mm_or_si128(stop, _mm_cmpeq_epi8(chars, _mm_set1_epi8('<')));
+                stop = _mm_or_si128(stop, _mm_cmpeq_epi8(chars, _mm_set1_epi8('>')));
+                stop = _mm_or_si128(stop, _mm_cmpeq_epi8(chars, _mm_set1_epi8('%')));
+                stop = _mm_or_si128(stop, _mm_cmpeq_epi8(chars, _mm_set1_epi8('?')));
+                stop = _mm_or_si128(stop, _mm_cmpeq_epi8(chars, _mm_set1_epi8('#')));
+            }
+
+            const int mask = _mm_movemask_epi8(stop);
+            if (mask != 0)
+            {
+                unsigned long index;
+                _BitScanForward(&index, mask);
+                return i + index;
+            }
+        }
+    }
+#endif
+
+    while (i < cch && pch[i] != '\0' && !pfnFShouldEscape(static_cast<BYTE>(pch[i])))
+    {
+        i++;
+    }
+
+    return i;
+}
+
 HRESULT
 STRA::Escape(
     VOID
@@ -676,7 +816,8 @@ Return Value:
 {
     LPCSTR  pch     = QueryStr();
     __analysis_assume( pch != NULL );
-    int     i      = 0;
+    const DWORD cch = QueryCCH();
+    DWORD   i      = 0;
     BYTE    ch;
     HRESULT hr      = S_OK;
     ULONG64  NewSize = 0;
@@ -695,6 +836,11 @@ Return Value:
 
     _ASSERTE( pch );
 
+    //
+    // Most strings have nothing to escape, they return here untouched.
+    //
+    i = CountUnescaped(pch, cch, pfnFShouldEscape);
+
     while (pch[i] != NULL)
     {
         //
@@ -786,12 +932,24 @@ Return Value:
         }
         else
         {
+            //
+            // Copy the whole run of characters that stay as they are.
+            //
+            const DWORD cchRun = 1 + CountUnescaped(pch + i + 1, cch - i - 1, pfnFShouldEscape);
+
             // if no escaping done, no need to copy
             if (fEscapingDone)
             {
-                // if ANY escaping done, copy current character into new buffer
-                straTemp.Append(&pch[i], 1);
+                // if ANY escaping done, copy the run into new buffer
+                hr = straTemp.Append(&pch[i], cchRun);
+                if (FAILED(hr))
+                {
+                    return hr;
+                }
             }
+
+            i += cchRun;
+            continue;
         }
 
         // inspect the next character in the string
@@ -1052,6 +1210,23 @@ STRA::AuxAppendW(
         goto Finished;
     }
 
+    //
+    // ASCII is the same in UTF-8, skip the conversion.
+    //
+    if ( CodePage == CP_UTF8 &&
+         CountAsciiW( pszAppendW, cchAppendW ) == cchAppendW )
+    {
+        if( !m_Buff.Resize( static_cast<SIZE_T>(cbOffset) + cchAppendW + sizeof( CHAR ) ) )
+        {
+            hr = E_OUTOFMEMORY;
+            goto Finished;
+        }
+
+        NarrowAsciiW( pszAppendW, cchAppendW, QueryStr() + cbOffset );
+        cbRet = cchAppendW;
+        goto Finished;
+    }
+
     //
     // start by assuming 1 char to 1 char will be enough space
     //
@@ -1218,6 +1393,24 @@ STRA::ConvertUnicodeToCodePage(
 
     DWORD dwFlags;
 
+    //
+    // ASCII is the same in UTF-8, skip the conversion.
+    //
+    if (uCodePage == CP_UTF8 &&
+        dwStringLen != 0 &&
+        dwStringLen < INT_MAX &&
+        CountAsciiW(pszSrcUnicodeString, dwStringLen) == dwStringLen)
+    {
+        if (!pbufDstAnsiString->Resize(dwStringLen + 1))
+        {
+            return -1;
+        }
+
+        NarrowAsciiW(pszSrcUnicodeString, dwStringLen, static_cast<CHAR*>(pbufDstAnsiString->QueryPtr()));
+        static_cast<CHAR*>(pbufDstAnsiString->QueryPtr())[dwStringLen] = '\0';
+        return static_cast<int>(dwStringLen);
+    }
+
     if (uCodePage == CP_ACP)
     {
         dwFlags = WC_NO_BEST_FIT_CHARS;
@@ -20,7 +20,8 @@ public:
 
     STRA(
         __inout_ecount(cchInit) CHAR* pbInit,
-        __in DWORD cchInit
+        __in DWORD cchInit,
+        __in_opt BUMP_ARENA* pArena = NULL
     );
 
     BOOL
@@ -504,4 +505,10 @@ CHAR* InitHelper(__out CHAR (&psz)[size])
 
 #define INLINE_STRA_INIT(name) name(InitHelper(__ach##name), sizeof(__ach##name))
 
+//
+// Like STACK_STRA, but grows into arena instead of the heap.
+//
+#define ARENA_STRA(name, size, arena)   CHAR __ach##name[size];\
+                                        STRA  name(InitHelper(__ach##name), sizeof(__ach##name), (arena))
+
 #pragma warning( pop )
@@ -16,13 +16,15 @@ STRU::STRU(
 
 STRU::STRU(
     __inout_ecount(cchInit) WCHAR* pbInit,
-    __in DWORD cchInit
-) : m_Buff( pbInit, cchInit * sizeof( WCHAR ) ),
+    __in DWORD cchInit,
+    __in_opt BUMP_ARENA* pArena
+) : m_Buff( pbInit, cchInit * sizeof( WCHAR ), pArena ),
     m_cchLen( 0 )
 /*++
     Description:
 
-        Used by STACK_STRU. Initially populates underlying buffer with pbInit.
+        Used by STACK_STRU and ARENA_STRU. Initially populates underlying
+        buffer with pbInit, growing into pArena if given.
 
         pbInit is not freed.
 
@@ -30,6 +32,7 @@ STRU::STRU(
 
         pbInit - initial memory to use
         cchInit - count, in characters, of pbInit
+        pArena - arena to grow into, NULL to grow on the heap
 
     Returns:
 
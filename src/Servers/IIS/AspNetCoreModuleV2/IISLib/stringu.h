@@ -20,7 +20,8 @@ public:
 
     STRU(
         __inout_ecount(cchInit) WCHAR* pbInit,
-        __in DWORD cchInit
+        __in DWORD cchInit,
+        __in_opt BUMP_ARENA* pArena = NULL
     );
 
     BOOL
@@ -417,6 +418,12 @@ WCHAR* InitHelper(__out WCHAR (&psz)[size])
 
 #define INLINE_STRU_INIT(name) name(InitHelper(__ach##name), sizeof(__ach##name)/sizeof(*__ach##name))
 
+//
+// Like STACK_STRU, but grows into arena instead of the heap.
+//
+#define ARENA_STRU(name, size, arena)   WCHAR __ach##name[size];\
+                                        STRU name(InitHelper(__ach##name), sizeof(__ach##name)/sizeof(*__ach##name), (arena))
+
 
 HRESULT
 MakePathCanonicalizationProof(
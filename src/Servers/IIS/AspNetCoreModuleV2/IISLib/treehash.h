@@ -10,7 +10,7 @@
 template <class _Record>
 class TREE_HASH_NODE
 {
-    template <class _Record>
+    template <class _Record, class _Lock>
     friend class TREE_HASH_TABLE;
 
  private:
@@ -30,7 +30,11 @@ class TREE_HASH_NODE
     DWORD               _dwHash;
 };
 
-template <class _Record>
+//
+// _Lock is CWSDRWLock by default, STRIPED_READ_WRITE_LOCK suits tables
+// looked up from many threads and rarely changed.
+//
+template <class _Record, class _Lock = CWSDRWLock>
 class TREE_HASH_TABLE
 {
 protected:
@@ -97,7 +101,7 @@ public:
         PCWSTR      pszKey
     )
     {
-        return _fCaseSensitive ? HashString(pszKey) : HashStringNoCase(pszKey);
+        return _fCaseSensitive ? HashStringFast(pszKey) : HashStringNoCaseFast(pszKey);
     }
 
     virtual
@@ -191,12 +195,12 @@ private:
     DWORD                       _nBuckets;
     DWORD                       _nItems;
     BOOL                        _fCaseSensitive;
-    CWSDRWLock                  _tableLock;
+    _Lock                       _tableLock;
 };
 
-template <class _Record>
+template <class _Record, class _Lock>
 HRESULT
-TREE_HASH_TABLE<_Record>::AllocateNode(
+TREE_HASH_TABLE<_Record,_Lock>::AllocateNode(
     PCWSTR                      pszPath,
     DWORD                       dwHash,
     _Record *                   pRecord,
@@ -232,9 +236,9 @@ TREE_HASH_TABLE<_Record>::AllocateNode(
     return S_OK;
 }
 
-template <class _Record>
+template <class _Record, class _Lock>
 HRESULT
-TREE_HASH_TABLE<_Record>::Initialize(
+TREE_HASH_TABLE<_Record,_Lock>::Initialize(
     DWORD   nBuckets
 )
 {
@@ -285,8 +289,8 @@ Failed:
 }
 
 
-template <class _Record>
-TREE_HASH_TABLE<_Record>::~TREE_HASH_TABLE()
+template <class _Record, class _Lock>
+TREE_HASH_TABLE<_Record,_Lock>::~TREE_HASH_TABLE()
 {
     if (_ppBuckets == NULL)
     {
@@ -302,9 +306,9 @@ TREE_HASH_TABLE<_Record>::~TREE_HASH_TABLE()
     _nBuckets = 0;
 }
 
-template <class _Record>
+template <class _Record, class _Lock>
 VOID
-TREE_HASH_TABLE<_Record>::Clear()
+TREE_HASH_TABLE<_Record,_Lock>::Clear()
 {
     TREE_HASH_NODE<_Record> *pCurrent;
     TREE_HASH_NODE<_Record> *pNext;
@@ -327,9 +331,9 @@ TREE_HASH_TABLE<_Record>::Clear()
     _tableLock.ExclusiveRelease();
 }
 
-template <class _Record>
+template <class _Record, class _Lock>
 BOOL
-TREE_HASH_TABLE<_Record>::FindNodeInternal(
+TREE_HASH_TABLE<_Record,_Lock>::FindNodeInternal(
     PCWSTR                  pszKey,
     DWORD                   dwHash,
     TREE_HASH_NODE<_Record> **   ppNode,
@@ -382,9 +386,9 @@ TREE_HASH_TABLE<_Record>::FindNodeInternal(
     return fFound;
 }
 
-template <class _Record>
+template <class _Record, class _Lock>
 VOID
-TREE_HASH_TABLE<_Record>::FindKey(
+TREE_HASH_TABLE<_Record,_Lock>::FindKey(
     PCWSTR              pszKey,
     _Record **          ppRecord
 )
@@ -407,9 +411,9 @@ TREE_HASH_TABLE<_Record>::FindKey(
     _tableLock.SharedRelease();
 }
 
-template <class _Record>
+template <class _Record, class _Lock>
 HRESULT
-TREE_HASH_TABLE<_Record>::AddNodeInternal(
+TREE_HASH_TABLE<_Record,_Lock>::AddNodeInternal(
     PCWSTR                      pszPath,
     DWORD                       dwHash,
     _Record *                   pRecord,
@@ -512,9 +516,9 @@ TREE_HASH_TABLE<_Record>::AddNodeInternal(
     return S_OK;
 }
 
-template <class _Record>
+template <class _Record, class _Lock>
 HRESULT
-TREE_HASH_TABLE<_Record>::InsertRecord(
+TREE_HASH_TABLE<_Record,_Lock>::InsertRecord(
     _Record *           pRecord
 )
 /*++
@@ -601,9 +605,9 @@ Finished:
     return hr;
 }
 
-template <class _Record>
+template <class _Record, class _Lock>
 VOID
-TREE_HASH_TABLE<_Record>::DeleteNodeInternal(
+TREE_HASH_TABLE<_Record,_Lock>::DeleteNodeInternal(
     TREE_HASH_NODE<_Record> **  ppNextPointer,
     TREE_HASH_NODE<_Record> *   pNode
 )
@@ -657,9 +661,9 @@ TREE_HASH_TABLE<_Record>::DeleteNodeInternal(
     _nItems--;
 }
 
-template <class _Record>
+template <class _Record, class _Lock>
 VOID
-TREE_HASH_TABLE<_Record>::DeleteKey(
+TREE_HASH_TABLE<_Record,_Lock>::DeleteKey(
     PCWSTR      pszKey
 )
 {
@@ -678,9 +682,9 @@ TREE_HASH_TABLE<_Record>::DeleteKey(
     _tableLock.ExclusiveRelease();
 }
 
-template <class _Record>
+template <class _Record, class _Lock>
 VOID
-TREE_HASH_TABLE<_Record>::DeleteIf(
+TREE_HASH_TABLE<_Record,_Lock>::DeleteIf(
     PFN_DELETE_IF               pfnDeleteIf,
     PVOID                       pvContext
 )
@@ -738,9 +742,9 @@ TREE_HASH_TABLE<_Record>::DeleteIf(
     _tableLock.ExclusiveRelease();
 }
 
-template <class _Record>
+template <class _Record, class _Lock>
 VOID
-TREE_HASH_TABLE<_Record>::Apply(
+TREE_HASH_TABLE<_Record,_Lock>::Apply(
     PFN_APPLY                   pfnApply,
     PVOID                       pvContext
 )
@@ -766,9 +770,9 @@ TREE_HASH_TABLE<_Record>::Apply(
     _tableLock.SharedRelease();
 }
 
-template <class _Record>
+template <class _Record, class _Lock>
 VOID
-TREE_HASH_TABLE<_Record>::RehashTableIfNeeded(
+TREE_HASH_TABLE<_Record,_Lock>::RehashTableIfNeeded(
     VOID
 )
 {
@@ -46,6 +46,11 @@ InProcessOptions::InProcessOptions(const ConfigurationSource &configurationSourc
     m_fBasicAuthEnabled(false),
     m_fAnonymousAuthEnabled(false),
     m_dwMaxRequestBodySize(INFINITE),
+    m_dwMaxConcurrentRequests(0),
+    m_dwRequestQueueLimit(0),
+    m_dwShadowCopyQuietPeriodInMS(5000),
+    m_dwShadowCopyMaxDelayInMS(60000),
+    m_dwShadowCopyRetainedDirectories(0),
     m_dwStartupTimeLimitInMS(INFINITE),
     m_dwShutdownTimeLimitInMS(INFINITE)
 {
@@ -67,6 +72,38 @@ InProcessOptions::InProcessOptions(const ConfigurationSource &configurationSourc
     m_fCallStartupHook = equals_ignore_case(find_element(handlerSettings, CS_ASPNETCORE_HANDLER_CALL_STARTUP_HOOK).value_or(L"true"), L"true");
     m_strStackSize = find_element(handlerSettings, CS_ASPNETCORE_HANDLER_STACK_SIZE).value_or(L"1048576");
     m_fSuppressRecycleOnStartupTimeout = equals_ignore_case(find_element(handlerSettings, CS_ASPNETCORE_SUPPRESS_RECYCLE_ON_STARTUP_TIMEOUT).value_or(L"false"), L"true");
+    m_stdoutLogRolling.maxFileSizeBytes = _wcstoui64(find_element(handlerSettings, CS_ASPNETCORE_STDOUT_LOG_MAX_FILE_SIZE).value_or(L"0").c_str(), nullptr, 10);
+    m_stdoutLogRolling.rollIntervalMs = _wtoi(find_element(handlerSettings, CS_ASPNETCORE_STDOUT_LOG_ROLL_INTERVAL).value_or(L"0").c_str()) * 1000;
+    m_stdoutLogRolling.retainedFiles = _wtoi(find_element(handlerSettings, CS_ASPNETCORE_STDOUT_LOG_RETAINED_FILES).value_or(L"0").c_str());
+    m_stdoutLogRolling.preallocate = equals_ignore_case(find_element(handlerSettings, CS_ASPNETCORE_STDOUT_LOG_PREALLOCATE).value_or(L"false"), L"true");
+    m_stdoutLogRolling.compress = equals_ignore_case(find_element(handlerSettings, CS_ASPNETCORE_STDOUT_LOG_COMPRESS).value_or(L"false"), L"true");
+    m_stdoutLogRolling.maxTotalBytes = _wcstoui64(find_element(handlerSettings, CS_ASPNETCORE_STDOUT_LOG_MAX_TOTAL_SIZE).value_or(L"0").c_str(), nullptr, 10);
+
+    // Semicolon separated, e.g. "/;/api/health"
+    const auto warmupPaths = find_element(handlerSettings, CS_ASPNETCORE_HANDLER_WARMUP_PATHS).value_or(L"");
+    size_t pathStart = 0;
+    while (pathStart < warmupPaths.length())
+    {
+        auto pathEnd = warmupPaths.find(L';', pathStart);
+        if (pathEnd == std::wstring::npos)
+        {
+            pathEnd = warmupPaths.length();
+        }
+
+        if (pathEnd > pathStart)
+        {
+            m_warmupPaths.push_back(warmupPaths.substr(pathStart, pathEnd - pathStart));
+        }
+
+        pathStart = pathEnd + 1;
+    }
+
+    m_dwMaxConcurrentRequests = _wtoi(find_element(handlerSettings, CS_ASPNETCORE_HANDLER_MAX_CONCURRENT_REQUESTS).value_or(L"0").c_str());
+    m_dwRequestQueueLimit = _wtoi(find_element(handlerSettings, CS_ASPNETCORE_HANDLER_REQUEST_QUEUE_LIMIT).value_or(L"0").c_str());
+    m_priorityPaths = PriorityPaths(find_element(handlerSettings, CS_ASPNETCORE_HANDLER_PRIORITY_PATHS).value_or(L""));
+    m_dwShadowCopyQuietPeriodInMS = _wtoi(find_element(handlerSettings, CS_ASPNETCORE_HANDLER_SHADOW_COPY_QUIET_PERIOD).value_or(L"5000").c_str());
+    m_dwShadowCopyMaxDelayInMS = _wtoi(find_element(handlerSettings, CS_ASPNETCORE_HANDLER_SHADOW_COPY_MAX_DELAY).value_or(L"60000").c_str());
+    m_dwShadowCopyRetainedDirectories = _wtoi(find_element(handlerSettings, CS_ASPNETCORE_HANDLER_SHADOW_COPY_RETAINED_DIRECTORIES).value_or(L"0").c_str());
 
     m_dwStartupTimeLimitInMS = aspNetCoreSection->GetRequiredLong(CS_ASPNETCORE_PROCESS_STARTUP_TIME_LIMIT) * 1000;
     m_dwShutdownTimeLimitInMS = aspNetCoreSection->GetRequiredLong(CS_ASPNETCORE_PROCESS_SHUTDOWN_TIME_LIMIT) * 1000;
@@ -7,6 +7,8 @@
 #include "BindingInformation.h"
 #include "ConfigurationSource.h"
 #include "WebConfigConfigurationSource.h"
+#include "RedirectionOutput.h"
+#include "PriorityPaths.h"
 #include <map>
 
 class InProcessOptions: NonCopyable
@@ -36,6 +38,12 @@ public:
         return m_struStdoutLogFile;
     }
 
+    const FileRollingOptions&
+    QueryStdoutLogRolling() const
+    {
+        return m_stdoutLogRolling;
+    }
+
     bool
     QueryDisableStartUpErrorPage() const
     {
@@ -124,6 +132,58 @@ public:
         return m_fSuppressRecycleOnStartupTimeout;
     }
 
+    // Paths relative to the application that are requested once it started,
+    // before any other request is let through.
+    const std::vector<std::wstring>&
+    QueryWarmupPaths() const
+    {
+        return m_warmupPaths;
+    }
+
+    // Requests let into managed at the same time, 0 if not limited.
+    DWORD
+    QueryMaxConcurrentRequests() const
+    {
+        return m_dwMaxConcurrentRequests;
+    }
+
+    // Requests held back natively while the concurrent requests are at the
+    // limit, the ones beyond are rejected with a 503.
+    DWORD
+    QueryRequestQueueLimit() const
+    {
+        return m_dwRequestQueueLimit;
+    }
+
+    // Requests let into managed regardless of maxConcurrentRequests.
+    const PriorityPaths&
+    QueryPriorityPaths() const
+    {
+        return m_priorityPaths;
+    }
+
+    // How long dll changes have to stop before the shadow copy is made
+    DWORD
+    QueryShadowCopyQuietPeriodInMS() const
+    {
+        return m_dwShadowCopyQuietPeriodInMS;
+    }
+
+    // Longest a shadow copy is held back by changes that keep coming
+    DWORD
+    QueryShadowCopyMaxDelayInMS() const
+    {
+        return m_dwShadowCopyMaxDelayInMS;
+    }
+
+    // Previous shadow copy directories kept besides the one in use, the
+    // most recent ones, to roll back to quickly
+    DWORD
+    QueryShadowCopyRetainedDirectories() const
+    {
+        return m_dwShadowCopyRetainedDirectories;
+    }
+
     InProcessOptions(const ConfigurationSource &configurationSource, IHttpSite* pSite);
 
     static
@@ -138,6 +198,7 @@ private:
     std::wstring                   m_strProcessPath;
     std::wstring                   m_struStdoutLogFile;
     std::wstring                   m_strStackSize;
+    FileRollingOptions             m_stdoutLogRolling;
     bool                           m_fStdoutLogEnabled;
     bool                           m_fDisableStartUpErrorPage;
     bool                           m_fSetCurrentDirectory;
@@ -149,8 +210,15 @@ private:
     DWORD                          m_dwStartupTimeLimitInMS;
     DWORD                          m_dwShutdownTimeLimitInMS;
     DWORD                          m_dwMaxRequestBodySize;
+    DWORD                          m_dwMaxConcurrentRequests;
+    DWORD                          m_dwRequestQueueLimit;
+    DWORD                          m_dwShadowCopyQuietPeriodInMS;
+    DWORD                          m_dwShadowCopyMaxDelayInMS;
+    DWORD                          m_dwShadowCopyRetainedDirectories;
     std::map<std::wstring, std::wstring, ignore_case_comparer> m_environmentVariables;
     std::vector<BindingInformation> m_bindingInformation;
+    std::vector<std::wstring>      m_warmupPaths;
+    PriorityPaths                  m_priorityPaths;
 
 protected:
     InProcessOptions() = default;
@@ -19,12 +19,8 @@ public:
         USHORT statusCode,
         USHORT subStatusCode,
         const std::string& statusText)
-        : m_disableLogs(disableLogs),
-        m_HR(hr),
-        m_error(errorPageContent),
-        m_statusCode(statusCode),
-        m_subStatusCode(subStatusCode),
-        m_statusText(std::move(statusText)),
+        : m_HR(hr),
+        m_page(std::make_shared<const ServerErrorPage>(ServerErrorPage{ statusCode, subStatusCode, statusText, disableLogs != FALSE, errorPageContent })),
         InProcessApplicationBase(pServer, pApplication)
     {
     }
@@ -33,17 +29,13 @@ public:
 
     HRESULT CreateHandler(IHttpContext* pHttpContext, IREQUEST_HANDLER** pRequestHandler)
     {
-        *pRequestHandler = new ServerErrorHandler(*pHttpContext, m_statusCode, m_subStatusCode, m_statusText, m_HR, m_disableLogs, m_error);
+        *pRequestHandler = new ServerErrorHandler(*pHttpContext, m_page, m_HR);
 
         return S_OK;
     }
 
 private:
-    std::string m_error;
-    BOOL m_disableLogs;
     HRESULT m_HR;
-    USHORT m_statusCode;
-    USHORT m_subStatusCode;
-    std::string m_statusText;
+    std::shared_ptr<const ServerErrorPage> m_page;
 };
 
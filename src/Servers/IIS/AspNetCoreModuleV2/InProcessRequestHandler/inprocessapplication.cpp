@@ -13,8 +13,17 @@
 #include "ModuleHelpers.h"
 #include "Environment.h"
 #include "HostFxr.h"
+#include <algorithm>
 
 IN_PROCESS_APPLICATION* IN_PROCESS_APPLICATION::s_Application = NULL;
+IN_PROCESS_NATIVE_COUNTERS IN_PROCESS_APPLICATION::sm_nativeCounters = {};
+
+struct WinHttpHandleTraits
+{
+    using HandleType = HINTERNET;
+    static constexpr HINTERNET DefaultHandle = nullptr;
+    static void Close(HINTERNET handle) noexcept { WinHttpCloseHandle(handle); }
+};
 
 IN_PROCESS_APPLICATION::IN_PROCESS_APPLICATION(
     IHttpServer& pHttpServer,
@@ -24,14 +33,45 @@ IN_PROCESS_APPLICATION::IN_PROCESS_APPLICATION(
     DWORD                  nParameters) :
     InProcessApplicationBase(pHttpServer,
         pApplication),
+    m_handlerContext(),
+    m_RequestInfoHandler(nullptr),
     m_Initialized(false),
     m_blockManagedCallbacks(true),
     m_waitForShutdown(true),
     m_pConfig(std::move(pConfig)),
-    m_requestCount(0)
+    m_pRequestCounts(nullptr),
+    m_cAdmittedRequests(0),
+    m_fAdmissionClosed(false),
+    m_fDraining(false),
+    m_pCompletionCounts(nullptr),
+    m_fRequestsReferenced(false),
+    m_fWarmingUp(false),
+    m_hWarmupRequest(nullptr),
+    m_fWarmupCancelled(false),
+    m_fNativeCountersEnabled(false),
+    m_llCounterFrequency(0),
+    m_nativeCountersTimer(NativeCountersTimerCallback, this)
 {
     DBG_ASSERT(m_pConfig);
 
+    InitializeSRWLock(&m_srwWarmupLock);
+    InitializeSRWLock(&m_srwAdmissionLock);
+    InitializeSRWLock(&m_srwNativeCountersLock);
+
+    THROW_IF_FAILED(PER_CPU<LONG>::Create([](LONG* pCount) { *pCount = 0; }, &m_pRequestCounts));
+    THROW_IF_FAILED(PER_CPU<LONG>::Create([](LONG* pCount) { *pCount = 0; }, &m_pCompletionCounts));
+
+    // Requests are still served, just not counted, without the counters.
+    LOG_IF_FAILED(m_counters.Initialize());
+    LOG_IF_FAILED(m_countersPublisher.Start(QueryApplicationId(),
+        [this](APPLICATION_COUNTERS::SNAPSHOT* pSnapshot) { m_counters.AddToSnapshot(pSnapshot); }));
+
+    m_serverAddresses = BindingInformation::Format(m_pConfig->QueryBindings(), QueryApplicationVirtualPath());
+
+    m_startupTimeline.Mark(StartupTimeline::ApplicationCreated);
+    // Older shims don't pass their phases.
+    m_startupTimeline.Merge(FindParameter<const StartupTimeline*>(s_startupTimelineParameterName, pParameters, nParameters));
+
     const auto knownLocation = FindParameter<PCWSTR>(s_exeLocationParameterName, pParameters, nParameters);
     if (knownLocation != nullptr)
     {
@@ -45,23 +85,55 @@ IN_PROCESS_APPLICATION::IN_PROCESS_APPLICATION(
     }
 
     m_shutdownTimeout = m_pConfig.get()->QueryShutdownTimeLimitInMS();
+    m_shadowCopyQuietPeriod = m_pConfig.get()->QueryShadowCopyQuietPeriodInMS();
+    m_shadowCopyMaxDelay = m_pConfig.get()->QueryShadowCopyMaxDelayInMS();
 
     m_stringRedirectionOutput = std::make_shared<StringStreamRedirectionOutput>();
+    m_counters.MemoryCharged(APPLICATION_COUNTERS::MEMORY_TAG_STDOUT_CAPTURE, StringStreamRedirectionOutput::GetBufferSize());
 }
 
 IN_PROCESS_APPLICATION::~IN_PROCESS_APPLICATION()
 {
     s_Application = nullptr;
+
+    m_countersPublisher.Stop();
+    m_nativeCountersTimer.Cancel();
+
+    if (m_pRequestCounts != nullptr)
+    {
+        m_pRequestCounts->Dispose();
+        m_pRequestCounts = nullptr;
+    }
+
+    if (m_pCompletionCounts != nullptr)
+    {
+        m_pCompletionCounts->Dispose();
+        m_pCompletionCounts = nullptr;
+    }
 }
 
 VOID
 IN_PROCESS_APPLICATION::StopInternal(bool fServerInitiated)
 {
+    // From now on the request that completes last signals the drain.
+    m_fDraining = true;
+
+    // Requests waiting for admission are turned away, they would only
+    // get into managed while it shuts down.
+    CloseAdmissionQueue();
+
     // Stop app offline tracking before shutting down CLR.
     // This is to help with shadow copy scenario where the app is shutting down.
     AppOfflineTrackingApplication::StopInternal(fServerInitiated);
     StopClr();
     InProcessApplicationBase::StopInternal(fServerInitiated);
+
+    // Requests that are still in flight drop the reference once the last
+    // of them completed. The caller holds one of its own.
+    if (QueryRequestCount() == 0 && m_fRequestsReferenced.exchange(false))
+    {
+        ReleaseRequestsReference();
+    }
 }
 
 VOID
@@ -94,11 +166,7 @@ IN_PROCESS_APPLICATION::StopClr()
             shutdownHandler(m_ShutdownHandlerContext);
         }
 
-        SRWSharedLock dataLock(m_dataLock);
-
-        auto requestCount = m_requestCount.load();
-
-        if (requestCount == 0)
+        if (QueryRequestCount() == 0)
         {
             CallRequestsDrained();
         }
@@ -115,6 +183,8 @@ IN_PROCESS_APPLICATION::StopClr()
         m_folderCleanupThread.join();
     }
 
+    CancelWarmup();
+
     s_Application = nullptr;
 }
 
@@ -131,17 +201,20 @@ IN_PROCESS_APPLICATION::SetCallbackHandles(
 {
     LOG_INFO(L"In-process callbacks set");
 
-    m_RequestHandler = request_handler;
-    m_RequestHandlerContext = pvRequstHandlerContext;
-    m_DisconnectHandler = disconnect_callback;
+    m_handlerContext.pRequestHandler = request_handler;
+    m_handlerContext.pRequestHandlerContext = pvRequstHandlerContext;
+    m_handlerContext.pDisconnectHandler = disconnect_callback;
+    m_handlerContext.pAsyncCompletionHandler = async_completion_handler;
     m_ShutdownHandler = shutdown_handler;
     m_ShutdownHandlerContext = pvShutdownHandlerContext;
-    m_AsyncCompletionHandler = async_completion_handler;
     m_RequestsDrainedHandler = requestsDrainedHandler;
 
     m_blockManagedCallbacks = false;
     m_Initialized = true;
 
+    m_startupTimeline.Mark(StartupTimeline::CallbacksRegistered);
+    m_startupTimeline.Write(QueryApplicationId().c_str());
+
     // Can't check the std err handle as it isn't a critical error
     // Initialization complete
     EventLog::Info(
@@ -179,25 +252,10 @@ IN_PROCESS_APPLICATION::LoadManagedApplication(ErrorContext& errorContext)
             throw InvalidOperationException(L"File changed between copy and start of application, restarting.");
         }
         // Cleanup other directories that haven't been removed.
-        m_folderCleanupThread = std::thread([](std::wstring shadowCopyDir)
-            {
-                auto parentDir = std::filesystem::path(shadowCopyDir).parent_path();
-                for (auto& p : std::filesystem::directory_iterator(parentDir))
-                {
-                    if (p.path() != shadowCopyDir)
-                    {
-                        try
-                        {
-                            std::filesystem::remove_all(p.path());
-                        }
-                        catch (...)
-                        {
-                            OBSERVE_CAUGHT_EXCEPTION();
-                        }
-                    }
-                }
-
-            }, m_shadowCopyDirectory);
+        m_folderCleanupThread = std::thread(CleanupShadowCopyDirectories,
+            m_shadowCopyDirectory,
+            m_pConfig->QueryShadowCopyRetainedDirectories(),
+            static_cast<HANDLE>(m_pShutdownEvent));
     }
 
     m_workerThread = std::thread([](std::unique_ptr<IN_PROCESS_APPLICATION, IAPPLICATION_DELETER> application)
@@ -242,9 +300,200 @@ IN_PROCESS_APPLICATION::LoadManagedApplication(ErrorContext& errorContext)
         throw InvalidOperationException(format(L"CLR worker thread exited prematurely"));
     }
 
+    if (!m_pConfig->QueryWarmupPaths().empty())
+    {
+        StartWarmup();
+    }
+
     return S_OK;
 }
 
+void
+IN_PROCESS_APPLICATION::StartWarmup()
+{
+    GUID token;
+    WCHAR szToken[40];
+
+    THROW_IF_FAILED(CoCreateGuid(&token));
+    THROW_LAST_ERROR_IF(StringFromGUID2(token, szToken, _countof(szToken)) == 0);
+    m_strWarmupToken = to_multi_byte_string(szToken, CP_UTF8);
+
+    THROW_LAST_ERROR_IF_NULL(m_pWarmupCompleteEvent = CreateEvent(
+        nullptr,  // default security attributes
+        TRUE,     // manual reset event
+        FALSE,    // not set
+        nullptr)); // name
+
+    m_fWarmingUp = true;
+
+    // The warmup requests go through IIS like any other request, they can
+    // only be sent once the application was created and this returned.
+    m_warmupThread = std::thread([](std::unique_ptr<IN_PROCESS_APPLICATION, IAPPLICATION_DELETER> application)
+        {
+            application->SendWarmupRequests();
+
+            application->m_fWarmingUp = false;
+            SetEvent(application->m_pWarmupCompleteEvent);
+        }, ::ReferenceApplication(this));
+}
+
+void
+IN_PROCESS_APPLICATION::SendWarmupRequests()
+{
+    // Loopback to the site, http preferred over https
+    std::optional<BindingInformation> binding;
+    for (auto item : m_pConfig->QueryBindings())
+    {
+        if (!equals_ignore_case(item.QueryProtocol(), CS_SITE_BINDING_PROTOCOL_HTTPS))
+        {
+            binding = item;
+            break;
+        }
+
+        if (!binding.has_value())
+        {
+            binding = item;
+        }
+    }
+
+    if (!binding.has_value())
+    {
+        LOG_WARN(L"No site binding to send the warmup requests to");
+        return;
+    }
+
+    const bool fSecure = equals_ignore_case(binding->QueryProtocol(), CS_SITE_BINDING_PROTOCOL_HTTPS);
+    const auto port = static_cast<INTERNET_PORT>(_wtoi(binding->QueryPort().c_str()));
+
+    std::wstring headers = L"MS-ASPNETCORE-WARMUP: " + to_wide_string(m_strWarmupToken, CP_UTF8) + L"\r\n";
+    if (binding->QueryHost() != CS_SITE_BINDING_INFORMATION_ALL_HOSTS)
+    {
+        headers += L"Host: " + binding->QueryHost() + L"\r\n";
+    }
+
+    std::wstring virtualPath = QueryApplicationVirtualPath();
+    if (!virtualPath.empty() && virtualPath.back() == L'/')
+    {
+        virtualPath.pop_back();
+    }
+
+    HandleWrapper<WinHttpHandleTraits> hSession(WinHttpOpen(L"ASP.NET Core Module warmup",
+        WINHTTP_ACCESS_TYPE_NO_PROXY,
+        WINHTTP_NO_PROXY_NAME,
+        WINHTTP_NO_PROXY_BYPASS,
+        0));
+    if (hSession == nullptr)
+    {
+        LOG_LAST_ERROR();
+        return;
+    }
+
+    const DWORD dwStartupTimeLimitInMS = m_pConfig->QueryStartupTimeLimitInMS();
+    const int timeout = dwStartupTimeLimitInMS > INT_MAX ? -1 : static_cast<int>(dwStartupTimeLimitInMS);
+    LOG_LAST_ERROR_IF(!WinHttpSetTimeouts(hSession, timeout, timeout, timeout, timeout));
+
+    HandleWrapper<WinHttpHandleTraits> hConnect(WinHttpConnect(hSession, L"localhost", port, 0));
+    if (hConnect == nullptr)
+    {
+        LOG_LAST_ERROR();
+        return;
+    }
+
+    for (const auto& path : m_pConfig->QueryWarmupPaths())
+    {
+        const std::wstring url = virtualPath + (path.front() == L'/' ? L"" : L"/") + path;
+
+        {
+            SRWExclusiveLock lock(m_srwWarmupLock);
+            if (m_fWarmupCancelled)
+            {
+                return;
+            }
+
+            m_hWarmupRequest = WinHttpOpenRequest(hConnect,
+                L"GET",
+                url.c_str(),
+                nullptr,
+                WINHTTP_NO_REFERER,
+                WINHTTP_DEFAULT_ACCEPT_TYPES,
+                fSecure ? WINHTTP_FLAG_SECURE : 0);
+            if (m_hWarmupRequest == nullptr)
+            {
+                LOG_LAST_ERROR();
+                return;
+            }
+        }
+
+        // CancelWarmup closing the handle cancels these
+        const HINTERNET hRequest = m_hWarmupRequest;
+        DWORD dwStatusCode = 0;
+        DWORD cbStatusCode = sizeof(dwStatusCode);
+        // The certificate is the one of the site's host name, not of localhost
+        DWORD dwSecurityFlags = SECURITY_FLAG_IGNORE_UNKNOWN_CA |
+            SECURITY_FLAG_IGNORE_CERT_CN_INVALID |
+            SECURITY_FLAG_IGNORE_CERT_DATE_INVALID;
+
+        if ((!fSecure || WinHttpSetOption(hRequest, WINHTTP_OPTION_SECURITY_FLAGS, &dwSecurityFlags, sizeof(dwSecurityFlags))) &&
+            WinHttpSendRequest(hRequest, headers.c_str(), static_cast<DWORD>(headers.length()), WINHTTP_NO_REQUEST_DATA, 0, 0, 0) &&
+            WinHttpReceiveResponse(hRequest, nullptr) &&
+            WinHttpQueryHeaders(hRequest, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER, WINHTTP_HEADER_NAME_BY_INDEX, &dwStatusCode, &cbStatusCode, WINHTTP_NO_HEADER_INDEX))
+        {
+            LOG_INFOF(L"Warmup request to '%ls' completed with status code %d", url.c_str(), dwStatusCode);
+        }
+        else
+        {
+            LOG_WARNF(L"Warmup request to '%ls' failed with error %d", url.c_str(), GetLastError());
+        }
+
+        SRWExclusiveLock lock(m_srwWarmupLock);
+        if (m_hWarmupRequest != nullptr)
+        {
+            WinHttpCloseHandle(m_hWarmupRequest);
+            m_hWarmupRequest = nullptr;
+        }
+    }
+}
+
+void
+IN_PROCESS_APPLICATION::CancelWarmup()
+{
+    {
+        SRWExclusiveLock lock(m_srwWarmupLock);
+        m_fWarmupCancelled = true;
+
+        // The request would only complete once stopping finished
+        if (m_hWarmupRequest != nullptr)
+        {
+            WinHttpCloseHandle(m_hWarmupRequest);
+            m_hWarmupRequest = nullptr;
+        }
+    }
+
+    if (m_warmupThread.joinable())
+    {
+        m_warmupThread.join();
+    }
+}
+
+void
+IN_PROCESS_APPLICATION::WaitForWarmup(IHttpContext& pHttpContext)
+{
+    if (!m_fWarmingUp)
+    {
+        return;
+    }
+
+    USHORT cchToken = 0;
+    PCSTR pszToken = pHttpContext.GetRequest()->GetHeader("MS-ASPNETCORE-WARMUP", &cchToken);
+    if (pszToken != nullptr && m_strWarmupToken.compare(0, std::string::npos, pszToken, cchToken) == 0)
+    {
+        return;
+    }
+
+    LOG_TRACE(L"Waiting for warmup to complete");
+    WaitForSingleObject(m_pWarmupCompleteEvent, m_pConfig->QueryStartupTimeLimitInMS());
+}
+
 void
 IN_PROCESS_APPLICATION::ExecuteApplication()
 {
@@ -256,6 +505,8 @@ IN_PROCESS_APPLICATION::ExecuteApplication()
 
         ErrorContext errorContext; // unused
 
+        m_startupTimeline.Mark(StartupTimeline::ExecuteApplicationStarted);
+
         if (s_fMainCallback == nullptr)
         {
             THROW_IF_FAILED(HostFxrResolutionResult::Create(
@@ -267,9 +518,13 @@ IN_PROCESS_APPLICATION::ExecuteApplication()
                 hostFxrResolutionResult
             ));
 
+            m_startupTimeline.Mark(StartupTimeline::HostFxrResolved);
+
             hostFxrResolutionResult->GetArguments(context->m_argc, context->m_argv);
             THROW_IF_FAILED(SetEnvironmentVariablesOnWorkerProcess());
             context->m_hostFxr.Load(hostFxrResolutionResult->GetHostFxrLocation());
+
+            m_startupTimeline.Mark(StartupTimeline::HostFxrLoaded);
         }
         else
         {
@@ -307,7 +562,8 @@ IN_PROCESS_APPLICATION::ExecuteApplication()
             m_pConfig->QueryStdoutLogEnabled(),
             m_pConfig->QueryStdoutLogFile(),
             QueryApplicationPhysicalPath(),
-            m_stringRedirectionOutput
+            m_stringRedirectionOutput,
+            m_pConfig->QueryStdoutLogRolling()
         );
 
         StandardStreamRedirection redirection(*redirectionOutput.get(), m_pHttpServer.IsCommandLineLaunch());
@@ -325,6 +581,8 @@ IN_PROCESS_APPLICATION::ExecuteApplication()
             throw InvalidOperationException(format(L"Error occurred when initializing in-process application, Return code: 0x%x, Error logs: %ls", startupReturnCode, content.c_str()));
         }
 
+        m_startupTimeline.Mark(StartupTimeline::HostFxrInitialized);
+
         if (m_pConfig->QueryCallStartupHook())
         {
             PWSTR startupHookValue = NULL;
@@ -354,6 +612,7 @@ IN_PROCESS_APPLICATION::ExecuteApplication()
         bool clrThreadExited;
         {
             //Start CLR thread
+            m_startupTimeline.Mark(StartupTimeline::ClrThreadStarted);
             m_clrThread = std::thread(ClrThreadEntryPoint, context);
 
             // Wait for thread exit or shutdown event
@@ -633,13 +892,21 @@ IN_PROCESS_APPLICATION::CreateHandler(
 {
     try
     {
-        SRWSharedLock dataLock(m_dataLock);
+        // TryCreateHandler holds the stop lock, no stop is in progress.
         DBG_ASSERT(!m_fStopCalled);
-        m_requestCount++;
+        InterlockedIncrement(m_pRequestCounts->GetLocal());
+        m_counters.RequestStarted();
+        m_counters.MemoryCharged(APPLICATION_COUNTERS::MEMORY_TAG_HANDLERS, sizeof(IN_PROCESS_HANDLER));
+
+        // Only the first request takes the reference, later ones only read it.
+        if (!m_fRequestsReferenced && !m_fRequestsReferenced.exchange(true))
+        {
+            ReferenceApplication();
+        }
 
-        LOG_TRACEF(L"Adding request. Total Request Count %d", m_requestCount.load());
+        LOG_TRACE(L"Adding request.");
 
-        *pRequestHandler = new IN_PROCESS_HANDLER(::ReferenceApplication(this), pHttpContext, m_RequestHandler, m_RequestHandlerContext, m_DisconnectHandler, m_AsyncCompletionHandler);
+        *pRequestHandler = new IN_PROCESS_HANDLER(this, pHttpContext, &m_handlerContext);
     }
     CATCH_RETURN();
 
@@ -649,15 +916,327 @@ IN_PROCESS_APPLICATION::CreateHandler(
 void
 IN_PROCESS_APPLICATION::HandleRequestCompletion()
 {
-    SRWSharedLock dataLock(m_dataLock);
+    // Once the request is no longer counted nothing keeps the application
+    // alive for it, entering a completion block first keeps the reference
+    // held until this completion left.
+    LONG* pCompletionCount = m_pCompletionCounts->GetLocal();
+    InterlockedIncrement(pCompletionCount);
+
+    // The block of another CPU may go negative, only the sum is meaningful.
+    // The interlocked decrement orders it before the read of m_fDraining, and
+    // StopInternal sets m_fDraining before StopClr sums up the counts, so
+    // that at least one of them sees the last request complete.
+    m_counters.MemoryReleased(APPLICATION_COUNTERS::MEMORY_TAG_HANDLERS, sizeof(IN_PROCESS_HANDLER));
+    m_counters.RequestCompleted();
+    InterlockedDecrement(m_pRequestCounts->GetLocal());
+
+    LOG_TRACE(L"Removing request.");
+
+    bool fReleaseReference = false;
+    if (m_fDraining && QueryRequestCount() == 0)
+    {
+        if (!m_blockManagedCallbacks)
+        {
+            CallRequestsDrained();
+        }
+
+        fReleaseReference = m_fRequestsReferenced.exchange(false);
+    }
+
+    // Not touched after leaving unless it is this completion that holds
+    // the reference now.
+    InterlockedDecrement(pCompletionCount);
+
+    if (fReleaseReference)
+    {
+        ReleaseRequestsReference();
+    }
+}
+
+IN_PROCESS_APPLICATION::ADMISSION_RESULT
+IN_PROCESS_APPLICATION::AdmitRequest(IN_PROCESS_HANDLER* pHandler)
+{
+    SRWExclusiveLock lock(m_srwAdmissionLock);
 
-    auto requestCount = --m_requestCount;
+    if (m_cAdmittedRequests < m_pConfig->QueryMaxConcurrentRequests())
+    {
+        m_cAdmittedRequests++;
+        return ADMISSION_ADMITTED;
+    }
 
-    LOG_TRACEF(L"Removing Request %d", requestCount);
+    if (!m_fAdmissionClosed && m_admissionQueue.size() < m_pConfig->QueryRequestQueueLimit())
+    {
+        try
+        {
+            m_admissionQueue.push_back(pHandler);
+            m_counters.RequestQueued();
+            return ADMISSION_QUEUED;
+        }
+        catch (...)
+        {
+            OBSERVE_CAUGHT_EXCEPTION();
+        }
+    }
+
+    LOG_TRACE(L"Rejecting request, the concurrent request and queue limits are reached.");
+    m_counters.RecordForwardingError(APPLICATION_COUNTERS::FORWARDING_ERROR_UNAVAILABLE);
+    return ADMISSION_REJECTED;
+}
+
+void
+IN_PROCESS_APPLICATION::ReleaseAdmission()
+{
+    IN_PROCESS_HANDLER* pNextHandler = nullptr;
+
+    {
+        SRWExclusiveLock lock(m_srwAdmissionLock);
+
+        if (m_admissionQueue.empty())
+        {
+            m_cAdmittedRequests--;
+        }
+        else
+        {
+            // The slot is handed over, the admitted count stays the same.
+            pNextHandler = m_admissionQueue.front();
+            m_admissionQueue.pop_front();
+            m_counters.RequestDequeued();
+        }
+    }
 
-    if (m_fStopCalled && requestCount == 0 && !m_blockManagedCallbacks)
+    if (pNextHandler != nullptr)
     {
-        CallRequestsDrained();
+        pNextHandler->ResumeAdmission(/* fAdmitted */ true);
+    }
+}
+
+void
+IN_PROCESS_APPLICATION::CloseAdmissionQueue()
+{
+    std::deque<IN_PROCESS_HANDLER*> admissionQueue;
+
+    {
+        SRWExclusiveLock lock(m_srwAdmissionLock);
+
+        m_fAdmissionClosed = true;
+        admissionQueue.swap(m_admissionQueue);
+    }
+
+    for (auto pHandler : admissionQueue)
+    {
+        m_counters.RequestDequeued();
+        pHandler->ResumeAdmission(/* fAdmitted */ false);
+    }
+}
+
+HRESULT
+IN_PROCESS_APPLICATION::EnableNativeCounters(_Outptr_ const IN_PROCESS_NATIVE_COUNTERS** ppCounters)
+{
+    SRWExclusiveLock lock(m_srwNativeCountersLock);
+
+    if (!m_fNativeCountersEnabled)
+    {
+        LARGE_INTEGER liFrequency;
+        RETURN_LAST_ERROR_IF(!QueryPerformanceFrequency(&liFrequency));
+        m_llCounterFrequency = liFrequency.QuadPart;
+
+        RETURN_IF_FAILED(LatencyHistogram::Create(m_pQueueTimeHistogram));
+        RETURN_IF_FAILED(LatencyHistogram::Create(m_pCompletionHistogram));
+
+        sm_nativeCounters.dwVersion = IN_PROCESS_NATIVE_COUNTERS_VERSION;
+        sm_nativeCounters.cbSize = sizeof(IN_PROCESS_NATIVE_COUNTERS);
+        UpdateNativeCounters();
+
+        RETURN_IF_FAILED(m_nativeCountersTimer.Set(APPLICATION_COUNTERS_PUBLISHER::PUBLISH_INTERVAL_MS,
+            APPLICATION_COUNTERS_PUBLISHER::PUBLISH_INTERVAL_MS));
+
+        // The histograms are set before requests may see the flag.
+        m_fNativeCountersEnabled = true;
+    }
+
+    *ppCounters = &sm_nativeCounters;
+    return S_OK;
+}
+
+void
+IN_PROCESS_APPLICATION::RecordSince(LatencyHistogram* pHistogram, LONGLONG llStart) noexcept
+{
+    if (llStart == 0)
+    {
+        return;
+    }
+
+    LARGE_INTEGER liNow;
+    QueryPerformanceCounter(&liNow);
+
+    const LONGLONG llTicks = liNow.QuadPart - llStart;
+    pHistogram->Record(static_cast<ULONGLONG>((llTicks / m_llCounterFrequency) * 1000000 +
+        (llTicks % m_llCounterFrequency) * 1000000 / m_llCounterFrequency));
+}
+
+void
+IN_PROCESS_APPLICATION::UpdateNativeCounters() noexcept
+{
+    APPLICATION_COUNTERS::SNAPSHOT counters = {};
+    LatencyHistogramSnapshot queueTime;
+    LatencyHistogramSnapshot completions;
+
+    m_counters.AddToSnapshot(&counters);
+    m_pQueueTimeHistogram->Snapshot(queueTime);
+    m_pCompletionHistogram->Snapshot(completions);
+
+    const LONG64 cQueueTimeSamples = queueTime.QueryCount();
+    const LONG64 cCompletions = completions.QueryCount();
+
+    // Down to the last interval, which makes the previous ones the totals.
+    queueTime.Subtract(m_previousQueueTime);
+    completions.Subtract(m_previousCompletions);
+    m_previousQueueTime.Merge(queueTime);
+    m_previousCompletions.Merge(completions);
+
+    // Odd while written, the fences keep the fields within the two bumps.
+    InterlockedIncrement(&sm_nativeCounters.lSequence);
+
+    sm_nativeCounters.cTotalRequests = counters.cTotalRequests;
+    sm_nativeCounters.cActiveRequests = counters.cActiveRequests;
+    sm_nativeCounters.cQueuedRequests = counters.cQueuedRequests;
+    sm_nativeCounters.cRejectedRequests = counters.rgcForwardingErrors[APPLICATION_COUNTERS::FORWARDING_ERROR_UNAVAILABLE];
+    sm_nativeCounters.cQueueTimeSamples = cQueueTimeSamples;
+    sm_nativeCounters.llQueueTimeMeanMicroseconds = queueTime.QueryCount() != 0 ? queueTime.QuerySum() / queueTime.QueryCount() : 0;
+    sm_nativeCounters.llQueueTimeP50Microseconds = static_cast<LONG64>(queueTime.QueryPercentile(50));
+    sm_nativeCounters.llQueueTimeP99Microseconds = static_cast<LONG64>(queueTime.QueryPercentile(99));
+    sm_nativeCounters.cCompletions = cCompletions;
+    sm_nativeCounters.llCompletionMeanMicroseconds = completions.QueryCount() != 0 ? completions.QuerySum() / completions.QueryCount() : 0;
+    sm_nativeCounters.llCompletionP50Microseconds = static_cast<LONG64>(completions.QueryPercentile(50));
+    sm_nativeCounters.llCompletionP99Microseconds = static_cast<LONG64>(completions.QueryPercentile(99));
+    sm_nativeCounters.cbHandlerMemory = max(counters.rgcbMemory[APPLICATION_COUNTERS::MEMORY_TAG_HANDLERS], 0LL);
+    sm_nativeCounters.cbStdoutCaptureMemory = counters.rgcbMemory[APPLICATION_COUNTERS::MEMORY_TAG_STDOUT_CAPTURE];
+
+    InterlockedIncrement(&sm_nativeCounters.lSequence);
+}
+
+// static
+VOID
+CALLBACK
+IN_PROCESS_APPLICATION::NativeCountersTimerCallback(PVOID pContext)
+{
+    static_cast<IN_PROCESS_APPLICATION*>(pContext)->UpdateNativeCounters();
+}
+
+LONG
+IN_PROCESS_APPLICATION::QueryRequestCount()
+{
+    return SumCounts(m_pRequestCounts);
+}
+
+void
+IN_PROCESS_APPLICATION::ReleaseRequestsReference()
+{
+    // Only new requests add to the completion counts, and there are none
+    // once the requests drained, so a sum of zero stays zero. Completions
+    // only stay for a few instructions or for the drain notification.
+    while (SumCounts(m_pCompletionCounts) != 0)
+    {
+        SwitchToThread();
+    }
+
+    LOG_INFO(L"Requests drained, releasing their application reference.");
+
+    DereferenceApplication();
+}
+
+// static
+LONG
+IN_PROCESS_APPLICATION::SumCounts(PER_CPU<LONG>* pCounts)
+{
+    LONG count = 0;
+
+    pCounts->ForEach([&count](LONG* pCount)
+    {
+        count += *pCount;
+    });
+
+    return count;
+}
+
+// static
+void
+IN_PROCESS_APPLICATION::CleanupShadowCopyDirectories(const std::wstring& shadowCopyDirectory, DWORD dwRetainedDirectories, HANDLE hShutdownEvent)
+{
+    // Files deleted between pauses
+    constexpr int c_deletionBatchSize = 64;
+    constexpr DWORD c_deletionPauseMS = 50;
+
+    //
+    // Deleting is never urgent, background mode lowers the I/O priority of
+    // the thread so the deletions don't compete with the app starting up.
+    // The thread is only running this, it isn't ended again.
+    //
+    LOG_LAST_ERROR_IF(!SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN));
+
+    try
+    {
+        // Numbered directories newest first, the rest is deleted in any case.
+        std::vector<std::pair<int, std::filesystem::path>> directories;
+        const auto parentDir = std::filesystem::path(shadowCopyDirectory).parent_path();
+        for (auto& p : std::filesystem::directory_iterator(parentDir))
+        {
+            if (p.path() == shadowCopyDirectory)
+            {
+                continue;
+            }
+
+            int directoryNumber = -1;
+            try
+            {
+                directoryNumber = std::stoi(p.path().filename().wstring());
+            }
+            catch (...)
+            {
+                // Not a shadow copy generation
+            }
+            directories.emplace_back(directoryNumber, p.path());
+        }
+
+        std::sort(directories.begin(), directories.end(), [](const auto& left, const auto& right) { return left.first > right.first; });
+
+        int cDeleted = 0;
+        for (size_t i = 0; i < directories.size(); i++)
+        {
+            if (i < dwRetainedDirectories && directories[i].first >= 0)
+            {
+                LOG_INFOF(L"Keeping shadow copy directory '%ls'", directories[i].second.c_str());
+                continue;
+            }
+
+            //
+            // Deleted bottom up a batch at a time, pausing in between. The
+            // pause ends early on shutdown, which is waiting for this thread.
+            //
+            std::error_code ec;
+            std::vector<std::filesystem::path> entries;
+            for (auto it = std::filesystem::recursive_directory_iterator(directories[i].second, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+            {
+                entries.push_back(it->path());
+            }
+            entries.push_back(directories[i].second);
+
+            for (auto entry = entries.rbegin(); entry != entries.rend(); ++entry)
+            {
+                std::filesystem::remove(*entry, ec);
+
+                if (++cDeleted % c_deletionBatchSize == 0 &&
+                    WaitForSingleObject(hShutdownEvent, c_deletionPauseMS) != WAIT_TIMEOUT)
+                {
+                    LOG_INFO(L"Stopping shadow copy directory cleanup");
+                    return;
+                }
+            }
+        }
+    }
+    catch (...)
+    {
+        OBSERVE_CAUGHT_EXCEPTION();
     }
 }
 
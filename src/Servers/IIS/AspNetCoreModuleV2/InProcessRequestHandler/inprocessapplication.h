@@ -4,9 +4,15 @@
 #pragma once
 
 #include <thread>
+#include <deque>
 #include "InProcessApplicationBase.h"
 #include "InProcessOptions.h"
 #include "HostFxr.h"
+#include "applicationcounters.h"
+#include "StartupTimeline.h"
+#include "FileHandleCache.h"
+#include "LatencyHistogram.h"
+#include "TimerWheel.h"
 
 class IN_PROCESS_HANDLER;
 typedef REQUEST_NOTIFICATION_STATUS(WINAPI * PFN_REQUEST_HANDLER) (IN_PROCESS_HANDLER* pInProcessHandler, void* pvRequestHandlerContext);
@@ -15,6 +21,81 @@ typedef BOOL(WINAPI * PFN_SHUTDOWN_HANDLER) (void* pvShutdownHandlerContext);
 typedef REQUEST_NOTIFICATION_STATUS(WINAPI * PFN_ASYNC_COMPLETION_HANDLER)(void *pvManagedHttpContext, HRESULT hrCompletionStatus, DWORD cbCompletion);
 typedef void(WINAPI * PFN_REQUESTS_DRAINED_HANDLER) (void* pvShutdownHandlerContext);
 
+//
+// The callbacks every request of an application calls into managed with.
+// Set once when managed started, handlers point to the block of their
+// application rather than copying it.
+//
+struct IN_PROCESS_HANDLER_CONTEXT
+{
+    PFN_REQUEST_HANDLER             pRequestHandler;
+    VOID*                           pRequestHandlerContext;
+    PFN_DISCONNECT_HANDLER          pDisconnectHandler;
+    PFN_ASYNC_COMPLETION_HANDLER    pAsyncCompletionHandler;
+};
+
+#define IN_PROCESS_REQUEST_INFO_VERSION 1
+
+//
+// What the managed server reads at the start of every request, filled in
+// before the request callback so that it needs no further calls for it.
+// The pointers stay valid until the request completes. Fields are only
+// ever appended, dwVersion is the version they were filled in for.
+//
+struct IN_PROCESS_REQUEST_INFO
+{
+    DWORD                   dwVersion;
+    HTTP_REQUEST_V2*        pRawRequest;
+    HTTP_CONNECTION_ID      connectionId;
+    HTTP_REQUEST_ID         requestId;
+    // Not NUL terminated and not allocated, NULL if no user was authenticated.
+    PCWSTR                  pszAuthType;
+    DWORD                   cchAuthType;
+    HANDLE                  hToken;
+    // NULL if the request did not come over TLS.
+    HTTP_SSL_INFO*          pSslInfo;
+    HTTP_SSL_PROTOCOL_INFO* pSslProtocolInfo;
+};
+
+#define IN_PROCESS_NATIVE_COUNTERS_VERSION 1
+
+//
+// Counters of the native side of the application that the managed server
+// polls and republishes, with plain reads rather than a call per sample.
+// Updated once a second after http_get_native_counters was called. A
+// reader retries while lSequence is odd or changed during its read. Fields
+// are only ever appended, cbSize is the size of the ones written.
+//
+struct IN_PROCESS_NATIVE_COUNTERS
+{
+    DWORD                   dwVersion;
+    DWORD                   cbSize;
+    volatile LONG           lSequence;
+    DWORD                   dwReserved;
+    LONG64                  cTotalRequests;
+    LONG64                  cActiveRequests;
+    // Waiting for maxConcurrentRequests admission, and turned away by it.
+    LONG64                  cQueuedRequests;
+    LONG64                  cRejectedRequests;
+    // From IIS handing the request to the module to the request callback
+    // into managed: warmup and admission waits included. The counts are
+    // totals, the latencies over the last second.
+    LONG64                  cQueueTimeSamples;
+    LONG64                  llQueueTimeMeanMicroseconds;
+    LONG64                  llQueueTimeP50Microseconds;
+    LONG64                  llQueueTimeP99Microseconds;
+    // Of the async completion callbacks into managed.
+    LONG64                  cCompletions;
+    LONG64                  llCompletionMeanMicroseconds;
+    LONG64                  llCompletionP50Microseconds;
+    LONG64                  llCompletionP99Microseconds;
+    // Native memory held for the application, in bytes.
+    LONG64                  cbHandlerMemory;
+    LONG64                  cbStdoutCaptureMemory;
+};
+
+typedef REQUEST_NOTIFICATION_STATUS(WINAPI * PFN_REQUEST_INFO_HANDLER) (IN_PROCESS_HANDLER* pInProcessHandler, const IN_PROCESS_REQUEST_INFO* pRequestInfo, void* pvRequestHandlerContext);
+
 class IN_PROCESS_APPLICATION : public InProcessApplicationBase
 {
 public:
@@ -42,6 +123,22 @@ public:
         _In_ VOID* pvShutdownHandlerContext
     );
 
+    // Replaces the request callback, requests are started with the request
+    // info pre-filled from then on.
+    VOID
+    SetRequestInfoHandler(
+        _In_ PFN_REQUEST_INFO_HANDLER request_info_callback
+    )
+    {
+        m_RequestInfoHandler = request_info_callback;
+    }
+
+    PFN_REQUEST_INFO_HANDLER
+    QueryRequestInfoHandler() const
+    {
+        return m_RequestInfoHandler;
+    }
+
     __override
     HRESULT
     CreateHandler(
@@ -61,12 +158,17 @@ public:
     void
     QueueStop();
 
+    // Holds back requests other than the warmup ones until the warmup
+    // requests completed or the startup time limit passed.
+    void
+    WaitForWarmup(IHttpContext& pHttpContext);
+
     void
     StopIncomingRequests()
     {
         QueueStop();
 
-        LOG_INFOF(L"Waiting for %d requests to drain", m_requestCount.load());
+        LOG_INFOF(L"Waiting for %d requests to drain", QueryRequestCount());
     }
 
     void
@@ -100,12 +202,83 @@ public:
         return *m_pConfig;
     }
 
+    // The bindings of the application formatted for the managed server,
+    // they don't change while it runs.
+    const std::wstring&
+    QueryServerAddresses() const noexcept
+    {
+        return m_serverAddresses;
+    }
+
+    // Files the managed server sends by handle, see http_open_cached_file.
+    FileHandleCache&
+    QueryFileHandleCache() noexcept
+    {
+        return m_fileHandleCache;
+    }
+
     bool
     QueryBlockCallbacksIntoManaged() const
     {
         return m_blockManagedCallbacks;
     }
 
+    // Starts updating the native counters, which stay readable for the
+    // lifetime of the worker process.
+    HRESULT
+    EnableNativeCounters(_Outptr_ const IN_PROCESS_NATIVE_COUNTERS** ppCounters);
+
+    // QueryPerformanceCounter value to pass to the Record calls, 0 while
+    // the native counters are not enabled.
+    LONGLONG
+    QueryCounterTimestamp() const noexcept
+    {
+        LARGE_INTEGER liCounter = {};
+        if (m_fNativeCountersEnabled)
+        {
+            QueryPerformanceCounter(&liCounter);
+        }
+        return liCounter.QuadPart;
+    }
+
+    void
+    RecordQueueTime(LONGLONG llStart) noexcept
+    {
+        RecordSince(m_pQueueTimeHistogram.get(), llStart);
+    }
+
+    void
+    RecordCompletionTime(LONGLONG llStart) noexcept
+    {
+        RecordSince(m_pCompletionHistogram.get(), llStart);
+    }
+
+    enum ADMISSION_RESULT
+    {
+        ADMISSION_ADMITTED,
+        ADMISSION_QUEUED,
+        ADMISSION_REJECTED
+    };
+
+    // Whether maxConcurrentRequests limits the requests let into managed.
+    bool
+    QueryAdmissionControlled() const
+    {
+        return m_pConfig->QueryMaxConcurrentRequests() != 0;
+    }
+
+    // Lets the request into managed while below maxConcurrentRequests, and
+    // queues it while below requestQueueLimit otherwise. A queued handler
+    // is resumed with a completion once it was admitted or the
+    // application stopped.
+    ADMISSION_RESULT
+    AdmitRequest(IN_PROCESS_HANDLER* pHandler);
+
+    // Hands the slot of an admitted request that completed to the request
+    // queued first.
+    void
+    ReleaseAdmission();
+
     static
     HRESULT Start(
         IHttpServer& pServer,
@@ -147,30 +320,77 @@ private:
     std::thread                     m_workerThread;
     // Thread for cleaning up existing shadow copy folders
     std::thread                     m_folderCleanupThread;
+    // Thread sending the warmup requests, joined on shutdown
+    std::thread                     m_warmupThread;
+    // The event that gets triggered when the warmup requests completed
+    HandleWrapper<NullHandleTraits> m_pWarmupCompleteEvent;
+    std::atomic_bool                m_fWarmingUp;
+    // Sent with the warmup requests, they are the ones let through
+    std::string                     m_strWarmupToken;
+    // The warmup request in flight, closed to cancel it on shutdown
+    SRWLOCK                         m_srwWarmupLock;
+    HINTERNET                       m_hWarmupRequest;
+    bool                            m_fWarmupCancelled;
     // The event that gets triggered when managed initialization is complete
     HandleWrapper<NullHandleTraits> m_pInitializeEvent;
     // The event that gets triggered when worker thread should exit
     HandleWrapper<NullHandleTraits> m_pShutdownEvent;
 
-    // The request handler callback from managed code
-    PFN_REQUEST_HANDLER             m_RequestHandler;
-    VOID*                           m_RequestHandlerContext;
+    // The request, disconnect and async completion callbacks from managed code
+    IN_PROCESS_HANDLER_CONTEXT      m_handlerContext;
+    // The request handler taking the pre-filled request info, if registered
+    PFN_REQUEST_INFO_HANDLER        m_RequestInfoHandler;
 
     // The shutdown handler callback from managed code
     PFN_SHUTDOWN_HANDLER            m_ShutdownHandler;
     VOID*                           m_ShutdownHandlerContext;
 
-    PFN_ASYNC_COMPLETION_HANDLER    m_AsyncCompletionHandler;
-    PFN_DISCONNECT_HANDLER          m_DisconnectHandler;
     std::atomic<PFN_REQUESTS_DRAINED_HANDLER>    m_RequestsDrainedHandler;
 
     std::wstring                    m_dotnetExeKnownLocation;
+    std::wstring                    m_serverAddresses;
 
     std::atomic_bool                m_blockManagedCallbacks;
     bool                            m_Initialized;
     bool                            m_waitForShutdown;
 
-    std::atomic<int>                m_requestCount;
+    // Requests in flight, counted on the CPU they start and complete on so
+    // that the request path touches no shared cache line. Only the sum is
+    // meaningful, it is only taken once draining started.
+    PER_CPU<LONG>*                  m_pRequestCounts;
+    // Requests admitted into managed and requests waiting for admission,
+    // only used once maxConcurrentRequests is set.
+    SRWLOCK                         m_srwAdmissionLock;
+    DWORD                           m_cAdmittedRequests;
+    std::deque<IN_PROCESS_HANDLER*> m_admissionQueue;
+    bool                            m_fAdmissionClosed;
+    // Set once stop was requested, completions check for the drain from then on.
+    std::atomic_bool                m_fDraining;
+    // Completions that may still touch the application, each one leaves
+    // the block it entered. Only looked at before dropping the reference
+    // held for the requests.
+    PER_CPU<LONG>*                  m_pCompletionCounts;
+    // Requests hold no reference of their own. The application holds one
+    // for all of them from the first request until they drained.
+    std::atomic_bool                m_fRequestsReferenced;
+    // Requests, admission queue and requests turned away by the limits.
+    APPLICATION_COUNTERS            m_counters;
+    APPLICATION_COUNTERS_PUBLISHER  m_countersPublisher;
+    // Only created once the managed server asked for the native counters.
+    // The latencies are published over the last interval, the previous
+    // snapshots are only touched by the timer.
+    SRWLOCK                         m_srwNativeCountersLock;
+    std::atomic_bool                m_fNativeCountersEnabled;
+    LONGLONG                        m_llCounterFrequency;
+    std::unique_ptr<LatencyHistogram> m_pQueueTimeHistogram;
+    std::unique_ptr<LatencyHistogram> m_pCompletionHistogram;
+    LatencyHistogramSnapshot        m_previousQueueTime;
+    LatencyHistogramSnapshot        m_previousCompletions;
+    TimerWheel::Timer               m_nativeCountersTimer;
+    static IN_PROCESS_NATIVE_COUNTERS sm_nativeCounters;
+    // Written once the managed server registered its callbacks.
+    StartupTimeline                 m_startupTimeline;
+    FileHandleCache                 m_fileHandleCache;
 
     std::unique_ptr<InProcessOptions> m_pConfig;
 
@@ -180,6 +400,7 @@ private:
 
     inline static const LPCSTR      s_exeLocationParameterName = "InProcessExeLocation";
     inline static const LPCSTR      s_shadowCopyDirectoryName = "ShadowCopyDirectory";
+    inline static const LPCSTR      s_startupTimelineParameterName = "StartupTimeline";
 
     VOID
     UnexpectedThreadExit(const ExecuteClrContext& context) const;
@@ -190,9 +411,46 @@ private:
     void
     StopClr();
 
+    void
+    StartWarmup();
+
+    void
+    SendWarmupRequests();
+
+    void
+    CancelWarmup();
+
+    void
+    CloseAdmissionQueue();
+
     void
     CallRequestsDrained();
 
+    LONG
+    QueryRequestCount();
+
+    void
+    ReleaseRequestsReference();
+
+    void
+    RecordSince(LatencyHistogram* pHistogram, LONGLONG llStart) noexcept;
+
+    void
+    UpdateNativeCounters() noexcept;
+
+    static
+    VOID
+    CALLBACK
+    NativeCountersTimerCallback(PVOID pContext);
+
+    static
+    LONG
+    SumCounts(PER_CPU<LONG>* pCounts);
+
+    static
+    void
+    CleanupShadowCopyDirectories(const std::wstring& shadowCopyDirectory, DWORD dwRetainedDirectories, HANDLE hShutdownEvent);
+
     static
     void
     ClrThreadEntryPoint(const std::shared_ptr<ExecuteClrContext> &context);
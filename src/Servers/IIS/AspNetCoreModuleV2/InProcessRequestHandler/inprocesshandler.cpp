@@ -9,24 +9,28 @@
 ALLOC_CACHE_HANDLER * IN_PROCESS_HANDLER::sm_pAlloc = NULL;
 
 IN_PROCESS_HANDLER::IN_PROCESS_HANDLER(
-    _In_ std::unique_ptr<IN_PROCESS_APPLICATION, IAPPLICATION_DELETER> pApplication,
+    _In_ IN_PROCESS_APPLICATION *pApplication,
     _In_ IHttpContext *pW3Context,
-    _In_ PFN_REQUEST_HANDLER pRequestHandler,
-    _In_ void * pRequestHandlerContext,
-    _In_ PFN_DISCONNECT_HANDLER pDisconnectHandler,
-    _In_ PFN_ASYNC_COMPLETION_HANDLER pAsyncCompletion
+    _In_ const IN_PROCESS_HANDLER_CONTEXT *pHandlerContext
 ): REQUEST_HANDLER(*pW3Context),
    m_pManagedHttpContext(nullptr),
    m_requestNotificationStatus(RQ_NOTIFICATION_PENDING),
    m_fManagedRequestComplete(FALSE),
    m_pW3Context(pW3Context),
-   m_pApplication(std::move(pApplication)),
-   m_pRequestHandler(pRequestHandler),
-   m_pRequestHandlerContext(pRequestHandlerContext),
-   m_pAsyncCompletionHandler(pAsyncCompletion),
-   m_pDisconnectHandler(pDisconnectHandler),
+   m_pApplication(pApplication),
+   m_pHandlerContext(pHandlerContext),
    m_disconnectFired(false),
-   m_queueNotified(false)
+   m_fAdmitted(false),
+   m_fAdmissionPending(false),
+   m_queueNotified(false),
+   m_cWebSocketBuffers(0),
+   m_cReadSegments(0),
+   m_iReadSegment(0),
+   m_cbVectoredRead(0),
+   m_fVectoredReadPending(false),
+   m_cbBufferedEntity(0),
+   m_fBufferedEntityCounted(false),
+   m_llCreated(pApplication->QueryCounterTimestamp())
 {
     InitializeSRWLock(&m_srwDisconnectLock);
 }
@@ -37,7 +41,9 @@ IN_PROCESS_HANDLER::ExecuteRequestHandler()
 {
     ::RaiseEvent<ANCMEvents::ANCM_INPROC_EXECUTE_REQUEST_START>(m_pW3Context, nullptr);
 
-    if (m_pRequestHandler == NULL)
+    m_pApplication->WaitForWarmup(*m_pW3Context);
+
+    if (m_pHandlerContext->pRequestHandler == NULL)
     {
         ::RaiseEvent<ANCMEvents::ANCM_INPROC_EXECUTE_REQUEST_COMPLETION>(m_pW3Context, nullptr, RQ_NOTIFICATION_FINISH_REQUEST);
         return RQ_NOTIFICATION_FINISH_REQUEST;
@@ -47,7 +53,49 @@ IN_PROCESS_HANDLER::ExecuteRequestHandler()
         return ServerShutdownMessage();
     }
 
-    auto status = m_pRequestHandler(this, m_pRequestHandlerContext);
+    if (m_pApplication->QueryAdmissionControlled() &&
+        !m_pApplication->QueryConfig().QueryPriorityPaths().Matches(*m_pW3Context))
+    {
+        // Set before queuing, the completion may be posted right after.
+        m_fAdmissionPending = true;
+
+        const auto admission = m_pApplication->AdmitRequest(this);
+        if (admission == IN_PROCESS_APPLICATION::ADMISSION_QUEUED)
+        {
+            return RQ_NOTIFICATION_PENDING;
+        }
+
+        m_fAdmissionPending = false;
+
+        if (admission == IN_PROCESS_APPLICATION::ADMISSION_REJECTED)
+        {
+            return ServerBusyMessage();
+        }
+
+        m_fAdmitted = true;
+    }
+
+    return ExecuteManagedRequest();
+}
+
+REQUEST_NOTIFICATION_STATUS
+IN_PROCESS_HANDLER::ExecuteManagedRequest()
+{
+    REQUEST_NOTIFICATION_STATUS status;
+    const auto pRequestInfoHandler = m_pApplication->QueryRequestInfoHandler();
+
+    m_pApplication->RecordQueueTime(m_llCreated);
+
+    if (pRequestInfoHandler != nullptr)
+    {
+        IN_PROCESS_REQUEST_INFO requestInfo;
+        FillRequestInfo(&requestInfo);
+        status = pRequestInfoHandler(this, &requestInfo, m_pHandlerContext->pRequestHandlerContext);
+    }
+    else
+    {
+        status = m_pHandlerContext->pRequestHandler(this, m_pHandlerContext->pRequestHandlerContext);
+    }
     ::RaiseEvent<ANCMEvents::ANCM_INPROC_EXECUTE_REQUEST_COMPLETION>(m_pW3Context, nullptr, status);
     return status;
 }
@@ -67,6 +115,24 @@ IN_PROCESS_HANDLER::AsyncCompletion(
         ::RaiseEvent<ANCMEvents::ANCM_INPROC_ASYNC_COMPLETION_COMPLETION>(m_pW3Context, nullptr, m_requestNotificationStatus);
         return m_requestNotificationStatus;
     }
+    if (m_fAdmissionPending)
+    {
+        // Posted by ResumeAdmission, managed has not seen the request yet.
+        m_fAdmissionPending = false;
+
+        if (!m_fAdmitted || m_pApplication->QueryBlockCallbacksIntoManaged())
+        {
+            return ServerShutdownMessage();
+        }
+
+        if (m_disconnectFired)
+        {
+            // The client went away while the request was queued.
+            return RQ_NOTIFICATION_FINISH_REQUEST;
+        }
+
+        return ExecuteManagedRequest();
+    }
     if (m_pApplication->QueryBlockCallbacksIntoManaged())
     {
         // this can potentially happen in ungraceful shutdown.
@@ -75,20 +141,97 @@ IN_PROCESS_HANDLER::AsyncCompletion(
         return ServerShutdownMessage();
     }
 
+    if (m_fVectoredReadPending)
+    {
+        // One read of a vectored read completed, managed only hears about
+        // the whole of it. Bytes already read are completed successfully,
+        // the error comes back on the next read.
+        if (FAILED(hrCompletionStatus))
+        {
+            if (m_cbVectoredRead > 0)
+            {
+                hrCompletionStatus = S_OK;
+            }
+        }
+        else if (AddVectoredReadBytes(cbCompletion))
+        {
+            BOOL fCompletionPending;
+            hrCompletionStatus = ContinueVectoredRead(&fCompletionPending);
+            if (fCompletionPending)
+            {
+                return RQ_NOTIFICATION_PENDING;
+            }
+        }
+
+        m_fVectoredReadPending = false;
+        cbCompletion = m_cbVectoredRead;
+    }
+
     assert(m_pManagedHttpContext != nullptr);
     // Call the managed handler for async completion.
 
-    auto status = m_pAsyncCompletionHandler(m_pManagedHttpContext, hrCompletionStatus, cbCompletion);
+    const LONGLONG llCompletionStart = m_pApplication->QueryCounterTimestamp();
+    auto status = m_pHandlerContext->pAsyncCompletionHandler(m_pManagedHttpContext, hrCompletionStatus, cbCompletion);
+    m_pApplication->RecordCompletionTime(llCompletionStart);
     ::RaiseEvent<ANCMEvents::ANCM_INPROC_ASYNC_COMPLETION_COMPLETION>(m_pW3Context, nullptr, status);
     return status;
 }
 
+VOID
+IN_PROCESS_HANDLER::FillRequestInfo(
+    _Out_ IN_PROCESS_REQUEST_INFO* pRequestInfo
+) const
+{
+    // IIS hands out the HTTP_REQUEST_V2 it got from http.sys
+    auto pRawRequest = reinterpret_cast<HTTP_REQUEST_V2*>(m_pW3Context->GetRequest()->GetRawHttpRequest());
+
+    ZeroMemory(pRequestInfo, sizeof(*pRequestInfo));
+    pRequestInfo->dwVersion = IN_PROCESS_REQUEST_INFO_VERSION;
+    pRequestInfo->pRawRequest = pRawRequest;
+    pRequestInfo->connectionId = pRawRequest->ConnectionId;
+    pRequestInfo->requestId = pRawRequest->RequestId;
+    pRequestInfo->pSslInfo = pRawRequest->pSslInfo;
+
+    for (USHORT i = 0; i < pRawRequest->RequestInfoCount; i++)
+    {
+        if (pRawRequest->pRequestInfo[i].InfoType == HttpRequestInfoTypeSslProtocol)
+        {
+            pRequestInfo->pSslProtocolInfo = static_cast<HTTP_SSL_PROTOCOL_INFO*>(pRawRequest->pRequestInfo[i].pInfo);
+            break;
+        }
+    }
+
+    IHttpUser* pUser = m_pW3Context->GetUser();
+    if (pUser != nullptr)
+    {
+        pRequestInfo->pszAuthType = pUser->GetAuthenticationType();
+        pRequestInfo->cchAuthType = pRequestInfo->pszAuthType == nullptr ? 0 : static_cast<DWORD>(wcslen(pRequestInfo->pszAuthType));
+        pRequestInfo->hToken = pUser->GetPrimaryToken();
+    }
+}
+
 REQUEST_NOTIFICATION_STATUS IN_PROCESS_HANDLER::ServerShutdownMessage() const
 {
     ::RaiseEvent<ANCMEvents::ANCM_INPROC_REQUEST_SHUTDOWN>(m_pW3Context, nullptr);
     return ShuttingDownHandler::ServerShutdownMessage(m_pW3Context);
 }
 
+REQUEST_NOTIFICATION_STATUS IN_PROCESS_HANDLER::ServerBusyMessage() const
+{
+    // Same status IIS uses when its own concurrent request limit is reached.
+    m_pW3Context->GetResponse()->SetStatus(503, "Service Unavailable", 2, HRESULT_FROM_WIN32(ERROR_BUSY));
+    return RQ_NOTIFICATION_FINISH_REQUEST;
+}
+
+VOID
+IN_PROCESS_HANDLER::ResumeAdmission(
+    BOOL fAdmitted
+)
+{
+    m_fAdmitted = fAdmitted;
+    LOG_IF_FAILED(m_pW3Context->PostCompletion(0));
+}
+
 // Called from native IIS
 VOID
 IN_PROCESS_HANDLER::NotifyDisconnect()
@@ -117,7 +260,7 @@ IN_PROCESS_HANDLER::NotifyDisconnect()
     // for example this can happen when the client cancels the request very quickly after making it
     if (pManagedHttpContext != nullptr)
     {
-        m_pDisconnectHandler(pManagedHttpContext);
+        m_pHandlerContext->pDisconnectHandler(pManagedHttpContext);
     }
 
     // Make sure we unblock any potential current or future m_queueCheck.wait(...) calls
@@ -191,8 +334,258 @@ IN_PROCESS_HANDLER::SetManagedHttpContext(
     {
         // Safe to call, managed code is waiting on SetManagedHttpContext in the process request loop and doesn't dispose
         // the GCHandle until after the request loop completes
-        m_pDisconnectHandler(pManagedHttpContext);
+        m_pHandlerContext->pDisconnectHandler(pManagedHttpContext);
+    }
+}
+
+// Called from managed server
+HRESULT
+IN_PROCESS_HANDLER::RegisterWebSocketBuffers(
+    _In_reads_(cBuffers) CHAR** ppBuffers,
+    _In_reads_(cBuffers) DWORD* pcbBuffers,
+    DWORD cBuffers
+)
+{
+    // Registered once per connection, IO may already refer to the set.
+    if (m_pWebSocketBuffers != nullptr)
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_ALREADY_INITIALIZED));
+    }
+
+    if (ppBuffers == nullptr || pcbBuffers == nullptr || cBuffers == 0 || cBuffers > MAX_WEBSOCKET_BUFFERS)
+    {
+        RETURN_HR(E_INVALIDARG);
+    }
+
+    for (DWORD i = 0; i < cBuffers; i++)
+    {
+        if (ppBuffers[i] == nullptr || pcbBuffers[i] == 0)
+        {
+            RETURN_HR(E_INVALIDARG);
+        }
+    }
+
+    std::unique_ptr<WEBSOCKET_BUFFER[]> pWebSocketBuffers(new (std::nothrow) WEBSOCKET_BUFFER[cBuffers]);
+    if (pWebSocketBuffers == nullptr)
+    {
+        RETURN_HR(E_OUTOFMEMORY);
+    }
+
+    for (DWORD i = 0; i < cBuffers; i++)
+    {
+        pWebSocketBuffers[i].pBuffer = ppBuffers[i];
+        pWebSocketBuffers[i].cbBuffer = pcbBuffers[i];
+    }
+
+    m_pWebSocketBuffers = std::move(pWebSocketBuffers);
+    m_cWebSocketBuffers = cBuffers;
+    return S_OK;
+}
+
+// Called from managed server
+HRESULT
+IN_PROCESS_HANDLER::ReadRequestBytesVectored(
+    _In_reads_(cSegments) CHAR** ppSegments,
+    _In_reads_(cSegments) DWORD* pcbSegments,
+    DWORD cSegments,
+    _Out_ DWORD* pdwBytesReceived,
+    _Out_ BOOL* pfCompletionPending
+)
+{
+    *pdwBytesReceived = 0;
+    *pfCompletionPending = FALSE;
+
+    // Managed has one body read outstanding at a time.
+    if (m_fVectoredReadPending)
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_BUSY));
+    }
+
+    if (ppSegments == nullptr || pcbSegments == nullptr || cSegments == 0 || cSegments > MAX_READ_SEGMENTS)
+    {
+        RETURN_HR(E_INVALIDARG);
+    }
+
+    for (DWORD i = 0; i < cSegments; i++)
+    {
+        if (ppSegments[i] == nullptr || pcbSegments[i] == 0)
+        {
+            RETURN_HR(E_INVALIDARG);
+        }
+    }
+
+    if (m_pReadSegments == nullptr)
+    {
+        m_pReadSegments.reset(new (std::nothrow) READ_SEGMENT[MAX_READ_SEGMENTS]);
+        if (m_pReadSegments == nullptr)
+        {
+            RETURN_HR(E_OUTOFMEMORY);
+        }
+    }
+
+    for (DWORD i = 0; i < cSegments; i++)
+    {
+        m_pReadSegments[i].pBuffer = ppSegments[i];
+        m_pReadSegments[i].cbBuffer = pcbSegments[i];
+    }
+
+    m_cReadSegments = cSegments;
+    m_iReadSegment = 0;
+    m_cbVectoredRead = 0;
+
+    // Set before the first read, its completion can run before this returns.
+    m_fVectoredReadPending = true;
+
+    const HRESULT hr = ContinueVectoredRead(pfCompletionPending);
+    if (*pfCompletionPending)
+    {
+        return S_OK;
+    }
+
+    m_fVectoredReadPending = false;
+    *pdwBytesReceived = m_cbVectoredRead;
+    return hr;
+}
+
+HRESULT
+IN_PROCESS_HANDLER::ContinueVectoredRead(
+    _Out_ BOOL* pfCompletionPending
+)
+{
+    IHttpRequest* pHttpRequest = m_pW3Context->GetRequest();
+
+    *pfCompletionPending = FALSE;
+
+    while (m_iReadSegment < m_cReadSegments && pHttpRequest->GetRemainingEntityBytes() > 0)
+    {
+        const READ_SEGMENT& segment = m_pReadSegments[m_iReadSegment];
+        DWORD cbRead = 0;
+
+        const HRESULT hr = ReadEntityBody(
+            segment.pBuffer,
+            segment.cbBuffer,
+            &cbRead,
+            pfCompletionPending);
+        if (FAILED(hr))
+        {
+            return m_cbVectoredRead > 0 ? S_OK : hr;
+        }
+
+        // The members may already be in use by the completion.
+        if (*pfCompletionPending)
+        {
+            return S_OK;
+        }
+
+        if (!AddVectoredReadBytes(cbRead))
+        {
+            break;
+        }
+    }
+
+    return S_OK;
+}
+
+HRESULT
+IN_PROCESS_HANDLER::ReadRequestBytes(
+    _Out_writes_bytes_(cbBuffer) CHAR* pBuffer,
+    DWORD cbBuffer,
+    _Out_ DWORD* pdwBytesReceived,
+    _Out_ BOOL* pfCompletionPending
+)
+{
+    *pdwBytesReceived = 0;
+    *pfCompletionPending = FALSE;
+
+    if (m_pW3Context->GetRequest()->GetRemainingEntityBytes() == 0)
+    {
+        return S_OK;
     }
+
+    return ReadEntityBody(pBuffer, cbBuffer, pdwBytesReceived, pfCompletionPending);
+}
+
+HRESULT
+IN_PROCESS_HANDLER::ReadEntityBody(
+    _Out_writes_bytes_(cbBuffer) CHAR* pBuffer,
+    DWORD cbBuffer,
+    _Out_ DWORD* pcbRead,
+    _Out_ BOOL* pfCompletionPending
+)
+{
+    IHttpRequest* pHttpRequest = m_pW3Context->GetRequest();
+
+    if (!m_fBufferedEntityCounted)
+    {
+        m_cbBufferedEntity = QueryBufferedEntityBytes();
+        m_fBufferedEntityCounted = true;
+    }
+
+    if (m_cbBufferedEntity == 0)
+    {
+        return pHttpRequest->ReadEntityBody(pBuffer, cbBuffer, TRUE, pcbRead, pfCompletionPending);
+    }
+
+    //
+    // Capped so that the synchronous read is served from what IIS holds
+    // and never waits for the client.
+    //
+    BOOL fCompletionPending = FALSE;
+    const HRESULT hr = pHttpRequest->ReadEntityBody(pBuffer, min(cbBuffer, m_cbBufferedEntity), FALSE, pcbRead, &fCompletionPending);
+    *pfCompletionPending = FALSE;
+
+    // Failed or nothing returned, IIS does not hold them after all; the
+    // next read goes asynchronous as before.
+    m_cbBufferedEntity = FAILED(hr) || *pcbRead == 0 ? 0 : m_cbBufferedEntity - min(*pcbRead, m_cbBufferedEntity);
+    return hr;
+}
+
+DWORD
+IN_PROCESS_HANDLER::QueryBufferedEntityBytes() const
+{
+    IHttpRequest* pHttpRequest = m_pW3Context->GetRequest();
+    const HTTP_REQUEST* pRawRequest = pHttpRequest->GetRawHttpRequest();
+
+    //
+    // The chunks received with the headers are what IIS returns first,
+    // unless a module before us read some of the body already. That is
+    // only known with a Content-Length; chunked bodies are read
+    // asynchronously from the start.
+    //
+    PCSTR pszContentLength = pHttpRequest->GetHeader(HttpHeaderContentLength);
+    if (pszContentLength == nullptr ||
+        pHttpRequest->GetRemainingEntityBytes() != strtoul(pszContentLength, nullptr, 10))
+    {
+        return 0;
+    }
+
+    ULONGLONG cbBuffered = 0;
+    for (USHORT i = 0; i < pRawRequest->EntityChunkCount; i++)
+    {
+        const HTTP_DATA_CHUNK& chunk = pRawRequest->pEntityChunks[i];
+        if (chunk.DataChunkType != HttpDataChunkFromMemory)
+        {
+            return 0;
+        }
+        cbBuffered += chunk.FromMemory.BufferLength;
+    }
+
+    return static_cast<DWORD>(min(cbBuffered, static_cast<ULONGLONG>(pHttpRequest->GetRemainingEntityBytes())));
+}
+
+BOOL
+IN_PROCESS_HANDLER::AddVectoredReadBytes(
+    DWORD cbRead
+)
+{
+    // A short read means nothing more is buffered yet, waiting for the next
+    // segment would hold back what was read.
+    const BOOL fFilled = cbRead == m_pReadSegments[m_iReadSegment].cbBuffer;
+
+    m_cbVectoredRead += cbRead;
+    m_iReadSegment++;
+
+    return fFilled;
 }
 
 // static
@@ -15,16 +15,20 @@ class IN_PROCESS_APPLICATION;
 class IN_PROCESS_HANDLER : public REQUEST_HANDLER
 {
 public:
+    // The application is kept alive for the request until it completed,
+    // the handler context belongs to it.
     IN_PROCESS_HANDLER(
-        _In_ std::unique_ptr<IN_PROCESS_APPLICATION, IAPPLICATION_DELETER> pApplication,
+        _In_ IN_PROCESS_APPLICATION *pApplication,
         _In_ IHttpContext   *pW3Context,
-        _In_ PFN_REQUEST_HANDLER pRequestHandler,
-        _In_ void * pRequestHandlerContext,
-        _In_ PFN_DISCONNECT_HANDLER m_DisconnectHandler,
-        _In_ PFN_ASYNC_COMPLETION_HANDLER pAsyncCompletion);
+        _In_ const IN_PROCESS_HANDLER_CONTEXT *pHandlerContext);
 
     ~IN_PROCESS_HANDLER()
     {
+        if (m_fAdmitted)
+        {
+            m_pApplication->ReleaseAdmission();
+        }
+
         m_pApplication->HandleRequestCompletion();
     }
 
@@ -57,11 +61,75 @@ public:
     VOID
     IndicateManagedRequestComplete();
 
+    // Completes the wait of a request queued for admission, it either goes
+    // into managed or is turned away once the completion arrives.
+    VOID
+    ResumeAdmission(
+        BOOL fAdmitted
+    );
+
     VOID
     SetAsyncCompletionStatus(
         REQUEST_NOTIFICATION_STATUS requestNotificationStatus
     );
 
+    // Upper bound of the buffers a WebSocket connection registers.
+    static constexpr DWORD MAX_WEBSOCKET_BUFFERS = 64;
+
+    // Records the buffers that WebSocket reads and writes refer to by
+    // index from now on. The managed side keeps them pinned until the
+    // request completes; they are validated once here, not on every IO.
+    HRESULT
+    RegisterWebSocketBuffers(
+        _In_reads_(cBuffers) CHAR** ppBuffers,
+        _In_reads_(cBuffers) DWORD* pcbBuffers,
+        DWORD cBuffers
+    );
+
+    BOOL
+    QueryWebSocketBuffer(
+        DWORD dwIndex,
+        _Out_ CHAR** ppBuffer,
+        _Out_ DWORD* pcbBuffer
+    ) const
+    {
+        if (dwIndex >= m_cWebSocketBuffers)
+        {
+            return FALSE;
+        }
+
+        *ppBuffer = m_pWebSocketBuffers[dwIndex].pBuffer;
+        *pcbBuffer = m_pWebSocketBuffers[dwIndex].cbBuffer;
+        return TRUE;
+    }
+
+    // Reads the request body into pBuffer. Bytes IIS already holds, those
+    // received with the headers, are returned synchronously; only reading
+    // past them pends a completion.
+    HRESULT
+    ReadRequestBytes(
+        _Out_writes_bytes_(cbBuffer) CHAR* pBuffer,
+        DWORD cbBuffer,
+        _Out_ DWORD* pdwBytesReceived,
+        _Out_ BOOL* pfCompletionPending
+    );
+
+    // Upper bound of the segments one vectored read fills.
+    static constexpr DWORD MAX_READ_SEGMENTS = 16;
+
+    // Reads the request body into the segments in order, moving on to the
+    // next segment only while the previous one was filled completely. Only
+    // one completion is raised, with the bytes of every segment. The
+    // segments stay pinned until it arrives.
+    HRESULT
+    ReadRequestBytesVectored(
+        _In_reads_(cSegments) CHAR** ppSegments,
+        _In_reads_(cSegments) DWORD* pcbSegments,
+        DWORD cSegments,
+        _Out_ DWORD* pdwBytesReceived,
+        _Out_ BOOL* pfCompletionPending
+    );
+
     static void * operator new(size_t size);
 
     static void operator delete(void * pMemory);
@@ -75,23 +143,87 @@ public:
     StaticTerminate();
 
 private:
+    struct WEBSOCKET_BUFFER
+    {
+        CHAR*   pBuffer;
+        DWORD   cbBuffer;
+    };
+
+    struct READ_SEGMENT
+    {
+        CHAR*   pBuffer;
+        DWORD   cbBuffer;
+    };
+
     REQUEST_NOTIFICATION_STATUS
     ServerShutdownMessage() const;
 
+    REQUEST_NOTIFICATION_STATUS
+    ServerBusyMessage() const;
+
+    REQUEST_NOTIFICATION_STATUS
+    ExecuteManagedRequest();
+
+    HRESULT
+    ContinueVectoredRead(
+        _Out_ BOOL* pfCompletionPending
+    );
+
+    HRESULT
+    ReadEntityBody(
+        _Out_writes_bytes_(cbBuffer) CHAR* pBuffer,
+        DWORD cbBuffer,
+        _Out_ DWORD* pcbRead,
+        _Out_ BOOL* pfCompletionPending
+    );
+
+    DWORD
+    QueryBufferedEntityBytes() const;
+
+    BOOL
+    AddVectoredReadBytes(
+        DWORD cbRead
+    );
+
+    VOID
+    FillRequestInfo(
+        _Out_ IN_PROCESS_REQUEST_INFO* pRequestInfo
+    ) const;
+
     PVOID m_pManagedHttpContext;
     BOOL m_fManagedRequestComplete;
     REQUEST_NOTIFICATION_STATUS m_requestNotificationStatus;
     IHttpContext*               m_pW3Context;
-    std::unique_ptr<IN_PROCESS_APPLICATION, IAPPLICATION_DELETER> m_pApplication;
-    PFN_REQUEST_HANDLER         m_pRequestHandler;
-    void*                       m_pRequestHandlerContext;
-    PFN_ASYNC_COMPLETION_HANDLER m_pAsyncCompletionHandler;
-    PFN_DISCONNECT_HANDLER       m_pDisconnectHandler;
+    IN_PROCESS_APPLICATION*     m_pApplication;
+    const IN_PROCESS_HANDLER_CONTEXT* m_pHandlerContext;
     static ALLOC_CACHE_HANDLER *   sm_pAlloc;
     bool m_disconnectFired;
     SRWLOCK m_srwDisconnectLock;
 
+    // Holds one of the maxConcurrentRequests slots of the application.
+    bool m_fAdmitted;
+    // Queued for admission, the next completion is the one resuming it.
+    bool m_fAdmissionPending;
+
     std::mutex m_lockQueue;
     std::condition_variable m_queueCheck;
     bool m_queueNotified;
+
+    std::unique_ptr<WEBSOCKET_BUFFER[]> m_pWebSocketBuffers;
+    DWORD m_cWebSocketBuffers;
+
+    // Allocated on the first vectored read and reused by the later ones.
+    std::unique_ptr<READ_SEGMENT[]> m_pReadSegments;
+    DWORD m_cReadSegments;
+    DWORD m_iReadSegment;
+    DWORD m_cbVectoredRead;
+    bool m_fVectoredReadPending;
+
+    // Body bytes IIS holds that were not read yet, counted on the first
+    // read. Reading them synchronously cannot block.
+    DWORD m_cbBufferedEntity;
+    bool m_fBufferedEntityCounted;
+
+    // For the queue time of the native counters, 0 while they are off.
+    LONGLONG m_llCreated;
 };
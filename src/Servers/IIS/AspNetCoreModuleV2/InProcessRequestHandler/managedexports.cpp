@@ -5,55 +5,12 @@
 #include "inprocesshandler.h"
 #include "requesthandler_config.h"
 #include "EventLog.h"
+#include "HttpResponse4.h"
 
 extern bool g_fInProcessApplicationCreated;
 extern std::string g_errorPageContent;
 extern IHttpServer* g_pHttpServer;
 
-//
-// Add support for certain HTTP/2.0 features like trailing headers
-// and GOAWAY or RST_STREAM frames.
-//
-
-class __declspec(uuid("1a2acc57-cae2-4f28-b4ab-00c8f96b12ec"))
-    IHttpResponse4 : public IHttpResponse3
-{
-public:
-    virtual
-        HRESULT
-        DeleteTrailer(
-            _In_ PCSTR  pszHeaderName
-        ) = 0;
-
-    virtual
-        PCSTR
-        GetTrailer(
-            _In_  PCSTR    pszHeaderName,
-            _Out_ USHORT* pcchHeaderValue = NULL
-        ) const = 0;
-
-    virtual
-        VOID
-        ResetStream(
-            _In_ ULONG errorCode
-        ) = 0;
-
-    virtual
-        VOID
-        SetNeedGoAway(
-            VOID
-        ) = 0;
-
-    virtual
-        HRESULT
-        SetTrailer(
-            _In_ PCSTR  pszHeaderName,
-            _In_ PCSTR  pszHeaderValue,
-            _In_ USHORT cchHeaderValue,
-            _In_ BOOL fReplace
-        ) = 0;
-};
-
 //
 // Initialization export
 //
@@ -88,6 +45,35 @@ register_callbacks(
     return S_OK;
 }
 
+//
+// Optional, after register_callbacks. Requests are started through
+// request_info_handler from then on. dwVersion is the request info version
+// the caller was built against, a module older than that keeps starting
+// requests through the request callback.
+//
+EXTERN_C __declspec(dllexport)
+HRESULT
+register_request_info_callback(
+    _In_ IN_PROCESS_APPLICATION* pInProcessApplication,
+    _In_ PFN_REQUEST_INFO_HANDLER request_info_handler,
+    _In_ DWORD dwVersion
+)
+{
+    if (pInProcessApplication == NULL || request_info_handler == NULL || dwVersion == 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (dwVersion > IN_PROCESS_REQUEST_INFO_VERSION)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    pInProcessApplication->SetRequestInfoHandler(request_info_handler);
+
+    return S_OK;
+}
+
 EXTERN_C __declspec(dllexport)
 HTTP_REQUEST*
 http_get_raw_request(
@@ -137,6 +123,101 @@ Finished:
     return hr;
 }
 
+//
+// Same as http_get_server_variable without the copy: the value is the one
+// IIS keeps for the request, valid until the request completes or the
+// variable is set again. *ppszValue is NULL for a variable that is not set
+// or empty.
+//
+EXTERN_C __declspec(dllexport)
+HRESULT
+http_get_server_variable_view(
+    _In_ IN_PROCESS_HANDLER* pInProcessHandler,
+    _In_ PCSTR pszVariableName,
+    _Out_ PCWSTR* ppszValue,
+    _Out_ DWORD* pcchValue
+)
+{
+    PCWSTR pszVariableValue;
+    DWORD cchLength;
+
+    *ppszValue = NULL;
+    *pcchValue = 0;
+
+    HRESULT hr = pInProcessHandler
+        ->QueryHttpContext()
+        ->GetServerVariable(pszVariableName, &pszVariableValue, &cchLength);
+
+    if (SUCCEEDED(hr) && cchLength != 0)
+    {
+        *ppszValue = pszVariableValue;
+        *pcchValue = cchLength;
+    }
+
+    return hr;
+}
+
+//
+// Same as http_get_server_variable for cVariables variables at once. Each
+// value is copied NUL terminated into the caller's arena, at character
+// offset pdwOffsets[i] with pcchValues[i] characters; a variable that is
+// not set or empty gets an offset of MAXDWORD. If the arena is too small
+// the values that don't fit are left out and ERROR_INSUFFICIENT_BUFFER is
+// returned, *pcchRequired tells the size needed.
+//
+EXTERN_C __declspec(dllexport)
+HRESULT
+http_get_server_variables(
+    _In_ IN_PROCESS_HANDLER* pInProcessHandler,
+    _In_reads_(cVariables) PCSTR* ppszVariableNames,
+    _In_ DWORD cVariables,
+    _Out_writes_opt_(cchArena) PWSTR pwszArena,
+    _In_ DWORD cchArena,
+    _Out_writes_(cVariables) DWORD* pdwOffsets,
+    _Out_writes_(cVariables) DWORD* pcchValues,
+    _Out_ DWORD* pcchRequired
+)
+{
+    IHttpContext* pHttpContext = pInProcessHandler->QueryHttpContext();
+    DWORD cchRequired = 0;
+
+    *pcchRequired = 0;
+
+    for (DWORD i = 0; i < cVariables; i++)
+    {
+        PCWSTR pszVariableValue;
+        DWORD cchLength;
+
+        if (FAILED(pHttpContext->GetServerVariable(ppszVariableNames[i], &pszVariableValue, &cchLength)) ||
+            cchLength == 0)
+        {
+            pdwOffsets[i] = MAXDWORD;
+            pcchValues[i] = 0;
+            continue;
+        }
+
+        if (cchLength + 1 > MAXDWORD - cchRequired)
+        {
+            return HRESULT_FROM_WIN32(ERROR_ARITHMETIC_OVERFLOW);
+        }
+
+        pdwOffsets[i] = cchRequired;
+        pcchValues[i] = cchLength;
+
+        if (cchRequired + cchLength + 1 <= cchArena)
+        {
+            memcpy(pwszArena + cchRequired, pszVariableValue, cchLength * sizeof(WCHAR));
+            pwszArena[cchRequired + cchLength] = L'\0';
+        }
+
+        cchRequired += cchLength + 1;
+    }
+
+    *pcchRequired = cchRequired;
+
+    return cchRequired <= cchArena ? S_OK : HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+}
+
 EXTERN_C __declspec(dllexport)
 HRESULT
 http_set_server_variable(
@@ -252,16 +333,71 @@ http_get_application_properties(
 
     const auto& pConfiguration = pInProcessApplication->QueryConfig();
 
+    // The managed marshaller frees the strings, they are copied from the
+    // ones the application keeps.
+    auto allocString = [](const std::wstring& value)
+    {
+        return SysAllocStringLen(value.data(), static_cast<UINT>(value.size()));
+    };
+
     pIISConfigurationData->pInProcessApplication = pInProcessApplication;
-    pIISConfigurationData->pwzFullApplicationPath = SysAllocString(pInProcessApplication->QueryApplicationPhysicalPath().c_str());
-    pIISConfigurationData->pwzVirtualApplicationPath = SysAllocString(pInProcessApplication->QueryApplicationVirtualPath().c_str());
+    pIISConfigurationData->pwzFullApplicationPath = allocString(pInProcessApplication->QueryApplicationPhysicalPath());
+    pIISConfigurationData->pwzVirtualApplicationPath = allocString(pInProcessApplication->QueryApplicationVirtualPath());
     pIISConfigurationData->fWindowsAuthEnabled = pConfiguration.QueryWindowsAuthEnabled();
     pIISConfigurationData->fBasicAuthEnabled = pConfiguration.QueryBasicAuthEnabled();
     pIISConfigurationData->fAnonymousAuthEnable = pConfiguration.QueryAnonymousAuthEnabled();
+    pIISConfigurationData->pwzBindings = allocString(pInProcessApplication->QueryServerAddresses());
+    pIISConfigurationData->maxRequestBodySize = pConfiguration.QueryMaxRequestBodySizeLimit();
+    return S_OK;
+}
+
+//
+// Same as IISConfigurationData with the strings of the application rather
+// than copies of them, valid for the lifetime of the application.
+//
+struct IISConfigurationDataView
+{
+    IN_PROCESS_APPLICATION* pInProcessApplication;
+    PCWSTR pwzFullApplicationPath;
+    DWORD cchFullApplicationPath;
+    PCWSTR pwzVirtualApplicationPath;
+    DWORD cchVirtualApplicationPath;
+    PCWSTR pwzBindings;
+    DWORD cchBindings;
+    BOOL fWindowsAuthEnabled;
+    BOOL fBasicAuthEnabled;
+    BOOL fAnonymousAuthEnable;
+    DWORD maxRequestBodySize;
+};
+
+EXTERN_C __declspec(dllexport)
+HRESULT
+http_get_application_properties_view(
+    _Out_ IISConfigurationDataView* pIISConfigurationData
+)
+{
+    auto pInProcessApplication = IN_PROCESS_APPLICATION::GetInstance();
+    if (pInProcessApplication == NULL)
+    {
+        return E_FAIL;
+    }
+
+    const auto& pConfiguration = pInProcessApplication->QueryConfig();
+    const auto& physicalPath = pInProcessApplication->QueryApplicationPhysicalPath();
+    const auto& virtualPath = pInProcessApplication->QueryApplicationVirtualPath();
+    const auto& bindings = pInProcessApplication->QueryServerAddresses();
 
-    auto const serverAddresses = BindingInformation::Format(pConfiguration.QueryBindings(), pInProcessApplication->QueryApplicationVirtualPath());
-    pIISConfigurationData->pwzBindings = SysAllocString(serverAddresses.c_str());
-    pIISConfigurationData->maxRequestBodySize = pInProcessApplication->QueryConfig().QueryMaxRequestBodySizeLimit();
+    pIISConfigurationData->pInProcessApplication = pInProcessApplication;
+    pIISConfigurationData->pwzFullApplicationPath = physicalPath.c_str();
+    pIISConfigurationData->cchFullApplicationPath = static_cast<DWORD>(physicalPath.size());
+    pIISConfigurationData->pwzVirtualApplicationPath = virtualPath.c_str();
+    pIISConfigurationData->cchVirtualApplicationPath = static_cast<DWORD>(virtualPath.size());
+    pIISConfigurationData->pwzBindings = bindings.c_str();
+    pIISConfigurationData->cchBindings = static_cast<DWORD>(bindings.size());
+    pIISConfigurationData->fWindowsAuthEnabled = pConfiguration.QueryWindowsAuthEnabled();
+    pIISConfigurationData->fBasicAuthEnabled = pConfiguration.QueryBasicAuthEnabled();
+    pIISConfigurationData->fAnonymousAuthEnable = pConfiguration.QueryAnonymousAuthEnabled();
+    pIISConfigurationData->maxRequestBodySize = pConfiguration.QueryMaxRequestBodySizeLimit();
     return S_OK;
 }
 
@@ -275,8 +411,6 @@ http_read_request_bytes(
     _Out_ BOOL* pfCompletionPending
 )
 {
-    HRESULT hr = S_OK;
-
     if (pInProcessHandler == NULL)
     {
         return E_FAIL;
@@ -285,26 +419,31 @@ http_read_request_bytes(
     {
         return E_FAIL;
     }
-    IHttpRequest* pHttpRequest = (IHttpRequest*)pInProcessHandler->QueryHttpContext()->GetRequest();
 
-    // Check if there is anything to read
-    if (pHttpRequest->GetRemainingEntityBytes() > 0)
-    {
-        BOOL fAsync = TRUE;
-        hr = pHttpRequest->ReadEntityBody(
-            pvBuffer,
-            dwCbBuffer,
-            fAsync,
-            pdwBytesReceived,
-            pfCompletionPending);
-    }
-    else
+    return pInProcessHandler->ReadRequestBytes(pvBuffer, dwCbBuffer, pdwBytesReceived, pfCompletionPending);
+}
+
+//
+// Same as http_read_request_bytes, filling up to MAX_READ_SEGMENTS buffers
+// with one completion.
+//
+EXTERN_C __declspec(dllexport)
+HRESULT
+http_read_request_bytes_vectored(
+    _In_ IN_PROCESS_HANDLER* pInProcessHandler,
+    _In_ CHAR** ppSegments,
+    _In_ DWORD* pcbSegments,
+    _In_ DWORD cSegments,
+    _Out_ DWORD* pdwBytesReceived,
+    _Out_ BOOL* pfCompletionPending
+)
+{
+    if (pInProcessHandler == NULL)
     {
-        *pdwBytesReceived = 0;
-        *pfCompletionPending = FALSE;
+        return E_FAIL;
     }
 
-    return hr;
+    return pInProcessHandler->ReadRequestBytesVectored(ppSegments, pcbSegments, cSegments, pdwBytesReceived, pfCompletionPending);
 }
 
 EXTERN_C __declspec(dllexport)
@@ -332,6 +471,57 @@ http_write_response_bytes(
     return hr;
 }
 
+//
+// A file opened through the file handle cache of the application, sent
+// with an HttpDataChunkFromFileHandle chunk. The handle and the ETag stay
+// valid until http_release_cached_file is called with pEntry, after the
+// write that references the handle completed.
+//
+struct CachedFileInformation
+{
+    FileHandleCache::Entry* pEntry;
+    HANDLE hFile;
+    ULONGLONG cbFile;
+    FILETIME ftLastWriteTime;
+    PCSTR pszETag;
+};
+
+EXTERN_C __declspec(dllexport)
+HRESULT
+http_open_cached_file(
+    _In_ IN_PROCESS_APPLICATION* pInProcessApplication,
+    _In_ PCWSTR pszPhysicalPath,
+    _Out_ CachedFileInformation* pFileInformation
+)
+{
+    FileHandleCache::Entry* pEntry = nullptr;
+
+    *pFileInformation = {};
+
+    // Not logged, the managed server answers a missing file with a 404.
+    const HRESULT hr = pInProcessApplication->QueryFileHandleCache().Open(pszPhysicalPath, &pEntry);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    pFileInformation->pEntry = pEntry;
+    pFileInformation->hFile = pEntry->QueryHandle();
+    pFileInformation->cbFile = pEntry->QuerySize();
+    pFileInformation->ftLastWriteTime = pEntry->QueryLastWriteTime();
+    pFileInformation->pszETag = pEntry->QueryETag().c_str();
+    return S_OK;
+}
+
+EXTERN_C __declspec(dllexport)
+VOID
+http_release_cached_file(
+    _In_ FileHandleCache::Entry* pEntry
+)
+{
+    pEntry->Dereference();
+}
+
 EXTERN_C __declspec(dllexport)
 HRESULT
 http_flush_response_bytes(
@@ -353,6 +543,60 @@ http_flush_response_bytes(
     return hr;
 }
 
+//
+// Writes the last chunks of the response and ends it, the same as
+// http_write_response_bytes followed by http_flush_response_bytes without
+// more data, with one completion. Without response buffering the write
+// itself is the final send, otherwise the flush sends the headers and the
+// buffered chunks at once.
+//
+EXTERN_C __declspec(dllexport)
+HRESULT
+http_write_response_bytes_final(
+    _In_ IN_PROCESS_HANDLER* pInProcessHandler,
+    _In_ HTTP_DATA_CHUNK* pDataChunks,
+    _In_ DWORD dwChunks,
+    _In_ BOOL fDisconnect,
+    _Out_ BOOL* pfCompletionExpected
+)
+{
+    IHttpResponse* pHttpResponse = (IHttpResponse*)pInProcessHandler->QueryHttpContext()->GetResponse();
+    BOOL fAsync = TRUE;
+    BOOL fMoreData = FALSE;
+    DWORD dwBytesSent = 0;
+
+    *pfCompletionExpected = FALSE;
+
+    if (fDisconnect)
+    {
+        // HTTP_SEND_RESPONSE_FLAG_DISCONNECT on the final send
+        pHttpResponse->SetNeedDisconnect();
+    }
+
+    if (dwChunks > 0)
+    {
+        RETURN_IF_FAILED(pHttpResponse->WriteEntityChunks(
+            pDataChunks,
+            dwChunks,
+            fAsync,
+            fMoreData,
+            &dwBytesSent,
+            pfCompletionExpected));
+
+        // Went out to http.sys as the end of the response already.
+        if (*pfCompletionExpected)
+        {
+            return S_OK;
+        }
+    }
+
+    return pHttpResponse->Flush(
+        fAsync,
+        fMoreData,
+        &dwBytesSent,
+        pfCompletionExpected);
+}
+
 EXTERN_C __declspec(dllexport)
 HRESULT
 http_websockets_read_bytes(
@@ -411,6 +655,88 @@ http_websockets_write_bytes(
     return hr;
 }
 
+EXTERN_C __declspec(dllexport)
+HRESULT
+http_websockets_register_buffers(
+    _In_ IN_PROCESS_HANDLER* pInProcessHandler,
+    _In_ CHAR** ppBuffers,
+    _In_ DWORD* pcbBuffers,
+    _In_ DWORD cBuffers
+)
+{
+    return pInProcessHandler->RegisterWebSocketBuffers(ppBuffers, pcbBuffers, cBuffers);
+}
+
+//
+// Same as http_websockets_read_bytes, into the registered buffer dwIndex.
+//
+EXTERN_C __declspec(dllexport)
+HRESULT
+http_websockets_read_registered(
+    _In_ IN_PROCESS_HANDLER* pInProcessHandler,
+    _In_ DWORD dwIndex,
+    _In_ PFN_ASYNC_COMPLETION pfnCompletionCallback,
+    _In_ VOID* pvCompletionContext,
+    _In_ DWORD* pDwBytesReceived,
+    _In_ BOOL* pfCompletionPending
+)
+{
+    CHAR* pBuffer;
+    DWORD cbBuffer;
+
+    if (!pInProcessHandler->QueryWebSocketBuffer(dwIndex, &pBuffer, &cbBuffer))
+    {
+        return E_INVALIDARG;
+    }
+
+    return http_websockets_read_bytes(
+        pInProcessHandler,
+        pBuffer,
+        cbBuffer,
+        pfnCompletionCallback,
+        pvCompletionContext,
+        pDwBytesReceived,
+        pfCompletionPending);
+}
+
+//
+// Same as http_websockets_write_bytes, sending the first cbData bytes of
+// the registered buffer dwIndex.
+//
+EXTERN_C __declspec(dllexport)
+HRESULT
+http_websockets_write_registered(
+    _In_ IN_PROCESS_HANDLER* pInProcessHandler,
+    _In_ DWORD dwIndex,
+    _In_ DWORD cbData,
+    _In_ PFN_ASYNC_COMPLETION pfnCompletionCallback,
+    _In_ VOID* pvCompletionContext,
+    _In_ BOOL* pfCompletionExpected
+)
+{
+    HTTP_DATA_CHUNK dataChunk;
+    CHAR* pBuffer;
+    DWORD cbBuffer;
+
+    if (!pInProcessHandler->QueryWebSocketBuffer(dwIndex, &pBuffer, &cbBuffer) || cbData > cbBuffer)
+    {
+        return E_INVALIDARG;
+    }
+
+    // IIS copies the chunk array, only the data has to outlive the call.
+    dataChunk.DataChunkType = HttpDataChunkFromMemory;
+    dataChunk.FromMemory.pBuffer = pBuffer;
+    dataChunk.FromMemory.BufferLength = cbData;
+
+    return http_websockets_write_bytes(
+        pInProcessHandler,
+        &dataChunk,
+        1,
+        pfnCompletionCallback,
+        pvCompletionContext,
+        pfCompletionExpected);
+}
+
 EXTERN_C __declspec(dllexport)
 HRESULT
 http_websockets_flush_bytes(
@@ -504,6 +830,98 @@ http_response_set_known_header(
     return pInProcessHandler->QueryHttpContext()->GetResponse()->SetHeader(dwHeaderId, pszHeaderValue, usHeaderValueLength, fReplace);
 }
 
+//
+// One header of http_response_set_headers. A known header has a null
+// pszHeaderName and its HTTP_HEADER_ID in dwHeaderId, an unknown one a
+// null terminated name.
+//
+struct ResponseHeader
+{
+    PCSTR pszHeaderName;
+    PCSTR pszHeaderValue;
+    DWORD dwHeaderId;
+    USHORT usHeaderValueLength;
+    BOOL fReplace;
+};
+
+//
+// Sets cHeaders response headers at once, in order, as the calls to
+// http_response_set_known_header and http_response_set_unknown_header
+// would. Stops at the first one that fails, the ones before it are set.
+//
+EXTERN_C __declspec(dllexport)
+HRESULT
+http_response_set_headers(
+    _In_ IN_PROCESS_HANDLER* pInProcessHandler,
+    _In_reads_(cHeaders) const ResponseHeader* pHeaders,
+    _In_ DWORD cHeaders
+)
+{
+    IHttpResponse* pHttpResponse = pInProcessHandler->QueryHttpContext()->GetResponse();
+
+    for (DWORD i = 0; i < cHeaders; i++)
+    {
+        const ResponseHeader& header = pHeaders[i];
+        if (header.pszHeaderName == nullptr)
+        {
+            RETURN_IF_FAILED(pHttpResponse->SetHeader(static_cast<HTTP_HEADER_ID>(header.dwHeaderId), header.pszHeaderValue, header.usHeaderValueLength, header.fReplace));
+        }
+        else
+        {
+            RETURN_IF_FAILED(pHttpResponse->SetHeader(header.pszHeaderName, header.pszHeaderValue, header.usHeaderValueLength, header.fReplace));
+        }
+    }
+
+    return S_OK;
+}
+
+//
+// Lets http.sys serve the response from its kernel cache for
+// dwSecondsToLive, 0 keeps it out of the cache. Must be called before the
+// headers are sent. The vary by lists are comma separated and optional;
+// IIS only kernel caches responses it can serve without running the
+// pipeline, it falls back to sending the response uncached otherwise.
+//
+EXTERN_C __declspec(dllexport)
+HRESULT
+http_response_set_kernel_cache_policy(
+    _In_ IN_PROCESS_HANDLER* pInProcessHandler,
+    _In_ DWORD dwSecondsToLive,
+    _In_opt_ PCSTR pszVaryByHeaders,
+    _In_opt_ PCSTR pszVaryByQueryStrings
+)
+{
+    IHttpResponse* pHttpResponse = (IHttpResponse*)pInProcessHandler->QueryHttpContext()->GetResponse();
+
+    if (dwSecondsToLive == 0)
+    {
+        pHttpResponse->DisableKernelCache();
+        return S_OK;
+    }
+
+    IHttpCachePolicy* pCachePolicy = pHttpResponse->GetCachePolicy();
+    if (pCachePolicy == NULL)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    if (pszVaryByHeaders != NULL && *pszVaryByHeaders != '\0')
+    {
+        RETURN_IF_FAILED(pCachePolicy->AppendVaryByHeader(pszVaryByHeaders));
+    }
+
+    if (pszVaryByQueryStrings != NULL && *pszVaryByQueryStrings != '\0')
+    {
+        RETURN_IF_FAILED(pCachePolicy->AppendVaryByQueryString(pszVaryByQueryStrings));
+    }
+
+    HTTP_CACHE_POLICY* pKernelCachePolicy = pCachePolicy->GetKernelCachePolicy();
+    pKernelCachePolicy->Policy = HttpCachePolicyTimeToLive;
+    pKernelCachePolicy->SecondsToLive = dwSecondsToLive;
+
+    return S_OK;
+}
+
 EXTERN_C __declspec(dllexport)
 HRESULT
 http_get_authentication_information(
@@ -518,6 +936,28 @@ http_get_authentication_information(
     return S_OK;
 }
 
+//
+// Same as http_get_authentication_information with the authentication type
+// IIS keeps for the request, valid until the request completes.
+//
+EXTERN_C __declspec(dllexport)
+HRESULT
+http_get_authentication_information_view(
+    _In_ IN_PROCESS_HANDLER* pInProcessHandler,
+    _Out_ PCWSTR* ppszAuthType,
+    _Out_ DWORD* pcchAuthType,
+    _Out_ VOID** pvToken
+)
+{
+    IHttpUser* pUser = pInProcessHandler->QueryHttpContext()->GetUser();
+
+    *ppszAuthType = pUser->GetAuthenticationType();
+    *pcchAuthType = *ppszAuthType != NULL ? static_cast<DWORD>(wcslen(*ppszAuthType)) : 0;
+    *pvToken = pUser->GetPrimaryToken();
+
+    return S_OK;
+}
+
 EXTERN_C __declspec(dllexport)
 HRESULT
 http_stop_calls_into_managed(_In_ IN_PROCESS_APPLICATION* pInProcessApplication)
@@ -544,6 +984,28 @@ http_stop_incoming_requests(_In_ IN_PROCESS_APPLICATION* pInProcessApplication)
     return S_OK;
 }
 
+//
+// Called once by the managed server, which then polls the block itself.
+// *pdwVersion is the version of the block, as for the request info.
+//
+EXTERN_C __declspec(dllexport)
+HRESULT
+http_get_native_counters(
+    _In_ IN_PROCESS_APPLICATION* pInProcessApplication,
+    _Outptr_ const IN_PROCESS_NATIVE_COUNTERS** ppCounters,
+    _Out_ DWORD* pdwVersion
+)
+{
+    if (pInProcessApplication == NULL || ppCounters == NULL || pdwVersion == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    RETURN_IF_FAILED(pInProcessApplication->EnableNativeCounters(ppCounters));
+    *pdwVersion = (*ppCounters)->dwVersion;
+    return S_OK;
+}
+
 EXTERN_C __declspec(dllexport)
 VOID
 set_main_handler(_In_ hostfxr_main_fn main)
@@ -642,4 +1104,63 @@ http_query_request_property(
         pcbBytesReturned,
         pOverlapped);
 }
+#define IN_PROCESS_FAST_EXPORTS_VERSION 1
+
+//
+// Exports the managed server may call without a GC transition, through
+// unmanaged[SuppressGCTransition] function pointers. Each of them only
+// reads or sets state of the request IIS already holds: it does not
+// block, take a lock, allocate, call back into managed code or fail.
+// Exports that can do any of these, such as setting the status with its
+// reason phrase, stay out of it. Entries are only ever appended, cbSize
+// is the size of the table of the module.
+//
+struct IN_PROCESS_FAST_EXPORTS
+{
+    DWORD                   dwVersion;
+    DWORD                   cbSize;
+    HTTP_REQUEST*           (*pfnGetRawRequest)(IN_PROCESS_HANDLER* pInProcessHandler);
+    HTTP_RESPONSE*          (*pfnGetRawResponse)(IN_PROCESS_HANDLER* pInProcessHandler);
+    HRESULT                 (*pfnDisableBuffering)(IN_PROCESS_HANDLER* pInProcessHandler);
+    VOID                    (*pfnGetCompletionInfo)(IHttpCompletionInfo2* info, DWORD* cbBytes, HRESULT* hr);
+};
+
+static const IN_PROCESS_FAST_EXPORTS g_FastExports =
+{
+    IN_PROCESS_FAST_EXPORTS_VERSION,
+    sizeof(IN_PROCESS_FAST_EXPORTS),
+    http_get_raw_request,
+    http_get_raw_response,
+    http_disable_buffering,
+    http_get_completion_info,
+};
+
+//
+// The fast tier table, valid for the lifetime of the process. dwVersion is
+// the version the caller was built against, a module older than that
+// fails it and the caller keeps using the exports themselves.
+//
+EXTERN_C __declspec(dllexport)
+HRESULT
+http_get_fast_exports(
+    _In_ DWORD dwVersion,
+    _Out_ const IN_PROCESS_FAST_EXPORTS** ppExports
+)
+{
+    *ppExports = NULL;
+
+    if (dwVersion == 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (dwVersion > IN_PROCESS_FAST_EXPORTS_VERSION)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    *ppExports = &g_FastExports;
+    return S_OK;
+}
+
 // End of export
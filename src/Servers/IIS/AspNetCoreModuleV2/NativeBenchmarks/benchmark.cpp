@@ -0,0 +1,447 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+//
+// Zero initialized before any registration runs.
+//
+static BENCHMARK_REGISTRATION *     s_pFirstRegistration = NULL;
+static BENCHMARK_REGISTRATION **    s_ppNextRegistration = &s_pFirstRegistration;
+
+static constexpr ULONGLONG          MAX_ITERATIONS = 1000000000;
+
+BENCHMARK_REGISTRATION::BENCHMARK_REGISTRATION(
+    PCSTR           pszName,
+    PFN_BENCHMARK   pfnBenchmark,
+    DWORD           cThreads
+) : pszName(pszName),
+    pfnBenchmark(pfnBenchmark),
+    cThreads(cThreads),
+    pNext(NULL)
+{
+    *s_ppNextRegistration = this;
+    s_ppNextRegistration = &pNext;
+}
+
+__declspec(noinline)
+VOID
+BenchmarkUsePointer(
+    const volatile VOID *   pv
+)
+{
+    UNREFERENCED_PARAMETER(pv);
+}
+
+static
+ULONGLONG
+QueryThreadCpuTime(
+    VOID
+)
+{
+    FILETIME        ftCreation;
+    FILETIME        ftExit;
+    ULARGE_INTEGER  ulKernel;
+    ULARGE_INTEGER  ulUser;
+
+    if (!GetThreadTimes(GetCurrentThread(), &ftCreation, &ftExit,
+            reinterpret_cast<FILETIME *>(&ulKernel),
+            reinterpret_cast<FILETIME *>(&ulUser)))
+    {
+        return 0;
+    }
+
+    return ulKernel.QuadPart + ulUser.QuadPart;
+}
+
+VOID
+BENCHMARK_STATE::Start(
+    VOID
+)
+{
+    LARGE_INTEGER liCounter;
+
+    m_ullCpuStart = QueryThreadCpuTime();
+    QueryPerformanceCounter(&liCounter);
+    m_llStart = liCounter.QuadPart;
+}
+
+VOID
+BENCHMARK_STATE::Stop(
+    VOID
+)
+{
+    LARGE_INTEGER liCounter;
+
+    QueryPerformanceCounter(&liCounter);
+    m_llEnd = liCounter.QuadPart;
+    m_ullCpuEnd = QueryThreadCpuTime();
+}
+
+HRESULT
+BENCHMARK_RUNNER::RunOnce(
+    const BENCHMARK_REGISTRATION *  pRegistration,
+    ULONGLONG                       cIterations,
+    _Out_ RESULT *                  pResult
+)
+{
+    std::vector<BENCHMARK_STATE>    states;
+    volatile LONG                   cStarted = 0;
+    LARGE_INTEGER                   liFrequency;
+    LONGLONG                        llSlowest = 0;
+    ULONGLONG                       ullCpu = 0;
+    ULONGLONG                       cbPerIteration = 0;
+
+    ZeroMemory(pResult, sizeof(*pResult));
+    QueryPerformanceFrequency(&liFrequency);
+
+    try
+    {
+        states.reserve(pRegistration->cThreads);
+        for (DWORD i = 0; i < pRegistration->cThreads; i++)
+        {
+            states.emplace_back(cIterations, i, pRegistration->cThreads);
+        }
+
+        if (pRegistration->cThreads == 1)
+        {
+            pRegistration->pfnBenchmark(states[0]);
+        }
+        else
+        {
+            std::vector<std::thread> threads;
+
+            //
+            // The threads all start their loop once every one of them runs.
+            // They spin rather than wait so that none is still being woken
+            // up when the others start.
+            //
+            threads.reserve(pRegistration->cThreads);
+            try
+            {
+                for (auto& state : states)
+                {
+                    threads.emplace_back([&cStarted, &state, pRegistration]()
+                        {
+                            InterlockedIncrement(&cStarted);
+                            while (static_cast<DWORD>(cStarted) < pRegistration->cThreads)
+                            {
+                                YieldProcessor();
+                            }
+
+                            pRegistration->pfnBenchmark(state);
+                        });
+                }
+            }
+            catch (const std::system_error &)
+            {
+                // Lets the threads that exist go, they must be joined.
+                InterlockedExchange(&cStarted, MAXLONG);
+                for (auto& thread : threads)
+                {
+                    thread.join();
+                }
+                throw;
+            }
+
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+        }
+    }
+    catch (const std::bad_alloc &)
+    {
+        return E_OUTOFMEMORY;
+    }
+    catch (const std::system_error & error)
+    {
+        return HRESULT_FROM_WIN32(error.code().value());
+    }
+
+    for (const auto& state : states)
+    {
+        if (state.m_llEnd == 0)
+        {
+            // The benchmark returned without finishing its loop.
+            return E_UNEXPECTED;
+        }
+
+        llSlowest = max(llSlowest, state.m_llEnd - state.m_llStart);
+        ullCpu += state.m_ullCpuEnd - state.m_ullCpuStart;
+        cbPerIteration = max(cbPerIteration, state.m_cbPerIteration);
+    }
+
+    const double dblElapsedNs = static_cast<double>(llSlowest) * 1e9 / static_cast<double>(liFrequency.QuadPart);
+
+    pResult->cIterations = cIterations;
+    pResult->dblRealTimeNs = dblElapsedNs / static_cast<double>(cIterations);
+    pResult->dblCpuTimeNs = static_cast<double>(ullCpu) * 100.0 / pRegistration->cThreads / static_cast<double>(cIterations);
+    pResult->dblBytesPerSecond = dblElapsedNs == 0 ? 0 :
+        static_cast<double>(cbPerIteration) * cIterations * pRegistration->cThreads * 1e9 / dblElapsedNs;
+
+    return S_OK;
+}
+
+static
+double
+Median(
+    std::vector<double> & values
+)
+{
+    std::sort(values.begin(), values.end());
+
+    const SIZE_T i = values.size() / 2;
+    return values.size() % 2 == 0 ? (values[i - 1] + values[i]) / 2 : values[i];
+}
+
+HRESULT
+BENCHMARK_RUNNER::Run(
+    FILE *      pOutput
+)
+{
+    WriteHeader(pOutput);
+
+    for (const BENCHMARK_REGISTRATION * pRegistration = s_pFirstRegistration;
+         pRegistration != NULL;
+         pRegistration = pRegistration->pNext)
+    {
+        std::vector<RESULT>     results;
+        RESULT                  result;
+        ULONGLONG               cIterations = 1;
+
+        if (m_pszFilter != NULL && strstr(pRegistration->pszName, m_pszFilter) == NULL)
+        {
+            continue;
+        }
+
+        //
+        // Grows the iteration count until a run lasts the minimum time, the
+        // way Google Benchmark does. The runs doing so double as warmup.
+        //
+        for (;;)
+        {
+            RETURN_IF_FAILED(RunOnce(pRegistration, cIterations, &result));
+
+            const double dblElapsedMs = result.dblRealTimeNs * cIterations / 1e6;
+            if (dblElapsedMs >= m_dwMinTimeMs || cIterations >= MAX_ITERATIONS)
+            {
+                break;
+            }
+
+            double dblMultiplier = m_dwMinTimeMs * 1.4 / max(dblElapsedMs, 1e-6);
+            if (dblElapsedMs < m_dwMinTimeMs / 10.0)
+            {
+                dblMultiplier = min(dblMultiplier, 10.0);
+            }
+
+            cIterations = min(MAX_ITERATIONS,
+                max(cIterations + 1, static_cast<ULONGLONG>(cIterations * dblMultiplier)));
+        }
+
+        try
+        {
+            for (DWORD i = 0; i < m_cRepetitions; i++)
+            {
+                RETURN_IF_FAILED(RunOnce(pRegistration, cIterations, &result));
+                results.push_back(result);
+                WriteResult(pOutput, pRegistration, NULL, i, result);
+            }
+        }
+        CATCH_RETURN();
+
+        if (results.size() > 1)
+        {
+            RESULT mean = {};
+            RESULT median = {};
+            RESULT stddev = {};
+            std::vector<double> realTimes;
+            std::vector<double> cpuTimes;
+            std::vector<double> bytesPerSecond;
+
+            try
+            {
+                for (const auto& repetition : results)
+                {
+                    mean.dblRealTimeNs += repetition.dblRealTimeNs / results.size();
+                    mean.dblCpuTimeNs += repetition.dblCpuTimeNs / results.size();
+                    mean.dblBytesPerSecond += repetition.dblBytesPerSecond / results.size();
+                    realTimes.push_back(repetition.dblRealTimeNs);
+                    cpuTimes.push_back(repetition.dblCpuTimeNs);
+                    bytesPerSecond.push_back(repetition.dblBytesPerSecond);
+                }
+            }
+            CATCH_RETURN();
+
+            for (const auto& repetition : results)
+            {
+                stddev.dblRealTimeNs += (repetition.dblRealTimeNs - mean.dblRealTimeNs) * (repetition.dblRealTimeNs - mean.dblRealTimeNs);
+                stddev.dblCpuTimeNs += (repetition.dblCpuTimeNs - mean.dblCpuTimeNs) * (repetition.dblCpuTimeNs - mean.dblCpuTimeNs);
+                stddev.dblBytesPerSecond += (repetition.dblBytesPerSecond - mean.dblBytesPerSecond) * (repetition.dblBytesPerSecond - mean.dblBytesPerSecond);
+            }
+
+            // Sample standard deviation, as Google Benchmark reports it.
+            stddev.dblRealTimeNs = sqrt(stddev.dblRealTimeNs / (results.size() - 1));
+            stddev.dblCpuTimeNs = sqrt(stddev.dblCpuTimeNs / (results.size() - 1));
+            stddev.dblBytesPerSecond = sqrt(stddev.dblBytesPerSecond / (results.size() - 1));
+
+            median.dblRealTimeNs = Median(realTimes);
+            median.dblCpuTimeNs = Median(cpuTimes);
+            median.dblBytesPerSecond = Median(bytesPerSecond);
+
+            mean.cIterations = median.cIterations = stddev.cIterations = cIterations;
+
+            WriteResult(pOutput, pRegistration, "mean", 0, mean);
+            WriteResult(pOutput, pRegistration, "median", 0, median);
+            WriteResult(pOutput, pRegistration, "stddev", 0, stddev);
+        }
+    }
+
+    WriteFooter(pOutput);
+
+    return S_OK;
+}
+
+static
+VOID
+WriteJsonString(
+    FILE *      pOutput,
+    PCSTR       psz
+)
+{
+    fputc('"', pOutput);
+    for (; *psz != '\0'; psz++)
+    {
+        if (*psz == '"' || *psz == '\\')
+        {
+            fputc('\\', pOutput);
+        }
+        fputc(*psz, pOutput);
+    }
+    fputc('"', pOutput);
+}
+
+VOID
+BENCHMARK_RUNNER::WriteHeader(
+    FILE *      pOutput
+)
+{
+    SYSTEM_INFO     systemInfo;
+    SYSTEMTIME      time;
+    CHAR            achHostName[MAX_COMPUTERNAME_LENGTH + 1] = "";
+    DWORD           cchHostName = _countof(achHostName);
+    CHAR            achExecutable[MAX_PATH] = "";
+
+    switch (m_format)
+    {
+    case FORMAT_JSON:
+        GetSystemInfo(&systemInfo);
+        GetLocalTime(&time);
+        GetComputerNameA(achHostName, &cchHostName);
+        GetModuleFileNameA(NULL, achExecutable, _countof(achExecutable));
+
+        fprintf(pOutput, "{\n  \"context\": {\n");
+        fprintf(pOutput, "    \"date\": \"%04u-%02u-%02uT%02u:%02u:%02u\",\n",
+            time.wYear, time.wMonth, time.wDay, time.wHour, time.wMinute, time.wSecond);
+        fprintf(pOutput, "    \"host_name\": ");
+        WriteJsonString(pOutput, achHostName);
+        fprintf(pOutput, ",\n    \"executable\": ");
+        WriteJsonString(pOutput, achExecutable);
+        fprintf(pOutput, ",\n    \"num_cpus\": %lu,\n", systemInfo.dwNumberOfProcessors);
+#ifdef _DEBUG
+        fprintf(pOutput, "    \"library_build_type\": \"debug\"\n");
+#else
+        fprintf(pOutput, "    \"library_build_type\": \"release\"\n");
+#endif
+        fprintf(pOutput, "  },\n  \"benchmarks\": [");
+        break;
+
+    case FORMAT_CSV:
+        fprintf(pOutput, "name,iterations,real_time,cpu_time,time_unit,bytes_per_second\n");
+        break;
+
+    default:
+        fprintf(pOutput, "%-48s %14s %14s %14s %16s\n", "Benchmark", "Time (ns)", "CPU (ns)", "Iterations", "Bytes/s");
+        break;
+    }
+}
+
+VOID
+BENCHMARK_RUNNER::WriteResult(
+    FILE *                          pOutput,
+    const BENCHMARK_REGISTRATION *  pRegistration,
+    PCSTR                           pszAggregate,
+    DWORD                           dwRepetition,
+    const RESULT &                  result
+)
+{
+    CHAR    achName[256];
+
+    if (pszAggregate == NULL)
+    {
+        StringCchCopyA(achName, _countof(achName), pRegistration->pszName);
+    }
+    else
+    {
+        StringCchPrintfA(achName, _countof(achName), "%s_%s", pRegistration->pszName, pszAggregate);
+    }
+
+    switch (m_format)
+    {
+    case FORMAT_JSON:
+        fprintf(pOutput, "%s\n    {\n", m_cRun == 0 ? "" : ",");
+        fprintf(pOutput, "      \"name\": ");
+        WriteJsonString(pOutput, achName);
+        fprintf(pOutput, ",\n      \"run_name\": ");
+        WriteJsonString(pOutput, pRegistration->pszName);
+        if (pszAggregate == NULL)
+        {
+            fprintf(pOutput, ",\n      \"run_type\": \"iteration\",\n");
+            fprintf(pOutput, "      \"repetition_index\": %lu,\n", dwRepetition);
+        }
+        else
+        {
+            fprintf(pOutput, ",\n      \"run_type\": \"aggregate\",\n");
+            fprintf(pOutput, "      \"aggregate_name\": \"%s\",\n", pszAggregate);
+        }
+        fprintf(pOutput, "      \"repetitions\": %lu,\n", m_cRepetitions);
+        fprintf(pOutput, "      \"threads\": %lu,\n", pRegistration->cThreads);
+        fprintf(pOutput, "      \"iterations\": %llu,\n", result.cIterations);
+        fprintf(pOutput, "      \"real_time\": %.6e,\n", result.dblRealTimeNs);
+        fprintf(pOutput, "      \"cpu_time\": %.6e,\n", result.dblCpuTimeNs);
+        fprintf(pOutput, "      \"time_unit\": \"ns\"");
+        if (result.dblBytesPerSecond != 0)
+        {
+            fprintf(pOutput, ",\n      \"bytes_per_second\": %.6e", result.dblBytesPerSecond);
+        }
+        fprintf(pOutput, "\n    }");
+        break;
+
+    case FORMAT_CSV:
+        fprintf(pOutput, "\"%s\",%llu,%.6e,%.6e,ns,", achName, result.cIterations, result.dblRealTimeNs, result.dblCpuTimeNs);
+        if (result.dblBytesPerSecond != 0)
+        {
+            fprintf(pOutput, "%.6e", result.dblBytesPerSecond);
+        }
+        fprintf(pOutput, "\n");
+        break;
+
+    default:
+        fprintf(pOutput, "%-48s %14.2f %14.2f %14llu %16.0f\n", achName, result.dblRealTimeNs, result.dblCpuTimeNs, result.cIterations, result.dblBytesPerSecond);
+        break;
+    }
+
+    m_cRun++;
+    fflush(pOutput);
+}
+
+VOID
+BENCHMARK_RUNNER::WriteFooter(
+    FILE *      pOutput
+)
+{
+    if (m_format == FORMAT_JSON)
+    {
+        fprintf(pOutput, "\n  ]\n}\n");
+    }
+}
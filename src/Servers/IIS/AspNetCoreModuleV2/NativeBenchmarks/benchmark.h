@@ -0,0 +1,261 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// Minimal harness in the style of Google Benchmark. A benchmark is a
+// function looping on BENCHMARK_STATE::KeepRunning, registered with
+// BENCHMARK or BENCHMARK_THREADS:
+//
+//  static VOID StraCopy(BENCHMARK_STATE & state)
+//  {
+//      STRA str;
+//      while (state.KeepRunning())
+//      {
+//          str.Copy("...");
+//      }
+//  }
+//  BENCHMARK(StraCopy);
+//
+// Only the loop is timed, setup before it and teardown after it are not.
+// A benchmark that fails its setup returns without looping, which fails
+// the run. The runner picks the iteration count so that a repetition lasts at
+// least the minimum time, and writes the results as Google Benchmark
+// JSON so that its compare tooling works on them.
+//
+
+class BENCHMARK_STATE
+{
+public:
+
+    BENCHMARK_STATE(
+        ULONGLONG   cIterations,
+        DWORD       dwThreadIndex,
+        DWORD       cThreads
+    ) : m_cIterations(cIterations),
+        m_cRemaining(cIterations),
+        m_dwThreadIndex(dwThreadIndex),
+        m_cThreads(cThreads),
+        m_cbPerIteration(0),
+        m_llStart(0),
+        m_llEnd(0),
+        m_ullCpuStart(0),
+        m_ullCpuEnd(0)
+    {
+    }
+
+    __forceinline
+    bool
+    KeepRunning(
+        VOID
+    )
+    {
+        if (m_cRemaining == m_cIterations)
+        {
+            Start();
+        }
+
+        if (m_cRemaining != 0)
+        {
+            --m_cRemaining;
+            return true;
+        }
+
+        Stop();
+        return false;
+    }
+
+    ULONGLONG
+    QueryIterations(
+        VOID
+    ) const
+    {
+        return m_cIterations;
+    }
+
+    DWORD
+    QueryThreadIndex(
+        VOID
+    ) const
+    {
+        return m_dwThreadIndex;
+    }
+
+    DWORD
+    QueryThreadCount(
+        VOID
+    ) const
+    {
+        return m_cThreads;
+    }
+
+    //
+    // Bytes an iteration processes, reported as bytes_per_second.
+    //
+    VOID
+    SetBytesPerIteration(
+        ULONGLONG   cbPerIteration
+    )
+    {
+        m_cbPerIteration = cbPerIteration;
+    }
+
+private:
+
+    friend class BENCHMARK_RUNNER;
+
+    VOID
+    Start(
+        VOID
+    );
+
+    VOID
+    Stop(
+        VOID
+    );
+
+    const ULONGLONG     m_cIterations;
+    ULONGLONG           m_cRemaining;
+    const DWORD         m_dwThreadIndex;
+    const DWORD         m_cThreads;
+    ULONGLONG           m_cbPerIteration;
+    // QueryPerformanceCounter values
+    LONGLONG            m_llStart;
+    LONGLONG            m_llEnd;
+    // Thread times, in 100ns units
+    ULONGLONG           m_ullCpuStart;
+    ULONGLONG           m_ullCpuEnd;
+};
+
+typedef
+VOID
+(*PFN_BENCHMARK)(
+    BENCHMARK_STATE &   state
+);
+
+//
+// Benchmarks register themselves from static constructors, the order of
+// a file is kept.
+//
+struct BENCHMARK_REGISTRATION
+{
+    BENCHMARK_REGISTRATION(
+        PCSTR           pszName,
+        PFN_BENCHMARK   pfnBenchmark,
+        DWORD           cThreads
+    );
+
+    PCSTR                       pszName;
+    PFN_BENCHMARK               pfnBenchmark;
+    DWORD                       cThreads;
+    BENCHMARK_REGISTRATION *    pNext;
+};
+
+#define BENCHMARK(function) \
+    static BENCHMARK_REGISTRATION s_benchmark_##function(#function, function, 1)
+
+//
+// Runs the function on cThreads threads at once, each looping the same
+// number of iterations, for contention. The time reported is the one of
+// the slowest thread.
+//
+#define BENCHMARK_THREADS(function, threads) \
+    static BENCHMARK_REGISTRATION s_benchmark_##function##_##threads(#function "/threads:" #threads, function, threads)
+
+//
+// Keeps the compiler from discarding a result the benchmark computes but
+// never uses.
+//
+VOID
+BenchmarkUsePointer(
+    const volatile VOID *   pv
+);
+
+template <class T>
+__forceinline
+VOID
+DoNotOptimize(
+    const T &   value
+)
+{
+    BenchmarkUsePointer(&reinterpret_cast<const volatile char &>(value));
+    _ReadWriteBarrier();
+}
+
+class BENCHMARK_RUNNER
+{
+public:
+
+    enum FORMAT
+    {
+        FORMAT_CONSOLE = 0,
+        FORMAT_JSON,
+        FORMAT_CSV
+    };
+
+    BENCHMARK_RUNNER(
+        FORMAT      format,
+        PCSTR       pszFilter,
+        DWORD       cRepetitions,
+        DWORD       dwMinTimeMs
+    ) : m_format(format),
+        m_pszFilter(pszFilter),
+        m_cRepetitions(cRepetitions),
+        m_dwMinTimeMs(dwMinTimeMs),
+        m_cRun(0)
+    {
+    }
+
+    //
+    // Runs the registered benchmarks whose name contains the filter and
+    // writes the results to pOutput.
+    //
+    HRESULT
+    Run(
+        FILE *      pOutput
+    );
+
+private:
+
+    struct RESULT
+    {
+        ULONGLONG   cIterations;
+        double      dblRealTimeNs;
+        double      dblCpuTimeNs;
+        double      dblBytesPerSecond;
+    };
+
+    HRESULT
+    RunOnce(
+        const BENCHMARK_REGISTRATION *  pRegistration,
+        ULONGLONG                       cIterations,
+        _Out_ RESULT *                  pResult
+    );
+
+    VOID
+    WriteHeader(
+        FILE *      pOutput
+    );
+
+    VOID
+    WriteResult(
+        FILE *                          pOutput,
+        const BENCHMARK_REGISTRATION *  pRegistration,
+        PCSTR                           pszAggregate,
+        DWORD                           dwRepetition,
+        const RESULT &                  result
+    );
+
+    VOID
+    WriteFooter(
+        FILE *      pOutput
+    );
+
+    FORMAT      m_format;
+    PCSTR       m_pszFilter;
+    DWORD       m_cRepetitions;
+    DWORD       m_dwMinTimeMs;
+    // Results written so far, for the JSON separators
+    DWORD       m_cRun;
+};
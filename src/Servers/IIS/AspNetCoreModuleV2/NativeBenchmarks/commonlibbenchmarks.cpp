@@ -0,0 +1,38 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+//
+// BindingInformation
+//
+
+static
+VOID
+BindingInformationFormat(
+    BENCHMARK_STATE &   state
+)
+{
+    std::vector<BindingInformation> bindings;
+
+    try
+    {
+        // A site with the usual http and https bindings, and a host name.
+        bindings.emplace_back(L"http", L"*:80:");
+        bindings.emplace_back(L"https", L"*:443:");
+        bindings.emplace_back(L"http", L"*:8080:www.example.com");
+    }
+    catch (const std::bad_alloc &)
+    {
+        return;
+    }
+
+    const std::wstring basePath = L"/app";
+
+    while (state.KeepRunning())
+    {
+        std::wstring result = BindingInformation::Format(bindings, basePath);
+        DoNotOptimize(result);
+    }
+}
+BENCHMARK(BindingInformationFormat);
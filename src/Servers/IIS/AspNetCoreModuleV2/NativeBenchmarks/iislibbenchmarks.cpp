@@ -0,0 +1,503 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+//
+// STRA and STRU
+//
+
+static const CHAR   s_achAscii[] = "/app/api/values/42?culture=en-US&format=json&fields=name,value";
+static const WCHAR  s_awchAscii[] = L"/app/api/values/42?culture=en-US&format=json&fields=name,value";
+// Escaped both as a URL and as UTF-8.
+static const CHAR   s_achUrl[] = "/app/some path/<document>%20name?query#fragment";
+// Mostly two and three byte UTF-8 sequences.
+static const WCHAR  s_awchUnicode[] = L"/app/\u00e9t\u00e9/\u4e2d\u6587/\u0440\u0443\u0441\u0441\u043a\u0438\u0439/caf\u00e9";
+static const CHAR   s_achUtf8[] = u8"/app/\u00e9t\u00e9/\u4e2d\u6587/\u0440\u0443\u0441\u0441\u043a\u0438\u0439/caf\u00e9";
+
+static
+VOID
+StraCopy(
+    BENCHMARK_STATE &   state
+)
+{
+    STRA str;
+
+    state.SetBytesPerIteration(sizeof(s_achAscii) - 1);
+    while (state.KeepRunning())
+    {
+        str.Copy(s_achAscii, sizeof(s_achAscii) - 1);
+        DoNotOptimize(str);
+    }
+}
+BENCHMARK(StraCopy);
+
+static
+VOID
+StruCopy(
+    BENCHMARK_STATE &   state
+)
+{
+    STRU str;
+
+    state.SetBytesPerIteration(sizeof(s_awchAscii) - sizeof(WCHAR));
+    while (state.KeepRunning())
+    {
+        str.Copy(s_awchAscii, _countof(s_awchAscii) - 1);
+        DoNotOptimize(str);
+    }
+}
+BENCHMARK(StruCopy);
+
+static
+VOID
+StraCopyAndEscape(
+    BENCHMARK_STATE &   state
+)
+{
+    STRA str;
+
+    state.SetBytesPerIteration(sizeof(s_achUrl) - 1);
+    while (state.KeepRunning())
+    {
+        str.Copy(s_achUrl, sizeof(s_achUrl) - 1);
+        str.Escape();
+        DoNotOptimize(str);
+    }
+}
+BENCHMARK(StraCopyAndEscape);
+
+static
+VOID
+StraCopyAndEscapeAscii(
+    BENCHMARK_STATE &   state
+)
+{
+    STRA str;
+
+    // Nothing to escape, the common case of a request URL.
+    state.SetBytesPerIteration(sizeof(s_achAscii) - 1);
+    while (state.KeepRunning())
+    {
+        str.Copy(s_achAscii, sizeof(s_achAscii) - 1);
+        str.Escape();
+        DoNotOptimize(str);
+    }
+}
+BENCHMARK(StraCopyAndEscapeAscii);
+
+static
+VOID
+StraCopyWToUtf8Escaped(
+    BENCHMARK_STATE &   state
+)
+{
+    STRA str;
+
+    state.SetBytesPerIteration(sizeof(s_awchUnicode) - sizeof(WCHAR));
+    while (state.KeepRunning())
+    {
+        str.CopyWToUTF8Escaped(s_awchUnicode, _countof(s_awchUnicode) - 1);
+        DoNotOptimize(str);
+    }
+}
+BENCHMARK(StraCopyWToUtf8Escaped);
+
+static
+VOID
+StraCopyWUtf8(
+    BENCHMARK_STATE &   state
+)
+{
+    STRA str;
+
+    state.SetBytesPerIteration(sizeof(s_awchUnicode) - sizeof(WCHAR));
+    while (state.KeepRunning())
+    {
+        str.CopyW(s_awchUnicode, _countof(s_awchUnicode) - 1);
+        DoNotOptimize(str);
+    }
+}
+BENCHMARK(StraCopyWUtf8);
+
+static
+VOID
+StraCopyWAscii(
+    BENCHMARK_STATE &   state
+)
+{
+    STRA str;
+
+    state.SetBytesPerIteration(sizeof(s_awchAscii) - sizeof(WCHAR));
+    while (state.KeepRunning())
+    {
+        str.CopyW(s_awchAscii, _countof(s_awchAscii) - 1);
+        DoNotOptimize(str);
+    }
+}
+BENCHMARK(StraCopyWAscii);
+
+static
+VOID
+StruCopyAUtf8(
+    BENCHMARK_STATE &   state
+)
+{
+    STRU str;
+
+    state.SetBytesPerIteration(sizeof(s_achUtf8) - 1);
+    while (state.KeepRunning())
+    {
+        str.CopyA(s_achUtf8, sizeof(s_achUtf8) - 1);
+        DoNotOptimize(str);
+    }
+}
+BENCHMARK(StruCopyAUtf8);
+
+//
+// HASH_TABLE
+//
+
+class BENCHMARK_HASH_RECORD
+{
+public:
+
+    HRESULT
+    Initialize(
+        PCWSTR  pszKey
+    )
+    {
+        return m_strKey.Copy(pszKey);
+    }
+
+    PCWSTR
+    QueryKey(
+        VOID
+    ) const
+    {
+        return m_strKey.QueryStr();
+    }
+
+private:
+
+    STRU    m_strKey;
+};
+
+//
+// The records outlive the table, so referencing them is free and only the
+// lookup itself is measured.
+//
+class BENCHMARK_HASH : public HASH_TABLE<BENCHMARK_HASH_RECORD, PCWSTR>
+{
+public:
+
+    VOID
+    ReferenceRecord(
+        BENCHMARK_HASH_RECORD * pRecord
+    ) override
+    {
+        UNREFERENCED_PARAMETER(pRecord);
+    }
+
+    VOID
+    DereferenceRecord(
+        BENCHMARK_HASH_RECORD * pRecord
+    ) override
+    {
+        UNREFERENCED_PARAMETER(pRecord);
+    }
+
+    PCWSTR
+    ExtractKey(
+        BENCHMARK_HASH_RECORD * pRecord
+    ) override
+    {
+        return pRecord->QueryKey();
+    }
+
+    DWORD
+    CalcKeyHash(
+        PCWSTR  key
+    ) override
+    {
+        return HashStringNoCase(key);
+    }
+
+    BOOL
+    EqualKeys(
+        PCWSTR  key1,
+        PCWSTR  key2
+    ) override
+    {
+        return _wcsicmp(key1, key2) == 0;
+    }
+};
+
+//
+// Shared by the threads of a benchmark, built by the first one.
+//
+class HASH_TABLE_FIXTURE
+{
+public:
+
+    static constexpr DWORD  RECORDS = 256;
+
+    HASH_TABLE_FIXTURE() :
+        m_hr(S_OK)
+    {
+        for (DWORD i = 0; i < RECORDS && SUCCEEDED(m_hr); i++)
+        {
+            WCHAR achKey[32];
+
+            if (FAILED(m_hr = StringCchPrintfW(achKey, _countof(achKey), L"ENVIRONMENT_VARIABLE_%03lu", i)) ||
+                FAILED(m_hr = m_rgRecords[i].Initialize(achKey)) ||
+                FAILED(m_hr = StringCchPrintfW(m_rgachLookups[i], _countof(m_rgachLookups[i]), L"environment_variable_%03lu", i)))
+            {
+                break;
+            }
+        }
+
+        if (SUCCEEDED(m_hr))
+        {
+            m_hr = m_table.Initialize(RECORDS / 4);
+        }
+
+        for (DWORD i = 0; i < RECORDS && SUCCEEDED(m_hr); i++)
+        {
+            m_hr = m_table.InsertRecord(&m_rgRecords[i]);
+        }
+    }
+
+    ~HASH_TABLE_FIXTURE()
+    {
+        m_table.Clear();
+    }
+
+    static
+    HASH_TABLE_FIXTURE &
+    Get(
+        VOID
+    )
+    {
+        static HASH_TABLE_FIXTURE fixture;
+        return fixture;
+    }
+
+    HRESULT                 m_hr;
+    BENCHMARK_HASH          m_table;
+    BENCHMARK_HASH_RECORD   m_rgRecords[RECORDS];
+    // Same keys as the records, in another case.
+    WCHAR                   m_rgachLookups[RECORDS][32];
+};
+
+static
+VOID
+HashTableFindKey(
+    BENCHMARK_STATE &   state
+)
+{
+    HASH_TABLE_FIXTURE &    fixture = HASH_TABLE_FIXTURE::Get();
+    DWORD                   i = state.QueryThreadIndex() * 17;
+
+    if (FAILED(fixture.m_hr))
+    {
+        return;
+    }
+
+    while (state.KeepRunning())
+    {
+        BENCHMARK_HASH_RECORD * pRecord = NULL;
+
+        fixture.m_table.FindKey(fixture.m_rgachLookups[i++ % HASH_TABLE_FIXTURE::RECORDS], &pRecord);
+        DoNotOptimize(pRecord);
+    }
+}
+BENCHMARK(HashTableFindKey);
+BENCHMARK_THREADS(HashTableFindKey, 4);
+
+static
+VOID
+HashTableFindKeyMiss(
+    BENCHMARK_STATE &   state
+)
+{
+    HASH_TABLE_FIXTURE &    fixture = HASH_TABLE_FIXTURE::Get();
+
+    if (FAILED(fixture.m_hr))
+    {
+        return;
+    }
+
+    while (state.KeepRunning())
+    {
+        BENCHMARK_HASH_RECORD * pRecord = NULL;
+
+        fixture.m_table.FindKey(L"ENVIRONMENT_VARIABLE_NONE", &pRecord);
+        DoNotOptimize(pRecord);
+    }
+}
+BENCHMARK(HashTableFindKeyMiss);
+
+//
+// ALLOC_CACHE_HANDLER
+//
+
+class ALLOC_CACHE_FIXTURE
+{
+public:
+
+    // The size of a FORWARDING_HANDLER is in this range.
+    static constexpr DWORD  OBJECT_SIZE = 1024;
+
+    ALLOC_CACHE_FIXTURE()
+    {
+        m_hr = m_allocator.Initialize(OBJECT_SIZE, 64);
+    }
+
+    static
+    ALLOC_CACHE_FIXTURE &
+    Get(
+        VOID
+    )
+    {
+        static ALLOC_CACHE_FIXTURE fixture;
+        return fixture;
+    }
+
+    HRESULT                 m_hr;
+    ALLOC_CACHE_HANDLER     m_allocator;
+};
+
+static
+VOID
+AllocCacheAllocFree(
+    BENCHMARK_STATE &   state
+)
+{
+    ALLOC_CACHE_FIXTURE & fixture = ALLOC_CACHE_FIXTURE::Get();
+
+    if (FAILED(fixture.m_hr))
+    {
+        return;
+    }
+
+    while (state.KeepRunning())
+    {
+        LPVOID pv = fixture.m_allocator.Alloc();
+        DoNotOptimize(pv);
+        if (pv != NULL)
+        {
+            fixture.m_allocator.Free(pv);
+        }
+    }
+}
+BENCHMARK(AllocCacheAllocFree);
+BENCHMARK_THREADS(AllocCacheAllocFree, 2);
+BENCHMARK_THREADS(AllocCacheAllocFree, 8);
+BENCHMARK_THREADS(AllocCacheAllocFree, 32);
+
+//
+// Holds more objects than a lookaside list keeps, so that frees overflow
+// and allocations miss as under a burst of requests.
+//
+static
+VOID
+AllocCacheAllocFreeBurst(
+    BENCHMARK_STATE &   state
+)
+{
+    ALLOC_CACHE_FIXTURE &   fixture = ALLOC_CACHE_FIXTURE::Get();
+    LPVOID                  rgpv[512];
+
+    if (FAILED(fixture.m_hr))
+    {
+        return;
+    }
+
+    while (state.KeepRunning())
+    {
+        for (auto& pv : rgpv)
+        {
+            pv = fixture.m_allocator.Alloc();
+        }
+
+        for (auto pv : rgpv)
+        {
+            if (pv != NULL)
+            {
+                fixture.m_allocator.Free(pv);
+            }
+        }
+    }
+}
+BENCHMARK(AllocCacheAllocFreeBurst);
+BENCHMARK_THREADS(AllocCacheAllocFreeBurst, 8);
+
+//
+// base64
+//
+
+class BASE64_FIXTURE
+{
+public:
+
+    static constexpr DWORD  DECODED_SIZE = 1024;
+    static constexpr DWORD  ENCODED_SIZE = (DECODED_SIZE + 2) / 3 * 4 + 1;
+
+    BASE64_FIXTURE()
+    {
+        for (DWORD i = 0; i < DECODED_SIZE; i++)
+        {
+            m_rgbDecoded[i] = static_cast<BYTE>(i * 7 + 3);
+        }
+
+        m_dwError = Base64Encode(m_rgbDecoded, DECODED_SIZE, m_achEncoded, ENCODED_SIZE, NULL);
+    }
+
+    DWORD   m_dwError;
+    BYTE    m_rgbDecoded[DECODED_SIZE];
+    CHAR    m_achEncoded[ENCODED_SIZE];
+};
+
+static
+VOID
+Base64EncodeBuffer(
+    BENCHMARK_STATE &   state
+)
+{
+    BASE64_FIXTURE  fixture;
+    CHAR            achEncoded[BASE64_FIXTURE::ENCODED_SIZE];
+    DWORD           cchEncoded;
+
+    state.SetBytesPerIteration(BASE64_FIXTURE::DECODED_SIZE);
+    while (state.KeepRunning())
+    {
+        Base64Encode(fixture.m_rgbDecoded, BASE64_FIXTURE::DECODED_SIZE, achEncoded, _countof(achEncoded), &cchEncoded);
+        DoNotOptimize(achEncoded);
+    }
+}
+BENCHMARK(Base64EncodeBuffer);
+
+static
+VOID
+Base64DecodeBuffer(
+    BENCHMARK_STATE &   state
+)
+{
+    BASE64_FIXTURE  fixture;
+    BYTE            rgbDecoded[BASE64_FIXTURE::DECODED_SIZE];
+    DWORD           cbDecoded;
+
+    if (fixture.m_dwError != NO_ERROR)
+    {
+        return;
+    }
+
+    state.SetBytesPerIteration(BASE64_FIXTURE::ENCODED_SIZE - 1);
+    while (state.KeepRunning())
+    {
+        Base64Decode(fixture.m_achEncoded, rgbDecoded, sizeof(rgbDecoded), &cbDecoded);
+        DoNotOptimize(rgbDecoded);
+    }
+}
+BENCHMARK(Base64DecodeBuffer);
@@ -0,0 +1,111 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+DECLARE_DEBUG_PRINT_OBJECT("nativebenchmarks");
+
+static
+VOID
+PrintUsage(
+    VOID
+)
+{
+    wprintf(L"Usage: NativeBenchmarks [-filter <substring>] [-format console|json|csv] [-out <file>] [-repetitions <count>] [-minTime <ms>]\n");
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    BENCHMARK_RUNNER::FORMAT    format = BENCHMARK_RUNNER::FORMAT_CONSOLE;
+    STRA                        strFilter;
+    PCWSTR                      pszOutput = NULL;
+    DWORD                       cRepetitions = 1;
+    DWORD                       dwMinTimeMs = 500;
+    FILE *                      pOutput = stdout;
+    HRESULT                     hr;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (_wcsicmp(argv[i], L"-filter") == 0 && i + 1 < argc)
+        {
+            hr = strFilter.CopyW(argv[++i]);
+            if (FAILED(hr))
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if (_wcsicmp(argv[i], L"-format") == 0 && i + 1 < argc)
+        {
+            ++i;
+            if (_wcsicmp(argv[i], L"json") == 0)
+            {
+                format = BENCHMARK_RUNNER::FORMAT_JSON;
+            }
+            else if (_wcsicmp(argv[i], L"csv") == 0)
+            {
+                format = BENCHMARK_RUNNER::FORMAT_CSV;
+            }
+            else if (_wcsicmp(argv[i], L"console") != 0)
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if (_wcsicmp(argv[i], L"-out") == 0 && i + 1 < argc)
+        {
+            pszOutput = argv[++i];
+        }
+        else if (_wcsicmp(argv[i], L"-repetitions") == 0 && i + 1 < argc)
+        {
+            cRepetitions = _wtoi(argv[++i]);
+        }
+        else if (_wcsicmp(argv[i], L"-minTime") == 0 && i + 1 < argc)
+        {
+            dwMinTimeMs = _wtoi(argv[++i]);
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (cRepetitions == 0)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    hr = ALLOC_CACHE_HANDLER::StaticInitialize();
+    if (FAILED(hr))
+    {
+        wprintf(L"ALLOC_CACHE_HANDLER::StaticInitialize failed with %08x\n", hr);
+        return 1;
+    }
+
+    if (pszOutput != NULL && _wfopen_s(&pOutput, pszOutput, L"w") != 0)
+    {
+        wprintf(L"Could not open %s\n", pszOutput);
+        return 1;
+    }
+
+    BENCHMARK_RUNNER runner(format, strFilter.IsEmpty() ? NULL : strFilter.QueryStr(), cRepetitions, dwMinTimeMs);
+
+    hr = runner.Run(pOutput);
+    if (FAILED(hr))
+    {
+        wprintf(L"Running the benchmarks failed with %08x\n", hr);
+    }
+
+    if (pOutput != stdout)
+    {
+        fclose(pOutput);
+    }
+
+    //
+    // No ALLOC_CACHE_HANDLER::StaticTerminate, the allocators of the
+    // benchmarks are static and freed past the end of main.
+    //
+    return FAILED(hr) ? 1 : 0;
+}
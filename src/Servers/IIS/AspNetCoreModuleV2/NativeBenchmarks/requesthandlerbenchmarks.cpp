@@ -0,0 +1,77 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+//
+// RESPONSE_HEADER_HASH
+//
+
+struct HEADER_NAME
+{
+    PCSTR   pszName;
+    DWORD   cchName;
+};
+
+#define HEADER_NAME_ENTRY(name)     { name, sizeof(name) - 1 }
+
+//
+// The headers of a typical response, as a backend spells them.
+//
+static const HEADER_NAME s_rgKnownHeaders[] =
+{
+    HEADER_NAME_ENTRY("Content-Length"),
+    HEADER_NAME_ENTRY("Content-Type"),
+    HEADER_NAME_ENTRY("Date"),
+    HEADER_NAME_ENTRY("Server"),
+    HEADER_NAME_ENTRY("cache-control"),
+    HEADER_NAME_ENTRY("ETag"),
+    HEADER_NAME_ENTRY("Last-Modified"),
+    HEADER_NAME_ENTRY("Transfer-Encoding"),
+};
+
+static const HEADER_NAME s_rgUnknownHeaders[] =
+{
+    HEADER_NAME_ENTRY("Set-Cookie"),
+    HEADER_NAME_ENTRY("X-Powered-By"),
+    HEADER_NAME_ENTRY("Request-Context"),
+    HEADER_NAME_ENTRY("Strict-Transport-Security"),
+    HEADER_NAME_ENTRY("X-Content-Type-Options"),
+    HEADER_NAME_ENTRY("Content-Security-Policy"),
+    HEADER_NAME_ENTRY("Access-Control-Allow-Origin"),
+    HEADER_NAME_ENTRY("traceparent"),
+};
+
+static
+VOID
+ResponseHeaderHashKnown(
+    BENCHMARK_STATE &   state
+)
+{
+    DWORD i = 0;
+
+    while (state.KeepRunning())
+    {
+        const HEADER_NAME & header = s_rgKnownHeaders[i++ % _countof(s_rgKnownHeaders)];
+        DWORD dwIndex = RESPONSE_HEADER_HASH::GetIndex(header.pszName, header.cchName);
+        DoNotOptimize(dwIndex);
+    }
+}
+BENCHMARK(ResponseHeaderHashKnown);
+
+static
+VOID
+ResponseHeaderHashUnknown(
+    BENCHMARK_STATE &   state
+)
+{
+    DWORD i = 0;
+
+    while (state.KeepRunning())
+    {
+        const HEADER_NAME & header = s_rgUnknownHeaders[i++ % _countof(s_rgUnknownHeaders)];
+        DWORD dwIndex = RESPONSE_HEADER_HASH::GetIndex(header.pszName, header.cchName);
+        DoNotOptimize(dwIndex);
+    }
+}
+BENCHMARK(ResponseHeaderHashUnknown);
@@ -0,0 +1,591 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+namespace fs = std::filesystem;
+
+//
+// Application start, phase by phase, against synthetic application
+// layouts: what the shim does from reading <aspNetCore> to knowing which
+// handler and hostfxr to load. Every iteration resolves again from
+// nothing kept in memory. Nothing is loaded, so the files of the layouts
+// are empty but for dotnet.exe; the file system cache is warm after the
+// first iteration, as it is for any start but the first after a boot.
+//
+
+//
+// A directory under %TEMP% holding the layout of a benchmark, deleted
+// with it.
+//
+class SYNTHETIC_TREE
+{
+public:
+
+    SYNTHETIC_TREE()
+    {
+        m_root = fs::temp_directory_path() / (L"ancm-startup-" + std::to_wstring(GetCurrentProcessId()) + L"-" + std::to_wstring(InterlockedIncrement(&sm_cTrees)));
+        fs::create_directories(m_root);
+    }
+
+    ~SYNTHETIC_TREE()
+    {
+        std::error_code ec;
+        fs::remove_all(m_root, ec);
+    }
+
+    const fs::path &
+    QueryRoot() const
+    {
+        return m_root;
+    }
+
+    //
+    // An empty file at relativePath, creating its directories.
+    //
+    fs::path
+    AddFile(
+        const fs::path &    relativePath
+    ) const
+    {
+        const auto path = m_root / relativePath;
+        fs::create_directories(path.parent_path());
+        std::ofstream(path, std::ios::binary);
+        return path;
+    }
+
+    fs::path
+    AddDirectory(
+        const fs::path &    relativePath
+    ) const
+    {
+        const auto path = m_root / relativePath;
+        fs::create_directories(path);
+        return path;
+    }
+
+    //
+    // The files of a published application: its dll, the runtimeconfig and
+    // deps next to it, and cReferences dependencies.
+    //
+    fs::path
+    AddApplication(
+        const fs::path &    relativePath,
+        DWORD               cReferences
+    ) const
+    {
+        AddFile(relativePath / L"app.dll");
+        AddFile(relativePath / L"app.runtimeconfig.json");
+        AddFile(relativePath / L"app.deps.json");
+        AddFile(relativePath / L"web.config");
+        for (DWORD i = 0; i < cReferences; i++)
+        {
+            AddFile(relativePath / (L"Dependency" + std::to_wstring(i) + L".dll"));
+        }
+        return m_root / relativePath;
+    }
+
+private:
+
+    static LONG     sm_cTrees;
+    fs::path        m_root;
+};
+
+LONG SYNTHETIC_TREE::sm_cTrees = 0;
+
+//
+// Handler versions installed next to the module after years of updates.
+//
+static
+VOID
+AddGlobalVersions(
+    const SYNTHETIC_TREE &  tree,
+    const fs::path &        relativePath
+)
+{
+    for (DWORD major = 2; major <= 9; major++)
+    {
+        for (DWORD patch = 0; patch < 6; patch++)
+        {
+            const auto version = std::to_wstring(major) + L".0." + std::to_wstring(patch);
+            tree.AddFile(relativePath / version / L"aspnetcorev2_outofprocess.dll");
+        }
+        tree.AddFile(relativePath / (std::to_wstring(major) + L".0.0-preview.1") / L"aspnetcorev2_outofprocess.dll");
+        tree.AddFile(relativePath / (std::to_wstring(major) + L".0.0-rc.2") / L"aspnetcorev2_outofprocess.dll");
+    }
+}
+
+//
+// A dotnet installation with several runtimes side by side. dotnet.exe is
+// a copy of this executable, found on PATH only if its bitness matches.
+//
+static
+fs::path
+AddDotnetRoot(
+    const SYNTHETIC_TREE &  tree,
+    const fs::path &        relativePath
+)
+{
+    static const PCWSTR s_rgVersions[] = { L"3.1.32", L"6.0.36", L"7.0.20", L"8.0.11", L"9.0.0", L"10.0.0-preview.3" };
+
+    for (const auto version : s_rgVersions)
+    {
+        tree.AddFile(relativePath / L"host" / L"fxr" / version / L"hostfxr.dll");
+        tree.AddDirectory(relativePath / L"shared" / L"Microsoft.NETCore.App" / version);
+        tree.AddDirectory(relativePath / L"shared" / L"Microsoft.AspNetCore.App" / version);
+    }
+
+    WCHAR wszModule[MAX_PATH];
+    if (GetModuleFileNameW(NULL, wszModule, _countof(wszModule)) == 0)
+    {
+        throw std::system_error(GetLastError(), std::system_category());
+    }
+
+    const auto dotnetExePath = tree.QueryRoot() / relativePath / L"dotnet.exe";
+    fs::copy_file(wszModule, dotnetExePath, fs::copy_options::overwrite_existing);
+    return dotnetExePath;
+}
+
+//
+// Configuration as read from applicationHost.config and web.config, held
+// in memory.
+//
+class FAKE_CONFIGURATION_SECTION : public ConfigurationSection
+{
+public:
+
+    std::optional<std::wstring>
+    GetString(const std::wstring& name) const override
+    {
+        const auto iter = m_strings.find(name);
+        return iter == m_strings.end() ? std::nullopt : std::make_optional(iter->second);
+    }
+
+    std::optional<bool>
+    GetBool(const std::wstring& name) const override
+    {
+        const auto value = GetString(name);
+        return value.has_value() ? std::make_optional(equals_ignore_case(value.value(), L"true")) : std::nullopt;
+    }
+
+    std::optional<DWORD>
+    GetLong(const std::wstring& name) const override
+    {
+        const auto value = GetString(name);
+        return value.has_value() ? std::make_optional(static_cast<DWORD>(wcstoul(value->c_str(), nullptr, 10))) : std::nullopt;
+    }
+
+    std::optional<DWORD>
+    GetTimespan(const std::wstring& name) const override
+    {
+        return GetLong(name);
+    }
+
+    std::optional<std::shared_ptr<ConfigurationSection>>
+    GetSection(const std::wstring& name) const override
+    {
+        const auto iter = m_sections.find(name);
+        return iter == m_sections.end() ? std::nullopt : std::make_optional(iter->second);
+    }
+
+    std::vector<std::shared_ptr<ConfigurationSection>>
+    GetCollection() const override
+    {
+        return m_collection;
+    }
+
+    VOID
+    AddItem(const std::wstring& name, const std::wstring& value)
+    {
+        auto item = std::make_shared<FAKE_CONFIGURATION_SECTION>();
+        item->m_strings[CS_ASPNETCORE_COLLECTION_ITEM_NAME] = name;
+        item->m_strings[CS_ASPNETCORE_COLLECTION_ITEM_VALUE] = value;
+        m_collection.push_back(item);
+    }
+
+    std::map<std::wstring, std::wstring>                                m_strings;
+    std::map<std::wstring, std::shared_ptr<FAKE_CONFIGURATION_SECTION>> m_sections;
+    std::vector<std::shared_ptr<ConfigurationSection>>                  m_collection;
+};
+
+class FAKE_CONFIGURATION_SOURCE : public ConfigurationSource
+{
+public:
+
+    std::shared_ptr<ConfigurationSection>
+    GetSection(const std::wstring& name) const override
+    {
+        const auto iter = m_sections.find(name);
+        return iter == m_sections.end() ? nullptr : iter->second;
+    }
+
+    std::map<std::wstring, std::shared_ptr<FAKE_CONFIGURATION_SECTION>> m_sections;
+};
+
+//
+// <aspNetCore> of an in-process application with shadow copy on and a
+// few environment variables, as the templates and hosting bundles write it.
+//
+static
+VOID
+AddAspNetCoreSection(
+    FAKE_CONFIGURATION_SOURCE & source
+)
+{
+    auto section = std::make_shared<FAKE_CONFIGURATION_SECTION>();
+    section->m_strings[CS_ASPNETCORE_PROCESS_EXE_PATH] = L"dotnet";
+    section->m_strings[CS_ASPNETCORE_PROCESS_ARGUMENTS] = L".\\app.dll";
+    section->m_strings[CS_ASPNETCORE_HOSTING_MODEL] = L"inprocess";
+    section->m_strings[CS_ASPNETCORE_STDOUT_LOG_ENABLED] = L"false";
+    section->m_strings[CS_ASPNETCORE_STDOUT_LOG_FILE] = L".\\logs\\stdout";
+    section->m_strings[CS_ASPNETCORE_DISABLE_START_UP_ERROR_PAGE] = L"false";
+
+    auto handlerSettings = std::make_shared<FAKE_CONFIGURATION_SECTION>();
+    handlerSettings->AddItem(L"enableShadowCopy", L"true");
+    handlerSettings->AddItem(L"shadowCopyDirectory", L"../ShadowCopyDirectory/");
+    handlerSettings->AddItem(L"debugLevel", L"FILE,TRACE");
+    section->m_sections[CS_ASPNETCORE_HANDLER_SETTINGS] = handlerSettings;
+
+    auto environmentVariables = std::make_shared<FAKE_CONFIGURATION_SECTION>();
+    environmentVariables->AddItem(L"ASPNETCORE_ENVIRONMENT", L"Production");
+    environmentVariables->AddItem(L"ASPNETCORE_HOSTINGSTARTUPASSEMBLIES", L"Microsoft.AspNetCore.Server.IISIntegration");
+    environmentVariables->AddItem(L"DOTNET_gcServer", L"1");
+    section->m_sections[CS_ASPNETCORE_ENVIRONMENT_VARIABLES] = environmentVariables;
+
+    source.m_sections[CS_ASPNETCORE_SECTION] = section;
+}
+
+//
+// ShimOptions
+//
+
+static
+VOID
+StartupShimOptions(
+    BENCHMARK_STATE &   state
+)
+{
+    FAKE_CONFIGURATION_SOURCE source;
+
+    try
+    {
+        AddAspNetCoreSection(source);
+        ShimOptions options(source);
+    }
+    catch (...)
+    {
+        return;
+    }
+
+    while (state.KeepRunning())
+    {
+        ShimOptions options(source);
+        DoNotOptimize(options);
+    }
+}
+BENCHMARK(StartupShimOptions);
+
+//
+// GlobalVersionUtility, the out-of-process handler of the global location
+//
+
+static
+VOID
+StartupFindHighestGlobalVersion(
+    BENCHMARK_STATE &   state
+)
+{
+    std::optional<SYNTHETIC_TREE> tree;
+
+    try
+    {
+        tree.emplace();
+        AddGlobalVersions(tree.value(), L"");
+        GlobalVersionUtility::FindHighestGlobalVersion(tree->QueryRoot().c_str());
+    }
+    catch (...)
+    {
+        return;
+    }
+
+    const std::wstring folder = tree->QueryRoot();
+    while (state.KeepRunning())
+    {
+        std::wstring version = GlobalVersionUtility::FindHighestGlobalVersion(folder.c_str());
+        DoNotOptimize(version);
+    }
+}
+BENCHMARK(StartupFindHighestGlobalVersion);
+
+static
+VOID
+StartupGlobalRequestHandlerPath(
+    BENCHMARK_STATE &   state
+)
+{
+    std::optional<SYNTHETIC_TREE> tree;
+
+    try
+    {
+        tree.emplace();
+        AddGlobalVersions(tree.value(), L"");
+        GlobalVersionUtility::GetGlobalRequestHandlerPath(tree->QueryRoot().c_str(), L"", L"aspnetcorev2_outofprocess.dll");
+    }
+    catch (...)
+    {
+        return;
+    }
+
+    // No handlerVersion, the highest one is looked for.
+    const std::wstring folder = tree->QueryRoot();
+    while (state.KeepRunning())
+    {
+        std::wstring path = GlobalVersionUtility::GetGlobalRequestHandlerPath(folder.c_str(), L"", L"aspnetcorev2_outofprocess.dll");
+        DoNotOptimize(path);
+    }
+}
+BENCHMARK(StartupGlobalRequestHandlerPath);
+
+//
+// The same through the cache of the worker process, what every start but
+// the first one pays.
+//
+static
+VOID
+StartupGlobalVersionCache(
+    BENCHMARK_STATE &   state
+)
+{
+    std::optional<SYNTHETIC_TREE> tree;
+    GlobalVersionCache cache;
+
+    try
+    {
+        tree.emplace();
+        AddGlobalVersions(tree.value(), L"");
+        cache.FindHighestGlobalVersion(tree->QueryRoot().c_str());
+    }
+    catch (...)
+    {
+        return;
+    }
+
+    const std::wstring folder = tree->QueryRoot();
+    while (state.KeepRunning())
+    {
+        std::wstring version = cache.FindHighestGlobalVersion(folder.c_str());
+        DoNotOptimize(version);
+    }
+}
+BENCHMARK(StartupGlobalVersionCache);
+
+//
+// HostFxrResolver
+//
+
+static
+VOID
+ResolveHostFxr(
+    BENCHMARK_STATE &       state,
+    const fs::path &        processPath,
+    const fs::path &        applicationPath,
+    const std::wstring &    arguments
+)
+{
+    fs::path                    hostFxrDllPath;
+    fs::path                    dotnetExePath;
+    std::vector<std::wstring>   resolvedArguments;
+    ErrorContext                errorContext;
+
+    try
+    {
+        HostFxrResolver::GetHostFxrParameters(processPath, applicationPath, arguments, hostFxrDllPath, dotnetExePath, resolvedArguments, errorContext);
+    }
+    catch (...)
+    {
+        return;
+    }
+
+    while (state.KeepRunning())
+    {
+        // Without the dotnet.exe of a previous start.
+        dotnetExePath.clear();
+        HostFxrResolver::GetHostFxrParameters(processPath, applicationPath, arguments, hostFxrDllPath, dotnetExePath, resolvedArguments, errorContext);
+        DoNotOptimize(resolvedArguments);
+    }
+}
+
+//
+// Framework dependent, processPath to the dotnet.exe of an installation.
+//
+static
+VOID
+StartupHostFxrPortable(
+    BENCHMARK_STATE &   state
+)
+{
+    std::optional<SYNTHETIC_TREE>   tree;
+    fs::path                        dotnetExePath;
+    fs::path                        applicationPath;
+
+    try
+    {
+        tree.emplace();
+        dotnetExePath = AddDotnetRoot(tree.value(), L"dotnet");
+        applicationPath = tree->AddApplication(L"site", 64);
+    }
+    catch (...)
+    {
+        return;
+    }
+
+    ResolveHostFxr(state, dotnetExePath, applicationPath, L".\\app.dll --urls http://localhost");
+}
+BENCHMARK(StartupHostFxrPortable);
+
+//
+// Framework dependent with the app.exe launcher, dotnet found from PATH.
+//
+static
+VOID
+StartupHostFxrPortableLauncher(
+    BENCHMARK_STATE &   state
+)
+{
+    std::optional<SYNTHETIC_TREE>   tree;
+    fs::path                        applicationPath;
+    std::optional<std::wstring>     path;
+
+    try
+    {
+        tree.emplace();
+        const auto dotnetExePath = AddDotnetRoot(tree.value(), L"dotnet");
+        applicationPath = tree->AddApplication(L"site", 64);
+        tree->AddFile(L"site\\app.exe");
+
+        // Where the installer puts it, after the system directories; an
+        // installation of this machine must not be found first.
+        path = Environment::GetEnvironmentVariableValue(L"PATH");
+        const auto newPath = L"%SystemRoot%\\system32;%SystemRoot%;%SystemRoot%\\System32\\Wbem;%SystemRoot%\\System32\\WindowsPowerShell\\v1.0\\;" + dotnetExePath.parent_path().wstring();
+        if (!SetEnvironmentVariableW(L"PATH", newPath.c_str()))
+        {
+            return;
+        }
+    }
+    catch (...)
+    {
+        return;
+    }
+
+    ResolveHostFxr(state, L"app.exe", applicationPath, L"");
+
+    SetEnvironmentVariableW(L"PATH", path.has_value() ? path->c_str() : NULL);
+}
+BENCHMARK(StartupHostFxrPortableLauncher);
+
+//
+// Self contained, hostfxr.dll next to app.exe.
+//
+static
+VOID
+StartupHostFxrStandalone(
+    BENCHMARK_STATE &   state
+)
+{
+    std::optional<SYNTHETIC_TREE>   tree;
+    fs::path                        applicationPath;
+
+    try
+    {
+        tree.emplace();
+        applicationPath = tree->AddApplication(L"site", 256);
+        tree->AddFile(L"site\\app.exe");
+        tree->AddFile(L"site\\hostfxr.dll");
+        tree->AddFile(L"site\\hostpolicy.dll");
+        tree->AddFile(L"site\\coreclr.dll");
+    }
+    catch (...)
+    {
+        return;
+    }
+
+    ResolveHostFxr(state, applicationPath / L"app.exe", applicationPath, L"");
+}
+BENCHMARK(StartupHostFxrStandalone);
+
+//
+// Shadow copy, Environment::CheckUpToDate and CopyToDirectory
+//
+
+//
+// A restart with nothing changed since the last copy, the common case.
+//
+static
+VOID
+StartupShadowCopyUpToDate(
+    BENCHMARK_STATE &   state
+)
+{
+    std::optional<SYNTHETIC_TREE>   tree;
+    fs::path                        applicationPath;
+    fs::path                        shadowCopyPath;
+    int                             cCopied = 0;
+
+    try
+    {
+        tree.emplace();
+        applicationPath = tree->AddApplication(L"site", 256);
+        shadowCopyPath = tree->AddDirectory(L"ShadowCopyDirectory");
+        if (Environment::CopyToDirectory(applicationPath, shadowCopyPath / L"0", false, shadowCopyPath, cCopied) != S_OK)
+        {
+            return;
+        }
+    }
+    catch (...)
+    {
+        return;
+    }
+
+    const std::wstring source = applicationPath;
+    while (state.KeepRunning())
+    {
+        bool fUpToDate = Environment::CheckUpToDate(source, shadowCopyPath / L"0", L".dll", shadowCopyPath);
+        DoNotOptimize(fUpToDate);
+    }
+}
+BENCHMARK(StartupShadowCopyUpToDate);
+
+//
+// The first start after a deployment, every file copied to a directory
+// cleaned first.
+//
+static
+VOID
+StartupShadowCopy(
+    BENCHMARK_STATE &   state
+)
+{
+    std::optional<SYNTHETIC_TREE>   tree;
+    fs::path                        applicationPath;
+    fs::path                        shadowCopyPath;
+
+    try
+    {
+        tree.emplace();
+        applicationPath = tree->AddApplication(L"site", 256);
+        shadowCopyPath = tree->AddDirectory(L"ShadowCopyDirectory");
+    }
+    catch (...)
+    {
+        return;
+    }
+
+    const std::wstring source = applicationPath;
+    while (state.KeepRunning())
+    {
+        int cCopied = 0;
+        HRESULT hr = Environment::CopyToDirectory(source, shadowCopyPath / L"0", true, shadowCopyPath, cCopied);
+        DoNotOptimize(hr);
+    }
+}
+BENCHMARK(StartupShadowCopy);
@@ -0,0 +1,32 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// The benchmarked code is compiled exactly as in the out of process handler.
+//
+#include "..\OutOfProcessRequestHandler\stdafx.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "hashfn.h"
+#include "hashtable.h"
+#include "BindingInformation.h"
+#include "ConfigurationSection.h"
+#include "ConfigurationSource.h"
+#include "Environment.h"
+#include "GlobalVersionUtility.h"
+#include "HostFxrResolver.h"
+#include "StringHelpers.h"
+#include "ShimOptions.h"
+#include "benchmark.h"
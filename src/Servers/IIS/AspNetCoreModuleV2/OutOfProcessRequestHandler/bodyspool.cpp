@@ -0,0 +1,361 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "bodyspool.h"
+
+BODY_SPOOL::BODY_SPOOL(
+    _In_ IHttpContext *     pHttpContext,
+    DWORD                   cbMemoryLimit,
+    DWORD                   cbMaxSize
+) : m_pHttpContext(pHttpContext),
+    m_cbMemoryLimit(cbMemoryLimit),
+    m_cbMaxSize(cbMaxSize),
+    m_cBuffers(0),
+    m_cbMemory(0),
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_pIo(NULL),
+    m_overlapped(),
+    m_pIoBuffer(NULL),
+    m_cbFile(0),
+    m_fIoPending(FALSE),
+    m_fIoRead(FALSE),
+    m_hrIo(S_OK),
+    m_cbIo(0),
+    m_cbSent(0)
+{
+}
+
+BODY_SPOOL::~BODY_SPOOL()
+{
+    DBG_ASSERT(!m_fIoPending);
+
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+
+    if (m_pIo != NULL)
+    {
+        WaitForThreadpoolIoCallbacks(m_pIo, FALSE);
+        CloseThreadpoolIo(m_pIo);
+        m_pIo = NULL;
+    }
+
+    for (DWORD i = 0; i < m_cBuffers; i++)
+    {
+        delete[] m_buffBuffers.QueryPtr()[i];
+    }
+
+    if (m_pIoBuffer != NULL)
+    {
+        delete[] m_pIoBuffer;
+        m_pIoBuffer = NULL;
+    }
+}
+
+HRESULT
+BODY_SPOOL::GetReadBuffer(
+    _Outptr_result_bytebuffer_(*pcbBuffer) BYTE ** ppBuffer,
+    _Out_ DWORD *           pcbBuffer
+)
+{
+    if (m_cbMemory < m_cbMemoryLimit)
+    {
+        if (m_cbMemory / SPOOL_BUFFER_SIZE == m_cBuffers)
+        {
+            const DWORD cbNeeded = (m_cBuffers + 1) * sizeof(BYTE *);
+            if (cbNeeded > m_buffBuffers.QuerySize() &&
+                !m_buffBuffers.Resize(max(cbNeeded, m_buffBuffers.QuerySize() * 2)))
+            {
+                RETURN_HR(E_OUTOFMEMORY);
+            }
+
+            BYTE *pBuffer = new BYTE[SPOOL_BUFFER_SIZE];
+            if (pBuffer == NULL)
+            {
+                RETURN_HR(E_OUTOFMEMORY);
+            }
+
+            m_buffBuffers.QueryPtr()[m_cBuffers++] = pBuffer;
+        }
+
+        const DWORD cbUsed = m_cbMemory % SPOOL_BUFFER_SIZE;
+        *ppBuffer = m_buffBuffers.QueryPtr()[m_cBuffers - 1] + cbUsed;
+        *pcbBuffer = min(SPOOL_BUFFER_SIZE - cbUsed, m_cbMemoryLimit - m_cbMemory);
+        return S_OK;
+    }
+
+    if (m_pIoBuffer == NULL)
+    {
+        m_pIoBuffer = new BYTE[SPOOL_BUFFER_SIZE];
+        if (m_pIoBuffer == NULL)
+        {
+            RETURN_HR(E_OUTOFMEMORY);
+        }
+    }
+
+    *ppBuffer = m_pIoBuffer;
+    *pcbBuffer = SPOOL_BUFFER_SIZE;
+    return S_OK;
+}
+
+HRESULT
+BODY_SPOOL::Append(
+    DWORD                   cbRead,
+    _Out_ BOOL *            pfPending
+)
+{
+    DBG_ASSERT(!m_fIoPending);
+
+    *pfPending = FALSE;
+
+    if (cbRead == 0)
+    {
+        return S_OK;
+    }
+
+    if (cbRead > m_cbMaxSize - QuerySize())
+    {
+        // Answered with a 413, not logged.
+        return HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE);
+    }
+
+    if (m_cbMemory < m_cbMemoryLimit)
+    {
+        m_cbMemory += cbRead;
+        return S_OK;
+    }
+
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        RETURN_IF_FAILED(CreateSpoolFile());
+    }
+
+    ULARGE_INTEGER liOffset;
+    liOffset.QuadPart = m_cbFile;
+
+    ZeroMemory(&m_overlapped, sizeof(m_overlapped));
+    m_overlapped.Offset = liOffset.LowPart;
+    m_overlapped.OffsetHigh = liOffset.HighPart;
+
+    //
+    // Set before the write is issued, its completion may be posted before
+    // WriteFile returns.
+    //
+    m_fIoPending = TRUE;
+    m_fIoRead = FALSE;
+
+    StartThreadpoolIo(m_pIo);
+    if (!WriteFile(m_hFile, m_pIoBuffer, cbRead, NULL, &m_overlapped))
+    {
+        const DWORD dwError = GetLastError();
+        if (dwError != ERROR_IO_PENDING)
+        {
+            CancelThreadpoolIo(m_pIo);
+            m_fIoPending = FALSE;
+            RETURN_HR(HRESULT_FROM_WIN32(dwError));
+        }
+    }
+
+    *pfPending = TRUE;
+    return S_OK;
+}
+
+HRESULT
+BODY_SPOOL::Read(
+    _Outptr_result_bytebuffer_(*pcbData) BYTE ** ppData,
+    _Out_ DWORD *           pcbData,
+    _Out_ BOOL *            pfPending
+)
+{
+    DBG_ASSERT(!m_fIoPending);
+
+    *ppData = NULL;
+    *pcbData = 0;
+    *pfPending = FALSE;
+
+    if (m_cbSent < m_cbMemory)
+    {
+        const DWORD cbSent = static_cast<DWORD>(m_cbSent);
+        const DWORD cbOffset = cbSent % SPOOL_BUFFER_SIZE;
+
+        *ppData = m_buffBuffers.QueryPtr()[cbSent / SPOOL_BUFFER_SIZE] + cbOffset;
+        *pcbData = min(SPOOL_BUFFER_SIZE - cbOffset, m_cbMemory - cbSent);
+        m_cbSent += *pcbData;
+        return S_OK;
+    }
+
+    ULARGE_INTEGER liOffset;
+    liOffset.QuadPart = m_cbSent - m_cbMemory;
+    if (liOffset.QuadPart == m_cbFile)
+    {
+        // All of it was sent.
+        return S_OK;
+    }
+
+    ZeroMemory(&m_overlapped, sizeof(m_overlapped));
+    m_overlapped.Offset = liOffset.LowPart;
+    m_overlapped.OffsetHigh = liOffset.HighPart;
+
+    m_fIoPending = TRUE;
+    m_fIoRead = TRUE;
+
+    StartThreadpoolIo(m_pIo);
+    if (!ReadFile(m_hFile,
+        m_pIoBuffer,
+        static_cast<DWORD>(min(static_cast<ULONGLONG>(SPOOL_BUFFER_SIZE), m_cbFile - liOffset.QuadPart)),
+        NULL,
+        &m_overlapped))
+    {
+        const DWORD dwError = GetLastError();
+        if (dwError != ERROR_IO_PENDING)
+        {
+            CancelThreadpoolIo(m_pIo);
+            m_fIoPending = FALSE;
+            RETURN_HR(HRESULT_FROM_WIN32(dwError));
+        }
+    }
+
+    *pfPending = TRUE;
+    return S_OK;
+}
+
+HRESULT
+BODY_SPOOL::WriteEntityChunks(
+    _In_ IHttpResponse *    pResponse
+)
+{
+    DBG_ASSERT(!m_fIoPending);
+
+    HTTP_DATA_CHUNK Chunk;
+
+    for (DWORD cbOffset = 0; cbOffset < m_cbMemory; cbOffset += SPOOL_BUFFER_SIZE)
+    {
+        Chunk.DataChunkType = HttpDataChunkFromMemory;
+        Chunk.FromMemory.pBuffer = m_buffBuffers.QueryPtr()[cbOffset / SPOOL_BUFFER_SIZE];
+        Chunk.FromMemory.BufferLength = min(SPOOL_BUFFER_SIZE, m_cbMemory - cbOffset);
+        RETURN_IF_FAILED(pResponse->WriteEntityChunkByReference(&Chunk));
+    }
+
+    if (m_cbFile != 0)
+    {
+        //
+        // http.sys reads the file itself while the response is sent.
+        //
+        Chunk.DataChunkType = HttpDataChunkFromFileHandle;
+        Chunk.FromFileHandle.ByteRange.StartingOffset.QuadPart = 0;
+        Chunk.FromFileHandle.ByteRange.Length.QuadPart = m_cbFile;
+        Chunk.FromFileHandle.FileHandle = m_hFile;
+        RETURN_IF_FAILED(pResponse->WriteEntityChunkByReference(&Chunk));
+    }
+
+    m_cbSent = m_cbMemory + m_cbFile;
+
+    return S_OK;
+}
+
+HRESULT
+BODY_SPOOL::OnIoCompleted(
+    _Outptr_opt_result_bytebuffer_(*pcbData) BYTE ** ppData,
+    _Out_opt_ DWORD *       pcbData
+)
+{
+    DBG_ASSERT(m_fIoPending);
+
+    m_fIoPending = FALSE;
+
+    if (ppData != NULL)
+    {
+        *ppData = NULL;
+    }
+    if (pcbData != NULL)
+    {
+        *pcbData = 0;
+    }
+
+    RETURN_IF_FAILED(m_hrIo);
+
+    if (!m_fIoRead)
+    {
+        m_cbFile += m_cbIo;
+        return S_OK;
+    }
+
+    if (m_cbIo == 0)
+    {
+        // The file is ours, it can't have become shorter.
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_HANDLE_EOF));
+    }
+
+    m_cbSent += m_cbIo;
+
+    if (ppData != NULL)
+    {
+        *ppData = m_pIoBuffer;
+    }
+    if (pcbData != NULL)
+    {
+        *pcbData = m_cbIo;
+    }
+
+    return S_OK;
+}
+
+HRESULT
+BODY_SPOOL::CreateSpoolFile()
+{
+    WCHAR   szTempPath[MAX_PATH + 1];
+    WCHAR   szTempFile[MAX_PATH + 1];
+
+    const DWORD cchTempPath = GetTempPath(_countof(szTempPath), szTempPath);
+    RETURN_LAST_ERROR_IF(cchTempPath == 0 || cchTempPath > _countof(szTempPath));
+    RETURN_LAST_ERROR_IF(GetTempFileName(szTempPath, L"anc", 0, szTempFile) == 0);
+
+    //
+    // GetTempFileName created the file, it is opened again to be deleted
+    // once closed, whatever happens to the worker process.
+    //
+    m_hFile = CreateFile(szTempFile,
+        GENERIC_READ | GENERIC_WRITE,
+        0,
+        NULL,
+        CREATE_ALWAYS,
+        FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE | FILE_FLAG_OVERLAPPED,
+        NULL);
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        const HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        DeleteFile(szTempFile);
+        RETURN_HR(hr);
+    }
+
+    m_pIo = CreateThreadpoolIo(m_hFile, IoCompletionCallback, this, NULL);
+    RETURN_LAST_ERROR_IF_NULL(m_pIo);
+
+    return S_OK;
+}
+
+// static
+VOID
+CALLBACK
+BODY_SPOOL::IoCompletionCallback(
+    PTP_CALLBACK_INSTANCE,
+    PVOID                   pvContext,
+    PVOID,
+    ULONG                   ulIoResult,
+    ULONG_PTR               cbTransferred,
+    PTP_IO
+)
+{
+    BODY_SPOOL *pSpool = static_cast<BODY_SPOOL *>(pvContext);
+
+    pSpool->m_hrIo = HRESULT_FROM_WIN32(ulIoResult);
+    pSpool->m_cbIo = static_cast<DWORD>(cbTransferred);
+
+    //
+    // AsyncCompletion of the handler picks the result up with
+    // OnIoCompleted.
+    //
+    LOG_IF_FAILED(pSpool->m_pHttpContext->PostCompletion(static_cast<DWORD>(cbTransferred)));
+}
@@ -0,0 +1,143 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// Body read in full on one side before it is sent on the other, so that a
+// slow client only holds an IIS request. With requestBufferingMemoryLimit
+// the request body is read before the backend is asked for a connection,
+// with responseSpoolingMemoryLimit the backend response is drained and its
+// request closed before the client is sent the body.
+//
+// The first cbMemoryLimit bytes are kept in memory, the rest goes to a
+// temporary file deleted when it is closed. The file is written and read
+// with overlapped I/O on the thread pool, each completion is posted back
+// to the request and handed to OnIoCompleted from AsyncCompletion. Only
+// one operation is outstanding at a time, the handler serializes them.
+//
+class BODY_SPOOL
+{
+public:
+    BODY_SPOOL(
+        _In_ IHttpContext *     pHttpContext,
+        DWORD                   cbMemoryLimit,
+        DWORD                   cbMaxSize
+    );
+
+    ~BODY_SPOOL();
+
+    //
+    // Buffer the next ReadEntityBody reads into.
+    //
+    HRESULT
+    GetReadBuffer(
+        _Outptr_result_bytebuffer_(*pcbBuffer) BYTE ** ppBuffer,
+        _Out_ DWORD *           pcbBuffer
+    );
+
+    //
+    // Keeps the cbRead bytes read into the buffer of GetReadBuffer. Fails
+    // with ERROR_FILE_TOO_LARGE past cbMaxSize. Sets *pfPending when they
+    // are written to the file.
+    //
+    HRESULT
+    Append(
+        DWORD                   cbRead,
+        _Out_ BOOL *            pfPending
+    );
+
+    //
+    // The next bytes of the body to send, none once all of it was. Sets
+    // *pfPending when they are read from the file, OnIoCompleted then
+    // returns them.
+    //
+    HRESULT
+    Read(
+        _Outptr_result_bytebuffer_(*pcbData) BYTE ** ppData,
+        _Out_ DWORD *           pcbData,
+        _Out_ BOOL *            pfPending
+    );
+
+    //
+    // Hands all of the body to the IIS response by reference, the memory
+    // buffers and a single chunk for the file. The spool has to outlive
+    // the response.
+    //
+    HRESULT
+    WriteEntityChunks(
+        _In_ IHttpResponse *    pResponse
+    );
+
+    //
+    // Result of the file operation left pending by Append or Read, with
+    // the bytes read for Read.
+    //
+    HRESULT
+    OnIoCompleted(
+        _Outptr_opt_result_bytebuffer_(*pcbData) BYTE ** ppData,
+        _Out_opt_ DWORD *       pcbData
+    );
+
+    BOOL
+    QueryIoPending() const
+    {
+        return m_fIoPending;
+    }
+
+    DWORD
+    QuerySize() const
+    {
+        return m_cbMemory + static_cast<DWORD>(m_cbFile);
+    }
+
+private:
+    static const DWORD      SPOOL_BUFFER_SIZE = 16 * 1024;
+    static const DWORD      INLINE_BUFFERS = 8;
+
+    HRESULT
+    CreateSpoolFile();
+
+    static
+    VOID
+    CALLBACK
+    IoCompletionCallback(
+        PTP_CALLBACK_INSTANCE   pInstance,
+        PVOID                   pvContext,
+        PVOID                   pvOverlapped,
+        ULONG                   ulIoResult,
+        ULONG_PTR               cbTransferred,
+        PTP_IO                  pIo
+    );
+
+    IHttpContext *          m_pHttpContext;
+    DWORD                   m_cbMemoryLimit;
+    DWORD                   m_cbMaxSize;
+
+    //
+    // Memory part of the body, m_cbMemory bytes over m_cBuffers buffers of
+    // SPOOL_BUFFER_SIZE.
+    //
+    BUFFER_T<BYTE*, INLINE_BUFFERS> m_buffBuffers;
+    DWORD                   m_cBuffers;
+    DWORD                   m_cbMemory;
+
+    //
+    // File part of the body, following the memory part. m_pIoBuffer is
+    // read into from IIS and written from, or read into from the file.
+    //
+    HANDLE                  m_hFile;
+    PTP_IO                  m_pIo;
+    OVERLAPPED              m_overlapped;
+    BYTE *                  m_pIoBuffer;
+    ULONGLONG               m_cbFile;
+    BOOL                    m_fIoPending;
+    BOOL                    m_fIoRead;
+    HRESULT                 m_hrIo;
+    DWORD                   m_cbIo;
+
+    //
+    // Bytes handed out by Read so far.
+    //
+    ULONGLONG               m_cbSent;
+};
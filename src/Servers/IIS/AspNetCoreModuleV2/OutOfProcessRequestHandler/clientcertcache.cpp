@@ -0,0 +1,205 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "clientcertcache.h"
+#include "SRWExclusiveLock.h"
+
+CLIENT_CERT_CACHE_ENTRY::CLIENT_CERT_CACHE_ENTRY(
+    VOID
+) :
+    m_connectionId(HTTP_NULL_ID),
+    m_pbCertificate(NULL),
+    m_cbCertificate(0),
+    m_pszEncoded(NULL),
+    m_cchEncoded(0),
+    m_ullLastUsed(0),
+    m_cRefs(1)
+{
+}
+
+CLIENT_CERT_CACHE_ENTRY::~CLIENT_CERT_CACHE_ENTRY()
+{
+    delete[] m_pbCertificate;
+    m_pbCertificate = NULL;
+
+    delete[] m_pszEncoded;
+    m_pszEncoded = NULL;
+}
+
+HRESULT
+CLIENT_CERT_CACHE_ENTRY::Initialize(
+    HTTP_CONNECTION_ID                      connectionId,
+    _In_ const HTTP_SSL_CLIENT_CERT_INFO *  pCertInfo
+)
+{
+    const DWORD cchEncoded = (pCertInfo->CertEncodedSize + 2) / 3 * 4;
+
+    m_pbCertificate = new BYTE[pCertInfo->CertEncodedSize];
+    m_pszEncoded = new CHAR[cchEncoded + 1];
+    if (m_pbCertificate == NULL || m_pszEncoded == NULL)
+    {
+        RETURN_HR(E_OUTOFMEMORY);
+    }
+
+    memcpy(m_pbCertificate, pCertInfo->pCertEncoded, pCertInfo->CertEncodedSize);
+    m_cbCertificate = pCertInfo->CertEncodedSize;
+
+    const DWORD dwError = Base64Encode(pCertInfo->pCertEncoded,
+        pCertInfo->CertEncodedSize,
+        m_pszEncoded,
+        cchEncoded + 1,
+        &m_cchEncoded);
+    if (dwError != NO_ERROR)
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(dwError));
+    }
+
+    m_connectionId = connectionId;
+    return S_OK;
+}
+
+BOOL
+CLIENT_CERT_CACHE_ENTRY::IsCertificate(
+    HTTP_CONNECTION_ID                      connectionId,
+    _In_ const HTTP_SSL_CLIENT_CERT_INFO *  pCertInfo
+) const
+{
+    return m_connectionId == connectionId &&
+        m_cbCertificate == pCertInfo->CertEncodedSize &&
+        memcmp(m_pbCertificate, pCertInfo->pCertEncoded, m_cbCertificate) == 0;
+}
+
+CLIENT_CERT_CACHE::CLIENT_CERT_CACHE() :
+    m_cEntries(0),
+    m_ullNextSweep(0)
+{
+    InitializeSRWLock(&m_srwLock);
+    ZeroMemory(m_rgEntries, sizeof(m_rgEntries));
+}
+
+CLIENT_CERT_CACHE::~CLIENT_CERT_CACHE()
+{
+    for (DWORD i = 0; i < m_cEntries; i++)
+    {
+        m_rgEntries[i]->DereferenceClientCertCacheEntry();
+        m_rgEntries[i] = NULL;
+    }
+    m_cEntries = 0;
+}
+
+HRESULT
+CLIENT_CERT_CACHE::Acquire(
+    HTTP_CONNECTION_ID                      connectionId,
+    _In_ const HTTP_SSL_CLIENT_CERT_INFO *  pCertInfo,
+    _Outptr_ CLIENT_CERT_CACHE_ENTRY **     ppEntry
+)
+{
+    CLIENT_CERT_CACHE_ENTRY *   pNewEntry = NULL;
+    CLIENT_CERT_CACHE_ENTRY *   pReplaced = NULL;
+    HRESULT                     hr = S_OK;
+    const ULONGLONG             ullNow = GetTickCount64();
+
+    *ppEntry = NULL;
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        if (ullNow >= m_ullNextSweep)
+        {
+            RemoveIdleEntriesNoLock(ullNow);
+            m_ullNextSweep = ullNow + IDLE_TIMEOUT_MS / 4;
+        }
+
+        for (DWORD i = 0; i < m_cEntries; i++)
+        {
+            if (m_rgEntries[i]->IsCertificate(connectionId, pCertInfo))
+            {
+                m_rgEntries[i]->m_ullLastUsed = ullNow;
+                m_rgEntries[i]->ReferenceClientCertCacheEntry();
+                *ppEntry = m_rgEntries[i];
+                return S_OK;
+            }
+        }
+    }
+
+    //
+    // Encoded outside of the lock, it is the expensive part.
+    //
+    pNewEntry = new CLIENT_CERT_CACHE_ENTRY();
+    if (pNewEntry == NULL)
+    {
+        RETURN_HR(E_OUTOFMEMORY);
+    }
+
+    if (FAILED_LOG(hr = pNewEntry->Initialize(connectionId, pCertInfo)))
+    {
+        pNewEntry->DereferenceClientCertCacheEntry();
+        return hr;
+    }
+
+    pNewEntry->m_ullLastUsed = ullNow;
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        //
+        // A connection has one certificate at a time, a renegotiated one
+        // replaces the entry. Another request of the connection may have
+        // added the same one meanwhile, which is just as good.
+        //
+        DWORD i = 0;
+        for (; i < m_cEntries; i++)
+        {
+            if (m_rgEntries[i]->m_connectionId == connectionId)
+            {
+                pReplaced = m_rgEntries[i];
+                m_rgEntries[i] = pNewEntry;
+                break;
+            }
+        }
+
+        if (i == m_cEntries && m_cEntries < MAX_ENTRIES)
+        {
+            m_rgEntries[m_cEntries++] = pNewEntry;
+        }
+        else if (i == m_cEntries)
+        {
+            // The cache is full, encoded for this request alone.
+            *ppEntry = pNewEntry;
+            return S_OK;
+        }
+
+        pNewEntry->ReferenceClientCertCacheEntry();
+    }
+
+    if (pReplaced != NULL)
+    {
+        pReplaced->DereferenceClientCertCacheEntry();
+    }
+
+    *ppEntry = pNewEntry;
+    return S_OK;
+}
+
+VOID
+CLIENT_CERT_CACHE::RemoveIdleEntriesNoLock(
+    ULONGLONG                               ullNow
+)
+{
+    for (DWORD i = 0; i < m_cEntries; )
+    {
+        CLIENT_CERT_CACHE_ENTRY *pEntry = m_rgEntries[i];
+        if (ullNow - pEntry->m_ullLastUsed >= IDLE_TIMEOUT_MS)
+        {
+            m_rgEntries[i] = m_rgEntries[--m_cEntries];
+            m_rgEntries[m_cEntries] = NULL;
+
+            // Requests still using it hold their own reference.
+            pEntry->DereferenceClientCertCacheEntry();
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
@@ -0,0 +1,116 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// Base64 encoding of the client certificate of one connection, as sent in
+// MS-ASPNETCORE-CLIENTCERT. Never changed once created; each request using
+// it holds a reference until its headers are built.
+//
+class CLIENT_CERT_CACHE_ENTRY
+{
+public:
+
+    PCSTR
+    QueryEncoded() const
+    {
+        return m_pszEncoded;
+    }
+
+    DWORD
+    QueryEncodedLength() const
+    {
+        return m_cchEncoded;
+    }
+
+    VOID
+    ReferenceClientCertCacheEntry()
+    {
+        InterlockedIncrement(&m_cRefs);
+    }
+
+    VOID
+    DereferenceClientCertCacheEntry()
+    {
+        if (InterlockedDecrement(&m_cRefs) == 0)
+        {
+            delete this;
+        }
+    }
+
+private:
+
+    friend class CLIENT_CERT_CACHE;
+
+    CLIENT_CERT_CACHE_ENTRY(
+        VOID
+    );
+
+    ~CLIENT_CERT_CACHE_ENTRY();
+
+    HRESULT
+    Initialize(
+        HTTP_CONNECTION_ID                      connectionId,
+        _In_ const HTTP_SSL_CLIENT_CERT_INFO *  pCertInfo
+    );
+
+    BOOL
+    IsCertificate(
+        HTTP_CONNECTION_ID                      connectionId,
+        _In_ const HTTP_SSL_CLIENT_CERT_INFO *  pCertInfo
+    ) const;
+
+    HTTP_CONNECTION_ID  m_connectionId;
+    //
+    // The DER certificate the encoding is of, compared as a renegotiation
+    // may present another one on the same connection.
+    //
+    BYTE *              m_pbCertificate;
+    DWORD               m_cbCertificate;
+    CHAR *              m_pszEncoded;
+    DWORD               m_cchEncoded;
+    ULONGLONG           m_ullLastUsed;
+    volatile LONG       m_cRefs;
+};
+
+//
+// Encoded client certificates of the connections of an application, so
+// that the requests of a mutual TLS keep-alive connection don't each
+// encode the same certificate again.
+//
+// The connection closing is not seen between requests, an entry goes
+// once unused for IDLE_TIMEOUT_MS. Past MAX_ENTRIES the certificate is
+// encoded for the request alone.
+//
+class CLIENT_CERT_CACHE
+{
+public:
+    CLIENT_CERT_CACHE();
+
+    ~CLIENT_CERT_CACHE();
+
+    //
+    // Referenced encoding of pCertInfo for a request of connectionId.
+    //
+    HRESULT
+    Acquire(
+        HTTP_CONNECTION_ID                      connectionId,
+        _In_ const HTTP_SSL_CLIENT_CERT_INFO *  pCertInfo,
+        _Outptr_ CLIENT_CERT_CACHE_ENTRY **     ppEntry
+    );
+
+    static const DWORD      MAX_ENTRIES = 256;
+    static const DWORD      IDLE_TIMEOUT_MS = 60000;
+
+private:
+    VOID
+    RemoveIdleEntriesNoLock(
+        ULONGLONG                               ullNow
+    );
+
+    SRWLOCK                     m_srwLock;
+    CLIENT_CERT_CACHE_ENTRY *   m_rgEntries[MAX_ENTRIES];
+    DWORD                       m_cEntries;
+    ULONGLONG                   m_ullNextSweep;
+};
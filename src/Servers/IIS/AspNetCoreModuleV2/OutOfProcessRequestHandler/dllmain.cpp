@@ -8,6 +8,7 @@ DECLARE_DEBUG_PRINT_OBJECT("aspnetcorev2_outofprocess.dll");
 
 BOOL                g_fWebSocketStaticInitialize = FALSE;
 BOOL                g_fEnableReferenceCountTracing = FALSE;
+BOOL                g_fCaptureReferenceCountStacks = FALSE;
 BOOL                g_fGlobalInitialize = FALSE;
 BOOL                g_fOutOfProcessInitialize = FALSE;
 BOOL                g_fOutOfProcessInitializeError = FALSE;
@@ -85,6 +86,18 @@ InitializeGlobalConfiguration(
             {
                 g_fEnableReferenceCountTracing = !!dwData;
             }
+
+            cbData = sizeof(dwData);
+            if ((RegQueryValueEx(hKey,
+                L"CaptureReferenceCountStacks",
+                NULL,
+                &dwType,
+                (LPBYTE)&dwData,
+                &cbData) == NO_ERROR) &&
+                (dwType == REG_DWORD) && (dwData == 1 || dwData == 0))
+            {
+                g_fCaptureReferenceCountStacks = !!dwData;
+            }
         }
 
         g_fWebSocketStaticInitialize = IsWindows8OrGreater();
@@ -151,42 +164,15 @@ EnsureOutOfProcessInitializtion(IHttpApplication *pHttpApplication)
             }
         }
 
-        g_hWinhttpSession = WinHttpOpen(L"",
-            WINHTTP_ACCESS_TYPE_NO_PROXY,
-            WINHTTP_NO_PROXY_NAME,
-            WINHTTP_NO_PROXY_BYPASS,
-            WINHTTP_FLAG_ASYNC);
-        FINISHED_LAST_ERROR_IF(g_hWinhttpSession == NULL);
-
-        //
-        // Don't set non-blocking callbacks WINHTTP_OPTION_ASSURED_NON_BLOCKING_CALLBACKS,
-        // as we will call WinHttpQueryDataAvailable to get response on the same thread
-        // that we received callback from Winhttp on completing sending/forwarding the request
-        //
-
-        //
-        // Setup the callback function
-        //
-        FINISHED_LAST_ERROR_IF(WinHttpSetStatusCallback(g_hWinhttpSession,
-            FORWARDING_HANDLER::OnWinHttpCompletion,
-            (WINHTTP_CALLBACK_FLAG_ALL_COMPLETIONS |
-                WINHTTP_CALLBACK_STATUS_SENDING_REQUEST),
-            NULL) == WINHTTP_INVALID_STATUS_CALLBACK);
-
-        //
-        // Make sure we see the redirects (rather than winhttp doing it
-        // automatically)
-        //
-        DWORD dwRedirectOption = WINHTTP_OPTION_REDIRECT_POLICY_NEVER;
-        FINISHED_LAST_ERROR_IF(!WinHttpSetOption(g_hWinhttpSession,
-            WINHTTP_OPTION_REDIRECT_POLICY,
-            &dwRedirectOption,
-            sizeof(dwRedirectOption)));
+        // Requests are proxied where delegation is missing.
+        LOG_IF_FAILED(REQUEST_DELEGATION::StaticInitialize());
 
         g_dwTlsIndex = TlsAlloc();
         FINISHED_LAST_ERROR_IF(g_dwTlsIndex == TLS_OUT_OF_INDEXES);
         FINISHED_IF_FAILED(ALLOC_CACHE_HANDLER::StaticInitialize());
         FINISHED_IF_FAILED(FORWARDING_HANDLER::StaticInitialize(g_fEnableReferenceCountTracing));
+        // After the handler, the session takes its defaults from the protocol config.
+        FINISHED_IF_FAILED(FORWARDER_CONNECTION::OpenSession(FORWARDING_HANDLER::QueryProtocolConfig(), &g_hWinhttpSession));
         FINISHED_IF_FAILED(WEBSOCKET_HANDLER::StaticInitialize(g_fEnableReferenceCountTracing));
 
         DebugInitializeFromConfig(*g_pHttpServer, *pHttpApplication);
@@ -216,6 +202,7 @@ BOOL APIENTRY DllMain(HMODULE hModule,
         break;
     case DLL_PROCESS_DETACH:
         g_fProcessDetach = TRUE;
+        WEBSOCKET_HANDLER::StaticTerminate();
         FORWARDING_HANDLER::StaticTerminate();
         ALLOC_CACHE_HANDLER::StaticTerminate();
         DebugStop();
@@ -0,0 +1,169 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "environmentblock.h"
+#include <memory>
+#include "exceptions.h"
+
+namespace
+{
+    const PCWSTR s_rgPerProcessVariables[] =
+    {
+        ASPNETCORE_PORT_ENV_STR,
+        ASPNETCORE_APP_PATH_ENV_STR,
+        ASPNETCORE_APP_TOKEN_ENV_STR,
+        ASPNETCORE_READY_EVENT_ENV_STR,
+        ASPNETCORE_DELEGATION_QUEUE_ENV_STR,
+    };
+}
+
+HRESULT
+ENVIRONMENT_BLOCK::Initialize(
+    _In_ const std::map<std::wstring, std::wstring, ignore_case_comparer>& variables
+)
+{
+    try
+    {
+        // Names of the configuration come without the '='.
+        std::map<std::wstring, std::wstring, ignore_case_comparer> remaining;
+        for (const auto& variable : variables)
+        {
+            std::wstring strName = variable.first + L"=";
+            if (IsPerProcessVariable(strName.c_str(), strName.length()))
+            {
+                m_configuredValues.insert_or_assign(std::move(strName), variable.second);
+            }
+            else
+            {
+                remaining.insert_or_assign(std::move(strName), variable.second);
+            }
+        }
+
+        m_block.clear();
+
+        const auto pszEnvironment = std::unique_ptr<WCHAR, decltype(&FreeEnvironmentStringsW)>(
+            GetEnvironmentStringsW(), &FreeEnvironmentStringsW);
+        if (pszEnvironment == nullptr)
+        {
+            RETURN_HR(HRESULT_FROM_WIN32(ERROR_INVALID_ENVIRONMENT));
+        }
+
+        for (PCWSTR pszCurrent = pszEnvironment.get(); *pszCurrent != L'\0';)
+        {
+            const size_t cchCurrent = wcslen(pszCurrent);
+            PCWSTR pszEqualChar = wcschr(pszCurrent, L'=');
+            if (pszEqualChar == nullptr)
+            {
+                // env variable is not well formatted
+                RETURN_HR(HRESULT_FROM_WIN32(ERROR_INVALID_ENVIRONMENT));
+            }
+
+            const size_t cchName = pszEqualChar - pszCurrent + 1;
+            if (!IsPerProcessVariable(pszCurrent, cchName))
+            {
+                const auto itr = remaining.find(std::wstring(pszCurrent, cchName));
+                if (itr != remaining.end())
+                {
+                    // same env variable is defined in configuration, use it
+                    AppendVariable(itr->first, itr->second);
+                    remaining.erase(itr);
+                }
+                else
+                {
+                    m_block.insert(m_block.end(), pszCurrent, pszCurrent + cchCurrent + 1);
+                }
+            }
+
+            pszCurrent += cchCurrent + 1;
+        }
+
+        for (const auto& variable : remaining)
+        {
+            AppendVariable(variable.first, variable.second);
+        }
+    }
+    CATCH_RETURN();
+
+    return S_OK;
+}
+
+PCWSTR
+ENVIRONMENT_BLOCK::QueryConfiguredValue(
+    _In_ PCWSTR     pszName
+) const noexcept
+{
+    try
+    {
+        const auto itr = m_configuredValues.find(pszName);
+        return itr != m_configuredValues.end() ? itr->second.c_str() : NULL;
+    }
+    catch (...)
+    {
+        OBSERVE_CAUGHT_EXCEPTION();
+        return NULL;
+    }
+}
+
+HRESULT
+ENVIRONMENT_BLOCK::Format(
+    _In_reads_(cVariables) const VARIABLE *    rgVariables,
+    _In_ DWORD                                  cVariables,
+    _Inout_ std::vector<WCHAR> *                pBlock
+) const
+{
+    try
+    {
+        size_t cchBlock = m_block.size() + 1;
+        for (DWORD i = 0; i < cVariables; ++i)
+        {
+            cchBlock += wcslen(rgVariables[i].pszName) + wcslen(rgVariables[i].pszValue) + 1;
+        }
+
+        // A retry of the start reuses the capacity of the previous one.
+        pBlock->clear();
+        pBlock->reserve(cchBlock);
+        pBlock->assign(m_block.begin(), m_block.end());
+
+        for (DWORD i = 0; i < cVariables; ++i)
+        {
+            const PCWSTR pszName = rgVariables[i].pszName;
+            const PCWSTR pszValue = rgVariables[i].pszValue;
+            pBlock->insert(pBlock->end(), pszName, pszName + wcslen(pszName));
+            pBlock->insert(pBlock->end(), pszValue, pszValue + wcslen(pszValue) + 1);
+        }
+
+        pBlock->push_back(L'\0');
+    }
+    CATCH_RETURN();
+
+    return S_OK;
+}
+
+VOID
+ENVIRONMENT_BLOCK::AppendVariable(
+    _In_ const std::wstring&    strName,
+    _In_ const std::wstring&    strValue
+)
+{
+    m_block.insert(m_block.end(), strName.begin(), strName.end());
+    m_block.insert(m_block.end(), strValue.c_str(), strValue.c_str() + strValue.length() + 1);
+}
+
+// static
+BOOL
+ENVIRONMENT_BLOCK::IsPerProcessVariable(
+    _In_reads_(cchName) PCWSTR  pszName,
+    _In_ size_t                 cchName
+) noexcept
+{
+    for (const PCWSTR pszPerProcess : s_rgPerProcessVariables)
+    {
+        if (wcslen(pszPerProcess) == cchName &&
+            _wcsnicmp(pszPerProcess, pszName, cchName) == 0)
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
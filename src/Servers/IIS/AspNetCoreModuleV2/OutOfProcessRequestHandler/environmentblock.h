@@ -0,0 +1,81 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include "StringHelpers.h"
+
+//
+// The environment of the backend processes of an application: the
+// environment of the worker process with the configured variables merged
+// in, built once by PROCESS_MANAGER and copied by every process start and
+// restart. A configuration change recycles the application, and with it
+// the process manager that owns the block.
+//
+// The variables that differ per process, the port, the token, the
+// readiness event, the delegation queue and the application path, are
+// left out of the block whether the worker or the configuration sets
+// them. Format appends them after the copy. A configured port or token
+// is kept for SERVER_PROCESS, see QueryConfiguredValue.
+//
+class ENVIRONMENT_BLOCK
+{
+public:
+    struct VARIABLE
+    {
+        // With the trailing '=', like ASPNETCORE_PORT_ENV_STR.
+        PCWSTR  pszName;
+        PCWSTR  pszValue;
+    };
+
+    //
+    // variables are the configured ones, as returned by
+    // ENVIRONMENT_VAR_HELPERS::InitEnvironmentVariablesTable.
+    //
+    HRESULT
+    Initialize(
+        _In_ const std::map<std::wstring, std::wstring, ignore_case_comparer>& variables
+    );
+
+    //
+    // The configured value of one of the per-process variables, NULL if
+    // it is not configured.
+    //
+    PCWSTR
+    QueryConfiguredValue(
+        _In_ PCWSTR     pszName
+    ) const noexcept;
+
+    //
+    // Writes the block followed by rgVariables into pBlock, the
+    // environment to give CreateProcessW.
+    //
+    HRESULT
+    Format(
+        _In_reads_(cVariables) const VARIABLE *    rgVariables,
+        _In_ DWORD                                  cVariables,
+        _Inout_ std::vector<WCHAR> *                pBlock
+    ) const;
+
+private:
+    VOID
+    AppendVariable(
+        _In_ const std::wstring&    strName,
+        _In_ const std::wstring&    strValue
+    );
+
+    static
+    BOOL
+    IsPerProcessVariable(
+        _In_reads_(cchName) PCWSTR  pszName,
+        _In_ size_t                 cchName
+    ) noexcept;
+
+    // Every variable NUL terminated, without the final NUL of a block.
+    std::vector<WCHAR>      m_block;
+    // Configured values of the per-process variables, names with the '='.
+    std::map<std::wstring, std::wstring, ignore_case_comparer> m_configuredValues;
+};
@@ -7,17 +7,69 @@
 FORWARDER_CONNECTION::FORWARDER_CONNECTION(
     VOID
 ) : m_cRefs (1),
-    m_hConnection (NULL)
+    m_hConnection (NULL),
+    m_hSession (NULL),
+    m_pSharedSession (NULL)
 {
 }
 
+//static
+HRESULT
+FORWARDER_SESSION::Create(
+    _Out_ FORWARDER_SESSION **      ppSession
+)
+{
+    *ppSession = NULL;
+
+    FORWARDER_SESSION *pSession = new FORWARDER_SESSION();
+    if (pSession == NULL)
+    {
+        RETURN_HR(E_OUTOFMEMORY);
+    }
+
+    HRESULT hr = FORWARDER_CONNECTION::OpenSession(FORWARDING_HANDLER::QueryProtocolConfig(), &pSession->m_hSession);
+    if (FAILED_LOG(hr))
+    {
+        pSession->DereferenceForwarderSession();
+        return hr;
+    }
+
+    *ppSession = pSession;
+    return S_OK;
+}
+
 HRESULT
 FORWARDER_CONNECTION::Initialize(
-    DWORD   dwPort
+    _In_opt_ FORWARDER_SESSION *    pSession,
+    DWORD                           dwPort,
+    DWORD                           dwMaxConnections
 )
 {
-    RETURN_IF_FAILED(m_ConnectionKey.Initialize( dwPort ));
-    m_hConnection = WinHttpConnect(g_hWinhttpSession,
+    HINTERNET hSession = g_hWinhttpSession;
+
+    if (pSession != NULL && dwMaxConnections == 0)
+    {
+        // Held until the connection handle is closed.
+        pSession->ReferenceForwarderSession();
+        m_pSharedSession = pSession;
+        hSession = pSession->QueryHandle();
+    }
+
+    if (dwMaxConnections != 0)
+    {
+        //
+        // WinHTTP only takes the per server connection limit on a session
+        // handle, and the shared session serves every application.
+        //
+        RETURN_IF_FAILED(OpenSession(FORWARDING_HANDLER::QueryProtocolConfig(), &m_hSession));
+        RETURN_LAST_ERROR_IF(!WinHttpSetOption(m_hSession,
+                                 WINHTTP_OPTION_MAX_CONNS_PER_SERVER,
+                                 &dwMaxConnections,
+                                 sizeof(dwMaxConnections)));
+        hSession = m_hSession;
+    }
+
+    m_hConnection = WinHttpConnect(hSession,
                                    L"127.0.0.1",
                                    (USHORT) dwPort,
                                    0);
@@ -26,9 +78,199 @@ FORWARDER_CONNECTION::Initialize(
     // Since WinHttp will not emit WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING
     // when closing WebSocket handle on Win8. Register callback at Connect level as a workaround
     //
+    // The requests opened on the connection inherit the callback, so it
+    // carries the notifications the forwarding handler needs from them.
+    //
     RETURN_LAST_ERROR_IF (WinHttpSetStatusCallback(m_hConnection,
                                  FORWARDING_HANDLER::OnWinHttpCompletion,
-                                 WINHTTP_CALLBACK_FLAG_HANDLES,
+                                 (WINHTTP_CALLBACK_FLAG_ALL_COMPLETIONS |
+                                     WINHTTP_CALLBACK_FLAG_HANDLES |
+                                     WINHTTP_CALLBACK_STATUS_SENDING_REQUEST),
                                  NULL) == WINHTTP_INVALID_STATUS_CALLBACK);
     return S_OK;
 }
+
+//static
+HRESULT
+FORWARDER_CONNECTION::OpenSession(
+    _In_ const PROTOCOL_CONFIG *    pProtocol,
+    _Out_ HINTERNET *               phSession
+)
+{
+    HINTERNET hSession = WinHttpOpen(L"",
+        WINHTTP_ACCESS_TYPE_NO_PROXY,
+        WINHTTP_NO_PROXY_NAME,
+        WINHTTP_NO_PROXY_BYPASS,
+        WINHTTP_FLAG_ASYNC);
+    RETURN_LAST_ERROR_IF_NULL(hSession);
+
+    //
+    // Don't set non-blocking callbacks WINHTTP_OPTION_ASSURED_NON_BLOCKING_CALLBACKS,
+    // as we will call WinHttpQueryDataAvailable to get response on the same thread
+    // that we received callback from Winhttp on completing sending/forwarding the request
+    //
+
+    //
+    // Setup the callback function
+    //
+    if (WinHttpSetStatusCallback(hSession,
+            FORWARDING_HANDLER::OnWinHttpCompletion,
+            (WINHTTP_CALLBACK_FLAG_ALL_COMPLETIONS |
+                WINHTTP_CALLBACK_STATUS_SENDING_REQUEST),
+            NULL) == WINHTTP_INVALID_STATUS_CALLBACK)
+    {
+        HRESULT hr = LOG_IF_FAILED(HRESULT_FROM_WIN32(GetLastError()));
+        WinHttpCloseHandle(hSession);
+        return hr;
+    }
+
+    //
+    // Make sure we see the redirects (rather than winhttp doing it
+    // automatically)
+    //
+    DWORD dwRedirectOption = WINHTTP_OPTION_REDIRECT_POLICY_NEVER;
+    if (!WinHttpSetOption(hSession,
+            WINHTTP_OPTION_REDIRECT_POLICY,
+            &dwRedirectOption,
+            sizeof(dwRedirectOption)))
+    {
+        HRESULT hr = LOG_IF_FAILED(HRESULT_FROM_WIN32(GetLastError()));
+        WinHttpCloseHandle(hSession);
+        return hr;
+    }
+
+    //
+    // Defaults of every request, a request only overrides the timeouts when
+    // a debugger is attached to its backend.
+    //
+    const DWORD dwTimeout = pProtocol->QueryTimeout();
+    DWORD dwResponseBufferLimit = pProtocol->QueryResponseBufferLimit();
+    DWORD dwMaxHeaderSize = pProtocol->QueryMaxResponseHeaderSize();
+    if (!WinHttpSetTimeouts(hSession,
+            dwTimeout, // resolve timeout
+            dwTimeout, // connect timeout
+            dwTimeout, // send timeout
+            dwTimeout) || // receive timeout
+        !WinHttpSetOption(hSession,
+            WINHTTP_OPTION_MAX_RESPONSE_DRAIN_SIZE,
+            &dwResponseBufferLimit,
+            sizeof(dwResponseBufferLimit)) ||
+        !WinHttpSetOption(hSession,
+            WINHTTP_OPTION_MAX_RESPONSE_HEADER_SIZE,
+            &dwMaxHeaderSize,
+            sizeof(dwMaxHeaderSize)))
+    {
+        HRESULT hr = LOG_IF_FAILED(HRESULT_FROM_WIN32(GetLastError()));
+        WinHttpCloseHandle(hSession);
+        return hr;
+    }
+
+    *phSession = hSession;
+    return S_OK;
+}
+
+VOID
+FORWARDER_CONNECTION::Prewarm(
+    DWORD   cConnections,
+    PCWSTR  pszUrl,
+    PCWSTR  pszHeaders,
+    DWORD   dwTimeout
+)
+{
+    cConnections = min(cConnections, MAX_PREWARM_CONNECTIONS);
+
+    for (DWORD i = 0; i < cConnections; i++)
+    {
+        //
+        // HEAD so that the answer has no body to drain before the
+        // connection goes back to the pool.
+        //
+        HINTERNET hRequest = WinHttpOpenRequest(m_hConnection,
+            L"HEAD",
+            pszUrl,
+            NULL,
+            WINHTTP_NO_REFERER,
+            WINHTTP_DEFAULT_ACCEPT_TYPES,
+            0);
+        if (hRequest == NULL)
+        {
+            LOG_IF_FAILED(HRESULT_FROM_WIN32(GetLastError()));
+            return;
+        }
+
+        //
+        // Each outstanding request holds a reference, released when WinHTTP
+        // reports its handle closing.
+        //
+        DWORD_PTR dwContext = reinterpret_cast<DWORD_PTR>(this);
+        if (!WinHttpSetTimeouts(hRequest, dwTimeout, dwTimeout, dwTimeout, dwTimeout) ||
+            !WinHttpSetOption(hRequest, WINHTTP_OPTION_CONTEXT_VALUE, &dwContext, sizeof(dwContext)) ||
+            WinHttpSetStatusCallback(hRequest,
+                FORWARDER_CONNECTION::OnPrewarmCompletion,
+                WINHTTP_CALLBACK_FLAG_ALL_COMPLETIONS | WINHTTP_CALLBACK_FLAG_HANDLES,
+                NULL) == WINHTTP_INVALID_STATUS_CALLBACK)
+        {
+            LOG_IF_FAILED(HRESULT_FROM_WIN32(GetLastError()));
+            WinHttpSetStatusCallback(hRequest, NULL, 0, NULL);
+            WinHttpCloseHandle(hRequest);
+            return;
+        }
+
+        ReferenceForwarderConnection();
+
+        if (!WinHttpSendRequest(hRequest,
+            pszHeaders,
+            static_cast<DWORD>(-1L),
+            WINHTTP_NO_REQUEST_DATA,
+            0,
+            0,
+            dwContext))
+        {
+            LOG_IF_FAILED(HRESULT_FROM_WIN32(GetLastError()));
+            WinHttpCloseHandle(hRequest);
+            return;
+        }
+    }
+}
+
+//static
+VOID
+CALLBACK
+FORWARDER_CONNECTION::OnPrewarmCompletion(
+    HINTERNET   hRequest,
+    DWORD_PTR   dwContext,
+    DWORD       dwInternetStatus,
+    LPVOID      lpvStatusInformation,
+    DWORD       dwStatusInformationLength
+)
+{
+    UNREFERENCED_PARAMETER(lpvStatusInformation);
+    UNREFERENCED_PARAMETER(dwStatusInformationLength);
+
+    switch (dwInternetStatus)
+    {
+    case WINHTTP_CALLBACK_STATUS_SENDREQUEST_COMPLETE:
+        if (WinHttpReceiveResponse(hRequest, NULL))
+        {
+            break;
+        }
+        WinHttpCloseHandle(hRequest);
+        break;
+
+    case WINHTTP_CALLBACK_STATUS_HEADERS_AVAILABLE:
+    case WINHTTP_CALLBACK_STATUS_REQUEST_ERROR:
+        //
+        // The connection is either back in the pool or gone, in both cases
+        // the request is done.
+        //
+        WinHttpCloseHandle(hRequest);
+        break;
+
+    case WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING:
+        reinterpret_cast<FORWARDER_CONNECTION *>(dwContext)->DereferenceForwarderConnection();
+        break;
+
+    default:
+        break;
+    }
+}
@@ -3,47 +3,71 @@
 
 #pragma once
 
+#define MAX_PREWARM_CONNECTIONS 64
+
 //
-// The key used for hash-table lookups, consists of the port on which the http process is created.
+// WinHTTP session of one application with isolateWinHttpSession, so that
+// its connections are pooled and limited apart from the other
+// applications of the worker process. Held by the process manager and by
+// every connection made on it, none outlives the session handle.
 //
-class FORWARDER_CONNECTION_KEY
+class FORWARDER_SESSION
 {
 public:
 
-    FORWARDER_CONNECTION_KEY(
-        VOID
-    )
+    static
+    HRESULT
+    Create(
+        _Out_ FORWARDER_SESSION **      ppSession
+    );
+
+    HINTERNET
+    QueryHandle() const
     {
+        return m_hSession;
     }
 
-    HRESULT
-    Initialize(
-        _In_ DWORD  dwPort
-    )
+    VOID
+    ReferenceForwarderSession() const
     {
-        m_dwPort = dwPort;
-        return S_OK;
+        InterlockedIncrement(&m_cRefs);
     }
 
-    BOOL
-    GetIsEqual(
-        const FORWARDER_CONNECTION_KEY * key2
-    ) const
+    VOID
+    DereferenceForwarderSession() const
     {
-        return m_dwPort == key2->m_dwPort;
+        if (InterlockedDecrement(&m_cRefs) == 0)
+        {
+            delete this;
+        }
     }
 
-    DWORD CalcKeyHash() const
+private:
+
+    FORWARDER_SESSION() :
+        m_cRefs(1),
+        m_hSession(NULL)
     {
-        // TODO: Review hash distribution.
-        return Hash(m_dwPort);
     }
 
-private:
+    ~FORWARDER_SESSION()
+    {
+        if (m_hSession != NULL)
+        {
+            WinHttpCloseHandle(m_hSession);
+            m_hSession = NULL;
+        }
+    }
 
-    DWORD      m_dwPort;
+    mutable LONG                m_cRefs;
+    HINTERNET                   m_hSession;
 };
 
+//
+// The WinHTTP connection to one backend process. Each SERVER_PROCESS owns
+// its connection and hands it to the forwarding handler directly, so no
+// lookup or lock sits between a request and its connection handle.
+//
 class FORWARDER_CONNECTION
 {
 public:
@@ -52,9 +76,43 @@ public:
         VOID
     );
 
+    //
+    // dwMaxConnections != 0 gives the backend its own WinHTTP session so
+    // that the keep-alive pool to it can be capped, otherwise it shares
+    // the session of pSession, or g_hWinhttpSession when NULL.
+    //
     HRESULT
     Initialize(
-        DWORD   dwPort
+        _In_opt_ FORWARDER_SESSION *    pSession,
+        DWORD                           dwPort,
+        DWORD                           dwMaxConnections
+    );
+
+    //
+    // Opens up to cConnections keep-alive connections to the backend by
+    // issuing that many concurrent requests for pszUrl; they stay in the
+    // WinHTTP pool once answered. Completes asynchronously and never fails
+    // the caller, a connection that cannot be opened is simply not warm.
+    //
+    VOID
+    Prewarm(
+        DWORD   cConnections,
+        PCWSTR  pszUrl,
+        PCWSTR  pszHeaders,
+        DWORD   dwTimeout
+    );
+
+    //
+    // Opens an asynchronous session configured the way the forwarding
+    // handler expects (status callback, no automatic redirects). The
+    // timeouts and response limits of pProtocol are set on the session so
+    // that its requests inherit them instead of setting them one by one.
+    //
+    static
+    HRESULT
+    OpenSession(
+        _In_ const PROTOCOL_CONFIG *    pProtocol,
+        _Out_ HINTERNET *               phSession
     );
 
     HINTERNET
@@ -78,12 +136,6 @@ public:
         }
     }
 
-    FORWARDER_CONNECTION_KEY *
-    QueryConnectionKey()
-    {
-        return &m_ConnectionKey;
-    }
-
 private:
 
     ~FORWARDER_CONNECTION()
@@ -93,65 +145,38 @@ private:
             WinHttpCloseHandle(m_hConnection);
             m_hConnection = NULL;
         }
-    }
-
-    mutable LONG                m_cRefs;
-    FORWARDER_CONNECTION_KEY    m_ConnectionKey;
-    HINTERNET                   m_hConnection;
-};
-
-class FORWARDER_CONNECTION_HASH :
-    public HASH_TABLE<FORWARDER_CONNECTION, FORWARDER_CONNECTION_KEY *>
-{
-
-public:
-
-    FORWARDER_CONNECTION_HASH()
-    {}
-
-    FORWARDER_CONNECTION_KEY *
-    ExtractKey(
-        FORWARDER_CONNECTION *pConnection
-    )
-    {
-        return pConnection->QueryConnectionKey();
-    }
-
-    DWORD
-    CalcKeyHash(
-        FORWARDER_CONNECTION_KEY *key
-    )
-    {
-        return key->CalcKeyHash();
-    }
 
-    BOOL
-    EqualKeys(
-        FORWARDER_CONNECTION_KEY *key1,
-        FORWARDER_CONNECTION_KEY *key2
-    )
-    {
-        return key1->GetIsEqual(key2);
-    }
+        if (m_hSession != NULL)
+        {
+            WinHttpCloseHandle(m_hSession);
+            m_hSession = NULL;
+        }
 
-    VOID
-    ReferenceRecord(
-        FORWARDER_CONNECTION *pConnection
-    )
-    {
-        pConnection->ReferenceForwarderConnection();
+        if (m_pSharedSession != NULL)
+        {
+            m_pSharedSession->DereferenceForwarderSession();
+            m_pSharedSession = NULL;
+        }
     }
 
+    static
     VOID
-    DereferenceRecord(
-        FORWARDER_CONNECTION *pConnection
-    )
-    {
-        pConnection->DereferenceForwarderConnection();
-    }
-
-private:
+    CALLBACK
+    OnPrewarmCompletion(
+        HINTERNET   hRequest,
+        DWORD_PTR   dwContext,
+        DWORD       dwInternetStatus,
+        LPVOID      lpvStatusInformation,
+        DWORD       dwStatusInformationLength
+    );
 
-    FORWARDER_CONNECTION_HASH(const FORWARDER_CONNECTION_HASH &);
-    void operator=(const FORWARDER_CONNECTION_HASH &);
-};
\ No newline at end of file
+    mutable LONG                m_cRefs;
+    HINTERNET                   m_hConnection;
+    //
+    // Dedicated session when the connection count is capped, NULL when
+    // the connection is made on a shared session.
+    //
+    HINTERNET                   m_hSession;
+    // The application session the connection is made on, if any.
+    const FORWARDER_SESSION *   m_pSharedSession;
+};
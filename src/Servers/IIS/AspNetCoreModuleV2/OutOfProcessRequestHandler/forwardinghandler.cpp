@@ -8,9 +8,12 @@
 #include "ServerErrorHandler.h"
 #include "resource.h"
 #include "file_utility.h"
+#include "LockContention.h"
+#include "AllocationTracking.h"
+#include "TraceProvider.h"
 
 // Just to be aware of the FORWARDING_HANDLER object size.
-C_ASSERT(sizeof(FORWARDING_HANDLER) <= 632);
+C_ASSERT(sizeof(FORWARDING_HANDLER) <= 616 + INLINE_RESPONSE_BUFFER_SIZE);
 
 #define DEF_MAX_FORWARDS        32
 #define HEX_TO_ASCII(c) ((CHAR)(((c) < 10) ? ((c) + '0') : ((c) + 'a' - 10)))
@@ -20,10 +23,16 @@ C_ASSERT(sizeof(FORWARDING_HANDLER) <= 632);
 #define FORWARDING_HANDLER_SIGNATURE        ((DWORD)'FHLR')
 #define FORWARDING_HANDLER_SIGNATURE_FREE   ((DWORD)'fhlr')
 
+#define IS_SEND_FILE_SEPARATOR(c) ((c) == '\\' || (c) == '/')
+
 ALLOC_CACHE_HANDLER *       FORWARDING_HANDLER::sm_pAlloc = NULL;
-TRACE_LOG *                 FORWARDING_HANDLER::sm_pTraceLog = NULL;
+PER_CPU_REF_TRACE_LOG *     FORWARDING_HANDLER::sm_pTraceLog = NULL;
 PROTOCOL_CONFIG             FORWARDING_HANDLER::sm_ProtocolConfig;
-RESPONSE_HEADER_HASH *      FORWARDING_HANDLER::sm_pResponseHeaderHash = NULL;
+RESPONSE_BUFFER_POOL *      FORWARDING_HANDLER::sm_pResponseBufferPool = NULL;
+LONGLONG                    FORWARDING_HANDLER::sm_llPerformanceFrequency = 0;
+REQUEST_SAMPLER             FORWARDING_HANDLER::sm_RequestSampler;
+GROUP_AFFINITY *            FORWARDING_HANDLER::sm_pNodeAffinity = NULL;
+USHORT                      FORWARDING_HANDLER::sm_cNodes = 0;
 
 FORWARDING_HANDLER::FORWARDING_HANDLER(
     _In_ IHttpContext                  *pW3Context,
@@ -31,31 +40,84 @@ FORWARDING_HANDLER::FORWARDING_HANDLER(
 ) : REQUEST_HANDLER(*pW3Context),
     m_Signature(FORWARDING_HANDLER_SIGNATURE),
     m_RequestStatus(FORWARDER_START),
+    m_cRefs(1),
+    m_dwHandlers (1), // default http handler
+    m_pW3Context(pW3Context),
     m_fClientDisconnected(FALSE),
-    m_fResponseHeadersReceivedAndSet(FALSE),
-    m_fDoReverseRewriteHeaders(FALSE),
     m_fFinishRequest(FALSE),
+    m_fDoneAsyncCompletion(FALSE),
     m_fHasError(FALSE),
-    m_pszHeaders(NULL),
-    m_cchHeaders(0),
+    m_fHttpHandleInClose(FALSE),
     m_BytesToReceive(0),
     m_BytesToSend(0),
+    m_cInlineReads(0),
+    m_pReadAhead(NULL),
+    m_pUpload(NULL),
+    m_fDoReverseRewriteHeaders(FALSE),
+    m_fPriorityRequest(FALSE),
+    m_fWaitedForProcess(FALSE),
+    m_fWaitedForCacheFill(FALSE),
     m_fWebSocketEnabled(FALSE),
-    m_pWebSocket(NULL),
-    m_dwHandlers (1), // default http handler
-    m_fDoneAsyncCompletion(FALSE),
-    m_fHttpHandleInClose(FALSE),
-    m_fWebSocketHandleInClose(FALSE),
+    m_fResponseHeadersReceivedAndSet(FALSE),
     m_fServerResetConn(FALSE),
-    m_cRefs(1),
-    m_pW3Context(pW3Context),
+    m_fRequestRetried(FALSE),
+    m_fResponseFlushed(FALSE),
+    m_fReadingWholeResponse(FALSE),
+    m_fAwaitingResponseHeaders(FALSE),
+    m_hrProcessStart(S_OK),
+    m_pszHeaders(NULL),
+    m_cchHeaders(0),
+    m_cbChunkedBodyRead(0),
+    m_cRetriesLeft(0),
+    m_dwFlushIntervalInMS(0),
+    m_ullLastFlushTick(0),
+    m_pCold(NULL),
+    m_pRequestSpool(NULL),
+    m_pResponseSpool(NULL),
+    m_pResponseSpoolBuffer(NULL),
+    m_fResponseSpoolSent(FALSE),
+    m_pServerProcess(NULL),
+    m_pWindowsAuthToken(NULL),
+    m_pSendFileInfo(NULL),
+    m_Timings(),
+    m_pSample(NULL),
+    m_pCacheEntry(NULL),
+    m_pCacheFill(NULL),
     m_pApplication(std::move(pApplication)),
-    m_fReactToDisconnect(FALSE)
+    m_fReactToDisconnect(FALSE),
+    m_fInlineResponseBufferInUse(FALSE)
 {
     LOG_TRACE(L"FORWARDING_HANDLER::FORWARDING_HANDLER");
 
+    m_pApplication->QueryCounters()->RequestStarted();
+    m_pApplication->QueryCounters()->MemoryCharged(APPLICATION_COUNTERS::MEMORY_TAG_HANDLERS, sizeof(FORWARDING_HANDLER));
+
     m_fWebSocketSupported = m_pApplication->QueryWebsocketStatus();
-    m_fForwardResponseConnectionHeader = m_pApplication->QueryConfig()->QueryForwardResponseConnectionHeader()->Equals(L"true", /* ignoreCase */ 1);
+    m_fForwardResponseConnectionHeader = m_pApplication->QueryConfig()->QueryForwardResponseConnectionHeader()->Equals(L"true", /* ignoreCase */ 1) != FALSE;
+    m_fSetForwardTimingsServerVariable = m_pApplication->QueryConfig()->QueryForwardTimingsServerVariable()->Equals(L"true", /* ignoreCase */ 1) != FALSE;
+
+    //
+    // The handler and its buffers come from slabs of the node of the IIS
+    // thread building it, the completions are kept on that node.
+    //
+    m_uCompletionNode = NO_COMPLETION_NODE;
+    if (sm_pNodeAffinity != NULL && m_pApplication->QueryConfig()->QueryNumaLocalCompletions())
+    {
+        PROCESSOR_NUMBER processorNumber;
+        USHORT usNode = 0;
+        GetCurrentProcessorNumberEx(&processorNumber);
+        if (GetNumaProcessorNodeEx(&processorNumber, &usNode) &&
+            usNode < sm_cNodes &&
+            sm_pNodeAffinity[usNode].Mask != 0)
+        {
+            m_uCompletionNode = usNode;
+        }
+    }
+    if (REQUEST_SAMPLER::ShouldSample(m_pApplication->QueryConfig()->QueryRequestSamplingRate()))
+    {
+        // Not sampled if out of memory.
+        m_pSample = new (std::nothrow) REQUEST_SAMPLE();
+    }
     InitializeSRWLock(&m_RequestLock);
 }
 
@@ -84,10 +146,170 @@ FORWARDING_HANDLER::~FORWARDING_HANDLER(
 
     FreeResponseBuffers();
 
-    if (m_pWebSocket)
+    FreeReadAhead();
+
+    FreeUpload();
+
+    if (m_pRequestSpool != NULL)
+    {
+        delete m_pRequestSpool;
+        m_pRequestSpool = NULL;
+    }
+
+    if (m_pResponseSpool != NULL)
+    {
+        delete m_pResponseSpool;
+        m_pResponseSpool = NULL;
+    }
+
+    if (QueryWebSocket() != NULL)
+    {
+        m_pCold->pWebSocket->Terminate();
+        m_pCold->pWebSocket = NULL;
+    }
+
+    ReleaseWindowsAuthToken(m_fResponseHeadersReceivedAndSet);
+
+    if (m_pServerProcess != NULL)
+    {
+        m_pServerProcess->DecrementOutstandingRequests();
+        m_pServerProcess->DereferenceServerProcess();
+        m_pServerProcess = NULL;
+    }
+
+    if (m_pSendFileInfo != NULL)
+    {
+        m_pSendFileInfo->DereferenceFileInfo();
+        m_pSendFileInfo = NULL;
+    }
+
+    if (m_pSample != NULL)
+    {
+        delete m_pSample;
+        m_pSample = NULL;
+    }
+
+    if (m_pCacheEntry != NULL)
+    {
+        m_pCacheEntry->Dereference();
+        m_pCacheEntry = NULL;
+    }
+
+    EndResponseCacheFill();
+
+    m_pApplication->QueryCounters()->MemoryReleased(APPLICATION_COUNTERS::MEMORY_TAG_HANDLERS, sizeof(FORWARDING_HANDLER));
+    m_pApplication->QueryCounters()->RequestCompleted();
+}
+
+//
+// Whether the header is one of the MS-ASPNETCORE* headers the module
+// sends to the backend itself. The case folded first 8 bytes are compared
+// as one word, which rejects nearly every header without a string compare.
+//
+static
+BOOL
+IsAspNetCoreHeaderName(
+    const HTTP_UNKNOWN_HEADER *pHeader
+)
+{
+    // "ms-aspne" as a little endian word, '-' already has the 0x20 bit
+    static const UINT64 ullPrefixFolded = 0x656E7073612D736DULL;
+    UINT64              ullStart;
+
+    if (pHeader->NameLength < 13)
+    {
+        return FALSE;
+    }
+
+    memcpy(&ullStart, pHeader->pName, sizeof(ullStart));
+    if ((ullStart | 0x2020202020202020ULL) != ullPrefixFolded)
+    {
+        return FALSE;
+    }
+
+    return _strnicmp(pHeader->pName, "MS-ASPNETCORE", 13) == 0;
+}
+
+//
+// RFC 7231 idempotent methods, sending one of them twice has the same
+// effect on the backend as sending it once.
+//
+static
+BOOL
+IsIdempotentVerb(
+    HTTP_VERB       verb
+)
+{
+    switch (verb)
+    {
+    case HttpVerbGET:
+    case HttpVerbHEAD:
+    case HttpVerbOPTIONS:
+    case HttpVerbTRACE:
+    case HttpVerbPUT:
+    case HttpVerbDELETE:
+        return TRUE;
+
+    default:
+        return FALSE;
+    }
+}
+
+//
+// RFC 7231 safe methods, the backend is not expected to change anything
+// for them.
+//
+static
+BOOL
+IsSafeVerb(
+    HTTP_VERB       verb
+)
+{
+    switch (verb)
+    {
+    case HttpVerbGET:
+    case HttpVerbHEAD:
+    case HttpVerbOPTIONS:
+    case HttpVerbTRACE:
+        return TRUE;
+
+    default:
+        return FALSE;
+    }
+}
+
+//
+// The counter a request failed with hr is accounted to.
+//
+static
+APPLICATION_COUNTERS::FORWARDING_ERROR
+QueryForwardingError(
+    HRESULT         hr
+)
+{
+    switch (hr)
     {
-        m_pWebSocket->Terminate();
-        m_pWebSocket = NULL;
+    case HRESULT_FROM_WIN32(ERROR_WINHTTP_CANNOT_CONNECT):
+    case HRESULT_FROM_WIN32(ERROR_WINHTTP_CONNECTION_ERROR):
+    case HRESULT_FROM_WIN32(ERROR_WINHTTP_NAME_NOT_RESOLVED):
+        return APPLICATION_COUNTERS::FORWARDING_ERROR_CONNECT;
+
+    case HRESULT_FROM_WIN32(ERROR_WINHTTP_TIMEOUT):
+        return APPLICATION_COUNTERS::FORWARDING_ERROR_TIMEOUT;
+
+    case HRESULT_FROM_WIN32(ERROR_WINHTTP_INVALID_SERVER_RESPONSE):
+    case HRESULT_FROM_WIN32(ERROR_WINHTTP_HEADER_SIZE_OVERFLOW):
+        return APPLICATION_COUNTERS::FORWARDING_ERROR_INVALID_RESPONSE;
+
+    case HRESULT_FROM_WIN32(ERROR_SERVER_DISABLED):
+    case HRESULT_FROM_WIN32(ERROR_CREATE_FAILED):
+        return APPLICATION_COUNTERS::FORWARDING_ERROR_PROCESS_START;
+
+    case E_APPLICATION_EXITING:
+        return APPLICATION_COUNTERS::FORWARDING_ERROR_UNAVAILABLE;
+
+    default:
+        return APPLICATION_COUNTERS::FORWARDING_ERROR_OTHER;
     }
 }
 
@@ -99,7 +321,6 @@ FORWARDING_HANDLER::ExecuteRequestHandler()
     HRESULT                     hr = S_OK;
     BOOL                        fRequestLocked = FALSE;
     BOOL                        fFailedToStartKestrel = FALSE;
-    BOOL                        fSecure = FALSE;
     HINTERNET                   hConnect = NULL;
     IHttpRequest               *pRequest = m_pW3Context->GetRequest();
     IHttpResponse              *pResponse = m_pW3Context->GetResponse();
@@ -108,10 +329,14 @@ FORWARDING_HANDLER::ExecuteRequestHandler()
     SERVER_PROCESS             *pServerProcess = NULL;
 
     USHORT                      cchHostName = 0;
+    PCWSTR                      pszEscapedUrl = NULL;
+
+    ARENA_STRU(struEscapedUrl, 2048, &m_Arena);
 
-    STACK_STRU(strDestination, 32);
-    STACK_STRU(strUrl, 2048);
-    STACK_STRU(struEscapedUrl, 2048);
+    if (m_Timings.llStart == 0)
+    {
+        m_Timings.llStart = QueryTimestamp();
+    }
 
     //
     // Take a reference so that object does not go away as a result of
@@ -135,7 +360,62 @@ FORWARDING_HANDLER::ExecuteRequestHandler()
         FAILURE(E_INVALIDARG);
     }
 
-    hr = m_pApplication->GetProcess(&pServerProcess);
+    if (IsRequestBodyTooLarge())
+    {
+        //
+        // Answered before a backend is involved, not logged.
+        //
+        hr = HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE);
+        goto Failure;
+    }
+
+    if (TryCoalesceCacheableRequest(&retVal))
+    {
+        goto Finished;
+    }
+
+    if (m_pRequestSpool == NULL &&
+        m_pApplication->QueryConfig()->QueryRequestBufferingMemoryLimit() != 0)
+    {
+        BOOL fSpooling = FALSE;
+        FAILURE_IF_FAILED(BeginSpoolRequestBody(&fSpooling));
+        if (fSpooling)
+        {
+            //
+            // Forwarded once the whole body is read, see SpoolRequestBody.
+            //
+            retVal = SpoolRequestBody(0, S_OK);
+            goto Finished;
+        }
+    }
+
+    if (m_fWaitedForProcess)
+    {
+        //
+        // Resumed after the process start this request was parked on.
+        //
+        hr = m_hrProcessStart;
+        if (SUCCEEDED(hr))
+        {
+            hr = m_pApplication->GetProcess(&pServerProcess);
+        }
+    }
+    else
+    {
+        //
+        // Do not hold the IIS thread while a process starts, park the
+        // request instead and resume it once the process is up.
+        //
+        m_RequestStatus = FORWARDER_WAITING_FOR_PROCESS;
+        hr = m_pApplication->GetProcessAsync(this, &pServerProcess);
+        if (hr == HRESULT_FROM_WIN32(ERROR_IO_PENDING))
+        {
+            retVal = RQ_NOTIFICATION_PENDING;
+            goto Finished;
+        }
+        m_RequestStatus = FORWARDER_START;
+    }
+
     if (FAILED_LOG(hr))
     {
         fFailedToStartKestrel = TRUE;
@@ -148,25 +428,48 @@ FORWARDING_HANDLER::ExecuteRequestHandler()
         FAILURE(HRESULT_FROM_WIN32(ERROR_CREATE_FAILED));
     }
 
-    if (pServerProcess->QueryWinHttpConnection() == NULL)
+    //
+    // GetProcess hands out a referenced process, the destructor releases it.
+    //
+    m_pServerProcess = pServerProcess;
+    m_pServerProcess->IncrementOutstandingRequests();
+
+    m_fPriorityRequest = m_pApplication->QueryConfig()->QueryPriorityPaths().Matches(*m_pW3Context);
+
+    if (pServerProcess->QueryRequestDelegation() != NULL &&
+        m_pRequestSpool == NULL &&
+        REQUEST_DELEGATION::CanDelegate(m_pW3Context))
     {
-        FAILURE(HRESULT_FROM_WIN32(ERROR_INVALID_HANDLE));
+        pServerProcess->NotifyRequestForwarded(m_pW3Context->GetTraceContext());
+
+        FAILURE_IF_FAILED(pServerProcess->QueryRequestDelegation()->DelegateRequest(pRequest));
+
+        //
+        // The backend answers on the connection of the client, what IIS
+        // would still send for the request fails.
+        //
+        m_RequestStatus = FORWARDER_DONE;
+        pResponse->DisableKernelCache();
+        retVal = RQ_NOTIFICATION_FINISH_REQUEST;
+        goto Finished;
     }
 
-    hConnect = pServerProcess->QueryWinHttpConnection()->QueryHandle();
+    if (pServerProcess->QueryWinHttpConnection(m_fPriorityRequest) == NULL)
+    {
+        FAILURE(HRESULT_FROM_WIN32(ERROR_INVALID_HANDLE));
+    }
 
-    m_pszOriginalHostHeader = pRequest->GetHeader(HttpHeaderHost, &cchHostName);
-    //
-    // parse original url
-    //
-    FAILURE_IF_FAILED(URL_UTILITY::SplitUrl(pRequest->GetRawHttpRequest()->CookedUrl.pFullUrl,
-        &fSecure,
-        &strDestination,
-        &strUrl));
+    hConnect = pServerProcess->QueryWinHttpConnection(m_fPriorityRequest)->QueryHandle();
 
-    FAILURE_IF_FAILED(URL_UTILITY::EscapeAbsPath(pRequest, &struEscapedUrl));
+    FAILURE_IF_FAILED(URL_UTILITY::EscapeAbsPath(pRequest, &struEscapedUrl, &pszEscapedUrl));
 
-    m_fDoReverseRewriteHeaders = pProtocol->QueryReverseRewriteHeaders();
+    m_fDoReverseRewriteHeaders = pProtocol->QueryReverseRewriteHeaders() != FALSE;
+    if (m_fDoReverseRewriteHeaders)
+    {
+        FAILURE_IF_FAILED(EnsureColdState());
+        m_pCold->pszOriginalHostHeader = pRequest->GetHeader(HttpHeaderHost, &cchHostName);
+        m_pCold->cchOriginalHostHeader = cchHostName;
+    }
 
     m_cMinBufferLimit = pProtocol->QueryMinResponseBuffer();
 
@@ -183,16 +486,27 @@ FORWARDING_HANDLER::ExecuteRequestHandler()
         }
     }
 
+    //
+    // Streaming mode replaces response buffering, so it is only used when
+    // buffering is effectively disabled.
+    //
+    if (pProtocol->QueryResponseReadAheadBuffers() != 0 &&
+        !m_fWebSocketEnabled &&
+        m_cMinBufferLimit < BUFFER_SIZE / 2)
+    {
+        FAILURE_IF_FAILED(InitializeReadAhead(pProtocol->QueryResponseReadAheadBuffers()));
+    }
+
     FAILURE_IF_FAILED(CreateWinHttpRequest(pRequest,
         pProtocol,
         hConnect,
-        &struEscapedUrl,
+        pszEscapedUrl,
         pServerProcess));
 
     m_fReactToDisconnect = TRUE;
 
     // require lock as client disconnect callback may happen
-    AcquireSRWLockShared(&m_RequestLock);
+    LockContention::AcquireShared(&m_RequestLock, LockSite::ForwardingHandlerRequest);
     fRequestLocked = TRUE;
 
     //
@@ -232,6 +546,23 @@ FORWARDING_HANDLER::ExecuteRequestHandler()
         m_BytesToReceive = INFINITE;
     }
 
+    if (m_BytesToReceive == 0 &&
+        !m_fWebSocketEnabled &&
+        IsIdempotentVerb(pRequest->GetRawHttpRequest()->Verb))
+    {
+        //
+        // Nothing of the request is consumed by sending it, so it can be
+        // sent again if the backend connection fails.
+        //
+        m_cRetriesLeft = pProtocol->QueryIdempotentRequestRetries();
+    }
+
+    if (m_BytesToReceive > 0 && !m_fWebSocketEnabled && m_pRequestSpool == NULL)
+    {
+        FAILURE_IF_FAILED(InitializeUpload(pProtocol->QueryRequestBodyReadAheadBuffers(),
+            pProtocol->QueryRequestBodyReadAheadLimit()));
+    }
+
     if (m_fWebSocketEnabled)
     {
         //
@@ -256,9 +587,12 @@ FORWARDING_HANDLER::ExecuteRequestHandler()
             NULL);
     }
 
+    // Before the send, the request may complete on another thread after.
+    pServerProcess->NotifyRequestForwarded(m_pW3Context->GetTraceContext());
+
     if (!WinHttpSendRequest(m_hRequest,
         m_pszHeaders,
-        m_cchHeaders,
+        m_pszHeaders != NULL ? m_cchHeaders : 0,
         NULL,
         0,
         cbContentLength,
@@ -295,30 +629,44 @@ Failure:
 
     pResponse->DisableKernelCache();
     pResponse->GetRawHttpResponse()->EntityChunkCount = 0;
+
+    // Without a client or with a rejected body there was nothing to forward.
+    if (hr != HRESULT_FROM_WIN32(WSAECONNRESET) &&
+        hr != HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE) &&
+        m_pApplication != NULL)
+    {
+        m_pApplication->QueryCounters()->RecordForwardingError(fFailedToStartKestrel
+            ? APPLICATION_COUNTERS::FORWARDING_ERROR_PROCESS_START
+            : QueryForwardingError(hr));
+    }
+
     if (hr == HRESULT_FROM_WIN32(WSAECONNRESET))
     {
         pResponse->SetStatus(400, "Bad Request", 0, hr);
     }
+    else if (hr == HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE))
+    {
+        pResponse->SetStatus(413, "Request Entity Too Large", 0, hr);
+    }
     else if (hr == E_APPLICATION_EXITING)
     {
         pResponse->SetStatus(503, "Service Unavailable", 0, S_OK, nullptr, TRUE);
     }
     else if (fFailedToStartKestrel && !m_pApplication->QueryConfig()->QueryDisableStartUpErrorPage())
     {
-        static std::string htmlResponse = FILE_UTILITY::GetHtml(g_hOutOfProcessRHModule,
-            ANCM_ERROR_PAGE,
-            502,
-            5,
-            "ANCM Out-Of-Process Startup Failure",
-            "<ul><li> The application process failed to start </li><li> The application process started but then stopped </li><li> The application process started but failed to listen on the configured port </li></ul>");
-
-        ServerErrorHandler handler(*m_pW3Context,
+        static const auto page = std::make_shared<const ServerErrorPage>(ServerErrorPage{
             502,
             5,
             "Bad Gateway",
-            hr,
-            m_pApplication->QueryConfig()->QueryDisableStartUpErrorPage(),
-            htmlResponse);
+            false /* disableStartupPage */,
+            FILE_UTILITY::GetHtml(g_hOutOfProcessRHModule,
+                ANCM_ERROR_PAGE,
+                502,
+                5,
+                "ANCM Out-Of-Process Startup Failure",
+                "<ul><li> The application process failed to start </li><li> The application process started but then stopped </li><li> The application process started but failed to listen on the configured port </li></ul>") });
+
+        ServerErrorHandler handler(*m_pW3Context, page, hr);
 
         handler.ExecuteRequestHandler();
     }
@@ -381,10 +729,45 @@ REQUEST_NOTIFICATION_STATUS
     BOOL                        fClientError = FALSE;
     BOOL                        fClosed = FALSE;
     BOOL                        fWebSocketUpgraded = FALSE;
+    BOOL                        fFlushCompleted = FALSE;
+    BOOL                        fUploadReadCompleted = FALSE;
+    BOOL                        fSpoolIoCompleted = FALSE;
+    BOOL                        fFinishOnFailure = FALSE;
+    HRESULT                     hrSpoolIo = S_OK;
+    BYTE *                      pSpoolData = NULL;
+    DWORD                       cbSpoolData = 0;
 
     DBG_ASSERT(m_pW3Context != NULL);
     __analysis_assume(m_pW3Context != NULL);
 
+    if (m_RequestStatus == FORWARDER_WAITING_FOR_PROCESS)
+    {
+        //
+        // Completion posted by OnProcessStartCompleted, nothing else is
+        // outstanding yet so no lock is needed.
+        //
+        m_RequestStatus = FORWARDER_START;
+        return ExecuteRequestHandler();
+    }
+
+    if (m_RequestStatus == FORWARDER_WAITING_FOR_CACHE_FILL)
+    {
+        //
+        // Completion posted by OnResponseCacheFillCompleted.
+        //
+        m_RequestStatus = FORWARDER_START;
+        return ExecuteRequestHandler();
+    }
+
+    if (m_RequestStatus == FORWARDER_SPOOLING_REQUEST)
+    {
+        //
+        // Completion of a read of the request body or of a write to the
+        // spool file, the request isn't forwarded yet.
+        //
+        return SpoolRequestBody(cbCompletion, hrCompletionStatus);
+    }
+
     //
     // Take a reference so that object does not go away as a result of
     // async completion.
@@ -393,7 +776,7 @@ REQUEST_NOTIFICATION_STATUS
 
     if (sm_pTraceLog != NULL)
     {
-        WriteRefTraceLogEx(sm_pTraceLog,
+        sm_pTraceLog->Write(
             m_cRefs,
             this,
             "FORWARDING_HANDLER::OnAsyncCompletion Enter",
@@ -411,6 +794,41 @@ REQUEST_NOTIFICATION_STATUS
         fLocked = TRUE;
     }
 
+    if (m_pReadAhead != NULL && m_pReadAhead->fFlushOutstanding)
+    {
+        //
+        // In streaming mode the only IIS operation that can be outstanding
+        // is the response flush, so this is its completion.
+        //
+        OnReadAheadFlushCompleted();
+        fFlushCompleted = TRUE;
+    }
+    else if (m_pUpload != NULL && m_pUpload->fReadOutstanding)
+    {
+        //
+        // Likewise, while the request body is uploaded the only IIS
+        // operation that can be outstanding is the pipeline's read.
+        //
+        m_pUpload->fReadOutstanding = FALSE;
+        fUploadReadCompleted = TRUE;
+    }
+    else if (m_pRequestSpool != NULL && m_pRequestSpool->QueryIoPending())
+    {
+        //
+        // And while a spooled body is sent, the read from its file.
+        //
+        hrSpoolIo = m_pRequestSpool->OnIoCompleted(&pSpoolData, &cbSpoolData);
+        fSpoolIoCompleted = TRUE;
+    }
+    else if (m_pResponseSpool != NULL && m_pResponseSpool->QueryIoPending())
+    {
+        //
+        // And while the response body is spooled, the write to its file.
+        //
+        hrSpoolIo = m_pResponseSpool->OnIoCompleted(NULL, NULL);
+        fSpoolIoCompleted = TRUE;
+    }
+
     if (m_fClientDisconnected && (m_RequestStatus != FORWARDER_DONE))
     {
         FAILURE(ERROR_CONNECTION_ABORTED);
@@ -423,13 +841,20 @@ REQUEST_NOTIFICATION_STATUS
         //
         // This should be the write completion of the 101 response.
         //
-        m_pWebSocket = new WEBSOCKET_HANDLER();
-        if (m_pWebSocket == NULL)
+        FAILURE_IF_FAILED(EnsureColdState());
+        m_pCold->pWebSocket = new WEBSOCKET_HANDLER();
+        if (m_pCold->pWebSocket == NULL)
         {
             FAILURE(E_OUTOFMEMORY);
         }
 
-        hr = m_pWebSocket->ProcessRequest(this, m_pW3Context, m_hRequest, &fWebSocketUpgraded);
+        hr = m_pCold->pWebSocket->ProcessRequest(this,
+            m_pW3Context,
+            m_hRequest,
+            m_pApplication->QueryConfig(),
+            m_pApplication->QueryWebSocketCounters(),
+            m_pApplication->QueryCounters(),
+            &fWebSocketUpgraded);
         if (fWebSocketUpgraded)
         {
             // WinHttp WebSocket handle has been created, bump the counter so that remember to close it
@@ -477,20 +902,52 @@ REQUEST_NOTIFICATION_STATUS
             FAILURE(hr);
         }
 
+        FAILURE_IF_FAILED(hrSpoolIo);
         FAILURE_IF_FAILED(OnReceivingResponse());
         break;
 
     case FORWARDER_SENDING_REQUEST:
 
+        if (fSpoolIoCompleted)
+        {
+            FAILURE_IF_FAILED(hrSpoolIo);
+            FAILURE_IF_FAILED(WriteSpooledData(pSpoolData, cbSpoolData));
+            break;
+        }
+
         hr = OnSendingRequest(cbCompletion,
             hrCompletionStatus,
             &fClientError);
         FAILURE_IF_FAILED(hr);
         break;
 
+    case FORWARDER_RETRYING_REQUEST:
+
+        //
+        // The handle of the failed attempt is closed, send the request to
+        // a backend process again.
+        //
+        FAILURE_IF_FAILED(RetryRequest());
+        break;
+
     default:
         DBG_ASSERT(m_RequestStatus == FORWARDER_DONE);
-        if (m_hRequest == NULL && m_pWebSocket == NULL)
+        if ((fFlushCompleted || fUploadReadCompleted || fSpoolIoCompleted) &&
+            m_hRequest != NULL &&
+            !m_fHttpHandleInClose)
+        {
+            //
+            // The WinHTTP side finished (or failed) while a streaming flush,
+            // a request body read or a spool file operation was in flight,
+            // closing the handle was deferred until now.
+            //
+            m_fHttpHandleInClose = TRUE;
+            WinHttpCloseHandle(m_hRequest);
+            m_hRequest = NULL;
+            goto Finished;
+        }
+
+        if (m_hRequest == NULL && QueryWebSocket() == NULL)
         {
             // Request must have been done
             if (!m_fFinishRequest)
@@ -520,6 +977,15 @@ REQUEST_NOTIFICATION_STATUS
 
 Failure:
 
+    if (m_RequestStatus == FORWARDER_RETRYING_REQUEST && m_hRequest == NULL)
+    {
+        //
+        // The previous attempt's handle is gone and no new one was opened,
+        // so no WinHTTP callback is left to complete the request.
+        //
+        fFinishOnFailure = TRUE;
+    }
+
     //
     // Reset status for consistency.
     //
@@ -537,7 +1003,12 @@ Failure:
 
         if (fClientError || m_fClientDisconnected)
         {
-            if (!m_fResponseHeadersReceivedAndSet)
+            if (!m_fResponseHeadersReceivedAndSet &&
+                hr == HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE))
+            {
+                pResponse->SetStatus(413, "Request Entity Too Large", 0, hr);
+            }
+            else if (!m_fResponseHeadersReceivedAndSet)
             {
                 pResponse->SetStatus(400, "Bad Request", 0, HRESULT_FROM_WIN32(WSAECONNRESET));
             }
@@ -555,6 +1026,12 @@ Failure:
             STACK_STRU(strDescription, 128);
 
             pResponse->SetStatus(502, "Bad Gateway", 3, hr);
+            m_pApplication->QueryCounters()->RecordForwardingError(QueryForwardingError(hr));
+
+            if (hr == HRESULT_FROM_WIN32(ERROR_WINHTTP_TIMEOUT) && m_pServerProcess != NULL)
+            {
+                m_pServerProcess->RecordForwardResult(TRUE);
+            }
 
             if (hr > HRESULT_FROM_WIN32(WINHTTP_ERROR_BASE) &&
                 hr <= HRESULT_FROM_WIN32(WINHTTP_ERROR_LAST))
@@ -598,10 +1075,12 @@ Failure:
         }
     }
 
-    if (m_pWebSocket != NULL && !m_fWebSocketHandleInClose)
+    //
+    // Repeated terminations are ignored by the WebSocket state.
+    //
+    if (QueryWebSocket() != NULL)
     {
-        m_fWebSocketHandleInClose = TRUE;
-        m_pWebSocket->TerminateRequest();
+        m_pCold->pWebSocket->TerminateRequest();
     }
 
     if (m_hRequest != NULL && !m_fHttpHandleInClose)
@@ -611,6 +1090,12 @@ Failure:
         m_hRequest = NULL;
     }
 
+    if (fFinishOnFailure)
+    {
+        m_fFinishRequest = TRUE;
+        retVal = RQ_NOTIFICATION_FINISH_REQUEST;
+    }
+
 Finished:
 
     if (retVal != RQ_NOTIFICATION_PENDING)
@@ -624,6 +1109,7 @@ Finished:
         if (!m_fDoneAsyncCompletion)
         {
             m_fDoneAsyncCompletion = TRUE;
+            ReportForwardTimings();
         }
         else
         {
@@ -666,20 +1152,60 @@ HRESULT
 --*/
 {
     HRESULT                         hr = S_OK;
+    LARGE_INTEGER                   liFrequency;
+
+    QueryPerformanceFrequency(&liFrequency);
+    sm_llPerformanceFrequency = liFrequency.QuadPart;
 
     FINISHED_IF_NULL_ALLOC(sm_pAlloc = new ALLOC_CACHE_HANDLER);
     FINISHED_IF_FAILED(sm_pAlloc->Initialize(sizeof(FORWARDING_HANDLER), 64)); // nThreshold
 
-    FINISHED_IF_NULL_ALLOC(sm_pResponseHeaderHash = new RESPONSE_HEADER_HASH);
-
-    FINISHED_IF_FAILED(sm_pResponseHeaderHash->Initialize());
-
     // Initialize PROTOCOL_CONFIG
     FINISHED_IF_FAILED(sm_ProtocolConfig.Initialize());
 
-    if (fEnableReferenceCountTracing)
+    //
+    // Entity buffers never exceed ENTITY_BUFFER_SIZE, so there is no point
+    // in size classes beyond it even if the response buffer limit is larger.
+    //
+    FINISHED_IF_NULL_ALLOC(sm_pResponseBufferPool = new RESPONSE_BUFFER_POOL);
+    FINISHED_IF_FAILED(sm_pResponseBufferPool->Initialize(
+        sm_ProtocolConfig.QueryResponseBufferPoolMinSize(),
+        max(sm_ProtocolConfig.QueryResponseBufferPoolMinSize(),
+            min(sm_ProtocolConfig.QueryResponseBufferLimit(), ENTITY_BUFFER_SIZE)),
+        static_cast<LONG>(sm_ProtocolConfig.QueryResponseBufferPoolDepth())));
+
+    SetTraceCaptureStateCallback(OnTraceCaptureState);
+
+    //
+    // Completions are left where WinHTTP runs them if the nodes can't be
+    // queried, the node of a request then reads as NO_COMPLETION_NODE.
+    //
+    ULONG ulHighestNode = 0;
+    if (GetNumaHighestNodeNumber(&ulHighestNode) &&
+        ulHighestNode != 0 &&
+        ulHighestNode < NO_COMPLETION_NODE)
     {
-        sm_pTraceLog = CreateRefTraceLog(10000, 0);
+        sm_pNodeAffinity = new GROUP_AFFINITY[ulHighestNode + 1];
+        if (sm_pNodeAffinity != NULL)
+        {
+            sm_cNodes = static_cast<USHORT>(ulHighestNode + 1);
+            for (USHORT usNode = 0; usNode < sm_cNodes; usNode++)
+            {
+                // A node without processors has an empty mask, never moved to.
+                if (!GetNumaNodeProcessorMaskEx(usNode, &sm_pNodeAffinity[usNode]))
+                {
+                    ZeroMemory(&sm_pNodeAffinity[usNode], sizeof(GROUP_AFFINITY));
+                }
+            }
+        }
+    }
+
+    if (fEnableReferenceCountTracing)
+    {
+        // Tracing is left off if out of memory.
+        LOG_IF_FAILED(PER_CPU_REF_TRACE_LOG::Create(REF_TRACE_ENTRIES_PER_PROCESSOR,
+            g_fCaptureReferenceCountStacks,
+            &sm_pTraceLog));
     }
 
 Finished:
@@ -694,16 +1220,21 @@ Finished:
 VOID
 FORWARDING_HANDLER::StaticTerminate()
 {
-    if (sm_pResponseHeaderHash != NULL)
+    SetTraceCaptureStateCallback(nullptr);
+
+    delete[] sm_pNodeAffinity;
+    sm_pNodeAffinity = NULL;
+    sm_cNodes = 0;
+
+    if (sm_pResponseBufferPool != NULL)
     {
-        sm_pResponseHeaderHash->Clear();
-        delete sm_pResponseHeaderHash;
-        sm_pResponseHeaderHash = NULL;
+        delete sm_pResponseBufferPool;
+        sm_pResponseBufferPool = NULL;
     }
 
     if (sm_pTraceLog != NULL)
     {
-        DestroyRefTraceLog(sm_pTraceLog);
+        sm_pTraceLog->Destroy();
         sm_pTraceLog = NULL;
     }
 
@@ -735,6 +1266,179 @@ void FORWARDING_HANDLER::operator delete(void * pMemory)
     }
 }
 
+//
+// Names of the request known headers, indexed by HTTP_HEADER_ID.
+//
+#define KNOWN_REQUEST_HEADER(name) { name, sizeof(name) - 1 }
+
+static const struct
+{
+    PCSTR   pszName;
+    USHORT  cchName;
+} s_rgKnownRequestHeaders[HttpHeaderRequestMaximum] =
+{
+    KNOWN_REQUEST_HEADER("Cache-Control"),
+    KNOWN_REQUEST_HEADER("Connection"),
+    KNOWN_REQUEST_HEADER("Date"),
+    KNOWN_REQUEST_HEADER("Keep-Alive"),
+    KNOWN_REQUEST_HEADER("Pragma"),
+    KNOWN_REQUEST_HEADER("Trailer"),
+    KNOWN_REQUEST_HEADER("Transfer-Encoding"),
+    KNOWN_REQUEST_HEADER("Upgrade"),
+    KNOWN_REQUEST_HEADER("Via"),
+    KNOWN_REQUEST_HEADER("Warning"),
+    KNOWN_REQUEST_HEADER("Allow"),
+    KNOWN_REQUEST_HEADER("Content-Length"),
+    KNOWN_REQUEST_HEADER("Content-Type"),
+    KNOWN_REQUEST_HEADER("Content-Encoding"),
+    KNOWN_REQUEST_HEADER("Content-Language"),
+    KNOWN_REQUEST_HEADER("Content-Location"),
+    KNOWN_REQUEST_HEADER("Content-MD5"),
+    KNOWN_REQUEST_HEADER("Content-Range"),
+    KNOWN_REQUEST_HEADER("Expires"),
+    KNOWN_REQUEST_HEADER("Last-Modified"),
+    KNOWN_REQUEST_HEADER("Accept"),
+    KNOWN_REQUEST_HEADER("Accept-Charset"),
+    KNOWN_REQUEST_HEADER("Accept-Encoding"),
+    KNOWN_REQUEST_HEADER("Accept-Language"),
+    KNOWN_REQUEST_HEADER("Authorization"),
+    KNOWN_REQUEST_HEADER("Cookie"),
+    KNOWN_REQUEST_HEADER("Expect"),
+    KNOWN_REQUEST_HEADER("From"),
+    KNOWN_REQUEST_HEADER("Host"),
+    KNOWN_REQUEST_HEADER("If-Match"),
+    KNOWN_REQUEST_HEADER("If-Modified-Since"),
+    KNOWN_REQUEST_HEADER("If-None-Match"),
+    KNOWN_REQUEST_HEADER("If-Range"),
+    KNOWN_REQUEST_HEADER("If-Unmodified-Since"),
+    KNOWN_REQUEST_HEADER("Max-Forwards"),
+    KNOWN_REQUEST_HEADER("Proxy-Authorization"),
+    KNOWN_REQUEST_HEADER("Referer"),
+    KNOWN_REQUEST_HEADER("Range"),
+    KNOWN_REQUEST_HEADER("TE"),
+    KNOWN_REQUEST_HEADER("Translate"),
+    KNOWN_REQUEST_HEADER("User-Agent"),
+};
+
+#undef KNOWN_REQUEST_HEADER
+
+//
+// HTTP_HEADER_ID of a request known header, HttpHeaderRequestMaximum for
+// an unknown one.
+//
+static
+DWORD
+FindKnownRequestHeader(
+    _In_reads_(cchName) PCSTR   pszName,
+    USHORT                      cchName
+)
+{
+    for (DWORD i = 0; i < HttpHeaderRequestMaximum; i++)
+    {
+        if (s_rgKnownRequestHeaders[i].cchName == cchName &&
+            _strnicmp(s_rgKnownRequestHeaders[i].pszName, pszName, cchName) == 0)
+        {
+            return i;
+        }
+    }
+
+    return HttpHeaderRequestMaximum;
+}
+
+//
+// Calls fn(pszName, cchName, pszValue, cchValue) for each header forwarded
+// to the backend, in the order HTTP.sys holds them. The MS-ASPNETCORE*
+// headers of the client are left out, an override takes the place of the
+// first header of its name and drops the others, and the overrides the
+// client sent no header for come last. Neither string is terminated.
+//
+template<typename Fn>
+static
+VOID
+ForEachForwardedHeader(
+    _In_ const HTTP_REQUEST_HEADERS *           pHeaders,
+    _In_reads_(cOverrides) const HEADER_OVERRIDE * rgOverrides,
+    DWORD                                       cOverrides,
+    Fn                                          fn
+)
+{
+    BOOL rgfOverridden[MAX_HEADER_OVERRIDES] = { FALSE };
+
+    DBG_ASSERT(cOverrides <= MAX_HEADER_OVERRIDES);
+
+    auto Override = [&](DWORD iOverride)
+    {
+        if (!rgfOverridden[iOverride] && rgOverrides[iOverride].pszValue != NULL)
+        {
+            fn(rgOverrides[iOverride].pszName,
+               rgOverrides[iOverride].cchName,
+               rgOverrides[iOverride].pszValue,
+               rgOverrides[iOverride].cchValue);
+        }
+        rgfOverridden[iOverride] = TRUE;
+    };
+
+    for (DWORD i = 0; i < HttpHeaderRequestMaximum; i++)
+    {
+        const HTTP_KNOWN_HEADER *pHeader = &pHeaders->KnownHeaders[i];
+        if (pHeader->RawValueLength == 0)
+        {
+            continue;
+        }
+
+        DWORD iOverride = 0;
+        while (iOverride < cOverrides && rgOverrides[iOverride].dwKnownId != i)
+        {
+            iOverride++;
+        }
+
+        if (iOverride < cOverrides)
+        {
+            Override(iOverride);
+            continue;
+        }
+
+        fn(s_rgKnownRequestHeaders[i].pszName,
+           s_rgKnownRequestHeaders[i].cchName,
+           pHeader->pRawValue,
+           pHeader->RawValueLength);
+    }
+
+    for (DWORD i = 0; i < pHeaders->UnknownHeaderCount; i++)
+    {
+        const HTTP_UNKNOWN_HEADER *pHeader = &pHeaders->pUnknownHeaders[i];
+        if (IsAspNetCoreHeaderName(pHeader))
+        {
+            continue;
+        }
+
+        DWORD iOverride = 0;
+        while (iOverride < cOverrides &&
+              (rgOverrides[iOverride].dwKnownId != HttpHeaderRequestMaximum ||
+               rgOverrides[iOverride].cchName != pHeader->NameLength ||
+               _strnicmp(rgOverrides[iOverride].pszName, pHeader->pName, pHeader->NameLength) != 0))
+        {
+            iOverride++;
+        }
+
+        if (iOverride < cOverrides)
+        {
+            Override(iOverride);
+            continue;
+        }
+
+        fn(pHeader->pName,
+           pHeader->NameLength,
+           pHeader->pRawValue,
+           pHeader->RawValueLength);
+    }
+
+    for (DWORD i = 0; i < cOverrides; i++)
+    {
+        Override(i);
+    }
+}
+
 HRESULT
 FORWARDING_HANDLER::GetHeaders(
     _In_ const PROTOCOL_CONFIG *    pProtocol,
@@ -743,20 +1447,52 @@ FORWARDING_HANDLER::GetHeaders(
     _Out_   PCWSTR *                ppszHeaders,
     _Inout_ DWORD *                 pcchHeaders
 )
+/*++
+
+Routine Description:
+
+Build the headers forwarded to the backend. What the module adds, replaces
+or removes is kept as overrides of the client headers, which are streamed
+into the block as they are, so the IIS request is never changed. Other
+modules keep seeing the headers of the client, and a retried request is
+built from them again.
+
+--*/
 {
     PCSTR pszCurrentHeader;
-    PCSTR ppHeadersToBeRemoved;
     PCSTR pszFinalHeader;
     USHORT cchCurrentHeader;
     DWORD cchFinalHeader;
     BOOL  fSecure = FALSE;  // dummy. Used in SplitUrl. Value will not be used
                             // as ANCM always use http protocol to communicate with backend
-    STRU  struDestination;
-    STRU  struUrl;
-    STACK_STRA(strTemp, 64);
-    HTTP_REQUEST_HEADERS *pHeaders;
+    //
+    // Everything below is sized so that typical requests build their
+    // forwarded headers without touching the heap; unusually long values
+    // and client certificates grow into the handler's arena.
+    //
+    ARENA_STRU(struDestination, 64, &m_Arena);
+    ARENA_STRA(strHost, 64, &m_Arena);
+    ARENA_STRA(strForwardedFor, 64, &m_Arena);
+    ARENA_STRA(strForwardedProto, 16, &m_Arena);
+    CLIENT_CERT_CACHE_ENTRY *pClientCert = NULL;
+    HRESULT hr = S_OK;
+    CHAR pszHandleStr[16] = { 0 };
     IHttpRequest *pRequest = m_pW3Context->GetRequest();
-    MULTISZA mszMsAspNetCoreHeaders;
+    HEADER_OVERRIDE rgOverrides[MAX_HEADER_OVERRIDES];
+    DWORD cOverrides = 0;
+
+    // pszValue NULL to leave the header out, the strings outlive the block.
+    auto AddOverride = [&rgOverrides, &cOverrides](PCSTR pszName, PCSTR pszValue, SIZE_T cchValue)
+    {
+        DBG_ASSERT(cOverrides < MAX_HEADER_OVERRIDES);
+
+        HEADER_OVERRIDE *pOverride = &rgOverrides[cOverrides++];
+        pOverride->pszName = pszName;
+        pOverride->cchName = static_cast<USHORT>(strlen(pszName));
+        pOverride->dwKnownId = FindKnownRequestHeader(pszName, pOverride->cchName);
+        pOverride->pszValue = pszValue;
+        pOverride->cchValue = static_cast<USHORT>(cchValue);
+    };
 
     //
     // We historically set the host section in request url to the new host header
@@ -768,47 +1504,21 @@ FORWARDING_HANDLER::GetHeaders(
         RETURN_IF_FAILED(URL_UTILITY::SplitUrl(pRequest->GetRawHttpRequest()->CookedUrl.pFullUrl,
             &fSecure,
             &struDestination,
-            &struUrl));
-
-        RETURN_IF_FAILED(strTemp.CopyW(struDestination.QueryStr()));
-        RETURN_IF_FAILED(pRequest->SetHeader(HttpHeaderHost,
-            strTemp.QueryStr(),
-            static_cast<USHORT>(strTemp.QueryCCH()),
-            TRUE)); // fReplace
-    }
-    //
-    // Strip all headers starting with MS-ASPNETCORE.
-    // These headers are generated by the asp.net core module and
-    // passed to the process it creates.
-    //
+            NULL)); // only the destination is needed
 
-    pHeaders = &m_pW3Context->GetRequest()->GetRawHttpRequest()->Headers;
-    for (DWORD i = 0; i<pHeaders->UnknownHeaderCount; i++)
-    {
-        if (_strnicmp(pHeaders->pUnknownHeaders[i].pName, "MS-ASPNETCORE", 13) == 0)
-        {
-            mszMsAspNetCoreHeaders.Append(pHeaders->pUnknownHeaders[i].pName, (DWORD)pHeaders->pUnknownHeaders[i].NameLength);
-        }
+        RETURN_IF_FAILED(strHost.CopyW(struDestination.QueryStr()));
+        AddOverride("Host", strHost.QueryStr(), strHost.QueryCCH());
     }
 
-    ppHeadersToBeRemoved = mszMsAspNetCoreHeaders.First();
-
     //
-    // iterate the list of headers to be removed and delete them from the request.
+    // The MS-ASPNETCORE* headers of the client are never forwarded, see
+    // ForEachForwardedHeader. These are the ones of the module.
     //
-
-    while (ppHeadersToBeRemoved != NULL)
-    {
-        m_pW3Context->GetRequest()->DeleteHeader(ppHeadersToBeRemoved);
-        ppHeadersToBeRemoved = mszMsAspNetCoreHeaders.Next(ppHeadersToBeRemoved);
-    }
-
     if (pServerProcess->QueryGuid() != NULL)
     {
-        RETURN_IF_FAILED(m_pW3Context->GetRequest()->SetHeader("MS-ASPNETCORE-TOKEN",
+        AddOverride("MS-ASPNETCORE-TOKEN",
             pServerProcess->QueryGuid(),
-            (USHORT)strlen(pServerProcess->QueryGuid()),
-            TRUE));
+            pServerProcess->QueryGuidLength());
     }
 
     if (fForwardWindowsAuthToken &&
@@ -819,34 +1529,41 @@ FORWARDING_HANDLER::GetHeaders(
             m_pW3Context->GetUser()->GetPrimaryToken() != INVALID_HANDLE_VALUE)
         {
             HANDLE hTargetTokenHandle = NULL;
+            DBG_ASSERT(m_pWindowsAuthToken == NULL);
             RETURN_IF_FAILED(pServerProcess->SetWindowsAuthToken(m_pW3Context->GetUser()->GetPrimaryToken(),
-                &hTargetTokenHandle));
+                m_pW3Context->GetRequest()->GetRawHttpRequest()->ConnectionId,
+                &hTargetTokenHandle,
+                &m_pWindowsAuthToken));
 
             //
             // set request header with target token value
             //
-            CHAR pszHandleStr[16] = { 0 };
             if (_ui64toa_s((UINT64)hTargetTokenHandle, pszHandleStr, 16, 16) != 0)
             {
                 RETURN_HR(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
             }
 
-            RETURN_IF_FAILED(m_pW3Context->GetRequest()->SetHeader("MS-ASPNETCORE-WINAUTHTOKEN",
+            //
+            // A cached handle is sent under its own name, the backend must
+            // not close it.
+            //
+            AddOverride(m_pWindowsAuthToken != NULL ?
+                    "MS-ASPNETCORE-WINAUTHTOKEN-CACHED" : "MS-ASPNETCORE-WINAUTHTOKEN",
                 pszHandleStr,
-                (USHORT)strlen(pszHandleStr),
-                TRUE));
+                strlen(pszHandleStr));
         }
     }
 
+    //
+    // The values below are appended to what the client sent.
+    //
     if (!pProtocol->QueryXForwardedForName()->IsEmpty())
     {
-        strTemp.Reset();
-
         pszCurrentHeader = pRequest->GetHeader(pProtocol->QueryXForwardedForName()->QueryStr(), &cchCurrentHeader);
         if (pszCurrentHeader != NULL)
         {
-            RETURN_IF_FAILED(strTemp.Copy(pszCurrentHeader, cchCurrentHeader));
-            RETURN_IF_FAILED(strTemp.Append(", ", 2));
+            RETURN_IF_FAILED(strForwardedFor.Copy(pszCurrentHeader, cchCurrentHeader));
+            RETURN_IF_FAILED(strForwardedFor.Append(", ", 2));
         }
 
         RETURN_IF_FAILED(m_pW3Context->GetServerVariable("REMOTE_ADDR",
@@ -855,13 +1572,13 @@ FORWARDING_HANDLER::GetHeaders(
 
         if (pRequest->GetRawHttpRequest()->Address.pRemoteAddress->sa_family == AF_INET6)
         {
-            RETURN_IF_FAILED(strTemp.Append("[", 1));
-            RETURN_IF_FAILED(strTemp.Append(pszFinalHeader, cchFinalHeader));
-            RETURN_IF_FAILED(strTemp.Append("]", 1));
+            RETURN_IF_FAILED(strForwardedFor.Append("[", 1));
+            RETURN_IF_FAILED(strForwardedFor.Append(pszFinalHeader, cchFinalHeader));
+            RETURN_IF_FAILED(strForwardedFor.Append("]", 1));
         }
         else
         {
-            RETURN_IF_FAILED(strTemp.Append(pszFinalHeader, cchFinalHeader));
+            RETURN_IF_FAILED(strForwardedFor.Append(pszFinalHeader, cchFinalHeader));
         }
 
         if (pProtocol->QueryIncludePortInXForwardedFor())
@@ -870,14 +1587,13 @@ FORWARDING_HANDLER::GetHeaders(
                 &pszFinalHeader,
                 &cchFinalHeader));
 
-            RETURN_IF_FAILED(strTemp.Append(":", 1));
-            RETURN_IF_FAILED(strTemp.Append(pszFinalHeader, cchFinalHeader));
+            RETURN_IF_FAILED(strForwardedFor.Append(":", 1));
+            RETURN_IF_FAILED(strForwardedFor.Append(pszFinalHeader, cchFinalHeader));
         }
 
-        RETURN_IF_FAILED(pRequest->SetHeader(pProtocol->QueryXForwardedForName()->QueryStr(),
-            strTemp.QueryStr(),
-            static_cast<USHORT>(strTemp.QueryCCH()),
-            TRUE)); // fReplace
+        AddOverride(pProtocol->QueryXForwardedForName()->QueryStr(),
+            strForwardedFor.QueryStr(),
+            strForwardedFor.QueryCCH());
     }
 
     if (!pProtocol->QuerySslHeaderName()->IsEmpty())
@@ -889,21 +1605,18 @@ FORWARDING_HANDLER::GetHeaders(
             pszScheme = "https";
         }
 
-        strTemp.Reset();
-
         pszCurrentHeader = pRequest->GetHeader(pProtocol->QuerySslHeaderName()->QueryStr(), &cchCurrentHeader);
         if (pszCurrentHeader != NULL)
         {
-            RETURN_IF_FAILED(strTemp.Copy(pszCurrentHeader, cchCurrentHeader));
-            RETURN_IF_FAILED(strTemp.Append(", ", 2));
+            RETURN_IF_FAILED(strForwardedProto.Copy(pszCurrentHeader, cchCurrentHeader));
+            RETURN_IF_FAILED(strForwardedProto.Append(", ", 2));
         }
 
-        RETURN_IF_FAILED(strTemp.Append(pszScheme));
+        RETURN_IF_FAILED(strForwardedProto.Append(pszScheme));
 
-        RETURN_IF_FAILED(pRequest->SetHeader(pProtocol->QuerySslHeaderName()->QueryStr(),
-            strTemp.QueryStr(),
-            (USHORT)strTemp.QueryCCH(),
-            TRUE));
+        AddOverride(pProtocol->QuerySslHeaderName()->QueryStr(),
+            strForwardedProto.QueryStr(),
+            strForwardedProto.QueryCCH());
     }
 
     if (!pProtocol->QueryClientCertName()->IsEmpty())
@@ -911,27 +1624,22 @@ FORWARDING_HANDLER::GetHeaders(
         if (pRequest->GetRawHttpRequest()->pSslInfo == NULL ||
             pRequest->GetRawHttpRequest()->pSslInfo->pClientCertInfo == NULL)
         {
-            pRequest->DeleteHeader(pProtocol->QueryClientCertName()->QueryStr());
+            AddOverride(pProtocol->QueryClientCertName()->QueryStr(), NULL, 0);
         }
         else
         {
-            // Resize the buffer large enough to hold the encoded certificate info
-            RETURN_IF_FAILED(strTemp.Resize(
-                1 + (pRequest->GetRawHttpRequest()->pSslInfo->pClientCertInfo->CertEncodedSize + 2) / 3 * 4));
-
-            Base64Encode(
-                pRequest->GetRawHttpRequest()->pSslInfo->pClientCertInfo->pCertEncoded,
-                pRequest->GetRawHttpRequest()->pSslInfo->pClientCertInfo->CertEncodedSize,
-                strTemp.QueryStr(),
-                strTemp.QuerySize(),
-                NULL);
-            strTemp.SyncWithBuffer();
-
-            RETURN_IF_FAILED(pRequest->SetHeader(
-                pProtocol->QueryClientCertName()->QueryStr(),
-                strTemp.QueryStr(),
-                static_cast<USHORT>(strTemp.QueryCCH()),
-                TRUE)); // fReplace
+            //
+            // Encoded once for the requests of the connection, held until
+            // the block is built.
+            //
+            RETURN_IF_FAILED(m_pApplication->QueryClientCertCache()->Acquire(
+                pRequest->GetRawHttpRequest()->ConnectionId,
+                pRequest->GetRawHttpRequest()->pSslInfo->pClientCertInfo,
+                &pClientCert));
+
+            AddOverride(pProtocol->QueryClientCertName()->QueryStr(),
+                pClientCert->QueryEncoded(),
+                pClientCert->QueryEncodedLength());
         }
     }
 
@@ -940,32 +1648,230 @@ FORWARDING_HANDLER::GetHeaders(
     //
     if (!m_fWebSocketEnabled)
     {
-        pRequest->DeleteHeader(HttpHeaderConnection);
+        AddOverride("Connection", NULL, 0);
+    }
+    else if (m_pApplication->QueryConfig()->QueryWebSocketStripExtensions()->Equals(L"true", /* ignoreCase */ 1))
+    {
+        //
+        // Neither the IIS WebSocket module nor WinHTTP exposes the RSV bits
+        // of a frame, so an extension the backend accepts can't be relayed.
+        // Without the offer the backend answers with plain frames.
+        //
+        AddOverride("Sec-WebSocket-Extensions", NULL, 0);
+    }
+
+    //
+    // With compression offloaded the backend must not see Accept-Encoding.
+    // IIS dynamic compression still reads it from the request when the
+    // response is sent.
+    //
+    if (m_pApplication->QueryConfig()->QueryOffloadResponseCompression()->Equals(L"true", /* ignoreCase */ 1))
+    {
+        AddOverride("Accept-Encoding", NULL, 0);
+    }
+
+    if (WINHTTP_HELPER::sm_pfnWinHttpAddRequestHeadersEx != NULL)
+    {
+        //
+        // The headers are added to the request handle, nothing is passed
+        // to WinHttpSendRequest. The count kept is the size on the wire.
+        //
+        *ppszHeaders = NULL;
+        hr = AddRequestHeadersEx(rgOverrides, cOverrides, pcchHeaders);
+    }
+    else
+    {
+        hr = SerializeRequestHeaders(rgOverrides, cOverrides, ppszHeaders, pcchHeaders);
+    }
+
+    if (pClientCert != NULL)
+    {
+        pClientCert->DereferenceClientCertCacheEntry();
+    }
+
+    return hr;
+}
+
+HRESULT
+FORWARDING_HANDLER::SerializeRequestHeaders(
+    _In_reads_(cOverrides) const HEADER_OVERRIDE * rgOverrides,
+    DWORD                                       cOverrides,
+    _Out_   PCWSTR *                            ppszHeaders,
+    _Out_   DWORD *                             pcchHeaders
+)
+{
+    const HTTP_REQUEST_HEADERS *pHeaders = &m_pW3Context->GetRequest()->GetRawHttpRequest()->Headers;
+    SIZE_T cchHeaders = 0;
+
+    *ppszHeaders = NULL;
+    *pcchHeaders = 0;
+
+    //
+    // Sized first so that the block is one allocation.
+    //
+    ForEachForwardedHeader(pHeaders, rgOverrides, cOverrides,
+        [&cchHeaders](PCSTR, USHORT cchName, PCSTR, USHORT cchValue)
+        {
+            cchHeaders += cchName + 2 + cchValue + 2;
+        });
+
+    PWSTR pszHeaders = static_cast<PWSTR>(m_Arena.Alloc((cchHeaders + 1) * sizeof(WCHAR)));
+    if (pszHeaders == NULL)
+    {
+        RETURN_HR(E_OUTOFMEMORY);
+    }
+
+    //
+    // WinHTTP narrows the block one character to one byte, so each byte
+    // is widened as it is rather than decoded.
+    //
+    PWSTR pszNext = pszHeaders;
+
+    auto Widen = [&pszNext](PCSTR psz, USHORT cch)
+    {
+        for (USHORT i = 0; i < cch; i++)
+        {
+            *pszNext++ = static_cast<WCHAR>(static_cast<BYTE>(psz[i]));
+        }
+    };
+
+    ForEachForwardedHeader(pHeaders, rgOverrides, cOverrides,
+        [&](PCSTR pszName, USHORT cchName, PCSTR pszValue, USHORT cchValue)
+        {
+            Widen(pszName, cchName);
+            *pszNext++ = L':';
+            *pszNext++ = L' ';
+            Widen(pszValue, cchValue);
+            *pszNext++ = L'\r';
+            *pszNext++ = L'\n';
+        });
+
+    *pszNext = L'\0';
+    DBG_ASSERT(pszNext == pszHeaders + cchHeaders);
+
+    *ppszHeaders = pszHeaders;
+    *pcchHeaders = static_cast<DWORD>(cchHeaders);
+    return S_OK;
+}
+
+HRESULT
+FORWARDING_HANDLER::AddRequestHeadersEx(
+    _In_reads_(cOverrides) const HEADER_OVERRIDE * rgOverrides,
+    DWORD                                       cOverrides,
+    _Out_   DWORD *                             pcbHeaders
+)
+{
+    const HTTP_REQUEST_HEADERS *pHeaders = &m_pW3Context->GetRequest()->GetRawHttpRequest()->Headers;
+    DWORD   cHeaders = 0;
+    SIZE_T  cbStrings = 0;
+    DWORD   cbWire = 0;
+
+    *pcbHeaders = 0;
+
+    //
+    // Sized first so that the entries and the strings they point to are
+    // one allocation.
+    //
+    ForEachForwardedHeader(pHeaders, rgOverrides, cOverrides,
+        [&cHeaders, &cbStrings](PCSTR, USHORT cchName, PCSTR, USHORT cchValue)
+        {
+            cHeaders++;
+            cbStrings += cchName + 1 + cchValue + 1;
+        });
+
+    if (cHeaders == 0)
+    {
+        return S_OK;
     }
 
     //
-    // Get all the headers to send to the client
+    // The names and values HTTP.sys hands out are not terminated, WinHTTP
+    // wants them terminated, so they are copied once.
     //
-    RETURN_IF_FAILED(m_pW3Context->GetServerVariable("ALL_RAW",
-        ppszHeaders,
-        pcchHeaders));
+    WINHTTP_HELPER_EXTENDED_HEADER *pEntries = static_cast<WINHTTP_HELPER_EXTENDED_HEADER *>(
+        m_Arena.Alloc(cHeaders * sizeof(WINHTTP_HELPER_EXTENDED_HEADER) + cbStrings));
+    if (pEntries == NULL)
+    {
+        RETURN_HR(E_OUTOFMEMORY);
+    }
+
+    CHAR *pszNext = reinterpret_cast<CHAR *>(pEntries + cHeaders);
+    DWORD iEntry = 0;
+
+    auto CopyTerminated = [&pszNext](PCSTR psz, USHORT cch)
+    {
+        PCSTR pszCopy = pszNext;
+        memcpy(pszNext, psz, cch);
+        pszNext[cch] = '\0';
+        pszNext += cch + 1;
+        return pszCopy;
+    };
+
+    ForEachForwardedHeader(pHeaders, rgOverrides, cOverrides,
+        [&](PCSTR pszName, USHORT cchName, PCSTR pszValue, USHORT cchValue)
+        {
+            pEntries[iEntry].pszName = CopyTerminated(pszName, cchName);
+            pEntries[iEntry].pszValue = CopyTerminated(pszValue, cchValue);
+            cbWire += cchName + 2 + cchValue + 2;
+            iEntry++;
+        });
+
+    DBG_ASSERT(iEntry == cHeaders);
+
+    const DWORD dwError = WINHTTP_HELPER::sm_pfnWinHttpAddRequestHeadersEx(m_hRequest,
+        WINHTTP_ADDREQ_FLAG_ADD,
+        0,  // ullFlags, UTF-8 names and values
+        0,
+        cHeaders,
+        pEntries);
+    if (dwError != ERROR_SUCCESS)
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(dwError));
+    }
 
+    *pcbHeaders = cbWire;
     return S_OK;
 }
 
+//
+// Text of the versions WinHttpOpenRequest is given for nearly every
+// request, spelled as the HTTP_VERSION server variable spells them. NULL
+// for others, which are looked up.
+//
+static
+PCWSTR
+QueryKnownHttpVersion(
+    const HTTP_VERSION &    version
+)
+{
+    if (version.MajorVersion == 1)
+    {
+        if (version.MinorVersion == 1)
+        {
+            return L"HTTP/1.1";
+        }
+
+        if (version.MinorVersion == 0)
+        {
+            return L"HTTP/1.0";
+        }
+    }
+
+    return NULL;
+}
+
 HRESULT
 FORWARDING_HANDLER::CreateWinHttpRequest(
     _In_ const IHttpRequest *       pRequest,
     _In_ const PROTOCOL_CONFIG *    pProtocol,
     _In_ HINTERNET                  hConnect,
-    _Inout_ STRU *                  pstrUrl,
+    _In_ PCWSTR                     pszUrl,
     _In_ SERVER_PROCESS*            pServerProcess
 )
 {
     HRESULT         hr = S_OK;
     PCWSTR          pszVersion = NULL;
     PCSTR           pszVerb;
-    DWORD           dwTimeout = INFINITE;
     STACK_STRU(strVerb, 32);
 
     //
@@ -975,7 +1881,7 @@ FORWARDING_HANDLER::CreateWinHttpRequest(
     pszVerb = pRequest->GetHttpMethod();
     FINISHED_IF_FAILED(strVerb.CopyA(pszVerb));
 
-    //pszVersion = pProtocol->QueryVersion();
+    pszVersion = QueryKnownHttpVersion(pRequest->GetRawHttpRequest()->Version);
     if (pszVersion == NULL)
     {
         DWORD cchUnused;
@@ -987,7 +1893,7 @@ FORWARDING_HANDLER::CreateWinHttpRequest(
 
     m_hRequest = WinHttpOpenRequest(hConnect,
         strVerb.QueryStr(),
-        pstrUrl->QueryStr(),
+        pszUrl,
         pszVersion,
         WINHTTP_NO_REFERER,
         WINHTTP_DEFAULT_ACCEPT_TYPES,
@@ -996,29 +1902,19 @@ FORWARDING_HANDLER::CreateWinHttpRequest(
 
     FINISHED_LAST_ERROR_IF_NULL (m_hRequest);
 
-    if (!pServerProcess->IsDebuggerAttached())
+    //
+    // The timeouts, the response limits and the status callback come from
+    // the session and the connection, see FORWARDER_CONNECTION.
+    //
+    if (pServerProcess->IsDebuggerAttached() && pProtocol->QueryTimeout() != INFINITE)
     {
-        dwTimeout = pProtocol->QueryTimeout();
+        FINISHED_LAST_ERROR_IF(!WinHttpSetTimeouts(m_hRequest,
+                                INFINITE, // resolve timeout
+                                INFINITE, // connect timeout
+                                INFINITE, // send timeout
+                                INFINITE)); // receive timeout
     }
 
-    FINISHED_LAST_ERROR_IF(!WinHttpSetTimeouts(m_hRequest,
-                            dwTimeout, //resolve timeout
-                            dwTimeout, // connect timeout
-                            dwTimeout, // send timeout
-                            dwTimeout)); // receive timeout
-
-    DWORD dwResponseBufferLimit = pProtocol->QueryResponseBufferLimit();
-    FINISHED_LAST_ERROR_IF(!WinHttpSetOption(m_hRequest,
-        WINHTTP_OPTION_MAX_RESPONSE_DRAIN_SIZE,
-        &dwResponseBufferLimit,
-        sizeof(dwResponseBufferLimit)));
-
-    DWORD dwMaxHeaderSize = pProtocol->QueryMaxResponseHeaderSize();
-    FINISHED_LAST_ERROR_IF(!WinHttpSetOption(m_hRequest,
-        WINHTTP_OPTION_MAX_RESPONSE_HEADER_SIZE,
-        &dwMaxHeaderSize,
-        sizeof(dwMaxHeaderSize)));
-
     DWORD dwOption = WINHTTP_DISABLE_COOKIES;
 
     dwOption |= WINHTTP_DISABLE_AUTHENTICATION;
@@ -1028,17 +1924,17 @@ FORWARDING_HANDLER::CreateWinHttpRequest(
         dwOption |= WINHTTP_DISABLE_KEEP_ALIVE;
     }
 
+    // Only settable on a request handle.
     FINISHED_LAST_ERROR_IF(!WinHttpSetOption(m_hRequest,
         WINHTTP_OPTION_DISABLE_FEATURE,
         &dwOption,
         sizeof(dwOption)));
 
-    FINISHED_LAST_ERROR_IF(WinHttpSetStatusCallback(m_hRequest,
-        FORWARDING_HANDLER::OnWinHttpCompletion,
-        (WINHTTP_CALLBACK_FLAG_ALL_COMPLETIONS |
-            WINHTTP_CALLBACK_FLAG_HANDLES |
-            WINHTTP_CALLBACK_STATUS_SENDING_REQUEST),
-        NULL) == WINHTTP_INVALID_STATUS_CALLBACK);
+    //
+    // Held until the closing callback of the last handle of this attempt,
+    // for a WebSocket that is the one of the upgraded connection.
+    //
+    m_pApplication->QueryCounters()->WinHttpConnectionOpened();
 
     FINISHED_IF_FAILED(GetHeaders(pProtocol,
                     m_pApplication->QueryConfig()->QueryForwardWindowsAuthToken(),
@@ -1066,10 +1962,55 @@ FORWARDING_HANDLER::OnWinHttpCompletion(
         return;
     }
     DBG_ASSERT(pThis->m_Signature == FORWARDING_HANDLER_SIGNATURE);
+    ALLOCATION_TRACKING_REQUEST_SCOPE(false);
+
+    //
+    // The handler may be gone once the completion is processed, the node
+    // is read before.
+    //
+    GROUP_AFFINITY previousAffinity;
+    const BOOL fMoved = pThis->m_uCompletionNode != NO_COMPLETION_NODE &&
+        MoveToCompletionNode(pThis->m_uCompletionNode, &previousAffinity);
+
     pThis->OnWinHttpCompletionInternal(hRequest,
         dwInternetStatus,
         lpvStatusInformation,
         dwStatusInformationLength);
+
+    //
+    // WinHTTP threads serve every node. Widening the affinity again doesn't
+    // migrate the thread, the next completion of the node finds it there.
+    //
+    if (fMoved)
+    {
+        LOG_LAST_ERROR_IF(!SetThreadGroupAffinity(GetCurrentThread(), &previousAffinity, NULL));
+    }
+}
+
+// static
+BOOL
+FORWARDING_HANDLER::MoveToCompletionNode(
+    UINT                    uNode,
+    _Out_ GROUP_AFFINITY *  pPrevious
+)
+{
+    PROCESSOR_NUMBER processorNumber;
+    USHORT usCurrentNode = 0;
+
+    DBG_ASSERT(uNode < sm_cNodes);
+
+    GetCurrentProcessorNumberEx(&processorNumber);
+    if (GetNumaProcessorNodeEx(&processorNumber, &usCurrentNode) &&
+        usCurrentNode == uNode)
+    {
+        return FALSE;
+    }
+
+    //
+    // Taking a processor out of the affinity of the running thread
+    // reschedules it right away, on the node.
+    //
+    return SetThreadGroupAffinity(GetCurrentThread(), &sm_pNodeAffinity[uNode], pPrevious);
 }
 
 VOID
@@ -1119,7 +2060,7 @@ None
 
     if (sm_pTraceLog != NULL)
     {
-        WriteRefTraceLogEx(sm_pTraceLog,
+        sm_pTraceLog->Write(
             m_cRefs,
             this,
             "FORWARDING_HANDLER::OnWinHttpCompletionInternal Enter",
@@ -1160,16 +2101,27 @@ None
         }
         else
         {
-            AcquireSRWLockShared(&m_RequestLock);
+            LockContention::AcquireShared(&m_RequestLock, LockSite::ForwardingHandlerRequest);
             TlsSetValue(g_dwTlsIndex, this);
             fSharedLocked = TRUE;
             DBG_ASSERT(TlsGetValue(g_dwTlsIndex) == this);
         }
     }
 
+    if (dwInternetStatus == WINHTTP_CALLBACK_STATUS_HEADERS_AVAILABLE ||
+        dwInternetStatus == WINHTTP_CALLBACK_STATUS_REQUEST_ERROR ||
+        fHandleClosing)
+    {
+        m_fAwaitingResponseHeaders = FALSE;
+    }
+
     if (fHandleClosing)
     {
         dwHandlers = InterlockedDecrement(&m_dwHandlers);
+        if (dwHandlers == 0)
+        {
+            m_pApplication->QueryCounters()->WinHttpConnectionClosed();
+        }
     }
 
     if (m_fFinishRequest)
@@ -1194,8 +2146,10 @@ None
     //
     if (m_RequestStatus == FORWARDER_RECEIVED_WEBSOCKET_RESPONSE)
     {
+        WEBSOCKET_HANDLER *pWebSocket = QueryWebSocket();
+
         fAnotherCompletionExpected = TRUE;
-        if (m_pWebSocket == NULL)
+        if (pWebSocket == NULL)
         {
             goto Finished;
         }
@@ -1203,23 +2157,23 @@ None
         switch (dwInternetStatus)
         {
         case WINHTTP_CALLBACK_STATUS_SHUTDOWN_COMPLETE:
-            m_pWebSocket->OnWinHttpShutdownComplete();
+            pWebSocket->OnWinHttpShutdownComplete();
             break;
 
         case WINHTTP_CALLBACK_STATUS_WRITE_COMPLETE:
-            m_pWebSocket->OnWinHttpSendComplete(
+            pWebSocket->OnWinHttpSendComplete(
                 (WINHTTP_WEB_SOCKET_STATUS*)lpvStatusInformation
             );
             break;
 
         case WINHTTP_CALLBACK_STATUS_READ_COMPLETE:
-            m_pWebSocket->OnWinHttpReceiveComplete(
+            pWebSocket->OnWinHttpReceiveComplete(
                 (WINHTTP_WEB_SOCKET_STATUS*)lpvStatusInformation
             );
             break;
 
         case WINHTTP_CALLBACK_STATUS_REQUEST_ERROR:
-            m_pWebSocket->OnWinHttpIoError(
+            pWebSocket->OnWinHttpIoError(
                 (WINHTTP_WEB_SOCKET_ASYNC_RESULT*)lpvStatusInformation
             );
             break;
@@ -1227,10 +2181,28 @@ None
         goto Finished;
     }
 
+    if (m_pSample != NULL)
+    {
+        m_pSample->cWinHttpCallbacks++;
+        m_pSample->dwWinHttpCallbackStatuses |= dwInternetStatus;
+        if (dwInternetStatus == WINHTTP_CALLBACK_STATUS_WRITE_COMPLETE)
+        {
+            m_pSample->cbRequestBody += *static_cast<const DWORD *>(lpvStatusInformation);
+        }
+        else if (dwInternetStatus == WINHTTP_CALLBACK_STATUS_READ_COMPLETE)
+        {
+            m_pSample->cbResponseBody += dwStatusInformationLength;
+        }
+    }
+
     switch (dwInternetStatus)
     {
     case WINHTTP_CALLBACK_STATUS_SENDREQUEST_COMPLETE:
     case WINHTTP_CALLBACK_STATUS_WRITE_COMPLETE:
+        if (dwInternetStatus == WINHTTP_CALLBACK_STATUS_SENDREQUEST_COMPLETE)
+        {
+            m_Timings.llSendComplete = QueryTimestamp();
+        }
         hr = LOG_IF_FAILED(OnWinHttpCompletionSendRequestOrWriteComplete(hRequest,
             dwInternetStatus,
             &fClientError,
@@ -1238,6 +2210,7 @@ None
         break;
 
     case WINHTTP_CALLBACK_STATUS_HEADERS_AVAILABLE:
+        m_Timings.llHeadersAvailable = QueryTimestamp();
         hr = LOG_IF_FAILED(OnWinHttpCompletionStatusHeadersAvailable(hRequest,
             &fAnotherCompletionExpected));
         break;
@@ -1249,6 +2222,11 @@ None
         break;
 
     case WINHTTP_CALLBACK_STATUS_READ_COMPLETE:
+        m_Timings.llLastByte = QueryTimestamp();
+        if (m_Timings.llFirstByte == 0)
+        {
+            m_Timings.llFirstByte = m_Timings.llLastByte;
+        }
         hr = LOG_IF_FAILED(OnWinHttpCompletionStatusReadComplete(pResponse,
             dwStatusInformationLength,
             &fAnotherCompletionExpected));
@@ -1256,6 +2234,15 @@ None
 
     case WINHTTP_CALLBACK_STATUS_REQUEST_ERROR:
         hr = LOG_IF_FAILED(HRESULT_FROM_WIN32(static_cast<const WINHTTP_ASYNC_RESULT *>(lpvStatusInformation)->dwError));
+        if (CanRetryRequest(hr))
+        {
+            //
+            // The closing handle reports back before the request is sent again.
+            //
+            BeginRetryRequest();
+            hr = S_OK;
+            fAnotherCompletionExpected = TRUE;
+        }
         break;
 
     case WINHTTP_CALLBACK_STATUS_SENDING_REQUEST:
@@ -1282,7 +2269,8 @@ None
                 m_pW3Context->GetTraceContext(),
                 NULL);
         }
-        if (m_RequestStatus != FORWARDER_DONE)
+        if (m_RequestStatus != FORWARDER_DONE &&
+            m_RequestStatus != FORWARDER_RETRYING_REQUEST)
         {
             hr = LOG_IF_FAILED(ERROR_CONNECTION_ABORTED);
             fClientError = m_fClientDisconnected;
@@ -1303,7 +2291,7 @@ None
         hr = LOG_IF_FAILED(E_UNEXPECTED);
         if (sm_pTraceLog != NULL)
         {
-            WriteRefTraceLogEx(sm_pTraceLog,
+            sm_pTraceLog->Write(
                 m_cRefs,
                 this,
                 "FORWARDING_HANDLER::OnWinHttpCompletionInternal Unexpected WinHTTP Status",
@@ -1361,6 +2349,12 @@ Failure:
             STACK_STRU(strDescription, 128);
 
             pResponse->SetStatus(502, "Bad Gateway", 3, hr);
+            m_pApplication->QueryCounters()->RecordForwardingError(QueryForwardingError(hr));
+
+            if (hr == HRESULT_FROM_WIN32(ERROR_WINHTTP_TIMEOUT) && m_pServerProcess != NULL)
+            {
+                m_pServerProcess->RecordForwardResult(TRUE);
+            }
 
             if (!(hr > HRESULT_FROM_WIN32(WINHTTP_ERROR_BASE) &&
                 hr <= HRESULT_FROM_WIN32(WINHTTP_ERROR_LAST)) ||
@@ -1412,19 +2406,33 @@ Finished:
     // Never post completion again after that
     // Otherwise, there will be a AV as the request already passed IIS pipeline
     //
-    if (fHandleClosing && dwHandlers == 0)
+    if (fHandleClosing && m_RequestStatus == FORWARDER_RETRYING_REQUEST)
+    {
+        //
+        // Retry path
+        //
+        // The failed attempt's handle is gone, let AsyncCompletion send the
+        // request again on an IIS thread.
+        //
+        fDoPostCompletion = dwHandlers == 0;
+    }
+    else if (fHandleClosing && dwHandlers == 0)
     {
         //
         // Happy path
         //
         // Marked the request is finished, no more PostCompletion is allowed
         RemoveRequest();
+        if (!m_fHasError && m_RequestStatus == FORWARDER_DONE)
+        {
+            CompleteResponseCacheFill();
+        }
         m_fFinishRequest = TRUE;
         fDoPostCompletion = TRUE;
-        if (m_pWebSocket != NULL)
+        if (QueryWebSocket() != NULL)
         {
-            m_pWebSocket->Terminate();
-            m_pWebSocket = NULL;
+            m_pCold->pWebSocket->Terminate();
+            m_pCold->pWebSocket = NULL;
         }
     }
     else if (m_RequestStatus == FORWARDER_DONE)
@@ -1432,18 +2440,28 @@ Finished:
         //
         // Error path
         //
+        // In streaming mode IIS may still be flushing a chunk, and while
+        // uploading it may still be reading the request body or its spool
+        // file, or writing the response spool file; closing the handle now
+        // would post a second IIS completion. AsyncCompletion closes it
+        // once that operation completes.
+        //
         RemoveRequest();
-        if (m_hRequest != NULL && !m_fHttpHandleInClose)
+        if (m_hRequest != NULL &&
+            !m_fHttpHandleInClose &&
+            !(m_pReadAhead != NULL && m_pReadAhead->fFlushOutstanding) &&
+            !(m_pUpload != NULL && m_pUpload->fReadOutstanding) &&
+            !(m_pRequestSpool != NULL && m_pRequestSpool->QueryIoPending()) &&
+            !(m_pResponseSpool != NULL && m_pResponseSpool->QueryIoPending()))
         {
             m_fHttpHandleInClose = TRUE;
             WinHttpCloseHandle(m_hRequest);
             m_hRequest = NULL;
         }
 
-        if (m_pWebSocket != NULL && !m_fWebSocketHandleInClose)
+        if (QueryWebSocket() != NULL)
         {
-            m_fWebSocketHandleInClose = TRUE;
-            m_pWebSocket->TerminateRequest();
+            m_pCold->pWebSocket->TerminateRequest();
         }
 
         if (fHandleClosing)
@@ -1495,6 +2513,16 @@ FORWARDING_HANDLER::OnWinHttpCompletionSendRequestOrWriteComplete(
     HRESULT hr = S_OK;
     IHttpRequest *      pRequest = m_pW3Context->GetRequest();
 
+    if (m_pUpload != NULL)
+    {
+        return OnUploadWriteComplete(pfClientError, pfAnotherCompletionExpected);
+    }
+
+    if (m_pRequestSpool != NULL)
+    {
+        return SendSpooledRequestBody(pfAnotherCompletionExpected);
+    }
+
     //
     // completion for sending the initial request or request entity to
     // winhttp, get more request entity if available, else start receiving
@@ -1510,7 +2538,7 @@ FORWARDING_HANDLER::OnWinHttpCompletionSendRequestOrWriteComplete(
 
         if (sm_pTraceLog != NULL)
         {
-            WriteRefTraceLogEx(sm_pTraceLog,
+            sm_pTraceLog->Write(
                 m_cRefs,
                 this,
                 "Calling ReadEntityBody",
@@ -1577,6 +2605,7 @@ FORWARDING_HANDLER::OnWinHttpCompletionSendRequestOrWriteComplete(
 
     m_RequestStatus = FORWARDER_RECEIVING_RESPONSE;
 
+    m_fAwaitingResponseHeaders = TRUE;
     FINISHED_LAST_ERROR_IF(!WinHttpReceiveResponse(hRequest, NULL));
     *pfAnotherCompletionExpected = TRUE;
 
@@ -1593,7 +2622,7 @@ FORWARDING_HANDLER::OnWinHttpCompletionStatusHeadersAvailable(
 {
     HRESULT       hr = S_OK;
     STACK_BUFFER(bufHeaderBuffer, 2048);
-    STACK_STRA(strHeaders, 2048);
+    ARENA_STRA(strHeaders, 2048, &m_Arena);
     DWORD         dwHeaderSize = bufHeaderBuffer.QuerySize();
 
     UNREFERENCED_PARAMETER(pfAnotherCompletionExpected);
@@ -1645,22 +2674,60 @@ FORWARDING_HANDLER::OnWinHttpCompletionStatusHeadersAvailable(
         FINISHED_IF_FAILED(strHeaders.Append("\r\n"));
     }
 
+    if (m_pSample != NULL)
+    {
+        m_pSample->cchResponseHeaders = strHeaders.QueryCCH();
+    }
+
     FINISHED_IF_FAILED(SetStatusAndHeaders(
         strHeaders.QueryStr(),
         strHeaders.QueryCCH()));
 
     FreeResponseBuffers();
 
-    //
-    // If the request was websocket, and response was 101,
-    // trigger a flush, so that IIS's websocket module
-    // can get a chance to initialize and complete the handshake.
-    //
+    if (m_pSendFileInfo != NULL)
+    {
+        //
+        // Nothing of the backend response body is read, closing the handle
+        // drops it and completes the request with the file.
+        //
+        FINISHED_IF_FAILED(SetSendFileResponse());
+        m_RequestStatus = FORWARDER_DONE;
+        goto Finished;
+    }
+
+    if (!m_fWebSocketEnabled)
+    {
+        BeginResponseCacheFill();
+        FINISHED_IF_FAILED(BeginSpoolResponseBody());
+
+        if (CanReadWholeResponse())
+        {
+            //
+            // Read from here rather than from an IIS completion, the
+            // response goes to IIS once the body is in.
+            //
+            FINISHED_IF_FAILED(ReadWholeResponse());
+            *pfAnotherCompletionExpected = TRUE;
+            goto Finished;
+        }
+    }
+
+    //
+    // If the request was websocket, and response was 101,
+    // trigger a flush, so that IIS's websocket module
+    // can get a chance to initialize and complete the handshake.
+    //
 
     if (m_fWebSocketEnabled)
     {
         m_RequestStatus = FORWARDER_RECEIVED_WEBSOCKET_RESPONSE;
 
+        if (m_pSample != NULL)
+        {
+            m_pSample->cFlushes++;
+        }
+
         hr = m_pW3Context->GetResponse()->Flush(
             TRUE,
             TRUE,
@@ -1701,6 +2768,7 @@ FORWARDING_HANDLER::OnWinHttpCompletionStatusDataAvailable(
             FINISHED(HRESULT_FROM_WIN32(ERROR_WINHTTP_INVALID_SERVER_RESPONSE));
         }
 
+
         m_RequestStatus = FORWARDER_DONE;
 
         goto Finished;
@@ -1744,6 +2812,27 @@ FORWARDING_HANDLER::OnWinHttpCompletionStatusReadComplete(
 {
     HRESULT hr = S_OK;
 
+    if (m_pReadAhead != NULL)
+    {
+        return OnReadAheadReadComplete(pResponse,
+            dwStatusInformationLength,
+            pfAnotherCompletionExpected);
+    }
+
+    if (m_pResponseSpool != NULL && !m_fResponseSpoolSent)
+    {
+        return OnSpoolReadComplete(pResponse,
+            dwStatusInformationLength,
+            pfAnotherCompletionExpected);
+    }
+
+    if (m_fReadingWholeResponse)
+    {
+        return OnWholeResponseReadComplete(pResponse,
+            dwStatusInformationLength,
+            pfAnotherCompletionExpected);
+    }
+
     //
     // Response data has been read from winhttp, send it to the client
     //
@@ -1790,22 +2879,60 @@ FORWARDING_HANDLER::OnWinHttpCompletionStatusReadComplete(
         Chunk.FromMemory.pBuffer = m_pEntityBuffer;
         Chunk.FromMemory.BufferLength = dwStatusInformationLength;
         FINISHED_IF_FAILED(pResponse->WriteEntityChunkByReference(&Chunk));
+
+        AppendResponseCacheBody(m_pEntityBuffer, dwStatusInformationLength);
     }
 
-    if (m_cBytesBuffered >= m_cMinBufferLimit)
+    if (m_cBytesBuffered >= m_cMinBufferLimit ||
+        (m_dwFlushIntervalInMS != 0 &&
+         GetTickCount64() - m_ullLastFlushTick >= m_dwFlushIntervalInMS))
     {
+        if (m_dwFlushIntervalInMS != 0)
+        {
+            m_ullLastFlushTick = GetTickCount64();
+        }
+
         //
         // Always post a completion to resume the WinHTTP data pump.
         //
+        m_fResponseFlushed = TRUE;
+        if (m_pSample != NULL)
+        {
+            m_pSample->cFlushes++;
+        }
         FINISHED_IF_FAILED(pResponse->Flush(TRUE,     // fAsync
             TRUE,     // fMoreData
             NULL));    // pcbSent
 
+        m_cInlineReads = 0;
         *pfAnotherCompletionExpected = TRUE;
     }
     else
     {
-        *pfAnotherCompletionExpected = FALSE;
+        //
+        // The chunk stays referenced by the response until the next flush,
+        // the next read has to go into a fresh buffer.
+        //
+        m_pEntityBuffer = NULL;
+
+        if (m_RequestStatus == FORWARDER_RECEIVING_RESPONSE &&
+            m_cInlineReads < sm_ProtocolConfig.QueryResponseInlineReads())
+        {
+            //
+            // Nothing IIS has to do before the next read, issue it from
+            // this thread rather than hopping to an IIS one to do so. A
+            // read WinHTTP completes synchronously nests back in here,
+            // hence the bound, past which the completion is posted.
+            //
+            m_cInlineReads++;
+            FINISHED_IF_FAILED(OnReceivingResponse());
+            *pfAnotherCompletionExpected = TRUE;
+        }
+        else
+        {
+            m_cInlineReads = 0;
+            *pfAnotherCompletionExpected = FALSE;
+        }
     }
 
 Finished:
@@ -1813,6 +2940,58 @@ Finished:
     return hr;
 }
 
+//
+// Wrap cbData bytes of request body, read at pBuffer + 6, into a chunk of a
+// chunk-encoded body: the hex length and CRLF go right in front of the data
+// and a CRLF right after it. Returns the length of the framed chunk, which
+// starts at pBuffer + *pcbOffset.
+//
+static
+DWORD
+FrameRequestBodyChunk(
+    _Inout_ BYTE *      pBuffer,
+    DWORD               cbData,
+    _Out_ DWORD *       pcbOffset
+)
+{
+    pBuffer[4] = '\r';
+    pBuffer[5] = '\n';
+
+    pBuffer[cbData + 6] = '\r';
+    pBuffer[cbData + 7] = '\n';
+
+    if (cbData < 0x10)
+    {
+        *pcbOffset = 3;
+        pBuffer[3] = HEX_TO_ASCII(cbData);
+        return cbData + 5;
+    }
+    else if (cbData < 0x100)
+    {
+        *pcbOffset = 2;
+        pBuffer[2] = HEX_TO_ASCII(cbData >> 4);
+        pBuffer[3] = HEX_TO_ASCII(cbData & 0xf);
+        return cbData + 6;
+    }
+    else if (cbData < 0x1000)
+    {
+        *pcbOffset = 1;
+        pBuffer[1] = HEX_TO_ASCII(cbData >> 8);
+        pBuffer[2] = HEX_TO_ASCII((cbData >> 4) & 0xf);
+        pBuffer[3] = HEX_TO_ASCII(cbData & 0xf);
+        return cbData + 7;
+    }
+
+    DBG_ASSERT(cbData < 0x10000);
+
+    *pcbOffset = 0;
+    pBuffer[0] = HEX_TO_ASCII(cbData >> 12);
+    pBuffer[1] = HEX_TO_ASCII((cbData >> 8) & 0xf);
+    pBuffer[2] = HEX_TO_ASCII((cbData >> 4) & 0xf);
+    pBuffer[3] = HEX_TO_ASCII(cbData & 0xf);
+    return cbData + 8;
+}
+
 HRESULT
 FORWARDING_HANDLER::OnSendingRequest(
     DWORD                       cbCompletion,
@@ -1820,6 +2999,11 @@ FORWARDING_HANDLER::OnSendingRequest(
     __out BOOL *                pfClientError
 )
 {
+    if (m_pUpload != NULL)
+    {
+        return OnUploadReadComplete(cbCompletion, hrCompletionStatus, pfClientError);
+    }
+
     //
     // This is a completion for a read from http.sys, abort in case
     // of failure, if we read anything write it out over WinHTTP,
@@ -1842,6 +3026,7 @@ FORWARDING_HANDLER::OnSendingRequest(
         {
             m_RequestStatus = FORWARDER_RECEIVING_RESPONSE;
 
+            m_fAwaitingResponseHeaders = TRUE;
             RETURN_LAST_ERROR_IF(!WinHttpReceiveResponse(m_hRequest, NULL));
         }
     }
@@ -1856,48 +3041,17 @@ FORWARDING_HANDLER::OnSendingRequest(
         }
         else
         {
+            HRESULT hr = CountChunkedRequestBody(cbCompletion);
+            if (FAILED(hr))
+            {
+                *pfClientError = TRUE;
+                return hr;
+            }
+
             //
             // For chunk-encoded requests, need to re-chunk the entity body
-            // Add the CRLF just before and after the chunk data
             //
-            m_pEntityBuffer[4] = '\r';
-            m_pEntityBuffer[5] = '\n';
-
-            m_pEntityBuffer[cbCompletion + 6] = '\r';
-            m_pEntityBuffer[cbCompletion + 7] = '\n';
-
-            if (cbCompletion < 0x10)
-            {
-                cbOffset = 3;
-                m_pEntityBuffer[3] = HEX_TO_ASCII(cbCompletion);
-                cbCompletion += 5;
-            }
-            else if (cbCompletion < 0x100)
-            {
-                cbOffset = 2;
-                m_pEntityBuffer[2] = HEX_TO_ASCII(cbCompletion >> 4);
-                m_pEntityBuffer[3] = HEX_TO_ASCII(cbCompletion & 0xf);
-                cbCompletion += 6;
-            }
-            else if (cbCompletion < 0x1000)
-            {
-                cbOffset = 1;
-                m_pEntityBuffer[1] = HEX_TO_ASCII(cbCompletion >> 8);
-                m_pEntityBuffer[2] = HEX_TO_ASCII((cbCompletion >> 4) & 0xf);
-                m_pEntityBuffer[3] = HEX_TO_ASCII(cbCompletion & 0xf);
-                cbCompletion += 7;
-            }
-            else
-            {
-                DBG_ASSERT(cbCompletion < 0x10000);
-
-                cbOffset = 0;
-                m_pEntityBuffer[0] = HEX_TO_ASCII(cbCompletion >> 12);
-                m_pEntityBuffer[1] = HEX_TO_ASCII((cbCompletion >> 8) & 0xf);
-                m_pEntityBuffer[2] = HEX_TO_ASCII((cbCompletion >> 4) & 0xf);
-                m_pEntityBuffer[3] = HEX_TO_ASCII(cbCompletion & 0xf);
-                cbCompletion += 8;
-            }
+            cbCompletion = FrameRequestBodyChunk(m_pEntityBuffer, cbCompletion, &cbOffset);
         }
         m_cchLastSend = cbCompletion;
 
@@ -1915,12 +3069,53 @@ FORWARDING_HANDLER::OnSendingRequest(
     return S_OK;
 }
 
+BOOL
+FORWARDING_HANDLER::IsRequestBodyTooLarge()
+{
+    const DWORD cbMaxRequestBodySize = m_pApplication->QueryConfig()->QueryMaxRequestBodySize();
+    if (cbMaxRequestBodySize == 0)
+    {
+        return FALSE;
+    }
+
+    PCSTR pszContentLength = m_pW3Context->GetRequest()->GetHeader(HttpHeaderContentLength);
+    return pszContentLength != NULL &&
+        _strtoui64(pszContentLength, NULL, 10) > cbMaxRequestBodySize;
+}
+
+HRESULT
+FORWARDING_HANDLER::CountChunkedRequestBody(
+    DWORD                       cbCompletion
+)
+{
+    const DWORD cbMaxRequestBodySize = m_pApplication->QueryConfig()->QueryMaxRequestBodySize();
+    if (cbMaxRequestBodySize != 0 &&
+        cbCompletion > cbMaxRequestBodySize - m_cbChunkedBodyRead)
+    {
+        return HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE);
+    }
+
+    m_cbChunkedBodyRead += cbCompletion;
+    return S_OK;
+}
+
 HRESULT
 FORWARDING_HANDLER::OnReceivingResponse(
 )
 {
-    if (m_cBytesBuffered >= m_cMinBufferLimit)
+    if (m_pReadAhead != NULL)
     {
+        return OnReadAheadReceivingResponse();
+    }
+
+    if (m_pResponseSpool != NULL && !m_fResponseSpoolSent)
+    {
+        return OnSpoolReceivingResponse();
+    }
+
+    if (m_fResponseFlushed)
+    {
+        m_fResponseFlushed = FALSE;
         FreeResponseBuffers();
     }
 
@@ -1971,6 +3166,107 @@ FORWARDING_HANDLER::OnReceivingResponse(
     return S_OK;
 }
 
+BOOL
+FORWARDING_HANDLER::CanReadWholeResponse() const
+{
+    return m_RequestStatus == FORWARDER_RECEIVING_RESPONSE &&
+        m_cContentLength != 0 &&
+        m_cContentLength <= BUFFER_SIZE &&
+        m_pReadAhead == NULL &&
+        m_pUpload == NULL &&
+        m_pResponseSpool == NULL;
+}
+
+HRESULT
+FORWARDING_HANDLER::ReadWholeResponse()
+/*++
+
+Routine Description:
+
+    Start reading the whole response body into a buffer of its size, from
+    the headers available WinHTTP callback.
+
+--*/
+{
+    DBG_ASSERT(CanReadWholeResponse());
+
+    m_BytesToSend = static_cast<DWORD>(m_cContentLength);
+    m_cBytesBuffered = 0;
+
+    m_pEntityBuffer = GetNewResponseBuffer(m_BytesToSend);
+    if (m_pEntityBuffer == NULL)
+    {
+        RETURN_HR(E_OUTOFMEMORY);
+    }
+
+    m_fReadingWholeResponse = TRUE;
+
+    RETURN_LAST_ERROR_IF(!WinHttpReadData(m_hRequest,
+        m_pEntityBuffer,
+        m_BytesToSend,
+        NULL));
+
+    return S_OK;
+}
+
+HRESULT
+FORWARDING_HANDLER::OnWholeResponseReadComplete(
+    _In_ IHttpResponse *        pResponse,
+    DWORD                       cbRead,
+    _Out_ BOOL *                pfAnotherCompletionExpected
+)
+/*++
+
+Routine Description:
+
+    Continue reading the body of the small response fast path. Once all
+    of it is in, it is added to the response and the request is done: the
+    handle closing posts the IIS completion and IIS then sends the status,
+    headers and body together as the final send of the request.
+
+--*/
+{
+    DBG_ASSERT(cbRead <= m_BytesToSend);
+
+    *pfAnotherCompletionExpected = FALSE;
+
+    if (cbRead == 0)
+    {
+        //
+        // The backend closed the connection before the Content-Length.
+        //
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_WINHTTP_INVALID_SERVER_RESPONSE));
+    }
+
+    m_BytesToSend -= cbRead;
+    m_cBytesBuffered += cbRead;
+
+    if (m_BytesToSend != 0)
+    {
+        RETURN_LAST_ERROR_IF(!WinHttpReadData(m_hRequest,
+            m_pEntityBuffer + m_cBytesBuffered,
+            m_BytesToSend,
+            NULL));
+
+        *pfAnotherCompletionExpected = TRUE;
+        return S_OK;
+    }
+
+    m_fReadingWholeResponse = FALSE;
+    m_cContentLength = 0;
+
+    HTTP_DATA_CHUNK Chunk;
+    Chunk.DataChunkType = HttpDataChunkFromMemory;
+    Chunk.FromMemory.pBuffer = m_pEntityBuffer;
+    Chunk.FromMemory.BufferLength = m_cBytesBuffered;
+    RETURN_IF_FAILED(pResponse->WriteEntityChunkByReference(&Chunk));
+
+    AppendResponseCacheBody(m_pEntityBuffer, m_cBytesBuffered);
+
+    m_RequestStatus = FORWARDER_DONE;
+    return S_OK;
+}
+
 BYTE *
 FORWARDING_HANDLER::GetNewResponseBuffer(
     DWORD   dwBufferSize
@@ -1984,12 +3280,22 @@ FORWARDING_HANDLER::GetNewResponseBuffer(
         return NULL;
     }
 
-    BYTE *pBuffer = (BYTE *)HeapAlloc(GetProcessHeap(),
-        0, // dwFlags
-        dwBufferSize);
-    if (pBuffer == NULL)
+    BYTE *pBuffer;
+    if (!m_fInlineResponseBufferInUse &&
+        dwBufferSize <= INLINE_RESPONSE_BUFFER_SIZE)
     {
-        return NULL;
+        m_fInlineResponseBufferInUse = TRUE;
+        pBuffer = m_rgbInlineResponseBuffer;
+    }
+    else
+    {
+        pBuffer = sm_pResponseBufferPool->Alloc(dwBufferSize,
+            m_pApplication->QueryCounters(),
+            APPLICATION_COUNTERS::MEMORY_TAG_RESPONSE_BUFFERS);
+        if (pBuffer == NULL)
+        {
+            return NULL;
+        }
     }
 
     m_buffEntityBuffers.QueryPtr()[m_cEntityBuffers] = pBuffer;
@@ -2004,115 +3310,1213 @@ FORWARDING_HANDLER::FreeResponseBuffers()
     BYTE **pBuffers = m_buffEntityBuffers.QueryPtr();
     for (DWORD i = 0; i<m_cEntityBuffers; i++)
     {
-        HeapFree(GetProcessHeap(),
-            0, // dwFlags
-            pBuffers[i]);
+        if (pBuffers[i] != m_rgbInlineResponseBuffer)
+        {
+            sm_pResponseBufferPool->Free(pBuffers[i]);
+        }
     }
+    m_fInlineResponseBufferInUse = FALSE;
     m_cEntityBuffers = 0;
     m_pEntityBuffer = NULL;
     m_cBytesBuffered = 0;
 }
 
 HRESULT
-FORWARDING_HANDLER::SetStatusAndHeaders(
-    PCSTR           pszHeaders,
-    DWORD
+FORWARDING_HANDLER::InitializeReadAhead(
+    DWORD   cBuffers
 )
-{
-    IHttpResponse * pResponse = m_pW3Context->GetResponse();
-    IHttpRequest *  pRequest = m_pW3Context->GetRequest();
-    STACK_STRA(strHeaderName, 128);
-    STACK_STRA(strHeaderValue, 2048);
-    DWORD           index = 0;
-    PSTR            pchNewline;
-    PCSTR           pchEndofHeaderValue;
-    BOOL            fServerHeaderPresent = FALSE;
+/*++
 
-    _ASSERT(pszHeaders != NULL);
+Routine Description:
 
-    //
-    // The first line is the status line
-    //
-    PSTR pchStatus = const_cast<PSTR>(strchr(pszHeaders, ' '));
-    if (pchStatus == NULL)
+    Allocate the read buffer ring used by the streaming response mode.
+
+    In streaming mode every completed WinHttpReadData is handed to IIS by
+    reference right away and the next read is posted into another buffer
+    of the ring without waiting for the IIS flush. WinHTTP only allows a
+    single outstanding read per request, so the ring lets the WinHTTP read
+    and the IIS flush overlap rather than stacking reads.
+
+--*/
+{
+    DBG_ASSERT(m_pReadAhead == NULL);
+
+    m_pReadAhead = new RESPONSE_READ_AHEAD;
+    if (m_pReadAhead == NULL)
     {
-        return HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER);
+        RETURN_HR(E_OUTOFMEMORY);
     }
-    while (*pchStatus == ' ')
+
+    ZeroMemory(m_pReadAhead, sizeof(RESPONSE_READ_AHEAD));
+    m_pReadAhead->cBuffers = min(cBuffers, RESPONSE_READ_AHEAD::MAX_BUFFERS);
+
+    for (DWORD i = 0; i < m_pReadAhead->cBuffers; i++)
     {
-        pchStatus++;
+        BYTE *pBuffer = sm_pResponseBufferPool->Alloc(BUFFER_SIZE,
+            m_pApplication->QueryCounters(),
+            APPLICATION_COUNTERS::MEMORY_TAG_RESPONSE_BUFFERS);
+        if (pBuffer == NULL)
+        {
+            RETURN_HR(E_OUTOFMEMORY);
+        }
+
+        m_pReadAhead->rgFreeBuffers[m_pReadAhead->cFreeBuffers++] = pBuffer;
     }
-    USHORT uStatus = static_cast<USHORT>(atoi(pchStatus));
 
-    if (m_fWebSocketEnabled && uStatus != 101)
-    {
-        //
-        // Expected 101 response.
-        //
+    return S_OK;
+}
 
-        m_fWebSocketEnabled = FALSE;
+VOID
+FORWARDING_HANDLER::FreeReadAhead()
+{
+    if (m_pReadAhead == NULL)
+    {
+        return;
     }
 
-    pchStatus = strchr(pchStatus, ' ');
-    if (pchStatus == NULL)
+    //
+    // By now the WinHTTP handle is closed and IIS is done with the
+    // response, so every buffer of the ring can go back to the pool.
+    //
+    for (DWORD i = 0; i < m_pReadAhead->cFreeBuffers; i++)
     {
-        return HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER);
+        sm_pResponseBufferPool->Free(m_pReadAhead->rgFreeBuffers[i]);
     }
-    while (*pchStatus == ' ')
+
+    for (DWORD i = 0; i < m_pReadAhead->cPendingChunks; i++)
     {
-        pchStatus++;
+        sm_pResponseBufferPool->Free(
+            static_cast<BYTE *>(m_pReadAhead->rgPendingChunks[i].FromMemory.pBuffer));
     }
-    if (*pchStatus == '\r' || *pchStatus == '\n')
+
+    for (DWORD i = 0; i < m_pReadAhead->cFlushingBuffers; i++)
     {
-        pchStatus--;
+        sm_pResponseBufferPool->Free(m_pReadAhead->rgFlushingBuffers[i]);
     }
 
-    pchNewline = strchr(pchStatus, '\n');
-    if (pchNewline == NULL)
+    if (m_pReadAhead->pReadBuffer != NULL)
     {
-        return HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER);
+        sm_pResponseBufferPool->Free(m_pReadAhead->pReadBuffer);
     }
 
-    if (uStatus != 200)
+    delete m_pReadAhead;
+    m_pReadAhead = NULL;
+}
+
+VOID
+FORWARDING_HANDLER::OnReadAheadFlushCompleted()
+{
+    DBG_ASSERT(m_pReadAhead != NULL);
+    DBG_ASSERT(m_pReadAhead->fFlushOutstanding);
+
+    for (DWORD i = 0; i < m_pReadAhead->cFlushingBuffers; i++)
     {
-        //
-        // Skip over any spaces before the '\n'
-        //
-        for (pchEndofHeaderValue = pchNewline - 1;
-            (pchEndofHeaderValue > pchStatus) &&
-            ((*pchEndofHeaderValue == ' ') ||
-            (*pchEndofHeaderValue == '\r'));
-            pchEndofHeaderValue--)
-        {
-        }
+        m_pReadAhead->rgFreeBuffers[m_pReadAhead->cFreeBuffers++] =
+            m_pReadAhead->rgFlushingBuffers[i];
+    }
+
+    m_pReadAhead->cFlushingBuffers = 0;
+    m_pReadAhead->fFlushOutstanding = FALSE;
+}
+
+HRESULT
+FORWARDING_HANDLER::ReadAheadPostRead()
+{
+    DBG_ASSERT(m_pReadAhead != NULL);
 
+    if (m_pReadAhead->pReadBuffer != NULL ||
+        m_pReadAhead->fEndOfResponse ||
+        m_pReadAhead->cFreeBuffers == 0)
+    {
         //
-        // Copy the status description
+        // A read is already posted, there is nothing left to read or every
+        // buffer is still owned by IIS; the next flush completion retries.
         //
-        RETURN_IF_FAILED(strHeaderValue.Copy(
-            pchStatus,
-            (DWORD)(pchEndofHeaderValue - pchStatus) + 1));
-        RETURN_IF_FAILED(pResponse->SetStatus(uStatus,
-                strHeaderValue.QueryStr(),
-                0,
-                S_OK,
-                NULL,
-                TRUE));
+        return S_OK;
     }
 
-    for (index = static_cast<DWORD>(pchNewline - pszHeaders) + 1;
-        pszHeaders[index] != '\r' && pszHeaders[index] != '\n' && pszHeaders[index] != '\0';
-        index = static_cast<DWORD>(pchNewline - pszHeaders) + 1)
+    BYTE *pBuffer = m_pReadAhead->rgFreeBuffers[--m_pReadAhead->cFreeBuffers];
+    m_pReadAhead->pReadBuffer = pBuffer;
+
+    if (!WinHttpReadData(m_hRequest,
+            pBuffer,
+            BUFFER_SIZE,
+            NULL))
     {
+        DWORD dwError = GetLastError();
+        m_pReadAhead->pReadBuffer = NULL;
+        m_pReadAhead->rgFreeBuffers[m_pReadAhead->cFreeBuffers++] = pBuffer;
+        RETURN_HR(HRESULT_FROM_WIN32(dwError));
+    }
+
+    return S_OK;
+}
+
+HRESULT
+FORWARDING_HANDLER::ReadAheadFlushPending(
+    _In_ IHttpResponse *    pResponse
+)
+{
+    DBG_ASSERT(m_pReadAhead != NULL);
+    DBG_ASSERT(!m_pReadAhead->fFlushOutstanding);
+
+    if (m_pReadAhead->cPendingChunks == 0)
+    {
+        return S_OK;
+    }
+
+    //
+    // The chunks stay in their read buffers, IIS only references them until
+    // the flush completes.
+    //
+    for (DWORD i = 0; i < m_pReadAhead->cPendingChunks; i++)
+    {
+        HTTP_DATA_CHUNK *pChunk = &m_pReadAhead->rgPendingChunks[i];
+        RETURN_IF_FAILED(pResponse->WriteEntityChunkByReference(pChunk));
+
+        m_pReadAhead->rgFlushingBuffers[m_pReadAhead->cFlushingBuffers++] =
+            static_cast<BYTE *>(pChunk->FromMemory.pBuffer);
+    }
+    m_pReadAhead->cPendingChunks = 0;
+
+    m_pReadAhead->fFlushOutstanding = TRUE;
+    if (m_pSample != NULL)
+    {
+        m_pSample->cFlushes++;
+    }
+    HRESULT hr = pResponse->Flush(TRUE,     // fAsync
+        TRUE,     // fMoreData
+        NULL);    // pcbSent
+    if (FAILED_LOG(hr))
+    {
+        m_pReadAhead->fFlushOutstanding = FALSE;
+        return hr;
+    }
+
+    return S_OK;
+}
+
+HRESULT
+FORWARDING_HANDLER::OnReadAheadReadComplete(
+    _In_ IHttpResponse *    pResponse,
+    DWORD                   cbRead,
+    _Out_ BOOL *            pfAnotherCompletionExpected
+)
+{
+    DBG_ASSERT(m_pReadAhead != NULL);
+    DBG_ASSERT(m_pReadAhead->pReadBuffer != NULL);
+
+    BYTE *pBuffer = m_pReadAhead->pReadBuffer;
+    m_pReadAhead->pReadBuffer = NULL;
+
+    //
+    // Unless told otherwise, either the outstanding flush or the next read
+    // resumes the request.
+    //
+    *pfAnotherCompletionExpected = TRUE;
+
+    if (m_RequestStatus != FORWARDER_RECEIVING_RESPONSE)
+    {
+        //
+        // The request failed while the read was outstanding.
+        //
+        m_pReadAhead->rgFreeBuffers[m_pReadAhead->cFreeBuffers++] = pBuffer;
+        return S_OK;
+    }
+
+    if (cbRead == 0)
+    {
+        m_pReadAhead->rgFreeBuffers[m_pReadAhead->cFreeBuffers++] = pBuffer;
+        if (m_cContentLength != 0)
+        {
+            RETURN_HR(HRESULT_FROM_WIN32(ERROR_WINHTTP_INVALID_SERVER_RESPONSE));
+        }
+
+        m_pReadAhead->fEndOfResponse = TRUE;
+    }
+    else
+    {
+        if (m_cContentLength != 0)
+        {
+            m_cContentLength -= cbRead;
+        }
+
+        HTTP_DATA_CHUNK *pChunk = &m_pReadAhead->rgPendingChunks[m_pReadAhead->cPendingChunks++];
+        pChunk->DataChunkType = HttpDataChunkFromMemory;
+        pChunk->FromMemory.pBuffer = pBuffer;
+        pChunk->FromMemory.BufferLength = cbRead;
+
+        AppendResponseCacheBody(pBuffer, cbRead);
+    }
+
+    if (!m_pReadAhead->fFlushOutstanding)
+    {
+        RETURN_IF_FAILED(ReadAheadFlushPending(pResponse));
+    }
+
+    RETURN_IF_FAILED(ReadAheadPostRead());
+
+    if (m_pReadAhead->fEndOfResponse && !m_pReadAhead->fFlushOutstanding)
+    {
+        //
+        // Everything has been handed to IIS, finish the same way the
+        // buffered path does on end of response.
+        //
+        m_RequestStatus = FORWARDER_DONE;
+        *pfAnotherCompletionExpected = FALSE;
+    }
+
+    return S_OK;
+}
+
+HRESULT
+FORWARDING_HANDLER::OnReadAheadReceivingResponse()
+{
+    DBG_ASSERT(m_pReadAhead != NULL);
+
+    //
+    // Either the response headers were just sent or a flush completed
+    // (its buffers were recycled in AsyncCompletion). Hand over whatever
+    // WinHTTP produced meanwhile and keep a read posted.
+    //
+    RETURN_IF_FAILED(ReadAheadFlushPending(m_pW3Context->GetResponse()));
+    RETURN_IF_FAILED(ReadAheadPostRead());
+
+    if (m_pReadAhead->fEndOfResponse && !m_pReadAhead->fFlushOutstanding)
+    {
+        //
+        // The last chunk has been flushed. Closing the handle triggers
+        // WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING which posts the final completion.
+        //
+        m_RequestStatus = FORWARDER_DONE;
+        if (m_hRequest != NULL && !m_fHttpHandleInClose)
+        {
+            m_fHttpHandleInClose = TRUE;
+            WinHttpCloseHandle(m_hRequest);
+            m_hRequest = NULL;
+        }
+    }
+
+    return S_OK;
+}
+
+HRESULT
+FORWARDING_HANDLER::InitializeUpload(
+    DWORD   cBuffers,
+    DWORD   cbLimit
+)
+/*++
+
+Routine Description:
+
+    Allocate the buffer ring used to upload the request body.
+
+    With several buffers the next ReadEntityBody is posted into a free
+    buffer as soon as the previous read completes, while WinHttpWriteData
+    is still sending an earlier chunk to the backend, instead of strictly
+    alternating the two. The ring is bounded by both the buffer count and
+    cbLimit; with fewer than two buffers nothing is allocated and the
+    classic read/write loop is used.
+
+--*/
+{
+    DBG_ASSERT(m_pUpload == NULL);
+
+    cBuffers = min(cBuffers, REQUEST_BODY_UPLOAD::MAX_BUFFERS);
+    if (cbLimit != 0)
+    {
+        cBuffers = min(cBuffers, cbLimit / ENTITY_BUFFER_SIZE);
+    }
+
+    if (cBuffers < 2)
+    {
+        return S_OK;
+    }
+
+    m_pUpload = new REQUEST_BODY_UPLOAD;
+    if (m_pUpload == NULL)
+    {
+        RETURN_HR(E_OUTOFMEMORY);
+    }
+
+    ZeroMemory(m_pUpload, sizeof(REQUEST_BODY_UPLOAD));
+    m_pUpload->cBuffers = cBuffers;
+
+    for (DWORD i = 0; i < m_pUpload->cBuffers; i++)
+    {
+        BYTE *pBuffer = sm_pResponseBufferPool->Alloc(ENTITY_BUFFER_SIZE,
+            m_pApplication->QueryCounters(),
+            APPLICATION_COUNTERS::MEMORY_TAG_RESPONSE_BUFFERS);
+        if (pBuffer == NULL)
+        {
+            RETURN_HR(E_OUTOFMEMORY);
+        }
+
+        m_pUpload->rgFreeBuffers[m_pUpload->cFreeBuffers++] = pBuffer;
+    }
+
+    return S_OK;
+}
+
+VOID
+FORWARDING_HANDLER::FreeUpload()
+{
+    if (m_pUpload == NULL)
+    {
+        return;
+    }
+
+    for (DWORD i = 0; i < m_pUpload->cFreeBuffers; i++)
+    {
+        sm_pResponseBufferPool->Free(m_pUpload->rgFreeBuffers[i]);
+    }
+
+    for (DWORD i = 0; i < m_pUpload->cPendingChunks; i++)
+    {
+        if (m_pUpload->rgPendingChunks[i].pBuffer != NULL)
+        {
+            sm_pResponseBufferPool->Free(m_pUpload->rgPendingChunks[i].pBuffer);
+        }
+    }
+
+    if (m_pUpload->pReadBuffer != NULL)
+    {
+        sm_pResponseBufferPool->Free(m_pUpload->pReadBuffer);
+    }
+
+    if (m_pUpload->pWriteBuffer != NULL)
+    {
+        sm_pResponseBufferPool->Free(m_pUpload->pWriteBuffer);
+    }
+
+    delete m_pUpload;
+    m_pUpload = NULL;
+}
+
+VOID
+FORWARDING_HANDLER::ReleaseWindowsAuthToken(
+    BOOL                        fConsumed
+)
+{
+    if (m_pWindowsAuthToken == NULL)
+    {
+        return;
+    }
+
+    //
+    // A disconnect is only seen while a request is in flight, the cache
+    // expires the handles of connections that closed between requests.
+    //
+    m_pServerProcess->ReleaseWindowsAuthToken(m_pWindowsAuthToken,
+                                              m_fClientDisconnected,
+                                              fConsumed);
+    m_pWindowsAuthToken = NULL;
+}
+
+HRESULT
+FORWARDING_HANDLER::UploadPostRead(
+    _Out_ BOOL *    pfClientError
+)
+{
+    DBG_ASSERT(m_pUpload != NULL);
+
+    if (m_pUpload->pReadBuffer != NULL ||
+        m_pUpload->fEndOfRequest ||
+        m_pUpload->cFreeBuffers == 0)
+    {
+        //
+        // A read is already posted, the body has been read entirely or every
+        // buffer is still queued for WinHTTP; the next write completion
+        // retries.
+        //
+        return S_OK;
+    }
+
+    if (m_BytesToReceive == 0)
+    {
+        m_pUpload->fEndOfRequest = TRUE;
+        return S_OK;
+    }
+
+    BYTE *pBuffer = m_pUpload->rgFreeBuffers[--m_pUpload->cFreeBuffers];
+    m_pUpload->pReadBuffer = pBuffer;
+    m_pUpload->fReadOutstanding = TRUE;
+
+    if (sm_pTraceLog != NULL)
+    {
+        sm_pTraceLog->Write(
+            m_cRefs,
+            this,
+            "Calling ReadEntityBody",
+            NULL,
+            NULL);
+    }
+    HRESULT hr = m_pW3Context->GetRequest()->ReadEntityBody(
+        pBuffer + 6,
+        min(m_BytesToReceive, BUFFER_SIZE),
+        TRUE,       // fAsync
+        NULL,       // pcbBytesReceived
+        NULL);      // pfCompletionPending
+    if (hr == HRESULT_FROM_WIN32(ERROR_HANDLE_EOF) || FAILED_LOG(hr))
+    {
+        //
+        // No completion is posted in either case.
+        //
+        m_pUpload->fReadOutstanding = FALSE;
+        m_pUpload->pReadBuffer = NULL;
+        m_pUpload->rgFreeBuffers[m_pUpload->cFreeBuffers++] = pBuffer;
+
+        if (hr != HRESULT_FROM_WIN32(ERROR_HANDLE_EOF))
+        {
+            *pfClientError = TRUE;
+            return hr;
+        }
+
+        DBG_ASSERT(m_BytesToReceive == 0 ||
+            m_BytesToReceive == INFINITE);
+
+        m_pUpload->fEndOfRequest = TRUE;
+        if (m_BytesToReceive == INFINITE)
+        {
+            m_BytesToReceive = 0;
+            m_pUpload->rgPendingChunks[m_pUpload->cPendingChunks++] = { NULL, 0, 5 };
+        }
+    }
+
+    return S_OK;
+}
+
+HRESULT
+FORWARDING_HANDLER::UploadWritePending()
+{
+    DBG_ASSERT(m_pUpload != NULL);
+
+    if (m_pUpload->fWriteOutstanding ||
+        m_pUpload->cPendingChunks == 0)
+    {
+        return S_OK;
+    }
+
+    //
+    // WinHTTP may complete the write on this thread, so the pipeline state
+    // has to be updated before the call.
+    //
+    const REQUEST_BODY_UPLOAD::PENDING_CHUNK chunk = m_pUpload->rgPendingChunks[0];
+    m_pUpload->cPendingChunks--;
+    MoveMemory(&m_pUpload->rgPendingChunks[0],
+        &m_pUpload->rgPendingChunks[1],
+        m_pUpload->cPendingChunks * sizeof(REQUEST_BODY_UPLOAD::PENDING_CHUNK));
+
+    m_pUpload->pWriteBuffer = chunk.pBuffer;
+    m_pUpload->fWriteOutstanding = TRUE;
+    m_cchLastSend = chunk.cbLength;
+
+    if (!WinHttpWriteData(m_hRequest,
+            chunk.pBuffer != NULL ? chunk.pBuffer + chunk.cbOffset : reinterpret_cast<const BYTE *>("0\r\n\r\n"),
+            chunk.cbLength,
+            NULL))
+    {
+        //
+        // The buffer is released with the rest of the ring.
+        //
+        m_pUpload->fWriteOutstanding = FALSE;
+        RETURN_LAST_ERROR();
+    }
+
+    return S_OK;
+}
+
+HRESULT
+FORWARDING_HANDLER::UploadContinue(
+    _Out_ BOOL *    pfClientError
+)
+{
+    DBG_ASSERT(m_pUpload != NULL);
+
+    RETURN_IF_FAILED(UploadPostRead(pfClientError));
+    RETURN_IF_FAILED(UploadWritePending());
+
+    //
+    // A write completing on this thread may already have moved on to the
+    // response.
+    //
+    if (m_RequestStatus == FORWARDER_SENDING_REQUEST &&
+        m_pUpload->fEndOfRequest &&
+        !m_pUpload->fReadOutstanding &&
+        !m_pUpload->fWriteOutstanding &&
+        m_pUpload->cPendingChunks == 0)
+    {
+        m_RequestStatus = FORWARDER_RECEIVING_RESPONSE;
+
+        m_fAwaitingResponseHeaders = TRUE;
+        RETURN_LAST_ERROR_IF(!WinHttpReceiveResponse(m_hRequest, NULL));
+    }
+
+    return S_OK;
+}
+
+HRESULT
+FORWARDING_HANDLER::OnUploadReadComplete(
+    DWORD           cbCompletion,
+    HRESULT         hrCompletionStatus,
+    _Out_ BOOL *    pfClientError
+)
+{
+    DBG_ASSERT(m_pUpload != NULL);
+    DBG_ASSERT(m_pUpload->pReadBuffer != NULL);
+    DBG_ASSERT(!m_pUpload->fReadOutstanding);
+
+    BYTE *pBuffer = m_pUpload->pReadBuffer;
+    m_pUpload->pReadBuffer = NULL;
+
+    if (hrCompletionStatus == HRESULT_FROM_WIN32(ERROR_HANDLE_EOF) ||
+        (SUCCEEDED(hrCompletionStatus) && cbCompletion == 0))
+    {
+        m_pUpload->rgFreeBuffers[m_pUpload->cFreeBuffers++] = pBuffer;
+        m_pUpload->fEndOfRequest = TRUE;
+
+        if (m_BytesToReceive == INFINITE)
+        {
+            m_BytesToReceive = 0;
+            m_pUpload->rgPendingChunks[m_pUpload->cPendingChunks++] = { NULL, 0, 5 };
+        }
+    }
+    else if (SUCCEEDED(hrCompletionStatus))
+    {
+        if (m_BytesToReceive == INFINITE)
+        {
+            HRESULT hr = CountChunkedRequestBody(cbCompletion);
+            if (FAILED(hr))
+            {
+                m_pUpload->rgFreeBuffers[m_pUpload->cFreeBuffers++] = pBuffer;
+                *pfClientError = TRUE;
+                return hr;
+            }
+        }
+
+        REQUEST_BODY_UPLOAD::PENDING_CHUNK *pChunk =
+            &m_pUpload->rgPendingChunks[m_pUpload->cPendingChunks++];
+        pChunk->pBuffer = pBuffer;
+
+        if (m_BytesToReceive != INFINITE)
+        {
+            m_BytesToReceive -= cbCompletion;
+            pChunk->cbOffset = 6;
+            pChunk->cbLength = cbCompletion;
+        }
+        else
+        {
+            pChunk->cbLength = FrameRequestBodyChunk(pBuffer, cbCompletion, &pChunk->cbOffset);
+        }
+    }
+    else
+    {
+        m_pUpload->rgFreeBuffers[m_pUpload->cFreeBuffers++] = pBuffer;
+        *pfClientError = TRUE;
+        RETURN_HR(hrCompletionStatus);
+    }
+
+    return UploadContinue(pfClientError);
+}
+
+HRESULT
+FORWARDING_HANDLER::OnUploadWriteComplete(
+    _Out_ BOOL *    pfClientError,
+    _Out_ BOOL *    pfAnotherCompletionExpected
+)
+{
+    DBG_ASSERT(m_pUpload != NULL);
+
+    //
+    // Also reached for WINHTTP_CALLBACK_STATUS_SENDREQUEST_COMPLETE, in which
+    // case no write was outstanding yet.
+    //
+    if (m_pUpload->fWriteOutstanding)
+    {
+        m_pUpload->fWriteOutstanding = FALSE;
+        if (m_pUpload->pWriteBuffer != NULL)
+        {
+            m_pUpload->rgFreeBuffers[m_pUpload->cFreeBuffers++] = m_pUpload->pWriteBuffer;
+            m_pUpload->pWriteBuffer = NULL;
+        }
+    }
+
+    //
+    // Either a request body read, the next write or the response is
+    // outstanding once this returns successfully.
+    //
+    *pfAnotherCompletionExpected = TRUE;
+
+    if (m_RequestStatus != FORWARDER_SENDING_REQUEST)
+    {
+        return S_OK;
+    }
+
+    return UploadContinue(pfClientError);
+}
+
+HRESULT
+FORWARDING_HANDLER::BeginSpoolRequestBody(
+    _Out_ BOOL *    pfSpooling
+)
+/*++
+
+Routine Description:
+
+    Start reading the request body into a BODY_SPOOL, before the
+    backend is asked for a connection.
+
+    A body with a Content-Length over requestBufferingMaxSize is streamed
+    as before, a chunked body is spooled until it turns out to be longer.
+
+--*/
+{
+    IHttpRequest           *pRequest = m_pW3Context->GetRequest();
+    REQUESTHANDLER_CONFIG  *pConfig = m_pApplication->QueryConfig();
+
+    *pfSpooling = FALSE;
+
+    PCSTR pszContentLength = pRequest->GetHeader(HttpHeaderContentLength);
+    if (pszContentLength != NULL)
+    {
+        const DWORD cbContentLength = atol(pszContentLength);
+        if (cbContentLength == 0 ||
+            cbContentLength > pConfig->QueryRequestBufferingMaxSize())
+        {
+            return S_OK;
+        }
+    }
+    else if (pRequest->GetHeader(HttpHeaderTransferEncoding) == NULL)
+    {
+        return S_OK;
+    }
+
+    //
+    // A chunked body is also rejected once over maxRequestBodySize.
+    //
+    DWORD cbMaxSize = pConfig->QueryRequestBufferingMaxSize();
+    if (pConfig->QueryMaxRequestBodySize() != 0)
+    {
+        cbMaxSize = min(cbMaxSize, pConfig->QueryMaxRequestBodySize());
+    }
+
+    m_pRequestSpool = new BODY_SPOOL(m_pW3Context,
+        pConfig->QueryRequestBufferingMemoryLimit(),
+        cbMaxSize);
+    if (m_pRequestSpool == NULL)
+    {
+        RETURN_HR(E_OUTOFMEMORY);
+    }
+
+    m_RequestStatus = FORWARDER_SPOOLING_REQUEST;
+    *pfSpooling = TRUE;
+
+    return S_OK;
+}
+
+REQUEST_NOTIFICATION_STATUS
+FORWARDING_HANDLER::SpoolRequestBody(
+    DWORD           cbCompletion,
+    HRESULT         hrCompletionStatus
+)
+/*++
+
+Routine Description:
+
+    Continue reading the request body into the spool, from a completion of
+    ReadEntityBody or of a write to the spool file.
+
+    Once the body is read the request is forwarded with a Content-Length,
+    the chunked encoding of the client is dropped, and the body is sent
+    from the spool.
+
+--*/
+{
+    HRESULT         hr = S_OK;
+    BOOL            fClientError = FALSE;
+    BOOL            fPending = FALSE;
+    BOOL            fEndOfRequest = FALSE;
+    BYTE *          pBuffer = NULL;
+    DWORD           cbBuffer = 0;
+    IHttpRequest   *pRequest = m_pW3Context->GetRequest();
+    IHttpResponse  *pResponse = m_pW3Context->GetResponse();
+    CHAR            szContentLength[16];
+
+    DBG_ASSERT(m_pRequestSpool != NULL);
+
+    if (m_pRequestSpool->QueryIoPending())
+    {
+        FAILURE_IF_FAILED(m_pRequestSpool->OnIoCompleted(NULL, NULL));
+    }
+    else if (hrCompletionStatus == HRESULT_FROM_WIN32(ERROR_HANDLE_EOF))
+    {
+        fEndOfRequest = TRUE;
+    }
+    else if (FAILED(hrCompletionStatus))
+    {
+        fClientError = TRUE;
+        FAILURE(hrCompletionStatus);
+    }
+    else
+    {
+        FAILURE_IF_FAILED(m_pRequestSpool->Append(cbCompletion, &fPending));
+        if (fPending)
+        {
+            return RQ_NOTIFICATION_PENDING;
+        }
+    }
+
+    if (!fEndOfRequest)
+    {
+        FAILURE_IF_FAILED(m_pRequestSpool->GetReadBuffer(&pBuffer, &cbBuffer));
+
+        hr = pRequest->ReadEntityBody(pBuffer,
+            cbBuffer,
+            TRUE,       // fAsync
+            NULL,       // pcbBytesReceived
+            NULL);      // pfCompletionPending
+        if (hr != HRESULT_FROM_WIN32(ERROR_HANDLE_EOF))
+        {
+            if (FAILED(hr))
+            {
+                fClientError = TRUE;
+                goto Failure;
+            }
+
+            //
+            // ReadEntityBody will post a completion to IIS.
+            //
+            return RQ_NOTIFICATION_PENDING;
+        }
+
+        hr = S_OK;
+    }
+
+    if (pRequest->GetHeader(HttpHeaderTransferEncoding) != NULL)
+    {
+        FAILURE_IF_FAILED(pRequest->DeleteHeader(HttpHeaderTransferEncoding));
+    }
+
+    _ultoa_s(m_pRequestSpool->QuerySize(), szContentLength, _countof(szContentLength), 10);
+    FAILURE_IF_FAILED(pRequest->SetHeader(HttpHeaderContentLength,
+        szContentLength,
+        static_cast<USHORT>(strlen(szContentLength)),
+        TRUE));
+
+    m_RequestStatus = FORWARDER_START;
+    return ExecuteRequestHandler();
+
+Failure:
+    m_RequestStatus = FORWARDER_DONE;
+
+    pResponse->DisableKernelCache();
+
+    if (hr == HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE))
+    {
+        pResponse->SetStatus(413, "Request Entity Too Large", 0, hr);
+    }
+    else if (fClientError)
+    {
+        pResponse->SetStatus(400, "Bad Request", 0, HRESULT_FROM_WIN32(WSAECONNRESET));
+    }
+    else
+    {
+        pResponse->SetStatus(500, "Internal Server Error", 0, hr);
+    }
+
+    return RQ_NOTIFICATION_FINISH_REQUEST;
+}
+
+HRESULT
+FORWARDING_HANDLER::BeginSpoolResponseBody()
+/*++
+
+Routine Description:
+
+    Decide from the response headers whether the response body is drained
+    into a BODY_SPOOL before it is sent, which frees the backend request
+    from a slow client.
+
+    Not for the streaming response mode, a body with a Content-Length over
+    responseSpoolingMaxSize, or a content type with a response buffering
+    policy or of a gRPC call, whose client reads it as it is produced.
+
+--*/
+{
+    REQUESTHANDLER_CONFIG  *pConfig = m_pApplication->QueryConfig();
+    IHttpResponse          *pResponse = m_pW3Context->GetResponse();
+    USHORT                  cchContentType = 0;
+
+    DBG_ASSERT(m_pResponseSpool == NULL);
+
+    if (pConfig->QueryResponseSpoolingMemoryLimit() == 0 ||
+        m_pReadAhead != NULL ||
+        m_cContentLength > pConfig->QueryResponseSpoolingMaxSize())
+    {
+        return S_OK;
+    }
+
+    PCSTR pszContentType = pResponse->GetHeader(HttpHeaderContentType, &cchContentType);
+    if (pszContentType != NULL &&
+        (pConfig->FindResponseBufferingPolicy(pszContentType, cchContentType) != NULL ||
+         (cchContentType >= sizeof("application/grpc") - 1 &&
+          _strnicmp(pszContentType, "application/grpc", sizeof("application/grpc") - 1) == 0)))
+    {
+        return S_OK;
+    }
+
+    m_pResponseSpool = new BODY_SPOOL(m_pW3Context,
+        pConfig->QueryResponseSpoolingMemoryLimit(),
+        pConfig->QueryResponseSpoolingMaxSize());
+    if (m_pResponseSpool == NULL)
+    {
+        RETURN_HR(E_OUTOFMEMORY);
+    }
+
+    return S_OK;
+}
+
+HRESULT
+FORWARDING_HANDLER::OnSpoolReceivingResponse()
+{
+    DWORD cbBuffer = 0;
+
+    DBG_ASSERT(m_pResponseSpool != NULL && !m_pResponseSpool->QueryIoPending());
+
+    RETURN_IF_FAILED(m_pResponseSpool->GetReadBuffer(&m_pResponseSpoolBuffer, &cbBuffer));
+
+    RETURN_LAST_ERROR_IF(!WinHttpReadData(m_hRequest,
+        m_pResponseSpoolBuffer,
+        cbBuffer,
+        NULL));
+
+    return S_OK;
+}
+
+HRESULT
+FORWARDING_HANDLER::OnSpoolReadComplete(
+    _In_ IHttpResponse *    pResponse,
+    DWORD                   cbRead,
+    _Out_ BOOL *            pfAnotherCompletionExpected
+)
+/*++
+
+Routine Description:
+
+    A read of the response body into the spool completed. The next read is
+    issued from AsyncCompletion, after the write to the spool file when
+    the bytes went there.
+
+    At the end of the response the whole body is handed to IIS and the
+    WinHTTP request is closed, IIS sends the body once the request
+    completes. A body that outgrows responseSpoolingMaxSize is flushed as
+    far as it was read and the rest is forwarded as usual.
+
+--*/
+{
+    HRESULT hr = S_OK;
+    BOOL    fPending = FALSE;
+
+    DBG_ASSERT(m_pResponseSpool != NULL);
+
+    *pfAnotherCompletionExpected = FALSE;
+
+    if (cbRead == 0)
+    {
+        if (m_cContentLength != 0)
+        {
+            RETURN_HR(HRESULT_FROM_WIN32(ERROR_WINHTTP_INVALID_SERVER_RESPONSE));
+        }
+
+        RETURN_IF_FAILED(m_pResponseSpool->WriteEntityChunks(pResponse));
+        m_fResponseSpoolSent = TRUE;
+
+        //
+        // Closing the handle releases the backend request, the final
+        // completion is posted once it is gone.
+        //
+        m_RequestStatus = FORWARDER_DONE;
+        return S_OK;
+    }
+
+    if (m_cContentLength != 0)
+    {
+        m_cContentLength -= cbRead;
+    }
+
+    AppendResponseCacheBody(m_pResponseSpoolBuffer, cbRead);
+
+    hr = m_pResponseSpool->Append(cbRead, &fPending);
+    if (hr == HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE))
+    {
+        //
+        // The read buffer belongs to the spool as well, it stays
+        // referenced by the response like the rest of it.
+        //
+        RETURN_IF_FAILED(m_pResponseSpool->WriteEntityChunks(pResponse));
+
+        HTTP_DATA_CHUNK Chunk;
+        Chunk.DataChunkType = HttpDataChunkFromMemory;
+        Chunk.FromMemory.pBuffer = m_pResponseSpoolBuffer;
+        Chunk.FromMemory.BufferLength = cbRead;
+        RETURN_IF_FAILED(pResponse->WriteEntityChunkByReference(&Chunk));
+
+        m_fResponseSpoolSent = TRUE;
+        m_fResponseFlushed = TRUE;
+        if (m_pSample != NULL)
+        {
+            m_pSample->cFlushes++;
+        }
+        RETURN_IF_FAILED(pResponse->Flush(TRUE,     // fAsync
+            TRUE,     // fMoreData
+            NULL));    // pcbSent
+
+        *pfAnotherCompletionExpected = TRUE;
+        return S_OK;
+    }
+
+    RETURN_IF_FAILED(hr);
+
+    //
+    // A write to the spool file posts its own completion.
+    //
+    *pfAnotherCompletionExpected = fPending;
+
+    return S_OK;
+}
+
+HRESULT
+FORWARDING_HANDLER::SendSpooledRequestBody(
+    _Out_ BOOL *    pfAnotherCompletionExpected
+)
+/*++
+
+Routine Description:
+
+    Send the next part of a spooled request body after the headers or the
+    previous part were sent. A part read from the spool file is sent from
+    AsyncCompletion once the read completes.
+
+--*/
+{
+    BYTE *  pData = NULL;
+    DWORD   cbData = 0;
+    BOOL    fPending = FALSE;
+
+    RETURN_IF_FAILED(m_pRequestSpool->Read(&pData, &cbData, &fPending));
+
+    *pfAnotherCompletionExpected = TRUE;
+
+    if (fPending)
+    {
+        return S_OK;
+    }
+
+    return WriteSpooledData(pData, cbData);
+}
+
+HRESULT
+FORWARDING_HANDLER::WriteSpooledData(
+    _In_reads_bytes_(cbData) BYTE * pData,
+    DWORD                   cbData
+)
+{
+    if (cbData == 0)
+    {
+        m_RequestStatus = FORWARDER_RECEIVING_RESPONSE;
+
+        m_fAwaitingResponseHeaders = TRUE;
+        RETURN_LAST_ERROR_IF(!WinHttpReceiveResponse(m_hRequest, NULL));
+        return S_OK;
+    }
+
+    m_cchLastSend = cbData;
+
+    RETURN_LAST_ERROR_IF(!WinHttpWriteData(m_hRequest,
+        pData,
+        cbData,
+        NULL));
+
+    return S_OK;
+}
+
+//
+// Scan one header line starting at pch for the terminating '\n', and record
+// the first ':' seen on the way. Both delimiters are looked for in the same
+// pass, 16 bytes at a time where SSE2 is available, instead of a strchr per
+// delimiter.
+//
+// Returns the '\n', or NULL if the line is not terminated before pchEnd.
+// *ppchColon is left untouched when the line has no ':'.
+//
+static
+PSTR
+ScanHeaderLine(
+    _In_ PSTR           pch,
+    _In_ PCSTR          pchEnd,
+    _Inout_ PSTR *      ppchColon
+)
+{
+#if defined(_M_IX86) || defined(_M_X64)
+    const __m128i xmmNewline = _mm_set1_epi8('\n');
+    const __m128i xmmColon = _mm_set1_epi8(':');
+
+    while (pchEnd - pch >= 16)
+    {
+        __m128i xmmChunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pch));
+        DWORD dwNewlineMask = _mm_movemask_epi8(_mm_cmpeq_epi8(xmmChunk, xmmNewline));
+        DWORD dwColonMask = _mm_movemask_epi8(_mm_cmpeq_epi8(xmmChunk, xmmColon));
+        DWORD dwBit;
+
+        if (*ppchColon == NULL && dwColonMask != 0)
+        {
+            //
+            // Only a ':' ahead of the '\n' belongs to this line.
+            //
+            if (dwNewlineMask != 0)
+            {
+                dwColonMask &= (dwNewlineMask & (0 - dwNewlineMask)) - 1;
+            }
+            if (_BitScanForward(&dwBit, dwColonMask))
+            {
+                *ppchColon = pch + dwBit;
+            }
+        }
+
+        if (_BitScanForward(&dwBit, dwNewlineMask))
+        {
+            return pch + dwBit;
+        }
+
+        pch += 16;
+    }
+#endif
+
+    for (; pch < pchEnd; pch++)
+    {
+        if (*pch == '\n')
+        {
+            return pch;
+        }
+        if (*pch == ':' && *ppchColon == NULL)
+        {
+            *ppchColon = pch;
+        }
+    }
+
+    return NULL;
+}
+
+HRESULT
+FORWARDING_HANDLER::SetStatusAndHeaders(
+    PSTR            pszHeaders,
+    DWORD           cchHeaders
+)
+/*++
+
+Routine Description:
+
+    Parse the raw status line and headers returned by WinHTTP and set them on
+    the IIS response.
+
+    The buffer belongs to the caller and is only scratch space, so names and
+    values are terminated in place and handed to IIS straight from the
+    buffer instead of being copied out first.
+
+--*/
+{
+    IHttpResponse * pResponse = m_pW3Context->GetResponse();
+    IHttpRequest *  pRequest = m_pW3Context->GetRequest();
+    PCSTR           pchHeadersEnd = pszHeaders + cchHeaders;
+    PSTR            pchLine;
+    PSTR            pchNewline;
+    PSTR            pchEndofHeaderValue;
+    BOOL            fServerHeaderPresent = FALSE;
+
+    _ASSERT(pszHeaders != NULL);
+
+    //
+    // The first line is the status line
+    //
+    PSTR pchStatus = strchr(pszHeaders, ' ');
+    if (pchStatus == NULL)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER);
+    }
+    while (*pchStatus == ' ')
+    {
+        pchStatus++;
+    }
+    USHORT uStatus = static_cast<USHORT>(atoi(pchStatus));
+
+    if (m_pServerProcess != NULL)
+    {
+        m_pServerProcess->RecordForwardResult(uStatus >= 500);
+    }
+
+    if (m_fWebSocketEnabled && uStatus != 101)
+    {
+        //
+        // Expected 101 response.
+        //
+
+        m_fWebSocketEnabled = FALSE;
+    }
+
+    pchStatus = strchr(pchStatus, ' ');
+    if (pchStatus == NULL)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER);
+    }
+    while (*pchStatus == ' ')
+    {
+        pchStatus++;
+    }
+    if (*pchStatus == '\r' || *pchStatus == '\n')
+    {
+        pchStatus--;
+    }
+
+    pchNewline = strchr(pchStatus, '\n');
+    if (pchNewline == NULL)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER);
+    }
+
+    if (uStatus != 200)
+    {
+        //
+        // Skip over any spaces before the '\n'
+        //
+        for (pchEndofHeaderValue = pchNewline - 1;
+            (pchEndofHeaderValue > pchStatus) &&
+            ((*pchEndofHeaderValue == ' ') ||
+            (*pchEndofHeaderValue == '\r'));
+            pchEndofHeaderValue--)
+        {
+        }
+
         //
-        // Find the ':' in Header : Value\r\n
+        // Terminate the status description in place
         //
-        PCSTR pchColon = strchr(pszHeaders + index, ':');
+        pchEndofHeaderValue[1] = '\0';
+        RETURN_IF_FAILED(pResponse->SetStatus(uStatus,
+                pchStatus,
+                0,
+                S_OK,
+                NULL,
+                TRUE));
+    }
 
+    for (pchLine = pchNewline + 1;
+        pchLine < pchHeadersEnd && *pchLine != '\r' && *pchLine != '\n' && *pchLine != '\0';
+        pchLine = pchNewline + 1)
+    {
         //
-        // Find the '\n' in Header : Value\r\n
+        // Find the ':' and the '\n' in Header : Value\r\n
         //
-        pchNewline = const_cast<PSTR>(strchr(pszHeaders + index, '\n'));
+        PSTR pchColon = NULL;
+        pchNewline = ScanHeaderLine(pchLine, pchHeadersEnd, &pchColon);
 
         if (pchNewline == NULL)
         {
@@ -2122,15 +4526,19 @@ FORWARDING_HANDLER::SetStatusAndHeaders(
         //
         // Take care of header continuation
         //
-        while (pchNewline[1] == ' ' ||
-            pchNewline[1] == '\t')
+        while (pchNewline + 1 < pchHeadersEnd &&
+            (pchNewline[1] == ' ' ||
+            pchNewline[1] == '\t'))
         {
-            pchNewline = strchr(pchNewline + 1, '\n');
+            pchNewline = ScanHeaderLine(pchNewline + 1, pchHeadersEnd, &pchColon);
+            if (pchNewline == NULL)
+            {
+                return HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER);
+            }
         }
 
-        DBG_ASSERT(
-            (pchColon != NULL) && (pchColon < pchNewline));
-        if ((pchColon == NULL) || (pchColon >= pchNewline))
+        DBG_ASSERT(pchColon != NULL);
+        if (pchColon == NULL)
         {
             return HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER);
         }
@@ -2138,9 +4546,9 @@ FORWARDING_HANDLER::SetStatusAndHeaders(
         //
         // Skip over any spaces before the ':'
         //
-        PCSTR pchEndofHeaderName;
+        PSTR pchEndofHeaderName;
         for (pchEndofHeaderName = pchColon - 1;
-            (pchEndofHeaderName >= pszHeaders + index) &&
+            (pchEndofHeaderName >= pchLine) &&
             (*pchEndofHeaderName == ' ');
             pchEndofHeaderName--)
         {
@@ -2148,19 +4556,13 @@ FORWARDING_HANDLER::SetStatusAndHeaders(
 
         pchEndofHeaderName++;
 
-        //
-        // Copy the header name
-        //
-        RETURN_IF_FAILED(strHeaderName.Copy(
-            pszHeaders + index,
-            (DWORD)(pchEndofHeaderName - pszHeaders) - index));
-
         //
         // Skip over the ':' and any trailing spaces
         //
-        for (index = static_cast<DWORD>(pchColon - pszHeaders) + 1;
-            pszHeaders[index] == ' ';
-            index++)
+        PSTR pchHeaderValue;
+        for (pchHeaderValue = pchColon + 1;
+            *pchHeaderValue == ' ';
+            pchHeaderValue++)
         {
         }
 
@@ -2168,7 +4570,7 @@ FORWARDING_HANDLER::SetStatusAndHeaders(
         // Skip over any spaces before the '\n'
         //
         for (pchEndofHeaderValue = pchNewline - 1;
-            (pchEndofHeaderValue >= pszHeaders + index) &&
+            (pchEndofHeaderValue >= pchHeaderValue) &&
             ((*pchEndofHeaderValue == ' ') ||
             (*pchEndofHeaderValue == '\r'));
             pchEndofHeaderValue--)
@@ -2178,29 +4580,32 @@ FORWARDING_HANDLER::SetStatusAndHeaders(
         pchEndofHeaderValue++;
 
         //
-        // Copy the header value
+        // Terminate the name and the value in place; pchNewline is already
+        // known so overwriting the delimiters does not affect the next line.
         //
-        if (pchEndofHeaderValue == pszHeaders + index)
-        {
-            strHeaderValue.Reset();
-        }
-        else
-        {
-            RETURN_IF_FAILED(strHeaderValue.Copy(
-                pszHeaders + index,
-                (DWORD)(pchEndofHeaderValue - pszHeaders) - index));
-        }
+        *pchEndofHeaderName = '\0';
+        *pchEndofHeaderValue = '\0';
+        USHORT cchHeaderValue = static_cast<USHORT>(pchEndofHeaderValue - pchHeaderValue);
 
         //
         // Do not pass the transfer-encoding:chunked, Connection, Date or
         // Server headers along
         //
-        DWORD headerIndex = sm_pResponseHeaderHash->GetIndex(strHeaderName.QueryStr());
+        DWORD headerIndex = RESPONSE_HEADER_HASH::GetIndex(pchLine,
+            static_cast<DWORD>(pchEndofHeaderName - pchLine));
         if (headerIndex == UNKNOWN_INDEX)
         {
-            RETURN_IF_FAILED(pResponse->SetHeader(strHeaderName.QueryStr(),
-                strHeaderValue.QueryStr(),
-                static_cast<USHORT>(strHeaderValue.QueryCCH()),
+            if (!m_fWebSocketEnabled &&
+                !m_pApplication->QueryConfig()->QuerySendFileRoot()->IsEmpty() &&
+                _stricmp(pchLine, "X-Sendfile") == 0)
+            {
+                RETURN_IF_FAILED(OpenSendFile(pchHeaderValue, cchHeaderValue));
+                continue;
+            }
+
+            RETURN_IF_FAILED(pResponse->SetHeader(pchLine,
+                pchHeaderValue,
+                cchHeaderValue,
                 FALSE)); // fReplace
         }
         else
@@ -2208,7 +4613,7 @@ FORWARDING_HANDLER::SetStatusAndHeaders(
             switch (headerIndex)
             {
             case HttpHeaderTransferEncoding:
-                if (!strHeaderValue.Equals("chunked", TRUE))
+                if (_stricmp(pchHeaderValue, "chunked") != 0)
                 {
                     break;
                 }
@@ -2225,203 +4630,916 @@ FORWARDING_HANDLER::SetStatusAndHeaders(
                 fServerHeaderPresent = TRUE;
                 break;
 
-            case HttpHeaderContentLength:
-                if (pRequest->GetRawHttpRequest()->Verb != HttpVerbHEAD)
-                {
-                    m_cContentLength = _atoi64(strHeaderValue.QueryStr());
-                }
-                break;
-            }
+            case HttpHeaderContentLength:
+                if (pRequest->GetRawHttpRequest()->Verb != HttpVerbHEAD)
+                {
+                    m_cContentLength = _atoi64(pchHeaderValue);
+                }
+                break;
+
+            case HttpHeaderContentType:
+                //
+                // The streaming response mode already flushes every read,
+                // only the buffered modes are tuned per content type.
+                //
+                if (m_pReadAhead == NULL && !m_fWebSocketEnabled)
+                {
+                    const RESPONSE_BUFFERING_POLICY *pPolicy =
+                        m_pApplication->QueryConfig()->FindResponseBufferingPolicy(pchHeaderValue, cchHeaderValue);
+                    if (pPolicy != NULL)
+                    {
+                        m_cMinBufferLimit = pPolicy->dwMinResponseBuffer;
+                        m_dwFlushIntervalInMS = pPolicy->dwFlushIntervalInMS;
+                        m_ullLastFlushTick = GetTickCount64();
+                    }
+                    else if (cchHeaderValue >= sizeof("application/grpc") - 1 &&
+                             _strnicmp(pchHeaderValue, "application/grpc", sizeof("application/grpc") - 1) == 0)
+                    {
+                        //
+                        // A streaming call is only as fast as its messages
+                        // reach the client, every read is sent as it
+                        // completes.
+                        //
+                        m_cMinBufferLimit = 0;
+                        m_dwFlushIntervalInMS = 0;
+                    }
+                }
+                break;
+            }
+
+            RETURN_IF_FAILED(pResponse->SetHeader(static_cast<HTTP_HEADER_ID>(headerIndex),
+                pchHeaderValue,
+                cchHeaderValue,
+                TRUE)); // fReplace
+        }
+    }
+
+    //
+    // Explicitly remove the Server header if the back-end didn't set one.
+    //
+
+    if (!fServerHeaderPresent)
+    {
+        pResponse->DeleteHeader("Server");
+    }
+
+    if (m_fDoReverseRewriteHeaders)
+    {
+        RETURN_IF_FAILED(DoReverseRewrite(pResponse));
+    }
+
+    m_fResponseHeadersReceivedAndSet = TRUE;
+
+    return S_OK;
+}
+
+HRESULT
+FORWARDING_HANDLER::OpenSendFile(
+    _In_ PCSTR      pszPath,
+    USHORT          cchPath
+)
+/*++
+
+Routine Description:
+
+    Resolve the path the backend asked to have sent and open it through the
+    IIS file cache, which keeps the handle open for the following requests
+    and closes it when the file changes.
+
+    A relative path names a file under sendFileRoot, any other has to be
+    fully qualified: one rooted on the current drive ("\files\a") or
+    relative to the current folder of a drive ("C:a") would depend on the
+    current directory of the worker process.
+
+    Only the application is trusted to name files, the path is turned into
+    a full one before it is compared with sendFileRoot so that '..' can't
+    lead out of it. The file is opened as the worker process, once open its
+    final path is checked as well so that a junction or a symbolic link
+    under sendFileRoot can't either.
+
+--*/
+{
+    REQUESTHANDLER_CONFIG * pConfig = m_pApplication->QueryConfig();
+    const STRU *    pstruRoot = pConfig->QuerySendFileRoot();
+    const STRU *    pstruFinalRoot = pConfig->QuerySendFileFinalRoot();
+    STACK_STRU(struPath, MAX_PATH);
+    STACK_STRU(struFullPath, MAX_PATH);
+    STACK_STRU(struFinalPath, MAX_PATH);
+
+    if (m_pSendFileInfo != NULL)
+    {
+        // Sent more than once.
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_WINHTTP_INVALID_SERVER_RESPONSE));
+    }
+
+    if ((cchPath >= 2 && IS_SEND_FILE_SEPARATOR(pszPath[0]) && IS_SEND_FILE_SEPARATOR(pszPath[1])) ||
+        (cchPath >= 3 && isalpha(static_cast<UCHAR>(pszPath[0])) && pszPath[1] == ':' && IS_SEND_FILE_SEPARATOR(pszPath[2])))
+    {
+        RETURN_IF_FAILED(struPath.CopyA(pszPath, cchPath));
+    }
+    else if (cchPath != 0 && !IS_SEND_FILE_SEPARATOR(pszPath[0]) && memchr(pszPath, ':', cchPath) == NULL)
+    {
+        RETURN_IF_FAILED(struPath.Copy(*pstruRoot));
+        RETURN_IF_FAILED(struPath.AppendA(pszPath, cchPath));
+    }
+    else
+    {
+        LOG_WARNF(L"The backend asked to send '%.*S', which is neither fully qualified nor relative to the sendFileRoot",
+            static_cast<int>(cchPath),
+            pszPath);
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_ACCESS_DENIED));
+    }
+
+    RETURN_IF_FAILED(FILE_UTILITY::GetFullPath(struPath.QueryStr(), &struFullPath));
+
+    //
+    // Both roots end with a separator, C:\files\ doesn't let C:\files2 in.
+    //
+    if (struFullPath.QueryCCH() <= pstruRoot->QueryCCH() ||
+        _wcsnicmp(struFullPath.QueryStr(), pstruRoot->QueryStr(), pstruRoot->QueryCCH()) != 0)
+    {
+        LOG_WARNF(L"The backend asked to send '%ls', which is outside of the sendFileRoot '%ls'",
+            struFullPath.QueryStr(),
+            pstruRoot->QueryStr());
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_ACCESS_DENIED));
+    }
+
+    RETURN_IF_FAILED(g_pHttpServer->GetFileInfo(struFullPath.QueryStr(),
+        NULL,   // hUserToken, opened as the worker process
+        NULL,   // pSid
+        NULL,   // pszChangeNotificationPath
+        NULL,   // hChangeNotificationToken
+        TRUE,   // fCache
+        &m_pSendFileInfo,
+        m_pW3Context->GetTraceContext()));
+
+    if (m_pSendFileInfo->GetAttributes() & FILE_ATTRIBUTE_DIRECTORY)
+    {
+        m_pSendFileInfo->DereferenceFileInfo();
+        m_pSendFileInfo = NULL;
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_ACCESS_DENIED));
+    }
+
+    RETURN_IF_FAILED(FILE_UTILITY::GetFinalPath(m_pSendFileInfo->GetFileHandle(), &struFinalPath));
+    if (struFinalPath.QueryCCH() <= pstruFinalRoot->QueryCCH() ||
+        _wcsnicmp(struFinalPath.QueryStr(), pstruFinalRoot->QueryStr(), pstruFinalRoot->QueryCCH()) != 0)
+    {
+        LOG_WARNF(L"The backend asked to send '%ls', which resolves to '%ls' outside of the sendFileRoot '%ls'",
+            struFullPath.QueryStr(),
+            struFinalPath.QueryStr(),
+            pstruFinalRoot->QueryStr());
+        m_pSendFileInfo->DereferenceFileInfo();
+        m_pSendFileInfo = NULL;
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_ACCESS_DENIED));
+    }
+
+    return S_OK;
+}
+
+HRESULT
+FORWARDING_HANDLER::SetSendFileResponse(
+)
+{
+    IHttpResponse * pResponse = m_pW3Context->GetResponse();
+    ULARGE_INTEGER  liFileSize;
+    CHAR            szContentLength[32];
+
+    DBG_ASSERT(m_pSendFileInfo != NULL);
+
+    m_pSendFileInfo->GetSize(&liFileSize);
+    m_cContentLength = 0;
+
+    //
+    // The headers the backend set about its own body don't describe the
+    // file. Ranges aren't served from it, the whole file is sent.
+    //
+    RETURN_IF_FAILED(pResponse->DeleteHeader(HttpHeaderContentEncoding));
+    RETURN_IF_FAILED(pResponse->DeleteHeader(HttpHeaderTransferEncoding));
+    RETURN_IF_FAILED(pResponse->DeleteHeader(HttpHeaderContentRange));
+    RETURN_IF_FAILED(pResponse->DeleteHeader(HttpHeaderAcceptRanges));
+    RETURN_IF_FAILED(pResponse->DeleteHeader(HttpHeaderEtag));
+
+    USHORT usStatusCode = 0;
+    pResponse->GetStatus(&usStatusCode);
+    if (usStatusCode == 206)
+    {
+        RETURN_IF_FAILED(pResponse->SetStatus(200, "OK"));
+    }
+
+    if (_ui64toa_s(liFileSize.QuadPart, szContentLength, sizeof(szContentLength), 10) != 0)
+    {
+        RETURN_HR(E_INVALIDARG);
+    }
+
+    RETURN_IF_FAILED(pResponse->SetHeader(HttpHeaderContentLength,
+        szContentLength,
+        static_cast<USHORT>(strlen(szContentLength)),
+        TRUE)); // fReplace
+
+    if (m_pW3Context->GetRequest()->GetRawHttpRequest()->Verb == HttpVerbHEAD ||
+        liFileSize.QuadPart == 0)
+    {
+        return S_OK;
+    }
+
+    HTTP_DATA_CHUNK chunk;
+    chunk.DataChunkType = HttpDataChunkFromFileHandle;
+    chunk.FromFileHandle.ByteRange.StartingOffset.QuadPart = 0;
+    chunk.FromFileHandle.ByteRange.Length.QuadPart = liFileSize.QuadPart;
+    chunk.FromFileHandle.FileHandle = m_pSendFileInfo->GetFileHandle();
+
+    RETURN_IF_FAILED(pResponse->WriteEntityChunkByReference(&chunk));
+
+    return S_OK;
+}
+
+VOID
+FORWARDING_HANDLER::BeginResponseCacheFill(
+)
+{
+    RESPONSE_CACHE *pCache = m_pApplication->QueryResponseCache();
+    STACK_STRA(strKey, 256);
+
+    DBG_ASSERT(m_pCacheEntry == NULL);
+
+    if (pCache == NULL ||
+        !RESPONSE_CACHE::IsCacheableRequest(m_pW3Context) ||
+        FAILED_LOG(RESPONSE_CACHE::BuildKey(m_pW3Context->GetRequest(), &strKey)))
+    {
+        EndResponseCacheFill();
+        return;
+    }
+
+    //
+    // The response is forwarded all the same when the entry can't be made.
+    //
+    LOG_IF_FAILED(RESPONSE_CACHE_ENTRY::Create(m_pW3Context->GetRequest(),
+        m_pW3Context->GetResponse(),
+        strKey,
+        pCache->QueryMaxEntrySize(),
+        &m_pCacheEntry));
+    if (m_pCacheEntry == NULL)
+    {
+        EndResponseCacheFill();
+    }
+}
+
+VOID
+FORWARDING_HANDLER::AppendResponseCacheBody(
+    _In_reads_bytes_(cbData) const BYTE *   pbData,
+    DWORD                                   cbData
+)
+{
+    if (m_pCacheEntry != NULL && !m_pCacheEntry->AppendBody(pbData, cbData))
+    {
+        m_pCacheEntry->Dereference();
+        m_pCacheEntry = NULL;
+        EndResponseCacheFill();
+    }
+}
+
+VOID
+FORWARDING_HANDLER::CompleteResponseCacheFill(
+)
+{
+    if (m_pCacheEntry == NULL)
+    {
+        return;
+    }
+
+    m_pApplication->QueryResponseCache()->Insert(m_pCacheEntry);
+    m_pCacheEntry->Dereference();
+    m_pCacheEntry = NULL;
+
+    EndResponseCacheFill();
+}
+
+BOOL
+FORWARDING_HANDLER::TryCoalesceCacheableRequest(
+    _Out_ REQUEST_NOTIFICATION_STATUS * pRetVal
+)
+{
+    RESPONSE_CACHE *        pCache = m_pApplication->QueryResponseCache();
+    IHttpResponse *         pResponse = m_pW3Context->GetResponse();
+    RESPONSE_CACHE_ENTRY *  pEntry = NULL;
+    STACK_STRA(strKey, 256);
+
+    //
+    // Only on the first execution, or the one resuming from the wait.
+    //
+    if (pCache == NULL ||
+        m_fWaitedForProcess ||
+        m_fRequestRetried ||
+        m_pCacheFill != NULL ||
+        !RESPONSE_CACHE::IsCacheableRequest(m_pW3Context) ||
+        FAILED_LOG(RESPONSE_CACHE::BuildKey(m_pW3Context->GetRequest(), &strKey)))
+    {
+        return FALSE;
+    }
+
+    if (m_fWaitedForCacheFill)
+    {
+        //
+        // A miss now means the response was not cacheable, the waiters go
+        // to the backend each rather than queue up again.
+        //
+        pEntry = pCache->Lookup(m_pW3Context->GetRequest(), strKey);
+    }
+    else
+    {
+        HRESULT hr = pCache->JoinFill(m_pW3Context->GetRequest(), strKey, this, &pEntry, &m_pCacheFill);
+        if (hr == HRESULT_FROM_WIN32(ERROR_IO_PENDING))
+        {
+            m_RequestStatus = FORWARDER_WAITING_FOR_CACHE_FILL;
+            *pRetVal = RQ_NOTIFICATION_PENDING;
+            return TRUE;
+        }
+        LOG_IF_FAILED(hr);
+    }
+
+    if (pEntry == NULL)
+    {
+        return FALSE;
+    }
+
+    //
+    // Kept until the handler goes away, IIS references the body.
+    //
+    DBG_ASSERT(m_pCacheEntry == NULL);
+    m_pCacheEntry = pEntry;
+    m_RequestStatus = FORWARDER_DONE;
+
+    if (FAILED_LOG(pEntry->WriteResponse(pResponse)))
+    {
+        pResponse->Clear();
+        pResponse->SetStatus(500, "Internal Server Error");
+    }
+
+    *pRetVal = RQ_NOTIFICATION_FINISH_REQUEST;
+    return TRUE;
+}
+
+VOID
+FORWARDING_HANDLER::EndResponseCacheFill(
+)
+{
+    if (m_pCacheFill != NULL)
+    {
+        m_pApplication->QueryResponseCache()->EndFill(m_pCacheFill);
+        m_pCacheFill = NULL;
+    }
+}
+
+HRESULT
+FORWARDING_HANDLER::DoReverseRewrite(
+    _In_ IHttpResponse *pResponse
+)
+/*++
+
+Routine Description:
+
+Point the URLs and cookie domains of the backend response back at the
+host the client used. Headers are matched in place and only a header that
+actually changes is copied.
+
+--*/
+{
+    DBG_ASSERT(pResponse == m_pW3Context->GetResponse());
+    BOOL fSecure = (m_pW3Context->GetRequest()->GetRawHttpRequest()->pSslInfo != NULL);
+    HTTP_RESPONSE_HEADERS *pHeaders;
+
+    if (m_pCold == NULL || m_pCold->pszOriginalHostHeader == NULL)
+    {
+        return S_OK;
+    }
+
+    //
+    // Content-Location and Location are easy, one known header in
+    // http[s]://host/url format
+    //
+    RETURN_IF_FAILED(ReverseRewriteUrlHeader(pResponse, HttpHeaderContentLocation, fSecure));
+    RETURN_IF_FAILED(ReverseRewriteUrlHeader(pResponse, HttpHeaderLocation, fSecure));
+
+    //
+    // Set-Cookie is different - possibly multiple unknown headers with
+    // syntax name=value ; ... ; Domain=.host ; ...
+    //
+    pHeaders = &pResponse->GetRawHttpResponse()->Headers;
+    for (DWORD i = 0; i<pHeaders->UnknownHeaderCount; i++)
+    {
+        if (pHeaders->pUnknownHeaders[i].NameLength != 10 ||
+            _strnicmp(pHeaders->pUnknownHeaders[i].pName, "Set-Cookie", 10) != 0)
+        {
+            continue;
+        }
+
+        RETURN_IF_FAILED(ReverseRewriteCookieDomain(&pHeaders->pUnknownHeaders[i]));
+    }
 
-            RETURN_IF_FAILED(pResponse->SetHeader(static_cast<HTTP_HEADER_ID>(headerIndex),
-                strHeaderValue.QueryStr(),
-                static_cast<USHORT>(strHeaderValue.QueryCCH()),
-                TRUE)); // fReplace
-        }
+    return S_OK;
+}
+
+HRESULT
+FORWARDING_HANDLER::ReverseRewriteUrlHeader(
+    _In_ IHttpResponse *        pResponse,
+    HTTP_HEADER_ID              headerId,
+    BOOL                        fSecure
+)
+{
+    USHORT  cchHeader = 0;
+    PCSTR   pszHeader = pResponse->GetHeader(headerId, &cchHeader);
+    PCSTR   pszStartHost;
+    PCSTR   pszEndHost;
+    PCSTR   pszScheme = fSecure ? "https://" : "http://";
+    SIZE_T  cchScheme = fSecure ? 8 : 7;
+
+    if (pszHeader == NULL)
+    {
+        return S_OK;
     }
 
-    //
-    // Explicitly remove the Server header if the back-end didn't set one.
-    //
+    if (cchHeader >= 7 && _strnicmp(pszHeader, "http://", 7) == 0)
+    {
+        pszStartHost = pszHeader + 7;
+    }
+    else if (cchHeader >= 8 && _strnicmp(pszHeader, "https://", 8) == 0)
+    {
+        pszStartHost = pszHeader + 8;
+    }
+    else
+    {
+        return S_OK;
+    }
 
-    if (!fServerHeaderPresent)
+    PCSTR pszEnd = pszHeader + cchHeader;
+    pszEndHost = static_cast<PCSTR>(memchr(pszStartHost, '/', pszEnd - pszStartHost));
+    if (pszEndHost == NULL)
     {
-        pResponse->DeleteHeader("Server");
+        pszEndHost = pszEnd;
     }
 
-    if (m_fDoReverseRewriteHeaders)
+    //
+    // The backend already used the client's scheme and host.
+    //
+    if (static_cast<SIZE_T>(pszStartHost - pszHeader) == cchScheme &&
+        pszEndHost - pszStartHost == m_pCold->cchOriginalHostHeader &&
+        _strnicmp(pszHeader, pszScheme, cchScheme) == 0 &&
+        _strnicmp(pszStartHost, m_pCold->pszOriginalHostHeader, m_pCold->cchOriginalHostHeader) == 0)
     {
-        RETURN_IF_FAILED(DoReverseRewrite(pResponse));
+        return S_OK;
     }
 
-    m_fResponseHeadersReceivedAndSet = TRUE;
+    ARENA_STRA(strTemp, 256, &m_Arena);
+    RETURN_IF_FAILED(strTemp.Copy(pszScheme, cchScheme));
+    RETURN_IF_FAILED(strTemp.Append(m_pCold->pszOriginalHostHeader, m_pCold->cchOriginalHostHeader));
+    RETURN_IF_FAILED(strTemp.Append(pszEndHost, pszEnd - pszEndHost));
+
+    RETURN_IF_FAILED(pResponse->SetHeader(headerId,
+        strTemp.QueryStr(),
+        static_cast<USHORT>(strTemp.QueryCCH()),
+        TRUE));
 
     return S_OK;
 }
 
 HRESULT
-FORWARDING_HANDLER::DoReverseRewrite(
-    _In_ IHttpResponse *pResponse
+FORWARDING_HANDLER::ReverseRewriteCookieDomain(
+    _Inout_ HTTP_UNKNOWN_HEADER *   pHeader
 )
 {
-    DBG_ASSERT(pResponse == m_pW3Context->GetResponse());
-    BOOL fSecure = (m_pW3Context->GetRequest()->GetRawHttpRequest()->pSslInfo != NULL);
-    STRA strTemp;
-    PCSTR pszHeader;
+    PCSTR pszValue = pHeader->pRawValue;
+    PCSTR pszEnd = pszValue + pHeader->RawValueLength;
     PCSTR pszStartHost;
     PCSTR pszEndHost;
-    HTTP_RESPONSE_HEADERS *pHeaders;
+    PSTR  pszNewValue;
+    SIZE_T cchNewValue;
 
-    //
-    // Content-Location and Location are easy, one known header in
-    // http[s]://host/url format
-    //
-    pszHeader = pResponse->GetHeader(HttpHeaderContentLocation);
-    if (pszHeader != NULL)
+    pszStartHost = static_cast<PCSTR>(memchr(pszValue, ';', pHeader->RawValueLength));
+    while (pszStartHost != NULL)
     {
-        if (_strnicmp(pszHeader, "http://", 7) == 0)
+        pszStartHost++;
+        while (pszStartHost < pszEnd && IsSpace(*pszStartHost))
         {
-            pszStartHost = pszHeader + 7;
+            pszStartHost++;
         }
-        else if (_strnicmp(pszHeader, "https://", 8) == 0)
+
+        if (pszEnd - pszStartHost < 6 ||
+            _strnicmp(pszStartHost, "Domain", 6) != 0)
         {
-            pszStartHost = pszHeader + 8;
+            pszStartHost = static_cast<PCSTR>(memchr(pszStartHost, ';', pszEnd - pszStartHost));
+            continue;
         }
-        else
+        pszStartHost += 6;
+
+        while (pszStartHost < pszEnd && IsSpace(*pszStartHost))
+        {
+            pszStartHost++;
+        }
+        if (pszStartHost == pszEnd || *pszStartHost != '=')
+        {
+            break;
+        }
+        pszStartHost++;
+        while (pszStartHost < pszEnd && IsSpace(*pszStartHost))
+        {
+            pszStartHost++;
+        }
+        if (pszStartHost < pszEnd && *pszStartHost == '.')
+        {
+            pszStartHost++;
+        }
+        pszEndHost = pszStartHost;
+        while (pszEndHost < pszEnd &&
+            !IsSpace(*pszEndHost) &&
+            *pszEndHost != ';')
         {
-            goto Location;
+            pszEndHost++;
         }
 
-        pszEndHost = strchr(pszStartHost, '/');
+        if (pszEndHost - pszStartHost == m_pCold->cchOriginalHostHeader &&
+            _strnicmp(pszStartHost, m_pCold->pszOriginalHostHeader, m_pCold->cchOriginalHostHeader) == 0)
+        {
+            return S_OK;
+        }
 
-        RETURN_IF_FAILED(strTemp.Copy(fSecure ? "https://" : "http://"));
-        RETURN_IF_FAILED(strTemp.Append(m_pszOriginalHostHeader));
+        //
+        // The new value lives as long as the response, so it is built
+        // straight into request memory.
+        //
+        cchNewValue = (pszStartHost - pszValue) + m_pCold->cchOriginalHostHeader + (pszEnd - pszEndHost);
+        if (cchNewValue > MAXUSHORT)
+        {
+            RETURN_HR(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+        }
 
-        if (pszEndHost != NULL)
+        pszNewValue = static_cast<PSTR>(m_pW3Context->AllocateRequestMemory(static_cast<DWORD>(cchNewValue + 1)));
+        if (pszNewValue == NULL)
         {
-            RETURN_IF_FAILED(strTemp.Append(pszEndHost));
+            RETURN_HR(E_OUTOFMEMORY);
         }
-        RETURN_IF_FAILED(pResponse->SetHeader(HttpHeaderContentLocation,
-            strTemp.QueryStr(),
-            static_cast<USHORT>(strTemp.QueryCCH()),
-            TRUE));
+
+        PSTR pch = pszNewValue;
+        memcpy(pch, pszValue, pszStartHost - pszValue);
+        pch += pszStartHost - pszValue;
+        memcpy(pch, m_pCold->pszOriginalHostHeader, m_pCold->cchOriginalHostHeader);
+        pch += m_pCold->cchOriginalHostHeader;
+        memcpy(pch, pszEndHost, pszEnd - pszEndHost);
+        pszNewValue[cchNewValue] = '\0';
+
+        pHeader->pRawValue = pszNewValue;
+        pHeader->RawValueLength = static_cast<USHORT>(cchNewValue);
+        break;
     }
 
-Location:
+    return S_OK;
+}
+
+VOID
+FORWARDING_HANDLER::RemoveRequest(
+    VOID
+)
+{
+    m_fReactToDisconnect = FALSE;
+}
+
+BOOL
+FORWARDING_HANDLER::CanRetryRequest(
+    HRESULT                 hr
+) const
+/*++
+
+Routine Description:
+
+Whether a failed WinHTTP request can be sent again to a backend process:
+the failure must be a connection failure, the request must still have
+retries left and nothing of the response may have reached the client.
+
+A connection lost once the request was sent may have lost it after the
+backend ran it, so only a safe method is sent again then. PUT and DELETE
+are idempotent but the backend may be in the middle of them.
 
-    pszHeader = pResponse->GetHeader(HttpHeaderLocation);
-    if (pszHeader != NULL)
+--*/
+{
+    if (hr == HRESULT_FROM_WIN32(ERROR_WINHTTP_CONNECTION_ERROR))
     {
-        if (_strnicmp(pszHeader, "http://", 7) == 0)
+        if (m_RequestStatus == FORWARDER_RECEIVING_RESPONSE &&
+            !IsSafeVerb(m_pW3Context->GetRequest()->GetRawHttpRequest()->Verb))
         {
-            pszStartHost = pszHeader + 7;
-        }
-        else if (_strnicmp(pszHeader, "https://", 8) == 0)
-        {
-            pszStartHost = pszHeader + 8;
-        }
-        else
-        {
-            goto SetCookie;
+            return FALSE;
         }
+    }
+    else if (hr != HRESULT_FROM_WIN32(ERROR_WINHTTP_CANNOT_CONNECT))
+    {
+        return FALSE;
+    }
 
-        pszEndHost = strchr(pszStartHost, '/');
+    return m_cRetriesLeft > 0 &&
+        (m_RequestStatus == FORWARDER_SENDING_REQUEST ||
+            m_RequestStatus == FORWARDER_RECEIVING_RESPONSE) &&
+        !m_fResponseHeadersReceivedAndSet &&
+        !m_fClientDisconnected &&
+        !m_fHasError &&
+        m_hRequest != NULL &&
+        !m_fHttpHandleInClose;
+}
+
+VOID
+FORWARDING_HANDLER::BeginRetryRequest()
+{
+    DBG_ASSERT(m_cRetriesLeft > 0);
+
+    LOG_TRACEF(L"FORWARDING_HANDLER::BeginRetryRequest, %d retries left --%p\n", m_cRetriesLeft, m_pW3Context);
+
+    m_cRetriesLeft--;
+    m_RequestStatus = FORWARDER_RETRYING_REQUEST;
+
+    m_fHttpHandleInClose = TRUE;
+    WinHttpCloseHandle(m_hRequest);
+    m_hRequest = NULL;
+}
+
+HRESULT
+FORWARDING_HANDLER::RetryRequest()
+/*++
+
+Routine Description:
+
+Send the request again after BeginRetryRequest closed the handle of the
+failed attempt. The routing policy is asked for another process, so with
+processesPerApplication > 1 a backend that went away is usually skipped.
+
+--*/
+{
+    HRESULT             hr = S_OK;
+    IHttpRequest       *pRequest = m_pW3Context->GetRequest();
+    PROTOCOL_CONFIG    *pProtocol = &sm_ProtocolConfig;
+    SERVER_PROCESS     *pServerProcess = NULL;
+    PCWSTR              pszEscapedUrl = NULL;
+
+    ARENA_STRU(struEscapedUrl, 2048, &m_Arena);
+
+    DBG_ASSERT(m_RequestStatus == FORWARDER_RETRYING_REQUEST);
+    DBG_ASSERT(m_hRequest == NULL);
+    DBG_ASSERT(m_dwHandlers == 0);
+
+    RETURN_IF_FAILED(m_pApplication->GetProcess(&pServerProcess));
+    if (pServerProcess == NULL)
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_CREATE_FAILED));
+    }
 
-        RETURN_IF_FAILED(strTemp.Copy(fSecure ? "https://" : "http://"));
-        RETURN_IF_FAILED(strTemp.Append(m_pszOriginalHostHeader));
+    if (pServerProcess == m_pServerProcess)
+    {
+        //
+        // The failed process may not have been noticed as gone yet, give
+        // the routing policy one more pick.
+        //
+        pServerProcess->DereferenceServerProcess();
+        pServerProcess = NULL;
 
-        if (pszEndHost != NULL)
+        RETURN_IF_FAILED(m_pApplication->GetProcess(&pServerProcess));
+        if (pServerProcess == NULL)
         {
-            RETURN_IF_FAILED(strTemp.Append(pszEndHost));
+            RETURN_HR(HRESULT_FROM_WIN32(ERROR_CREATE_FAILED));
         }
-        RETURN_IF_FAILED(pResponse->SetHeader(HttpHeaderLocation,
-            strTemp.QueryStr(),
-            static_cast<USHORT>(strTemp.QueryCCH()),
-            TRUE));
     }
 
-SetCookie:
+    // The failed attempt may not have reached the backend.
+    ReleaseWindowsAuthToken(FALSE);
+
+    m_pServerProcess->DecrementOutstandingRequests();
+    m_pServerProcess->DereferenceServerProcess();
+    m_pServerProcess = pServerProcess;
+    m_pServerProcess->IncrementOutstandingRequests();
+
+    if (pServerProcess->QueryWinHttpConnection(m_fPriorityRequest) == NULL)
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_INVALID_HANDLE));
+    }
+
+    RETURN_IF_FAILED(URL_UTILITY::EscapeAbsPath(pRequest, &struEscapedUrl, &pszEscapedUrl));
+
+    m_fRequestRetried = TRUE;
+    m_fHttpHandleInClose = FALSE;
 
     //
-    // Set-Cookie is different - possibly multiple unknown headers with
-    // syntax name=value ; ... ; Domain=.host ; ...
+    // Count the new handle before opening it, its closing callback brings
+    // the count back to zero.
     //
-    pHeaders = &pResponse->GetRawHttpResponse()->Headers;
-    for (DWORD i = 0; i<pHeaders->UnknownHeaderCount; i++)
+    InterlockedIncrement(&m_dwHandlers);
+
+    hr = CreateWinHttpRequest(pRequest,
+        pProtocol,
+        pServerProcess->QueryWinHttpConnection(m_fPriorityRequest)->QueryHandle(),
+        pszEscapedUrl,
+        pServerProcess);
+    if (FAILED_LOG(hr))
     {
-        if (_stricmp(pHeaders->pUnknownHeaders[i].pName, "Set-Cookie") != 0)
+        if (m_hRequest == NULL)
         {
-            continue;
+            InterlockedDecrement(&m_dwHandlers);
         }
+        return hr;
+    }
 
-        pszHeader = pHeaders->pUnknownHeaders[i].pRawValue;
-        pszStartHost = strchr(pszHeader, ';');
-        while (pszStartHost != NULL)
-        {
-            pszStartHost++;
-            while (IsSpace(*pszStartHost))
-            {
-                pszStartHost++;
-            }
+    m_RequestStatus = FORWARDER_SENDING_REQUEST;
+    m_cchLastSend = m_cchHeaders;
 
-            if (_strnicmp(pszStartHost, "Domain", 6) != 0)
-            {
-                pszStartHost = strchr(pszStartHost, ';');
-                continue;
-            }
-            pszStartHost += 6;
+    RETURN_LAST_ERROR_IF(!WinHttpSendRequest(m_hRequest,
+        m_pszHeaders,
+        m_pszHeaders != NULL ? m_cchHeaders : 0,
+        NULL,
+        0,
+        0,
+        reinterpret_cast<DWORD_PTR>(static_cast<PVOID>(this))));
 
-            while (IsSpace(*pszStartHost))
-            {
-                pszStartHost++;
-            }
-            if (*pszStartHost != '=')
-            {
-                break;
-            }
-            pszStartHost++;
-            while (IsSpace(*pszStartHost))
-            {
-                pszStartHost++;
-            }
-            if (*pszStartHost == '.')
-            {
-                pszStartHost++;
-            }
-            pszEndHost = pszStartHost;
-            while (!IsSpace(*pszEndHost) &&
-                *pszEndHost != ';' &&
-                *pszEndHost != '\0')
-            {
-                pszEndHost++;
-            }
+    return S_OK;
+}
 
-            RETURN_IF_FAILED(strTemp.Copy(pszHeader, static_cast<DWORD>(pszStartHost - pszHeader)));
-            RETURN_IF_FAILED(strTemp.Append(m_pszOriginalHostHeader));
-            RETURN_IF_FAILED(strTemp.Append(pszEndHost));
+ULONG
+FORWARDING_HANDLER::QueryElapsedMicroseconds(
+    LONGLONG                llTimestamp
+) const
+{
+    if (llTimestamp == 0 || sm_llPerformanceFrequency == 0)
+    {
+        return 0;
+    }
 
-            pszHeader = (PCSTR)m_pW3Context->AllocateRequestMemory(strTemp.QueryCCH() + 1);
-            if (pszHeader == NULL)
-            {
-                RETURN_HR(E_OUTOFMEMORY);
-            }
-            StringCchCopyA(const_cast<PSTR>(pszHeader), strTemp.QueryCCH() + 1, strTemp.QueryStr());
-            pHeaders->pUnknownHeaders[i].pRawValue = pszHeader;
-            pHeaders->pUnknownHeaders[i].RawValueLength = static_cast<USHORT>(strTemp.QueryCCH());
+    const LONGLONG llElapsed = llTimestamp - m_Timings.llStart;
+    const LONGLONG llMicroseconds = (llElapsed / sm_llPerformanceFrequency) * 1000000 +
+        (llElapsed % sm_llPerformanceFrequency) * 1000000 / sm_llPerformanceFrequency;
 
-            break;
+    return static_cast<ULONG>(min(llMicroseconds, static_cast<LONGLONG>(MAXULONG)));
+}
+
+//
+// Publishes the latency breakdown of the finished request, relative to the
+// start of ExecuteRequestHandler, through the ANCM trace event and, when
+// forwardTimingsServerVariable is set, the ANCM_FORWARD_TIMINGS server
+// variable so that it can be added to the IIS log with a custom field.
+//
+VOID
+FORWARDING_HANDLER::ReportForwardTimings()
+{
+    if (m_Timings.llStart == 0)
+    {
+        return;
+    }
+
+    const ULONG ulSendComplete = QueryElapsedMicroseconds(m_Timings.llSendComplete);
+    const ULONG ulHeadersAvailable = QueryElapsedMicroseconds(m_Timings.llHeadersAvailable);
+    const ULONG ulFirstByte = QueryElapsedMicroseconds(m_Timings.llFirstByte);
+    const ULONG ulLastByte = QueryElapsedMicroseconds(m_Timings.llLastByte);
+
+    if (ulLastByte != 0)
+    {
+        m_pApplication->QueryCounters()->RecordForward(ulLastByte);
+    }
+
+    if (m_pSample != NULL)
+    {
+        RecordSample(ulSendComplete, ulHeadersAvailable, ulFirstByte, ulLastByte);
+    }
+
+    if (ANCMEvents::ANCM_REQUEST_FORWARD_TIMINGS::IsEnabled(m_pW3Context->GetTraceContext()))
+    {
+        ANCMEvents::ANCM_REQUEST_FORWARD_TIMINGS::RaiseEvent(
+            m_pW3Context->GetTraceContext(),
+            NULL,
+            ulSendComplete,
+            ulHeadersAvailable,
+            ulFirstByte,
+            ulLastByte);
+    }
+
+    if (m_fSetForwardTimingsServerVariable)
+    {
+        WCHAR achTimings[128];
+
+        if (swprintf_s(achTimings,
+                _countof(achTimings),
+                L"send=%lu;headers=%lu;firstByte=%lu;lastByte=%lu",
+                ulSendComplete,
+                ulHeadersAvailable,
+                ulFirstByte,
+                ulLastByte) > 0)
+        {
+            LOG_IF_FAILED(m_pW3Context->SetServerVariable("ANCM_FORWARD_TIMINGS", achTimings));
         }
     }
+}
+
+//
+// Allocates the state of the WebSocket and reverse rewrite paths on first
+// use. Called from the request's own path only, as m_Arena requires.
+//
+HRESULT
+FORWARDING_HANDLER::EnsureColdState()
+{
+    if (m_pCold != NULL)
+    {
+        return S_OK;
+    }
+
+    COLD_STATE *pCold = static_cast<COLD_STATE *>(m_Arena.Alloc(sizeof(COLD_STATE)));
+    if (pCold == NULL)
+    {
+        RETURN_HR(E_OUTOFMEMORY);
+    }
 
+    ZeroMemory(pCold, sizeof(COLD_STATE));
+    m_pCold = pCold;
     return S_OK;
 }
 
+//
+// Completes the detail of a sampled request and hands it to the ring.
+//
 VOID
-FORWARDING_HANDLER::RemoveRequest(
-    VOID
+FORWARDING_HANDLER::RecordSample(
+    ULONG                   ulSendComplete,
+    ULONG                   ulHeadersAvailable,
+    ULONG                   ulFirstByte,
+    ULONG                   ulLastByte
 )
 {
-    m_fReactToDisconnect = FALSE;
+    const HTTP_COOKED_URL &cookedUrl = m_pW3Context->GetRequest()->GetRawHttpRequest()->CookedUrl;
+
+    GetSystemTimeAsFileTime(&m_pSample->ftCompleted);
+    m_pSample->dwProcessId = m_pServerProcess != NULL ? m_pServerProcess->QueryProcessId() : 0;
+    m_pW3Context->GetResponse()->GetStatus(&m_pSample->usStatusCode);
+    m_pSample->cchRequestHeaders = m_cchHeaders;
+    m_pSample->ulSendComplete = ulSendComplete;
+    m_pSample->ulHeadersAvailable = ulHeadersAvailable;
+    m_pSample->ulFirstByte = ulFirstByte;
+    m_pSample->ulLastByte = ulLastByte;
+
+    if (cookedUrl.pAbsPath != NULL)
+    {
+        wcsncpy_s(m_pSample->achUrl,
+            cookedUrl.pAbsPath,
+            min(static_cast<size_t>(cookedUrl.AbsPathLength / sizeof(WCHAR)), _countof(m_pSample->achUrl) - 1));
+    }
+
+    sm_RequestSampler.Record(m_pSample);
+}
+
+//
+// Writes the merged entries of a reference trace log as RefTrace events,
+// oldest first, while a session listens for them.
+//
+static
+VOID
+WriteRefTraceEvents(
+    PCSTR                       pszLogName,
+    PER_CPU_REF_TRACE_LOG *     pLog
+)
+{
+    if (pLog == NULL ||
+        !TraceLoggingProviderEnabled(g_hTraceProvider, WINEVENT_LEVEL_VERBOSE, ASPNETCORE_TRACE_KEYWORD_REFTRACE))
+    {
+        return;
+    }
+
+    std::vector<PER_CPU_REF_TRACE_LOG_ENTRY> entries;
+    if (FAILED_LOG(pLog->Snapshot(entries)))
+    {
+        return;
+    }
+
+    for (const auto& entry : entries)
+    {
+        ULONG64 rgullStack[REF_TRACE_LOG_STACK_DEPTH];
+        for (DWORD i = 0; i < REF_TRACE_LOG_STACK_DEPTH; i++)
+        {
+            rgullStack[i] = reinterpret_cast<ULONG_PTR>(entry.Stack[i]);
+        }
+
+        TraceLoggingWrite(g_hTraceProvider,
+            "RefTrace",
+            TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+            TraceLoggingKeyword(ASPNETCORE_TRACE_KEYWORD_REFTRACE),
+            TraceLoggingString(pszLogName, "Log"),
+            TraceLoggingInt64(entry.llTimestamp, "Timestamp"),
+            TraceLoggingInt32(entry.NewRefCount, "RefCount"),
+            TraceLoggingUInt32(entry.Thread, "ThreadId"),
+            TraceLoggingUInt32(entry.Processor, "Processor"),
+            TraceLoggingPointer(entry.Context, "Context"),
+            TraceLoggingPointer(entry.Context1, "Context1"),
+            TraceLoggingPointer(entry.Context2, "Context2"),
+            TraceLoggingPointer(entry.Context3, "Context3"),
+            TraceLoggingHexUInt64Array(rgullStack, REF_TRACE_LOG_STACK_DEPTH, "Stack"));
+    }
+}
+
+// static
+VOID
+FORWARDING_HANDLER::OnTraceCaptureState()
+{
+    sm_RequestSampler.Dump();
+    WriteRefTraceEvents("FORWARDING_HANDLER", sm_pTraceLog);
+    WriteRefTraceEvents("WEBSOCKET_HANDLER", WEBSOCKET_HANDLER::QueryTraceLog());
 }
 
 VOID
@@ -2452,6 +5570,24 @@ FORWARDING_HANDLER::NotifyDisconnect()
     if (!m_fHttpHandleInClose)
     {
         m_fClientDisconnected = true;
+
+        //
+        // While the backend works on the response headers nothing of IIS
+        // is outstanding, close the handle now rather than on the next
+        // completion so that the backend sees its connection go instead of
+        // finishing a response nobody reads. The aborted receive completes
+        // the request from the WinHTTP callback.
+        //
+        if (m_fAwaitingResponseHeaders &&
+            m_hRequest != NULL &&
+            !(m_pUpload != NULL && m_pUpload->fReadOutstanding) &&
+            !(m_pRequestSpool != NULL && m_pRequestSpool->QueryIoPending()) &&
+            !(m_pResponseSpool != NULL && m_pResponseSpool->QueryIoPending()))
+        {
+            m_fHttpHandleInClose = TRUE;
+            WinHttpCloseHandle(m_hRequest);
+            m_hRequest = NULL;
+        }
     }
 
     if (fLocked)
@@ -2460,11 +5596,40 @@ FORWARDING_HANDLER::NotifyDisconnect()
     }
 }
 
+VOID
+FORWARDING_HANDLER::OnProcessStartCompleted(
+    HRESULT hr
+)
+{
+    DBG_ASSERT(m_RequestStatus == FORWARDER_WAITING_FOR_PROCESS);
+
+    LOG_TRACEF(L"FORWARDING_HANDLER::OnProcessStartCompleted, hr %x --%p\n", hr, m_pW3Context);
+
+    m_hrProcessStart = hr;
+    m_fWaitedForProcess = TRUE;
+
+    //
+    // AsyncCompletion picks the request up from FORWARDER_WAITING_FOR_PROCESS.
+    //
+    LOG_IF_FAILED(m_pW3Context->PostCompletion(0));
+}
+
+VOID
+FORWARDING_HANDLER::OnResponseCacheFillCompleted(
+)
+{
+    DBG_ASSERT(m_RequestStatus == FORWARDER_WAITING_FOR_CACHE_FILL);
+
+    m_fWaitedForCacheFill = TRUE;
+
+    LOG_IF_FAILED(m_pW3Context->PostCompletion(0));
+}
+
 VOID
 FORWARDING_HANDLER::AcquireLockExclusive()
 {
     DBG_ASSERT(TlsGetValue(g_dwTlsIndex) == NULL);
-    AcquireSRWLockExclusive(&m_RequestLock);
+    LockContention::AcquireExclusive(&m_RequestLock, LockSite::ForwardingHandlerRequest);
     TlsSetValue(g_dwTlsIndex, this);
     DBG_ASSERT(TlsGetValue(g_dwTlsIndex) == this);
 }
@@ -1,5 +1,10 @@
 #pragma once
 
+//
+// Entries of each processor's ring of the reference trace logs.
+//
+#define REF_TRACE_ENTRIES_PER_PROCESSOR 1024
+
 extern DWORD            g_OptionalWinHttpFlags;
 extern HINSTANCE        g_hOutOfProcessRHModule;
 extern HINSTANCE        g_hWinHttpModule;
@@ -10,14 +15,159 @@ class OUT_OF_PROCESS_APPLICATION;
 enum FORWARDING_REQUEST_STATUS
 {
     FORWARDER_START,
+    //
+    // Parked until the backend process is started, the request resumes
+    // from AsyncCompletion.
+    //
+    FORWARDER_WAITING_FOR_PROCESS,
+    //
+    // Parked until the request forwarded for the same cacheable URL has
+    // its response, the request resumes from AsyncCompletion.
+    //
+    FORWARDER_WAITING_FOR_CACHE_FILL,
+    //
+    // Reading the request body into BODY_SPOOL before forwarding
+    // the request, the request resumes from AsyncCompletion.
+    //
+    FORWARDER_SPOOLING_REQUEST,
     FORWARDER_SENDING_REQUEST,
     FORWARDER_RECEIVING_RESPONSE,
     FORWARDER_RECEIVED_WEBSOCKET_RESPONSE,
+    //
+    // The failed attempt's WinHTTP handle is closing, the request is sent
+    // again from AsyncCompletion once it is gone.
+    //
+    FORWARDER_RETRYING_REQUEST,
     FORWARDER_DONE,
     FORWARDER_FINISH_REQUEST
 };
 
 
+//
+// State of the streaming response mode. A small ring of read buffers lets
+// FORWARDING_HANDLER post the next WinHttpReadData while IIS is still
+// flushing the previous chunk; a buffer is recycled as soon as the flush
+// referencing it completes.
+//
+struct RESPONSE_READ_AHEAD
+{
+    static const DWORD  MAX_BUFFERS = 8;
+
+    DWORD               cBuffers;
+    //
+    // Buffers available for the next WinHttpReadData.
+    //
+    BYTE *              rgFreeBuffers[MAX_BUFFERS];
+    DWORD               cFreeBuffers;
+    //
+    // Completed reads that have not been handed to IIS yet.
+    //
+    HTTP_DATA_CHUNK     rgPendingChunks[MAX_BUFFERS];
+    DWORD               cPendingChunks;
+    //
+    // Buffers referenced by the IIS flush in progress.
+    //
+    BYTE *              rgFlushingBuffers[MAX_BUFFERS];
+    DWORD               cFlushingBuffers;
+    //
+    // Buffer WinHTTP is currently reading into, NULL if no read is posted.
+    //
+    BYTE *              pReadBuffer;
+    BOOL                fFlushOutstanding;
+    BOOL                fEndOfResponse;
+};
+
+//
+// State of the request body upload pipeline. While WinHTTP writes one chunk
+// of the request body to the backend, the next chunk is already being read
+// from the client into another buffer of the ring. IIS and WinHTTP each
+// still have at most one operation outstanding.
+//
+struct REQUEST_BODY_UPLOAD
+{
+    static const DWORD  MAX_BUFFERS = 4;
+
+    struct PENDING_CHUNK
+    {
+        //
+        // NULL for the terminating chunk of a chunk-encoded body.
+        //
+        BYTE *          pBuffer;
+        DWORD           cbOffset;
+        DWORD           cbLength;
+    };
+
+    DWORD               cBuffers;
+    //
+    // Buffers available for the next ReadEntityBody.
+    //
+    BYTE *              rgFreeBuffers[MAX_BUFFERS];
+    DWORD               cFreeBuffers;
+    //
+    // Chunks read from the client, already framed, that have not been
+    // handed to WinHTTP yet; oldest first. One extra slot for the
+    // terminating chunk.
+    //
+    PENDING_CHUNK       rgPendingChunks[MAX_BUFFERS + 1];
+    DWORD               cPendingChunks;
+    //
+    // Buffer IIS is reading into and buffer WinHTTP is writing from.
+    //
+    BYTE *              pReadBuffer;
+    BYTE *              pWriteBuffer;
+    BOOL                fReadOutstanding;
+    BOOL                fWriteOutstanding;
+    BOOL                fEndOfRequest;
+};
+
+//
+// Size of the response buffer embedded in FORWARDING_HANDLER.
+//
+#define INLINE_RESPONSE_BUFFER_SIZE 1024
+
+//
+// Header of the forwarded block that replaces the ones of its name the
+// client sent, or with a NULL value removes them, see
+// FORWARDING_HANDLER::GetHeaders.
+//
+struct HEADER_OVERRIDE
+{
+    PCSTR               pszName;
+    USHORT              cchName;
+    //
+    // HTTP_HEADER_ID of the name, HttpHeaderRequestMaximum for an unknown
+    // header.
+    //
+    DWORD               dwKnownId;
+    PCSTR               pszValue;
+    USHORT              cchValue;
+};
+
+//
+// Host, the two MS-ASPNETCORE headers, the three forwarding headers,
+// Connection, Sec-WebSocket-Extensions and Accept-Encoding.
+//
+#define MAX_HEADER_OVERRIDES 9
+
+//
+// QueryPerformanceCounter timestamps of the forwarding milestones of one
+// request, 0 for a milestone that was not reached.
+//
+struct FORWARD_TIMINGS
+{
+    LONGLONG            llStart;
+    //
+    // WinHTTP sent the request headers, i.e. the backend connection is up.
+    //
+    LONGLONG            llSendComplete;
+    LONGLONG            llHeadersAvailable;
+    //
+    // First and last completed response body read.
+    //
+    LONGLONG            llFirstByte;
+    LONGLONG            llLastByte;
+};
+
 class FORWARDING_HANDLER : public REQUEST_HANDLER
 {
 public:
@@ -68,15 +218,47 @@ public:
     VOID
     StaticTerminate();
 
+    //
+    // Valid once StaticInitialize succeeded.
+    //
+    static
+    const PROTOCOL_CONFIG *
+    QueryProtocolConfig()
+    {
+        return &sm_ProtocolConfig;
+    }
+
     VOID
     NotifyDisconnect() override;
 
+    //
+    // Called by OUT_OF_PROCESS_APPLICATION when the process start this
+    // request was parked on has finished.
+    //
+    VOID
+    OnProcessStartCompleted(
+        HRESULT hr
+    );
+
+    //
+    // Called by RESPONSE_CACHE when the request forwarded for the URL this
+    // request was parked on is done.
+    //
+    VOID
+    OnResponseCacheFillCompleted();
+
     static void * operator new(size_t size);
 
     static void operator delete(void * pMemory);
 
 private:
 
+    //
+    // The header replay of ForwardingLoadHarness runs the request and
+    // response header paths of a handler without forwarding.
+    //
+    friend class HEADER_REPLAY;
+
     VOID
     AcquireLockExclusive();
 
@@ -88,7 +270,7 @@ private:
         _In_ const IHttpRequest *       pRequest,
         _In_ const PROTOCOL_CONFIG *    pProtocol,
         _In_ HINTERNET                  hConnect,
-        _Inout_ STRU *                  pstrUrl,
+        _In_ PCWSTR                     pszUrl,
         _In_ SERVER_PROCESS*                 pServerProcess
     );
 
@@ -128,6 +310,24 @@ private:
         _Out_ BOOL *                pfAnotherCompletionExpected
     );
 
+    //
+    // Small response fast path: a body with a Content-Length of at most
+    // BUFFER_SIZE is read whole into one buffer from the WinHTTP callbacks
+    // and handed to IIS once, without a flush of its own.
+    //
+    BOOL
+    CanReadWholeResponse() const;
+
+    HRESULT
+    ReadWholeResponse();
+
+    HRESULT
+    OnWholeResponseReadComplete(
+        _In_ IHttpResponse *        pResponse,
+        DWORD                       cbRead,
+        _Out_ BOOL *                pfAnotherCompletionExpected
+    );
+
     HRESULT
     OnSendingRequest(
         DWORD                       cbCompletion,
@@ -138,6 +338,32 @@ private:
     HRESULT
     OnReceivingResponse();
 
+    //
+    // Whether the Content-Length of the request is over maxRequestBodySize.
+    //
+    BOOL
+    IsRequestBodyTooLarge();
+
+    //
+    // Counts cbCompletion more bytes of a chunked request body, fails with
+    // ERROR_FILE_TOO_LARGE once it is over maxRequestBodySize.
+    //
+    HRESULT
+    CountChunkedRequestBody(
+        DWORD                       cbCompletion
+    );
+
+    BOOL
+    CanRetryRequest(
+        HRESULT                     hr
+    ) const;
+
+    VOID
+    BeginRetryRequest();
+
+    HRESULT
+    RetryRequest();
+
     BYTE *
     GetNewResponseBuffer(
         DWORD   dwBufferSize
@@ -146,17 +372,188 @@ private:
     VOID
     FreeResponseBuffers();
 
+    HRESULT
+    InitializeReadAhead(
+        DWORD                       cBuffers
+    );
+
+    VOID
+    FreeReadAhead();
+
+    VOID
+    OnReadAheadFlushCompleted();
+
+    HRESULT
+    ReadAheadPostRead();
+
+    HRESULT
+    ReadAheadFlushPending(
+        _In_ IHttpResponse *        pResponse
+    );
+
+    HRESULT
+    OnReadAheadReadComplete(
+        _In_ IHttpResponse *        pResponse,
+        DWORD                       cbRead,
+        _Out_ BOOL *                pfAnotherCompletionExpected
+    );
+
+    HRESULT
+    OnReadAheadReceivingResponse();
+
+    HRESULT
+    InitializeUpload(
+        DWORD                       cBuffers,
+        DWORD                       cbLimit
+    );
+
+    VOID
+    FreeUpload();
+
+    VOID
+    ReleaseWindowsAuthToken(
+        BOOL                        fConsumed
+    );
+
+    HRESULT
+    UploadPostRead(
+        _Out_ BOOL *                pfClientError
+    );
+
+    HRESULT
+    UploadWritePending();
+
+    HRESULT
+    UploadContinue(
+        _Out_ BOOL *                pfClientError
+    );
+
+    HRESULT
+    OnUploadReadComplete(
+        DWORD                       cbCompletion,
+        HRESULT                     hrCompletionStatus,
+        _Out_ BOOL *                pfClientError
+    );
+
+    HRESULT
+    OnUploadWriteComplete(
+        _Out_ BOOL *                pfClientError,
+        _Out_ BOOL *                pfAnotherCompletionExpected
+    );
+
+    HRESULT
+    BeginSpoolRequestBody(
+        _Out_ BOOL *                pfSpooling
+    );
+
+    REQUEST_NOTIFICATION_STATUS
+    SpoolRequestBody(
+        DWORD                       cbCompletion,
+        HRESULT                     hrCompletionStatus
+    );
+
+    HRESULT
+    BeginSpoolResponseBody();
+
+    HRESULT
+    OnSpoolReceivingResponse();
+
+    HRESULT
+    OnSpoolReadComplete(
+        _In_ IHttpResponse *        pResponse,
+        DWORD                       cbRead,
+        _Out_ BOOL *                pfAnotherCompletionExpected
+    );
+
+    HRESULT
+    SendSpooledRequestBody(
+        _Out_ BOOL *                pfAnotherCompletionExpected
+    );
+
+    HRESULT
+    WriteSpooledData(
+        _In_reads_bytes_(cbData) BYTE * pData,
+        DWORD                       cbData
+    );
+
     HRESULT
     SetStatusAndHeaders(
-        PCSTR               pszHeaders,
+        PSTR                pszHeaders,
         DWORD               cchHeaders
     );
 
+    //
+    // Looks up the file named by the X-Sendfile header of the backend
+    // response in the IIS file cache, it has to be under the sendFileRoot
+    // of the application once its junctions and links are resolved.
+    //
+    HRESULT
+    OpenSendFile(
+        _In_ PCSTR                  pszPath,
+        USHORT                      cchPath
+    );
+
+    //
+    // Replaces the body of the backend response with the file opened by
+    // OpenSendFile, HTTP.sys sends it straight from the file handle. The
+    // entity headers of the backend body are dropped.
+    //
+    HRESULT
+    SetSendFileResponse();
+
+    //
+    // Answers the request from the response cache, or parks it behind the
+    // request already forwarded for the same URL. FALSE when the request
+    // has to be forwarded.
+    //
+    BOOL
+    TryCoalesceCacheableRequest(
+        _Out_ REQUEST_NOTIFICATION_STATUS * pRetVal
+    );
+
+    //
+    // Resumes the requests parked behind this one, if it was forwarded
+    // for them.
+    //
+    VOID
+    EndResponseCacheFill();
+
+    //
+    // Starts the response cache entry of a response the application may
+    // cache, once its status and headers are set.
+    //
+    VOID
+    BeginResponseCacheFill();
+
+    VOID
+    AppendResponseCacheBody(
+        _In_reads_bytes_(cbData) const BYTE *   pbData,
+        DWORD                                   cbData
+    );
+
+    //
+    // Hands the entry to the cache once the whole response was forwarded.
+    //
+    VOID
+    CompleteResponseCacheFill();
+
     HRESULT
     DoReverseRewrite(
         _In_ IHttpResponse *pResponse
     );
 
+    HRESULT
+    ReverseRewriteUrlHeader(
+        _In_ IHttpResponse *        pResponse,
+        HTTP_HEADER_ID              headerId,
+        BOOL                        fSecure
+    );
+
+    HRESULT
+    ReverseRewriteCookieDomain(
+        _Inout_ HTTP_UNKNOWN_HEADER *   pHeader
+    );
+
     HRESULT
     GetHeaders(
         _In_ const PROTOCOL_CONFIG *    pProtocol,
@@ -166,26 +563,118 @@ private:
         _Inout_ DWORD *                 pcchHeaders
     );
 
+    //
+    // The forwarded headers as the wide block WinHttpSendRequest is
+    // given, streamed from the HTTP.sys headers into the handler arena.
+    //
+    HRESULT
+    SerializeRequestHeaders(
+        _In_reads_(cOverrides) const HEADER_OVERRIDE * rgOverrides,
+        DWORD                                       cOverrides,
+        _Out_   PCWSTR *                            ppszHeaders,
+        _Out_   DWORD *                             pcchHeaders
+    );
+
+    //
+    // Adds the forwarded headers to m_hRequest with
+    // WinHttpAddRequestHeadersEx, straight from the narrow HTTP.sys
+    // headers rather than through a wide block.
+    //
+    HRESULT
+    AddRequestHeadersEx(
+        _In_reads_(cOverrides) const HEADER_OVERRIDE * rgOverrides,
+        DWORD                                       cOverrides,
+        _Out_   DWORD *                             pcbHeaders
+    );
+
     VOID
     RemoveRequest(
         VOID
     );
 
+    static
+    LONGLONG
+    QueryTimestamp()
+    {
+        LARGE_INTEGER liCounter;
+        QueryPerformanceCounter(&liCounter);
+        return liCounter.QuadPart;
+    }
+
+    ULONG
+    QueryElapsedMicroseconds(
+        LONGLONG                llTimestamp
+    ) const;
+
+    VOID
+    ReportForwardTimings();
+
+    VOID
+    RecordSample(
+        ULONG                   ulSendComplete,
+        ULONG                   ulHeadersAvailable,
+        ULONG                   ulFirstByte,
+        ULONG                   ulLastByte
+    );
+
+    //
+    // Answers a rundown request of a session with the request samples and
+    // the reference trace logs of the module.
+    //
+    static
+    VOID
+    OnTraceCaptureState();
+
+    //
+    // Confines the calling thread to the processors of uNode when it runs
+    // on another node, returning the affinity to restore in pPrevious.
+    //
+    static
+    BOOL
+    MoveToCompletionNode(
+        UINT                    uNode,
+        _Out_ GROUP_AFFINITY *  pPrevious
+    );
+
+    //
+    // State only WebSocket and reverse rewrite requests use, allocated
+    // from m_Arena the first time one of them needs it.
+    //
+    struct COLD_STATE
+    {
+        WEBSOCKET_HANDLER *             pWebSocket;
+        PCSTR                           pszOriginalHostHeader;
+        USHORT                          cchOriginalHostHeader;
+    };
+
+    HRESULT
+    EnsureColdState();
+
+    WEBSOCKET_HANDLER *
+    QueryWebSocket() const
+    {
+        return m_pCold != NULL ? m_pCold->pWebSocket : NULL;
+    }
+
+    //
+    // Fields every completion touches come first, so that with the
+    // REQUEST_HANDLER base they span the first two cache lines of the
+    // handler.
+    //
     DWORD                               m_Signature;
+    FORWARDING_REQUEST_STATUS           m_RequestStatus;
+    mutable LONG                        m_cRefs;
+    //
+    // Record the number of winhttp handles in use
+    // release IIS pipeline only after all handles got closed
+    //
+    volatile  LONG                      m_dwHandlers;
+    IHttpContext*                       m_pW3Context;
+    HINTERNET                           m_hRequest;
     //
     // WinHTTP request handle is protected using a read-write lock.
     //
     SRWLOCK                             m_RequestLock;
-    HINTERNET                           m_hRequest;
-    FORWARDING_REQUEST_STATUS           m_RequestStatus;
-
-    BOOL                                m_fForwardResponseConnectionHeader;
-    BOOL                                m_fWebSocketEnabled;
-    BOOL                                m_fWebSocketSupported;
-    BOOL                                m_fResponseHeadersReceivedAndSet;
-    BOOL                                m_fResetConnection;
-    BOOL                                m_fDoReverseRewriteHeaders;
-    BOOL                                m_fServerResetConn;
     volatile  BOOL                      m_fClientDisconnected;
     //
     // A safety guard flag indicating no more IIS PostCompletion is allowed
@@ -199,44 +688,181 @@ private:
     volatile  BOOL                      m_fHasError;
     //
     // WinHttp may hit AV under race if handle got closed more than once simultaneously
-    // Use two bool variables to guard
+    // The WebSocket handle is guarded by the WEBSOCKET_HANDLER state
     //
     volatile  BOOL                      m_fHttpHandleInClose;
-    volatile  BOOL                      m_fWebSocketHandleInClose;
+    DWORD                               m_BytesToReceive;
+    DWORD                               m_BytesToSend;
+    DWORD                               m_cBytesBuffered;
+    //
+    // Response reads issued from the WinHTTP callback since the last IIS
+    // completion.
+    //
+    DWORD                               m_cInlineReads;
+    ULONGLONG                           m_cContentLength;
+    BYTE *                              m_pEntityBuffer;
+    RESPONSE_READ_AHEAD *               m_pReadAhead;
+    REQUEST_BODY_UPLOAD *               m_pUpload;
 
-    PCSTR                               m_pszOriginalHostHeader;
-    PCWSTR                              m_pszHeaders;
     //
-    // Record the number of winhttp handles in use
-    // release IIS pipeline only after all handles got closed
+    // Settled before the request is sent, and only read once WinHTTP and
+    // IIS completions may run concurrently, so they can share a word.
+    // Flags written while completions are outstanding stay BOOLs.
     //
-    volatile  LONG                      m_dwHandlers;
+    UINT                                m_fForwardResponseConnectionHeader : 1;
+    UINT                                m_fSetForwardTimingsServerVariable : 1;
+    UINT                                m_fWebSocketSupported : 1;
+    UINT                                m_fDoReverseRewriteHeaders : 1;
+    //
+    // Set when the path is one of the priority paths of the application,
+    // it then goes over the connection reserved for them.
+    //
+    UINT                                m_fPriorityRequest : 1;
+    //
+    // Set once the request has been parked on a process start, the
+    // outcome of which is in m_hrProcessStart.
+    //
+    UINT                                m_fWaitedForProcess : 1;
+    //
+    // Set once the request has been parked on a response cache fill.
+    //
+    UINT                                m_fWaitedForCacheFill : 1;
+    //
+    // NUMA node the WinHTTP completions of the request run on with
+    // numaLocalCompletions, NO_COMPLETION_NODE to run them where they
+    // arrive.
+    //
+    UINT                                m_uCompletionNode : 16;
+
+    BOOL                                m_fWebSocketEnabled;
+    BOOL                                m_fResponseHeadersReceivedAndSet;
+    BOOL                                m_fResetConnection;
+    BOOL                                m_fServerResetConn;
+    //
+    // Set once the request has been sent more than once.
+    //
+    BOOL                                m_fRequestRetried;
+    BOOL                                m_fResponseFlushed;
+    //
+    // Set while the body is read by the small response fast path.
+    //
+    BOOL                                m_fReadingWholeResponse;
+    //
+    // Set from the WinHttpReceiveResponse call until its completion, while
+    // only WinHTTP has an operation outstanding for the request.
+    //
+    BOOL                                m_fAwaitingResponseHeaders;
+    HRESULT                             m_hrProcessStart;
+
+    PCWSTR                              m_pszHeaders;
     DWORD                               m_cchHeaders;
-    DWORD                               m_BytesToReceive;
-    DWORD                               m_BytesToSend;
     DWORD                               m_cchLastSend;
+    //
+    // Bytes of a chunked request body read so far, see
+    // CountChunkedRequestBody.
+    //
+    DWORD                               m_cbChunkedBodyRead;
     DWORD                               m_cEntityBuffers;
-    DWORD                               m_cBytesBuffered;
     DWORD                               m_cMinBufferLimit;
-    ULONGLONG                           m_cContentLength;
-    WEBSOCKET_HANDLER *                 m_pWebSocket;
+    //
+    // Remaining re-dispatches after backend connection failures, only non
+    // zero for idempotent requests without a body.
+    //
+    DWORD                               m_cRetriesLeft;
+    //
+    // Set from the response buffering policy matching the Content-Type.
+    //
+    DWORD                               m_dwFlushIntervalInMS;
+    ULONGLONG                           m_ullLastFlushTick;
+    //
+    // NULL until a WebSocket upgrade or a reverse rewrite needs it.
+    //
+    COLD_STATE *                        m_pCold;
 
-    BYTE *                              m_pEntityBuffer;
+    //
+    // Request body read before the request was forwarded, NULL unless
+    // requestBufferingMemoryLimit is set.
+    //
+    BODY_SPOOL *                        m_pRequestSpool;
+    //
+    // Response body drained from the backend before it is sent, NULL
+    // unless responseSpoolingMemoryLimit is set. m_pResponseSpoolBuffer is
+    // the buffer of the outstanding WinHttpReadData, and once the spooled
+    // body was handed to IIS m_fResponseSpoolSent is set and the rest of a
+    // longer body is forwarded as it is read.
+    //
+    BODY_SPOOL *                        m_pResponseSpool;
+    BYTE *                              m_pResponseSpoolBuffer;
+    BOOL                                m_fResponseSpoolSent;
+    //
+    // Backend the request is forwarded to, referenced for the lifetime of
+    // the handler so its outstanding request count can be released.
+    //
+    SERVER_PROCESS *                    m_pServerProcess;
+    //
+    // User token handle of m_pServerProcess kept for the connection, NULL
+    // unless cacheWindowsAuthToken is set.
+    //
+    WINDOWS_AUTH_TOKEN_CACHE_ENTRY *    m_pWindowsAuthToken;
+    //
+    // File sent instead of the backend response body, held until the
+    // response that references its handle is gone.
+    //
+    IHttpFileInfo *                     m_pSendFileInfo;
+    FORWARD_TIMINGS                     m_Timings;
+    //
+    // Detail gathered for the request sampler, NULL unless the request
+    // was picked.
+    //
+    REQUEST_SAMPLE *                    m_pSample;
+    //
+    // Copy of the response being built for the response cache, NULL
+    // unless the response may be cached. For a request answered from the
+    // cache, the entry IIS sends the body of.
+    //
+    RESPONSE_CACHE_ENTRY *              m_pCacheEntry;
+    //
+    // Set while other requests for the URL wait on this one's response.
+    //
+    RESPONSE_CACHE_FILL *               m_pCacheFill;
+    std::unique_ptr<OUT_OF_PROCESS_APPLICATION, IAPPLICATION_DELETER> m_pApplication;
+    //
+    // Written from the disconnect notification, kept out of the packed
+    // flags above.
+    //
+    bool                                m_fReactToDisconnect;
+    //
+    // Backs the strings built while forwarding once they outgrow their
+    // stack buffers. Only the request's own, sequential path allocates
+    // from it, the memory goes away with the handler.
+    //
+    BUMP_ARENA                          m_Arena;
     static const SIZE_T                 INLINE_ENTITY_BUFFERS = 8;
     BUFFER_T<BYTE*, INLINE_ENTITY_BUFFERS> m_buffEntityBuffers;
 
     static ALLOC_CACHE_HANDLER *        sm_pAlloc;
     static PROTOCOL_CONFIG              sm_ProtocolConfig;
-    static RESPONSE_HEADER_HASH *       sm_pResponseHeaderHash;
+    static RESPONSE_BUFFER_POOL *       sm_pResponseBufferPool;
+    static LONGLONG                     sm_llPerformanceFrequency;
+    static REQUEST_SAMPLER              sm_RequestSampler;
+    //
+    // Processors of each NUMA node, NULL on a single node machine.
+    //
+    static GROUP_AFFINITY *             sm_pNodeAffinity;
+    static USHORT                       sm_cNodes;
+    static const USHORT                 NO_COMPLETION_NODE = 0xFFFF;
     //
     // Reference cout tracing for debugging purposes.
     //
-    static TRACE_LOG *                  sm_pTraceLog;
+    static PER_CPU_REF_TRACE_LOG *      sm_pTraceLog;
 
     static STRA                         sm_pStra502ErrorMsg;
 
-    mutable LONG                        m_cRefs;
-    IHttpContext*                       m_pW3Context;
-    std::unique_ptr<OUT_OF_PROCESS_APPLICATION, IAPPLICATION_DELETER> m_pApplication;
-    bool                                m_fReactToDisconnect;
+    //
+    // First small response buffer, carved out of the handler allocation so
+    // that a short response needs no allocation of its own. Kept last so
+    // that it does not separate the fields above.
+    //
+    BOOL                                m_fInlineResponseBufferInUse;
+    BYTE                                m_rgbInlineResponseBuffer[INLINE_RESPONSE_BUFFER_SIZE];
 };
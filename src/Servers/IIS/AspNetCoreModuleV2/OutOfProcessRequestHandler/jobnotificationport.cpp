@@ -0,0 +1,180 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "jobnotificationport.h"
+#include "SRWExclusiveLock.h"
+#include "SRWSharedLock.h"
+
+SRWLOCK   JOB_NOTIFICATION_PORT::sm_srwLock = SRWLOCK_INIT;
+HANDLE    JOB_NOTIFICATION_PORT::sm_hPort = NULL;
+ULONG_PTR JOB_NOTIFICATION_PORT::sm_ulNextKey = JOB_NOTIFICATION_PORT::SHUTDOWN_KEY + 1;
+std::map<ULONG_PTR, SERVER_PROCESS *> JOB_NOTIFICATION_PORT::sm_processes;
+
+//static
+HRESULT
+JOB_NOTIFICATION_PORT::Associate(
+    _In_ HANDLE             hJobObject,
+    _In_ SERVER_PROCESS *   pServerProcess,
+    _Out_ ULONG_PTR *       pulKey
+)
+{
+    SRWExclusiveLock lock(sm_srwLock);
+
+    *pulKey = 0;
+
+    if (sm_hPort == NULL)
+    {
+        HANDLE hPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+        RETURN_LAST_ERROR_IF_NULL(hPort);
+
+        //
+        // The thread closes the port once it is told to stop, and frees this
+        // reference on the request handler, which it may outlive.
+        //
+        HMODULE hModule = NULL;
+        if (!GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS,
+                reinterpret_cast<LPCWSTR>(&DispatcherThreadProc),
+                &hModule))
+        {
+            const DWORD dwError = GetLastError();
+            CloseHandle(hPort);
+            RETURN_HR(HRESULT_FROM_WIN32(dwError));
+        }
+
+        HANDLE hThread = CreateThread(NULL, 0, DispatcherThreadProc, hPort, 0, NULL);
+        if (hThread == NULL)
+        {
+            const DWORD dwError = GetLastError();
+            FreeLibrary(hModule);
+            CloseHandle(hPort);
+            RETURN_HR(HRESULT_FROM_WIN32(dwError));
+        }
+
+        CloseHandle(hThread);
+        sm_hPort = hPort;
+    }
+
+    const ULONG_PTR ulKey = sm_ulNextKey++;
+
+    //
+    // In the map first, the first notifications are queued as soon as the
+    // job is associated.
+    //
+    try
+    {
+        sm_processes[ulKey] = pServerProcess;
+    }
+    CATCH_RETURN();
+
+    JOBOBJECT_ASSOCIATE_COMPLETION_PORT portInfo = { 0 };
+    portInfo.CompletionKey = reinterpret_cast<PVOID>(ulKey);
+    portInfo.CompletionPort = sm_hPort;
+
+    if (!SetInformationJobObject(hJobObject, JobObjectAssociateCompletionPortInformation, &portInfo, sizeof portInfo))
+    {
+        const DWORD dwError = GetLastError();
+        sm_processes.erase(ulKey);
+        if (sm_processes.empty())
+        {
+            PostQueuedCompletionStatus(sm_hPort, 0, SHUTDOWN_KEY, NULL);
+            sm_hPort = NULL;
+        }
+        RETURN_HR(HRESULT_FROM_WIN32(dwError));
+    }
+
+    *pulKey = ulKey;
+    return S_OK;
+}
+
+//static
+VOID
+JOB_NOTIFICATION_PORT::Disassociate(
+    ULONG_PTR               ulKey
+)
+{
+    SRWExclusiveLock lock(sm_srwLock);
+
+    if (sm_processes.erase(ulKey) != 0 && sm_processes.empty())
+    {
+        // Whatever is still queued behind it is for jobs gone already.
+        PostQueuedCompletionStatus(sm_hPort, 0, SHUTDOWN_KEY, NULL);
+        sm_hPort = NULL;
+    }
+}
+
+//static
+DWORD
+WINAPI
+JOB_NOTIFICATION_PORT::DispatcherThreadProc(
+    _In_ LPVOID             pParameter
+)
+{
+    HANDLE hPort = static_cast<HANDLE>(pParameter);
+
+    for (;;)
+    {
+        DWORD           dwMessage = 0;
+        ULONG_PTR       ulKey = 0;
+        LPOVERLAPPED    pOverlapped = NULL;
+
+        if (!GetQueuedCompletionStatus(hPort, &dwMessage, &ulKey, &pOverlapped, INFINITE))
+        {
+            // Job notifications never fail, the port itself is at fault.
+            LOG_LAST_ERROR();
+            break;
+        }
+
+        if (ulKey == SHUTDOWN_KEY)
+        {
+            break;
+        }
+
+        //
+        // lpOverlapped carries the id of the process the message is about,
+        // when it is about one.
+        //
+        Dispatch(ulKey, dwMessage, static_cast<DWORD>(reinterpret_cast<ULONG_PTR>(pOverlapped)));
+    }
+
+    CloseHandle(hPort);
+
+    // The reference Associate took for the thread.
+    FreeLibraryAndExitThread(g_hOutOfProcessRHModule, 0);
+}
+
+//static
+VOID
+JOB_NOTIFICATION_PORT::Dispatch(
+    ULONG_PTR               ulKey,
+    DWORD                   dwMessage,
+    DWORD                   dwProcessId
+)
+{
+    SERVER_PROCESS *pExitedProcess = NULL;
+
+    {
+        // Held so that Disassociate waits for the notification.
+        SRWSharedLock lock(sm_srwLock);
+
+        auto it = sm_processes.find(ulKey);
+        if (it == sm_processes.end())
+        {
+            return;
+        }
+
+        if (it->second->OnJobNotification(dwMessage, dwProcessId))
+        {
+            pExitedProcess = it->second;
+        }
+    }
+
+    //
+    // Outside of the lock, the process may be shut down and freed, which
+    // disassociates its job. The reference of the exit watch keeps it
+    // alive until then.
+    //
+    if (pExitedProcess != NULL)
+    {
+        pExitedProcess->CompleteProcessExit();
+    }
+}
@@ -0,0 +1,71 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+class SERVER_PROCESS;
+
+//
+// One completion port for the job objects of all the backends this worker
+// process starts, read by one dispatcher thread. The thread keeps the
+// process lists of the jobs up to date, handles the exit of a backend in
+// place of a thread pool wait on it and reports the memory limit of a job
+// being hit, so a worker watching hundreds of backends waits on one port
+// rather than on a handle per process.
+//
+// A job is associated with a key of its own, never reused: a notification
+// still queued for a job that was disassociated since finds no process and
+// is dropped. The dispatcher runs while a job is associated, and keeps the
+// request handler loaded until it exits.
+//
+class JOB_NOTIFICATION_PORT
+{
+public:
+    //
+    // Associates the job of pServerProcess, starting the dispatcher on the
+    // first one. *pulKey is kept for Disassociate.
+    //
+    static
+    HRESULT
+    Associate(
+        _In_ HANDLE             hJobObject,
+        _In_ SERVER_PROCESS *   pServerProcess,
+        _Out_ ULONG_PTR *       pulKey
+    );
+
+    //
+    // Once it returns no notification is being dispatched to the process
+    // and none will be. The dispatcher is stopped with the last job.
+    //
+    static
+    VOID
+    Disassociate(
+        ULONG_PTR               ulKey
+    );
+
+private:
+    //
+    // Posted once the last job is disassociated, no job has it.
+    //
+    static const ULONG_PTR  SHUTDOWN_KEY = 0;
+
+    static
+    DWORD
+    WINAPI
+    DispatcherThreadProc(
+        _In_ LPVOID             pParameter
+    );
+
+    static
+    VOID
+    Dispatch(
+        ULONG_PTR               ulKey,
+        DWORD                   dwMessage,
+        DWORD                   dwProcessId
+    );
+
+    static SRWLOCK                              sm_srwLock;
+    static HANDLE                               sm_hPort;
+    static ULONG_PTR                            sm_ulNextKey;
+    static std::map<ULONG_PTR, SERVER_PROCESS *> sm_processes;
+};
@@ -0,0 +1,915 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "loopbackhttpclient.h"
+#include "SRWExclusiveLock.h"
+#include <mswsock.h>
+
+// The same for every socket of the provider, looked up by the first one.
+static LPFN_CONNECTEX   s_pfnConnectEx = NULL;
+
+static
+BOOL
+IsHeaderName(
+    _In_reads_(cchName) PCSTR   pchName,
+    SIZE_T                      cchName,
+    _In_ PCSTR                  pszHeader
+)
+{
+    return cchName == strlen(pszHeader) &&
+        _strnicmp(pchName, pszHeader, cchName) == 0;
+}
+
+VOID
+LOOPBACK_RESPONSE_PARSER::Reset(
+    VOID
+)
+{
+    m_state = STATE_HEADERS;
+    m_dwStatusCode = 0;
+    m_fKeepAlive = FALSE;
+    m_cbReceived = 0;
+    m_cbRemaining = 0;
+    m_cchHeaders = 0;
+}
+
+HRESULT
+LOOPBACK_RESPONSE_PARSER::Parse(
+    _In_reads_bytes_(cbData) const BYTE *   pData,
+    DWORD                                   cbData,
+    _Out_ BOOL *                            pfComplete
+)
+{
+    *pfComplete = FALSE;
+    m_cbReceived += cbData;
+
+    while (cbData != 0)
+    {
+        DWORD cbConsumed = 0;
+
+        switch (m_state)
+        {
+        case STATE_HEADERS:
+        {
+            //
+            // The blank line may straddle two reads, the search starts
+            // where the previous one could not see the end.
+            //
+            const DWORD cchSearchFrom = m_cchHeaders > 3 ? m_cchHeaders - 3 : 0;
+            const DWORD cbCopy = min(cbData, MAX_HEADERS_SIZE - m_cchHeaders);
+            DWORD       cchEnd = 0;
+
+            memcpy(m_rgchHeaders + m_cchHeaders, pData, cbCopy);
+            m_cchHeaders += cbCopy;
+
+            for (DWORD i = cchSearchFrom; i + 4 <= m_cchHeaders; i++)
+            {
+                if (memcmp(m_rgchHeaders + i, "\r\n\r\n", 4) == 0)
+                {
+                    cchEnd = i + 4;
+                    break;
+                }
+            }
+
+            if (cchEnd == 0)
+            {
+                if (m_cchHeaders == MAX_HEADERS_SIZE)
+                {
+                    RETURN_HR(HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER));
+                }
+                return S_OK;
+            }
+
+            // What follows the headers in this read is the body.
+            cbConsumed = cbCopy - (m_cchHeaders - cchEnd);
+            m_cchHeaders = cchEnd;
+            RETURN_IF_FAILED(ParseHeaders());
+            break;
+        }
+
+        case STATE_BODY_LENGTH:
+            cbConsumed = static_cast<DWORD>(min(static_cast<ULONGLONG>(cbData), m_cbRemaining));
+            m_cbRemaining -= cbConsumed;
+            if (m_cbRemaining == 0)
+            {
+                m_state = STATE_COMPLETE;
+            }
+            break;
+
+        case STATE_BODY_TO_CLOSE:
+            cbConsumed = cbData;
+            break;
+
+        case STATE_COMPLETE:
+            m_fKeepAlive = FALSE;
+            cbConsumed = cbData;
+            break;
+
+        default:
+            RETURN_IF_FAILED(ParseChunked(pData, cbData, &cbConsumed));
+            break;
+        }
+
+        pData += cbConsumed;
+        cbData -= cbConsumed;
+    }
+
+    *pfComplete = m_state == STATE_COMPLETE;
+    return S_OK;
+}
+
+HRESULT
+LOOPBACK_RESPONSE_PARSER::OnConnectionClosed(
+    _Out_ BOOL *                            pfComplete
+)
+{
+    m_fKeepAlive = FALSE;
+
+    if (m_state == STATE_BODY_TO_CLOSE || m_state == STATE_COMPLETE)
+    {
+        m_state = STATE_COMPLETE;
+        *pfComplete = TRUE;
+        return S_OK;
+    }
+
+    //
+    // Not logged, it is how an idle connection closed by the backend shows
+    // up and the request is sent again.
+    //
+    *pfComplete = FALSE;
+    return HRESULT_FROM_WIN32(WSAECONNRESET);
+}
+
+HRESULT
+LOOPBACK_RESPONSE_PARSER::ParseHeaders(
+    VOID
+)
+/*++
+
+Routine Description:
+
+    Parse the m_cchHeaders bytes of m_rgchHeaders, ended by the blank line,
+    and set up the reading of the body. Every line, the last one included,
+    ends with CRLF; each is terminated in place.
+
+--*/
+{
+    CHAR *          pchLine = m_rgchHeaders;
+    CHAR * const    pchEnd = m_rgchHeaders + m_cchHeaders - 2;
+    BOOL            fStatusLine = TRUE;
+    BOOL            fHttp11 = FALSE;
+    BOOL            fKeepAlive = FALSE;
+    BOOL            fChunked = FALSE;
+    BOOL            fHasLength = FALSE;
+    ULONGLONG       cbLength = 0;
+
+    while (pchLine < pchEnd)
+    {
+        CHAR* pchLineEnd = pchLine;
+        while (pchLineEnd[0] != '\r' || pchLineEnd[1] != '\n')
+        {
+            pchLineEnd++;
+        }
+        *pchLineEnd = '\0';
+
+        if (fStatusLine)
+        {
+            // HTTP/1.x SSS Reason
+            if (strncmp(pchLine, "HTTP/1.", 7) != 0 ||
+                (pchLine[7] != '0' && pchLine[7] != '1') ||
+                pchLine[8] != ' ')
+            {
+                RETURN_HR(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+            }
+
+            fHttp11 = pchLine[7] == '1';
+            fKeepAlive = fHttp11;
+            m_dwStatusCode = strtoul(pchLine + 9, NULL, 10);
+            if (m_dwStatusCode < 100 || m_dwStatusCode > 999)
+            {
+                RETURN_HR(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+            }
+
+            fStatusLine = FALSE;
+        }
+        else
+        {
+            CHAR* pchColon = strchr(pchLine, ':');
+            if (pchColon == NULL)
+            {
+                RETURN_HR(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+            }
+
+            CHAR* pszValue = pchColon + 1;
+            while (*pszValue == ' ' || *pszValue == '\t')
+            {
+                pszValue++;
+            }
+
+            CHAR* pchValueEnd = pchLineEnd;
+            while (pchValueEnd > pszValue && (pchValueEnd[-1] == ' ' || pchValueEnd[-1] == '\t'))
+            {
+                *--pchValueEnd = '\0';
+            }
+
+            const SIZE_T cchName = pchColon - pchLine;
+            const SIZE_T cchValue = pchValueEnd - pszValue;
+
+            if (IsHeaderName(pchLine, cchName, "Content-Length"))
+            {
+                CHAR* pchDigitsEnd = NULL;
+                cbLength = _strtoui64(pszValue, &pchDigitsEnd, 10);
+                if (pchDigitsEnd == pszValue || *pchDigitsEnd != '\0')
+                {
+                    RETURN_HR(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+                }
+                fHasLength = TRUE;
+            }
+            else if (IsHeaderName(pchLine, cchName, "Transfer-Encoding"))
+            {
+                // chunked is always the last coding applied.
+                fChunked = cchValue >= 7 && _stricmp(pchValueEnd - 7, "chunked") == 0;
+            }
+            else if (IsHeaderName(pchLine, cchName, "Connection"))
+            {
+                if (_stricmp(pszValue, "close") == 0)
+                {
+                    fKeepAlive = FALSE;
+                }
+                else if (_stricmp(pszValue, "keep-alive") == 0)
+                {
+                    fKeepAlive = TRUE;
+                }
+            }
+        }
+
+        pchLine = pchLineEnd + 2;
+    }
+
+    m_fKeepAlive = fKeepAlive;
+
+    if (m_dwStatusCode < 200 && m_dwStatusCode != 101)
+    {
+        // An interim response, the final one follows.
+        m_cchHeaders = 0;
+        m_state = STATE_HEADERS;
+    }
+    else if (m_dwStatusCode == 101)
+    {
+        // Nothing HTTP follows on the connection.
+        m_fKeepAlive = FALSE;
+        m_state = STATE_COMPLETE;
+    }
+    else if (m_dwStatusCode == 204 || m_dwStatusCode == 304)
+    {
+        m_state = STATE_COMPLETE;
+    }
+    else if (fChunked)
+    {
+        m_cbRemaining = 0;
+        m_state = STATE_CHUNK_SIZE;
+    }
+    else if (fHasLength)
+    {
+        m_cbRemaining = cbLength;
+        m_state = cbLength != 0 ? STATE_BODY_LENGTH : STATE_COMPLETE;
+    }
+    else
+    {
+        m_fKeepAlive = FALSE;
+        m_state = STATE_BODY_TO_CLOSE;
+    }
+
+    return S_OK;
+}
+
+HRESULT
+LOOPBACK_RESPONSE_PARSER::ParseChunked(
+    _In_reads_bytes_(cbData) const BYTE *   pData,
+    DWORD                                   cbData,
+    _Out_ DWORD *                           pcbConsumed
+)
+{
+    DWORD i = 0;
+
+    while (i < cbData && m_state != STATE_COMPLETE)
+    {
+        const CHAR ch = static_cast<CHAR>(pData[i]);
+
+        switch (m_state)
+        {
+        case STATE_CHUNK_SIZE:
+        {
+            int nDigit = -1;
+            if (ch >= '0' && ch <= '9')
+            {
+                nDigit = ch - '0';
+            }
+            else if (ch >= 'a' && ch <= 'f')
+            {
+                nDigit = ch - 'a' + 10;
+            }
+            else if (ch >= 'A' && ch <= 'F')
+            {
+                nDigit = ch - 'A' + 10;
+            }
+
+            if (nDigit >= 0)
+            {
+                if ((m_cbRemaining >> 60) != 0)
+                {
+                    RETURN_HR(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+                }
+                m_cbRemaining = m_cbRemaining * 16 + nDigit;
+            }
+            else if (ch == ';' || ch == ' ' || ch == '\t')
+            {
+                m_state = STATE_CHUNK_EXTENSION;
+            }
+            else if (ch == '\r')
+            {
+                m_state = STATE_CHUNK_SIZE_LF;
+            }
+            else
+            {
+                RETURN_HR(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+            }
+            i++;
+            break;
+        }
+
+        case STATE_CHUNK_EXTENSION:
+            if (ch == '\r')
+            {
+                m_state = STATE_CHUNK_SIZE_LF;
+            }
+            i++;
+            break;
+
+        case STATE_CHUNK_SIZE_LF:
+            if (ch != '\n')
+            {
+                RETURN_HR(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+            }
+            // The last chunk is the empty one, trailers follow.
+            m_state = m_cbRemaining != 0 ? STATE_CHUNK_DATA : STATE_TRAILER_LINE_START;
+            i++;
+            break;
+
+        case STATE_CHUNK_DATA:
+        {
+            const DWORD cbSkip = static_cast<DWORD>(min(static_cast<ULONGLONG>(cbData - i), m_cbRemaining));
+            m_cbRemaining -= cbSkip;
+            i += cbSkip;
+            if (m_cbRemaining == 0)
+            {
+                m_state = STATE_CHUNK_DATA_CR;
+            }
+            break;
+        }
+
+        case STATE_CHUNK_DATA_CR:
+            if (ch != '\r')
+            {
+                RETURN_HR(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+            }
+            m_state = STATE_CHUNK_DATA_LF;
+            i++;
+            break;
+
+        case STATE_CHUNK_DATA_LF:
+            if (ch != '\n')
+            {
+                RETURN_HR(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+            }
+            m_state = STATE_CHUNK_SIZE;
+            i++;
+            break;
+
+        case STATE_TRAILER_LINE_START:
+            m_state = ch == '\r' ? STATE_TRAILER_LF : STATE_TRAILER_LINE;
+            i++;
+            break;
+
+        case STATE_TRAILER_LINE:
+            if (ch == '\n')
+            {
+                m_state = STATE_TRAILER_LINE_START;
+            }
+            i++;
+            break;
+
+        case STATE_TRAILER_LF:
+            if (ch != '\n')
+            {
+                RETURN_HR(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+            }
+            m_state = STATE_COMPLETE;
+            i++;
+            break;
+
+        default:
+            DBG_ASSERT(FALSE);
+            RETURN_HR(E_UNEXPECTED);
+        }
+    }
+
+    *pcbConsumed = i;
+    return S_OK;
+}
+
+LOOPBACK_CONNECTION::LOOPBACK_CONNECTION(
+    _In_ LOOPBACK_HTTP_CLIENT *     pClient
+) :
+    m_pClient(pClient),
+    m_socket(INVALID_SOCKET),
+    m_pIo(NULL),
+    m_state(STATE_CONNECTING),
+    m_fReused(FALSE),
+    m_cbSent(0),
+    m_pfnCompletion(NULL),
+    m_pContext(NULL),
+    m_timer(TimeoutCallback, this),
+    m_fTimedOut(FALSE)
+{
+    ZeroMemory(&m_overlapped, sizeof(m_overlapped));
+    InitializeSRWLock(&m_srwLock);
+}
+
+LOOPBACK_CONNECTION::~LOOPBACK_CONNECTION()
+{
+    m_timer.Cancel();
+    Close();
+}
+
+HRESULT
+LOOPBACK_CONNECTION::Open(
+    VOID
+)
+{
+    SOCKADDR_IN addr = {};
+    BOOL        fNoDelay = TRUE;
+
+    m_socket = WSASocketW(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED);
+    if (m_socket == INVALID_SOCKET)
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(WSAGetLastError()));
+    }
+
+    // Each request is a single write, it is not held back.
+    setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&fNoDelay), sizeof(fNoDelay));
+
+    // ConnectEx only takes a bound socket.
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(m_socket, reinterpret_cast<SOCKADDR*>(&addr), sizeof(addr)) == SOCKET_ERROR)
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(WSAGetLastError()));
+    }
+
+    if (s_pfnConnectEx == NULL)
+    {
+        GUID            guidConnectEx = WSAID_CONNECTEX;
+        LPFN_CONNECTEX  pfnConnectEx = NULL;
+        DWORD           cbReturned = 0;
+
+        if (WSAIoctl(m_socket,
+            SIO_GET_EXTENSION_FUNCTION_POINTER,
+            &guidConnectEx,
+            sizeof(guidConnectEx),
+            &pfnConnectEx,
+            sizeof(pfnConnectEx),
+            &cbReturned,
+            NULL,
+            NULL) == SOCKET_ERROR)
+        {
+            RETURN_HR(HRESULT_FROM_WIN32(WSAGetLastError()));
+        }
+
+        s_pfnConnectEx = pfnConnectEx;
+    }
+
+    m_pIo = CreateThreadpoolIo(reinterpret_cast<HANDLE>(m_socket), IoCompletionCallback, this, NULL);
+    RETURN_LAST_ERROR_IF_NULL(m_pIo);
+
+    return S_OK;
+}
+
+VOID
+LOOPBACK_CONNECTION::Close(
+    VOID
+)
+{
+    if (m_socket != INVALID_SOCKET)
+    {
+        closesocket(m_socket);
+        m_socket = INVALID_SOCKET;
+    }
+
+    // Freed once the callback running it, if any, returns.
+    if (m_pIo != NULL)
+    {
+        CloseThreadpoolIo(m_pIo);
+        m_pIo = NULL;
+    }
+}
+
+HRESULT
+LOOPBACK_CONNECTION::Start(
+    DWORD                           dwTimeoutInMS,
+    BOOL                            fReused,
+    PFN_LOOPBACK_REQUEST_COMPLETION pfnCompletion,
+    PVOID                           pContext
+)
+{
+    HRESULT hr = S_OK;
+
+    m_pfnCompletion = pfnCompletion;
+    m_pContext = pContext;
+    m_fReused = fReused;
+    m_fTimedOut = FALSE;
+    m_cbSent = 0;
+    m_parser.Reset();
+
+    if (m_socket == INVALID_SOCKET)
+    {
+        RETURN_IF_FAILED(Open());
+    }
+
+    RETURN_IF_FAILED(m_timer.Set(dwTimeoutInMS));
+
+    hr = Issue(fReused ? STATE_SENDING : STATE_CONNECTING);
+    if (FAILED(hr) && fReused)
+    {
+        hr = Reconnect();
+    }
+
+    if (FAILED(hr))
+    {
+        m_timer.Cancel();
+        return hr;
+    }
+
+    return S_OK;
+}
+
+HRESULT
+LOOPBACK_CONNECTION::Reconnect(
+    VOID
+)
+{
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        Close();
+        m_fReused = FALSE;
+        m_cbSent = 0;
+        m_parser.Reset();
+
+        RETURN_IF_FAILED(Open());
+    }
+
+    return Issue(STATE_CONNECTING);
+}
+
+HRESULT
+LOOPBACK_CONNECTION::Issue(
+    STATE                           state
+)
+{
+    SRWExclusiveLock lock(m_srwLock);
+    BOOL fSucceeded = FALSE;
+
+    if (m_fTimedOut)
+    {
+        return HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+    }
+
+    m_state = state;
+    ZeroMemory(&m_overlapped, sizeof(m_overlapped));
+
+    StartThreadpoolIo(m_pIo);
+
+    switch (state)
+    {
+    case STATE_CONNECTING:
+    {
+        SOCKADDR_IN addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<USHORT>(m_pClient->QueryPort()));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        fSucceeded = s_pfnConnectEx(m_socket,
+            reinterpret_cast<SOCKADDR*>(&addr),
+            sizeof(addr),
+            NULL,
+            0,
+            NULL,
+            &m_overlapped);
+        break;
+    }
+
+    case STATE_SENDING:
+    {
+        WSABUF buffer;
+        buffer.buf = m_straRequest.QueryStr() + m_cbSent;
+        buffer.len = m_straRequest.QueryCCH() - m_cbSent;
+
+        fSucceeded = WSASend(m_socket, &buffer, 1, NULL, 0, &m_overlapped, NULL) == 0;
+        break;
+    }
+
+    case STATE_RECEIVING:
+    {
+        WSABUF buffer;
+        DWORD  dwFlags = 0;
+        buffer.buf = reinterpret_cast<CHAR*>(m_rgbBuffer);
+        buffer.len = sizeof(m_rgbBuffer);
+
+        fSucceeded = WSARecv(m_socket, &buffer, 1, NULL, &dwFlags, &m_overlapped, NULL) == 0;
+        break;
+    }
+    }
+
+    //
+    // A completion is queued even when the operation is done right away.
+    //
+    if (!fSucceeded)
+    {
+        const int nError = WSAGetLastError();
+        if (nError != WSA_IO_PENDING)
+        {
+            CancelThreadpoolIo(m_pIo);
+            return HRESULT_FROM_WIN32(nError);
+        }
+    }
+
+    return S_OK;
+}
+
+VOID
+LOOPBACK_CONNECTION::OnIoCompleted(
+    ULONG                           ulIoResult,
+    DWORD                           cbTransferred
+)
+{
+    HRESULT hr = HRESULT_FROM_WIN32(ulIoResult);
+    BOOL    fComplete = FALSE;
+
+    // Cancelled by TimeoutCallback.
+    if (m_fTimedOut)
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        switch (m_state)
+        {
+        case STATE_CONNECTING:
+            // So that shutdown and getpeername work on the socket.
+            setsockopt(m_socket, SOL_SOCKET, SO_UPDATE_CONNECT_CONTEXT, NULL, 0);
+            hr = Issue(STATE_SENDING);
+            break;
+
+        case STATE_SENDING:
+            m_cbSent += cbTransferred;
+            hr = Issue(m_cbSent < m_straRequest.QueryCCH() ? STATE_SENDING : STATE_RECEIVING);
+            break;
+
+        case STATE_RECEIVING:
+            hr = cbTransferred != 0 ?
+                m_parser.Parse(m_rgbBuffer, cbTransferred, &fComplete) :
+                m_parser.OnConnectionClosed(&fComplete);
+            if (SUCCEEDED(hr) && !fComplete)
+            {
+                hr = Issue(STATE_RECEIVING);
+            }
+            break;
+        }
+    }
+
+    if (FAILED(hr) && m_fReused && !m_fTimedOut && m_parser.IsEmpty())
+    {
+        hr = Reconnect();
+    }
+
+    if (FAILED(hr) || fComplete)
+    {
+        Complete(hr);
+    }
+}
+
+VOID
+LOOPBACK_CONNECTION::Complete(
+    HRESULT                         hr
+)
+{
+    LOOPBACK_HTTP_CLIENT * const            pClient = m_pClient;
+    const PFN_LOOPBACK_REQUEST_COMPLETION   pfnCompletion = m_pfnCompletion;
+    const PVOID                             pContext = m_pContext;
+    const DWORD                             dwStatusCode = SUCCEEDED(hr) ? m_parser.QueryStatusCode() : 0;
+
+    // Also waits for a timeout callback in flight.
+    m_timer.Cancel();
+
+    //
+    // Deletes this or keeps it for the next request, which the completion
+    // may already send.
+    //
+    pClient->ReleaseConnection(this, SUCCEEDED(hr) && m_parser.QueryKeepAlive());
+
+    pfnCompletion(pContext, hr, dwStatusCode);
+
+    // The reference of SendRequest.
+    pClient->DereferenceLoopbackHttpClient();
+}
+
+// static
+VOID
+CALLBACK
+LOOPBACK_CONNECTION::IoCompletionCallback(
+    PTP_CALLBACK_INSTANCE,
+    PVOID                           pvContext,
+    PVOID,
+    ULONG                           ulIoResult,
+    ULONG_PTR                       cbTransferred,
+    PTP_IO
+)
+{
+    static_cast<LOOPBACK_CONNECTION*>(pvContext)->OnIoCompleted(ulIoResult, static_cast<DWORD>(cbTransferred));
+}
+
+// static
+VOID
+CALLBACK
+LOOPBACK_CONNECTION::TimeoutCallback(
+    PVOID                           pContext
+)
+{
+    LOOPBACK_CONNECTION *pConnection = static_cast<LOOPBACK_CONNECTION*>(pContext);
+
+    SRWExclusiveLock lock(pConnection->m_srwLock);
+
+    //
+    // The I/O in flight completes as aborted, and is reported as timed
+    // out, or the next one is not issued.
+    //
+    pConnection->m_fTimedOut = TRUE;
+    CancelIoEx(reinterpret_cast<HANDLE>(pConnection->m_socket), NULL);
+}
+
+LOOPBACK_HTTP_CLIENT::LOOPBACK_HTTP_CLIENT(
+    VOID
+) :
+    m_cRefs(1),
+    m_dwPort(0),
+    m_fShutdown(FALSE),
+    m_cIdleConnections(0)
+{
+    InitializeSRWLock(&m_srwLock);
+    ZeroMemory(m_rgpIdleConnections, sizeof(m_rgpIdleConnections));
+}
+
+LOOPBACK_HTTP_CLIENT::~LOOPBACK_HTTP_CLIENT()
+{
+    for (DWORD i = 0; i < m_cIdleConnections; i++)
+    {
+        delete m_rgpIdleConnections[i];
+        m_rgpIdleConnections[i] = NULL;
+    }
+    m_cIdleConnections = 0;
+}
+
+HRESULT
+LOOPBACK_HTTP_CLIENT::Initialize(
+    DWORD   dwPort
+)
+{
+    m_dwPort = dwPort;
+    return S_OK;
+}
+
+HRESULT
+LOOPBACK_HTTP_CLIENT::SendRequest(
+    _In_ PCSTR                      pszMethod,
+    _In_ PCSTR                      pszPath,
+    _In_ PCSTR                      pszHeaders,
+    DWORD                           dwTimeoutInMS,
+    PFN_LOOPBACK_REQUEST_COMPLETION pfnCompletion,
+    PVOID                           pContext
+)
+{
+    HRESULT                 hr = S_OK;
+    LOOPBACK_CONNECTION    *pConnection = NULL;
+    BOOL                    fReused = FALSE;
+    CHAR                    szPort[16];
+    STRA                   *pstraRequest = NULL;
+
+    if (m_fShutdown)
+    {
+        return E_APPLICATION_EXITING;
+    }
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        if (m_cIdleConnections != 0)
+        {
+            pConnection = m_rgpIdleConnections[--m_cIdleConnections];
+            m_rgpIdleConnections[m_cIdleConnections] = NULL;
+            fReused = TRUE;
+        }
+    }
+
+    if (pConnection == NULL)
+    {
+        pConnection = new LOOPBACK_CONNECTION(this);
+        if (pConnection == NULL)
+        {
+            RETURN_HR(E_OUTOFMEMORY);
+        }
+    }
+
+    _ultoa_s(m_dwPort, szPort, _countof(szPort), 10);
+
+    pstraRequest = pConnection->QueryRequest();
+    if (FAILED_LOG(hr = pstraRequest->Copy(pszMethod)) ||
+        FAILED_LOG(hr = pstraRequest->Append(" ")) ||
+        FAILED_LOG(hr = pstraRequest->Append(pszPath)) ||
+        FAILED_LOG(hr = pstraRequest->Append(" HTTP/1.1\r\nHost: 127.0.0.1:")) ||
+        FAILED_LOG(hr = pstraRequest->Append(szPort)) ||
+        FAILED_LOG(hr = pstraRequest->Append("\r\n")) ||
+        FAILED_LOG(hr = pstraRequest->Append(pszHeaders)) ||
+        FAILED_LOG(hr = pstraRequest->Append("\r\n")))
+    {
+        goto Finished;
+    }
+
+    // Held by the request until its completion returns.
+    ReferenceLoopbackHttpClient();
+
+    if (FAILED_LOG(hr = pConnection->Start(dwTimeoutInMS, fReused, pfnCompletion, pContext)))
+    {
+        DereferenceLoopbackHttpClient();
+        goto Finished;
+    }
+
+    pConnection = NULL;
+
+Finished:
+    if (pConnection != NULL)
+    {
+        ReleaseConnection(pConnection, FALSE);
+    }
+
+    return hr;
+}
+
+VOID
+LOOPBACK_HTTP_CLIENT::ReleaseConnection(
+    _In_ LOOPBACK_CONNECTION *      pConnection,
+    BOOL                            fKeepAlive
+)
+{
+    if (fKeepAlive && !m_fShutdown)
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        if (m_cIdleConnections < MAX_IDLE_CONNECTIONS)
+        {
+            m_rgpIdleConnections[m_cIdleConnections++] = pConnection;
+            return;
+        }
+    }
+
+    delete pConnection;
+}
+
+VOID
+LOOPBACK_HTTP_CLIENT::Shutdown(
+    VOID
+)
+{
+    LOOPBACK_CONNECTION    *rgpConnections[MAX_IDLE_CONNECTIONS];
+    DWORD                   cConnections = 0;
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        m_fShutdown = TRUE;
+
+        for (DWORD i = 0; i < m_cIdleConnections; i++)
+        {
+            rgpConnections[cConnections++] = m_rgpIdleConnections[i];
+            m_rgpIdleConnections[i] = NULL;
+        }
+        m_cIdleConnections = 0;
+    }
+
+    // Outside of the lock, each closes its socket.
+    for (DWORD i = 0; i < cConnections; i++)
+    {
+        delete rgpConnections[i];
+    }
+}
@@ -0,0 +1,339 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+class LOOPBACK_HTTP_CLIENT;
+
+//
+// Called once per LOOPBACK_HTTP_CLIENT::SendRequest on a thread pool I/O
+// thread. dwStatusCode is 0 when hr failed.
+//
+typedef
+VOID
+(*PFN_LOOPBACK_REQUEST_COMPLETION)(
+    PVOID       pContext,
+    HRESULT     hr,
+    DWORD       dwStatusCode
+);
+
+//
+// Just enough of HTTP/1.1 to find where the response to a bodyless request
+// ends: the status line, Content-Length, chunked transfer encoding and
+// Connection. The body itself is skipped.
+//
+class LOOPBACK_RESPONSE_PARSER
+{
+public:
+    LOOPBACK_RESPONSE_PARSER()
+    {
+        Reset();
+    }
+
+    VOID
+    Reset(
+        VOID
+    );
+
+    //
+    // Consumes the next cbData bytes of the response, *pfComplete once the
+    // end of it was seen. Nothing is pipelined, bytes past the end only
+    // keep the connection from being reused.
+    //
+    HRESULT
+    Parse(
+        _In_reads_bytes_(cbData) const BYTE *   pData,
+        DWORD                                   cbData,
+        _Out_ BOOL *                            pfComplete
+    );
+
+    //
+    // The backend closed the connection. Completes a response whose body
+    // has no length, fails any other.
+    //
+    HRESULT
+    OnConnectionClosed(
+        _Out_ BOOL *                            pfComplete
+    );
+
+    DWORD
+    QueryStatusCode() const
+    {
+        return m_dwStatusCode;
+    }
+
+    BOOL
+    QueryKeepAlive() const
+    {
+        return m_fKeepAlive;
+    }
+
+    //
+    // No byte of the response was seen, a reused connection that fails
+    // now was closed by the backend while idle and the request is safe to
+    // send again.
+    //
+    BOOL
+    IsEmpty() const
+    {
+        return m_cbReceived == 0;
+    }
+
+private:
+    enum STATE
+    {
+        STATE_HEADERS,
+        STATE_BODY_LENGTH,
+        STATE_BODY_TO_CLOSE,
+        STATE_CHUNK_SIZE,
+        STATE_CHUNK_EXTENSION,
+        STATE_CHUNK_SIZE_LF,
+        STATE_CHUNK_DATA,
+        STATE_CHUNK_DATA_CR,
+        STATE_CHUNK_DATA_LF,
+        STATE_TRAILER_LINE_START,
+        STATE_TRAILER_LINE,
+        STATE_TRAILER_LF,
+        STATE_COMPLETE
+    };
+
+    // Status line and headers of one response.
+    static const DWORD      MAX_HEADERS_SIZE = 8 * 1024;
+
+    HRESULT
+    ParseHeaders(
+        VOID
+    );
+
+    HRESULT
+    ParseChunked(
+        _In_reads_bytes_(cbData) const BYTE *   pData,
+        DWORD                                   cbData,
+        _Out_ DWORD *                           pcbConsumed
+    );
+
+    STATE                   m_state;
+    DWORD                   m_dwStatusCode;
+    BOOL                    m_fKeepAlive;
+    ULONGLONG               m_cbReceived;
+    // Body or chunk bytes still to skip.
+    ULONGLONG               m_cbRemaining;
+    DWORD                   m_cchHeaders;
+    CHAR                    m_rgchHeaders[MAX_HEADERS_SIZE];
+};
+
+//
+// One keep-alive socket to the backend and the request it carries. The
+// socket is bound to the thread pool, each step of the request is issued
+// from the completion of the previous one.
+//
+class LOOPBACK_CONNECTION
+{
+public:
+    LOOPBACK_CONNECTION(
+        _In_ LOOPBACK_HTTP_CLIENT *     pClient
+    );
+
+    ~LOOPBACK_CONNECTION();
+
+    //
+    // Sends m_straRequest, set by the client, and reads the response.
+    // fReused when the socket was taken from the idle pool.
+    //
+    HRESULT
+    Start(
+        DWORD                           dwTimeoutInMS,
+        BOOL                            fReused,
+        PFN_LOOPBACK_REQUEST_COMPLETION pfnCompletion,
+        PVOID                           pContext
+    );
+
+    STRA *
+    QueryRequest()
+    {
+        return &m_straRequest;
+    }
+
+private:
+    enum STATE
+    {
+        STATE_CONNECTING,
+        STATE_SENDING,
+        STATE_RECEIVING
+    };
+
+    static const DWORD      RECEIVE_BUFFER_SIZE = 4 * 1024;
+
+    HRESULT
+    Open(
+        VOID
+    );
+
+    //
+    // No I/O may be pending, its completion would find the socket gone.
+    //
+    VOID
+    Close(
+        VOID
+    );
+
+    //
+    // Starts over on a new socket, the reused one was closed by the
+    // backend while idle.
+    //
+    HRESULT
+    Reconnect(
+        VOID
+    );
+
+    //
+    // Issues the next step of the request unless it timed out meanwhile,
+    // see TimeoutCallback.
+    //
+    HRESULT
+    Issue(
+        STATE                           state
+    );
+
+    VOID
+    OnIoCompleted(
+        ULONG                           ulIoResult,
+        DWORD                           cbTransferred
+    );
+
+    VOID
+    Complete(
+        HRESULT                         hr
+    );
+
+    static
+    VOID
+    CALLBACK
+    IoCompletionCallback(
+        PTP_CALLBACK_INSTANCE           pInstance,
+        PVOID                           pvContext,
+        PVOID                           pvOverlapped,
+        ULONG                           ulIoResult,
+        ULONG_PTR                       cbTransferred,
+        PTP_IO                          pIo
+    );
+
+    static
+    VOID
+    CALLBACK
+    TimeoutCallback(
+        PVOID                           pContext
+    );
+
+    LOOPBACK_HTTP_CLIENT *          m_pClient;
+    SOCKET                          m_socket;
+    PTP_IO                          m_pIo;
+    OVERLAPPED                      m_overlapped;
+    STATE                           m_state;
+    BOOL                            m_fReused;
+
+    STRA                            m_straRequest;
+    DWORD                           m_cbSent;
+    LOOPBACK_RESPONSE_PARSER        m_parser;
+    BYTE                            m_rgbBuffer[RECEIVE_BUFFER_SIZE];
+
+    PFN_LOOPBACK_REQUEST_COMPLETION m_pfnCompletion;
+    PVOID                           m_pContext;
+
+    //
+    // m_srwLock orders a timeout cancelling the I/O in flight with the
+    // next step being issued, so that none is issued once timed out.
+    //
+    TimerWheel::Timer               m_timer;
+    SRWLOCK                         m_srwLock;
+    BOOL                            m_fTimedOut;
+};
+
+//
+// Purpose-built HTTP/1.1 client for one backend process on the loopback,
+// with its own pool of keep-alive sockets and none of the proxy, auth and
+// callback machinery of WinHTTP. Requests are bodyless and their response
+// body is skipped, which is what the health probes need; forwarded
+// requests still go through FORWARDER_CONNECTION.
+//
+class LOOPBACK_HTTP_CLIENT
+{
+public:
+    LOOPBACK_HTTP_CLIENT(
+        VOID
+    );
+
+    HRESULT
+    Initialize(
+        DWORD   dwPort
+    );
+
+    //
+    // Sends "pszMethod pszPath HTTP/1.1" with pszHeaders, each line ended
+    // by CRLF, and calls pfnCompletion with the status of the response.
+    // Nothing is called when it fails. Not for HEAD, its response would be
+    // read as having the body it announces.
+    //
+    HRESULT
+    SendRequest(
+        _In_ PCSTR                      pszMethod,
+        _In_ PCSTR                      pszPath,
+        _In_ PCSTR                      pszHeaders,
+        DWORD                           dwTimeoutInMS,
+        PFN_LOOPBACK_REQUEST_COMPLETION pfnCompletion,
+        PVOID                           pContext
+    );
+
+    //
+    // Closes the idle sockets, the ones of requests in flight are closed
+    // once they complete.
+    //
+    VOID
+    Shutdown(
+        VOID
+    );
+
+    //
+    // The connection is done with its request. Kept for the next one when
+    // fKeepAlive, closed otherwise.
+    //
+    VOID
+    ReleaseConnection(
+        _In_ LOOPBACK_CONNECTION *      pConnection,
+        BOOL                            fKeepAlive
+    );
+
+    DWORD
+    QueryPort() const
+    {
+        return m_dwPort;
+    }
+
+    VOID
+    ReferenceLoopbackHttpClient() const
+    {
+        InterlockedIncrement(&m_cRefs);
+    }
+
+    VOID
+    DereferenceLoopbackHttpClient() const
+    {
+        if (InterlockedDecrement(&m_cRefs) == 0)
+        {
+            delete this;
+        }
+    }
+
+private:
+    static const DWORD      MAX_IDLE_CONNECTIONS = 4;
+
+    ~LOOPBACK_HTTP_CLIENT();
+
+    mutable LONG            m_cRefs;
+    DWORD                   m_dwPort;
+    volatile BOOL           m_fShutdown;
+
+    SRWLOCK                 m_srwLock;
+    LOOPBACK_CONNECTION *   m_rgpIdleConnections[MAX_IDLE_CONNECTIONS];
+    DWORD                   m_cIdleConnections;
+};
@@ -10,13 +10,21 @@ OUT_OF_PROCESS_APPLICATION::OUT_OF_PROCESS_APPLICATION(
     std::unique_ptr<REQUESTHANDLER_CONFIG> pConfig) :
     AppOfflineTrackingApplication(pApplication),
     m_fWebSocketSupported(WEBSOCKET_STATUS::WEBSOCKET_UNKNOWN),
-    m_pConfig(std::move(pConfig))
+    m_pConfig(std::move(pConfig)),
+    m_fProcessStartInProgress(FALSE),
+    m_lEagerStartTriggered(0),
+    m_cEagerStartsPending(0),
+    m_fEagerStartSucceeded(FALSE)
 {
     m_pProcessManager = NULL;
+    InitializeSRWLock(&m_srwLockProcessStart);
 }
 
 OUT_OF_PROCESS_APPLICATION::~OUT_OF_PROCESS_APPLICATION()
 {
+    // Publishing reads the process manager's counters.
+    m_countersPublisher.Stop();
+
     SRWExclusiveLock lock(m_stopLock);
     if (m_pProcessManager != NULL)
     {
@@ -33,8 +41,27 @@ OUT_OF_PROCESS_APPLICATION::Initialize(
     if (m_pProcessManager == NULL)
     {
         m_pProcessManager = new PROCESS_MANAGER();
-        RETURN_IF_FAILED(m_pProcessManager->Initialize());
+        RETURN_IF_FAILED(m_pProcessManager->Initialize(m_pConfig->QueryIsolateWinHttpSession()));
     }
+
+    // WebSockets are still proxied, just not counted, without the counters.
+    LOG_IF_FAILED(m_webSocketCounters.Initialize());
+
+    LOG_IF_FAILED(m_counters.Initialize());
+
+    if (m_pConfig->QueryResponseCacheSize() != 0)
+    {
+        std::unique_ptr<RESPONSE_CACHE> pResponseCache(new RESPONSE_CACHE(m_pConfig->QueryResponseCacheSize()));
+        RETURN_IF_FAILED(pResponseCache->Initialize());
+        m_pResponseCache = std::move(pResponseCache);
+    }
+    LOG_IF_FAILED(m_countersPublisher.Start(QueryApplicationId(),
+        [this](APPLICATION_COUNTERS::SNAPSHOT* pSnapshot)
+        {
+            m_counters.AddToSnapshot(pSnapshot);
+            m_pProcessManager->QueryCounters()->AddToSnapshot(pSnapshot);
+        }));
+
     return S_OK;
 }
 
@@ -43,7 +70,203 @@ OUT_OF_PROCESS_APPLICATION::GetProcess(
     _Out_   SERVER_PROCESS       **ppServerProcess
 )
 {
-    return m_pProcessManager->GetProcess(m_pConfig.get(), QueryWebsocketStatus(), ppServerProcess);
+    RETURN_IF_FAILED(m_pProcessManager->GetProcess(m_pConfig.get(), QueryWebsocketStatus(), ppServerProcess));
+
+    StartStandbyFillIfNeeded();
+    StartIdleRestoreIfNeeded();
+
+    return S_OK;
+}
+
+HRESULT
+OUT_OF_PROCESS_APPLICATION::GetProcessAsync(
+    _In_    FORWARDING_HANDLER   *pWaiter,
+    _Out_   SERVER_PROCESS       **ppServerProcess
+)
+{
+    RETURN_IF_FAILED(m_pProcessManager->GetReadyProcess(m_pConfig.get(), ppServerProcess));
+
+    if (*ppServerProcess != NULL)
+    {
+        StartStandbyFillIfNeeded();
+        StartIdleRestoreIfNeeded();
+        return S_OK;
+    }
+
+    {
+        SRWExclusiveLock lock(m_srwLockProcessStart);
+
+        pWaiter->ReferenceRequestHandler();
+        m_processStartWaiters.push_back(pWaiter);
+
+        if (m_fProcessStartInProgress)
+        {
+            return HRESULT_FROM_WIN32(ERROR_IO_PENDING);
+        }
+
+        //
+        // The callback owns a reference on the application so m_pConfig
+        // outlives it.
+        //
+        auto application = ::ReferenceApplication(this);
+        if (TrySubmitThreadpoolCallback(StartProcessCallback, application.get(), NULL))
+        {
+            application.release();
+            m_fProcessStartInProgress = TRUE;
+            return HRESULT_FROM_WIN32(ERROR_IO_PENDING);
+        }
+
+        LOG_LAST_ERROR();
+        m_processStartWaiters.pop_back();
+        pWaiter->DereferenceRequestHandler();
+    }
+
+    //
+    // No thread pool work item, start the process on this thread.
+    //
+    return GetProcess(ppServerProcess);
+}
+
+// static
+VOID
+CALLBACK
+OUT_OF_PROCESS_APPLICATION::StartProcessCallback(
+    _Inout_ PTP_CALLBACK_INSTANCE   Instance,
+    _Inout_opt_ PVOID               pContext
+)
+{
+    UNREFERENCED_PARAMETER(Instance);
+
+    std::unique_ptr<OUT_OF_PROCESS_APPLICATION, IAPPLICATION_DELETER> application(
+        static_cast<OUT_OF_PROCESS_APPLICATION*>(pContext));
+    SERVER_PROCESS* pServerProcess = NULL;
+
+    //
+    // The process ends up in the snapshot, parked requests get it from
+    // there when they resume.
+    //
+    HRESULT hr = application->GetProcess(&pServerProcess);
+    if (pServerProcess != NULL)
+    {
+        pServerProcess->DereferenceServerProcess();
+    }
+
+    application->CompleteProcessStartWaiters(hr, TRUE);
+}
+
+VOID
+OUT_OF_PROCESS_APPLICATION::CompleteProcessStartWaiters(
+    HRESULT hr,
+    BOOL    fStartDone
+)
+{
+    std::vector<FORWARDING_HANDLER*> waiters;
+
+    {
+        SRWExclusiveLock lock(m_srwLockProcessStart);
+        waiters.swap(m_processStartWaiters);
+        if (fStartDone)
+        {
+            m_fProcessStartInProgress = FALSE;
+        }
+    }
+
+    for (FORWARDING_HANDLER* pWaiter : waiters)
+    {
+        pWaiter->OnProcessStartCompleted(hr);
+        pWaiter->DereferenceRequestHandler();
+    }
+}
+
+VOID
+OUT_OF_PROCESS_APPLICATION::StartAllProcesses()
+{
+    DWORD cProcesses = max(m_pConfig->QueryProcessesPerApplication(), 1);
+
+    {
+        SRWExclusiveLock lock(m_srwLockProcessStart);
+
+        if (m_fProcessStartInProgress)
+        {
+            return;
+        }
+
+        //
+        // Requests arriving meanwhile are parked in GetProcessAsync and
+        // resumed as soon as the first process is ready.
+        //
+        m_fProcessStartInProgress = TRUE;
+        m_cEagerStartsPending = cProcesses;
+    }
+
+    for (DWORD i = 0; i < cProcesses; ++i)
+    {
+        std::thread startThread([](std::unique_ptr<OUT_OF_PROCESS_APPLICATION, IAPPLICATION_DELETER> application, DWORD dwProcessIndex)
+            {
+                application->EagerStartProcess(dwProcessIndex);
+            }, ::ReferenceApplication(this), i);
+
+        startThread.detach();
+    }
+}
+
+VOID
+OUT_OF_PROCESS_APPLICATION::EagerStartProcess(
+    DWORD dwProcessIndex
+)
+{
+    HRESULT hr = m_pProcessManager->StartProcessInSlot(m_pConfig.get(), QueryWebsocketStatus(), dwProcessIndex);
+    if (SUCCEEDED_LOG(hr))
+    {
+        m_fEagerStartSucceeded = TRUE;
+    }
+
+    BOOL fStartDone = InterlockedDecrement(&m_cEagerStartsPending) == 0;
+
+    if (SUCCEEDED(hr) || fStartDone)
+    {
+        CompleteProcessStartWaiters(m_fEagerStartSucceeded ? S_OK : hr, fStartDone);
+    }
+}
+
+VOID
+OUT_OF_PROCESS_APPLICATION::StartStandbyFillIfNeeded()
+{
+    if (m_pProcessManager->TryBeginStandbyFill())
+    {
+        //
+        // Keep spare processes started in the background; the thread holds
+        // a reference on the application so m_pConfig outlives it.
+        //
+        std::thread standbyThread([](std::unique_ptr<OUT_OF_PROCESS_APPLICATION, IAPPLICATION_DELETER> application)
+            {
+                application->m_pProcessManager->FillStandbyProcesses(
+                    application->m_pConfig.get(),
+                    application->QueryWebsocketStatus());
+            }, ::ReferenceApplication(this));
+
+        standbyThread.detach();
+    }
+}
+
+VOID
+OUT_OF_PROCESS_APPLICATION::StartIdleRestoreIfNeeded()
+{
+    if (m_pProcessManager->TryBeginIdleRestore())
+    {
+        //
+        // Bring back the processes shut down while idle, the thread holds a
+        // reference on the application like the standby fill does.
+        //
+        std::thread restoreThread([](std::unique_ptr<OUT_OF_PROCESS_APPLICATION, IAPPLICATION_DELETER> application)
+            {
+                application->m_pProcessManager->RestoreIdleProcesses(
+                    application->m_pConfig.get(),
+                    application->QueryWebsocketStatus());
+            }, ::ReferenceApplication(this));
+
+        restoreThread.detach();
+    }
 }
 
 __override
@@ -71,6 +294,30 @@ OUT_OF_PROCESS_APPLICATION::CreateHandler(
         SetWebsocketStatus(pHttpContext);
     }
 
+    //
+    // The websocket status is known now, so the processes can be started.
+    //
+    if (m_lEagerStartTriggered == 0 &&
+        m_pConfig->QueryEagerProcessStartup()->Equals(L"true", /* ignoreCase */ 1) &&
+        InterlockedCompareExchange(&m_lEagerStartTriggered, 1L, 0L) == 0L)
+    {
+        StartAllProcesses();
+    }
+
+    if (m_pResponseCache != NULL && RESPONSE_CACHE::IsCacheableRequest(pHttpContext))
+    {
+        STACK_STRA(strKey, 256);
+        if (SUCCEEDED_LOG(RESPONSE_CACHE::BuildKey(pHttpContext->GetRequest(), &strKey)))
+        {
+            RESPONSE_CACHE_ENTRY* pEntry = m_pResponseCache->Lookup(pHttpContext->GetRequest(), strKey);
+            if (pEntry != NULL)
+            {
+                *pRequestHandler = new CACHED_RESPONSE_HANDLER(*pHttpContext, pEntry);
+                return S_OK;
+            }
+        }
+    }
+
     pHandler = new FORWARDING_HANDLER(pHttpContext, ::ReferenceApplication(this));
     *pRequestHandler = pHandler;
     return S_OK;
@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include <thread>
+#include <vector>
 #include "AppOfflineTrackingApplication.h"
 
 class OUT_OF_PROCESS_APPLICATION : public AppOfflineTrackingApplication
@@ -25,11 +27,25 @@ public:
     HRESULT
     Initialize();
 
+    //
+    // Returns a referenced process, see PROCESS_MANAGER::GetProcess.
+    //
     HRESULT
     GetProcess(
         _Out_   SERVER_PROCESS       **ppServerProcess
     );
 
+    //
+    // Returns a referenced ready process, or HRESULT_FROM_WIN32(ERROR_IO_PENDING)
+    // when one has to be started first. The start then runs on the thread
+    // pool and pWaiter->OnProcessStartCompleted() is called once it is done.
+    //
+    HRESULT
+    GetProcessAsync(
+        _In_    FORWARDING_HANDLER   *pWaiter,
+        _Out_   SERVER_PROCESS       **ppServerProcess
+    );
+
     __override
     VOID
     StopInternal(bool fServerInitiated)
@@ -51,13 +67,74 @@ public:
         return m_pConfig.get();
     }
 
+    WEBSOCKET_COUNTERS* QueryWebSocketCounters()
+    {
+        return &m_webSocketCounters;
+    }
+
+    APPLICATION_COUNTERS* QueryCounters()
+    {
+        return &m_counters;
+    }
+
+    // NULL when responseCacheSize is 0.
+    RESPONSE_CACHE* QueryResponseCache()
+    {
+        return m_pResponseCache.get();
+    }
+
+    CLIENT_CERT_CACHE* QueryClientCertCache()
+    {
+        return &m_clientCertCache;
+    }
+
 private:
 
     VOID SetWebsocketStatus(IHttpContext *pHttpContext);
 
+    VOID StartStandbyFillIfNeeded();
+
+    VOID StartIdleRestoreIfNeeded();
+
+    VOID StartAllProcesses();
+
+    VOID EagerStartProcess(DWORD dwProcessIndex);
+
+    VOID CompleteProcessStartWaiters(HRESULT hr, BOOL fStartDone);
+
+    static
+    VOID
+    CALLBACK
+    StartProcessCallback(
+        _Inout_ PTP_CALLBACK_INSTANCE   Instance,
+        _Inout_opt_ PVOID               pContext
+    );
+
     PROCESS_MANAGER * m_pProcessManager;
     IHttpServer      *m_pHttpServer;
 
     WEBSOCKET_STATUS              m_fWebSocketSupported;
     std::unique_ptr<REQUESTHANDLER_CONFIG> m_pConfig;
+    WEBSOCKET_COUNTERS            m_webSocketCounters;
+    // Requests of the application, the process manager counts its own.
+    APPLICATION_COUNTERS          m_counters;
+    APPLICATION_COUNTERS_PUBLISHER m_countersPublisher;
+    std::unique_ptr<RESPONSE_CACHE> m_pResponseCache;
+    CLIENT_CERT_CACHE             m_clientCertCache;
+
+    //
+    // Requests parked until the process start in progress completes,
+    // each holds a reference. Guarded by m_srwLockProcessStart.
+    //
+    SRWLOCK                          m_srwLockProcessStart;
+    std::vector<FORWARDING_HANDLER*> m_processStartWaiters;
+    BOOL                             m_fProcessStartInProgress;
+
+    //
+    // eagerProcessStartup: set once the start of all processes was
+    // triggered, and the number of those starts still running.
+    //
+    volatile LONG                    m_lEagerStartTriggered;
+    volatile LONG                    m_cEagerStartsPending;
+    volatile BOOL                    m_fEagerStartSucceeded;
 };
@@ -0,0 +1,87 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "portallocator.h"
+#include "SRWExclusiveLock.h"
+
+SRWLOCK   PORT_ALLOCATOR::sm_srwLock = SRWLOCK_INIT;
+ULONGLONG PORT_ALLOCATOR::sm_rgPorts[PORT_ALLOCATOR::WORD_COUNT] = {};
+DWORD     PORT_ALLOCATOR::sm_dwNextIndex = 0;
+BOOL      PORT_ALLOCATOR::sm_fNextIndexSet = FALSE;
+
+//static
+HRESULT
+PORT_ALLOCATOR::Acquire(
+    DWORD           dwExcludedPort,
+    _Out_ DWORD *   pdwPort
+)
+{
+    SRWExclusiveLock lock(sm_srwLock);
+
+    *pdwPort = 0;
+
+    if (!sm_fNextIndexSet)
+    {
+        //
+        // Each worker of the pool starts elsewhere in the range, the
+        // workers don't see each other's ports.
+        //
+        sm_dwNextIndex = std::random_device()() % PORT_COUNT;
+        sm_fNextIndexSet = TRUE;
+    }
+
+    //
+    // One more word than the bitmap has, the word the scan starts in is
+    // looked at again for the bits before the start.
+    //
+    DWORD dwIndex = sm_dwNextIndex;
+    for (DWORD cWords = 0; cWords <= WORD_COUNT; cWords++)
+    {
+        const DWORD iWord = dwIndex / 64;
+        ULONGLONG   ullFree = ~sm_rgPorts[iWord] & (~0ULL << (dwIndex % 64));
+        if (iWord == WORD_COUNT - 1 && PORT_COUNT % 64 != 0)
+        {
+            ullFree &= (1ULL << (PORT_COUNT % 64)) - 1;
+        }
+
+        if (dwExcludedPort >= MIN_PORT_RANDOM &&
+            dwExcludedPort <= MAX_PORT &&
+            (dwExcludedPort - MIN_PORT_RANDOM) / 64 == iWord)
+        {
+            ullFree &= ~(1ULL << ((dwExcludedPort - MIN_PORT_RANDOM) % 64));
+        }
+
+        unsigned long iBit;
+        if (_BitScanForward64(&iBit, ullFree))
+        {
+            const DWORD dwPicked = iWord * 64 + iBit;
+
+            sm_rgPorts[iWord] |= 1ULL << iBit;
+            sm_dwNextIndex = (dwPicked + 1) % PORT_COUNT;
+
+            *pdwPort = MIN_PORT_RANDOM + dwPicked;
+            return S_OK;
+        }
+
+        dwIndex = (iWord + 1) % WORD_COUNT * 64;
+    }
+
+    // Every port of the range is used by a backend of this worker.
+    RETURN_HR(HRESULT_FROM_WIN32(ERROR_PORT_NOT_SET));
+}
+
+//static
+VOID
+PORT_ALLOCATOR::Release(
+    DWORD           dwPort
+)
+{
+    DBG_ASSERT(dwPort >= MIN_PORT_RANDOM && dwPort <= MAX_PORT);
+
+    const DWORD dwIndex = dwPort - MIN_PORT_RANDOM;
+
+    SRWExclusiveLock lock(sm_srwLock);
+
+    DBG_ASSERT((sm_rgPorts[dwIndex / 64] & (1ULL << (dwIndex % 64))) != 0);
+    sm_rgPorts[dwIndex / 64] &= ~(1ULL << (dwIndex % 64));
+}
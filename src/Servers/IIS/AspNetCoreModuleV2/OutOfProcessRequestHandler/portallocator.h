@@ -0,0 +1,46 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// Ports of [MIN_PORT_RANDOM, MAX_PORT] handed out to the backends this
+// worker process starts, shared by all of its applications.
+//
+// Two backends of the worker never get the same port, even while neither
+// is listening yet, which a bind probe alone can't tell. Ports are handed
+// out next-fit from a random start: each pick is a scan of the bitmap
+// words rather than random draws, and a released port is the last one to
+// be picked again. Ports used by other processes are still found with
+// SERVER_PROCESS::IsPortAvailable.
+//
+class PORT_ALLOCATOR
+{
+public:
+    //
+    // Marks the next free port other than dwExcludedPort, which must be
+    // given back with Release once its backend is gone.
+    //
+    static
+    HRESULT
+    Acquire(
+        DWORD           dwExcludedPort,
+        _Out_ DWORD *   pdwPort
+    );
+
+    static
+    VOID
+    Release(
+        DWORD           dwPort
+    );
+
+private:
+    static const DWORD  PORT_COUNT = MAX_PORT - MIN_PORT_RANDOM + 1;
+    static const DWORD  WORD_COUNT = (PORT_COUNT + 63) / 64;
+
+    static SRWLOCK      sm_srwLock;
+    // Bit i of word i / 64 set while MIN_PORT_RANDOM + i is handed out.
+    static ULONGLONG    sm_rgPorts[WORD_COUNT];
+    static DWORD        sm_dwNextIndex;
+    static BOOL         sm_fNextIndexSet;
+};
@@ -5,12 +5,14 @@
 #include "EventLog.h"
 #include "exceptions.h"
 #include "SRWSharedLock.h"
+#include "SRWExclusiveLock.h"
+#include <thread>
 
 volatile BOOL               PROCESS_MANAGER::sm_fWSAStartupDone = FALSE;
 
 HRESULT
 PROCESS_MANAGER::Initialize(
-    VOID
+    BOOL    fIsolateWinHttpSession
 )
 {
     WSADATA                              wsaData;
@@ -18,7 +20,7 @@ PROCESS_MANAGER::Initialize(
 
     if( !sm_fWSAStartupDone )
     {
-        auto lock = SRWExclusiveLock(m_srwLock);
+        auto lock = SRWExclusiveLock(m_srwLock, LockSite::ProcessManager);
 
         if( !sm_fWSAStartupDone )
         {
@@ -30,7 +32,14 @@ PROCESS_MANAGER::Initialize(
         }
     }
 
-    m_dwRapidFailTickStart = GetTickCount();
+
+    if( m_pSnapshotReaders == nullptr )
+    {
+        RETURN_IF_FAILED(EpochReaders::Create(m_pSnapshotReaders));
+    }
+
+    // Processes are still managed, just not counted, without the counters.
+    LOG_IF_FAILED(m_counters.Initialize());
 
     if( m_hNULHandle == NULL )
     {
@@ -49,134 +58,1348 @@ PROCESS_MANAGER::Initialize(
         RETURN_LAST_ERROR_IF( m_hNULHandle == INVALID_HANDLE_VALUE );
     }
 
+    if( fIsolateWinHttpSession && m_pForwarderSession == NULL )
+    {
+        RETURN_IF_FAILED(FORWARDER_SESSION::Create(&m_pForwarderSession));
+    }
+
     return S_OK;
 }
 
 PROCESS_MANAGER::~PROCESS_MANAGER()
 {
+    m_idleTimer.Cancel();
+
+    for (DWORD i = 0; i < m_cStandbyProcesses; ++i)
+    {
+        m_rgpStandbyProcesses[i]->DereferenceServerProcess();
+        m_rgpStandbyProcesses[i] = NULL;
+    }
+    m_cStandbyProcesses = 0;
+
+    if (m_pSnapshot != NULL)
+    {
+        FreeSnapshot(m_pSnapshot);
+        m_pSnapshot = NULL;
+    }
+
+    FreeSnapshots(m_pRetiredSnapshots);
+    m_pRetiredSnapshots = NULL;
+
+    // Connections still in use by requests hold their own reference.
+    if (m_pForwarderSession != NULL)
+    {
+        m_pForwarderSession->DereferenceForwarderSession();
+        m_pForwarderSession = NULL;
+    }
+}
+
+PROCESS_LIST_SNAPSHOT*
+PROCESS_MANAGER::AcquireSnapshot(
+    _Out_ LONG**    ppcReaders
+)
+/*++
+
+Routine Description:
+
+    Enter a read of the published snapshot, see EpochReaders. The counter
+    is per CPU to keep the request path free of a shared cache line; the
+    caller hands it back to ReleaseSnapshot.
+
+--*/
+{
+    *ppcReaders = m_pSnapshotReaders->Enter();
+
+    return static_cast<PROCESS_LIST_SNAPSHOT*>(ReadPointerAcquire(
+        reinterpret_cast<PVOID volatile*>(&m_pSnapshot)));
+}
+
+VOID
+PROCESS_MANAGER::ReleaseSnapshot(
+    _In_ LONG*      pcReaders
+)
+{
+    EpochReaders::Exit(pcReaders);
+
+    //
+    // Snapshots retired while readers held them are reclaimed by the
+    // readers that come after, when no writer does. A reader never waits
+    // for the lock, and frees outside of it.
+    //
+    if (ReadPointerNoFence(reinterpret_cast<PVOID volatile*>(&m_pRetiredSnapshots)) != NULL &&
+        TryAcquireSRWLockExclusive(&m_srwLock))
+    {
+        PROCESS_LIST_SNAPSHOT* pReclaimed = ReclaimSnapshotsNoLock();
+        ReleaseSRWLockExclusive(&m_srwLock);
+
+        FreeSnapshots(pReclaimed);
+    }
 }
 
+// static
 HRESULT
-PROCESS_MANAGER::GetProcess(
-    _In_    REQUESTHANDLER_CONFIG      *pConfig,
-    _In_    BOOL                        fWebsocketSupported,
-    _Out_   SERVER_PROCESS            **ppServerProcess
+PROCESS_MANAGER::CreateSnapshot(
+    _In_opt_ const PROCESS_LIST_SNAPSHOT*   pSource,
+    DWORD                                   cProcesses,
+    DWORD                                   dwReplaceIndex,
+    _In_opt_ SERVER_PROCESS*                pReplacement,
+    _Out_ PROCESS_LIST_SNAPSHOT**           ppSnapshot
 )
+/*++
+
+Routine Description:
+
+    Copy pSource (or start from an empty list) with the slot dwReplaceIndex
+    set to pReplacement. Pass MAXDWORD as dwReplaceIndex to clear every slot.
+
+--*/
 {
-    DWORD            dwProcessIndex = 0;
-    std::unique_ptr<SERVER_PROCESS>  pSelectedServerProcess;
+    DBG_ASSERT(cProcesses != 0);
+    DBG_ASSERT(pSource == NULL || pSource->cProcesses == cProcesses);
 
-    if (InterlockedCompareExchange(&m_lStopping, 1L, 1L) == 1L)
+    SIZE_T cbSnapshot = FIELD_OFFSET(PROCESS_LIST_SNAPSHOT, rgProcesses) +
+        cProcesses * sizeof(SERVER_PROCESS*);
+
+    auto pSnapshot = static_cast<PROCESS_LIST_SNAPSHOT*>(HeapAlloc(GetProcessHeap(), 0, cbSnapshot));
+    if (pSnapshot == NULL)
     {
-        RETURN_IF_FAILED(E_APPLICATION_EXITING);
+        RETURN_HR(E_OUTOFMEMORY);
     }
 
-    if (!m_fServerProcessListReady)
+    pSnapshot->pNextRetired = NULL;
+    pSnapshot->lRetiredEpoch = 0;
+    pSnapshot->cProcesses = cProcesses;
+
+    for (DWORD i = 0; i < cProcesses; ++i)
     {
-        auto lock = SRWExclusiveLock(m_srwLock);
+        SERVER_PROCESS* pServerProcess = NULL;
+        if (dwReplaceIndex == MAXDWORD)
+        {
+            pServerProcess = NULL;
+        }
+        else if (i == dwReplaceIndex)
+        {
+            pServerProcess = pReplacement;
+        }
+        else if (pSource != NULL)
+        {
+            pServerProcess = pSource->rgProcesses[i];
+        }
 
-        if (!m_fServerProcessListReady)
+        if (pServerProcess != NULL)
         {
-            m_dwProcessesPerApplication = pConfig->QueryProcessesPerApplication();
-            m_ppServerProcessList = new SERVER_PROCESS*[m_dwProcessesPerApplication];
+            pServerProcess->ReferenceServerProcess();
+        }
+        pSnapshot->rgProcesses[i] = pServerProcess;
+    }
 
-            for (DWORD i = 0; i < m_dwProcessesPerApplication; ++i)
-            {
-                m_ppServerProcessList[i] = NULL;
-            }
+    *ppSnapshot = pSnapshot;
+    return S_OK;
+}
+
+// static
+VOID
+PROCESS_MANAGER::FreeSnapshot(
+    _In_ PROCESS_LIST_SNAPSHOT* pSnapshot
+)
+{
+    for (DWORD i = 0; i < pSnapshot->cProcesses; ++i)
+    {
+        if (pSnapshot->rgProcesses[i] != NULL)
+        {
+            pSnapshot->rgProcesses[i]->DereferenceServerProcess();
         }
-        m_fServerProcessListReady = TRUE;
     }
 
+    HeapFree(GetProcessHeap(), 0, pSnapshot);
+}
+
+// static
+VOID
+PROCESS_MANAGER::FreeSnapshots(
+    _In_opt_ PROCESS_LIST_SNAPSHOT* pSnapshots
+)
+{
+    while (pSnapshots != NULL)
     {
-        auto lock = SRWSharedLock(m_srwLock);
+        PROCESS_LIST_SNAPSHOT* pSnapshot = pSnapshots;
+        pSnapshots = pSnapshot->pNextRetired;
+        FreeSnapshot(pSnapshot);
+    }
+}
 
-        //
-        // round robin through to the next available process.
-        //
-        dwProcessIndex = InterlockedIncrement(&m_dwRouteToProcessIndex);
-        dwProcessIndex = dwProcessIndex % m_dwProcessesPerApplication;
+VOID
+PROCESS_MANAGER::PublishSnapshotNoLock(
+    _In_ PROCESS_LIST_SNAPSHOT* pSnapshot
+)
+{
+    PROCESS_LIST_SNAPSHOT* pPrevious = static_cast<PROCESS_LIST_SNAPSHOT*>(
+        InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&m_pSnapshot), pSnapshot));
+
+    if (pPrevious != NULL)
+    {
+        pPrevious->lRetiredEpoch = m_pSnapshotReaders->QueryEpoch();
+        pPrevious->pNextRetired = m_pRetiredSnapshots;
+        m_pRetiredSnapshots = pPrevious;
+    }
+
+    FreeSnapshots(ReclaimSnapshotsNoLock());
+}
+
+PROCESS_LIST_SNAPSHOT*
+PROCESS_MANAGER::ReclaimSnapshotsNoLock(
+    VOID
+)
+/*++
+
+Routine Description:
+
+    Advance the reader epoch and detach the retired snapshots no reader can
+    still be looking at, see EpochReaders.
+
+--*/
+{
+    if (m_pRetiredSnapshots == NULL)
+    {
+        return NULL;
+    }
+
+    m_pSnapshotReaders->Advance();
+
+    // Newest first, everything past the first free one is older still.
+    PROCESS_LIST_SNAPSHOT* volatile* ppRetired = &m_pRetiredSnapshots;
+    while (*ppRetired != NULL && !m_pSnapshotReaders->IsReclaimable((*ppRetired)->lRetiredEpoch))
+    {
+        ppRetired = &(*ppRetired)->pNextRetired;
+    }
 
-        if (m_ppServerProcessList[dwProcessIndex] != NULL &&
-            m_ppServerProcessList[dwProcessIndex]->IsReady())
+    PROCESS_LIST_SNAPSHOT* pReclaimed = *ppRetired;
+    *ppRetired = NULL;
+    return pReclaimed;
+}
+
+VOID
+PROCESS_MANAGER::ShutdownProcessNoLock(
+    SERVER_PROCESS* pServerProcess
+)
+{
+    for (DWORD i = 0; i < m_cStandbyProcesses; ++i)
+    {
+        if (m_rgpStandbyProcesses[i]->GetPort() == pServerProcess->GetPort())
         {
-            *ppServerProcess = m_ppServerProcessList[dwProcessIndex];
-            return S_OK;
+            // a standby process exited before being promoted.
+            m_rgpStandbyProcesses[i]->StopProcess();
+            m_rgpStandbyProcesses[i]->DereferenceServerProcess();
+            m_rgpStandbyProcesses[i] = m_rgpStandbyProcesses[--m_cStandbyProcesses];
+            m_rgpStandbyProcesses[m_cStandbyProcesses] = NULL;
+            return;
         }
     }
 
-    // should make the lock per process so that we can start processes simultaneously ?
-    if (m_ppServerProcessList[dwProcessIndex] == NULL ||
-        !m_ppServerProcessList[dwProcessIndex]->IsReady())
+    PROCESS_LIST_SNAPSHOT* pCurrent = m_pSnapshot;
+
+    if (pCurrent == NULL)
     {
-        auto lock = SRWExclusiveLock(m_srwLock);
+        return;
+    }
 
-        if (m_ppServerProcessList[dwProcessIndex] != NULL)
+    for (DWORD i = 0; i < pCurrent->cProcesses; ++i)
+    {
+        if (pCurrent->rgProcesses[i] != NULL &&
+            pCurrent->rgProcesses[i]->GetPort() == pServerProcess->GetPort())
         {
-            if (!m_ppServerProcessList[dwProcessIndex]->IsReady())
+            // shutdown pServerProcess if not already shutdown.
+            pCurrent->rgProcesses[i]->StopProcess();
+
+            // The next request for the slot starts its replacement.
+            if (m_lStopping == 0)
+            {
+                m_counters.BackendRestarted();
+            }
+
+            PROCESS_LIST_SNAPSHOT* pSnapshot = NULL;
+            if (FAILED_LOG(CreateSnapshot(pCurrent, pCurrent->cProcesses, i, NULL, &pSnapshot)))
             {
                 //
-                // terminate existing process that is not ready
-                // before creating new one.
+                // The stopped process stays listed, it is not ready anymore
+                // so GetProcess replaces it on the next request.
                 //
-                ShutdownProcessNoLock( m_ppServerProcessList[dwProcessIndex] );
+                return;
             }
-            else
+
+            PublishSnapshotNoLock(pSnapshot);
+            pCurrent = pSnapshot;
+        }
+    }
+}
+
+VOID
+PROCESS_MANAGER::ShutdownAllProcessesNoLock(
+    _Inout_ std::vector<SERVER_PROCESS*> & signaled
+)
+{
+    //
+    // Every process is signaled before waiting for any, so that they shut
+    // down concurrently within one shutdown time limit. The wait is left
+    // to the caller, GetProcess and ShutdownProcess don't block behind it.
+    //
+    PROCESS_LIST_SNAPSHOT* pCurrent = m_pSnapshot;
+
+    try
+    {
+        signaled.reserve((pCurrent != NULL ? pCurrent->cProcesses : 0) + m_cStandbyProcesses);
+    }
+    catch (...)
+    {
+        OBSERVE_CAUGHT_EXCEPTION();
+    }
+
+    const auto signal = [&signaled](SERVER_PROCESS* pServerProcess)
+    {
+        if (signaled.capacity() == signaled.size())
+        {
+            // One at a time after all.
+            pServerProcess->SendSignal();
+        }
+        else if (pServerProcess->BeginSignal())
+        {
+            signaled.push_back(pServerProcess);
+        }
+    };
+
+    for (DWORD i = 0; i < m_cStandbyProcesses; ++i)
+    {
+        signal(m_rgpStandbyProcesses[i]);
+        m_rgpStandbyProcesses[i]->DereferenceServerProcess();
+        m_rgpStandbyProcesses[i] = NULL;
+    }
+    m_cStandbyProcesses = 0;
+
+    if (pCurrent != NULL)
+    {
+        for (DWORD i = 0; i < pCurrent->cProcesses; ++i)
+        {
+            if (pCurrent->rgProcesses[i] != NULL)
             {
-                // server is already up and ready to serve requests.
-                //m_ppServerProcessList[dwProcessIndex]->ReferenceServerProcess();
-                *ppServerProcess = m_ppServerProcessList[dwProcessIndex];
-                return S_OK;
+                // shutdown pServerProcess if not already shutdown.
+                signal(pCurrent->rgProcesses[i]);
             }
         }
+    }
+
+    if (pCurrent == NULL)
+    {
+        return;
+    }
+
+    PROCESS_LIST_SNAPSHOT* pSnapshot = NULL;
+    if (SUCCEEDED_LOG(CreateSnapshot(pCurrent, pCurrent->cProcesses, MAXDWORD, NULL, &pSnapshot)))
+    {
+        PublishSnapshotNoLock(pSnapshot);
+    }
+}
+
+// static
+VOID
+PROCESS_MANAGER::CompleteSignals(
+    _In_ const std::vector<SERVER_PROCESS*> & signaled
+)
+{
+    // BeginSignal holds a reference until CompleteSignal.
+    for (SERVER_PROCESS* pServerProcess : signaled)
+    {
+        pServerProcess->CompleteSignal();
+    }
+}
+
+VOID
+PROCESS_MANAGER::DrainAllProcesses(
+    VOID
+)
+/*++
 
-        if (RapidFailsPerMinuteExceeded(pConfig->QueryRapidFailsPerMinute()))
+Routine Description:
+
+    Take every process out of routing, then let each one complete its
+    requests in flight before it is signaled to shut down. A recycle is
+    served by the new application instance meanwhile. The processes drain
+    in parallel so shutting down takes one shutdown time limit rather than
+    one per process; m_srwLock is not held while waiting.
+
+--*/
+{
+    std::vector<SERVER_PROCESS*> processes;
+    std::vector<SERVER_PROCESS*> signaled;
+    BOOL fDrain = TRUE;
+
+    {
+        auto lock = SRWExclusiveLock(m_srwLock, LockSite::ProcessManager);
+
+        PROCESS_LIST_SNAPSHOT* pCurrent = m_pSnapshot;
+        const DWORD cProcesses = (pCurrent != NULL ? pCurrent->cProcesses : 0) + m_cStandbyProcesses;
+
+        try
         {
-            //
-            // rapid fails per minute exceeded, do not create new process.
-            //
-            EventLog::Info(
-                ASPNETCORE_EVENT_RAPID_FAIL_COUNT_EXCEEDED,
-                ASPNETCORE_EVENT_RAPID_FAIL_COUNT_EXCEEDED_MSG,
-                pConfig->QueryRapidFailsPerMinute());
+            processes.reserve(cProcesses);
+        }
+        catch (...)
+        {
+            OBSERVE_CAUGHT_EXCEPTION();
+            ShutdownAllProcessesNoLock(signaled);
+            fDrain = FALSE;
+        }
 
-            RETURN_HR(HRESULT_FROM_WIN32(ERROR_SERVER_DISABLED));
+        if (fDrain)
+        {
+            for (DWORD i = 0; i < m_cStandbyProcesses; ++i)
+            {
+                processes.push_back(m_rgpStandbyProcesses[i]);
+                m_rgpStandbyProcesses[i] = NULL;
+            }
+            m_cStandbyProcesses = 0;
+
+            if (pCurrent != NULL)
+            {
+                for (DWORD i = 0; i < pCurrent->cProcesses; ++i)
+                {
+                    if (pCurrent->rgProcesses[i] != NULL)
+                    {
+                        pCurrent->rgProcesses[i]->ReferenceServerProcess();
+                        processes.push_back(pCurrent->rgProcesses[i]);
+                    }
+                }
+
+                PROCESS_LIST_SNAPSHOT* pSnapshot = NULL;
+                if (SUCCEEDED_LOG(CreateSnapshot(pCurrent, pCurrent->cProcesses, MAXDWORD, NULL, &pSnapshot)))
+                {
+                    PublishSnapshotNoLock(pSnapshot);
+                }
+            }
+        }
+    }
+
+    if (!fDrain)
+    {
+        CompleteSignals(signaled);
+        return;
+    }
+
+    std::vector<std::thread> drainThreads;
+    for (SERVER_PROCESS* pServerProcess : processes)
+    {
+        const auto drain = [pServerProcess]()
+        {
+            pServerProcess->DrainAndSendSignal();
+            pServerProcess->DereferenceServerProcess();
+        };
+
+        try
+        {
+            drainThreads.emplace_back(drain);
+        }
+        catch (...)
+        {
+            OBSERVE_CAUGHT_EXCEPTION();
+            drain();
+        }
+    }
+
+    for (auto& drainThread : drainThreads)
+    {
+        drainThread.join();
+    }
+}
+
+DWORD
+PROCESS_MANAGER::SelectProcessIndex(
+    _In_ const PROCESS_LIST_SNAPSHOT*   pSnapshot
+)
+/*++
+
+Routine Description:
+
+    Pick the slot of pSnapshot the next request goes to.
+
+    An empty or not yet ready slot is always preferred by the load aware
+    policies so that GetProcess (re)starts the backend for it, the same way
+    round robin eventually lands on it.
+
+    With NUMA placement only the slots placed on the node of the calling
+    thread are considered, slots dwFirst, dwFirst + dwStride, ...
+
+--*/
+{
+    DWORD dwCounter = InterlockedIncrement(&m_dwRouteToProcessIndex);
+    DWORD dwFirst = 0;
+    DWORD dwStride = 1;
+    DWORD cCandidates = m_dwProcessesPerApplication;
+
+    if (m_dwProcessesPerApplication == 1)
+    {
+        return 0;
+    }
+
+    if (m_cNumaNodes != 0)
+    {
+        PROCESSOR_NUMBER processorNumber;
+        USHORT           usNode = 0;
+
+        GetCurrentProcessorNumberEx(&processorNumber);
+        if (GetNumaProcessorNodeEx(&processorNumber, &usNode) &&
+            usNode < m_cNumaNodes &&
+            usNode < m_dwProcessesPerApplication)
+        {
+            dwFirst = usNode;
+            dwStride = m_cNumaNodes;
+            cCandidates = (m_dwProcessesPerApplication - usNode + m_cNumaNodes - 1) / m_cNumaNodes;
+        }
+
+        if (cCandidates == 1)
+        {
+            return dwFirst;
         }
+    }
+
+    DWORD dwCandidate = dwCounter % cCandidates;
+
+    switch (m_RoutingPolicy)
+    {
+    case ROUTING_LEAST_OUTSTANDING_REQUESTS:
+    {
+        //
+        // Start the scan at the round robin position so that ties are
+        // still spread over all processes.
+        //
+        DWORD dwBestIndex = dwFirst + dwCandidate * dwStride;
+        LONG  cBestOutstanding = MAXLONG;
 
-        if (m_ppServerProcessList[dwProcessIndex] == NULL)
+        for (DWORD i = 0; i < cCandidates; ++i)
         {
+            DWORD dwIndex = dwFirst + ((dwCandidate + i) % cCandidates) * dwStride;
+            SERVER_PROCESS* pServerProcess = pSnapshot->rgProcesses[dwIndex];
+
+            if (pServerProcess == NULL || !pServerProcess->IsReady())
+            {
+                return dwIndex;
+            }
+
+            LONG cOutstanding = pServerProcess->QueryOutstandingRequests();
+            if (cOutstanding < cBestOutstanding)
+            {
+                cBestOutstanding = cOutstanding;
+                dwBestIndex = dwIndex;
+            }
+        }
+
+        return dwBestIndex;
+    }
 
-            pSelectedServerProcess = std::make_unique<SERVER_PROCESS>();
-            RETURN_IF_FAILED(pSelectedServerProcess->Initialize(
-                    this,                                   //ProcessManager
-                    pConfig->QueryProcessPath(),            //
-                    pConfig->QueryArguments(),              //
-                    pConfig->QueryStartupTimeLimitInMS(),
-                    pConfig->QueryShutdownTimeLimitInMS(),
-                    pConfig->QueryWindowsAuthEnabled(),
-                    pConfig->QueryBasicAuthEnabled(),
-                    pConfig->QueryAnonymousAuthEnabled(),
-                    pConfig->QueryEnvironmentVariables(),
-                    pConfig->QueryStdoutLogEnabled(),
-                    pConfig->QueryEnableOutOfProcessConsoleRedirection(),
-                    fWebsocketSupported,
-                    pConfig->QueryStdoutLogFile(),
-                    pConfig->QueryApplicationPhysicalPath(),   // physical path
-                    pConfig->QueryApplicationPath(),           // app path
-                    pConfig->QueryApplicationVirtualPath(),     // App relative virtual path,
-                    pConfig->QueryBindings()
-            ));
-            RETURN_IF_FAILED(pSelectedServerProcess->StartProcess());
+    case ROUTING_POWER_OF_TWO_CHOICES:
+    {
+        //
+        // Two distinct pseudo random slots derived from the routing counter
+        // (Knuth multiplicative hash), keep the less loaded one.
+        //
+        DWORD dwHash = dwCounter * 2654435761u;
+        DWORD dwFirstChoice = dwHash % cCandidates;
+        DWORD dwSecondChoice = (dwFirstChoice + 1 + (dwHash >> 16) % (cCandidates - 1)) % cCandidates;
+
+        dwFirstChoice = dwFirst + dwFirstChoice * dwStride;
+        dwSecondChoice = dwFirst + dwSecondChoice * dwStride;
+
+        SERVER_PROCESS* pFirst = pSnapshot->rgProcesses[dwFirstChoice];
+        SERVER_PROCESS* pSecond = pSnapshot->rgProcesses[dwSecondChoice];
+
+        if (pFirst == NULL || !pFirst->IsReady())
+        {
+            return dwFirstChoice;
         }
 
-        if (!pSelectedServerProcess->IsReady())
+        if (pSecond == NULL || !pSecond->IsReady())
         {
-            RETURN_HR(HRESULT_FROM_WIN32(ERROR_CREATE_FAILED));
+            return dwSecondChoice;
         }
 
-        m_ppServerProcessList[dwProcessIndex] = pSelectedServerProcess.release();
+        return pSecond->QueryOutstandingRequests() < pFirst->QueryOutstandingRequests() ?
+            dwSecondChoice : dwFirstChoice;
+    }
+
+    default:
+        //
+        // round robin through to the next available process.
+        //
+        return dwFirst + dwCandidate * dwStride;
+    }
+}
+
+HRESULT
+PROCESS_MANAGER::CreateServerProcess(
+    _In_    REQUESTHANDLER_CONFIG      *pConfig,
+    _In_    BOOL                        fWebsocketSupported,
+    _In_    DWORD                       dwProcessIndex,
+    _Out_   std::unique_ptr<SERVER_PROCESS>& pServerProcess
+)
+{
+    PROCESS_RESOURCE_LIMITS resourceLimits = pConfig->QueryProcessResourceLimits();
+    const LONG lNumaNode = dwProcessIndex != MAXDWORD ? QuerySlotNumaNode(dwProcessIndex) : -1;
+    if (lNumaNode >= 0)
+    {
+        resourceLimits.lNumaNode = lNumaNode;
+    }
+
+    std::shared_ptr<const ENVIRONMENT_BLOCK> pEnvironmentBlock;
+    RETURN_IF_FAILED(GetEnvironmentBlock(pConfig, fWebsocketSupported, pEnvironmentBlock));
+
+    pServerProcess = std::make_unique<SERVER_PROCESS>();
+    RETURN_IF_FAILED(pServerProcess->Initialize(
+            this,                                   //ProcessManager
+            pConfig->QueryProcessPath(),            //
+            pConfig->QueryArguments(),              //
+            pConfig->QueryStartupTimeLimitInMS(),
+            pConfig->QueryShutdownTimeLimitInMS(),
+            pConfig->QueryMaxConnectionsPerBackend(),
+            pConfig->QueryPrewarmConnections(),
+            !pConfig->QueryPriorityPaths().empty(),
+            pConfig->QueryRequestDelegation(),
+            pConfig->QueryCacheWindowsAuthToken(),
+            resourceLimits,
+            std::move(pEnvironmentBlock),
+            pConfig->QueryStdoutLogEnabled(),
+            pConfig->QueryEnableOutOfProcessConsoleRedirection(),
+            pConfig->QueryStdoutLogFile(),
+            pConfig->QueryApplicationPhysicalPath(),   // physical path
+            pConfig->QueryApplicationPath(),           // app path
+            pConfig->QueryApplicationVirtualPath()     // App relative virtual path,
+    ));
+
+    RETURN_IF_FAILED(pServerProcess->SetHealthChecks(
+            pConfig->QueryHealthCheckPath(),
+            pConfig->QueryHealthCheckIntervalInMS(),
+            pConfig->QueryHealthCheckTimeoutInMS(),
+            pConfig->QueryHealthCheckUnhealthyThreshold(),
+            pConfig->QueryOutlierConsecutiveFailures()));
+
+    //
+    // Standby processes are not shared, they are promoted into a slot of
+    // this worker only.
+    //
+    if (m_pWebGardenRegistry == nullptr || dwProcessIndex >= m_pWebGardenRegistry->QuerySlotCount())
+    {
+        return StartServerProcess(pServerProcess.get());
+    }
+
+    RETURN_IF_FAILED(m_pWebGardenRegistry->LockSlot(dwProcessIndex, pConfig->QueryStartupTimeLimitInMS()));
+
+    HRESULT hr = S_OK;
+    WEB_GARDEN_REGISTRY::BACKEND backend;
+    if (m_pWebGardenRegistry->TryGetBackend(dwProcessIndex, &backend) &&
+        SUCCEEDED_LOG(pServerProcess->AttachProcess(backend.dwListeningProcessId, backend.dwPort, backend.rgchToken)))
+    {
+        LOG_INFOF(L"Attached to process %d on port %d started by worker %d",
+            backend.dwListeningProcessId,
+            backend.dwPort,
+            backend.dwOwnerProcessId);
     }
-    *ppServerProcess = m_ppServerProcessList[dwProcessIndex];
+    else
+    {
+        hr = StartServerProcess(pServerProcess.get());
+        if (SUCCEEDED(hr) && pServerProcess->IsReady())
+        {
+            LOG_IF_FAILED(m_pWebGardenRegistry->RecordBackend(dwProcessIndex,
+                pServerProcess->QueryListeningProcessId(),
+                pServerProcess->GetPort(),
+                pServerProcess->QueryGuid()));
+        }
+    }
+
+    m_pWebGardenRegistry->UnlockSlot(dwProcessIndex);
+    return hr;
+}
+
+HRESULT
+PROCESS_MANAGER::StartServerProcess(
+    _In_    SERVER_PROCESS             *pServerProcess
+)
+{
+    BOOL fProbe = FALSE;
+    if (!m_rapidFailBreaker.TryBeginStart(&fProbe))
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_SERVER_DISABLED));
+    }
+
+    HRESULT hr = pServerProcess->StartProcess();
+    if (m_rapidFailBreaker.EndStart(fProbe, SUCCEEDED(hr) && pServerProcess->IsReady()))
+    {
+        m_counters.RapidFailTripped();
+    }
+    RETURN_IF_FAILED(hr);
+
+    return S_OK;
+}
+
+HRESULT
+PROCESS_MANAGER::GetEnvironmentBlock(
+    _In_    REQUESTHANDLER_CONFIG      *pConfig,
+    _In_    BOOL                        fWebsocketSupported,
+    _Out_   std::shared_ptr<const ENVIRONMENT_BLOCK>& pEnvironmentBlock
+)
+{
+    auto lock = SRWExclusiveLock(m_environmentBlockLock);
+
+    if (m_pEnvironmentBlock == nullptr ||
+        m_fEnvironmentBlockWebSocketSupported != fWebsocketSupported)
+    {
+        try
+        {
+            auto variables = ENVIRONMENT_VAR_HELPERS::InitEnvironmentVariablesTable(
+                pConfig->QueryEnvironmentVariables(),
+                pConfig->QueryWindowsAuthEnabled(),
+                pConfig->QueryBasicAuthEnabled(),
+                pConfig->QueryAnonymousAuthEnabled(),
+                true, // fAddHostingStartup
+                pConfig->QueryApplicationPath()->QueryStr(),
+                pConfig->QueryBindings()->QueryStr());
+
+            variables = ENVIRONMENT_VAR_HELPERS::AddWebsocketEnabledToEnvironmentVariables(variables, fWebsocketSupported);
+
+            auto pNewEnvironmentBlock = std::make_shared<ENVIRONMENT_BLOCK>();
+            RETURN_IF_FAILED(pNewEnvironmentBlock->Initialize(variables));
+
+            m_pEnvironmentBlock = std::move(pNewEnvironmentBlock);
+            m_fEnvironmentBlockWebSocketSupported = fWebsocketSupported;
+        }
+        CATCH_RETURN();
+    }
+
+    pEnvironmentBlock = m_pEnvironmentBlock;
+    return S_OK;
+}
+
+BOOL
+PROCESS_MANAGER::PromoteStandbyProcessNoLock(
+    DWORD                   dwProcessIndex,
+    _Out_ SERVER_PROCESS  **ppServerProcess
+)
+/*++
+
+Routine Description:
+
+    Move a ready standby process into slot dwProcessIndex of the published
+    snapshot. Standby processes that are not ready anymore are dropped.
+    On success the standby list reference is handed to the caller.
+
+--*/
+{
+    while (m_cStandbyProcesses != 0)
+    {
+        SERVER_PROCESS* pStandby = m_rgpStandbyProcesses[--m_cStandbyProcesses];
+        m_rgpStandbyProcesses[m_cStandbyProcesses] = NULL;
+
+        if (!pStandby->IsReady())
+        {
+            pStandby->DereferenceServerProcess();
+            continue;
+        }
+
+        PROCESS_LIST_SNAPSHOT* pSnapshot = NULL;
+        if (FAILED_LOG(CreateSnapshot(m_pSnapshot,
+                m_pSnapshot->cProcesses,
+                dwProcessIndex,
+                pStandby,
+                &pSnapshot)))
+        {
+            m_rgpStandbyProcesses[m_cStandbyProcesses++] = pStandby;
+            return FALSE;
+        }
+
+        PublishSnapshotNoLock(pSnapshot);
+
+        *ppServerProcess = pStandby;
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+VOID
+PROCESS_MANAGER::FillStandbyProcesses(
+    _In_    REQUESTHANDLER_CONFIG      *pConfig,
+    _In_    BOOL                        fWebsocketSupported
+)
+/*++
+
+Routine Description:
+
+    Start and warm up standby processes until m_cStandbyTarget are
+    available. Runs on a background thread after TryBeginStandbyFill
+    returned TRUE; the processes are started without holding m_srwLock so
+    request routing and failover are not blocked meanwhile.
+
+--*/
+{
+    STRU* pstruWarmupUrl = pConfig->QueryStandbyWarmupUrl();
+
+    for (;;)
+    {
+        {
+            auto lock = SRWExclusiveLock(m_srwLock, LockSite::ProcessManager);
+
+            if (m_lStopping != 0 ||
+                m_cStandbyProcesses >= m_cStandbyTarget ||
+                !m_rapidFailBreaker.IsStartAllowed())
+            {
+                break;
+            }
+        }
+
+        std::unique_ptr<SERVER_PROCESS> pStandby;
+        if (FAILED_LOG(CreateServerProcess(pConfig, fWebsocketSupported, MAXDWORD, pStandby)) ||
+            !pStandby->IsReady())
+        {
+            break;
+        }
+
+        if (!pstruWarmupUrl->IsEmpty())
+        {
+            LOG_IF_FAILED(pStandby->SendWarmupRequest(pstruWarmupUrl->QueryStr()));
+        }
+
+        {
+            auto lock = SRWExclusiveLock(m_srwLock, LockSite::ProcessManager);
+
+            if (m_lStopping == 0 && m_cStandbyProcesses < m_cStandbyTarget)
+            {
+                m_rgpStandbyProcesses[m_cStandbyProcesses++] = pStandby.release();
+                continue;
+            }
+        }
+
+        //
+        // Stopping or enough standby processes by now, shut down the one we
+        // just started (outside of the lock, SendSignal waits for the exit).
+        //
+        SERVER_PROCESS* pUnneeded = pStandby.release();
+        pUnneeded->SendSignal();
+        pUnneeded->DereferenceServerProcess();
+        break;
+    }
+
+    InterlockedExchange(&m_lStandbyFillInProgress, 0L);
+}
+
+// static
+VOID
+CALLBACK
+PROCESS_MANAGER::IdleTimerCallback(
+    PVOID       pContext
+)
+{
+    PROCESS_MANAGER *pProcessManager = static_cast<PROCESS_MANAGER*>(pContext);
+
+    if (pProcessManager->m_lStopping != 0 ||
+        GetTickCount64() - pProcessManager->m_ullLastRequest < pProcessManager->m_dwIdleScaleDownTimeoutInMS ||
+        InterlockedCompareExchange(&pProcessManager->m_lIdleState, IDLE_STATE_SCALING_DOWN, IDLE_STATE_ACTIVE) != IDLE_STATE_ACTIVE)
+    {
+        return;
+    }
+
+    //
+    // Draining waits for the processes to exit, off the timer wheel thread.
+    //
+    pProcessManager->ReferenceProcessManager();
+
+    if (!TrySubmitThreadpoolCallback(ScaleDownIdleCallback, pProcessManager, NULL))
+    {
+        LOG_LAST_ERROR();
+        InterlockedExchange(&pProcessManager->m_lIdleState, IDLE_STATE_ACTIVE);
+        pProcessManager->DereferenceProcessManager();
+    }
+}
+
+// static
+VOID
+CALLBACK
+PROCESS_MANAGER::ScaleDownIdleCallback(
+    PTP_CALLBACK_INSTANCE   Instance,
+    PVOID                   pContext
+)
+{
+    UNREFERENCED_PARAMETER(Instance);
+
+    PROCESS_MANAGER *pProcessManager = static_cast<PROCESS_MANAGER*>(pContext);
+
+    pProcessManager->ScaleDownIdleProcesses();
+    pProcessManager->DereferenceProcessManager();
+}
+
+VOID
+PROCESS_MANAGER::ScaleDownIdleProcesses(
+    VOID
+)
+/*++
+
+Routine Description:
+
+    Keep the first ready process and shut down the other slots and the
+    standby processes, then trim the kept one. Requests arriving meanwhile
+    are routed to any ready process; the first one once scaled down starts
+    the rest again, see RestoreIdleProcesses.
+
+--*/
+{
+    std::vector<SERVER_PROCESS*> processes;
+    SERVER_PROCESS* pKept = NULL;
+
+    {
+        auto lock = SRWExclusiveLock(m_srwLock, LockSite::ProcessManager);
+
+        PROCESS_LIST_SNAPSHOT* pCurrent = m_pSnapshot;
+
+        if (m_lStopping != 0)
+        {
+            return;
+        }
+
+        try
+        {
+            processes.reserve(pCurrent->cProcesses + m_cStandbyProcesses);
+        }
+        catch (...)
+        {
+            OBSERVE_CAUGHT_EXCEPTION();
+            InterlockedExchange(&m_lIdleState, IDLE_STATE_ACTIVE);
+            return;
+        }
+
+        for (DWORD i = 0; i < m_cStandbyProcesses; ++i)
+        {
+            processes.push_back(m_rgpStandbyProcesses[i]);
+            m_rgpStandbyProcesses[i] = NULL;
+        }
+        m_cStandbyProcesses = 0;
+
+        for (DWORD i = 0; i < pCurrent->cProcesses; ++i)
+        {
+            SERVER_PROCESS* pServerProcess = pCurrent->rgProcesses[i];
+            if (pServerProcess == NULL)
+            {
+                continue;
+            }
+
+            if (pKept == NULL && pServerProcess->IsReady())
+            {
+                pServerProcess->ReferenceServerProcess();
+                pKept = pServerProcess;
+                continue;
+            }
+
+            PROCESS_LIST_SNAPSHOT* pSnapshot = NULL;
+            if (FAILED_LOG(CreateSnapshot(pCurrent, pCurrent->cProcesses, i, NULL, &pSnapshot)))
+            {
+                continue;
+            }
+
+            // Before publishing, the snapshot may be freed right away.
+            pServerProcess->ReferenceServerProcess();
+            processes.push_back(pServerProcess);
+
+            PublishSnapshotNoLock(pSnapshot);
+            pCurrent = pSnapshot;
+        }
+    }
+
+    for (SERVER_PROCESS* pServerProcess : processes)
+    {
+        pServerProcess->DrainAndSendSignal();
+        pServerProcess->DereferenceServerProcess();
+    }
+
+    if (pKept != NULL)
+    {
+        pKept->EnterIdle(m_fIdleSuspend);
+        pKept->DereferenceServerProcess();
+    }
+
+    LOG_INFOF(L"Scaled down to one process after %d ms without requests, %d processes shut down",
+        m_dwIdleScaleDownTimeoutInMS,
+        static_cast<DWORD>(processes.size()));
+
+    InterlockedExchange(&m_lIdleState, IDLE_STATE_SCALED_DOWN);
+}
+
+VOID
+PROCESS_MANAGER::RestoreIdleProcesses(
+    _In_    REQUESTHANDLER_CONFIG      *pConfig,
+    _In_    BOOL                        fWebsocketSupported
+)
+/*++
+
+Routine Description:
+
+    Start the slots shut down by ScaleDownIdleProcesses again. Runs on a
+    background thread after TryBeginIdleRestore returned TRUE, requests
+    keep going to the kept process until the slots are ready.
+
+--*/
+{
+    for (DWORD i = 0; i < m_dwProcessesPerApplication && m_lStopping == 0; ++i)
+    {
+        LOG_IF_FAILED(StartProcessInSlot(pConfig, fWebsocketSupported, i));
+    }
+
+    InterlockedExchange(&m_lIdleState, IDLE_STATE_ACTIVE);
+}
+
+HRESULT
+PROCESS_MANAGER::EnsureProcessListReady(
+    _In_    REQUESTHANDLER_CONFIG      *pConfig
+)
+{
+    PROCESS_LIST_SNAPSHOT  *pSnapshot = NULL;
+
+    if (InterlockedCompareExchange(&m_lStopping, 1L, 1L) == 1L)
+    {
+        RETURN_IF_FAILED(E_APPLICATION_EXITING);
+    }
+
+    if (!m_fServerProcessListReady)
+    {
+        auto lock = SRWExclusiveLock(m_srwLock, LockSite::ProcessManager);
+
+        if (!m_fServerProcessListReady)
+        {
+            m_dwProcessesPerApplication = pConfig->QueryProcessesPerApplication();
+
+            STRU* pstruRoutingPolicy = pConfig->QueryProcessRoutingPolicy();
+            if (pstruRoutingPolicy->Equals(L"leastRequests", /* ignoreCase */ 1))
+            {
+                m_RoutingPolicy = ROUTING_LEAST_OUTSTANDING_REQUESTS;
+            }
+            else if (pstruRoutingPolicy->Equals(L"powerOfTwoChoices", /* ignoreCase */ 1))
+            {
+                m_RoutingPolicy = ROUTING_POWER_OF_TWO_CHOICES;
+            }
+            else
+            {
+                m_RoutingPolicy = ROUTING_ROUND_ROBIN;
+            }
+
+            m_cStandbyTarget = min(pConfig->QueryStandbyProcesses(), MAX_STANDBY_PROCESSES);
+
+            m_rapidFailBreaker.Initialize(pConfig->QueryRapidFailsPerMinute(),
+                pConfig->QueryRapidFailBackoffInitialInMS(),
+                pConfig->QueryRapidFailBackoffMaxInMS(),
+                pConfig->QueryRapidFailRecoveryIntervalInMS());
+
+            ULONG ulHighestNode = 0;
+            if (pConfig->QueryProcessNumaPlacement()->Equals(L"true", /* ignoreCase */ 1) &&
+                GetNumaHighestNodeNumber(&ulHighestNode) &&
+                ulHighestNode != 0)
+            {
+                m_cNumaNodes = ulHighestNode + 1;
+            }
+
+            //
+            // Without the registry every worker starts processes of its own,
+            // which still serves the requests. An HttpSys backend can't be
+            // attached to, HTTP.sys owns its port.
+            //
+            if (pConfig->QueryShareBackendsAcrossWebGarden() && !pConfig->QueryRequestDelegation())
+            {
+                auto pRegistry = std::make_unique<WEB_GARDEN_REGISTRY>();
+                if (SUCCEEDED_LOG(pRegistry->Initialize(g_pHttpServer->GetAppPoolName(),
+                        pConfig->QueryApplicationPath()->QueryStr(),
+                        m_dwProcessesPerApplication)))
+                {
+                    m_pWebGardenRegistry = std::move(pRegistry);
+                }
+            }
+
+            RETURN_IF_FAILED(CreateSnapshot(NULL, m_dwProcessesPerApplication, MAXDWORD, NULL, &pSnapshot));
+            PublishSnapshotNoLock(pSnapshot);
+            pSnapshot = NULL;
+
+            m_dwIdleScaleDownTimeoutInMS = pConfig->QueryIdleScaleDownTimeoutInMS();
+            m_fIdleSuspend = pConfig->QueryIdleSuspend();
+            if (m_dwIdleScaleDownTimeoutInMS != 0)
+            {
+                m_ullLastRequest = GetTickCount64();
+                LOG_IF_FAILED(m_idleTimer.Set(IDLE_CHECK_INTERVAL_MS, IDLE_CHECK_INTERVAL_MS));
+            }
+        }
+        m_fServerProcessListReady = TRUE;
+    }
+
+    return S_OK;
+}
+
+HRESULT
+PROCESS_MANAGER::StartProcessInSlot(
+    _In_    REQUESTHANDLER_CONFIG      *pConfig,
+    _In_    BOOL                        fWebsocketSupported,
+    _In_    DWORD                       dwProcessIndex
+)
+/*++
+
+Routine Description:
+
+    Start the process of slot dwProcessIndex unless it is already up and
+    publish it as soon as it is ready. Used by the eager startup, which
+    calls this for all slots concurrently; the process is started without
+    holding m_srwLock.
+
+--*/
+{
+    std::unique_ptr<SERVER_PROCESS> pServerProcess;
+
+    RETURN_IF_FAILED(EnsureProcessListReady(pConfig));
+
+    {
+        auto lock = SRWExclusiveLock(m_srwLock, LockSite::ProcessManager);
+
+        if (dwProcessIndex >= m_pSnapshot->cProcesses)
+        {
+            RETURN_HR(E_INVALIDARG);
+        }
+
+        if (m_pSnapshot->rgProcesses[dwProcessIndex] != NULL &&
+            m_pSnapshot->rgProcesses[dwProcessIndex]->IsReady())
+        {
+            return S_OK;
+        }
+
+        if (!m_rapidFailBreaker.IsStartAllowed())
+        {
+            RETURN_HR(HRESULT_FROM_WIN32(ERROR_SERVER_DISABLED));
+        }
+    }
+
+    //
+    // Readers that land on a slot still starting fall back to any ready process.
+    //
+    InterlockedIncrement(&m_cStartingProcesses);
+
+    HRESULT hr = CreateServerProcess(pConfig, fWebsocketSupported, dwProcessIndex, pServerProcess);
+
+    InterlockedDecrement(&m_cStartingProcesses);
+    RETURN_IF_FAILED(hr);
+
+    if (!pServerProcess->IsReady())
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_CREATE_FAILED));
+    }
+
+    {
+        auto lock = SRWExclusiveLock(m_srwLock, LockSite::ProcessManager);
+
+        PROCESS_LIST_SNAPSHOT* pCurrent = m_pSnapshot;
+        if (m_lStopping == 0 &&
+            (pCurrent->rgProcesses[dwProcessIndex] == NULL ||
+             !pCurrent->rgProcesses[dwProcessIndex]->IsReady()))
+        {
+            if (pCurrent->rgProcesses[dwProcessIndex] != NULL)
+            {
+                ShutdownProcessNoLock(pCurrent->rgProcesses[dwProcessIndex]);
+                pCurrent = m_pSnapshot;
+            }
+
+            PROCESS_LIST_SNAPSHOT* pSnapshot = NULL;
+            RETURN_IF_FAILED(CreateSnapshot(pCurrent,
+                pCurrent->cProcesses,
+                dwProcessIndex,
+                pServerProcess.get(),
+                &pSnapshot));
+            PublishSnapshotNoLock(pSnapshot);
+
+            LOG_INFOF(L"Process %d of %d is ready on port %d",
+                dwProcessIndex + 1,
+                m_pSnapshot->cProcesses,
+                pServerProcess->GetPort());
+
+            //
+            // The snapshot holds its own reference now.
+            //
+            pServerProcess.release()->DereferenceServerProcess();
+            return S_OK;
+        }
+    }
+
+    //
+    // Stopping, or a request started this slot meanwhile; shut down the one
+    // we just started (outside of the lock, SendSignal waits for the exit).
+    //
+    SERVER_PROCESS* pUnneeded = pServerProcess.release();
+    pUnneeded->SendSignal();
+    pUnneeded->DereferenceServerProcess();
+
+    return S_OK;
+}
+
+HRESULT
+PROCESS_MANAGER::GetReadyProcess(
+    _In_    REQUESTHANDLER_CONFIG      *pConfig,
+    _Out_   SERVER_PROCESS            **ppServerProcess
+)
+{
+    DWORD dwProcessIndex = 0;
+    return GetReadyProcessInternal(pConfig, &dwProcessIndex, ppServerProcess);
+}
+
+HRESULT
+PROCESS_MANAGER::GetReadyProcessInternal(
+    _In_    REQUESTHANDLER_CONFIG      *pConfig,
+    _Out_   DWORD                      *pdwProcessIndex,
+    _Out_   SERVER_PROCESS            **ppServerProcess
+)
+{
+    DWORD                   dwProcessIndex = 0;
+    LONG                   *pcReaders = NULL;
+    PROCESS_LIST_SNAPSHOT  *pSnapshot = NULL;
+    SERVER_PROCESS         *pServerProcess = NULL;
+
+    *ppServerProcess = NULL;
+
+    RETURN_IF_FAILED(EnsureProcessListReady(pConfig));
+
+    if (m_dwIdleScaleDownTimeoutInMS != 0)
+    {
+        const ULONGLONG ullNow = GetTickCount64();
+        if (ullNow - m_ullLastRequest >= IDLE_CHECK_INTERVAL_MS)
+        {
+            m_ullLastRequest = ullNow;
+        }
+    }
+
+    //
+    // Fast path, no lock: pick a ready process from the published snapshot.
+    //
+    pSnapshot = AcquireSnapshot(&pcReaders);
+
+    dwProcessIndex = SelectProcessIndex(pSnapshot);
+    pServerProcess = pSnapshot->rgProcesses[dwProcessIndex];
+
+    if (pServerProcess == NULL || !pServerProcess->IsReady())
+    {
+        pServerProcess = NULL;
+
+        if (m_cStartingProcesses != 0 || m_lIdleState != IDLE_STATE_ACTIVE)
+        {
+            //
+            // Another request is (re)starting a process, or the application
+            // is scaled down. Rather than queueing behind the start on
+            // m_srwLock, use any process that is ready.
+            //
+            for (DWORD i = 0; i < pSnapshot->cProcesses; ++i)
+            {
+                if (pSnapshot->rgProcesses[i] != NULL &&
+                    pSnapshot->rgProcesses[i]->IsReady())
+                {
+                    pServerProcess = pSnapshot->rgProcesses[i];
+                    break;
+                }
+            }
+        }
+    }
+
+    if (pServerProcess != NULL)
+    {
+        pServerProcess->ReferenceServerProcess();
+    }
+
+    ReleaseSnapshot(pcReaders);
+
+    *pdwProcessIndex = dwProcessIndex;
+    *ppServerProcess = pServerProcess;
+    return S_OK;
+}
+
+HRESULT
+PROCESS_MANAGER::GetProcess(
+    _In_    REQUESTHANDLER_CONFIG      *pConfig,
+    _In_    BOOL                        fWebsocketSupported,
+    _Out_   SERVER_PROCESS            **ppServerProcess
+)
+{
+    DWORD                   dwProcessIndex = 0;
+    PROCESS_LIST_SNAPSHOT  *pSnapshot = NULL;
+    std::unique_ptr<SERVER_PROCESS>  pSelectedServerProcess;
+
+    RETURN_IF_FAILED(GetReadyProcessInternal(pConfig, &dwProcessIndex, ppServerProcess));
+
+    if (*ppServerProcess != NULL)
+    {
+        return S_OK;
+    }
+
+    // should make the lock per process so that we can start processes simultaneously ?
+    auto lock = SRWExclusiveLock(m_srwLock, LockSite::ProcessManager);
+
+    PROCESS_LIST_SNAPSHOT* pCurrent = m_pSnapshot;
+    if (pCurrent->rgProcesses[dwProcessIndex] != NULL)
+    {
+        if (!pCurrent->rgProcesses[dwProcessIndex]->IsReady())
+        {
+            //
+            // terminate existing process that is not ready
+            // before creating new one.
+            //
+            ShutdownProcessNoLock( pCurrent->rgProcesses[dwProcessIndex] );
+            pCurrent = m_pSnapshot;
+        }
+        else
+        {
+            // server is already up and ready to serve requests.
+            pCurrent->rgProcesses[dwProcessIndex]->ReferenceServerProcess();
+            *ppServerProcess = pCurrent->rgProcesses[dwProcessIndex];
+            return S_OK;
+        }
+    }
+
+    if (PromoteStandbyProcessNoLock(dwProcessIndex, ppServerProcess))
+    {
+        return S_OK;
+    }
+
+    if (!m_rapidFailBreaker.IsStartAllowed())
+    {
+        //
+        // rapid fails per minute exceeded, do not create new process.
+        //
+        EventLog::Info(
+            ASPNETCORE_EVENT_RAPID_FAIL_COUNT_EXCEEDED,
+            ASPNETCORE_EVENT_RAPID_FAIL_COUNT_EXCEEDED_MSG,
+            pConfig->QueryRapidFailsPerMinute());
+
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_SERVER_DISABLED));
+    }
+
+    //
+    // Readers that land on this slot meanwhile fall back to any ready process.
+    //
+    InterlockedIncrement(&m_cStartingProcesses);
+
+    HRESULT hr = CreateServerProcess(pConfig, fWebsocketSupported, dwProcessIndex, pSelectedServerProcess);
+
+    InterlockedDecrement(&m_cStartingProcesses);
+    RETURN_IF_FAILED(hr);
+
+    if (!pSelectedServerProcess->IsReady())
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_CREATE_FAILED));
+    }
+
+    RETURN_IF_FAILED(CreateSnapshot(pCurrent,
+        pCurrent->cProcesses,
+        dwProcessIndex,
+        pSelectedServerProcess.get(),
+        &pSnapshot));
+    PublishSnapshotNoLock(pSnapshot);
+
+    //
+    // The snapshot holds its own reference now, the creation reference
+    // is handed to the caller.
+    //
+    *ppServerProcess = pSelectedServerProcess.release();
 
     return S_OK;
 }
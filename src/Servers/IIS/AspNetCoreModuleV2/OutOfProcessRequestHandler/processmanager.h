@@ -3,9 +3,56 @@
 
 #pragma once
 
+#include "LockContention.h"
+#include "EpochReaders.h"
+
 #define ONE_MINUTE_IN_MILLISECONDS 60000
+#define MAX_STANDBY_PROCESSES      4
+// Granularity of the idle tracking, see idleScaleDownTimeout.
+#define IDLE_CHECK_INTERVAL_MS     10000
 class SERVER_PROCESS;
 
+//
+// How GetProcess spreads requests over processesPerApplication backends.
+//
+enum PROCESS_ROUTING_POLICY
+{
+    ROUTING_ROUND_ROBIN,
+    ROUTING_LEAST_OUTSTANDING_REQUESTS,
+    ROUTING_POWER_OF_TWO_CHOICES
+};
+
+//
+// idleScaleDownTimeout: ACTIVE -> SCALING_DOWN -> SCALED_DOWN on the idle
+// timer, SCALED_DOWN -> RESTORING -> ACTIVE from the next request.
+//
+enum PROCESS_IDLE_STATE
+{
+    IDLE_STATE_ACTIVE,
+    IDLE_STATE_SCALING_DOWN,
+    IDLE_STATE_SCALED_DOWN,
+    IDLE_STATE_RESTORING
+};
+
+//
+// Immutable view of the backend processes of an application.
+//
+// GetProcess reads the published snapshot without taking m_srwLock.
+// Writers (first use, restart, shutdown) serialize on m_srwLock, publish a
+// modified copy and retire the previous snapshot; retired snapshots are
+// freed once no reader can still be looking at them, see
+// ReclaimSnapshotsNoLock. Every snapshot holds its own reference on the
+// processes it lists.
+//
+struct PROCESS_LIST_SNAPSHOT
+{
+    PROCESS_LIST_SNAPSHOT * pNextRetired;
+    // Epoch of m_pSnapshotReaders once it was replaced.
+    LONG                    lRetiredEpoch;
+    DWORD                   cProcesses;
+    SERVER_PROCESS *        rgProcesses[ANYSIZE_ARRAY];
+};
+
 class PROCESS_MANAGER
 {
 public:
@@ -28,6 +75,10 @@ public:
         }
     }
 
+    //
+    // Returns a referenced process, the caller must call
+    // DereferenceServerProcess() once done with it.
+    //
     HRESULT 
     GetProcess(
         _In_    REQUESTHANDLER_CONFIG      *pConfig,
@@ -35,34 +86,65 @@ public:
         _Out_   SERVER_PROCESS            **ppServerProcess
     );
 
+    //
+    // Like GetProcess but never starts a process: *ppServerProcess is set
+    // to a referenced ready process, or to NULL when one has to be started.
+    //
+    HRESULT
+    GetReadyProcess(
+        _In_    REQUESTHANDLER_CONFIG      *pConfig,
+        _Out_   SERVER_PROCESS            **ppServerProcess
+    );
+
+    HRESULT
+    StartProcessInSlot(
+        _In_    REQUESTHANDLER_CONFIG      *pConfig,
+        _In_    BOOL                        fWebsocketSupported,
+        _In_    DWORD                       dwProcessIndex
+    );
+
+    DWORD
+    QueryProcessesPerApplication() const
+    {
+        return m_dwProcessesPerApplication;
+    }
+
     HANDLE
     QueryNULHandle()
     {
         return m_hNULHandle;
     }
 
+    //
+    // fIsolateWinHttpSession opens the WinHTTP session the processes of the
+    // application forward on, see QueryForwarderSession.
+    //
     HRESULT
     Initialize(
-        VOID
+        BOOL    fIsolateWinHttpSession
     );
 
+    //
+    // NULL when the application forwards on g_hWinhttpSession.
+    //
+    FORWARDER_SESSION*
+    QueryForwarderSession() const
+    {
+        return m_pForwarderSession;
+    }
+
     VOID
     SendShutdownSignal()
     {
-        AcquireSRWLockExclusive( &m_srwLock );
+        std::vector<SERVER_PROCESS*> signaled;
 
-        for(DWORD i = 0; i < m_dwProcessesPerApplication; ++i )
-        {
-            if( m_ppServerProcessList != NULL && 
-                m_ppServerProcessList[i] != NULL )
-            {
-                m_ppServerProcessList[i]->SendSignal();
-                m_ppServerProcessList[i]->DereferenceServerProcess();
-                m_ppServerProcessList[i] = NULL;
-            }
-        }
+        LockContention::AcquireExclusive( &m_srwLock, LockSite::ProcessManager );
+
+        ShutdownAllProcessesNoLock(signaled);
 
         ReleaseSRWLockExclusive( &m_srwLock );
+
+        CompleteSignals(signaled);
     }
 
     VOID 
@@ -70,7 +152,7 @@ public:
         SERVER_PROCESS* pServerProcess
     )
     {
-        AcquireSRWLockExclusive( &m_srwLock );
+        LockContention::AcquireExclusive( &m_srwLock, LockSite::ProcessManager );
 
         ShutdownProcessNoLock( pServerProcess );
 
@@ -81,11 +163,15 @@ public:
     ShutdownAllProcesses(
     )
     {
-        AcquireSRWLockExclusive( &m_srwLock );
+        std::vector<SERVER_PROCESS*> signaled;
+
+        LockContention::AcquireExclusive( &m_srwLock, LockSite::ProcessManager );
 
-        ShutdownAllProcessesNoLock();
+        ShutdownAllProcessesNoLock(signaled);
 
         ReleaseSRWLockExclusive( &m_srwLock );
+
+        CompleteSignals(signaled);
     }
 
     VOID
@@ -94,7 +180,8 @@ public:
     {
         if (InterlockedCompareExchange(&m_lStopping, 1L, 0L) == 0L)
         {
-            ShutdownAllProcesses();
+            m_idleTimer.Cancel();
+            DrainAllProcesses();
         }
     }
 
@@ -103,91 +190,303 @@ public:
         VOID
     )
     {
-        InterlockedIncrement(&m_cRapidFailCount);
+        if (m_rapidFailBreaker.RecordFailure())
+        {
+            m_counters.RapidFailTripped();
+        }
+    }
+
+    //
+    // Backend restarts and rapid fail trips. Owned here rather than by the
+    // application, processes report crashes until the last one is gone.
+    //
+    APPLICATION_COUNTERS*
+    QueryCounters()
+    {
+        return &m_counters;
+    }
+
+    //
+    // Returns TRUE if the caller should run FillStandbyProcesses, at most
+    // one fill runs at a time.
+    //
+    BOOL
+    TryBeginStandbyFill(
+        VOID
+    )
+    {
+        if (m_cStandbyTarget == 0 ||
+            m_cStandbyProcesses >= m_cStandbyTarget ||
+            m_lStopping != 0)
+        {
+            return FALSE;
+        }
+
+        return InterlockedCompareExchange(&m_lStandbyFillInProgress, 1L, 0L) == 0L;
+    }
+
+    VOID
+    FillStandbyProcesses(
+        _In_    REQUESTHANDLER_CONFIG      *pConfig,
+        _In_    BOOL                        fWebsocketSupported
+    );
+
+    //
+    // Returns TRUE if the caller should run RestoreIdleProcesses, once per
+    // idle scale down.
+    //
+    BOOL
+    TryBeginIdleRestore(
+        VOID
+    )
+    {
+        return m_lIdleState == IDLE_STATE_SCALED_DOWN &&
+            InterlockedCompareExchange(&m_lIdleState, IDLE_STATE_RESTORING, IDLE_STATE_SCALED_DOWN) == IDLE_STATE_SCALED_DOWN;
     }
 
+    VOID
+    RestoreIdleProcesses(
+        _In_    REQUESTHANDLER_CONFIG      *pConfig,
+        _In_    BOOL                        fWebsocketSupported
+    );
+
     PROCESS_MANAGER() : 
-        m_ppServerProcessList( NULL ),
+        m_pSnapshot( NULL ),
+        m_pRetiredSnapshots( NULL ),
+        m_pSnapshotReaders( nullptr ),
         m_hNULHandle( NULL ),
-        m_cRapidFailCount( 0 ),
+        m_pForwarderSession( NULL ),
         m_dwProcessesPerApplication( 1 ),
         m_dwRouteToProcessIndex( 0 ),
+        m_RoutingPolicy( ROUTING_ROUND_ROBIN ),
+        m_cNumaNodes( 0 ),
+        m_cStartingProcesses( 0 ),
+        m_cStandbyProcesses( 0 ),
+        m_cStandbyTarget( 0 ),
+        m_lStandbyFillInProgress( 0 ),
+        m_fEnvironmentBlockWebSocketSupported( FALSE ),
         m_fServerProcessListReady(FALSE),
         m_lStopping(0),
+        m_idleTimer( IdleTimerCallback, this ),
+        m_dwIdleScaleDownTimeoutInMS( 0 ),
+        m_fIdleSuspend( FALSE ),
+        m_ullLastRequest( 0 ),
+        m_lIdleState( IDLE_STATE_ACTIVE ),
         m_cRefs( 1 )
     {
-        m_ppServerProcessList = NULL;
-        m_fServerProcessListReady = FALSE;
+        for (DWORD i = 0; i < MAX_STANDBY_PROCESSES; ++i)
+        {
+            m_rgpStandbyProcesses[i] = NULL;
+        }
         InitializeSRWLock( &m_srwLock );
+        InitializeSRWLock( &m_environmentBlockLock );
     }
 
 private:
 
-    BOOL 
-    RapidFailsPerMinuteExceeded(
-        LONG dwRapidFailsPerMinute
-    )
-    {
-        DWORD dwCurrentTickCount = GetTickCount();
+    HRESULT
+    EnsureProcessListReady(
+        _In_    REQUESTHANDLER_CONFIG      *pConfig
+    );
 
-        if( (dwCurrentTickCount - m_dwRapidFailTickStart)
-             >= ONE_MINUTE_IN_MILLISECONDS )
-        {
-            //
-            // reset counters every minute.
-            //
+    HRESULT
+    GetReadyProcessInternal(
+        _In_    REQUESTHANDLER_CONFIG      *pConfig,
+        _Out_   DWORD                      *pdwProcessIndex,
+        _Out_   SERVER_PROCESS            **ppServerProcess
+    );
 
-            InterlockedExchange(&m_cRapidFailCount, 0);
-            m_dwRapidFailTickStart = dwCurrentTickCount;
-        }
+    //
+    // dwProcessIndex is the slot the process is started for, MAXDWORD for
+    // a standby process. With shareBackendsAcrossWebGarden the process may
+    // attach to the backend another worker started for the slot.
+    //
+    HRESULT
+    CreateServerProcess(
+        _In_    REQUESTHANDLER_CONFIG      *pConfig,
+        _In_    BOOL                        fWebsocketSupported,
+        _In_    DWORD                       dwProcessIndex,
+        _Out_   std::unique_ptr<SERVER_PROCESS>& pServerProcess
+    );
 
-        return m_cRapidFailCount > dwRapidFailsPerMinute;
+    //
+    // Starts pServerProcess through the rapid fail breaker.
+    //
+    HRESULT
+    StartServerProcess(
+        _In_    SERVER_PROCESS             *pServerProcess
+    );
+
+    //
+    // The environment block of the backends, built by the first start and
+    // shared by the ones after it.
+    //
+    HRESULT
+    GetEnvironmentBlock(
+        _In_    REQUESTHANDLER_CONFIG      *pConfig,
+        _In_    BOOL                        fWebsocketSupported,
+        _Out_   std::shared_ptr<const ENVIRONMENT_BLOCK>& pEnvironmentBlock
+    );
+
+    BOOL
+    PromoteStandbyProcessNoLock(
+        DWORD                       dwProcessIndex,
+        _Out_ SERVER_PROCESS      **ppServerProcess
+    );
+
+    //
+    // NUMA node the process of slot dwProcessIndex is placed on, -1 without
+    // NUMA placement. Slots are dealt out to the nodes in turn.
+    //
+    LONG
+    QuerySlotNumaNode(
+        DWORD dwProcessIndex
+    ) const
+    {
+        return m_cNumaNodes != 0 ? static_cast<LONG>(dwProcessIndex % m_cNumaNodes) : -1;
     }
 
+    DWORD
+    SelectProcessIndex(
+        _In_ const PROCESS_LIST_SNAPSHOT *  pSnapshot
+    );
+
+    PROCESS_LIST_SNAPSHOT *
+    AcquireSnapshot(
+        _Out_ LONG **   ppcReaders
+    );
+
+    VOID
+    ReleaseSnapshot(
+        _In_ LONG *     pcReaders
+    );
+
+    static
+    HRESULT
+    CreateSnapshot(
+        _In_opt_ const PROCESS_LIST_SNAPSHOT *  pSource,
+        DWORD                                   cProcesses,
+        DWORD                                   dwReplaceIndex,
+        _In_opt_ SERVER_PROCESS *               pReplacement,
+        _Out_ PROCESS_LIST_SNAPSHOT **          ppSnapshot
+    );
+
+    static
+    VOID
+    FreeSnapshot(
+        _In_ PROCESS_LIST_SNAPSHOT *    pSnapshot
+    );
+
+    static
+    VOID
+    FreeSnapshots(
+        _In_opt_ PROCESS_LIST_SNAPSHOT *    pSnapshots
+    );
+
+    VOID
+    PublishSnapshotNoLock(
+        _In_ PROCESS_LIST_SNAPSHOT *    pSnapshot
+    );
+
+    //
+    // Detaches the retired snapshots no reader can hold anymore, for
+    // FreeSnapshots.
+    //
+    PROCESS_LIST_SNAPSHOT *
+    ReclaimSnapshotsNoLock(
+        VOID
+    );
+
     VOID 
     ShutdownProcessNoLock(
         SERVER_PROCESS* pServerProcess
-    )
-    {
-        for(DWORD i = 0; i < m_dwProcessesPerApplication; ++i )
-        {
-            if( m_ppServerProcessList != NULL && 
-                m_ppServerProcessList[i] != NULL && 
-                m_ppServerProcessList[i]->GetPort() == pServerProcess->GetPort() )
-            {
-                // shutdown pServerProcess if not already shutdown.
-                m_ppServerProcessList[i]->StopProcess();
-                m_ppServerProcessList[i]->DereferenceServerProcess();
-                m_ppServerProcessList[i] = NULL;
-            }
-        }
-    }
+    );
 
+    //
+    // Signals every process, those that must still be waited for are
+    // added to signaled for CompleteSignals once m_srwLock is released.
+    //
     VOID 
     ShutdownAllProcessesNoLock(
+        _Inout_ std::vector<SERVER_PROCESS*> & signaled
+    );
+
+    static
+    VOID
+    CompleteSignals(
+        _In_ const std::vector<SERVER_PROCESS*> & signaled
+    );
+
+    VOID
+    DrainAllProcesses(
         VOID
-    )
-    {
-        for(DWORD i = 0; i < m_dwProcessesPerApplication; ++i )
-        {
-            if( m_ppServerProcessList != NULL &&
-                m_ppServerProcessList[i] != NULL )
-            {
-                // shutdown pServerProcess if not already shutdown.
-                m_ppServerProcessList[i]->SendSignal();
-                m_ppServerProcessList[i]->DereferenceServerProcess();
-                m_ppServerProcessList[i] = NULL;
-            }
-        }
-    }
+    );
+
+    static
+    VOID
+    CALLBACK
+    IdleTimerCallback(
+        PVOID       pContext
+    );
+
+    static
+    VOID
+    CALLBACK
+    ScaleDownIdleCallback(
+        PTP_CALLBACK_INSTANCE   Instance,
+        PVOID                   pContext
+    );
+
+    VOID
+    ScaleDownIdleProcesses(
+        VOID
+    );
 
-    volatile LONG                     m_cRapidFailCount;
-    DWORD                             m_dwRapidFailTickStart;
+    RAPID_FAIL_BREAKER                m_rapidFailBreaker;
+    APPLICATION_COUNTERS              m_counters;
     DWORD                             m_dwProcessesPerApplication;
     volatile DWORD                    m_dwRouteToProcessIndex;
+    PROCESS_ROUTING_POLICY            m_RoutingPolicy;
+    //
+    // Number of NUMA nodes processes are placed on, 0 without placement.
+    //
+    DWORD                             m_cNumaNodes;
 
+    //
+    // m_srwLock serializes the writers of m_pSnapshot, readers never take it.
+    //
     SRWLOCK                           m_srwLock;
-    SERVER_PROCESS                  **m_ppServerProcessList;
+    PROCESS_LIST_SNAPSHOT * volatile  m_pSnapshot;
+    // Newest first. Read by ReleaseSnapshot without the lock.
+    PROCESS_LIST_SNAPSHOT * volatile  m_pRetiredSnapshots;
+    //
+    // GetProcess calls currently reading a snapshot. Only advanced by
+    // ReclaimSnapshotsNoLock.
+    //
+    std::unique_ptr<EpochReaders>     m_pSnapshotReaders;
+
+    //
+    // Started, warmed up processes waiting to replace a crashed or recycled
+    // one, protected by m_srwLock. Each entry holds a reference.
+    //
+    SERVER_PROCESS *                  m_rgpStandbyProcesses[MAX_STANDBY_PROCESSES];
+    DWORD                             m_cStandbyProcesses;
+    DWORD                             m_cStandbyTarget;
+    volatile LONG                     m_lStandbyFillInProgress;
+
+    //
+    // Shares the backends of the slots with the other workers of the web
+    // garden, null unless shareBackendsAcrossWebGarden is set.
+    //
+    std::unique_ptr<WEB_GARDEN_REGISTRY> m_pWebGardenRegistry;
+
+    //
+    // Protects m_pEnvironmentBlock, built with the websocket support of
+    // m_fEnvironmentBlockWebSocketSupported.
+    //
+    SRWLOCK                           m_environmentBlockLock;
+    std::shared_ptr<const ENVIRONMENT_BLOCK> m_pEnvironmentBlock;
+    BOOL                              m_fEnvironmentBlockWebSocketSupported;
 
     //
     // m_hNULHandle is used to redirect stdout/stderr to NUL.
@@ -200,9 +499,26 @@ private:
     //
 
     HANDLE                            m_hNULHandle;
+    FORWARDER_SESSION *               m_pForwarderSession;
     mutable LONG                      m_cRefs;
 
     volatile static BOOL              sm_fWSAStartupDone;
+    //
+    // Processes being started, while non zero readers whose slot is not
+    // ready use any ready process.
+    //
+    volatile LONG                     m_cStartingProcesses;
     volatile BOOL                     m_fServerProcessListReady;
     volatile LONG                     m_lStopping;
+
+    //
+    // idleScaleDownTimeout. m_ullLastRequest is only written when it is
+    // IDLE_CHECK_INTERVAL_MS old so that busy applications don't share the
+    // cache line on every request.
+    //
+    TimerWheel::Timer                 m_idleTimer;
+    DWORD                             m_dwIdleScaleDownTimeoutInMS;
+    BOOL                              m_fIdleSuspend;
+    volatile ULONGLONG                m_ullLastRequest;
+    volatile LONG                     m_lIdleState;
 };
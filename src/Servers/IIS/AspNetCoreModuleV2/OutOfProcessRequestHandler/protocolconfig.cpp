@@ -20,6 +20,13 @@ PROTOCOL_CONFIG::Initialize()
     m_dwMinResponseBuffer = 0; // no response buffering
     m_dwResponseBufferLimit = 4096*1024;
     m_dwMaxResponseHeaderSize = 65536;
+    m_dwResponseBufferPoolMinSize = 1024;
+    m_dwResponseBufferPoolDepth = 64;
+    m_dwResponseReadAheadBuffers = 0; // streaming response mode disabled
+    m_dwRequestBodyReadAheadBuffers = 0; // one request body buffer in flight
+    m_dwRequestBodyReadAheadLimit = 0; // bounded by the buffer count only
+    m_dwIdempotentRequestRetries = 0; // failed dispatches are not retried
+    m_dwResponseInlineReads = 0; // every read goes through an IIS completion
     return S_OK;
 }
 
@@ -29,4 +36,9 @@ PROTOCOL_CONFIG::OverrideConfig(
 )
 {
     m_msTimeout = pAspNetCoreConfig->QueryRequestTimeoutInMS();
+    m_dwResponseReadAheadBuffers = pAspNetCoreConfig->QueryResponseReadAheadBuffers();
+    m_dwRequestBodyReadAheadBuffers = pAspNetCoreConfig->QueryRequestBodyReadAheadBuffers();
+    m_dwRequestBodyReadAheadLimit = pAspNetCoreConfig->QueryRequestBodyReadAheadLimit();
+    m_dwIdempotentRequestRetries = pAspNetCoreConfig->QueryIdempotentRequestRetries();
+    m_dwResponseInlineReads = pAspNetCoreConfig->QueryResponseInlineReads();
 }
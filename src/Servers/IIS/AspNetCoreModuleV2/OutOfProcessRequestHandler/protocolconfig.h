@@ -67,6 +67,67 @@ class PROTOCOL_CONFIG
         return m_dwResponseBufferLimit;
     }
 
+    //
+    // Smallest size class of the pooled entity buffers. Size classes double
+    // from here up to min(QueryResponseBufferLimit(), largest entity buffer).
+    //
+    DWORD
+    QueryResponseBufferPoolMinSize() const
+    {
+        return m_dwResponseBufferPoolMinSize;
+    }
+
+    //
+    // Per-CPU free list depth of every pooled size class.
+    //
+    DWORD
+    QueryResponseBufferPoolDepth() const
+    {
+        return m_dwResponseBufferPoolDepth;
+    }
+
+    //
+    // Depth of the read buffer ring of the streaming response mode, 0 when
+    // the mode is off.
+    //
+    DWORD
+    QueryResponseReadAheadBuffers() const
+    {
+        return m_dwResponseReadAheadBuffers;
+    }
+
+    //
+    // Depth and memory cap of the request body upload pipeline; fewer than
+    // two buffers keeps the strict read/write loop.
+    //
+    DWORD
+    QueryRequestBodyReadAheadBuffers() const
+    {
+        return m_dwRequestBodyReadAheadBuffers;
+    }
+
+    DWORD
+    QueryRequestBodyReadAheadLimit() const
+    {
+        return m_dwRequestBodyReadAheadLimit;
+    }
+
+    DWORD
+    QueryIdempotentRequestRetries() const
+    {
+        return m_dwIdempotentRequestRetries;
+    }
+
+    //
+    // Buffered response reads issued in a row from the WinHTTP callback,
+    // bounding the stack when WinHTTP completes them synchronously.
+    //
+    DWORD
+    QueryResponseInlineReads() const
+    {
+        return m_dwResponseInlineReads;
+    }
+
     DWORD
     QueryMaxResponseHeaderSize() const
     {
@@ -96,6 +157,13 @@ class PROTOCOL_CONFIG
     DWORD           m_dwMinResponseBuffer;
     DWORD           m_dwResponseBufferLimit;
     DWORD           m_dwMaxResponseHeaderSize;
+    DWORD           m_dwResponseBufferPoolMinSize;
+    DWORD           m_dwResponseBufferPoolDepth;
+    DWORD           m_dwResponseReadAheadBuffers;
+    DWORD           m_dwRequestBodyReadAheadBuffers;
+    DWORD           m_dwRequestBodyReadAheadLimit;
+    DWORD           m_dwIdempotentRequestRetries;
+    DWORD           m_dwResponseInlineReads;
 
     STRA            m_strXForwardedForName;
     STRA            m_strSslHeaderName;
@@ -0,0 +1,179 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "rapidfailbreaker.h"
+#include "SRWExclusiveLock.h"
+
+RAPID_FAIL_BREAKER::RAPID_FAIL_BREAKER() :
+    m_state(BREAKER_CLOSED),
+    m_dwFailsPerMinute(MAX_RAPID_FAILS_PER_MINUTE),
+    m_dwBackoffInitialInMS(DEFAULT_RAPID_FAIL_BACKOFF_INITIAL_MS),
+    m_dwBackoffMaxInMS(DEFAULT_RAPID_FAIL_BACKOFF_MAX_MS),
+    m_dwRecoveryIntervalInMS(DEFAULT_RAPID_FAIL_RECOVERY_INTERVAL_MS),
+    m_cFailures(0),
+    m_ullWindowStart(GetTickCount64()),
+    m_ullOpenUntil(0),
+    m_ullClosedSince(m_ullWindowStart),
+    m_cConsecutiveTrips(0),
+    m_fProbeInFlight(FALSE)
+{
+    InitializeSRWLock(&m_srwLock);
+}
+
+VOID
+RAPID_FAIL_BREAKER::Initialize(
+    DWORD   dwFailsPerMinute,
+    DWORD   dwBackoffInitialInMS,
+    DWORD   dwBackoffMaxInMS,
+    DWORD   dwRecoveryIntervalInMS
+)
+{
+    SRWExclusiveLock lock(m_srwLock);
+
+    m_dwFailsPerMinute = dwFailsPerMinute;
+    m_dwBackoffInitialInMS = dwBackoffInitialInMS;
+    m_dwBackoffMaxInMS = max(dwBackoffMaxInMS, dwBackoffInitialInMS);
+    m_dwRecoveryIntervalInMS = dwRecoveryIntervalInMS;
+}
+
+BOOL
+RAPID_FAIL_BREAKER::RecordFailure(
+    VOID
+)
+{
+    SRWExclusiveLock lock(m_srwLock);
+
+    const ULONGLONG ullNow = GetTickCount64();
+    if (ullNow - m_ullWindowStart >= ONE_MINUTE_IN_MILLISECONDS)
+    {
+        m_ullWindowStart = ullNow;
+        m_cFailures = 0;
+    }
+
+    m_cFailures++;
+
+    //
+    // While half open the probe decides, see EndStart.
+    //
+    if (m_state == BREAKER_CLOSED && m_cFailures > m_dwFailsPerMinute)
+    {
+        TripNoLock(ullNow);
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+BOOL
+RAPID_FAIL_BREAKER::IsStartAllowed(
+    VOID
+)
+{
+    SRWExclusiveLock lock(m_srwLock);
+
+    switch (m_state)
+    {
+    case BREAKER_OPEN:
+        return GetTickCount64() >= m_ullOpenUntil;
+
+    case BREAKER_HALF_OPEN:
+        return !m_fProbeInFlight;
+
+    default:
+        return TRUE;
+    }
+}
+
+BOOL
+RAPID_FAIL_BREAKER::TryBeginStart(
+    _Out_ BOOL     *pfProbe
+)
+{
+    SRWExclusiveLock lock(m_srwLock);
+
+    *pfProbe = FALSE;
+
+    if (m_state == BREAKER_OPEN)
+    {
+        if (GetTickCount64() < m_ullOpenUntil)
+        {
+            return FALSE;
+        }
+
+        m_state = BREAKER_HALF_OPEN;
+        m_fProbeInFlight = FALSE;
+    }
+
+    if (m_state == BREAKER_HALF_OPEN)
+    {
+        if (m_fProbeInFlight)
+        {
+            return FALSE;
+        }
+
+        m_fProbeInFlight = TRUE;
+        *pfProbe = TRUE;
+    }
+
+    return TRUE;
+}
+
+BOOL
+RAPID_FAIL_BREAKER::EndStart(
+    BOOL    fProbe,
+    BOOL    fSucceeded
+)
+{
+    if (!fProbe)
+    {
+        return FALSE;
+    }
+
+    SRWExclusiveLock lock(m_srwLock);
+
+    const ULONGLONG ullNow = GetTickCount64();
+    m_fProbeInFlight = FALSE;
+
+    if (fSucceeded)
+    {
+        LOG_INFO(L"Backend process started after rapid fail backoff, accepting process starts again.");
+
+        m_state = BREAKER_CLOSED;
+        m_cFailures = 0;
+        m_ullWindowStart = ullNow;
+        m_ullClosedSince = ullNow;
+        return FALSE;
+    }
+
+    TripNoLock(ullNow);
+    return TRUE;
+}
+
+VOID
+RAPID_FAIL_BREAKER::TripNoLock(
+    ULONGLONG   ullNow
+)
+{
+    if (m_state == BREAKER_CLOSED && m_dwRecoveryIntervalInMS != 0)
+    {
+        const ULONGLONG cRecovered = (ullNow - m_ullClosedSince) / m_dwRecoveryIntervalInMS;
+        m_cConsecutiveTrips -= static_cast<DWORD>(min(cRecovered, static_cast<ULONGLONG>(m_cConsecutiveTrips)));
+    }
+
+    ULONGLONG ullBackoff = m_dwBackoffInitialInMS;
+    for (DWORD i = 0; i < m_cConsecutiveTrips && ullBackoff < m_dwBackoffMaxInMS; ++i)
+    {
+        ullBackoff *= 2;
+    }
+    ullBackoff = min(ullBackoff, static_cast<ULONGLONG>(m_dwBackoffMaxInMS));
+
+    m_cConsecutiveTrips++;
+    m_state = BREAKER_OPEN;
+    m_ullOpenUntil = ullNow + ullBackoff;
+    m_cFailures = 0;
+    m_ullWindowStart = ullNow;
+
+    LOG_WARNF(L"Rapid fail limit of %d per minute exceeded, refusing backend process starts for %llu ms",
+        m_dwFailsPerMinute,
+        ullBackoff);
+}
@@ -0,0 +1,98 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// Circuit breaker in front of the backend process starts of an application.
+//
+//  closed      starts are allowed, crashes and failed starts are counted
+//              per minute.
+//  open        more than rapidFailsPerMinute failures, starts are refused
+//              for the backoff, which doubles with every consecutive trip
+//              up to the configured maximum.
+//  half open   the backoff elapsed, a single probe start is let through. It
+//              closes the breaker when the process comes up and reopens it
+//              with the next backoff otherwise.
+//
+// Every recovery interval spent closed takes one doubling off the next
+// backoff, so an application that crashes now and then is not held back
+// like one that is crash looping.
+//
+class RAPID_FAIL_BREAKER
+{
+public:
+
+    RAPID_FAIL_BREAKER();
+
+    VOID
+    Initialize(
+        DWORD   dwFailsPerMinute,
+        DWORD   dwBackoffInitialInMS,
+        DWORD   dwBackoffMaxInMS,
+        DWORD   dwRecoveryIntervalInMS
+    );
+
+    //
+    // Counts a crash or a failed start. Returns TRUE if it opened the breaker.
+    //
+    BOOL
+    RecordFailure(
+        VOID
+    );
+
+    //
+    // Whether TryBeginStart would currently let a start through, without
+    // claiming the probe.
+    //
+    BOOL
+    IsStartAllowed(
+        VOID
+    );
+
+    //
+    // Returns FALSE if the breaker refuses the start. Otherwise the caller
+    // starts a process and reports the outcome to EndStart, passing back
+    // *pfProbe.
+    //
+    BOOL
+    TryBeginStart(
+        _Out_ BOOL     *pfProbe
+    );
+
+    //
+    // Returns TRUE if a failed probe opened the breaker again.
+    //
+    BOOL
+    EndStart(
+        BOOL    fProbe,
+        BOOL    fSucceeded
+    );
+
+private:
+
+    enum BREAKER_STATE
+    {
+        BREAKER_CLOSED,
+        BREAKER_OPEN,
+        BREAKER_HALF_OPEN
+    };
+
+    VOID
+    TripNoLock(
+        ULONGLONG   ullNow
+    );
+
+    SRWLOCK         m_srwLock;
+    BREAKER_STATE   m_state;
+    DWORD           m_dwFailsPerMinute;
+    DWORD           m_dwBackoffInitialInMS;
+    DWORD           m_dwBackoffMaxInMS;
+    DWORD           m_dwRecoveryIntervalInMS;
+    DWORD           m_cFailures;
+    ULONGLONG       m_ullWindowStart;
+    ULONGLONG       m_ullOpenUntil;
+    ULONGLONG       m_ullClosedSince;
+    DWORD           m_cConsecutiveTrips;
+    BOOL            m_fProbeInFlight;
+};
@@ -0,0 +1,205 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "requestdelegation.h"
+#include "SRWExclusiveLock.h"
+
+PFN_HTTP_FIND_URL_GROUP_ID
+REQUEST_DELEGATION::sm_pfnHttpFindUrlGroupId;
+
+PFN_HTTP_DELEGATE_REQUEST_EX
+REQUEST_DELEGATION::sm_pfnHttpDelegateRequestEx;
+
+HANDLE  REQUEST_DELEGATION::sm_hSourceQueue = NULL;
+SRWLOCK REQUEST_DELEGATION::sm_srwSourceQueueLock = SRWLOCK_INIT;
+
+REQUEST_DELEGATION::REQUEST_DELEGATION() :
+    m_hQueue(NULL)
+{
+}
+
+REQUEST_DELEGATION::~REQUEST_DELEGATION()
+{
+    if (m_hQueue != NULL)
+    {
+        HttpCloseRequestQueue(m_hQueue);
+        m_hQueue = NULL;
+    }
+}
+
+//static
+HRESULT
+REQUEST_DELEGATION::StaticInitialize(
+    VOID
+)
+{
+    HMODULE hHttpApi = GetModuleHandleA("httpapi.dll");
+    RETURN_LAST_ERROR_IF(hHttpApi == NULL);
+
+    sm_pfnHttpFindUrlGroupId = (PFN_HTTP_FIND_URL_GROUP_ID)
+        GetProcAddress(hHttpApi, "HttpFindUrlGroupId");
+    sm_pfnHttpDelegateRequestEx = (PFN_HTTP_DELEGATE_REQUEST_EX)
+        GetProcAddress(hHttpApi, "HttpDelegateRequestEx");
+
+    if (sm_pfnHttpFindUrlGroupId == NULL)
+    {
+        sm_pfnHttpDelegateRequestEx = NULL;
+    }
+
+    return S_OK;
+}
+
+//static
+HRESULT
+REQUEST_DELEGATION::EnsureSourceQueue(
+    VOID
+)
+{
+    SRWExclusiveLock lock(sm_srwSourceQueueLock);
+
+    if (sm_hSourceQueue != NULL)
+    {
+        return S_OK;
+    }
+
+    ULONG ulResult = HttpInitialize(HTTPAPI_VERSION_2, HTTP_INITIALIZE_SERVER, NULL);
+    if (ulResult != NO_ERROR)
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(ulResult));
+    }
+
+    //
+    // The worker process receives its requests from the queue named after
+    // its application pool, a handle of our own on it is enough to hand
+    // them over.
+    //
+    HANDLE hSourceQueue = NULL;
+    ulResult = HttpCreateRequestQueue(HTTPAPI_VERSION_2,
+        g_pHttpServer->GetAppPoolName(),
+        NULL,
+        HTTP_CREATE_REQUEST_QUEUE_FLAG_OPEN_EXISTING,
+        &hSourceQueue);
+    if (ulResult != NO_ERROR)
+    {
+        HttpTerminate(HTTP_INITIALIZE_SERVER, NULL);
+        RETURN_HR(HRESULT_FROM_WIN32(ulResult));
+    }
+
+    sm_hSourceQueue = hSourceQueue;
+    return S_OK;
+}
+
+HRESULT
+REQUEST_DELEGATION::Open(
+    _In_ PCWSTR     pszQueueName,
+    _In_ PCWSTR     pszUrlPrefix
+)
+{
+    HTTP_URL_GROUP_ID   urlGroupId = 0;
+    HTTP_BINDING_INFO   bindingInfo = {};
+    ULONG               ulResult = NO_ERROR;
+
+    if (!IsSupported())
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED));
+    }
+
+    RETURN_IF_FAILED(EnsureSourceQueue());
+    RETURN_IF_FAILED(m_struUrlPrefix.Copy(pszUrlPrefix));
+
+    if (m_hQueue == NULL)
+    {
+        ulResult = HttpCreateRequestQueue(HTTPAPI_VERSION_2,
+            pszQueueName,
+            NULL,
+            HTTP_CREATE_REQUEST_QUEUE_FLAG_OPEN_EXISTING,
+            &m_hQueue);
+        if (ulResult != NO_ERROR)
+        {
+            m_hQueue = NULL;
+            return HRESULT_FROM_WIN32(ulResult);
+        }
+    }
+
+    ulResult = sm_pfnHttpFindUrlGroupId(pszUrlPrefix, m_hQueue, &urlGroupId);
+    if (ulResult != NO_ERROR)
+    {
+        return HRESULT_FROM_WIN32(ulResult);
+    }
+
+    //
+    // Lets the URL group of the backend take requests delegated from
+    // another queue.
+    //
+    bindingInfo.Flags.Present = 1;
+    bindingInfo.RequestQueueHandle = m_hQueue;
+    ulResult = HttpSetUrlGroupProperty(urlGroupId,
+        HTTP_SERVER_DELEGATION_PROPERTY,
+        &bindingInfo,
+        sizeof(bindingInfo));
+    if (ulResult != NO_ERROR)
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(ulResult));
+    }
+
+    return S_OK;
+}
+
+//static
+BOOL
+REQUEST_DELEGATION::CanDelegate(
+    _In_ IHttpContext  *pHttpContext
+)
+{
+    IHttpRequest       *pRequest = pHttpContext->GetRequest();
+    const HTTP_REQUEST *pRawRequest = pRequest->GetRawHttpRequest();
+
+    // A child request shares the HTTP.sys request of its parent.
+    if (pHttpContext->GetParentContext() != NULL)
+    {
+        return FALSE;
+    }
+
+    // Received along with the headers, HTTP.sys no longer has it.
+    if (pRawRequest->EntityChunkCount != 0)
+    {
+        return FALSE;
+    }
+
+    PCSTR pszContentLength = pRequest->GetHeader(HttpHeaderContentLength);
+    if (pszContentLength != NULL)
+    {
+        // Unless a module read some of the body before us.
+        return pRequest->GetRemainingEntityBytes() == strtoul(pszContentLength, NULL, 10);
+    }
+
+    return pRequest->GetHeader(HttpHeaderTransferEncoding) == NULL;
+}
+
+HRESULT
+REQUEST_DELEGATION::DelegateRequest(
+    _In_ IHttpRequest  *pRequest
+)
+{
+    REQUEST_DELEGATION_PROPERTY_INFO propertyInfo;
+    propertyInfo.ulPropertyId = DELEGATE_REQUEST_DELEGATE_URL_PROPERTY;
+    propertyInfo.cbPropertyInfo = m_struUrlPrefix.QueryCCH() * sizeof(WCHAR);
+    propertyInfo.pvPropertyInfo = m_struUrlPrefix.QueryStr();
+
+    //
+    // No URL group id, HTTP.sys finds the group of the backend from the
+    // URL in the property.
+    //
+    const ULONG ulResult = sm_pfnHttpDelegateRequestEx(sm_hSourceQueue,
+        m_hQueue,
+        pRequest->GetRawHttpRequest()->RequestId,
+        0,
+        1,
+        &propertyInfo);
+    if (ulResult != NO_ERROR)
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(ulResult));
+    }
+
+    return S_OK;
+}
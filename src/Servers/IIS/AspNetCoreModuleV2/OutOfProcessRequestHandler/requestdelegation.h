@@ -0,0 +1,126 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+// Name of the HTTP.sys request queue a backend taking delegated requests creates.
+#define ASPNETCORE_DELEGATION_QUEUE_ENV_STR         L"ASPNETCORE_DELEGATION_QUEUE="
+#define DELEGATION_QUEUE_NAME_PREFIX                L"AspNetCore_"
+
+//
+// HTTP_DELEGATE_REQUEST_PROPERTY_INFO and the ids it uses. Declared here
+// as the SDK only has them for Windows 10 targets.
+//
+struct REQUEST_DELEGATION_PROPERTY_INFO
+{
+    ULONG   ulPropertyId;
+    ULONG   cbPropertyInfo;
+    PVOID   pvPropertyInfo;
+};
+
+#define DELEGATE_REQUEST_DELEGATE_URL_PROPERTY      1
+#define HTTP_SERVER_DELEGATION_PROPERTY             static_cast<HTTP_SERVER_PROPERTY>(16)
+
+typedef
+ULONG
+(WINAPI * PFN_HTTP_FIND_URL_GROUP_ID)(
+    _In_ PCWSTR FullyQualifiedUrl,
+    _In_ HANDLE RequestQueueHandle,
+    _Out_ PHTTP_URL_GROUP_ID UrlGroupId
+);
+
+typedef
+ULONG
+(WINAPI * PFN_HTTP_DELEGATE_REQUEST_EX)(
+    _In_ HANDLE RequestQueueHandle,
+    _In_ HANDLE DelegateQueueHandle,
+    _In_ HTTP_REQUEST_ID RequestId,
+    _In_ HTTP_URL_GROUP_ID DelegateUrlGroupId,
+    _In_ ULONG PropertyInfoSetSize,
+    _In_reads_(PropertyInfoSetSize) REQUEST_DELEGATION_PROPERTY_INFO * PropertyInfoSet
+);
+
+//
+// Hands requests to the HTTP.sys request queue of a backend process with
+// requestDelegation, instead of proxying them through WinHTTP. HTTP.sys
+// moves the request and its connection to the backend, which reads the
+// body and sends the response itself.
+//
+// The backend, an HttpSys server, creates the request queue named in
+// ASPNETCORE_DELEGATION_QUEUE and registers http://127.0.0.1:<port>/ on it,
+// with the port of ASPNETCORE_PORT. SERVER_PROCESS waits for that queue
+// instead of a listener on the port. Requests that can't be delegated are
+// still proxied to the port.
+//
+class REQUEST_DELEGATION
+{
+public:
+    REQUEST_DELEGATION();
+
+    ~REQUEST_DELEGATION();
+
+    //
+    // Finds the delegation functions, older systems don't have them and
+    // requests are then proxied.
+    //
+    static
+    HRESULT
+    StaticInitialize();
+
+    static
+    BOOL
+    IsSupported()
+    {
+        return sm_pfnHttpDelegateRequestEx != NULL;
+    }
+
+    //
+    // Fails until the backend created its queue and registered
+    // pszUrlPrefix on it, it does not log as it is polled during startup.
+    //
+    HRESULT
+    Open(
+        _In_ PCWSTR     pszQueueName,
+        _In_ PCWSTR     pszUrlPrefix
+    );
+
+    //
+    // Whether IIS left all of the request to HTTP.sys. A request with some
+    // of its body read by IIS, or a child request, is proxied instead.
+    //
+    static
+    BOOL
+    CanDelegate(
+        _In_ IHttpContext  *pHttpContext
+    );
+
+    //
+    // Once it succeeds the request is gone from the queue of the worker
+    // process and nothing can be sent for it anymore.
+    //
+    HRESULT
+    DelegateRequest(
+        _In_ IHttpRequest  *pRequest
+    );
+
+private:
+    //
+    // The queue of the application pool, opened once and kept for the
+    // rest of the worker process.
+    //
+    static
+    HRESULT
+    EnsureSourceQueue();
+
+    HANDLE                  m_hQueue;
+    STRU                    m_struUrlPrefix;
+
+    static
+    PFN_HTTP_FIND_URL_GROUP_ID      sm_pfnHttpFindUrlGroupId;
+
+    static
+    PFN_HTTP_DELEGATE_REQUEST_EX    sm_pfnHttpDelegateRequestEx;
+
+    static HANDLE           sm_hSourceQueue;
+    static SRWLOCK          sm_srwSourceQueueLock;
+};
@@ -0,0 +1,97 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "requestsampler.h"
+#include <memory>
+#include "SRWExclusiveLock.h"
+#include "SRWSharedLock.h"
+#include "TraceProvider.h"
+
+REQUEST_SAMPLER::REQUEST_SAMPLER() :
+    m_cRecorded(0),
+    m_rgSamples()
+{
+    InitializeSRWLock(&m_lock);
+}
+
+// static
+BOOL
+REQUEST_SAMPLER::ShouldSample(
+    DWORD                   dwSamplingRate
+)
+{
+    static thread_local DWORD t_cRequests;
+
+    return dwSamplingRate != 0 && ++t_cRequests % dwSamplingRate == 0;
+}
+
+VOID
+REQUEST_SAMPLER::Record(
+    _In_ const REQUEST_SAMPLE * pSample
+)
+{
+    SRWExclusiveLock lock(m_lock);
+
+    m_rgSamples[m_cRecorded % RING_SIZE] = *pSample;
+    m_cRecorded++;
+}
+
+VOID
+REQUEST_SAMPLER::Dump(
+    VOID
+)
+{
+    if (!TraceLoggingProviderEnabled(g_hTraceProvider, WINEVENT_LEVEL_INFO, ASPNETCORE_TRACE_KEYWORD_REQUESTS))
+    {
+        return;
+    }
+
+    //
+    // Copied out so that requests finishing meanwhile do not wait for the
+    // events to be written.
+    //
+    std::unique_ptr<REQUEST_SAMPLE[]> pSamples(new (std::nothrow) REQUEST_SAMPLE[RING_SIZE]);
+    if (pSamples == NULL)
+    {
+        return;
+    }
+
+    ULONGLONG cRecorded;
+    DWORD cSamples;
+    {
+        SRWSharedLock lock(m_lock);
+
+        cRecorded = m_cRecorded;
+        cSamples = static_cast<DWORD>(min(cRecorded, static_cast<ULONGLONG>(RING_SIZE)));
+        for (DWORD i = 0; i < cSamples; i++)
+        {
+            pSamples[i] = m_rgSamples[(cRecorded - cSamples + i) % RING_SIZE];
+        }
+    }
+
+    for (DWORD i = 0; i < cSamples; i++)
+    {
+        const REQUEST_SAMPLE &sample = pSamples[i];
+
+        TraceLoggingWrite(g_hTraceProvider,
+            "RequestSample",
+            TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+            TraceLoggingKeyword(ASPNETCORE_TRACE_KEYWORD_REQUESTS),
+            TraceLoggingUInt64(cRecorded - cSamples + i, "SampleIndex"),
+            TraceLoggingFileTime(sample.ftCompleted, "CompletedTime"),
+            TraceLoggingWideString(sample.achUrl, "Url"),
+            TraceLoggingUInt32(sample.dwProcessId, "ProcessId"),
+            TraceLoggingUInt16(sample.usStatusCode, "StatusCode"),
+            TraceLoggingUInt32(sample.cchRequestHeaders, "RequestHeaderChars"),
+            TraceLoggingUInt32(sample.cchResponseHeaders, "ResponseHeaderChars"),
+            TraceLoggingUInt64(sample.cbRequestBody, "RequestBodyBytes"),
+            TraceLoggingUInt64(sample.cbResponseBody, "ResponseBodyBytes"),
+            TraceLoggingUInt32(sample.cFlushes, "Flushes"),
+            TraceLoggingUInt32(sample.cWinHttpCallbacks, "WinHttpCallbacks"),
+            TraceLoggingHexUInt32(sample.dwWinHttpCallbackStatuses, "WinHttpCallbackStatuses"),
+            TraceLoggingUInt32(sample.ulSendComplete, "SendCompleteMicroseconds"),
+            TraceLoggingUInt32(sample.ulHeadersAvailable, "HeadersAvailableMicroseconds"),
+            TraceLoggingUInt32(sample.ulFirstByte, "FirstByteMicroseconds"),
+            TraceLoggingUInt32(sample.ulLastByte, "LastByteMicroseconds"));
+    }
+}
@@ -0,0 +1,98 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// Detail of one sampled forwarded request. Filled by its FORWARDING_HANDLER
+// under the request lock and copied into the ring once the request is done.
+//
+struct REQUEST_SAMPLE
+{
+    static const DWORD  MAX_URL_CCH = 128;
+
+    //
+    // System time the request finished.
+    //
+    FILETIME            ftCompleted;
+    DWORD               dwProcessId;
+    USHORT              usStatusCode;
+    //
+    // Characters of the request headers sent and of the status line and
+    // headers received.
+    //
+    DWORD               cchRequestHeaders;
+    DWORD               cchResponseHeaders;
+    //
+    // Bytes written to and read from the backend, chunk framing included.
+    //
+    ULONGLONG           cbRequestBody;
+    ULONGLONG           cbResponseBody;
+    DWORD               cFlushes;
+    DWORD               cWinHttpCallbacks;
+    //
+    // WINHTTP_CALLBACK_STATUS_* flags of the callbacks observed.
+    //
+    DWORD               dwWinHttpCallbackStatuses;
+    //
+    // Microseconds since the start of the request, see FORWARD_TIMINGS.
+    //
+    ULONG               ulSendComplete;
+    ULONG               ulHeadersAvailable;
+    ULONG               ulFirstByte;
+    ULONG               ulLastByte;
+    //
+    // Path of the request, truncated.
+    //
+    WCHAR               achUrl[MAX_URL_CCH];
+};
+
+//
+// Keeps the last RING_SIZE requests sampled by the handlers of this module
+// and writes them as RequestSample events of the module's TraceLogging
+// provider when a session that enabled ASPNETCORE_TRACE_KEYWORD_REQUESTS
+// asks for a rundown.
+//
+// Which requests are sampled is decided per thread, so that picking one in
+// requestSamplingRate requests costs a request no shared write.
+//
+class REQUEST_SAMPLER
+{
+public:
+
+    static const DWORD  RING_SIZE = 256;
+
+    REQUEST_SAMPLER();
+
+    static
+    BOOL
+    ShouldSample(
+        DWORD                   dwSamplingRate
+    );
+
+    VOID
+    Record(
+        _In_ const REQUEST_SAMPLE * pSample
+    );
+
+    //
+    // Writes the samples in the ring, oldest first. Does nothing unless a
+    // session listens for them.
+    //
+    VOID
+    Dump(
+        VOID
+    );
+
+private:
+
+    REQUEST_SAMPLER(const REQUEST_SAMPLER &);
+    void operator=(const REQUEST_SAMPLER &);
+
+    SRWLOCK                 m_lock;
+    //
+    // Total samples recorded, the next one goes to slot m_cRecorded % RING_SIZE.
+    //
+    ULONGLONG               m_cRecorded;
+    REQUEST_SAMPLE          m_rgSamples[RING_SIZE];
+};
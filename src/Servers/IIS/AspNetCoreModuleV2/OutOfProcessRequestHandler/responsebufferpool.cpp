@@ -0,0 +1,175 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "responsebufferpool.h"
+#include "exceptions.h"
+
+#define RESPONSE_BUFFER_SIGNATURE           ((DWORD)'RBPL')
+#define RESPONSE_BUFFER_SIGNATURE_FREE      ((DWORD)'rbpl')
+
+RESPONSE_BUFFER_POOL::RESPONSE_BUFFER_POOL(
+    VOID
+) : m_cSizeClasses(0)
+{
+    for (DWORD i = 0; i < MAX_SIZE_CLASSES; ++i)
+    {
+        m_rgcbSizeClasses[i] = 0;
+        m_rgpAllocators[i] = NULL;
+    }
+}
+
+RESPONSE_BUFFER_POOL::~RESPONSE_BUFFER_POOL()
+{
+    for (DWORD i = 0; i < m_cSizeClasses; ++i)
+    {
+        if (m_rgpAllocators[i] != NULL)
+        {
+            delete m_rgpAllocators[i];
+            m_rgpAllocators[i] = NULL;
+        }
+    }
+    m_cSizeClasses = 0;
+}
+
+HRESULT
+RESPONSE_BUFFER_POOL::Initialize(
+    DWORD   cbMinBufferSize,
+    DWORD   cbMaxBufferSize,
+    LONG    nThreshold
+)
+/*++
+
+Routine Description:
+
+    Build the size classes for the pool. Size classes start at
+    cbMinBufferSize and double until cbMaxBufferSize is reached; the last
+    size class is always exactly cbMaxBufferSize so that the largest buffer
+    FORWARDING_HANDLER asks for is still served from the pool.
+
+Arguments:
+
+    cbMinBufferSize - Smallest size class.
+    cbMaxBufferSize - Largest size class.
+    nThreshold      - Per-CPU free list depth of each size class.
+
+Return Value:
+
+    HRESULT
+
+--*/
+{
+    DBG_ASSERT(m_cSizeClasses == 0);
+
+    if (cbMinBufferSize == 0 || cbMaxBufferSize < cbMinBufferSize)
+    {
+        RETURN_HR(E_INVALIDARG);
+    }
+
+    DWORD cbSizeClass = cbMinBufferSize;
+    while (m_cSizeClasses < MAX_SIZE_CLASSES)
+    {
+        if (cbSizeClass >= cbMaxBufferSize ||
+            m_cSizeClasses == MAX_SIZE_CLASSES - 1)
+        {
+            cbSizeClass = cbMaxBufferSize;
+        }
+
+        auto pAllocator = std::make_unique<ALLOC_CACHE_HANDLER>();
+        RETURN_IF_FAILED(pAllocator->Initialize(static_cast<DWORD>(HEADER_SIZE) + cbSizeClass, nThreshold));
+
+        m_rgcbSizeClasses[m_cSizeClasses] = cbSizeClass;
+        m_rgpAllocators[m_cSizeClasses] = pAllocator.release();
+        m_cSizeClasses++;
+
+        if (cbSizeClass == cbMaxBufferSize)
+        {
+            break;
+        }
+
+        cbSizeClass *= 2;
+    }
+
+    return S_OK;
+}
+
+BYTE *
+RESPONSE_BUFFER_POOL::Alloc(
+    DWORD                               cbBufferSize,
+    _In_opt_ APPLICATION_COUNTERS *     pCounters,
+    APPLICATION_COUNTERS::MEMORY_TAG    memoryTag
+)
+{
+    BUFFER_HEADER * pHeader = NULL;
+    DWORD           dwSizeClass = HEAP_SIZE_CLASS;
+
+    //
+    // Only a handful of size classes, a linear scan is cheaper than
+    // anything smarter.
+    //
+    for (DWORD i = 0; i < m_cSizeClasses; ++i)
+    {
+        if (cbBufferSize <= m_rgcbSizeClasses[i])
+        {
+            dwSizeClass = i;
+            break;
+        }
+    }
+
+    if (dwSizeClass != HEAP_SIZE_CLASS)
+    {
+        pHeader = static_cast<BUFFER_HEADER *>(m_rgpAllocators[dwSizeClass]->Alloc());
+    }
+    else
+    {
+        pHeader = static_cast<BUFFER_HEADER *>(HeapAlloc(GetProcessHeap(),
+            0, // dwFlags
+            HEADER_SIZE + cbBufferSize));
+    }
+
+    if (pHeader == NULL)
+    {
+        return NULL;
+    }
+
+    pHeader->dwSignature = RESPONSE_BUFFER_SIGNATURE;
+    pHeader->dwSizeClass = dwSizeClass;
+    pHeader->cbCharged = static_cast<DWORD>(HEADER_SIZE) +
+        (dwSizeClass != HEAP_SIZE_CLASS ? m_rgcbSizeClasses[dwSizeClass] : cbBufferSize);
+    pHeader->memoryTag = memoryTag;
+    pHeader->pCounters = pCounters;
+
+    if (pCounters != NULL)
+    {
+        pCounters->MemoryCharged(memoryTag, pHeader->cbCharged);
+    }
+
+    return reinterpret_cast<BYTE *>(pHeader) + HEADER_SIZE;
+}
+
+VOID
+RESPONSE_BUFFER_POOL::Free(
+    _In_ BYTE * pBuffer
+)
+{
+    DBG_ASSERT(pBuffer != NULL);
+
+    BUFFER_HEADER * pHeader = reinterpret_cast<BUFFER_HEADER *>(pBuffer - HEADER_SIZE);
+    DBG_ASSERT(pHeader->dwSignature == RESPONSE_BUFFER_SIGNATURE);
+    pHeader->dwSignature = RESPONSE_BUFFER_SIGNATURE_FREE;
+
+    if (pHeader->pCounters != NULL)
+    {
+        pHeader->pCounters->MemoryReleased(pHeader->memoryTag, pHeader->cbCharged);
+    }
+
+    if (pHeader->dwSizeClass == HEAP_SIZE_CLASS)
+    {
+        HeapFree(GetProcessHeap(),
+            0, // dwFlags
+            pHeader);
+        return;
+    }
+
+    DBG_ASSERT(pHeader->dwSizeClass < m_cSizeClasses);
+    m_rgpAllocators[pHeader->dwSizeClass]->Free(pHeader);
+}
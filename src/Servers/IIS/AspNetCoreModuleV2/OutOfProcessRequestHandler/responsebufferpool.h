@@ -0,0 +1,89 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// Size-classed pool for the entity buffers used by FORWARDING_HANDLER and
+// the receive buffers WEBSOCKET_HANDLER borrows while relaying a message.
+//
+// Every size class is backed by its own ALLOC_CACHE_HANDLER, i.e. a
+// PER_CPU<SLIST_HEADER> free list, so the common allocate/free pair on the
+// request path never takes the process heap lock. Requests larger than the
+// biggest size class go straight to the process heap.
+//
+// A buffer is charged to the application counters it was allocated for
+// until it is freed, the counters must outlive it.
+//
+class RESPONSE_BUFFER_POOL
+{
+public:
+
+    RESPONSE_BUFFER_POOL(
+        VOID
+    );
+
+    ~RESPONSE_BUFFER_POOL();
+
+    HRESULT
+    Initialize(
+        DWORD   cbMinBufferSize,
+        DWORD   cbMaxBufferSize,
+        LONG    nThreshold
+    );
+
+    BYTE *
+    Alloc(
+        DWORD                               cbBufferSize,
+        _In_opt_ APPLICATION_COUNTERS *     pCounters,
+        APPLICATION_COUNTERS::MEMORY_TAG    memoryTag
+    );
+
+    VOID
+    Free(
+        _In_ BYTE * pBuffer
+    );
+
+    DWORD
+    QuerySizeClassCount() const
+    {
+        return m_cSizeClasses;
+    }
+
+    DWORD
+    QuerySizeClass(
+        DWORD   dwIndex
+    ) const
+    {
+        DBG_ASSERT(dwIndex < m_cSizeClasses);
+        return m_rgcbSizeClasses[dwIndex];
+    }
+
+private:
+
+    //
+    // Prefix stored in front of every buffer handed out by the pool so that
+    // Free() knows which size class the block belongs to. The header is
+    // padded to MEMORY_ALLOCATION_ALIGNMENT to keep the payload aligned.
+    //
+    struct BUFFER_HEADER
+    {
+        DWORD                               dwSignature;
+        DWORD                               dwSizeClass;
+        DWORD                               cbCharged;
+        APPLICATION_COUNTERS::MEMORY_TAG    memoryTag;
+        APPLICATION_COUNTERS *              pCounters;
+    };
+
+    static const DWORD  MAX_SIZE_CLASSES = 8;
+    static const DWORD  HEAP_SIZE_CLASS = 0xFFFFFFFF;
+    static const SIZE_T HEADER_SIZE =
+        (sizeof(BUFFER_HEADER) + MEMORY_ALLOCATION_ALIGNMENT - 1) & ~(MEMORY_ALLOCATION_ALIGNMENT - 1);
+
+    RESPONSE_BUFFER_POOL(const RESPONSE_BUFFER_POOL &);
+    void operator=(const RESPONSE_BUFFER_POOL &);
+
+    DWORD                   m_cSizeClasses;
+    DWORD                   m_rgcbSizeClasses[MAX_SIZE_CLASSES];
+    ALLOC_CACHE_HANDLER *   m_rgpAllocators[MAX_SIZE_CLASSES];
+};
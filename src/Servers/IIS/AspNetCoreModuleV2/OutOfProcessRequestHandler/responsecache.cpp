@@ -0,0 +1,812 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "responsecache.h"
+#include <memory>
+#include "hashfn.h"
+#include "exceptions.h"
+#include "SRWExclusiveLock.h"
+#include "SRWSharedLock.h"
+
+#define RESPONSE_CACHE_BUCKETS              256
+
+//
+// Longest a response is kept, whatever its max-age.
+//
+#define RESPONSE_CACHE_MAX_AGE_SECONDS      (24 * 60 * 60)
+
+struct CACHE_CONTROL
+{
+    BOOL    fNoStore;
+    BOOL    fNoCache;
+    BOOL    fPrivate;
+    // -1 when absent
+    LONG    lMaxAge;
+    LONG    lSharedMaxAge;
+};
+
+static
+BOOL
+IsDirective(
+    _In_reads_(cchDirective) PCSTR  pszDirective,
+    SIZE_T                          cchDirective,
+    PCSTR                           pszName
+)
+{
+    const SIZE_T cchName = strlen(pszName);
+
+    return cchDirective == cchName && _strnicmp(pszDirective, pszName, cchName) == 0;
+}
+
+//
+// Directives of a Cache-Control header, arguments other than the delta
+// seconds of max-age and s-maxage are ignored.
+//
+static
+VOID
+ParseCacheControl(
+    _In_reads_opt_(cchHeader) PCSTR pszHeader,
+    USHORT                          cchHeader,
+    _Out_ CACHE_CONTROL *           pCacheControl
+)
+{
+    PCSTR pchEnd = pszHeader + cchHeader;
+
+    ZeroMemory(pCacheControl, sizeof(*pCacheControl));
+    pCacheControl->lMaxAge = -1;
+    pCacheControl->lSharedMaxAge = -1;
+
+    if (pszHeader == NULL)
+    {
+        return;
+    }
+
+    for (PCSTR pch = pszHeader; pch < pchEnd; )
+    {
+        while (pch < pchEnd && (*pch == ' ' || *pch == '\t' || *pch == ','))
+        {
+            pch++;
+        }
+
+        PCSTR pszDirective = pch;
+        while (pch < pchEnd && *pch != '=' && *pch != ',' && *pch != ' ' && *pch != '\t')
+        {
+            pch++;
+        }
+        const SIZE_T cchDirective = pch - pszDirective;
+
+        LONG lSeconds = -1;
+        if (pch < pchEnd && *pch == '=')
+        {
+            pch++;
+            BOOL fQuoted = pch < pchEnd && *pch == '"';
+            if (fQuoted)
+            {
+                pch++;
+            }
+            if (pch < pchEnd && *pch >= '0' && *pch <= '9')
+            {
+                lSeconds = 0;
+                while (pch < pchEnd && *pch >= '0' && *pch <= '9')
+                {
+                    lSeconds = min(lSeconds * 10 + (*pch - '0'), RESPONSE_CACHE_MAX_AGE_SECONDS);
+                    pch++;
+                }
+            }
+            //
+            // Skip the rest of the argument, a quoted one may contain commas.
+            //
+            while (pch < pchEnd && (fQuoted || *pch != ','))
+            {
+                if (*pch == '"')
+                {
+                    fQuoted = !fQuoted;
+                }
+                pch++;
+            }
+        }
+
+        if (IsDirective(pszDirective, cchDirective, "no-store"))
+        {
+            pCacheControl->fNoStore = TRUE;
+        }
+        else if (IsDirective(pszDirective, cchDirective, "no-cache"))
+        {
+            pCacheControl->fNoCache = TRUE;
+        }
+        else if (IsDirective(pszDirective, cchDirective, "private"))
+        {
+            pCacheControl->fPrivate = TRUE;
+        }
+        else if (IsDirective(pszDirective, cchDirective, "max-age"))
+        {
+            pCacheControl->lMaxAge = lSeconds;
+        }
+        else if (IsDirective(pszDirective, cchDirective, "s-maxage"))
+        {
+            pCacheControl->lSharedMaxAge = lSeconds;
+        }
+    }
+}
+
+RESPONSE_CACHE_ENTRY::RESPONSE_CACHE_ENTRY(
+    VOID
+) : m_pNextInBucket(NULL),
+    m_dwHash(0),
+    m_cRefs(1),
+    m_fRecentlyUsed(FALSE),
+    m_ullExpires(0),
+    m_cbMaxSize(0),
+    m_usStatusCode(0),
+    m_cbVary(0),
+    m_cbHeaders(0),
+    m_cbBody(0)
+{
+    InitializeListHead(&m_listEntry);
+}
+
+// static
+HRESULT
+RESPONSE_CACHE_ENTRY::Create(
+    _In_ IHttpRequest *             pRequest,
+    _In_ IHttpResponse *            pResponse,
+    _In_ const STRA &               strKey,
+    DWORD                           cbMaxSize,
+    _Out_ RESPONSE_CACHE_ENTRY **   ppEntry
+)
+{
+    const HTTP_RESPONSE *       pRawResponse = pResponse->GetRawHttpResponse();
+    const HTTP_RESPONSE_HEADERS *pHeaders = &pRawResponse->Headers;
+    CACHE_CONTROL               cacheControl;
+    USHORT                      cchHeader;
+    PCSTR                       pszHeader;
+
+    *ppEntry = NULL;
+
+    if (pRawResponse->StatusCode != 200)
+    {
+        return S_OK;
+    }
+
+    pszHeader = pResponse->GetHeader(HttpHeaderCacheControl, &cchHeader);
+    ParseCacheControl(pszHeader, cchHeader, &cacheControl);
+
+    const LONG lMaxAge = cacheControl.lSharedMaxAge != -1 ? cacheControl.lSharedMaxAge : cacheControl.lMaxAge;
+    if (lMaxAge <= 0 ||
+        cacheControl.fNoStore ||
+        cacheControl.fNoCache ||
+        cacheControl.fPrivate)
+    {
+        return S_OK;
+    }
+
+    //
+    // A response setting cookies is meant for one client only.
+    //
+    if (pHeaders->KnownHeaders[HttpHeaderSetCookie].RawValueLength != 0)
+    {
+        return S_OK;
+    }
+    for (USHORT i = 0; i < pHeaders->UnknownHeaderCount; i++)
+    {
+        if (IsDirective(pHeaders->pUnknownHeaders[i].pName,
+                pHeaders->pUnknownHeaders[i].NameLength,
+                "Set-Cookie"))
+        {
+            return S_OK;
+        }
+    }
+
+    pszHeader = pResponse->GetHeader(HttpHeaderContentLength);
+    if (pszHeader != NULL && _strtoui64(pszHeader, NULL, 10) > cbMaxSize)
+    {
+        return S_OK;
+    }
+
+    std::unique_ptr<RESPONSE_CACHE_ENTRY, void(*)(RESPONSE_CACHE_ENTRY*)> pEntry(
+        new (std::nothrow) RESPONSE_CACHE_ENTRY(),
+        [](RESPONSE_CACHE_ENTRY* p) { p->Dereference(); });
+    if (pEntry == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    pszHeader = pResponse->GetHeader(HttpHeaderVary, &cchHeader);
+    if (pszHeader != NULL)
+    {
+        HRESULT hr = pEntry->AddVaryHeaders(pRequest, pszHeader, cchHeader);
+        if (hr == S_FALSE)
+        {
+            //
+            // Vary: *
+            //
+            return S_OK;
+        }
+        RETURN_IF_FAILED(hr);
+    }
+
+    RETURN_IF_FAILED(pEntry->m_strKey.Copy(strKey));
+    RETURN_IF_FAILED(pEntry->m_strReason.Copy(pRawResponse->pReason, pRawResponse->ReasonLength));
+
+    for (USHORT i = 0; i < HttpHeaderResponseMaximum; i++)
+    {
+        //
+        // Hop-by-hop headers belong to the backend connection, and the Date
+        // of the stored response would be stale, HTTP.SYS adds a current one.
+        //
+        if (pHeaders->KnownHeaders[i].RawValueLength == 0 ||
+            i == HttpHeaderConnection ||
+            i == HttpHeaderKeepAlive ||
+            i == HttpHeaderTransferEncoding ||
+            i == HttpHeaderDate)
+        {
+            continue;
+        }
+
+        RETURN_IF_FAILED(pEntry->AddHeader(i,
+            "",
+            0,
+            pHeaders->KnownHeaders[i].pRawValue,
+            pHeaders->KnownHeaders[i].RawValueLength));
+    }
+
+    for (USHORT i = 0; i < pHeaders->UnknownHeaderCount; i++)
+    {
+        RETURN_IF_FAILED(pEntry->AddHeader(HttpHeaderResponseMaximum,
+            pHeaders->pUnknownHeaders[i].pName,
+            pHeaders->pUnknownHeaders[i].NameLength,
+            pHeaders->pUnknownHeaders[i].pRawValue,
+            pHeaders->pUnknownHeaders[i].RawValueLength));
+    }
+
+    pEntry->m_usStatusCode = pRawResponse->StatusCode;
+    pEntry->m_ullExpires = GetTickCount64() + static_cast<ULONGLONG>(lMaxAge) * 1000;
+    pEntry->m_cbMaxSize = cbMaxSize;
+    pEntry->m_dwHash = HashBlobFast(strKey.QueryStr(), strKey.QueryCCH());
+
+    if (pEntry->QuerySize() > cbMaxSize)
+    {
+        return S_OK;
+    }
+
+    *ppEntry = pEntry.release();
+    return S_OK;
+}
+
+HRESULT
+RESPONSE_CACHE_ENTRY::AddVaryHeaders(
+    _In_ IHttpRequest *             pRequest,
+    _In_reads_(cchVary) PCSTR       pszVary,
+    USHORT                          cchVary
+)
+/*++
+
+Routine Description:
+
+    Store the request values of the headers the Vary header names.
+
+Return Value:
+
+    S_FALSE when the response varies on everything and may not be cached.
+
+--*/
+{
+    STACK_STRA(strName, 64);
+    PCSTR pchEnd = pszVary + cchVary;
+
+    for (PCSTR pch = pszVary; pch < pchEnd; )
+    {
+        while (pch < pchEnd && (*pch == ' ' || *pch == '\t' || *pch == ','))
+        {
+            pch++;
+        }
+
+        PCSTR pszName = pch;
+        while (pch < pchEnd && *pch != ',' && *pch != ' ' && *pch != '\t')
+        {
+            pch++;
+        }
+        const USHORT cchName = static_cast<USHORT>(pch - pszName);
+
+        if (cchName == 0)
+        {
+            continue;
+        }
+        if (cchName == 1 && *pszName == '*')
+        {
+            return S_FALSE;
+        }
+
+        RETURN_IF_FAILED(strName.Copy(pszName, cchName));
+
+        USHORT cchValue = 0;
+        PCSTR pszValue = pRequest->GetHeader(strName.QueryStr(), &cchValue);
+        if (pszValue == NULL)
+        {
+            cchValue = 0;
+        }
+
+        const DWORD cbNeeded = m_cbVary + cchName + 1 + cchValue + 1;
+        RETURN_IF_FAILED(ResizeBufferByTwo(m_bufVary, cbNeeded));
+
+        BYTE *pb = m_bufVary.QueryPtr() + m_cbVary;
+        memcpy(pb, pszName, cchName);
+        pb[cchName] = '\0';
+        pb += cchName + 1;
+        if (cchValue != 0)
+        {
+            memcpy(pb, pszValue, cchValue);
+        }
+        pb[cchValue] = '\0';
+        m_cbVary = cbNeeded;
+    }
+
+    return S_OK;
+}
+
+HRESULT
+RESPONSE_CACHE_ENTRY::AddHeader(
+    USHORT                          usHeaderId,
+    _In_reads_(cchName) PCSTR       pszName,
+    USHORT                          cchName,
+    _In_reads_(cchValue) PCSTR      pszValue,
+    USHORT                          cchValue
+)
+{
+    HEADER_RECORD record;
+    const DWORD cbNeeded = m_cbHeaders + sizeof(record) + cchName + 1 + cchValue + 1;
+
+    RETURN_IF_FAILED(ResizeBufferByTwo(m_bufHeaders, cbNeeded));
+
+    record.usHeaderId = usHeaderId;
+    record.cchName = cchName;
+    record.cchValue = cchValue;
+
+    BYTE *pb = m_bufHeaders.QueryPtr() + m_cbHeaders;
+    memcpy(pb, &record, sizeof(record));
+    pb += sizeof(record);
+    memcpy(pb, pszName, cchName);
+    pb[cchName] = '\0';
+    pb += cchName + 1;
+    memcpy(pb, pszValue, cchValue);
+    pb[cchValue] = '\0';
+    m_cbHeaders = cbNeeded;
+
+    return S_OK;
+}
+
+BOOL
+RESPONSE_CACHE_ENTRY::AppendBody(
+    _In_reads_bytes_(cbData) const BYTE *   pbData,
+    DWORD                                   cbData
+)
+{
+    if (cbData > m_cbMaxSize - min(static_cast<SIZE_T>(m_cbMaxSize), QuerySize()) ||
+        FAILED(ResizeBufferByTwo(m_bufBody, static_cast<SIZE_T>(m_cbBody) + cbData)))
+    {
+        return FALSE;
+    }
+
+    memcpy(m_bufBody.QueryPtr() + m_cbBody, pbData, cbData);
+    m_cbBody += cbData;
+
+    //
+    // Doubling may have taken it over.
+    //
+    return QuerySize() <= m_cbMaxSize;
+}
+
+BOOL
+RESPONSE_CACHE_ENTRY::MatchesVary(
+    _In_ IHttpRequest *             pRequest
+) const
+{
+    const BYTE *pb = m_bufVary.QueryPtr();
+    const BYTE *pbEnd = pb + m_cbVary;
+
+    while (pb < pbEnd)
+    {
+        PCSTR pszName = reinterpret_cast<PCSTR>(pb);
+        const SIZE_T cchName = strlen(pszName);
+        PCSTR pszStored = pszName + cchName + 1;
+        const SIZE_T cchStored = strlen(pszStored);
+
+        USHORT cchValue = 0;
+        PCSTR pszValue = pRequest->GetHeader(pszName, &cchValue);
+        if (pszValue == NULL)
+        {
+            cchValue = 0;
+        }
+
+        if (cchValue != cchStored ||
+            (cchValue != 0 && memcmp(pszValue, pszStored, cchValue) != 0))
+        {
+            return FALSE;
+        }
+
+        pb = reinterpret_cast<const BYTE *>(pszStored + cchStored + 1);
+    }
+
+    return TRUE;
+}
+
+HRESULT
+RESPONSE_CACHE_ENTRY::WriteResponse(
+    _In_ IHttpResponse *            pResponse
+) const
+{
+    const BYTE *pb = m_bufHeaders.QueryPtr();
+    const BYTE *pbEnd = pb + m_cbHeaders;
+
+    RETURN_IF_FAILED(pResponse->SetStatus(m_usStatusCode, m_strReason.QueryStr()));
+
+    while (pb < pbEnd)
+    {
+        HEADER_RECORD record;
+        memcpy(&record, pb, sizeof(record));
+
+        PCSTR pszName = reinterpret_cast<PCSTR>(pb + sizeof(record));
+        PCSTR pszValue = pszName + record.cchName + 1;
+
+        if (record.usHeaderId == HttpHeaderResponseMaximum)
+        {
+            RETURN_IF_FAILED(pResponse->SetHeader(pszName, pszValue, record.cchValue, FALSE));
+        }
+        else
+        {
+            RETURN_IF_FAILED(pResponse->SetHeader(static_cast<HTTP_HEADER_ID>(record.usHeaderId),
+                pszValue,
+                record.cchValue,
+                TRUE));
+        }
+
+        pb = reinterpret_cast<const BYTE *>(pszValue + record.cchValue + 1);
+    }
+
+    if (m_cbBody != 0)
+    {
+        //
+        // IIS only references the body, the handler keeps the entry alive
+        // until the response is sent.
+        //
+        HTTP_DATA_CHUNK chunk;
+        chunk.DataChunkType = HttpDataChunkFromMemory;
+        chunk.FromMemory.pBuffer = m_bufBody.QueryPtr();
+        chunk.FromMemory.BufferLength = m_cbBody;
+        RETURN_IF_FAILED(pResponse->WriteEntityChunkByReference(&chunk));
+    }
+
+    return S_OK;
+}
+
+RESPONSE_CACHE::RESPONSE_CACHE(
+    DWORD                           cbCapacity
+) : m_rgpBuckets(NULL),
+    m_rgpFillBuckets(NULL),
+    m_cBuckets(0),
+    m_cbSize(0),
+    m_cbCapacity(cbCapacity)
+{
+    InitializeSRWLock(&m_lock);
+    InitializeListHead(&m_lruList);
+}
+
+RESPONSE_CACHE::~RESPONSE_CACHE()
+{
+    while (!IsListEmpty(&m_lruList))
+    {
+        RESPONSE_CACHE_ENTRY *pEntry = CONTAINING_RECORD(RemoveHeadList(&m_lruList),
+            RESPONSE_CACHE_ENTRY,
+            m_listEntry);
+        pEntry->Dereference();
+    }
+
+    //
+    // Every fill belongs to a handler, which references the application
+    // and so the cache.
+    //
+    delete[] m_rgpFillBuckets;
+    m_rgpFillBuckets = NULL;
+
+    delete[] m_rgpBuckets;
+    m_rgpBuckets = NULL;
+}
+
+HRESULT
+RESPONSE_CACHE::Initialize(
+    VOID
+)
+{
+    m_rgpBuckets = new (std::nothrow) RESPONSE_CACHE_ENTRY*[RESPONSE_CACHE_BUCKETS]();
+    if (m_rgpBuckets == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+    m_rgpFillBuckets = new (std::nothrow) RESPONSE_CACHE_FILL*[RESPONSE_CACHE_BUCKETS]();
+    if (m_rgpFillBuckets == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+    m_cBuckets = RESPONSE_CACHE_BUCKETS;
+
+    return S_OK;
+}
+
+// static
+BOOL
+RESPONSE_CACHE::IsCacheableRequest(
+    _In_ IHttpContext *             pHttpContext
+)
+{
+    IHttpRequest *pRequest = pHttpContext->GetRequest();
+    IHttpUser *pUser = pHttpContext->GetUser();
+
+    if (pRequest->GetRawHttpRequest()->Verb != HttpVerbGET ||
+        pRequest->GetHeader(HttpHeaderAuthorization) != NULL ||
+        pRequest->GetHeader("Upgrade") != NULL ||
+        pRequest->GetHeader(HttpHeaderTransferEncoding) != NULL ||
+        pRequest->GetRemainingEntityBytes() != 0)
+    {
+        return FALSE;
+    }
+
+    return pUser == NULL ||
+        pUser->GetAuthenticationType() == NULL ||
+        pUser->GetAuthenticationType()[0] == L'\0';
+}
+
+// static
+HRESULT
+RESPONSE_CACHE::BuildKey(
+    _In_ IHttpRequest *             pRequest,
+    _Inout_ STRA *                  pstrKey
+)
+{
+    const HTTP_COOKED_URL *pCookedUrl = &pRequest->GetRawHttpRequest()->CookedUrl;
+
+    return pstrKey->CopyW(pCookedUrl->pFullUrl, pCookedUrl->FullUrlLength / sizeof(WCHAR));
+}
+
+RESPONSE_CACHE_ENTRY **
+RESPONSE_CACHE::FindBucketSlotLocked(
+    DWORD                           dwHash,
+    _In_ const STRA &               strKey
+)
+{
+    RESPONSE_CACHE_ENTRY **ppSlot = &m_rgpBuckets[dwHash & (m_cBuckets - 1)];
+
+    while (*ppSlot != NULL &&
+           ((*ppSlot)->m_dwHash != dwHash || !(*ppSlot)->m_strKey.Equals(strKey)))
+    {
+        ppSlot = &(*ppSlot)->m_pNextInBucket;
+    }
+
+    return ppSlot;
+}
+
+VOID
+RESPONSE_CACHE::RemoveLocked(
+    _In_ RESPONSE_CACHE_ENTRY **    ppSlot
+)
+{
+    RESPONSE_CACHE_ENTRY *pEntry = *ppSlot;
+
+    *ppSlot = pEntry->m_pNextInBucket;
+    RemoveEntryList(&pEntry->m_listEntry);
+    m_cbSize -= pEntry->QuerySize();
+    pEntry->Dereference();
+}
+
+// static
+BOOL
+RESPONSE_CACHE::AllowsCachedResponse(
+    _In_ IHttpRequest *             pRequest
+)
+{
+    CACHE_CONTROL cacheControl;
+    USHORT cchHeader;
+    PCSTR pszHeader;
+
+    //
+    // The client asks for the response to come from the backend.
+    //
+    pszHeader = pRequest->GetHeader(HttpHeaderCacheControl, &cchHeader);
+    ParseCacheControl(pszHeader, cchHeader, &cacheControl);
+    if (cacheControl.fNoCache || cacheControl.fNoStore || cacheControl.lMaxAge == 0)
+    {
+        return FALSE;
+    }
+    pszHeader = pRequest->GetHeader(HttpHeaderPragma, &cchHeader);
+    if (pszHeader != NULL && cchHeader >= 8 && _strnicmp(pszHeader, "no-cache", 8) == 0)
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+RESPONSE_CACHE_ENTRY *
+RESPONSE_CACHE::LookupLocked(
+    _In_ IHttpRequest *             pRequest,
+    DWORD                           dwHash,
+    _In_ const STRA &               strKey
+)
+{
+    RESPONSE_CACHE_ENTRY *pEntry = *FindBucketSlotLocked(dwHash, strKey);
+    if (pEntry == NULL ||
+        !pEntry->IsFresh(GetTickCount64()) ||
+        !pEntry->MatchesVary(pRequest))
+    {
+        return NULL;
+    }
+
+    if (!pEntry->m_fRecentlyUsed)
+    {
+        pEntry->m_fRecentlyUsed = TRUE;
+    }
+    pEntry->Reference();
+
+    return pEntry;
+}
+
+RESPONSE_CACHE_ENTRY *
+RESPONSE_CACHE::Lookup(
+    _In_ IHttpRequest *             pRequest,
+    _In_ const STRA &               strKey
+)
+{
+    if (!AllowsCachedResponse(pRequest))
+    {
+        return NULL;
+    }
+
+    const DWORD dwHash = HashBlobFast(strKey.QueryStr(), strKey.QueryCCH());
+
+    SRWSharedLock lock(m_lock);
+
+    return LookupLocked(pRequest, dwHash, strKey);
+}
+
+HRESULT
+RESPONSE_CACHE::JoinFill(
+    _In_ IHttpRequest *             pRequest,
+    _In_ const STRA &               strKey,
+    _In_ FORWARDING_HANDLER *       pWaiter,
+    _Out_ RESPONSE_CACHE_ENTRY **   ppEntry,
+    _Out_ RESPONSE_CACHE_FILL **    ppFill
+)
+{
+    *ppEntry = NULL;
+    *ppFill = NULL;
+
+    if (!AllowsCachedResponse(pRequest))
+    {
+        return S_OK;
+    }
+
+    const DWORD dwHash = HashBlobFast(strKey.QueryStr(), strKey.QueryCCH());
+
+    std::unique_ptr<RESPONSE_CACHE_FILL> pFill(new (std::nothrow) RESPONSE_CACHE_FILL());
+    if (pFill == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+    RETURN_IF_FAILED(pFill->strKey.Copy(strKey));
+    pFill->dwHash = dwHash;
+
+    SRWExclusiveLock lock(m_lock);
+
+    //
+    // Inserted since the lookup of CreateHandler.
+    //
+    *ppEntry = LookupLocked(pRequest, dwHash, strKey);
+    if (*ppEntry != NULL)
+    {
+        return S_OK;
+    }
+
+    RESPONSE_CACHE_FILL **ppSlot = &m_rgpFillBuckets[dwHash & (m_cBuckets - 1)];
+    while (*ppSlot != NULL &&
+           ((*ppSlot)->dwHash != dwHash || !(*ppSlot)->strKey.Equals(strKey)))
+    {
+        ppSlot = &(*ppSlot)->pNext;
+    }
+
+    if (*ppSlot != NULL)
+    {
+        pWaiter->ReferenceRequestHandler();
+        (*ppSlot)->waiters.push_back(pWaiter);
+        return HRESULT_FROM_WIN32(ERROR_IO_PENDING);
+    }
+
+    pFill->pNext = NULL;
+    *ppSlot = pFill.get();
+    *ppFill = pFill.release();
+
+    return S_OK;
+}
+
+VOID
+RESPONSE_CACHE::EndFill(
+    _In_ RESPONSE_CACHE_FILL *      pFill
+)
+{
+    std::unique_ptr<RESPONSE_CACHE_FILL> pOwnedFill(pFill);
+
+    {
+        SRWExclusiveLock lock(m_lock);
+
+        RESPONSE_CACHE_FILL **ppSlot = &m_rgpFillBuckets[pFill->dwHash & (m_cBuckets - 1)];
+        while (*ppSlot != pFill)
+        {
+            ppSlot = &(*ppSlot)->pNext;
+        }
+        *ppSlot = pFill->pNext;
+    }
+
+    for (FORWARDING_HANDLER* pWaiter : pFill->waiters)
+    {
+        pWaiter->OnResponseCacheFillCompleted();
+        pWaiter->DereferenceRequestHandler();
+    }
+}
+
+VOID
+RESPONSE_CACHE::Insert(
+    _In_ RESPONSE_CACHE_ENTRY *     pEntry
+)
+{
+    const SIZE_T cbEntry = pEntry->QuerySize();
+    const ULONGLONG ullNow = GetTickCount64();
+
+    SRWExclusiveLock lock(m_lock);
+
+    RESPONSE_CACHE_ENTRY **ppSlot = FindBucketSlotLocked(pEntry->m_dwHash, pEntry->m_strKey);
+    if (*ppSlot != NULL)
+    {
+        RemoveLocked(ppSlot);
+    }
+
+    //
+    // Second chance: an entry hit since eviction last passed over it is
+    // moved to the front instead of being evicted. Every entry is passed
+    // over at most twice.
+    //
+    while (m_cbSize + cbEntry > m_cbCapacity && !IsListEmpty(&m_lruList))
+    {
+        RESPONSE_CACHE_ENTRY *pOldest = CONTAINING_RECORD(m_lruList.Blink,
+            RESPONSE_CACHE_ENTRY,
+            m_listEntry);
+
+        if (pOldest->m_fRecentlyUsed && pOldest->IsFresh(ullNow))
+        {
+            pOldest->m_fRecentlyUsed = FALSE;
+            RemoveEntryList(&pOldest->m_listEntry);
+            InsertHeadList(&m_lruList, &pOldest->m_listEntry);
+            continue;
+        }
+
+        RemoveLocked(FindBucketSlotLocked(pOldest->m_dwHash, pOldest->m_strKey));
+    }
+
+    pEntry->Reference();
+    pEntry->m_fRecentlyUsed = FALSE;
+    pEntry->m_pNextInBucket = NULL;
+    *FindBucketSlotLocked(pEntry->m_dwHash, pEntry->m_strKey) = pEntry;
+    InsertHeadList(&m_lruList, &pEntry->m_listEntry);
+    m_cbSize += cbEntry;
+}
+
+REQUEST_NOTIFICATION_STATUS
+CACHED_RESPONSE_HANDLER::ExecuteRequestHandler()
+{
+    IHttpResponse *pResponse = m_pHttpContext.GetResponse();
+
+    if (FAILED_LOG(m_pEntry->WriteResponse(pResponse)))
+    {
+        pResponse->Clear();
+        pResponse->SetStatus(500, "Internal Server Error");
+    }
+
+    return RQ_NOTIFICATION_FINISH_REQUEST;
+}
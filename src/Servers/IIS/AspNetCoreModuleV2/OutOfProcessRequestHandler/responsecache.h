@@ -0,0 +1,357 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <vector>
+#include "requesthandler.h"
+
+class FORWARDING_HANDLER;
+
+//
+// Backend response kept by RESPONSE_CACHE: the status, headers and body of
+// a fresh 200 response to an anonymous GET, built while the response is
+// forwarded. Once inserted it is never changed, so any number of requests
+// serve it at the same time. Each of them holds a reference until its
+// response has been sent, as the body is handed to IIS by reference.
+//
+class RESPONSE_CACHE_ENTRY
+{
+public:
+
+    //
+    // Starts the entry of the response whose status and headers are set on
+    // pResponse. *ppEntry is NULL when the response may not be cached.
+    //
+    static
+    HRESULT
+    Create(
+        _In_ IHttpRequest *             pRequest,
+        _In_ IHttpResponse *            pResponse,
+        _In_ const STRA &               strKey,
+        DWORD                           cbMaxSize,
+        _Out_ RESPONSE_CACHE_ENTRY **   ppEntry
+    );
+
+    VOID
+    Reference(
+        VOID
+    )
+    {
+        InterlockedIncrement(&m_cRefs);
+    }
+
+    VOID
+    Dereference(
+        VOID
+    )
+    {
+        if (InterlockedDecrement(&m_cRefs) == 0)
+        {
+            delete this;
+        }
+    }
+
+    //
+    // Adds forwarded body to an entry not inserted yet. FALSE when the entry
+    // outgrew the size it may have, it is then dropped.
+    //
+    BOOL
+    AppendBody(
+        _In_reads_bytes_(cbData) const BYTE *   pbData,
+        DWORD                                   cbData
+    );
+
+    //
+    // Sets the status, headers and body on the response of a request the
+    // entry was looked up for.
+    //
+    HRESULT
+    WriteResponse(
+        _In_ IHttpResponse *            pResponse
+    ) const;
+
+private:
+
+    friend class RESPONSE_CACHE;
+
+    //
+    // Header of every response header stored in m_bufHeaders, followed by
+    // the terminated name and value.
+    //
+    struct HEADER_RECORD
+    {
+        //
+        // HttpHeaderResponseMaximum for an unknown header.
+        //
+        USHORT          usHeaderId;
+        USHORT          cchName;
+        USHORT          cchValue;
+    };
+
+    RESPONSE_CACHE_ENTRY(
+        VOID
+    );
+
+    ~RESPONSE_CACHE_ENTRY() = default;
+
+    BOOL
+    IsFresh(
+        ULONGLONG                       ullNow
+    ) const
+    {
+        return ullNow < m_ullExpires;
+    }
+
+    //
+    // Whether the request sent the same values for the headers the
+    // response varies on as the request the entry was built for.
+    //
+    BOOL
+    MatchesVary(
+        _In_ IHttpRequest *             pRequest
+    ) const;
+
+    HRESULT
+    AddVaryHeaders(
+        _In_ IHttpRequest *             pRequest,
+        _In_reads_(cchVary) PCSTR       pszVary,
+        USHORT                          cchVary
+    );
+
+    HRESULT
+    AddHeader(
+        USHORT                          usHeaderId,
+        _In_reads_(cchName) PCSTR       pszName,
+        USHORT                          cchName,
+        _In_reads_(cchValue) PCSTR      pszValue,
+        USHORT                          cchValue
+    );
+
+    SIZE_T
+    QuerySize(
+        VOID
+    ) const
+    {
+        return sizeof(*this) + m_strKey.QuerySize() + m_strReason.QuerySize() +
+            m_bufVary.QuerySize() + m_bufHeaders.QuerySize() + m_bufBody.QuerySize();
+    }
+
+    //
+    // RESPONSE_CACHE links, guarded by its lock.
+    //
+    LIST_ENTRY              m_listEntry;
+    RESPONSE_CACHE_ENTRY *  m_pNextInBucket;
+    DWORD                   m_dwHash;
+    volatile LONG           m_cRefs;
+    //
+    // Set by every hit, cleared when eviction passes over the entry.
+    //
+    volatile BOOL           m_fRecentlyUsed;
+    //
+    // GetTickCount64 value the response stops being fresh at.
+    //
+    ULONGLONG               m_ullExpires;
+    DWORD                   m_cbMaxSize;
+    USHORT                  m_usStatusCode;
+    STRA                    m_strKey;
+    STRA                    m_strReason;
+    //
+    // Terminated name and value pairs of the request headers named by the
+    // Vary header of the response.
+    //
+    BUFFER                  m_bufVary;
+    DWORD                   m_cbVary;
+    BUFFER                  m_bufHeaders;
+    DWORD                   m_cbHeaders;
+    BUFFER                  m_bufBody;
+    DWORD                   m_cbBody;
+};
+
+//
+// Backend request of a URL missing from RESPONSE_CACHE, which the other
+// requests for the URL wait on instead of going to the backend as well.
+//
+struct RESPONSE_CACHE_FILL
+{
+    RESPONSE_CACHE_FILL *               pNext;
+    DWORD                               dwHash;
+    STRA                                strKey;
+    //
+    // Parked requests, each holds a reference.
+    //
+    std::vector<FORWARDING_HANDLER*>    waiters;
+};
+
+//
+// In-memory cache of backend responses to heavily repeated anonymous GETs,
+// so that hits are answered without going to the backend. Entries are keyed
+// on the URL, one variant per URL, and kept for the max-age or s-maxage of
+// their Cache-Control. Past the byte capacity the least recently used ones
+// are evicted, recency being the second chance flag hits set so that a hit
+// only needs the shared lock.
+//
+// Concurrent misses of a URL are coalesced: the first one is forwarded and
+// the others wait for its response to be inserted, see JoinFill.
+//
+class RESPONSE_CACHE
+{
+public:
+
+    RESPONSE_CACHE(
+        DWORD                           cbCapacity
+    );
+
+    ~RESPONSE_CACHE();
+
+    HRESULT
+    Initialize(
+        VOID
+    );
+
+    //
+    // Whether the response to the request may be looked up and stored:
+    // an anonymous GET without a body that is not a WebSocket upgrade.
+    //
+    static
+    BOOL
+    IsCacheableRequest(
+        _In_ IHttpContext *             pHttpContext
+    );
+
+    static
+    HRESULT
+    BuildKey(
+        _In_ IHttpRequest *             pRequest,
+        _Inout_ STRA *                  pstrKey
+    );
+
+    //
+    // Returns a referenced fresh entry the request can be answered with,
+    // NULL on a miss.
+    //
+    RESPONSE_CACHE_ENTRY *
+    Lookup(
+        _In_ IHttpRequest *             pRequest,
+        _In_ const STRA &               strKey
+    );
+
+    //
+    // Lookup for a request about to be forwarded. On a miss, either the
+    // request forwards and fills the entry, *ppFill is then set and has to
+    // be passed to EndFill, or another request already does and the waiter
+    // is parked until it is done, HRESULT_FROM_WIN32(ERROR_IO_PENDING) is
+    // then returned. Neither happens for a client asking for a response
+    // from the backend.
+    //
+    HRESULT
+    JoinFill(
+        _In_ IHttpRequest *             pRequest,
+        _In_ const STRA &               strKey,
+        _In_ FORWARDING_HANDLER *       pWaiter,
+        _Out_ RESPONSE_CACHE_ENTRY **   ppEntry,
+        _Out_ RESPONSE_CACHE_FILL **    ppFill
+    );
+
+    //
+    // Resumes the requests waiting on the fill, once its entry was inserted
+    // or turned out not to be cacheable. They look the URL up again and go
+    // to the backend on a miss.
+    //
+    VOID
+    EndFill(
+        _In_ RESPONSE_CACHE_FILL *      pFill
+    );
+
+    //
+    // Adds a complete entry, replacing the one of the same key.
+    //
+    VOID
+    Insert(
+        _In_ RESPONSE_CACHE_ENTRY *     pEntry
+    );
+
+    //
+    // Largest entry worth keeping, so that one response can't flush the
+    // whole cache.
+    //
+    DWORD
+    QueryMaxEntrySize(
+        VOID
+    ) const
+    {
+        return m_cbCapacity / 8;
+    }
+
+private:
+
+    RESPONSE_CACHE(const RESPONSE_CACHE &);
+    void operator=(const RESPONSE_CACHE &);
+
+    static
+    BOOL
+    AllowsCachedResponse(
+        _In_ IHttpRequest *             pRequest
+    );
+
+    RESPONSE_CACHE_ENTRY *
+    LookupLocked(
+        _In_ IHttpRequest *             pRequest,
+        DWORD                           dwHash,
+        _In_ const STRA &               strKey
+    );
+
+    RESPONSE_CACHE_ENTRY **
+    FindBucketSlotLocked(
+        DWORD                           dwHash,
+        _In_ const STRA &               strKey
+    );
+
+    VOID
+    RemoveLocked(
+        _In_ RESPONSE_CACHE_ENTRY **    ppSlot
+    );
+
+    SRWLOCK                         m_lock;
+    RESPONSE_CACHE_ENTRY **         m_rgpBuckets;
+    RESPONSE_CACHE_FILL **          m_rgpFillBuckets;
+    DWORD                           m_cBuckets;
+    //
+    // Most recently inserted first.
+    //
+    LIST_ENTRY                      m_lruList;
+    SIZE_T                          m_cbSize;
+    DWORD                           m_cbCapacity;
+};
+
+//
+// Answers a request from a RESPONSE_CACHE_ENTRY, without a backend.
+//
+class CACHED_RESPONSE_HANDLER : public REQUEST_HANDLER
+{
+public:
+
+    //
+    // Takes over the reference of pEntry.
+    //
+    CACHED_RESPONSE_HANDLER(
+        IHttpContext &                  pHttpContext,
+        _In_ RESPONSE_CACHE_ENTRY *     pEntry
+    ) noexcept
+        : REQUEST_HANDLER(pHttpContext),
+          m_pEntry(pEntry)
+    {
+    }
+
+    ~CACHED_RESPONSE_HANDLER() override
+    {
+        m_pEntry->Dereference();
+    }
+
+    REQUEST_NOTIFICATION_STATUS
+    ExecuteRequestHandler() override;
+
+private:
+
+    RESPONSE_CACHE_ENTRY *      m_pEntry;
+};
@@ -2,89 +2,144 @@
 // Licensed under the MIT License. See License.txt in the project root for license information.
 
 #include "responseheaderhash.h"
-#include "exceptions.h"
 
-HEADER_RECORD RESPONSE_HEADER_HASH::sm_rgHeaders[] =
+struct HEADER_RECORD
 {
-    { "Cache-Control",       HttpHeaderCacheControl       },
-    { "Connection",          HttpHeaderConnection         },
-    { "Date",                HttpHeaderDate               },
-    { "Keep-Alive",          HttpHeaderKeepAlive          },
-    { "Pragma",              HttpHeaderPragma             },
-    { "Trailer",             HttpHeaderTrailer            },
-    { "Transfer-Encoding",   HttpHeaderTransferEncoding   },
-    { "Upgrade",             HttpHeaderUpgrade            },
-    { "Via",                 HttpHeaderVia                },
-    { "Warning",             HttpHeaderWarning            },
-    { "Allow",               HttpHeaderAllow              },
-    { "Content-Length",      HttpHeaderContentLength      },
-    { "Content-Type",        HttpHeaderContentType        },
-    { "Content-Encoding",    HttpHeaderContentEncoding    },
-    { "Content-Language",    HttpHeaderContentLanguage    },
-    { "Content-Location",    HttpHeaderContentLocation    },
-    { "Content-MD5",         HttpHeaderContentMd5         },
-    { "Content-Range",       HttpHeaderContentRange       },
-    { "Expires",             HttpHeaderExpires            },
-    { "Last-Modified",       HttpHeaderLastModified       },
-    { "Accept-Ranges",       HttpHeaderAcceptRanges       },
-    { "Age",                 HttpHeaderAge                },
-    { "ETag",                HttpHeaderEtag               },
-    { "Location",            HttpHeaderLocation           },
-    { "Proxy-Authenticate",  HttpHeaderProxyAuthenticate  },
-    { "Retry-After",         HttpHeaderRetryAfter         },
-    { "Server",              HttpHeaderServer             },
-    // Set it to something which cannot be a header name, in effect
-    // making Server an unknown header. w:w is used to avoid collision with Keep-Alive.
-    { "w:w\r\n",             HttpHeaderServer             },
-    // Set it to something which cannot be a header name, in effect
-    // making Set-Cookie an unknown header
-    { "y:y\r\n",             HttpHeaderSetCookie          },
-    { "Vary",                HttpHeaderVary               },
-    // Set it to something which cannot be a header name, in effect
-    // making WWW-Authenticate an unknown header
-    { "z:z\r\n",             HttpHeaderWwwAuthenticate    }
+    PCSTR   _pszName;
+    DWORD   _cchName;
+    ULONG   _ulHeaderIndex;
+};
+
+#define HEADER_RECORD_ENTRY(name, index)    { name, sizeof(name) - 1, index }
+
+static constexpr HEADER_RECORD sm_rgHeaders[] =
+{
+    HEADER_RECORD_ENTRY("Cache-Control",       HttpHeaderCacheControl       ),
+    HEADER_RECORD_ENTRY("Connection",          HttpHeaderConnection         ),
+    HEADER_RECORD_ENTRY("Date",                HttpHeaderDate               ),
+    HEADER_RECORD_ENTRY("Keep-Alive",          HttpHeaderKeepAlive          ),
+    HEADER_RECORD_ENTRY("Pragma",              HttpHeaderPragma             ),
+    HEADER_RECORD_ENTRY("Trailer",             HttpHeaderTrailer            ),
+    HEADER_RECORD_ENTRY("Transfer-Encoding",   HttpHeaderTransferEncoding   ),
+    HEADER_RECORD_ENTRY("Upgrade",             HttpHeaderUpgrade            ),
+    HEADER_RECORD_ENTRY("Via",                 HttpHeaderVia                ),
+    HEADER_RECORD_ENTRY("Warning",             HttpHeaderWarning            ),
+    HEADER_RECORD_ENTRY("Allow",               HttpHeaderAllow              ),
+    HEADER_RECORD_ENTRY("Content-Length",      HttpHeaderContentLength      ),
+    HEADER_RECORD_ENTRY("Content-Type",        HttpHeaderContentType        ),
+    HEADER_RECORD_ENTRY("Content-Encoding",    HttpHeaderContentEncoding    ),
+    HEADER_RECORD_ENTRY("Content-Language",    HttpHeaderContentLanguage    ),
+    HEADER_RECORD_ENTRY("Content-Location",    HttpHeaderContentLocation    ),
+    HEADER_RECORD_ENTRY("Content-MD5",         HttpHeaderContentMd5         ),
+    HEADER_RECORD_ENTRY("Content-Range",       HttpHeaderContentRange       ),
+    HEADER_RECORD_ENTRY("Expires",             HttpHeaderExpires            ),
+    HEADER_RECORD_ENTRY("Last-Modified",       HttpHeaderLastModified       ),
+    HEADER_RECORD_ENTRY("Accept-Ranges",       HttpHeaderAcceptRanges       ),
+    HEADER_RECORD_ENTRY("Age",                 HttpHeaderAge                ),
+    HEADER_RECORD_ENTRY("ETag",                HttpHeaderEtag               ),
+    HEADER_RECORD_ENTRY("Location",            HttpHeaderLocation           ),
+    HEADER_RECORD_ENTRY("Proxy-Authenticate",  HttpHeaderProxyAuthenticate  ),
+    HEADER_RECORD_ENTRY("Retry-After",         HttpHeaderRetryAfter         ),
+    HEADER_RECORD_ENTRY("Server",              HttpHeaderServer             ),
+    HEADER_RECORD_ENTRY("Vary",                HttpHeaderVary               ),
+};
+
+//
+// 64 slots for the 28 known headers. If a header is added and the
+// static_assert below fires, retune the multipliers in HashHeaderName.
+//
+static constexpr DWORD HEADER_SLOT_COUNT = 64;
+
+static
+constexpr
+DWORD
+HashHeaderName(
+    CHAR    chFirst,
+    CHAR    chLast,
+    DWORD   cchName
+)
+{
+    //
+    // OR-ing in 0x20 folds ASCII letters to lower case; the other
+    // characters allowed in a header name only need to hash consistently.
+    //
+    return (cchName +
+        4 * static_cast<DWORD>(static_cast<UCHAR>(chFirst | 0x20)) +
+        24 * static_cast<DWORD>(static_cast<UCHAR>(chLast | 0x20))) & (HEADER_SLOT_COUNT - 1);
+}
+
+struct HEADER_SLOT_TABLE
+{
+    //
+    // Index + 1 into sm_rgHeaders, 0 for an empty slot.
+    //
+    BYTE    rgSlots[HEADER_SLOT_COUNT];
+    bool    fCollision;
+
+    constexpr
+    HEADER_SLOT_TABLE(
+    ) : rgSlots(),
+        fCollision(false)
+    {
+        for (DWORD i = 0; i < _countof(sm_rgHeaders); ++i)
+        {
+            const DWORD dwSlot = HashHeaderName(sm_rgHeaders[i]._pszName[0],
+                sm_rgHeaders[i]._pszName[sm_rgHeaders[i]._cchName - 1],
+                sm_rgHeaders[i]._cchName);
 
+            if (rgSlots[dwSlot] != 0)
+            {
+                fCollision = true;
+            }
+            rgSlots[dwSlot] = static_cast<BYTE>(i + 1);
+        }
+    }
 };
 
-HRESULT
-RESPONSE_HEADER_HASH::Initialize(
-    VOID
+static constexpr HEADER_SLOT_TABLE sm_HeaderSlots;
+
+static_assert(!sm_HeaderSlots.fCollision, "Known response headers must hash to distinct slots");
+
+// static
+DWORD
+RESPONSE_HEADER_HASH::GetIndex(
+    _In_reads_(cchName) PCSTR   pszName,
+    DWORD                       cchName
 )
 /*++
 
 Routine Description:
 
-    Initialize global header hash table
+    Map a response header name to its HTTP_HEADER_ID.
 
 Arguments:
 
-    None
+    pszName  - Header name, not necessarily null terminated.
+    cchName  - Length of the header name.
 
 Return Value:
 
-    HRESULT
+    HTTP_HEADER_ID of the header or UNKNOWN_INDEX.
 
 --*/
 {
-    //
-    // 31 response headers.
-    // Make sure to update the number of buckets it new headers
-    // are added. Test it to avoid collisions.
-    //
-    C_ASSERT(_countof(sm_rgHeaders) == 31);
+    if (cchName == 0)
+    {
+        return UNKNOWN_INDEX;
+    }
 
-    //
-    // 79 buckets will have less collisions for the 31 response headers.
-    // Known collisions are "Age" colliding with "Expire" and "Location"
-    // colliding with both "Expire" and "Age".
-    //
-    RETURN_IF_FAILED(HASH_TABLE::Initialize(79));
+    const BYTE bSlot = sm_HeaderSlots.rgSlots[HashHeaderName(pszName[0], pszName[cchName - 1], cchName)];
+    if (bSlot == 0)
+    {
+        return UNKNOWN_INDEX;
+    }
 
-    for ( DWORD Index = 0; Index < _countof(sm_rgHeaders); ++Index )
+    const HEADER_RECORD & record = sm_rgHeaders[bSlot - 1];
+    if (record._cchName != cchName ||
+        _strnicmp(pszName, record._pszName, cchName) != 0)
     {
-        RETURN_IF_FAILED(InsertRecord(&sm_rgHeaders[Index]));
+        return UNKNOWN_INDEX;
     }
 
-    return S_OK;
+    return record._ulHeaderIndex;
 }
-
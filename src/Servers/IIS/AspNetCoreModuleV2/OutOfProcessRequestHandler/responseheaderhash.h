@@ -9,100 +9,30 @@
 
 #define UNKNOWN_INDEX           (0xFFFFFFFF)
 
-struct HEADER_RECORD
-{
-    PCSTR   _pszName;
-    ULONG   _ulHeaderIndex;
-};
-
-class RESPONSE_HEADER_HASH: public HASH_TABLE<HEADER_RECORD, PCSTR>
+//
+// The set of known response headers is fixed, so instead of a general
+// purpose hash table the lookup uses a perfect hash on the name length and
+// the case-folded first and last characters, built at compile time. A
+// lookup is one table probe followed by a single case-insensitive compare.
+//
+// Set-Cookie and WWW-Authenticate are deliberately left out of the table so
+// that they stay on the unknown header path, which appends instead of
+// replacing and therefore preserves multiple values.
+//
+class RESPONSE_HEADER_HASH
 {
 public:
-    RESPONSE_HEADER_HASH() 
-    {}
-    
-    VOID
-    ReferenceRecord(
-        HEADER_RECORD *
-    )
-    {}
-
-    VOID
-    DereferenceRecord(
-        HEADER_RECORD *
-    )
-    {}
-
-    PCSTR
-    ExtractKey(
-        HEADER_RECORD * pRecord
-    )
-    {
-        return pRecord->_pszName;
-    }
-
-    DWORD
-    CalcKeyHash(
-        PCSTR   key
-    )
-    {
-        return HashStringNoCase(key);
-    }
 
-    BOOL
-    EqualKeys(
-        PCSTR   key1,
-        PCSTR   key2
-    )
-    {
-        return (_stricmp(key1, key2) == 0);
-    }
-
-    HRESULT
-    Initialize(
-        VOID
-    );
-    
-    VOID
-    Terminate(
-        VOID
-    );
-    
+    static
     DWORD
     GetIndex(
-        PCSTR             pszName
-    )
-    {
-        HEADER_RECORD *       pRecord = NULL;
-
-        FindKey(pszName, &pRecord);
-        if (pRecord != NULL)
-        {
-            return pRecord->_ulHeaderIndex;
-        }
-
-        return UNKNOWN_INDEX;
-    }
-    
-    static
-    PCSTR
-    GetString(
-        ULONG               ulIndex
-    )
-    {
-        if (ulIndex < HttpHeaderResponseMaximum)
-        {
-            DBG_ASSERT(sm_rgHeaders[ulIndex]._ulHeaderIndex == ulIndex);
-            return sm_rgHeaders[ulIndex]._pszName;
-        }
+        _In_reads_(cchName) PCSTR   pszName,
+        DWORD                       cchName
+    );
 
-        return NULL;
-    }
-    
 private:
 
-    static HEADER_RECORD         sm_rgHeaders[];
-
+    RESPONSE_HEADER_HASH();
     RESPONSE_HEADER_HASH(const RESPONSE_HEADER_HASH &);
     void operator=(const RESPONSE_HEADER_HASH &);
 };
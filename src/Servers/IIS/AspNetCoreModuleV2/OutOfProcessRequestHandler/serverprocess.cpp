@@ -2,11 +2,51 @@
 // Licensed under the MIT License. See License.txt in the project root for license information.
 
 #include "serverprocess.h"
+#include "SRWExclusiveLock.h"
 
 #include <IPHlpApi.h>
 #include "EventLog.h"
 #include "file_utility.h"
 #include "exceptions.h"
+#include "TraceProvider.h"
+
+SRWLOCK SERVER_PROCESS::sm_srwConsoleLock = SRWLOCK_INIT;
+
+//
+// Microseconds between two QueryPerformanceCounter values, 0 if the first
+// phase was never reached. Split at whole seconds so that a process
+// lifetime of years does not overflow.
+//
+static
+ULONGLONG
+QueryMicrosecondsBetween(
+    LONGLONG    llFrom,
+    LONGLONG    llTo
+)
+{
+    LARGE_INTEGER liFrequency;
+
+    if (llFrom == 0 || llTo < llFrom || !QueryPerformanceFrequency(&liFrequency))
+    {
+        return 0;
+    }
+
+    const ULONGLONG ullTicks = static_cast<ULONGLONG>(llTo - llFrom);
+    const ULONGLONG ullFrequency = static_cast<ULONGLONG>(liFrequency.QuadPart);
+
+    return ullTicks / ullFrequency * 1000000 + ullTicks % ullFrequency * 1000000 / ullFrequency;
+}
+
+static
+LONGLONG
+QueryTimestamp(
+    VOID
+)
+{
+    LARGE_INTEGER liCounter;
+    QueryPerformanceCounter(&liCounter);
+    return liCounter.QuadPart;
+}
 
 HRESULT
 SERVER_PROCESS::Initialize(
@@ -15,28 +55,34 @@ SERVER_PROCESS::Initialize(
     STRU                 *pszArguments,
     DWORD                 dwStartupTimeLimitInMS,
     DWORD                 dwShutdownTimeLimitInMS,
-    BOOL                  fWindowsAuthEnabled,
-    BOOL                  fBasicAuthEnabled,
-    BOOL                  fAnonymousAuthEnabled,
-    std::map<std::wstring, std::wstring, ignore_case_comparer>& pEnvironmentVariables,
+    DWORD                 dwMaxConnections,
+    DWORD                 dwPrewarmConnections,
+    BOOL                  fReservePriorityConnection,
+    BOOL                  fRequestDelegation,
+    BOOL                  fCacheWindowsAuthToken,
+    const PROCESS_RESOURCE_LIMITS& resourceLimits,
+    std::shared_ptr<const ENVIRONMENT_BLOCK> pEnvironmentBlock,
     BOOL                  fStdoutLogEnabled,
     BOOL                  fEnableOutOfProcessConsoleRedirection,
-    BOOL                  fWebSocketSupported,
     STRU                  *pstruStdoutLogFile,
     STRU                  *pszAppPhysicalPath,
     STRU                  *pszAppPath,
-    STRU                  *pszAppVirtualPath,
-    STRU                  *pszHttpsPort
+    STRU                  *pszAppVirtualPath
 )
 {
     m_pProcessManager = pProcessManager;
     m_dwStartupTimeLimitInMS = dwStartupTimeLimitInMS;
     m_dwShutdownTimeLimitInMS = dwShutdownTimeLimitInMS;
+    m_dwMaxConnections = dwMaxConnections;
+    m_dwPrewarmConnections = dwPrewarmConnections;
+    m_fReservePriorityConnection = fReservePriorityConnection && dwMaxConnections != 0;
+    if (m_dwMaxConnections != 0)
+    {
+        m_dwPrewarmConnections = min(m_dwPrewarmConnections, m_dwMaxConnections);
+    }
+    m_fRequestDelegation = fRequestDelegation && REQUEST_DELEGATION::IsSupported();
+    m_resourceLimits = resourceLimits;
     m_fStdoutLogEnabled = fStdoutLogEnabled;
-    m_fWebSocketSupported = fWebSocketSupported;
-    m_fWindowsAuthEnabled = fWindowsAuthEnabled;
-    m_fBasicAuthEnabled = fBasicAuthEnabled;
-    m_fAnonymousAuthEnabled = fAnonymousAuthEnabled;
     m_fEnableOutOfProcessConsoleRedirection = fEnableOutOfProcessConsoleRedirection;
     m_pProcessManager->ReferenceProcessManager();
     m_fDebuggerAttached = FALSE;
@@ -48,13 +94,18 @@ SERVER_PROCESS::Initialize(
         FAILED_LOG(hr = m_struAppFullPath.Copy(*pszAppPath))||
         FAILED_LOG(hr = m_struAppVirtualPath.Copy(*pszAppVirtualPath))||
         FAILED_LOG(hr = m_Arguments.Copy(*pszArguments)) ||
-        FAILED_LOG(hr = m_struHttpsPort.Copy(*pszHttpsPort)) ||
         FAILED_LOG(hr = SetupJobObject()))
     {
         return hr;
     }
 
-    m_pEnvironmentVarTable = pEnvironmentVariables;
+    m_pEnvironmentBlock = std::move(pEnvironmentBlock);
+
+    if (fCacheWindowsAuthToken)
+    {
+        // Without it every request duplicates its token.
+        m_pWindowsAuthTokenCache.reset(new (std::nothrow) WINDOWS_AUTH_TOKEN_CACHE());
+    }
 
     return S_OK;
 }
@@ -83,11 +134,90 @@ SERVER_PROCESS::SetupJobObject(VOID)
     JOBOBJECT_EXTENDED_LIMIT_INFORMATION jobInfo = { 0 };
     jobInfo.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
 
+    if (m_resourceLimits.dwMemoryLimitInMB != 0)
+    {
+        jobInfo.BasicLimitInformation.LimitFlags |= JOB_OBJECT_LIMIT_JOB_MEMORY;
+        jobInfo.JobMemoryLimit = static_cast<SIZE_T>(m_resourceLimits.dwMemoryLimitInMB) * 1024 * 1024;
+    }
+
+    if (m_resourceLimits.dwWorkingSetLimitInMB != 0)
+    {
+        jobInfo.BasicLimitInformation.LimitFlags |= JOB_OBJECT_LIMIT_WORKINGSET;
+        jobInfo.BasicLimitInformation.MaximumWorkingSetSize = static_cast<SIZE_T>(m_resourceLimits.dwWorkingSetLimitInMB) * 1024 * 1024;
+        jobInfo.BasicLimitInformation.MinimumWorkingSetSize = min(jobInfo.BasicLimitInformation.MaximumWorkingSetSize, MIN_JOB_WORKING_SET_SIZE);
+    }
+
     if (!SetInformationJobObject(m_hJobObject, JobObjectExtendedLimitInformation, &jobInfo, sizeof jobInfo))
     {
         return HRESULT_FROM_WIN32(GetLastError());
     }
 
+    // A limit the OS rejects, e.g. a NUMA node that doesn't exist, must not
+    // keep the application from starting.
+    LOG_IF_FAILED(ApplyJobResourceLimits());
+
+    //
+    // Track the processes of the job and the exit of the backend from its
+    // notifications instead of enumerating it every time and waiting on
+    // the process. Associated before any process is assigned so that no
+    // process is missed; without notifications the job is enumerated and
+    // the process waited on.
+    //
+    m_fExitWatched = FALSE;
+    m_fProcessExited = FALSE;
+    m_fMemoryLimitReported = FALSE;
+    LOG_IF_FAILED(JOB_NOTIFICATION_PORT::Associate(m_hJobObject, this, &m_ulJobNotificationKey));
+
+    return S_OK;
+}
+
+HRESULT
+SERVER_PROCESS::ApplyJobResourceLimits(VOID)
+{
+    if (m_resourceLimits.dwCpuRatePercent != 0)
+    {
+        JOBOBJECT_CPU_RATE_CONTROL_INFORMATION cpuRateInfo = { 0 };
+        cpuRateInfo.ControlFlags = JOB_OBJECT_CPU_RATE_CONTROL_ENABLE | JOB_OBJECT_CPU_RATE_CONTROL_HARD_CAP;
+        // In 1/100 of a percent of the cycles of all processors.
+        cpuRateInfo.CpuRate = m_resourceLimits.dwCpuRatePercent * 100;
+
+        RETURN_LAST_ERROR_IF(!SetInformationJobObject(m_hJobObject, JobObjectCpuRateControlInformation, &cpuRateInfo, sizeof cpuRateInfo));
+    }
+
+    if (m_resourceLimits.lNumaNode >= 0)
+    {
+        GROUP_AFFINITY groupAffinity = { 0 };
+        RETURN_LAST_ERROR_IF(!GetNumaNodeProcessorMaskEx(static_cast<USHORT>(m_resourceLimits.lNumaNode), &groupAffinity));
+        RETURN_LAST_ERROR_IF(!SetInformationJobObject(m_hJobObject, JobObjectGroupInformationEx, &groupAffinity, sizeof groupAffinity));
+    }
+
+    return S_OK;
+}
+
+HRESULT
+SERVER_PROCESS::ApplyCpuSets(VOID)
+{
+    typedef BOOL (WINAPI *PFN_SET_PROCESS_DEFAULT_CPU_SETS)(HANDLE, const ULONG*, ULONG);
+
+    if (m_resourceLimits.cpuSetIds.empty())
+    {
+        return S_OK;
+    }
+
+    // CPU sets are per process and only available from Windows 10 on, the
+    // processes the backend starts keep the system default.
+    static const auto pfnSetProcessDefaultCpuSets = reinterpret_cast<PFN_SET_PROCESS_DEFAULT_CPU_SETS>(
+        GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "SetProcessDefaultCpuSets"));
+    if (pfnSetProcessDefaultCpuSets == nullptr)
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED));
+    }
+
+    RETURN_LAST_ERROR_IF(!pfnSetProcessDefaultCpuSets(
+        m_hProcessHandle,
+        m_resourceLimits.cpuSetIds.data(),
+        static_cast<ULONG>(m_resourceLimits.cpuSetIds.size())));
+
     return S_OK;
 }
 
@@ -100,71 +230,121 @@ SERVER_PROCESS::GetRandomPort
 {
     DBG_ASSERT(pdwPickedPort);
 
-    std::uniform_int_distribution<> dist(MIN_PORT_RANDOM, MAX_PORT);
-
-    BOOL fPortInUse;
-    DWORD dwActualProcessId; // Ignored, but required for the function call.
+    BOOL fPortAvailable;
     constexpr int maxRetries = 10;
     for (int retry = 0; retry < maxRetries; ++retry)
     {
-        do
+        RETURN_IF_FAILED(PORT_ALLOCATOR::Acquire(dwExcludedPort, pdwPickedPort));
+
+        HRESULT hr = IsPortAvailable(*pdwPickedPort, &fPortAvailable);
+        if (SUCCEEDED(hr) && fPortAvailable)
         {
-            *pdwPickedPort = dist(m_randomGenerator);
-        } while (*pdwPickedPort == dwExcludedPort); // Keep generating until a valid port is found.
+            m_fPortAcquired = TRUE;
+            return S_OK; // Port found and is not in use, success!
+        }
+
+        // Held by another process, the allocator moves on past it.
+        PORT_ALLOCATOR::Release(*pdwPickedPort);
+        *pdwPickedPort = 0;
 
-        HRESULT hr = CheckIfServerIsUp(*pdwPickedPort, &dwActualProcessId, &fPortInUse);
         if (FAILED(hr))
         {
             return hr;
         }
+    }
 
-        if (!fPortInUse)
+    // All retries failed, return error.
+    return HRESULT_FROM_WIN32(ERROR_PORT_NOT_SET);
+}
+
+HRESULT
+SERVER_PROCESS::IsPortAvailable(
+    _In_  DWORD     dwPort,
+    _Out_ BOOL    * pfAvailable
+)
+/*++
+
+Routine Description:
+
+    Check whether the backend will be able to listen on dwPort by binding
+    an exclusive loopback socket to it. Unlike scanning the listener table
+    this is a single syscall and also catches ports held by sockets that
+    are not listening (connected sockets, TIME_WAIT, excluded ranges).
+
+--*/
+{
+    SOCKET      socketCheck = INVALID_SOCKET;
+    SOCKADDR_IN address = {};
+    BOOL        fExclusive = TRUE;
+
+    DBG_ASSERT(pfAvailable);
+    *pfAvailable = FALSE;
+
+    socketCheck = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (socketCheck == INVALID_SOCKET)
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(WSAGetLastError()));
+    }
+
+    if (setsockopt(socketCheck,
+            SOL_SOCKET,
+            SO_EXCLUSIVEADDRUSE,
+            reinterpret_cast<const char *>(&fExclusive),
+            sizeof(fExclusive)) == SOCKET_ERROR)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(WSAGetLastError());
+        closesocket(socketCheck);
+        RETURN_HR(hr);
+    }
+
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<USHORT>(dwPort));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(socketCheck, reinterpret_cast<SOCKADDR *>(&address), sizeof(address)) == 0)
+    {
+        *pfAvailable = TRUE;
+    }
+    else
+    {
+        int iError = WSAGetLastError();
+        if (iError != WSAEADDRINUSE && iError != WSAEACCES)
         {
-            return S_OK; // Port found and is not in use, success!
+            closesocket(socketCheck);
+            RETURN_HR(HRESULT_FROM_WIN32(iError));
         }
     }
 
-    // All retries failed, return error.
-    return HRESULT_FROM_WIN32(ERROR_PORT_NOT_SET);
+    closesocket(socketCheck);
+    return S_OK;
 }
 
 HRESULT
 SERVER_PROCESS::SetupListenPort(
-    ENVIRONMENT_VAR_HASH    *pEnvironmentVarTable,
     BOOL*                    pfCriticalError
 )
 {
     HRESULT hr = S_OK;
-    ENVIRONMENT_VAR_ENTRY *pEntry = NULL;
     *pfCriticalError = FALSE;
 
-    pEnvironmentVarTable->FindKey(ASPNETCORE_PORT_ENV_STR, &pEntry);
-    if (pEntry != NULL)
+    PCWSTR pszConfiguredPort = m_pEnvironmentBlock->QueryConfiguredValue(ASPNETCORE_PORT_ENV_STR);
+    if (pszConfiguredPort != NULL && pszConfiguredPort[0] != L'\0')
     {
-        if (pEntry->QueryValue() != NULL && pEntry->QueryValue()[0] != L'\0')
+        m_dwPort = (DWORD)_wtoi(pszConfiguredPort);
+        if (m_dwPort >MAX_PORT || m_dwPort < MIN_PORT)
         {
-            m_dwPort = (DWORD)_wtoi(pEntry->QueryValue());
-            if (m_dwPort >MAX_PORT || m_dwPort < MIN_PORT)
-            {
-                hr = E_INVALIDARG;
-                *pfCriticalError = TRUE;
-                goto Finished;
-                // need add log for this one
-            }
-            hr = m_struPort.Copy(pEntry->QueryValue());
+            hr = E_INVALIDARG;
+            *pfCriticalError = TRUE;
             goto Finished;
+            // need add log for this one
         }
-        else
-        {
-            //
-            // user set the env variable but did not give value, let's set it up
-            //
-            pEnvironmentVarTable->DeleteKey(ASPNETCORE_PORT_ENV_STR);
-            pEntry->Dereference();
-            pEntry = NULL;
-        }
+        hr = m_struPort.Copy(pszConfiguredPort);
+        goto Finished;
     }
 
+    //
+    // user did not set the env variable or did not give value, let's set it up
+    //
     WCHAR buffer[15];
     if (FAILED_LOG(hr = GetRandomPort(&m_dwPort)))
     {
@@ -177,27 +357,12 @@ SERVER_PROCESS::SetupListenPort(
         goto Finished;
     }
 
-    pEntry = new ENVIRONMENT_VAR_ENTRY();
-    if (pEntry == NULL)
-    {
-        hr = E_OUTOFMEMORY;
-        goto Finished;
-    }
-
-    if (FAILED_LOG(hr = pEntry->Initialize(ASPNETCORE_PORT_ENV_STR, buffer)) ||
-        FAILED_LOG(hr = pEnvironmentVarTable->InsertRecord(pEntry)) ||
-        FAILED_LOG(hr = m_struPort.Copy(buffer)))
+    if (FAILED_LOG(hr = m_struPort.Copy(buffer)))
     {
         goto Finished;
     }
 
 Finished:
-    if (pEntry != NULL)
-    {
-        pEntry->Dereference();
-        pEntry = NULL;
-    }
-
     if (FAILED_LOG(hr))
     {
         EventLog::Error(
@@ -214,40 +379,9 @@ Finished:
     return hr;
 }
 
-HRESULT
-SERVER_PROCESS::SetupAppPath(
-    ENVIRONMENT_VAR_HASH* pEnvironmentVarTable
-)
-{
-    ENVIRONMENT_VAR_ENTRY*  pEntry = nullptr;
-    pEnvironmentVarTable->FindKey(ASPNETCORE_APP_PATH_ENV_STR, &pEntry);
-    if (pEntry != nullptr)
-    {
-        // user should not set this environment variable in configuration
-        pEnvironmentVarTable->DeleteKey(ASPNETCORE_APP_PATH_ENV_STR);
-        pEntry->Dereference();
-        pEntry = nullptr;
-    }
-
-    pEntry = new ENVIRONMENT_VAR_ENTRY();
-    if (pEntry == nullptr)
-    {
-        return E_OUTOFMEMORY;
-    }
-
-    HRESULT hr = S_OK;
-    if (SUCCEEDED_LOG(hr = pEntry->Initialize(ASPNETCORE_APP_PATH_ENV_STR, m_struAppVirtualPath.QueryStr())))
-    {
-        LOG_IF_FAILED(hr = pEnvironmentVarTable->InsertRecord(pEntry));
-    }
-
-    pEntry->Dereference();
-    return hr;
-}
-
 HRESULT
 SERVER_PROCESS::SetupAppToken(
-    ENVIRONMENT_VAR_HASH    *pEnvironmentVarTable
+    STRU*   pstrAppToken
 )
 {
     HRESULT     hr = S_OK;
@@ -255,61 +389,47 @@ SERVER_PROCESS::SetupAppToken(
     PSTR        pszLogUuid = NULL;
     BOOL        fRpcStringAllocd = FALSE;
     RPC_STATUS  rpcStatus;
-    STRU        strAppToken;
-    ENVIRONMENT_VAR_ENTRY*  pEntry = NULL;
 
-    pEnvironmentVarTable->FindKey(ASPNETCORE_APP_TOKEN_ENV_STR, &pEntry);
-    if (pEntry != NULL)
+    PCWSTR pszConfiguredToken = m_pEnvironmentBlock->QueryConfiguredValue(ASPNETCORE_APP_TOKEN_ENV_STR);
+    if (pszConfiguredToken != NULL)
     {
         // user sets the environment variable
         m_straGuid.Reset();
-        hr = m_straGuid.CopyW(pEntry->QueryValue());
-        pEntry->Dereference();
-        pEntry = NULL;
-        goto Finished;
+        if (FAILED_LOG(hr = m_straGuid.CopyW(pszConfiguredToken)))
+        {
+            goto Finished;
+        }
     }
-    else
+    else if (m_straGuid.IsEmpty())
     {
-        if (m_straGuid.IsEmpty())
+        // the GUID has not been set yet
+        rpcStatus = UuidCreate(&logUuid);
+        if (rpcStatus != RPC_S_OK)
         {
-            // the GUID has not been set yet
-            rpcStatus = UuidCreate(&logUuid);
-            if (rpcStatus != RPC_S_OK)
-            {
-                hr = rpcStatus;
-                goto Finished;
-            }
-
-            rpcStatus = UuidToStringA(&logUuid, (BYTE **)&pszLogUuid);
-            if (rpcStatus != RPC_S_OK)
-            {
-                hr = rpcStatus;
-                goto Finished;
-            }
-
-            fRpcStringAllocd = TRUE;
-
-            if (FAILED_LOG(hr = m_straGuid.Copy(pszLogUuid)))
-            {
-                goto Finished;
-            }
+            hr = rpcStatus;
+            goto Finished;
         }
 
-        pEntry = new ENVIRONMENT_VAR_ENTRY();
-        if (pEntry == NULL)
+        rpcStatus = UuidToStringA(&logUuid, (BYTE **)&pszLogUuid);
+        if (rpcStatus != RPC_S_OK)
         {
-            hr = E_OUTOFMEMORY;
+            hr = rpcStatus;
             goto Finished;
         }
 
-        if (FAILED_LOG(strAppToken.CopyA(m_straGuid.QueryStr())) ||
-            FAILED_LOG(hr = pEntry->Initialize(ASPNETCORE_APP_TOKEN_ENV_STR, strAppToken.QueryStr())) ||
-            FAILED_LOG(hr = pEnvironmentVarTable->InsertRecord(pEntry)))
+        fRpcStringAllocd = TRUE;
+
+        if (FAILED_LOG(hr = m_straGuid.Copy(pszLogUuid)))
         {
             goto Finished;
         }
     }
 
+    if (FAILED_LOG(hr = pstrAppToken->CopyA(m_straGuid.QueryStr())))
+    {
+        goto Finished;
+    }
+
 Finished:
 
     if (fRpcStringAllocd)
@@ -317,92 +437,87 @@ Finished:
         RpcStringFreeA((BYTE **)&pszLogUuid);
         pszLogUuid = NULL;
     }
-    if (pEntry != NULL)
-    {
-        pEntry->Dereference();
-        pEntry = NULL;
-    }
     return hr;
 }
 
 HRESULT
-SERVER_PROCESS::OutputEnvironmentVariables
-(
-    MULTISZ*                pmszOutput,
-    ENVIRONMENT_VAR_HASH*   pEnvironmentVarTable
+SERVER_PROCESS::SetupReadyEvent(
+    STRU*   pstrEventName
 )
 {
-    HRESULT    hr = S_OK;
-    LPWSTR     pszEnvironmentVariables = NULL;
-    LPWSTR     pszCurrentVariable = NULL;
-    LPWSTR     pszNextVariable = NULL;
-    LPWSTR     pszEqualChar = NULL;
-    STRU       strEnvVar;
-    ENVIRONMENT_VAR_ENTRY* pEntry = NULL;
-
-    DBG_ASSERT(pmszOutput);
-    DBG_ASSERT(pEnvironmentVarTable); // We added some startup variables
-    DBG_ASSERT(pEnvironmentVarTable->Count() >0);
-
-    // cleanup, as we may in retry logic
-    pmszOutput->Reset();
+    //
+    // The event is named after the per-process token so that it is unique
+    // and only known to the backend we start.
+    //
+    RETURN_IF_FAILED(pstrEventName->Copy(READY_EVENT_NAME_PREFIX));
+    RETURN_IF_FAILED(pstrEventName->AppendA(m_straGuid.QueryStr()));
 
-    pszEnvironmentVariables = GetEnvironmentStringsW();
-    if (pszEnvironmentVariables == NULL)
+    if (m_hReadyEvent == NULL)
     {
-        hr = HRESULT_FROM_WIN32(ERROR_INVALID_ENVIRONMENT);
-        goto Finished;
+        m_hReadyEvent = CreateEventW(NULL,  // security attributes
+            TRUE,                           // manual reset
+            FALSE,                          // initial state
+            pstrEventName->QueryStr());
+        RETURN_LAST_ERROR_IF_NULL(m_hReadyEvent);
     }
-    pszCurrentVariable = pszEnvironmentVariables;
-    while (*pszCurrentVariable != L'\0')
+    else
     {
-        pszNextVariable = pszCurrentVariable + wcslen(pszCurrentVariable) + 1;
-        pszEqualChar = wcschr(pszCurrentVariable, L'=');
-        if (pszEqualChar != NULL)
-        {
-            if (FAILED_LOG(hr = strEnvVar.Copy(pszCurrentVariable, (DWORD)(pszEqualChar - pszCurrentVariable) + 1)))
-            {
-                goto Finished;
-            }
-            pEnvironmentVarTable->FindKey(strEnvVar.QueryStr(), &pEntry);
-            if (pEntry != NULL)
-            {
-                // same env variable is defined in configuration, use it
-                if (FAILED_LOG(hr = strEnvVar.Append(pEntry->QueryValue())))
-                {
-                    goto Finished;
-                }
-                pmszOutput->Append(strEnvVar);  //should we check the returned bool
-                // remove the record from hash table as we already output it
-                pEntry->Dereference();
-                pEnvironmentVarTable->DeleteKey(pEntry->QueryName());
-                strEnvVar.Reset();
-                pEntry = NULL;
-            }
-            else
-            {
-                pmszOutput->Append(pszCurrentVariable);
-            }
-        }
-        else
-        {
-            // env varaible is not well formated
-            hr = HRESULT_FROM_WIN32(ERROR_INVALID_ENVIRONMENT);
-            goto Finished;
-        }
-        // move to next env variable
-        pszCurrentVariable = pszNextVariable;
+        // start retry, forget about the previous attempt.
+        ResetEvent(m_hReadyEvent);
     }
-    // append the remaining env variable in hash table
-    pEnvironmentVarTable->Apply(ENVIRONMENT_VAR_HELPERS::CopyToMultiSz, pmszOutput);
 
-Finished:
-    if (pszEnvironmentVariables != NULL)
+    return S_OK;
+}
+
+HRESULT
+SERVER_PROCESS::SetupRequestDelegation(
+    VOID
+)
+{
+    //
+    // Named after the token like the readiness event. A retry opens the
+    // queue of the new process again.
+    //
+    m_pRequestDelegation.reset(new (std::nothrow) REQUEST_DELEGATION());
+    if (m_pRequestDelegation == nullptr)
     {
-        FreeEnvironmentStringsW(pszEnvironmentVariables);
-        pszEnvironmentVariables = NULL;
+        RETURN_HR(E_OUTOFMEMORY);
     }
-    return hr;
+
+    RETURN_IF_FAILED(m_struDelegationQueueName.Copy(DELEGATION_QUEUE_NAME_PREFIX));
+    RETURN_IF_FAILED(m_struDelegationQueueName.AppendA(m_straGuid.QueryStr()));
+
+    // The address requests that are not delegated are proxied to.
+    RETURN_IF_FAILED(m_struDelegationUrlPrefix.SafeSnwprintf(L"http://%S:%s/", LOCALHOST, m_struPort.QueryStr()));
+
+    return S_OK;
+}
+
+//
+// The environment block of the process manager, with the variables that
+// differ per process appended.
+//
+HRESULT
+SERVER_PROCESS::OutputEnvironmentVariables
+(
+    const STRU&             strAppToken,
+    const STRU&             strEventName,
+    std::vector<WCHAR>*     pEnvironment
+)
+{
+    const ENVIRONMENT_BLOCK::VARIABLE rgVariables[] =
+    {
+        { ASPNETCORE_PORT_ENV_STR,          m_struPort.QueryStr() },
+        { ASPNETCORE_APP_PATH_ENV_STR,      m_struAppVirtualPath.QueryStr() },
+        { ASPNETCORE_APP_TOKEN_ENV_STR,     strAppToken.QueryStr() },
+        { ASPNETCORE_READY_EVENT_ENV_STR,   strEventName.QueryStr() },
+        // Last, only set with requestDelegation.
+        { ASPNETCORE_DELEGATION_QUEUE_ENV_STR, m_struDelegationQueueName.QueryStr() },
+    };
+
+    return m_pEnvironmentBlock->Format(rgVariables,
+        m_fRequestDelegation ? _countof(rgVariables) : _countof(rgVariables) - 1,
+        pEnvironment);
 }
 
 HRESULT
@@ -489,6 +604,8 @@ SERVER_PROCESS::PostStartCheck(
     DWORD   dwTickCount = 0;
     DWORD   dwTimeDifference = 0;
     DWORD   dwActualProcessId = 0;
+    DWORD   dwProbeInterval = READY_PROBE_MIN_INTERVAL_MS;
+    BOOL    fPortAvailable = TRUE;
     INT     iChildProcessIndex = -1;
     STACK_STRU(strEventMsg, 256);
 
@@ -516,15 +633,47 @@ SERVER_PROCESS::PostStartCheck(
                 }
             }
         }
-        //
-        // dwActualProcessId will be set only when NsiAPI(GetExtendedTcpTable) is supported
-        //
-        hr = CheckIfServerIsUp(m_dwPort, &dwActualProcessId, &fReady);
+        if (m_pRequestDelegation != NULL)
+        {
+            //
+            // HTTP.sys owns the port of an HttpSys server, the backend is
+            // up once its queue takes delegated requests.
+            //
+            fReady = SUCCEEDED(m_pRequestDelegation->Open(m_struDelegationQueueName.QueryStr(),
+                m_struDelegationUrlPrefix.QueryStr()));
+            dwActualProcessId = m_dwProcessId;
+        }
+        else
+        {
+            //
+            // Probing the port with a bind is a single syscall, only scan the
+            // listener table (to learn the listening process id) once the port
+            // has been taken by someone.
+            //
+            hr = IsPortAvailable(m_dwPort, &fPortAvailable);
+            if (FAILED_LOG(hr) || !fPortAvailable)
+            {
+                //
+                // dwActualProcessId will be set only when NsiAPI(GetExtendedTcpTable) is supported
+                //
+                hr = CheckIfServerIsUp(m_dwPort, &dwActualProcessId, &fReady);
+            }
+        }
         fDebuggerAttached = IsDebuggerIsAttached();
 
         if (!fReady)
         {
-            Sleep(250);
+            //
+            // Wake up as soon as the backend signals readiness or exits,
+            // otherwise re-probe with an exponential backoff.
+            //
+            HANDLE rgWaitHandles[] = { m_hProcessHandle, m_hReadyEvent };
+            WaitForMultipleObjects(m_hReadyEvent != NULL ? 2 : 1,
+                rgWaitHandles,
+                FALSE,  // bWaitAll
+                dwProbeInterval);
+
+            dwProbeInterval = min(dwProbeInterval * 2, READY_PROBE_MAX_INTERVAL_MS);
         }
 
         dwTimeDifference = (GetTickCount() - dwTickCount);
@@ -537,8 +686,8 @@ SERVER_PROCESS::PostStartCheck(
         goto Finished;
     }
 
-    // register call back with the created process
-    if (FAILED_LOG(hr = RegisterProcessWait(&m_hProcessWaitHandle, m_hProcessHandle)))
+    // watch the exit of the created process
+    if (FAILED_LOG(hr = WatchProcessExit(&m_hProcessWaitHandle, m_hProcessHandle)))
     {
         goto Finished;
     }
@@ -587,7 +736,7 @@ SERVER_PROCESS::PostStartCheck(
                         fDebuggerAttached = FALSE;
                     }
 
-                    if (FAILED_LOG(hr = RegisterProcessWait(&m_hChildProcessWaitHandles[i],
+                    if (FAILED_LOG(hr = WatchProcessExit(&m_hChildProcessWaitHandles[i],
                         m_hChildProcessHandles[i])))
                     {
                         goto Finished;
@@ -641,7 +790,7 @@ SERVER_PROCESS::PostStartCheck(
         //
         // final check to make sure child process listening on HTTP is still UP
         // This is needed because, the child process might have crashed/exited between
-        // the previous call to checkIfServerIsUp and RegisterProcessWait
+        // the previous call to checkIfServerIsUp and WatchProcessExit
         // and we would not know about it.
         //
 
@@ -673,7 +822,28 @@ SERVER_PROCESS::PostStartCheck(
             goto Finished;
         }
 
-        hr = m_pForwarderConnection->Initialize(m_dwPort);
+        hr = m_pForwarderConnection->Initialize(m_pProcessManager->QueryForwarderSession(), m_dwPort, m_dwMaxConnections);
+        if (FAILED_LOG(hr))
+        {
+            goto Finished;
+        }
+    }
+
+    //
+    // The capped connection has a session of its own, this one shares
+    // the application or global session and with it a separate pool that
+    // is not capped.
+    //
+    if (m_fReservePriorityConnection && m_pPriorityConnection == NULL)
+    {
+        m_pPriorityConnection = new FORWARDER_CONNECTION();
+        if (m_pPriorityConnection == NULL)
+        {
+            hr = E_OUTOFMEMORY;
+            goto Finished;
+        }
+
+        hr = m_pPriorityConnection->Initialize(m_pProcessManager->QueryForwarderSession(), m_dwPort, 0);
         if (FAILED_LOG(hr))
         {
             goto Finished;
@@ -684,10 +854,33 @@ SERVER_PROCESS::PostStartCheck(
                                             FALSE,
                                             m_dwListeningProcessId);
 
+    m_llListening = QueryTimestamp();
+
+    TraceLoggingWrite(g_hTraceProvider,
+        "BackendProcessListening",
+        TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+        TraceLoggingKeyword(ASPNETCORE_TRACE_KEYWORD_PROCESS),
+        TraceLoggingWideString(m_struAppFullPath.QueryStr(), "ApplicationPath"),
+        TraceLoggingUInt32(m_dwProcessId, "ProcessId"),
+        TraceLoggingUInt32(m_dwListeningProcessId, "ListeningProcessId"),
+        TraceLoggingUInt32(m_dwPort, "Port"),
+        TraceLoggingUInt64(QueryMicrosecondsBetween(m_llProcessCreated, m_llListening), "ListenMicroseconds"),
+        TraceLoggingUInt64(QueryMicrosecondsBetween(m_llStartRequested, m_llListening), "ElapsedMicroseconds"));
+
     //
     // mark server process as Ready
     //
     m_fReady = TRUE;
+    StartHealthChecks();
+
+    //
+    // Open keep-alive connections now so that the first burst of requests
+    // does not pay for the TCP setup.
+    //
+    if (m_dwPrewarmConnections != 0)
+    {
+        PrewarmConnections();
+    }
 
 Finished:
     m_fDebuggerAttached = fDebuggerAttached;
@@ -700,6 +893,12 @@ Finished:
             m_pForwarderConnection = NULL;
         }
 
+        if (m_pPriorityConnection != NULL)
+        {
+            m_pPriorityConnection->DereferenceForwarderConnection();
+            m_pPriorityConnection = NULL;
+        }
+
         if (!strEventMsg.IsEmpty())
         {
             EventLog::Warn(
@@ -720,11 +919,14 @@ SERVER_PROCESS::StartProcess(
     STARTUPINFOW            startupInfo = {0};
     DWORD                   dwRetryCount = 2; // should we allow customer to config it
     DWORD                   dwCreationFlags = 0;
-    MULTISZ                 mszNewEnvironment;
-    ENVIRONMENT_VAR_HASH    *pHashTable = NULL;
+    std::vector<WCHAR>      newEnvironment;
+    STRU                    strAppToken;
+    STRU                    strEventName;
     PWSTR                   pStrStage = NULL;
     BOOL                    fCriticalError = FALSE;
-    std::map<std::wstring, std::wstring, ignore_case_comparer> variables;
+    LONGLONG                llCreateStart = 0;
+
+    m_llStartRequested = QueryTimestamp();
 
     GetStartupInfoW(&startupInfo);
 
@@ -736,6 +938,7 @@ SERVER_PROCESS::StartProcess(
 
     while (dwRetryCount > 0)
     {
+        ReleasePort();
         m_dwPort = 0;
         dwRetryCount--;
         //
@@ -747,63 +950,46 @@ SERVER_PROCESS::StartProcess(
             goto Failure;
         }
 
-        try
-        {
-            variables = ENVIRONMENT_VAR_HELPERS::InitEnvironmentVariablesTable(
-                m_pEnvironmentVarTable,
-                m_fWindowsAuthEnabled,
-                m_fBasicAuthEnabled,
-                m_fAnonymousAuthEnabled,
-                true, // fAddHostingStartup
-                m_struAppFullPath.QueryStr(),
-                m_struHttpsPort.QueryStr());
-
-            variables = ENVIRONMENT_VAR_HELPERS::AddWebsocketEnabledToEnvironmentVariables(variables, m_fWebSocketSupported);
-        }
-        CATCH_RETURN();
-
-
-        pHashTable = new ENVIRONMENT_VAR_HASH();
-        RETURN_IF_FAILED(pHashTable->Initialize(37 /*prime*/));
-        // Copy environment variables to old style hash table
-        for (auto & variable : variables)
+        //
+        // setup the the port that the backend process will listen on
+        //
+        if (FAILED_LOG(hr = SetupListenPort(&fCriticalError)))
         {
-            auto pNewEntry = std::unique_ptr<ENVIRONMENT_VAR_ENTRY, ENVIRONMENT_VAR_ENTRY_DELETER>(new ENVIRONMENT_VAR_ENTRY());
-            RETURN_IF_FAILED(pNewEntry->Initialize((variable.first + L"=").c_str(), variable.second.c_str()));
-            RETURN_IF_FAILED(pHashTable->InsertRecord(pNewEntry.get()));
+            pStrStage = L"SetupListenPort";
+            goto Failure;
         }
 
         //
-        // setup the the port that the backend process will listen on
+        // generate new guid for each process
         //
-        if (FAILED_LOG(hr = SetupListenPort(pHashTable, &fCriticalError)))
+        if (FAILED_LOG(hr = SetupAppToken(&strAppToken)))
         {
-            pStrStage = L"SetupListenPort";
+            pStrStage = L"SetupAppToken";
             goto Failure;
         }
 
         //
-        // get app path
+        // readiness event the backend can signal instead of being polled
         //
-        if (FAILED_LOG(hr = SetupAppPath(pHashTable)))
+        if (FAILED_LOG(hr = SetupReadyEvent(&strEventName)))
         {
-            pStrStage = L"SetupAppPath";
+            pStrStage = L"SetupReadyEvent";
             goto Failure;
         }
 
         //
-        // generate new guid for each process
+        // request queue the backend creates to take delegated requests
         //
-        if (FAILED_LOG(hr = SetupAppToken(pHashTable)))
+        if (m_fRequestDelegation && FAILED_LOG(hr = SetupRequestDelegation()))
         {
-            pStrStage = L"SetupAppToken";
+            pStrStage = L"SetupRequestDelegation";
             goto Failure;
         }
 
         //
         // setup environment variables for new process
         //
-        if (FAILED_LOG(hr = OutputEnvironmentVariables(&mszNewEnvironment, pHashTable)))
+        if (FAILED_LOG(hr = OutputEnvironmentVariables(strAppToken, strEventName, &newEnvironment)))
         {
             pStrStage = L"OutputEnvironmentVariables";
             goto Failure;
@@ -814,6 +1000,8 @@ SERVER_PROCESS::StartProcess(
             CREATE_SUSPENDED |
             CREATE_NEW_PROCESS_GROUP;
 
+        llCreateStart = QueryTimestamp();
+
         if (!CreateProcessW(
             NULL,                   // applicationName
             m_struCommandLine.QueryStr(),
@@ -821,7 +1009,7 @@ SERVER_PROCESS::StartProcess(
             NULL,                   // threadAttr
             TRUE,                   // inheritHandles
             dwCreationFlags,
-            mszNewEnvironment.QueryStr(),
+            newEnvironment.data(),
             m_struPhysicalPath.QueryStr(), // currentDir
             &startupInfo,
             &processInformation))
@@ -833,6 +1021,17 @@ SERVER_PROCESS::StartProcess(
 
         m_hProcessHandle = processInformation.hProcess;
         m_dwProcessId = processInformation.dwProcessId;
+        m_llProcessCreated = QueryTimestamp();
+
+        TraceLoggingWrite(g_hTraceProvider,
+            "BackendProcessCreated",
+            TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+            TraceLoggingKeyword(ASPNETCORE_TRACE_KEYWORD_PROCESS),
+            TraceLoggingWideString(m_struAppFullPath.QueryStr(), "ApplicationPath"),
+            TraceLoggingUInt32(m_dwProcessId, "ProcessId"),
+            TraceLoggingUInt32(m_dwPort, "Port"),
+            TraceLoggingUInt64(QueryMicrosecondsBetween(llCreateStart, m_llProcessCreated), "CreateProcessMicroseconds"),
+            TraceLoggingUInt64(QueryMicrosecondsBetween(m_llStartRequested, m_llProcessCreated), "ElapsedMicroseconds"));
 
         if (FAILED_LOG(hr = SetupJobObject()))
         {
@@ -853,6 +1052,9 @@ SERVER_PROCESS::StartProcess(
             }
         }
 
+        // Before the first thread runs so no work is scheduled elsewhere.
+        LOG_IF_FAILED(ApplyCpuSets());
+
         if (ResumeThread(processInformation.hThread) == -1)
         {
             pStrStage = L"ResumeThread";
@@ -883,6 +1085,17 @@ SERVER_PROCESS::StartProcess(
         goto Finished;
 
     Failure:
+        TraceLoggingWrite(g_hTraceProvider,
+            "BackendProcessStartFailed",
+            TraceLoggingLevel(WINEVENT_LEVEL_WARNING),
+            TraceLoggingKeyword(ASPNETCORE_TRACE_KEYWORD_PROCESS),
+            TraceLoggingWideString(m_struAppFullPath.QueryStr(), "ApplicationPath"),
+            TraceLoggingUInt32(m_dwProcessId, "ProcessId"),
+            TraceLoggingUInt32(m_dwPort, "Port"),
+            TraceLoggingWideString(pStrStage, "Stage"),
+            TraceLoggingHResult(hr, "HResult"),
+            TraceLoggingUInt64(QueryMicrosecondsBetween(m_llStartRequested, QueryTimestamp()), "ElapsedMicroseconds"));
+
         if (fCriticalError)
         {
             // Critical error, no retry need to avoid wasting resource and polluting log
@@ -906,13 +1119,6 @@ SERVER_PROCESS::StartProcess(
             processInformation.hThread = NULL;
         }
 
-        if (pHashTable != NULL)
-        {
-            pHashTable->Clear();
-            delete pHashTable;
-            pHashTable = NULL;
-        }
-
         CleanUp();
     }
 
@@ -929,6 +1135,15 @@ Finished:
             m_hStdErrWritePipe = NULL;
         }
 
+        //
+        // Stop capturing before m_output is logged below.
+        //
+        if (m_pStdErrReader != nullptr)
+        {
+            m_pStdErrReader->Stop(0);
+            m_pStdErrReader.reset();
+        }
+
         if (m_hStdoutHandle != NULL)
         {
             if (m_hStdoutHandle != INVALID_HANDLE_VALUE)
@@ -941,7 +1156,7 @@ Finished:
 
         if (m_fStdoutLogEnabled)
         {
-            m_Timer.CancelTimer();
+            m_Timer.Cancel();
         }
 
         EventLog::Error(
@@ -956,16 +1171,165 @@ Finished:
     return hr;
 }
 
+HRESULT
+SERVER_PROCESS::AttachProcess(
+    DWORD   dwListeningProcessId,
+    DWORD   dwPort,
+    _In_ PCSTR pszToken
+)
+{
+    HRESULT hr = S_OK;
+    BOOL    fReady = FALSE;
+    DWORD   dwActualProcessId = 0;
+
+    m_llStartRequested = QueryTimestamp();
+    m_fAttached = TRUE;
+    m_dwPort = dwPort;
+    m_dwProcessId = dwListeningProcessId;
+    m_dwListeningProcessId = dwListeningProcessId;
+
+    if (FAILED_LOG(hr = m_straGuid.Copy(pszToken)))
+    {
+        goto Finished;
+    }
+
+    //
+    // The port may have been taken by another process since the backend
+    // was recorded.
+    //
+    if (FAILED_LOG(hr = CheckIfServerIsUp(m_dwPort, &dwActualProcessId, &fReady)))
+    {
+        goto Finished;
+    }
+
+    if (!fReady || dwActualProcessId != dwListeningProcessId)
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+        goto Finished;
+    }
+
+    m_hListeningProcessHandle = OpenProcess(SYNCHRONIZE | PROCESS_DUP_HANDLE,
+                                            FALSE,
+                                            m_dwListeningProcessId);
+    if (m_hListeningProcessHandle == NULL)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    m_pForwarderConnection = new FORWARDER_CONNECTION();
+    if (m_pForwarderConnection == NULL)
+    {
+        hr = E_OUTOFMEMORY;
+        goto Finished;
+    }
+
+    if (FAILED_LOG(hr = m_pForwarderConnection->Initialize(m_pProcessManager->QueryForwarderSession(), m_dwPort, m_dwMaxConnections)))
+    {
+        goto Finished;
+    }
+
+    if (m_fReservePriorityConnection)
+    {
+        m_pPriorityConnection = new FORWARDER_CONNECTION();
+        if (m_pPriorityConnection == NULL)
+        {
+            hr = E_OUTOFMEMORY;
+            goto Finished;
+        }
+
+        if (FAILED_LOG(hr = m_pPriorityConnection->Initialize(m_pProcessManager->QueryForwarderSession(), m_dwPort, 0)))
+        {
+            goto Finished;
+        }
+    }
+
+    //
+    // Registered last, nothing has to undo it. The exit of the backend is
+    // handled like the crash of a process of our own.
+    //
+    if (FAILED_LOG(hr = RegisterProcessWait(&m_hProcessWaitHandle, m_hListeningProcessHandle)))
+    {
+        goto Finished;
+    }
+
+    m_llProcessCreated = m_llListening = QueryTimestamp();
+
+    TraceLoggingWrite(g_hTraceProvider,
+        "BackendProcessAttached",
+        TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+        TraceLoggingKeyword(ASPNETCORE_TRACE_KEYWORD_PROCESS),
+        TraceLoggingWideString(m_struAppFullPath.QueryStr(), "ApplicationPath"),
+        TraceLoggingUInt32(m_dwListeningProcessId, "ListeningProcessId"),
+        TraceLoggingUInt32(m_dwPort, "Port"));
+
+    m_fReady = TRUE;
+    StartHealthChecks();
+
+    if (m_dwPrewarmConnections != 0)
+    {
+        PrewarmConnections();
+    }
+
+Finished:
+    if (FAILED(hr))
+    {
+        //
+        // Back to a process that is not started, the caller may start one
+        // with StartProcess.
+        //
+        if (m_pForwarderConnection != NULL)
+        {
+            m_pForwarderConnection->DereferenceForwarderConnection();
+            m_pForwarderConnection = NULL;
+        }
+
+        if (m_pPriorityConnection != NULL)
+        {
+            m_pPriorityConnection->DereferenceForwarderConnection();
+            m_pPriorityConnection = NULL;
+        }
+
+        if (m_hListeningProcessHandle != NULL)
+        {
+            CloseHandle(m_hListeningProcessHandle);
+            m_hListeningProcessHandle = NULL;
+        }
+
+        m_straGuid.Reset();
+        m_fAttached = FALSE;
+        m_dwPort = 0;
+        m_dwProcessId = 0;
+        m_dwListeningProcessId = 0;
+    }
+
+    return hr;
+}
+
 HRESULT
 SERVER_PROCESS::SetWindowsAuthToken(
     HANDLE hToken,
-    LPHANDLE pTargetTokenHandle
+    HTTP_CONNECTION_ID connectionId,
+    LPHANDLE pTargetTokenHandle,
+    WINDOWS_AUTH_TOKEN_CACHE_ENTRY **ppEntry
 )
 {
     HRESULT hr = S_OK;
 
+    *ppEntry = NULL;
+
     if (m_hListeningProcessHandle != NULL && m_hListeningProcessHandle != INVALID_HANDLE_VALUE)
     {
+        if (m_pWindowsAuthTokenCache != NULL)
+        {
+            hr = m_pWindowsAuthTokenCache->Acquire(m_hListeningProcessHandle,
+                                                   connectionId,
+                                                   hToken,
+                                                   pTargetTokenHandle,
+                                                   ppEntry);
+            goto Finished;
+        }
+
         if (!DuplicateHandle( GetCurrentProcess(),
                              hToken,
                              m_hListeningProcessHandle,
@@ -984,6 +1348,21 @@ Finished:
     return hr;
 }
 
+VOID
+SERVER_PROCESS::ReleaseWindowsAuthToken(
+    WINDOWS_AUTH_TOKEN_CACHE_ENTRY *pEntry,
+    BOOL fConnectionClosed,
+    BOOL fConsumed
+)
+{
+    DBG_ASSERT(m_pWindowsAuthTokenCache != NULL);
+
+    m_pWindowsAuthTokenCache->Release(m_hListeningProcessHandle,
+                                      pEntry,
+                                      fConnectionClosed,
+                                      fConsumed);
+}
+
 HRESULT
 SERVER_PROCESS::SetupStdHandles(
     LPSTARTUPINFOW pStartupInfo
@@ -1012,16 +1391,27 @@ SERVER_PROCESS::SetupStdHandles(
 
     if (!m_fStdoutLogEnabled)
     {
-        CreatePipe(&m_hStdoutHandle, &m_hStdErrWritePipe, &saAttr, 0 /*nSize*/);
+        //
+        // Capture the first 30Kb of output with overlapped reads on the
+        // thread pool rather than a reader thread per process.
+        //
+        m_pStdErrReader = std::make_unique<OverlappedPipeReader>(OnStdErrData, this);
+        hr = m_pStdErrReader->Create(TRUE /*fInheritWritePipe*/, &m_hStdErrWritePipe);
+        if (SUCCEEDED_LOG(hr))
+        {
+            hr = m_pStdErrReader->Start();
+        }
 
-        // Read the stderr handle on a separate thread until we get 30Kb.
-        m_hReadThread = CreateThread(
-            nullptr,       // default security attributes
-            0,          // default stack size
-            reinterpret_cast<LPTHREAD_START_ROUTINE>(ReadStdErrHandle),
-            this,       // thread function arguments
-            0,          // default creation flags
-            nullptr);      // receive thread identifier
+        if (FAILED_LOG(hr))
+        {
+            m_pStdErrReader.reset();
+            if (m_hStdErrWritePipe != INVALID_HANDLE_VALUE)
+            {
+                CloseHandle(m_hStdErrWritePipe);
+            }
+            m_hStdErrWritePipe = NULL;
+            goto Finished;
+        }
 
         pStartupInfo->dwFlags = STARTF_USESTDHANDLES;
         pStartupInfo->hStdInput = INVALID_HANDLE_VALUE;
@@ -1079,7 +1469,7 @@ SERVER_PROCESS::SetupStdHandles(
     pStartupInfo->hStdError = m_hStdoutHandle;
     pStartupInfo->hStdOutput = m_hStdoutHandle;
     // start timer to open and close handles regularly.
-    m_Timer.InitializeTimer(STTIMER::TimerCallback, &m_struFullLogFile, 3000, 3000);
+    LOG_IF_FAILED(m_Timer.Set(3000, 3000));
 
 Finished:
     if (FAILED_LOG(hr))
@@ -1104,55 +1494,40 @@ Finished:
     return hr;
 }
 
-
-void
-SERVER_PROCESS::ReadStdErrHandle(
-    LPVOID pContext
+// static
+VOID
+CALLBACK
+SERVER_PROCESS::LogFileTimerCallback(
+    PVOID       pContext
 )
 {
-    auto pLoggingProvider = static_cast<SERVER_PROCESS*>(pContext);
-    DBG_ASSERT(pLoggingProvider != NULL);
-    pLoggingProvider->ReadStdErrHandleInternal();
+    auto pServerProcess = static_cast<SERVER_PROCESS*>(pContext);
+    STTIMER::TimerCallback(nullptr, &pServerProcess->m_struFullLogFile, nullptr);
 }
 
 void
-SERVER_PROCESS::ReadStdErrHandleInternal()
+SERVER_PROCESS::OnStdErrData(
+    PVOID       pContext,
+    const char *pData,
+    DWORD       cbData
+)
 {
-    const size_t bufferSize = 4096;
-    size_t charactersLeft = 30000;
-    std::string tempBuffer;
+    auto pServerProcess = static_cast<SERVER_PROCESS*>(pContext);
+    DBG_ASSERT(pServerProcess != NULL);
 
-    tempBuffer.resize(bufferSize);
-
-    DWORD dwNumBytesRead = 0;
-    while (charactersLeft > 0)
+    //
+    // Past the first 30Kb the output is still read, otherwise the program
+    // may hang as nothing drains its stdout, but thrown away.
+    //
+    if (pServerProcess->m_cchOutputLeft == 0)
     {
-        if (ReadFile(m_hStdoutHandle,
-            tempBuffer.data(),
-            bufferSize,
-            &dwNumBytesRead,
-            nullptr))
-        {
-            auto text = to_wide_string(tempBuffer, dwNumBytesRead, GetConsoleOutputCP());
-            auto const writeSize = min(charactersLeft, text.size());
-            m_output.write(text.c_str(), writeSize);
-            charactersLeft -= writeSize;
-        }
-        else
-        {
-            return;
-        }
+        return;
     }
 
-    // Continue reading from console out until the program ends or the handle is invalid.
-    // Otherwise, the program may hang as nothing is reading stdout.
-    while (ReadFile(m_hStdoutHandle,
-        tempBuffer.data(),
-        bufferSize,
-        &dwNumBytesRead,
-        nullptr))
-    {
-    }
+    auto text = to_wide_string(std::string_view(pData, cbData), GetConsoleOutputCP());
+    auto const writeSize = min(pServerProcess->m_cchOutputLeft, text.size());
+    pServerProcess->m_output.write(text.c_str(), writeSize);
+    pServerProcess->m_cchOutputLeft -= writeSize;
 }
 
 HRESULT
@@ -1251,63 +1626,95 @@ SERVER_PROCESS::SendSignal(
     VOID
 )
 {
-    HRESULT hr      = S_OK;
-    HANDLE  hThread = NULL;
+    if (BeginSignal())
+    {
+        CompleteSignal();
+    }
+}
+
+BOOL
+SERVER_PROCESS::BeginSignal(
+    VOID
+)
+{
+    StopHealthChecks();
+
+    // Throttled, it would not make the shutdown time limit.
+    ResumeFromIdle();
+
+    if (m_fAttached)
+    {
+        //
+        // The backend belongs to the worker that started it, just stop
+        // watching it.
+        //
+        m_fReady = FALSE;
+        if (InterlockedCompareExchange(&m_lStopping, 1L, 0L) == 0L &&
+            m_hProcessWaitHandle != NULL)
+        {
+            UnregisterWait(m_hProcessWaitHandle);
+            m_hProcessWaitHandle = NULL;
+            DereferenceServerProcess();
+        }
+        return FALSE;
+    }
 
+    // Released by CompleteSignal.
     ReferenceServerProcess();
 
+    m_llShutdownSignaled = QueryTimestamp();
+    m_ullShutdownDeadline = GetTickCount64() + m_dwShutdownTimeLimitInMS;
+
+    TraceLoggingWrite(g_hTraceProvider,
+        "BackendProcessShutdownSignaled",
+        TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+        TraceLoggingKeyword(ASPNETCORE_TRACE_KEYWORD_PROCESS),
+        TraceLoggingWideString(m_struAppFullPath.QueryStr(), "ApplicationPath"),
+        TraceLoggingUInt32(m_dwProcessId, "ProcessId"),
+        TraceLoggingUInt32(m_dwPort, "Port"),
+        TraceLoggingInt32(m_cOutstandingRequests, "OutstandingRequests"),
+        TraceLoggingUInt64(QueryMicrosecondsBetween(m_llListening, m_llShutdownSignaled), "UptimeMicroseconds"));
+
     m_hShutdownHandle = OpenProcess(SYNCHRONIZE | PROCESS_TERMINATE, FALSE, m_dwProcessId);
 
     if (m_hShutdownHandle == NULL)
     {
         // since we cannot open the process. let's terminate the process
-        hr = HRESULT_FROM_WIN32(GetLastError());
-        goto Finished;
+        LOG_IF_FAILED(HRESULT_FROM_WIN32(GetLastError()));
+        TerminateBackendProcess();
+        DereferenceServerProcess();
+        return FALSE;
     }
 
-    hThread = CreateThread(
-        NULL,       // default security attributes
-        0,          // default stack size
-        (LPTHREAD_START_ROUTINE)SendShutDownSignal,
-        this,       // thread function arguments
-        0,          // default creation flags
-        NULL);      // receive thread identifier
-
-    if (hThread == NULL)
+    if (FAILED_LOG(SendShutdownHttpMessage()))
     {
-        hr = HRESULT_FROM_WIN32(GetLastError());
-        goto Finished;
+        SendCtrlSignal();
     }
 
+    return TRUE;
+}
+
+VOID
+SERVER_PROCESS::CompleteSignal(
+    VOID
+)
+{
+    const ULONGLONG ullNow = GetTickCount64();
+    DWORD           dwWaitInMS = ullNow < m_ullShutdownDeadline ? static_cast<DWORD>(m_ullShutdownDeadline - ullNow) : 0;
+
     //
     // Reset the shutdown timeout if debugger is attached.
     // Do it only for the case that debugger is attached during process creation
     // as IsDebuggerIsAttached call is too heavy
     //
-    if (WaitForSingleObject(m_hShutdownHandle, m_fDebuggerAttached ? INFINITE : m_dwShutdownTimeLimitInMS) != WAIT_OBJECT_0)
-    {
-        hr = HRESULT_FROM_WIN32(ERROR_TIMEOUT);
-        goto Finished;
-    }
-    // thread should already exit
-    CloseHandle(hThread);
-    hThread = NULL;
-
-Finished:
-    if (hThread != NULL)
+    if (m_fDebuggerAttached)
     {
-        // if the send shutdown message thread is still running, terminate it
-        DWORD dwThreadStatus = 0;
-        if (GetExitCodeThread(hThread, &dwThreadStatus)!= 0 && dwThreadStatus == STILL_ACTIVE)
-        {
-            TerminateThread(hThread, STATUS_CONTROL_C_EXIT);
-        }
-        CloseHandle(hThread);
-        hThread = NULL;
+        dwWaitInMS = INFINITE;
     }
 
-    if (FAILED_LOG(hr))
+    if (WaitForSingleObject(m_hShutdownHandle, dwWaitInMS) != WAIT_OBJECT_0)
     {
+        LOG_IF_FAILED(HRESULT_FROM_WIN32(ERROR_TIMEOUT));
         TerminateBackendProcess();
     }
 
@@ -1320,6 +1727,45 @@ Finished:
     DereferenceServerProcess();
 }
 
+VOID
+SERVER_PROCESS::DrainAndSendSignal(
+    VOID
+)
+{
+    const ULONGLONG ullDrainStart = GetTickCount64();
+
+    // Failing while draining must not kill it early.
+    StopHealthChecks();
+
+    if (m_cOutstandingRequests > 0)
+    {
+        LOG_INFOF(L"Draining %d requests from process %d on port %d",
+            m_cOutstandingRequests,
+            m_dwProcessId,
+            m_dwPort);
+    }
+
+    //
+    // Polling keeps the request path free of a completion signal. Like
+    // SendSignal, don't time out while a debugger is attached.
+    //
+    while (m_cOutstandingRequests > 0 &&
+        (m_fDebuggerAttached || GetTickCount64() - ullDrainStart < m_dwShutdownTimeLimitInMS))
+    {
+        Sleep(DRAIN_POLL_INTERVAL_MS);
+    }
+
+    if (m_cOutstandingRequests > 0)
+    {
+        LOG_WARNF(L"Process %d still has %d requests after draining for %d ms",
+            m_dwProcessId,
+            m_cOutstandingRequests,
+            m_dwShutdownTimeLimitInMS);
+    }
+
+    SendSignal();
+}
+
 
 //
 // StopProcess is only called if process crashes OR if the process
@@ -1331,9 +1777,28 @@ SERVER_PROCESS::StopProcess(
 )
 {
     m_fReady = FALSE;
+    StopHealthChecks();
+
+    //
+    // The crash of a shared backend is counted by the worker that started
+    // it, there is nothing of ours to stop.
+    //
+    if (m_fAttached)
+    {
+        return;
+    }
 
     m_pProcessManager->IncrementRapidFailCount();
 
+    //
+    // Kill the whole tree at once, without waiting as the process manager
+    // lock may be held.
+    //
+    if (m_hJobObject != NULL)
+    {
+        LOG_IF_FAILED(StopAllProcessesInJobObject(0));
+    }
+
     for (INT i=0; i<MAX_ACTIVE_CHILD_PROCESSES; ++i)
     {
         if (m_hChildProcessHandles[i] != NULL)
@@ -1359,214 +1824,221 @@ SERVER_PROCESS::StopProcess(
     }
 }
 
-BOOL
-SERVER_PROCESS::IsDebuggerIsAttached(
-    VOID
+VOID
+SERVER_PROCESS::ApplyJobNotificationNoLock(
+    DWORD   dwMessage,
+    DWORD   dwProcessId
 )
 {
-    HRESULT                             hr = S_OK;
-    PJOBOBJECT_BASIC_PROCESS_ID_LIST    processList = NULL;
-    DWORD                               dwPid = 0;
-    DWORD                               dwWorkerProcessPid = 0;
-    DWORD                               cbNumBytes = 1024;
-    DWORD                               dwRetries = 0;
-    DWORD                               dwError = NO_ERROR;
-    BOOL                                fDebuggerPresent = FALSE;
-
-    dwWorkerProcessPid = GetCurrentProcessId();
-
-    do
+    switch (dwMessage)
     {
-        dwError = NO_ERROR;
-
-        if (processList != NULL)
+    case JOB_OBJECT_MSG_NEW_PROCESS:
+        for (DWORD i = 0; i < m_cJobProcessIds; ++i)
         {
-            HeapFree(GetProcessHeap(), 0, processList);
-            processList = NULL;
-
-            // resize
-            cbNumBytes = cbNumBytes * 2;
+            if (m_rgJobProcessIds[i] == dwProcessId)
+            {
+                // Already picked up by an enumeration.
+                return;
+            }
         }
 
-        processList = (PJOBOBJECT_BASIC_PROCESS_ID_LIST) HeapAlloc(
-                            GetProcessHeap(),
-                            0,
-                            cbNumBytes
-                            );
-        if (processList == NULL)
+        if (m_cJobProcessIds < MAX_JOB_PROCESS_IDS)
         {
-            hr = E_OUTOFMEMORY;
-            goto Finished;
+            m_rgJobProcessIds[m_cJobProcessIds++] = dwProcessId;
         }
+        else
+        {
+            m_fJobProcessIdsValid = FALSE;
+        }
+        break;
 
-        RtlZeroMemory(processList, cbNumBytes);
-
-        if (!QueryInformationJobObject(
-                m_hJobObject,
-                JobObjectBasicProcessIdList,
-                processList,
-                cbNumBytes,
-                NULL))
+    case JOB_OBJECT_MSG_EXIT_PROCESS:
+    case JOB_OBJECT_MSG_ABNORMAL_EXIT_PROCESS:
+        for (DWORD i = 0; i < m_cJobProcessIds; ++i)
         {
-            dwError = GetLastError();
-            if (dwError != ERROR_MORE_DATA)
+            if (m_rgJobProcessIds[i] == dwProcessId)
             {
-                hr = HRESULT_FROM_WIN32(dwError);
-                goto Finished;
+                m_rgJobProcessIds[i] = m_rgJobProcessIds[--m_cJobProcessIds];
+                break;
             }
         }
+        break;
 
-    } while (dwRetries++ < 5 &&
-             processList != NULL &&
-             (processList->NumberOfAssignedProcesses > processList->NumberOfProcessIdsInList ||
-              processList->NumberOfProcessIdsInList == 0));
+    case JOB_OBJECT_MSG_ACTIVE_PROCESS_ZERO:
+        m_cJobProcessIds = 0;
+        break;
 
-    if (dwError == ERROR_MORE_DATA)
-    {
-        hr = E_OUTOFMEMORY;
-        // some error
-        goto Finished;
+    default:
+        break;
     }
+}
+
+HRESULT
+SERVER_PROCESS::EnumerateJobProcessIdsNoLock(
+    VOID
+)
+{
+    struct
+    {
+        JOBOBJECT_BASIC_PROCESS_ID_LIST list;
+        ULONG_PTR                       rgMoreProcessIds[MAX_JOB_PROCESS_IDS - 1];
+    } processList = {};
 
-    if (processList == NULL ||
-        (processList->NumberOfAssignedProcesses > processList->NumberOfProcessIdsInList ||
-        processList->NumberOfProcessIdsInList == 0))
+    m_fJobProcessIdsValid = FALSE;
+
+    if (!QueryInformationJobObject(
+            m_hJobObject,
+            JobObjectBasicProcessIdList,
+            &processList,
+            sizeof processList,
+            NULL))
     {
-        hr = HRESULT_FROM_WIN32(ERROR_PROCESS_ABORTED);
-        // some error
-        goto Finished;
+        DWORD dwError = GetLastError();
+        if (dwError != ERROR_MORE_DATA)
+        {
+            return HRESULT_FROM_WIN32(dwError);
+        }
     }
 
-    if (processList->NumberOfProcessIdsInList > MAX_ACTIVE_CHILD_PROCESSES)
+    if (processList.list.NumberOfAssignedProcesses > processList.list.NumberOfProcessIdsInList)
     {
-        hr = HRESULT_FROM_WIN32(ERROR_CREATE_FAILED);
-        goto Finished;
+        return HRESULT_FROM_WIN32(ERROR_CREATE_FAILED);
     }
 
-    for (DWORD i=0; i<processList->NumberOfProcessIdsInList; i++)
+    m_cJobProcessIds = processList.list.NumberOfProcessIdsInList;
+    for (DWORD i = 0; i < m_cJobProcessIds; ++i)
     {
-        dwPid = (DWORD)processList->ProcessIdList[i];
-        if (dwPid != dwWorkerProcessPid)
-        {
-            HANDLE hProcess = OpenProcess(
-                    PROCESS_QUERY_INFORMATION | SYNCHRONIZE | PROCESS_TERMINATE | PROCESS_DUP_HANDLE,
-                    FALSE,
-                    dwPid);
+        m_rgJobProcessIds[i] = static_cast<DWORD>(processList.list.ProcessIdList[i]);
+    }
 
-            BOOL returnValue = CheckRemoteDebuggerPresent(hProcess, &fDebuggerPresent);
-            if (hProcess != NULL)
-            {
-                CloseHandle(hProcess);
-                hProcess = NULL;
-            }
+    //
+    // Without notifications the list is stale as soon as it is read.
+    //
+    m_fJobProcessIdsValid = m_ulJobNotificationKey != 0;
+    return S_OK;
+}
 
-            if (!returnValue)
-            {
-                goto Finished;
-            }
+HRESULT
+SERVER_PROCESS::GetJobProcessIds(
+    _Out_writes_to_(cMaxProcessIds, *pcProcessIds) DWORD  *rgProcessIds,
+    DWORD                                                   cMaxProcessIds,
+    _Out_ DWORD                                            *pcProcessIds
+)
+/*++
 
-            if (fDebuggerPresent)
-            {
-                break;
-            }
+Routine Description:
+
+    Copy the ids of the processes in the job. The cached list is kept up to
+    date by the dispatcher of JOB_NOTIFICATION_PORT; as the OS does not
+    guarantee the delivery of job notifications, the cached count is checked
+    against the job accounting and the job is only enumerated again when
+    they disagree.
+
+--*/
+{
+    *pcProcessIds = 0;
+
+    if (m_hJobObject == NULL)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_HANDLE);
+    }
+
+    SRWExclusiveLock lock(m_srwJobProcessLock);
+
+    JOBOBJECT_BASIC_ACCOUNTING_INFORMATION accountingInfo = {};
+    if (!m_fJobProcessIdsValid ||
+        !QueryInformationJobObject(
+            m_hJobObject,
+            JobObjectBasicAccountingInformation,
+            &accountingInfo,
+            sizeof accountingInfo,
+            NULL) ||
+        accountingInfo.ActiveProcesses != m_cJobProcessIds)
+    {
+        HRESULT hr = EnumerateJobProcessIdsNoLock();
+        if (FAILED(hr))
+        {
+            return hr;
         }
     }
 
-Finished:
+    if (m_cJobProcessIds > cMaxProcessIds)
+    {
+        return HRESULT_FROM_WIN32(ERROR_CREATE_FAILED);
+    }
 
-    if (processList != NULL)
+    for (DWORD i = 0; i < m_cJobProcessIds; ++i)
     {
-        HeapFree(GetProcessHeap(), 0, processList);
+        rgProcessIds[i] = m_rgJobProcessIds[i];
     }
+    *pcProcessIds = m_cJobProcessIds;
 
-    return fDebuggerPresent;
+    return S_OK;
 }
 
-HRESULT
-SERVER_PROCESS::GetChildProcessHandles(
+BOOL
+SERVER_PROCESS::IsDebuggerIsAttached(
     VOID
 )
 {
-    HRESULT                             hr = S_OK;
-    PJOBOBJECT_BASIC_PROCESS_ID_LIST    processList = NULL;
-    DWORD                               dwPid = 0;
-    DWORD                               dwWorkerProcessPid = 0;
-    DWORD                               cbNumBytes = 1024;
-    DWORD                               dwRetries = 0;
-    DWORD                               dwError = NO_ERROR;
-
-    dwWorkerProcessPid = GetCurrentProcessId();
+    DWORD   rgProcessIds[MAX_ACTIVE_CHILD_PROCESSES];
+    DWORD   cProcessIds = 0;
+    DWORD   dwWorkerProcessPid = GetCurrentProcessId();
+    BOOL    fDebuggerPresent = FALSE;
 
-    do
+    if (FAILED(GetJobProcessIds(rgProcessIds, MAX_ACTIVE_CHILD_PROCESSES, &cProcessIds)))
     {
-        dwError = NO_ERROR;
-
-        if (processList != NULL)
-        {
-            HeapFree(GetProcessHeap(), 0, processList);
-            processList = NULL;
-
-            // resize
-            cbNumBytes = cbNumBytes * 2;
-        }
+        return FALSE;
+    }
 
-        processList = (PJOBOBJECT_BASIC_PROCESS_ID_LIST) HeapAlloc(
-                            GetProcessHeap(),
-                            0,
-                            cbNumBytes
-                            );
-        if (processList == NULL)
+    for (DWORD i = 0; i < cProcessIds; i++)
+    {
+        if (rgProcessIds[i] != dwWorkerProcessPid)
         {
-            hr = E_OUTOFMEMORY;
-            goto Finished;
-        }
+            HANDLE hProcess = OpenProcess(
+                    PROCESS_QUERY_INFORMATION | SYNCHRONIZE | PROCESS_TERMINATE | PROCESS_DUP_HANDLE,
+                    FALSE,
+                    rgProcessIds[i]);
 
-        RtlZeroMemory(processList, cbNumBytes);
+            BOOL returnValue = CheckRemoteDebuggerPresent(hProcess, &fDebuggerPresent);
+            if (hProcess != NULL)
+            {
+                CloseHandle(hProcess);
+                hProcess = NULL;
+            }
 
-        if (!QueryInformationJobObject(
-                m_hJobObject,
-                JobObjectBasicProcessIdList,
-                processList,
-                cbNumBytes,
-                NULL))
-        {
-            dwError = GetLastError();
-            if (dwError != ERROR_MORE_DATA)
+            if (!returnValue || fDebuggerPresent)
             {
-                hr = HRESULT_FROM_WIN32(dwError);
-                goto Finished;
+                break;
             }
         }
+    }
 
-    } while (dwRetries++ < 5 &&
-             processList != NULL &&
-             (processList->NumberOfAssignedProcesses > processList->NumberOfProcessIdsInList || processList->NumberOfProcessIdsInList == 0));
+    return fDebuggerPresent;
+}
 
-    if (dwError == ERROR_MORE_DATA)
-    {
-        hr = E_OUTOFMEMORY;
-        // some error
-        goto Finished;
-    }
+HRESULT
+SERVER_PROCESS::GetChildProcessHandles(
+    VOID
+)
+{
+    DWORD   rgProcessIds[MAX_ACTIVE_CHILD_PROCESSES];
+    DWORD   cProcessIds = 0;
+    DWORD   dwWorkerProcessPid = GetCurrentProcessId();
 
-    if (processList == NULL || (processList->NumberOfAssignedProcesses > processList->NumberOfProcessIdsInList || processList->NumberOfProcessIdsInList == 0))
-    {
-        hr = HRESULT_FROM_WIN32(ERROR_PROCESS_ABORTED);
-        // some error
-        goto Finished;
-    }
+    RETURN_IF_FAILED(GetJobProcessIds(rgProcessIds, MAX_ACTIVE_CHILD_PROCESSES, &cProcessIds));
 
-    if (processList->NumberOfProcessIdsInList > MAX_ACTIVE_CHILD_PROCESSES)
+    if (cProcessIds == 0)
     {
-        hr = HRESULT_FROM_WIN32(ERROR_CREATE_FAILED);
-        goto Finished;
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_PROCESS_ABORTED));
     }
 
-    for (DWORD i=0; i<processList->NumberOfProcessIdsInList; i++)
+    for (DWORD i = 0; i < cProcessIds; i++)
     {
-        dwPid = (DWORD)processList->ProcessIdList[i];
+        DWORD dwPid = rgProcessIds[i];
         if (dwPid != m_dwProcessId &&
-            dwPid != dwWorkerProcessPid )
+            dwPid != dwWorkerProcessPid &&
+            m_cChildProcess < MAX_ACTIVE_CHILD_PROCESSES)
         {
             m_hChildProcessHandles[m_cChildProcess] = OpenProcess(
                                             PROCESS_QUERY_INFORMATION | SYNCHRONIZE | PROCESS_TERMINATE | PROCESS_DUP_HANDLE,
@@ -1578,138 +2050,128 @@ SERVER_PROCESS::GetChildProcessHandles(
         }
     }
 
-Finished:
-
-    if (processList != NULL)
-    {
-        HeapFree(GetProcessHeap(), 0, processList);
-    }
-
-    return hr;
+    return S_OK;
 }
 
 HRESULT
 SERVER_PROCESS::StopAllProcessesInJobObject(
-        VOID
+    DWORD   dwWaitTimeoutInMS
 )
+/*++
+
+Routine Description:
+
+    Terminate the whole process tree of the backend with one call and wait
+    up to dwWaitTimeoutInMS for every process of it to exit, woken up by
+    the job notifications rather than waiting on the processes one by one.
+
+--*/
 {
-    HRESULT                             hr = S_OK;
-    PJOBOBJECT_BASIC_PROCESS_ID_LIST    processList = NULL;
-    HANDLE                              hProcess = NULL;
-    DWORD                               dwWorkerProcessPid = 0;
-    DWORD                               cbNumBytes = 1024;
-    DWORD                               dwRetries = 0;
+    if (m_hJobObject == NULL)
+    {
+        return S_OK;
+    }
 
-    dwWorkerProcessPid = GetCurrentProcessId();
+    RETURN_LAST_ERROR_IF(!TerminateJobObject(m_hJobObject, 1));
 
-    do
+    if (dwWaitTimeoutInMS == 0)
     {
-        if (processList != NULL)
-        {
-            HeapFree(GetProcessHeap(), 0, processList);
-            processList = NULL;
+        return S_OK;
+    }
 
-            // resize
-            cbNumBytes = cbNumBytes * 2;
-        }
+    const ULONGLONG ullDeadline = GetTickCount64() + dwWaitTimeoutInMS;
+    SRWExclusiveLock lock(m_srwJobProcessLock);
 
-        processList = (PJOBOBJECT_BASIC_PROCESS_ID_LIST) HeapAlloc(
-                            GetProcessHeap(),
-                            0,
-                            cbNumBytes
-                            );
-        if (processList == NULL)
+    for (;;)
+    {
+        JOBOBJECT_BASIC_ACCOUNTING_INFORMATION accountingInfo = {};
+        RETURN_LAST_ERROR_IF(!QueryInformationJobObject(
+            m_hJobObject,
+            JobObjectBasicAccountingInformation,
+            &accountingInfo,
+            sizeof accountingInfo,
+            NULL));
+
+        if (accountingInfo.ActiveProcesses == 0)
         {
-            hr = E_OUTOFMEMORY;
-            goto Finished;
+            m_cJobProcessIds = 0;
+            return S_OK;
         }
 
-        RtlZeroMemory(processList, cbNumBytes);
-
-        if (!QueryInformationJobObject(
-                m_hJobObject,
-                JobObjectBasicProcessIdList,
-                processList,
-                cbNumBytes,
-                NULL))
+        const ULONGLONG ullNow = GetTickCount64();
+        if (ullNow >= ullDeadline)
         {
-            DWORD dwError = GetLastError();
-            if (dwError != ERROR_MORE_DATA)
-            {
-                hr = HRESULT_FROM_WIN32(dwError);
-                goto Finished;
-            }
+            RETURN_HR(HRESULT_FROM_WIN32(ERROR_TIMEOUT));
         }
 
-    } while (dwRetries++ < 5 &&
-             processList != NULL &&
-             (processList->NumberOfAssignedProcesses > processList->NumberOfProcessIdsInList || processList->NumberOfProcessIdsInList == 0));
-
-    if (processList == NULL || (processList->NumberOfAssignedProcesses > processList->NumberOfProcessIdsInList || processList->NumberOfProcessIdsInList == 0))
-    {
-        hr = HRESULT_FROM_WIN32(ERROR_NOT_ENOUGH_MEMORY);
-        // some error
-        goto Finished;
-    }
-
-    for (DWORD i=0; i<processList->NumberOfProcessIdsInList; i++)
-    {
-        if (dwWorkerProcessPid != (DWORD)processList->ProcessIdList[i])
+        const DWORD dwWait = static_cast<DWORD>(ullDeadline - ullNow);
+        if (m_ulJobNotificationKey != 0)
         {
-            hProcess = OpenProcess(PROCESS_TERMINATE,
-                                   FALSE,
-                                   (DWORD)processList->ProcessIdList[i]);
-            if (hProcess != NULL)
-            {
-                if (!TerminateProcess(hProcess, 1))
-                {
-                    hr = HRESULT_FROM_WIN32(GetLastError());
-                }
-                else
-                {
-                    WaitForSingleObject(hProcess, INFINITE);
-                }
-
-                if (hProcess != NULL)
-                {
-                    CloseHandle(hProcess);
-                    hProcess = NULL;
-                }
-            }
+            // Releases the lock for OnJobNotification, which wakes it up.
+            SleepConditionVariableSRW(&m_cvJobProcesses, &m_srwJobProcessLock, dwWait, 0);
+        }
+        else
+        {
+            Sleep(min(dwWait, JOB_TERMINATE_POLL_INTERVAL_MS));
         }
     }
-
-Finished:
-
-    if (processList != NULL)
-    {
-        HeapFree(GetProcessHeap(), 0, processList);
-    }
-
-    return hr;
 }
 
 SERVER_PROCESS::SERVER_PROCESS() :
     m_cRefs(1),
+    m_cOutstandingRequests(0),
     m_hProcessHandle(NULL),
     m_hProcessWaitHandle(NULL),
     m_dwProcessId(0),
     m_cChildProcess(0),
     m_fReady(FALSE),
     m_lStopping(0L),
+    m_lFirstRequestForwarded(0L),
+    m_llStartRequested(0),
+    m_llProcessCreated(0),
+    m_llListening(0),
+    m_llShutdownSignaled(0),
     m_hStdoutHandle(NULL),
     m_fStdoutLogEnabled(FALSE),
     m_hJobObject(NULL),
+    m_ulJobNotificationKey(0),
+    m_cJobProcessIds(0),
+    m_fJobProcessIdsValid(FALSE),
+    m_fExitWatched(FALSE),
+    m_fProcessExited(FALSE),
+    m_fMemoryLimitReported(FALSE),
     m_pForwarderConnection(NULL),
+    m_pPriorityConnection(NULL),
+    m_fReservePriorityConnection(FALSE),
+    m_fAttached(FALSE),
+    m_fRequestDelegation(FALSE),
+    m_Timer(LogFileTimerCallback, this),
+    m_healthCheckTimer(HealthCheckTimerCallback, this),
+    m_dwHealthCheckIntervalInMS(0),
+    m_dwHealthCheckTimeoutInMS(0),
+    m_dwHealthCheckUnhealthyThreshold(0),
+    m_cHealthCheckFailures(0),
+    m_lHealthCheckInFlight(0),
+    m_pLoopbackClient(NULL),
+    m_dwOutlierFailures(0),
+    m_cConsecutiveFailures(0),
+    m_lEjected(0),
+    m_lIdleSuspended(0),
     m_dwListeningProcessId(0),
     m_hListeningProcessHandle(NULL),
     m_hShutdownHandle(NULL),
+    m_ullShutdownDeadline(0),
     m_hStdErrWritePipe(NULL),
-    m_hReadThread(nullptr),
-    m_randomGenerator(std::random_device()())
+    m_hReadyEvent(NULL),
+    m_cchOutputLeft(MAX_CAPTURED_OUTPUT_CHARS),
+    m_fPortAcquired(FALSE)
 {
     //InterlockedIncrement(&g_dwActiveServerProcesses);
 
+    InitializeSRWLock(&m_srwJobProcessLock);
+    InitializeConditionVariable(&m_cvJobProcesses);
+    InitializeSRWLock(&m_srwIdleLock);
+
     for (INT i=0; i<MAX_ACTIVE_CHILD_PROCESSES; ++i)
     {
         m_dwChildProcessIds[i] = 0;
@@ -1721,6 +2183,13 @@ SERVER_PROCESS::SERVER_PROCESS() :
 VOID
 SERVER_PROCESS::CleanUp()
 {
+    // First, no notification may reach the object from here on.
+    if (m_ulJobNotificationKey != 0)
+    {
+        JOB_NOTIFICATION_PORT::Disassociate(m_ulJobNotificationKey);
+        m_ulJobNotificationKey = 0;
+    }
+
     if (m_hProcessWaitHandle != NULL)
     {
         UnregisterWait(m_hProcessWaitHandle);
@@ -1750,11 +2219,21 @@ SERVER_PROCESS::CleanUp()
     {
         if (m_hListeningProcessHandle != INVALID_HANDLE_VALUE)
         {
+            if (m_pWindowsAuthTokenCache != NULL)
+            {
+                m_pWindowsAuthTokenCache->Clear(m_hListeningProcessHandle);
+            }
             CloseHandle(m_hListeningProcessHandle);
         }
         m_hListeningProcessHandle = NULL;
     }
 
+    if (m_hReadyEvent != NULL)
+    {
+        CloseHandle(m_hReadyEvent);
+        m_hReadyEvent = NULL;
+    }
+
     for (INT i = 0; i<MAX_ACTIVE_CHILD_PROCESSES; ++i)
     {
         if (m_hChildProcessHandles[i] != NULL)
@@ -1784,17 +2263,37 @@ SERVER_PROCESS::CleanUp()
         m_pForwarderConnection = NULL;
     }
 
+    if (m_pPriorityConnection != NULL)
+    {
+        m_pPriorityConnection->DereferenceForwarderConnection();
+        m_pPriorityConnection = NULL;
+    }
+
+    // The backend is gone, or never started listening.
+    ReleasePort();
 }
 
-SERVER_PROCESS::~SERVER_PROCESS()
+VOID
+SERVER_PROCESS::ReleasePort()
 {
-    DWORD    dwThreadStatus = 0;
+    if (m_fPortAcquired)
+    {
+        PORT_ALLOCATOR::Release(m_dwPort);
+        m_fPortAcquired = FALSE;
+    }
+}
 
+SERVER_PROCESS::~SERVER_PROCESS()
+{
     CleanUp();
 
-    // no need to free m_pEnvironmentVarTable, as it references to
-    // the same hash table hold by configuration.
-    // the hashtable memory will be freed once onfiguration got recycled
+    // No probe is in flight, each holds a reference.
+    if (m_pLoopbackClient != NULL)
+    {
+        m_pLoopbackClient->Shutdown();
+        m_pLoopbackClient->DereferenceLoopbackHttpClient();
+        m_pLoopbackClient = NULL;
+    }
 
     if (m_pProcessManager != NULL)
     {
@@ -1813,36 +2312,13 @@ SERVER_PROCESS::~SERVER_PROCESS()
         m_hStdErrWritePipe = NULL;
     }
 
-    // Forces ReadFile to cancel, causing the read loop to complete.
-    // Don't check return value as IO may or may not be completed already.
-    if (m_hReadThread != nullptr)
+    // Cancels the outstanding pipe read, the reader does not touch this
+    // object anymore once Stop returns.
+    if (m_pStdErrReader != nullptr)
     {
         LOG_INFO(L"Canceling standard stream pipe reader.");
-        CancelSynchronousIo(m_hReadThread);
-    }
-
-    // GetExitCodeThread returns 0 on failure; thread status code is invalid.
-    if (m_hReadThread != nullptr &&
-        !LOG_LAST_ERROR_IF(!GetExitCodeThread(m_hReadThread, &dwThreadStatus)) &&
-        dwThreadStatus == STILL_ACTIVE)
-    {
-        // Wait for graceful shutdown, i.e., the exit of the background thread or timeout
-        if (WaitForSingleObject(m_hReadThread, PIPE_OUTPUT_THREAD_TIMEOUT) != WAIT_OBJECT_0)
-        {
-            // If the thread is still running, we need kill it first before exit to avoid AV
-            if (!LOG_LAST_ERROR_IF(GetExitCodeThread(m_hReadThread, &dwThreadStatus) == 0) &&
-                dwThreadStatus == STILL_ACTIVE)
-            {
-                LOG_WARN(L"Thread reading stdout/err hit timeout, forcibly closing thread.");
-                TerminateThread(m_hReadThread, STATUS_CONTROL_C_EXIT);
-            }
-        }
-    }
-
-    if (m_hReadThread != nullptr)
-    {
-        CloseHandle(m_hReadThread);
-        m_hReadThread = nullptr;
+        m_pStdErrReader->Stop(0);
+        m_pStdErrReader.reset();
     }
 
     if (m_hStdoutHandle != NULL)
@@ -1856,9 +2332,11 @@ SERVER_PROCESS::~SERVER_PROCESS()
 
     if (m_fStdoutLogEnabled)
     {
-        m_Timer.CancelTimer();
+        m_Timer.Cancel();
     }
 
+    m_healthCheckTimer.Cancel();
+
     if (!m_fStdoutLogEnabled && !m_struFullLogFile.IsEmpty())
     {
         WIN32_FIND_DATA fileData;
@@ -1929,108 +2407,353 @@ Finished:
     return hr;
 }
 
-VOID
-SERVER_PROCESS::HandleProcessExit( VOID )
+HRESULT
+SERVER_PROCESS::WatchProcessExit(
+    PHANDLE                 phWaitHandle,
+    HANDLE                  hProcessToWatch
+)
 {
-    BOOL        fReady = FALSE;
-    DWORD       dwProcessId = 0;
+    if (m_ulJobNotificationKey == 0)
+    {
+        return RegisterProcessWait(phWaitHandle, hProcessToWatch);
+    }
 
-    if (InterlockedCompareExchange(&m_lStopping, 1L, 0L) == 0L)
     {
-        CheckIfServerIsUp(m_dwPort, &dwProcessId, &fReady);
+        SRWExclusiveLock lock(m_srwJobProcessLock);
 
-        if (!fReady)
+        if (m_fExitWatched)
+        {
+            return S_OK;
+        }
+
+        if (!m_fProcessExited)
+        {
+            // dispatcher will dereference.
+            ReferenceServerProcess();
+            m_fExitWatched = TRUE;
+            return S_OK;
+        }
+    }
+
+    //
+    // Its notification came before the watch, the handle is or is about to
+    // be signaled and the wait handles the exit as it always did.
+    //
+    return RegisterProcessWait(phWaitHandle, hProcessToWatch);
+}
+
+BOOL
+SERVER_PROCESS::OnJobNotification(
+    DWORD   dwMessage,
+    DWORD   dwProcessId
+)
+{
+    SRWExclusiveLock lock(m_srwJobProcessLock);
+
+    ApplyJobNotificationNoLock(dwMessage, dwProcessId);
+    WakeAllConditionVariable(&m_cvJobProcesses);
+
+    switch (dwMessage)
+    {
+    case JOB_OBJECT_MSG_JOB_MEMORY_LIMIT:
+    case JOB_OBJECT_MSG_PROCESS_MEMORY_LIMIT:
+        TraceLoggingWrite(g_hTraceProvider,
+            "BackendProcessMemoryLimit",
+            TraceLoggingLevel(WINEVENT_LEVEL_WARNING),
+            TraceLoggingKeyword(ASPNETCORE_TRACE_KEYWORD_PROCESS),
+            TraceLoggingWideString(m_struAppFullPath.QueryStr(), "ApplicationPath"),
+            TraceLoggingUInt32(m_dwProcessId, "ProcessId"),
+            TraceLoggingUInt32(dwProcessId, "LimitedProcessId"),
+            TraceLoggingUInt32(m_resourceLimits.dwMemoryLimitInMB, "MemoryLimitInMB"));
+
+        // Every failed allocation is reported, the event log gets the first.
+        if (!m_fMemoryLimitReported)
         {
-            EventLog::Info(
-                ASPNETCORE_EVENT_PROCESS_SHUTDOWN,
-                ASPNETCORE_EVENT_PROCESS_SHUTDOWN_MSG,
+            m_fMemoryLimitReported = TRUE;
+            EventLog::Warn(
+                ASPNETCORE_EVENT_PROCESS_MEMORY_LIMIT,
+                ASPNETCORE_EVENT_PROCESS_MEMORY_LIMIT_MSG,
                 m_struAppFullPath.QueryStr(),
                 m_struPhysicalPath.QueryStr(),
-                m_dwProcessId,
-                m_dwPort);
+                dwProcessId,
+                m_resourceLimits.dwMemoryLimitInMB);
+        }
+        return FALSE;
 
-            m_pProcessManager->ShutdownProcess(this);
+    case JOB_OBJECT_MSG_EXIT_PROCESS:
+    case JOB_OBJECT_MSG_ABNORMAL_EXIT_PROCESS:
+        if (dwProcessId != m_dwProcessId &&
+            dwProcessId != m_dwListeningProcessId)
+        {
+            return FALSE;
         }
+        break;
 
-        DereferenceServerProcess();
+    case JOB_OBJECT_MSG_ACTIVE_PROCESS_ZERO:
+        break;
+
+    default:
+        return FALSE;
+    }
+
+    m_fProcessExited = TRUE;
+
+    return m_fExitWatched &&
+        InterlockedCompareExchange(&m_lStopping, 1L, 0L) == 0L;
+}
+
+VOID
+SERVER_PROCESS::HandleProcessExit( VOID )
+{
+    if (InterlockedCompareExchange(&m_lStopping, 1L, 0L) == 0L)
+    {
+        CompleteProcessExit();
     }
 }
 
-HRESULT
-SERVER_PROCESS::SendShutdownHttpMessage( VOID )
+VOID
+SERVER_PROCESS::CompleteProcessExit( VOID )
 {
-    HRESULT    hr = S_OK;
-    HINTERNET  hSession = NULL;
-    HINTERNET  hConnect = NULL;
-    HINTERNET  hRequest = NULL;
+    BOOL        fReady = FALSE;
+    DWORD       dwProcessId = 0;
 
-    STACK_STRU(strHeaders, 256);
-    STRU       strAppToken;
-    STRU       strUrl;
-    DWORD      dwStatusCode = 0;
-    DWORD      dwSize = sizeof(dwStatusCode);
+    TraceProcessExit(FALSE);
 
-    hSession = WinHttpOpen(L"",
-        WINHTTP_ACCESS_TYPE_DEFAULT_PROXY,
-        WINHTTP_NO_PROXY_NAME,
-        WINHTTP_NO_PROXY_BYPASS,
-        0);
+    CheckIfServerIsUp(m_dwPort, &dwProcessId, &fReady);
 
-    if (hSession == NULL)
+    if (!fReady)
     {
-        hr = HRESULT_FROM_WIN32(GetLastError());
-        goto Finished;
+        EventLog::Info(
+            ASPNETCORE_EVENT_PROCESS_SHUTDOWN,
+            ASPNETCORE_EVENT_PROCESS_SHUTDOWN_MSG,
+            m_struAppFullPath.QueryStr(),
+            m_struPhysicalPath.QueryStr(),
+            m_dwProcessId,
+            m_dwPort);
+
+        m_pProcessManager->ShutdownProcess(this);
     }
 
-    hConnect = WinHttpConnect(hSession,
-        L"127.0.0.1",
-        (USHORT)m_dwPort,
-        0);
+    DereferenceServerProcess();
+}
+
+HRESULT
+SERVER_PROCESS::SendShutdownHttpMessage( VOID )
+{
+    HRESULT    hr = S_OK;
+    STACK_STRA(straPath, 256);
+    STACK_STRA(straHeaders, 256);
+
+    RETURN_IF_FAILED(EnsureLoopbackClient());
 
-    if (hConnect == NULL)
-    {
-        hr = HRESULT_FROM_WIN32(GetLastError());
-        goto Finished;
-    }
     if (m_struAppVirtualPath.QueryCCH() > 1)
     {
         // app path size is 1 means site root, i.e., "/"
         // we don't want to add duplicated '/' to the request url
         // otherwise the request will fail
-        strUrl.Copy(m_struAppVirtualPath);
+        RETURN_IF_FAILED(straPath.CopyW(m_struAppVirtualPath.QueryStr()));
     }
-    strUrl.Append(L"/iisintegration");
+    RETURN_IF_FAILED(straPath.Append("/iisintegration"));
 
-    hRequest = WinHttpOpenRequest(hConnect,
-        L"POST",
-        strUrl.QueryStr(),
-        NULL,
-        WINHTTP_NO_REFERER,
-        NULL,
-        0);
+    // set up the shutdown headers
+    RETURN_IF_FAILED(straHeaders.Copy("MS-ASPNETCORE-EVENT: shutdown\r\n"
+        "Content-Length: 0\r\n"
+        "MS-ASPNETCORE-TOKEN: "));
+    RETURN_IF_FAILED(straHeaders.Append(m_straGuid));
+    RETURN_IF_FAILED(straHeaders.Append("\r\n"));
 
-    if (hRequest == NULL)
+    // Held by the message until its completion returns.
+    ReferenceServerProcess();
+
+    if (FAILED_LOG(hr = m_pLoopbackClient->SendRequest("POST",
+        straPath.QueryStr(),
+        straHeaders.QueryStr(),
+        m_dwShutdownTimeLimitInMS,
+        OnShutdownMessageCompleted,
+        this)))
     {
-        hr = HRESULT_FROM_WIN32(GetLastError());
-        goto Finished;
+        DereferenceServerProcess();
+    }
+
+    return hr;
+}
+
+HRESULT
+SERVER_PROCESS::EnsureLoopbackClient(
+    VOID
+)
+{
+    HRESULT                 hr = S_OK;
+    LOOPBACK_HTTP_CLIENT   *pClient = NULL;
+
+    if (m_pLoopbackClient != NULL)
+    {
+        return S_OK;
+    }
+
+    pClient = new LOOPBACK_HTTP_CLIENT();
+    if (pClient == NULL)
+    {
+        RETURN_HR(E_OUTOFMEMORY);
+    }
+
+    if (FAILED_LOG(hr = pClient->Initialize(m_dwPort)))
+    {
+        pClient->DereferenceLoopbackHttpClient();
+        return hr;
+    }
+
+    // The probes and the shutdown may race to create it.
+    if (InterlockedCompareExchangePointer(reinterpret_cast<PVOID*>(&m_pLoopbackClient), pClient, NULL) != NULL)
+    {
+        pClient->DereferenceLoopbackHttpClient();
+    }
+
+    return S_OK;
+}
+
+// static
+VOID
+SERVER_PROCESS::OnShutdownMessageCompleted(
+    PVOID       pContext,
+    HRESULT     hr,
+    DWORD       dwStatusCode
+)
+{
+    SERVER_PROCESS *pServerProcess = static_cast<SERVER_PROCESS*>(pContext);
+
+    if (SUCCEEDED(hr))
+    {
+        // log
+        EventLog::Info(
+            ASPNETCORE_EVENT_SENT_SHUTDOWN_HTTP_REQUEST,
+            ASPNETCORE_EVENT_SENT_SHUTDOWN_HTTP_REQUEST_MSG,
+            pServerProcess->m_dwProcessId,
+            dwStatusCode);
+
+        if (dwStatusCode != 202)
+        {
+            // not expected http status
+            hr = E_FAIL;
+        }
+    }
+
+    if (FAILED_LOG(hr))
+    {
+        pServerProcess->SendCtrlSignal();
+    }
+
+    pServerProcess->DereferenceServerProcess();
+}
+
+HRESULT
+SERVER_PROCESS::SendWarmupRequest(
+    _In_ PCWSTR pszWarmupUrl
+)
+/*++
+
+Routine Description:
+
+    Issue a synchronous GET for pszWarmupUrl (relative to the application
+    virtual path) so that a standby process has JITted the hot path before
+    it is promoted. Any HTTP response counts as success.
+
+--*/
+{
+    DWORD dwStatusCode = 0;
+
+    return SendLocalGetRequest(pszWarmupUrl, m_dwStartupTimeLimitInMS, &dwStatusCode);
+}
+
+HRESULT
+SERVER_PROCESS::SendLocalGetRequest(
+    _In_ PCWSTR pszPath,
+    DWORD dwTimeoutInMS,
+    _Out_ DWORD * pdwStatusCode
+)
+{
+    HRESULT    hr = S_OK;
+    HINTERNET  hSession = NULL;
+    HINTERNET  hConnect = NULL;
+    HINTERNET  hRequest = NULL;
+
+    DWORD      cbStatusCode = sizeof(*pdwStatusCode);
+
+    STACK_STRU(strHeaders, 256);
+    STRU       strUrl;
+
+    *pdwStatusCode = 0;
+
+    hSession = WinHttpOpen(L"",
+        WINHTTP_ACCESS_TYPE_NO_PROXY,
+        WINHTTP_NO_PROXY_NAME,
+        WINHTTP_NO_PROXY_BYPASS,
+        0);
+
+    if (hSession == NULL)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    hConnect = WinHttpConnect(hSession,
+        L"127.0.0.1",
+        (USHORT)m_dwPort,
+        0);
+
+    if (hConnect == NULL)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    if (m_struAppVirtualPath.QueryCCH() > 1)
+    {
+        // app path size is 1 means site root, i.e., "/"
+        if (FAILED_LOG(hr = strUrl.Copy(m_struAppVirtualPath)))
+        {
+            goto Finished;
+        }
+    }
+
+    if (pszPath[0] != L'/' &&
+        FAILED_LOG(hr = strUrl.Append(L"/")))
+    {
+        goto Finished;
+    }
+
+    if (FAILED_LOG(hr = strUrl.Append(pszPath)))
+    {
+        goto Finished;
+    }
+
+    hRequest = WinHttpOpenRequest(hConnect,
+        L"GET",
+        strUrl.QueryStr(),
+        NULL,
+        WINHTTP_NO_REFERER,
+        NULL,
+        0);
+
+    if (hRequest == NULL)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
     }
 
-    // set timeout
     if (!WinHttpSetTimeouts(hRequest,
-        m_dwShutdownTimeLimitInMS,  // dwResolveTimeout
-        m_dwShutdownTimeLimitInMS,  // dwConnectTimeout
-        m_dwShutdownTimeLimitInMS,  // dwSendTimeout
-        m_dwShutdownTimeLimitInMS)) // dwReceiveTimeout
+        dwTimeoutInMS,  // dwResolveTimeout
+        dwTimeoutInMS,  // dwConnectTimeout
+        dwTimeoutInMS,  // dwSendTimeout
+        dwTimeoutInMS)) // dwReceiveTimeout
     {
         hr = HRESULT_FROM_WIN32(GetLastError());
         goto Finished;
     }
 
-    // set up the shutdown headers
-    if (FAILED_LOG(hr = strHeaders.Append(L"MS-ASPNETCORE-EVENT:shutdown \r\n")) ||
-        FAILED_LOG(hr = strAppToken.Append(L"MS-ASPNETCORE-TOKEN:")) ||
-        FAILED_LOG(hr = strAppToken.AppendA(m_straGuid.QueryStr())) ||
-        FAILED_LOG(hr = strHeaders.Append(strAppToken.QueryStr())))
+    // the pairing token is required by the IIS integration middleware
+    if (FAILED_LOG(hr = strHeaders.Append(L"MS-ASPNETCORE-TOKEN:")) ||
+        FAILED_LOG(hr = strHeaders.AppendA(m_straGuid.QueryStr())))
     {
         goto Finished;
     }
@@ -2047,7 +2770,7 @@ SERVER_PROCESS::SendShutdownHttpMessage( VOID )
         goto Finished;
     }
 
-    if (!WinHttpReceiveResponse(hRequest , NULL))
+    if (!WinHttpReceiveResponse(hRequest, NULL))
     {
         hr = HRESULT_FROM_WIN32(GetLastError());
         goto Finished;
@@ -2056,27 +2779,14 @@ SERVER_PROCESS::SendShutdownHttpMessage( VOID )
     if (!WinHttpQueryHeaders(hRequest,
         WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
         WINHTTP_HEADER_NAME_BY_INDEX,
-        &dwStatusCode,
-        &dwSize,
+        pdwStatusCode,
+        &cbStatusCode,
         WINHTTP_NO_HEADER_INDEX))
     {
         hr = HRESULT_FROM_WIN32(GetLastError());
         goto Finished;
     }
 
-    if (dwStatusCode != 202)
-    {
-        // not expected http status
-        hr = E_FAIL;
-    }
-
-    // log
-    EventLog::Info(
-        ASPNETCORE_EVENT_SENT_SHUTDOWN_HTTP_REQUEST,
-        ASPNETCORE_EVENT_SENT_SHUTDOWN_HTTP_REQUEST_MSG,
-        m_dwProcessId,
-        dwStatusCode);
-
 Finished:
     if (hRequest)
     {
@@ -2096,69 +2806,362 @@ Finished:
     return hr;
 }
 
-//static
-VOID
-SERVER_PROCESS::SendShutDownSignal(
-    LPVOID lpParam
+HRESULT
+SERVER_PROCESS::SetHealthChecks(
+    _In_ STRU * pstruPath,
+    DWORD dwIntervalInMS,
+    DWORD dwTimeoutInMS,
+    DWORD dwUnhealthyThreshold,
+    DWORD dwOutlierFailures
 )
 {
-    SERVER_PROCESS* pThis = static_cast<SERVER_PROCESS *>(lpParam);
-    DBG_ASSERT(pThis);
-    pThis->SendShutDownSignalInternal();
+    if (dwIntervalInMS != 0 && dwUnhealthyThreshold != 0)
+    {
+        RETURN_IF_FAILED(m_struHealthCheckPath.Copy(*pstruPath));
+    }
+
+    m_dwHealthCheckIntervalInMS = dwIntervalInMS;
+    m_dwHealthCheckTimeoutInMS = dwTimeoutInMS;
+    m_dwHealthCheckUnhealthyThreshold = dwUnhealthyThreshold;
+    m_dwOutlierFailures = dwOutlierFailures;
+
+    return S_OK;
 }
 
-//
-// send shutdown message first, if fail then send
-// ctrl-c to the backend process to let it gracefully shutdown
-//
 VOID
-SERVER_PROCESS::SendShutDownSignalInternal(
+SERVER_PROCESS::StartHealthChecks(
     VOID
 )
 {
-    ReferenceServerProcess();
+    HRESULT hr = S_OK;
 
-    if (FAILED_LOG(SendShutdownHttpMessage()))
+    if (m_struHealthCheckPath.IsEmpty() || !m_straHealthCheckPath.IsEmpty())
     {
-        //
-        // failed to send shutdown http message
-        // try send ctrl signal
-        //
-        HWND  hCurrentConsole = NULL;
-        BOOL  fFreeConsole = FALSE;
-        hCurrentConsole = GetConsoleWindow();
-        if (hCurrentConsole)
+        return;
+    }
+
+    if (m_struAppVirtualPath.QueryCCH() > 1)
+    {
+        // app path size is 1 means site root, i.e., "/"
+        if (FAILED_LOG(hr = m_straHealthCheckPath.CopyW(m_struAppVirtualPath.QueryStr())))
         {
-            // free current console first, as we may have one, e.g., hostedwebcore case
-            fFreeConsole = FreeConsole();
+            return;
         }
+    }
+
+    if ((m_struHealthCheckPath.QueryStr()[0] != L'/' &&
+            FAILED_LOG(hr = m_straHealthCheckPath.Append("/"))) ||
+        FAILED_LOG(hr = m_straHealthCheckPath.AppendW(m_struHealthCheckPath.QueryStr())))
+    {
+        return;
+    }
+
+    // the pairing token is required by the IIS integration middleware
+    if (FAILED_LOG(hr = m_straHealthCheckHeaders.Copy("MS-ASPNETCORE-TOKEN: ")) ||
+        FAILED_LOG(hr = m_straHealthCheckHeaders.Append(m_straGuid)) ||
+        FAILED_LOG(hr = m_straHealthCheckHeaders.Append("\r\n")))
+    {
+        return;
+    }
+
+    if (FAILED_LOG(hr = EnsureLoopbackClient()))
+    {
+        return;
+    }
+
+    LOG_IF_FAILED(m_healthCheckTimer.Set(m_dwHealthCheckIntervalInMS, m_dwHealthCheckIntervalInMS));
+}
+
+VOID
+SERVER_PROCESS::StopHealthChecks(
+    VOID
+)
+{
+    InterlockedExchange(&m_lEjected, 1L);
+
+    if (!m_struHealthCheckPath.IsEmpty())
+    {
+        // Waits for a callback in flight, the probe may still be running
+        // and holds its own reference.
+        m_healthCheckTimer.Cancel();
+    }
+}
+
+// static
+VOID
+CALLBACK
+SERVER_PROCESS::HealthCheckTimerCallback(
+    PVOID       pContext
+)
+{
+    SERVER_PROCESS *pServerProcess = static_cast<SERVER_PROCESS*>(pContext);
+    HRESULT         hr = S_OK;
+
+    //
+    // A probe slower than the interval is not stacked up behind. An idle
+    // throttled process would fail it.
+    //
+    if (!pServerProcess->m_fReady ||
+        pServerProcess->m_lEjected != 0 ||
+        pServerProcess->m_lIdleSuspended != 0 ||
+        InterlockedCompareExchange(&pServerProcess->m_lHealthCheckInFlight, 1L, 0L) != 0L)
+    {
+        return;
+    }
+
+    pServerProcess->ReferenceServerProcess();
+
+    hr = pServerProcess->m_pLoopbackClient->SendRequest("GET",
+        pServerProcess->m_straHealthCheckPath.QueryStr(),
+        pServerProcess->m_straHealthCheckHeaders.QueryStr(),
+        pServerProcess->m_dwHealthCheckTimeoutInMS,
+        OnHealthCheckCompleted,
+        pServerProcess);
+
+    // Nothing was sent, counted as a failed probe all the same.
+    if (FAILED(hr))
+    {
+        OnHealthCheckCompleted(pServerProcess, hr, 0);
+    }
+}
+
+// static
+VOID
+SERVER_PROCESS::OnHealthCheckCompleted(
+    PVOID       pContext,
+    HRESULT     hr,
+    DWORD       dwStatusCode
+)
+/*++
+
+Routine Description:
+
+    A transport error, a timeout or a 5xx fails the probe. Any other
+    response means the process still answers, even if the path is not
+    mapped.
+
+--*/
+{
+    SERVER_PROCESS *pServerProcess = static_cast<SERVER_PROCESS*>(pContext);
+
+    if (SUCCEEDED(hr) && dwStatusCode < 500)
+    {
+        pServerProcess->m_cHealthCheckFailures = 0;
+    }
+    else if (++pServerProcess->m_cHealthCheckFailures == pServerProcess->m_dwHealthCheckUnhealthyThreshold)
+    {
+        LOG_WARNF(L"Health check of process %d on port %d failed %d times, last with hr 0x%x status %d",
+            pServerProcess->m_dwProcessId,
+            pServerProcess->m_dwPort,
+            pServerProcess->m_cHealthCheckFailures,
+            hr,
+            dwStatusCode);
+
+        pServerProcess->Eject(L"failing health checks");
+    }
+
+    InterlockedExchange(&pServerProcess->m_lHealthCheckInFlight, 0L);
+    pServerProcess->DereferenceServerProcess();
+}
+
+VOID
+SERVER_PROCESS::EnterIdle(
+    BOOL fSuspend
+)
+{
+    DWORD   rgProcessIds[MAX_JOB_PROCESS_IDS];
+    DWORD   cProcessIds = 0;
+    DWORD   dwWorkerProcessPid = GetCurrentProcessId();
+
+    if (m_fAttached ||
+        m_hJobObject == NULL ||
+        m_cOutstandingRequests != 0 ||
+        FAILED_LOG(GetJobProcessIds(rgProcessIds, MAX_JOB_PROCESS_IDS, &cProcessIds)))
+    {
+        return;
+    }
 
-        if (AttachConsole(m_dwProcessId))
+    for (DWORD i = 0; i < cProcessIds; i++)
+    {
+        if (rgProcessIds[i] == dwWorkerProcessPid)
         {
-            // As we called CreateProcess with CREATE_NEW_PROCESS_GROUP
-            // call ctrl-break instead of ctrl-c as child process ignores ctrl-c
-            if (!GenerateConsoleCtrlEvent(CTRL_BREAK_EVENT, m_dwProcessId))
-            {
-                // failed to send the ctrl signal. terminate the backend process immediately instead of waiting for timeout
-                TerminateBackendProcess();
-            }
-            FreeConsole();
+            continue;
+        }
 
-            if (fFreeConsole)
-            {
-                // IISExpress and hostedwebcore w3wp run as background process
-                // have to attach console back to ensure post app_offline scenario still works
-                AttachConsole(ATTACH_PARENT_PROCESS);
-            }
+        // Gone meanwhile if it can't be opened.
+        HANDLE hProcess = OpenProcess(PROCESS_SET_QUOTA | PROCESS_QUERY_LIMITED_INFORMATION, FALSE, rgProcessIds[i]);
+        if (hProcess != NULL)
+        {
+            //
+            // The pages go to the standby list and are faulted back in as
+            // the next requests touch them.
+            //
+            LOG_LAST_ERROR_IF(!SetProcessWorkingSetSize(hProcess, static_cast<SIZE_T>(-1), static_cast<SIZE_T>(-1)));
+            CloseHandle(hProcess);
         }
-        else
+    }
+
+    if (!fSuspend)
+    {
+        return;
+    }
+
+    SRWExclusiveLock lock(m_srwIdleLock);
+
+    InterlockedExchange(&m_lIdleSuspended, 1L);
+
+    if (m_cOutstandingRequests != 0)
+    {
+        InterlockedExchange(&m_lIdleSuspended, 0L);
+        return;
+    }
+
+    //
+    // Throttled rather than frozen, a request racing with it is slow but
+    // never stuck.
+    //
+    JOBOBJECT_CPU_RATE_CONTROL_INFORMATION cpuRateInfo = { 0 };
+    cpuRateInfo.ControlFlags = JOB_OBJECT_CPU_RATE_CONTROL_ENABLE | JOB_OBJECT_CPU_RATE_CONTROL_HARD_CAP;
+    cpuRateInfo.CpuRate = 1;
+
+    if (!SetInformationJobObject(m_hJobObject, JobObjectCpuRateControlInformation, &cpuRateInfo, sizeof cpuRateInfo))
+    {
+        LOG_LAST_ERROR();
+        InterlockedExchange(&m_lIdleSuspended, 0L);
+    }
+}
+
+VOID
+SERVER_PROCESS::ResumeFromIdle(
+    VOID
+)
+{
+    SRWExclusiveLock lock(m_srwIdleLock);
+
+    if (m_lIdleSuspended == 0)
+    {
+        return;
+    }
+
+    // Back to processCpuRateLimit, or to no limit at all.
+    JOBOBJECT_CPU_RATE_CONTROL_INFORMATION cpuRateInfo = { 0 };
+    if (m_resourceLimits.dwCpuRatePercent != 0)
+    {
+        cpuRateInfo.ControlFlags = JOB_OBJECT_CPU_RATE_CONTROL_ENABLE | JOB_OBJECT_CPU_RATE_CONTROL_HARD_CAP;
+        cpuRateInfo.CpuRate = m_resourceLimits.dwCpuRatePercent * 100;
+    }
+
+    LOG_LAST_ERROR_IF(!SetInformationJobObject(m_hJobObject, JobObjectCpuRateControlInformation, &cpuRateInfo, sizeof cpuRateInfo));
+
+    InterlockedExchange(&m_lIdleSuspended, 0L);
+}
+
+VOID
+SERVER_PROCESS::Eject(
+    _In_ PCWSTR pszReason
+)
+/*++
+
+Routine Description:
+
+    Shut the process down like a crash so that the next request starts a
+    replacement in its slot, only unrouting it when attached. This counts
+    towards the rapid fail limit, a backend that keeps hanging is treated
+    like one that keeps crashing.
+
+--*/
+{
+    if (InterlockedCompareExchange(&m_lEjected, 1L, 0L) != 0L)
+    {
+        return;
+    }
+
+    LOG_WARNF(L"Taking process %d on port %d out of routing for %s",
+        m_dwProcessId,
+        m_dwPort,
+        pszReason);
+
+    TraceLoggingWrite(g_hTraceProvider,
+        "BackendProcessEjected",
+        TraceLoggingLevel(WINEVENT_LEVEL_WARNING),
+        TraceLoggingKeyword(ASPNETCORE_TRACE_KEYWORD_PROCESS),
+        TraceLoggingWideString(m_struAppFullPath.QueryStr(), "ApplicationPath"),
+        TraceLoggingUInt32(m_dwProcessId, "ProcessId"),
+        TraceLoggingUInt32(m_dwPort, "Port"),
+        TraceLoggingWideString(pszReason, "Reason"));
+
+    m_pProcessManager->QueryCounters()->BackendEjected();
+    m_pProcessManager->ShutdownProcess(this);
+}
+
+VOID
+SERVER_PROCESS::PrewarmConnections(
+    VOID
+)
+{
+    STACK_STRU(strHeaders, 256);
+    STACK_STRU(strUrl, 256);
+
+    //
+    // Carry the pairing token so the IIS integration middleware accepts the
+    // request like any forwarded one.
+    //
+    if (FAILED_LOG(strHeaders.Append(L"MS-ASPNETCORE-TOKEN:")) ||
+        FAILED_LOG(strHeaders.AppendA(m_straGuid.QueryStr())) ||
+        FAILED_LOG(strUrl.Copy(m_struAppVirtualPath.QueryCCH() > 1 ? m_struAppVirtualPath.QueryStr() : L"/")))
+    {
+        return;
+    }
+
+    m_pForwarderConnection->Prewarm(m_dwPrewarmConnections,
+        strUrl.QueryStr(),
+        strHeaders.QueryStr(),
+        m_dwStartupTimeLimitInMS);
+}
+
+//
+// the shutdown message failed, send ctrl-break to the backend process to
+// let it gracefully shutdown
+//
+VOID
+SERVER_PROCESS::SendCtrlSignal(
+    VOID
+)
+{
+    SRWExclusiveLock lock(sm_srwConsoleLock);
+
+    HWND  hCurrentConsole = NULL;
+    BOOL  fFreeConsole = FALSE;
+    hCurrentConsole = GetConsoleWindow();
+    if (hCurrentConsole)
+    {
+        // free current console first, as we may have one, e.g., hostedwebcore case
+        fFreeConsole = FreeConsole();
+    }
+
+    if (AttachConsole(m_dwProcessId))
+    {
+        // As we called CreateProcess with CREATE_NEW_PROCESS_GROUP
+        // call ctrl-break instead of ctrl-c as child process ignores ctrl-c
+        if (!GenerateConsoleCtrlEvent(CTRL_BREAK_EVENT, m_dwProcessId))
         {
-            // terminate the backend process immediately instead of waiting for timeout
+            // failed to send the ctrl signal. terminate the backend process immediately instead of waiting for timeout
             TerminateBackendProcess();
         }
-    }
+        FreeConsole();
 
-    DereferenceServerProcess();
+        if (fFreeConsole)
+        {
+            // IISExpress and hostedwebcore w3wp run as background process
+            // have to attach console back to ensure post app_offline scenario still works
+            AttachConsole(ATTACH_PARENT_PROCESS);
+        }
+    }
+    else
+    {
+        // terminate the backend process immediately instead of waiting for timeout
+        TerminateBackendProcess();
+    }
 }
 
 VOID
@@ -2168,6 +3171,8 @@ SERVER_PROCESS::TerminateBackendProcess(
 {
     if (InterlockedCompareExchange(&m_lStopping, 1L, 0L) == 0L)
     {
+        TraceProcessExit(TRUE);
+
         // backend process will be terminated, remove the waitcallback
         if (m_hProcessWaitHandle != NULL)
         {
@@ -2179,8 +3184,18 @@ SERVER_PROCESS::TerminateBackendProcess(
 
             m_hProcessWaitHandle = NULL;
         }
+        else if (m_fExitWatched)
+        {
+            // same for the watch, the dispatcher lost m_lStopping to us
+            DereferenceServerProcess();
+        }
+
+        // cannot gracefully shutdown or timeout, terminate the process tree
+        if (m_hJobObject != NULL)
+        {
+            LOG_IF_FAILED(StopAllProcessesInJobObject(JOB_TERMINATE_TIMEOUT_MS));
+        }
 
-        // cannot gracefully shutdown or timeout, terminate the process
         if (m_hProcessHandle != NULL && m_hProcessHandle != INVALID_HANDLE_VALUE)
         {
             TerminateProcess(m_hProcessHandle, 0);
@@ -2194,3 +3209,78 @@ SERVER_PROCESS::TerminateBackendProcess(
             m_dwProcessId);
     }
 }
+
+VOID
+SERVER_PROCESS::TraceFirstRequestForwarded(
+    _In_ IHttpTraceContext *    pTraceContext
+)
+{
+    const LONGLONG llNow = QueryTimestamp();
+    const ULONGLONG ullProcessCreatedMicroseconds = QueryMicrosecondsBetween(m_llStartRequested, m_llProcessCreated);
+    const ULONGLONG ullListenMicroseconds = QueryMicrosecondsBetween(m_llProcessCreated, m_llListening);
+    const ULONGLONG ullFirstRequestMicroseconds = QueryMicrosecondsBetween(m_llListening, llNow);
+
+    TraceLoggingWrite(g_hTraceProvider,
+        "BackendProcessFirstRequest",
+        TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+        TraceLoggingKeyword(ASPNETCORE_TRACE_KEYWORD_PROCESS),
+        TraceLoggingWideString(m_struAppFullPath.QueryStr(), "ApplicationPath"),
+        TraceLoggingUInt32(m_dwProcessId, "ProcessId"),
+        TraceLoggingUInt32(m_dwPort, "Port"),
+        TraceLoggingUInt64(ullFirstRequestMicroseconds, "FirstRequestMicroseconds"),
+        TraceLoggingUInt64(QueryMicrosecondsBetween(m_llStartRequested, llNow), "ElapsedMicroseconds"));
+
+    //
+    // The startup phases once more on the request, for FREB, which has no
+    // trace context while the process starts.
+    //
+    if (pTraceContext != NULL &&
+        ANCMEvents::ANCM_BACKEND_PROCESS_START::IsEnabled(pTraceContext))
+    {
+        ANCMEvents::ANCM_BACKEND_PROCESS_START::RaiseEvent(
+            pTraceContext,
+            NULL,
+            m_dwProcessId,
+            m_dwPort,
+            static_cast<ULONG>(min(ullProcessCreatedMicroseconds, static_cast<ULONGLONG>(ULONG_MAX))),
+            static_cast<ULONG>(min(ullListenMicroseconds, static_cast<ULONGLONG>(ULONG_MAX))),
+            static_cast<ULONG>(min(ullFirstRequestMicroseconds, static_cast<ULONGLONG>(ULONG_MAX))));
+    }
+}
+
+//
+// Called once per process by whoever wins m_lStopping, either on the exit
+// callback or before terminating the tree.
+//
+VOID
+SERVER_PROCESS::TraceProcessExit(
+    BOOL    fTerminated
+)
+{
+    if (!TraceLoggingProviderEnabled(g_hTraceProvider, WINEVENT_LEVEL_INFO, ASPNETCORE_TRACE_KEYWORD_PROCESS))
+    {
+        return;
+    }
+
+    const LONGLONG llNow = QueryTimestamp();
+    DWORD dwExitCode = 0;
+
+    if (m_hProcessHandle != NULL && m_hProcessHandle != INVALID_HANDLE_VALUE &&
+        !GetExitCodeProcess(m_hProcessHandle, &dwExitCode))
+    {
+        dwExitCode = 0;
+    }
+
+    TraceLoggingWrite(g_hTraceProvider,
+        "BackendProcessExited",
+        TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+        TraceLoggingKeyword(ASPNETCORE_TRACE_KEYWORD_PROCESS),
+        TraceLoggingWideString(m_struAppFullPath.QueryStr(), "ApplicationPath"),
+        TraceLoggingUInt32(m_dwProcessId, "ProcessId"),
+        TraceLoggingUInt32(m_dwPort, "Port"),
+        TraceLoggingUInt32(dwExitCode, "ExitCode"),
+        TraceLoggingBool(fTerminated, "Terminated"),
+        TraceLoggingBool(m_llShutdownSignaled != 0, "ShutdownSignaled"),
+        TraceLoggingUInt64(QueryMicrosecondsBetween(m_llShutdownSignaled, llNow), "ShutdownMicroseconds"),
+        TraceLoggingUInt64(QueryMicrosecondsBetween(m_llProcessCreated, llNow), "LifetimeMicroseconds"));
+}
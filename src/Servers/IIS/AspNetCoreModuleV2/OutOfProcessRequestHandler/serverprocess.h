@@ -4,7 +4,8 @@
 #pragma once
 
 #include <random>
-#include <map>
+#include <memory>
+#include "OverlappedPipeReader.h"
 
 // Minimum port number that can be used.
 // This is lower than 'MIN_PORT_RANDOM' since we allow people to choose
@@ -17,12 +18,28 @@
 #define MIN_PORT_RANDOM                             10000
 #define MAX_PORT                                    48000
 #define MAX_ACTIVE_CHILD_PROCESSES                  16
-#define PIPE_OUTPUT_THREAD_TIMEOUT                  2000
+// Processes of a job tracked from its notifications.
+#define MAX_JOB_PROCESS_IDS                         64
+// Wait for a terminated process tree to exit.
+#define JOB_TERMINATE_TIMEOUT_MS                    5000
+#define JOB_TERMINATE_POLL_INTERVAL_MS              10UL
+// Characters of console output kept for the start failure event.
+#define MAX_CAPTURED_OUTPUT_CHARS                   30000
 #define LOCALHOST                                   "127.0.0.1"
 #define ASPNETCORE_PORT_STR                         L"ASPNETCORE_PORT"
 #define ASPNETCORE_PORT_ENV_STR                     L"ASPNETCORE_PORT="
 #define ASPNETCORE_APP_PATH_ENV_STR                 L"ASPNETCORE_APPL_PATH="
 #define ASPNETCORE_APP_TOKEN_ENV_STR                L"ASPNETCORE_TOKEN="
+// Name of a manual-reset event the backend may signal once it listens.
+#define ASPNETCORE_READY_EVENT_ENV_STR              L"ASPNETCORE_READY_EVENT="
+#define READY_EVENT_NAME_PREFIX                     L"Local\\ASPNETCORE_READY_"
+// Bounds of the exponential backoff between readiness probes.
+#define READY_PROBE_MIN_INTERVAL_MS                 10
+#define READY_PROBE_MAX_INTERVAL_MS                 250
+// Interval at which a draining process checks for outstanding requests.
+#define DRAIN_POLL_INTERVAL_MS                      50
+// Minimum working set given to a job with a working set limit.
+#define MIN_JOB_WORKING_SET_SIZE                    (static_cast<SIZE_T>(1024) * 1024)
 
 class PROCESS_MANAGER;
 
@@ -38,27 +55,54 @@ public:
         _In_ STRU                 *pszArguments,
         _In_ DWORD                 dwStartupTimeLimitInMS,
         _In_ DWORD                 dwShtudownTimeLimitInMS,
-        _In_ BOOL                  fWindowsAuthEnabled,
-        _In_ BOOL                  fBasicAuthEnabled,
-        _In_ BOOL                  fAnonymousAuthEnabled,
-        _In_ std::map<std::wstring, std::wstring, ignore_case_comparer>& pEnvironmentVariables,
+        _In_ DWORD                 dwMaxConnections,
+        _In_ DWORD                 dwPrewarmConnections,
+        _In_ BOOL                  fReservePriorityConnection,
+        _In_ BOOL                  fRequestDelegation,
+        _In_ BOOL                  fCacheWindowsAuthToken,
+        _In_ const PROCESS_RESOURCE_LIMITS& resourceLimits,
+        _In_ std::shared_ptr<const ENVIRONMENT_BLOCK> pEnvironmentBlock,
         _In_ BOOL                  fStdoutLogEnabled,
         _In_ BOOL                  fDisableRedirection,
-        _In_ BOOL                  fWebSocketSupported,
         _In_ STRU                 *pstruStdoutLogFile,
         _In_ STRU                 *pszAppPhysicalPath,
         _In_ STRU                 *pszAppPath,
-        _In_ STRU                 *pszAppVirtualPath,
-        _In_ STRU                 *pszHttpsPort
+        _In_ STRU                 *pszAppVirtualPath
         );
 
     HRESULT
     StartProcess( VOID );
 
+    //
+    // Uses the backend another worker of the web garden started instead of
+    // starting one, see WEB_GARDEN_REGISTRY. The process is watched like
+    // one of our own but never signaled or terminated by this object.
+    //
+    HRESULT
+    AttachProcess(
+        DWORD   dwListeningProcessId,
+        DWORD   dwPort,
+        _In_ PCSTR pszToken
+    );
+
+    //
+    // *ppEntry is set when the handle is kept for the connection, see
+    // WINDOWS_AUTH_TOKEN_CACHE, and must be given to
+    // ReleaseWindowsAuthToken once the request is done.
+    //
     HRESULT
     SetWindowsAuthToken(
         _In_ HANDLE hToken,
-        _Out_ LPHANDLE pTargeTokenHandle
+        HTTP_CONNECTION_ID connectionId,
+        _Out_ LPHANDLE pTargeTokenHandle,
+        _Outptr_result_maybenull_ WINDOWS_AUTH_TOKEN_CACHE_ENTRY **ppEntry
+    );
+
+    VOID
+    ReleaseWindowsAuthToken(
+        _In_ WINDOWS_AUTH_TOKEN_CACHE_ENTRY *pEntry,
+        BOOL fConnectionClosed,
+        BOOL fConsumed
     );
 
     BOOL
@@ -88,6 +132,84 @@ public:
         return m_dwPort;
     }
 
+    DWORD
+    QueryProcessId()
+    {
+        return m_dwProcessId;
+    }
+
+    DWORD
+    QueryListeningProcessId()
+    {
+        return m_dwListeningProcessId;
+    }
+
+    BOOL
+    IsAttached()
+    {
+        return m_fAttached;
+    }
+
+    //
+    // Number of requests currently forwarded to this process, used by the
+    // load aware routing policies of PROCESS_MANAGER.
+    //
+    LONG
+    QueryOutstandingRequests() const
+    {
+        return m_cOutstandingRequests;
+    }
+
+    VOID
+    IncrementOutstandingRequests()
+    {
+        InterlockedIncrement(&m_cOutstandingRequests);
+
+        // Pairs with EnterIdle, one of the two sees the other.
+        if (m_lIdleSuspended != 0)
+        {
+            ResumeFromIdle();
+        }
+    }
+
+    VOID
+    DecrementOutstandingRequests()
+    {
+        InterlockedDecrement(&m_cOutstandingRequests);
+    }
+
+    //
+    // Trims the working set of the processes of the job and, with
+    // fSuspend, throttles the job to the lowest CPU rate until the next
+    // request is sent to it. Nothing is done while requests are in flight,
+    // nor for an attached process which the other workers still use.
+    //
+    VOID
+    EnterIdle(
+        BOOL fSuspend
+    );
+
+    VOID
+    ResumeFromIdle(
+        VOID
+    );
+
+    //
+    // Called for every request sent to this process, the first one traces
+    // how long the process took from StartProcess to serving it.
+    //
+    VOID
+    NotifyRequestForwarded(
+        _In_ IHttpTraceContext *    pTraceContext
+    )
+    {
+        if (m_lFirstRequestForwarded == 0 &&
+            InterlockedExchange(&m_lFirstRequestForwarded, 1L) == 0L)
+        {
+            TraceFirstRequestForwarded(pTraceContext);
+        }
+    }
+
     VOID
     ReferenceServerProcess(
         VOID
@@ -124,12 +246,49 @@ public:
         VOID
     );
 
+    //
+    // A notification of the job, on the dispatcher of JOB_NOTIFICATION_PORT.
+    // TRUE when it is the exit of the watched backend and the caller now
+    // owns its stop, it then calls CompleteProcessExit.
+    //
+    BOOL
+    OnJobNotification(
+        DWORD   dwMessage,
+        DWORD   dwProcessId
+    );
+
+    //
+    // The exit of the backend, once m_lStopping was won for it. Releases
+    // the reference of the wait or watch that saw it.
+    //
+    VOID
+    CompleteProcessExit(
+        VOID
+    );
+
+    //
+    // Requests for the priority paths of the application get a connection
+    // that is not capped, they never wait for one of the capped pool.
+    //
     FORWARDER_CONNECTION*
     QueryWinHttpConnection(
-        VOID
+        BOOL    fPriorityRequest = FALSE
     )
     {
-        return m_pForwarderConnection;
+        return fPriorityRequest && m_pPriorityConnection != NULL
+            ? m_pPriorityConnection
+            : m_pForwarderConnection;
+    }
+
+    //
+    // Non null with requestDelegation, the requests of a ready process
+    // that REQUEST_DELEGATION::CanDelegate takes are handed to its queue
+    // instead of this connection.
+    //
+    REQUEST_DELEGATION*
+    QueryRequestDelegation()
+    {
+        return m_pRequestDelegation.get();
     }
 
     LPCSTR
@@ -138,21 +297,161 @@ public:
         return m_straGuid.QueryStr();
     };
 
+    USHORT
+    QueryGuidLength()
+    {
+        return static_cast<USHORT>(m_straGuid.QueryCCH());
+    };
+
     VOID
     SendSignal(
         VOID
     );
 
+    //
+    // SendSignal in two halves, so that the processes of an application are
+    // all signaled before waiting for any of them and share one shutdown
+    // time limit. BeginSignal sends the shutdown message without waiting,
+    // FALSE when there is nothing to wait for. CompleteSignal then waits
+    // for the exit until the time limit since BeginSignal and terminates
+    // the process past it.
+    //
+    BOOL
+    BeginSignal(
+        VOID
+    );
+
+    VOID
+    CompleteSignal(
+        VOID
+    );
+
+    //
+    // Waits for the requests in flight to complete, at most the shutdown
+    // time limit, then calls SendSignal. The process must not be routed to
+    // anymore.
+    //
+    VOID
+    DrainAndSendSignal(
+        VOID
+    );
+
+    HRESULT
+    SendWarmupRequest(
+        _In_ PCWSTR pszWarmupUrl
+    );
+
+    //
+    // Once ready, the process is sent a GET for pstruPath every
+    // dwIntervalInMS when the path is set, and taken out of routing after
+    // dwUnhealthyThreshold failed probes in a row. dwOutlierFailures also
+    // takes it out after that many failed requests in a row, see
+    // RecordForwardResult. 0 turns either off.
+    //
+    HRESULT
+    SetHealthChecks(
+        _In_ STRU * pstruPath,
+        DWORD dwIntervalInMS,
+        DWORD dwTimeoutInMS,
+        DWORD dwUnhealthyThreshold,
+        DWORD dwOutlierFailures
+    );
+
+    //
+    // fFailed for a 5xx response or a timeout of a forwarded request.
+    //
+    VOID
+    RecordForwardResult(
+        BOOL fFailed
+    )
+    {
+        if (m_dwOutlierFailures == 0)
+        {
+            return;
+        }
+
+        if (!fFailed)
+        {
+            // Skips the write, and the cache line bounce, in the common case.
+            if (m_cConsecutiveFailures != 0)
+            {
+                InterlockedExchange(&m_cConsecutiveFailures, 0);
+            }
+            return;
+        }
+
+        if (static_cast<DWORD>(InterlockedIncrement(&m_cConsecutiveFailures)) == m_dwOutlierFailures)
+        {
+            Eject(L"consecutive failed requests");
+        }
+    }
+
     static
         void
-        ReadStdErrHandle(
-            LPVOID pContext
+        OnStdErrData(
+            PVOID       pContext,
+            const char *pData,
+            DWORD       cbData
         );
 
-    void
-        ReadStdErrHandleInternal();
-
 private:
+    // Opens and closes the stdout log regularly so that its size shows.
+    static
+    VOID
+    CALLBACK
+    LogFileTimerCallback(
+        PVOID       pContext
+    );
+
+    static
+    VOID
+    CALLBACK
+    HealthCheckTimerCallback(
+        PVOID       pContext
+    );
+
+    // PFN_LOOPBACK_REQUEST_COMPLETION of the probe.
+    static
+    VOID
+    OnHealthCheckCompleted(
+        PVOID       pContext,
+        HRESULT     hr,
+        DWORD       dwStatusCode
+    );
+
+    VOID
+    StartHealthChecks(
+        VOID
+    );
+
+    //
+    // Also keeps the process from being ejected, it is on its way out.
+    //
+    VOID
+    StopHealthChecks(
+        VOID
+    );
+
+    //
+    // Stops routing to the process once, through the process manager as a
+    // crash would.
+    //
+    VOID
+    Eject(
+        _In_ PCWSTR pszReason
+    );
+
+    //
+    // Synchronous GET for pszPath, relative to the application virtual
+    // path, with the pairing token.
+    //
+    HRESULT
+    SendLocalGetRequest(
+        _In_ PCWSTR pszPath,
+        DWORD dwTimeoutInMS,
+        _Out_ DWORD * pdwStatusCode
+    );
+
     VOID
     CleanUp();
 
@@ -161,6 +460,16 @@ private:
        VOID
     );
 
+    HRESULT
+    ApplyJobResourceLimits(
+       VOID
+    );
+
+    HRESULT
+    ApplyCpuSets(
+       VOID
+    );
+
     BOOL
     IsDebuggerIsAttached(
         VOID
@@ -168,9 +477,27 @@ private:
 
     HRESULT
     StopAllProcessesInJobObject(
+        DWORD   dwWaitTimeoutInMS
+    );
+
+    HRESULT
+    GetJobProcessIds(
+        _Out_writes_to_(cMaxProcessIds, *pcProcessIds) DWORD  *rgProcessIds,
+        DWORD                                                   cMaxProcessIds,
+        _Out_ DWORD                                            *pcProcessIds
+    );
+
+    HRESULT
+    EnumerateJobProcessIdsNoLock(
         VOID
     );
 
+    VOID
+    ApplyJobNotificationNoLock(
+        DWORD   dwMessage,
+        DWORD   dwProcessId
+    );
+
     HRESULT
     SetupStdHandles(
         _Inout_ LPSTARTUPINFOW pStartupInfo
@@ -189,6 +516,17 @@ private:
         _In_ HANDLE  hProcessToWaitOn
     );
 
+    //
+    // Watches the backend from the notifications of its job, or with a
+    // wait on hProcessToWatch when they are not received. One watch covers
+    // both the process started and its listening child.
+    //
+    HRESULT
+    WatchProcessExit(
+        _In_ PHANDLE phWaitHandle,
+        _In_ HANDLE  hProcessToWatch
+    );
+
     HRESULT
     GetChildProcessHandles(
         VOID
@@ -196,24 +534,29 @@ private:
 
     HRESULT
     SetupListenPort(
-        ENVIRONMENT_VAR_HASH    *pEnvironmentVarTable,
         BOOL                    *pfCriticalError
     );
 
     HRESULT
-    SetupAppPath(
-        ENVIRONMENT_VAR_HASH*   pEnvironmentVarTable
+    SetupAppToken(
+        STRU*                   pstrAppToken
     );
 
     HRESULT
-    SetupAppToken(
-        ENVIRONMENT_VAR_HASH*   pEnvironmentVarTable
+    SetupReadyEvent(
+        STRU*                   pstrEventName
+    );
+
+    HRESULT
+    SetupRequestDelegation(
+        VOID
     );
 
     HRESULT
     OutputEnvironmentVariables(
-        MULTISZ*                pmszOutput,
-        ENVIRONMENT_VAR_HASH*   pEnvironmentVarTable
+        const STRU&             strAppToken,
+        const STRU&             strEventName,
+        std::vector<WCHAR>*     pEnvironment
     );
 
     HRESULT
@@ -226,43 +569,111 @@ private:
         VOID
     );
 
+    HRESULT
+    IsPortAvailable(
+        _In_  DWORD     dwPort,
+        _Out_ BOOL    * pfAvailable
+    );
+
     HRESULT
     GetRandomPort(
         DWORD*    pdwPickedPort,
         DWORD     dwExcludedPort
     );
 
-    static
     VOID
-    SendShutDownSignal(
-        LPVOID lpParam
-        );
+    ReleasePort();
 
+    //
+    // Ctrl-break, for when the shutdown message fails. Serialized as
+    // attaching to the console of the backend is per worker process.
+    //
     VOID
-    SendShutDownSignalInternal(
+    SendCtrlSignal(
         VOID
     );
 
+    //
+    // Posts the shutdown message over m_pLoopbackClient, the completion
+    // falls back to SendCtrlSignal.
+    //
     HRESULT
     SendShutdownHttpMessage(
         VOID
     );
 
+    HRESULT
+    EnsureLoopbackClient(
+        VOID
+    );
+
+    // PFN_LOOPBACK_REQUEST_COMPLETION of the shutdown message.
+    static
+    VOID
+    OnShutdownMessageCompleted(
+        PVOID       pContext,
+        HRESULT     hr,
+        DWORD       dwStatusCode
+    );
+
+    VOID
+    PrewarmConnections(
+        VOID
+    );
+
     VOID
     TerminateBackendProcess(
         VOID
     );
 
+    VOID
+    TraceFirstRequestForwarded(
+        _In_ IHttpTraceContext *    pTraceContext
+    );
+
+    VOID
+    TraceProcessExit(
+        BOOL    fTerminated
+    );
+
     FORWARDER_CONNECTION   *m_pForwarderConnection;
+    // Only opened when the connections are capped and priority paths are set.
+    FORWARDER_CONNECTION   *m_pPriorityConnection;
+    BOOL                    m_fReservePriorityConnection;
+    // Started by another worker of the web garden, see AttachProcess.
+    BOOL                    m_fAttached;
+    BOOL                    m_fRequestDelegation;
+    // Named after the token, with the prefix the backend registers on it.
+    STRU                    m_struDelegationQueueName;
+    STRU                    m_struDelegationUrlPrefix;
+    std::unique_ptr<REQUEST_DELEGATION> m_pRequestDelegation;
+    // Only with cacheWindowsAuthToken.
+    std::unique_ptr<WINDOWS_AUTH_TOKEN_CACHE> m_pWindowsAuthTokenCache;
     BOOL                    m_fStdoutLogEnabled;
-    BOOL                    m_fWebSocketSupported;
-    BOOL                    m_fWindowsAuthEnabled;
-    BOOL                    m_fBasicAuthEnabled;
-    BOOL                    m_fAnonymousAuthEnabled;
     BOOL                    m_fDebuggerAttached;
     BOOL                    m_fEnableOutOfProcessConsoleRedirection;
 
-    STTIMER                 m_Timer;
+    TimerWheel::Timer       m_Timer;
+    TimerWheel::Timer       m_healthCheckTimer;
+    STRU                    m_struHealthCheckPath;
+    // Request line path and headers of the probe, set with the client.
+    STRA                    m_straHealthCheckPath;
+    STRA                    m_straHealthCheckHeaders;
+    // Of the probes and the shutdown message, created by the first of them.
+    LOOPBACK_HTTP_CLIENT *  m_pLoopbackClient;
+    DWORD                   m_dwHealthCheckIntervalInMS;
+    DWORD                   m_dwHealthCheckTimeoutInMS;
+    DWORD                   m_dwHealthCheckUnhealthyThreshold;
+    // Only touched by the probe, one at a time.
+    DWORD                   m_cHealthCheckFailures;
+    volatile LONG           m_lHealthCheckInFlight;
+    DWORD                   m_dwOutlierFailures;
+    volatile LONG           m_cConsecutiveFailures;
+    // Set once ejected, or once stopping so that it never is.
+    volatile LONG           m_lEjected;
+    // Throttled by EnterIdle, m_srwIdleLock orders it with ResumeFromIdle.
+    volatile LONG           m_lIdleSuspended;
+    SRWLOCK                 m_srwIdleLock;
     SOCKET                  m_socket;
 
     STRU                    m_struLogFile;
@@ -272,27 +683,59 @@ private:
     STRU                    m_struAppVirtualPath;  // e.g., '/' for site
     STRU                    m_struAppFullPath;     // e.g.,  /LM/W3SVC/4/ROOT/Inproc
     STRU                    m_struPhysicalPath;    // e.g., c:/test/mysite
-    STRU                    m_struHttpsPort;     // e.g.,  /LM/W3SVC/4/ROOT/Inproc
     STRU                    m_struPort;
     STRU                    m_struCommandLine;
 
     volatile LONG           m_lStopping;
     volatile BOOL           m_fReady;
+    volatile LONG           m_lFirstRequestForwarded;
     mutable LONG            m_cRefs;
+    volatile LONG           m_cOutstandingRequests;
 
-    std::mt19937            m_randomGenerator;
+    // m_dwPort was handed out by PORT_ALLOCATOR.
+    BOOL                    m_fPortAcquired;
 
     DWORD                   m_dwPort;
     DWORD                   m_dwStartupTimeLimitInMS;
     DWORD                   m_dwShutdownTimeLimitInMS;
+    DWORD                   m_dwMaxConnections;
+    DWORD                   m_dwPrewarmConnections;
     DWORD                   m_cChildProcess;
     DWORD                   m_dwChildProcessIds[MAX_ACTIVE_CHILD_PROCESSES];
     DWORD                   m_dwProcessId;
     DWORD                   m_dwListeningProcessId;
 
+    //
+    // QueryPerformanceCounter at the phases of the process lifetime for
+    // its lifecycle events, 0 until a phase is reached.
+    //
+    LONGLONG                m_llStartRequested;
+    LONGLONG                m_llProcessCreated;
+    LONGLONG                m_llListening;
+    LONGLONG                m_llShutdownSignaled;
+
     STRA                    m_straGuid;
 
+    PROCESS_RESOURCE_LIMITS m_resourceLimits;
+
     HANDLE                  m_hJobObject;
+    //
+    // Key of the job on JOB_NOTIFICATION_PORT, 0 when its notifications
+    // are not received. They keep m_rgJobProcessIds up to date and set
+    // the flags below, all protected by m_srwJobProcessLock.
+    //
+    ULONG_PTR               m_ulJobNotificationKey;
+    SRWLOCK                 m_srwJobProcessLock;
+    // Woken up on every notification, for StopAllProcessesInJobObject.
+    CONDITION_VARIABLE      m_cvJobProcesses;
+    DWORD                   m_rgJobProcessIds[MAX_JOB_PROCESS_IDS];
+    DWORD                   m_cJobProcessIds;
+    BOOL                    m_fJobProcessIdsValid;
+    // The watch holds a reference, as a wait on the process does.
+    BOOL                    m_fExitWatched;
+    // Set on an exit of the backend even before it is watched.
+    BOOL                    m_fProcessExited;
+    BOOL                    m_fMemoryLimitReported;
     HANDLE                  m_hStdoutHandle;
     //
     // m_hProcessHandle is the handle to process this object creates.
@@ -301,8 +744,19 @@ private:
     HANDLE                  m_hListeningProcessHandle;
     HANDLE                  m_hProcessWaitHandle;
     HANDLE                  m_hShutdownHandle;
-    HANDLE                  m_hReadThread;
+    ULONGLONG               m_ullShutdownDeadline;
     HANDLE                  m_hStdErrWritePipe;
+    //
+    // Reads the console output pipe on the thread pool when output is not
+    // redirected to the stdout log file.
+    //
+    std::unique_ptr<OverlappedPipeReader> m_pStdErrReader;
+    size_t                  m_cchOutputLeft;
+    //
+    // Signaled by a backend that supports ASPNETCORE_READY_EVENT once it
+    // is listening, lets PostStartCheck skip the probe backoff.
+    //
+    HANDLE                  m_hReadyEvent;
     std::wstringstream      m_output;
     //
     // m_hChildProcessHandle is the handle to process created by
@@ -312,5 +766,7 @@ private:
     HANDLE                  m_hChildProcessWaitHandles[MAX_ACTIVE_CHILD_PROCESSES];
 
     PROCESS_MANAGER         *m_pProcessManager;
-    std::map<std::wstring, std::wstring, ignore_case_comparer> m_pEnvironmentVarTable;
+    std::shared_ptr<const ENVIRONMENT_BLOCK> m_pEnvironmentBlock;
+
+    static SRWLOCK          sm_srwConsoleLock;
 };
@@ -26,6 +26,9 @@
 #include <wchar.h>
 #include <io.h>
 #include <stdio.h>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 // This should remove our issue of compiling for win7 without header files.
 // We  force the Windows 8 version check logic in iiswebsocket.h to succeed even though we're compiling for Windows 7.
@@ -52,6 +55,7 @@
 #include "base64.h"
 #include "listentry.h"
 #include "debugutil.h"
+#include "percputracelog.h"
 
 // Common lib
 #include "requesthandler.h"
@@ -62,11 +66,27 @@
 #include "requesthandler_config.h"
 
 #include "sttimer.h"
+#include "TimerWheel.h"
+#include "applicationcounters.h"
+#include "websocketcounters.h"
 #include "websockethandler.h"
 #include "responseheaderhash.h"
 #include "protocolconfig.h"
+#include "requestsampler.h"
+#include "responsebufferpool.h"
+#include "responsecache.h"
 #include "forwarderconnection.h"
+#include "environmentblock.h"
+#include "requestdelegation.h"
+#include "bodyspool.h"
+#include "windowsauthtokencache.h"
+#include "clientcertcache.h"
+#include "loopbackhttpclient.h"
 #include "serverprocess.h"
+#include "jobnotificationport.h"
+#include "portallocator.h"
+#include "rapidfailbreaker.h"
+#include "webgardenregistry.h"
 #include "processmanager.h"
 #include "forwardinghandler.h"
 #include "outprocessapplication.h"
@@ -110,6 +130,7 @@ extern BOOL       g_fAsyncDisconnectAvailable;
 extern BOOL       g_fWinHttpNonBlockingCallbackAvailable;
 extern BOOL       g_fWebSocketStaticInitialize;
 extern BOOL       g_fEnableReferenceCountTracing;
+extern BOOL       g_fCaptureReferenceCountStacks;
 extern BOOL       g_fProcessDetach;
 extern DWORD      g_dwActiveServerProcesses;
 extern DWORD      g_OptionalWinHttpFlags;
@@ -31,7 +31,7 @@ Arguments:
     pfSecure - SSL to be used in forwarding?
     pstrDestination - destination
     pDestinationPort - port
-    pstrUrl - URL
+    pstrUrl - URL, optional
 
 Return Value:
 
@@ -68,12 +68,18 @@ Return Value:
     LPCWSTR pszSlash = wcschr(pszDestinationUrl, L'/');
     if (pszSlash == NULL)
     {
-        RETURN_IF_FAILED(pstrUrl->Copy(L"/", 1));
+        if (pstrUrl != NULL)
+        {
+            RETURN_IF_FAILED(pstrUrl->Copy(L"/", 1));
+        }
         RETURN_IF_FAILED(pstrDestination->Copy(pszDestinationUrl));
     }
     else
     {
-        RETURN_IF_FAILED(pstrUrl->Copy(pszSlash));
+        if (pstrUrl != NULL)
+        {
+            RETURN_IF_FAILED(pstrUrl->Copy(pszSlash));
+        }
         RETURN_IF_FAILED(pstrDestination->Copy(pszDestinationUrl,
                             (DWORD)(pszSlash - pszDestinationUrl)));
     }
@@ -89,18 +95,73 @@ Return Value:
             (ch) - L'A' + 10                            \
         : (ch) - L'0')
 
+//
+// Number of leading characters of pch that are not '?', the only character
+// EscapeAbsPath rewrites. Tests 8 characters at once where SSE2 is there.
+//
+static
+DWORD
+CountUntilQuestionMark(
+    __in_ecount(cch) LPCWSTR    pch,
+    DWORD                       cch
+)
+{
+    DWORD i = 0;
+
+#if defined(_M_IX86) || defined(_M_X64)
+    const __m128i questionMark = _mm_set1_epi16(L'?');
+
+    for ( ; i + 8 <= cch; i += 8)
+    {
+        const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pch + i));
+        const int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(chars, questionMark));
+        if (mask != 0)
+        {
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return i + index / sizeof(WCHAR);
+        }
+    }
+#endif
+
+    while (i < cch && pch[i] != L'?')
+    {
+        i++;
+    }
+
+    return i;
+}
+
 HRESULT
 URL_UTILITY::EscapeAbsPath(
-    IHttpRequest * pRequest,
-    STRU * strEscapedUrl
+    const IHttpRequest * pRequest,
+    STRU * strEscapedUrl,
+    _Out_ PCWSTR * ppszEscapedUrl
 )
 {
+    const HTTP_COOKED_URL & cookedUrl = pRequest->GetRawHttpRequest()->CookedUrl;
+    const DWORD             cchAbsPath = cookedUrl.AbsPathLength / sizeof(WCHAR);
+    const DWORD             cchQueryString = cookedUrl.QueryStringLength / sizeof(WCHAR);
     STRU    strAbsPath;
     LPCWSTR pszAbsPath = NULL;
     LPCWSTR pszFindStr = NULL;
 
-    RETURN_IF_FAILED(strAbsPath.Copy( pRequest->GetRawHttpRequest()->CookedUrl.pAbsPath,
-        pRequest->GetRawHttpRequest()->CookedUrl.AbsPathLength / sizeof(WCHAR) ));
+    *ppszEscapedUrl = NULL;
+
+    //
+    // The query string follows the absolute path up to the end of the full
+    // URL, so without a '?' decoded into the path the two already are the
+    // URL to send.
+    //
+    if (CountUntilQuestionMark(cookedUrl.pAbsPath, cchAbsPath) == cchAbsPath &&
+        (cchQueryString == 0 || cookedUrl.pQueryString == cookedUrl.pAbsPath + cchAbsPath) &&
+        cookedUrl.pAbsPath[cchAbsPath + cchQueryString] == L'\0')
+    {
+        *ppszEscapedUrl = cookedUrl.pAbsPath;
+        return S_OK;
+    }
+
+    RETURN_IF_FAILED(strAbsPath.Copy(cookedUrl.pAbsPath, cchAbsPath));
 
     pszAbsPath = strAbsPath.QueryStr();
     pszFindStr = wcschr(pszAbsPath, L'?');
@@ -114,9 +175,8 @@ URL_UTILITY::EscapeAbsPath(
     }
 
     RETURN_IF_FAILED(strEscapedUrl->Append(pszAbsPath));
-    RETURN_IF_FAILED(strEscapedUrl->Append(pRequest->GetRawHttpRequest()->CookedUrl.pQueryString,
-                          pRequest->GetRawHttpRequest()->CookedUrl.QueryStringLength / sizeof(WCHAR)));
+    RETURN_IF_FAILED(strEscapedUrl->Append(cookedUrl.pQueryString, cchQueryString));
 
+    *ppszEscapedUrl = strEscapedUrl->QueryStr();
     return S_OK;
 }
-
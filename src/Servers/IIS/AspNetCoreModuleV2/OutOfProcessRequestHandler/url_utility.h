@@ -12,19 +12,29 @@ class URL_UTILITY
 {
 public:
 
+    //
+    // pstrUrl may be NULL when only the destination is needed.
+    //
     static
     HRESULT
     SplitUrl(
         PCWSTR pszDestinationUrl,
         BOOL *pfSecure,
         STRU *pstrDestination,
-        STRU *pstrUrl
+        _Out_opt_ STRU *pstrUrl
     );
 
+    //
+    // Sets *ppszEscapedUrl to the absolute path and query string of the
+    // request as sent to the backend. Most paths need no escaping, then it
+    // points into the cooked URL of the request and strEscapedUrl is left
+    // alone; otherwise the URL is built in strEscapedUrl.
+    //
     static HRESULT
     EscapeAbsPath(
-        IHttpRequest * pRequest,
-        STRU * strEscapedUrl
+        const IHttpRequest * pRequest,
+        STRU * strEscapedUrl,
+        _Out_ PCWSTR * ppszEscapedUrl
     );
 };
 
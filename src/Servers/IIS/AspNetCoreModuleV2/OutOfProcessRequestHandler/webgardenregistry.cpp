@@ -0,0 +1,205 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "webgardenregistry.h"
+
+WEB_GARDEN_REGISTRY::WEB_GARDEN_REGISTRY() :
+    m_hSection(NULL),
+    m_pSection(NULL),
+    m_cSlots(0)
+{
+    for (DWORD i = 0; i < MAX_WEB_GARDEN_SLOTS; ++i)
+    {
+        m_rghSlotMutexes[i] = NULL;
+    }
+}
+
+WEB_GARDEN_REGISTRY::~WEB_GARDEN_REGISTRY()
+{
+    for (DWORD i = 0; i < m_cSlots; ++i)
+    {
+        if (m_rghSlotMutexes[i] != NULL)
+        {
+            CloseHandle(m_rghSlotMutexes[i]);
+            m_rghSlotMutexes[i] = NULL;
+        }
+    }
+
+    if (m_pSection != NULL)
+    {
+        UnmapViewOfFile(m_pSection);
+        m_pSection = NULL;
+    }
+
+    if (m_hSection != NULL)
+    {
+        CloseHandle(m_hSection);
+        m_hSection = NULL;
+    }
+}
+
+HRESULT
+WEB_GARDEN_REGISTRY::Initialize(
+    _In_ PCWSTR     pszAppPoolName,
+    _In_ PCWSTR     pszApplicationPath,
+    DWORD           cSlots
+)
+{
+    STRU    struName;
+    STRU    struMutexName;
+
+    //
+    // Named after the application pool and the application, hashed as
+    // object names are limited in length and can't contain '\'.
+    //
+    ULONGLONG ullHash = 14695981039346656037ULL;
+    auto hash = [&ullHash](PCWSTR psz)
+    {
+        for (; *psz != L'\0'; ++psz)
+        {
+            ullHash ^= towlower(*psz);
+            ullHash *= 1099511628211ULL;
+        }
+        ullHash ^= L'|';
+        ullHash *= 1099511628211ULL;
+    };
+    hash(pszAppPoolName);
+    hash(pszApplicationPath);
+
+    RETURN_IF_FAILED(struName.SafeSnwprintf(L"%s%016I64x", WEB_GARDEN_NAME_PREFIX, ullHash));
+
+    m_hSection = CreateFileMapping(INVALID_HANDLE_VALUE,
+        NULL,
+        PAGE_READWRITE,
+        0,
+        sizeof(SECTION),
+        struName.QueryStr());
+    RETURN_LAST_ERROR_IF_NULL(m_hSection);
+
+    m_pSection = static_cast<SECTION*>(MapViewOfFile(m_hSection, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, sizeof(SECTION)));
+    RETURN_LAST_ERROR_IF_NULL(m_pSection);
+
+    m_cSlots = min(cSlots, MAX_WEB_GARDEN_SLOTS);
+    for (DWORD i = 0; i < m_cSlots; ++i)
+    {
+        RETURN_IF_FAILED(struMutexName.SafeSnwprintf(L"%s_%u", struName.QueryStr(), i));
+
+        m_rghSlotMutexes[i] = CreateMutex(NULL, FALSE, struMutexName.QueryStr());
+        RETURN_LAST_ERROR_IF_NULL(m_rghSlotMutexes[i]);
+    }
+
+    return S_OK;
+}
+
+HRESULT
+WEB_GARDEN_REGISTRY::LockSlot(
+    DWORD           dwSlot,
+    DWORD           dwTimeoutInMS
+)
+{
+    if (dwSlot >= m_cSlots)
+    {
+        RETURN_HR(E_INVALIDARG);
+    }
+
+    switch (WaitForSingleObject(m_rghSlotMutexes[dwSlot], dwTimeoutInMS))
+    {
+    case WAIT_OBJECT_0:
+        return S_OK;
+
+    case WAIT_ABANDONED:
+        //
+        // The previous leader exited while starting the backend, the
+        // record is checked for a live process before it is used anyway.
+        //
+        LOG_INFOF(L"Took over the abandoned lead on web garden slot %u", dwSlot);
+        return S_OK;
+
+    case WAIT_TIMEOUT:
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_TIMEOUT));
+
+    default:
+        RETURN_LAST_ERROR();
+    }
+}
+
+VOID
+WEB_GARDEN_REGISTRY::UnlockSlot(
+    DWORD           dwSlot
+)
+{
+    if (dwSlot < m_cSlots)
+    {
+        ReleaseMutex(m_rghSlotMutexes[dwSlot]);
+    }
+}
+
+BOOL
+WEB_GARDEN_REGISTRY::TryGetBackend(
+    DWORD           dwSlot,
+    _Out_ BACKEND  *pBackend
+)
+{
+    if (dwSlot >= m_cSlots)
+    {
+        return FALSE;
+    }
+
+    *pBackend = m_pSection->rgBackends[dwSlot];
+
+    if (pBackend->dwListeningProcessId == 0 ||
+        pBackend->dwOwnerProcessId == GetCurrentProcessId())
+    {
+        // A process of our own would be known to the process manager.
+        return FALSE;
+    }
+
+    // Terminated with the null character, the section may be stale.
+    pBackend->rgchToken[MAX_WEB_GARDEN_TOKEN_CHARS] = '\0';
+
+    HANDLE hProcess = OpenProcess(SYNCHRONIZE, FALSE, pBackend->dwListeningProcessId);
+    if (hProcess == NULL)
+    {
+        return FALSE;
+    }
+
+    const BOOL fRunning = WaitForSingleObject(hProcess, 0) == WAIT_TIMEOUT;
+    CloseHandle(hProcess);
+
+    return fRunning;
+}
+
+HRESULT
+WEB_GARDEN_REGISTRY::RecordBackend(
+    DWORD           dwSlot,
+    DWORD           dwListeningProcessId,
+    DWORD           dwPort,
+    _In_ PCSTR      pszToken
+)
+{
+    if (dwSlot >= m_cSlots)
+    {
+        RETURN_HR(E_INVALIDARG);
+    }
+
+    BACKEND& backend = m_pSection->rgBackends[dwSlot];
+
+    const size_t cchToken = strlen(pszToken);
+    if (cchToken > MAX_WEB_GARDEN_TOKEN_CHARS)
+    {
+        //
+        // A configured ASPNETCORE_TOKEN too long to share, the other
+        // workers start backends of their own.
+        //
+        backend.dwListeningProcessId = 0;
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER));
+    }
+
+    memcpy(backend.rgchToken, pszToken, cchToken + 1);
+    backend.dwOwnerProcessId = GetCurrentProcessId();
+    backend.dwListeningProcessId = dwListeningProcessId;
+    backend.dwPort = dwPort;
+    backend.dwGeneration++;
+
+    return S_OK;
+}
@@ -0,0 +1,107 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#define MAX_WEB_GARDEN_SLOTS                        100
+// Characters of the ASPNETCORE_TOKEN of a shared backend, a GUID by default.
+#define MAX_WEB_GARDEN_TOKEN_CHARS                  63
+#define WEB_GARDEN_NAME_PREFIX                      L"Local\\AspNetCoreModule_Garden_"
+
+//
+// Lets the worker processes of a web garden share the backend processes of
+// an application instead of each starting processesPerApplication of its
+// own. The workers of the application pool open the same named section,
+// which records for each process slot the backend that serves it: the
+// worker that started it, the process listening, its port and its token.
+//
+// A named mutex per slot gives one worker at a time the lead on the slot.
+// The leader either finds a live backend recorded and attaches to it, or
+// starts one and records it. A worker that exits while holding the mutex
+// abandons it, which hands the lead to the next one.
+//
+// A backend is in the job object of the worker that started it and exits
+// with it. The other workers watch the listening process, see it exit like
+// a crash and the next of them to need the slot starts a replacement.
+//
+class WEB_GARDEN_REGISTRY
+{
+public:
+
+    struct BACKEND
+    {
+        DWORD   dwOwnerProcessId;
+        DWORD   dwListeningProcessId;
+        DWORD   dwPort;
+        // Incremented every time a backend is recorded for the slot.
+        DWORD   dwGeneration;
+        CHAR    rgchToken[MAX_WEB_GARDEN_TOKEN_CHARS + 1];
+    };
+
+    WEB_GARDEN_REGISTRY();
+
+    ~WEB_GARDEN_REGISTRY();
+
+    HRESULT
+    Initialize(
+        _In_ PCWSTR     pszAppPoolName,
+        _In_ PCWSTR     pszApplicationPath,
+        DWORD           cSlots
+    );
+
+    DWORD
+    QuerySlotCount() const
+    {
+        return m_cSlots;
+    }
+
+    //
+    // Waits at most dwTimeoutInMS for the lead on dwSlot. The calling
+    // thread holds it until it calls UnlockSlot.
+    //
+    HRESULT
+    LockSlot(
+        DWORD           dwSlot,
+        DWORD           dwTimeoutInMS
+    );
+
+    VOID
+    UnlockSlot(
+        DWORD           dwSlot
+    );
+
+    //
+    // Returns TRUE if a backend whose listening process still runs is
+    // recorded for dwSlot. Called with the slot locked.
+    //
+    BOOL
+    TryGetBackend(
+        DWORD           dwSlot,
+        _Out_ BACKEND  *pBackend
+    );
+
+    //
+    // Records the backend this worker started for dwSlot. Called with the
+    // slot locked.
+    //
+    HRESULT
+    RecordBackend(
+        DWORD           dwSlot,
+        DWORD           dwListeningProcessId,
+        DWORD           dwPort,
+        _In_ PCSTR      pszToken
+    );
+
+private:
+
+    // Zero filled by the worker that creates it.
+    struct SECTION
+    {
+        BACKEND rgBackends[MAX_WEB_GARDEN_SLOTS];
+    };
+
+    HANDLE              m_hSection;
+    SECTION            *m_pSection;
+    DWORD               m_cSlots;
+    HANDLE              m_rghSlotMutexes[MAX_WEB_GARDEN_SLOTS];
+};
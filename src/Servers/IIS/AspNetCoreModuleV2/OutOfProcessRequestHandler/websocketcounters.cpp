@@ -0,0 +1,116 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "websocketcounters.h"
+#include "exceptions.h"
+
+WEBSOCKET_COUNTERS::WEBSOCKET_COUNTERS() :
+    m_pCounters(NULL)
+{
+}
+
+WEBSOCKET_COUNTERS::~WEBSOCKET_COUNTERS()
+{
+    if (m_pCounters != NULL)
+    {
+        m_pCounters->Dispose();
+        m_pCounters = NULL;
+    }
+}
+
+HRESULT
+WEBSOCKET_COUNTERS::Initialize(
+    VOID
+)
+{
+    if (m_pCounters == NULL)
+    {
+        RETURN_IF_FAILED(PER_CPU<SNAPSHOT>::Create([](SNAPSHOT* pCounters) { ZeroMemory(pCounters, sizeof(*pCounters)); },
+            &m_pCounters));
+    }
+
+    return S_OK;
+}
+
+//
+// A thread may move to another CPU between GetLocal and the update, the
+// updates are interlocked so that the block stays consistent when it does.
+//
+
+VOID
+WEBSOCKET_COUNTERS::ConnectionOpened(
+    VOID
+)
+{
+    if (m_pCounters == NULL)
+    {
+        return;
+    }
+
+    SNAPSHOT* pCounters = m_pCounters->GetLocal();
+    InterlockedIncrement64(&pCounters->cActiveConnections);
+    InterlockedIncrement64(&pCounters->cTotalConnections);
+}
+
+VOID
+WEBSOCKET_COUNTERS::ConnectionClosed(
+    VOID
+)
+{
+    if (m_pCounters == NULL)
+    {
+        return;
+    }
+
+    // The block of another CPU may go negative, only the sum is meaningful.
+    InterlockedDecrement64(&m_pCounters->GetLocal()->cActiveConnections);
+}
+
+VOID
+WEBSOCKET_COUNTERS::RecordRelay(
+    DIRECTION   direction,
+    DWORD       cbData,
+    BOOL        fEndOfMessage,
+    LONG64      llRelayMicroseconds
+)
+{
+    if (m_pCounters == NULL)
+    {
+        return;
+    }
+
+    SNAPSHOT* pCounters = m_pCounters->GetLocal();
+    if (fEndOfMessage)
+    {
+        InterlockedIncrement64(&pCounters->rgcMessages[direction]);
+    }
+    InterlockedAdd64(&pCounters->rgcbBytes[direction], cbData);
+    InterlockedIncrement64(&pCounters->rgcRelays[direction]);
+    InterlockedAdd64(&pCounters->rgllRelayMicroseconds[direction], llRelayMicroseconds);
+}
+
+VOID
+WEBSOCKET_COUNTERS::QuerySnapshot(
+    _Out_ SNAPSHOT * pSnapshot
+)
+{
+    ZeroMemory(pSnapshot, sizeof(*pSnapshot));
+
+    if (m_pCounters == NULL)
+    {
+        return;
+    }
+
+    m_pCounters->ForEach([pSnapshot](SNAPSHOT* pCounters)
+    {
+        pSnapshot->cActiveConnections += pCounters->cActiveConnections;
+        pSnapshot->cTotalConnections += pCounters->cTotalConnections;
+        for (DWORD i = 0; i < DIRECTION_COUNT; ++i)
+        {
+            pSnapshot->rgcMessages[i] += pCounters->rgcMessages[i];
+            pSnapshot->rgcbBytes[i] += pCounters->rgcbBytes[i];
+            pSnapshot->rgcRelays[i] += pCounters->rgcRelays[i];
+            pSnapshot->rgllRelayMicroseconds[i] += pCounters->rgllRelayMicroseconds[i];
+        }
+    });
+}
@@ -0,0 +1,77 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// Totals of the WebSocket connections proxied for one application.
+//
+// Every CPU updates its own cache-line sized block, so that thousands of
+// connections relaying messages never contend on a shared counter; the
+// blocks are summed up when a snapshot is taken.
+//
+class WEBSOCKET_COUNTERS
+{
+public:
+
+    enum DIRECTION
+    {
+        TO_BACKEND = 0,
+        TO_CLIENT = 1,
+        DIRECTION_COUNT
+    };
+
+    struct SNAPSHOT
+    {
+        LONG64  cActiveConnections;
+        LONG64  cTotalConnections;
+        LONG64  rgcMessages[DIRECTION_COUNT];
+        LONG64  rgcbBytes[DIRECTION_COUNT];
+        LONG64  rgcRelays[DIRECTION_COUNT];
+        LONG64  rgllRelayMicroseconds[DIRECTION_COUNT];
+    };
+
+    WEBSOCKET_COUNTERS();
+
+    ~WEBSOCKET_COUNTERS();
+
+    HRESULT
+    Initialize(
+        VOID
+    );
+
+    VOID
+    ConnectionOpened(
+        VOID
+    );
+
+    VOID
+    ConnectionClosed(
+        VOID
+    );
+
+    //
+    // Accounts for one send relayed in the given direction, taking
+    // llRelayMicroseconds from the completion of the receive to the
+    // completion of the send.
+    //
+    VOID
+    RecordRelay(
+        DIRECTION   direction,
+        DWORD       cbData,
+        BOOL        fEndOfMessage,
+        LONG64      llRelayMicroseconds
+    );
+
+    VOID
+    QuerySnapshot(
+        _Out_ SNAPSHOT * pSnapshot
+    );
+
+private:
+
+    WEBSOCKET_COUNTERS(const WEBSOCKET_COUNTERS &);
+    void operator=(const WEBSOCKET_COUNTERS &);
+
+    PER_CPU<SNAPSHOT> *     m_pCounters;
+};
@@ -25,31 +25,103 @@ indicates the API completion from HTTP, and not necessarily over the network.
 
 This prevents the need for data buffering at the Asp.Net Core Module level.
 
+The read waiting for a message to start is posted with a small inline buffer,
+most connections are idle most of the time. Only when a message does not fit
+in it is a receive buffer borrowed from a shared pool, for as long as the rest
+of the message is being relayed.
+
+With fragment coalescing on, a fragment that is not the end of its message is
+not sent on right away; the next receive appends to it, and the fragments are
+sent as one once the message ends or the buffer is full. Message boundaries
+are never merged, so this only saves sends on messages that arrive in pieces.
+
+-----------------
+Teardown
+-----------------
+Closing is sequenced by a single state word instead of a lock: the cleanup
+flags, the cleanup reason and the outstanding IO count are all updated with
+interlocked operations. The first Cleanup records its reason and cancels the
+IO, completions stop issuing IO once they see it, and whichever completion
+brings the IO count to zero indicates completion to IIS. An IIS IO issued
+while a cleanup started is canceled again by the thread that issued it.
+
+-----------------
+Idle Connections
+-----------------
+Connections with an idle timeout are tracked in one timer wheel shared by the
+whole process and advanced by a single timer. Traffic only updates the
+connection's last activity time; the wheel is reorganized lazily when a slot
+comes up, which reclaims the connections that stayed idle for their timeout
+and moves the others to the slot of their new deadline.
+
+The same wheel enforces the slow client timeout. Nothing is read from WinHTTP
+while a send to IIS is outstanding, so memory per connection stays bounded by
+the receive buffer and a slow client pushes back on the backend through TCP;
+a client that doesn't accept a send within the timeout is disconnected.
+
 --*/
 
 #include "websockethandler.h"
 #include "exceptions.h"
+#include "SRWExclusiveLock.h"
 
 SRWLOCK WEBSOCKET_HANDLER::sm_RequestsListLock;
 
 LIST_ENTRY WEBSOCKET_HANDLER::sm_RequestsListHead;
 
-TRACE_LOG * WEBSOCKET_HANDLER::sm_pTraceLog;
+PER_CPU_REF_TRACE_LOG * WEBSOCKET_HANDLER::sm_pTraceLog;
+
+RESPONSE_BUFFER_POOL * WEBSOCKET_HANDLER::sm_pReceiveBufferPool;
+
+LONGLONG WEBSOCKET_HANDLER::sm_llPerformanceFrequency;
+
+SRWLOCK WEBSOCKET_HANDLER::sm_IdleWheelLock;
+
+LIST_ENTRY WEBSOCKET_HANDLER::sm_rgIdleWheel[WEBSOCKET_HANDLER::IDLE_WHEEL_SLOTS];
+
+ULONGLONG WEBSOCKET_HANDLER::sm_ullIdleWheelNextTick;
+
+STTIMER * WEBSOCKET_HANDLER::sm_pIdleTimer;
+
+volatile LONG WEBSOCKET_HANDLER::sm_lIdleTimerStarted;
 
 WEBSOCKET_HANDLER::WEBSOCKET_HANDLER() :
     _pHttpContext(NULL),
     _pWebSocketContext(NULL),
     _hWebSocketRequest(NULL),
     _pHandler(NULL),
-    _dwOutstandingIo(0),
-    _fCleanupInProgress(FALSE),
-    _fIndicateCompletionToIis(FALSE),
-    _fHandleClosed(FALSE),
-    _fReceivedCloseMsg(FALSE)
+    _cbReceiveBuffer(RECEIVE_BUFFER_SIZE),
+    _fCoalesceFragments(FALSE),
+    _cbMaxMessage(0),
+    _pCounters(NULL),
+    _connectionCounters(),
+    _pApplicationCounters(NULL),
+    _llConnected(0),
+    _fConnectionCounted(FALSE),
+    _cRefs(1),
+    _fInIdleWheel(FALSE),
+    _fIdleWheelClosed(FALSE),
+    _dwIdleTimeoutInMS(0),
+    _ullLastActivity(0),
+    _dwSlowClientTimeoutInMS(0),
+    _ullClientSendStarted(0),
+    _lState(0)
 {
     LOG_TRACE(L"WEBSOCKET_HANDLER::WEBSOCKET_HANDLER");
 
-    InitializeCriticalSectionAndSpinCount(&_RequestLock, 1000);
+    for (RECEIVE_BUFFER * pReceiveBuffer : { &_WinHttpReceiveBuffer, &_IisReceiveBuffer })
+    {
+        pReceiveBuffer->pBuffer = pReceiveBuffer->rgIdleBuffer;
+        pReceiveBuffer->cbBuffer = IDLE_RECEIVE_BUFFER_SIZE;
+        pReceiveBuffer->cbPending = 0;
+        pReceiveBuffer->cbInFlight = 0;
+        pReceiveBuffer->fEndOfMessage = FALSE;
+        pReceiveBuffer->liReceiveCompleted.QuadPart = 0;
+        pReceiveBuffer->pPooledBuffer = NULL;
+        pReceiveBuffer->fMessageInProgress = FALSE;
+        pReceiveBuffer->cbMessage = 0;
+    }
+
     InsertRequest();
 }
 
@@ -57,28 +129,284 @@ VOID
 WEBSOCKET_HANDLER::Terminate(
     VOID
     )
+/*++
+
+    Routine Description:
+
+    Release the connection once the forwarding handler is done with it.
+    The IO is only torn down here if the connection did not complete
+    through IndicateCompletionToIIS already.
+
+--*/
 {
+    LONG lState;
+
     LOG_TRACE(L"WEBSOCKET_HANDLER::Terminate");
-    if (!_fHandleClosed)
+
+    lState = InterlockedOr(&_lState, STATE_CLEANUP | STATE_TERMINATED);
+    if (lState & STATE_TERMINATED)
     {
-    RemoveRequest();
-    _fCleanupInProgress = TRUE;
+        return;
+    }
 
-    if (_pHttpContext != NULL)
+    //
+    // No cancel starts once terminated, wait for one in progress to be done
+    // with the contexts before they are released.
+    //
+    while (_lState & STATE_CANCEL_ACTIVE)
     {
-        _pHttpContext->CancelIo();
-        _pHttpContext = NULL;
+        SwitchToThread();
     }
-    if (_hWebSocketRequest)
+
+    RemoveFromIdleWheel();
+    ReportConnectionEnd();
+    RemoveRequest();
+
+    if (!(lState & STATE_HANDLE_CLOSED))
     {
-        WinHttpCloseHandle(_hWebSocketRequest);
-        _hWebSocketRequest = NULL;
+        if (_pHttpContext != NULL)
+        {
+            _pHttpContext->CancelIo();
+        }
+        if (_hWebSocketRequest)
+        {
+            WinHttpCloseHandle(_hWebSocketRequest);
+            _hWebSocketRequest = NULL;
+        }
     }
 
+    _pHttpContext = NULL;
     _pWebSocketContext = NULL;
-    DeleteCriticalSection(&_RequestLock);
+    ReleaseReceiveBuffer(&_WinHttpReceiveBuffer);
+    ReleaseReceiveBuffer(&_IisReceiveBuffer);
+
+    DereferenceHandler();
+}
 
-    delete this;
+VOID
+WEBSOCKET_HANDLER::ReferenceHandler(
+    VOID
+    )
+{
+    InterlockedIncrement(&_cRefs);
+}
+
+VOID
+WEBSOCKET_HANDLER::DereferenceHandler(
+    VOID
+    )
+{
+    if (InterlockedDecrement(&_cRefs) == 0)
+    {
+        delete this;
+    }
+}
+
+//static
+LIST_ENTRY *
+WEBSOCKET_HANDLER::QueryIdleWheelSlot(
+    ULONGLONG   ullTick
+    )
+{
+    return &sm_rgIdleWheel[ullTick % IDLE_WHEEL_SLOTS];
+}
+
+ULONGLONG
+WEBSOCKET_HANDLER::QueryTimeoutDeadline(
+    ULONGLONG       ullNow,
+    CleanupReason * pReason
+    ) const
+{
+    ULONGLONG ullDeadline = MAXULONGLONG;
+
+    *pReason = IdleTimeout;
+
+    if (_dwIdleTimeoutInMS != 0)
+    {
+        ullDeadline = _ullLastActivity + _dwIdleTimeoutInMS;
+    }
+
+    if (_dwSlowClientTimeoutInMS != 0)
+    {
+        //
+        // Without a send in progress, the earliest one starts now.
+        //
+        const ULONGLONG ullClientSendStarted = _ullClientSendStarted;
+        const ULONGLONG ullSlowClientDeadline =
+            (ullClientSendStarted != 0 ? ullClientSendStarted : ullNow + 1) + _dwSlowClientTimeoutInMS;
+
+        if (ullSlowClientDeadline < ullDeadline)
+        {
+            ullDeadline = ullSlowClientDeadline;
+            *pReason = SlowClient;
+        }
+    }
+
+    return ullDeadline;
+}
+
+VOID
+WEBSOCKET_HANDLER::InsertIntoIdleWheel(
+    VOID
+    )
+/*++
+
+    Routine Description:
+
+    Start tracking the connection for its timeouts, called once the
+    upgrade completed. Consumes the reference ProcessRequest took for
+    the wheel.
+
+--*/
+{
+    CleanupReason reason;
+
+    if (!QueryTimeoutsEnabled())
+    {
+        return;
+    }
+
+    _ullLastActivity = GetTickCount64();
+
+    if (InterlockedCompareExchange(&sm_lIdleTimerStarted, 1L, 0L) == 0L)
+    {
+        {
+            SRWExclusiveLock lock(sm_IdleWheelLock);
+            sm_ullIdleWheelNextTick = _ullLastActivity / IDLE_WHEEL_TICK_MS;
+        }
+
+        sm_pIdleTimer = new STTIMER();
+        if (sm_pIdleTimer == NULL ||
+            FAILED_LOG(sm_pIdleTimer->InitializeTimer(IdleTimerCallback, NULL, IDLE_WHEEL_TICK_MS, IDLE_WHEEL_TICK_MS)))
+        {
+            // Connections are still tracked, just never reclaimed.
+            LOG_WARN(L"WEBSOCKET_HANDLER: idle connections can't be reclaimed, the idle timer could not be created.");
+        }
+    }
+
+    {
+        SRWExclusiveLock lock(sm_IdleWheelLock);
+        if (!_fIdleWheelClosed)
+        {
+            InsertTailList(QueryIdleWheelSlot(
+                max(QueryTimeoutDeadline(_ullLastActivity, &reason) / IDLE_WHEEL_TICK_MS, sm_ullIdleWheelNextTick)),
+                &_idleListEntry);
+            _fInIdleWheel = TRUE;
+            return;
+        }
+    }
+
+    // The connection ended before it could be tracked.
+    DereferenceHandler();
+}
+
+VOID
+WEBSOCKET_HANDLER::RemoveFromIdleWheel(
+    VOID
+    )
+{
+    BOOL fInIdleWheel = FALSE;
+
+    {
+        SRWExclusiveLock lock(sm_IdleWheelLock);
+        _fIdleWheelClosed = TRUE;
+        if (_fInIdleWheel)
+        {
+            RemoveEntryList(&_idleListEntry);
+            _fInIdleWheel = FALSE;
+            fInIdleWheel = TRUE;
+        }
+    }
+
+    if (fInIdleWheel)
+    {
+        DereferenceHandler();
+    }
+}
+
+//static
+VOID
+CALLBACK
+WEBSOCKET_HANDLER::IdleTimerCallback(
+    _In_ PTP_CALLBACK_INSTANCE  Instance,
+    _In_ PVOID                  pContext,
+    _In_ PTP_TIMER              pTimer
+    )
+/*++
+
+    Routine Description:
+
+    Advance the idle wheel to the current tick, catching up on at most one
+    revolution if the thread pool was late. The connections of every slot
+    passed either have timed out and are cleaned up, outside of the wheel
+    lock, or move to the slot of their new deadline.
+
+--*/
+{
+    UNREFERENCED_PARAMETER(Instance);
+    UNREFERENCED_PARAMETER(pContext);
+    UNREFERENCED_PARAMETER(pTimer);
+
+    LIST_ENTRY          expiredList;
+    LIST_ENTRY          slotList;
+    CleanupReason       reason;
+    const ULONGLONG     ullNow = GetTickCount64();
+    const ULONGLONG     ullNowTick = ullNow / IDLE_WHEEL_TICK_MS;
+
+    InitializeListHead(&expiredList);
+    InitializeListHead(&slotList);
+
+    {
+        SRWExclusiveLock lock(sm_IdleWheelLock);
+
+        for (DWORD cSlots = 0;
+             sm_ullIdleWheelNextTick <= ullNowTick && cSlots < IDLE_WHEEL_SLOTS;
+             ++cSlots, ++sm_ullIdleWheelNextTick)
+        {
+            LIST_ENTRY * pSlot = QueryIdleWheelSlot(sm_ullIdleWheelNextTick);
+
+            //
+            // Detach the slot first, a connection may land in it again.
+            //
+            while (!IsListEmpty(pSlot))
+            {
+                InsertTailList(&slotList, RemoveHeadList(pSlot));
+            }
+
+            while (!IsListEmpty(&slotList))
+            {
+                LIST_ENTRY * pEntry = RemoveHeadList(&slotList);
+                WEBSOCKET_HANDLER * pHandler = CONTAINING_RECORD(pEntry, WEBSOCKET_HANDLER, _idleListEntry);
+                const ULONGLONG ullDeadline = pHandler->QueryTimeoutDeadline(ullNow, &reason);
+
+                if (ullDeadline <= ullNow)
+                {
+                    // The wheel's reference moves to the expired list.
+                    pHandler->_fInIdleWheel = FALSE;
+                    InsertTailList(&expiredList, pEntry);
+                }
+                else
+                {
+                    InsertTailList(QueryIdleWheelSlot(
+                        max(ullDeadline / IDLE_WHEEL_TICK_MS, sm_ullIdleWheelNextTick + 1)),
+                        pEntry);
+                }
+            }
+        }
+    }
+
+    while (!IsListEmpty(&expiredList))
+    {
+        WEBSOCKET_HANDLER * pHandler = CONTAINING_RECORD(RemoveHeadList(&expiredList), WEBSOCKET_HANDLER, _idleListEntry);
+
+        pHandler->QueryTimeoutDeadline(ullNow, &reason);
+
+        LOG_TRACEF(L"WEBSOCKET_HANDLER::IdleTimerCallback reclaiming connection with reason %d, idle for %llu ms",
+            reason,
+            ullNow - pHandler->_ullLastActivity);
+
+        pHandler->Cleanup(reason);
+        pHandler->DereferenceHandler();
     }
 }
 
@@ -107,11 +435,41 @@ WEBSOCKET_HANDLER::StaticInitialize(
         // for debugging purposes.
         //
         InitializeListHead (&sm_RequestsListHead);
-        sm_pTraceLog = CreateRefTraceLog( 10000, 0 );
+        LOG_IF_FAILED(PER_CPU_REF_TRACE_LOG::Create(REF_TRACE_ENTRIES_PER_PROCESSOR,
+            g_fCaptureReferenceCountStacks,
+            &sm_pTraceLog));
     }
 
     InitializeSRWLock(&sm_RequestsListLock);
 
+    InitializeSRWLock(&sm_IdleWheelLock);
+    for (DWORD i = 0; i < IDLE_WHEEL_SLOTS; ++i)
+    {
+        InitializeListHead(&sm_rgIdleWheel[i]);
+    }
+
+    LARGE_INTEGER liFrequency;
+    QueryPerformanceFrequency(&liFrequency);
+    sm_llPerformanceFrequency = liFrequency.QuadPart;
+
+    //
+    // Shared by every connection, sized classes cover whatever
+    // webSocketReceiveBufferSize the applications configure.
+    //
+    sm_pReceiveBufferPool = new RESPONSE_BUFFER_POOL;
+    if (sm_pReceiveBufferPool == NULL)
+    {
+        RETURN_HR(E_OUTOFMEMORY);
+    }
+
+    HRESULT hr = sm_pReceiveBufferPool->Initialize(IDLE_RECEIVE_BUFFER_SIZE * 8, MAX_RECEIVE_BUFFER_SIZE, 64); // nThreshold
+    if (FAILED(hr))
+    {
+        delete sm_pReceiveBufferPool;
+        sm_pReceiveBufferPool = NULL;
+        RETURN_HR(hr);
+    }
+
     return S_OK;
 }
 
@@ -128,9 +486,226 @@ WEBSOCKET_HANDLER::StaticTerminate(
 
     if (sm_pTraceLog)
     {
-        DestroyRefTraceLog(sm_pTraceLog);
+        sm_pTraceLog->Destroy();
         sm_pTraceLog = NULL;
     }
+
+    if (sm_pIdleTimer != NULL)
+    {
+        //
+        // Only stop new callbacks, waiting for one in progress could dead
+        // lock under the loader lock. The timer is left to the process exit.
+        //
+        sm_pIdleTimer->SetTimer(0);
+    }
+
+    if (sm_pReceiveBufferPool != NULL)
+    {
+        delete sm_pReceiveBufferPool;
+        sm_pReceiveBufferPool = NULL;
+    }
+}
+
+VOID
+WEBSOCKET_HANDLER::PrepareReceiveBuffer(
+    RECEIVE_BUFFER *    pReceiveBuffer
+    )
+/*++
+
+    Routine Description:
+
+    Pick the buffer for the next receive of one direction, called once
+    the previous receive's data was sent on.
+
+    While a message is in progress its remaining fragments are read into a
+    pooled buffer, falling back to the inline buffer if the pool is out of
+    memory. Otherwise the pooled buffer goes back to the pool and the
+    receive waits for the next message with the inline buffer.
+
+--*/
+{
+    if (pReceiveBuffer->fMessageInProgress)
+    {
+        if (pReceiveBuffer->pPooledBuffer == NULL)
+        {
+            pReceiveBuffer->pPooledBuffer = sm_pReceiveBufferPool->Alloc(_cbReceiveBuffer,
+                _pApplicationCounters,
+                APPLICATION_COUNTERS::MEMORY_TAG_WEBSOCKET_BUFFERS);
+        }
+
+        if (pReceiveBuffer->pPooledBuffer != NULL)
+        {
+            if (pReceiveBuffer->pBuffer != pReceiveBuffer->pPooledBuffer && pReceiveBuffer->cbPending != 0)
+            {
+                // Coalesced fragments move along with the receive.
+                memcpy(pReceiveBuffer->pPooledBuffer, pReceiveBuffer->pBuffer, pReceiveBuffer->cbPending);
+            }
+
+            pReceiveBuffer->pBuffer = pReceiveBuffer->pPooledBuffer;
+            pReceiveBuffer->cbBuffer = _cbReceiveBuffer;
+            return;
+        }
+    }
+    else
+    {
+        ReleaseReceiveBuffer(pReceiveBuffer);
+    }
+
+    pReceiveBuffer->pBuffer = pReceiveBuffer->rgIdleBuffer;
+    pReceiveBuffer->cbBuffer = IDLE_RECEIVE_BUFFER_SIZE;
+}
+
+BOOL
+WEBSOCKET_HANDLER::CoalesceFragment(
+    RECEIVE_BUFFER *    pReceiveBuffer,
+    DWORD               cbFragment
+    )
+/*++
+
+    Routine Description:
+
+    Account for a received fragment and decide whether it is held back for
+    the next receive to append to, rather than sent on. That is the case
+    while coalescing, in the middle of a message and with room left in the
+    buffer; the rest of a message sent in one go is typically already
+    buffered by then. Holding back never delays the end of a message.
+
+--*/
+{
+    pReceiveBuffer->cbPending += cbFragment;
+
+    if (!_fCoalesceFragments || !pReceiveBuffer->fMessageInProgress)
+    {
+        return FALSE;
+    }
+
+    PrepareReceiveBuffer(pReceiveBuffer);
+    return pReceiveBuffer->cbPending < pReceiveBuffer->cbBuffer;
+}
+
+//static
+LONG64
+WEBSOCKET_HANDLER::QueryMicrosecondsSince(
+    LONGLONG    llStart
+    )
+{
+    LARGE_INTEGER liNow;
+
+    if (llStart == 0)
+    {
+        return 0;
+    }
+
+    QueryPerformanceCounter(&liNow);
+    const LONGLONG llElapsed = liNow.QuadPart - llStart;
+
+    return (llElapsed / sm_llPerformanceFrequency) * 1000000 +
+        (llElapsed % sm_llPerformanceFrequency) * 1000000 / sm_llPerformanceFrequency;
+}
+
+VOID
+WEBSOCKET_HANDLER::RecordRelay(
+    WEBSOCKET_COUNTERS::DIRECTION   direction,
+    RECEIVE_BUFFER *                pReceiveBuffer
+    )
+/*++
+
+    Routine Description:
+
+    Account for a completed send of the data received into pReceiveBuffer.
+    Sends of one direction complete one at a time, so the connection's own
+    counters need no synchronization.
+
+--*/
+{
+    const LONG64 llRelayMicroseconds = QueryMicrosecondsSince(pReceiveBuffer->liReceiveCompleted.QuadPart);
+
+    if (pReceiveBuffer->fEndOfMessage)
+    {
+        _connectionCounters.rgcMessages[direction]++;
+    }
+    _connectionCounters.rgcbBytes[direction] += pReceiveBuffer->cbInFlight;
+    _connectionCounters.rgcRelays[direction]++;
+    _connectionCounters.rgllRelayMicroseconds[direction] += llRelayMicroseconds;
+
+    if (_pCounters != NULL)
+    {
+        _pCounters->RecordRelay(direction,
+            pReceiveBuffer->cbInFlight,
+            pReceiveBuffer->fEndOfMessage,
+            llRelayMicroseconds);
+    }
+}
+
+VOID
+WEBSOCKET_HANDLER::ReportConnectionEnd(
+    VOID
+    )
+/*++
+
+    Routine Description:
+
+    Take the connection off the open connections of the application and
+    publish its counters, with the application totals, through the
+    ANCM_WEBSOCKET_CONNECTION_END trace event.
+
+--*/
+{
+    if (!_fConnectionCounted)
+    {
+        return;
+    }
+    _fConnectionCounted = FALSE;
+
+    _pCounters->ConnectionClosed();
+
+    if (_pHttpContext == NULL ||
+        !ANCMEvents::ANCM_WEBSOCKET_CONNECTION_END::IsEnabled(_pHttpContext->GetTraceContext()))
+    {
+        return;
+    }
+
+    WEBSOCKET_COUNTERS::SNAPSHOT totals;
+    _pCounters->QuerySnapshot(&totals);
+
+    auto average = [](LONG64 llTotal, LONG64 cCount)
+    {
+        return static_cast<ULONG>(cCount == 0 ? 0 : min(llTotal / cCount, static_cast<LONG64>(MAXULONG)));
+    };
+
+    ANCMEvents::ANCM_WEBSOCKET_CONNECTION_END::RaiseEvent(
+        _pHttpContext->GetTraceContext(),
+        NULL,
+        static_cast<ULONG>(min(QueryMicrosecondsSince(_llConnected) / 1000, static_cast<LONG64>(MAXULONG))),
+        _connectionCounters.rgcMessages[WEBSOCKET_COUNTERS::TO_BACKEND],
+        _connectionCounters.rgcbBytes[WEBSOCKET_COUNTERS::TO_BACKEND],
+        _connectionCounters.rgcMessages[WEBSOCKET_COUNTERS::TO_CLIENT],
+        _connectionCounters.rgcbBytes[WEBSOCKET_COUNTERS::TO_CLIENT],
+        average(_connectionCounters.rgllRelayMicroseconds[WEBSOCKET_COUNTERS::TO_BACKEND],
+            _connectionCounters.rgcRelays[WEBSOCKET_COUNTERS::TO_BACKEND]),
+        average(_connectionCounters.rgllRelayMicroseconds[WEBSOCKET_COUNTERS::TO_CLIENT],
+            _connectionCounters.rgcRelays[WEBSOCKET_COUNTERS::TO_CLIENT]),
+        static_cast<ULONG>(max(totals.cActiveConnections, 0LL)),
+        totals.cTotalConnections,
+        totals.rgcMessages[WEBSOCKET_COUNTERS::TO_BACKEND],
+        totals.rgcbBytes[WEBSOCKET_COUNTERS::TO_BACKEND],
+        totals.rgcMessages[WEBSOCKET_COUNTERS::TO_CLIENT],
+        totals.rgcbBytes[WEBSOCKET_COUNTERS::TO_CLIENT]);
+}
+
+VOID
+WEBSOCKET_HANDLER::ReleaseReceiveBuffer(
+    RECEIVE_BUFFER *    pReceiveBuffer
+    )
+{
+    if (pReceiveBuffer->pPooledBuffer != NULL)
+    {
+        sm_pReceiveBufferPool->Free(pReceiveBuffer->pPooledBuffer);
+        pReceiveBuffer->pPooledBuffer = NULL;
+    }
+
+    pReceiveBuffer->pBuffer = pReceiveBuffer->rgIdleBuffer;
+    pReceiveBuffer->cbBuffer = IDLE_RECEIVE_BUFFER_SIZE;
 }
 
 VOID
@@ -165,10 +740,10 @@ WEBSOCKET_HANDLER::IncrementOutstandingIo(
     VOID
     )
 {
-    LONG dwOutstandingIo = InterlockedIncrement(&_dwOutstandingIo);
+    LONG lState = InterlockedAdd(&_lState, STATE_IO_UNIT);
     if (sm_pTraceLog)
     {
-        WriteRefTraceLog(sm_pTraceLog, dwOutstandingIo, this);
+        sm_pTraceLog->Write(lState >> STATE_IO_SHIFT, this);
     }
 }
 
@@ -182,18 +757,18 @@ WEBSOCKET_HANDLER::DecrementOutstandingIo(
 
     This indicates completion to IIS if all outstanding IO
     has been completed, and a Cleanup was triggered for this
-    connection (denoted by _fIndicateCompletionToIis).
+    connection (denoted by STATE_INDICATE_COMPLETION).
 
 --*/
 {
-    LONG dwOutstandingIo = InterlockedDecrement (&_dwOutstandingIo);
+    LONG lState = InterlockedAdd(&_lState, -STATE_IO_UNIT);
 
     if (sm_pTraceLog)
     {
-        WriteRefTraceLog(sm_pTraceLog, dwOutstandingIo, this);
+        sm_pTraceLog->Write(lState >> STATE_IO_SHIFT, this);
     }
 
-    if (dwOutstandingIo == 0 && _fIndicateCompletionToIis)
+    if ((lState >> STATE_IO_SHIFT) == 0 && (lState & STATE_INDICATE_COMPLETION))
     {
         IndicateCompletionToIIS();
     }
@@ -212,7 +787,10 @@ WEBSOCKET_HANDLER::IndicateCompletionToIIS(
 
 --*/
 {
-    LOG_TRACEF(L"WEBSOCKET_HANDLER::IndicateCompletionToIIS called %d", _dwOutstandingIo);
+    HINTERNET   hWebSocketRequest;
+    LONG        lState = _lState;
+
+    LOG_TRACEF(L"WEBSOCKET_HANDLER::IndicateCompletionToIIS called %d", lState >> STATE_IO_SHIFT);
 
     //
     // close Websocket handle. This will triger a WinHttp callback
@@ -220,15 +798,36 @@ WEBSOCKET_HANDLER::IndicateCompletionToIIS(
     // Make sure no pending IO as there is no IIS websocket cancelation,
     // any unexpected callback will lead to AV. Revisit it once CanelOutGoingIO works
     //
-    if (_hWebSocketRequest != NULL && _dwOutstandingIo == 0)
+    for (;;)
     {
-        LOG_TRACE(L"WEBSOCKET_HANDLER::IndicateCompletionToIIS");
+        if ((lState >> STATE_IO_SHIFT) != 0 ||
+            (lState & (STATE_HANDLE_CLOSED | STATE_TERMINATED)) ||
+            _hWebSocketRequest == NULL)
+        {
+            return;
+        }
 
-        _pHandler->SetStatus(FORWARDER_DONE);
-        _fHandleClosed = TRUE;
-        WinHttpCloseHandle(_hWebSocketRequest);
-        _hWebSocketRequest = NULL;
+        LONG lObserved = InterlockedCompareExchange(&_lState, lState | STATE_HANDLE_CLOSED, lState);
+        if (lObserved == lState)
+        {
+            break;
+        }
+        lState = lObserved;
     }
+
+    LOG_TRACE(L"WEBSOCKET_HANDLER::IndicateCompletionToIIS");
+
+    RemoveFromIdleWheel();
+    ReportConnectionEnd();
+
+    _pHandler->SetStatus(FORWARDER_DONE);
+
+    //
+    // The handle close callback may terminate the handler on this thread.
+    //
+    hWebSocketRequest = _hWebSocketRequest;
+    _hWebSocketRequest = NULL;
+    WinHttpCloseHandle(hWebSocketRequest);
 }
 
 HRESULT
@@ -236,6 +835,9 @@ WEBSOCKET_HANDLER::ProcessRequest(
     FORWARDING_HANDLER *pHandler,
     IHttpContext *pHttpContext,
     HINTERNET     hRequest,
+    REQUESTHANDLER_CONFIG * pConfig,
+    WEBSOCKET_COUNTERS * pCounters,
+    APPLICATION_COUNTERS * pApplicationCounters,
     BOOL*         pfHandleCreated
 )
 /*++
@@ -250,16 +852,43 @@ Routine Description:
     websocket handle to IIS's websocket context, and initiates IO
     in these two endpoints.
 
+    pConfig supplies the receive buffer size, fragment coalescing and idle
+    timeout of the application, pCounters receives its WebSocket counters
+    and pApplicationCounters the memory of the receive buffers.
 
 --*/
 {
     HRESULT hr = S_OK;
-    //DWORD dwBuffSize = RECEIVE_BUFFER_SIZE;
+    DWORD   cbReceiveBuffer = pConfig->QueryWebSocketReceiveBufferSize();
 
     *pfHandleCreated = FALSE;
     _pHandler = pHandler;
+    _fCoalesceFragments = pConfig->QueryWebSocketCoalesceFragments()->Equals(L"true", /* ignoreCase */ 1);
+    _dwIdleTimeoutInMS = pConfig->QueryWebSocketIdleTimeoutInMS();
+    _dwSlowClientTimeoutInMS = pConfig->QueryWebSocketSlowClientTimeoutInMS();
+    _cbMaxMessage = pConfig->QueryWebSocketMaxMessageSize();
+    _pApplicationCounters = pApplicationCounters;
+
+    if (cbReceiveBuffer != 0)
+    {
+        _cbReceiveBuffer = min(max(cbReceiveBuffer, IDLE_RECEIVE_BUFFER_SIZE), MAX_RECEIVE_BUFFER_SIZE);
+    }
+
+    if (QueryTimeoutsEnabled())
+    {
+        //
+        // Taken for the idle wheel before any IO is started, the connection
+        // may complete before ProcessRequest returns.
+        //
+        ReferenceHandler();
+    }
+
+    //
+    // Counted as an IO until the receives in both directions are issued,
+    // so that completions can't close the connection while it is set up.
+    //
+    IncrementOutstandingIo();
 
-    EnterCriticalSection(&_RequestLock);
     LOG_TRACEF(L"WEBSOCKET_HANDLER::ProcessRequest");
 
     //
@@ -300,37 +929,42 @@ Routine Description:
 
     *pfHandleCreated = TRUE;
 
+    if (pCounters != NULL)
+    {
+        LARGE_INTEGER liConnected;
+        QueryPerformanceCounter(&liConnected);
+        _llConnected = liConnected.QuadPart;
+
+        _pCounters = pCounters;
+        _pCounters->ConnectionOpened();
+        _fConnectionCounted = TRUE;
+    }
+
     //
     // Resize the send & receive buffers to be more conservative (and avoid DoS attacks).
     // NOTE: The two WinHTTP options below were added for WinBlue, so we can't
     // rely on their existence.
     //
+    if (cbReceiveBuffer != 0)
+    {
+        DWORD dwBuffSize = _cbReceiveBuffer;
 
-    //if (!WinHttpSetOption(_hWebSocketRequest,
-    //                      WINHTTP_OPTION_WEB_SOCKET_RECEIVE_BUFFER_SIZE,
-    //                      &dwBuffSize,
-    //                      sizeof(dwBuffSize)))
-    //{
-    //    DWORD dwRet = GetLastError();
-    //    if ( dwRet != ERROR_WINHTTP_INVALID_OPTION )
-    //    {
-    //        hr = HRESULT_FROM_WIN32(dwRet);
-    //        goto Finished;
-    //    }
-    //}
-
-    //if (!WinHttpSetOption(_hWebSocketRequest,
-    //                      WINHTTP_OPTION_WEB_SOCKET_SEND_BUFFER_SIZE,
-    //                      &dwBuffSize,
-    //                      sizeof(dwBuffSize)))
-    //{
-    //    DWORD dwRet = GetLastError();
-    //    if ( dwRet != ERROR_WINHTTP_INVALID_OPTION )
-    //    {
-    //        hr = HRESULT_FROM_WIN32(dwRet);
-    //        goto Finished;
-    //    }
-    //}
+        for (DWORD dwOption : { WINHTTP_OPTION_WEB_SOCKET_RECEIVE_BUFFER_SIZE, WINHTTP_OPTION_WEB_SOCKET_SEND_BUFFER_SIZE })
+        {
+            if (!WinHttpSetOption(_hWebSocketRequest,
+                                  dwOption,
+                                  &dwBuffSize,
+                                  sizeof(dwBuffSize)))
+            {
+                DWORD dwRet = GetLastError();
+                if ( dwRet != ERROR_WINHTTP_INVALID_OPTION )
+                {
+                    hr = HRESULT_FROM_WIN32(dwRet);
+                    goto Finished;
+                }
+            }
+        }
+    }
 
     //
     // Initiate Read on IIS
@@ -352,11 +986,24 @@ Routine Description:
     }
 
 Finished:
-    LeaveCriticalSection(&_RequestLock);
-
     if (FAILED_LOG(hr))
     {
         LOG_ERRORF(L"Process Request Failed with HR=%08x", hr);
+
+        //
+        // The forwarding handler tears down a failed upgrade.
+        //
+        InterlockedAdd(&_lState, -STATE_IO_UNIT);
+
+        if (QueryTimeoutsEnabled())
+        {
+            DereferenceHandler();
+        }
+    }
+    else
+    {
+        InsertIntoIdleWheel();
+        DecrementOutstandingIo();
     }
 
     return hr;
@@ -376,17 +1023,20 @@ Routine Description:
 --*/
 {
     HRESULT hr = S_OK;
-    DWORD   dwBufferSize = RECEIVE_BUFFER_SIZE;
+    DWORD   dwBufferSize;
     BOOL    fUtf8Encoded;
     BOOL    fFinalFragment;
     BOOL    fClose;
 
     LOG_TRACE(L"WEBSOCKET_HANDLER::DoIisWebSocketReceive");
 
+    PrepareReceiveBuffer(&_IisReceiveBuffer);
+    dwBufferSize = _IisReceiveBuffer.cbBuffer - _IisReceiveBuffer.cbPending;
+
     IncrementOutstandingIo();
 
     hr = _pWebSocketContext->ReadFragment(
-            &_IisReceiveBuffer,
+            _IisReceiveBuffer.pBuffer + _IisReceiveBuffer.cbPending,
             &dwBufferSize,
             TRUE,
             &fUtf8Encoded,
@@ -400,6 +1050,10 @@ Routine Description:
         DecrementOutstandingIo();
         LOG_ERRORF(L"WEBSOCKET_HANDLER::DoIisWebSocketSend failed with %08x", hr);
     }
+    else if (QueryCleanupInProgress())
+    {
+        CancelIoForCleanup(FALSE);
+    }
 
     return hr;
 }
@@ -422,12 +1076,14 @@ Routine Description:
 
     LOG_TRACE(L"WEBSOCKET_HANDLER::DoWinHttpWebSocketReceive");
 
+    PrepareReceiveBuffer(&_WinHttpReceiveBuffer);
+
     IncrementOutstandingIo();
 
     dwError = WINHTTP_HELPER::sm_pfnWinHttpWebSocketReceive(
                 _hWebSocketRequest,
-                &_WinHttpReceiveBuffer,
-                RECEIVE_BUFFER_SIZE,
+                _WinHttpReceiveBuffer.pBuffer + _WinHttpReceiveBuffer.cbPending,
+                _WinHttpReceiveBuffer.cbBuffer - _WinHttpReceiveBuffer.cbPending,
                 NULL,
                 NULL);
 
@@ -475,8 +1131,8 @@ Routine Description:
         dwError = WINHTTP_HELPER::sm_pfnWinHttpWebSocketQueryCloseStatus(
                     _hWebSocketRequest,
                     &uStatus,
-                    &_WinHttpReceiveBuffer,
-                    RECEIVE_BUFFER_SIZE,
+                    _WinHttpReceiveBuffer.pBuffer,
+                    _WinHttpReceiveBuffer.cbBuffer,
                     &dwReceived);
 
         if (dwError != NO_ERROR)
@@ -488,7 +1144,7 @@ Routine Description:
         //
         // Convert close reason to WCHAR
         //
-        hr = strCloseReason.CopyA((PCSTR)&_WinHttpReceiveBuffer,
+        hr = strCloseReason.CopyA((PCSTR)_WinHttpReceiveBuffer.pBuffer,
             dwReceived);
         if (FAILED_LOG(hr))
         {
@@ -496,12 +1152,12 @@ Routine Description:
         }
 
         IncrementOutstandingIo();
+        _ullClientSendStarted = GetTickCount64();
         //
         // Backend end may start close hand shake first
         // Need to indicate no more receive should be called on WinHttp connection
         //
-        _fReceivedCloseMsg = TRUE;
-        _fIndicateCompletionToIis = TRUE;
+        InterlockedOr(&_lState, STATE_RECEIVED_CLOSE | STATE_INDICATE_COMPLETION);
 
         //
         // Send close to IIS.
@@ -526,12 +1182,13 @@ Routine Description:
             &fClose);
 
         IncrementOutstandingIo();
+        _ullClientSendStarted = GetTickCount64();
 
         //
         // Do the Send.
         //
         hr = _pWebSocketContext->WriteFragment(
-                &_WinHttpReceiveBuffer,
+                _WinHttpReceiveBuffer.pBuffer,
                 &cbData,
                 TRUE,
                 fUtf8Encoded,
@@ -543,8 +1200,13 @@ Routine Description:
 
     if (FAILED_LOG(hr))
     {
+        _ullClientSendStarted = 0;
         DecrementOutstandingIo();
     }
+    else if (QueryCleanupInProgress())
+    {
+        CancelIoForCleanup(FALSE);
+    }
 
 Finished:
     if (FAILED_LOG(hr))
@@ -638,7 +1300,7 @@ Routine Description:
         dwError = WINHTTP_HELPER::sm_pfnWinHttpWebSocketSend(
                         _hWebSocketRequest,
                         eBufferType,
-                        cbData == 0 ? NULL : &_IisReceiveBuffer,
+                        cbData == 0 ? NULL : _IisReceiveBuffer.pBuffer,
                         cbData
                         );
     }
@@ -738,24 +1400,17 @@ Routine Description:
 ++*/
 {
     HRESULT                 hr = S_OK;
-    BOOL                    fLocked = FALSE;
     CleanupReason           cleanupReason = CleanupReasonUnknown;
 
     LOG_TRACE(L"WEBSOCKET_HANDLER::OnWinHttpSendComplete");
 
-    if (_fCleanupInProgress)
+    if (QueryCleanupInProgress())
     {
         goto Finished;
     }
 
-    EnterCriticalSection (&_RequestLock);
+    RecordRelay(WEBSOCKET_COUNTERS::TO_BACKEND, &_IisReceiveBuffer);
 
-    fLocked = TRUE;
-
-    if (_fCleanupInProgress)
-    {
-        goto Finished;
-    }
     //
     // Data was successfully sent to backend.
     // Initiate next receive from IIS.
@@ -768,11 +1423,6 @@ Routine Description:
     }
 
 Finished:
-    if (fLocked)
-    {
-        LeaveCriticalSection(&_RequestLock);
-    }
-
     if (FAILED_LOG(hr))
     {
         Cleanup (cleanupReason);
@@ -837,25 +1487,50 @@ Routine Description:
 --*/
 {
     HRESULT  hr = S_OK;
-    BOOL     fLocked = FALSE;
+    DWORD    cbData;
     CleanupReason cleanupReason = CleanupReasonUnknown;
 
     LOG_TRACEF(L"WEBSOCKET_HANDLER::OnWinHttpReceiveComplete --%p", _pHandler);
 
-    if (_fCleanupInProgress)
+    _ullLastActivity = GetTickCount64();
+
+    if (QueryCleanupInProgress())
     {
         goto Finished;
     }
 
-    EnterCriticalSection(&_RequestLock);
+    //
+    // Keep a pooled buffer for the rest of the message, if any.
+    //
+    _WinHttpReceiveBuffer.fMessageInProgress =
+        pCompletionStatus->eBufferType == WINHTTP_WEB_SOCKET_BINARY_FRAGMENT_BUFFER_TYPE ||
+        pCompletionStatus->eBufferType == WINHTTP_WEB_SOCKET_UTF8_FRAGMENT_BUFFER_TYPE;
 
-    fLocked = TRUE;
-    if (_fCleanupInProgress)
+    if (CoalesceFragment(&_WinHttpReceiveBuffer, pCompletionStatus->dwBytesTransferred))
     {
+        hr = DoWinHttpWebSocketReceive();
+        if (FAILED_LOG(hr))
+        {
+            cleanupReason = ServerDisconnect;
+        }
         goto Finished;
     }
+
+    //
+    // The coalesced fragments go out with the type of the last one.
+    //
+    cbData = _WinHttpReceiveBuffer.cbPending;
+    _WinHttpReceiveBuffer.cbPending = 0;
+
+    _WinHttpReceiveBuffer.cbInFlight =
+        pCompletionStatus->eBufferType == WINHTTP_WEB_SOCKET_CLOSE_BUFFER_TYPE ? 0 : cbData;
+    _WinHttpReceiveBuffer.fEndOfMessage =
+        pCompletionStatus->eBufferType == WINHTTP_WEB_SOCKET_BINARY_MESSAGE_BUFFER_TYPE ||
+        pCompletionStatus->eBufferType == WINHTTP_WEB_SOCKET_UTF8_MESSAGE_BUFFER_TYPE;
+    QueryPerformanceCounter(&_WinHttpReceiveBuffer.liReceiveCompleted);
+
     hr = DoIisWebSocketSend(
-            pCompletionStatus->dwBytesTransferred,
+            cbData,
             pCompletionStatus->eBufferType
             );
 
@@ -866,10 +1541,6 @@ Routine Description:
     }
 
 Finished:
-    if (fLocked)
-    {
-        LeaveCriticalSection(&_RequestLock);
-    }
     if (FAILED_LOG(hr))
     {
         Cleanup (cleanupReason);
@@ -904,13 +1575,14 @@ Routine Description:
 --*/
 {
     HRESULT         hr = S_OK;
-    BOOL            fLocked = FALSE;
     CleanupReason   cleanupReason = CleanupReasonUnknown;
 
     UNREFERENCED_PARAMETER(cbIo);
 
     LOG_TRACE(L"WEBSOCKET_HANDLER::OnIisSendComplete");
 
+    _ullClientSendStarted = 0;
+
     if (FAILED_LOG(hrCompletion))
     {
         hr = hrCompletion;
@@ -918,21 +1590,17 @@ Routine Description:
         goto Finished;
     }
 
-    if (_fCleanupInProgress)
-    {
-        goto Finished;
-    }
-    EnterCriticalSection(&_RequestLock);
-    fLocked = TRUE;
-    if (_fCleanupInProgress)
+    if (QueryCleanupInProgress())
     {
         goto Finished;
     }
 
+    RecordRelay(WEBSOCKET_COUNTERS::TO_CLIENT, &_WinHttpReceiveBuffer);
+
     //
     // Only call read if no close hand shake was received from backend
     //
-    if (!_fReceivedCloseMsg)
+    if (!(_lState & STATE_RECEIVED_CLOSE))
     {
         //
         // Write Completed, initiate next read from backend server.
@@ -946,10 +1614,6 @@ Routine Description:
     }
 
 Finished:
-    if (fLocked)
-    {
-        LeaveCriticalSection(&_RequestLock);
-    }
     if (FAILED_LOG(hr))
     {
         Cleanup (cleanupReason);
@@ -989,12 +1653,14 @@ Routine Description:
 --*/
 {
     HRESULT    hr = S_OK;
-    BOOL       fLocked = FALSE;
     CleanupReason cleanupReason = CleanupReasonUnknown;
     WINHTTP_WEB_SOCKET_BUFFER_TYPE  BufferType;
+    DWORD      cbData;
 
     LOG_TRACE(L"WEBSOCKET_HANDLER::OnIisReceiveComplete");
 
+    _ullLastActivity = GetTickCount64();
+
     if (FAILED_LOG(hrCompletion))
     {
         cleanupReason = ClientDisconnect;
@@ -1002,18 +1668,43 @@ Routine Description:
         goto Finished;
     }
 
-    if (_fCleanupInProgress)
+    if (QueryCleanupInProgress())
     {
         goto Finished;
     }
 
-    EnterCriticalSection(&_RequestLock);
+    //
+    // Checked before anything of the fragment is relayed, the rest of an
+    // oversized message is never read.
+    //
+    if (!fClose)
+    {
+        _IisReceiveBuffer.cbMessage += cbIO;
+        if (_cbMaxMessage != 0 && _IisReceiveBuffer.cbMessage > _cbMaxMessage)
+        {
+            LOG_WARNF(L"WEBSOCKET_HANDLER::OnIisReceiveComplete closing connection, message of more than %lu bytes", _cbMaxMessage);
+            Cleanup(MessageTooBig);
+            goto Finished;
+        }
+
+        if (fFinalFragment)
+        {
+            _IisReceiveBuffer.cbMessage = 0;
+        }
+    }
+
+    _IisReceiveBuffer.fMessageInProgress = !fFinalFragment && !fClose;
 
-    fLocked = TRUE;
-    if (_fCleanupInProgress)
+    if (CoalesceFragment(&_IisReceiveBuffer, cbIO))
     {
+        hr = DoIisWebSocketReceive();
+        if (FAILED_LOG(hr))
+        {
+            cleanupReason = ClientDisconnect;
+        }
         goto Finished;
     }
+
     //
     // Get Buffer Type from flags.
     //
@@ -1027,7 +1718,14 @@ Routine Description:
     // Initiate Send.
     //
 
-    hr =  DoWinHttpWebSocketSend(cbIO, BufferType);
+    cbData = _IisReceiveBuffer.cbPending;
+    _IisReceiveBuffer.cbPending = 0;
+
+    _IisReceiveBuffer.cbInFlight = cbData;
+    _IisReceiveBuffer.fEndOfMessage = fFinalFragment && !fClose;
+    QueryPerformanceCounter(&_IisReceiveBuffer.liReceiveCompleted);
+
+    hr =  DoWinHttpWebSocketSend(cbData, BufferType);
     if (FAILED_LOG(hr))
     {
         cleanupReason = ServerDisconnect;
@@ -1035,10 +1733,6 @@ Routine Description:
     }
 
 Finished:
-    if (fLocked)
-    {
-        LeaveCriticalSection(&_RequestLock);
-    }
     if (FAILED_LOG(hr))
     {
         Cleanup (cleanupReason);
@@ -1066,63 +1760,162 @@ Routine Description:
 
     Cleanup function for the websocket handler.
 
-    Initiates cancelIo on the two IO endpoints:
+    The first cleanup records its reason with the state word and
+    initiates cancelIo on the two IO endpoints:
     IIS, WinHttp client.
+    Completions stop issuing IO once they see the state, the last one
+    indicates completion to IIS.
 
 Arguments:
     CleanupReason
 --*/
 {
-    BOOL    fLocked = FALSE;
+    LONG lState = _lState;
+
     LOG_TRACEF(L"WEBSOCKET_HANDLER::Cleanup Initiated with reason %d", reason);
 
-    if (_fCleanupInProgress)
+    for (;;)
     {
-        goto Finished;
+        if (lState & STATE_CLEANUP)
+        {
+            return;
+        }
+
+        LONG lObserved = InterlockedCompareExchange(&_lState,
+            lState | STATE_CLEANUP | STATE_INDICATE_COMPLETION | (reason << STATE_REASON_SHIFT),
+            lState);
+        if (lObserved == lState)
+        {
+            break;
+        }
+        lState = lObserved;
     }
 
-    EnterCriticalSection(&_RequestLock);
+    CancelIoForCleanup(TRUE);
+}
+
+VOID
+WEBSOCKET_HANDLER::CancelIoForCleanup(
+    BOOL    fInitial
+)
+/*++
+
+Routine Description:
+
+    Cancel the IO for the reason of the cleanup in progress. Only one
+    thread cancels at a time: if another one already does, it is asked to
+    go over the IIS IO once more, which then includes the IO the caller
+    just issued.
+
+--*/
+{
+    LONG            lState = _lState;
+    CleanupReason   reason;
 
-    fLocked = TRUE;
-    if (_fCleanupInProgress)
+    for (;;)
     {
-        goto Finished;
-    }
+        if (lState & STATE_TERMINATED)
+        {
+            return;
+        }
 
-    _fCleanupInProgress = TRUE;
+        LONG lObserved = InterlockedCompareExchange(&_lState,
+            lState | ((lState & STATE_CANCEL_ACTIVE) ? STATE_CANCEL_AGAIN : STATE_CANCEL_ACTIVE),
+            lState);
+        if (lObserved == lState)
+        {
+            if (lState & STATE_CANCEL_ACTIVE)
+            {
+                return;
+            }
+            break;
+        }
+        lState = lObserved;
+    }
 
-    _fIndicateCompletionToIis = TRUE;
+    reason = (CleanupReason)((lState & STATE_REASON_MASK) >> STATE_REASON_SHIFT);
 
     //
     // TODO:: Raise FREB event with cleanup reason.
     //
-    if (reason == ClientDisconnect || reason == ServerStateUnavailable)
+    if (fInitial && reason == MessageTooBig)
     {
         //
-        // Calling shutdown to notify the backend about disonnect
+        // Both ends are told the message was too big. The close to the
+        // client completes like any send, so the IIS IO is only canceled
+        // if it can't be issued.
         //
         WINHTTP_HELPER::sm_pfnWinHttpWebSocketShutdown(
             _hWebSocketRequest,
-            1011, // indicate that a server is terminating the connection because it encountered
-                  // an unexpected condition that prevent it from fulfilling the request
+            1009, // message too big
             NULL, // Reason
             0);   // length og Reason
 
+        IncrementOutstandingIo();
+        if (FAILED_LOG(_pWebSocketContext->SendConnectionClose(
+                TRUE,
+                1009,
+                NULL,
+                OnWriteIoCompletion,
+                this,
+                NULL)))
+        {
+            DecrementOutstandingIo();
+
+            // The backend was told already, only cancel the IIS IO.
+            reason = ServerDisconnect;
+        }
     }
 
-    if (reason == ServerDisconnect || reason == ServerStateUnavailable)
+    if (fInitial &&
+        (reason == ClientDisconnect || reason == ServerStateUnavailable || reason == IdleTimeout || reason == SlowClient))
     {
-        _pHttpContext->CancelIo();
         //
-        // CancelIo sometime may not be able to cannel pending websocket IO
-        // ResetConnection to force IISWebsocket module to release the pipeline
+        // Calling shutdown to notify the backend about disonnect
         //
-        _pHttpContext->GetResponse()->ResetConnection();
+        WINHTTP_HELPER::sm_pfnWinHttpWebSocketShutdown(
+            _hWebSocketRequest,
+            reason == IdleTimeout || reason == SlowClient ?
+                1001 : // going away, the connection was idle or the client too slow
+                1011,  // indicate that a server is terminating the connection because it encountered
+                       // an unexpected condition that prevent it from fulfilling the request
+            NULL, // Reason
+            0);   // length og Reason
+
     }
 
-Finished:
-    if (fLocked)
+    for (;;)
     {
-        LeaveCriticalSection(&_RequestLock);
+        if (_pHttpContext != NULL &&
+            (reason == ServerDisconnect || reason == ServerStateUnavailable || reason == IdleTimeout || reason == SlowClient))
+        {
+            _pHttpContext->CancelIo();
+            //
+            // CancelIo sometime may not be able to cannel pending websocket IO
+            // ResetConnection to force IISWebsocket module to release the pipeline
+            //
+            _pHttpContext->GetResponse()->ResetConnection();
+        }
+
+        //
+        // Done unless another IIS IO was issued meanwhile.
+        //
+        lState = _lState;
+        for (;;)
+        {
+            LONG lObserved = InterlockedCompareExchange(&_lState,
+                (lState & STATE_CANCEL_AGAIN) ? (lState & ~STATE_CANCEL_AGAIN) : (lState & ~STATE_CANCEL_ACTIVE),
+                lState);
+            if (lObserved == lState)
+            {
+                break;
+            }
+            lState = lObserved;
+        }
+
+        if (!(lState & STATE_CANCEL_AGAIN))
+        {
+            return;
+        }
     }
 }
@@ -5,6 +5,7 @@
 
 extern IHttpServer *    g_pHttpServer;
 class FORWARDING_HANDLER;
+class RESPONSE_BUFFER_POOL;
 
 class WEBSOCKET_HANDLER
 {
@@ -23,6 +24,18 @@ public:
         VOID
         );
 
+    //
+    // NULL unless reference count tracing is enabled.
+    //
+    static
+    PER_CPU_REF_TRACE_LOG *
+    QueryTraceLog(
+        VOID
+        )
+    {
+        return sm_pTraceLog;
+    }
+
     VOID
     Terminate(
         VOID
@@ -41,6 +54,9 @@ public:
         FORWARDING_HANDLER *pHandler,
         IHttpContext * pHttpContext,
         HINTERNET      hRequest,
+        REQUESTHANDLER_CONFIG * pConfig,
+        WEBSOCKET_COUNTERS * pCounters,
+        APPLICATION_COUNTERS * pApplicationCounters,
         BOOL*          pfHandleCreated
         );
 
@@ -71,6 +87,18 @@ public:
 
 
 private:
+    //
+    // Drives the relay loop against fake endpoints, see
+    // WebSocketRelayBenchmarks.
+    //
+    friend class WEBSOCKET_RELAY_BENCHMARK;
+
+    //
+    // Large enough for a close frame's reason, at most 123 bytes.
+    //
+    static const
+    DWORD               IDLE_RECEIVE_BUFFER_SIZE = 128;
+
     enum CleanupReason
     {
         CleanupReasonUnknown = 0,
@@ -78,14 +106,133 @@ private:
         ConnectFailed = 2,
         ClientDisconnect = 3,
         ServerDisconnect = 4,
-        ServerStateUnavailable = 5
+        ServerStateUnavailable = 5,
+        SlowClient = 6,
+        MessageTooBig = 7
     };
 
+    //
+    // Teardown state of the connection, one word that is only updated
+    // with interlocked operations so that no completion takes a lock to
+    // find out the connection is closing. The low bits are flags, the
+    // cleanup reason sits above them and the high word counts the
+    // outstanding IO.
+    //
+    static const
+    LONG                STATE_CLEANUP = 0x0001;
+
+    static const
+    LONG                STATE_INDICATE_COMPLETION = 0x0002;
+
+    static const
+    LONG                STATE_RECEIVED_CLOSE = 0x0004;
+
+    static const
+    LONG                STATE_HANDLE_CLOSED = 0x0008;
+
+    static const
+    LONG                STATE_TERMINATED = 0x0010;
+
+    //
+    // Set while the IO of a cleanup is being canceled, and to have the
+    // canceling thread go over the IIS IO once more.
+    //
+    static const
+    LONG                STATE_CANCEL_ACTIVE = 0x0020;
+
+    static const
+    LONG                STATE_CANCEL_AGAIN = 0x0040;
+
+    static const
+    LONG                STATE_REASON_SHIFT = 8;
+
+    static const
+    LONG                STATE_REASON_MASK = 0x0F00;
+
+    static const
+    LONG                STATE_IO_SHIFT = 16;
+
+    static const
+    LONG                STATE_IO_UNIT = 0x10000;
+
     virtual
     ~WEBSOCKET_HANDLER()
     {
     }
 
+    BOOL
+    QueryCleanupInProgress(
+        VOID
+    ) const
+    {
+        return (_lState & STATE_CLEANUP) != 0;
+    }
+
+    //
+    // Cancels the IO of the cleanup in progress. Also called after an IIS
+    // IO was issued while a cleanup started, which may have missed it.
+    //
+    VOID
+    CancelIoForCleanup(
+        BOOL    fInitial
+    );
+
+    //
+    // Terminate releases the reference the handler is created with, the
+    // idle wheel holds one while the connection is tracked.
+    //
+    VOID
+    ReferenceHandler(
+        VOID
+    );
+
+    VOID
+    DereferenceHandler(
+        VOID
+    );
+
+    VOID
+    InsertIntoIdleWheel(
+        VOID
+    );
+
+    VOID
+    RemoveFromIdleWheel(
+        VOID
+    );
+
+    static
+    LIST_ENTRY *
+    QueryIdleWheelSlot(
+        ULONGLONG   ullTick
+    );
+
+    BOOL
+    QueryTimeoutsEnabled(
+        VOID
+    ) const
+    {
+        return _dwIdleTimeoutInMS != 0 || _dwSlowClientTimeoutInMS != 0;
+    }
+
+    //
+    // Earliest time the connection can time out, and the reason it would.
+    //
+    ULONGLONG
+    QueryTimeoutDeadline(
+        ULONGLONG       ullNow,
+        CleanupReason * pReason
+    ) const;
+
+    static
+    VOID
+    CALLBACK
+    IdleTimerCallback(
+        _In_ PTP_CALLBACK_INSTANCE  Instance,
+        _In_ PVOID                  pContext,
+        _In_ PTP_TIMER              pTimer
+    );
+
     WEBSOCKET_HANDLER(const WEBSOCKET_HANDLER &);
     void operator=(const WEBSOCKET_HANDLER &);
 
@@ -180,10 +327,138 @@ private:
         VOID
     );
 
+    //
+    // Receive buffer of one direction. The read waiting for a message to
+    // start goes to the small inline buffer, so that an idle connection
+    // holds no pooled memory; a buffer is only borrowed from the pool while
+    // the rest of a fragmented message is being relayed.
+    //
+    // When fragments are coalesced, cbPending bytes of the message in
+    // progress are already in pBuffer and the next receive appends to them.
+    //
+    // cbInFlight and fEndOfMessage describe the send of the received data
+    // to the other endpoint, liReceiveCompleted is when its receive
+    // completed, for the counters.
+    //
+    struct RECEIVE_BUFFER
+    {
+        BYTE *  pBuffer;
+        DWORD   cbBuffer;
+        DWORD   cbPending;
+        DWORD   cbInFlight;
+        BOOL    fEndOfMessage;
+        LARGE_INTEGER liReceiveCompleted;
+        BYTE *  pPooledBuffer;
+        BOOL    fMessageInProgress;
+        // Bytes received of the message in progress so far.
+        ULONGLONG cbMessage;
+        BYTE    rgIdleBuffer[IDLE_RECEIVE_BUFFER_SIZE];
+    };
+
+    VOID
+    PrepareReceiveBuffer(
+        RECEIVE_BUFFER *    pReceiveBuffer
+    );
+
+    VOID
+    ReleaseReceiveBuffer(
+        RECEIVE_BUFFER *    pReceiveBuffer
+    );
+
+    BOOL
+    CoalesceFragment(
+        RECEIVE_BUFFER *    pReceiveBuffer,
+        DWORD               cbFragment
+    );
+
+    VOID
+    RecordRelay(
+        WEBSOCKET_COUNTERS::DIRECTION   direction,
+        RECEIVE_BUFFER *                pReceiveBuffer
+    );
+
+    VOID
+    ReportConnectionEnd(
+        VOID
+    );
+
+    static
+    LONG64
+    QueryMicrosecondsSince(
+        LONGLONG    llStart
+    );
+
 private:
+    //
+    // Default and bounds of the pooled receive buffers.
+    //
     static const
     DWORD               RECEIVE_BUFFER_SIZE = 4*1024;
 
+    static const
+    DWORD               MAX_RECEIVE_BUFFER_SIZE = 64*1024;
+
+    //
+    // One revolution of the idle wheel, connections further away from
+    // their deadline are looked at once per revolution.
+    //
+    static const
+    DWORD               IDLE_WHEEL_SLOTS = 64;
+
+    static const
+    DWORD               IDLE_WHEEL_TICK_MS = 1000;
+
+    LONG                _cRefs;
+
+    //
+    // Links the connection into its idle wheel slot, protected by
+    // sm_IdleWheelLock like _fInIdleWheel and _fIdleWheelClosed.
+    // _ullLastActivity is written by the receive completions without it.
+    //
+    LIST_ENTRY          _idleListEntry;
+
+    BOOL                _fInIdleWheel;
+
+    BOOL                _fIdleWheelClosed;
+
+    DWORD               _dwIdleTimeoutInMS;
+
+    volatile
+    ULONGLONG           _ullLastActivity;
+
+    DWORD               _dwSlowClientTimeoutInMS;
+
+    //
+    // Start of the send to IIS in progress, 0 while there is none. Reads
+    // from WinHTTP are paused until it completes, so a slow client holds
+    // at most one receive buffer here and pushes back on the backend.
+    //
+    volatile
+    ULONGLONG           _ullClientSendStarted;
+
+    DWORD               _cbReceiveBuffer;
+
+    BOOL                _fCoalesceFragments;
+
+    DWORD               _cbMaxMessage;
+
+    //
+    // Application totals, and this connection's share of them. The
+    // connection is counted from the upgrade until ReportConnectionEnd.
+    //
+    WEBSOCKET_COUNTERS * _pCounters;
+
+    WEBSOCKET_COUNTERS::SNAPSHOT _connectionCounters;
+
+    //
+    // Charged with the pooled receive buffers of the connection.
+    //
+    APPLICATION_COUNTERS * _pApplicationCounters;
+
+    LONGLONG            _llConnected;
+
+    BOOL                _fConnectionCounted;
+
     LIST_ENTRY          _listEntry;
 
     IHttpContext3 *     _pHttpContext;
@@ -194,32 +469,44 @@ private:
 
     HINTERNET           _hWebSocketRequest;
 
-    BYTE                _WinHttpReceiveBuffer[RECEIVE_BUFFER_SIZE];
+    RECEIVE_BUFFER      _WinHttpReceiveBuffer;
+
+    RECEIVE_BUFFER      _IisReceiveBuffer;
+
+    volatile
+    LONG                _lState;
 
-    BYTE                _IisReceiveBuffer[RECEIVE_BUFFER_SIZE];
+    static
+    LIST_ENTRY          sm_RequestsListHead;
 
-    CRITICAL_SECTION    _RequestLock;
+    static
+    SRWLOCK             sm_RequestsListLock;
 
-    LONG                _dwOutstandingIo;
+    static
+    PER_CPU_REF_TRACE_LOG * sm_pTraceLog;
 
-    volatile
-    BOOL                _fCleanupInProgress;
+    static
+    RESPONSE_BUFFER_POOL * sm_pReceiveBufferPool;
 
-    volatile
-    BOOL                _fIndicateCompletionToIis;
+    static
+    LONGLONG            sm_llPerformanceFrequency;
 
-    volatile
-    BOOL                _fHandleClosed;
+    //
+    // The single timer wheel that every connection with an idle timeout
+    // is tracked in.
+    //
+    static
+    SRWLOCK             sm_IdleWheelLock;
 
-    volatile
-    BOOL                _fReceivedCloseMsg;
+    static
+    LIST_ENTRY          sm_rgIdleWheel[IDLE_WHEEL_SLOTS];
 
     static
-    LIST_ENTRY          sm_RequestsListHead;
+    ULONGLONG           sm_ullIdleWheelNextTick;
 
     static
-    SRWLOCK             sm_RequestsListLock;
+    STTIMER *           sm_pIdleTimer;
 
     static
-    TRACE_LOG *         sm_pTraceLog;
+    volatile LONG       sm_lIdleTimerStarted;
 };
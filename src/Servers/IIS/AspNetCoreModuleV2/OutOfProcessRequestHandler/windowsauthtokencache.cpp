@@ -0,0 +1,310 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "windowsauthtokencache.h"
+#include "SRWExclusiveLock.h"
+
+WINDOWS_AUTH_TOKEN_CACHE::WINDOWS_AUTH_TOKEN_CACHE() :
+    m_cEntries(0),
+    m_ullNextSweep(0)
+{
+    InitializeSRWLock(&m_srwLock);
+    ZeroMemory(m_rgEntries, sizeof(m_rgEntries));
+}
+
+WINDOWS_AUTH_TOKEN_CACHE::~WINDOWS_AUTH_TOKEN_CACHE()
+{
+    //
+    // Without Clear the backend is gone, and its handles with it.
+    //
+    for (DWORD i = 0; i < m_cEntries; i++)
+    {
+        DBG_ASSERT(m_rgEntries[i]->cRequests == 0);
+        delete m_rgEntries[i];
+    }
+    m_cEntries = 0;
+}
+
+HRESULT
+WINDOWS_AUTH_TOKEN_CACHE::Acquire(
+    _In_ HANDLE                             hProcess,
+    HTTP_CONNECTION_ID                      connectionId,
+    _In_ HANDLE                             hToken,
+    _Out_ HANDLE *                          phTargetToken,
+    _Outptr_result_maybenull_ WINDOWS_AUTH_TOKEN_CACHE_ENTRY ** ppEntry
+)
+{
+    TOKEN_STATISTICS                    statistics;
+    DWORD                               cbStatistics = 0;
+    HANDLE                              rghClose[MAX_ENTRIES];
+    DWORD                               cClose = 0;
+    WINDOWS_AUTH_TOKEN_CACHE_ENTRY *    pEntry = NULL;
+    WINDOWS_AUTH_TOKEN_CACHE_ENTRY *    pNewEntry = NULL;
+    HANDLE                              hTargetToken = NULL;
+    const ULONGLONG                     ullNow = GetTickCount64();
+
+    *phTargetToken = NULL;
+    *ppEntry = NULL;
+
+    RETURN_LAST_ERROR_IF(!GetTokenInformation(hToken,
+        TokenStatistics,
+        &statistics,
+        sizeof(statistics),
+        &cbStatistics));
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        if (ullNow >= m_ullNextSweep)
+        {
+            cClose = RemoveIdleEntriesNoLock(ullNow, rghClose);
+            m_ullNextSweep = ullNow + IDLE_TIMEOUT_MS / 4;
+        }
+
+        for (DWORD i = 0; i < m_cEntries; i++)
+        {
+            if (!m_rgEntries[i]->fAbandoned &&
+                m_rgEntries[i]->connectionId == connectionId &&
+                m_rgEntries[i]->authenticationId.LowPart == statistics.AuthenticationId.LowPart &&
+                m_rgEntries[i]->authenticationId.HighPart == statistics.AuthenticationId.HighPart)
+            {
+                pEntry = m_rgEntries[i];
+                pEntry->cRequests++;
+                pEntry->ullLastUsed = ullNow;
+                break;
+            }
+        }
+    }
+
+    // Outside of the lock, each is a call into the backend process.
+    for (DWORD i = 0; i < cClose; i++)
+    {
+        CloseTargetToken(hProcess, rghClose[i]);
+    }
+
+    if (pEntry != NULL)
+    {
+        *phTargetToken = pEntry->hTargetToken;
+        *ppEntry = pEntry;
+        return S_OK;
+    }
+
+    RETURN_LAST_ERROR_IF(!DuplicateHandle(GetCurrentProcess(),
+        hToken,
+        hProcess,
+        &hTargetToken,
+        0,
+        FALSE,
+        DUPLICATE_SAME_ACCESS));
+
+    *phTargetToken = hTargetToken;
+
+    pNewEntry = new WINDOWS_AUTH_TOKEN_CACHE_ENTRY;
+    if (pNewEntry == NULL)
+    {
+        // Sent uncached.
+        return S_OK;
+    }
+
+    ZeroMemory(pNewEntry, sizeof(WINDOWS_AUTH_TOKEN_CACHE_ENTRY));
+    pNewEntry->connectionId = connectionId;
+    pNewEntry->authenticationId = statistics.AuthenticationId;
+    pNewEntry->hTargetToken = hTargetToken;
+    pNewEntry->cRequests = 1;
+    pNewEntry->ullLastUsed = ullNow;
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        //
+        // Another request of the connection may have added it meanwhile.
+        //
+        for (DWORD i = 0; i < m_cEntries; i++)
+        {
+            if (!m_rgEntries[i]->fAbandoned &&
+                m_rgEntries[i]->connectionId == connectionId &&
+                m_rgEntries[i]->authenticationId.LowPart == statistics.AuthenticationId.LowPart &&
+                m_rgEntries[i]->authenticationId.HighPart == statistics.AuthenticationId.HighPart)
+            {
+                pEntry = m_rgEntries[i];
+                pEntry->cRequests++;
+                pEntry->ullLastUsed = ullNow;
+                break;
+            }
+        }
+
+        if (pEntry == NULL && m_cEntries < MAX_ENTRIES)
+        {
+            m_rgEntries[m_cEntries++] = pNewEntry;
+            pEntry = pNewEntry;
+            pNewEntry = NULL;
+        }
+    }
+
+    if (pNewEntry != NULL)
+    {
+        delete pNewEntry;
+
+        if (pEntry == NULL)
+        {
+            // The cache is full, sent uncached.
+            return S_OK;
+        }
+
+        // Never sent, so not read by the backend.
+        CloseTargetToken(hProcess, hTargetToken);
+    }
+
+    *phTargetToken = pEntry->hTargetToken;
+    *ppEntry = pEntry;
+    return S_OK;
+}
+
+VOID
+WINDOWS_AUTH_TOKEN_CACHE::Release(
+    _In_ HANDLE                             hProcess,
+    _In_ WINDOWS_AUTH_TOKEN_CACHE_ENTRY *   pEntry,
+    BOOL                                    fConnectionClosed,
+    BOOL                                    fConsumed
+)
+{
+    BOOL fFree = FALSE;
+    BOOL fClose = FALSE;
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        DBG_ASSERT(pEntry->cRequests != 0);
+        pEntry->cRequests--;
+        pEntry->ullLastUsed = GetTickCount64();
+
+        if (!fConsumed)
+        {
+            pEntry->fAbandoned = TRUE;
+        }
+
+        //
+        // An abandoned handle stays for RemoveIdleEntriesNoLock to close,
+        // even once the connection closed.
+        //
+        if (fConnectionClosed && !pEntry->fAbandoned && !pEntry->fRemoved)
+        {
+            for (DWORD i = 0; i < m_cEntries; i++)
+            {
+                if (m_rgEntries[i] == pEntry)
+                {
+                    RemoveEntryNoLock(i);
+                    break;
+                }
+            }
+        }
+
+        if (pEntry->fRemoved && pEntry->cRequests == 0)
+        {
+            if (!pEntry->fAbandoned)
+            {
+                fFree = TRUE;
+                fClose = TRUE;
+            }
+            else if (m_cEntries < MAX_ENTRIES)
+            {
+                // Removed while another request of it was in flight.
+                pEntry->fRemoved = FALSE;
+                m_rgEntries[m_cEntries++] = pEntry;
+            }
+            else
+            {
+                // Nowhere to wait for the idle expiry, it stays open.
+                fFree = TRUE;
+            }
+        }
+    }
+
+    if (fClose)
+    {
+        CloseTargetToken(hProcess, pEntry->hTargetToken);
+    }
+
+    if (fFree)
+    {
+        delete pEntry;
+    }
+}
+
+VOID
+WINDOWS_AUTH_TOKEN_CACHE::Clear(
+    _In_ HANDLE                             hProcess
+)
+{
+    SRWExclusiveLock lock(m_srwLock);
+
+    while (m_cEntries != 0)
+    {
+        WINDOWS_AUTH_TOKEN_CACHE_ENTRY *pEntry = m_rgEntries[m_cEntries - 1];
+        RemoveEntryNoLock(m_cEntries - 1);
+
+        if (pEntry->cRequests == 0)
+        {
+            CloseTargetToken(hProcess, pEntry->hTargetToken);
+            delete pEntry;
+        }
+    }
+}
+
+VOID
+WINDOWS_AUTH_TOKEN_CACHE::RemoveEntryNoLock(
+    DWORD                                   iEntry
+)
+{
+    DBG_ASSERT(iEntry < m_cEntries);
+
+    m_rgEntries[iEntry]->fRemoved = TRUE;
+    m_rgEntries[iEntry] = m_rgEntries[--m_cEntries];
+    m_rgEntries[m_cEntries] = NULL;
+}
+
+DWORD
+WINDOWS_AUTH_TOKEN_CACHE::RemoveIdleEntriesNoLock(
+    ULONGLONG                               ullNow,
+    _Out_writes_(MAX_ENTRIES) HANDLE *      phClose
+)
+{
+    DWORD cClose = 0;
+
+    for (DWORD i = 0; i < m_cEntries; )
+    {
+        WINDOWS_AUTH_TOKEN_CACHE_ENTRY *pEntry = m_rgEntries[i];
+        if (pEntry->cRequests == 0 &&
+            ullNow - pEntry->ullLastUsed >= IDLE_TIMEOUT_MS)
+        {
+            phClose[cClose++] = pEntry->hTargetToken;
+            RemoveEntryNoLock(i);
+            delete pEntry;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    return cClose;
+}
+
+// static
+VOID
+WINDOWS_AUTH_TOKEN_CACHE::CloseTargetToken(
+    _In_ HANDLE                             hProcess,
+    _In_ HANDLE                             hTargetToken
+)
+{
+    //
+    // Fails once the backend exited, its handles are closed already.
+    //
+    (VOID)DuplicateHandle(hProcess,
+        hTargetToken,
+        NULL,
+        NULL,
+        0,
+        FALSE,
+        DUPLICATE_CLOSE_SOURCE);
+}
@@ -0,0 +1,112 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// Handle of a user token duplicated into a backend process, shared by the
+// requests of one connection and logon session.
+//
+struct WINDOWS_AUTH_TOKEN_CACHE_ENTRY
+{
+    HTTP_CONNECTION_ID  connectionId;
+    LUID                authenticationId;
+    HANDLE              hTargetToken;
+    //
+    // Requests the handle was sent with that are not released yet.
+    //
+    DWORD               cRequests;
+    ULONGLONG           ullLastUsed;
+    //
+    // Removed from the cache, freed by the last release.
+    //
+    BOOL                fRemoved;
+    //
+    // A request got no response or was retried, the backend may still read
+    // the handle. It is not sent again, and closed once it went unused for
+    // IDLE_TIMEOUT_MS.
+    //
+    BOOL                fAbandoned;
+};
+
+//
+// User tokens duplicated into a backend process, kept across the requests
+// of a keep-alive connection with cacheWindowsAuthToken instead of being
+// duplicated for every request.
+//
+// The backend is sent the handle in MS-ASPNETCORE-WINAUTHTOKEN-CACHED and
+// must not close it. The cache closes it in the backend with
+// DUPLICATE_CLOSE_SOURCE once the connection was seen closing, or once it
+// went unused for IDLE_TIMEOUT_MS as connections usually close between
+// requests. The handle of a request the backend did not answer is only
+// closed by the idle expiry, which gives the backend time to read it.
+// Past MAX_ENTRIES the handle is sent the usual way.
+//
+class WINDOWS_AUTH_TOKEN_CACHE
+{
+public:
+    WINDOWS_AUTH_TOKEN_CACHE();
+
+    ~WINDOWS_AUTH_TOKEN_CACHE();
+
+    //
+    // The handle of hToken in hProcess for a request of connectionId.
+    // *ppEntry is NULL when it could not be cached, the backend then owns
+    // the handle.
+    //
+    HRESULT
+    Acquire(
+        _In_ HANDLE                             hProcess,
+        HTTP_CONNECTION_ID                      connectionId,
+        _In_ HANDLE                             hToken,
+        _Out_ HANDLE *                          phTargetToken,
+        _Outptr_result_maybenull_ WINDOWS_AUTH_TOKEN_CACHE_ENTRY ** ppEntry
+    );
+
+    //
+    // Once the request is done. fConsumed when the backend answered it,
+    // and so read the handle.
+    //
+    VOID
+    Release(
+        _In_ HANDLE                             hProcess,
+        _In_ WINDOWS_AUTH_TOKEN_CACHE_ENTRY *   pEntry,
+        BOOL                                    fConnectionClosed,
+        BOOL                                    fConsumed
+    );
+
+    //
+    // Closes the handles of every entry, none may be in use.
+    //
+    VOID
+    Clear(
+        _In_ HANDLE                             hProcess
+    );
+
+    static const DWORD      MAX_ENTRIES = 256;
+    static const DWORD      IDLE_TIMEOUT_MS = 60000;
+
+private:
+    VOID
+    RemoveEntryNoLock(
+        DWORD                                   iEntry
+    );
+
+    DWORD
+    RemoveIdleEntriesNoLock(
+        ULONGLONG                               ullNow,
+        _Out_writes_(MAX_ENTRIES) HANDLE *      phClose
+    );
+
+    static
+    VOID
+    CloseTargetToken(
+        _In_ HANDLE                             hProcess,
+        _In_ HANDLE                             hTargetToken
+    );
+
+    SRWLOCK                             m_srwLock;
+    WINDOWS_AUTH_TOKEN_CACHE_ENTRY *    m_rgEntries[MAX_ENTRIES];
+    DWORD                               m_cEntries;
+    ULONGLONG                           m_ullNextSweep;
+};
@@ -19,12 +19,22 @@ WINHTTP_HELPER::sm_pfnWinHttpWebSocketShutdown;
 PFN_WINHTTP_WEBSOCKET_QUERY_CLOSE_STATUS
 WINHTTP_HELPER::sm_pfnWinHttpWebSocketQueryCloseStatus;
 
+PFN_WINHTTP_ADD_REQUEST_HEADERS_EX
+WINHTTP_HELPER::sm_pfnWinHttpAddRequestHeadersEx;
+
 //static
 HRESULT
 WINHTTP_HELPER::StaticInitialize(
     VOID
 )
 {
+    HMODULE  hWinHttp = GetModuleHandleA("winhttp.dll");
+    RETURN_LAST_ERROR_IF (hWinHttp == NULL);
+
+    // Optional, missing on older systems.
+    sm_pfnWinHttpAddRequestHeadersEx = (PFN_WINHTTP_ADD_REQUEST_HEADERS_EX)
+        GetProcAddress(hWinHttp, "WinHttpAddRequestHeadersEx");
+
     //
     // Initialize the function pointers for WinHttp Websocket API's.
     //
@@ -33,9 +43,6 @@ WINHTTP_HELPER::StaticInitialize(
         return S_OK;
     }
 
-    HMODULE  hWinHttp = GetModuleHandleA("winhttp.dll");
-    RETURN_LAST_ERROR_IF (hWinHttp == NULL);
-
     sm_pfnWinHttpWebSocketCompleteUpgrade = (PFN_WINHTTP_WEBSOCKET_COMPLETE_UPGRADE)
         GetProcAddress(hWinHttp, "WinHttpWebSocketCompleteUpgrade");
     RETURN_LAST_ERROR_IF (sm_pfnWinHttpWebSocketCompleteUpgrade == NULL);
@@ -49,6 +49,27 @@ DWORD
     _Out_range_(0, WINHTTP_WEB_SOCKET_MAX_CLOSE_REASON_LENGTH) DWORD *pdwReasonLengthConsumed
 );
 
+//
+// WINHTTP_EXTENDED_HEADER without the UNICODE flag. Declared here as the
+// SDK only has it for Windows 10 targets.
+//
+struct WINHTTP_HELPER_EXTENDED_HEADER
+{
+    PCSTR   pszName;
+    PCSTR   pszValue;
+};
+
+typedef
+DWORD
+(WINAPI * PFN_WINHTTP_ADD_REQUEST_HEADERS_EX)(
+    _In_ HINTERNET hRequest,
+    _In_ DWORD dwModifiers,
+    _In_ ULONGLONG ullFlags,
+    _In_ ULONGLONG ullExtra,
+    _In_ DWORD cHeaders,
+    _In_reads_(cHeaders) WINHTTP_HELPER_EXTENDED_HEADER * pHeaders
+);
+
 class WINHTTP_HELPER
 {
 public:
@@ -88,4 +109,11 @@ public:
 
     static
     PFN_WINHTTP_WEBSOCKET_QUERY_CLOSE_STATUS    sm_pfnWinHttpWebSocketQueryCloseStatus;
+
+    //
+    // NULL before Windows 10 2004, request headers are then sent as the
+    // wide block WinHttpSendRequest takes.
+    //
+    static
+    PFN_WINHTTP_ADD_REQUEST_HEADERS_EX          sm_pfnWinHttpAddRequestHeadersEx;
 };
\ No newline at end of file
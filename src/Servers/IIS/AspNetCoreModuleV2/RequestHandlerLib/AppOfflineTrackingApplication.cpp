@@ -46,7 +46,9 @@ HRESULT AppOfflineTrackingApplication::StartMonitoringAppOflineImpl()
         L"app_offline.htm",
         m_shadowCopyDirectory,
         this,
-        m_shutdownTimeout));
+        m_shutdownTimeout,
+        m_shadowCopyQuietPeriod,
+        m_shadowCopyMaxDelay));
 
     return S_OK;
 }
@@ -16,7 +16,9 @@ public:
         m_applicationPath(application.GetApplicationPhysicalPath()),
         m_fileWatcher(nullptr),
         m_fAppOfflineProcessed(false),
-        m_shutdownTimeout(120000) // default to 2 minutes
+        m_shutdownTimeout(120000), // default to 2 minutes
+        m_shadowCopyQuietPeriod(5000),
+        m_shadowCopyMaxDelay(60000)
     {
     }
 
@@ -42,6 +44,8 @@ public:
     bool                                         m_detectedAppOffline;
     std::wstring                                 m_shadowCopyDirectory;
     DWORD                                        m_shutdownTimeout;
+    DWORD                                        m_shadowCopyQuietPeriod;
+    DWORD                                        m_shadowCopyMaxDelay;
 private:
     HRESULT
     StartMonitoringAppOflineImpl();
@@ -0,0 +1,253 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include "applicationcounters.h"
+#include "exceptions.h"
+#include "TraceProvider.h"
+
+APPLICATION_COUNTERS::APPLICATION_COUNTERS() :
+    m_pCounters(NULL)
+{
+}
+
+APPLICATION_COUNTERS::~APPLICATION_COUNTERS()
+{
+    if (m_pCounters != NULL)
+    {
+        m_pCounters->Dispose();
+        m_pCounters = NULL;
+    }
+}
+
+HRESULT
+APPLICATION_COUNTERS::Initialize(
+    VOID
+)
+{
+    if (m_pCounters == NULL)
+    {
+        RETURN_IF_FAILED(PER_CPU<SNAPSHOT>::Create([](SNAPSHOT* pCounters) { ZeroMemory(pCounters, sizeof(*pCounters)); },
+            &m_pCounters));
+    }
+
+    return S_OK;
+}
+
+VOID
+APPLICATION_COUNTERS::RecordForwardingError(
+    FORWARDING_ERROR    error
+)
+{
+    if (m_pCounters == NULL || error >= FORWARDING_ERROR_COUNT)
+    {
+        return;
+    }
+
+    InterlockedIncrement64(&m_pCounters->GetLocal()->rgcForwardingErrors[error]);
+}
+
+VOID
+APPLICATION_COUNTERS::RecordForward(
+    LONG64  llForwardMicroseconds
+)
+{
+    if (m_pCounters == NULL)
+    {
+        return;
+    }
+
+    SNAPSHOT* pCounters = m_pCounters->GetLocal();
+    InterlockedIncrement64(&pCounters->cForwardedRequests);
+    InterlockedAdd64(&pCounters->llForwardMicroseconds, llForwardMicroseconds);
+}
+
+VOID
+APPLICATION_COUNTERS::AddToSnapshot(
+    _Inout_ SNAPSHOT * pSnapshot
+)
+{
+    if (m_pCounters == NULL)
+    {
+        return;
+    }
+
+    m_pCounters->ForEach([pSnapshot](SNAPSHOT* pCounters)
+    {
+        pSnapshot->cTotalRequests += pCounters->cTotalRequests;
+        pSnapshot->cActiveRequests += pCounters->cActiveRequests;
+        pSnapshot->cQueuedRequests += pCounters->cQueuedRequests;
+        for (DWORD i = 0; i < FORWARDING_ERROR_COUNT; ++i)
+        {
+            pSnapshot->rgcForwardingErrors[i] += pCounters->rgcForwardingErrors[i];
+        }
+        pSnapshot->cBackendRestarts += pCounters->cBackendRestarts;
+        pSnapshot->cRapidFailTrips += pCounters->cRapidFailTrips;
+        pSnapshot->cBackendEjections += pCounters->cBackendEjections;
+        pSnapshot->cWinHttpConnections += pCounters->cWinHttpConnections;
+        pSnapshot->cForwardedRequests += pCounters->cForwardedRequests;
+        pSnapshot->llForwardMicroseconds += pCounters->llForwardMicroseconds;
+        for (DWORD i = 0; i < MEMORY_TAG_COUNT; ++i)
+        {
+            pSnapshot->rgcbMemory[i] += pCounters->rgcbMemory[i];
+        }
+    });
+}
+
+APPLICATION_COUNTERS_PUBLISHER::APPLICATION_COUNTERS_PUBLISHER() :
+    m_pTimer(NULL),
+    m_previous(),
+    m_ullPreviousTick(0),
+    m_lPublishing(0)
+{
+}
+
+APPLICATION_COUNTERS_PUBLISHER::~APPLICATION_COUNTERS_PUBLISHER()
+{
+    Stop();
+}
+
+HRESULT
+APPLICATION_COUNTERS_PUBLISHER::Start(
+    const std::wstring &    applicationId,
+    COLLECT_CALLBACK        collect
+)
+{
+    if (m_pTimer != NULL)
+    {
+        return S_OK;
+    }
+
+    m_applicationId = applicationId;
+    m_collect = std::move(collect);
+
+    RETURN_LAST_ERROR_IF_NULL(m_pTimer = CreateThreadpoolTimer(TimerCallback, this, NULL));
+
+    //
+    // Periodic, the window lets the thread pool batch the timers of all
+    // applications.
+    //
+    ULARGE_INTEGER dueTime;
+    dueTime.QuadPart = static_cast<ULONGLONG>(-static_cast<LONGLONG>(PUBLISH_INTERVAL_MS) * 10000);
+    FILETIME ftDueTime;
+    ftDueTime.dwLowDateTime = dueTime.LowPart;
+    ftDueTime.dwHighDateTime = dueTime.HighPart;
+
+    SetThreadpoolTimer(m_pTimer, &ftDueTime, PUBLISH_INTERVAL_MS, PUBLISH_INTERVAL_MS / 10);
+
+    return S_OK;
+}
+
+VOID
+APPLICATION_COUNTERS_PUBLISHER::Stop(
+    VOID
+)
+{
+    if (m_pTimer == NULL)
+    {
+        return;
+    }
+
+    SetThreadpoolTimer(m_pTimer, NULL, 0, 0);
+    WaitForThreadpoolTimerCallbacks(m_pTimer, TRUE);
+    CloseThreadpoolTimer(m_pTimer);
+    m_pTimer = NULL;
+}
+
+// static
+VOID
+CALLBACK
+APPLICATION_COUNTERS_PUBLISHER::TimerCallback(
+    _Inout_     PTP_CALLBACK_INSTANCE   Instance,
+    _Inout_opt_ PVOID                   pContext,
+    _Inout_     PTP_TIMER               pTimer
+)
+{
+    UNREFERENCED_PARAMETER(Instance);
+    UNREFERENCED_PARAMETER(pTimer);
+
+    static_cast<APPLICATION_COUNTERS_PUBLISHER*>(pContext)->Publish();
+}
+
+VOID
+APPLICATION_COUNTERS_PUBLISHER::Publish(
+    VOID
+)
+{
+    if (!TraceLoggingProviderEnabled(g_hTraceProvider, WINEVENT_LEVEL_INFO, ASPNETCORE_TRACE_KEYWORD_COUNTERS))
+    {
+        m_ullPreviousTick = 0;
+        return;
+    }
+
+    //
+    // A publish that is late by a whole interval overlaps with the next
+    // one, which is skipped then; m_previous is only touched by one.
+    //
+    if (InterlockedCompareExchange(&m_lPublishing, 1L, 0L) != 0L)
+    {
+        return;
+    }
+
+    APPLICATION_COUNTERS::SNAPSHOT current = {};
+    try
+    {
+        m_collect(&current);
+    }
+    catch (...)
+    {
+        OBSERVE_CAUGHT_EXCEPTION();
+        InterlockedExchange(&m_lPublishing, 0L);
+        return;
+    }
+
+    const ULONGLONG ullNow = GetTickCount64();
+    const ULONGLONG ullElapsed = ullNow - m_ullPreviousTick;
+    const APPLICATION_COUNTERS::SNAPSHOT previous = m_previous;
+    const BOOL fHavePrevious = m_ullPreviousTick != 0 && ullElapsed != 0;
+
+    m_previous = current;
+    m_ullPreviousTick = ullNow;
+
+    InterlockedExchange(&m_lPublishing, 0L);
+
+    //
+    // The first interval after a session started only takes the baseline
+    // for the rates.
+    //
+    if (!fHavePrevious)
+    {
+        return;
+    }
+
+    const LONG64 cRequests = current.cTotalRequests - previous.cTotalRequests;
+    const LONG64 cForwarded = current.cForwardedRequests - previous.cForwardedRequests;
+    const LONG64 llForwardMicroseconds = current.llForwardMicroseconds - previous.llForwardMicroseconds;
+
+    const UINT64 ullRequestsPerSecond = cRequests <= 0 ? 0 : static_cast<UINT64>(cRequests) * 1000 / ullElapsed;
+    const UINT64 ullAverageForwardMicroseconds = cForwarded <= 0 ? 0 : static_cast<UINT64>(llForwardMicroseconds / cForwarded);
+
+    TraceLoggingWrite(g_hTraceProvider,
+        "ApplicationCounters",
+        TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+        TraceLoggingKeyword(ASPNETCORE_TRACE_KEYWORD_COUNTERS),
+        TraceLoggingWideString(m_applicationId.c_str(), "ApplicationId"),
+        TraceLoggingUInt64(ullRequestsPerSecond, "RequestsPerSecond"),
+        TraceLoggingInt64(max(current.cActiveRequests, 0LL), "ActiveRequests"),
+        TraceLoggingInt64(max(current.cQueuedRequests, 0LL), "QueuedRequests"),
+        TraceLoggingInt64(current.rgcForwardingErrors[APPLICATION_COUNTERS::FORWARDING_ERROR_PROCESS_START], "ProcessStartErrors"),
+        TraceLoggingInt64(current.rgcForwardingErrors[APPLICATION_COUNTERS::FORWARDING_ERROR_CONNECT], "ConnectErrors"),
+        TraceLoggingInt64(current.rgcForwardingErrors[APPLICATION_COUNTERS::FORWARDING_ERROR_TIMEOUT], "TimeoutErrors"),
+        TraceLoggingInt64(current.rgcForwardingErrors[APPLICATION_COUNTERS::FORWARDING_ERROR_INVALID_RESPONSE], "InvalidResponseErrors"),
+        TraceLoggingInt64(current.rgcForwardingErrors[APPLICATION_COUNTERS::FORWARDING_ERROR_UNAVAILABLE], "UnavailableErrors"),
+        TraceLoggingInt64(current.rgcForwardingErrors[APPLICATION_COUNTERS::FORWARDING_ERROR_OTHER], "OtherErrors"),
+        TraceLoggingInt64(current.cBackendRestarts, "BackendRestarts"),
+        TraceLoggingInt64(current.cRapidFailTrips, "RapidFailTrips"),
+        TraceLoggingInt64(current.cBackendEjections, "BackendEjections"),
+        TraceLoggingInt64(max(current.cWinHttpConnections, 0LL), "WinHttpConnections"),
+        TraceLoggingUInt64(ullAverageForwardMicroseconds, "AverageForwardMicroseconds"),
+        TraceLoggingInt64(max(current.rgcbMemory[APPLICATION_COUNTERS::MEMORY_TAG_HANDLERS], 0LL), "HandlerMemoryBytes"),
+        TraceLoggingInt64(max(current.rgcbMemory[APPLICATION_COUNTERS::MEMORY_TAG_RESPONSE_BUFFERS], 0LL), "ResponseBufferMemoryBytes"),
+        TraceLoggingInt64(max(current.rgcbMemory[APPLICATION_COUNTERS::MEMORY_TAG_WEBSOCKET_BUFFERS], 0LL), "WebSocketBufferMemoryBytes"),
+        TraceLoggingInt64(max(current.rgcbMemory[APPLICATION_COUNTERS::MEMORY_TAG_STDOUT_CAPTURE], 0LL), "StdoutCaptureMemoryBytes"));
+}
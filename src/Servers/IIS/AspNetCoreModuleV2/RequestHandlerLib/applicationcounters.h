@@ -0,0 +1,304 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <Windows.h>
+#include <functional>
+#include <string>
+#include "percpu.h"
+
+//
+// Request and backend counters of one application.
+//
+// Like WEBSOCKET_COUNTERS every CPU updates its own block and the blocks
+// are only summed up for a snapshot, so counting costs the request path
+// an interlocked add on a cache line no other CPU writes.
+//
+class APPLICATION_COUNTERS
+{
+public:
+
+    enum FORWARDING_ERROR
+    {
+        // The backend process did not start or is held back by rapid fail.
+        FORWARDING_ERROR_PROCESS_START = 0,
+        FORWARDING_ERROR_CONNECT,
+        FORWARDING_ERROR_TIMEOUT,
+        FORWARDING_ERROR_INVALID_RESPONSE,
+        // Turned away while stopping or over the request limits.
+        FORWARDING_ERROR_UNAVAILABLE,
+        FORWARDING_ERROR_OTHER,
+        FORWARDING_ERROR_COUNT
+    };
+
+    //
+    // What the native memory charged to the application is held for. The
+    // pools are shared by the applications of the worker process, the
+    // memory is charged to the one whose request took it out.
+    //
+    enum MEMORY_TAG
+    {
+        // Request handler objects.
+        MEMORY_TAG_HANDLERS = 0,
+        // Entity buffers of forwarded requests and responses.
+        MEMORY_TAG_RESPONSE_BUFFERS,
+        MEMORY_TAG_WEBSOCKET_BUFFERS,
+        // Buffer of the stdout and stderr captured for startup errors.
+        MEMORY_TAG_STDOUT_CAPTURE,
+        MEMORY_TAG_COUNT
+    };
+
+    struct SNAPSHOT
+    {
+        LONG64  cTotalRequests;
+        LONG64  cActiveRequests;
+        // Requests waiting for in-process admission.
+        LONG64  cQueuedRequests;
+        LONG64  rgcForwardingErrors[FORWARDING_ERROR_COUNT];
+        // Processes taken out of their slot after a crash or a failed start.
+        LONG64  cBackendRestarts;
+        LONG64  cRapidFailTrips;
+        // Live processes taken out of routing for failing health checks.
+        LONG64  cBackendEjections;
+        // Open WinHTTP requests, each holds a backend connection.
+        LONG64  cWinHttpConnections;
+        LONG64  cForwardedRequests;
+        LONG64  llForwardMicroseconds;
+        // Bytes currently held, by MEMORY_TAG.
+        LONG64  rgcbMemory[MEMORY_TAG_COUNT];
+    };
+
+    APPLICATION_COUNTERS();
+
+    ~APPLICATION_COUNTERS();
+
+    HRESULT
+    Initialize(
+        VOID
+    );
+
+    VOID
+    RequestStarted(
+        VOID
+    )
+    {
+        Increment(&SNAPSHOT::cTotalRequests);
+        Increment(&SNAPSHOT::cActiveRequests);
+    }
+
+    VOID
+    RequestCompleted(
+        VOID
+    )
+    {
+        Add(&SNAPSHOT::cActiveRequests, -1);
+    }
+
+    VOID
+    RequestQueued(
+        VOID
+    )
+    {
+        Increment(&SNAPSHOT::cQueuedRequests);
+    }
+
+    VOID
+    RequestDequeued(
+        VOID
+    )
+    {
+        Add(&SNAPSHOT::cQueuedRequests, -1);
+    }
+
+    VOID
+    RecordForwardingError(
+        FORWARDING_ERROR    error
+    );
+
+    //
+    // Accounts for one forwarded request, taking llForwardMicroseconds
+    // from the start of the request to the last byte of the response.
+    //
+    VOID
+    RecordForward(
+        LONG64  llForwardMicroseconds
+    );
+
+    VOID
+    WinHttpConnectionOpened(
+        VOID
+    )
+    {
+        Increment(&SNAPSHOT::cWinHttpConnections);
+    }
+
+    VOID
+    WinHttpConnectionClosed(
+        VOID
+    )
+    {
+        Add(&SNAPSHOT::cWinHttpConnections, -1);
+    }
+
+    VOID
+    BackendRestarted(
+        VOID
+    )
+    {
+        Increment(&SNAPSHOT::cBackendRestarts);
+    }
+
+    VOID
+    BackendEjected(
+        VOID
+    )
+    {
+        Increment(&SNAPSHOT::cBackendEjections);
+    }
+
+    VOID
+    RapidFailTripped(
+        VOID
+    )
+    {
+        Increment(&SNAPSHOT::cRapidFailTrips);
+    }
+
+    //
+    // Takes and gives back cbMemory bytes of native memory for the
+    // application. A pooled block is charged at the size it was carved at,
+    // not the size asked for.
+    //
+    VOID
+    MemoryCharged(
+        MEMORY_TAG  tag,
+        SIZE_T      cbMemory
+    )
+    {
+        AddMemory(tag, static_cast<LONG64>(cbMemory));
+    }
+
+    VOID
+    MemoryReleased(
+        MEMORY_TAG  tag,
+        SIZE_T      cbMemory
+    )
+    {
+        AddMemory(tag, -static_cast<LONG64>(cbMemory));
+    }
+
+    //
+    // Adds the totals of all CPUs to *pSnapshot, so that the counters of
+    // several owners add up to the ones of the application.
+    //
+    VOID
+    AddToSnapshot(
+        _Inout_ SNAPSHOT * pSnapshot
+    );
+
+private:
+
+    APPLICATION_COUNTERS(const APPLICATION_COUNTERS &);
+    void operator=(const APPLICATION_COUNTERS &);
+
+    VOID
+    Increment(
+        LONG64 SNAPSHOT::*  pllCounter
+    )
+    {
+        Add(pllCounter, 1);
+    }
+
+    //
+    // The block of another CPU may go negative, only the sum is meaningful.
+    // Interlocked as a thread may move to another CPU after GetLocal.
+    //
+    VOID
+    Add(
+        LONG64 SNAPSHOT::*  pllCounter,
+        LONG64              llValue
+    )
+    {
+        if (m_pCounters != NULL)
+        {
+            InterlockedAdd64(&(m_pCounters->GetLocal()->*pllCounter), llValue);
+        }
+    }
+
+    VOID
+    AddMemory(
+        MEMORY_TAG  tag,
+        LONG64      llValue
+    )
+    {
+        if (m_pCounters != NULL && tag < MEMORY_TAG_COUNT)
+        {
+            InterlockedAdd64(&m_pCounters->GetLocal()->rgcbMemory[tag], llValue);
+        }
+    }
+
+    PER_CPU<SNAPSHOT> *     m_pCounters;
+};
+
+//
+// Writes the counters of an application as an ApplicationCounters event
+// of the module's TraceLogging provider once a second, while a session
+// enabled ASPNETCORE_TRACE_KEYWORD_COUNTERS at the informational level.
+// Rates and the average latency are taken over the last interval.
+//
+class APPLICATION_COUNTERS_PUBLISHER
+{
+public:
+
+    // Fills the snapshot, which comes zeroed, from the owners' counters.
+    typedef std::function<VOID(APPLICATION_COUNTERS::SNAPSHOT *)> COLLECT_CALLBACK;
+
+    static constexpr DWORD PUBLISH_INTERVAL_MS = 1000;
+
+    APPLICATION_COUNTERS_PUBLISHER();
+
+    ~APPLICATION_COUNTERS_PUBLISHER();
+
+    HRESULT
+    Start(
+        const std::wstring &    applicationId,
+        COLLECT_CALLBACK        collect
+    );
+
+    //
+    // Waits for a publish in progress, the counters collect reads may go
+    // away once this returned. Must be called before they do.
+    //
+    VOID
+    Stop(
+        VOID
+    );
+
+private:
+
+    APPLICATION_COUNTERS_PUBLISHER(const APPLICATION_COUNTERS_PUBLISHER &);
+    void operator=(const APPLICATION_COUNTERS_PUBLISHER &);
+
+    VOID
+    Publish(
+        VOID
+    );
+
+    static
+    VOID
+    CALLBACK
+    TimerCallback(
+        _Inout_     PTP_CALLBACK_INSTANCE   Instance,
+        _Inout_opt_ PVOID                   pContext,
+        _Inout_     PTP_TIMER               pTimer
+    );
+
+    PTP_TIMER                       m_pTimer;
+    std::wstring                    m_applicationId;
+    COLLECT_CALLBACK                m_collect;
+    // The snapshot of the previous publish, 0 ticks if there was none.
+    APPLICATION_COUNTERS::SNAPSHOT  m_previous;
+    ULONGLONG                       m_ullPreviousTick;
+    volatile LONG                   m_lPublishing;
+};
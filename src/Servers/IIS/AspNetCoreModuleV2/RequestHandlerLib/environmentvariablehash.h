@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include "flathash.h"
+
 #define HOSTING_STARTUP_ASSEMBLIES_ENV_STR          L"ASPNETCORE_HOSTINGSTARTUPASSEMBLIES"
 #define HOSTING_STARTUP_ASSEMBLIES_VALUE            L"Microsoft.AspNetCore.Server.IISIntegration"
 #define ASPNETCORE_IIS_AUTH_ENV_STR                 L"ASPNETCORE_IIS_HTTPAUTH"
@@ -79,13 +81,9 @@ private:
 };
 
 
-class ENVIRONMENT_VAR_HASH : public HASH_TABLE<ENVIRONMENT_VAR_ENTRY, PWSTR>
+struct ENVIRONMENT_VAR_HASH_TRAITS
 {
-public:
-    ENVIRONMENT_VAR_HASH()
-    {
-    }
-
+    static
     PWSTR
     ExtractKey(
         ENVIRONMENT_VAR_ENTRY *   pEntry
@@ -94,14 +92,16 @@ public:
         return pEntry->QueryName();
     }
 
+    static
     DWORD
     CalcKeyHash(
         PWSTR   pszName
     )
     {
-        return HashStringNoCase(pszName);
+        return HashStringNoCaseFast(pszName);
     }
 
+    static
     BOOL
     EqualKeys(
         PWSTR   pszName1,
@@ -111,6 +111,7 @@ public:
         return (_wcsicmp(pszName1, pszName2) == 0);
     }
 
+    static
     VOID
     ReferenceRecord(
         ENVIRONMENT_VAR_ENTRY *   pEntry
@@ -119,6 +120,7 @@ public:
         pEntry->Reference();
     }
 
+    static
     VOID
     DereferenceRecord(
         ENVIRONMENT_VAR_ENTRY *   pEntry
@@ -126,7 +128,14 @@ public:
     {
         pEntry->Dereference();
     }
+};
 
+class ENVIRONMENT_VAR_HASH : public FLAT_HASH_TABLE<ENVIRONMENT_VAR_ENTRY, PWSTR, ENVIRONMENT_VAR_HASH_TRAITS>
+{
+public:
+    ENVIRONMENT_VAR_HASH()
+    {
+    }
 
 private:
     ENVIRONMENT_VAR_HASH(const ENVIRONMENT_VAR_HASH &);
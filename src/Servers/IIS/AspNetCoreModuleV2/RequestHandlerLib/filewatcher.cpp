@@ -9,74 +9,23 @@
 #include <EventLog.h>
 
 FILE_WATCHER::FILE_WATCHER() :
-    m_hCompletionPort(nullptr),
-    m_hChangeNotificationThread(nullptr),
-    m_fThreadExit(false),
     m_fShadowCopyEnabled(false),
-    m_copied(false)
+    m_copied(false),
+    m_shutdownTimeout(0),
+    m_shadowCopyQuietPeriod(0),
+    m_shadowCopyMaxDelay(0),
+    m_ulFirstDllChangeTime(0)
 {
     m_pDoneCopyEvent = CreateEvent(
         nullptr,  // default security attributes
         TRUE,     // manual reset event
         FALSE,    // not set
         nullptr); // name
-
-    // Use of TerminateThread for the file watcher thread was eliminated in favor of an event-based
-    // approach. Out of an abundance of caution, we are temporarily adding an environment variable
-    // to allow falling back to TerminateThread usage. If all goes well, this will be removed in a
-    // future release.
-    m_fRudeThreadTermination = false;
-    auto enableThreadTerminationValue = Environment::GetEnvironmentVariableValue(L"ASPNETCORE_FILE_WATCHER_THREAD_TERMINATION");
-    if (enableThreadTerminationValue.has_value())
-    {
-        m_fRudeThreadTermination = (enableThreadTerminationValue.value() == L"1");
-    }
 }
 
 FILE_WATCHER::~FILE_WATCHER()
 {
     StopMonitor();
-    WaitForWatcherThreadExit();
-}
-
-void FILE_WATCHER::WaitForWatcherThreadExit()
-{
-    if (m_hChangeNotificationThread == nullptr)
-    {
-        return;
-    }
-
-    if (m_fRudeThreadTermination)
-    {
-        // This is the old behavior, which is now opt-in using an environment variable. Wait for
-        // the thread to exit, but if it doesn't exit soon enough, terminate it.
-        const int totalWaitTimeMs = 10000;
-        const int waitIntervalMs = 50;
-        const int iterations = totalWaitTimeMs / waitIntervalMs;
-        for (int i = 0; i < iterations && !m_fThreadExit; i++)
-        {
-            // Check if the thread has exited.
-            DWORD result = WaitForSingleObject(m_hChangeNotificationThread, waitIntervalMs);
-            if (result == WAIT_OBJECT_0)
-            {
-                // The thread has exited.
-                m_fThreadExit = true;
-                break;
-            }
-        }
-
-        if (!m_fThreadExit)
-        {
-            LOG_INFO(L"File watcher thread did not exit. Forcing termination.");
-            TerminateThread(m_hChangeNotificationThread, 1);
-        }
-    }
-    else
-    {
-        // Wait for the thread to exit.
-        LOG_INFO(L"Waiting for file watcher thread to exit.");
-        WaitForSingleObject(m_hChangeNotificationThread, INFINITE);
-    }
 }
 
 HRESULT
@@ -85,21 +34,16 @@ FILE_WATCHER::Create(
     _In_ PCWSTR                  pszFileNameToMonitor,
     _In_ const std::wstring&     shadowCopyPath,
     _In_ AppOfflineTrackingApplication* pApplication,
-    _In_ DWORD                   shutdownTimeout
+    _In_ DWORD                   shutdownTimeout,
+    _In_ DWORD                   shadowCopyQuietPeriod,
+    _In_ DWORD                   shadowCopyMaxDelay
 )
 {
     m_shadowCopyPath = shadowCopyPath;
     m_fShadowCopyEnabled = !shadowCopyPath.empty();
     m_shutdownTimeout = shutdownTimeout;
-
-    RETURN_LAST_ERROR_IF_NULL(m_hCompletionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 0));
-
-    RETURN_LAST_ERROR_IF_NULL(m_hChangeNotificationThread = CreateThread(nullptr,
-        0,
-        (LPTHREAD_START_ROUTINE)ChangeNotificationThread,
-        this,
-        0,
-        NULL));
+    m_shadowCopyQuietPeriod = shadowCopyQuietPeriod;
+    m_shadowCopyMaxDelay = shadowCopyMaxDelay;
 
     if (pszDirectoryToMonitor == nullptr ||
         pszFileNameToMonitor == nullptr ||
@@ -111,118 +55,42 @@ FILE_WATCHER::Create(
 
     _pApplication = ReferenceApplication(pApplication);
 
-    RETURN_IF_FAILED(_strFileName.Copy(pszFileNameToMonitor));
+    if (m_fShadowCopyEnabled)
+    {
+        // Only armed once dlls change
+        RETURN_IF_FAILED(m_Timer.InitializeTimer(FILE_WATCHER::TimerCallback, this));
+    }
+
+    _fileName = pszFileNameToMonitor;
     RETURN_IF_FAILED(_strDirectoryName.Copy(pszDirectoryToMonitor));
     RETURN_IF_FAILED(_strFullName.Append(_strDirectoryName));
-    RETURN_IF_FAILED(_strFullName.Append(_strFileName));
+    RETURN_IF_FAILED(_strFullName.Append(pszFileNameToMonitor));
 
-    //
-    // Resize change buffer to something "reasonable"
-    //
-    RETURN_LAST_ERROR_IF(!_buffDirectoryChanges.Resize(FILE_WATCHER_ENTRY_BUFFER_SIZE));
-
-    _hDirectory = CreateFileW(
+    RETURN_IF_FAILED(DirectoryWatchService::StartWatching(
         _strDirectoryName.QueryStr(),
-        FILE_LIST_DIRECTORY,
-        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
-        nullptr,
-        OPEN_EXISTING,
-        FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
-        NULL);
-
-    RETURN_LAST_ERROR_IF(_hDirectory == INVALID_HANDLE_VALUE);
-
-    RETURN_LAST_ERROR_IF_NULL(CreateIoCompletionPort(
-        _hDirectory,
-        m_hCompletionPort,
-        NULL,
-        0));
-
-    RETURN_IF_FAILED(Monitor());
-
-    return S_OK;
-}
-
-DWORD
-WINAPI
-FILE_WATCHER::ChangeNotificationThread(
-    LPVOID  pvArg
-)
-/*++
-
-Routine Description:
-
-IO completion thread
-
-Arguments:
-
-None
-
-Return Value:
-
-Win32 error
-
---*/
-{
-    FILE_WATCHER* pFileMonitor = (FILE_WATCHER*)pvArg;
-    
-    LOG_INFO(L"Starting file watcher thread");
-    DBG_ASSERT(pFileMonitor != nullptr);
-
-    while (true)
-    {
-
-        DWORD       cbCompletion = 0;
-        OVERLAPPED* pOverlapped = nullptr;
-        ULONG_PTR   completionKey;
-
-        BOOL success = GetQueuedCompletionStatus(
-            pFileMonitor->m_hCompletionPort,
-            &cbCompletion,
-            &completionKey,
-            &pOverlapped,
-            INFINITE);
-
-        DBG_ASSERT(success);
-        (void)success;
-
-        if (completionKey == FILE_WATCHER_SHUTDOWN_KEY)
-        {
-            break;
-        }
-
-        DBG_ASSERT(pOverlapped != nullptr);
-        if (pOverlapped != nullptr)
+        FILE_NOTIFY_VALID_MASK & ~FILE_NOTIFY_CHANGE_LAST_ACCESS,
+        [this](HRESULT hr, const FILE_NOTIFY_INFORMATION* pNotifications)
         {
-            pFileMonitor->HandleChangeCompletion(cbCompletion);
-
-            if (!pFileMonitor->_lStopMonitorCalled)
+            // A failed watch stops reporting changes, nothing to handle.
+            if (SUCCEEDED(hr))
             {
-                //
-                // Continue monitoring
-                //
-                pFileMonitor->Monitor();
+                LOG_IF_FAILED(HandleChangeCompletion(pNotifications));
             }
-        }
-    }
-
-    pFileMonitor->m_fThreadExit = true;
+        },
+        _directoryWatch));
 
-    if (pFileMonitor->m_fShadowCopyEnabled)
+    // Check if file exist because ReadDirectoryChangesW would not fire events for existing files
+    if (GetFileAttributes(_strFullName.QueryStr()) != INVALID_FILE_ATTRIBUTES)
     {
-        // Cancel the timer to avoid it calling copy.
-        pFileMonitor->m_Timer.CancelTimer();
-        FILE_WATCHER::CopyAndShutdown(pFileMonitor);
+        RETURN_IF_FAILED(HandleChangeCompletion(nullptr));
     }
 
-    LOG_INFO(L"Stopping file watcher thread");
-
-    ExitThread(0);
+    return S_OK;
 }
 
 HRESULT
 FILE_WATCHER::HandleChangeCompletion(
-    _In_ DWORD          cbCompletion
+    _In_ const FILE_NOTIFY_INFORMATION* pNotifications
 )
 /*++
 
@@ -233,8 +101,7 @@ need to be flushed)
 
 Arguments:
 
-dwCompletionStatus - Completion status
-cbCompletion - Bytes of completion
+pNotifications - Changes read from the directory, nullptr if they were lost
 
 Return Value:
 
@@ -245,14 +112,6 @@ HRESULT
     BOOL                        fAppOfflineChanged = FALSE;
     BOOL                        fDllChanged = FALSE;
 
-    // When directory handle is closed then HandleChangeCompletion
-    // happens with cbCompletion = 0 and dwCompletionStatus = 0
-    // From documentation it is not clear if that combination
-    // of return values is specific to closing handles or whether
-    // it could also mean an error condition. Hence we will maintain
-    // explicit flag that will help us determine if entry
-    // is being shutdown (StopMonitor() called)
-    //
     if (_lStopMonitorCalled)
     {
         return S_OK;
@@ -263,23 +122,20 @@ HRESULT
     // Let assume the file got changed instead of checking files
     // Otherwise we have to cache the file info
     //
-    if (cbCompletion == 0)
+    if (pNotifications == nullptr)
     {
         fAppOfflineChanged = TRUE;
     }
     else
     {
-        auto pNotificationInfo = (FILE_NOTIFY_INFORMATION*)_buffDirectoryChanges.QueryPtr();
-        DBG_ASSERT(pNotificationInfo != nullptr);
-
-        while (pNotificationInfo != nullptr)
+        for (auto pNotificationInfo = pNotifications;
+            pNotificationInfo != nullptr;
+            pNotificationInfo = DirectoryWatchService::NextNotification(pNotificationInfo))
         {
             //
             // check whether the monitored file got changed
             //
-            if (_wcsnicmp(pNotificationInfo->FileName,
-                _strFileName.QueryStr(),
-                pNotificationInfo->FileNameLength / sizeof(WCHAR)) == 0)
+            if (DirectoryWatchService::IsNotificationFor(pNotificationInfo, _fileName))
             {
                 fAppOfflineChanged = TRUE;
                 auto app = _pApplication.get();
@@ -300,20 +156,6 @@ HRESULT
                     fDllChanged = TRUE;
                 }
             }
-
-            //
-            // Advance to next notification
-            //
-            if (pNotificationInfo->NextEntryOffset == 0)
-            {
-                pNotificationInfo = nullptr;
-            }
-            else
-            {
-                pNotificationInfo = (FILE_NOTIFY_INFORMATION*)
-                    ((PBYTE)pNotificationInfo +
-                        pNotificationInfo->NextEntryOffset);
-            }
         }
     }
 
@@ -326,10 +168,28 @@ HRESULT
 
     if (fDllChanged && m_fShadowCopyEnabled && !_lStopMonitorCalled)
     {
-        // Reset timer for dll checks
-        LOG_INFO(L"Detected dll change, resetting timer callback which will eventually trigger shutdown.");
-        m_Timer.CancelTimer();
-        m_Timer.InitializeTimer(FILE_WATCHER::TimerCallback, this, 5000, INFINITE);
+        //
+        // A deploy changes dlls for a while, each change pushes the copy
+        // back so the whole deploy ends up in one copy and one recycle.
+        // Changes that keep coming only hold it back up to the max delay.
+        //
+        const auto ulCurrentTime = GetTickCount64();
+        if (m_ulFirstDllChangeTime == 0)
+        {
+            m_ulFirstDllChangeTime = ulCurrentTime;
+        }
+
+        const auto ulDeadline = m_ulFirstDllChangeTime + m_shadowCopyMaxDelay;
+        DWORD dwWait = m_shadowCopyQuietPeriod;
+        if (ulCurrentTime + dwWait > ulDeadline)
+        {
+            dwWait = static_cast<DWORD>(ulDeadline > ulCurrentTime ? ulDeadline - ulCurrentTime : 0);
+        }
+
+        LOG_INFOF(L"Detected dll change, shadow copying and shutting down in %d ms.", dwWait);
+
+        // A wait of zero would disable the timer
+        m_Timer.SetTimer(dwWait == 0 ? 1 : dwWait);
     }
 
     return S_OK;
@@ -417,30 +277,6 @@ FILE_WATCHER::RunNotificationCallback(
     return 0;
 }
 
-HRESULT
-FILE_WATCHER::Monitor(VOID)
-{
-    DWORD   cbRead;
-    ZeroMemory(&_overlapped, sizeof(_overlapped));
-
-    RETURN_LAST_ERROR_IF(!ReadDirectoryChangesW(_hDirectory,
-        _buffDirectoryChanges.QueryPtr(),
-        _buffDirectoryChanges.QuerySize(),
-        FALSE,        // Watching sub dirs. Set to False now as only monitoring app_offline
-        FILE_NOTIFY_VALID_MASK & ~FILE_NOTIFY_CHANGE_LAST_ACCESS,
-        &cbRead,
-        &_overlapped,
-        nullptr));
-
-    // Check if file exist because ReadDirectoryChangesW would not fire events for existing files
-    if (GetFileAttributes(_strFullName.QueryStr()) != INVALID_FILE_ATTRIBUTES)
-    {
-        PostQueuedCompletionStatus(m_hCompletionPort, 0, 0, &_overlapped);
-    }
-
-    return S_OK;
-}
-
 VOID
 FILE_WATCHER::StopMonitor()
 {
@@ -456,12 +292,15 @@ FILE_WATCHER::StopMonitor()
 
     LOG_INFO(L"Stopping file watching.");
 
-    // Signal the file watcher thread to exit
-    PostQueuedCompletionStatus(m_hCompletionPort, 0, FILE_WATCHER_SHUTDOWN_KEY, NULL);
-    WaitForWatcherThreadExit();
+    // Returns once a change being handled is done with.
+    _directoryWatch = nullptr;
 
     if (m_fShadowCopyEnabled)
     {
+        // Cancel the timer to avoid it calling copy.
+        m_Timer.CancelTimer();
+        CopyAndShutdown(this);
+
         // If we are shadow copying, wait for the copying to finish.
         WaitForSingleObject(m_pDoneCopyEvent, m_shutdownTimeout);
     }
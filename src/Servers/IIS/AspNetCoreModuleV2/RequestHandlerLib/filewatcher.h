@@ -9,10 +9,9 @@
 #include "iapplication.h"
 #include "HandleWrapper.h"
 #include "Environment.h"
+#include "DirectoryWatchService.h"
 #include <sttimer.h>
 
-#define FILE_WATCHER_SHUTDOWN_KEY           (ULONG_PTR)(-1)
-#define FILE_WATCHER_ENTRY_BUFFER_SIZE      4096
 #define FILE_NOTIFY_VALID_MASK              0x00000fff
 
 class AppOfflineTrackingApplication;
@@ -24,20 +23,16 @@ public:
 
     ~FILE_WATCHER();
 
-    void WaitForWatcherThreadExit();
-
     HRESULT Create(
         _In_ PCWSTR                  pszDirectoryToMonitor,
         _In_ PCWSTR                  pszFileNameToMonitor,
         _In_ const std::wstring&            shadowCopyPath,
         _In_ AppOfflineTrackingApplication *pApplication,
-        _In_ DWORD                   shutdownTimeout
+        _In_ DWORD                   shutdownTimeout,
+        _In_ DWORD                   shadowCopyQuietPeriod,
+        _In_ DWORD                   shadowCopyMaxDelay
     );
 
-    static
-    DWORD
-    WINAPI ChangeNotificationThread(LPVOID);
-
     static
     DWORD
     WINAPI RunNotificationCallback(LPVOID);
@@ -50,30 +45,29 @@ public:
 
     static DWORD WINAPI CopyAndShutdown(FILE_WATCHER* watcher);
 
-    HRESULT HandleChangeCompletion(DWORD cbCompletion);
+    HRESULT HandleChangeCompletion(const FILE_NOTIFY_INFORMATION* pNotifications);
 
-    HRESULT Monitor();
     void StopMonitor();
 
 private:
-    HandleWrapper<NullHandleTraits>               m_hCompletionPort;
-    HandleWrapper<NullHandleTraits>               m_hChangeNotificationThread;
-    HandleWrapper<NullHandleTraits>               _hDirectory;
     HandleWrapper<NullHandleTraits>               m_pDoneCopyEvent;
-    std::atomic_bool        m_fThreadExit;
     STTIMER                 m_Timer;
     SRWLOCK                 m_copyLock{};
     BOOL                    m_copied;
 
-    BUFFER                  _buffDirectoryChanges;
-    STRU                    _strFileName;
+    std::wstring            _fileName;
     STRU                    _strDirectoryName;
     STRU                    _strFullName;
     LONG                    _lStopMonitorCalled {};
     bool                    m_fShadowCopyEnabled;
     std::wstring            m_shadowCopyPath;
     DWORD                   m_shutdownTimeout;
-    OVERLAPPED              _overlapped;
+    // Dll changes are coalesced into one copy once they stop for the quiet
+    // period, or at the latest the max delay after the first one.
+    DWORD                   m_shadowCopyQuietPeriod;
+    DWORD                   m_shadowCopyMaxDelay;
+    ULONGLONG               m_ulFirstDllChangeTime;
     std::unique_ptr<AppOfflineTrackingApplication, IAPPLICATION_DELETER> _pApplication;
-    bool                    m_fRudeThreadTermination;
+    // Directory reads complete on the threads shared by every watcher
+    DirectoryWatchService::WatchHandle _directoryWatch;
 };
@@ -7,6 +7,8 @@
 #include "environmentvariablehash.h"
 #include "exceptions.h"
 #include "config_utility.h"
+#include "file_utility.h"
+#include "HandleWrapper.h"
 #include "Environment.h"
 
 REQUESTHANDLER_CONFIG::~REQUESTHANDLER_CONFIG()
@@ -88,6 +90,40 @@ REQUESTHANDLER_CONFIG::Populate(
     STRU                            strEnvName;
     STRU                            strEnvValue;
     STRU                            strExpandedEnvValue;
+    STRU                            struResponseReadAheadBuffers;
+    STRU                            struRequestBodyReadAheadBuffers;
+    STRU                            struRequestBodyReadAheadLimit;
+    STRU                            struRequestBufferingMemoryLimit;
+    STRU                            struRequestBufferingMaxSize;
+    STRU                            struMaxRequestBodySize;
+    STRU                            struResponseSpoolingMemoryLimit;
+    STRU                            struResponseSpoolingMaxSize;
+    STRU                            struResponseBufferingPolicy;
+    STRU                            struIdempotentRequestRetries;
+    STRU                            struMaxConnectionsPerBackend;
+    STRU                            struPrewarmConnections;
+    STRU                            struPriorityPaths;
+    STRU                            struStandbyProcesses;
+    STRU                            struProcessCpuRateLimit;
+    STRU                            struProcessMemoryLimit;
+    STRU                            struProcessWorkingSetLimit;
+    STRU                            struProcessNumaNode;
+    STRU                            struProcessCpuSets;
+    STRU                            struRapidFailBackoffInitial;
+    STRU                            struRapidFailBackoffMax;
+    STRU                            struRapidFailRecoveryInterval;
+    STRU                            struHealthCheckInterval;
+    STRU                            struHealthCheckTimeout;
+    STRU                            struHealthCheckUnhealthyThreshold;
+    STRU                            struOutlierConsecutiveFailures;
+    STRU                            struIdleScaleDownTimeout;
+    STRU                            struWebSocketReceiveBufferSize;
+    STRU                            struWebSocketIdleTimeout;
+    STRU                            struWebSocketSlowClientTimeout;
+    STRU                            struWebSocketMaxMessageSize;
+    STRU                            struRequestSamplingRate;
+    STRU                            struResponseCacheSize;
+    STRU                            struResponseInlineReads;
     STRU                            strApplicationFullPath;
     IAppHostAdminManager           *pAdminManager = NULL;
     IAppHostElement                *pAspNetCoreElement = NULL;
@@ -421,6 +457,499 @@ REQUESTHANDLER_CONFIG::Populate(
         goto Finished;
     }
 
+    hr = ConfigUtility::FindForwardTimingsServerVariable(pAspNetCoreElement, m_struForwardTimingsServerVariable);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    hr = ConfigUtility::FindOffloadResponseCompression(pAspNetCoreElement, m_struOffloadResponseCompression);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    hr = ConfigUtility::FindIdempotentRequestRetries(pAspNetCoreElement, struIdempotentRequestRetries);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struIdempotentRequestRetries.IsEmpty())
+    {
+        m_dwIdempotentRequestRetries = _wtoi(struIdempotentRequestRetries.QueryStr());
+    }
+
+    hr = ConfigUtility::FindMaxConnectionsPerBackend(pAspNetCoreElement, struMaxConnectionsPerBackend);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struMaxConnectionsPerBackend.IsEmpty())
+    {
+        m_dwMaxConnectionsPerBackend = _wtoi(struMaxConnectionsPerBackend.QueryStr());
+    }
+
+    hr = ConfigUtility::FindPrewarmConnections(pAspNetCoreElement, struPrewarmConnections);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struPrewarmConnections.IsEmpty())
+    {
+        m_dwPrewarmConnections = _wtoi(struPrewarmConnections.QueryStr());
+    }
+
+    hr = ConfigUtility::FindIsolateWinHttpSession(pAspNetCoreElement, m_struIsolateWinHttpSession);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    hr = ConfigUtility::FindPriorityPaths(pAspNetCoreElement, struPriorityPaths);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    try
+    {
+        m_priorityPaths = PriorityPaths(std::wstring_view(struPriorityPaths.QueryStr(), struPriorityPaths.QueryCCH()));
+    }
+    catch (...)
+    {
+        hr = OBSERVE_CAUGHT_EXCEPTION();
+        goto Finished;
+    }
+
+    hr = ConfigUtility::FindProcessRoutingPolicy(pAspNetCoreElement, m_struProcessRoutingPolicy);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    hr = ConfigUtility::FindStandbyProcesses(pAspNetCoreElement, struStandbyProcesses);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struStandbyProcesses.IsEmpty())
+    {
+        m_dwStandbyProcesses = _wtoi(struStandbyProcesses.QueryStr());
+    }
+
+    hr = ConfigUtility::FindStandbyWarmupUrl(pAspNetCoreElement, m_struStandbyWarmupUrl);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    hr = ConfigUtility::FindEagerProcessStartup(pAspNetCoreElement, m_struEagerProcessStartup);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    hr = ConfigUtility::FindShareBackendsAcrossWebGarden(pAspNetCoreElement, m_struShareBackendsAcrossWebGarden);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    hr = ConfigUtility::FindRequestDelegation(pAspNetCoreElement, m_struRequestDelegation);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    hr = ConfigUtility::FindCacheWindowsAuthToken(pAspNetCoreElement, m_struCacheWindowsAuthToken);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    hr = ConfigUtility::FindSendFileRoot(pAspNetCoreElement, m_struSendFileRoot);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!m_struSendFileRoot.IsEmpty())
+    {
+        hr = ResolveSendFileRoot();
+        if (FAILED(hr))
+        {
+            goto Finished;
+        }
+    }
+
+    hr = ConfigUtility::FindResponseReadAheadBuffers(pAspNetCoreElement, struResponseReadAheadBuffers);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struResponseReadAheadBuffers.IsEmpty())
+    {
+        m_dwResponseReadAheadBuffers = _wtoi(struResponseReadAheadBuffers.QueryStr());
+    }
+
+    hr = ConfigUtility::FindRequestBodyReadAheadBuffers(pAspNetCoreElement, struRequestBodyReadAheadBuffers);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struRequestBodyReadAheadBuffers.IsEmpty())
+    {
+        m_dwRequestBodyReadAheadBuffers = _wtoi(struRequestBodyReadAheadBuffers.QueryStr());
+    }
+
+    hr = ConfigUtility::FindRequestBodyReadAheadLimit(pAspNetCoreElement, struRequestBodyReadAheadLimit);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struRequestBodyReadAheadLimit.IsEmpty())
+    {
+        m_dwRequestBodyReadAheadLimit = _wtoi(struRequestBodyReadAheadLimit.QueryStr());
+    }
+
+    hr = ConfigUtility::FindRequestBufferingMemoryLimit(pAspNetCoreElement, struRequestBufferingMemoryLimit);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struRequestBufferingMemoryLimit.IsEmpty())
+    {
+        m_dwRequestBufferingMemoryLimit = _wtoi(struRequestBufferingMemoryLimit.QueryStr());
+    }
+
+    hr = ConfigUtility::FindRequestBufferingMaxSize(pAspNetCoreElement, struRequestBufferingMaxSize);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struRequestBufferingMaxSize.IsEmpty())
+    {
+        m_dwRequestBufferingMaxSize = _wtoi(struRequestBufferingMaxSize.QueryStr());
+    }
+
+    hr = ConfigUtility::FindMaxRequestBodySize(pAspNetCoreElement, struMaxRequestBodySize);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struMaxRequestBodySize.IsEmpty())
+    {
+        m_dwMaxRequestBodySize = _wtoi(struMaxRequestBodySize.QueryStr());
+    }
+
+    hr = ConfigUtility::FindResponseSpoolingMemoryLimit(pAspNetCoreElement, struResponseSpoolingMemoryLimit);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struResponseSpoolingMemoryLimit.IsEmpty())
+    {
+        m_dwResponseSpoolingMemoryLimit = _wtoi(struResponseSpoolingMemoryLimit.QueryStr());
+    }
+
+    hr = ConfigUtility::FindResponseSpoolingMaxSize(pAspNetCoreElement, struResponseSpoolingMaxSize);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struResponseSpoolingMaxSize.IsEmpty())
+    {
+        m_dwResponseSpoolingMaxSize = _wtoi(struResponseSpoolingMaxSize.QueryStr());
+    }
+
+    hr = ConfigUtility::FindResponseBufferingPolicy(pAspNetCoreElement, struResponseBufferingPolicy);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struResponseBufferingPolicy.IsEmpty())
+    {
+        hr = ParseResponseBufferingPolicies(struResponseBufferingPolicy.QueryStr(), m_responseBufferingPolicies);
+        if (FAILED(hr))
+        {
+            goto Finished;
+        }
+    }
+
+    hr = ConfigUtility::FindRapidFailBackoffInitial(pAspNetCoreElement, struRapidFailBackoffInitial);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struRapidFailBackoffInitial.IsEmpty())
+    {
+        m_dwRapidFailBackoffInitialInMS = _wtoi(struRapidFailBackoffInitial.QueryStr());
+    }
+
+    hr = ConfigUtility::FindRapidFailBackoffMax(pAspNetCoreElement, struRapidFailBackoffMax);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struRapidFailBackoffMax.IsEmpty())
+    {
+        m_dwRapidFailBackoffMaxInMS = _wtoi(struRapidFailBackoffMax.QueryStr());
+    }
+
+    hr = ConfigUtility::FindRapidFailRecoveryInterval(pAspNetCoreElement, struRapidFailRecoveryInterval);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struRapidFailRecoveryInterval.IsEmpty())
+    {
+        m_dwRapidFailRecoveryIntervalInMS = _wtoi(struRapidFailRecoveryInterval.QueryStr());
+    }
+
+    hr = ConfigUtility::FindHealthCheckPath(pAspNetCoreElement, m_struHealthCheckPath);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    hr = ConfigUtility::FindHealthCheckInterval(pAspNetCoreElement, struHealthCheckInterval);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struHealthCheckInterval.IsEmpty())
+    {
+        m_dwHealthCheckIntervalInMS = _wtoi(struHealthCheckInterval.QueryStr());
+    }
+
+    hr = ConfigUtility::FindHealthCheckTimeout(pAspNetCoreElement, struHealthCheckTimeout);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struHealthCheckTimeout.IsEmpty())
+    {
+        m_dwHealthCheckTimeoutInMS = _wtoi(struHealthCheckTimeout.QueryStr());
+    }
+
+    hr = ConfigUtility::FindHealthCheckUnhealthyThreshold(pAspNetCoreElement, struHealthCheckUnhealthyThreshold);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struHealthCheckUnhealthyThreshold.IsEmpty())
+    {
+        m_dwHealthCheckUnhealthyThreshold = _wtoi(struHealthCheckUnhealthyThreshold.QueryStr());
+    }
+
+    hr = ConfigUtility::FindOutlierConsecutiveFailures(pAspNetCoreElement, struOutlierConsecutiveFailures);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struOutlierConsecutiveFailures.IsEmpty())
+    {
+        m_dwOutlierConsecutiveFailures = _wtoi(struOutlierConsecutiveFailures.QueryStr());
+    }
+
+    hr = ConfigUtility::FindIdleScaleDownTimeout(pAspNetCoreElement, struIdleScaleDownTimeout);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struIdleScaleDownTimeout.IsEmpty())
+    {
+        // In minutes, like the IIS idle timeout.
+        m_dwIdleScaleDownTimeoutInMS = _wtoi(struIdleScaleDownTimeout.QueryStr()) * 60000;
+    }
+
+    hr = ConfigUtility::FindIdleSuspend(pAspNetCoreElement, m_struIdleSuspend);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    hr = ConfigUtility::FindWebSocketReceiveBufferSize(pAspNetCoreElement, struWebSocketReceiveBufferSize);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struWebSocketReceiveBufferSize.IsEmpty())
+    {
+        m_dwWebSocketReceiveBufferSize = _wtoi(struWebSocketReceiveBufferSize.QueryStr());
+    }
+
+    hr = ConfigUtility::FindWebSocketCoalesceFragments(pAspNetCoreElement, m_struWebSocketCoalesceFragments);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    hr = ConfigUtility::FindWebSocketIdleTimeout(pAspNetCoreElement, struWebSocketIdleTimeout);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struWebSocketIdleTimeout.IsEmpty())
+    {
+        m_dwWebSocketIdleTimeoutInMS = _wtoi(struWebSocketIdleTimeout.QueryStr()) * MILLISECONDS_IN_ONE_SECOND;
+    }
+
+    hr = ConfigUtility::FindWebSocketStripExtensions(pAspNetCoreElement, m_struWebSocketStripExtensions);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    hr = ConfigUtility::FindWebSocketSlowClientTimeout(pAspNetCoreElement, struWebSocketSlowClientTimeout);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struWebSocketSlowClientTimeout.IsEmpty())
+    {
+        m_dwWebSocketSlowClientTimeoutInMS = _wtoi(struWebSocketSlowClientTimeout.QueryStr()) * MILLISECONDS_IN_ONE_SECOND;
+    }
+
+    hr = ConfigUtility::FindWebSocketMaxMessageSize(pAspNetCoreElement, struWebSocketMaxMessageSize);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struWebSocketMaxMessageSize.IsEmpty())
+    {
+        m_dwWebSocketMaxMessageSize = _wtoi(struWebSocketMaxMessageSize.QueryStr());
+    }
+
+    hr = ConfigUtility::FindRequestSamplingRate(pAspNetCoreElement, struRequestSamplingRate);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struRequestSamplingRate.IsEmpty())
+    {
+        m_dwRequestSamplingRate = _wtoi(struRequestSamplingRate.QueryStr());
+    }
+
+    hr = ConfigUtility::FindResponseCacheSize(pAspNetCoreElement, struResponseCacheSize);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struResponseCacheSize.IsEmpty())
+    {
+        m_dwResponseCacheSize = _wtoi(struResponseCacheSize.QueryStr());
+    }
+
+    hr = ConfigUtility::FindResponseInlineReads(pAspNetCoreElement, struResponseInlineReads);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struResponseInlineReads.IsEmpty())
+    {
+        m_dwResponseInlineReads = _wtoi(struResponseInlineReads.QueryStr());
+    }
+
+    hr = ConfigUtility::FindProcessNumaPlacement(pAspNetCoreElement, m_struProcessNumaPlacement);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    hr = ConfigUtility::FindNumaLocalCompletions(pAspNetCoreElement, m_struNumaLocalCompletions);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    hr = ConfigUtility::FindProcessCpuRateLimit(pAspNetCoreElement, struProcessCpuRateLimit);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struProcessCpuRateLimit.IsEmpty())
+    {
+        m_processResourceLimits.dwCpuRatePercent = min(static_cast<DWORD>(_wtoi(struProcessCpuRateLimit.QueryStr())), 100UL);
+    }
+
+    hr = ConfigUtility::FindProcessMemoryLimit(pAspNetCoreElement, struProcessMemoryLimit);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struProcessMemoryLimit.IsEmpty())
+    {
+        m_processResourceLimits.dwMemoryLimitInMB = _wtoi(struProcessMemoryLimit.QueryStr());
+    }
+
+    hr = ConfigUtility::FindProcessWorkingSetLimit(pAspNetCoreElement, struProcessWorkingSetLimit);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struProcessWorkingSetLimit.IsEmpty())
+    {
+        m_processResourceLimits.dwWorkingSetLimitInMB = _wtoi(struProcessWorkingSetLimit.QueryStr());
+    }
+
+    hr = ConfigUtility::FindProcessNumaNode(pAspNetCoreElement, struProcessNumaNode);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struProcessNumaNode.IsEmpty())
+    {
+        m_processResourceLimits.lNumaNode = _wtoi(struProcessNumaNode.QueryStr());
+    }
+
+    hr = ConfigUtility::FindProcessCpuSets(pAspNetCoreElement, struProcessCpuSets);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!struProcessCpuSets.IsEmpty())
+    {
+        hr = ParseCpuSetIds(struProcessCpuSets.QueryStr(), m_processResourceLimits.cpuSetIds);
+        if (FAILED(hr))
+        {
+            goto Finished;
+        }
+    }
+
 Finished:
 
     if (pAspNetCoreElement != NULL)
@@ -449,3 +978,192 @@ Finished:
 
     return hr;
 }
+
+// static
+HRESULT
+REQUESTHANDLER_CONFIG::ParseCpuSetIds(
+    _In_ PCWSTR                 pszCpuSets,
+    _Inout_ std::vector<ULONG>& cpuSetIds
+)
+/*++
+
+Routine Description:
+
+    Parse the processCpuSets handler setting, a ',' separated list of CPU
+    set ids as reported by GetSystemCpuSetInformation. Empty and
+    non-numeric entries are ignored, 0 is never a valid id.
+
+--*/
+{
+    try
+    {
+        std::wstringstream cpuSetStream(pszCpuSets);
+        std::wstring entry;
+
+        while (std::getline(cpuSetStream, entry, L','))
+        {
+            const ULONG id = wcstoul(entry.c_str(), nullptr, 10);
+            if (id != 0)
+            {
+                cpuSetIds.push_back(id);
+            }
+        }
+    }
+    CATCH_RETURN();
+
+    return S_OK;
+}
+
+HRESULT
+REQUESTHANDLER_CONFIG::ResolveSendFileRoot(
+)
+/*++
+
+Routine Description:
+
+    Canonicalize sendFileRoot once, relative to the application folder.
+    The full path is what the paths the backend names are compared with,
+    the final path of the folder what the files opened are checked against
+    so that a junction or a symbolic link under it can't lead out of it.
+    The folder has to exist.
+
+--*/
+{
+    STRU struRoot;
+
+    if (PathIsRelative(m_struSendFileRoot.QueryStr()))
+    {
+        RETURN_IF_FAILED(struRoot.Copy(m_struApplicationPhysicalPath));
+        if (!struRoot.EndsWith(L"\\"))
+        {
+            RETURN_IF_FAILED(struRoot.Append(L"\\"));
+        }
+    }
+    RETURN_IF_FAILED(struRoot.Append(m_struSendFileRoot));
+
+    RETURN_IF_FAILED(FILE_UTILITY::GetFullPath(struRoot.QueryStr(), &m_struSendFileRoot));
+    if (!m_struSendFileRoot.EndsWith(L"\\"))
+    {
+        RETURN_IF_FAILED(m_struSendFileRoot.Append(L"\\"));
+    }
+
+    HandleWrapper<InvalidHandleTraits> hRoot = CreateFile(m_struSendFileRoot.QueryStr(),
+        0,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL,
+        OPEN_EXISTING,
+        FILE_FLAG_BACKUP_SEMANTICS,
+        NULL);
+    RETURN_LAST_ERROR_IF(hRoot == INVALID_HANDLE_VALUE);
+
+    RETURN_IF_FAILED(FILE_UTILITY::GetFinalPath(hRoot, &m_struSendFileFinalRoot));
+    if (!m_struSendFileFinalRoot.EndsWith(L"\\"))
+    {
+        RETURN_IF_FAILED(m_struSendFileFinalRoot.Append(L"\\"));
+    }
+
+    return S_OK;
+}
+
+// static
+HRESULT
+REQUESTHANDLER_CONFIG::ParseResponseBufferingPolicies(
+    _In_ PCWSTR                                     pszPolicies,
+    _Inout_ std::vector<RESPONSE_BUFFERING_POLICY>& policies
+)
+/*++
+
+Routine Description:
+
+    Parse the responseBufferingPolicy handler setting. Entries without a
+    media type or without '=' are ignored, like other malformed numeric
+    handler settings.
+
+--*/
+{
+    try
+    {
+        std::wstringstream policyStream(pszPolicies);
+        std::wstring entry;
+
+        while (std::getline(policyStream, entry, L';'))
+        {
+            const size_t equals = entry.find(L'=');
+            if (equals == std::wstring::npos)
+            {
+                continue;
+            }
+
+            RESPONSE_BUFFERING_POLICY policy = {};
+            for (size_t i = 0; i < equals; i++)
+            {
+                //
+                // Media types are ASCII tokens.
+                //
+                if (!iswspace(entry[i]))
+                {
+                    policy.strContentType.push_back(static_cast<CHAR>(towlower(entry[i])));
+                }
+            }
+
+            if (policy.strContentType.empty())
+            {
+                continue;
+            }
+
+            policy.dwMinResponseBuffer = _wtoi(entry.c_str() + equals + 1);
+
+            const size_t comma = entry.find(L',', equals);
+            if (comma != std::wstring::npos)
+            {
+                policy.dwFlushIntervalInMS = _wtoi(entry.c_str() + comma + 1);
+            }
+
+            policies.push_back(std::move(policy));
+        }
+    }
+    CATCH_RETURN();
+
+    return S_OK;
+}
+
+const RESPONSE_BUFFERING_POLICY *
+REQUESTHANDLER_CONFIG::FindResponseBufferingPolicy(
+    _In_reads_(cchContentType) PCSTR    pszContentType,
+    DWORD                               cchContentType
+) const
+{
+    //
+    // Only the media type takes part in the match, not its parameters.
+    //
+    DWORD cchMediaType = 0;
+    while (cchMediaType < cchContentType &&
+        pszContentType[cchMediaType] != ';' &&
+        pszContentType[cchMediaType] != ' ')
+    {
+        cchMediaType++;
+    }
+
+    for (const RESPONSE_BUFFERING_POLICY& policy : m_responseBufferingPolicies)
+    {
+        const DWORD cchPolicy = static_cast<DWORD>(policy.strContentType.size());
+
+        if (cchPolicy >= 2 &&
+            policy.strContentType[cchPolicy - 1] == '*' &&
+            policy.strContentType[cchPolicy - 2] == '/')
+        {
+            if (cchMediaType >= cchPolicy - 1 &&
+                _strnicmp(pszContentType, policy.strContentType.c_str(), cchPolicy - 1) == 0)
+            {
+                return &policy;
+            }
+        }
+        else if (cchMediaType == cchPolicy &&
+            _strnicmp(pszContentType, policy.strContentType.c_str(), cchPolicy) == 0)
+        {
+            return &policy;
+        }
+    }
+
+    return NULL;
+}
@@ -31,6 +31,15 @@
 #define CS_ASPNETCORE_HOSTING_MODEL                      L"hostingModel"
 
 #define MAX_RAPID_FAILS_PER_MINUTE 100
+#define DEFAULT_RAPID_FAIL_BACKOFF_INITIAL_MS 1000
+#define DEFAULT_RAPID_FAIL_BACKOFF_MAX_MS 60000
+#define DEFAULT_RAPID_FAIL_RECOVERY_INTERVAL_MS 60000
+#define DEFAULT_HEALTH_CHECK_INTERVAL_MS 10000
+#define DEFAULT_HEALTH_CHECK_TIMEOUT_MS 5000
+#define DEFAULT_HEALTH_CHECK_UNHEALTHY_THRESHOLD 3
+// Same default as the maxAllowedContentLength of request filtering.
+#define DEFAULT_REQUEST_BUFFERING_MAX_SIZE 30000000
+#define DEFAULT_RESPONSE_SPOOLING_MAX_SIZE 104857600
 #define MILLISECONDS_IN_ONE_SECOND 1000
 
 #define TIMESPAN_IN_MILLISECONDS(x)  ((x)/((LONGLONG)(10000)))
@@ -42,6 +51,7 @@
 #include "stdafx.h"
 #include "environmentvariablehash.h"
 #include "BindingInformation.h"
+#include "PriorityPaths.h"
 
 enum APP_HOSTING_MODEL
 {
@@ -50,6 +60,62 @@ enum APP_HOSTING_MODEL
     HOSTING_OUT_PROCESS
 };
 
+//
+// Response buffering override for one class of responses, selected by the
+// media type of the Content-Type header. The responseBufferingPolicy
+// handler setting is a ';' separated list of
+//
+//     media/type=minResponseBuffer[,flushIntervalInMS]
+//
+// entries, e.g. "text/event-stream=0;application/octet-stream=262144,200".
+// A "media/*" entry matches every subtype, the first match wins.
+//
+struct RESPONSE_BUFFERING_POLICY
+{
+    //
+    // Lower case media type without parameters.
+    //
+    std::string     strContentType;
+    //
+    // Bytes to accumulate before flushing to the client, 0 flushes every read.
+    //
+    DWORD           dwMinResponseBuffer;
+    //
+    // Flush after this long even if fewer bytes were buffered, 0 to disable.
+    //
+    DWORD           dwFlushIntervalInMS;
+};
+
+//
+// Limits applied to the job object of every backend process of an
+// application, so that one application can't starve the others on a
+// shared host. Every limit covers the backend and the processes it starts.
+//
+struct PROCESS_RESOURCE_LIMITS
+{
+    //
+    // Hard cap on CPU time in percent of all processors, 0 for no cap.
+    //
+    DWORD               dwCpuRatePercent;
+    //
+    // Committed memory in MB, 0 for no limit.
+    //
+    DWORD               dwMemoryLimitInMB;
+    //
+    // Working set of each process in MB, 0 for no limit.
+    //
+    DWORD               dwWorkingSetLimitInMB;
+    //
+    // NUMA node the processes are confined to, -1 for any node.
+    //
+    LONG                lNumaNode;
+    //
+    // CPU sets the backend process is scheduled on, empty for the system
+    // default.
+    //
+    std::vector<ULONG>  cpuSetIds;
+};
+
 class REQUESTHANDLER_CONFIG
 {
 public:
@@ -228,16 +294,519 @@ public:
         return &m_struForwardResponseConnectionHeader;
     }
 
+    STRU*
+    QueryForwardTimingsServerVariable()
+    {
+        return &m_struForwardTimingsServerVariable;
+    }
+
+    //
+    // "true" hides Accept-Encoding from the backend so that it answers
+    // uncompressed and IIS dynamic compression compresses the response.
+    //
+    STRU*
+    QueryOffloadResponseCompression()
+    {
+        return &m_struOffloadResponseCompression;
+    }
+
+    //
+    // Number of spare backend processes kept started for failover.
+    //
+    DWORD
+    QueryStandbyProcesses()
+    {
+        return m_dwStandbyProcesses;
+    }
+
+    STRU*
+    QueryStandbyWarmupUrl()
+    {
+        return &m_struStandbyWarmupUrl;
+    }
+
+    //
+    // "true" to start all processesPerApplication processes at once when
+    // the application starts instead of on first use.
+    //
+    STRU*
+    QueryEagerProcessStartup()
+    {
+        return &m_struEagerProcessStartup;
+    }
+
+    //
+    // "true" for the worker processes of a web garden to share one set of
+    // processesPerApplication processes instead of starting their own.
+    //
+    BOOL
+    QueryShareBackendsAcrossWebGarden()
+    {
+        return m_struShareBackendsAcrossWebGarden.Equals(L"true", /* ignoreCase */ 1);
+    }
+
+    //
+    // "true" to hand requests to the HTTP.sys request queue of the backend
+    // instead of proxying them, see REQUEST_DELEGATION. The backend must be
+    // an HttpSys server that creates the queue it is given.
+    //
+    BOOL
+    QueryRequestDelegation()
+    {
+        return m_struRequestDelegation.Equals(L"true", /* ignoreCase */ 1);
+    }
+
+    //
+    // "true" to send the user token of a keep-alive connection once per
+    // backend process instead of with every request, see
+    // WINDOWS_AUTH_TOKEN_CACHE. The backend must not close the handle.
+    //
+    BOOL
+    QueryCacheWindowsAuthToken()
+    {
+        return m_struCacheWindowsAuthToken.Equals(L"true", /* ignoreCase */ 1);
+    }
+
+    //
+    // Folder the backend may have files sent from with an X-Sendfile
+    // response header, empty when the header is passed on to the client.
+    // A full path ending with a separator.
+    //
+    STRU*
+    QuerySendFileRoot()
+    {
+        return &m_struSendFileRoot;
+    }
+
+    //
+    // The sendFileRoot folder as FILE_UTILITY::GetFinalPath has it, what
+    // the final path of a file sent has to start with.
+    //
+    STRU*
+    QuerySendFileFinalRoot()
+    {
+        return &m_struSendFileFinalRoot;
+    }
+
+    //
+    // "true" to spread the processes of the application over the NUMA
+    // nodes and route each request to a process on the node of the thread
+    // it arrived on.
+    //
+    STRU*
+    QueryProcessNumaPlacement()
+    {
+        return &m_struProcessNumaPlacement;
+    }
+
+    //
+    // Run the WinHTTP completions of a request on the NUMA node of the
+    // thread it arrived on, where its handler and buffers were allocated.
+    //
+    BOOL
+    QueryNumaLocalCompletions()
+    {
+        return m_struNumaLocalCompletions.Equals(L"true", /* ignoreCase */ 1);
+    }
+
+    STRU*
+    QueryProcessRoutingPolicy()
+    {
+        return &m_struProcessRoutingPolicy;
+    }
+
+    //
+    // Number of read buffers used by the streaming response mode of the
+    // out-of-process handler, 0 keeps the classic read/flush loop.
+    //
+    DWORD
+    QueryResponseReadAheadBuffers()
+    {
+        return m_dwResponseReadAheadBuffers;
+    }
+
+    const RESPONSE_BUFFERING_POLICY *
+    FindResponseBufferingPolicy(
+        _In_reads_(cchContentType) PCSTR    pszContentType,
+        DWORD                               cchContentType
+    ) const;
+
+    static
+    HRESULT
+    ParseResponseBufferingPolicies(
+        _In_ PCWSTR                                     pszPolicies,
+        _Inout_ std::vector<RESPONSE_BUFFERING_POLICY>& policies
+    );
+
+    static
+    HRESULT
+    ParseCpuSetIds(
+        _In_ PCWSTR                 pszCpuSets,
+        _Inout_ std::vector<ULONG>& cpuSetIds
+    );
+
+    HRESULT
+    ResolveSendFileRoot();
+
+    //
+    // Number of buffers the out-of-process handler may keep in flight while
+    // uploading a request body, 0 or 1 keeps the strict read/write loop.
+    //
+    DWORD
+    QueryRequestBodyReadAheadBuffers()
+    {
+        return m_dwRequestBodyReadAheadBuffers;
+    }
+
+    //
+    // Upper bound in bytes on the memory used by those buffers, 0 for no
+    // limit beyond the buffer count.
+    //
+    DWORD
+    QueryRequestBodyReadAheadLimit()
+    {
+        return m_dwRequestBodyReadAheadLimit;
+    }
+
+    //
+    // Bytes of a request body the out-of-process handler keeps in memory
+    // while reading all of it before forwarding the request, the rest is
+    // spooled to a temporary file. 0 forwards the body as it is read.
+    //
+    DWORD
+    QueryRequestBufferingMemoryLimit()
+    {
+        return m_dwRequestBufferingMemoryLimit;
+    }
+
+    //
+    // Largest request body read before forwarding. A longer body with a
+    // Content-Length is streamed, a longer chunked one is rejected with 413.
+    //
+    DWORD
+    QueryRequestBufferingMaxSize()
+    {
+        return m_dwRequestBufferingMaxSize;
+    }
+
+    //
+    // Largest request body forwarded, a longer one is answered with 413
+    // without reaching the backend. 0 for no limit.
+    //
+    DWORD
+    QueryMaxRequestBodySize()
+    {
+        return m_dwMaxRequestBodySize;
+    }
+
+    //
+    // Bytes of a response body the out-of-process handler keeps in memory
+    // while draining the backend before sending the body to the client,
+    // the rest is spooled to a temporary file. 0 sends the body as it is
+    // read.
+    //
+    DWORD
+    QueryResponseSpoolingMemoryLimit()
+    {
+        return m_dwResponseSpoolingMemoryLimit;
+    }
+
+    //
+    // Largest response body spooled. A longer body is sent as it is read
+    // from the point it turns out longer.
+    //
+    DWORD
+    QueryResponseSpoolingMaxSize()
+    {
+        return m_dwResponseSpoolingMaxSize;
+    }
+
+    //
+    // Number of times the out-of-process handler may re-dispatch an
+    // idempotent request without a body to another backend process after a
+    // connection failure, 0 to never retry.
+    //
+    DWORD
+    QueryIdempotentRequestRetries()
+    {
+        return m_dwIdempotentRequestRetries;
+    }
+
+    //
+    // Cap on the keep-alive connections WinHTTP opens to one backend
+    // process, 0 for the WinHTTP default.
+    //
+    DWORD
+    QueryMaxConnectionsPerBackend()
+    {
+        return m_dwMaxConnectionsPerBackend;
+    }
+
+    //
+    // Keep-alive connections opened to a backend process as soon as it
+    // is listening.
+    //
+    DWORD
+    QueryPrewarmConnections()
+    {
+        return m_dwPrewarmConnections;
+    }
+
+    //
+    // Forward on a WinHTTP session of the application's own instead of the
+    // one every application of the worker process shares.
+    //
+    BOOL
+    QueryIsolateWinHttpSession()
+    {
+        return m_struIsolateWinHttpSession.Equals(L"true", /* ignoreCase */ 1);
+    }
+
+    //
+    // Paths forwarded on a connection of their own when the connections
+    // to a backend process are capped, see SERVER_PROCESS.
+    //
+    const PriorityPaths&
+    QueryPriorityPaths() const
+    {
+        return m_priorityPaths;
+    }
+
+    //
+    // Time new processes are refused for after rapidFailsPerMinute was
+    // exceeded, doubled for every consecutive trip up to
+    // QueryRapidFailBackoffMaxInMS.
+    //
+    DWORD
+    QueryRapidFailBackoffInitialInMS()
+    {
+        return m_dwRapidFailBackoffInitialInMS;
+    }
+
+    DWORD
+    QueryRapidFailBackoffMaxInMS()
+    {
+        return m_dwRapidFailBackoffMaxInMS;
+    }
+
+    //
+    // Healthy time that takes one doubling off the next backoff.
+    //
+    DWORD
+    QueryRapidFailRecoveryIntervalInMS()
+    {
+        return m_dwRapidFailRecoveryIntervalInMS;
+    }
+
+    //
+    // Path of the application each backend is sent a GET for every
+    // QueryHealthCheckIntervalInMS, empty when the backends are not
+    // probed. A process failing QueryHealthCheckUnhealthyThreshold probes
+    // in a row is taken out of routing and replaced.
+    //
+    STRU*
+    QueryHealthCheckPath()
+    {
+        return &m_struHealthCheckPath;
+    }
+
+    DWORD
+    QueryHealthCheckIntervalInMS()
+    {
+        return m_dwHealthCheckIntervalInMS;
+    }
+
+    //
+    // A probe not answered in time fails, as does a 5xx status.
+    //
+    DWORD
+    QueryHealthCheckTimeoutInMS()
+    {
+        return m_dwHealthCheckTimeoutInMS;
+    }
+
+    DWORD
+    QueryHealthCheckUnhealthyThreshold()
+    {
+        return m_dwHealthCheckUnhealthyThreshold;
+    }
+
+    //
+    // Forwarded requests in a row answered with a 5xx status or timing
+    // out after which a process is taken out of routing and replaced, 0
+    // not to watch them.
+    //
+    DWORD
+    QueryOutlierConsecutiveFailures()
+    {
+        return m_dwOutlierConsecutiveFailures;
+    }
+
+    //
+    // Time without requests after which the application is shrunk to one
+    // process with its working set trimmed, 0 to keep every process
+    // resident. The next request brings the others back.
+    //
+    DWORD
+    QueryIdleScaleDownTimeoutInMS()
+    {
+        return m_dwIdleScaleDownTimeoutInMS;
+    }
+
+    //
+    // Also throttle the remaining process while the application is idle.
+    //
+    BOOL
+    QueryIdleSuspend()
+    {
+        return m_struIdleSuspend.Equals(L"true", /* ignoreCase */ 1);
+    }
+
+    //
+    // Size in bytes of the buffers a WebSocket connection borrows while it
+    // relays a message, also applied to WinHTTP's WebSocket buffers; 0 for
+    // the defaults.
+    //
+    DWORD
+    QueryWebSocketReceiveBufferSize()
+    {
+        return m_dwWebSocketReceiveBufferSize;
+    }
+
+    //
+    // "true" to relay the fragments of a WebSocket message in as few sends
+    // as the receive buffer allows instead of one send per fragment.
+    //
+    STRU*
+    QueryWebSocketCoalesceFragments()
+    {
+        return &m_struWebSocketCoalesceFragments;
+    }
+
+    //
+    // Time without traffic in either direction after which a proxied
+    // WebSocket connection is closed, 0 to keep idle connections open.
+    //
+    DWORD
+    QueryWebSocketIdleTimeoutInMS()
+    {
+        return m_dwWebSocketIdleTimeoutInMS;
+    }
+
+    //
+    // "true" to keep the client's WebSocket extension offers, such as
+    // permessage-deflate, from the backend so that it relays plain frames.
+    //
+    STRU*
+    QueryWebSocketStripExtensions()
+    {
+        return &m_struWebSocketStripExtensions;
+    }
+
+    //
+    // Time a client may take to accept one relayed WebSocket send before
+    // the connection is closed, 0 to wait for slow clients indefinitely.
+    //
+    DWORD
+    QueryWebSocketSlowClientTimeoutInMS()
+    {
+        return m_dwWebSocketSlowClientTimeoutInMS;
+    }
+
+    //
+    // Largest WebSocket message in bytes a client may send to the backend,
+    // 0 for no limit.
+    //
+    DWORD
+    QueryWebSocketMaxMessageSize()
+    {
+        return m_dwWebSocketMaxMessageSize;
+    }
+
+    //
+    // One in this many forwarded requests is sampled in detail by the
+    // out-of-process handler, 0 to sample none.
+    //
+    DWORD
+    QueryRequestSamplingRate()
+    {
+        return m_dwRequestSamplingRate;
+    }
+
+    //
+    // Bytes of backend responses the out-of-process handler may keep in
+    // memory to answer repeated anonymous GETs itself, 0 to cache nothing.
+    //
+    DWORD
+    QueryResponseCacheSize()
+    {
+        return m_dwResponseCacheSize;
+    }
+
+    //
+    // Response reads the out-of-process handler may issue in a row from
+    // the WinHTTP callback instead of an IIS completion, 0 for none.
+    //
+    DWORD
+    QueryResponseInlineReads()
+    {
+        return m_dwResponseInlineReads;
+    }
+
+    //
+    // Job object limits for every backend process of the application.
+    //
+    const PROCESS_RESOURCE_LIMITS&
+    QueryProcessResourceLimits()
+    {
+        return m_processResourceLimits;
+    }
+
 protected:
 
+    //
+    // Configures an application without AppHost, see
+    // ForwardingLoadHarness.
+    //
+    friend class FORWARDING_LOAD_HARNESS;
+
     //
     // protected constructor
     //
     REQUESTHANDLER_CONFIG() :
         m_fStdoutLogEnabled(FALSE),
+        m_dwResponseReadAheadBuffers(0),
+        m_dwRequestBodyReadAheadBuffers(0),
+        m_dwRequestBodyReadAheadLimit(0),
+        m_dwRequestBufferingMemoryLimit(0),
+        m_dwRequestBufferingMaxSize(DEFAULT_REQUEST_BUFFERING_MAX_SIZE),
+        m_dwMaxRequestBodySize(0),
+        m_dwResponseSpoolingMemoryLimit(0),
+        m_dwResponseSpoolingMaxSize(DEFAULT_RESPONSE_SPOOLING_MAX_SIZE),
+        m_dwIdempotentRequestRetries(0),
+        m_dwMaxConnectionsPerBackend(0),
+        m_dwPrewarmConnections(0),
+        m_dwStandbyProcesses(0),
+        m_dwRapidFailBackoffInitialInMS(DEFAULT_RAPID_FAIL_BACKOFF_INITIAL_MS),
+        m_dwRapidFailBackoffMaxInMS(DEFAULT_RAPID_FAIL_BACKOFF_MAX_MS),
+        m_dwRapidFailRecoveryIntervalInMS(DEFAULT_RAPID_FAIL_RECOVERY_INTERVAL_MS),
+        m_dwHealthCheckIntervalInMS(DEFAULT_HEALTH_CHECK_INTERVAL_MS),
+        m_dwHealthCheckTimeoutInMS(DEFAULT_HEALTH_CHECK_TIMEOUT_MS),
+        m_dwHealthCheckUnhealthyThreshold(DEFAULT_HEALTH_CHECK_UNHEALTHY_THRESHOLD),
+        m_dwOutlierConsecutiveFailures(0),
+        m_dwIdleScaleDownTimeoutInMS(0),
+        m_dwWebSocketReceiveBufferSize(0),
+        m_dwWebSocketIdleTimeoutInMS(0),
+        m_dwWebSocketSlowClientTimeoutInMS(0),
+        m_dwWebSocketMaxMessageSize(0),
+        m_dwRequestSamplingRate(0),
+        m_dwResponseCacheSize(0),
+        m_dwResponseInlineReads(0),
         m_hostingModel(HOSTING_UNKNOWN),
+        m_processResourceLimits(),
         m_ppStrArguments(NULL)
     {
+        m_processResourceLimits.lNumaNode = -1;
     }
 
     HRESULT
@@ -252,6 +821,34 @@ protected:
     DWORD                  m_dwShutdownTimeLimitInMS;
     DWORD                  m_dwRapidFailsPerMinute;
     DWORD                  m_dwProcessesPerApplication;
+    DWORD                  m_dwResponseReadAheadBuffers;
+    DWORD                  m_dwRequestBodyReadAheadBuffers;
+    DWORD                  m_dwRequestBodyReadAheadLimit;
+    DWORD                  m_dwRequestBufferingMemoryLimit;
+    DWORD                  m_dwRequestBufferingMaxSize;
+    DWORD                  m_dwMaxRequestBodySize;
+    DWORD                  m_dwResponseSpoolingMemoryLimit;
+    DWORD                  m_dwResponseSpoolingMaxSize;
+    DWORD                  m_dwIdempotentRequestRetries;
+    DWORD                  m_dwMaxConnectionsPerBackend;
+    DWORD                  m_dwPrewarmConnections;
+    DWORD                  m_dwStandbyProcesses;
+    DWORD                  m_dwRapidFailBackoffInitialInMS;
+    DWORD                  m_dwRapidFailBackoffMaxInMS;
+    DWORD                  m_dwRapidFailRecoveryIntervalInMS;
+    DWORD                  m_dwHealthCheckIntervalInMS;
+    DWORD                  m_dwHealthCheckTimeoutInMS;
+    DWORD                  m_dwHealthCheckUnhealthyThreshold;
+    DWORD                  m_dwOutlierConsecutiveFailures;
+    DWORD                  m_dwIdleScaleDownTimeoutInMS;
+    DWORD                  m_dwWebSocketReceiveBufferSize;
+    DWORD                  m_dwWebSocketIdleTimeoutInMS;
+    DWORD                  m_dwWebSocketSlowClientTimeoutInMS;
+    DWORD                  m_dwWebSocketMaxMessageSize;
+    DWORD                  m_dwRequestSamplingRate;
+    DWORD                  m_dwResponseCacheSize;
+    PriorityPaths          m_priorityPaths;
+    DWORD                  m_dwResponseInlineReads;
     STRU                   m_struArguments;
     STRU                   m_struProcessPath;
     STRU                   m_struStdoutLogFile;
@@ -260,6 +857,23 @@ protected:
     STRU                   m_struApplicationVirtualPath;
     STRU                   m_struConfigPath;
     STRU                   m_struForwardResponseConnectionHeader;
+    STRU                   m_struForwardTimingsServerVariable;
+    STRU                   m_struOffloadResponseCompression;
+    STRU                   m_struProcessRoutingPolicy;
+    STRU                   m_struStandbyWarmupUrl;
+    STRU                   m_struEagerProcessStartup;
+    STRU                   m_struShareBackendsAcrossWebGarden;
+    STRU                   m_struRequestDelegation;
+    STRU                   m_struCacheWindowsAuthToken;
+    STRU                   m_struSendFileRoot;
+    STRU                   m_struSendFileFinalRoot;
+    STRU                   m_struHealthCheckPath;
+    STRU                   m_struIdleSuspend;
+    STRU                   m_struIsolateWinHttpSession;
+    STRU                   m_struProcessNumaPlacement;
+    STRU                   m_struNumaLocalCompletions;
+    STRU                   m_struWebSocketCoalesceFragments;
+    STRU                   m_struWebSocketStripExtensions;
     BOOL                   m_fStdoutLogEnabled;
     BOOL                   m_fForwardWindowsAuthToken;
     BOOL                   m_fDisableStartUpErrorPage;
@@ -269,6 +883,8 @@ protected:
     STRU                   m_fEnableOutOfProcessConsoleRedirection;
     APP_HOSTING_MODEL      m_hostingModel;
     std::map<std::wstring, std::wstring, ignore_case_comparer> m_pEnvironmentVariables;
+    std::vector<RESPONSE_BUFFERING_POLICY> m_responseBufferingPolicies;
+    PROCESS_RESOURCE_LIMITS m_processResourceLimits;
     STRU                   m_struHostFxrLocation;
     PWSTR*                 m_ppStrArguments;
     DWORD                  m_dwArgc;
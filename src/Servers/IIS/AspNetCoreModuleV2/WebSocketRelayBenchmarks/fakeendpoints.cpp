@@ -0,0 +1,333 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+FAKE_WEBSOCKET_CONTEXT::FAKE_WEBSOCKET_CONTEXT() :
+    m_pbRead(NULL),
+    m_cbRead(0),
+    m_pfnReadCompletion(NULL),
+    m_pvReadCompletionContext(NULL),
+    m_cMessagesWritten(0),
+    m_llLastMessageWritten(0)
+{
+}
+
+HRESULT
+FAKE_WEBSOCKET_CONTEXT::WriteFragment(
+    _In_ VOID *                     pData,
+    _Inout_ DWORD *                 pcbSent,
+    _In_ BOOL                       fAsync,
+    _In_ BOOL                       fUTF8Encoded,
+    _In_ BOOL                       fFinalFragment,
+    _In_ PFN_WEBSOCKET_COMPLETION   pfnCompletion,
+    _In_ VOID *                     pvCompletionContext,
+    _Out_ BOOL *                    pfCompletionExpected
+)
+{
+    UNREFERENCED_PARAMETER(pData);
+    UNREFERENCED_PARAMETER(fAsync);
+
+    m_writes.push_back({ *pcbSent, fUTF8Encoded, fFinalFragment, FALSE, pfnCompletion, pvCompletionContext });
+
+    if (fFinalFragment)
+    {
+        LARGE_INTEGER liNow;
+        QueryPerformanceCounter(&liNow);
+        m_llLastMessageWritten = liNow.QuadPart;
+        m_cMessagesWritten++;
+    }
+
+    if (pfCompletionExpected != NULL)
+    {
+        *pfCompletionExpected = TRUE;
+    }
+
+    return S_OK;
+}
+
+HRESULT
+FAKE_WEBSOCKET_CONTEXT::ReadFragment(
+    _Out_ VOID *                    pData,
+    _Inout_ DWORD *                 pcbData,
+    _In_ BOOL                       fAsync,
+    _Out_ BOOL *                    pfUTF8Encoded,
+    _Out_ BOOL *                    pfFinalFragment,
+    _Out_ BOOL *                    pfConnectionClose,
+    _In_ PFN_WEBSOCKET_COMPLETION   pfnCompletion,
+    _In_ VOID *                     pvCompletionContext,
+    _Out_ BOOL *                    pfCompletionExpected
+)
+{
+    UNREFERENCED_PARAMETER(fAsync);
+    UNREFERENCED_PARAMETER(pfUTF8Encoded);
+    UNREFERENCED_PARAMETER(pfFinalFragment);
+    UNREFERENCED_PARAMETER(pfConnectionClose);
+
+    if (m_pfnReadCompletion != NULL)
+    {
+        // IIS allows a single outstanding read.
+        return HRESULT_FROM_WIN32(ERROR_INVALID_STATE);
+    }
+
+    m_pbRead = static_cast<BYTE *>(pData);
+    m_cbRead = *pcbData;
+    m_pfnReadCompletion = pfnCompletion;
+    m_pvReadCompletionContext = pvCompletionContext;
+
+    if (pfCompletionExpected != NULL)
+    {
+        *pfCompletionExpected = TRUE;
+    }
+
+    return S_OK;
+}
+
+HRESULT
+FAKE_WEBSOCKET_CONTEXT::SendConnectionClose(
+    _In_ BOOL                       fAsync,
+    _In_ USHORT                     uStatusCode,
+    _In_ LPCWSTR                    pszReason,
+    _In_ PFN_WEBSOCKET_COMPLETION   pfnCompletion,
+    _In_ VOID *                     pvCompletionContext,
+    _Out_ BOOL *                    pfCompletionExpected
+)
+{
+    UNREFERENCED_PARAMETER(fAsync);
+    UNREFERENCED_PARAMETER(uStatusCode);
+    UNREFERENCED_PARAMETER(pszReason);
+
+    m_writes.push_back({ 0, FALSE, TRUE, TRUE, pfnCompletion, pvCompletionContext });
+
+    if (pfCompletionExpected != NULL)
+    {
+        *pfCompletionExpected = TRUE;
+    }
+
+    return S_OK;
+}
+
+HRESULT
+FAKE_WEBSOCKET_CONTEXT::GetCloseStatus(
+    _Out_ USHORT *                  pStatusCode,
+    _Out_ LPCWSTR *                 ppszReason,
+    _Out_ USHORT *                  pcchReason
+)
+{
+    *pStatusCode = 1000;
+
+    if (ppszReason != NULL)
+    {
+        *ppszReason = L"";
+    }
+
+    if (pcchReason != NULL)
+    {
+        *pcchReason = 0;
+    }
+
+    return S_OK;
+}
+
+VOID
+FAKE_WEBSOCKET_CONTEXT::CompleteRead(
+    const BYTE *    pbData,
+    DWORD           cbData,
+    BOOL            fFinalFragment
+)
+{
+    PFN_WEBSOCKET_COMPLETION    pfnCompletion = m_pfnReadCompletion;
+    VOID *                      pvCompletionContext = m_pvReadCompletionContext;
+
+    DBG_ASSERT(pfnCompletion != NULL && cbData <= m_cbRead);
+
+    //
+    // The completion may post the next read.
+    //
+    memcpy(m_pbRead, pbData, cbData);
+    m_pbRead = NULL;
+    m_cbRead = 0;
+    m_pfnReadCompletion = NULL;
+    m_pvReadCompletionContext = NULL;
+
+    pfnCompletion(S_OK, pvCompletionContext, cbData, FALSE, fFinalFragment, FALSE);
+}
+
+BOOL
+FAKE_WEBSOCKET_CONTEXT::CompleteWrite(
+    VOID
+)
+{
+    if (m_writes.empty())
+    {
+        return FALSE;
+    }
+
+    WRITE write = m_writes.front();
+    m_writes.pop_front();
+
+    write.pfnCompletion(S_OK,
+        write.pvCompletionContext,
+        write.cbData,
+        write.fUTF8Encoded,
+        write.fFinalFragment,
+        write.fClose);
+
+    return TRUE;
+}
+
+FAKE_WINHTTP_WEBSOCKET::FAKE_WINHTTP_WEBSOCKET() :
+    m_pbReceive(NULL),
+    m_cbReceive(0),
+    m_cMessagesSent(0),
+    m_llLastMessageSent(0)
+{
+}
+
+//static
+VOID
+FAKE_WINHTTP_WEBSOCKET::Install(
+    VOID
+)
+{
+    WINHTTP_HELPER::sm_pfnWinHttpWebSocketSend = WebSocketSend;
+    WINHTTP_HELPER::sm_pfnWinHttpWebSocketReceive = WebSocketReceive;
+    WINHTTP_HELPER::sm_pfnWinHttpWebSocketShutdown = WebSocketShutdown;
+    WINHTTP_HELPER::sm_pfnWinHttpWebSocketQueryCloseStatus = WebSocketQueryCloseStatus;
+}
+
+VOID
+FAKE_WINHTTP_WEBSOCKET::CompleteReceive(
+    WEBSOCKET_HANDLER * pHandler,
+    const BYTE *        pbData,
+    DWORD               cbData,
+    BOOL                fFinalFragment
+)
+{
+    WINHTTP_WEB_SOCKET_STATUS status;
+
+    DBG_ASSERT(m_pbReceive != NULL && cbData <= m_cbReceive);
+
+    memcpy(m_pbReceive, pbData, cbData);
+    m_pbReceive = NULL;
+    m_cbReceive = 0;
+
+    status.dwBytesTransferred = cbData;
+    status.eBufferType = fFinalFragment ?
+        WINHTTP_WEB_SOCKET_BINARY_MESSAGE_BUFFER_TYPE :
+        WINHTTP_WEB_SOCKET_BINARY_FRAGMENT_BUFFER_TYPE;
+
+    pHandler->OnWinHttpReceiveComplete(&status);
+}
+
+BOOL
+FAKE_WINHTTP_WEBSOCKET::CompleteSend(
+    WEBSOCKET_HANDLER * pHandler
+)
+{
+    if (m_sends.empty())
+    {
+        return FALSE;
+    }
+
+    WINHTTP_WEB_SOCKET_STATUS status = m_sends.front();
+    m_sends.pop_front();
+
+    pHandler->OnWinHttpSendComplete(&status);
+
+    return TRUE;
+}
+
+//static
+DWORD
+WINAPI
+FAKE_WINHTTP_WEBSOCKET::WebSocketSend(
+    _In_ HINTERNET                      hWebSocket,
+    _In_ WINHTTP_WEB_SOCKET_BUFFER_TYPE eBufferType,
+    _In_reads_opt_(dwBufferLength) PVOID pvBuffer,
+    _In_ DWORD                          dwBufferLength
+)
+{
+    FAKE_WINHTTP_WEBSOCKET * pWebSocket = reinterpret_cast<FAKE_WINHTTP_WEBSOCKET *>(hWebSocket);
+
+    UNREFERENCED_PARAMETER(pvBuffer);
+
+    pWebSocket->m_sends.push_back({ dwBufferLength, eBufferType });
+
+    if (eBufferType == WINHTTP_WEB_SOCKET_BINARY_MESSAGE_BUFFER_TYPE ||
+        eBufferType == WINHTTP_WEB_SOCKET_UTF8_MESSAGE_BUFFER_TYPE)
+    {
+        LARGE_INTEGER liNow;
+        QueryPerformanceCounter(&liNow);
+        pWebSocket->m_llLastMessageSent = liNow.QuadPart;
+        pWebSocket->m_cMessagesSent++;
+    }
+
+    return NO_ERROR;
+}
+
+//static
+DWORD
+WINAPI
+FAKE_WINHTTP_WEBSOCKET::WebSocketReceive(
+    _In_ HINTERNET                      hWebSocket,
+    _Out_writes_bytes_to_(dwBufferLength, *pdwBytesRead) PVOID pvBuffer,
+    _In_ DWORD                          dwBufferLength,
+    _Out_range_(0, dwBufferLength) DWORD * pdwBytesRead,
+    _Out_ WINHTTP_WEB_SOCKET_BUFFER_TYPE * peBufferType
+)
+{
+    FAKE_WINHTTP_WEBSOCKET * pWebSocket = reinterpret_cast<FAKE_WINHTTP_WEBSOCKET *>(hWebSocket);
+
+    UNREFERENCED_PARAMETER(pdwBytesRead);
+    UNREFERENCED_PARAMETER(peBufferType);
+
+    if (pWebSocket->m_pbReceive != NULL)
+    {
+        return ERROR_INVALID_OPERATION;
+    }
+
+    pWebSocket->m_pbReceive = static_cast<BYTE *>(pvBuffer);
+    pWebSocket->m_cbReceive = dwBufferLength;
+
+    return NO_ERROR;
+}
+
+//static
+DWORD
+WINAPI
+FAKE_WINHTTP_WEBSOCKET::WebSocketShutdown(
+    _In_ HINTERNET                      hWebSocket,
+    _In_ USHORT                         usStatus,
+    _In_reads_bytes_opt_(dwReasonLength) PVOID pvReason,
+    _In_ DWORD                          dwReasonLength
+)
+{
+    UNREFERENCED_PARAMETER(hWebSocket);
+    UNREFERENCED_PARAMETER(usStatus);
+    UNREFERENCED_PARAMETER(pvReason);
+    UNREFERENCED_PARAMETER(dwReasonLength);
+
+    return NO_ERROR;
+}
+
+//static
+DWORD
+WINAPI
+FAKE_WINHTTP_WEBSOCKET::WebSocketQueryCloseStatus(
+    _In_ HINTERNET                      hWebSocket,
+    _Out_ USHORT *                      pusStatus,
+    _Out_writes_bytes_to_opt_(dwReasonLength, *pdwReasonLengthConsumed) PVOID pvReason,
+    _In_ DWORD                          dwReasonLength,
+    _Out_ DWORD *                       pdwReasonLengthConsumed
+)
+{
+    UNREFERENCED_PARAMETER(hWebSocket);
+    UNREFERENCED_PARAMETER(pvReason);
+    UNREFERENCED_PARAMETER(dwReasonLength);
+
+    *pusStatus = 1000;
+    *pdwReasonLengthConsumed = 0;
+
+    return NO_ERROR;
+}
@@ -0,0 +1,296 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// The two endpoints WEBSOCKET_HANDLER relays between, without a network.
+//
+// Both fakes accept any number of sends, which complete when the driver
+// asks them to, and hold a single receive until the driver hands it the
+// next piece of a message. Completions then run on the driver's thread,
+// like the IIS and WinHTTP completions would run on their own threads.
+//
+
+//
+// IIS side of the connection, the client.
+//
+class FAKE_WEBSOCKET_CONTEXT : public IWebSocketContext
+{
+public:
+    FAKE_WEBSOCKET_CONTEXT();
+
+    VOID
+    CleanupStoredContext(
+        VOID
+    ) override
+    {
+    }
+
+    HRESULT
+    WriteFragment(
+        _In_ VOID *                     pData,
+        _Inout_ DWORD *                 pcbSent,
+        _In_ BOOL                       fAsync,
+        _In_ BOOL                       fUTF8Encoded,
+        _In_ BOOL                       fFinalFragment,
+        _In_ PFN_WEBSOCKET_COMPLETION   pfnCompletion,
+        _In_ VOID *                     pvCompletionContext,
+        _Out_ BOOL *                    pfCompletionExpected
+    ) override;
+
+    HRESULT
+    ReadFragment(
+        _Out_ VOID *                    pData,
+        _Inout_ DWORD *                 pcbData,
+        _In_ BOOL                       fAsync,
+        _Out_ BOOL *                    pfUTF8Encoded,
+        _Out_ BOOL *                    pfFinalFragment,
+        _Out_ BOOL *                    pfConnectionClose,
+        _In_ PFN_WEBSOCKET_COMPLETION   pfnCompletion,
+        _In_ VOID *                     pvCompletionContext,
+        _Out_ BOOL *                    pfCompletionExpected
+    ) override;
+
+    HRESULT
+    SendConnectionClose(
+        _In_ BOOL                       fAsync,
+        _In_ USHORT                     uStatusCode,
+        _In_ LPCWSTR                    pszReason,
+        _In_ PFN_WEBSOCKET_COMPLETION   pfnCompletion,
+        _In_ VOID *                     pvCompletionContext,
+        _Out_ BOOL *                    pfCompletionExpected
+    ) override;
+
+    HRESULT
+    GetCloseStatus(
+        _Out_ USHORT *                  pStatusCode,
+        _Out_ LPCWSTR *                 ppszReason,
+        _Out_ USHORT *                  pcchReason
+    ) override;
+
+    VOID
+    CloseTcpConnection(
+        VOID
+    ) override
+    {
+    }
+
+    VOID
+    CancelOutstandingIO(
+        VOID
+    ) override
+    {
+    }
+
+    BOOL
+    QueryReadPending(
+        VOID
+    ) const
+    {
+        return m_pfnReadCompletion != NULL;
+    }
+
+    DWORD
+    QueryReadSize(
+        VOID
+    ) const
+    {
+        return m_cbRead;
+    }
+
+    //
+    // Completes the pending read with at most QueryReadSize() bytes of
+    // the client's message.
+    //
+    VOID
+    CompleteRead(
+        const BYTE *    pbData,
+        DWORD           cbData,
+        BOOL            fFinalFragment
+    );
+
+    //
+    // Completes the oldest send, FALSE if there is none.
+    //
+    BOOL
+    CompleteWrite(
+        VOID
+    );
+
+    //
+    // Messages sent to the client so far and when the last one was.
+    //
+    LONG64
+    QueryMessagesWritten(
+        VOID
+    ) const
+    {
+        return m_cMessagesWritten;
+    }
+
+    LONGLONG
+    QueryLastMessageWritten(
+        VOID
+    ) const
+    {
+        return m_llLastMessageWritten;
+    }
+
+private:
+    struct WRITE
+    {
+        DWORD                       cbData;
+        BOOL                        fUTF8Encoded;
+        BOOL                        fFinalFragment;
+        BOOL                        fClose;
+        PFN_WEBSOCKET_COMPLETION    pfnCompletion;
+        VOID *                      pvCompletionContext;
+    };
+
+    FAKE_WEBSOCKET_CONTEXT(const FAKE_WEBSOCKET_CONTEXT &);
+    void operator=(const FAKE_WEBSOCKET_CONTEXT &);
+
+    BYTE *                      m_pbRead;
+    DWORD                       m_cbRead;
+    PFN_WEBSOCKET_COMPLETION    m_pfnReadCompletion;
+    VOID *                      m_pvReadCompletionContext;
+
+    std::deque<WRITE>           m_writes;
+    LONG64                      m_cMessagesWritten;
+    LONGLONG                    m_llLastMessageWritten;
+};
+
+//
+// WinHTTP side of the connection, the backend. Install() points the
+// WINHTTP_HELPER functions at the fakes, the WebSocket handle is the
+// address of the instance.
+//
+class FAKE_WINHTTP_WEBSOCKET
+{
+public:
+    FAKE_WINHTTP_WEBSOCKET();
+
+    static
+    VOID
+    Install(
+        VOID
+    );
+
+    HINTERNET
+    QueryHandle(
+        VOID
+    )
+    {
+        return reinterpret_cast<HINTERNET>(this);
+    }
+
+    BOOL
+    QueryReceivePending(
+        VOID
+    ) const
+    {
+        return m_pbReceive != NULL;
+    }
+
+    DWORD
+    QueryReceiveSize(
+        VOID
+    ) const
+    {
+        return m_cbReceive;
+    }
+
+    //
+    // Completes the pending receive with at most QueryReceiveSize() bytes
+    // of the backend's message, the way the WinHTTP callback of the
+    // forwarding handler does.
+    //
+    VOID
+    CompleteReceive(
+        WEBSOCKET_HANDLER * pHandler,
+        const BYTE *        pbData,
+        DWORD               cbData,
+        BOOL                fFinalFragment
+    );
+
+    //
+    // Completes the oldest send, FALSE if there is none.
+    //
+    BOOL
+    CompleteSend(
+        WEBSOCKET_HANDLER * pHandler
+    );
+
+    //
+    // Messages sent to the backend so far and when the last one was.
+    //
+    LONG64
+    QueryMessagesSent(
+        VOID
+    ) const
+    {
+        return m_cMessagesSent;
+    }
+
+    LONGLONG
+    QueryLastMessageSent(
+        VOID
+    ) const
+    {
+        return m_llLastMessageSent;
+    }
+
+private:
+    FAKE_WINHTTP_WEBSOCKET(const FAKE_WINHTTP_WEBSOCKET &);
+    void operator=(const FAKE_WINHTTP_WEBSOCKET &);
+
+    static
+    DWORD
+    WINAPI
+    WebSocketSend(
+        _In_ HINTERNET                      hWebSocket,
+        _In_ WINHTTP_WEB_SOCKET_BUFFER_TYPE eBufferType,
+        _In_reads_opt_(dwBufferLength) PVOID pvBuffer,
+        _In_ DWORD                          dwBufferLength
+    );
+
+    static
+    DWORD
+    WINAPI
+    WebSocketReceive(
+        _In_ HINTERNET                      hWebSocket,
+        _Out_writes_bytes_to_(dwBufferLength, *pdwBytesRead) PVOID pvBuffer,
+        _In_ DWORD                          dwBufferLength,
+        _Out_range_(0, dwBufferLength) DWORD * pdwBytesRead,
+        _Out_ WINHTTP_WEB_SOCKET_BUFFER_TYPE * peBufferType
+    );
+
+    static
+    DWORD
+    WINAPI
+    WebSocketShutdown(
+        _In_ HINTERNET                      hWebSocket,
+        _In_ USHORT                         usStatus,
+        _In_reads_bytes_opt_(dwReasonLength) PVOID pvReason,
+        _In_ DWORD                          dwReasonLength
+    );
+
+    static
+    DWORD
+    WINAPI
+    WebSocketQueryCloseStatus(
+        _In_ HINTERNET                      hWebSocket,
+        _Out_ USHORT *                      pusStatus,
+        _Out_writes_bytes_to_opt_(dwReasonLength, *pdwReasonLengthConsumed) PVOID pvReason,
+        _In_ DWORD                          dwReasonLength,
+        _Out_ DWORD *                       pdwReasonLengthConsumed
+    );
+
+    BYTE *                      m_pbReceive;
+    DWORD                       m_cbReceive;
+
+    std::deque<WINHTTP_WEB_SOCKET_STATUS> m_sends;
+    LONG64                      m_cMessagesSent;
+    LONGLONG                    m_llLastMessageSent;
+};
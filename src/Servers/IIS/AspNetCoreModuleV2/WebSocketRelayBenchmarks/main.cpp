@@ -0,0 +1,100 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+DECLARE_DEBUG_PRINT_OBJECT("websocketrelaybenchmarks");
+
+//
+// Globals of the out of process handler the relay depends on.
+//
+BOOL                g_fWebSocketStaticInitialize = TRUE;
+BOOL                g_fEnableReferenceCountTracing = FALSE;
+BOOL                g_fCaptureReferenceCountStacks = FALSE;
+IHttpServer *       g_pHttpServer = NULL;
+
+static const DWORD  g_rgcbMessageSizes[] = { 16, 128, 1024, 4 * 1024, 16 * 1024, 64 * 1024 };
+
+static
+VOID
+PrintUsage(
+    VOID
+)
+{
+    wprintf(L"Usage: WebSocketRelayBenchmarks [-messages <count>] [-receiveBufferSize <bytes>] [-coalesceFragments]\n");
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    DWORD   cMessages = 100000;
+    DWORD   cbReceiveBuffer = 0;
+    BOOL    fCoalesceFragments = FALSE;
+    HRESULT hr;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (_wcsicmp(argv[i], L"-messages") == 0 && i + 1 < argc)
+        {
+            cMessages = _wtoi(argv[++i]);
+        }
+        else if (_wcsicmp(argv[i], L"-receiveBufferSize") == 0 && i + 1 < argc)
+        {
+            cbReceiveBuffer = _wtoi(argv[++i]);
+        }
+        else if (_wcsicmp(argv[i], L"-coalesceFragments") == 0)
+        {
+            fCoalesceFragments = TRUE;
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (cMessages == 0)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    FAKE_WINHTTP_WEBSOCKET::Install();
+
+    hr = WEBSOCKET_HANDLER::StaticInitialize(FALSE);
+    if (FAILED(hr))
+    {
+        wprintf(L"WEBSOCKET_HANDLER::StaticInitialize failed with %08x\n", hr);
+        return 1;
+    }
+
+    wprintf(L"%-10s %10s %14s %10s %10s %12s\n", L"direction", L"bytes", L"messages/s", L"p50 us", L"p99 us", L"bytes/conn");
+
+    for (WEBSOCKET_RELAY_BENCHMARK::DIRECTION direction : { WEBSOCKET_RELAY_BENCHMARK::TO_BACKEND, WEBSOCKET_RELAY_BENCHMARK::TO_CLIENT })
+    {
+        for (DWORD cbMessage : g_rgcbMessageSizes)
+        {
+            WEBSOCKET_RELAY_BENCHMARK           benchmark(cbReceiveBuffer, fCoalesceFragments);
+            WEBSOCKET_RELAY_BENCHMARK::RESULT   result;
+
+            hr = benchmark.Run(direction, cbMessage, max(cMessages / 10, 1UL), cMessages, &result);
+            if (FAILED(hr))
+            {
+                wprintf(L"Relaying %lu byte messages failed with %08x\n", cbMessage, hr);
+                WEBSOCKET_HANDLER::StaticTerminate();
+                return 1;
+            }
+
+            wprintf(L"%-10s %10lu %14.0f %10.2f %10.2f %12Iu\n",
+                direction == WEBSOCKET_RELAY_BENCHMARK::TO_BACKEND ? L"toBackend" : L"toClient",
+                cbMessage,
+                result.dblMessagesPerSecond,
+                result.dblP50Microseconds,
+                result.dblP99Microseconds,
+                result.cbPerConnection);
+        }
+    }
+
+    WEBSOCKET_HANDLER::StaticTerminate();
+
+    return 0;
+}
@@ -0,0 +1,15 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// The relay is compiled exactly as in the out of process handler.
+//
+#include "..\OutOfProcessRequestHandler\stdafx.h"
+
+#include <algorithm>
+#include <deque>
+
+#include "fakeendpoints.h"
+#include "websocketrelaybenchmark.h"
@@ -0,0 +1,291 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include "exceptions.h"
+
+WEBSOCKET_RELAY_BENCHMARK::WEBSOCKET_RELAY_BENCHMARK(
+    DWORD   cbReceiveBuffer,
+    BOOL    fCoalesceFragments
+) :
+    m_cbReceiveBuffer(cbReceiveBuffer),
+    m_fCoalesceFragments(fCoalesceFragments),
+    m_pHandler(NULL),
+    m_cbPeakPooled(0)
+{
+}
+
+WEBSOCKET_RELAY_BENCHMARK::~WEBSOCKET_RELAY_BENCHMARK()
+{
+    EndConnection();
+}
+
+HRESULT
+WEBSOCKET_RELAY_BENCHMARK::Run(
+    DIRECTION   direction,
+    DWORD       cbMessage,
+    DWORD       cWarmupMessages,
+    DWORD       cMessages,
+    _Out_ RESULT * pResult
+)
+{
+    LARGE_INTEGER   liFrequency;
+    LARGE_INTEGER   liStart;
+    LARGE_INTEGER   liEnd;
+    LONGLONG        llLatency;
+    HRESULT         hr;
+
+    ZeroMemory(pResult, sizeof(*pResult));
+
+    if (cMessages == 0)
+    {
+        RETURN_HR(E_INVALIDARG);
+    }
+
+    try
+    {
+        m_message.resize(cbMessage);
+        m_latencies.reserve(cMessages);
+    }
+    CATCH_RETURN();
+
+    // Any pattern does, it is copied like the payload of a real message.
+    for (DWORD i = 0; i < cbMessage; ++i)
+    {
+        m_message[i] = static_cast<BYTE>(i);
+    }
+
+    hr = StartConnection();
+    if (FAILED_LOG(hr))
+    {
+        goto Finished;
+    }
+
+    for (DWORD i = 0; i < cWarmupMessages; ++i)
+    {
+        hr = RelayMessage(direction, cbMessage, &llLatency);
+        if (FAILED_LOG(hr))
+        {
+            goto Finished;
+        }
+    }
+
+    //
+    // The buffers the warmup borrowed are back in the pool, only the
+    // measured messages count towards the peak.
+    //
+    m_cbPeakPooled = 0;
+
+    QueryPerformanceCounter(&liStart);
+    for (DWORD i = 0; i < cMessages; ++i)
+    {
+        hr = RelayMessage(direction, cbMessage, &llLatency);
+        if (FAILED_LOG(hr))
+        {
+            goto Finished;
+        }
+        m_latencies.push_back(llLatency);
+    }
+    QueryPerformanceCounter(&liEnd);
+
+Finished:
+    //
+    // Always released here, the receive buffers go back to a pool that
+    // does not outlive the caller.
+    //
+    EndConnection();
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    QueryPerformanceFrequency(&liFrequency);
+    const double dblMicrosecondsPerTick = 1000000.0 / liFrequency.QuadPart;
+
+    std::sort(m_latencies.begin(), m_latencies.end());
+
+    pResult->cMessages = cMessages;
+    pResult->dblMessagesPerSecond = cMessages * static_cast<double>(liFrequency.QuadPart) /
+        max(liEnd.QuadPart - liStart.QuadPart, 1LL);
+    pResult->dblP50Microseconds = m_latencies[(cMessages - 1) / 2] * dblMicrosecondsPerTick;
+    pResult->dblP99Microseconds = m_latencies[(cMessages - 1) * 99 / 100] * dblMicrosecondsPerTick;
+    pResult->cbPerConnection = sizeof(WEBSOCKET_HANDLER) + m_cbPeakPooled;
+
+    return S_OK;
+}
+
+HRESULT
+WEBSOCKET_RELAY_BENCHMARK::StartConnection(
+    VOID
+)
+/*++
+
+Routine Description:
+
+    Set up the handler like ProcessRequest does once the upgrade is
+    complete, with the fake endpoints, and post the receives of both
+    directions.
+
+--*/
+{
+    HRESULT hr;
+
+    m_pHandler = new WEBSOCKET_HANDLER;
+    if (m_pHandler == NULL)
+    {
+        RETURN_HR(E_OUTOFMEMORY);
+    }
+
+    m_pHandler->_pWebSocketContext = &m_client;
+    m_pHandler->_hWebSocketRequest = m_backend.QueryHandle();
+    m_pHandler->_fCoalesceFragments = m_fCoalesceFragments;
+
+    if (m_cbReceiveBuffer != 0)
+    {
+        m_pHandler->_cbReceiveBuffer = min(max(m_cbReceiveBuffer, WEBSOCKET_HANDLER::IDLE_RECEIVE_BUFFER_SIZE),
+            WEBSOCKET_HANDLER::MAX_RECEIVE_BUFFER_SIZE);
+    }
+
+    m_pHandler->IncrementOutstandingIo();
+
+    hr = m_pHandler->DoIisWebSocketReceive();
+    if (SUCCEEDED(hr))
+    {
+        hr = m_pHandler->DoWinHttpWebSocketReceive();
+    }
+
+    m_pHandler->DecrementOutstandingIo();
+
+    return hr;
+}
+
+VOID
+WEBSOCKET_RELAY_BENCHMARK::EndConnection(
+    VOID
+)
+{
+    if (m_pHandler == NULL)
+    {
+        return;
+    }
+
+    //
+    // The receives of both directions are still outstanding with the fakes,
+    // which never complete them. The handle is not a WinHTTP one and must
+    // not be closed.
+    //
+    m_pHandler->_hWebSocketRequest = NULL;
+    m_pHandler->Terminate();
+    m_pHandler = NULL;
+}
+
+HRESULT
+WEBSOCKET_RELAY_BENCHMARK::RelayMessage(
+    DIRECTION   direction,
+    DWORD       cbMessage,
+    _Out_ LONGLONG * pllLatency
+)
+{
+    LARGE_INTEGER   liStart;
+    DWORD           cbDelivered = 0;
+    const LONG64    cMessagesRelayed = direction == TO_BACKEND ?
+        m_backend.QueryMessagesSent() :
+        m_client.QueryMessagesWritten();
+
+    *pllLatency = 0;
+
+    QueryPerformanceCounter(&liStart);
+
+    for (;;)
+    {
+        const LONG64 cMessages = direction == TO_BACKEND ?
+            m_backend.QueryMessagesSent() :
+            m_client.QueryMessagesWritten();
+        if (cMessages != cMessagesRelayed)
+        {
+            break;
+        }
+
+        //
+        // Data is only read after the previous read was sent on, the sends
+        // complete before more of the message arrives.
+        //
+        if (CompleteSend())
+        {
+            SamplePooledBytes();
+            continue;
+        }
+
+        if (cbDelivered == cbMessage && cbMessage != 0)
+        {
+            // The whole message was read but never sent on.
+            RETURN_HR(E_UNEXPECTED);
+        }
+
+        if (direction == TO_BACKEND)
+        {
+            if (!m_client.QueryReadPending())
+            {
+                RETURN_HR(E_UNEXPECTED);
+            }
+
+            const DWORD cbFragment = min(cbMessage - cbDelivered, m_client.QueryReadSize());
+            cbDelivered += cbFragment;
+            m_client.CompleteRead(m_message.data() + cbDelivered - cbFragment, cbFragment, cbDelivered == cbMessage);
+        }
+        else
+        {
+            if (!m_backend.QueryReceivePending())
+            {
+                RETURN_HR(E_UNEXPECTED);
+            }
+
+            const DWORD cbFragment = min(cbMessage - cbDelivered, m_backend.QueryReceiveSize());
+            cbDelivered += cbFragment;
+            m_backend.CompleteReceive(m_pHandler, m_message.data() + cbDelivered - cbFragment, cbFragment, cbDelivered == cbMessage);
+        }
+
+        SamplePooledBytes();
+    }
+
+    *pllLatency = (direction == TO_BACKEND ?
+        m_backend.QueryLastMessageSent() :
+        m_client.QueryLastMessageWritten()) - liStart.QuadPart;
+
+    //
+    // Completing the last send posts the receive of the next message.
+    //
+    while (CompleteSend())
+    {
+        SamplePooledBytes();
+    }
+
+    return S_OK;
+}
+
+BOOL
+WEBSOCKET_RELAY_BENCHMARK::CompleteSend(
+    VOID
+)
+{
+    return m_backend.CompleteSend(m_pHandler) || m_client.CompleteWrite();
+}
+
+VOID
+WEBSOCKET_RELAY_BENCHMARK::SamplePooledBytes(
+    VOID
+)
+{
+    SIZE_T cbPooled = 0;
+
+    for (WEBSOCKET_HANDLER::RECEIVE_BUFFER * pReceiveBuffer : { &m_pHandler->_WinHttpReceiveBuffer, &m_pHandler->_IisReceiveBuffer })
+    {
+        if (pReceiveBuffer->pPooledBuffer != NULL)
+        {
+            cbPooled += m_pHandler->_cbReceiveBuffer;
+        }
+    }
+
+    m_cbPeakPooled = max(m_cbPeakPooled, cbPooled);
+}
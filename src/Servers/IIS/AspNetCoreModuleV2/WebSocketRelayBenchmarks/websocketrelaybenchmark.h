@@ -0,0 +1,104 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// Relays messages of one size through a WEBSOCKET_HANDLER connected to
+// the fake endpoints, one message at a time, and measures:
+//
+//  - messages per second, over every relayed message;
+//  - the relay latency, from handing the first byte of a message to the
+//    handler until it issues the send of the message's last fragment;
+//  - the memory of the connection, the handler itself plus the most
+//    pooled receive buffer memory it held at any point.
+//
+// No ProcessRequest and no IHttpContext3 are involved, the handler is set
+// up with the fake endpoints directly and only its relay loop runs.
+//
+class WEBSOCKET_RELAY_BENCHMARK
+{
+public:
+    enum DIRECTION
+    {
+        TO_BACKEND = 0,
+        TO_CLIENT = 1
+    };
+
+    struct RESULT
+    {
+        DWORD   cMessages;
+        double  dblMessagesPerSecond;
+        double  dblP50Microseconds;
+        double  dblP99Microseconds;
+        SIZE_T  cbPerConnection;
+    };
+
+    WEBSOCKET_RELAY_BENCHMARK(
+        DWORD   cbReceiveBuffer,
+        BOOL    fCoalesceFragments
+    );
+
+    ~WEBSOCKET_RELAY_BENCHMARK();
+
+    //
+    // Relays cWarmupMessages unmeasured, then cMessages measured messages
+    // of cbMessage bytes. A benchmark runs once.
+    //
+    HRESULT
+    Run(
+        DIRECTION   direction,
+        DWORD       cbMessage,
+        DWORD       cWarmupMessages,
+        DWORD       cMessages,
+        _Out_ RESULT * pResult
+    );
+
+private:
+    WEBSOCKET_RELAY_BENCHMARK(const WEBSOCKET_RELAY_BENCHMARK &);
+    void operator=(const WEBSOCKET_RELAY_BENCHMARK &);
+
+    HRESULT
+    StartConnection(
+        VOID
+    );
+
+    VOID
+    EndConnection(
+        VOID
+    );
+
+    //
+    // Relays one message and returns its latency in performance counter
+    // ticks once every IO it caused has completed.
+    //
+    HRESULT
+    RelayMessage(
+        DIRECTION   direction,
+        DWORD       cbMessage,
+        _Out_ LONGLONG * pllLatency
+    );
+
+    //
+    // Completes one outstanding send of either endpoint, FALSE if there
+    // is none.
+    //
+    BOOL
+    CompleteSend(
+        VOID
+    );
+
+    VOID
+    SamplePooledBytes(
+        VOID
+    );
+
+    DWORD                       m_cbReceiveBuffer;
+    BOOL                        m_fCoalesceFragments;
+    WEBSOCKET_HANDLER *         m_pHandler;
+    FAKE_WEBSOCKET_CONTEXT      m_client;
+    FAKE_WINHTTP_WEBSOCKET      m_backend;
+    std::vector<BYTE>           m_message;
+    std::vector<LONGLONG>       m_latencies;
+    SIZE_T                      m_cbPeakPooled;
+};
@@ -0,0 +1,166 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+using System.Diagnostics.Tracing;
+
+namespace Microsoft.AspNetCore.Server.IIS.Core;
+
+// Counters of the native in-process handler: what IIS sees of the requests before and after
+// they are in managed code. They are read from the block the module publishes, nothing is
+// counted here.
+[EventSource(Name = "Microsoft-AspNetCore-Server-IIS")]
+internal sealed unsafe class IISEventSource : EventSource
+{
+    public static readonly IISEventSource Log = new IISEventSource();
+
+    private IncrementingPollingCounter? _requestsPerSecondCounter;
+    private PollingCounter? _totalRequestsCounter;
+    private PollingCounter? _currentRequestsCounter;
+    private PollingCounter? _queuedRequestsCounter;
+    private PollingCounter? _rejectedRequestsCounter;
+    private PollingCounter? _queueTimeMeanCounter;
+    private PollingCounter? _queueTimeP50Counter;
+    private PollingCounter? _queueTimeP99Counter;
+    private PollingCounter? _completionTimeMeanCounter;
+    private PollingCounter? _completionTimeP50Counter;
+    private PollingCounter? _completionTimeP99Counter;
+    private PollingCounter? _handlerMemoryCounter;
+    private PollingCounter? _stdoutCaptureMemoryCounter;
+
+    private readonly object _sync = new object();
+    private IISNativeApplication? _application;
+    private IISNativeCounters* _pCounters;
+    private IISNativeCounters _counters;
+
+    private IISEventSource()
+    {
+    }
+
+    // The module only measures once asked to, which is when a listener first enables the
+    // counters, be it before or after the server starts.
+    [NonEvent]
+    public void AttachApplication(IISNativeApplication application)
+    {
+        lock (_sync)
+        {
+            _application = application;
+            if (IsEnabled())
+            {
+                EnableNativeCountersNoLock();
+            }
+        }
+    }
+
+    protected override void OnEventCommand(EventCommandEventArgs command)
+    {
+        if (command.Command == EventCommand.Enable)
+        {
+            lock (_sync)
+            {
+                EnableNativeCountersNoLock();
+            }
+
+            // This is the convention for initializing counters in the RuntimeEventSource (lazily on the first enable command).
+            // They aren't disabled afterwards...
+
+            _requestsPerSecondCounter ??= new IncrementingPollingCounter("requests-per-second", this, () => Read().TotalRequests)
+            {
+                DisplayName = "Request Rate",
+                DisplayRateTimeScale = TimeSpan.FromSeconds(1)
+            };
+
+            _totalRequestsCounter ??= new PollingCounter("total-requests", this, () => Read().TotalRequests)
+            {
+                DisplayName = "Total Requests",
+            };
+
+            _currentRequestsCounter ??= new PollingCounter("current-requests", this, () => Read().ActiveRequests)
+            {
+                DisplayName = "Current Requests"
+            };
+
+            _queuedRequestsCounter ??= new PollingCounter("queued-requests", this, () => Read().QueuedRequests)
+            {
+                DisplayName = "Queued Requests"
+            };
+
+            _rejectedRequestsCounter ??= new PollingCounter("rejected-requests", this, () => Read().RejectedRequests)
+            {
+                DisplayName = "Rejected Requests"
+            };
+
+            _queueTimeMeanCounter ??= new PollingCounter("queue-time-mean", this, () => ToMilliseconds(Read().QueueTimeMeanMicroseconds))
+            {
+                DisplayName = "IIS Queue Time (mean)",
+                DisplayUnits = "ms"
+            };
+
+            _queueTimeP50Counter ??= new PollingCounter("queue-time-p50", this, () => ToMilliseconds(Read().QueueTimeP50Microseconds))
+            {
+                DisplayName = "IIS Queue Time (p50)",
+                DisplayUnits = "ms"
+            };
+
+            _queueTimeP99Counter ??= new PollingCounter("queue-time-p99", this, () => ToMilliseconds(Read().QueueTimeP99Microseconds))
+            {
+                DisplayName = "IIS Queue Time (p99)",
+                DisplayUnits = "ms"
+            };
+
+            _completionTimeMeanCounter ??= new PollingCounter("completion-time-mean", this, () => ToMilliseconds(Read().CompletionMeanMicroseconds))
+            {
+                DisplayName = "Native Completion Time (mean)",
+                DisplayUnits = "ms"
+            };
+
+            _completionTimeP50Counter ??= new PollingCounter("completion-time-p50", this, () => ToMilliseconds(Read().CompletionP50Microseconds))
+            {
+                DisplayName = "Native Completion Time (p50)",
+                DisplayUnits = "ms"
+            };
+
+            _completionTimeP99Counter ??= new PollingCounter("completion-time-p99", this, () => ToMilliseconds(Read().CompletionP99Microseconds))
+            {
+                DisplayName = "Native Completion Time (p99)",
+                DisplayUnits = "ms"
+            };
+
+            _handlerMemoryCounter ??= new PollingCounter("native-handler-memory", this, () => Read().HandlerMemoryBytes)
+            {
+                DisplayName = "Native Handler Memory",
+                DisplayUnits = "B"
+            };
+
+            _stdoutCaptureMemoryCounter ??= new PollingCounter("native-stdout-capture-memory", this, () => Read().StdoutCaptureMemoryBytes)
+            {
+                DisplayName = "Native Stdout Capture Memory",
+                DisplayUnits = "B"
+            };
+        }
+    }
+
+    private void EnableNativeCountersNoLock()
+    {
+        if (_pCounters == null && _application != null)
+        {
+            _pCounters = _application.TryGetNativeCounters();
+        }
+    }
+
+    // Counters are polled one after the other, each refreshes the copy; a block that is being
+    // rewritten leaves the previous one.
+    private IISNativeCounters Read()
+    {
+        lock (_sync)
+        {
+            if (_pCounters != null && IISNativeCounters.TryRead(_pCounters, out var counters))
+            {
+                _counters = counters;
+            }
+
+            return _counters;
+        }
+    }
+
+    private static double ToMilliseconds(long microseconds) => microseconds / 1000.0;
+}
@@ -557,6 +557,9 @@ internal abstract partial class IISHttpContext : NativeRequestContext, IThreadPo
     // that is only available on Win 11/Server 2022 or later.
     private static readonly bool OsSupportsAdvancedHttp2 = OperatingSystem.IsWindowsVersionAtLeast(10, 0, 20348, 0);
 
+    // Cleared for good the first time the module turns out not to have http_response_set_headers.
+    private static bool _batchResponseHeaders = true;
+
     protected bool AdvancedHttp2FeaturesSupported()
     {
         return OsSupportsAdvancedHttp2 &&
@@ -582,6 +585,20 @@ internal abstract partial class IISHttpContext : NativeRequestContext, IThreadPo
         }
 
         HttpResponseHeaders.IsReadOnly = true;
+        if (_batchResponseHeaders)
+        {
+            try
+            {
+                SetResponseHeadersBatched();
+                return;
+            }
+            catch (EntryPointNotFoundException)
+            {
+                // An older module, nothing was set.
+                _batchResponseHeaders = false;
+            }
+        }
+
         foreach (var headerPair in HttpResponseHeaders)
         {
             var headerValues = headerPair.Value;
@@ -623,6 +640,98 @@ internal abstract partial class IISHttpContext : NativeRequestContext, IThreadPo
         }
     }
 
+    // All the headers in one call into the module: names and values are encoded into one pooled
+    // buffer, each name null terminated, and described by an array of RESPONSE_HEADER.
+    private unsafe void SetResponseHeadersBatched()
+    {
+        var cHeaders = 0;
+        var cbHeaders = 0;
+        foreach (var headerPair in HttpResponseHeaders)
+        {
+            var headerValues = headerPair.Value;
+            if (headerValues.Count == 0)
+            {
+                continue;
+            }
+
+            var cbName = HttpApiTypes.KnownResponseHeaders.ContainsKey(headerPair.Key) ? 0 : Encoding.UTF8.GetByteCount(headerPair.Key) + 1;
+            for (var i = 0; i < headerValues.Count; i++)
+            {
+                var headerValue = headerValues[i];
+                if (!string.IsNullOrEmpty(headerValue))
+                {
+                    cHeaders++;
+                    cbHeaders += Encoding.UTF8.GetByteCount(headerValue);
+                }
+            }
+
+            // Encoded once for all its values.
+            cbHeaders += cbName;
+        }
+
+        if (cHeaders == 0)
+        {
+            return;
+        }
+
+        var buffer = ArrayPool<byte>.Shared.Rent(cbHeaders);
+        var headers = ArrayPool<NativeMethods.RESPONSE_HEADER>.Shared.Rent(cHeaders);
+        try
+        {
+            fixed (byte* pBuffer = buffer)
+            fixed (NativeMethods.RESPONSE_HEADER* pHeaders = headers)
+            {
+                var offset = 0;
+                var iHeader = 0;
+                foreach (var headerPair in HttpResponseHeaders)
+                {
+                    var headerValues = headerPair.Value;
+                    if (headerValues.Count == 0)
+                    {
+                        continue;
+                    }
+
+                    var isKnownHeader = HttpApiTypes.KnownResponseHeaders.TryGetValue(headerPair.Key, out var knownHeaderIndex);
+                    byte* pHeaderName = null;
+                    for (var i = 0; i < headerValues.Count; i++)
+                    {
+                        var headerValue = headerValues[i];
+                        if (string.IsNullOrEmpty(headerValue))
+                        {
+                            continue;
+                        }
+
+                        if (!isKnownHeader && pHeaderName == null)
+                        {
+                            pHeaderName = pBuffer + offset;
+                            offset += Encoding.UTF8.GetBytes(headerPair.Key, buffer.AsSpan(offset));
+                            buffer[offset++] = 0;
+                        }
+
+                        var cbValue = Encoding.UTF8.GetBytes(headerValue, buffer.AsSpan(offset));
+                        pHeaders[iHeader++] = new NativeMethods.RESPONSE_HEADER
+                        {
+                            pszHeaderName = pHeaderName,
+                            pszHeaderValue = pBuffer + offset,
+                            dwHeaderId = (uint)knownHeaderIndex,
+                            usHeaderValueLength = (ushort)cbValue,
+                            fReplace = i == 0 ? 1 : 0
+                        };
+                        offset += cbValue;
+                    }
+                }
+
+                Debug.Assert(iHeader == cHeaders);
+                NativeMethods.HttpResponseSetHeaders(_requestNativeHandle, pHeaders, cHeaders);
+            }
+        }
+        finally
+        {
+            ArrayPool<NativeMethods.RESPONSE_HEADER>.Shared.Return(headers);
+            ArrayPool<byte>.Shared.Return(buffer);
+        }
+    }
+
     public unsafe void SetResponseTrailers()
     {
         HttpResponseTrailers.IsReadOnly = true;
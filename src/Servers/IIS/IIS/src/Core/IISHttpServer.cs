@@ -106,6 +106,8 @@ internal sealed class IISHttpServer : IServer
             (IntPtr)_httpServerHandle,
             (IntPtr)_httpServerHandle);
 
+        IISEventSource.Log.AttachApplication(_nativeApplication);
+
         _serverAddressesFeature.Addresses = _options.ServerAddresses;
 
         return Task.CompletedTask;
@@ -35,6 +35,28 @@ internal sealed class IISNativeApplication
         }
     }
 
+    // Null when the module publishes no native counters, or none this server knows.
+    public unsafe IISNativeCounters* TryGetNativeCounters()
+    {
+        lock (_sync)
+        {
+            if (_nativeApplication.IsInvalid)
+            {
+                return null;
+            }
+
+            try
+            {
+                return NativeMethods.HttpTryGetNativeCounters(_nativeApplication, out var pCounters) ? pCounters : null;
+            }
+            catch (EntryPointNotFoundException)
+            {
+                // An older module.
+                return null;
+            }
+        }
+    }
+
     public unsafe void RegisterCallbacks(
         delegate* unmanaged<IntPtr, IntPtr, NativeMethods.REQUEST_NOTIFICATION_STATUS> requestCallback,
         delegate* unmanaged<IntPtr, int> shutdownCallback,
@@ -0,0 +1,61 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+using System.Runtime.InteropServices;
+
+namespace Microsoft.AspNetCore.Server.IIS.Core;
+
+// Mirrors IN_PROCESS_NATIVE_COUNTERS of the in-process handler. The module rewrites it once a second,
+// Sequence is odd while it does; counts are totals and latencies those of the last second.
+[StructLayout(LayoutKind.Sequential)]
+internal struct IISNativeCounters
+{
+    public const uint Version = 1;
+
+    public uint dwVersion;
+    public uint Size;
+    public int Sequence;
+    public uint Reserved;
+
+    public long TotalRequests;
+    public long ActiveRequests;
+    public long QueuedRequests;
+    public long RejectedRequests;
+
+    public long QueueTimeSamples;
+    public long QueueTimeMeanMicroseconds;
+    public long QueueTimeP50Microseconds;
+    public long QueueTimeP99Microseconds;
+
+    public long Completions;
+    public long CompletionMeanMicroseconds;
+    public long CompletionP50Microseconds;
+    public long CompletionP99Microseconds;
+
+    public long HandlerMemoryBytes;
+    public long StdoutCaptureMemoryBytes;
+
+    // Copies the block, retrying while the module is rewriting it. Returns false if it kept
+    // being rewritten, callers then keep their previous copy.
+    public static unsafe bool TryRead(IISNativeCounters* pCounters, out IISNativeCounters counters)
+    {
+        for (var attempt = 0; attempt < 8; attempt++)
+        {
+            var sequence = Volatile.Read(ref pCounters->Sequence);
+            if ((sequence & 1) == 0)
+            {
+                counters = *pCounters;
+                Interlocked.MemoryBarrier();
+                if (Volatile.Read(ref pCounters->Sequence) == sequence)
+                {
+                    return true;
+                }
+            }
+
+            Thread.Yield();
+        }
+
+        counters = default;
+        return false;
+    }
+}
@@ -39,6 +39,78 @@ internal static partial class NativeMethods
         RQ_NOTIFICATION_FINISH_REQUEST
     }
 
+    // One header of http_response_set_headers. pszHeaderName is null for a known header, whose
+    // HTTP_HEADER_ID is then dwHeaderId; names are null terminated.
+    [StructLayout(LayoutKind.Sequential)]
+    internal unsafe struct RESPONSE_HEADER
+    {
+        public byte* pszHeaderName;
+        public byte* pszHeaderValue;
+        public uint dwHeaderId;
+        public ushort usHeaderValueLength;
+        public int fReplace;
+    }
+
+    // Application properties of http_get_application_properties_view, the strings are the
+    // application's own and not null terminated.
+    [StructLayout(LayoutKind.Sequential)]
+    private unsafe struct IIS_CONFIGURATION_DATA_VIEW
+    {
+        public IntPtr pNativeApplication;
+        public char* pwzFullApplicationPath;
+        public uint cchFullApplicationPath;
+        public char* pwzVirtualApplicationPath;
+        public uint cchVirtualApplicationPath;
+        public char* pwzBindings;
+        public uint cchBindings;
+        public int fWindowsAuthEnabled;
+        public int fBasicAuthEnabled;
+        public int fAnonymousAuthEnable;
+        public uint maxRequestBodySize;
+    }
+
+    // Fast tier of http_get_fast_exports. The entries never block, fail or call back into
+    // managed code, so they are called without a GC transition.
+    [StructLayout(LayoutKind.Sequential)]
+    private unsafe struct IN_PROCESS_FAST_EXPORTS
+    {
+        public const uint Version = 1;
+
+        public uint dwVersion;
+        public uint cbSize;
+        public delegate* unmanaged[SuppressGCTransition]<IntPtr, HTTP_REQUEST_V2*> pfnGetRawRequest;
+        public delegate* unmanaged[SuppressGCTransition]<IntPtr, IntPtr> pfnGetRawResponse;
+        public delegate* unmanaged[SuppressGCTransition]<IntPtr, int> pfnDisableBuffering;
+        public delegate* unmanaged[SuppressGCTransition]<IntPtr, int*, int*, void> pfnGetCompletionInfo;
+    }
+
+    // Looked up on the first fast call rather than with NativeMethods, which is also used
+    // before the module is known to be loaded. Null with an older module.
+    private static unsafe class FastExports
+    {
+        public static readonly IN_PROCESS_FAST_EXPORTS* Table = GetTable();
+
+        private static IN_PROCESS_FAST_EXPORTS* GetTable()
+        {
+            try
+            {
+                if (http_get_fast_exports(IN_PROCESS_FAST_EXPORTS.Version, out var pExports) == HR_OK &&
+                    pExports->cbSize >= sizeof(IN_PROCESS_FAST_EXPORTS))
+                {
+                    return pExports;
+                }
+            }
+            catch (EntryPointNotFoundException)
+            {
+            }
+
+            return null;
+        }
+    }
+
+    // Cleared on the first call into an older module without the string view exports.
+    private static bool _stringViewsSupported = true;
+
     [LibraryImport(AspNetCoreModuleDll)]
     private static partial int http_post_completion(NativeSafeHandle pInProcessHandler, int cbBytes);
 
@@ -58,12 +130,20 @@ internal static partial class NativeMethods
         IntPtr pvRequestContext,
         IntPtr pvShutdownContext);
 
+    [LibraryImport(AspNetCoreModuleDll)]
+    private static unsafe partial int register_request_info_callback(NativeSafeHandle pInProcessApplication,
+        delegate* unmanaged<IntPtr, IntPtr, IntPtr, REQUEST_NOTIFICATION_STATUS> requestInfoCallback,
+        uint dwVersion);
+
     [LibraryImport(AspNetCoreModuleDll)]
     private static unsafe partial int http_write_response_bytes(NativeSafeHandle pInProcessHandler, HTTP_DATA_CHUNK* pDataChunks, int nChunks, [MarshalAs(UnmanagedType.Bool)] out bool fCompletionExpected);
 
     [LibraryImport(AspNetCoreModuleDll)]
     private static partial int http_flush_response_bytes(NativeSafeHandle pInProcessHandler, [MarshalAs(UnmanagedType.Bool)] bool fMoreData, [MarshalAs(UnmanagedType.Bool)] out bool fCompletionExpected);
 
+    [LibraryImport(AspNetCoreModuleDll)]
+    private static unsafe partial int http_write_response_bytes_final(NativeSafeHandle pInProcessHandler, HTTP_DATA_CHUNK* pDataChunks, int nChunks, [MarshalAs(UnmanagedType.Bool)] bool fDisconnect, [MarshalAs(UnmanagedType.Bool)] out bool fCompletionExpected);
+
     [LibraryImport(AspNetCoreModuleDll)]
     private static unsafe partial HTTP_REQUEST_V2* http_get_raw_request(NativeSafeHandle pInProcessHandler);
 
@@ -73,6 +153,12 @@ internal static partial class NativeMethods
     [LibraryImport(AspNetCoreModuleDll)]
     private static partial int http_stop_incoming_requests(NativeSafeHandle pInProcessApplication);
 
+    [LibraryImport(AspNetCoreModuleDll)]
+    private static unsafe partial int http_get_native_counters(NativeSafeHandle pInProcessApplication, out IISNativeCounters* pCounters, out uint dwVersion);
+
+    [LibraryImport(AspNetCoreModuleDll)]
+    private static unsafe partial int http_get_fast_exports(uint dwVersion, out IN_PROCESS_FAST_EXPORTS* pExports);
+
     [LibraryImport(AspNetCoreModuleDll)]
     private static partial int http_disable_buffering(NativeSafeHandle pInProcessHandler);
 
@@ -82,6 +168,9 @@ internal static partial class NativeMethods
     [LibraryImport(AspNetCoreModuleDll)]
     private static unsafe partial int http_read_request_bytes(NativeSafeHandle pInProcessHandler, byte* pvBuffer, int cbBuffer, out int dwBytesReceived, [MarshalAs(UnmanagedType.Bool)] out bool fCompletionExpected);
 
+    [LibraryImport(AspNetCoreModuleDll)]
+    private static unsafe partial int http_read_request_bytes_vectored(NativeSafeHandle pInProcessHandler, byte** ppSegments, int* pcbSegments, int cSegments, out int dwBytesReceived, [MarshalAs(UnmanagedType.Bool)] out bool fCompletionExpected);
+
     [LibraryImport(AspNetCoreModuleDll)]
     private static partial void http_get_completion_info(IntPtr pCompletionInfo, out int cbBytes, out int hr);
 
@@ -91,6 +180,9 @@ internal static partial class NativeMethods
     [LibraryImport(AspNetCoreModuleDll)]
     private static partial int http_get_application_properties(out IISConfigurationData iiConfigData);
 
+    [LibraryImport(AspNetCoreModuleDll)]
+    private static unsafe partial int http_get_application_properties_view(IIS_CONFIGURATION_DATA_VIEW* pIISConfigurationData);
+
     [LibraryImport(AspNetCoreModuleDll)]
     [SuppressMessage("LibraryImportGenerator", "SYSLIB1051:Specified type is not supported by source-generated P/Invokes", Justification = "The enum is handled by the runtime.")]
     private static unsafe partial int http_query_request_property(
@@ -109,6 +201,24 @@ internal static partial class NativeMethods
         [MarshalAs(UnmanagedType.LPStr)] string variableName,
         [MarshalAs(UnmanagedType.BStr)] out string value);
 
+    [LibraryImport(AspNetCoreModuleDll)]
+    private static unsafe partial int http_get_server_variable_view(
+        NativeSafeHandle pInProcessHandler,
+        [MarshalAs(UnmanagedType.LPStr)] string variableName,
+        out char* pszValue,
+        out uint cchValue);
+
+    [LibraryImport(AspNetCoreModuleDll)]
+    private static unsafe partial int http_get_server_variables(
+        NativeSafeHandle pInProcessHandler,
+        byte** ppszVariableNames,
+        int cVariables,
+        char* pwszArena,
+        int cchArena,
+        int* pdwOffsets,
+        int* pcchValues,
+        out int cchRequired);
+
     [LibraryImport(AspNetCoreModuleDll)]
     private static partial int http_set_server_variable(
         NativeSafeHandle pInProcessHandler,
@@ -134,6 +244,31 @@ internal static partial class NativeMethods
         IntPtr pvCompletionContext,
         [MarshalAs(UnmanagedType.Bool)] out bool fCompletionExpected);
 
+    [LibraryImport(AspNetCoreModuleDll)]
+    private static unsafe partial int http_websockets_register_buffers(
+        NativeSafeHandle pInProcessHandler,
+        byte** ppBuffers,
+        int* pcbBuffers,
+        int cBuffers);
+
+    [LibraryImport(AspNetCoreModuleDll)]
+    private static unsafe partial int http_websockets_read_registered(
+        NativeSafeHandle pInProcessHandler,
+        int dwIndex,
+        delegate* unmanaged<IntPtr, IntPtr, IntPtr, REQUEST_NOTIFICATION_STATUS> pfnCompletionCallback,
+        IntPtr pvCompletionContext,
+        out int dwBytesReceived,
+        [MarshalAs(UnmanagedType.Bool)] out bool fCompletionExpected);
+
+    [LibraryImport(AspNetCoreModuleDll)]
+    private static unsafe partial int http_websockets_write_registered(
+        NativeSafeHandle pInProcessHandler,
+        int dwIndex,
+        int cbData,
+        delegate* unmanaged<IntPtr, IntPtr, IntPtr, REQUEST_NOTIFICATION_STATUS> pfnCompletionCallback,
+        IntPtr pvCompletionContext,
+        [MarshalAs(UnmanagedType.Bool)] out bool fCompletionExpected);
+
     [LibraryImport(AspNetCoreModuleDll)]
     private static partial int http_enable_websockets(NativeSafeHandle pInProcessHandler);
 
@@ -149,6 +284,9 @@ internal static partial class NativeMethods
     [LibraryImport(AspNetCoreModuleDll)]
     private static unsafe partial int http_response_set_unknown_header(NativeSafeHandle pInProcessHandler, byte* pszHeaderName, byte* pszHeaderValue, ushort usHeaderValueLength, [MarshalAs(UnmanagedType.Bool)] bool fReplace);
 
+    [LibraryImport(AspNetCoreModuleDll)]
+    private static unsafe partial int http_response_set_headers(NativeSafeHandle pInProcessHandler, RESPONSE_HEADER* pHeaders, uint cHeaders);
+
     [LibraryImport(AspNetCoreModuleDll)]
     private static unsafe partial int http_has_response4(NativeSafeHandle pInProcessHandler, [MarshalAs(UnmanagedType.Bool)] out bool isResponse4);
 
@@ -161,9 +299,15 @@ internal static partial class NativeMethods
     [LibraryImport(AspNetCoreModuleDll)]
     private static unsafe partial int http_response_set_known_header(NativeSafeHandle pInProcessHandler, int headerId, byte* pHeaderValue, ushort length, [MarshalAs(UnmanagedType.Bool)] bool fReplace);
 
+    [LibraryImport(AspNetCoreModuleDll)]
+    private static partial int http_response_set_kernel_cache_policy(NativeSafeHandle pInProcessHandler, uint dwSecondsToLive, [MarshalAs(UnmanagedType.LPStr)] string? pszVaryByHeaders, [MarshalAs(UnmanagedType.LPStr)] string? pszVaryByQueryStrings);
+
     [LibraryImport(AspNetCoreModuleDll)]
     private static partial int http_get_authentication_information(NativeSafeHandle pInProcessHandler, [MarshalAs(UnmanagedType.BStr)] out string authType, out IntPtr token);
 
+    [LibraryImport(AspNetCoreModuleDll)]
+    private static unsafe partial int http_get_authentication_information_view(NativeSafeHandle pInProcessHandler, out char* pszAuthType, out uint cchAuthType, out IntPtr token);
+
     [LibraryImport(AspNetCoreModuleDll)]
     private static unsafe partial int http_set_startup_error_page_content(byte* content, int contentLength);
 
@@ -189,6 +333,16 @@ internal static partial class NativeMethods
         Validate(register_callbacks(pInProcessApplication, requestCallback, shutdownCallback, disconnectCallback, asyncCallback, requestsDrainedHandler, pvRequestContext, pvShutdownContext));
     }
 
+    // Starts requests with the raw request, connection and request ids, auth type and
+    // TLS info pre-filled. Returns false, and requests keep going through the request
+    // callback, if the module does not know the request info version.
+    internal static unsafe bool HttpTryRegisterRequestInfoCallback(NativeSafeHandle pInProcessApplication,
+        delegate* unmanaged<IntPtr, IntPtr, IntPtr, REQUEST_NOTIFICATION_STATUS> requestInfoCallback,
+        uint dwVersion)
+    {
+        return register_request_info_callback(pInProcessApplication, requestInfoCallback, dwVersion) == HR_OK;
+    }
+
     internal static unsafe int HttpWriteResponseBytes(NativeSafeHandle pInProcessHandler, HTTP_DATA_CHUNK* pDataChunks, int nChunks, out bool fCompletionExpected)
     {
         return http_write_response_bytes(pInProcessHandler, pDataChunks, nChunks, out fCompletionExpected);
@@ -199,9 +353,33 @@ internal static partial class NativeMethods
         return http_flush_response_bytes(pInProcessHandler, fMoreData, out fCompletionExpected);
     }
 
+    // Writes the last chunks and ends the response with one completion, trailers must be set before.
+    internal static unsafe int HttpWriteResponseBytesFinal(NativeSafeHandle pInProcessHandler, HTTP_DATA_CHUNK* pDataChunks, int nChunks, bool fDisconnect, out bool fCompletionExpected)
+    {
+        return http_write_response_bytes_final(pInProcessHandler, pDataChunks, nChunks, fDisconnect, out fCompletionExpected);
+    }
+
     internal static unsafe HTTP_REQUEST_V2* HttpGetRawRequest(NativeSafeHandle pInProcessHandler)
     {
-        return http_get_raw_request(pInProcessHandler);
+        var pExports = FastExports.Table;
+        if (pExports == null)
+        {
+            return http_get_raw_request(pInProcessHandler);
+        }
+
+        var fAddedRef = false;
+        try
+        {
+            pInProcessHandler.DangerousAddRef(ref fAddedRef);
+            return pExports->pfnGetRawRequest(pInProcessHandler.DangerousGetHandle());
+        }
+        finally
+        {
+            if (fAddedRef)
+            {
+                pInProcessHandler.DangerousRelease();
+            }
+        }
     }
 
     public static void HttpStopCallsIntoManaged(NativeSafeHandle pInProcessApplication)
@@ -214,9 +392,43 @@ internal static partial class NativeMethods
         Validate(http_stop_incoming_requests(pInProcessApplication));
     }
 
-    public static void HttpDisableBuffering(NativeSafeHandle pInProcessHandler)
+    // Starts the native counters of the application, returns the block they are published in
+    // for the lifetime of the process. Returns false if the module has none or of another layout.
+    internal static unsafe bool HttpTryGetNativeCounters(NativeSafeHandle pInProcessApplication, out IISNativeCounters* pCounters)
     {
-        Validate(http_disable_buffering(pInProcessHandler));
+        if (http_get_native_counters(pInProcessApplication, out pCounters, out var dwVersion) != HR_OK ||
+            dwVersion != IISNativeCounters.Version ||
+            pCounters->Size < sizeof(IISNativeCounters))
+        {
+            pCounters = null;
+            return false;
+        }
+
+        return true;
+    }
+
+    public static unsafe void HttpDisableBuffering(NativeSafeHandle pInProcessHandler)
+    {
+        var pExports = FastExports.Table;
+        if (pExports == null)
+        {
+            Validate(http_disable_buffering(pInProcessHandler));
+            return;
+        }
+
+        var fAddedRef = false;
+        try
+        {
+            pInProcessHandler.DangerousAddRef(ref fAddedRef);
+            Validate(pExports->pfnDisableBuffering(pInProcessHandler.DangerousGetHandle()));
+        }
+        finally
+        {
+            if (fAddedRef)
+            {
+                pInProcessHandler.DangerousRelease();
+            }
+        }
     }
 
     public static void HttpSetResponseStatusCode(NativeSafeHandle pInProcessHandler, ushort statusCode, string pszReason)
@@ -229,9 +441,26 @@ internal static partial class NativeMethods
         return http_read_request_bytes(pInProcessHandler, pvBuffer, cbBuffer, out dwBytesReceived, out fCompletionExpected);
     }
 
-    public static void HttpGetCompletionInfo(IntPtr pCompletionInfo, out int cbBytes, out int hr)
+    // Fills up to 16 pinned segments in order with one completion, moving on to the next
+    // segment only while the previous one was filled.
+    public static unsafe int HttpReadRequestBytesVectored(NativeSafeHandle pInProcessHandler, byte** ppSegments, int* pcbSegments, int cSegments, out int dwBytesReceived, out bool fCompletionExpected)
     {
-        http_get_completion_info(pCompletionInfo, out cbBytes, out hr);
+        return http_read_request_bytes_vectored(pInProcessHandler, ppSegments, pcbSegments, cSegments, out dwBytesReceived, out fCompletionExpected);
+    }
+
+    public static unsafe void HttpGetCompletionInfo(IntPtr pCompletionInfo, out int cbBytes, out int hr)
+    {
+        var pExports = FastExports.Table;
+        if (pExports == null)
+        {
+            http_get_completion_info(pCompletionInfo, out cbBytes, out hr);
+            return;
+        }
+
+        int cb, status;
+        pExports->pfnGetCompletionInfo(pCompletionInfo, &cb, &status);
+        cbBytes = cb;
+        hr = status;
     }
 
     public static void HttpSetManagedContext(NativeSafeHandle pInProcessHandler, IntPtr pvManagedContext)
@@ -239,8 +468,32 @@ internal static partial class NativeMethods
         Validate(http_set_managed_context(pInProcessHandler, pvManagedContext));
     }
 
-    internal static IISConfigurationData HttpGetApplicationProperties()
+    internal static unsafe IISConfigurationData HttpGetApplicationProperties()
     {
+        if (_stringViewsSupported)
+        {
+            try
+            {
+                IIS_CONFIGURATION_DATA_VIEW view;
+                Validate(http_get_application_properties_view(&view));
+                return new()
+                {
+                    pNativeApplication = view.pNativeApplication,
+                    pwzFullApplicationPath = new string(view.pwzFullApplicationPath, 0, (int)view.cchFullApplicationPath),
+                    pwzVirtualApplicationPath = new string(view.pwzVirtualApplicationPath, 0, (int)view.cchVirtualApplicationPath),
+                    fWindowsAuthEnabled = view.fWindowsAuthEnabled != 0,
+                    fBasicAuthEnabled = view.fBasicAuthEnabled != 0,
+                    fAnonymousAuthEnable = view.fAnonymousAuthEnable != 0,
+                    pwzBindings = new string(view.pwzBindings, 0, (int)view.cchBindings),
+                    maxRequestBodySize = view.maxRequestBodySize
+                };
+            }
+            catch (EntryPointNotFoundException)
+            {
+                _stringViewsSupported = false;
+            }
+        }
+
         Validate(http_get_application_properties(out IISConfigurationData iisConfigurationData));
         return iisConfigurationData;
     }
@@ -250,11 +503,47 @@ internal static partial class NativeMethods
         return http_query_request_property(requestId, propertyId, qualifier, qualifierSize, output, outputSize, bytesReturned, overlapped);
     }
 
-    public static bool HttpTryGetServerVariable(NativeSafeHandle pInProcessHandler, string variableName, out string value)
+    public static unsafe bool HttpTryGetServerVariable(NativeSafeHandle pInProcessHandler, string variableName, out string value)
     {
+        if (_stringViewsSupported)
+        {
+            try
+            {
+                // The value stays with the request, only the managed string is allocated.
+                if (http_get_server_variable_view(pInProcessHandler, variableName, out var pszValue, out var cchValue) != HR_OK)
+                {
+                    value = null!;
+                    return false;
+                }
+
+                value = pszValue == null ? null! : new string(pszValue, 0, (int)cchValue);
+                return true;
+            }
+            catch (EntryPointNotFoundException)
+            {
+                _stringViewsSupported = false;
+            }
+        }
+
         return http_get_server_variable(pInProcessHandler, variableName, out value) == 0;
     }
 
+    // Names are NUL terminated ASCII. Values are NUL terminated in the arena at
+    // pdwOffsets[i], -1 for a variable that is not set. Returns ERROR_INSUFFICIENT_BUFFER
+    // with the size needed in cchRequired if the arena is too small.
+    internal static unsafe int HttpGetServerVariables(
+        NativeSafeHandle pInProcessHandler,
+        byte** ppszVariableNames,
+        int cVariables,
+        char* pwszArena,
+        int cchArena,
+        int* pdwOffsets,
+        int* pcchValues,
+        out int cchRequired)
+    {
+        return http_get_server_variables(pInProcessHandler, ppszVariableNames, cVariables, pwszArena, cchArena, pdwOffsets, pcchValues, out cchRequired);
+    }
+
     public static void HttpSetServerVariable(NativeSafeHandle pInProcessHandler, string variableName, string value)
     {
         Validate(http_set_server_variable(pInProcessHandler, variableName, value));
@@ -282,6 +571,34 @@ internal static partial class NativeMethods
         return http_websockets_write_bytes(pInProcessHandler, pDataChunks, nChunks, pfnCompletionCallback, pvCompletionContext, out fCompletionExpected);
     }
 
+    // The buffers must stay pinned until the request completes.
+    internal static unsafe void HttpWebsocketsRegisterBuffers(NativeSafeHandle pInProcessHandler, byte** ppBuffers, int* pcbBuffers, int cBuffers)
+    {
+        Validate(http_websockets_register_buffers(pInProcessHandler, ppBuffers, pcbBuffers, cBuffers));
+    }
+
+    internal static unsafe int HttpWebsocketsReadRegistered(
+        NativeSafeHandle pInProcessHandler,
+        int dwIndex,
+        delegate* unmanaged<IntPtr, IntPtr, IntPtr, REQUEST_NOTIFICATION_STATUS> pfnCompletionCallback,
+        IntPtr pvCompletionContext,
+        out int dwBytesReceived,
+        out bool fCompletionExpected)
+    {
+        return http_websockets_read_registered(pInProcessHandler, dwIndex, pfnCompletionCallback, pvCompletionContext, out dwBytesReceived, out fCompletionExpected);
+    }
+
+    internal static unsafe int HttpWebsocketsWriteRegistered(
+        NativeSafeHandle pInProcessHandler,
+        int dwIndex,
+        int cbData,
+        delegate* unmanaged<IntPtr, IntPtr, IntPtr, REQUEST_NOTIFICATION_STATUS> pfnCompletionCallback,
+        IntPtr pvCompletionContext,
+        out bool fCompletionExpected)
+    {
+        return http_websockets_write_registered(pInProcessHandler, dwIndex, cbData, pfnCompletionCallback, pvCompletionContext, out fCompletionExpected);
+    }
+
     public static void HttpEnableWebsockets(NativeSafeHandle pInProcessHandler)
     {
         Validate(http_enable_websockets(pInProcessHandler));
@@ -316,13 +633,41 @@ internal static partial class NativeMethods
         Validate(http_response_set_known_header(pInProcessHandler, headerId, pHeaderValue, length, fReplace));
     }
 
+    // Sets all the headers of a response with one call, throws EntryPointNotFoundException
+    // with a module that predates it.
+    public static unsafe void HttpResponseSetHeaders(NativeSafeHandle pInProcessHandler, RESPONSE_HEADER* pHeaders, int cHeaders)
+    {
+        Validate(http_response_set_headers(pInProcessHandler, pHeaders, (uint)cHeaders));
+    }
+
+    // Lets http.sys cache the response in kernel mode for secondsToLive, 0 keeps it out of the cache.
+    // Must be called before the headers are sent, the vary by lists are comma separated.
+    internal static void HttpResponseSetKernelCachePolicy(NativeSafeHandle pInProcessHandler, uint secondsToLive, string? varyByHeaders, string? varyByQueryStrings)
+    {
+        Validate(http_response_set_kernel_cache_policy(pInProcessHandler, secondsToLive, varyByHeaders, varyByQueryStrings));
+    }
+
     internal static void HttpSetNeedGoAway(NativeSafeHandle pInProcessHandler)
     {
         Validate(http_response_set_need_goaway(pInProcessHandler));
     }
 
-    public static void HttpGetAuthenticationInformation(NativeSafeHandle pInProcessHandler, out string authType, out IntPtr token)
+    public static unsafe void HttpGetAuthenticationInformation(NativeSafeHandle pInProcessHandler, out string authType, out IntPtr token)
     {
+        if (_stringViewsSupported)
+        {
+            try
+            {
+                Validate(http_get_authentication_information_view(pInProcessHandler, out var pszAuthType, out var cchAuthType, out token));
+                authType = pszAuthType == null ? null! : new string(pszAuthType, 0, (int)cchAuthType);
+                return;
+            }
+            catch (EntryPointNotFoundException)
+            {
+                _stringViewsSupported = false;
+            }
+        }
+
         Validate(http_get_authentication_information(pInProcessHandler, out authType, out token));
     }
 
@@ -0,0 +1,70 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+using System.Net;
+using System.Net.Http;
+using System.Threading.Tasks;
+using Microsoft.AspNetCore.Server.IIS.FunctionalTests.Utilities;
+using Microsoft.AspNetCore.Server.IntegrationTesting;
+using Microsoft.AspNetCore.Server.IntegrationTesting.IIS;
+using Microsoft.AspNetCore.InternalTesting;
+using Xunit;
+
+#if !IIS_FUNCTIONALS
+using Microsoft.AspNetCore.Server.IIS.FunctionalTests;
+
+#if IISEXPRESS_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.IISExpress.FunctionalTests.OutOfProcess;
+#elif NEWHANDLER_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.NewHandler.FunctionalTests.OutOfProcess;
+#elif NEWSHIM_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.NewShim.FunctionalTests.OutOfProcess;
+#endif
+
+#else
+namespace Microsoft.AspNetCore.Server.IIS.FunctionalTests.OutOfProcess;
+#endif
+
+[Collection(PublishedSitesCollection.Name)]
+public class BackendEjectionTests : IISFunctionalTestBase
+{
+    public BackendEjectionTests(PublishedSitesFixture fixture) : base(fixture)
+    {
+    }
+
+    [ConditionalFact]
+    [RequiresNewHandler]
+    public async Task ProcessFailingHealthChecksReplaced()
+    {
+        var deploymentParameters = Fixture.GetBaseDeploymentParameters(HostingModel.OutOfProcess);
+        deploymentParameters.HandlerSettings["healthCheckPath"] = "/HealthStatus";
+        deploymentParameters.HandlerSettings["healthCheckInterval"] = "500";
+        deploymentParameters.HandlerSettings["healthCheckUnhealthyThreshold"] = "2";
+        var deploymentResult = await DeployAsync(deploymentParameters);
+        var processId = await deploymentResult.HttpClient.GetStringAsync("/ProcessId");
+
+        await deploymentResult.HttpClient.GetAsync("/MakeUnhealthy");
+
+        await deploymentResult.HttpClient.RetryRequestAsync("/ProcessId",
+            async r => r.IsSuccessStatusCode && await r.Content.ReadAsStringAsync() != processId);
+    }
+
+    [ConditionalFact]
+    [RequiresNewHandler]
+    public async Task ProcessFailingRequestsReplaced()
+    {
+        var deploymentParameters = Fixture.GetBaseDeploymentParameters(HostingModel.OutOfProcess);
+        deploymentParameters.HandlerSettings["outlierConsecutiveFailures"] = "2";
+        var deploymentResult = await DeployAsync(deploymentParameters);
+        var processId = await deploymentResult.HttpClient.GetStringAsync("/ProcessId");
+
+        for (var i = 0; i < 2; i++)
+        {
+            var response = await deploymentResult.HttpClient.GetAsync("/SetCustomErorCode?code=500");
+            Assert.Equal(HttpStatusCode.InternalServerError, response.StatusCode);
+        }
+
+        await deploymentResult.HttpClient.RetryRequestAsync("/ProcessId",
+            async r => r.IsSuccessStatusCode && await r.Content.ReadAsStringAsync() != processId);
+    }
+}
@@ -0,0 +1,80 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+using System.Net;
+using System.Net.Http;
+using System.Threading.Tasks;
+using Microsoft.AspNetCore.Server.IIS.FunctionalTests.Utilities;
+using Microsoft.AspNetCore.Server.IntegrationTesting;
+using Microsoft.AspNetCore.Server.IntegrationTesting.IIS;
+using Microsoft.AspNetCore.InternalTesting;
+using Xunit;
+
+#if !IIS_FUNCTIONALS
+using Microsoft.AspNetCore.Server.IIS.FunctionalTests;
+
+#if IISEXPRESS_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.IISExpress.FunctionalTests.OutOfProcess;
+#elif NEWHANDLER_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.NewHandler.FunctionalTests.OutOfProcess;
+#elif NEWSHIM_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.NewShim.FunctionalTests.OutOfProcess;
+#endif
+
+#else
+namespace Microsoft.AspNetCore.Server.IIS.FunctionalTests.OutOfProcess;
+#endif
+
+[Collection(PublishedSitesCollection.Name)]
+public class MaxRequestBodySizeTests : IISFunctionalTestBase
+{
+    public MaxRequestBodySizeTests(PublishedSitesFixture fixture) : base(fixture)
+    {
+    }
+
+    [ConditionalFact]
+    [RequiresNewHandler]
+    public async Task BodyUnderLimitForwarded()
+    {
+        var deploymentResult = await DeployWithMaxRequestBodySizeAsync();
+
+        var response = await deploymentResult.HttpClient.PostAsync("/ReadFullBody", new StringContent(new string('a', 10)));
+
+        Assert.Equal(HttpStatusCode.OK, response.StatusCode);
+        Assert.Equal("Completed", await response.Content.ReadAsStringAsync());
+    }
+
+    [ConditionalFact]
+    [RequiresNewHandler]
+    public async Task ContentLengthOverLimitRejected()
+    {
+        var deploymentResult = await DeployWithMaxRequestBodySizeAsync();
+
+        var response = await deploymentResult.HttpClient.PostAsync("/ReadFullBody", new StringContent(new string('a', 11)));
+
+        Assert.Equal(HttpStatusCode.RequestEntityTooLarge, response.StatusCode);
+    }
+
+    [ConditionalFact]
+    [RequiresNewHandler]
+    public async Task ChunkedBodyOverLimitRejected()
+    {
+        var deploymentResult = await DeployWithMaxRequestBodySizeAsync();
+        var request = new HttpRequestMessage(HttpMethod.Post, "/ReadFullBody")
+        {
+            Content = new StringContent(new string('a', 1000))
+        };
+        request.Headers.TransferEncodingChunked = true;
+
+        var response = await deploymentResult.HttpClient.SendAsync(request);
+
+        Assert.Equal(HttpStatusCode.RequestEntityTooLarge, response.StatusCode);
+    }
+
+    private Task<IISDeploymentResult> DeployWithMaxRequestBodySizeAsync()
+    {
+        var deploymentParameters = Fixture.GetBaseDeploymentParameters(HostingModel.OutOfProcess);
+        deploymentParameters.HandlerSettings["maxRequestBodySize"] = "10";
+        return DeployAsync(deploymentParameters);
+    }
+}
@@ -0,0 +1,89 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+using System.Net;
+using System.Net.Http;
+using System.Threading.Tasks;
+using Microsoft.AspNetCore.Server.IIS.FunctionalTests.Utilities;
+using Microsoft.AspNetCore.Server.IntegrationTesting;
+using Microsoft.AspNetCore.Server.IntegrationTesting.IIS;
+using Microsoft.AspNetCore.InternalTesting;
+using Xunit;
+
+#if !IIS_FUNCTIONALS
+using Microsoft.AspNetCore.Server.IIS.FunctionalTests;
+
+#if IISEXPRESS_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.IISExpress.FunctionalTests.OutOfProcess;
+#elif NEWHANDLER_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.NewHandler.FunctionalTests.OutOfProcess;
+#elif NEWSHIM_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.NewShim.FunctionalTests.OutOfProcess;
+#endif
+
+#else
+namespace Microsoft.AspNetCore.Server.IIS.FunctionalTests.OutOfProcess;
+#endif
+
+[Collection(PublishedSitesCollection.Name)]
+public class RequestBufferingTests : IISFunctionalTestBase
+{
+    public RequestBufferingTests(PublishedSitesFixture fixture) : base(fixture)
+    {
+    }
+
+    [ConditionalFact]
+    [RequiresNewHandler]
+    public async Task BodyLargerThanMemoryLimitSpooledToFile()
+    {
+        var deploymentResult = await DeployWithRequestBufferingAsync();
+
+        var response = await deploymentResult.HttpClient.PostAsync("/RequestBodyLength", new StringContent(new string('a', 1000000)));
+
+        Assert.Equal(HttpStatusCode.OK, response.StatusCode);
+        Assert.Equal("1000000;1000000", await response.Content.ReadAsStringAsync());
+    }
+
+    [ConditionalFact]
+    [RequiresNewHandler]
+    public async Task ChunkedBodyForwardedWithContentLength()
+    {
+        var deploymentResult = await DeployWithRequestBufferingAsync();
+        var request = new HttpRequestMessage(HttpMethod.Post, "/RequestBodyLength")
+        {
+            Content = new StringContent(new string('a', 100000))
+        };
+        request.Headers.TransferEncodingChunked = true;
+
+        var response = await deploymentResult.HttpClient.SendAsync(request);
+
+        Assert.Equal(HttpStatusCode.OK, response.StatusCode);
+        Assert.Equal("100000;100000", await response.Content.ReadAsStringAsync());
+    }
+
+    [ConditionalFact]
+    [RequiresNewHandler]
+    public async Task ChunkedBodyOverMaxSizeRejected()
+    {
+        var deploymentParameters = Fixture.GetBaseDeploymentParameters(HostingModel.OutOfProcess);
+        deploymentParameters.HandlerSettings["requestBufferingMemoryLimit"] = "1024";
+        deploymentParameters.HandlerSettings["requestBufferingMaxSize"] = "4096";
+        var deploymentResult = await DeployAsync(deploymentParameters);
+        var request = new HttpRequestMessage(HttpMethod.Post, "/RequestBodyLength")
+        {
+            Content = new StringContent(new string('a', 10000))
+        };
+        request.Headers.TransferEncodingChunked = true;
+
+        var response = await deploymentResult.HttpClient.SendAsync(request);
+
+        Assert.Equal(HttpStatusCode.RequestEntityTooLarge, response.StatusCode);
+    }
+
+    private Task<IISDeploymentResult> DeployWithRequestBufferingAsync()
+    {
+        var deploymentParameters = Fixture.GetBaseDeploymentParameters(HostingModel.OutOfProcess);
+        deploymentParameters.HandlerSettings["requestBufferingMemoryLimit"] = "1024";
+        return DeployAsync(deploymentParameters);
+    }
+}
@@ -0,0 +1,108 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+using System.Linq;
+using System.Net;
+using System.Net.Http;
+using System.Threading.Tasks;
+using Microsoft.AspNetCore.Server.IIS.FunctionalTests.Utilities;
+using Microsoft.AspNetCore.Server.IntegrationTesting;
+using Microsoft.AspNetCore.Server.IntegrationTesting.IIS;
+using Microsoft.AspNetCore.InternalTesting;
+using Microsoft.Net.Http.Headers;
+using Xunit;
+
+#if !IIS_FUNCTIONALS
+using Microsoft.AspNetCore.Server.IIS.FunctionalTests;
+
+#if IISEXPRESS_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.IISExpress.FunctionalTests.OutOfProcess;
+#elif NEWHANDLER_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.NewHandler.FunctionalTests.OutOfProcess;
+#elif NEWSHIM_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.NewShim.FunctionalTests.OutOfProcess;
+#endif
+
+#else
+namespace Microsoft.AspNetCore.Server.IIS.FunctionalTests.OutOfProcess;
+#endif
+
+[Collection(PublishedSitesCollection.Name)]
+public class ResponseCacheTests : IISFunctionalTestBase
+{
+    public ResponseCacheTests(PublishedSitesFixture fixture) : base(fixture)
+    {
+    }
+
+    [ConditionalFact]
+    [RequiresNewHandler]
+    public async Task CacheableResponseServedFromCache()
+    {
+        var deploymentResult = await DeployWithResponseCacheAsync();
+
+        var first = await deploymentResult.HttpClient.GetAsync("/CacheableResponse?key=hit");
+        var second = await deploymentResult.HttpClient.GetAsync("/CacheableResponse?key=hit");
+
+        Assert.Equal(HttpStatusCode.OK, first.StatusCode);
+        Assert.Equal(HttpStatusCode.OK, second.StatusCode);
+        Assert.Equal(await first.Content.ReadAsStringAsync(), await second.Content.ReadAsStringAsync());
+        Assert.Equal("public, max-age=60", second.Headers.CacheControl.ToString());
+    }
+
+    [ConditionalFact]
+    [RequiresNewHandler]
+    public async Task NoCacheRequestNotServedFromCache()
+    {
+        var deploymentResult = await DeployWithResponseCacheAsync();
+
+        var first = await deploymentResult.HttpClient.GetStringAsync("/CacheableResponse?key=nocache");
+        var request = new HttpRequestMessage(HttpMethod.Get, "/CacheableResponse?key=nocache");
+        request.Headers.TryAddWithoutValidation(HeaderNames.CacheControl, "no-cache");
+        var second = await deploymentResult.HttpClient.SendAsync(request);
+
+        Assert.NotEqual(first, await second.Content.ReadAsStringAsync());
+    }
+
+    [ConditionalFact]
+    [RequiresNewHandler]
+    public async Task CachedResponseVariesOnRequestHeader()
+    {
+        var deploymentResult = await DeployWithResponseCacheAsync();
+
+        var english = await GetWithLanguageAsync(deploymentResult, "en");
+
+        Assert.Equal(english, await GetWithLanguageAsync(deploymentResult, "en"));
+        Assert.NotEqual(english, await GetWithLanguageAsync(deploymentResult, "fr"));
+    }
+
+    [ConditionalFact]
+    [RequiresNewHandler]
+    public async Task ConcurrentMissesForwardedOnce()
+    {
+        var deploymentResult = await DeployWithResponseCacheAsync();
+        await deploymentResult.HttpClient.GetStringAsync("/HelloWorld");
+
+        var requests = Enumerable.Range(0, 5)
+            .Select(_ => deploymentResult.HttpClient.GetStringAsync("/SlowCacheableResponse?key=coalesce"))
+            .ToArray();
+        var bodies = await Task.WhenAll(requests);
+
+        Assert.Single(bodies.Distinct());
+    }
+
+    private static async Task<string> GetWithLanguageAsync(IISDeploymentResult deploymentResult, string language)
+    {
+        var request = new HttpRequestMessage(HttpMethod.Get, "/CacheableResponse?key=vary");
+        request.Headers.TryAddWithoutValidation(HeaderNames.AcceptLanguage, language);
+        var response = await deploymentResult.HttpClient.SendAsync(request);
+        Assert.Equal(HttpStatusCode.OK, response.StatusCode);
+        return await response.Content.ReadAsStringAsync();
+    }
+
+    private Task<IISDeploymentResult> DeployWithResponseCacheAsync()
+    {
+        var deploymentParameters = Fixture.GetBaseDeploymentParameters(HostingModel.OutOfProcess);
+        deploymentParameters.HandlerSettings["responseCacheSize"] = "1048576";
+        return DeployAsync(deploymentParameters);
+    }
+}
@@ -0,0 +1,71 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+using System.Net;
+using System.Net.Http;
+using System.Threading.Tasks;
+using Microsoft.AspNetCore.Server.IIS.FunctionalTests.Utilities;
+using Microsoft.AspNetCore.Server.IntegrationTesting;
+using Microsoft.AspNetCore.Server.IntegrationTesting.IIS;
+using Microsoft.AspNetCore.InternalTesting;
+using Xunit;
+
+#if !IIS_FUNCTIONALS
+using Microsoft.AspNetCore.Server.IIS.FunctionalTests;
+
+#if IISEXPRESS_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.IISExpress.FunctionalTests.OutOfProcess;
+#elif NEWHANDLER_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.NewHandler.FunctionalTests.OutOfProcess;
+#elif NEWSHIM_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.NewShim.FunctionalTests.OutOfProcess;
+#endif
+
+#else
+namespace Microsoft.AspNetCore.Server.IIS.FunctionalTests.OutOfProcess;
+#endif
+
+[Collection(PublishedSitesCollection.Name)]
+public class ResponseSpoolingTests : IISFunctionalTestBase
+{
+    public ResponseSpoolingTests(PublishedSitesFixture fixture) : base(fixture)
+    {
+    }
+
+    [ConditionalTheory]
+    [RequiresNewHandler]
+    [InlineData(100)]
+    [InlineData(1000000)]
+    public async Task SpooledResponseSentWhole(int length)
+    {
+        var deploymentResult = await DeployWithResponseSpoolingAsync(maxSize: null);
+
+        var response = await deploymentResult.HttpClient.GetAsync($"/LargeResponseBody?length={length}");
+
+        Assert.Equal(HttpStatusCode.OK, response.StatusCode);
+        Assert.Equal(new string('a', length), await response.Content.ReadAsStringAsync());
+    }
+
+    [ConditionalFact]
+    [RequiresNewHandler]
+    public async Task ResponseOverMaxSizeForwardedWhole()
+    {
+        var deploymentResult = await DeployWithResponseSpoolingAsync(maxSize: "65536");
+
+        var response = await deploymentResult.HttpClient.GetAsync("/LargeResponseBody?length=1000000");
+
+        Assert.Equal(HttpStatusCode.OK, response.StatusCode);
+        Assert.Equal(new string('a', 1000000), await response.Content.ReadAsStringAsync());
+    }
+
+    private Task<IISDeploymentResult> DeployWithResponseSpoolingAsync(string maxSize)
+    {
+        var deploymentParameters = Fixture.GetBaseDeploymentParameters(HostingModel.OutOfProcess);
+        deploymentParameters.HandlerSettings["responseSpoolingMemoryLimit"] = "4096";
+        if (maxSize != null)
+        {
+            deploymentParameters.HandlerSettings["responseSpoolingMaxSize"] = maxSize;
+        }
+        return DeployAsync(deploymentParameters);
+    }
+}
@@ -0,0 +1,66 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+using System.Net;
+using System.Net.Http;
+using System.Threading.Tasks;
+using Microsoft.AspNetCore.Server.IIS.FunctionalTests.Utilities;
+using Microsoft.AspNetCore.Server.IntegrationTesting;
+using Microsoft.AspNetCore.Server.IntegrationTesting.IIS;
+using Microsoft.AspNetCore.InternalTesting;
+using Xunit;
+
+#if !IIS_FUNCTIONALS
+using Microsoft.AspNetCore.Server.IIS.FunctionalTests;
+
+#if IISEXPRESS_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.IISExpress.FunctionalTests.OutOfProcess;
+#elif NEWHANDLER_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.NewHandler.FunctionalTests.OutOfProcess;
+#elif NEWSHIM_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.NewShim.FunctionalTests.OutOfProcess;
+#endif
+
+#else
+namespace Microsoft.AspNetCore.Server.IIS.FunctionalTests.OutOfProcess;
+#endif
+
+[Collection(PublishedSitesCollection.Name)]
+public class RetryTests : IISFunctionalTestBase
+{
+    public RetryTests(PublishedSitesFixture fixture) : base(fixture)
+    {
+    }
+
+    [ConditionalFact]
+    [RequiresNewHandler]
+    public async Task SafeRequestRetriedWhenConnectionLost()
+    {
+        var deploymentResult = await DeployWithRetriesAsync();
+
+        var response = await deploymentResult.HttpClient.GetAsync("/AbortFirstAttempt?key=get");
+
+        Assert.Equal(HttpStatusCode.OK, response.StatusCode);
+        Assert.Equal("Succeeded", await response.Content.ReadAsStringAsync());
+        Assert.Equal("2", await deploymentResult.HttpClient.GetStringAsync("/AttemptCount?key=get"));
+    }
+
+    [ConditionalFact]
+    [RequiresNewHandler]
+    public async Task UnsafeRequestNotRetriedWhenConnectionLost()
+    {
+        var deploymentResult = await DeployWithRetriesAsync();
+
+        var response = await deploymentResult.HttpClient.SendAsync(new HttpRequestMessage(HttpMethod.Put, "/AbortFirstAttempt?key=put"));
+
+        Assert.Equal(HttpStatusCode.BadGateway, response.StatusCode);
+        Assert.Equal("1", await deploymentResult.HttpClient.GetStringAsync("/AttemptCount?key=put"));
+    }
+
+    private Task<IISDeploymentResult> DeployWithRetriesAsync()
+    {
+        var deploymentParameters = Fixture.GetBaseDeploymentParameters(HostingModel.OutOfProcess);
+        deploymentParameters.HandlerSettings["idempotentRequestRetries"] = "1";
+        return DeployAsync(deploymentParameters);
+    }
+}
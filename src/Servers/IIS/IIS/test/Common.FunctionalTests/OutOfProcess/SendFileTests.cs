@@ -0,0 +1,82 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+using System.IO;
+using System.Net;
+using System.Net.Http;
+using System.Threading.Tasks;
+using Microsoft.AspNetCore.Server.IIS.FunctionalTests.Utilities;
+using Microsoft.AspNetCore.Server.IntegrationTesting;
+using Microsoft.AspNetCore.Server.IntegrationTesting.IIS;
+using Microsoft.AspNetCore.InternalTesting;
+using Xunit;
+
+#if !IIS_FUNCTIONALS
+using Microsoft.AspNetCore.Server.IIS.FunctionalTests;
+
+#if IISEXPRESS_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.IISExpress.FunctionalTests.OutOfProcess;
+#elif NEWHANDLER_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.NewHandler.FunctionalTests.OutOfProcess;
+#elif NEWSHIM_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.NewShim.FunctionalTests.OutOfProcess;
+#endif
+
+#else
+namespace Microsoft.AspNetCore.Server.IIS.FunctionalTests.OutOfProcess;
+#endif
+
+[Collection(PublishedSitesCollection.Name)]
+public class SendFileTests : IISFunctionalTestBase
+{
+    public SendFileTests(PublishedSitesFixture fixture) : base(fixture)
+    {
+    }
+
+    [ConditionalFact]
+    [RequiresNewHandler]
+    public async Task FileUnderSendFileRootSent()
+    {
+        var deploymentResult = await DeployWithSendFileRootAsync();
+        File.WriteAllText(Path.Combine(deploymentResult.ContentRoot, "wwwroot", "sent.txt"), "Sent file");
+
+        var response = await deploymentResult.HttpClient.GetAsync("/SendFile?path=sent.txt");
+
+        Assert.Equal(HttpStatusCode.OK, response.StatusCode);
+        Assert.Equal("Sent file", await response.Content.ReadAsStringAsync());
+        Assert.False(response.Headers.Contains("X-Sendfile"));
+    }
+
+    [ConditionalTheory]
+    [RequiresNewHandler]
+    [InlineData("..\\web.config")]
+    [InlineData("\\Windows\\win.ini")]
+    [InlineData("C:web.config")]
+    public async Task PathOutsideSendFileRootRejected(string path)
+    {
+        var deploymentResult = await DeployWithSendFileRootAsync();
+
+        var response = await deploymentResult.HttpClient.GetAsync("/SendFile?path=" + WebUtility.UrlEncode(path));
+
+        Assert.Equal(HttpStatusCode.BadGateway, response.StatusCode);
+    }
+
+    [ConditionalFact]
+    [RequiresNewHandler]
+    public async Task FullPathOutsideSendFileRootRejected()
+    {
+        var deploymentResult = await DeployWithSendFileRootAsync();
+        var path = Path.Combine(deploymentResult.ContentRoot, "web.config");
+
+        var response = await deploymentResult.HttpClient.GetAsync("/SendFile?path=" + WebUtility.UrlEncode(path));
+
+        Assert.Equal(HttpStatusCode.BadGateway, response.StatusCode);
+    }
+
+    private Task<IISDeploymentResult> DeployWithSendFileRootAsync()
+    {
+        var deploymentParameters = Fixture.GetBaseDeploymentParameters(HostingModel.OutOfProcess);
+        deploymentParameters.HandlerSettings["sendFileRoot"] = "wwwroot";
+        return DeployAsync(deploymentParameters);
+    }
+}
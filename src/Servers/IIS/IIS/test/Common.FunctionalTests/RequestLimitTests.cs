@@ -0,0 +1,76 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+
+using System;
+using System.Linq;
+using System.Net;
+using System.Net.Http;
+using System.Threading;
+using System.Threading.Tasks;
+using Microsoft.AspNetCore.Server.IIS.FunctionalTests.Utilities;
+using Microsoft.AspNetCore.Server.IntegrationTesting;
+using Microsoft.AspNetCore.Server.IntegrationTesting.IIS;
+using Microsoft.AspNetCore.InternalTesting;
+using Xunit;
+
+#if !IIS_FUNCTIONALS
+using Microsoft.AspNetCore.Server.IIS.FunctionalTests;
+
+#if IISEXPRESS_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.IISExpress.FunctionalTests;
+#elif NEWHANDLER_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.NewHandler.FunctionalTests;
+#elif NEWSHIM_FUNCTIONALS
+namespace Microsoft.AspNetCore.Server.IIS.NewShim.FunctionalTests;
+#endif
+
+#else
+namespace Microsoft.AspNetCore.Server.IIS.FunctionalTests;
+#endif
+
+[Collection(PublishedSitesCollection.Name)]
+public class RequestLimitTests : IISFunctionalTestBase
+{
+    public RequestLimitTests(PublishedSitesFixture fixture) : base(fixture)
+    {
+    }
+
+    [ConditionalFact]
+    [RequiresNewShim]
+    public async Task RequestsOverRateLimitRejected()
+    {
+        var deploymentParameters = Fixture.GetBaseDeploymentParameters();
+        deploymentParameters.HandlerSettings["rateLimitRequestsPerSecond"] = "1";
+        deploymentParameters.HandlerSettings["rateLimitBurst"] = "1";
+        var deploymentResult = await DeployAsync(deploymentParameters);
+        await deploymentResult.HttpClient.GetAsync("/HelloWorld");
+
+        var responses = await Task.WhenAll(Enumerable.Range(0, 3).Select(_ => deploymentResult.HttpClient.GetAsync("/HelloWorld")));
+
+        var rejected = responses.First(r => r.StatusCode == HttpStatusCode.TooManyRequests);
+        Assert.Equal(TimeSpan.FromSeconds(1), rejected.Headers.RetryAfter.Delta);
+        Assert.Empty(await rejected.Content.ReadAsStringAsync());
+    }
+
+    [ConditionalFact]
+    [RequiresNewShim]
+    public async Task RequestsOverActiveLimitRejected()
+    {
+        var deploymentParameters = Fixture.GetBaseDeploymentParameters();
+        deploymentParameters.HandlerSettings["maxActiveRequests"] = "1";
+        var deploymentResult = await DeployAsync(deploymentParameters);
+        await deploymentResult.HttpClient.GetAsync("/HelloWorld");
+
+        using (var cts = new CancellationTokenSource())
+        {
+            var waitingRequest = deploymentResult.HttpClient.GetAsync("/WaitForAbort", cts.Token);
+
+            await deploymentResult.HttpClient.RetryRequestAsync("/HelloWorld", r => r.StatusCode == HttpStatusCode.ServiceUnavailable);
+
+            cts.Cancel();
+            await Assert.ThrowsAnyAsync<OperationCanceledException>(() => waitingRequest);
+        }
+
+        await deploymentResult.HttpClient.RetryRequestAsync("/HelloWorld", r => r.IsSuccessStatusCode);
+    }
+}
@@ -2,6 +2,7 @@
 // The .NET Foundation licenses this file to you under the MIT license.
 
 using System;
+using System.Collections.Concurrent;
 using System.Collections.Generic;
 using System.Diagnostics;
 using System.Globalization;
@@ -171,6 +172,46 @@ public partial class Startup
         await context.Response.WriteAsync(_waitingRequestCount.ToString(CultureInfo.InvariantCulture));
     }
 
+    private static readonly ConcurrentDictionary<string, int> _attempts = new ConcurrentDictionary<string, int>();
+
+    public Task AbortFirstAttempt(HttpContext context)
+    {
+        if (_attempts.AddOrUpdate(context.Request.Query["key"], 1, (_, count) => count + 1) == 1)
+        {
+            context.Abort();
+            return Task.CompletedTask;
+        }
+
+        return context.Response.WriteAsync("Succeeded");
+    }
+
+    public async Task AttemptCount(HttpContext context)
+    {
+        _attempts.TryGetValue(context.Request.Query["key"], out var count);
+        await context.Response.WriteAsync(count.ToString(CultureInfo.InvariantCulture));
+    }
+
+    private static int _cacheableResponseCount;
+
+    public async Task CacheableResponse(HttpContext context)
+    {
+        context.Response.Headers[HeaderNames.CacheControl] = "public, max-age=60";
+        context.Response.Headers[HeaderNames.Vary] = HeaderNames.AcceptLanguage;
+        await context.Response.WriteAsync(Interlocked.Increment(ref _cacheableResponseCount).ToString(CultureInfo.InvariantCulture));
+    }
+
+    public async Task SlowCacheableResponse(HttpContext context)
+    {
+        await Task.Delay(500);
+        await CacheableResponse(context);
+    }
+
+    public Task SendFile(HttpContext context)
+    {
+        context.Response.Headers["X-Sendfile"] = context.Request.Query["path"];
+        return Task.CompletedTask;
+    }
+
     public Task CreateFile(HttpContext context)
     {
 #if FORWARDCOMPAT
@@ -580,6 +621,19 @@ public partial class Startup
     }
 
     private int _requestsInFlight = 0;
+    private async Task RequestBodyLength(HttpContext ctx)
+    {
+        var readBuffer = new byte[4096];
+        var length = 0;
+        int result;
+        while ((result = await ctx.Request.Body.ReadAsync(readBuffer, 0, readBuffer.Length)) != 0)
+        {
+            length += result;
+        }
+
+        await ctx.Response.WriteAsync($"{ctx.Request.ContentLength};{length}");
+    }
+
     private async Task ReadAndCountRequestBody(HttpContext ctx)
     {
         Interlocked.Increment(ref _requestsInFlight);
@@ -1127,6 +1181,20 @@ public partial class Startup
         await context.Response.WriteAsync(Environment.ProcessId.ToString(CultureInfo.InvariantCulture));
     }
 
+    private static bool _unhealthy;
+
+    public Task MakeUnhealthy(HttpContext context)
+    {
+        _unhealthy = true;
+        return Task.CompletedTask;
+    }
+
+    public Task HealthStatus(HttpContext context)
+    {
+        context.Response.StatusCode = _unhealthy ? 500 : 200;
+        return Task.CompletedTask;
+    }
+
     public async Task ANCM_HTTPS_PORT(HttpContext context)
     {
         var httpsPort = context.RequestServices.GetService<IConfiguration>().GetValue<int?>("ANCM_HTTPS_PORT");
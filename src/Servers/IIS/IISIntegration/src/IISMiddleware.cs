@@ -24,6 +24,7 @@ public class IISMiddleware
     private const string MSAspNetCoreToken = "MS-ASPNETCORE-TOKEN";
     private const string MSAspNetCoreEvent = "MS-ASPNETCORE-EVENT";
     private const string MSAspNetCoreWinAuthToken = "MS-ASPNETCORE-WINAUTHTOKEN";
+    private const string MSAspNetCoreWinAuthTokenCached = "MS-ASPNETCORE-WINAUTHTOKEN-CACHED";
     private const string ANCMShutdownEventHeaderValue = "shutdown";
     private static readonly PathString ANCMRequestPath = new PathString("/iisintegration");
     private static readonly Func<object, Task> ClearUserDelegate = ClearUser;
@@ -171,6 +172,14 @@ public class IISMiddleware
     {
         var tokenHeader = context.Request.Headers[MSAspNetCoreWinAuthToken];
 
+        // The module keeps a cached handle open for the later requests of the connection.
+        var isCached = false;
+        if (StringValues.IsNullOrEmpty(tokenHeader))
+        {
+            tokenHeader = context.Request.Headers[MSAspNetCoreWinAuthTokenCached];
+            isCached = true;
+        }
+
         if (!StringValues.IsNullOrEmpty(tokenHeader)
             && int.TryParse(tokenHeader, NumberStyles.HexNumber, CultureInfo.InvariantCulture, out var hexHandle))
         {
@@ -179,7 +188,10 @@ public class IISMiddleware
             var winIdentity = new WindowsIdentity(handle, IISDefaults.AuthenticationScheme);
 
             // WindowsIdentity just duplicated the handle so we need to close the original.
-            NativeMethods.CloseHandle(handle);
+            if (!isCached)
+            {
+                NativeMethods.CloseHandle(handle);
+            }
 
             context.Response.OnCompleted(ClearUserDelegate, context);
             context.Response.RegisterForDispose(winIdentity);